@@ -41,6 +41,9 @@ AmqpInboundChannelAdapterInstance::AmqpInboundChannelAdapterInstance() :
 	_receiveTimeoutProp(1000),
 	_recoveryIntervalProp(5000),
 	_txSizeProp(1),
+	_maxPrefetchCountProp(0),
+	_ackBatchSizeProp(1),
+	_ackBatchTimeProp(0),
 	CAF_CM_INIT_LOG("AmqpInboundChannelAdapterInstance") {
 }
 
@@ -124,6 +127,18 @@ void AmqpInboundChannelAdapterInstance::initialize(
 	if (prop.length()) {
 		_txSizeProp = CStringConv::fromString<uint32>(prop);
 	}
+	prop = configSection->findOptionalAttribute("max-prefetch-count");
+	if (prop.length()) {
+		_maxPrefetchCountProp = CStringConv::fromString<uint32>(prop);
+	}
+	prop = configSection->findOptionalAttribute("ack-batch-size");
+	if (prop.length()) {
+		_ackBatchSizeProp = CStringConv::fromString<uint32>(prop);
+	}
+	prop = configSection->findOptionalAttribute("ack-batch-time");
+	if (prop.length()) {
+		_ackBatchTimeProp = CStringConv::fromString<uint32>(prop);
+	}
 
 	_isInitialized = true;
 }
@@ -201,6 +216,9 @@ void AmqpInboundChannelAdapterInstance::wire(
 	_listenerContainer->setReceiveTimeout(_receiveTimeoutProp);
 	_listenerContainer->setRecoveryInterval(_recoveryIntervalProp);
 	_listenerContainer->setTxSize(_txSizeProp);
+	_listenerContainer->setMaxPrefetchCount(_maxPrefetchCountProp);
+	_listenerContainer->setAckBatchSize(_ackBatchSizeProp);
+	_listenerContainer->setAckBatchTime(_ackBatchTimeProp);
 	_listenerContainer->setMessagerListener(listenerSource);
 	_listenerContainer->init();
 
@@ -45,7 +45,10 @@ namespace Caf { namespace AmqpIntegration {
  * 	prefetch-count="100"
  * 	receive-timeout="5000"
  * 	recovery-interval="15000"
- * 	tx-size="25" />
+ * 	tx-size="25"
+ * 	max-prefetch-count="400"
+ * 	ack-batch-size="50"
+ * 	ack-batch-time="250" />
  *
  * <rabbit-inbound-channel-adapter
  * 	id="inboundAmqp"
@@ -80,6 +83,9 @@ namespace Caf { namespace AmqpIntegration {
  * <tr><td>receive-timeout</td><td><b>optional</b> Receive timeout in milliseconds.  Defaults to 1000.</td></tr>
  * <tr><td>recovery-interval</td><td><b>optional</b> Specifies the interval between broker connection recovery attempts in milliseconds.  Defaults to 5000.</td></tr>
  * <tr><td>tx-size</td><td><b>optional</b> Tells the adapter how many messages to process in a single batch.  This should be less than or equal to to prefetch-count. Defaults to 1.</td></tr>
+ * <tr><td>max-prefetch-count</td><td><b>optional</b> Lets the prefetch count grow up to this value while messages are handled quickly, and shrink back to prefetch-count when they are not. Defaults to 0, meaning the prefetch count stays fixed.</td></tr>
+ * <tr><td>ack-batch-size</td><td><b>optional</b> Tells the adapter how many handled messages to acknowledge at once.  Pending acknowledgements are always sent once no more messages are arriving. Defaults to 1.</td></tr>
+ * <tr><td>ack-batch-time</td><td><b>optional</b> The longest time in milliseconds an acknowledgement is held back to batch it with others. Defaults to 0.</td></tr>
  * </table>
  */
 class AmqpInboundChannelAdapterInstance :
@@ -148,6 +154,9 @@ private:
 	uint32 _receiveTimeoutProp;
 	uint32 _recoveryIntervalProp;
 	uint32 _txSizeProp;
+	uint32 _maxPrefetchCountProp;
+	uint32 _ackBatchSizeProp;
+	uint32 _ackBatchTimeProp;
 
 	CAF_CM_CREATE;
 	CAF_CM_CREATE_LOG;
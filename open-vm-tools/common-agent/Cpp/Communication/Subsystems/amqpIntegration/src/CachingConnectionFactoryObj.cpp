@@ -58,6 +58,12 @@ void CachingConnectionFactoryObj::initializeBean(
 	const std::string channelCacheSize = UriUtils::findOptParameter(uri, "channel_cache_size",
 			CStringConv::toString<uint32>(
 					AppConfigUtils::getRequiredUint32("communication_amqp", "channel_cache_size")));
+	const std::string channelIdleTimeout = UriUtils::findOptParameter(uri, "channel_idle_timeout",
+			CStringConv::toString<uint32>(
+					AppConfigUtils::getOptionalUint32("communication_amqp", "channel_idle_timeout")));
+	const std::string channelCachePrewarm = UriUtils::findOptParameter(uri, "channel_cache_prewarm",
+			CStringConv::toString<uint32>(
+					AppConfigUtils::getOptionalUint32("communication_amqp", "channel_cache_prewarm")));
 
 	CAF_CM_VALIDATE_STRING(uri.protocol);
 	CAF_CM_VALIDATE_STRING(uri.host);
@@ -90,6 +96,12 @@ void CachingConnectionFactoryObj::initializeBean(
 	if (!channelCacheSize.empty()) {
 		factory->setChannelCacheSize(CStringConv::fromString<uint32>(channelCacheSize));
 	}
+	if (!channelIdleTimeout.empty()) {
+		factory->setChannelIdleTimeout(CStringConv::fromString<uint32>(channelIdleTimeout));
+	}
+	if (!channelCachePrewarm.empty()) {
+		factory->setChannelCachePrewarm(CStringConv::fromString<uint32>(channelCachePrewarm));
+	}
 
 	_factory = factory;
 }
@@ -56,6 +56,12 @@ namespace Caf { namespace AmqpIntegration {
  * to wait indefinitely. By default 10 seconds.</td></tr>
  * <tr><td>channelCacheSize</td>
  * <td>The number of channels to cache. By default 1.</td></tr>
+ * <tr><td>channelIdleTimeout</td>
+ * <td>Milliseconds a cached channel may stay unused before it is closed.
+ * By default 0 (never).</td></tr>
+ * <tr><td>channelCachePrewarm</td>
+ * <td>The number of channels opened as soon as the connection is established.
+ * By default 0.</td></tr>
  * </table>
  */
 class CachingConnectionFactoryObj :
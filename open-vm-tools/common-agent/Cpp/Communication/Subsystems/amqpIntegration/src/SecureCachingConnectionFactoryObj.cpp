@@ -66,6 +66,12 @@ void SecureCachingConnectionFactoryObj::initializeBean(
 	const std::string channelCacheSize = UriUtils::findOptParameter(uri, "channel_cache_size",
 			CStringConv::toString<uint32>(
 					AppConfigUtils::getRequiredUint32("communication_amqp", "channel_cache_size")));
+	const std::string channelIdleTimeout = UriUtils::findOptParameter(uri, "channel_idle_timeout",
+			CStringConv::toString<uint32>(
+					AppConfigUtils::getOptionalUint32("communication_amqp", "channel_idle_timeout")));
+	const std::string channelCachePrewarm = UriUtils::findOptParameter(uri, "channel_cache_prewarm",
+			CStringConv::toString<uint32>(
+					AppConfigUtils::getOptionalUint32("communication_amqp", "channel_cache_prewarm")));
 
 	const std::deque<std::string> tlsCertPathCollectionInner = tlsCertPathCollection->getCertPath();
 	CAF_CM_VALIDATE_STL(tlsCertPathCollectionInner);
@@ -109,6 +115,12 @@ void SecureCachingConnectionFactoryObj::initializeBean(
 	if (! channelCacheSize.empty()) {
 		factory->setChannelCacheSize(CStringConv::fromString<uint32>(channelCacheSize));
 	}
+	if ( !channelIdleTimeout.empty()) {
+		factory->setChannelIdleTimeout(CStringConv::fromString<uint32>(channelIdleTimeout));
+	}
+	if ( !channelCachePrewarm.empty()) {
+		factory->setChannelCachePrewarm(CStringConv::fromString<uint32>(channelCachePrewarm));
+	}
 
 	_factory = factory;
 }
@@ -131,6 +131,14 @@ public: // Basic
 			const uint64 deliveryTag,
 			const bool requeue);
 
+	AmqpMethods::Confirm::SmartPtrSelectOk confirmSelect(
+			const uint32 maxUnconfirmed);
+
+	bool waitForConfirms(
+			const uint32 timeoutMs);
+
+	uint64 getNextPublishSeqNo();
+
 public: // Exchange
 	AmqpMethods::Exchange::SmartPtrDeclareOk exchangeDeclare(
 		const std::string& exchange,
@@ -200,6 +208,13 @@ private:
 
 	void callReturnListeners(const SmartPtrAMQCommand& command);
 
+	void waitForConfirmWindow();
+
+	void handleConfirm(
+			const uint64 deliveryTag,
+			const bool multiple,
+			const bool isNack);
+
 private:
 	/*
 	 * This class hooks the channel into the worker service
@@ -236,6 +251,7 @@ private:
 private:
 	static const uint8 DEBUGLOG_FLAG_ENTRYEXIT;
 	static const uint8 DEBUGLOG_FLAG_AMQP;
+	static const uint32 CONFIRM_WAIT_SLICE_MS;
 
 	bool _isInitialized;
 	volatile bool _isOpen;
@@ -250,6 +266,16 @@ private:
 	SmartPtrCAutoMutex _channelMutex;
 	CThreadSignal _channelSignal;
 
+	// Publisher confirm state. Guarded by _confirmMutex which, when both
+	// are held, is always taken after the class lock.
+	SmartPtrCAutoMutex _confirmMutex;
+	CThreadSignal _confirmSignal;
+	volatile bool _isConfirmMode;
+	uint32 _maxUnconfirmed;
+	uint64 _nextPublishSeqNo;
+	std::set<uint64> _unconfirmedSet;
+	bool _isNacked;
+
 	typedef std::deque<SmartPtrReturnListener> ReturnListenerCollection;
 	typedef TCopyOnWriteContainer<ReturnListenerCollection> CowReturnListenerCollection;
 	CowReturnListenerCollection _returnListeners;
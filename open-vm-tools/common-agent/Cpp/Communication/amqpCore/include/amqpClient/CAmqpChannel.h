@@ -80,6 +80,8 @@ public:
 			const uint16 prefetchCount,
 			bool global);
 
+	AMQPStatus confirmSelect();
+
 	AMQPStatus exchangeDeclare(
 			const std::string& exchange,
 			const std::string& type,
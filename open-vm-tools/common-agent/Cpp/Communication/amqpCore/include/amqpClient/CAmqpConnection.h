@@ -141,6 +141,9 @@ public:
 			const uint16 prefetchCount,
 			const bool global);
 
+	AMQPStatus confirmSelect(
+			const amqp_channel_t& channel);
+
 	AMQPStatus exchangeDeclare(
 			const amqp_channel_t& channel,
 			const std::string& exchange,
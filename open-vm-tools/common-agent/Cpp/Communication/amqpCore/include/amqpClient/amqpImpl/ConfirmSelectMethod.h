@@ -0,0 +1,44 @@
+/*
+ *  Copyright (C) 2012-2016 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+#ifndef CONFIRMSELECTMETHOD_H_
+#define CONFIRMSELECTMETHOD_H_
+
+
+#include "amqpClient/amqpImpl/IServerMethod.h"
+
+#include "amqpClient/CAmqpChannel.h"
+
+namespace Caf { namespace AmqpClient {
+/**
+ * @ingroup AmqpApiImpl
+ * @remark LIBRARY IMPLEMENTATION - NOT PART OF THE PUBLIC API
+ * @brief Implementation of AMQP confirm.select
+ */
+class ConfirmSelectMethod : public IServerMethod {
+public:
+	ConfirmSelectMethod();
+	virtual ~ConfirmSelectMethod();
+
+	/**
+	 * @brief Initialize the method
+	 */
+	void init();
+
+public: // IServerMethod
+	std::string getMethodName() const;
+
+	AMQPStatus send(const SmartPtrCAmqpChannel& channel);
+
+private:
+	bool _isInitialized;
+	CAF_CM_CREATE;
+	CAF_CM_DECLARE_NOCOPY(ConfirmSelectMethod);
+
+};
+CAF_DECLARE_SMART_POINTER(ConfirmSelectMethod);
+
+}}
+
+#endif /* CONFIRMSELECTMETHOD_H_ */
@@ -144,6 +144,44 @@ struct __declspec(novtable) QosOk : public Method {
 };
 CAF_DECLARE_SMART_INTERFACE_POINTER(QosOk);
 
+/**
+ * @ingroup AmqpApi
+ * @brief Interface representing the basic.ack method parameters sent by the
+ * server to confirm published messages
+ */
+struct __declspec(novtable) Ack : public Method {
+	CAF_DECL_UUID("263E67DE-AD66-4980-86C4-93FD7D7A1143")
+
+	/** @return the publish sequence number being confirmed */
+	virtual uint64 getDeliveryTag() = 0;
+
+	/**
+	 * @retval true if all messages up to and including the tag are confirmed
+	 * @retval false if only the message with the tag is confirmed
+	 */
+	virtual bool getMultiple() = 0;
+};
+CAF_DECLARE_SMART_INTERFACE_POINTER(Ack);
+
+/**
+ * @ingroup AmqpApi
+ * @brief Interface representing the basic.nack method parameters sent by the
+ * server for published messages it could not handle
+ */
+struct __declspec(novtable) Nack : public Method {
+	CAF_DECL_UUID("9BC305DB-19F4-4E65-A231-73B62F96C2A2")
+
+	/** @return the publish sequence number being rejected */
+	virtual uint64 getDeliveryTag() = 0;
+
+	/**
+	 * @retval true if all messages up to and including the tag are rejected
+	 * @retval false if only the message with the tag is rejected
+	 */
+	virtual bool getMultiple() = 0;
+};
+CAF_DECLARE_SMART_INTERFACE_POINTER(Nack);
+
 } // namespace Basic
 #endif
 
@@ -294,6 +332,25 @@ CAF_DECLARE_SMART_INTERFACE_POINTER(UnbindOk);
 } // namespace Queue
 #endif
 
+#if (1) // confirm
+/**
+ * @ingroup AmqpApi
+ * @brief AMQP Confirm methods
+ */
+namespace Confirm {
+
+/**
+ * @ingroup AmqpApi
+ * @brief Interface representing the confirm.select-ok method
+ */
+struct __declspec(novtable) SelectOk : public Method {
+	CAF_DECL_UUID("759E6A66-4229-42D1-9D72-388649B87116")
+};
+CAF_DECLARE_SMART_INTERFACE_POINTER(SelectOk);
+
+} // namespace Confirm
+#endif
+
 }}}
 
 #endif
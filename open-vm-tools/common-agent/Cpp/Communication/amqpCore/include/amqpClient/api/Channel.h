@@ -268,6 +268,38 @@ struct __declspec(novtable) Channel : public ICafObject {
 			const uint64 deliveryTag,
 			const bool requeue) = 0;
 
+	/**
+	 * @brief Puts the channel in publisher confirm mode
+	 * <p>
+	 * Once in confirm mode the broker acknowledges every message published on the
+	 * channel.  Messages are still written without waiting for their confirms, so
+	 * a stream of messages is not held up by round trips; basicPublish only blocks
+	 * once <i>maxUnconfirmed</i> messages are waiting to be confirmed.
+	 * @param maxUnconfirmed the largest number of published messages that may be
+	 * waiting for confirmation.  May be set to zero, meaning 'no limit'.
+	 * @return the method object representing the confirm.select-ok
+	 */
+	virtual AmqpMethods::Confirm::SmartPtrSelectOk confirmSelect(
+			const uint32 maxUnconfirmed) = 0;
+
+	/**
+	 * @brief Waits until all messages published so far have been confirmed
+	 * <p>
+	 * Throws AmqpTimeoutException if they have not all been confirmed in time.
+	 * @param timeoutMs the time to wait in milliseconds.  Zero means wait forever.
+	 * @retval true if the broker acknowledged all of them
+	 * @retval false if the broker rejected (basic.nack) any message since the
+	 * previous call
+	 */
+	virtual bool waitForConfirms(
+			const uint32 timeoutMs) = 0;
+
+	/**
+	 * @return the sequence number the next published message will be confirmed
+	 * with, or zero if the channel is not in confirm mode
+	 */
+	virtual uint64 getNextPublishSeqNo() = 0;
+
 	/**
 	 * @brief Creates an exchange
 	 * <p>
@@ -37,6 +37,11 @@ private: // CAbstractPollableChannel
 
 	SmartPtrIIntMessage doReceive(const int32 timeout);
 
+	void doReceiveBatch(
+			const uint32 maxMessages,
+			const int32 timeout,
+			CMessageCollection& messages);
+
 private:
 	static void QueueItemDestroyFunc(gpointer data);
 
@@ -54,6 +54,48 @@ public:
 			uint32 prefetchCount,
 			const std::string& queue);
 
+	/**
+	 * @brief Sets how message acknowledgements are batched
+	 * <p>
+	 * Handled messages are acknowledged together once <i>ackBatchSize</i> of them
+	 * are waiting, once the oldest of them has waited <i>ackBatchTimeMs</i>, or as
+	 * soon as no more messages are arriving, whichever comes first.  The batch never
+	 * grows past the prefetch count.  Only applies if the acknowledge mode is
+	 * <i>AUTO</i>.  Defaults to acknowledging every commit.
+	 * @param ackBatchSize the number of messages to acknowledge at once
+	 * @param ackBatchTimeMs the longest time in milliseconds an acknowledgement is held back
+	 */
+	void setAckBatching(
+			uint32 ackBatchSize,
+			uint32 ackBatchTimeMs);
+
+	/**
+	 * @brief Enables adaptive prefetch
+	 * <p>
+	 * While the handler keeps up with the deliveries the prefetch count is doubled,
+	 * up to <i>maxPrefetchCount</i>.  It is halved again, down to the prefetch
+	 * count passed to init, when messages take longer to handle.  A value not
+	 * greater than the init prefetch count keeps the prefetch count fixed.
+	 * @param maxPrefetchCount the upper limit of the prefetch count
+	 */
+	void setMaxPrefetchCount(uint32 maxPrefetchCount);
+
+	/**
+	 * @retval the number of delivered messages waiting to be handled
+	 */
+	uint32 getQueueDepth();
+
+	/**
+	 * @retval the prefetch count currently in effect
+	 */
+	uint32 getPrefetchCount();
+
+	/**
+	 * @retval the time in milliseconds the most recently acknowledged batch
+	 * waited for its acknowledgement
+	 */
+	uint64 getAckLatencyMs();
+
 	/**
 	 * @retval the underlying channel
 	 */
@@ -160,6 +202,12 @@ private:
 
 	SmartPtrIIntMessage handle(SmartPtrDelivery delivery);
 
+	void ackPending();
+
+	void adaptPrefetchCount(
+			const uint32 messageCount,
+			const bool isWindowFull);
+
 	static void destroyQueueItem(gpointer data);
 
 private:
@@ -179,6 +227,15 @@ private:
 	SmartPtrAmqpHeaderMapper _headerMapper;
 	AcknowledgeMode _acknowledgeMode;
 	uint32 _prefetchCount;
+	uint32 _maxPrefetchCount;
+	volatile uint32 _currentPrefetchCount;
+	uint32 _ackBatchSize;
+	uint32 _ackBatchTimeMs;
+	uint64 _unackedTag;
+	uint32 _unackedCount;
+	uint64 _unackedSinceMs;
+	uint64 _lastCommitMs;
+	volatile uint64 _ackLatencyMs;
 	std::string _queue;
 
 	CAF_CM_CREATE;
@@ -57,19 +57,67 @@ public:
 
 	void setChannelCacheSize(uint32 cacheSize);
 
+	/**
+	 * @brief Sets how long a channel may sit unused in the cache
+	 * <p>
+	 * Cached channels idle for longer are closed the next time a channel is
+	 * requested.
+	 * @param idleTimeoutMs the idle timeout in milliseconds. Zero (the default)
+	 * means cached channels are kept until the connection closes.
+	 */
+	void setChannelIdleTimeout(uint32 idleTimeoutMs);
+
+	/**
+	 * @brief Sets the number of channels to open as soon as the connection is
+	 * (re)established so that the first requests do not pay for channel creation
+	 * @param prewarmCount the number of channels; limited by the cache size.
+	 * Zero (the default) disables pre-warming.
+	 */
+	void setChannelCachePrewarm(uint32 prewarmCount);
+
+	/** @return the number of channels currently waiting in the cache */
+	uint32 getIdleChannelCount();
+
+	/** @return the number of getChannel() calls */
+	uint64 getChannelCheckoutCount();
+
+	/** @return the number of getChannel() calls satisfied from the cache */
+	uint64 getChannelCacheHitCount();
+
+	/** @return the number of channels opened, including pre-warmed ones */
+	uint64 getChannelCreateCount();
+
+	/** @return the number of cached channels closed for being idle too long */
+	uint64 getChannelIdleEvictionCount();
+
+	/** @return the total time in milliseconds spent in getChannel() */
+	uint64 getChannelCheckoutWaitMs();
+
+	/** @return the longest time in milliseconds spent in a getChannel() call */
+	uint64 getMaxChannelCheckoutWaitMs();
+
 public: // ConnectionFactory
 	SmartPtrConnection createConnection();
 
 	void addConnectionListener(const SmartPtrConnectionListener& listener);
 
 private:
-	typedef std::deque<SmartPtrChannelProxy> ProxyDeque;
+	struct CachedChannel {
+		SmartPtrChannelProxy channel;
+		uint64 idleSinceMs;
+	};
+	typedef std::deque<CachedChannel> ProxyDeque;
 	CAF_DECLARE_SMART_POINTER(ProxyDeque);
 
 	void reset();
 
+	void closeCachedChannels(ProxyDeque& channels);
+
 	SmartPtrChannelProxy newCachedChannelProxy();
 
+	SmartPtrChannelProxy newCachedChannelProxy(
+			const AmqpClient::SmartPtrChannel& channel);
+
 	AmqpClient::SmartPtrChannel createBareChannel();
 
 private:
@@ -107,6 +155,8 @@ private:
 	CAF_DECLARE_SMART_POINTER(ChannelCachingConnectionProxy);
 	friend class ChannelCachingConnectionProxy;
 
+	void prewarmChannels(const SmartPtrChannelCachingConnectionProxy& connection);
+
 	class CachedChannelHandler : public ChannelProxy {
 	public:
 		CachedChannelHandler();
@@ -190,6 +240,14 @@ private:
 				const uint64 deliveryTag,
 				const bool requeue);
 
+		AmqpClient::AmqpMethods::Confirm::SmartPtrSelectOk confirmSelect(
+				const uint32 maxUnconfirmed);
+
+		bool waitForConfirms(
+				const uint32 timeoutMs);
+
+		uint64 getNextPublishSeqNo();
+
 		AmqpClient::AmqpMethods::Exchange::SmartPtrDeclareOk exchangeDeclare(
 			const std::string& exchange,
 			const std::string& type,
@@ -255,9 +313,19 @@ private:
 	SmartPtrCAutoRecMutex _connectionMonitor;
 	SmartPtrChannelCachingConnectionProxy _connection;
 	uint32 _channelCacheSize;
+	uint32 _channelIdleTimeoutMs;
+	uint32 _channelCachePrewarm;
 	SmartPtrProxyDeque _cachedChannels;
 	SmartPtrCAutoRecMutex _cachedChannelsMonitor;
 
+	// Checkout statistics. Guarded by _cachedChannelsMonitor.
+	uint64 _checkoutCount;
+	uint64 _cacheHitCount;
+	uint64 _channelCreateCount;
+	uint64 _idleEvictionCount;
+	uint64 _checkoutWaitMs;
+	uint64 _maxCheckoutWaitMs;
+
 	CAF_CM_CREATE;
 	CAF_CM_CREATE_LOG;
 	CAF_CM_DECLARE_NOCOPY(CachingConnectionFactory);
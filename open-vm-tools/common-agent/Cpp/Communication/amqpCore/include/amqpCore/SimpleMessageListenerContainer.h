@@ -59,6 +59,20 @@ public:
 
 	void setPrefetchCount(const uint32 prefetchCount);
 
+	/**
+	 * @brief Set the upper limit for adaptive prefetch
+	 * @see BlockingQueueConsumer::setMaxPrefetchCount
+	 */
+	void setMaxPrefetchCount(const uint32 maxPrefetchCount);
+
+	/**
+	 * @brief Set how message acknowledgements are batched
+	 * @see BlockingQueueConsumer::setAckBatching
+	 */
+	void setAckBatchSize(const uint32 ackBatchSize);
+
+	void setAckBatchTime(const uint32 ackBatchTimeMs);
+
 	void setReceiveTimeout(const uint32 receiveTimeout);
 
 	void setRecoveryInterval(const uint32 recoveryInterval);
@@ -151,6 +165,9 @@ private:
 	AcknowledgeMode _acknowledgeMode;
 	uint32 _receiveTimeout;
 	uint32 _prefetchCount;
+	uint32 _maxPrefetchCount;
+	uint32 _ackBatchSize;
+	uint32 _ackBatchTimeMs;
 	uint32 _txSize;
 	uint32 _recoveryInterval;
 
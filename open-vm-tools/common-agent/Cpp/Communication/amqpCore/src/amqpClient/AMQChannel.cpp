@@ -26,6 +26,7 @@
 #include "amqpClient/amqpImpl/BasicRecoverMethod.h"
 #include "amqpClient/amqpImpl/BasicRejectMethod.h"
 #include "amqpClient/amqpImpl/ChannelCloseOkMethod.h"
+#include "amqpClient/amqpImpl/ConfirmSelectMethod.h"
 #include "amqpClient/amqpImpl/EnvelopeImpl.h"
 #include "amqpClient/amqpImpl/ExchangeDeclareMethod.h"
 #include "amqpClient/amqpImpl/ExchangeDeleteMethod.h"
@@ -52,6 +53,7 @@ using namespace Caf::AmqpClient;
 
 const uint8 AMQChannel::DEBUGLOG_FLAG_ENTRYEXIT = 0x01;
 const uint8 AMQChannel::DEBUGLOG_FLAG_AMQP = 0x02;
+const uint32 AMQChannel::CONFIRM_WAIT_SLICE_MS = 100;
 
 #define AMQCHANNEL_ENTRY \
 	if (_debugLogFlags & DEBUGLOG_FLAG_ENTRYEXIT) { CAF_CM_LOG_DEBUG_VA0("entry"); }
@@ -65,10 +67,16 @@ AMQChannel::AMQChannel() :
 	_isOpen(false),
 	_debugLogFlags(0),
 	_channelNumber(0),
+	_isConfirmMode(false),
+	_maxUnconfirmed(0),
+	_nextPublishSeqNo(0),
+	_isNacked(false),
 	CAF_CM_INIT_LOG("AMQChannel") {
 	CAF_CM_INIT_THREADSAFE;
 	_channelMutex.CreateInstance();
 	_channelMutex->initialize();
+	_confirmMutex.CreateInstance();
+	_confirmMutex->initialize();
 }
 
 AMQChannel::~AMQChannel() {
@@ -99,6 +107,7 @@ void AMQChannel::init(
 	_connection = connection;
 	_workService = workService;
 	_channelSignal.initialize("channelSignal");
+	_confirmSignal.initialize("confirmSignal");
 	_dispatcher.CreateInstance();
 	_dispatcher->init(_workService);
 
@@ -328,7 +337,21 @@ void AMQChannel::basicPublish(
 			immediate,
 			properties,
 			body);
-	transmit(method);
+
+	if (_isConfirmMode) {
+		// Block outside of the class lock so that the inbound confirms
+		// can be processed while we wait for room in the window.
+		waitForConfirmWindow();
+
+		// Number and send the message under the class lock so that its
+		// confirm cannot be processed before it is recorded.
+		CAF_CM_LOCK_UNLOCK;
+		transmit(method);
+		CAF_CM_LOCK_UNLOCK1(_confirmMutex);
+		_unconfirmedSet.insert(_nextPublishSeqNo++);
+	} else {
+		transmit(method);
+	}
 	AMQCHANNEL_EXIT;
 }
 
@@ -496,6 +519,122 @@ void AMQChannel::basicReject(
 	transmit(method);
 	AMQCHANNEL_EXIT;
 }
+
+AmqpMethods::Confirm::SmartPtrSelectOk AMQChannel::confirmSelect(
+		const uint32 maxUnconfirmed) {
+	CAF_CM_FUNCNAME("confirmSelect");
+	AMQCHANNEL_ENTRY;
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	// The broker numbers messages starting at 1 from the first confirm.select
+	// so the numbering must be in place before the method goes out.
+	bool wasConfirmMode = false;
+	{
+		CAF_CM_LOCK_UNLOCK;
+		CAF_CM_LOCK_UNLOCK1(_confirmMutex);
+		wasConfirmMode = _isConfirmMode;
+		if (!wasConfirmMode) {
+			_nextPublishSeqNo = 1;
+			_isConfirmMode = true;
+		}
+		_maxUnconfirmed = maxUnconfirmed;
+	}
+
+	SmartPtrConfirmSelectMethod method;
+	method.CreateInstance();
+	method->init();
+	SmartPtrAMQCommand reply;
+	try {
+		reply = execRpc(method);
+	}
+	CAF_CM_CATCH_ALL;
+	if (CAF_CM_ISEXCEPTION && !wasConfirmMode) {
+		CAF_CM_LOCK_UNLOCK1(_confirmMutex);
+		_isConfirmMode = false;
+		_nextPublishSeqNo = 0;
+		_unconfirmedSet.clear();
+	}
+	CAF_CM_THROWEXCEPTION;
+
+	AmqpMethods::Confirm::SmartPtrSelectOk selectOk;
+	SmartPtrIMethod replyMethod = reply->getMethod();
+	selectOk.QueryInterface(replyMethod, false);
+	if (!selectOk) {
+		CAF_CM_EXCEPTIONEX_VA1(
+				NoSuchInterfaceException,
+				0,
+				"Expected a confirm.select-ok response. Received '%s'. "
+				"Please report this bug.",
+				replyMethod->getProtocolMethodName().c_str());
+	}
+	AMQCHANNEL_EXIT;
+	return selectOk;
+}
+
+bool AMQChannel::waitForConfirms(
+		const uint32 timeoutMs) {
+	CAF_CM_FUNCNAME("waitForConfirms");
+	AMQCHANNEL_ENTRY;
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+	if (!_isConfirmMode) {
+		CAF_CM_EXCEPTIONEX_VA1(
+				IllegalStateException,
+				0,
+				"Channel #%d is not in confirm mode",
+				_channelNumber);
+	}
+
+	const uint64 startTimeMs = CDateTimeUtils::getTimeMs();
+	size_t unconfirmedCount = 0;
+	bool isAcked = true;
+	{
+		CAF_CM_LOCK_UNLOCK1(_confirmMutex);
+		while (!_unconfirmedSet.empty() && _isOpen) {
+			uint32 waitMs = CONFIRM_WAIT_SLICE_MS;
+			if (timeoutMs) {
+				const uint64 remainingMs =
+						CDateTimeUtils::calcRemainingTime(startTimeMs, timeoutMs);
+				if (!remainingMs) {
+					break;
+				}
+				if (remainingMs < waitMs) {
+					waitMs = static_cast<uint32>(remainingMs);
+				}
+			}
+			_confirmSignal.waitOrTimeout(_confirmMutex, waitMs);
+		}
+
+		// The signal only wakes one waiter; pass it along.
+		_confirmSignal.signal();
+		unconfirmedCount = _unconfirmedSet.size();
+		isAcked = !_isNacked;
+		if (!unconfirmedCount) {
+			_isNacked = false;
+		}
+	}
+
+	if (unconfirmedCount) {
+		ensureIsOpen();
+		CAF_CM_EXCEPTIONEX_VA3(
+				AmqpExceptions::AmqpTimeoutException,
+				0,
+				"[channel=%d] %d messages were not confirmed within %d ms",
+				_channelNumber,
+				static_cast<int32>(unconfirmedCount),
+				timeoutMs);
+	}
+	AMQCHANNEL_EXIT;
+	return isAcked;
+}
+
+uint64 AMQChannel::getNextPublishSeqNo() {
+	CAF_CM_FUNCNAME_VALIDATE("getNextPublishSeqNo");
+	AMQCHANNEL_ENTRY;
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+	CAF_CM_LOCK_UNLOCK1(_confirmMutex);
+	AMQCHANNEL_EXIT;
+	return _isConfirmMode ? _nextPublishSeqNo : 0;
+}
 #endif
 
 #if (1) // exchange
@@ -961,6 +1100,48 @@ bool AMQChannel::processAsync(const SmartPtrAMQCommand& command) {
 				callReturnListeners(command);
 				commandHandled = true;
 				break;
+
+			case AMQP_BASIC_ACK_METHOD:
+				{
+					commandHandled = true;
+					AmqpMethods::Basic::SmartPtrAck ackMethod;
+					ackMethod.QueryInterface(method, false);
+					if (ackMethod) {
+						handleConfirm(
+								ackMethod->getDeliveryTag(),
+								ackMethod->getMultiple(),
+								false);
+					} else {
+						CAF_CM_EXCEPTIONEX_VA0(
+								IllegalStateException,
+								0,
+								"Received AMQP_BASIC_ACK_METHOD but the method object "
+								"is not a AmqpClient::AmqpMethods::Basic::Ack instance. "
+								"Please report this bug.");
+					}
+				}
+				break;
+
+			case AMQP_BASIC_NACK_METHOD:
+				{
+					commandHandled = true;
+					AmqpMethods::Basic::SmartPtrNack nackMethod;
+					nackMethod.QueryInterface(method, false);
+					if (nackMethod) {
+						handleConfirm(
+								nackMethod->getDeliveryTag(),
+								nackMethod->getMultiple(),
+								true);
+					} else {
+						CAF_CM_EXCEPTIONEX_VA0(
+								IllegalStateException,
+								0,
+								"Received AMQP_BASIC_NACK_METHOD but the method object "
+								"is not a AmqpClient::AmqpMethods::Basic::Nack instance. "
+								"Please report this bug.");
+					}
+				}
+				break;
 			}
 		}
 		CAF_CM_CATCH_ALL;
@@ -1106,6 +1287,47 @@ void AMQChannel::transmit(const SmartPtrIServerMethod& method) {
 	AMQCHANNEL_EXIT;
 }
 
+/*
+ * Blocks the publisher until fewer than _maxUnconfirmed messages are
+ * waiting for their confirms or the channel closes.
+ */
+void AMQChannel::waitForConfirmWindow() {
+	CAF_CM_FUNCNAME_VALIDATE("waitForConfirmWindow");
+	{
+		CAF_CM_LOCK_UNLOCK1(_confirmMutex);
+		while (_maxUnconfirmed &&
+				(_unconfirmedSet.size() >= _maxUnconfirmed) &&
+				_isOpen) {
+			_confirmSignal.waitOrTimeout(_confirmMutex, CONFIRM_WAIT_SLICE_MS);
+		}
+		_confirmSignal.signal();
+	}
+	ensureIsOpen();
+}
+
+/*
+ * Handles a basic.ack or basic.nack sent by the broker for
+ * messages published in confirm mode.
+ */
+void AMQChannel::handleConfirm(
+		const uint64 deliveryTag,
+		const bool multiple,
+		const bool isNack) {
+	CAF_CM_FUNCNAME_VALIDATE("handleConfirm");
+	CAF_CM_LOCK_UNLOCK1(_confirmMutex);
+	if (multiple) {
+		_unconfirmedSet.erase(
+				_unconfirmedSet.begin(),
+				_unconfirmedSet.upper_bound(deliveryTag));
+	} else {
+		_unconfirmedSet.erase(deliveryTag);
+	}
+	if (isNack) {
+		_isNacked = true;
+	}
+	_confirmSignal.signal();
+}
+
 /*
  * This method is called when we have received a channel.close method
  * from the server.  Respond with a channel.close-ok method then
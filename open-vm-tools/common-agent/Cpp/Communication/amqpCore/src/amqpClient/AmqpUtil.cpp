@@ -101,6 +101,14 @@ AMQPStatus AmqpUtil::AMQP_BasicQos(
 	return channel->basicQos(prefetchSize, prefetchCount, global);
 }
 
+AMQPStatus AmqpUtil::AMQP_ConfirmSelect(
+		const SmartPtrCAmqpChannel& channel) {
+	CAF_CM_STATIC_FUNC_VALIDATE("AmqpUtil", "AMQP_ConfirmSelect");
+	CAF_CM_VALIDATE_SMARTPTR(channel);
+
+	return channel->confirmSelect();
+}
+
 AMQPStatus AmqpUtil::AMQP_ExchangeDeclare(
 		const SmartPtrCAmqpChannel& channel,
 		const std::string& exchange,
@@ -59,6 +59,9 @@ public:
 			const uint16 prefetchCount,
 			bool global);
 
+	static AMQPStatus AMQP_ConfirmSelect(
+			const SmartPtrCAmqpChannel& channel);
+
 	static AMQPStatus AMQP_ExchangeDeclare(
 			const SmartPtrCAmqpChannel& channel,
 			const std::string& exchange,
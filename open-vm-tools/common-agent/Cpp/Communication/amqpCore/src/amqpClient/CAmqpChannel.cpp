@@ -157,6 +157,13 @@ AMQPStatus CAmqpChannel::basicQos(
 	return _connection->basicQos(_channel, prefetchSize, prefetchCount, global);
 }
 
+AMQPStatus CAmqpChannel::confirmSelect() {
+	CAF_CM_FUNCNAME_VALIDATE("confirmSelect");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	return _connection->confirmSelect(_channel);
+}
+
 AMQPStatus CAmqpChannel::exchangeDeclare(
 		const std::string& exchange,
 		const std::string& type,
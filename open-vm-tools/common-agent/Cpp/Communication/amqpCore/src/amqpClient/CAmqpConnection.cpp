@@ -541,6 +541,25 @@ AMQPStatus CAmqpConnection::basicQos(
 	return AMQP_ERROR_OK;
 }
 
+AMQPStatus CAmqpConnection::confirmSelect(
+		const amqp_channel_t& channel) {
+	CAF_CM_FUNCNAME_VALIDATE("confirmSelect");
+
+	CAF_CM_LOG_DEBUG_VA1(
+			"Calling amqp_confirm_select - channel: %d", channel);
+
+	CAF_CM_LOCK_UNLOCK;
+	CAF_CM_VALIDATE_PTR(_connectionState);
+	CAF_CM_VALIDATE_BOOL(_connectionStateEnum == AMQP_STATE_CONNECTED);
+	validateOpenChannel(channel);
+
+	amqp_confirm_select_t method = {};
+	AmqpCommon::sendMethod(_connectionState, channel,
+			AMQP_CONFIRM_SELECT_METHOD, &method);
+
+	return AMQP_ERROR_OK;
+}
+
 AMQPStatus CAmqpConnection::exchangeDeclare(
 		const amqp_channel_t& channel,
 		const std::string& exchange,
@@ -32,6 +32,9 @@ const creatorEntry creatorEntries[] = {
 		creatorEntry(AMQP_BASIC_RETURN_METHOD, BasicReturnMethod::Creator),
 		creatorEntry(AMQP_BASIC_RECOVER_OK_METHOD, BasicRecoverOkMethod::Creator),
 		creatorEntry(AMQP_BASIC_QOS_OK_METHOD, BasicQosOkMethod::Creator),
+		creatorEntry(AMQP_BASIC_ACK_METHOD, BasicAckFromServerMethod::Creator),
+		creatorEntry(AMQP_BASIC_NACK_METHOD, BasicNackFromServerMethod::Creator),
+		creatorEntry(AMQP_CONFIRM_SELECT_OK_METHOD, ConfirmSelectOkMethod::Creator),
 		creatorEntry(AMQP_CHANNEL_OPEN_OK_METHOD, ChannelOpenOkMethod::Creator),
 		creatorEntry(AMQP_CHANNEL_CLOSE_OK_METHOD, ChannelCloseOkFromServerMethod::Creator),
 		creatorEntry(AMQP_CHANNEL_CLOSE_METHOD, ChannelCloseMethod::Creator),
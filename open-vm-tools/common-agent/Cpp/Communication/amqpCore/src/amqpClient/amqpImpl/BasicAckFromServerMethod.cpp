@@ -0,0 +1,35 @@
+/*
+ *  Copyright (C) 2012-2016 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+#include "stdafx.h"
+#include "BasicAckFromServerMethod.h"
+
+using namespace Caf::AmqpClient;
+
+BasicAckFromServerMethod::BasicAckFromServerMethod() :
+	_deliveryTag(0),
+	_multiple(false),
+	CAF_CM_INIT("BasicAckFromServerMethod") {
+}
+
+BasicAckFromServerMethod::~BasicAckFromServerMethod() {
+}
+
+void BasicAckFromServerMethod::init(const amqp_method_t * const method) {
+	CAF_CM_FUNCNAME("init");
+	CAF_CM_VALIDATE_PTR(method);
+	CAF_CM_ASSERT(AMQP_BASIC_ACK_METHOD == method->id);
+	const amqp_basic_ack_t * const decoded =
+			reinterpret_cast<const amqp_basic_ack_t * const>(method->decoded);
+	_deliveryTag = decoded->delivery_tag;
+	_multiple = decoded->multiple;
+}
+
+uint64 BasicAckFromServerMethod::getDeliveryTag() {
+	return _deliveryTag;
+}
+
+bool BasicAckFromServerMethod::getMultiple() {
+	return _multiple;
+}
@@ -0,0 +1,45 @@
+/*
+ *  Copyright (C) 2012-2016 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+#ifndef BASICACKFROMSERVERMETHOD_H_
+#define BASICACKFROMSERVERMETHOD_H_
+
+namespace Caf { namespace AmqpClient {
+
+/**
+ * @ingroup AmqpApiImpl
+ * @remark LIBRARY IMPLEMENTATION - NOT PART OF THE PUBLIC API
+ * @brief Implementation of AMQP basic.ack (received from server in confirm mode)
+ */
+class BasicAckFromServerMethod :
+	public TMethodImpl<BasicAckFromServerMethod>,
+	public AmqpMethods::Basic::Ack {
+	METHOD_DECL(
+		AmqpMethods::Basic::Ack,
+		AMQP_BASIC_ACK_METHOD,
+		"basic.ack",
+		false)
+
+public:
+	BasicAckFromServerMethod();
+	virtual ~BasicAckFromServerMethod();
+
+public: // IMethod
+	void init(const amqp_method_t * const method);
+
+public: // AmqpMethods::Basic::Ack
+	uint64 getDeliveryTag();
+	bool getMultiple();
+
+private:
+	uint64 _deliveryTag;
+	bool _multiple;
+	CAF_CM_CREATE;
+	CAF_CM_DECLARE_NOCOPY(BasicAckFromServerMethod);
+};
+CAF_DECLARE_SMART_QI_POINTER(BasicAckFromServerMethod);
+
+}}
+
+#endif /* BASICACKFROMSERVERMETHOD_H_ */
@@ -0,0 +1,35 @@
+/*
+ *  Copyright (C) 2012-2016 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+#include "stdafx.h"
+#include "BasicNackFromServerMethod.h"
+
+using namespace Caf::AmqpClient;
+
+BasicNackFromServerMethod::BasicNackFromServerMethod() :
+	_deliveryTag(0),
+	_multiple(false),
+	CAF_CM_INIT("BasicNackFromServerMethod") {
+}
+
+BasicNackFromServerMethod::~BasicNackFromServerMethod() {
+}
+
+void BasicNackFromServerMethod::init(const amqp_method_t * const method) {
+	CAF_CM_FUNCNAME("init");
+	CAF_CM_VALIDATE_PTR(method);
+	CAF_CM_ASSERT(AMQP_BASIC_NACK_METHOD == method->id);
+	const amqp_basic_nack_t * const decoded =
+			reinterpret_cast<const amqp_basic_nack_t * const>(method->decoded);
+	_deliveryTag = decoded->delivery_tag;
+	_multiple = decoded->multiple;
+}
+
+uint64 BasicNackFromServerMethod::getDeliveryTag() {
+	return _deliveryTag;
+}
+
+bool BasicNackFromServerMethod::getMultiple() {
+	return _multiple;
+}
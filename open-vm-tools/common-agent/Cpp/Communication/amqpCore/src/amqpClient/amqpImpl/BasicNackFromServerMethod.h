@@ -0,0 +1,45 @@
+/*
+ *  Copyright (C) 2012-2016 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+#ifndef BASICNACKFROMSERVERMETHOD_H_
+#define BASICNACKFROMSERVERMETHOD_H_
+
+namespace Caf { namespace AmqpClient {
+
+/**
+ * @ingroup AmqpApiImpl
+ * @remark LIBRARY IMPLEMENTATION - NOT PART OF THE PUBLIC API
+ * @brief Implementation of AMQP basic.nack (received from server in confirm mode)
+ */
+class BasicNackFromServerMethod :
+	public TMethodImpl<BasicNackFromServerMethod>,
+	public AmqpMethods::Basic::Nack {
+	METHOD_DECL(
+		AmqpMethods::Basic::Nack,
+		AMQP_BASIC_NACK_METHOD,
+		"basic.nack",
+		false)
+
+public:
+	BasicNackFromServerMethod();
+	virtual ~BasicNackFromServerMethod();
+
+public: // IMethod
+	void init(const amqp_method_t * const method);
+
+public: // AmqpMethods::Basic::Nack
+	uint64 getDeliveryTag();
+	bool getMultiple();
+
+private:
+	uint64 _deliveryTag;
+	bool _multiple;
+	CAF_CM_CREATE;
+	CAF_CM_DECLARE_NOCOPY(BasicNackFromServerMethod);
+};
+CAF_DECLARE_SMART_QI_POINTER(BasicNackFromServerMethod);
+
+}}
+
+#endif /* BASICNACKFROMSERVERMETHOD_H_ */
@@ -0,0 +1,35 @@
+/*
+ *  Copyright (C) 2012-2016 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+#include "stdafx.h"
+
+#include "amqpClient/CAmqpChannel.h"
+#include "amqpClient/amqpImpl/ConfirmSelectMethod.h"
+
+using namespace Caf::AmqpClient;
+
+ConfirmSelectMethod::ConfirmSelectMethod() :
+	_isInitialized(false),
+	CAF_CM_INIT("ConfirmSelectMethod") {
+}
+
+ConfirmSelectMethod::~ConfirmSelectMethod() {
+}
+
+void ConfirmSelectMethod::init() {
+	CAF_CM_FUNCNAME_VALIDATE("init");
+	CAF_CM_PRECOND_ISNOTINITIALIZED(_isInitialized);
+	_isInitialized = true;
+}
+
+std::string ConfirmSelectMethod::getMethodName() const {
+	return "confirm.select";
+}
+
+AMQPStatus ConfirmSelectMethod::send(const SmartPtrCAmqpChannel& channel) {
+	CAF_CM_FUNCNAME_VALIDATE("send");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	return AmqpUtil::AMQP_ConfirmSelect(channel);
+}
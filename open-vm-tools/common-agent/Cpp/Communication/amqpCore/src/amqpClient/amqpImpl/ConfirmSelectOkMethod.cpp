@@ -0,0 +1,21 @@
+/*
+ *  Copyright (C) 2012-2016 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+#include "stdafx.h"
+#include "ConfirmSelectOkMethod.h"
+
+using namespace Caf::AmqpClient;
+
+ConfirmSelectOkMethod::ConfirmSelectOkMethod() :
+	CAF_CM_INIT("ConfirmSelectOkMethod") {
+}
+
+ConfirmSelectOkMethod::~ConfirmSelectOkMethod() {
+}
+
+void ConfirmSelectOkMethod::init(const amqp_method_t * const method) {
+	CAF_CM_FUNCNAME("init");
+	CAF_CM_VALIDATE_PTR(method);
+	CAF_CM_ASSERT(AMQP_CONFIRM_SELECT_OK_METHOD == method->id);
+}
@@ -0,0 +1,41 @@
+/*
+ *  Copyright (C) 2012-2016 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+#ifndef CONFIRMSELECTOKMETHOD_H_
+#define CONFIRMSELECTOKMETHOD_H_
+
+namespace Caf { namespace AmqpClient {
+
+/**
+ * @ingroup AmqpApiImpl
+ * @remark LIBRARY IMPLEMENTATION - NOT PART OF THE PUBLIC API
+ * @brief Implementation of AMQP confirm.select-ok
+ */
+class ConfirmSelectOkMethod :
+	public TMethodImpl<ConfirmSelectOkMethod>,
+	public AmqpMethods::Confirm::SelectOk {
+	METHOD_DECL(
+		AmqpMethods::Confirm::SelectOk,
+		AMQP_CONFIRM_SELECT_OK_METHOD,
+		"confirm.select-ok",
+		false)
+
+public:
+	ConfirmSelectOkMethod();
+	virtual ~ConfirmSelectOkMethod();
+
+public: // IMethod
+	void init(const amqp_method_t * const method);
+
+public: // AmqpMethods::Confirm::SelectOk
+
+private:
+	CAF_CM_CREATE;
+	CAF_CM_DECLARE_NOCOPY(ConfirmSelectOkMethod);
+};
+CAF_DECLARE_SMART_QI_POINTER(ConfirmSelectOkMethod);
+
+}}
+
+#endif /* CONFIRMSELECTOKMETHOD_H_ */
@@ -23,11 +23,15 @@ using namespace Caf::AmqpClient;
 #include "BasicReturnMethod.h"
 #include "BasicRecoverOkMethod.h"
 #include "BasicQosOkMethod.h"
+#include "BasicAckFromServerMethod.h"
+#include "BasicNackFromServerMethod.h"
 
 #include "ChannelOpenOkMethod.h"
 #include "ChannelCloseMethod.h"
 #include "ChannelCloseOkFromServerMethod.h"
 
+#include "ConfirmSelectOkMethod.h"
+
 #include "ExchangeDeclareOkMethod.h"
 #include "ExchangeDeleteOkMethod.h"
 
@@ -97,6 +97,29 @@ SmartPtrIIntMessage AmqpMessageListenerSource::doReceive(const int32 timeout) {
 	return message;
 }
 
+void AmqpMessageListenerSource::doReceiveBatch(
+		const uint32 maxMessages,
+		const int32 timeout,
+		CMessageCollection& messages) {
+	CAF_CM_FUNCNAME_VALIDATE("doReceiveBatch");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	// Wait for the first message, then drain the rest under one queue lock
+	const SmartPtrIIntMessage message = doReceive(timeout);
+	if (message) {
+		messages.push_back(message);
+		g_async_queue_lock(_messageQueue);
+		gpointer data = NULL;
+		while ((messages.size() < maxMessages)
+				&& (data = g_async_queue_try_pop_unlocked(_messageQueue))) {
+			IIntMessage *messagePtr = reinterpret_cast<IIntMessage*>(data);
+			messages.push_back(messagePtr);
+			messagePtr->Release();
+		}
+		g_async_queue_unlock(_messageQueue);
+	}
+}
+
 void AmqpMessageListenerSource::QueueItemDestroyFunc(gpointer data) {
 	reinterpret_cast<IIntMessage*>(data)->Release();
 }
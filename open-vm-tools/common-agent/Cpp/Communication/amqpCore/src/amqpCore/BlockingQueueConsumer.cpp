@@ -21,6 +21,9 @@
 
 using namespace Caf::AmqpIntegration;
 
+// Messages taking longer than this to handle shrink the prefetch window
+static const uint64 SLOW_MESSAGE_MS = 1000;
+
 #if (1) // BlockingQueueConsumer
 BlockingQueueConsumer::BlockingQueueConsumer() :
 			_isInitialized(false),
@@ -29,6 +32,15 @@ BlockingQueueConsumer::BlockingQueueConsumer() :
 	_deliveryQueue(NULL),
 	_acknowledgeMode(ACKNOWLEDGEMODE_NONE),
 	_prefetchCount(0),
+	_maxPrefetchCount(0),
+	_currentPrefetchCount(0),
+	_ackBatchSize(1),
+	_ackBatchTimeMs(0),
+	_unackedTag(0),
+	_unackedCount(0),
+	_unackedSinceMs(0),
+	_lastCommitMs(0),
+	_ackLatencyMs(0),
 	CAF_CM_INIT_LOG("BlockingQueueConsumer") {
 	_parentLock.CreateInstance();
 	_parentLock->initialize();
@@ -58,11 +70,51 @@ void BlockingQueueConsumer::init(
 	_headerMapper = headerMapper;
 	_acknowledgeMode = acknowledgeMode;
 	_prefetchCount = prefetchCount;
+	_currentPrefetchCount = prefetchCount;
 	_queue = queue;
 	_deliveryQueue = g_async_queue_new_full(destroyQueueItem);
 	_isInitialized = true;
 }
 
+void BlockingQueueConsumer::setAckBatching(
+		uint32 ackBatchSize,
+		uint32 ackBatchTimeMs) {
+	CAF_CM_FUNCNAME_VALIDATE("setAckBatching");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+	CAF_CM_VALIDATE_NOTZERO(ackBatchSize);
+	_ackBatchSize = ackBatchSize;
+	_ackBatchTimeMs = ackBatchTimeMs;
+}
+
+void BlockingQueueConsumer::setMaxPrefetchCount(uint32 maxPrefetchCount) {
+	CAF_CM_FUNCNAME_VALIDATE("setMaxPrefetchCount");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	// basic.qos carries the prefetch count in 16 bits
+	_maxPrefetchCount = maxPrefetchCount > G_MAXUINT16 ? G_MAXUINT16 : maxPrefetchCount;
+}
+
+uint32 BlockingQueueConsumer::getQueueDepth() {
+	CAF_CM_FUNCNAME_VALIDATE("getQueueDepth");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	// Negative when threads are waiting on an empty queue
+	const gint length = g_async_queue_length(_deliveryQueue);
+	return length > 0 ? static_cast<uint32>(length) : 0;
+}
+
+uint32 BlockingQueueConsumer::getPrefetchCount() {
+	CAF_CM_FUNCNAME_VALIDATE("getPrefetchCount");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+	return _currentPrefetchCount;
+}
+
+uint64 BlockingQueueConsumer::getAckLatencyMs() {
+	CAF_CM_FUNCNAME_VALIDATE("getAckLatencyMs");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+	return _ackLatencyMs;
+}
+
 AmqpClient::SmartPtrChannel BlockingQueueConsumer::getChannel() {
 	CAF_CM_FUNCNAME("getChannel");
 	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
@@ -128,27 +180,43 @@ bool BlockingQueueConsumer::commitIfNecessary() {
 	std::set<uint64> deliveryTags;
 	{
 		CAF_CM_LOCK_UNLOCK1(_parentLock);
-		deliveryTags = _deliveryTags;
+		deliveryTags.swap(_deliveryTags);
 	}
 
 	try {
+		bool isWindowFull = false;
 		if (deliveryTags.size()) {
 			result = true;
 			if (_acknowledgeMode == ACKNOWLEDGEMODE_AUTO) {
 				std::set<uint64>::const_reverse_iterator tag = deliveryTags.rbegin();
 				CAF_CM_ASSERT(tag != deliveryTags.rend());
-				CAF_CM_LOG_DEBUG_VA2(
-						"basicAck [tag=%Ld][tag count=%d]",
-						*tag,
-						deliveryTags.size());
-				_channel->basicAck(*tag, true);
+				if (!_unackedCount) {
+					_unackedSinceMs = CDateTimeUtils::getTimeMs();
+				}
+				_unackedTag = *tag;
+				_unackedCount += static_cast<uint32>(deliveryTags.size());
+				isWindowFull = _currentPrefetchCount && (_unackedCount >= _currentPrefetchCount);
 			}
 		}
+
+		// Hold the ack back while messages keep arriving, but not past the batch
+		// size or time, and never once the broker has stopped sending because
+		// the prefetch window is used up.
+		if (_unackedCount &&
+				(deliveryTags.empty() ||
+				isWindowFull ||
+				(_unackedCount >= _ackBatchSize) ||
+				!CDateTimeUtils::calcRemainingTime(_unackedSinceMs, _ackBatchTimeMs))) {
+			ackPending();
+		}
+
+		if (deliveryTags.size()) {
+			adaptPrefetchCount(static_cast<uint32>(deliveryTags.size()), isWindowFull);
+		}
 	}
 	CAF_CM_CATCH_ALL;
-	{
-		CAF_CM_LOCK_UNLOCK1(_parentLock);
-		_deliveryTags.clear();
+	if (CAF_CM_ISEXCEPTION) {
+		_unackedCount = 0;
 	}
 	CAF_CM_THROWEXCEPTION;
 	return result;
@@ -172,6 +240,10 @@ void BlockingQueueConsumer::rollbackOnExceptionIfNecessary(SmartPtrCCafException
 				ex->getMsg().c_str());
 
 		try {
+			// Messages handled before this batch are still good
+			if (_unackedCount) {
+				ackPending();
+			}
 			for (TConstIterator<std::set<uint64> > tag(deliveryTags); tag; tag++) {
 #ifdef FIXED
 				_channel->basicReject(*tag, true);
@@ -184,6 +256,7 @@ void BlockingQueueConsumer::rollbackOnExceptionIfNecessary(SmartPtrCCafException
 			_deliveryTags.clear();
 		}
 		if (CAF_CM_ISEXCEPTION) {
+			_unackedCount = 0;
 			CAF_CM_LOG_ERROR_VA1(
 					"App exception overridden by rollback exception: "
 					"%s",
@@ -208,6 +281,9 @@ void BlockingQueueConsumer::start(const uint32 timeoutMs) {
 
 	CAF_CM_LOG_DEBUG_VA0("Starting consumer");
 	_isCanceled = false;
+	_currentPrefetchCount = _prefetchCount;
+	_unackedCount = 0;
+	_lastCommitMs = CDateTimeUtils::getTimeMs();
 	_connection = _connectionFactory->createConnection();
 	_channel = _connection->createChannel();
 
@@ -217,7 +293,7 @@ void BlockingQueueConsumer::start(const uint32 timeoutMs) {
 
 		// Set the prefetchCount if ack mode is not NONE (broker-auto)
 		if (_acknowledgeMode != ACKNOWLEDGEMODE_NONE) {
-			_channel->basicQos(0, _prefetchCount, false);
+			_channel->basicQos(0, _currentPrefetchCount, false);
 		}
 
 		if (_connectionFactory->getProtocol().compare("tunnel") != 0) {
@@ -268,10 +344,15 @@ void BlockingQueueConsumer::stop(const uint32 timeoutMs) {
 		std::string consumerTag = _consumer ? _consumer->getConsumerTag() : std::string();
 		if (_channel && consumerTag.length()) {
 			if (_channel->isOpen()) {
-					CAF_CM_LOG_DEBUG_VA1(
-							"Canceling consumer '%s'",
-							consumerTag.c_str());
-					_channel->basicCancel(consumerTag);
+				// Don't let the recover below re-deliver handled messages
+				if (_unackedCount) {
+					ackPending();
+				}
+
+				CAF_CM_LOG_DEBUG_VA1(
+						"Canceling consumer '%s'",
+						consumerTag.c_str());
+				_channel->basicCancel(consumerTag);
 
 				// If we are not using broker auto-ack then re-queue the messages
 				if (_acknowledgeMode != ACKNOWLEDGEMODE_NONE) {
@@ -319,6 +400,7 @@ void BlockingQueueConsumer::stop(const uint32 timeoutMs) {
 	_consumer = NULL;
 	_isRunning = false;
 	_isCanceled = false;
+	_unackedCount = 0;
 
 	if (_shutdownException) {
 		_shutdownException = NULL;
@@ -357,6 +439,61 @@ SmartPtrIIntMessage BlockingQueueConsumer::handle(SmartPtrDelivery delivery) {
 	return message;
 }
 
+void BlockingQueueConsumer::ackPending() {
+	CAF_CM_FUNCNAME_VALIDATE("ackPending");
+
+	CAF_CM_LOG_DEBUG_VA2(
+			"basicAck [tag=%Ld][tag count=%d]",
+			_unackedTag,
+			_unackedCount);
+	_unackedCount = 0;
+	_channel->basicAck(_unackedTag, true);
+	_ackLatencyMs = CDateTimeUtils::getTimeMs() - _unackedSinceMs;
+}
+
+void BlockingQueueConsumer::adaptPrefetchCount(
+		const uint32 messageCount,
+		const bool isWindowFull) {
+	CAF_CM_FUNCNAME_VALIDATE("adaptPrefetchCount");
+
+	const uint64 now = CDateTimeUtils::getTimeMs();
+	const uint64 perMessageMs = (now - _lastCommitMs) / messageCount;
+	_lastCommitMs = now;
+
+	if ((_acknowledgeMode == ACKNOWLEDGEMODE_NONE) ||
+			(_maxPrefetchCount <= _prefetchCount) ||
+			!_currentPrefetchCount) {
+		return;
+	}
+
+	// Grow the window when the handler has drained everything the broker was
+	// allowed to send, shrink it when messages are slow to handle so they
+	// aren't held here while other consumers could take them.
+	uint32 prefetchCount = _currentPrefetchCount;
+	if (perMessageMs >= SLOW_MESSAGE_MS) {
+		prefetchCount = prefetchCount / 2;
+		if (prefetchCount < _prefetchCount) {
+			prefetchCount = _prefetchCount;
+		}
+	} else if (isWindowFull && !getQueueDepth()) {
+		prefetchCount = prefetchCount * 2;
+		if (prefetchCount > _maxPrefetchCount) {
+			prefetchCount = _maxPrefetchCount;
+		}
+	}
+
+	if (prefetchCount != _currentPrefetchCount) {
+		CAF_CM_LOG_DEBUG_VA4(
+				"basicQos [prefetch=%d->%d][ms/msg=%Lu][ack latency ms=%Lu]",
+				_currentPrefetchCount,
+				prefetchCount,
+				perMessageMs,
+				_ackLatencyMs);
+		_channel->basicQos(0, prefetchCount, false);
+		_currentPrefetchCount = prefetchCount;
+	}
+}
+
 void BlockingQueueConsumer::destroyQueueItem(gpointer data) {
 	reinterpret_cast<Delivery*>(data)->Release();
 }
@@ -47,15 +47,18 @@ void CachingConnectionFactory::CachedChannelHandler::logicalClose() {
 		// Allow for multiple close calls - if this channel is already
 		// in the cached channels container then noop else add it
 		// to the cached channel collection
-		TSmartConstIterator<ProxyDeque> proxy(*(_parent->_cachedChannels));
-		while (proxy) {
-			if (*proxy == this) {
+		ProxyDeque::const_iterator proxy = _parent->_cachedChannels->begin();
+		while (proxy != _parent->_cachedChannels->end()) {
+			if (proxy->channel == this) {
 				break;
 			}
 			proxy++;
 		}
-		if (!proxy) {
-			_parent->_cachedChannels->push_back(this);
+		if (proxy == _parent->_cachedChannels->end()) {
+			CachedChannel cachedChannel;
+			cachedChannel.channel = this;
+			cachedChannel.idleSinceMs = CDateTimeUtils::getTimeMs();
+			_parent->_cachedChannels->push_back(cachedChannel);
 		}
 	}
 }
@@ -289,6 +292,39 @@ void CachingConnectionFactory::CachedChannelHandler::basicReject(
 	return _channel->basicReject(deliveryTag, requeue);
 }
 
+AmqpClient::AmqpMethods::Confirm::SmartPtrSelectOk
+CachingConnectionFactory::CachedChannelHandler::confirmSelect(
+		const uint32 maxUnconfirmed) {
+	CAF_CM_FUNCNAME("confirmSelect");
+	CAF_CM_LOCK_UNLOCK;
+	checkChannel();
+	AmqpClient::AmqpMethods::Confirm::SmartPtrSelectOk selectOk;
+	try {
+		selectOk = _channel->confirmSelect(maxUnconfirmed);
+	}
+	CAF_CM_CATCH_ALL;
+	postProcessCall(CAF_CM_GETEXCEPTION);
+	return selectOk;
+}
+
+bool CachingConnectionFactory::CachedChannelHandler::waitForConfirms(
+		const uint32 timeoutMs) {
+	CAF_CM_FUNCNAME("waitForConfirms");
+	CAF_CM_LOCK_UNLOCK;
+	checkChannel();
+	bool isAcked = false;
+	try {
+		isAcked = _channel->waitForConfirms(timeoutMs);
+	}
+	CAF_CM_CATCH_ALL;
+	postProcessCall(CAF_CM_GETEXCEPTION);
+	return isAcked;
+}
+
+uint64 CachingConnectionFactory::CachedChannelHandler::getNextPublishSeqNo() {
+	return _channel->getNextPublishSeqNo();
+}
+
 AmqpClient::AmqpMethods::Exchange::SmartPtrDeclareOk
 CachingConnectionFactory::CachedChannelHandler::exchangeDeclare(
 	const std::string& exchange,
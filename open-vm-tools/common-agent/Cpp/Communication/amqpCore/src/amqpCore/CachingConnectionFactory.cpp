@@ -19,6 +19,14 @@ CachingConnectionFactory::CachingConnectionFactory() :
 	_isInitialized(false),
 	_isActive(true),
 	_channelCacheSize(2),
+	_channelIdleTimeoutMs(0),
+	_channelCachePrewarm(0),
+	_checkoutCount(0),
+	_cacheHitCount(0),
+	_channelCreateCount(0),
+	_idleEvictionCount(0),
+	_checkoutWaitMs(0),
+	_maxCheckoutWaitMs(0),
 	CAF_CM_INIT_LOG("CachingConnectionFactory") {
 	_connectionMonitor.CreateInstance();
 	_connectionMonitor->initialize();
@@ -105,6 +113,16 @@ void CachingConnectionFactory::destroy() {
 	// underneath the _connection, store a temporary reference to it.
 	SmartPtrChannelCachingConnectionProxy connectionRef = _connection;
 	CAF_CM_LOCK_UNLOCK1(_connectionMonitor);
+	{
+		CAF_CM_LOCK_UNLOCK1(_cachedChannelsMonitor);
+		CAF_CM_LOG_INFO_VA5(
+				"Channel cache stats [checkouts=%s][hits=%s][created=%s][idleEvictions=%s][maxWaitMs=%s]",
+				CStringConv::toString<uint64>(_checkoutCount).c_str(),
+				CStringConv::toString<uint64>(_cacheHitCount).c_str(),
+				CStringConv::toString<uint64>(_channelCreateCount).c_str(),
+				CStringConv::toString<uint64>(_idleEvictionCount).c_str(),
+				CStringConv::toString<uint64>(_maxCheckoutWaitMs).c_str());
+	}
 	if (_connection) {
 		_connection->destroy();
 		_connection = NULL;
@@ -116,22 +134,85 @@ uint32 CachingConnectionFactory::getChannelCacheSize() {
 	return _channelCacheSize;
 }
 
+uint32 CachingConnectionFactory::getIdleChannelCount() {
+	CAF_CM_LOCK_UNLOCK1(_cachedChannelsMonitor);
+	return static_cast<uint32>(_cachedChannels ? _cachedChannels->size() : 0);
+}
+
+uint64 CachingConnectionFactory::getChannelCheckoutCount() {
+	CAF_CM_LOCK_UNLOCK1(_cachedChannelsMonitor);
+	return _checkoutCount;
+}
+
+uint64 CachingConnectionFactory::getChannelCacheHitCount() {
+	CAF_CM_LOCK_UNLOCK1(_cachedChannelsMonitor);
+	return _cacheHitCount;
+}
+
+uint64 CachingConnectionFactory::getChannelCreateCount() {
+	CAF_CM_LOCK_UNLOCK1(_cachedChannelsMonitor);
+	return _channelCreateCount;
+}
+
+uint64 CachingConnectionFactory::getChannelIdleEvictionCount() {
+	CAF_CM_LOCK_UNLOCK1(_cachedChannelsMonitor);
+	return _idleEvictionCount;
+}
+
+uint64 CachingConnectionFactory::getChannelCheckoutWaitMs() {
+	CAF_CM_LOCK_UNLOCK1(_cachedChannelsMonitor);
+	return _checkoutWaitMs;
+}
+
+uint64 CachingConnectionFactory::getMaxChannelCheckoutWaitMs() {
+	CAF_CM_LOCK_UNLOCK1(_cachedChannelsMonitor);
+	return _maxCheckoutWaitMs;
+}
+
 AmqpClient::SmartPtrChannel CachingConnectionFactory::getChannel() {
 	CAF_CM_FUNCNAME_VALIDATE("getChannel");
 	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+	const uint64 startTimeMs = CDateTimeUtils::getTimeMs();
 	AmqpClient::SmartPtrChannel channel;
+	ProxyDeque expiredChannels;
 	{
 		CAF_CM_LOCK_UNLOCK1(_cachedChannelsMonitor);
+		++_checkoutCount;
+
+		// The most recently returned channel is handed out first so the
+		// ones that have been idle the longest collect at the front.
+		if (_channelIdleTimeoutMs) {
+			while (!_cachedChannels->empty() &&
+					!CDateTimeUtils::calcRemainingTime(
+							_cachedChannels->front().idleSinceMs,
+							_channelIdleTimeoutMs)) {
+				expiredChannels.push_back(_cachedChannels->front());
+				_cachedChannels->pop_front();
+				++_idleEvictionCount;
+			}
+		}
 		if (_cachedChannels->size()) {
-			channel = _cachedChannels->front();
-			_cachedChannels->pop_front();
+			channel = _cachedChannels->back().channel;
+			_cachedChannels->pop_back();
+			++_cacheHitCount;
 		}
 	}
+	closeCachedChannels(expiredChannels);
+
 	if (channel) {
 		CAF_CM_LOG_DEBUG_VA1("found cached rabbit channel #%d", channel->getChannelNumber());
 	} else {
 		channel = newCachedChannelProxy();
 	}
+
+	const uint64 waitMs = CDateTimeUtils::getTimeMs() - startTimeMs;
+	{
+		CAF_CM_LOCK_UNLOCK1(_cachedChannelsMonitor);
+		_checkoutWaitMs += waitMs;
+		if (waitMs > _maxCheckoutWaitMs) {
+			_maxCheckoutWaitMs = waitMs;
+		}
+	}
 	return channel;
 }
 
@@ -151,6 +232,14 @@ void CachingConnectionFactory::setChannelCacheSize(uint32 cacheSize) {
 	_channelCacheSize = cacheSize;
 }
 
+void CachingConnectionFactory::setChannelIdleTimeout(uint32 idleTimeoutMs) {
+	_channelIdleTimeoutMs = idleTimeoutMs;
+}
+
+void CachingConnectionFactory::setChannelCachePrewarm(uint32 prewarmCount) {
+	_channelCachePrewarm = prewarmCount;
+}
+
 void CachingConnectionFactory::addConnectionListener(
 		const SmartPtrConnectionListener& listener) {
 	CAF_CM_FUNCNAME_VALIDATE("addConnectionListener");
@@ -165,24 +254,80 @@ void CachingConnectionFactory::addConnectionListener(
 SmartPtrConnection CachingConnectionFactory::createConnection() {
 	CAF_CM_FUNCNAME_VALIDATE("createConnection");
 	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
-	CAF_CM_LOCK_UNLOCK1(_connectionMonitor);
-	if (!_connection) {
-		_connection.CreateInstance();
-		_connection->init(createBareConnection(), this);
-		getConnectionListener()->onCreate(_connection);
+	SmartPtrChannelCachingConnectionProxy connection;
+	bool isNewConnection = false;
+	{
+		CAF_CM_LOCK_UNLOCK1(_connectionMonitor);
+		if (!_connection) {
+			_connection.CreateInstance();
+			_connection->init(createBareConnection(), this);
+			getConnectionListener()->onCreate(_connection);
+			isNewConnection = true;
+		}
+		connection = _connection;
+	}
+
+	// Channel opens are network round trips; don't hold up other callers
+	if (isNewConnection) {
+		prewarmChannels(connection);
 	}
-	return _connection;
+	return connection;
 }
 
 void CachingConnectionFactory::reset() {
 	CAF_CM_FUNCNAME("reset");
 	_isActive = false;
 	CAF_CM_LOCK_UNLOCK1(_cachedChannelsMonitor);
-	for (TSmartIterator<ProxyDeque> channel(*_cachedChannels);
-			channel;
+	closeCachedChannels(*_cachedChannels);
+	try {
+		_cachedChannels->clear();
+	}
+	CAF_CM_CATCH_ALL;
+	CAF_CM_LOG_CRIT_CAFEXCEPTION;
+	CAF_CM_CLEAREXCEPTION;
+	_isActive = true;
+	_connection = NULL;
+}
+
+/*
+ * Opens channels on a freshly created connection and parks them in the
+ * cache. Called without _connectionMonitor held; the channels are opened on
+ * the given connection only, so a connection that has already gone away is
+ * not replaced from here. Failures are logged only; channels will then be
+ * created on demand.
+ */
+void CachingConnectionFactory::prewarmChannels(
+		const SmartPtrChannelCachingConnectionProxy& connection) {
+	CAF_CM_FUNCNAME("prewarmChannels");
+	const uint32 prewarmCount = std::min(_channelCachePrewarm, _channelCacheSize);
+	try {
+		for (uint32 count = 0; count < prewarmCount; ++count) {
+			if (!connection->isOpen()) {
+				CAF_CM_LOG_DEBUG_VA1("Connection closed after pre-warming %d channels", count);
+				return;
+			}
+			// close() on a cached channel returns it to the cache
+			newCachedChannelProxy(connection->createBareChannel())->close();
+		}
+		if (prewarmCount) {
+			CAF_CM_LOG_DEBUG_VA1("Pre-warmed %d channels", prewarmCount);
+		}
+	}
+	CAF_CM_CATCH_ALL;
+	CAF_CM_LOG_WARN_CAFEXCEPTION;
+	CAF_CM_CLEAREXCEPTION;
+}
+
+/*
+ * Physically closes the target channels of cached channel proxies.
+ */
+void CachingConnectionFactory::closeCachedChannels(ProxyDeque& channels) {
+	CAF_CM_FUNCNAME("closeCachedChannels");
+	for (ProxyDeque::iterator channel = channels.begin();
+			channel != channels.end();
 			channel++) {
 		try {
-			AmqpClient::SmartPtrChannel target = channel->getTargetChannel();
+			AmqpClient::SmartPtrChannel target = channel->channel->getTargetChannel();
 			if (target) {
 				target->close();
 			}
@@ -191,18 +336,18 @@ void CachingConnectionFactory::reset() {
 		CAF_CM_LOG_CRIT_CAFEXCEPTION;
 		CAF_CM_CLEAREXCEPTION;
 	}
-	try {
-		_cachedChannels->clear();
-	}
-	CAF_CM_CATCH_ALL;
-	CAF_CM_LOG_CRIT_CAFEXCEPTION;
-	CAF_CM_CLEAREXCEPTION;
-	_isActive = true;
-	_connection = NULL;
 }
 
 SmartPtrChannelProxy CachingConnectionFactory::newCachedChannelProxy(){
-	AmqpClient::SmartPtrChannel channel = createBareChannel();
+	return newCachedChannelProxy(createBareChannel());
+}
+
+SmartPtrChannelProxy CachingConnectionFactory::newCachedChannelProxy(
+		const AmqpClient::SmartPtrChannel& channel) {
+	{
+		CAF_CM_LOCK_UNLOCK1(_cachedChannelsMonitor);
+		++_channelCreateCount;
+	}
 	SmartPtrCachedChannelHandler proxy;
 	proxy.CreateInstance();
 	proxy->init(this, channel);
@@ -28,6 +28,9 @@ SimpleMessageListenerContainer::SimpleMessageListenerContainer() :
 	_acknowledgeMode(ACKNOWLEDGEMODE_NONE),
 	_receiveTimeout(5000),
 	_prefetchCount(0),
+	_maxPrefetchCount(0),
+	_ackBatchSize(1),
+	_ackBatchTimeMs(0),
 	_txSize(1),
 	_recoveryInterval(30000),
 	CAF_CM_INIT_LOG("SimpleMessageListenerContainer") {
@@ -64,6 +67,28 @@ void SimpleMessageListenerContainer::setPrefetchCount(
 	_prefetchCount = prefetchCount;
 }
 
+void SimpleMessageListenerContainer::setMaxPrefetchCount(
+		const uint32 maxPrefetchCount) {
+	CAF_CM_FUNCNAME_VALIDATE("setMaxPrefetchCount");
+	CAF_CM_PRECOND_ISNOTINITIALIZED(_isInitialized);
+	_maxPrefetchCount = maxPrefetchCount;
+}
+
+void SimpleMessageListenerContainer::setAckBatchSize(
+		const uint32 ackBatchSize) {
+	CAF_CM_FUNCNAME_VALIDATE("setAckBatchSize");
+	CAF_CM_PRECOND_ISNOTINITIALIZED(_isInitialized);
+	CAF_CM_VALIDATE_NOTZERO(ackBatchSize);
+	_ackBatchSize = ackBatchSize;
+}
+
+void SimpleMessageListenerContainer::setAckBatchTime(
+		const uint32 ackBatchTimeMs) {
+	CAF_CM_FUNCNAME_VALIDATE("setAckBatchTime");
+	CAF_CM_PRECOND_ISNOTINITIALIZED(_isInitialized);
+	_ackBatchTimeMs = ackBatchTimeMs;
+}
+
 void SimpleMessageListenerContainer::setReceiveTimeout(
 		const uint32 receiveTimeout) {
 	CAF_CM_FUNCNAME_VALIDATE("setReceiveTimeout");
@@ -130,11 +155,15 @@ void SimpleMessageListenerContainer::start(const uint32 timeout) {
 	// the consumer will stall since the broker will not receive an ack for delivered
 	// messages
 	const uint32 actualPrefetchCount = _prefetchCount > _txSize ? _prefetchCount : _txSize;
-	CAF_CM_LOG_DEBUG_VA3(
-			"Config: [prefetchCount=%d][txSize=%d][actualPrefetchCount=%d]",
+	CAF_CM_LOG_DEBUG_VA6(
+			"Config: [prefetchCount=%d][txSize=%d][actualPrefetchCount=%d]"
+			"[maxPrefetchCount=%d][ackBatchSize=%d][ackBatchTimeMs=%d]",
 			_prefetchCount,
 			_txSize,
-			actualPrefetchCount);
+			actualPrefetchCount,
+			_maxPrefetchCount,
+			_ackBatchSize,
+			_ackBatchTimeMs);
 
 	// At this level simply allow all headers to pass through.
 	// The message listener consuming the message will have
@@ -150,6 +179,8 @@ void SimpleMessageListenerContainer::start(const uint32 timeout) {
 			_acknowledgeMode,
 			actualPrefetchCount,
 			_queue);
+	_consumer->setAckBatching(_ackBatchSize, _ackBatchTimeMs);
+	_consumer->setMaxPrefetchCount(_maxPrefetchCount);
 
 	SmartPtrAsyncMessageProcessingConsumer processor;
 	processor.CreateInstance();
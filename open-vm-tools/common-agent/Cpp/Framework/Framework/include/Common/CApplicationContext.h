@@ -11,6 +11,10 @@
 
 #include "Common/IAppContext.h"
 
+#include "Common/CAutoMutex.h"
+#include "Common/CThreadSignal.h"
+#include "Common/CWorkStealingThreadPool.h"
+#include "Exception/CCafException.h"
 #include "IBean.h"
 
 namespace Caf {
@@ -40,6 +44,7 @@ private:
 
 	struct CBeanNode {
 		CBeanNode() :
+			_isLazyInit(false),
 			_isInitialized(false) {}
 
 		std::string _id;
@@ -47,6 +52,7 @@ private:
 		SmartPtrIBean _bean;
 		CBeanCtorArgCollection _ctorArgs;
 		Cmapstrstr _properties;
+		bool _isLazyInit;
 		bool _isInitialized;
 	};
 	CAF_DECLARE_SMART_POINTER(CBeanNode);
@@ -64,6 +70,43 @@ private:
 	// key=bean id
 	typedef std::map<std::string, SmartPtrCBeanNode> CBeanCollection;
 
+	// Tracks the beans of one graph level being initialized on the shared pool
+	struct CBeanInitBatch {
+		CBeanInitBatch() :
+			_pendingCount(0),
+			_exception(NULL) {}
+
+		SmartPtrCAutoMutex _mutex;
+		CThreadSignal _doneSignal;
+		uint32 _pendingCount;
+		CCafException* _exception;
+	};
+	CAF_DECLARE_SMART_POINTER(CBeanInitBatch);
+
+	class CBeanInitTask : public CWorkStealingThreadPool::IThreadTask {
+	public:
+		CBeanInitTask();
+		virtual ~CBeanInitTask();
+
+		void init(
+				const CApplicationContext* context,
+				const CBeanCollection* beanCollection,
+				const SmartPtrCBeanNode& beanNode,
+				const SmartPtrCBeanInitBatch& batch);
+
+		void run();
+
+	private:
+		const CApplicationContext* _context;
+		const CBeanCollection* _beanCollection;
+		SmartPtrCBeanNode _beanNode;
+		SmartPtrCBeanInitBatch _batch;
+		CAF_CM_CREATE;
+		CAF_CM_CREATE_LOG;
+		CAF_CM_DECLARE_NOCOPY(CBeanInitTask);
+	};
+	CAF_DECLARE_SMART_POINTER(CBeanInitTask);
+
 public:
 	CApplicationContext();
 	virtual ~CApplicationContext();
@@ -74,6 +117,7 @@ public:
 
 	void terminate();
 
+	/// Beans declared with lazy-init="true" are left out until getBean() creates them
 	SmartPtrCBeans getBeans() const;
 
 public: // IApplicationContext
@@ -85,6 +129,9 @@ private:
 	CBeanGraph::ClistVertexEdges _beanTopologySort;
 	Cdeqstr _filenameCollection;
 
+	// Guards the creation of lazy-init beans
+	mutable SmartPtrCAutoMutex _lazyBeanMutex;
+
 private:
 	std::string getDefaultBeanConfigFile() const;
 
@@ -101,6 +148,18 @@ private:
 			CBeanCollection& beanCollection,
 			CBeanGraph::ClistVertexEdges& beanTopologySort) const;
 
+	void initializeBeanLevel(
+			const CBeanCollection& beanCollection,
+			const CBeanGraph::ClistVertexEdges& beanLevel) const;
+
+	void initializeBeanNode(
+			const CBeanCollection& beanCollection,
+			const SmartPtrCBeanNode& beanNode) const;
+
+	void initializeLazyBean(
+			const CBeanCollection& beanCollection,
+			const SmartPtrCBeanNode& beanNode) const;
+
 	void terminateBeans(CBeanGraph::ClistVertexEdges& beanTopologySort) const;
 
 private:
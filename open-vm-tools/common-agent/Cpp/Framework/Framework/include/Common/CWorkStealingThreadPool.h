@@ -0,0 +1,171 @@
+/*
+ *  Created on: Oct 15, 2026
+ *
+ *	Copyright (C) 2026 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+#ifndef CWORKSTEALINGTHREADPOOL_H_
+#define CWORKSTEALINGTHREADPOOL_H_
+
+#include "ICafObject.h"
+#include "Common/CAutoMutex.h"
+#include "Common/CThreadSignal.h"
+
+namespace Caf {
+
+class CWorkStealingThreadPool;
+CAF_DECLARE_SMART_POINTER(CWorkStealingThreadPool);
+
+/**
+ * @brief A fixed set of worker threads, each with its own task queues.
+ * <p>
+ * Tasks submitted from outside the pool are spread across the workers; tasks
+ * submitted by a task stay on the submitting worker. A worker that runs out of
+ * work takes tasks from the other workers so a long-running task does not hold
+ * up the ones queued behind it. Higher priority tasks are always taken first.
+ * <p>
+ * The shutdown behavior is to run all queued tasks, then stop the workers.
+ */
+class COMMONAGGREGATOR_LINKAGE CWorkStealingThreadPool {
+public:
+	/**
+	 * @brief Interface for task objects
+	 */
+	struct __declspec(novtable) IThreadTask : public ICafObject {
+		/**
+		 * @brief execute task
+		 */
+		virtual void run() = 0;
+	};
+	CAF_DECLARE_SMART_INTERFACE_POINTER(IThreadTask);
+
+	/** @brief Task priorities, highest first */
+	typedef enum {
+		PRIORITY_HIGH,
+		PRIORITY_NORMAL,
+		PRIORITY_LOW,
+		PRIORITY_COUNT
+	} EPriority;
+
+	/** @brief A simple structure to report some statistics */
+	struct Stats {
+		/** The number of worker threads */
+		uint32 threadCount;
+		/** The number of tasks waiting to run */
+		uint32 queuedTaskCount;
+		/** The number of tasks running */
+		uint32 activeTaskCount;
+		/** The number of tasks that have run */
+		uint64 completeTaskCount;
+		/** The number of tasks taken from another worker's queue */
+		uint64 stolenTaskCount;
+		/** The total time in milliseconds tasks spent queued */
+		uint64 totalQueueWaitMs;
+		/** The longest time in milliseconds a task spent queued */
+		uint64 maxQueueWaitMs;
+	};
+
+public:
+	/**
+	 * @brief Returns the process-wide pool, creating it on first use
+	 * <p>
+	 * The thread count comes from the optional <i>shared_thread_pool_size</i>
+	 * global application configuration setting.
+	 */
+	static SmartPtrCWorkStealingThreadPool getSharedPool();
+
+	/**
+	 * @brief Terminates the process-wide pool if it was created
+	 */
+	static void termSharedPool();
+
+public:
+	CWorkStealingThreadPool();
+	virtual ~CWorkStealingThreadPool();
+
+	/**
+	 * @brief initialize the thread pool
+	 * @param poolName a friendly name for the pool to aid in debugging
+	 * @param threadCount the number of worker threads
+	 */
+	void init(
+			const std::string& poolName,
+			uint32 threadCount);
+
+	/**
+	 * @brief terminate the thread pool
+	 * All queued tasks will be run before this method returns
+	 */
+	void term();
+
+	/**
+	 * @brief add a task to the pool
+	 * @param task the task to add
+	 * @param priority the task priority
+	 */
+	void enqueue(
+			const SmartPtrIThreadTask& task,
+			const EPriority priority = PRIORITY_NORMAL);
+
+	/** @return the current statistics */
+	Stats getStats() const;
+
+private:
+	struct QueuedTask {
+		SmartPtrIThreadTask task;
+		uint64 enqueuedMs;
+	};
+	typedef std::deque<QueuedTask> TaskDeque;
+
+	struct Worker {
+		CWorkStealingThreadPool* pool;
+		uint32 index;
+		GThread* thread;
+		SmartPtrCAutoMutex mutex;
+		TaskDeque queues[PRIORITY_COUNT];
+	};
+	CAF_DECLARE_SMART_POINTER(Worker);
+	typedef std::vector<SmartPtrWorker> WorkerVector;
+
+	static gpointer workerFunc(gpointer context);
+
+	void runWorker(Worker* worker);
+
+	bool takeTask(Worker* worker, QueuedTask& queuedTask);
+
+	void stopWorkers();
+
+private:
+	/** Default number of threads in the shared pool */
+	static const uint32 DEFAULT_SHARED_THREAD_COUNT;
+
+	/** Backstop for missed wakeups of idle workers in milliseconds */
+	static const uint32 IDLE_WAIT_MS;
+
+	static SmartPtrCWorkStealingThreadPool _sharedPool;
+
+private:
+	bool _isInitialized;
+	volatile bool _isShuttingDown;
+	std::string _poolName;
+	WorkerVector _workers;
+
+	// Guards the counters below and the idle workers' wait
+	mutable SmartPtrCAutoMutex _poolMutex;
+	CThreadSignal _idleSignal;
+	uint32 _nextWorker;
+	uint32 _queuedTaskCount;
+	uint32 _activeTaskCount;
+	uint64 _completeTaskCount;
+	uint64 _stolenTaskCount;
+	uint64 _totalQueueWaitMs;
+	uint64 _maxQueueWaitMs;
+
+	CAF_CM_CREATE;
+	CAF_CM_CREATE_LOG;
+	CAF_CM_DECLARE_NOCOPY(CWorkStealingThreadPool);
+};
+
+}
+
+#endif /* CWORKSTEALINGTHREADPOOL_H_ */
@@ -40,6 +40,8 @@ namespace Caf {
 	extern FRAMEWORK_LINKAGE const char* _sAppConfigGlobalParamOutputDir;
 	extern FRAMEWORK_LINKAGE const char* _sAppConfigGlobalParamDbDir;
 	extern FRAMEWORK_LINKAGE const char* _sAppConfigGlobalThreadStackSizeKb;
+	extern FRAMEWORK_LINKAGE const char* _sAppConfigGlobalSharedThreadPoolSize;
+	extern FRAMEWORK_LINKAGE const char* _sAppConfigGlobalParallelBeanInit;
 
 	extern FRAMEWORK_LINKAGE const GUID CAFCOMMON_GUID_NULL;
 
@@ -31,6 +31,9 @@ public:
 public:
 	SmartPtrIIntMessage receive();
 	SmartPtrIIntMessage receive(const int32 timeout);
+	SmartPtrCMessageCollection receiveBatch(
+		const uint32 maxMessages,
+		const int32 timeout);
 	SmartPtrCPollerMetadata getPollerMetadata() const;
 
 protected:
@@ -43,6 +46,17 @@ protected:
 	 */
 	virtual SmartPtrIIntMessage doReceive(const int32 timeout) = 0;
 
+	/**
+	 * Adds up to maxMessages messages to the collection. The timeout applies
+	 * to the first message only. The default calls doReceive once per message;
+	 * subclasses that can hand over several messages more cheaply than that
+	 * should override it.
+	 */
+	virtual void doReceiveBatch(
+		const uint32 maxMessages,
+		const int32 timeout,
+		CMessageCollection& messages);
+
 	void setPollerMetadata(const SmartPtrCPollerMetadata& pollerMetadata);
 
 	void setPollerMetadata(const SmartPtrIDocument& pollerDoc);
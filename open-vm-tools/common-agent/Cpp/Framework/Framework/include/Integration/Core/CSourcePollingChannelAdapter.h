@@ -9,6 +9,7 @@
 #define CSourcePollingChannelAdapter_h_
 
 #include "Common/CThreadSignal.h"
+#include "Exception/CCafException.h"
 
 #include "Integration/Dependencies/CPollerMetadata.h"
 #include "Integration/IErrorHandler.h"
@@ -44,6 +45,12 @@ public: // IRunnable
 private:
 	bool getIsCancelled() const;
 
+	void dispatchMessage(const SmartPtrIIntMessage& message);
+
+	void handleError(
+		const CCafException* cafException,
+		const SmartPtrIIntMessage& message);
+
 private:
 	bool _isInitialized;
 	bool _isCancelled;
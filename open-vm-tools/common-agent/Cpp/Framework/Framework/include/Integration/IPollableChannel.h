@@ -22,6 +22,12 @@ struct __declspec(novtable)
 
 	virtual SmartPtrIIntMessage receive() = 0;
 	virtual SmartPtrIIntMessage receive(const int32 timeout) = 0;
+
+	/// Receives up to maxMessages messages in one pass. Only the first
+	/// receive waits for the timeout; the rest take what is already there.
+	virtual SmartPtrCMessageCollection receiveBatch(
+		const uint32 maxMessages,
+		const int32 timeout) = 0;
 	virtual SmartPtrCPollerMetadata getPollerMetadata() const = 0;
 };
 
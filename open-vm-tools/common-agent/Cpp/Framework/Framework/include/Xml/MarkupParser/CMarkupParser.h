@@ -49,6 +49,8 @@ struct ElementName : public std::binary_function<SmartPtrElement, std::string, b
 
 SmartPtrElement MARKUPPARSER_LINKAGE parseString(const std::string& xml);
 
+SmartPtrElement MARKUPPARSER_LINKAGE parseBuffer(const char* xml, const size_t length);
+
 SmartPtrElement MARKUPPARSER_LINKAGE parseFile(const std::string& file);
 
 typedef Element::Children::iterator ChildIterator;
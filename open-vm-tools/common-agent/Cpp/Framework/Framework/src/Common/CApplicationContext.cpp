@@ -19,6 +19,8 @@ using namespace Caf;
 CApplicationContext::CApplicationContext(void) :
 	m_isInitialized(false),
 	CAF_CM_INIT_LOG("CApplicationContext") {
+	_lazyBeanMutex.CreateInstance();
+	_lazyBeanMutex->initialize();
 }
 
 CApplicationContext::~CApplicationContext(void) {
@@ -99,9 +101,11 @@ IAppContext::SmartPtrCBeans CApplicationContext::getBeans() const {
 	beans.CreateInstance();
 	for (TSmartConstMapIterator<CBeanCollection> beanIter(_beanCollection);
 		beanIter; beanIter++) {
-		beans->insert(CBeans::value_type(
-			beanIter.getKey().c_str(),
-			beanIter->_bean));
+		if (!beanIter->_isLazyInit) {
+			beans->insert(CBeans::value_type(
+				beanIter.getKey().c_str(),
+				beanIter->_bean));
+		}
 	}
 
 	return beans;
@@ -124,7 +128,16 @@ SmartPtrIBean CApplicationContext::getBean(const std::string& beanId) const {
 	CAF_CM_LOG_DEBUG_VA1(
 			"Bean Found - %s",
 			beanId.c_str());
-	return iter->second->_bean;
+
+	const SmartPtrCBeanNode beanNode = iter->second;
+	if (beanNode->_isLazyInit) {
+		CAF_CM_LOCK_UNLOCK1(_lazyBeanMutex);
+		if (!beanNode->_isInitialized) {
+			initializeLazyBean(_beanCollection, beanNode);
+		}
+	}
+
+	return beanNode->_bean;
 }
 
 std::string CApplicationContext::getDefaultBeanConfigFile() const {
@@ -169,6 +182,8 @@ void CApplicationContext::parseBeanConfig(
 			const std::string beanId = beanElement->findRequiredAttribute("id");
 			CAF_CM_LOG_DEBUG_VA1("Parsing bean [id=%s]", beanId.c_str());
 			const std::string beanClass = beanElement->findRequiredAttribute("class");
+			const bool isLazyInit =
+					(beanElement->findOptionalAttribute("lazy-init") == "true");
 			CAF_CM_LOG_DEBUG_VA2(
 					"Checking bean class [id=%s][class=%s]",
 					beanId.c_str(),
@@ -264,6 +279,7 @@ void CApplicationContext::parseBeanConfig(
 			beanNode->_class = beanClass;
 			beanNode->_ctorArgs = beanCtorArgs;
 			beanNode->_properties = beanProperties;
+			beanNode->_isLazyInit = isLazyInit;
 
 			if (!beanCollection.insert(
 					CBeanCollection::value_type(
@@ -295,6 +311,8 @@ void CApplicationContext::createBeanGraph(
 	CAF_CM_FUNCNAME("createBeanGraph");
 
 	// Iterate the bean collection and create the beans. They will not be initialized.
+	// Lazy-init beans are left alone so their modules are not loaded until
+	// getBean() asks for them.
 	// Two name sets will be built: bean names and contstructor-arg ref names.
 	// These two sets will be compared to ensure that all referenced beans exist.
 	Csetstr beanNames;
@@ -304,11 +322,18 @@ void CApplicationContext::createBeanGraph(
 			beanIter++) {
 
 		// Create the bean and add it to the collection
-		CAF_CM_LOG_DEBUG_VA2(
-				"Creating bean [id=%s][class=%s]",
-				beanIter.getKey().c_str(),
-				beanIter->_class.c_str());
-		beanIter->_bean.CreateInstance(beanIter->_class.c_str());
+		if (beanIter->_isLazyInit) {
+			CAF_CM_LOG_DEBUG_VA2(
+					"Deferring lazy-init bean [id=%s][class=%s]",
+					beanIter.getKey().c_str(),
+					beanIter->_class.c_str());
+		} else {
+			CAF_CM_LOG_DEBUG_VA2(
+					"Creating bean [id=%s][class=%s]",
+					beanIter.getKey().c_str(),
+					beanIter->_class.c_str());
+			beanIter->_bean.CreateInstance(beanIter->_class.c_str());
+		}
 
 		// Add the bean id to the beanNames set
 		if (!beanNames.insert(beanIter->_id).second) {
@@ -351,6 +376,29 @@ void CApplicationContext::createBeanGraph(
 				"One or more bean constructor-args references beans that are not defined.");
 	}
 
+	// An eagerly initialized bean cannot wait for a lazy-init bean it is
+	// constructed with
+	for (TSmartConstMapIterator<CBeanCollection> beanIter(beanCollection);
+			beanIter;
+			beanIter++) {
+		if (!beanIter->_isLazyInit) {
+			for (TConstMapIterator<CBeanCtorArgCollection> ctorArg(beanIter->_ctorArgs);
+					ctorArg;
+					ctorArg++) {
+				if ((CBeanCtorArg::REFERENCE == ctorArg->_type)
+						&& beanCollection.find(ctorArg->_value)->second->_isLazyInit) {
+					CAF_CM_EXCEPTIONEX_VA2(
+							InvalidArgumentException,
+							0,
+							"Bean constructor-arg references a lazy-init bean. "
+							"[bean id=%s][constructor-arg ref=%s]",
+							beanIter->_id.c_str(),
+							ctorArg->_value.c_str());
+				}
+			}
+		}
+	}
+
 	// Create a graph node for each bean
 	for (TSmartConstMapIterator<CBeanCollection> beanIter(beanCollection);
 			beanIter;
@@ -396,79 +444,199 @@ void CApplicationContext::createBeanGraph(
 void CApplicationContext::initializeBeans(
 		CBeanCollection& beanCollection,
 		CBeanGraph::ClistVertexEdges& beanTopologySort) const {
-	CAF_CM_FUNCNAME("initializeBeans");
-
-	for (TSmartIterator<CBeanGraph::ClistVertexEdges> beanNode(beanTopologySort);
+	CAF_CM_FUNCNAME_VALIDATE("initializeBeans");
+
+	// Group the eager beans by their depth in the graph. A bean only depends
+	// on beans in shallower levels, so the beans within a level can be
+	// initialized at the same time.
+	typedef std::map<std::string, uint32> CBeanLevelMap;
+	CBeanLevelMap beanLevelMap;
+	std::vector<CBeanGraph::ClistVertexEdges> beanLevels;
+	for (TSmartConstIterator<CBeanGraph::ClistVertexEdges> beanNode(beanTopologySort);
 			beanNode;
 			beanNode++) {
-		CAF_CM_LOG_DEBUG_VA1("Initializing bean %s", beanNode->_id.c_str());
-
-		// The bean should not have been initialized
-		if (beanNode->_isInitialized) {
-			CAF_CM_EXCEPTIONEX_VA1(
-					IllegalStateException,
-					0,
-					"Internal error: Bean [%s] has already been initialized.",
-					beanNode->_id.c_str());
+		if (beanNode->_isLazyInit) {
+			continue;
 		}
 
-		// Iterate the contructor-args and build a collection to
-		// pass to the bean initializer
-		IBean::Cargs beanInitArgs;
+		uint32 level = 0;
 		for (TConstMapIterator<CBeanCtorArgCollection> ctorArg(beanNode->_ctorArgs);
 				ctorArg;
 				ctorArg++) {
-			switch (ctorArg->_type) {
-				case CBeanCtorArg::REFERENCE: {
-						CBeanCollection::const_iterator bean = beanCollection.find(ctorArg->_value);
-						if (!bean->second->_isInitialized) {
-							CAF_CM_EXCEPTIONEX_VA2(
-									NullPointerException,
-									0,
-									"Internal error: Referenced bean not initialized. "
-									"[bean id=%s][constructor-arg ref=%s]",
-									beanNode->_id.c_str(),
-									ctorArg->_value.c_str());
-						}
-						beanInitArgs.push_back(IBean::CArg(bean->second->_bean));
-						CAF_CM_LOG_DEBUG_VA1(
-								"constructor-arg ref=%s",
-								ctorArg->_value.c_str());
-					}
-					break;
+			if (CBeanCtorArg::REFERENCE == ctorArg->_type) {
+				const uint32 refLevel = beanLevelMap[ctorArg->_value] + 1;
+				if (refLevel > level) {
+					level = refLevel;
+				}
+			}
+		}
+		beanLevelMap[beanNode->_id] = level;
 
-				case CBeanCtorArg::VALUE:
-					beanInitArgs.push_back(IBean::CArg(ctorArg->_value));
-					CAF_CM_LOG_DEBUG_VA1(
-							"constructor-arg value=%s",
-							ctorArg->_value.c_str());
-					break;
+		if (beanLevels.size() <= level) {
+			beanLevels.resize(level + 1);
+		}
+		beanLevels[level].push_back(*beanNode);
+	}
 
-				default:
-					CAF_CM_EXCEPTIONEX_VA2(
-							InvalidArgumentException,
-							0,
-							"Internal error: Bean constructor-arg is not a ref or value "
-							"[bean id=%s][constructor-arg index=%d]",
-							beanNode->_id.c_str(),
-							ctorArg.getKey());
+	const bool isParallel = AppConfigUtils::getOptionalBoolean(
+			_sAppConfigGlobalParallelBeanInit);
+	for (std::vector<CBeanGraph::ClistVertexEdges>::const_iterator beanLevel = beanLevels.begin();
+			beanLevel != beanLevels.end();
+			++beanLevel) {
+		if (isParallel && (beanLevel->size() > 1)) {
+			initializeBeanLevel(beanCollection, *beanLevel);
+		} else {
+			for (TSmartConstIterator<CBeanGraph::ClistVertexEdges> beanNode(*beanLevel);
+					beanNode;
+					beanNode++) {
+				initializeBeanNode(beanCollection, *beanNode);
 			}
 		}
+	}
+}
+
+void CApplicationContext::initializeBeanLevel(
+		const CBeanCollection& beanCollection,
+		const CBeanGraph::ClistVertexEdges& beanLevel) const {
+	CAF_CM_FUNCNAME("initializeBeanLevel");
+	CAF_CM_LOG_DEBUG_VA1("Initializing %d beans on the shared thread pool", beanLevel.size());
 
-		// Iterate the bean properties and resolve value references
-		SmartPtrIAppConfig appConfig = getAppConfig();
-		Cmapstrstr properties = beanNode->_properties;
+	SmartPtrCBeanInitBatch batch;
+	batch.CreateInstance();
+	batch->_mutex.CreateInstance();
+	batch->_mutex->initialize();
+	batch->_doneSignal.initialize("BeanInitBatch");
 
-		for (TMapIterator<Cmapstrstr> property(properties);
-				property;
-				property++) {
-			*property = appConfig->resolveValue(*property);
+	CAF_CM_LOCK_UNLOCK1(batch->_mutex);
+	try {
+		const SmartPtrCWorkStealingThreadPool threadPool =
+				CWorkStealingThreadPool::getSharedPool();
+		for (TSmartConstIterator<CBeanGraph::ClistVertexEdges> beanNode(beanLevel);
+				beanNode;
+				beanNode++) {
+			SmartPtrCBeanInitTask task;
+			task.CreateInstance();
+			task->init(this, &beanCollection, *beanNode, batch);
+			threadPool->enqueue(task, CWorkStealingThreadPool::PRIORITY_HIGH);
+			++batch->_pendingCount;
 		}
+	}
+	CAF_CM_CATCH_ALL;
 
-		// Initialize the bean
-		beanNode->_bean->initializeBean(beanInitArgs, properties);
-		beanNode->_isInitialized = true;
+	// The queued beans must finish even if queueing the rest failed
+	while (batch->_pendingCount) {
+		batch->_doneSignal.wait(batch->_mutex, 0);
 	}
+
+	if (batch->_exception) {
+		if (CAF_CM_ISEXCEPTION) {
+			batch->_exception->Release();
+		} else {
+			CAF_CM_GETEXCEPTION = batch->_exception;
+		}
+		batch->_exception = NULL;
+	}
+	CAF_CM_THROWEXCEPTION;
+}
+
+void CApplicationContext::initializeBeanNode(
+		const CBeanCollection& beanCollection,
+		const SmartPtrCBeanNode& beanNode) const {
+	CAF_CM_FUNCNAME("initializeBeanNode");
+
+	CAF_CM_LOG_DEBUG_VA1("Initializing bean %s", beanNode->_id.c_str());
+
+	// The bean should not have been initialized
+	if (beanNode->_isInitialized) {
+		CAF_CM_EXCEPTIONEX_VA1(
+				IllegalStateException,
+				0,
+				"Internal error: Bean [%s] has already been initialized.",
+				beanNode->_id.c_str());
+	}
+
+	// Iterate the contructor-args and build a collection to
+	// pass to the bean initializer
+	IBean::Cargs beanInitArgs;
+	for (TConstMapIterator<CBeanCtorArgCollection> ctorArg(beanNode->_ctorArgs);
+			ctorArg;
+			ctorArg++) {
+		switch (ctorArg->_type) {
+			case CBeanCtorArg::REFERENCE: {
+					CBeanCollection::const_iterator bean = beanCollection.find(ctorArg->_value);
+					if (!bean->second->_isInitialized) {
+						CAF_CM_EXCEPTIONEX_VA2(
+								NullPointerException,
+								0,
+								"Internal error: Referenced bean not initialized. "
+								"[bean id=%s][constructor-arg ref=%s]",
+								beanNode->_id.c_str(),
+								ctorArg->_value.c_str());
+					}
+					beanInitArgs.push_back(IBean::CArg(bean->second->_bean));
+					CAF_CM_LOG_DEBUG_VA1(
+							"constructor-arg ref=%s",
+							ctorArg->_value.c_str());
+				}
+				break;
+
+			case CBeanCtorArg::VALUE:
+				beanInitArgs.push_back(IBean::CArg(ctorArg->_value));
+				CAF_CM_LOG_DEBUG_VA1(
+						"constructor-arg value=%s",
+						ctorArg->_value.c_str());
+				break;
+
+			default:
+				CAF_CM_EXCEPTIONEX_VA2(
+						InvalidArgumentException,
+						0,
+						"Internal error: Bean constructor-arg is not a ref or value "
+						"[bean id=%s][constructor-arg index=%d]",
+						beanNode->_id.c_str(),
+						ctorArg.getKey());
+		}
+	}
+
+	// Iterate the bean properties and resolve value references
+	SmartPtrIAppConfig appConfig = getAppConfig();
+	Cmapstrstr properties = beanNode->_properties;
+
+	for (TMapIterator<Cmapstrstr> property(properties);
+			property;
+			property++) {
+		*property = appConfig->resolveValue(*property);
+	}
+
+	// Initialize the bean
+	beanNode->_bean->initializeBean(beanInitArgs, properties);
+	beanNode->_isInitialized = true;
+}
+
+void CApplicationContext::initializeLazyBean(
+		const CBeanCollection& beanCollection,
+		const SmartPtrCBeanNode& beanNode) const {
+	CAF_CM_FUNCNAME_VALIDATE("initializeLazyBean");
+
+	// Lazy-init beans may only be constructed with other lazy-init beans
+	// since the eager ones are already initialized
+	for (TConstMapIterator<CBeanCtorArgCollection> ctorArg(beanNode->_ctorArgs);
+			ctorArg;
+			ctorArg++) {
+		if (CBeanCtorArg::REFERENCE == ctorArg->_type) {
+			const SmartPtrCBeanNode refNode = beanCollection.find(ctorArg->_value)->second;
+			if (!refNode->_isInitialized) {
+				initializeLazyBean(beanCollection, refNode);
+			}
+		}
+	}
+
+	CAF_CM_LOG_DEBUG_VA2(
+			"Creating lazy-init bean [id=%s][class=%s]",
+			beanNode->_id.c_str(),
+			beanNode->_class.c_str());
+	beanNode->_bean.CreateInstance(beanNode->_class.c_str());
+	initializeBeanNode(beanCollection, beanNode);
 }
 
 void CApplicationContext::terminateBeans(CBeanGraph::ClistVertexEdges& beanTopologySort) const {
@@ -496,3 +664,52 @@ void CApplicationContext::terminateBeans(CBeanGraph::ClistVertexEdges& beanTopol
 		}
 	}
 }
+
+CApplicationContext::CBeanInitTask::CBeanInitTask() :
+	_context(NULL),
+	_beanCollection(NULL),
+	CAF_CM_INIT_LOG("CBeanInitTask") {
+}
+
+CApplicationContext::CBeanInitTask::~CBeanInitTask() {
+}
+
+void CApplicationContext::CBeanInitTask::init(
+		const CApplicationContext* context,
+		const CBeanCollection* beanCollection,
+		const SmartPtrCBeanNode& beanNode,
+		const SmartPtrCBeanInitBatch& batch) {
+	CAF_CM_FUNCNAME_VALIDATE("init");
+	CAF_CM_VALIDATE_PTR(context);
+	CAF_CM_VALIDATE_PTR(beanCollection);
+	CAF_CM_VALIDATE_SMARTPTR(beanNode);
+	CAF_CM_VALIDATE_SMARTPTR(batch);
+
+	_context = context;
+	_beanCollection = beanCollection;
+	_beanNode = beanNode;
+	_batch = batch;
+}
+
+void CApplicationContext::CBeanInitTask::run() {
+	CAF_CM_FUNCNAME("run");
+	try {
+		_context->initializeBeanNode(*_beanCollection, _beanNode);
+	}
+	CAF_CM_CATCH_ALL;
+
+	CAF_CM_LOCK_UNLOCK1(_batch->_mutex);
+	if (CAF_CM_ISEXCEPTION) {
+		CAF_CM_LOG_CRIT_CAFEXCEPTION;
+
+		// Keep the first failure for the initializing thread to throw
+		if (!_batch->_exception) {
+			_batch->_exception = CAF_CM_GETEXCEPTION;
+			_batch->_exception->AddRef();
+		}
+		CAF_CM_CLEAREXCEPTION;
+	}
+	if (--_batch->_pendingCount == 0) {
+		_batch->_doneSignal.signal();
+	}
+}
@@ -1232,6 +1232,15 @@ int64 FileSystemUtils::getFileSize(const std::string& filename) {
 	return rc == 0 ? stat_buf.st_size : -1;
 }
 
+int64 FileSystemUtils::getFileModifiedTime(const std::string& filename) {
+	CAF_CM_STATIC_FUNC_LOG_VALIDATE("FileSystemUtils", "getFileModifiedTime");
+	CAF_CM_VALIDATE_STRING(filename);
+
+	struct stat stat_buf;
+	int32 rc = ::stat(filename.c_str(), &stat_buf);
+	return rc == 0 ? static_cast<int64>(stat_buf.st_mtime) : -1;
+}
+
 std::string FileSystemUtils::saveTempTextFile(const std::string& filename_template, const std::string& contents) {
 	CAF_CM_STATIC_FUNC_LOG_VALIDATE("FileSystemUtils", "saveTempTextFile");
 
@@ -178,6 +178,9 @@ public:
 		const std::string &path);
 
 	static int64 getFileSize(const std::string& filename);
+
+	// Seconds since the epoch, or -1 if the file cannot be stat'ed
+	static int64 getFileModifiedTime(const std::string& filename);
 	
 	static std::string saveTempTextFile(const std::string& filename_template, const std::string& contents);
 	
@@ -11,6 +11,10 @@
 #ifndef WIN32
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
 #endif
 
 
@@ -27,6 +31,28 @@ void ProcessUtils::runSyncToFiles(
 
 	CAF_CM_STATIC_FUNC_LOG_VALIDATE("ProcessUtils", "runSyncToFiles");
 
+	CAF_CM_ENTER
+	{
+		CAF_CM_VALIDATE_STL(argv);
+		// stdoutPath is optional
+		// stderrPath is optional
+
+		ProcessUtils::runSyncToFiles(
+			argv, stdoutPath, stderrPath, priority, workingDirectory, 0);
+	}
+	CAF_CM_EXIT;
+}
+
+void ProcessUtils::runSyncToFiles(
+	const Cdeqstr& argv,
+	const std::string& stdoutPath,
+	const std::string& stderrPath,
+	const ProcessUtils::Priority priority,
+	const std::string& workingDirectory,
+	const uint32 timeoutSecs) {
+
+	CAF_CM_STATIC_FUNC_LOG_VALIDATE("ProcessUtils", "runSyncToFiles");
+
 	CAF_CM_ENTER
 	{
 		CAF_CM_VALIDATE_STL(argv);
@@ -36,7 +62,8 @@ void ProcessUtils::runSyncToFiles(
 		std::string stdoutContent;
 		std::string stderrContent;
 		ProcessUtils::runSync(
-			argv, stdoutPath, stderrPath, stdoutContent, stderrContent, priority, workingDirectory);
+			argv, stdoutPath, stderrPath, stdoutContent, stderrContent, priority,
+			workingDirectory, timeoutSecs);
 	}
 	CAF_CM_EXIT;
 }
@@ -55,7 +82,8 @@ void ProcessUtils::runSync(
 		CAF_CM_VALIDATE_STL(argv);
 
 		ProcessUtils::runSync(
-				argv, std::string(), std::string(), stdoutContent, stderrContent, priority, workingDirectory);
+				argv, std::string(), std::string(), stdoutContent, stderrContent, priority,
+				workingDirectory, 0);
 	}
 	CAF_CM_EXIT;
 }
@@ -68,7 +96,8 @@ void ProcessUtils::runSync(
 	std::string& stdoutContent,
 	std::string& stderrContent,
 	const ProcessUtils::Priority priority,
-	const std::string& workingDirectory) {
+	const std::string& workingDirectory,
+	const uint32 timeoutSecs) {
 	CAF_CM_STATIC_FUNC_LOG( "CProcessUtils", "runSync(Win)" );
 
 	const uint32 maxCmdLineLen = 1024;
@@ -163,7 +192,14 @@ void ProcessUtils::runSync(
 				cmdLine.c_str(), errorMsg.c_str());
 		} else {
 			// Successfully created the process.  Wait for it to finish.
-			::WaitForSingleObject(processInfo.hProcess, INFINITE);
+			const DWORD waitMs = (timeoutSecs == 0) ? INFINITE : timeoutSecs * 1000;
+			if (::WaitForSingleObject(processInfo.hProcess, waitMs) == WAIT_TIMEOUT) {
+				::TerminateProcess(processInfo.hProcess, ERROR_TIMEOUT);
+				::WaitForSingleObject(processInfo.hProcess, INFINITE);
+				CAF_CM_EXCEPTIONEX_VA2(TimeoutException, ERROR_TIMEOUT,
+					"Command timed out after %d secs and was killed - cmdLine: \"%s\"",
+					timeoutSecs, cmdLine.c_str());
+			}
 
 			// Get the exit code.
 			DWORD exitCode = 0;
@@ -275,7 +311,8 @@ void ProcessUtils::runSync(
 	std::string& stdoutContent,
 	std::string& stderrContent,
 	const ProcessUtils::Priority priority,
-	const std::string& workingDirectory) {
+	const std::string& workingDirectory,
+	const uint32 timeoutSecs) {
 	CAF_CM_STATIC_FUNC_LOG( "CProcessUtils", "runSync(NotWin)" );
 
 	GError *gError = NULL;
@@ -312,17 +349,29 @@ void ProcessUtils::runSync(
 		CAF_CM_LOG_INFO_VA1("Running command - %s", cmdLine.c_str());
 
 		gint gStatus = 0;
-		const bool isSuccessful = g_spawn_sync(
-			workingDirectory.length() == 0 ? NULL : workingDirectory.c_str(),
-			const_cast<char**>(argvNative),
-			NULL,							// child's environment, or NULL to inherit parent's
-			static_cast<GSpawnFlags>(0),	// GSpawnFlags - the defaults are fine
-			&SpawnChildSetup,				// child_setup - function to run in the child just before exec()
-			&niceLevel,						// user_data - user data for child_setup
-			&gStdout,
-			&gStderr,
-			&gStatus,
-			&gError);
+		bool isSuccessful = false;
+		if (timeoutSecs == 0) {
+			isSuccessful = g_spawn_sync(
+				workingDirectory.length() == 0 ? NULL : workingDirectory.c_str(),
+				const_cast<char**>(argvNative),
+				NULL,							// child's environment, or NULL to inherit parent's
+				static_cast<GSpawnFlags>(0),	// GSpawnFlags - the defaults are fine
+				&SpawnChildSetup,				// child_setup - function to run in the child just before exec()
+				&niceLevel,						// user_data - user data for child_setup
+				&gStdout,
+				&gStderr,
+				&gStatus,
+				&gError);
+		} else {
+			bool isTimedOut = false;
+			isSuccessful = spawnSyncWithTimeout(workingDirectory, argvNative, &niceLevel,
+				timeoutSecs, &gStdout, &gStderr, &gStatus, &gError, isTimedOut);
+			if (isTimedOut) {
+				CAF_CM_EXCEPTIONEX_VA2(TimeoutException, ETIMEDOUT,
+					"Command timed out after %d secs and was killed - cmdLine: \"%s\"",
+					timeoutSecs, cmdLine.c_str());
+			}
+		}
 
 		stdoutContent = (gStdout == NULL) ? std::string() : gStdout;
 		stderrContent = (gStderr == NULL) ? std::string() : gStderr;
@@ -362,6 +411,105 @@ void ProcessUtils::runSync(
 		throw;
 	}
 }
+
+/*
+ * Does what g_spawn_sync does, but gives up on the child once timeoutSecs
+ * have passed. A child that times out is killed and reaped before returning.
+ */
+bool ProcessUtils::spawnSyncWithTimeout(
+	const std::string& workingDirectory,
+	const char** argvNative,
+	int* niceLevel,
+	const uint32 timeoutSecs,
+	gchar** gStdout,
+	gchar** gStderr,
+	gint* gStatus,
+	GError** gError,
+	bool& isTimedOut) {
+	const uint32 pollSliceMs = 100;
+
+	isTimedOut = false;
+	GPid pid = 0;
+	gint stdoutFd = -1;
+	gint stderrFd = -1;
+	if (!g_spawn_async_with_pipes(
+			workingDirectory.length() == 0 ? NULL : workingDirectory.c_str(),
+			const_cast<char**>(argvNative),
+			NULL,
+			G_SPAWN_DO_NOT_REAP_CHILD,
+			&SpawnChildSetup,
+			niceLevel,
+			&pid,
+			NULL,
+			&stdoutFd,
+			&stderrFd,
+			gError)) {
+		return false;
+	}
+
+	GString* stdoutStr = g_string_new(NULL);
+	GString* stderrStr = g_string_new(NULL);
+	struct pollfd pollFds[2];
+	pollFds[0].fd = stdoutFd;
+	pollFds[0].events = POLLIN;
+	pollFds[1].fd = stderrFd;
+	pollFds[1].events = POLLIN;
+	GString* outputs[2] = { stdoutStr, stderrStr };
+
+	const uint64 startTimeMs = CDateTimeUtils::getTimeMs();
+	const uint64 timeoutMs = static_cast<uint64>(timeoutSecs) * 1000;
+	bool isReaped = false;
+	while (!isReaped) {
+		const uint64 elapsedMs = CDateTimeUtils::getTimeMs() - startTimeMs;
+		if (elapsedMs >= timeoutMs) {
+			isTimedOut = true;
+			break;
+		}
+		const int waitMs = static_cast<int>(std::min<uint64>(pollSliceMs, timeoutMs - elapsedMs));
+
+		// Keep draining the pipes so the child never blocks writing to them
+		if ((pollFds[0].fd >= 0) || (pollFds[1].fd >= 0)) {
+			pollFds[0].revents = 0;
+			pollFds[1].revents = 0;
+			if (::poll(pollFds, 2, waitMs) > 0) {
+				for (int index = 0; index < 2; ++index) {
+					if ((pollFds[index].fd >= 0) && pollFds[index].revents) {
+						char readBuf[4096];
+						const ssize_t readLen = ::read(pollFds[index].fd, readBuf, sizeof(readBuf));
+						if (readLen > 0) {
+							g_string_append_len(outputs[index], readBuf, readLen);
+						} else if ((readLen == 0) || ((errno != EINTR) && (errno != EAGAIN))) {
+							::close(pollFds[index].fd);
+							pollFds[index].fd = -1;
+						}
+					}
+				}
+			}
+		} else {
+			g_usleep(waitMs * 1000);
+		}
+
+		if ((pollFds[0].fd < 0) && (pollFds[1].fd < 0)) {
+			isReaped = (::waitpid(pid, gStatus, WNOHANG) == pid);
+		}
+	}
+
+	if (isTimedOut) {
+		::kill(pid, SIGKILL);
+		while ((::waitpid(pid, gStatus, 0) < 0) && (errno == EINTR)) {
+		}
+	}
+	for (int index = 0; index < 2; ++index) {
+		if (pollFds[index].fd >= 0) {
+			::close(pollFds[index].fd);
+		}
+	}
+	g_spawn_close_pid(pid);
+
+	*gStdout = g_string_free(stdoutStr, FALSE);
+	*gStderr = g_string_free(stderrStr, FALSE);
+	return !isTimedOut;
+}
 #endif
 
 std::string ProcessUtils::getUserName() {
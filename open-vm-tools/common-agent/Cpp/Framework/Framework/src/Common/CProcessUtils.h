@@ -29,6 +29,16 @@ public:
 		const ProcessUtils::Priority priority = NORMAL,
 		const std::string workingDirectory = ProcessUtils::INHERIT_PARENT_DIRECTORY);
 
+	// Like runSyncToFiles, but kills the process and throws a
+	// TimeoutException if it runs longer than timeoutSecs (0 waits forever).
+	static void runSyncToFiles(
+		const Cdeqstr& argv,
+		const std::string& stdoutPath,
+		const std::string& stderrPath,
+		const ProcessUtils::Priority priority,
+		const std::string& workingDirectory,
+		const uint32 timeoutSecs);
+
 	static void runSync(
 		const Cdeqstr& argv,
 		std::string& stdoutContent,
@@ -48,7 +58,8 @@ private:
 		std::string& stdoutContent,
 		std::string& stderrContent,
 		const ProcessUtils::Priority priority,
-		const std::string& workingDirectory);
+		const std::string& workingDirectory,
+		const uint32 timeoutSecs);
 
 	static const char** convertToCharArray(
 			const Cdeqstr& argv);
@@ -65,6 +76,17 @@ private:
 #ifdef WIN32
 	static std::string readFromPipe(
 		const HANDLE readPipe);
+#else
+	static bool spawnSyncWithTimeout(
+		const std::string& workingDirectory,
+		const char** argvNative,
+		int* niceLevel,
+		const uint32 timeoutSecs,
+		gchar** gStdout,
+		gchar** gStderr,
+		gint* gStatus,
+		GError** gError,
+		bool& isTimedOut);
 #endif
 
 private:
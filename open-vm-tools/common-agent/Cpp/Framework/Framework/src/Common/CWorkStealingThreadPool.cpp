@@ -0,0 +1,325 @@
+/*
+ *  Created on: Oct 15, 2026
+ *
+ *	Copyright (C) 2026 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+#include "stdafx.h"
+#include "Common/CWorkStealingThreadPool.h"
+#include "Exception/CCafException.h"
+
+using namespace Caf;
+
+const uint32 CWorkStealingThreadPool::DEFAULT_SHARED_THREAD_COUNT = 8;
+const uint32 CWorkStealingThreadPool::IDLE_WAIT_MS = 1000;
+
+SmartPtrCWorkStealingThreadPool CWorkStealingThreadPool::_sharedPool;
+G_LOCK_DEFINE_STATIC(sharedPool);
+
+SmartPtrCWorkStealingThreadPool CWorkStealingThreadPool::getSharedPool() {
+	CAF_CM_STATIC_FUNC_LOG("CWorkStealingThreadPool", "getSharedPool");
+	SmartPtrCWorkStealingThreadPool sharedPool;
+	G_LOCK(sharedPool);
+	try {
+		if (!_sharedPool) {
+			uint32 threadCount = AppConfigUtils::getOptionalUint32(
+					_sAppConfigGlobalSharedThreadPoolSize);
+			if (!threadCount) {
+				threadCount = DEFAULT_SHARED_THREAD_COUNT;
+			}
+			CAF_CM_LOG_DEBUG_VA1("Creating the shared thread pool - threads: %d", threadCount);
+
+			SmartPtrCWorkStealingThreadPool pool;
+			pool.CreateInstance();
+			pool->init("SharedThreadPool", threadCount);
+			_sharedPool = pool;
+		}
+		sharedPool = _sharedPool;
+	}
+	CAF_CM_CATCH_ALL;
+	G_UNLOCK(sharedPool);
+	CAF_CM_THROWEXCEPTION;
+	return sharedPool;
+}
+
+void CWorkStealingThreadPool::termSharedPool() {
+	CAF_CM_STATIC_FUNC_LOG("CWorkStealingThreadPool", "termSharedPool");
+	SmartPtrCWorkStealingThreadPool sharedPool;
+	G_LOCK(sharedPool);
+	sharedPool = _sharedPool;
+	_sharedPool = NULL;
+	G_UNLOCK(sharedPool);
+
+	if (sharedPool) {
+		try {
+			sharedPool->term();
+		}
+		CAF_CM_CATCH_ALL;
+		CAF_CM_LOG_CRIT_CAFEXCEPTION;
+		CAF_CM_CLEAREXCEPTION;
+	}
+}
+
+CWorkStealingThreadPool::CWorkStealingThreadPool() :
+	_isInitialized(false),
+	_isShuttingDown(false),
+	_nextWorker(0),
+	_queuedTaskCount(0),
+	_activeTaskCount(0),
+	_completeTaskCount(0),
+	_stolenTaskCount(0),
+	_totalQueueWaitMs(0),
+	_maxQueueWaitMs(0),
+	CAF_CM_INIT_LOG("CWorkStealingThreadPool") {
+	_poolMutex.CreateInstance();
+	_poolMutex->initialize();
+}
+
+CWorkStealingThreadPool::~CWorkStealingThreadPool() {
+	CAF_CM_FUNCNAME("~CWorkStealingThreadPool");
+	if (_workers.size()) {
+		CAF_CM_LOG_ERROR_VA1(
+				"[poolName=%s] Destroying thread pool but it is "
+				"still active. You really should call term() first.",
+				_poolName.c_str());
+		try {
+			stopWorkers();
+		}
+		CAF_CM_CATCH_ALL;
+		CAF_CM_LOG_CRIT_CAFEXCEPTION;
+		CAF_CM_CLEAREXCEPTION;
+	}
+}
+
+void CWorkStealingThreadPool::init(
+		const std::string& poolName,
+		uint32 threadCount) {
+	CAF_CM_FUNCNAME_VALIDATE("init");
+	CAF_CM_VALIDATE_STRING(poolName);
+	CAF_CM_VALIDATE_NOTZERO(threadCount);
+	CAF_CM_PRECOND_ISNOTINITIALIZED(_isInitialized);
+
+	_poolName = poolName;
+	_idleSignal.initialize(poolName + "-idle");
+
+	// All of the workers must exist before any of them starts looking
+	// through the others' queues
+	for (uint32 index = 0; index < threadCount; ++index) {
+		SmartPtrWorker worker;
+		worker.CreateInstance();
+		worker->pool = this;
+		worker->index = index;
+		worker->thread = NULL;
+		worker->mutex.CreateInstance();
+		worker->mutex->initialize();
+		_workers.push_back(worker);
+	}
+	try {
+		for (TSmartIterator<WorkerVector> worker(_workers); worker; worker++) {
+			worker->thread = CThreadUtils::startJoinable(
+					workerFunc,
+					(*worker).GetNonAddRefedInterface());
+		}
+	}
+	CAF_CM_CATCH_ALL;
+	if (CAF_CM_ISEXCEPTION) {
+		stopWorkers();
+	}
+	CAF_CM_THROWEXCEPTION;
+
+	_isInitialized = true;
+}
+
+void CWorkStealingThreadPool::term() {
+	CAF_CM_FUNCNAME("term");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	const GThread* self = g_thread_self();
+	for (TSmartConstIterator<WorkerVector> worker(_workers); worker; worker++) {
+		if (worker->thread == self) {
+			CAF_CM_EXCEPTIONEX_VA1(IllegalStateException, ERROR_INVALID_STATE,
+					"[poolName=%s] Must terminate the pool from a thread outside of it",
+					_poolName.c_str());
+		}
+	}
+
+	const Stats stats = getStats();
+	CAF_CM_LOG_DEBUG_VA4(
+			"[poolName=%s] Stopping - completed: %s, stolen: %s, maxQueueWaitMs: %s",
+			_poolName.c_str(),
+			CStringConv::toString<uint64>(stats.completeTaskCount).c_str(),
+			CStringConv::toString<uint64>(stats.stolenTaskCount).c_str(),
+			CStringConv::toString<uint64>(stats.maxQueueWaitMs).c_str());
+
+	stopWorkers();
+	_isInitialized = false;
+}
+
+void CWorkStealingThreadPool::enqueue(
+		const SmartPtrIThreadTask& task,
+		const EPriority priority) {
+	CAF_CM_FUNCNAME("enqueue");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+	CAF_CM_VALIDATE_INTERFACE(task);
+	CAF_CM_VALIDATE_BOOL(priority < PRIORITY_COUNT);
+
+	QueuedTask queuedTask;
+	queuedTask.task = task;
+	queuedTask.enqueuedMs = CDateTimeUtils::getTimeMs();
+
+	// Hold the pool lock throughout so the workers cannot see the shutdown
+	// flag and leave between the check and the task being counted
+	CAF_CM_LOCK_UNLOCK1(_poolMutex);
+	if (_isShuttingDown) {
+		CAF_CM_EXCEPTIONEX_VA1(IllegalStateException, ERROR_INVALID_STATE,
+				"[poolName=%s] The thread pool has been shut down",
+				_poolName.c_str());
+	}
+
+	// A task queued by a worker stays with that worker; everything else
+	// is spread round-robin
+	SmartPtrWorker target;
+	const GThread* self = g_thread_self();
+	for (TSmartConstIterator<WorkerVector> worker(_workers); worker; worker++) {
+		if (worker->thread == self) {
+			target = *worker;
+			break;
+		}
+	}
+	if (!target) {
+		target = _workers[_nextWorker++ % _workers.size()];
+	}
+	{
+		CAF_CM_LOCK_UNLOCK1(target->mutex);
+		target->queues[priority].push_back(queuedTask);
+	}
+	++_queuedTaskCount;
+	_idleSignal.signal();
+}
+
+CWorkStealingThreadPool::Stats CWorkStealingThreadPool::getStats() const {
+	CAF_CM_LOCK_UNLOCK1(_poolMutex);
+	Stats stats;
+	stats.threadCount = static_cast<uint32>(_workers.size());
+	stats.queuedTaskCount = _queuedTaskCount;
+	stats.activeTaskCount = _activeTaskCount;
+	stats.completeTaskCount = _completeTaskCount;
+	stats.stolenTaskCount = _stolenTaskCount;
+	stats.totalQueueWaitMs = _totalQueueWaitMs;
+	stats.maxQueueWaitMs = _maxQueueWaitMs;
+	return stats;
+}
+
+gpointer CWorkStealingThreadPool::workerFunc(gpointer context) {
+	CAF_CM_STATIC_FUNC_LOG("CWorkStealingThreadPool", "workerFunc");
+	try {
+		CAF_CM_VALIDATE_PTR(context);
+		Worker* worker = reinterpret_cast<Worker*>(context);
+		worker->pool->runWorker(worker);
+	}
+	CAF_CM_CATCH_ALL;
+	CAF_CM_LOG_CRIT_CAFEXCEPTION;
+	CAF_CM_CLEAREXCEPTION;
+	return NULL;
+}
+
+void CWorkStealingThreadPool::runWorker(Worker* worker) {
+	CAF_CM_FUNCNAME("runWorker");
+	CAF_CM_LOG_DEBUG_VA2("[poolName=%s] Starting worker #%d", _poolName.c_str(), worker->index);
+	while (true) {
+		QueuedTask queuedTask;
+		if (takeTask(worker, queuedTask)) {
+			try {
+				queuedTask.task->run();
+			}
+			CAF_CM_CATCH_ALL;
+			CAF_CM_LOG_CRIT_CAFEXCEPTION;
+			CAF_CM_CLEAREXCEPTION;
+			queuedTask.task = NULL;
+
+			CAF_CM_LOCK_UNLOCK1(_poolMutex);
+			--_activeTaskCount;
+			++_completeTaskCount;
+		} else {
+			CAF_CM_LOCK_UNLOCK1(_poolMutex);
+			if (!_queuedTaskCount) {
+				if (_isShuttingDown) {
+					// Wake the next worker so it sees the shutdown too
+					_idleSignal.signal();
+					break;
+				}
+				_idleSignal.waitOrTimeout(_poolMutex, IDLE_WAIT_MS);
+			}
+		}
+	}
+	CAF_CM_LOG_DEBUG_VA2("[poolName=%s] Leaving worker #%d", _poolName.c_str(), worker->index);
+}
+
+/*
+ * Takes the highest priority task available, first from the worker's own
+ * queue and then from the other workers' queues.  The worker takes its own
+ * oldest task; thieves take the newest so the two rarely contend.
+ */
+bool CWorkStealingThreadPool::takeTask(Worker* worker, QueuedTask& queuedTask) {
+	const uint32 workerCount = static_cast<uint32>(_workers.size());
+	bool isFound = false;
+	bool isStolen = false;
+	for (uint32 priority = 0; !isFound && (priority < PRIORITY_COUNT); ++priority) {
+		{
+			CAF_CM_LOCK_UNLOCK1(worker->mutex);
+			TaskDeque& queue = worker->queues[priority];
+			if (!queue.empty()) {
+				queuedTask = queue.front();
+				queue.pop_front();
+				isFound = true;
+			}
+		}
+		for (uint32 offset = 1; !isFound && (offset < workerCount); ++offset) {
+			Worker* victim =
+					_workers[(worker->index + offset) % workerCount].GetNonAddRefedInterface();
+			CAF_CM_LOCK_UNLOCK1(victim->mutex);
+			TaskDeque& queue = victim->queues[priority];
+			if (!queue.empty()) {
+				queuedTask = queue.back();
+				queue.pop_back();
+				isFound = true;
+				isStolen = true;
+			}
+		}
+	}
+
+	if (isFound) {
+		const uint64 waitMs = CDateTimeUtils::getTimeMs() - queuedTask.enqueuedMs;
+		CAF_CM_LOCK_UNLOCK1(_poolMutex);
+		--_queuedTaskCount;
+		++_activeTaskCount;
+		if (isStolen) {
+			++_stolenTaskCount;
+		}
+		_totalQueueWaitMs += waitMs;
+		if (waitMs > _maxQueueWaitMs) {
+			_maxQueueWaitMs = waitMs;
+		}
+
+		// The signal only wakes one worker; pass it along while work remains
+		if (_queuedTaskCount) {
+			_idleSignal.signal();
+		}
+	}
+	return isFound;
+}
+
+void CWorkStealingThreadPool::stopWorkers() {
+	{
+		CAF_CM_LOCK_UNLOCK1(_poolMutex);
+		_isShuttingDown = true;
+		_idleSignal.signal();
+	}
+	for (TSmartIterator<WorkerVector> worker(_workers); worker; worker++) {
+		if (worker->thread) {
+			CThreadUtils::join(worker->thread);
+			worker->thread = NULL;
+		}
+	}
+	_workers.clear();
+}
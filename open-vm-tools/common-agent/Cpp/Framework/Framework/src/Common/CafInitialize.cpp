@@ -11,6 +11,7 @@
 #include "Common/CWinScm.h"
 #endif
 
+#include "Common/CWorkStealingThreadPool.h"
 #include "CafInitialize.h"
 
 using namespace Caf;
@@ -53,5 +54,6 @@ HRESULT CafInitialize::serviceConfig() {
 }
 
 HRESULT CafInitialize::term() {
+	CWorkStealingThreadPool::termSharedPool();
 	return S_OK;
 }
@@ -44,6 +44,8 @@ namespace Caf {
 	const char* _sAppConfigGlobalParamOutputDir = "output_dir";
 	const char* _sAppConfigGlobalParamDbDir = "db_dir";
 	const char* _sAppConfigGlobalThreadStackSizeKb = "thread_stack_size_kb";
+	const char* _sAppConfigGlobalSharedThreadPoolSize = "shared_thread_pool_size";
+	const char* _sAppConfigGlobalParallelBeanInit = "parallel_bean_init";
 
 	const GUID CAFCOMMON_GUID_NULL = {0};
 
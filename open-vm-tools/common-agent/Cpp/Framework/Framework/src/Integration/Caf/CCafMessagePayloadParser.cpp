@@ -15,6 +15,8 @@
 #include "Doc/DocXml/CafInstallRequestXml/InstallProviderJobXml.h"
 #include "Doc/DocXml/CafInstallRequestXml/UninstallProviderJobXml.h"
 #include "Doc/DocXml/PayloadEnvelopeXml/PayloadEnvelopeXml.h"
+#include "Doc/DocXml/ProviderInfraXml/ProviderRegXml.h"
+#include "Doc/DocXml/ProviderRequestXml/ProviderRequestXml.h"
 
 #include "Doc/CafInstallRequestDoc/CInstallProviderJobDoc.h"
 #include "Doc/CafInstallRequestDoc/CInstallRequestDoc.h"
@@ -58,7 +60,7 @@ SmartPtrCProviderRequestDoc CCafMessagePayloadParser::getProviderRequest(
 	CAF_CM_STATIC_FUNC_VALIDATE("CCafMessagePayloadParser", "getProviderRequest");
 	CAF_CM_VALIDATE_SMARTPTR(payload);
 
-	return XmlRoots::parseProviderRequestFromString(bufferToStr(payload));
+	return ProviderRequestXml::parse(bufferToXml(payload, "caf:providerRequest"));
 }
 
 SmartPtrCProviderRegDoc CCafMessagePayloadParser::getProviderReg(
@@ -66,7 +68,7 @@ SmartPtrCProviderRegDoc CCafMessagePayloadParser::getProviderReg(
 	CAF_CM_STATIC_FUNC_VALIDATE("CCafMessagePayloadParser", "getProviderReg");
 	CAF_CM_VALIDATE_SMARTPTR(payload);
 
-	return XmlRoots::parseProviderRegFromString(bufferToStr(payload));
+	return ProviderRegXml::parse(bufferToXml(payload, "caf:providerReg"));
 }
 
 SmartPtrCInstallRequestDoc CCafMessagePayloadParser::getInstallRequest(
@@ -91,7 +93,12 @@ SmartPtrCXmlElement CCafMessagePayloadParser::bufferToXml(
 	CAF_CM_STATIC_FUNC_VALIDATE("CCafMessagePayloadParser", "bufferToXml");
 	CAF_CM_VALIDATE_SMARTPTR(payload);
 
-	return CXmlUtils::parseString(bufferToStr(payload), payloadType);
+	// Parse in place; the payload can be large and copying it buys nothing
+	const char* xml = reinterpret_cast<const char*>(payload->getPtr());
+	const void* nullPos = ::memchr(xml, '\0', payload->getByteCount());
+	const size_t xmlLen = nullPos ?
+			static_cast<const char*>(nullPos) - xml : payload->getByteCount();
+	return CXmlUtils::parseBuffer(xml, xmlLen, payloadType);
 }
 
 std::string CCafMessagePayloadParser::bufferToStr(
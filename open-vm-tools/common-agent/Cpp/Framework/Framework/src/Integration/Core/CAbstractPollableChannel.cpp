@@ -50,6 +50,60 @@ SmartPtrIIntMessage CAbstractPollableChannel::receive(const int32 timeout) {
 	return message;
 }
 
+SmartPtrCMessageCollection CAbstractPollableChannel::receiveBatch(
+		const uint32 maxMessages,
+		const int32 timeout) {
+	CAF_CM_FUNCNAME_VALIDATE("receiveBatch");
+	CAF_CM_VALIDATE_NOTZERO(maxMessages);
+
+	// The interceptors see the batch as a single receive
+	SmartPtrCMessageCollection messages;
+	messages.CreateInstance();
+	std::list<SmartPtrIChannelInterceptor> interceptors = getInterceptors();
+	SmartPtrIMessageChannel channel(this);
+	bool preReceiveOk = true;
+	for (TSmartIterator<std::list<SmartPtrIChannelInterceptor> > interceptor(interceptors);
+			interceptor && preReceiveOk;
+			interceptor++) {
+		preReceiveOk = interceptor->preReceive(channel);
+	}
+
+	if (preReceiveOk) {
+		CMessageCollection received;
+		doReceiveBatch(maxMessages, timeout, received);
+		for (TSmartIterator<CMessageCollection> receivedIter(received);
+				receivedIter;
+				receivedIter++) {
+			SmartPtrIIntMessage message = *receivedIter;
+			for (TSmartIterator<std::list<SmartPtrIChannelInterceptor> > interceptor(interceptors);
+					interceptor && message;
+					interceptor++) {
+				message = interceptor->postReceive(message, channel);
+			}
+			if (message) {
+				messages->push_back(message);
+			}
+		}
+	}
+
+	return messages;
+}
+
+void CAbstractPollableChannel::doReceiveBatch(
+		const uint32 maxMessages,
+		const int32 timeout,
+		CMessageCollection& messages) {
+	int32 receiveTimeout = timeout;
+	while (messages.size() < maxMessages) {
+		const SmartPtrIIntMessage message = doReceive(receiveTimeout);
+		if (message.IsNull()) {
+			break;
+		}
+		messages.push_back(message);
+		receiveTimeout = 0;
+	}
+}
+
 SmartPtrCPollerMetadata CAbstractPollableChannel::getPollerMetadata() const {
 	CAF_CM_FUNCNAME_VALIDATE("getPollerMetadata");
 	CAF_CM_VALIDATE_SMARTPTR(_pollerMetadata);
@@ -69,50 +69,40 @@ void CSourcePollingChannelAdapter::run() {
 	CAF_CM_FUNCNAME("run");
 	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
 
-	uint32 messageCount = 0;
-	SmartPtrIIntMessage message;
+	const uint32 maxMessagesPerPoll =
+			std::max<uint32>(_pollerMetadata->getMaxMessagesPerPoll(), 1);
 	while (! getIsCancelled()) {
+		// Take the whole poll's worth of messages from the channel at once
+		// so its lock and interceptors are paid for once per poll
+		SmartPtrCMessageCollection messages;
 		try {
-			message = NULL;
-			if (_isTimeoutSet) {
-				message = _inputPollableChannel->receive(_timeout);
-			} else {
-				message = _inputPollableChannel->receive();
-			}
-			if (! message.IsNull()) {
-				messageCount++;
-				_messageHandler->handleMessage(message);
-			}
+			messages = _inputPollableChannel->receiveBatch(
+					maxMessagesPerPoll, _isTimeoutSet ? _timeout : 0);
 		}
 		CAF_CM_CATCH_ALL;
 		CAF_CM_LOG_CRIT_CAFEXCEPTION;
 
 		if (CAF_CM_ISEXCEPTION) {
-			SmartPtrIIntMessage savedMessage = _messageHandler->getSavedMessage();
-			if (savedMessage.IsNull()) {
-				savedMessage = message;
-			}
-
-			SmartPtrCIntException intException;
-			intException.CreateInstance();
-			intException->initialize(CAF_CM_GETEXCEPTION);
-			_errorHandler->handleError(intException, savedMessage);
-
+			handleError(CAF_CM_GETEXCEPTION, NULL);
 			CAF_CM_CLEAREXCEPTION;
 		}
 
-		if (message.IsNull()
-			|| (messageCount >= _pollerMetadata->getMaxMessagesPerPoll())) {
-			{
-				CAF_THREADSIGNAL_LOCK_UNLOCK;
-//				CAF_CM_LOG_DEBUG_VA2("Wait (%s) - waitMs: %d",
-//						_threadSignalCancel.getName().c_str(),
-//						_pollerMetadata->getFixedRate());
-				_threadSignalCancel.waitOrTimeout(
-						CAF_THREADSIGNAL_MUTEX, _pollerMetadata->getFixedRate());
+		// The messages have left the channel, so all of them are dispatched
+		// even if the adapter is cancelled part way through
+		if (messages) {
+			for (TSmartConstIterator<CMessageCollection> message(*messages);
+					message; message++) {
+				dispatchMessage(*message);
 			}
+		}
 
-			messageCount = 0;
+		{
+			CAF_THREADSIGNAL_LOCK_UNLOCK;
+//			CAF_CM_LOG_DEBUG_VA2("Wait (%s) - waitMs: %d",
+//					_threadSignalCancel.getName().c_str(),
+//					_pollerMetadata->getFixedRate());
+			_threadSignalCancel.waitOrTimeout(
+					CAF_THREADSIGNAL_MUTEX, _pollerMetadata->getFixedRate());
 		}
 	}
 
@@ -129,6 +119,36 @@ void CSourcePollingChannelAdapter::cancel() {
 	_threadSignalCancel.signal();
 }
 
+void CSourcePollingChannelAdapter::dispatchMessage(
+	const SmartPtrIIntMessage& message) {
+	CAF_CM_FUNCNAME("dispatchMessage");
+
+	try {
+		_messageHandler->handleMessage(message);
+	}
+	CAF_CM_CATCH_ALL;
+	CAF_CM_LOG_CRIT_CAFEXCEPTION;
+
+	if (CAF_CM_ISEXCEPTION) {
+		handleError(CAF_CM_GETEXCEPTION, message);
+		CAF_CM_CLEAREXCEPTION;
+	}
+}
+
+void CSourcePollingChannelAdapter::handleError(
+	const CCafException* cafException,
+	const SmartPtrIIntMessage& message) {
+	SmartPtrIIntMessage savedMessage = _messageHandler->getSavedMessage();
+	if (savedMessage.IsNull()) {
+		savedMessage = message;
+	}
+
+	SmartPtrCIntException intException;
+	intException.CreateInstance();
+	intException->initialize(cafException);
+	_errorHandler->handleError(intException, savedMessage);
+}
+
 bool CSourcePollingChannelAdapter::getIsCancelled() const {
 	CAF_CM_FUNCNAME_VALIDATE("getIsCancelled");
 	CAF_CM_LOCK_UNLOCK;
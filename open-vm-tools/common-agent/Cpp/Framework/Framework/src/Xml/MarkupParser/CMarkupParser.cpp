@@ -13,8 +13,6 @@
 
 namespace Caf { namespace MarkupParser {
 
-std::string _xml;
-
 struct SParserState {
 	SParserState() :
 		depth(0) {
@@ -113,10 +111,16 @@ static GMarkupParser _markupParser = { cb_start_element,
 									   NULL };
 
 SmartPtrElement parseString(const std::string& xml) {
-	CAF_CM_STATIC_FUNC("MarkupParser", "parseString");
+	CAF_CM_STATIC_FUNC_VALIDATE("MarkupParser", "parseString");
 	CAF_CM_VALIDATE_STRINGPTRA(xml.c_str());
 
-	_xml = xml;
+	return parseBuffer(xml.c_str(), xml.length());
+}
+
+SmartPtrElement parseBuffer(const char* xml, const size_t length) {
+	CAF_CM_STATIC_FUNC("MarkupParser", "parseBuffer");
+	CAF_CM_VALIDATE_PTR(xml);
+	CAF_CM_VALIDATE_NOTZERO(length);
 
 	SParserState *parserState = new SParserState();
 	GError *parserError = NULL;
@@ -129,8 +133,8 @@ SmartPtrElement parseString(const std::string& xml) {
 	SmartPtrElement root;
 	try {
 		if (g_markup_parse_context_parse(context,
-										 xml.c_str(),
-										 xml.length(),
+										 xml,
+										 static_cast<gssize>(length),
 										 &parserError)) {
 			root = parserState->root;
 		}
@@ -165,14 +169,16 @@ SmartPtrElement parseFile(const std::string& file) {
 	CAF_CM_VALIDATE_STRINGPTRA(file.c_str());
 
 	gchar* text = NULL;
+	gsize textLen = 0;
 	GError *fileError = NULL;
 	SmartPtrElement root;
 	try {
-		if (g_file_get_contents(file.c_str(), &text, NULL, &fileError)) {
+		if (g_file_get_contents(file.c_str(), &text, &textLen, &fileError)) {
 		    if (! text || (text[ 0 ] == L'\0' )) {
 				CAF_CM_EXCEPTION_VA1(ERROR_INVALID_DATA, "File is empty - %s", file.c_str());
 		    }
-			root = parseString(text);
+			// Parse straight out of the file buffer rather than a copy of it
+			root = parseBuffer(text, textLen);
 		}
 		else {
 			CAF_CM_EXCEPTION_VA0(fileError->code, fileError->message);
@@ -205,12 +211,14 @@ ChildIterator findChild(SmartPtrElement& element, const std::string& name) {
 	CAF_CM_VALIDATE_SMARTPTR(element);
 	CAF_CM_VALIDATE_STRING(name);
 
+	// The last matching child wins, so search from the end and stop there
 	ChildIterator rc = element->children.end();
-	for(ChildIterator childIter = element->children.begin();
-		childIter != element->children.end();
-		childIter++) {
+	for(ChildIterator childIter = element->children.end();
+		childIter != element->children.begin();) {
+		--childIter;
 		if((*childIter)->name.compare(name) == 0) {
 			rc = childIter;
+			break;
 		}
 	}
 	return rc;
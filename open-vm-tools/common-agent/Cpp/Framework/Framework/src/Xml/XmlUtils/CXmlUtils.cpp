@@ -44,13 +44,25 @@ SmartPtrCXmlElement CXmlUtils::parseFile(
 SmartPtrCXmlElement CXmlUtils::parseString(
 	const std::string& xml,
 	const std::string& rootName) {
-	CAF_CM_STATIC_FUNC("CXmlUtils", "parseString");
+	CAF_CM_STATIC_FUNC_VALIDATE("CXmlUtils", "parseString");
 	CAF_CM_VALIDATE_STRING(xml);
 	// rootName is optional
 
+	return parseBuffer(xml.c_str(), xml.length(), rootName);
+}
+
+SmartPtrCXmlElement CXmlUtils::parseBuffer(
+	const char* xml,
+	const size_t length,
+	const std::string& rootName) {
+	CAF_CM_STATIC_FUNC("CXmlUtils", "parseBuffer");
+	CAF_CM_VALIDATE_PTR(xml);
+	CAF_CM_VALIDATE_NOTZERO(length);
+	// rootName is optional
+
 	const std::string path = "fromString";
 
-	const MarkupParser::SmartPtrElement element = MarkupParser::parseString(xml);
+	const MarkupParser::SmartPtrElement element = MarkupParser::parseBuffer(xml, length);
 	CAF_CM_VALIDATE_SMARTPTR(element);
 	CAF_CM_VALIDATE_STRING(element->name);
 	if (!rootName.empty()) {
@@ -24,6 +24,11 @@ public:
 		const std::string& xml,
 		const std::string& rootName);
 
+	static SmartPtrCXmlElement parseBuffer(
+		const char* xml,
+		const size_t length,
+		const std::string& rootName);
+
 	static SmartPtrCXmlElement createRootElement(
 		const std::string& rootName,
 		const std::string& rootNamespace);
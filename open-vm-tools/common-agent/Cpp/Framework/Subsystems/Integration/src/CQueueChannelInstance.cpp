@@ -118,3 +118,30 @@ SmartPtrIIntMessage CQueueChannelInstance::doReceive(const int32 timeout) {
 
 	return message;
 }
+
+void CQueueChannelInstance::doReceiveBatch(
+		const uint32 maxMessages,
+		const int32 timeout,
+		CMessageCollection& messages) {
+	CAF_CM_FUNCNAME("doReceiveBatch");
+
+	CAF_CM_ENTER_AND_LOCK {
+		CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+		if (timeout > 0) {
+			CAF_CM_EXCEPTIONEX_VA1(UnsupportedOperationException, E_INVALIDARG,
+				"Queue channel with timeout not currently supported: %s", _id.c_str());
+		}
+
+		if (! _messageQueue.empty()) {
+			CAF_CM_LOG_DEBUG_VA3("Receiving up to %d of %d messages - %s",
+				maxMessages, _messageQueue.size(), _id.c_str());
+
+			while (! _messageQueue.empty() && (messages.size() < maxMessages)) {
+				messages.push_back(_messageQueue.back());
+				_messageQueue.pop_back();
+			}
+		}
+	}
+	CAF_CM_UNLOCK_AND_EXIT;
+}
@@ -55,6 +55,11 @@ protected: // CAbstractPollableChannel
 
 	SmartPtrIIntMessage doReceive(const int32 timeout);
 
+	void doReceiveBatch(
+			const uint32 maxMessages,
+			const int32 timeout,
+			CMessageCollection& messages);
+
 private:
 	bool _isInitialized;
 	SmartPtrIDocument _configSection;
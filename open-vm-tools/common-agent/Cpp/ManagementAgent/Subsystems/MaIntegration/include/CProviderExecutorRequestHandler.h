@@ -12,13 +12,18 @@
 #include "Integration/IRunnable.h"
 
 #include "CProviderExecutorRequest.h"
+#include "CProviderRunLimiter.h"
 #include "Common/CAutoMutex.h"
+#include "Common/CWorkStealingThreadPool.h"
 #include "Integration/IErrorHandler.h"
 #include "Integration/ITaskExecutor.h"
 #include "Integration/ITransformer.h"
 
 namespace Caf {
 
+class CProviderExecutorRequestHandler;
+CAF_DECLARE_SMART_POINTER(CProviderExecutorRequestHandler);
+
 /// TODO - describe class
 class CProviderExecutorRequestHandler : public IRunnable {
 public:
@@ -29,7 +34,8 @@ public:
 	void initialize(const std::string& providerUri,
 			const SmartPtrITransformer beginImpersonationTransformer,
 			const SmartPtrITransformer endImpersonationTransformer,
-			const SmartPtrIErrorHandler errorHandler);
+			const SmartPtrIErrorHandler errorHandler,
+			const SmartPtrCProviderRunLimiter runLimiter);
 
 	void handleRequest(const SmartPtrCProviderExecutorRequest request);
 
@@ -45,29 +51,48 @@ private:
 	void executeRequestAsync(
 			const SmartPtrCProviderExecutorRequest& request);
 
-	std::deque<SmartPtrITaskExecutor> removeFinishedTaskExecutors(
-			const std::deque<SmartPtrITaskExecutor> taskExecutors) const;
-
 private:
 	bool _isInitialized;
 	bool _isCancelled;
 	std::string _providerPath;
 	std::string _providerUri;
-	std::deque<SmartPtrITaskExecutor> _taskExecutors;
 	SmartPtrCAutoMutex _mutex;
 	std::deque<SmartPtrCProviderExecutorRequest> _pendingRequests;
 	SmartPtrITransformer _beginImpersonationTransformer;
 	SmartPtrITransformer _endImpersonationTransformer;
 	SmartPtrIErrorHandler _errorHandler;
+	SmartPtrCProviderRunLimiter _runLimiter;
 
 private:
 	CAF_CM_CREATE;
 	CAF_CM_CREATE_LOG;
 	CAF_CM_CREATE_THREADSAFE;
 	CAF_CM_DECLARE_NOCOPY(CProviderExecutorRequestHandler);
-};
 
-CAF_DECLARE_SMART_POINTER(CProviderExecutorRequestHandler);
+private:
+	/*
+	 * Runs one pending request on the shared thread pool, then hands its
+	 * slot back to the run limiter
+	 */
+	class RequestTask : public CWorkStealingThreadPool::IThreadTask {
+	public:
+		RequestTask();
+
+		virtual ~RequestTask();
+
+		void init(
+				const SmartPtrCProviderExecutorRequestHandler& handler,
+				const SmartPtrCProviderRunLimiter& runLimiter);
+
+		void run();
+
+	private:
+		SmartPtrCProviderExecutorRequestHandler _handler;
+		SmartPtrCProviderRunLimiter _runLimiter;
+		CAF_CM_DECLARE_NOCOPY(RequestTask);
+	};
+	CAF_DECLARE_SMART_POINTER(RequestTask);
+};
 
 }
 
@@ -0,0 +1,47 @@
+/*
+ *  Created on: Oct 15, 2026
+ *
+ *	Copyright (C) 2026 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+#ifndef CProviderRunLimiter_h_
+#define CProviderRunLimiter_h_
+
+#include "Common/CWorkStealingThreadPool.h"
+
+namespace Caf {
+
+/// Caps how many provider runs are on the shared thread pool at once.
+/// Runs over the cap wait here, in order, until an earlier one releases its slot.
+class CProviderRunLimiter {
+public:
+	CProviderRunLimiter();
+	virtual ~CProviderRunLimiter();
+
+public:
+	/// A maxConcurrentRuns of 0 means no cap.
+	void initialize(const uint32 maxConcurrentRuns);
+
+	void submit(const CWorkStealingThreadPool::SmartPtrIThreadTask& task);
+
+	/// Must be called once by every submitted task when it finishes.
+	void release();
+
+private:
+	bool _isInitialized;
+	uint32 _maxConcurrentRuns;
+	uint32 _activeRunCount;
+	std::deque<CWorkStealingThreadPool::SmartPtrIThreadTask> _waitingTasks;
+
+private:
+	CAF_CM_CREATE;
+	CAF_CM_CREATE_LOG;
+	CAF_CM_CREATE_THREADSAFE;
+	CAF_CM_DECLARE_NOCOPY(CProviderRunLimiter);
+};
+
+CAF_DECLARE_SMART_POINTER(CProviderRunLimiter);
+
+}
+
+#endif // #ifndef CProviderRunLimiter_h_
@@ -28,6 +28,7 @@ bool operator< (const CClassId& lhs, const CClassId& rhs);
 class CSchemaCacheManager {
 private:
 	typedef std::map<CClassId, std::string> CClassCollection;
+	typedef std::map<std::string, int64> CFileModifiedTimes;
 
 public:
 	CSchemaCacheManager();
@@ -42,7 +43,7 @@ public:
 private:
 	void processSchemaSummaries(
 		const std::string& schemaCacheDirPath,
-		CClassCollection& classCollection) const;
+		CClassCollection& classCollection);
 
 	void addNewClasses(
 		const SmartPtrCSchemaSummaryDoc& schemaSummary,
@@ -57,6 +58,7 @@ private:
 	bool _isInitialized;
 	std::string _schemaCacheDirPath;
 	CClassCollection _classCollection;
+	CFileModifiedTimes _schemaSummaryModifiedTimes;
 
 private:
 	CAF_CM_CREATE;
@@ -70,6 +70,44 @@ SmartPtrCPersistenceDoc CPersistenceNamespaceDb::getUpdated(
 		const std::string updatesCur = getValue("updates");
 		if (_updates.compare(updatesCur) != 0) {
 			_updates = updatesCur;
+			resetValueCache(updatesCur);
+
+			Cdeqstr keys;
+			keys.push_back("version");
+			keys.push_back("ep.local_id");
+			keys.push_back("ep.private_key");
+			keys.push_back("ep.cert");
+			keys.push_back("applications");
+			keys.push_back("protocols");
+			prefetchValues(keys);
+
+			const std::string applications = getValue("applications");
+			Cdeqstr appList = CStringUtils::split(applications, ',');
+			const std::string protocols = getValue("protocols");
+			Cdeqstr protocolList = CStringUtils::split(protocols, ',');
+
+			keys.clear();
+			for (Cdeqstr::iterator appIt = appList.begin(); appIt != appList.end(); appIt++) {
+				const std::string appKey = "app." + *appIt;
+				keys.push_back(appKey + ".remote_id");
+				keys.push_back(appKey + ".protocol_name");
+				keys.push_back(appKey + ".cms.cipher");
+				keys.push_back(appKey + ".cms.cert_chain");
+				keys.push_back(appKey + ".cms.cert");
+			}
+			for (Cdeqstr::iterator protocolIt = protocolList.begin(); protocolIt != protocolList.end(); protocolIt++) {
+				const std::string protocolKey = "protocol." + *protocolIt;
+				keys.push_back(protocolKey + ".tls.cert.chain");
+				keys.push_back(protocolKey + ".tls.ciphers");
+				keys.push_back(protocolKey + ".protocol_name");
+				keys.push_back(protocolKey + ".tls.cert");
+				keys.push_back(protocolKey + ".tls.protocol");
+				keys.push_back(protocolKey + ".uri");
+				keys.push_back(protocolKey + ".uri.amqp");
+				keys.push_back(protocolKey + ".uri.tunnel");
+			}
+			prefetchValues(keys);
+
 			const std::string version = getValue("version");
 
 			//EP Doc
@@ -83,8 +121,6 @@ SmartPtrCPersistenceDoc CPersistenceNamespaceDb::getUpdated(
 
 			//App collection
 			std::deque<SmartPtrCRemoteSecurityDoc> applicationCollectionInner;
-			const std::string applications = getValue("applications");
-			Cdeqstr appList = CStringUtils::split(applications, ',');
 			for (Cdeqstr::iterator appIt = appList.begin(); appIt != appList.end(); appIt++) {
 				const std::string appKey = "app." + *appIt;
 				const std::string appId = getValue(appKey + ".remote_id");
@@ -115,8 +151,6 @@ SmartPtrCPersistenceDoc CPersistenceNamespaceDb::getUpdated(
 			applicationCollection.CreateInstance();
 			applicationCollection->initialize(applicationCollectionInner);
 
-			const std::string protocols = getValue("protocols");
-			Cdeqstr protocolList = CStringUtils::split(protocols, ',');
 			std::deque<SmartPtrCPersistenceProtocolDoc> persistenceProtocolCollectionInner;
 			for (Cdeqstr::iterator protocolIt = protocolList.begin(); protocolIt != protocolList.end(); protocolIt++) {
 				const std::string protocolKey = "protocol." + *protocolIt;
@@ -388,6 +422,11 @@ std::string CPersistenceNamespaceDb::getValue(const std::string& key) {
 	CAF_CM_VALIDATE_STRING(key);
 
 	CAF_CM_LOG_DEBUG_VA0("getValue");
+	const Cmapstrstr::const_iterator cached = _valueCache.find(key);
+	if (cached != _valueCache.end()) {
+		return cached->second;
+	}
+
 	std::string value;
 	std::string stdoutContent;
 	std::string stderrContent;
@@ -434,6 +473,7 @@ void CPersistenceNamespaceDb::setValue(
 			argv.push_back("-f");
 			argv.push_back(tmpFile);
 
+			_valueCache.erase(key);
 			ProcessUtils::runSync(argv, stdoutContent, stderrContent);
 		}
 		catch(ProcessFailedException* ex){
@@ -469,6 +509,7 @@ void CPersistenceNamespaceDb::removeKey(const std::string& key) {
 			argv.push_back("-k");
 			argv.push_back(key);
 
+			_valueCache.erase(key);
 			ProcessUtils::runSync(argv, stdoutContent, stderrContent);
 			_removedKeys.insert(key);
 		}
@@ -485,6 +526,97 @@ void CPersistenceNamespaceDb::removeKey(const std::string& key) {
 	}
 }
 
+void CPersistenceNamespaceDb::prefetchValues(
+		const Cdeqstr& keys) {
+	CAF_CM_FUNCNAME_VALIDATE("prefetchValues");
+
+	// Reads all of the keys with one run of the namespace command instead of
+	// one run per key. The values land in _valueCache, where getValue() finds
+	// them. Anything that goes wrong just leaves the keys uncached, and
+	// getValue() falls back to reading them one at a time.
+#ifdef WIN32
+	// The command-line is limited to a few hundred characters on Windows,
+	// which a full persistence refresh easily exceeds.
+	return;
+#else
+	Cdeqstr fetchKeys;
+	for (Cdeqstr::const_iterator keyIt = keys.begin(); keyIt != keys.end(); keyIt++) {
+		if (_valueCache.find(*keyIt) == _valueCache.end()) {
+			fetchKeys.push_back(*keyIt);
+		}
+	}
+
+	// With a single key the command prints the bare value, and getValue()
+	// costs the same.
+	if (fetchKeys.size() < 2) {
+		return;
+	}
+
+	std::string stdoutContent;
+	std::string stderrContent;
+	Cdeqstr argv;
+	argv.push_back(_nsdbCmdPath);
+	argv.push_back("get-value");
+	argv.push_back(_nsdbNamespace);
+	for (Cdeqstr::const_iterator keyIt = fetchKeys.begin(); keyIt != fetchKeys.end(); keyIt++) {
+		argv.push_back("-k");
+		argv.push_back(*keyIt);
+	}
+
+	try {
+		ProcessUtils::runSync(argv, stdoutContent, stderrContent);
+	}
+	catch(ProcessFailedException* ex){
+		CAF_CM_LOG_DEBUG_VA2("Bulk read failed, reading keys one at a time - %s: %s",
+				ex->getMsg().c_str(), stderrContent.c_str());
+		return;
+	}
+
+	// Each value comes back as its length on a line of its own, followed by
+	// the value and a newline.
+	Cmapstrstr values;
+	std::string::size_type pos = 0;
+	for (Cdeqstr::const_iterator keyIt = fetchKeys.begin(); keyIt != fetchKeys.end(); keyIt++) {
+		const std::string::size_type eol = stdoutContent.find('\n', pos);
+		if (eol == std::string::npos || eol == pos ||
+				stdoutContent.find_first_not_of("0123456789", pos) != eol) {
+			break;
+		}
+
+		const std::string::size_type len = ::strtoul(
+				stdoutContent.substr(pos, eol - pos).c_str(), NULL, 10);
+		pos = eol + 1;
+		if (len >= stdoutContent.length() - pos ||
+				stdoutContent[pos + len] != '\n') {
+			break;
+		}
+
+		values[*keyIt] = normalizeValue(stdoutContent.substr(pos, len));
+		pos += len + 1;
+	}
+
+	if (values.size() != fetchKeys.size() || pos != stdoutContent.length()) {
+		CAF_CM_LOG_DEBUG_VA1("Unexpected bulk read output, reading keys one at a time - %s",
+				stdoutContent.c_str());
+		return;
+	}
+
+	_valueCache.insert(values.begin(), values.end());
+#endif
+}
+
+void CPersistenceNamespaceDb::resetValueCache(
+		const std::string& updates) {
+	CAF_CM_FUNCNAME_VALIDATE("resetValueCache");
+
+	// The cached values are only good for as long as the "updates" counter
+	// stays the same.
+	if (_valueCacheUpdates.compare(updates) != 0) {
+		_valueCache.clear();
+		_valueCacheUpdates = updates;
+	}
+}
+
 bool CPersistenceNamespaceDb::isDataReady() {
 	CAF_CM_FUNCNAME_VALIDATE("isDataReady");
 
@@ -589,7 +721,13 @@ std::string CPersistenceNamespaceDb::getValueRaw(
 	argv.push_back(key);
 
 	ProcessUtils::runSync(argv, stdoutContent, stderrContent);
-	std::string value = stdoutContent;
+
+	return normalizeValue(stdoutContent);
+}
+
+std::string CPersistenceNamespaceDb::normalizeValue(
+		const std::string& rawValue) {
+	std::string value = rawValue;
 
 	//strip spaces
 	value = CStringUtils::trim(value);
@@ -63,6 +63,12 @@ private:
 
 	void removeKey(const std::string& key);
 
+	void prefetchValues(
+			const Cdeqstr& keys);
+
+	void resetValueCache(
+			const std::string& updates);
+
 	bool isReady();
 
 	bool isDataReady();
@@ -78,6 +84,9 @@ private:
 			std::string& stdoutContent,
 			std::string& stderrContent);
 
+	static std::string normalizeValue(
+			const std::string& rawValue);
+
 private:
 	bool _isInitialized;
 	bool _isReady;
@@ -94,6 +103,8 @@ private:
 	std::string _nsdbPollerSignalFile;
 	Csetstr _removedKeys;
 	std::string _updates;
+	std::string _valueCacheUpdates;
+	Cmapstrstr _valueCache;
 
 	SmartPtrCPersistenceDoc _persistenceUpdate;
 	SmartPtrCPersistenceDoc _persistenceRemove;
@@ -50,6 +50,13 @@ void CProviderExecutor::initializeBean(
 		_endImpersonationBeanId = itr->second;
 	}
 
+	// Independent provider runs go in parallel, up to the configured cap
+	const uint32 maxConcurrentProviders = AppConfigUtils::getOptionalUint32(
+			_sManagementAgentArea, "provider_max_concurrent");
+	CAF_CM_LOG_DEBUG_VA1("Max concurrent providers: %d", maxConcurrentProviders);
+	_runLimiter.CreateInstance();
+	_runLimiter->initialize(maxConcurrentProviders);
+
 	_isInitialized = true;
 }
 
@@ -130,7 +137,7 @@ void CProviderExecutor::handleMessage(const SmartPtrIIntMessage& message) {
 		SmartPtrCProviderExecutorRequestHandler requestHandler;
 		requestHandler.CreateInstance();
 		requestHandler->initialize(providerUri, _beginImpersonationTransformer,
-				_endImpersonationTransformer, _errorHandler);
+				_endImpersonationTransformer, _errorHandler, _runLimiter);
 		_handlers[providerUri] = requestHandler;
 		handler = requestHandler;
 	}
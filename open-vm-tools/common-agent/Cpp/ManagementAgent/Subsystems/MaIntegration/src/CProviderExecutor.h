@@ -71,7 +71,7 @@ private:
 	SmartPtrITransformer _beginImpersonationTransformer;
 	SmartPtrITransformer _endImpersonationTransformer;
 	SmartPtrIErrorHandler _errorHandler;
-
+	SmartPtrCProviderRunLimiter _runLimiter;
 
 private:
 	CAF_CM_CREATE;
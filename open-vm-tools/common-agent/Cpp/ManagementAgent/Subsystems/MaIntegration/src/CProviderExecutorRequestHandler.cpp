@@ -13,7 +13,6 @@
 #include "Doc/ProviderRequestDoc/CProviderRequestDoc.h"
 #include "Doc/ResponseDoc/CResponseDoc.h"
 #include "Integration/Core/CIntException.h"
-#include "Integration/Core/CSimpleAsyncTaskExecutor.h"
 #include "Integration/IErrorHandler.h"
 #include "Integration/IIntMessage.h"
 #include "Integration/ITaskExecutor.h"
@@ -41,11 +40,13 @@ CProviderExecutorRequestHandler::~CProviderExecutorRequestHandler() {
 void CProviderExecutorRequestHandler::initialize(const std::string& providerUri,
 		const SmartPtrITransformer beginImpersonationTransformer,
 		const SmartPtrITransformer endImpersonationTransformer,
-		const SmartPtrIErrorHandler errorHandler) {
+		const SmartPtrIErrorHandler errorHandler,
+		const SmartPtrCProviderRunLimiter runLimiter) {
 	CAF_CM_FUNCNAME("initialize");
 	CAF_CM_LOCK_UNLOCK;
 	CAF_CM_PRECOND_ISNOTINITIALIZED(_isInitialized);
 	CAF_CM_VALIDATE_STRING(providerUri);
+	CAF_CM_VALIDATE_SMARTPTR(runLimiter);
 
 	_providerUri = providerUri;
 	UriUtils::SUriRecord providerUriRecord;
@@ -69,6 +70,7 @@ void CProviderExecutorRequestHandler::initialize(const std::string& providerUri,
 	_beginImpersonationTransformer = beginImpersonationTransformer;
 	_endImpersonationTransformer = endImpersonationTransformer;
 	_errorHandler = errorHandler;
+	_runLimiter = runLimiter;
 
 	_isInitialized = true;
 }
@@ -184,9 +186,14 @@ void CProviderExecutorRequestHandler::processRequest(
 		}
 	}
 
+	// A provider that overruns its timeout is killed and the request fails
+	const uint32 timeoutSecs = AppConfigUtils::getOptionalUint32(
+			_sManagementAgentArea, "provider_timeout_secs");
+
 	{
 		CAF_CM_UNLOCK_LOCK;
-		ProcessUtils::runSyncToFiles(argv, stdoutPath, stderrPath, priority);
+		ProcessUtils::runSyncToFiles(argv, stdoutPath, stderrPath, priority,
+				ProcessUtils::INHERIT_PARENT_DIRECTORY, timeoutSecs);
 	}
 
 	// End impersonation
@@ -237,27 +244,33 @@ void CProviderExecutorRequestHandler::executeRequestAsync(
 
 	_pendingRequests.push_back(request);
 
-	_taskExecutors = removeFinishedTaskExecutors(_taskExecutors);
+	SmartPtrRequestTask task;
+	task.CreateInstance();
+	task->init(this, _runLimiter);
+	_runLimiter->submit(task);
+}
 
-	SmartPtrCSimpleAsyncTaskExecutor simpleAsyncTaskExecutor;
-	simpleAsyncTaskExecutor.CreateInstance();
-	simpleAsyncTaskExecutor->initialize(this, _errorHandler);
-	_taskExecutors.push_back(simpleAsyncTaskExecutor);
-	simpleAsyncTaskExecutor->execute(0);
+CProviderExecutorRequestHandler::RequestTask::RequestTask() {
 }
 
-std::deque<SmartPtrITaskExecutor> CProviderExecutorRequestHandler::removeFinishedTaskExecutors(
-		const std::deque<SmartPtrITaskExecutor> taskExecutors) const {
+CProviderExecutorRequestHandler::RequestTask::~RequestTask() {
+}
 
-	std::deque<SmartPtrITaskExecutor> taskExecutorsTmp;
-	for (TConstIterator<std::deque<SmartPtrITaskExecutor> > iter(taskExecutors);
-			iter; iter++) {
-		const SmartPtrITaskExecutor taskExecutorIter = *iter;
-		if (! ((taskExecutorIter->getState() == ITaskExecutor::ETaskStateFinished)
-				|| (taskExecutorIter->getState() == ITaskExecutor::ETaskStateFailed))) {
-			taskExecutorsTmp.push_back(taskExecutorIter);
-		}
+void CProviderExecutorRequestHandler::RequestTask::init(
+		const SmartPtrCProviderExecutorRequestHandler& handler,
+		const SmartPtrCProviderRunLimiter& runLimiter) {
+	_handler = handler;
+	_runLimiter = runLimiter;
+}
+
+void CProviderExecutorRequestHandler::RequestTask::run() {
+	CAF_CM_STATIC_FUNC_LOG("CProviderExecutorRequestHandler::RequestTask", "run");
+
+	try {
+		_handler->run();
 	}
+	CAF_CM_CATCH_ALL;
 
-	return taskExecutorsTmp;
+	_runLimiter->release();
+	CAF_CM_THROWEXCEPTION;
 }
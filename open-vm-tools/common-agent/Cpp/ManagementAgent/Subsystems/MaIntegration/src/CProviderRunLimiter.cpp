@@ -0,0 +1,69 @@
+/*
+ *  Created on: Oct 15, 2026
+ *
+ *	Copyright (C) 2026 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+#include "stdafx.h"
+
+#include "Common/CWorkStealingThreadPool.h"
+#include "CProviderRunLimiter.h"
+
+using namespace Caf;
+
+CProviderRunLimiter::CProviderRunLimiter() :
+		_isInitialized(false),
+		_maxConcurrentRuns(0),
+		_activeRunCount(0),
+		CAF_CM_INIT_LOG("CProviderRunLimiter") {
+	CAF_CM_INIT_THREADSAFE;
+}
+
+CProviderRunLimiter::~CProviderRunLimiter() {
+}
+
+void CProviderRunLimiter::initialize(const uint32 maxConcurrentRuns) {
+	CAF_CM_FUNCNAME_VALIDATE("initialize");
+	CAF_CM_LOCK_UNLOCK;
+	CAF_CM_PRECOND_ISNOTINITIALIZED(_isInitialized);
+
+	_maxConcurrentRuns = maxConcurrentRuns;
+	_isInitialized = true;
+}
+
+void CProviderRunLimiter::submit(
+		const CWorkStealingThreadPool::SmartPtrIThreadTask& task) {
+	CAF_CM_FUNCNAME_VALIDATE("submit");
+	CAF_CM_LOCK_UNLOCK;
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+	CAF_CM_VALIDATE_INTERFACE(task);
+
+	if ((_maxConcurrentRuns == 0) || (_activeRunCount < _maxConcurrentRuns)) {
+		++_activeRunCount;
+
+		// Provider runs are long compared to most pool work, so they go in
+		// at low priority and shorter tasks queued after them are taken first.
+		CWorkStealingThreadPool::getSharedPool()->enqueue(
+				task, CWorkStealingThreadPool::PRIORITY_LOW);
+	} else {
+		CAF_CM_LOG_DEBUG_VA2("Provider run waiting for a slot - active: %d, waiting: %d",
+				_activeRunCount, _waitingTasks.size());
+		_waitingTasks.push_back(task);
+	}
+}
+
+void CProviderRunLimiter::release() {
+	CAF_CM_FUNCNAME_VALIDATE("release");
+	CAF_CM_LOCK_UNLOCK;
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	// The slot passes straight to the longest waiting run
+	if (_waitingTasks.empty()) {
+		--_activeRunCount;
+	} else {
+		const CWorkStealingThreadPool::SmartPtrIThreadTask task = _waitingTasks.front();
+		_waitingTasks.pop_front();
+		CWorkStealingThreadPool::getSharedPool()->enqueue(
+				task, CWorkStealingThreadPool::PRIORITY_LOW);
+	}
+}
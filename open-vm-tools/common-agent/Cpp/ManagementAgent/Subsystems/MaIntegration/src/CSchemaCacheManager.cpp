@@ -106,7 +106,7 @@ std::string CSchemaCacheManager::findProvider(
 
 void CSchemaCacheManager::processSchemaSummaries(
 	const std::string& schemaCacheDirPath,
-	CClassCollection& classCollection) const {
+	CClassCollection& classCollection) {
 	CAF_CM_FUNCNAME_VALIDATE("processSchemaSummaries");
 
 	CAF_CM_ENTER {
@@ -136,12 +136,24 @@ void CSchemaCacheManager::processSchemaSummaries(
 					"Schema cache directory found without schema summary file... might be a timing issue - %s",
 					providerSchemaCacheDirPath.c_str());
 			} else {
+				// Summaries already added are only re-parsed once they change
+				const int64 modifiedTime =
+					FileSystemUtils::getFileModifiedTime(schemaSummaryFilePath);
+				CFileModifiedTimes::const_iterator modifiedTimeIter =
+					_schemaSummaryModifiedTimes.find(schemaSummaryFilePath);
+				if ((modifiedTime >= 0)
+					&& (modifiedTimeIter != _schemaSummaryModifiedTimes.end())
+					&& (modifiedTimeIter->second == modifiedTime)) {
+					continue;
+				}
+
 				CAF_CM_LOG_DEBUG_VA1("Found schema cache summary file - %s", schemaSummaryFilePath.c_str());
 
 				const SmartPtrCSchemaSummaryDoc schemaSummary =
 					XmlRoots::parseSchemaSummaryFromFile(schemaSummaryFilePath);
 
 				addNewClasses(schemaSummary, schemaSummaryFilePath, classCollection);
+				_schemaSummaryModifiedTimes[schemaSummaryFilePath] = modifiedTime;
 			}
 		}
 	}
@@ -235,6 +235,18 @@ struct AsyncSocket {
    Bool recvCbTimer;
    Bool recvFireOnPartial;
 
+   /* AsyncSocket_RecvPackets state. */
+   struct {
+      AsyncSocketRecvFn recvFn;  /* NULL unless receiving (or paused) */
+      void *clientData;
+      int maxLen;                /* Largest payload accepted */
+      char *buf;                 /* Pooled slab, or a larger heap buffer */
+      int bufLen;
+      int start;                 /* First byte not yet delivered */
+      int end;                   /* End of the received data */
+      Bool dispatching;          /* Inside AsyncSocketPacketDeliver */
+   } packet;
+
    SendBufList *sendBufList;
    SendBufList **sendBufTail;
    int sendPos;
@@ -244,6 +256,9 @@ struct AsyncSocket {
    Bool sendBufFull;
    Bool sendLowLatency;
 
+   AsyncSocketStats stats;
+   uint64 sendBufFullSince;   /* When sendBufFull was set, 0 if untimed */
+
    Bool sslConnected;
 
    uint8 inIPollCb;
@@ -71,6 +71,22 @@
 #include "uwvmkAPI.h"
 #endif
 
+/*
+ * On plain (non-SSL) sockets, queued send buffers are gathered into a single
+ * writev() of up to ASOCK_SEND_IOV_MAX buffers. The cap keeps the iovec
+ * array on the stack small.
+ */
+#if !defined(_WIN32) && defined(USE_SSL_DIRECT)
+#include <limits.h>
+#include <sys/uio.h>
+#define ASOCK_SEND_VECTORED
+#if defined(IOV_MAX) && IOV_MAX < 64
+#define ASOCK_SEND_IOV_MAX IOV_MAX
+#else
+#define ASOCK_SEND_IOV_MAX 64
+#endif
+#endif
+
 #ifdef __linux__
 /*
  * Our toolchain does not support IPV6_V6ONLY, but the host we are running on
@@ -114,10 +130,54 @@
  */
 static Atomic_uint32 nextid = { 1 };
 
+/*
+ * Sockets receiving length-prefixed packets (AsyncSocket_RecvPackets) read
+ * into slabs of ASOCK_PACKET_SLAB_SIZE bytes; packets that don't fit get a
+ * buffer of their own. Up to ASOCK_PACKET_POOL_SIZE released slabs are kept
+ * for reuse by other sockets.
+ */
+#define ASOCK_PACKET_HDR_SIZE   ((int)sizeof(uint32))
+#define ASOCK_PACKET_SLAB_SIZE  (64 * 1024)
+#define ASOCK_PACKET_POOL_SIZE  16
+
+static Atomic_Ptr asockPacketPoolLockStorage;
+static struct {
+   char     *slabs[ASOCK_PACKET_POOL_SIZE];
+   unsigned  numFree;
+} asockPacketPool;
+
+/*
+ * I/O statistics. Every socket keeps its own counts in asock->stats; with
+ * statistics enabled, callbacks and full send buffers are also timed and
+ * everything is summed up here as well.
+ */
+static Atomic_uint32 asockStatsEnabled;
+static struct {
+   Atomic_uint64 bytesSent;
+   Atomic_uint64 bytesRecv;
+   Atomic_uint64 msgsSent;
+   Atomic_uint64 msgsRecv;
+   Atomic_uint64 sendQueueLenMax;
+   Atomic_uint64 sendQueueBytesMax;
+   Atomic_uint64 sendBufFullTime;
+   Atomic_uint64 callbacks;
+   Atomic_uint64 callbackTime;
+   Atomic_uint64 callbackTimeMax;
+   Atomic_uint64 errors[ASOCKERR_COUNT];
+} asockGlobalStats;
+
+#define ASOCK_STATS_ENABLED()  (Atomic_Read32(&asockStatsEnabled) != 0)
+
 /*
  * Local Functions
  */
 static Bool AsyncSocketHasDataPending(AsyncSocket *asock);
+static void AsyncSocketStatsAdd(AsyncSocket *asock, uint64 *counter,
+                                Atomic_uint64 *global, uint64 val);
+static void AsyncSocketStatsQueue(AsyncSocket *asock, Bool enqueue, int len);
+static void AsyncSocketStatsSendBufFull(AsyncSocket *asock, Bool full);
+static uint64 AsyncSocketStatsCallbackStart(void);
+static void AsyncSocketStatsCallbackDone(AsyncSocket *asock, uint64 start);
 static int AsyncSocketMakeNonBlocking(int fd);
 static void AsyncSocketAcceptCallback(void *clientData);
 static void AsyncSocketConnectCallback(void *clientData);
@@ -149,6 +209,11 @@ static void AsyncSocketIPollRecvCallback(void *clientData);
 static Bool AsyncSocketAddListenCbSocket(AsyncSocket *asock);
 static void AsyncSocketSslConnectCallback(void *clientData);
 static void AsyncSocketSslAcceptCallback(void *clientData);
+static void AsyncSocketPacketRecvCb(void *buf, int len, AsyncSocket *asock,
+                                    void *clientData);
+static Bool AsyncSocketPacketReady(const AsyncSocket *asock);
+static Bool AsyncSocketPacketDeliver(AsyncSocket *asock);
+static void AsyncSocketPacketReset(AsyncSocket *asock);
 
 static const AsyncSocketVTable asyncStreamSocketVTable = {
    AsyncSocketGetState,
@@ -2338,7 +2403,12 @@ AsyncSocketRecvSocket(AsyncSocket *asock, // IN:
       asock->recvCb = TRUE;
    }
 
-   if (AsyncSocketHasDataPending(asock) && !asock->inRecvLoop) {
+   /*
+    * Packets buffered before AsyncSocket_RecvPackets was paused are handed
+    * out by the recv callback too; see AsyncSocketFillRecvBuffer.
+    */
+   if ((AsyncSocketHasDataPending(asock) || AsyncSocketPacketReady(asock)) &&
+       !asock->inRecvLoop) {
       ASOCKLOG(0, asock, ("installing recv RTime poll callback\n"));
       if (AsyncSocketPollAdd(asock, FALSE, 0, asock->vt->recvCallback, 0) !=
           VMWARE_STATUS_SUCCESS) {
@@ -2450,6 +2520,21 @@ AsyncSocketRecv(AsyncSocket *asock,  // IN:
       ASOCKWARN(asock, ("Recv called -- partially read buffer discarded.\n"));
    }
 
+   if (recvFn != AsyncSocketPacketRecvCb && asock->packet.buf != NULL) {
+      if (asock->packet.end != asock->packet.start) {
+         ASOCKWARN(asock, ("Recv called -- %d buffered packet bytes "
+                           "discarded.\n",
+                           asock->packet.end - asock->packet.start));
+      }
+      if (asock->packet.dispatching) {
+         /* Called from a packet callback; the buffer is still in use. */
+         asock->packet.recvFn = NULL;
+         asock->packet.start = asock->packet.end;
+      } else {
+         AsyncSocketPacketReset(asock);
+      }
+   }
+
    ASSERT(asock->vt);
    ASSERT(asock->vt->recvInternal);
    retVal = asock->vt->recvInternal(asock, buf, len);
@@ -2525,243 +2610,674 @@ AsyncSocketRecvPassedFd(AsyncSocket *asock,  // IN/OUT: socket
 /*
  *----------------------------------------------------------------------------
  *
- * AsyncSocketPoll --
- *
- *      Blocks on the specified socket until there's data pending or a
- *      timeout occurs.
+ * AsyncSocketPacketSlabAlloc --
+ * AsyncSocketPacketSlabFree --
  *
- *      If the specified socket is a dual stack listener, we will poll on all
- *      listening sockets and will return when one is ready with data for a
- *      connection. If both socket families happen to race with connect data,
- *      we will favor IPv6 for the return.
+ *      Get a receive slab from the pool (or the heap, when the pool is
+ *      empty) and give it back.
  *
  * Results:
- *      ASOCKERR_SUCCESS if it worked, ASOCKERR_GENERIC on system call
- *        failures
- *      ASOCKERR_TIMEOUT if we just didn't receive enough data.
+ *      A slab of ASOCK_PACKET_SLAB_SIZE bytes, or NULL if out of memory.
  *
  * Side effects:
  *      None.
+ *
  *----------------------------------------------------------------------------
  */
 
-static int
-AsyncSocketPoll(AsyncSocket *s,          // IN:
-                Bool read,               // IN:
-                int timeoutMS,           // IN:
-                AsyncSocket **outAsock)  // OUT:
+static char *
+AsyncSocketPacketSlabAlloc(void)
 {
-#ifndef _WIN32
-   struct pollfd p[2];
-   int retval;
-#else
-   /*
-    * We use select() to do this on Windows, since there ain't no poll().
-    * Fortunately, select() doesn't have the 1024 fd value limit.
-    */
-
-   int retval;
-   struct timeval tv;
-   struct fd_set rwfds;
-   struct fd_set exceptfds;
-#endif
-   AsyncSocket *asock[2];
-   int numSock = 0;
-   int i;
-
-   ASSERT(s->asockType != ASYNCSOCKET_TYPE_NAMEDPIPE);
-   ASSERT(*outAsock == NULL);
-
-   if (read && s->fd == -1) {
-      if (!s->listenAsock4 && !s->listenAsock6) {
-         ASSERT(FALSE);
-         ASOCKLG0(s, ("%s: Failed to find listener socket.\n", __FUNCTION__));
-         return ASOCKERR_GENERIC;
-      }
+   MXUserExclLock *lock =
+      MXUser_CreateSingletonExclLock(&asockPacketPoolLockStorage,
+                                     "asockPacketPoolLock", RANK_LEAF);
+   char *slab = NULL;
 
-      if (s->listenAsock6 && s->listenAsock6->fd != -1) {
-         asock[numSock++] = s->listenAsock6;
-      }
-      if (s->listenAsock4 && s->listenAsock4->fd != -1) {
-         asock[numSock++] = s->listenAsock4;
-      }
-   } else {
-      asock[numSock++] = s;
+   MXUser_AcquireExclLock(lock);
+   if (asockPacketPool.numFree > 0) {
+      slab = asockPacketPool.slabs[--asockPacketPool.numFree];
    }
+   MXUser_ReleaseExclLock(lock);
 
-   for (i = 0; i < numSock; i++) {
-      if (read && SSL_Pending(asock[i]->sslSock)) {
-         *outAsock = asock[i];
-         return ASOCKERR_SUCCESS;
-      }
-   }
-
-   while (1) {
-#ifndef _WIN32
-      for (i = 0; i < numSock; i++) {
-         p[i].fd = asock[i]->fd;
-         p[i].events = read ? POLLIN : POLLOUT;
-      }
-
-      retval = poll(p, numSock, timeoutMS);
-#else
-      tv.tv_sec = timeoutMS / 1000;
-      tv.tv_usec = (timeoutMS % 1000) * 1000;
-
-      FD_ZERO(&rwfds);
-      FD_ZERO(&exceptfds);
-
-      for (i = 0; i < numSock; i++) {
-         FD_SET(asock[i]->fd, &rwfds);
-         FD_SET(asock[i]->fd, &exceptfds);
-      }
+   return slab != NULL ? slab : malloc(ASOCK_PACKET_SLAB_SIZE);
+}
 
-      retval = select(1, read ? &rwfds : NULL, read ? NULL : &rwfds,
-                      &exceptfds, timeoutMS >= 0 ? &tv : NULL);
-#endif
 
-      switch (retval) {
-      case 1:
-      case 2: {
-         Bool failed = FALSE;
+static void
+AsyncSocketPacketSlabFree(char *slab)  // IN
+{
+   MXUserExclLock *lock =
+      MXUser_CreateSingletonExclLock(&asockPacketPoolLockStorage,
+                                     "asockPacketPoolLock", RANK_LEAF);
 
-#ifndef _WIN32
-         for (i = 0; i < numSock; i++) {
-            if (p[i].revents & (POLLERR | POLLNVAL)) {
-               failed = TRUE;
-            }
-         }
-#else
-         for (i = 0; i < numSock; i++) {
-            if (FD_ISSET(asock[i]->fd, &exceptfds)) {
-               failed = TRUE;
-            }
-         }
-#endif
+   MXUser_AcquireExclLock(lock);
+   if (asockPacketPool.numFree < ARRAYSIZE(asockPacketPool.slabs)) {
+      asockPacketPool.slabs[asockPacketPool.numFree++] = slab;
+      slab = NULL;
+   }
+   MXUser_ReleaseExclLock(lock);
 
-         if (failed) {
-            int sockErr = 0;
-            int sysErr;
-            int sockErrLen = sizeof sockErr;
+   free(slab);
+}
 
-            for (i = 0; i < numSock; i++) {
-               if (getsockopt(asock[i]->fd, SOL_SOCKET, SO_ERROR,
-                              (void *) &sockErr, (void *) &sockErrLen) == 0) {
-                  if (sockErr) {
-                     asock[i]->genericErrno = sockErr;
-                     ASOCKLG0(asock[i],
-                              ("%s: Socket error lookup returned %d: %s\n",
-                               __FUNCTION__, sockErr,
-                               Err_Errno2String(sockErr)));
-                  }
-               } else {
-                  sysErr = ASOCK_LASTERROR();
-                  asock[i]->genericErrno = sysErr;
-                  ASOCKLG0(asock[i],
-                           ("%s: Last socket error %d: %s\n",
-                            __FUNCTION__, sysErr, Err_Errno2String(sysErr)));
-               }
-            }
 
-            return ASOCKERR_GENERIC;
-         }
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocketPacketReset --
+ *
+ *      Leave packet receive mode, dropping whatever is buffered.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Releases the receive buffer.
+ *
+ *----------------------------------------------------------------------------
+ */
 
-         /*
-          * If one socket is ready, and it wasn't in an exception state,
-          * everything is ok. The socket is ready for reading/writing.
-          */
+static void
+AsyncSocketPacketReset(AsyncSocket *asock)  // IN/OUT
+{
+   ASSERT(!asock->packet.dispatching);
 
-#ifndef _WIN32
-         for (i = 0; i < numSock; i++) {
-            if (p[i].revents & (read ? POLLIN : POLLOUT)) {
-               *outAsock = asock[i];
-               return ASOCKERR_SUCCESS;
-            }
-         }
-#else
-         for (i = 0; i < numSock; i++) {
-            if (FD_ISSET(asock[i]->fd, &rwfds)) {
-               *outAsock = asock[i];
-               return ASOCKERR_SUCCESS;
-            }
-         }
-#endif
+   if (asock->packet.bufLen == ASOCK_PACKET_SLAB_SIZE) {
+      AsyncSocketPacketSlabFree(asock->packet.buf);
+   } else {
+      free(asock->packet.buf);
+   }
+   memset(&asock->packet, 0, sizeof asock->packet);
+}
 
-         ASOCKWARN(s, ("%s: Failed to return a ready socket.\n",
-                       __FUNCTION__));
-         return ASOCKERR_GENERIC;
-      }
-      case 0:
-         /*
-          * No sockets were ready within the specified time.
-          */
-         ASOCKLG0(s, ("%s: Timeout waiting for a ready socket.\n",
-                      __FUNCTION__));
-         return ASOCKERR_TIMEOUT;
 
-      case -1: {
-         int sysErr = ASOCK_LASTERROR();
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocketPacketNeeded --
+ *
+ *      Size of the packet at the head of the receive buffer, header
+ *      included, as far as it is known.
+ *
+ * Results:
+ *      The packet size, or ASOCK_PACKET_HDR_SIZE while the header is
+ *      incomplete.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
 
-         if (sysErr == EINTR) {
-            /*
-             * We were somehow interrupted by signal. Let's loop and retry.
-             */
+static int64
+AsyncSocketPacketNeeded(const AsyncSocket *asock)  // IN
+{
+   uint32 pktLen;
 
-            ASOCKLG0(s, ("%s: Socket interrupted by a signal.\n",
-                         __FUNCTION__));
-            continue;
-         }
+   if (asock->packet.end - asock->packet.start < ASOCK_PACKET_HDR_SIZE) {
+      return ASOCK_PACKET_HDR_SIZE;
+   }
 
-         s->genericErrno = sysErr;
+   /* Packets are not aligned in the buffer. */
+   memcpy(&pktLen, asock->packet.buf + asock->packet.start, sizeof pktLen);
 
-         ASOCKLG0(s, ("%s: Failed with error %d: %s\n", __FUNCTION__, sysErr,
-                      Err_Errno2String(sysErr)));
-         return ASOCKERR_GENERIC;
-      }
-      default:
-         NOT_REACHED();
-      }
-   }
+   return (int64)ntohl(pktLen) + ASOCK_PACKET_HDR_SIZE;
 }
 
 
 /*
  *----------------------------------------------------------------------------
  *
- * AsyncSocket_RecvBlocking --
- * AsyncSocket_RecvPartialBlocking --
- * AsyncSocket_SendBlocking --
- *
- *      Implement "blocking + timeout" operations on the socket. These are
- *      simple wrappers around the AsyncSocketBlockingWork function, which
- *      operates on the actual non-blocking socket, using poll to determine
- *      when it's ok to keep reading/writing. If we can't finish within the
- *      specified time, we give up and return the ASOCKERR_TIMEOUT error.
+ * AsyncSocketPacketTooBig --
  *
- *      Note that if these are called from a callback and a lock is being
- *      used (pollParams.lock), the whole blocking operation takes place
- *      with that lock held.  Regardless, it is the caller's responsibility
- *      to make sure the synchronous and asynchronous operations do not mix.
+ *      Check a packet size from AsyncSocketPacketNeeded against the limit
+ *      given to AsyncSocket_RecvPackets.
  *
  * Results:
- *      ASOCKERR_SUCCESS if we finished the operation, ASOCKERR_* error codes
- *      otherwise.
+ *      TRUE if the packet is over the limit.
  *
  * Side effects:
- *      Reads/writes the socket.
+ *      Logs.
  *
  *----------------------------------------------------------------------------
  */
 
-int
-AsyncSocket_RecvBlocking(AsyncSocket *s,
-                         void *buf,
-                         int len,
-                         int *received,
-                         int timeoutMS)
+static Bool
+AsyncSocketPacketTooBig(AsyncSocket *asock,  // IN
+                        int64 needed)        // IN
 {
-   return AsyncSocketBlockingWork(s, TRUE, buf, len, received, timeoutMS,
-                                  FALSE);
+   if (needed - ASOCK_PACKET_HDR_SIZE <= asock->packet.maxLen) {
+      return FALSE;
+   }
+   ASOCKWARN(asock, ("packet of %"FMT64"d bytes exceeds limit of %d\n",
+                     needed - ASOCK_PACKET_HDR_SIZE, asock->packet.maxLen));
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocketPacketReady --
+ *
+ *      Whether a complete packet is buffered and packet receive is active.
+ *
+ * Results:
+ *      TRUE if AsyncSocketPacketDeliver has something to hand out.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+AsyncSocketPacketReady(const AsyncSocket *asock)  // IN
+{
+   return asock->packet.recvFn != NULL && !asock->packet.dispatching &&
+          asock->packet.end - asock->packet.start >=
+             AsyncSocketPacketNeeded(asock);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocketPacketArm --
+ *
+ *      Make room for the rest of the current packet and post a partial
+ *      receive into the free end of the buffer.
+ *
+ *      The incomplete packet at the head of the buffer, if any, is moved
+ *      to the front; complete packets were handed out in place. A packet
+ *      larger than a slab gets a buffer of its own, which is swapped back
+ *      for a slab once it has been delivered.
+ *
+ * Results:
+ *      ASOCKERR_*.
+ *
+ * Side effects:
+ *      May reallocate the receive buffer.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+AsyncSocketPacketArm(AsyncSocket *asock)  // IN/OUT
+{
+   int avail = asock->packet.end - asock->packet.start;
+   int64 needed = AsyncSocketPacketNeeded(asock);
+   int bufLen;
+
+   ASSERT(AsyncSocketIsLocked(asock));
+
+   if (AsyncSocketPacketTooBig(asock, needed)) {
+      return ASOCKERR_GENERIC;
+   }
+
+   /*
+    * When resuming, the head packet may be complete already; leave room
+    * for at least one more byte so there is something to receive into.
+    */
+   bufLen = MAX((int)MAX(needed, avail + 1), ASOCK_PACKET_SLAB_SIZE);
+
+   if (asock->packet.buf == NULL || asock->packet.bufLen != bufLen) {
+      char *buf = bufLen == ASOCK_PACKET_SLAB_SIZE ?
+                  AsyncSocketPacketSlabAlloc() : malloc(bufLen);
+
+      if (buf == NULL) {
+         ASOCKWARN(asock, ("could not allocate a %d byte receive buffer\n",
+                           bufLen));
+         return ASOCKERR_GENERIC;
+      }
+      if (avail > 0) {
+         memcpy(buf, asock->packet.buf + asock->packet.start, avail);
+      }
+      if (asock->packet.bufLen == ASOCK_PACKET_SLAB_SIZE) {
+         AsyncSocketPacketSlabFree(asock->packet.buf);
+      } else {
+         free(asock->packet.buf);
+      }
+      asock->packet.buf = buf;
+      asock->packet.bufLen = bufLen;
+   } else if (asock->packet.start > 0 && avail > 0) {
+      memmove(asock->packet.buf, asock->packet.buf + asock->packet.start,
+              avail);
+   }
+   asock->packet.start = 0;
+   asock->packet.end = avail;
+
+   return AsyncSocketRecv(asock, asock->packet.buf + avail, bufLen - avail,
+                          TRUE, AsyncSocketPacketRecvCb, NULL);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocketPacketDeliver --
+ *
+ *      Hand every complete buffered packet to the client, then post a
+ *      receive for more. Stops early if the client closes the socket or
+ *      cancels the receive from its callback.
+ *
+ *      Errors (an oversized packet, or failing to post the receive) are
+ *      reported through the error handler.
+ *
+ * Results:
+ *      TRUE if receiving stopped, FALSE if a receive is posted.
+ *
+ * Side effects:
+ *      Fires the packet callback, possibly many times.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+AsyncSocketPacketDeliver(AsyncSocket *asock)  // IN/OUT
+{
+   int err;
+
+   ASSERT(AsyncSocketIsLocked(asock));
+   ASSERT(!asock->packet.dispatching);
+
+   asock->packet.dispatching = TRUE;
+   while (asock->packet.recvFn != NULL &&
+          asock->state == AsyncSocketConnected) {
+      int avail = asock->packet.end - asock->packet.start;
+      int64 needed = AsyncSocketPacketNeeded(asock);
+      uint64 start;
+      char *pkt;
+
+      if (AsyncSocketPacketTooBig(asock, needed)) {
+         asock->packet.dispatching = FALSE;
+         err = ASOCKERR_GENERIC;
+         goto error;
+      }
+      if (avail < needed) {
+         break;
+      }
+
+      pkt = asock->packet.buf + asock->packet.start;
+      asock->packet.start += (int)needed;
+      ASOCKLOG(3, asock, ("delivering %d byte packet\n", (int)needed));
+      AsyncSocketStatsAdd(asock, &asock->stats.msgsRecv,
+                          &asockGlobalStats.msgsRecv, 1);
+      start = AsyncSocketStatsCallbackStart();
+      asock->packet.recvFn(pkt, (int)needed, asock, asock->packet.clientData);
+      AsyncSocketStatsCallbackDone(asock, start);
+   }
+   asock->packet.dispatching = FALSE;
+
+   if (asock->state != AsyncSocketConnected || asock->packet.recvFn == NULL) {
+      return TRUE;
+   }
+
+   err = AsyncSocketPacketArm(asock);
+   if (err == ASOCKERR_SUCCESS) {
+      return FALSE;
+   }
+
+error:
+   AsyncSocketCancelRecv(asock, NULL, NULL, NULL, TRUE);
+   AsyncSocketPacketReset(asock);
+   AsyncSocketHandleError(asock, err);
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocketPacketRecvCb --
+ *
+ *      Partial receive callback posted by AsyncSocketPacketArm.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Fires the packet callback.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+AsyncSocketPacketRecvCb(void *buf,           // IN
+                        int len,             // IN
+                        AsyncSocket *asock,  // IN
+                        void *clientData)    // IN: unused
+{
+   ASSERT(buf == asock->packet.buf + asock->packet.end);
+
+   asock->packet.end += len;
+   AsyncSocketPacketDeliver(asock);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocket_RecvPackets --
+ *
+ *      Receive a stream of length-prefixed packets: each is a 32-bit length
+ *      in network byte order followed by that many bytes, the framing used
+ *      by the RpcIn and RabbitMQ proxy vsock channels.
+ *
+ *      Instead of a header receive, an allocation and a body receive per
+ *      packet, the socket reads as much as is available into a pooled
+ *      buffer and recvFn fires once per complete packet, pointing into that
+ *      buffer. buf covers the length prefix too; it is only valid until
+ *      recvFn returns.
+ *
+ *      AsyncSocket_CancelRecv pauses delivery, keeping what has already been
+ *      read, and calling this again resumes it. AsyncSocket_Recv leaves
+ *      packet mode and drops the buffered data.
+ *
+ * Results:
+ *      ASOCKERR_*.
+ *
+ * Side effects:
+ *      Could register poll callbacks.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+AsyncSocket_RecvPackets(AsyncSocket *asock,         // IN
+                        int maxPacketLen,           // IN: payload limit
+                        AsyncSocketRecvFn recvFn,   // IN
+                        void *clientData)           // IN
+{
+   int retVal;
+
+   if (!asock || !recvFn || maxPacketLen < 0 ||
+       maxPacketLen > MAX_INT32 - ASOCK_PACKET_HDR_SIZE) {
+      Warning(ASOCKPREFIX "%s called with invalid arguments!\n",
+              __FUNCTION__);
+
+      return ASOCKERR_INVAL;
+   }
+
+   if (asock->asockType == ASYNCSOCKET_TYPE_NAMEDPIPE) {
+      return ASOCKERR_INVAL;
+   }
+
+   AsyncSocketLock(asock);
+
+   if (asock->state != AsyncSocketConnected) {
+      ASOCKWARN(asock, ("recv called but state is not connected!\n"));
+      retVal = ASOCKERR_NOTCONNECTED;
+      goto outHaveLock;
+   }
+
+   asock->packet.recvFn = recvFn;
+   asock->packet.clientData = clientData;
+   asock->packet.maxLen = maxPacketLen;
+
+   if (asock->packet.dispatching) {
+      /* Resumed from a packet callback; the delivery loop carries on. */
+      retVal = ASOCKERR_SUCCESS;
+      goto outHaveLock;
+   }
+
+   /*
+    * Anything already complete is delivered from the RTime callback that
+    * AsyncSocketRecvSocket installs, not from here.
+    */
+   retVal = AsyncSocketPacketArm(asock);
+   if (retVal != ASOCKERR_SUCCESS) {
+      asock->packet.recvFn = NULL;
+   }
+
+outHaveLock:
+   AsyncSocketUnlock(asock);
+   return retVal;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocketPoll --
+ *
+ *      Blocks on the specified socket until there's data pending or a
+ *      timeout occurs.
+ *
+ *      If the specified socket is a dual stack listener, we will poll on all
+ *      listening sockets and will return when one is ready with data for a
+ *      connection. If both socket families happen to race with connect data,
+ *      we will favor IPv6 for the return.
+ *
+ * Results:
+ *      ASOCKERR_SUCCESS if it worked, ASOCKERR_GENERIC on system call
+ *        failures
+ *      ASOCKERR_TIMEOUT if we just didn't receive enough data.
+ *
+ * Side effects:
+ *      None.
+ *----------------------------------------------------------------------------
+ */
+
+static int
+AsyncSocketPoll(AsyncSocket *s,          // IN:
+                Bool read,               // IN:
+                int timeoutMS,           // IN:
+                AsyncSocket **outAsock)  // OUT:
+{
+#ifndef _WIN32
+   struct pollfd p[2];
+   int retval;
+#else
+   /*
+    * We use select() to do this on Windows, since there ain't no poll().
+    * Fortunately, select() doesn't have the 1024 fd value limit.
+    */
+
+   int retval;
+   struct timeval tv;
+   struct fd_set rwfds;
+   struct fd_set exceptfds;
+#endif
+   AsyncSocket *asock[2];
+   int numSock = 0;
+   int i;
+
+   ASSERT(s->asockType != ASYNCSOCKET_TYPE_NAMEDPIPE);
+   ASSERT(*outAsock == NULL);
+
+   if (read && s->fd == -1) {
+      if (!s->listenAsock4 && !s->listenAsock6) {
+         ASSERT(FALSE);
+         ASOCKLG0(s, ("%s: Failed to find listener socket.\n", __FUNCTION__));
+         return ASOCKERR_GENERIC;
+      }
+
+      if (s->listenAsock6 && s->listenAsock6->fd != -1) {
+         asock[numSock++] = s->listenAsock6;
+      }
+      if (s->listenAsock4 && s->listenAsock4->fd != -1) {
+         asock[numSock++] = s->listenAsock4;
+      }
+   } else {
+      asock[numSock++] = s;
+   }
+
+   for (i = 0; i < numSock; i++) {
+      if (read && SSL_Pending(asock[i]->sslSock)) {
+         *outAsock = asock[i];
+         return ASOCKERR_SUCCESS;
+      }
+   }
+
+   while (1) {
+#ifndef _WIN32
+      for (i = 0; i < numSock; i++) {
+         p[i].fd = asock[i]->fd;
+         p[i].events = read ? POLLIN : POLLOUT;
+      }
+
+      retval = poll(p, numSock, timeoutMS);
+#else
+      tv.tv_sec = timeoutMS / 1000;
+      tv.tv_usec = (timeoutMS % 1000) * 1000;
+
+      FD_ZERO(&rwfds);
+      FD_ZERO(&exceptfds);
+
+      for (i = 0; i < numSock; i++) {
+         FD_SET(asock[i]->fd, &rwfds);
+         FD_SET(asock[i]->fd, &exceptfds);
+      }
+
+      retval = select(1, read ? &rwfds : NULL, read ? NULL : &rwfds,
+                      &exceptfds, timeoutMS >= 0 ? &tv : NULL);
+#endif
+
+      switch (retval) {
+      case 1:
+      case 2: {
+         Bool failed = FALSE;
+
+#ifndef _WIN32
+         for (i = 0; i < numSock; i++) {
+            if (p[i].revents & (POLLERR | POLLNVAL)) {
+               failed = TRUE;
+            }
+         }
+#else
+         for (i = 0; i < numSock; i++) {
+            if (FD_ISSET(asock[i]->fd, &exceptfds)) {
+               failed = TRUE;
+            }
+         }
+#endif
+
+         if (failed) {
+            int sockErr = 0;
+            int sysErr;
+            int sockErrLen = sizeof sockErr;
+
+            for (i = 0; i < numSock; i++) {
+               if (getsockopt(asock[i]->fd, SOL_SOCKET, SO_ERROR,
+                              (void *) &sockErr, (void *) &sockErrLen) == 0) {
+                  if (sockErr) {
+                     asock[i]->genericErrno = sockErr;
+                     ASOCKLG0(asock[i],
+                              ("%s: Socket error lookup returned %d: %s\n",
+                               __FUNCTION__, sockErr,
+                               Err_Errno2String(sockErr)));
+                  }
+               } else {
+                  sysErr = ASOCK_LASTERROR();
+                  asock[i]->genericErrno = sysErr;
+                  ASOCKLG0(asock[i],
+                           ("%s: Last socket error %d: %s\n",
+                            __FUNCTION__, sysErr, Err_Errno2String(sysErr)));
+               }
+            }
+
+            return ASOCKERR_GENERIC;
+         }
+
+         /*
+          * If one socket is ready, and it wasn't in an exception state,
+          * everything is ok. The socket is ready for reading/writing.
+          */
+
+#ifndef _WIN32
+         for (i = 0; i < numSock; i++) {
+            if (p[i].revents & (read ? POLLIN : POLLOUT)) {
+               *outAsock = asock[i];
+               return ASOCKERR_SUCCESS;
+            }
+         }
+#else
+         for (i = 0; i < numSock; i++) {
+            if (FD_ISSET(asock[i]->fd, &rwfds)) {
+               *outAsock = asock[i];
+               return ASOCKERR_SUCCESS;
+            }
+         }
+#endif
+
+         ASOCKWARN(s, ("%s: Failed to return a ready socket.\n",
+                       __FUNCTION__));
+         return ASOCKERR_GENERIC;
+      }
+      case 0:
+         /*
+          * No sockets were ready within the specified time.
+          */
+         ASOCKLG0(s, ("%s: Timeout waiting for a ready socket.\n",
+                      __FUNCTION__));
+         return ASOCKERR_TIMEOUT;
+
+      case -1: {
+         int sysErr = ASOCK_LASTERROR();
+
+         if (sysErr == EINTR) {
+            /*
+             * We were somehow interrupted by signal. Let's loop and retry.
+             */
+
+            ASOCKLG0(s, ("%s: Socket interrupted by a signal.\n",
+                         __FUNCTION__));
+            continue;
+         }
+
+         s->genericErrno = sysErr;
+
+         ASOCKLG0(s, ("%s: Failed with error %d: %s\n", __FUNCTION__, sysErr,
+                      Err_Errno2String(sysErr)));
+         return ASOCKERR_GENERIC;
+      }
+      default:
+         NOT_REACHED();
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocket_RecvBlocking --
+ * AsyncSocket_RecvPartialBlocking --
+ * AsyncSocket_SendBlocking --
+ *
+ *      Implement "blocking + timeout" operations on the socket. These are
+ *      simple wrappers around the AsyncSocketBlockingWork function, which
+ *      operates on the actual non-blocking socket, using poll to determine
+ *      when it's ok to keep reading/writing. If we can't finish within the
+ *      specified time, we give up and return the ASOCKERR_TIMEOUT error.
+ *
+ *      Note that if these are called from a callback and a lock is being
+ *      used (pollParams.lock), the whole blocking operation takes place
+ *      with that lock held.  Regardless, it is the caller's responsibility
+ *      to make sure the synchronous and asynchronous operations do not mix.
+ *
+ * Results:
+ *      ASOCKERR_SUCCESS if we finished the operation, ASOCKERR_* error codes
+ *      otherwise.
+ *
+ * Side effects:
+ *      Reads/writes the socket.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+AsyncSocket_RecvBlocking(AsyncSocket *s,
+                         void *buf,
+                         int len,
+                         int *received,
+                         int timeoutMS)
+{
+   return AsyncSocketBlockingWork(s, TRUE, buf, len, received, timeoutMS,
+                                  FALSE);
 }
 
 int
@@ -2846,6 +3362,13 @@ AsyncSocketBlockingWork(AsyncSocket *s,  // IN:
       ASSERT(asock == s);
       if ((numBytes = read ? SSL_Read(s->sslSock, buf, len)
                            : SSL_Write(s->sslSock, buf, len)) > 0) {
+         if (read) {
+            AsyncSocketStatsAdd(s, &s->stats.bytesRecv,
+                                &asockGlobalStats.bytesRecv, numBytes);
+         } else {
+            AsyncSocketStatsAdd(s, &s->stats.bytesSent,
+                                &asockGlobalStats.bytesSent, numBytes);
+         }
          if (completed) {
             *completed += numBytes;
          }
@@ -3045,6 +3568,7 @@ outUndoAppend:
       }
 
       if ((*pcur)->buf == buf) {
+         AsyncSocketStatsQueue(asock, FALSE, (*pcur)->len);
          free(*pcur);
          *pcur = NULL;
          asock->sendBufTail = pcur;
@@ -3196,6 +3720,7 @@ AsyncSocketCheckAndDispatchRecv(AsyncSocket *s,  // IN
 
    if (s->recvPos == s->recvLen || s->recvFireOnPartial) {
       void *recvBuf = s->recvBuf;
+      uint64 start = 0;
       ASOCKLOG(3, s, ("recv buffer full, calling recvFn\n"));
 
       /*
@@ -3209,7 +3734,14 @@ AsyncSocketCheckAndDispatchRecv(AsyncSocket *s,  // IN
        */
 
       s->recvBuf = NULL;
+      if (s->recvFn != AsyncSocketPacketRecvCb) {
+         /* Packets are counted by AsyncSocketPacketDeliver. */
+         AsyncSocketStatsAdd(s, &s->stats.msgsRecv,
+                             &asockGlobalStats.msgsRecv, 1);
+         start = AsyncSocketStatsCallbackStart();
+      }
       s->recvFn(recvBuf, s->recvPos, s, s->clientData);
+      AsyncSocketStatsCallbackDone(s, start);
       if (s->state == AsyncSocketClosed) {
          ASOCKLG0(s, ("owner closed connection in recv callback\n"));
          *result = ASOCKERR_CLOSED;
@@ -3288,6 +3820,19 @@ AsyncSocketFillRecvBuffer(AsyncSocket *s)
 
    s->inRecvLoop = TRUE;
 
+   if (AsyncSocketPacketReady(s)) {
+      /*
+       * Complete packets left over from a paused AsyncSocket_RecvPackets go
+       * out before reading more.
+       */
+      if (AsyncSocketPacketDeliver(s)) {
+         result = ASOCKERR_SUCCESS;
+         goto exit;
+      }
+      needed = s->recvLen - s->recvPos;
+      ASSERT(needed > 0);
+   }
+
    do {
 
       /*
@@ -3314,6 +3859,8 @@ AsyncSocketFillRecvBuffer(AsyncSocket *s)
       if (recvd > 0) {
          s->sslConnected = TRUE;
          s->recvPos += recvd;
+         AsyncSocketStatsAdd(s, &s->stats.bytesRecv,
+                             &asockGlobalStats.bytesRecv, recvd);
          if (AsyncSocketCheckAndDispatchRecv(s, &result)) {
             goto exit;
          }
@@ -3409,6 +3956,8 @@ AsyncSocketDispatchSentBuffer(AsyncSocket *s)
    s->sendPos = 0;
    free(tmp.encodedBuf);
    free(head);
+   AsyncSocketStatsQueue(s, FALSE, tmp.len);
+   AsyncSocketStatsAdd(s, &s->stats.msgsSent, &asockGlobalStats.msgsSent, 1);
 
    if (tmp.sendFn) {
       /*
@@ -3421,9 +3970,137 @@ AsyncSocketDispatchSentBuffer(AsyncSocket *s)
        * it works. --rrdharan
        */
 
+      uint64 start = AsyncSocketStatsCallbackStart();
+
       tmp.sendFn(tmp.buf, tmp.len, s, tmp.clientData);
+      AsyncSocketStatsCallbackDone(s, start);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocketAdvanceSendPos --
+ *
+ *      Accounts for 'sent' bytes written from the head of the send buffer
+ *      list, which may span several buffers. Buffers that are now fully sent
+ *      are unlinked first, and their send callbacks are then fired in
+ *      order, so that a callback closing the socket or queueing more data
+ *      finds the list in a consistent state.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Fires send callbacks.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+AsyncSocketAdvanceSendPos(AsyncSocket *s,  // IN
+                          int sent)        // IN
+{
+   SendBufList *done = NULL;
+   SendBufList **doneTail = &done;
+
+   while (sent > 0) {
+      SendBufList *head = s->sendBufList;
+      int left;
+
+      ASSERT(head != NULL);
+      left = head->len - s->sendPos;
+      if (sent < left) {
+         s->sendPos += sent;
+         break;
+      }
+
+      sent -= left;
+      s->sendBufList = head->next;
+      s->sendPos = 0;
+      head->next = NULL;
+      *doneTail = head;
+      doneTail = &head->next;
+   }
+
+   if (s->sendBufList == NULL) {
+      s->sendBufTail = &(s->sendBufList);
+   }
+
+   while (done != NULL) {
+      SendBufList *cur = done;
+
+      done = cur->next;
+      free(cur->encodedBuf);
+      AsyncSocketStatsQueue(s, FALSE, cur->len);
+      AsyncSocketStatsAdd(s, &s->stats.msgsSent, &asockGlobalStats.msgsSent,
+                          1);
+
+      if (cur->sendFn) {
+         /*
+          * As in AsyncSocketDispatchSentBuffer, the callback may close the
+          * socket; the caller holds a reference to keep it alive.
+          */
+
+         uint64 start = AsyncSocketStatsCallbackStart();
+
+         cur->sendFn(cur->buf, cur->len, s, cur->clientData);
+         AsyncSocketStatsCallbackDone(s, start);
+      }
+      free(cur);
+   }
+}
+
+
+#ifdef ASOCK_SEND_VECTORED
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocketWriteVectored --
+ *
+ *      Writes as much of the queued send buffers as the socket takes, with
+ *      a single writev() covering up to ASOCK_SEND_IOV_MAX buffers. Only
+ *      for sockets that don't go through SSL.
+ *
+ * Results:
+ *      Number of bytes written, or -1 on error (see ASOCK_LASTERROR).
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+AsyncSocketWriteVectored(AsyncSocket *s)   // IN
+{
+   struct iovec iov[ASOCK_SEND_IOV_MAX];
+   SendBufList *cur;
+   int pos = s->sendPos;
+   int total = 0;
+   int n = 0;
+
+   for (cur = s->sendBufList;
+        cur != NULL && n < ASOCK_SEND_IOV_MAX;
+        cur = cur->next) {
+      int len = cur->len - pos;
+
+      if (len > INT_MAX - total) {
+         break;
+      }
+      iov[n].iov_base = (cur->encodedBuf ? cur->encodedBuf
+                                         : (char *)cur->buf) + pos;
+      iov[n].iov_len = len;
+      total += len;
+      pos = 0;
+      n++;
    }
+
+   ASOCKLOG(3, s, ("writev %d buffers, %d bytes\n", n, total));
+   return writev(SSL_GetFd(s->sslSock), iov, n);
 }
+#endif
 
 
 /*
@@ -3433,7 +4110,8 @@ AsyncSocketDispatchSentBuffer(AsyncSocket *s)
  *
  *      The meat of AsyncSocket's sending functionality.  This function
  *      actually writes to the wire assuming there's space in the buffers
- *      for the socket.
+ *      for the socket. On plain sockets, several queued buffers go out in
+ *      one writev().
  *
  * Results:
  *      ASOCKERR_SUCESS if everything worked, else ASOCKERR_GENERIC.
@@ -3469,8 +4147,12 @@ AsyncSocketWriteBuffers(AsyncSocket *s)
       int error = 0;
       int sent = 0;
       int left = head->len - s->sendPos;
-      int sizeToSend = head->len;
 
+#ifdef ASOCK_SEND_VECTORED
+      if (head->next != NULL && !SSL_IsEncrypted(s->sslSock)) {
+         sent = AsyncSocketWriteVectored(s);
+      } else
+#endif
       if (head->encodedBuf) {
          sent = SSL_Write(s->sslSock,
                           (uint8 *) head->encodedBuf + s->sendPos, left);
@@ -3481,11 +4163,12 @@ AsyncSocketWriteBuffers(AsyncSocket *s)
       ASOCKLOG(3, s, ("left\t%d\tsent\t%d\tremain\t%d\n",
                       left, sent, left - sent));
       if (sent > 0) {
+         AsyncSocketStatsSendBufFull(s, FALSE);
          s->sendBufFull = FALSE;
          s->sslConnected = TRUE;
-         if ((s->sendPos += sent) == sizeToSend) {
-            AsyncSocketDispatchSentBuffer(s);
-         }
+         AsyncSocketStatsAdd(s, &s->stats.bytesSent,
+                             &asockGlobalStats.bytesSent, sent);
+         AsyncSocketAdvanceSendPos(s, sent);
       } else if (sent == 0) {
          ASOCKLG0(s, ("socket write() should never return 0.\n"));
          NOT_REACHED();
@@ -3503,6 +4186,7 @@ AsyncSocketWriteBuffers(AsyncSocket *s)
           * Indicate send buffer is full.
           */
 
+         AsyncSocketStatsSendBufFull(s, TRUE);
          s->sendBufFull = TRUE;
          break;
       }
@@ -4355,6 +5039,7 @@ AsyncSocketCancelCbForCloseInt(AsyncSocket *asock)  // IN:
       free(cur->encodedBuf);
       asock->sendBufList = asock->sendBufList->next;
       asock->sendPos = 0;
+      AsyncSocketStatsQueue(asock, FALSE, cur->len);
 
       if (cur->sendFn) {
          cur->sendFn(cur->buf, pos, asock, cur->clientData);
@@ -4692,6 +5377,290 @@ AsyncSocket_GetID(AsyncSocket *asock)
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocket_SetStatsEnabled --
+ *
+ *      Turns timing of callbacks and full send buffers, and the global
+ *      statistics, on or off for all sockets.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+AsyncSocket_SetStatsEnabled(Bool enabled)  // IN
+{
+   Atomic_Write32(&asockStatsEnabled, enabled ? 1 : 0);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocket_GetStats --
+ *
+ *      Returns a snapshot of the I/O statistics of the asock.
+ *
+ * Results:
+ *      ASOCKERR_SUCCESS or ASOCKERR_INVAL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+AsyncSocket_GetStats(AsyncSocket *asock,       // IN
+                     AsyncSocketStats *stats)  // OUT
+{
+   if (asock == NULL || stats == NULL) {
+      return ASOCKERR_INVAL;
+   }
+
+   AsyncSocketLock(asock);
+   *stats = asock->stats;
+   AsyncSocketUnlock(asock);
+
+   return ASOCKERR_SUCCESS;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocket_GetGlobalStats --
+ *
+ *      Returns the I/O statistics summed over all sockets while statistics
+ *      were enabled. The current send queue lengths are left at zero.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+AsyncSocket_GetGlobalStats(AsyncSocketStats *stats)  // OUT
+{
+   int i;
+
+   memset(stats, 0, sizeof *stats);
+   stats->bytesSent = Atomic_Read64(&asockGlobalStats.bytesSent);
+   stats->bytesRecv = Atomic_Read64(&asockGlobalStats.bytesRecv);
+   stats->msgsSent = Atomic_Read64(&asockGlobalStats.msgsSent);
+   stats->msgsRecv = Atomic_Read64(&asockGlobalStats.msgsRecv);
+   stats->sendQueueLenMax =
+      (uint32)Atomic_Read64(&asockGlobalStats.sendQueueLenMax);
+   stats->sendQueueBytesMax = Atomic_Read64(&asockGlobalStats.sendQueueBytesMax);
+   stats->sendBufFullTime = Atomic_Read64(&asockGlobalStats.sendBufFullTime);
+   stats->callbacks = Atomic_Read64(&asockGlobalStats.callbacks);
+   stats->callbackTime = Atomic_Read64(&asockGlobalStats.callbackTime);
+   stats->callbackTimeMax = Atomic_Read64(&asockGlobalStats.callbackTimeMax);
+   for (i = 0; i < ASOCKERR_COUNT; i++) {
+      stats->errors[i] = Atomic_Read64(&asockGlobalStats.errors[i]);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocketStatsAdd --
+ *
+ *      Adds 'val' to a counter of the asock, and to the matching global
+ *      counter if statistics are enabled.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+AsyncSocketStatsAdd(AsyncSocket *asock,     // IN/OUT
+                    uint64 *counter,        // IN/OUT: in asock->stats
+                    Atomic_uint64 *global,  // IN/OUT
+                    uint64 val)             // IN
+{
+   *counter += val;
+   if (ASOCK_STATS_ENABLED()) {
+      Atomic_Add64(global, val);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocketStatsMax --
+ *
+ *      Raises a global high-water mark to 'val'.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+AsyncSocketStatsMax(Atomic_uint64 *global,  // IN/OUT
+                    uint64 val)             // IN
+{
+   uint64 cur = Atomic_Read64(global);
+
+   while (val > cur) {
+      uint64 old = Atomic_ReadIfEqualWrite64(global, cur, val);
+
+      if (old == cur) {
+         break;
+      }
+      cur = old;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocketStatsQueue --
+ *
+ *      Accounts for a buffer of 'len' bytes added to or removed from the
+ *      send queue.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+AsyncSocketStatsQueue(AsyncSocket *asock,  // IN/OUT
+                      Bool enqueue,        // IN
+                      int len)             // IN
+{
+   AsyncSocketStats *stats = &asock->stats;
+
+   if (!enqueue) {
+      stats->sendQueueLen -= MIN(stats->sendQueueLen, 1);
+      stats->sendQueueBytes -= MIN(stats->sendQueueBytes, (uint64)len);
+      return;
+   }
+
+   stats->sendQueueLen++;
+   stats->sendQueueBytes += len;
+   stats->sendQueueLenMax = MAX(stats->sendQueueLenMax, stats->sendQueueLen);
+   stats->sendQueueBytesMax = MAX(stats->sendQueueBytesMax,
+                                  stats->sendQueueBytes);
+   if (ASOCK_STATS_ENABLED()) {
+      AsyncSocketStatsMax(&asockGlobalStats.sendQueueLenMax,
+                          stats->sendQueueLen);
+      AsyncSocketStatsMax(&asockGlobalStats.sendQueueBytesMax,
+                          stats->sendQueueBytes);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocketStatsSendBufFull --
+ *
+ *      Called before changing asock->sendBufFull. Times how long the socket
+ *      send buffer stays full while statistics are enabled.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+AsyncSocketStatsSendBufFull(AsyncSocket *asock,  // IN/OUT
+                            Bool full)           // IN
+{
+   if (full) {
+      if (asock->sendBufFullSince == 0 && ASOCK_STATS_ENABLED()) {
+         asock->sendBufFullSince = Hostinfo_SystemTimerUS();
+      }
+   } else if (asock->sendBufFullSince != 0) {
+      uint64 elapsed = Hostinfo_SystemTimerUS() - asock->sendBufFullSince;
+
+      asock->sendBufFullSince = 0;
+      AsyncSocketStatsAdd(asock, &asock->stats.sendBufFullTime,
+                          &asockGlobalStats.sendBufFullTime, elapsed);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocketStatsCallbackStart --
+ * AsyncSocketStatsCallbackDone --
+ *
+ *      Bracket a receive or send callback to time it while statistics are
+ *      enabled.
+ *
+ * Results:
+ *      Start: timestamp to pass to Done, 0 if not timing.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static uint64
+AsyncSocketStatsCallbackStart(void)
+{
+   return ASOCK_STATS_ENABLED() ? Hostinfo_SystemTimerUS() : 0;
+}
+
+static void
+AsyncSocketStatsCallbackDone(AsyncSocket *asock,  // IN/OUT
+                             uint64 start)        // IN
+{
+   AsyncSocketStats *stats = &asock->stats;
+   uint64 elapsed;
+
+   if (start == 0) {
+      return;
+   }
+
+   elapsed = Hostinfo_SystemTimerUS() - start;
+   stats->callbacks++;
+   stats->callbackTime += elapsed;
+   stats->callbackTimeMax = MAX(stats->callbackTimeMax, elapsed);
+
+   Atomic_Inc64(&asockGlobalStats.callbacks);
+   Atomic_Add64(&asockGlobalStats.callbackTime, elapsed);
+   AsyncSocketStatsMax(&asockGlobalStats.callbackTimeMax, elapsed);
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -4739,6 +5708,7 @@ AsyncSocketSendInternal(AsyncSocket *asock,         // IN
    if (asock->sendBufList == newBuf) {
       *bufferListWasEmpty = TRUE;
    }
+   AsyncSocketStatsQueue(asock, TRUE, len);
 
    return ASOCKERR_SUCCESS;
 }
@@ -4889,8 +5859,13 @@ AsyncSocketMakeNonBlocking(int fd)
 void
 AsyncSocketHandleError(AsyncSocket *asock, int asockErr)
 {
+   int idx = (asockErr > ASOCKERR_SUCCESS && asockErr < ASOCKERR_COUNT) ?
+             asockErr : ASOCKERR_GENERIC;
+
    ASSERT(asock);
    asock->errorSeen = TRUE;
+   AsyncSocketStatsAdd(asock, &asock->stats.errors[idx],
+                       &asockGlobalStats.errors[idx], 1);
    if (asock->errorFn) {
       ASOCKLOG(3, asock, ("firing error callback (%s)\n",
                           AsyncSocket_Err2String(asockErr)));
@@ -5286,6 +6261,7 @@ AsyncSocketRelease(AsyncSocket *s,  // IN:
       if (s->vt && s->vt->release) {
          s->vt->release(s);
       }
+      AsyncSocketPacketReset(s);
       free(s);
 
       return 0;
@@ -5603,6 +6579,12 @@ AsyncSocketCancelRecv(AsyncSocket *asock,         // IN
    asock->recvPos = 0;
    asock->recvLen = 0;
 
+   /*
+    * Pauses AsyncSocket_RecvPackets; packets already received stay
+    * buffered until it is called again.
+    */
+   asock->packet.recvFn = NULL;
+
    if (asock->passFd.fd != -1) {
       SSLGeneric_close(asock->passFd.fd);
       asock->passFd.fd = -1;
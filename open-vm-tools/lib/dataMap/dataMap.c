@@ -69,11 +69,32 @@ typedef union {
    } strList;
 } DMFieldValue;
 
+/* DataMapEntry flags */
+#define DMENTRY_IN_ARENA        0x1   /* the entry itself lives in the arena */
+#define DMENTRY_PAYLOAD_BORROWED 0x2  /* payload is arena or input memory */
+
 typedef struct {
    DMFieldType type;
+   uint32 flags;
    DMFieldValue value;
 } DataMapEntry;
 
+/*
+ * Bump allocator for the entries and payloads of maps built by
+ * DataMap_Copy and DataMap_Deserialize[NoCopy]. Nothing in it is freed
+ * individually; the chunk chain goes away with the map.
+ */
+#define DM_ARENA_CHUNK_SIZE   1024
+#define DM_ARENA_ALIGN        8
+#define DM_ARENA_HDR_SIZE \
+   ((sizeof(DataMapArena) + DM_ARENA_ALIGN - 1) & ~(DM_ARENA_ALIGN - 1))
+
+typedef struct DataMapArena {
+   struct DataMapArena *next;   /* older, filled chunks */
+   size_t size;                 /* usable bytes after the header */
+   size_t used;
+} DataMapArena;
+
 /* structure used in hashMap iteration callback */
 typedef struct {
    DataMap *map;
@@ -84,6 +105,8 @@ typedef struct {
     */
    char *buffer;
    uint32 buffLen;        /* available buffer size */
+   DynBuf *dynBuf;        /* serialization output */
+   size_t dynBufStart;    /* offset of the first entry in dynBuf */
    uint32 maxNumElems;    /* this limits the number of elements for list print. */
    uint32 maxStrLen;      /* max number of bytes to print for each string */
    FieldIdNameEntry *fieldIdList;   /* array for field ID to name mapping */
@@ -92,6 +115,165 @@ typedef struct {
 
 static const uint64 magic_cookie = 0x4d41474943ULL;   /* 'MAGIC' */
 
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ArenaAddChunk --
+ *
+ *      Push a new chunk of at least 'size' bytes onto the map's arena.
+ *
+ * Result:
+ *      TRUE on success, FALSE if out of memory.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+ArenaAddChunk(DataMap *that,    // IN/OUT
+              size_t size)      // IN
+{
+   DataMapArena *chunk;
+
+   if (size < DM_ARENA_CHUNK_SIZE) {
+      size = DM_ARENA_CHUNK_SIZE;
+   }
+
+   if (size > ~(size_t)0 - DM_ARENA_HDR_SIZE) {
+      return FALSE;
+   }
+
+   chunk = (DataMapArena *)malloc(DM_ARENA_HDR_SIZE + size);
+   if (chunk == NULL) {
+      return FALSE;
+   }
+
+   chunk->next = that->arena;
+   chunk->size = size;
+   chunk->used = 0;
+   that->arena = chunk;
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ArenaAlloc --
+ *
+ *      Carve 'size' bytes, 8-byte aligned, out of the map's arena. The map
+ *      must be arena-backed.
+ *
+ * Result:
+ *      The memory, or NULL if out of memory.
+ *
+ * Side-effects:
+ *      May add a chunk to the arena.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+ArenaAlloc(DataMap *that,    // IN/OUT
+           size_t size)      // IN
+{
+   DataMapArena *chunk = that->arena;
+   void *ptr;
+
+   ASSERT(chunk != NULL);
+
+   if (size > ~(size_t)0 - DM_ARENA_ALIGN) {
+      return NULL;
+   }
+   size = (size + DM_ARENA_ALIGN - 1) & ~(size_t)(DM_ARENA_ALIGN - 1);
+
+   if (chunk->size - chunk->used < size) {
+      if (!ArenaAddChunk(that, size)) {
+         return NULL;
+      }
+      chunk = that->arena;
+   }
+
+   ptr = (char *)chunk + DM_ARENA_HDR_SIZE + chunk->used;
+   chunk->used += size;
+
+   return ptr;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ArenaFree --
+ *
+ *      Release all the chunks of the map's arena.
+ *
+ * Result:
+ *      None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+ArenaFree(DataMap *that)    // IN/OUT
+{
+   while (that->arena != NULL) {
+      DataMapArena *next = that->arena->next;
+
+      free(that->arena);
+      that->arena = next;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * AllocEntry --
+ *
+ *      - low level helper function to allocate an entry, out of the arena
+ *        for arena-backed maps.
+ *
+ * Result:
+ *      The entry, or NULL if out of memory.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static DataMapEntry *
+AllocEntry(DataMap *that,       // IN/OUT
+           DMFieldType type,    // IN
+           Bool borrowed)       // IN: payload is not owned by the entry
+{
+   DataMapEntry *entry;
+
+   if (that->arena != NULL) {
+      entry = (DataMapEntry *)ArenaAlloc(that, sizeof(DataMapEntry));
+   } else {
+      entry = (DataMapEntry *)malloc(sizeof(DataMapEntry));
+   }
+
+   if (entry != NULL) {
+      entry->type = type;
+      entry->flags = that->arena != NULL ? DMENTRY_IN_ARENA : 0;
+      if (borrowed) {
+         entry->flags |= DMENTRY_PAYLOAD_BORROWED;
+      }
+   }
+
+   return entry;
+}
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -114,12 +296,11 @@ AddEntry_Int64(DataMap *that,      // IN/OUT
                DMKeyType key,      // IN
                int64  value)       // IN
 {
-   DataMapEntry *entry = (DataMapEntry *)malloc(sizeof(DataMapEntry));
+   DataMapEntry *entry = AllocEntry(that, DMFIELDTYPE_INT64, FALSE);
 
    if (entry == NULL) {
       return DMERR_INSUFFICIENT_MEM;
    }
-   entry->type = DMFIELDTYPE_INT64;
    entry->value.number.val = value;
    if (!HashMap_Put(that->map, &key, &entry)) {
       return DMERR_INSUFFICIENT_MEM;
@@ -134,7 +315,8 @@ AddEntry_Int64(DataMap *that,      // IN/OUT
  * AddEntry_String --
  *
  *      Low level helper function to add a string type entry to the map.
- *      - 'str': ownership of the str pointer is passed to the map on success.
+ *      - 'str': ownership of the str pointer is passed to the map on success,
+ *        unless 'borrowed' is set (arena or input buffer memory).
  *
  * Result:
  *      0 on success
@@ -150,14 +332,14 @@ static ErrorCode
 AddEntry_String(DataMap *that,      // IN/OUT
                 DMKeyType  key,     // IN
                 char *str,          // IN
-                int32 strLen)       // IN
+                int32 strLen,       // IN
+                Bool borrowed)      // IN
 {
-   DataMapEntry *entry = (DataMapEntry *)malloc(sizeof(DataMapEntry));
+   DataMapEntry *entry = AllocEntry(that, DMFIELDTYPE_STRING, borrowed);
 
    if (entry == NULL) {
       return DMERR_INSUFFICIENT_MEM;
    }
-   entry->type = DMFIELDTYPE_STRING;
    entry->value.string.str = str;
    entry->value.string.length = strLen;
 
@@ -174,7 +356,8 @@ AddEntry_String(DataMap *that,      // IN/OUT
  * AddEntry_Int64List --
  *
  *      Low level helper function to add a list of numbers to the map
- *      - 'numbers': ownership of this pointer is passed to the map on success.
+ *      - 'numbers': ownership of this pointer is passed to the map on success,
+ *        unless 'borrowed' is set.
  *      - 'listLen': the number of integers in the list of 'numbers'.
  *
  * Result:
@@ -191,14 +374,14 @@ static ErrorCode
 AddEntry_Int64List(DataMap *that,            // IN/OUT
                    DMKeyType key,            // IN
                    int64 *numbers,           // IN
-                   int32 listLen)            // IN
+                   int32 listLen,            // IN
+                   Bool borrowed)            // IN
 {
-   DataMapEntry *entry = (DataMapEntry *)malloc(sizeof(DataMapEntry));
+   DataMapEntry *entry = AllocEntry(that, DMFIELDTYPE_INT64LIST, borrowed);
 
    if (entry == NULL) {
       return DMERR_INSUFFICIENT_MEM;
    }
-   entry->type = DMFIELDTYPE_INT64LIST;
    entry->value.numList.numbers = numbers;
    entry->value.numList.length = listLen;
 
@@ -222,6 +405,7 @@ AddEntry_Int64List(DataMap *that,            // IN/OUT
  *      - 'strLens': this is an array of integers which indicating the length of
  *        cooresponding string in strList. the ownership is passed to the map
  *        as well on success.
+ *      - 'borrowed': neither array nor the strings are owned by the map.
  *
  * Result:
  *      0 on success
@@ -237,14 +421,14 @@ static ErrorCode
 AddEntry_StringList(DataMap *that,            // IN/OUT
                     DMKeyType key,            // IN
                     char **strList,           // IN
-                    int32 *strLens)           // IN
+                    int32 *strLens,           // IN
+                    Bool borrowed)            // IN
 {
-   DataMapEntry *entry = (DataMapEntry *)malloc(sizeof(DataMapEntry));
+   DataMapEntry *entry = AllocEntry(that, DMFIELDTYPE_STRINGLIST, borrowed);
 
    if (entry == NULL) {
       return DMERR_INSUFFICIENT_MEM;
    }
-   entry->type = DMFIELDTYPE_STRINGLIST;
    entry->value.strList.strings = strList;
    entry->value.strList.lengths = strLens;
 
@@ -292,7 +476,8 @@ FreeStringList(char **strList,    // IN
  *
  * FreeEntryPayload --
  *
- *      - low level helper function to free entry payload only
+ *      - low level helper function to free entry payload only. A borrowed
+ *        payload is left alone, and the entry owns whatever is set next.
  *
  * Result:
  *      None
@@ -310,6 +495,11 @@ FreeEntryPayload(DataMapEntry *entry)    // IN
       return;
    }
 
+   if (entry->flags & DMENTRY_PAYLOAD_BORROWED) {
+      entry->flags &= ~DMENTRY_PAYLOAD_BORROWED;
+      return;
+   }
+
    switch(entry->type) {
       case DMFIELDTYPE_INT64:
          break;
@@ -498,6 +688,8 @@ EncodeString(char **buf,         // IN/OUT
  * DecodeString --
  *
  *      - low level helper function to decode a string from  a byte buffer
+ *        into an arena-backed map. With 'noCopy', *str points into the
+ *        input buffer; otherwise the string is copied into the arena.
  *
  * Result:
  *      None
@@ -511,6 +703,8 @@ EncodeString(char **buf,         // IN/OUT
 static ErrorCode
 DecodeString(char **buf,         // IN/OUT
              int32 *left,        // IN/OUT
+             Bool noCopy,        // IN
+             DataMap *that,      // IN/OUT
              char **str,         // OUT
              int32 *strLen)      // OUT
 {
@@ -522,16 +716,20 @@ DecodeString(char **buf,         // IN/OUT
       return res;
    }
 
-   if (*left < *strLen) {
+   if (*strLen < 0 || *left < *strLen) {
       return DMERR_TRUNCATED_DATA;
    }
 
-   *str = (char *)malloc(*strLen);
-   if (*str == NULL) {
-      return DMERR_INSUFFICIENT_MEM;
-   }
+   if (noCopy) {
+      *str = *buf;
+   } else {
+      *str = (char *)ArenaAlloc(that, *strLen);
+      if (*str == NULL) {
+         return DMERR_INSUFFICIENT_MEM;
+      }
 
-   memcpy(*str, *buf, *strLen);
+      memcpy(*str, *buf, *strLen);
+   }
    *buf += *strLen;
    *left -= *strLen;
 
@@ -606,7 +804,12 @@ DecodeInt64List(char **buf,        // IN/OUT
    if (res == DMERR_SUCCESS) {
       int32 i;
 
-      numList = (int64 *)malloc(sizeof(int64) * listLen);
+      if (listLen < 0 || listLen > *left / sizeof(int64)) {
+         return DMERR_TRUNCATED_DATA;
+      }
+
+      /* the wire format is not in host order, so the list can't be shared */
+      numList = (int64 *)ArenaAlloc(that, sizeof(int64) * listLen);
       if (numList == NULL) {
          return DMERR_INSUFFICIENT_MEM;
       }
@@ -619,12 +822,7 @@ DecodeInt64List(char **buf,        // IN/OUT
       }
 
       if (res == DMERR_SUCCESS) {
-         res = AddEntry_Int64List(that, fieldId, numList, listLen);
-      }
-
-      if (res != DMERR_SUCCESS) {
-         /* clean up memory */
-         free(numList);
+         res = AddEntry_Int64List(that, fieldId, numList, listLen, TRUE);
       }
    }
 
@@ -652,7 +850,9 @@ static void
 FreeEntry(DataMapEntry *entry)    // IN
 {
    FreeEntryPayload(entry);
-   free(entry);
+   if ((entry->flags & DMENTRY_IN_ARENA) == 0) {
+      free(entry);
+   }
 }
 
 
@@ -752,6 +952,7 @@ DataMap_Create(DataMap *that)    // IN/OUT
    }
 
    that->map = HashMap_AllocMap(16, sizeof(DMKeyType), sizeof(DataMapEntry *));
+   that->arena = NULL;
 
    if (that->map != NULL) {
       that->cookie = magic_cookie;
@@ -1242,12 +1443,13 @@ HashMapToStringEntryCb(void *key,            // IN
 /*
  *-----------------------------------------------------------------------------
  *
- * HashMapCalcEntrySizeCb --
+ * CalcEntrySize --
  *
  *      - calculate how much space is needed to encode an entry
  *
  * Result:
- *      None
+ *      0 on success
+ *      error code otherwise
  *
  * Side-effects:
  *      None
@@ -1255,76 +1457,59 @@ HashMapToStringEntryCb(void *key,            // IN
  *-----------------------------------------------------------------------------
  */
 
-static void
-HashMapCalcEntrySizeCb(void *key,            // IN
-                       void *data,           // IN
-                       void *userData)       // IN/OUT
+static ErrorCode
+CalcEntrySize(const DataMapEntry *entry,   // IN
+              uint32 *size)                // OUT
 {
-   DataMapEntry *entry = *((DataMapEntry **)data);
-   ClientData *clientData = (ClientData *)userData;
-   uint32 oldLen = clientData->buffLen;
-   uint32 *buffLen = &(clientData->buffLen);
+   uint32 buffLen;
 
-   if (clientData->result != DMERR_SUCCESS) {
-      /* a previous error has occurred, so stop. */
-      return;
-   }
+   buffLen = sizeof(int32);                /* type */
+   buffLen += sizeof(DMKeyType);           /* fieldId */
 
    switch(entry->type) {
       case DMFIELDTYPE_INT64:
-         {
-            *buffLen += sizeof(int32);        /* type */
-            *buffLen += sizeof(DMKeyType);    /* fieldId */
-            *buffLen += sizeof(int64);        /* int value */
-            break;
-         }
+         buffLen += sizeof(int64);         /* int value */
+         break;
       case DMFIELDTYPE_STRING:
-         {
-            *buffLen += sizeof(int32);        /* type */
-            *buffLen += sizeof(DMKeyType);    /* fieldId */
-            *buffLen += sizeof(int32);        /* string length */
-            *buffLen += entry->value.string.length; /* string payload */
-            break;
+         buffLen += sizeof(int32);         /* string length */
+         buffLen += entry->value.string.length; /* string payload */
+         if (buffLen < entry->value.string.length) {
+            return DMERR_INTEGER_OVERFLOW;
          }
+         break;
       case DMFIELDTYPE_INT64LIST:
-         {
-            *buffLen += sizeof(int32);        /* type */
-            *buffLen += sizeof(DMKeyType);    /* fieldId */
-            *buffLen += sizeof(int32);        /* list size */
-            *buffLen += sizeof(int64) * entry->value.numList.length;
-            break;
+         buffLen += sizeof(int32);         /* list size */
+         if (entry->value.numList.length > (MAX_UINT32 - buffLen) /
+                                           sizeof(int64)) {
+            return DMERR_INTEGER_OVERFLOW;
          }
+         buffLen += sizeof(int64) * entry->value.numList.length;
+         break;
       case DMFIELDTYPE_STRINGLIST:
          {
             char **strPtr = entry->value.strList.strings;
             int32 *lenPtr = entry->value.strList.lengths;
 
-            *buffLen += sizeof(int32);        /* type */
-            *buffLen += sizeof(DMKeyType);    /* fieldId */
-            *buffLen += sizeof(int32);        /* list size */
+            buffLen += sizeof(int32);      /* list size */
 
             for (; *strPtr != NULL; strPtr++, lenPtr++) {
-               if (*buffLen < oldLen) {
-                  clientData->result = DMERR_INTEGER_OVERFLOW;
-                  return;
-               }
+               uint32 oldLen = buffLen;
+
+               buffLen += sizeof(int32);   /* string length */
+               buffLen += *lenPtr;         /* string payload */
 
-               *buffLen += sizeof(int32);   /* string length */
-               *buffLen += *lenPtr;        /* string payload */
+               if (buffLen < oldLen) {
+                  return DMERR_INTEGER_OVERFLOW;
+               }
             }
             break;
          }
       default:
-         {
-            clientData->result = DMERR_UNKNOWN_TYPE;
-            return;
-         }
+         return DMERR_UNKNOWN_TYPE;
    }
 
-   if (*buffLen < oldLen) {
-      clientData->result = DMERR_INTEGER_OVERFLOW;
-      return;
-   }
+   *size = buffLen;
+   return DMERR_SUCCESS;
 }
 
 
@@ -1333,7 +1518,8 @@ HashMapCalcEntrySizeCb(void *key,            // IN
  *
  * HashMapSerializeEntryCb --
  *
- *      - serialize each entry into a byte buffer
+ *      - serialize each entry at the end of the output DynBuf, growing it
+ *        as needed.
  *
  * Result:
  *      None
@@ -1347,26 +1533,52 @@ HashMapCalcEntrySizeCb(void *key,            // IN
 static void
 HashMapSerializeEntryCb(void *key,            // IN
                         void *data,           // IN
-                        void *userData)       // OUT
+                        void *userData)       // IN/OUT
 {
    DataMapEntry *entry = *((DataMapEntry **)data);
    ClientData *clientData = (ClientData *)userData;
-   char **buffPtr = &(clientData->buffer);
-   char *buffPtrOrig = clientData->buffer;
+   DynBuf *dynBuf = clientData->dynBuf;
+   size_t used = DynBuf_GetSize(dynBuf);
+   uint32 entryLen;
+   char *buffPtr;
+   char **buffPtrPtr = &buffPtr;
+
+   if (clientData->result != DMERR_SUCCESS) {
+      /* a previous error has occurred, so stop. */
+      return;
+   }
+
+   clientData->result = CalcEntrySize(entry, &entryLen);
+   if (clientData->result != DMERR_SUCCESS) {
+      return;
+   }
+
+   /* the payload length prefix is a uint32 */
+   if (entryLen > MAX_UINT32 - (used - clientData->dynBufStart)) {
+      clientData->result = DMERR_INTEGER_OVERFLOW;
+      return;
+   }
+
+   if (!DynBuf_Reserve(dynBuf, entryLen)) {
+      clientData->result = DMERR_INSUFFICIENT_MEM;
+      return;
+   }
 
-   EncodeInt32(buffPtr, entry->type);   /* encode type */
-   EncodeInt32(buffPtr, *((DMKeyType *)key));   /* encode field id*/
+   buffPtr = (char *)DynBuf_Get(dynBuf) + used;
+
+   EncodeInt32(buffPtrPtr, entry->type);   /* encode type */
+   EncodeInt32(buffPtrPtr, *((DMKeyType *)key));   /* encode field id*/
 
    switch(entry->type) {
       case DMFIELDTYPE_INT64:
-         EncodeInt64(buffPtr, entry->value.number.val);
+         EncodeInt64(buffPtrPtr, entry->value.number.val);
          break;
       case DMFIELDTYPE_STRING:
-         EncodeString(buffPtr, entry->value.string.str,
+         EncodeString(buffPtrPtr, entry->value.string.str,
                       entry->value.string.length);
          break;
       case DMFIELDTYPE_INT64LIST:
-         EncodeInt64List(buffPtr, entry->value.numList.numbers,
+         EncodeInt64List(buffPtrPtr, entry->value.numList.numbers,
                          entry->value.numList.length);
          break;
       case DMFIELDTYPE_STRINGLIST:
@@ -1374,13 +1586,13 @@ HashMapSerializeEntryCb(void *key,            // IN
             char **strPtr = entry->value.strList.strings;
             int32 *lenPtr = entry->value.strList.lengths;
             int32 listSize = 0;
-            char *listSizePtr = *buffPtr;
+            char *listSizePtr = buffPtr;
 
             /*reserve the space for list size, we will update later*/
-            *buffPtr += sizeof(int32);
+            buffPtr += sizeof(int32);
 
             for (; *strPtr != NULL; strPtr++, lenPtr++) {
-               EncodeString(buffPtr, *strPtr, *lenPtr);
+               EncodeString(buffPtrPtr, *strPtr, *lenPtr);
                listSize ++;
             }
 
@@ -1392,8 +1604,10 @@ HashMapSerializeEntryCb(void *key,            // IN
          ASSERT(0);    /*  we do not expect this to happen */
    }
 
-   /* Update left buffer size so we can do a sanity check at the end */
-   clientData->buffLen -= (clientData->buffer - buffPtrOrig);
+   /* sanity check, make sure the entry space is just used up */
+   ASSERT(buffPtr - ((char *)DynBuf_Get(dynBuf) + used) == entryLen);
+
+   DynBuf_SetSize(dynBuf, used + entryLen);
 }
 
 
@@ -1402,7 +1616,7 @@ HashMapSerializeEntryCb(void *key,            // IN
  *
  * DecodeStringList --
  *
- *      Decode a string list entry and add to the dataMap
+ *      Decode a string list entry and add to the arena-backed dataMap
  *      - 'buf': *buf points to the input buffer. *buf is advanced accordingly
  *               on success.
  *      - 'left': indicates number of bytes left in the input buffer, *left is
@@ -1420,6 +1634,7 @@ HashMapSerializeEntryCb(void *key,            // IN
 static ErrorCode
 DecodeStringList(char **buf,           // IN
                  int32 *left,          // IN
+                 Bool noCopy,          // IN
                  DMKeyType fieldId,    // IN
                  DataMap *that)        // OUT
 {
@@ -1434,30 +1649,27 @@ DecodeStringList(char **buf,           // IN
       return res;
    }
 
-   strList = (char **)calloc(listSize + 1, sizeof(char *));
-   strLens = (int32 *)malloc(sizeof(int32) * listSize);
+   /* every string takes at least its length field */
+   if (listSize < 0 || listSize > *left / sizeof(int32)) {
+      return DMERR_TRUNCATED_DATA;
+   }
+
+   strList = (char **)ArenaAlloc(that, (listSize + 1) * sizeof(char *));
+   strLens = (int32 *)ArenaAlloc(that, listSize * sizeof(int32));
 
    if (strList == NULL || strLens == NULL) {
-      FreeStringList(strList, strLens);
       return DMERR_INSUFFICIENT_MEM;
    }
 
    for (i = 0; i < listSize; i++) {
-      res = DecodeString(buf, left, &strList[i], &strLens[i]);
+      res = DecodeString(buf, left, noCopy, that, &strList[i], &strLens[i]);
       if (res != DMERR_SUCCESS) {
-         break;
+         return res;
       }
    }
+   strList[listSize] = NULL;
 
-   if (res == DMERR_SUCCESS) {
-      res = AddEntry_StringList(that, fieldId, strList, strLens);
-   }
-
-   if (res != DMERR_SUCCESS) {
-      FreeStringList(strList, strLens);
-   }
-
-   return res;
+   return AddEntry_StringList(that, fieldId, strList, strLens, TRUE);
 }
 
 
@@ -1466,7 +1678,7 @@ DecodeStringList(char **buf,           // IN
  *
  * CopyStringList --
  *
- *      - copy string list entry into another map
+ *      - copy string list entry into another, arena-backed, map
  *
  * Result:
  *      None
@@ -1488,7 +1700,6 @@ CopyStringListEntry(DMKeyType fieldId,                  // IN
    int32 *newLens;
    int32 listSize = 0;
    char **ptr = oldList;
-   ErrorCode res = DMERR_SUCCESS;
    int32 i;
 
    /* get the list Size */
@@ -1496,11 +1707,10 @@ CopyStringListEntry(DMKeyType fieldId,                  // IN
       listSize ++;
    }
 
-   newList = (char **)calloc(listSize + 1, sizeof(char *));
-   newLens = (int32 *)malloc(sizeof(int32) * listSize);
+   newList = (char **)ArenaAlloc(dst, (listSize + 1) * sizeof(char *));
+   newLens = (int32 *)ArenaAlloc(dst, sizeof(int32) * listSize);
 
    if (newList == NULL || newLens == NULL) {
-      FreeStringList(newList, newLens);
       return DMERR_INSUFFICIENT_MEM;
    }
 
@@ -1509,23 +1719,15 @@ CopyStringListEntry(DMKeyType fieldId,                  // IN
 
    /* copy string one by one */
    for (i = 0; i < listSize; i++) {
-      newList[i] = (char *)malloc(newLens[i]);
+      newList[i] = (char *)ArenaAlloc(dst, newLens[i]);
       if (newList[i] == NULL) {
-         res = DMERR_INSUFFICIENT_MEM;
-         break;
+         return DMERR_INSUFFICIENT_MEM;
       }
       memcpy(newList[i], oldList[i], newLens[i]);
    }
+   newList[listSize] = NULL;
 
-   if (res == DMERR_SUCCESS) {
-      res = AddEntry_StringList(dst, fieldId, newList, newLens);
-   }
-
-   if (res != DMERR_SUCCESS) {
-      FreeStringList(newList, newLens);
-   }
-
-   return res;
+   return AddEntry_StringList(dst, fieldId, newList, newLens, TRUE);
 }
 
 
@@ -1534,7 +1736,8 @@ CopyStringListEntry(DMKeyType fieldId,                  // IN
  *
  * HashMapCopyEntryCb --
  *
- *      - Call back function to copy a dataMap entry.
+ *      - Call back function to copy a dataMap entry into an arena-backed
+ *        map.
  *
  * Result:
  *      None
@@ -1567,32 +1770,29 @@ HashMapCopyEntryCb(void *key,              // IN
          break;
       case DMFIELDTYPE_STRING:
       {
-         char *str = (char *)malloc(entry->value.string.length);
+         char *str = (char *)ArenaAlloc(dst, entry->value.string.length);
          if (str == NULL) {
             res = DMERR_INSUFFICIENT_MEM;
             break;
          }
          memcpy(str, entry->value.string.str, entry->value.string.length);
-         res = AddEntry_String(dst, fieldId, str, entry->value.string.length);
-         if (res != DMERR_SUCCESS) {
-            free(str);
-         }
+         res = AddEntry_String(dst, fieldId, str, entry->value.string.length,
+                               TRUE);
          break;
       }
       case DMFIELDTYPE_INT64LIST:
       {
          int64 *numList;
-            numList = (int64 *)malloc(sizeof(int64) *
+            numList = (int64 *)ArenaAlloc(dst, sizeof(int64) *
                   (entry->value.numList.length));
 
          if (numList == NULL) {
             res = DMERR_INSUFFICIENT_MEM;
          } else {
+            memcpy(numList, entry->value.numList.numbers,
+                   sizeof(int64) * entry->value.numList.length);
             res = AddEntry_Int64List(dst, fieldId, numList,
-                                     entry->value.numList.length);
-            if (res != DMERR_SUCCESS) {
-               free(numList);
-            }
+                                     entry->value.numList.length, TRUE);
          }
          break;
       }
@@ -1663,6 +1863,7 @@ DataMap_Destroy(DataMap *that)    // IN/OUT
    HashMap_Iterate(that->map, HashMapFreeEntryCb, TRUE, NULL);
 
    HashMap_DestroyMap(that->map);
+   ArenaFree(that);
 
    that->map = NULL;
    that->cookie = 0;
@@ -1676,7 +1877,8 @@ DataMap_Destroy(DataMap *that)    // IN/OUT
  *
  * DataMap_Copy --
  *
- *     Copy a DataMap, a deep copy.
+ *     Copy a DataMap, a deep copy. The entries of 'dst' and their payloads
+ *     are carved out of a per-map arena rather than allocated one by one.
  *     - 'dst': dst should *NOT* be initialized via DataMap_Create.
  *       the caller *MUST* call DataMap_Destroy to detroy dst upon success.
  *
@@ -1710,6 +1912,11 @@ DataMap_Copy(const DataMap *src,  // IN
       return res;
    }
 
+   if (!ArenaAddChunk(dst, 0)) {
+      DataMap_Destroy(dst);
+      return DMERR_INSUFFICIENT_MEM;
+   }
+
    clientData.map = dst;
    clientData.result = DMERR_SUCCESS;
 
@@ -1749,114 +1956,170 @@ DataMap_Serialize(const DataMap *that,     // IN
                   char **buf,              // OUT
                   uint32 *bufLen)          // OUT
 {
-   ClientData clientData;
+   DynBuf dynBuf;
+   ErrorCode res;
 
    if (that == NULL || buf == NULL || bufLen == NULL) {
       return DMERR_INVALID_ARGS;
    }
 
-   ASSERT(that->cookie == magic_cookie);
+   DynBuf_Init(&dynBuf);
 
-   /* get the buffer size first */
-   memset(&clientData, 0, sizeof clientData);
-   HashMap_Iterate(that->map, HashMapCalcEntrySizeCb, FALSE, &clientData);
-   if (clientData.result != DMERR_SUCCESS) {
-      return clientData.result;
+   res = DataMap_SerializeToDynBuf(that, &dynBuf);
+   if (res != DMERR_SUCCESS) {
+      DynBuf_Destroy(&dynBuf);
+      return res;
    }
 
-   /* 4 bytes is payload length */
-   *bufLen = clientData.buffLen + sizeof(uint32);
-   if (*bufLen < clientData.buffLen) {
-      return DMERR_INTEGER_OVERFLOW;
+   *bufLen = DynBuf_GetSize(&dynBuf);
+   *buf = DynBuf_Detach(&dynBuf);
+
+   return DMERR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMap_SerializeToDynBuf --
+ *
+ *     Serialize a DataMap, payload length included, at the end of 'buf' in
+ *     a single pass over the map. Callers that send many maps can keep one
+ *     DynBuf around, reserve room up front with DynBuf_Reserve and empty
+ *     it with DynBuf_Recycle between messages, so that no allocation
+ *     happens at all.
+ *
+ * Result:
+ *     0 on success
+ *     error code on failures, with the size of 'buf' unchanged.
+ *
+ * Side-effects:
+ *      'buf' may be reallocated.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMap_SerializeToDynBuf(const DataMap *that,   // IN
+                          DynBuf *buf)           // IN/OUT
+{
+   ClientData clientData;
+   size_t start;
+   char *lenPtr;
+
+   if (that == NULL || buf == NULL) {
+      return DMERR_INVALID_ARGS;
    }
 
-   *buf = (char *)malloc(*bufLen);
+   ASSERT(that->cookie == magic_cookie);
+
+   start = DynBuf_GetSize(buf);
 
-   if (*buf == NULL) {
+   /* 4 bytes is payload length, filled in once the entries are written */
+   if (!DynBuf_Reserve(buf, sizeof(uint32))) {
       return DMERR_INSUFFICIENT_MEM;
    }
+   DynBuf_SetSize(buf, start + sizeof(uint32));
 
-   /* now serialize the map into the buffer */
+   memset(&clientData, 0, sizeof clientData);
    clientData.map = (DataMap *)that;
    clientData.result = DMERR_SUCCESS;
-   clientData.buffer = *buf;
-
-   /* Encode the payload size */
-   EncodeInt32(&(clientData.buffer), clientData.buffLen);
+   clientData.dynBuf = buf;
+   clientData.dynBufStart = start + sizeof(uint32);
 
    HashMap_Iterate(that->map, HashMapSerializeEntryCb, FALSE, &clientData);
 
-   /* sanity check, make sure the buffer size is just used up*/
-   ASSERT(clientData.buffLen == 0);
-
    if (clientData.result != DMERR_SUCCESS) {
-      free(*buf);
-      *buf = NULL;
-      *bufLen = 0;
+      DynBuf_SetSize(buf, start);
+      return clientData.result;
    }
-   return clientData.result;
+
+   lenPtr = (char *)DynBuf_Get(buf) + start;
+   EncodeInt32(&lenPtr, DynBuf_GetSize(buf) - clientData.dynBufStart);
+
+   return DMERR_SUCCESS;
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * DataMap_Deserialize --
+ * DataMap_SerializeHeaderToDynBuf --
  *
- *      Initialize an empty DataMap from a buffer.
- *      - 'that': the given map should *NOT* be initialized by the caller.
- *        On success, the caller needs to call DataMap_Destropy on 'that' to
- *        avoid any memory leak.
+ *     Serialize a DataMap at the end of 'buf' as if it also held a string
+ *     entry 'fieldId' of 'strLen' bytes, writing everything but the string
+ *     bytes themselves. The caller sends the string right after the buffer,
+ *     so a large payload can go out from where it already is instead of
+ *     being copied into the map and then into the serialized buffer.
  *
  * Result:
- *      - 0 on success
- *      - error code on failures.
+ *     0 on success
+ *     error code on failures, with the size of 'buf' unchanged.
  *
  * Side-effects:
- *      None
+ *      'buf' may be reallocated.
  *
  *-----------------------------------------------------------------------------
  */
 
 ErrorCode
-DataMap_Deserialize(const char *bufIn ,    // IN
-                    const int32 bufLen,    // IN
-                    DataMap *that)         // OUT
+DataMap_SerializeHeaderToDynBuf(const DataMap *that,   // IN
+                                DMKeyType fieldId,     // IN
+                                int32 strLen,          // IN
+                                DynBuf *buf)           // IN/OUT
 {
    ErrorCode res;
-   int32 left = bufLen;   /* number of bytes undecoded */
-   int32 len;
-   char *buf = (char *)bufIn;
+   size_t start;
+   uint32 payloadLen;
+   char *ptr;
 
-   if (that == NULL || bufIn == NULL || bufLen < 0) {
+   if (that == NULL || buf == NULL || strLen < 0) {
       return DMERR_INVALID_ARGS;
    }
 
-   /* decode the encoded buffer length */
-   res = DecodeInt32(&buf, &left, &len);
+   if (LookupEntry(that, fieldId) != NULL) {
+      return DMERR_ALREADY_EXIST;
+   }
+
+   start = DynBuf_GetSize(buf);
+
+   res = DataMap_SerializeToDynBuf(that, buf);
    if (res != DMERR_SUCCESS) {
       return res;
    }
 
-   if (len > bufLen - sizeof(int32)) {
-      return DMERR_TRUNCATED_DATA;
+   /* type, field id and string length, as EncodeString would write them */
+   payloadLen = DynBuf_GetSize(buf) - start - sizeof(uint32);
+   if (3 * sizeof(int32) + (uint32)strLen > MAX_UINT32 - payloadLen) {
+      DynBuf_SetSize(buf, start);
+      return DMERR_INTEGER_OVERFLOW;
+   }
+
+   if (!DynBuf_Reserve(buf, 3 * sizeof(int32))) {
+      DynBuf_SetSize(buf, start);
+      return DMERR_INSUFFICIENT_MEM;
    }
 
-   left = len;
+   ptr = (char *)DynBuf_Get(buf) + DynBuf_GetSize(buf);
+   EncodeInt32(&ptr, DMFIELDTYPE_STRING);
+   EncodeInt32(&ptr, fieldId);
+   EncodeInt32(&ptr, strLen);
+   DynBuf_SetSize(buf, DynBuf_GetSize(buf) + 3 * sizeof(int32));
 
-   return DataMap_DeserializeContent(buf, left, that);
+   ptr = (char *)DynBuf_Get(buf) + start;
+   EncodeInt32(&ptr, payloadLen + 3 * sizeof(int32) + strLen);
+
+   return DMERR_SUCCESS;
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * DataMap_DeserializeContent --
+ * DeserializeContent --
  *
- *      Initialize an empty DataMap from the content of the data map buffer
- *      - 'that': the given map should *NOT* be initialized by the caller.
- *        On success, the caller needs to call DataMap_Destropy on 'that' to
- *        avoid any memory leak.
+ *      Initialize an empty, arena-backed, DataMap from the content of the
+ *      data map buffer. With 'noCopy', string payloads point into 'content'.
  *
  * Result:
  *      - 0 on success
@@ -1868,20 +2131,34 @@ DataMap_Deserialize(const char *bufIn ,    // IN
  *-----------------------------------------------------------------------------
  */
 
-ErrorCode
-DataMap_DeserializeContent(const char *content,    // IN
-                           const int32 contentLen, // IN
-                           DataMap *that)          // OUT
+static ErrorCode
+DeserializeContent(const char *content,    // IN
+                   const int32 contentLen, // IN
+                   Bool noCopy,            // IN
+                   DataMap *that)          // OUT
 {
    ErrorCode res;
    int32 left = contentLen;   /* number of bytes undecoded */
    char *buf = (char *)content;
 
+   if (that == NULL || content == NULL || contentLen < 0) {
+      return DMERR_INVALID_ARGS;
+   }
+
    res = DataMap_Create(that);   /* init the map */
    if (res != DMERR_SUCCESS) {
       return res;
    }
 
+   /*
+    * Size the first chunk so that typical maps decode without growing the
+    * arena; copied strings take at most 'contentLen' bytes.
+    */
+   if (!ArenaAddChunk(that, noCopy ? 0 : contentLen + DM_ARENA_CHUNK_SIZE)) {
+      res = DMERR_INSUFFICIENT_MEM;
+      goto out;
+   }
+
    while ((left> 0) && (res == DMERR_SUCCESS)) {
       DMFieldType type;
       DMKeyType fieldId;
@@ -1925,15 +2202,11 @@ DataMap_DeserializeContent(const char *content,    // IN
          {
             char *str;
             int32 strLen;
-            res = DecodeString(&buf, &left, &str, &strLen);
+            res = DecodeString(&buf, &left, noCopy, that, &str, &strLen);
             if (res != DMERR_SUCCESS) {
                goto out;
             }
-            res = AddEntry_String(that, fieldId, str, strLen);
-            if (res != DMERR_SUCCESS) {
-               /* clean up memory */
-               free(str);
-            }
+            res = AddEntry_String(that, fieldId, str, strLen, TRUE);
             break;
          }
          case DMFIELDTYPE_INT64LIST:
@@ -1943,7 +2216,7 @@ DataMap_DeserializeContent(const char *content,    // IN
          }
          case DMFIELDTYPE_STRINGLIST:
          {
-            res = DecodeStringList(&buf, &left, fieldId, that);
+            res = DecodeStringList(&buf, &left, noCopy, fieldId, that);
             break;
          }
          default:
@@ -1963,6 +2236,138 @@ out:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Deserialize --
+ *
+ *      Check the encoded payload length and decode the payload.
+ *
+ * Result:
+ *      - 0 on success
+ *      - error code on failures.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ErrorCode
+Deserialize(const char *bufIn,     // IN
+            const int32 bufLen,    // IN
+            Bool noCopy,           // IN
+            DataMap *that)         // OUT
+{
+   ErrorCode res;
+   int32 left = bufLen;   /* number of bytes undecoded */
+   int32 len;
+   char *buf = (char *)bufIn;
+
+   if (that == NULL || bufIn == NULL || bufLen < 0) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   /* decode the encoded buffer length */
+   res = DecodeInt32(&buf, &left, &len);
+   if (res != DMERR_SUCCESS) {
+      return res;
+   }
+
+   if (len < 0 || len > left) {
+      return DMERR_TRUNCATED_DATA;
+   }
+
+   return DeserializeContent(buf, len, noCopy, that);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMap_Deserialize --
+ *
+ *      Initialize an empty DataMap from a buffer.
+ *      - 'that': the given map should *NOT* be initialized by the caller.
+ *        On success, the caller needs to call DataMap_Destropy on 'that' to
+ *        avoid any memory leak.
+ *
+ * Result:
+ *      - 0 on success
+ *      - error code on failures.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMap_Deserialize(const char *bufIn ,    // IN
+                    const int32 bufLen,    // IN
+                    DataMap *that)         // OUT
+{
+   return Deserialize(bufIn, bufLen, FALSE, that);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMap_DeserializeNoCopy --
+ *
+ *      Like DataMap_Deserialize, but the string and string list payloads
+ *      of 'that' point straight into 'bufIn', which must stay valid and
+ *      unchanged until DataMap_Destroy is called on 'that'.
+ *
+ * Result:
+ *      - 0 on success
+ *      - error code on failures.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMap_DeserializeNoCopy(const char *bufIn,     // IN
+                          const int32 bufLen,    // IN
+                          DataMap *that)         // OUT
+{
+   return Deserialize(bufIn, bufLen, TRUE, that);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMap_DeserializeContent --
+ *
+ *      Initialize an empty DataMap from the content of the data map buffer
+ *      - 'that': the given map should *NOT* be initialized by the caller.
+ *        On success, the caller needs to call DataMap_Destropy on 'that' to
+ *        avoid any memory leak.
+ *
+ * Result:
+ *      - 0 on success
+ *      - error code on failures.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMap_DeserializeContent(const char *content,    // IN
+                           const int32 contentLen, // IN
+                           DataMap *that)          // OUT
+{
+   return DeserializeContent(content, contentLen, FALSE, that);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -2060,7 +2465,7 @@ DataMap_SetString(DataMap *that,       // IN/OUT
 
    entry = LookupEntry(that, fieldId);
    if (entry == NULL) {
-      return AddEntry_String(that, fieldId, str, strLen);
+      return AddEntry_String(that, fieldId, str, strLen, FALSE);
    } else if (!replace){
       return DMERR_ALREADY_EXIST;
    } else {
@@ -2115,7 +2520,7 @@ DataMap_SetInt64List(DataMap *that,        // IN/OUT
    entry = LookupEntry(that, fieldId);
    if (entry == NULL) {
       /* need to add a new entry */
-      return AddEntry_Int64List(that, fieldId, numList, listLen);
+      return AddEntry_Int64List(that, fieldId, numList, listLen, FALSE);
    } else if (!replace){
       return DMERR_ALREADY_EXIST;
    } else {
@@ -2175,7 +2580,7 @@ DataMap_SetStringList(DataMap *that,          // IN/OUT
    entry = LookupEntry(that, fieldId);
    if (entry == NULL) {
       /* need to add a new entry */
-      return AddEntry_StringList(that, fieldId, strList, strLens);
+      return AddEntry_StringList(that, fieldId, strList, strLens, FALSE);
    } else if (!replace){
       return DMERR_ALREADY_EXIST;
    } else {
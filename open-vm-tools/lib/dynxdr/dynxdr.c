@@ -86,6 +86,20 @@ typedef struct DynXdrData {
 #   define DYNXDR_INLINE_LEN_T u_int
 #endif
 
+/*
+ * Each thread keeps a few released streams around, with their buffers, so
+ * that code encoding similar payloads over and over (NIC info, stats, RPC
+ * replies) does not reallocate its way up to the same size every time.
+ * Buffers larger than DYNXDR_POOL_MAX_KEEP are freed rather than kept, so
+ * a one time large encode does not pin its memory. A thread that exits
+ * leaks at most DYNXDR_POOL_SIZE * DYNXDR_POOL_MAX_KEEP bytes.
+ */
+#define DYNXDR_POOL_SIZE      2
+#define DYNXDR_POOL_MAX_KEEP  (16 * 1024)
+
+static __thread DynXdrData *dynXdrPool[DYNXDR_POOL_SIZE];
+static __thread unsigned int dynXdrPoolCount;
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -345,13 +359,17 @@ DynXdr_Create(XDR *in)  // IN
       ret = in;
    }
 
-   priv = malloc(sizeof *priv);
-   if (priv == NULL) {
-      goto error;
+   if (dynXdrPoolCount > 0) {
+      priv = dynXdrPool[--dynXdrPoolCount];
+   } else {
+      priv = malloc(sizeof *priv);
+      if (priv == NULL) {
+         goto error;
+      }
+      DynBuf_Init(&priv->data);
    }
 
    priv->freeMe = (in == NULL);
-   DynBuf_Init(&priv->data);
 
    ret->x_op = XDR_ENCODE;
    ret->x_public = NULL;
@@ -369,6 +387,42 @@ error:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynXdr_CreateWithSize --
+ *
+ *    Same as DynXdr_Create(), but makes room for 'size' bytes up front.
+ *    Callers that know roughly how large the encoded data will be, e.g.
+ *    from the previous time they encoded the same kind of data, get a
+ *    single allocation instead of growing the buffer piecemeal.
+ *
+ * Results:
+ *    The XDR struct, or NULL on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+XDR *
+DynXdr_CreateWithSize(XDR *in,      // IN
+                      size_t size)  // IN
+{
+   XDR *ret = DynXdr_Create(in);
+
+   /*
+    * The size is only a hint; encoding grows the buffer as usual if
+    * reserving it fails.
+    */
+   if (ret != NULL) {
+      DynBuf_Reserve(&((DynXdrData *) ret->x_private)->data, size);
+   }
+   return ret;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -429,7 +483,10 @@ DynXdr_AllocGet(XDR *xdrs) // IN
  *
  * DynXdr_Get --
  *
- *    Returns the current data in the XDR buffer.
+ *    Returns the current data in the XDR buffer, without copying it. To
+ *    take ownership of the data, e.g. to hand it to an RPC send, call
+ *    DynXdr_Destroy() with "release" set to FALSE afterwards and free() the
+ *    data when done.
  *
  * Results:
  *    The current data in the buffer, or NULL if there's no data.
@@ -457,6 +514,9 @@ DynXdr_Get(XDR *xdrs)  // IN
  *    DynBuf (if "release" is TRUE). If the XDR stream was dynamically
  *    allocated by DynXdr_Create(), it will be freed.
  *
+ *    The stream's private data goes back to the calling thread's pool when
+ *    there is room, keeping small buffers for the next DynXdr_Create().
+ *
  * Results:
  *    None.
  *
@@ -473,12 +533,20 @@ DynXdr_Destroy(XDR *xdrs,     // IN
    if (xdrs) {
       DynXdrData *priv = (DynXdrData *) xdrs->x_private;
       if (release) {
-         DynBuf_Destroy(&priv->data);
+         DynBuf_Recycle(&priv->data, DYNXDR_POOL_MAX_KEEP);
+      } else {
+         /* The caller owns the data now. */
+         DynBuf_Init(&priv->data);
       }
       if (priv->freeMe) {
          free(xdrs);
       }
-      free(priv);
+      if (dynXdrPoolCount < DYNXDR_POOL_SIZE) {
+         dynXdrPool[dynXdrPoolCount++] = priv;
+      } else {
+         DynBuf_Destroy(&priv->data);
+         free(priv);
+      }
    }
 }
 
@@ -71,6 +71,9 @@
 
 #include "unicodeOperations.h"
 
+/* Buffer size for File_CopyFromFdToFd when it copies the data itself. */
+#define FILE_COPY_BUFFER_SIZE (1024 * 1024)
+
 
 /*
  *----------------------------------------------------------------------
@@ -680,6 +683,103 @@ FileLockMachineIDMatch(const char *hostMachineID,   // IN:
 }
 
 
+#if defined(_WIN32)
+/*
+ * The directory iterator, on top of File_ListDirectory.
+ */
+
+struct FileDirIter {
+   char  *pathName;
+   char **names;
+   int    count;
+   int    next;
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileDirIterOpen --
+ * FileDirIterNext --
+ * FileDirIterGetType --
+ * FileDirIterClose --
+ *
+ *      See filePosix.c.  Here the directory is listed all at once and entry
+ *      types are always looked up.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+FileDirIter *
+FileDirIterOpen(const char *pathName)  // IN:
+{
+   int err;
+   FileDirIter *iter = Util_SafeCalloc(1, sizeof *iter);
+
+   iter->count = File_ListDirectory(pathName, &iter->names);
+   if (iter->count == -1) {
+      err = Err_Errno();
+      free(iter);
+      Err_SetErrno(err);
+
+      return NULL;
+   }
+
+   iter->pathName = Util_SafeStrdup(pathName);
+
+   return iter;
+}
+
+Bool
+FileDirIterNext(FileDirIter *iter,     // IN:
+                FileDirEntry *entry)   // OUT:
+{
+   errno = 0;
+
+   if (iter->next < iter->count) {
+      entry->name = iter->names[iter->next++];
+      entry->fileType = FILE_TYPE_UNCERTAIN;
+
+      return TRUE;
+   }
+
+   return FALSE;
+}
+
+int
+FileDirIterGetType(FileDirIter *iter,          // IN:
+                   const FileDirEntry *entry,  // IN:
+                   Bool followSymlinks)        // IN:
+{
+   FileData fileData;
+   char *path = File_PathJoin(iter->pathName, entry->name);
+   int err = FileAttributes(path, &fileData);
+
+   free(path);
+
+   if (err != 0) {
+      Err_SetErrno(err);
+
+      return -1;
+   }
+
+   return fileData.fileType;
+}
+
+void
+FileDirIterClose(FileDirIter *iter)  // IN:
+{
+   if (iter != NULL) {
+      if (iter->count > 0) {
+         Util_FreeStringList(iter->names, iter->count);
+      }
+      free(iter->pathName);
+      free(iter);
+   }
+}
+#endif
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -699,18 +799,24 @@ FileLockMachineIDMatch(const char *hostMachineID,   // IN:
 Bool
 File_IsEmptyDirectory(const char *pathName)  // IN:
 {
-   int numFiles;
+   FileDirIter *iter;
+   FileDirEntry entry;
+   Bool isEmpty;
 
    if (!File_IsDirectory(pathName)) {
       return FALSE;
    }
 
-   numFiles = File_ListDirectory(pathName, NULL);
-   if (numFiles < 0) {
+   iter = FileDirIterOpen(pathName);
+   if (iter == NULL) {
       return FALSE;
    }
 
-   return numFiles == 0;
+   isEmpty = !FileDirIterNext(iter, &entry) && (errno == 0);
+
+   FileDirIterClose(iter);
+
+   return isEmpty;
 }
 
 
@@ -740,24 +846,31 @@ File_IsEmptyDirectory(const char *pathName)  // IN:
 Bool
 File_IsOsfsVolumeEmpty(const char *pathName)  // IN:
 {
-   int i, numFiles;
-   char **fileList = NULL;
+   FileDirIter *iter;
+   FileDirEntry entry;
    static const char vmfsSystemFilesuffix[] = ".sf";
    Bool onlyVmfsSystemFilesFound = TRUE;
 
-   numFiles = File_ListDirectory(pathName, &fileList);
-   if (numFiles == -1) {
+   iter = FileDirIterOpen(pathName);
+   if (iter == NULL) {
       return FALSE;
    }
 
-   for (i = 0; i < numFiles; i++) {
-      if (!Unicode_EndsWith(fileList[i], vmfsSystemFilesuffix)) {
-         onlyVmfsSystemFilesFound = FALSE;
+   while (onlyVmfsSystemFilesFound) {
+      if (!FileDirIterNext(iter, &entry)) {
+         /* Couldn't read the whole directory. */
+         if (errno != 0) {
+            onlyVmfsSystemFilesFound = FALSE;
+         }
          break;
       }
+
+      if (!Unicode_EndsWith(entry.name, vmfsSystemFilesuffix)) {
+         onlyVmfsSystemFilesFound = FALSE;
+      }
    }
 
-   Util_FreeStringList(fileList, numFiles);
+   FileDirIterClose(iter);
 
    return onlyVmfsSystemFilesFound;
 }
@@ -798,6 +911,9 @@ File_IsFile(const char *pathName)  // IN:
  *      Write all data between the current position in the 'src' file and the
  *      end of the 'src' file to the current position in the 'dst' file
  *
+ *      Where the kernel can copy the data itself (Linux), it is left to do
+ *      so; otherwise the data is read and written in large chunks.
+ *
  * Results:
  *      TRUE   success
  *      FALSE  failure
@@ -814,13 +930,30 @@ File_CopyFromFdToFd(FileIODescriptor src,  // IN:
 {
    Err_Number err;
    FileIOResult fretR;
+   unsigned char *buf;
+   Bool success = TRUE;
+
+#if defined(__linux__)
+   if (!FilePosixCopyFromFdToFd(src.posix, dst.posix)) {
+      err = Err_Errno();
+
+      Msg_Append(MSGID(File.CopyFromFdToFd.copy.failure)
+                 "Copy error: %s.\n\n", Msg_ErrString());
+
+      Err_SetErrno(err);
+
+      return FALSE;
+   }
+#endif
+
+   /* Copy whatever is left, if anything. */
+   buf = Util_SafeMalloc(FILE_COPY_BUFFER_SIZE);
 
    do {
-      unsigned char buf[8 * 1024];
       size_t actual;
       FileIOResult fretW;
 
-      fretR = FileIO_Read(&src, buf, sizeof buf, &actual);
+      fretR = FileIO_Read(&src, buf, FILE_COPY_BUFFER_SIZE, &actual);
       if (!FileIO_IsSuccess(fretR) && (fretR != FILEIO_READ_ERROR_EOF)) {
          err = Err_Errno();
 
@@ -829,7 +962,8 @@ File_CopyFromFdToFd(FileIODescriptor src,  // IN:
 
          Err_SetErrno(err);
 
-         return FALSE;
+         success = FALSE;
+         break;
       }
 
       fretW = FileIO_Write(&dst, buf, actual, NULL);
@@ -841,11 +975,16 @@ File_CopyFromFdToFd(FileIODescriptor src,  // IN:
 
          Err_SetErrno(err);
 
-         return FALSE;
+         success = FALSE;
+         break;
       }
    } while (fretR != FILEIO_READ_ERROR_EOF);
 
-   return TRUE;
+   err = Err_Errno();
+   free(buf);
+   Err_SetErrno(err);
+
+   return success;
 }
 
 
@@ -876,13 +1015,11 @@ FileCopyTree(const char *srcName,     // IN:
 {
    int err;
    Bool success = TRUE;
-   int numFiles;
-   int i;
-   char **fileList = NULL;
+   FileDirIter *iter;
 
-   numFiles = File_ListDirectory(srcName, &fileList);
+   iter = FileDirIterOpen(srcName);
 
-   if (numFiles == -1) {
+   if (iter == NULL) {
       err = Err_Errno();
       Msg_Append(MSGID(File.CopyTree.walk.failure)
                  "Unable to access '%s' when copying files.\n\n",
@@ -894,29 +1031,39 @@ FileCopyTree(const char *srcName,     // IN:
 
    File_EnsureDirectory(dstName);
 
-   for (i = 0; i < numFiles && success; i++) {
-      struct stat sb;
+   while (success) {
+      FileDirEntry entry;
+      int fileType;
       char *srcFilename;
 
-      srcFilename = File_PathJoin(srcName, fileList[i]);
-
-      if (followSymlinks) {
-         success = (Posix_Stat(srcFilename, &sb) == 0);
-      } else {
-         success = (Posix_Lstat(srcFilename, &sb) == 0);
+      if (!FileDirIterNext(iter, &entry)) {
+         if (errno != 0) {
+            err = Err_Errno();
+            Msg_Append(MSGID(File.CopyTree.walk.failure)
+                       "Unable to access '%s' when copying files.\n\n",
+                       srcName);
+            Err_SetErrno(err);
+            success = FALSE;
+         }
+         break;
       }
 
+      srcFilename = File_PathJoin(srcName, entry.name);
+
+      fileType = FileDirIterGetType(iter, &entry, followSymlinks);
+      success = (fileType != -1);
+
       if (success) {
-         char *dstFilename = File_PathJoin(dstName, fileList[i]);
+         char *dstFilename = File_PathJoin(dstName, entry.name);
 
-         switch (sb.st_mode & S_IFMT) {
-         case S_IFDIR:
+         switch (fileType) {
+         case FILE_TYPE_DIRECTORY:
             success = FileCopyTree(srcFilename, dstFilename, overwriteExisting,
                                    followSymlinks);
             break;
 
 #if !defined(_WIN32)
-         case S_IFLNK:
+         case FILE_TYPE_SYMLINK:
             if (Posix_Symlink(Posix_ReadLink(srcFilename), dstFilename) != 0) {
                err = Err_Errno();
                Msg_Append(MSGID(File.CopyTree.symlink.failure)
@@ -956,7 +1103,7 @@ FileCopyTree(const char *srcName,     // IN:
       free(srcFilename);
    }
 
-   Util_FreeStringList(fileList, numFiles);
+   FileDirIterClose(iter);
 
    return success;
 }
@@ -1475,9 +1622,8 @@ File_SupportsLargeFiles(const char *pathName)  // IN:
 int64
 File_GetSizeEx(const char *pathName) // IN:
 {
-   int numFiles;
-   int i;
-   char **fileList = NULL;
+   FileDirIter *iter;
+   FileDirEntry entry;
    struct stat sb;
    int64 totalSize = 0;
 
@@ -1493,17 +1639,17 @@ File_GetSizeEx(const char *pathName) // IN:
       return sb.st_size;
    }
 
-   numFiles = File_ListDirectory(pathName, &fileList);
+   iter = FileDirIterOpen(pathName);
 
-   if (-1 == numFiles) {
+   if (NULL == iter) {
       return -1;
    }
 
-   for (i = 0; i < numFiles; i++) {
+   while (FileDirIterNext(iter, &entry)) {
       char *fileName;
       int64 fileSize;
 
-      fileName = File_PathJoin(pathName, fileList[i]);
+      fileName = File_PathJoin(pathName, entry.name);
 
       fileSize = File_GetSizeEx(fileName);
 
@@ -1517,7 +1663,12 @@ File_GetSizeEx(const char *pathName) // IN:
       }
    }
 
-   Util_FreeStringList(fileList, numFiles);
+   if (totalSize != -1 && errno != 0) {
+      /* Couldn't read the whole directory. */
+      totalSize = -1;
+   }
+
+   FileDirIterClose(iter);
 
    return totalSize;
 }
@@ -1716,12 +1867,11 @@ static INLINE Bool
 FileDeleteDirectoryTree(const char *pathName,  // IN: directory to delete
                         Bool contentOnly)      // IN: Content only or not
 {
-   int i;
-   int numFiles;
    int err = 0;
    char *base;
 
-   char **fileList = NULL;
+   FileDirIter *iter;
+   FileDirEntry entry;
    Bool sawFileError = FALSE;
 
    if (Posix_EuidAccess(pathName, F_OK) != 0) {
@@ -1747,25 +1897,26 @@ FileDeleteDirectoryTree(const char *pathName,  // IN: directory to delete
          break;
    }
 
-   /* get list of files in current directory */
-   numFiles = File_ListDirectory(pathName, &fileList);
+   /* walk the files in current directory */
+   iter = FileDirIterOpen(pathName);
 
-   if (numFiles == -1) {
+   if (iter == NULL) {
       return FALSE;
    }
 
    /* delete everything in the directory */
    base = Unicode_Append(pathName, DIRSEPS);
 
-   for (i = 0; i < numFiles; i++) {
+   while (FileDirIterNext(iter, &entry)) {
       char *curPath;
-      struct stat statbuf;
+      int fileType;
 
-      curPath = Unicode_Append(base, fileList[i]);
+      curPath = Unicode_Append(base, entry.name);
 
-      if (Posix_Lstat(curPath, &statbuf) == 0) {
-         switch (statbuf.st_mode & S_IFMT) {
-         case S_IFDIR:
+      fileType = FileDirIterGetType(iter, &entry, FALSE);
+      if (fileType != -1) {
+         switch (fileType) {
+         case FILE_TYPE_DIRECTORY:
             /* Directory, recurse */
             if (!FileDeleteDirectoryTree(curPath, FALSE)) {
                sawFileError = TRUE;
@@ -1773,7 +1924,7 @@ FileDeleteDirectoryTree(const char *pathName,  // IN: directory to delete
             break;
 
 #if !defined(_WIN32)
-         case S_IFLNK:
+         case FILE_TYPE_SYMLINK:
             /* Delete symlink, not what it points to */
             if (FileDeletion(curPath, FALSE) != 0) {
                sawFileError = TRUE;
@@ -1804,6 +1955,12 @@ FileDeleteDirectoryTree(const char *pathName,  // IN: directory to delete
       free(curPath);
    }
 
+   /* Couldn't read the whole directory. */
+   if (errno != 0) {
+      sawFileError = TRUE;
+   }
+
+   FileDirIterClose(iter);
    free(base);
 
    if (!contentOnly) {
@@ -1816,8 +1973,6 @@ FileDeleteDirectoryTree(const char *pathName,  // IN: directory to delete
       }
    }
 
-   Util_FreeStringList(fileList, numFiles);
-
    return !sawFileError;
 }
 
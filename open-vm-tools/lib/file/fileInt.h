@@ -107,6 +107,31 @@ typedef struct FileData {
    int    fileGroup;
 } FileData;
 
+/*
+ * Streaming directory iteration, for the tree walkers.  Unlike
+ * File_ListDirectory, nothing is kept per entry, so memory use doesn't grow
+ * with the size of the directory: an entry is only valid until the next call
+ * to FileDirIterNext.  "." and ".." are skipped.
+ */
+
+typedef struct FileDirIter FileDirIter;
+
+typedef struct FileDirEntry {
+   const char *name;      // UTF-8
+   int         fileType;  // FILE_TYPE_*, FILE_TYPE_UNCERTAIN if not known yet
+} FileDirEntry;
+
+FileDirIter *FileDirIterOpen(const char *pathName);
+
+Bool FileDirIterNext(FileDirIter *iter,
+                     FileDirEntry *entry);
+
+int FileDirIterGetType(FileDirIter *iter,
+                       const FileDirEntry *entry,
+                       Bool followSymlinks);
+
+void FileDirIterClose(FileDirIter *iter);
+
 #define FILE_MAX_WAIT_TIME_MS 2000  // maximum wait time in milliseconds
 
 void FileIOResolveLockBits(int *access);
@@ -165,6 +190,11 @@ FileMapErrorToErrno(const char *functionName,
 
 char *FilePosixGetBlockDevice(char const *path);
 
+#if defined(__linux__)
+Bool FilePosixCopyFromFdToFd(int src,
+                             int dst);
+#endif
+
 int FileAttributes(const char *pathName,
                    FileData *fileData);
 
@@ -64,6 +64,8 @@
 #define LOCK_EXCLUSIVE  "X"
 #define FILELOCK_PROGRESS_DEARTH 8000 // Dearth of progress time in msec
 #define FILELOCK_PROGRESS_SAMPLE 200  // Progress sampling time in msec
+#define FILELOCK_SHORT_SLEEPS    7    // Sleeps of 1, 2, 4 ... 64 msec first
+#define FILELOCK_SLOW_ACQUIRE    1000 // Log acquisitions slower than this (msec)
 
 static char implicitReadToken;
 
@@ -109,6 +111,11 @@ struct FileLockToken
  *      sleep is determined by the count that is passed in. Checks are
  *      also done for exceeding the maximum wait time.
  *
+ *      The first few sleeps are short and doubling, so that a lock held
+ *      for a few milliseconds (the common case for config and state files)
+ *      is picked up right after it is released rather than a full 100 msec
+ *      sleep later.
+ *
  * Results:
  *      0       slept
  *      EAGAIN  maximum sleep time exceeded
@@ -131,13 +138,17 @@ FileLockSleeper(LockValues *myValues,  // IN/OUT:
       return EAGAIN;
    }
 
-   if (*loopCount <= 20) {
+   if (*loopCount < FILELOCK_SHORT_SLEEPS) {
+      /* most locks are "very short" */
+      msecSleepTime = 1 << *loopCount;
+      *loopCount += 1;
+   } else if (*loopCount <= FILELOCK_SHORT_SLEEPS + 20) {
       /* most locks are "short" */
       msecSleepTime = 100;
       *loopCount += 1;
-   } else if (*loopCount < 40) {
+   } else if (*loopCount < FILELOCK_SHORT_SLEEPS + 40) {
       /* lock has been around a while, linear back-off */
-      msecSleepTime = 100 * (*loopCount - 19);
+      msecSleepTime = 100 * (*loopCount - FILELOCK_SHORT_SLEEPS - 19);
       *loopCount += 1;
    } else {
       /* WOW! long time... Set a maximum */
@@ -1834,6 +1845,8 @@ FileLockIntrinsic(const char *pathName,    // IN:
    char *lockBase;
    LockValues myValues = { 0 };
    FileLockToken *tokenPtr;
+   VmTimeType start = Hostinfo_SystemTimerMS();
+   VmTimeType elapsed;
 
    /* Construct the locking directory path */
    lockBase = Unicode_Append(pathName, FILELOCK_SUFFIX);
@@ -1868,6 +1881,22 @@ FileLockIntrinsic(const char *pathName,    // IN:
 
    free(lockBase);
 
+   /*
+    * Report how long the acquisition took, so lock contention shows up in
+    * the logs rather than as unexplained stalls.
+    */
+
+   elapsed = Hostinfo_SystemTimerMS() - start;
+
+   if (tokenPtr != NULL && elapsed >= FILELOCK_SLOW_ACQUIRE) {
+      Log(LGPFX" %s %s lock on '%s' took %"FMT64"d msec.\n", __FUNCTION__,
+          myValues.lockType, pathName, elapsed);
+   } else {
+      LOG(1, ("%s %s lock on %s in %"FMT64"d msec.\n",
+          tokenPtr != NULL ? "Acquired" : "Did not acquire",
+          myValues.lockType, pathName, elapsed));
+   }
+
    return tokenPtr;
 }
 
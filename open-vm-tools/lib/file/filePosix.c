@@ -51,6 +51,9 @@
 #include <dirent.h>
 #if defined(__linux__)
 #   include <pwd.h>
+#   include <sys/ioctl.h>
+#   include <sys/sendfile.h>
+#   include <sys/syscall.h>
 #endif
 
 #include "vmware.h"
@@ -96,9 +99,37 @@ static char *FilePosixNearestExistingAncestor(char const *path);
 #endif
 
 struct WalkDirContextImpl {
-   int     cnt;
-   int     iter;
-   char  **files;
+   FileDirIter *iter;
+};
+
+#if defined(__linux__)
+/*
+ * What getdents64() fills the buffer with; the libc headers don't have it.
+ */
+typedef struct FileLinuxDirent64 {
+   uint64         d_ino;
+   int64          d_off;
+   unsigned short d_reclen;
+   unsigned char  d_type;
+   char           d_name[];
+} FileLinuxDirent64;
+
+/* Directory entries are read this many bytes' worth at a time. */
+#define FILE_DIRITER_BUFSIZE (32 * 1024)
+#endif
+
+struct FileDirIter {
+   int          fd;
+   Bool         utf8Names;      // Names are stored in UTF-8
+   const char  *rawName;        // Current entry's name, as stored
+   char        *convertedName;  // Current entry's name, if it was converted
+#if defined(__linux__)
+   char        *buf;
+   long         bufLen;
+   long         bufPos;
+#else
+   DIR         *dir;
+#endif
 };
 
 
@@ -120,6 +151,19 @@ struct WalkDirContextImpl {
 /* Long path chunk growth size */
 #define FILE_PATH_GROW_SIZE 1024
 
+#if defined(__linux__)
+/*
+ * Not taken from <linux/fs.h>, which doesn't mix with the libc headers on
+ * every distro.  Filesystems without reflinks reject it.
+ */
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+/* Most a single copy_file_range() or sendfile() is asked to move. */
+#define FILE_COPY_CHUNK_SIZE (1024 * 1024 * 1024)
+#endif
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -2908,6 +2952,294 @@ File_ListDirectory(const char *pathName,  // IN:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileDirIterOpen --
+ *
+ *      Starts reading the entries of directory 'pathName'.
+ *
+ *      On Linux, entries are read straight from getdents64() into a buffer
+ *      owned by the iterator; elsewhere, readdir() is used.
+ *
+ * Results:
+ *      An iterator to pass to FileDirIterNext and FileDirIterClose, or NULL
+ *      on failure (errno is set).
+ *
+ * Side effects:
+ *      The directory is held open until FileDirIterClose.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+FileDirIter *
+FileDirIterOpen(const char *pathName)  // IN:
+{
+   FileDirIter *iter;
+
+   ASSERT(pathName != NULL);
+
+   iter = Util_SafeCalloc(1, sizeof *iter);
+
+#if defined(__linux__)
+   iter->fd = Posix_Open(pathName, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (iter->fd == -1) {
+      free(iter);
+
+      // errno is preserved
+      return NULL;
+   }
+
+   iter->buf = Util_SafeMalloc(FILE_DIRITER_BUFSIZE);
+#else
+   iter->dir = Posix_OpenDir(pathName);
+   if (iter->dir == NULL) {
+      free(iter);
+
+      // errno is preserved
+      return NULL;
+   }
+
+   iter->fd = dirfd(iter->dir);
+#endif
+
+   iter->utf8Names =
+      Unicode_ResolveEncoding(STRING_ENCODING_DEFAULT) == STRING_ENCODING_UTF8;
+
+   return iter;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileDirIterNext --
+ *
+ *      Gets the next entry of a directory opened with FileDirIterOpen.
+ *
+ *      The entry's type comes from the directory itself, where the file
+ *      system records it; it is FILE_TYPE_UNCERTAIN otherwise.
+ *
+ *      A file name that cannot be represented in the default encoding
+ *      will appear as a string of three UTF8 substitution characters.
+ *
+ * Results:
+ *      TRUE and the entry, valid until the next call, if there is one.
+ *      FALSE otherwise, errno is 0 iff all the entries were read.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+FileDirIterNext(FileDirIter *iter,     // IN:
+                FileDirEntry *entry)   // OUT:
+{
+   const char *name;
+   int type;
+
+   ASSERT(iter != NULL);
+   ASSERT(entry != NULL);
+
+   free(iter->convertedName);
+   iter->convertedName = NULL;
+   iter->rawName = NULL;
+
+   do {
+#if defined(__linux__)
+      FileLinuxDirent64 *dent;
+
+      if (iter->bufPos >= iter->bufLen) {
+         long len = syscall(SYS_getdents64, iter->fd, iter->buf,
+                            FILE_DIRITER_BUFSIZE);
+
+         if (len <= 0) {
+            if (len == 0) {
+               errno = 0;
+            }
+
+            return FALSE;
+         }
+
+         iter->bufLen = len;
+         iter->bufPos = 0;
+      }
+
+      dent = (FileLinuxDirent64 *) (iter->buf + iter->bufPos);
+      iter->bufPos += dent->d_reclen;
+
+      name = dent->d_name;
+      type = dent->d_type;
+#else
+      struct dirent *dent;
+
+      errno = 0;
+      dent = readdir(iter->dir);
+      if (dent == NULL) {
+         return FALSE;
+      }
+
+      name = dent->d_name;
+#if defined(DT_UNKNOWN)
+      type = dent->d_type;
+#else
+      type = 0;
+#endif
+#endif
+   } while ((strcmp(name, ".") == 0) || (strcmp(name, "..") == 0));
+
+   iter->rawName = name;
+
+   switch (type) {
+#if defined(DT_UNKNOWN)
+   case DT_REG:
+      entry->fileType = FILE_TYPE_REGULAR;
+      break;
+   case DT_DIR:
+      entry->fileType = FILE_TYPE_DIRECTORY;
+      break;
+   case DT_LNK:
+      entry->fileType = FILE_TYPE_SYMLINK;
+      break;
+   case DT_BLK:
+      entry->fileType = FILE_TYPE_BLOCKDEVICE;
+      break;
+   case DT_CHR:
+      entry->fileType = FILE_TYPE_CHARDEVICE;
+      break;
+   case DT_FIFO:
+      entry->fileType = FILE_TYPE_FIFO;
+      break;
+   case DT_SOCK:
+      entry->fileType = FILE_TYPE_SOCKET;
+      break;
+#endif
+   default:
+      entry->fileType = FILE_TYPE_UNCERTAIN;
+      break;
+   }
+
+   /* Names need no copy in the common case of a UTF-8 locale. */
+   if (iter->utf8Names &&
+       Unicode_IsBufferValid(name, -1, STRING_ENCODING_UTF8)) {
+      entry->name = name;
+   } else if (Unicode_IsBufferValid(name, -1, STRING_ENCODING_DEFAULT)) {
+      iter->convertedName = Unicode_Alloc(name, STRING_ENCODING_DEFAULT);
+      entry->name = iter->convertedName;
+   } else {
+      char *id = Unicode_EscapeBuffer(name, -1, STRING_ENCODING_DEFAULT);
+
+      Warning("%s: file '%s' cannot be converted to UTF8\n", __FUNCTION__, id);
+      free(id);
+
+      iter->convertedName = Unicode_Duplicate(UNICODE_SUBSTITUTION_CHAR
+                                              UNICODE_SUBSTITUTION_CHAR
+                                              UNICODE_SUBSTITUTION_CHAR);
+      entry->name = iter->convertedName;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileDirIterGetType --
+ *
+ *      Gets the type of the entry last returned by FileDirIterNext, with
+ *      fstatat() relative to the open directory if the directory didn't
+ *      record it, or to find what a symbolic link points to if
+ *      'followSymlinks'.
+ *
+ * Results:
+ *      FILE_TYPE_*, or -1 on failure (errno is set).
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+FileDirIterGetType(FileDirIter *iter,          // IN:
+                   const FileDirEntry *entry,  // IN:
+                   Bool followSymlinks)        // IN:
+{
+   struct stat statbuf;
+
+   ASSERT(iter != NULL);
+   ASSERT(iter->rawName != NULL);
+
+   if (entry->fileType != FILE_TYPE_UNCERTAIN &&
+       !(followSymlinks && entry->fileType == FILE_TYPE_SYMLINK)) {
+      return entry->fileType;
+   }
+
+   if (fstatat(iter->fd, iter->rawName, &statbuf,
+               followSymlinks ? 0 : AT_SYMLINK_NOFOLLOW) == -1) {
+      return -1;
+   }
+
+   switch (statbuf.st_mode & S_IFMT) {
+   case S_IFREG:
+      return FILE_TYPE_REGULAR;
+   case S_IFDIR:
+      return FILE_TYPE_DIRECTORY;
+   case S_IFBLK:
+      return FILE_TYPE_BLOCKDEVICE;
+   case S_IFCHR:
+      return FILE_TYPE_CHARDEVICE;
+   case S_IFLNK:
+      return FILE_TYPE_SYMLINK;
+   case S_IFIFO:
+      return FILE_TYPE_FIFO;
+   case S_IFSOCK:
+      return FILE_TYPE_SOCKET;
+   default:
+      return FILE_TYPE_UNCERTAIN;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileDirIterClose --
+ *
+ *      Finishes reading a directory opened with FileDirIterOpen.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      The iterator is now invalid. errno is preserved.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+FileDirIterClose(FileDirIter *iter)  // IN:
+{
+   int err = errno;
+
+   if (iter != NULL) {
+#if defined(__linux__)
+      close(iter->fd);
+      free(iter->buf);
+#else
+      closedir(iter->dir);
+#endif
+      free(iter->convertedName);
+      free(iter);
+   }
+
+   errno = err;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -2928,9 +3260,7 @@ void
 File_WalkDirectoryEnd(WalkDirContext context)  // IN:
 {
    if (context != NULL) {
-      if (context->cnt > 0) {
-         Util_FreeStringList(context->files, context->cnt);
-      }
+      FileDirIterClose(context->iter);
       free(context);
    }
 }
@@ -2965,11 +3295,9 @@ File_WalkDirectoryStart(const char *parentPath)  // IN:
    WalkDirContextImpl *context = malloc(sizeof *context);
 
    if (context != NULL) {
-      context->files = NULL;
-      context->iter = 0;
-      context->cnt = File_ListDirectory(parentPath, &context->files);
+      context->iter = FileDirIterOpen(parentPath);
 
-      if (context->cnt == -1) {
+      if (context->iter == NULL) {
          File_WalkDirectoryEnd(context);
          context = NULL;
       }
@@ -3005,13 +3333,13 @@ Bool
 File_WalkDirectoryNext(WalkDirContext context,  // IN:
                        char **path)             // OUT:
 {
+   FileDirEntry entry;
+
    ASSERT(context);
    ASSERT(path);
 
-   errno = 0;  // Any errors showed up at "start time".
-
-   if (context->iter < context->cnt) {
-      *path = Util_SafeStrdup(context->files[context->iter++]);
+   if (FileDirIterNext(context->iter, &entry)) {
+      *path = Util_SafeStrdup(entry.name);
       return TRUE;
    }
 
@@ -3235,3 +3563,201 @@ File_IsCharDevice(const char *pathName)  // IN:
    return (FileAttributes(pathName, &fileData) == 0) &&
            (fileData.fileType == FILE_TYPE_CHARDEVICE);
 }
+
+
+#if defined(__linux__)
+/*
+ *----------------------------------------------------------------------------
+ *
+ * FilePosixCopyExtent --
+ *
+ *      Copies up to 'len' bytes from the current position in 'src' to the
+ *      current position in 'dst' without the data passing through user
+ *      space: with copy_file_range() if the kernel can do it for this pair
+ *      of files, or else with sendfile().  Both advance the positions as
+ *      read() and write() would.
+ *
+ * Results:
+ *      The number of bytes copied.  It is short of 'len' at EOF of 'src',
+ *      or if neither call works for these files.
+ *      -1 on failure, errno is set.
+ *
+ * Side effects:
+ *      None
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int64
+FilePosixCopyExtent(int src,     // IN:
+                    int dst,     // IN:
+                    uint64 len)  // IN:
+{
+   uint64 copied = 0;
+   Bool useCopyRange = TRUE;
+
+   while (copied < len) {
+      size_t chunk = MIN(len - copied, FILE_COPY_CHUNK_SIZE);
+      ssize_t ret = -1;
+
+#if defined(__NR_copy_file_range)
+      if (useCopyRange) {
+         ret = syscall(__NR_copy_file_range, src, NULL, dst, NULL, chunk, 0);
+         if (ret < 0 && errno != EINTR) {
+            if (errno != ENOSYS && errno != EXDEV && errno != EINVAL &&
+                errno != EOPNOTSUPP && errno != EBADF) {
+               return -1;
+            }
+
+            /* Not for these files (or this kernel); try sendfile(). */
+            useCopyRange = FALSE;
+            continue;
+         }
+      }
+#else
+      useCopyRange = FALSE;
+#endif
+
+      if (!useCopyRange) {
+         ret = sendfile(dst, src, NULL, chunk);
+         if (ret < 0 && errno != EINTR) {
+            if (errno == ENOSYS || errno == EINVAL) {
+               break;
+            }
+
+            return -1;
+         }
+      }
+
+      if (ret == 0) {
+         break;
+      }
+
+      if (ret > 0) {
+         copied += ret;
+      }
+   }
+
+   return copied;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * FilePosixCopyFromFdToFd --
+ *
+ *      Does as much of File_CopyFromFdToFd as the kernel can: with a reflink
+ *      if a whole file is copied to an empty one, otherwise extent by extent
+ *      with FilePosixCopyExtent.  If the destination is being appended to,
+ *      holes in the source are skipped, so that a sparse file stays sparse.
+ *
+ *      Only regular files are handled.  Whatever is left (the whole copy if
+ *      the kernel can't help) is for the caller to copy the ordinary way
+ *      from where the two positions are left, which always correspond.
+ *
+ * Results:
+ *      TRUE    success
+ *      FALSE   failure, errno is set
+ *
+ * Side effects:
+ *      The current position in the 'src' file and the 'dst' file are modified
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+FilePosixCopyFromFdToFd(int src,  // IN:
+                        int dst)  // IN:
+{
+   struct stat srcStat;
+   struct stat dstStat;
+   off_t srcPos;
+   off_t dstPos;
+   Bool sparse;
+
+   if (fstat(src, &srcStat) != 0 || fstat(dst, &dstStat) != 0 ||
+       !S_ISREG(srcStat.st_mode) || !S_ISREG(dstStat.st_mode)) {
+      return TRUE;
+   }
+
+   srcPos = lseek(src, 0, SEEK_CUR);
+   dstPos = lseek(dst, 0, SEEK_CUR);
+   if (srcPos < 0 || dstPos < 0 || srcPos >= srcStat.st_size) {
+      return TRUE;
+   }
+
+   if (srcPos == 0 && dstPos == 0 && dstStat.st_size == 0 &&
+       ioctl(dst, FICLONE, src) == 0) {
+      if (lseek(src, srcStat.st_size, SEEK_SET) < 0 ||
+          lseek(dst, srcStat.st_size, SEEK_SET) < 0) {
+         return FALSE;
+      }
+
+      return TRUE;
+   }
+
+   /* Skipping over holes is only safe if there's nothing to overwrite. */
+   sparse = dstPos >= dstStat.st_size;
+
+   while (srcPos < srcStat.st_size) {
+      off_t dataEnd = srcStat.st_size;
+      int64 copied;
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+      if (sparse) {
+         off_t data = lseek(src, srcPos, SEEK_DATA);
+
+         if (data < 0 && errno != ENXIO) {
+            /* The filesystem can't tell; copy everything. */
+            sparse = FALSE;
+         } else {
+            off_t hole;
+
+            /* ENXIO: nothing but a hole from here to EOF. */
+            if (data < 0 || data > srcStat.st_size) {
+               data = srcStat.st_size;
+            }
+
+            hole = data < srcStat.st_size ? lseek(src, data, SEEK_HOLE)
+                                          : srcStat.st_size;
+            if (hole > data && hole < dataEnd) {
+               dataEnd = hole;
+            }
+
+            dstPos += data - srcPos;
+            srcPos = data;
+            if (lseek(src, srcPos, SEEK_SET) < 0 ||
+                lseek(dst, dstPos, SEEK_SET) < 0) {
+               return FALSE;
+            }
+         }
+      }
+#endif
+
+      if (srcPos >= dataEnd) {
+         continue;
+      }
+
+      copied = FilePosixCopyExtent(src, dst, dataEnd - srcPos);
+      if (copied < 0) {
+         return FALSE;
+      }
+
+      srcPos += copied;
+      dstPos += copied;
+
+      if (srcPos < dataEnd) {
+         /* Short copy; the caller takes over from here. */
+         return TRUE;
+      }
+   }
+
+   /* A trailing hole was skipped over; give the file its full length. */
+   if (sparse && ftruncate(dst, dstPos) != 0) {
+      return FALSE;
+   }
+
+   return TRUE;
+}
+#endif
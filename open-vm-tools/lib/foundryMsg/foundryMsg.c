@@ -2476,3 +2476,86 @@ __VMAutomationMsgParserGetPropertyList(const char *caller,            // IN
 
    return err;
 }
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMAutomationMsgParserGetPropertyListView --
+ * __VMAutomationMsgParserGetPropertyListView --
+ *
+ *      Fetches a serialized property list of the specified length without
+ *      deserializing it.  propState is set up to read the properties in
+ *      place with VMAutomationMsgParserGetNextProperty, so string and blob
+ *      values are not copied out of the message.
+ *
+ * Results:
+ *      VixError.  VIX_OK on success.  Some other VIX_* code if message is malformed.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+VixError
+__VMAutomationMsgParserGetPropertyListView(const char *caller,              // IN
+                                           unsigned int line,               // IN
+                                           VMAutomationMsgParser *state,    // IN/OUT
+                                           size_t length,                   // IN
+                                           VMAutomationMsgParser *propState) // OUT
+{
+   VixError err;
+   const char *data;
+
+   err = __VMAutomationMsgParserGetData(caller, line, state, length, &data);
+   if (VIX_OK != err) {
+      return err;
+   }
+
+   propState->currentPtr = data;
+   propState->endPtr = data + length;
+   return VIX_OK;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMAutomationMsgParserGetNextProperty --
+ * __VMAutomationMsgParserGetNextProperty --
+ *
+ *      Fetches the next property from a property list view.  String and
+ *      blob values point into the message, and are only valid as long
+ *      as the message is.
+ *
+ * Results:
+ *      VixError.  VIX_OK on success.  VIX_E_NOT_FOUND if there are no more
+ *      properties.  Some other VIX_* code if message is malformed.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+VixError
+__VMAutomationMsgParserGetNextProperty(const char *caller,                // IN
+                                       unsigned int line,                 // IN
+                                       VMAutomationMsgParser *propState,  // IN/OUT
+                                       VixPropertyView *property)         // OUT
+{
+   VixError err;
+   size_t pos = 0;
+
+   err = VixPropertyList_ReadSerializedProperty(propState->currentPtr,
+                                                propState->endPtr -
+                                                   propState->currentPtr,
+                                                &pos, property);
+   if (VIX_OK != err && VIX_E_NOT_FOUND != err) {
+      Log("%s(%u): Malformed property list in message.\n", caller, line);
+   }
+
+   propState->currentPtr += pos;
+   return err;
+}
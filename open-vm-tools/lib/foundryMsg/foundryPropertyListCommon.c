@@ -81,10 +81,33 @@ void
 VixPropertyList_Initialize(VixPropertyListImpl *propList)  // IN
 {
    ASSERT(propList);
-   propList->properties = NULL;
+   memset(propList, 0, sizeof *propList);
 } // VixPropertyList_Initialize
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixPropertyListBucket --
+ *
+ *       Returns the index table bucket for a property ID.
+ *
+ * Results:
+ *       Bucket number.
+ *
+ * Side effects:
+ *       None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE unsigned int
+VixPropertyListBucket(int propertyID)  // IN
+{
+   return (uint32) propertyID % VIX_PROPERTY_LIST_BUCKETS;
+} // VixPropertyListBucket
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -130,6 +153,10 @@ VixPropertyList_RemoveAllWithoutHandles(VixPropertyListImpl *propList)   // IN
       
       free(property);
    }
+
+   propList->lastProperty = NULL;
+   propList->numItems = 0;
+   memset(propList->buckets, 0, sizeof propList->buckets);
 } // VixPropertyList_RemoveAllWithoutHandles
 
 
@@ -164,13 +191,67 @@ VixPropertyList_MarkAllSensitive(VixPropertyListImpl *propList)  // IN/OUT:
 } // VixPropertyList_MarkAllSensitive
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixPropertyListReserve --
+ *
+ *       Makes sure a serialization buffer has room for 'needed' more bytes
+ *       past 'used', growing it if necessary. The old buffer is zeroed
+ *       before it is freed since it may hold sensitive values.
+ *
+ * Results:
+ *       TRUE on success, FALSE if out of memory.
+ *
+ * Side effects:
+ *       *buffer and *bufferSize may change.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+VixPropertyListReserve(char **buffer,       // IN/OUT:
+                       size_t *bufferSize,  // IN/OUT:
+                       size_t used,         // IN:
+                       size_t needed)       // IN:
+{
+   size_t newSize;
+   char *newBuffer;
+
+   if (used + needed <= *bufferSize) {
+      return TRUE;
+   }
+
+   newSize = MAX(*bufferSize * 2, used + needed);
+   newBuffer = (char *) VixMsg_MallocClientData(newSize);
+   if (NULL == newBuffer) {
+      return FALSE;
+   }
+
+   if (used > 0) {
+      memcpy(newBuffer, *buffer, used);
+   }
+   Util_ZeroFree(*buffer, *bufferSize);
+
+   *buffer = newBuffer;
+   *bufferSize = newSize;
+
+   return TRUE;
+} // VixPropertyListReserve
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * VixPropertyList_Serialize --
  *
  *       Serialize a property list to a buffer. The buffer is allocated by
- *       this routine to be of the required size and should be freed by caller.
+ *       this routine and should be freed by caller. It may be larger than
+ *       *resultSize.
+ *
+ *       The list is walked once. The buffer is reserved up front from the
+ *       size of the last full serialization of this list, or from the
+ *       number of items, and only grows if a value does not fit.
  *
  *       This function should be modified to deal with the case of 
  *       properties of type VIX_PROPERTYTYPE_HANDLE.
@@ -180,7 +261,7 @@ VixPropertyList_MarkAllSensitive(VixPropertyListImpl *propList)  // IN/OUT:
  *      VixError.
  *
  * Side effects:
- *       None.
+ *       Updates the size hint of the list.
  *
  *-----------------------------------------------------------------------------
  */
@@ -194,6 +275,7 @@ VixPropertyList_Serialize(VixPropertyListImpl *propList,  // IN:
    VixError err = VIX_OK;
    VixPropertyValue *property = NULL;
    char *serializeBuffer = NULL;
+   const void *valuePtr;
    int valueLength;
    size_t headerSize;
    size_t propertyIDSize;
@@ -218,69 +300,91 @@ VixPropertyList_Serialize(VixPropertyListImpl *propList,  // IN:
    headerSize = propertyIDSize + propertyTypeSize + propertyValueLengthSize;
 
    /*
-    * Walk the property list to determine size of the needed buffer
+    * Reserve the buffer. Always allocate something, even for an empty
+    * list, so callers get a valid buffer back.
     */
-   property = propList->properties;
-   while (NULL != property) {
+   bufferSize = propList->serializeSizeHint;
+   if (0 == bufferSize) {
+      bufferSize = propList->numItems * (headerSize + PROPERTY_SIZE_INT64);
+   }
+   bufferSize = MAX(bufferSize, headerSize);
+   serializeBuffer = (char *) VixMsg_MallocClientData(bufferSize);
+   if (NULL == serializeBuffer) {
+      bufferSize = 0;
+      err = VIX_E_OUT_OF_MEMORY;
+      goto abort;
+   }
+
+   /*
+    * Write out the properties to the buffer in the following format:
+    * PropertyID | PropertyType | DataLength | Data
+    */
+   for (property = propList->properties;
+        NULL != property;
+        property = property->next) {
       /*
        * If only the dirty properties need to be serialized
        * then skip the unchanged ones.
        */
       if (dirtyOnly && (!property->isDirty)) {
-         property = property->next;
          continue;
       }
 
-      bufferSize += headerSize;
-      
       switch (property->type) {
          ////////////////////////////////////////////////////////
          case VIX_PROPERTYTYPE_INTEGER:
-            bufferSize += PROPERTY_SIZE_INT32;
+            valueLength = PROPERTY_SIZE_INT32;
+            valuePtr = &(property->value.intValue);
             break;
 
          ////////////////////////////////////////////////////////
          case VIX_PROPERTYTYPE_STRING:
-            if (property->value.strValue) {
-               valueLength = strlen(property->value.strValue) + 1;
-               /*
-                * The deserialization code rejects all non-UTF-8 strings.
-                * There should not be any non-UTF-8 strings passing
-                * through our code since we should have either converted
-                * non-UTF-8 strings from system APIs to UTF-8, or validated
-                * that any client-provided strings were UTF-8. But this
-                * if we've missed something, this should hopefully catch the
-                * offending code close to the act.
-                */
-               if (!Unicode_IsBufferValid(property->value.strValue,
-                                          valueLength,
-                                          STRING_ENCODING_UTF8)) {
-                  Log("%s: attempted to send a non-UTF-8 string for "
-                      "property %d.\n",
-                      __FUNCTION__, property->propertyID);
-                  ASSERT(0);
-                  err = VIX_E_INVALID_UTF8_STRING;
-               }
-               bufferSize += valueLength;
-            } else {
+            if (NULL == property->value.strValue) {
                err = VIX_E_INVALID_ARG;
                goto abort;
             }
+            valueLength = (int) strlen(property->value.strValue) + 1;
+            /*
+             * The deserialization code rejects all non-UTF-8 strings.
+             * There should not be any non-UTF-8 strings passing
+             * through our code since we should have either converted
+             * non-UTF-8 strings from system APIs to UTF-8, or validated
+             * that any client-provided strings were UTF-8. But this
+             * if we've missed something, this should hopefully catch the
+             * offending code close to the act.
+             */
+            if (!Unicode_IsBufferValid(property->value.strValue,
+                                       valueLength,
+                                       STRING_ENCODING_UTF8)) {
+               Log("%s: attempted to send a non-UTF-8 string for "
+                   "property %d.\n",
+                   __FUNCTION__, property->propertyID);
+               ASSERT(0);
+               err = VIX_E_INVALID_UTF8_STRING;
+            }
+            valuePtr = property->value.strValue;
             break;
 
          ////////////////////////////////////////////////////////
          case VIX_PROPERTYTYPE_BOOL:
-            bufferSize += PROPERTY_SIZE_BOOL;
+            valueLength = PROPERTY_SIZE_BOOL;
+            valuePtr = &(property->value.boolValue);
             break;
 
          ////////////////////////////////////////////////////////
          case VIX_PROPERTYTYPE_INT64:
-            bufferSize += PROPERTY_SIZE_INT64;
+            valueLength = PROPERTY_SIZE_INT64;
+            valuePtr = &(property->value.int64Value);
             break;
 
          ////////////////////////////////////////////////////////
          case VIX_PROPERTYTYPE_BLOB:
-            bufferSize += property->value.blobValue.blobSize;
+            if (NULL == property->value.blobValue.blobContents) {
+               err = VIX_E_INVALID_ARG;
+               goto abort;
+            }
+            valueLength = property->value.blobValue.blobSize;
+            valuePtr = property->value.blobValue.blobContents;
             break;
 
          ////////////////////////////////////////////////////////
@@ -300,107 +404,36 @@ VixPropertyList_Serialize(VixPropertyListImpl *propList,  // IN:
             goto abort;     
       }
 
-      property = property->next;
-   }
-
-   *resultBuffer = (char*) VixMsg_MallocClientData(bufferSize);
-   if (NULL == *resultBuffer) {
-      err = VIX_E_OUT_OF_MEMORY;
-      goto abort;
-   }
-   serializeBuffer = *resultBuffer;
-
-   pos = 0;
-   property = propList->properties;
-
-   /*
-    * Write out the properties to the buffer in the following format:
-    * PropertyID | PropertyType | DataLength | Data
-    */
-
-   while (NULL != property) {   
-      /*
-       * If only the dirty properties need to be serialized
-       * then skip the unchanged ones.
-       */
-      if (dirtyOnly && (!property->isDirty)) {
-         property = property->next;
-         continue;
+      if (!VixPropertyListReserve(&serializeBuffer, &bufferSize, pos,
+                                  headerSize + valueLength)) {
+         err = VIX_E_OUT_OF_MEMORY;
+         goto abort;
       }
 
       memcpy(&(serializeBuffer[pos]), &(property->propertyID), propertyIDSize);
       pos += propertyIDSize;
       memcpy(&(serializeBuffer[pos]), &(property->type), propertyTypeSize);
       pos += propertyTypeSize;
+      memcpy(&(serializeBuffer[pos]), &valueLength, propertyValueLengthSize);
+      pos += propertyValueLengthSize;
+      memcpy(&(serializeBuffer[pos]), valuePtr, valueLength);
+      pos += valueLength;
+   }
 
-      switch (property->type) {
-         ////////////////////////////////////////////////////////
-         case VIX_PROPERTYTYPE_INTEGER:
-             valueLength = PROPERTY_SIZE_INT32;
-             memcpy(&(serializeBuffer[pos]), &valueLength, propertyValueLengthSize);
-             pos += propertyValueLengthSize;
-             memcpy(&(serializeBuffer[pos]), &(property->value.intValue), valueLength);
-             break;
-
-         ////////////////////////////////////////////////////////
-         case VIX_PROPERTYTYPE_STRING:
-             valueLength = (int) strlen(property->value.strValue) + 1;
-             memcpy(&(serializeBuffer[pos]), &valueLength, propertyValueLengthSize);
-             pos += propertyValueLengthSize;
-             Str_Strcpy(&(serializeBuffer[pos]), property->value.strValue, valueLength);
-             break;
-
-         ////////////////////////////////////////////////////////
-         case VIX_PROPERTYTYPE_BOOL:
-             valueLength = PROPERTY_SIZE_BOOL;
-             memcpy(&(serializeBuffer[pos]), &valueLength, propertyValueLengthSize);
-             pos += propertyValueLengthSize;
-             memcpy(&(serializeBuffer[pos]), &(property->value.boolValue), valueLength);
-             break;
-
-         ////////////////////////////////////////////////////////
-         case VIX_PROPERTYTYPE_INT64:
-             valueLength = PROPERTY_SIZE_INT64;
-             memcpy(&(serializeBuffer[pos]), &valueLength, propertyValueLengthSize);
-             pos += propertyValueLengthSize;
-             memcpy(&(serializeBuffer[pos]), &(property->value.int64Value), valueLength);
-             break;
-
-         ////////////////////////////////////////////////////////
-         case VIX_PROPERTYTYPE_BLOB:
-            if (property->value.blobValue.blobContents) {
-               valueLength = property->value.blobValue.blobSize;
-               memcpy(&(serializeBuffer[pos]), &valueLength, propertyValueLengthSize);
-               pos += propertyValueLengthSize;
-               memcpy(&(serializeBuffer[pos]), 
-                      property->value.blobValue.blobContents, 
-                      valueLength);
-            } else {
-               err = VIX_E_INVALID_ARG;
-               goto abort;
-            }
-            break;
-
-         ////////////////////////////////////////////////////////
-         case VIX_PROPERTYTYPE_POINTER:
-            NOT_IMPLEMENTED();
+   if (VIX_OK != err) {
+      goto abort;
+   }
 
-         ////////////////////////////////////////////////////////
-         default:
-             err = VIX_E_UNRECOGNIZED_PROPERTY;
-             goto abort;     
-      }
-      
-      pos += valueLength;
-      property = property->next;
+   if (!dirtyOnly) {
+      propList->serializeSizeHint = pos;
    }
 
-   ASSERT(pos == bufferSize);
-   *resultSize = bufferSize;
+   *resultBuffer = serializeBuffer;
+   *resultSize = pos;
    
 abort:
    if (VIX_OK != err) {
-      free(serializeBuffer);
+      Util_ZeroFree(serializeBuffer, bufferSize);
       if (NULL != resultBuffer) {
          *resultBuffer = NULL;
       }
@@ -475,6 +508,126 @@ VixPropertyList_DeserializeNoClobber(VixPropertyListImpl *propList,     // IN
 } // VixPropertyList_DeserializeNoClobber
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixPropertyList_ReadSerializedProperty --
+ *
+ *       Reads the property at *pos of a serialized property list, without
+ *       copying its value out of the buffer. The checks are the same as
+ *       Deserialize() with VIX_PROPERTY_LIST_BAD_ENCODING_ERROR.
+ *
+ *       Trailing bytes too short to hold a property header are ignored,
+ *       as Deserialize() does.
+ *
+ * Results:
+ *       VIX_OK and the property in *property, with *pos moved past it.
+ *       VIX_E_NOT_FOUND if there are no more properties.
+ *       Some other VIX_* code if the buffer is malformed.
+ *
+ * Side effects:
+ *       None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+VixError
+VixPropertyList_ReadSerializedProperty(const char *buffer,         // IN
+                                       size_t bufferSize,          // IN
+                                       size_t *pos,                // IN/OUT
+                                       VixPropertyView *property)  // OUT
+{
+   size_t headerSize;
+   size_t valuePos;
+   int length;
+   const char *value;
+
+   ASSERT(NULL != buffer || 0 == bufferSize);
+   ASSERT(NULL != pos);
+   ASSERT(NULL != property);
+
+   headerSize = sizeof property->propertyID + sizeof property->type +
+                PROPERTY_LENGTH_SIZE;
+
+   if ((*pos + headerSize) >= bufferSize) {
+      *pos = bufferSize;
+      return VIX_E_NOT_FOUND;
+   }
+
+   valuePos = *pos;
+   memcpy(&property->propertyID, &buffer[valuePos], sizeof property->propertyID);
+   valuePos += sizeof property->propertyID;
+   memcpy(&property->type, &buffer[valuePos], sizeof property->type);
+   valuePos += sizeof property->type;
+   memcpy(&length, &buffer[valuePos], PROPERTY_LENGTH_SIZE);
+   valuePos += PROPERTY_LENGTH_SIZE;
+
+   if ((length < 1) || ((length + valuePos) > bufferSize)) {
+      return VIX_E_INVALID_SERIALIZED_DATA;
+   }
+   value = &buffer[valuePos];
+
+   switch (property->type) {
+      ////////////////////////////////////////////////////////
+      case VIX_PROPERTYTYPE_INTEGER:
+         if (PROPERTY_SIZE_INT32 != length) {
+            return VIX_E_INVALID_SERIALIZED_DATA;
+         }
+         memcpy(&property->value.intValue, value, length);
+         break;
+
+      ////////////////////////////////////////////////////////
+      case VIX_PROPERTYTYPE_STRING:
+         if (value[length - 1] != '\0') {
+            return VIX_E_INVALID_SERIALIZED_DATA;
+         }
+         if (!Unicode_IsBufferValid(value, length, STRING_ENCODING_UTF8)) {
+            Log("%s: non-UTF-8 string received for property %d.\n",
+                __FUNCTION__, property->propertyID);
+            return VIX_E_INVALID_UTF8_STRING;
+         }
+         property->value.strValue = value;
+         break;
+
+      ////////////////////////////////////////////////////////
+      case VIX_PROPERTYTYPE_BOOL:
+         if (PROPERTY_SIZE_BOOL != length) {
+            return VIX_E_INVALID_SERIALIZED_DATA;
+         }
+         property->value.boolValue = *value;
+         break;
+
+      ////////////////////////////////////////////////////////
+      case VIX_PROPERTYTYPE_INT64:
+         if (PROPERTY_SIZE_INT64 != length) {
+            return VIX_E_INVALID_SERIALIZED_DATA;
+         }
+         memcpy(&property->value.int64Value, value, length);
+         break;
+
+      ////////////////////////////////////////////////////////
+      case VIX_PROPERTYTYPE_BLOB:
+         property->value.blobValue.blobContents = (const unsigned char *) value;
+         property->value.blobValue.blobSize = length;
+         break;
+
+      ////////////////////////////////////////////////////////
+      case VIX_PROPERTYTYPE_POINTER:
+         Log("%s:%d, pointer properties cannot be serialized.\n",
+             __FUNCTION__, __LINE__);
+         return VIX_E_INVALID_SERIALIZED_DATA;
+
+      ////////////////////////////////////////////////////////
+      default:
+         return VIX_E_UNRECOGNIZED_PROPERTY;
+   }
+
+   *pos = valuePos + length;
+
+   return VIX_OK;
+} // VixPropertyList_ReadSerializedProperty
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -743,7 +896,7 @@ VixPropertyList_FindProperty(VixPropertyListImpl *propList,    // IN
    *resultEntry = NULL;
 
 
-   property = propList->properties;
+   property = propList->buckets[VixPropertyListBucket(propertyID)];
    while (NULL != property) {
       if (propertyID == property->propertyID) {
          if (index > 0) {
@@ -758,7 +911,7 @@ VixPropertyList_FindProperty(VixPropertyListImpl *propList,    // IN
          }
       } // (propertyID == property->propertyID)
 
-      property = property->next;
+      property = property->nextInBucket;
    } // while (NULL != property)
 
    /*
@@ -803,7 +956,7 @@ VixPropertyListAppendProperty(VixPropertyListImpl *propList,   // IN
                               VixPropertyValue **resultEntry)  // OUT
 {
    VixError err = VIX_OK;
-   VixPropertyValue *lastProperty;
+   VixPropertyValue **bucketEnd;
    VixPropertyValue *property = NULL;
 
    if (NULL == resultEntry) {
@@ -837,18 +990,25 @@ VixPropertyListAppendProperty(VixPropertyListImpl *propList,   // IN
     * like a list of VMs or snapshots, assume the order is meaningful and 
     * so it should be preserved.
     */
-   lastProperty = propList->properties;
-   while ((NULL != lastProperty) && (NULL != lastProperty->next)) {
-      lastProperty = lastProperty->next;
-   }
-
-   
-   if (NULL == lastProperty) {
+   if (NULL == propList->lastProperty) {
       propList->properties = property;
    } else {
-      lastProperty->next = property;
+      propList->lastProperty->next = property;
    }
    property->next = NULL;
+   propList->lastProperty = property;
+   propList->numItems++;
+
+   /*
+    * Same for its bucket, so FindProperty() sees repeated properties
+    * in list order.
+    */
+   bucketEnd = &propList->buckets[VixPropertyListBucket(propertyID)];
+   while (NULL != *bucketEnd) {
+      bucketEnd = &(*bucketEnd)->nextInBucket;
+   }
+   *bucketEnd = property;
+   property->nextInBucket = NULL;
 
 
    *resultEntry = property;
@@ -1796,18 +1956,11 @@ VixPropertyList_PropertyExists(VixPropertyListImpl *propList,     // IN
 int
 VixPropertyList_NumItems(VixPropertyListImpl *propList)     // IN
 {
-   VixPropertyValue *prop;
-   int count = 0;
-
    if (propList == NULL) {
       return 0;
    }
 
-   for (prop = propList->properties; prop != NULL; prop = prop->next) {
-      ++count;
-   }
-
-   return count;
+   return propList->numItems;
 } // VixPropertyList_NumItems
 
 
@@ -428,6 +428,7 @@ GlibUtils_CreateFileLogger(const char *path,
 
    data = g_new0(FileLogger, 1);
    data->handler.addsTimestamp = FALSE;
+   data->handler.batchable = TRUE;
    data->handler.shared = FALSE;
    data->handler.logfn = FileLoggerLog;
    data->handler.dtor = FileLoggerDestroy;
@@ -0,0 +1,86 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * guesthfstats.x --
+ *
+ *    Definition of the data structures used to upload a batch of high
+ *    frequency guest performance samples ("SetGuestInfo  <INFO_HFSTATS> ").
+ */
+
+enum GuestHfStatsVersion {
+   GUESTHFSTATS_V1 = 1
+};
+
+/*
+ * These are arbitrary limits to avoid possible DoS attacks. A batch must fit
+ * in a single guest RPC message; the guest splits larger uploads.
+ */
+const GUESTHFSTATS_MAX_DISKS      = 16;
+const GUESTHFSTATS_MAX_DISK_NAME  = 32;
+const GUESTHFSTATS_MAX_DATA       = 60000;
+
+/*
+ * Metric groups, used as a bit mask. Each enabled group contributes the
+ * following values to every sample, in this order:
+ *
+ * CPU    : user + nice, system + irq + softirq, idle, iowait, steal
+ *          (cumulative, USER_HZ ticks summed over all CPUs).
+ * MEMORY : MemAvailable (KiB), pages scanned by reclaim (cumulative), time
+ *          stalled on memory (cumulative "some" PSI, microseconds; 0 if not
+ *          supported by the guest kernel).
+ * SWAP   : pages swapped in, pages swapped out (cumulative), SwapFree (KiB).
+ * DISK   : for each disk in "disks", in order: sectors read, sectors
+ *          written, I/Os completed, time spent doing I/O (milliseconds)
+ *          (all cumulative).
+ */
+enum GuestHfMetric {
+   GUESTHF_METRIC_CPU     = 1,
+   GUESTHF_METRIC_MEMORY  = 2,
+   GUESTHF_METRIC_SWAP    = 4,
+   GUESTHF_METRIC_DISK    = 8
+};
+
+typedef string GuestHfDiskName<GUESTHFSTATS_MAX_DISK_NAME>;
+
+/*
+ * "data" holds numSamples samples, back to back. A sample is the time it was
+ * taken (milliseconds) followed by the values of the enabled metric groups.
+ * Every field is encoded as the difference from the same field of the
+ * previous sample in the batch (from 0 for the first sample, whose time is
+ * therefore relative to "startTime"), zigzag mapped to an unsigned number
+ * and written as a little endian base 128 varint. Cumulative counters that
+ * change slowly thus take a single byte per sample.
+ *
+ * "dropped" counts the samples that were overwritten in the guest's ring
+ * buffer since the previous batch, because the batch wasn't uploaded in time.
+ */
+struct GuestHfStatsV1 {
+   uint64            startTime;   /* guest monotonic clock, milliseconds */
+   uint32            interval;    /* nominal sampling interval, ms */
+   uint32            metrics;     /* GuestHfMetric bit mask */
+   uint32            numSamples;
+   uint32            dropped;
+   GuestHfDiskName   disks<GUESTHFSTATS_MAX_DISKS>;
+   opaque            data<GUESTHFSTATS_MAX_DATA>;
+};
+
+union GuestHfStats switch (GuestHfStatsVersion ver) {
+case GUESTHFSTATS_V1:
+   struct GuestHfStatsV1 *statsV1;
+};
@@ -0,0 +1,74 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * guestinfobatch.x --
+ *
+ *    Definition of the data structures used to send several guest info
+ *    updates in a single "SetGuestInfo" GuestRpc command, and of the
+ *    per-update status the host sends back.
+ */
+
+enum GuestInfoBatchVersion {
+   GUESTINFO_BATCH_V1 = 1
+};
+
+/*
+ * These are arbitrary limits to avoid possible DoS attacks. An entry can
+ * carry at most a full guest RPC message worth of data.
+ */
+const GUESTINFO_BATCH_MAX_ENTRIES   = 16;
+const GUESTINFO_BATCH_MAX_DATA      = 65536;
+
+/*
+ * A single update. "type" is a public/guestInfo.h::GuestInfoType value and
+ * "data" is exactly what would follow "SetGuestInfo  <type> " if the update
+ * was sent on its own (e.g., a NUL-terminated string for the key / value
+ * types, or a serialized GuestNicProto for INFO_IPADDRESS_V3).
+ */
+struct GuestInfoBatchEntry {
+   int      type;
+   opaque   data<GUESTINFO_BATCH_MAX_DATA>;
+};
+
+struct GuestInfoBatchV1 {
+   GuestInfoBatchEntry  entries<GUESTINFO_BATCH_MAX_ENTRIES>;
+};
+
+/*
+ * Host reply to a batch: one status per entry, in the order the entries
+ * were sent.
+ */
+struct GuestInfoBatchStatus {
+   int      type;
+   Bool     success;
+};
+
+struct GuestInfoBatchReplyV1 {
+   GuestInfoBatchStatus status<GUESTINFO_BATCH_MAX_ENTRIES>;
+};
+
+union GuestInfoBatch switch (GuestInfoBatchVersion ver) {
+case GUESTINFO_BATCH_V1:
+   struct GuestInfoBatchV1 *batchV1;
+};
+
+union GuestInfoBatchReply switch (GuestInfoBatchVersion ver) {
+case GUESTINFO_BATCH_V1:
+   struct GuestInfoBatchReplyV1 *replyV1;
+};
@@ -30,7 +30,8 @@
 enum NicInfoVersion {
    NIC_INFO_V1 = 1,     /* XXX Not represented here. */
    NIC_INFO_V2 = 2,
-   NIC_INFO_V3 = 3
+   NIC_INFO_V3 = 3,
+   NIC_INFO_V3_DELTA = 4
 };
 
 /*
@@ -312,6 +313,87 @@ struct NicInfoV3 {
 };
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NIC Info version 3, delta encoded.
+ *
+ *      Carries either a full NicInfoV3 snapshot or only what changed since
+ *      the previous update. Every update is numbered; a delta names the
+ *      update it applies on top of, and the receiver must reject a delta
+ *      whose base isn't the last update it applied. The sender then falls
+ *      back to a snapshot.
+ *
+ *      Route interface indices always refer to nicOrder, the complete NIC
+ *      list as of this update.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+typedef string NicMacAddress<NICINFO_MAC_LEN>;
+
+
+/*
+ * Per-NIC stack settings. Sent whole whenever any of them changed.
+ */
+struct GuestNicV3Config {
+   DnsConfigInfo        *dnsConfigInfo;
+   WinsConfigInfo       *winsConfigInfo;
+   DhcpConfigInfo       *dhcpConfigInfov4;
+   DhcpConfigInfo       *dhcpConfigInfov6;
+};
+
+
+/*
+ * Changes to one NIC. A NIC that wasn't known before lists all of its
+ * addresses in ipsAdded, and always has its config.
+ */
+struct GuestNicV3Delta {
+   string               macAddress<NICINFO_MAC_LEN>;
+   IpAddressEntry       ipsAdded<NICINFO_MAX_IPS>;
+   IpAddressEntry       ipsRemoved<NICINFO_MAX_IPS>;
+   GuestNicV3Config     *config;
+};
+
+
+/*
+ * Global stack settings. Sent whole whenever any of them changed.
+ */
+struct NicInfoV3Config {
+   DnsConfigInfo        *dnsConfigInfo;
+   WinsConfigInfo       *winsConfigInfo;
+   DhcpConfigInfo       *dhcpConfigInfov4;
+   DhcpConfigInfo       *dhcpConfigInfov6;
+};
+
+
+struct NicInfoV3Delta {
+   unsigned int         sequence;
+   unsigned int         baseSequence;
+
+   /*
+    * Complete state; when set, every field below is empty and baseSequence
+    * is ignored.
+    */
+   NicInfoV3            *snapshot;
+
+   /*
+    * MAC addresses of all current NICs, in order. NICs missing from this
+    * list are gone, along with their routes.
+    */
+   NicMacAddress        nicOrder<NICINFO_MAX_NICS>;
+   GuestNicV3Delta      nics<NICINFO_MAX_NICS>;
+
+   /*
+    * Removed routes only list routes through NICs still in nicOrder.
+    */
+   InetCidrRouteEntry   routesAdded<NICINFO_MAX_ROUTES>;
+   InetCidrRouteEntry   routesRemoved<NICINFO_MAX_ROUTES>;
+
+   NicInfoV3Config      *config;
+};
+
+
 /*
  * This defines the protocol for a "nic info" message. The union allows
  * us to create new versions of the protocol later by creating new values
@@ -326,4 +408,6 @@ case NIC_INFO_V2:
    struct GuestNicList *nicsV2;
 case NIC_INFO_V3:
    struct NicInfoV3 *nicInfoV3;
+case NIC_INFO_V3_DELTA:
+   struct NicInfoV3Delta *nicInfoV3Delta;
 };
@@ -32,10 +32,20 @@
 
 #include "vm_basic_types.h"
 #include "vm_assert.h"
+#include "vm_basic_asm.h"
 
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__) || (defined(_MSC_VER) && \
+    (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#define HASHMAP_GROUP_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define HASHMAP_GROUP_NEON
+#include <arm_neon.h>
+#endif
+
 #include "hashMap.h"
 #include "clamped.h"
 #ifdef VMX86_SERVER
@@ -50,10 +60,19 @@
  *    It is not intended to be thread safe nor should it be used in a way that
  *    this may cause problems.
  *
- *    Entries are stored based on a simple hash of their key.  Memory
- *    allocations are kept to a minimum to ensure that this is appropriate for
- *    use in a kernel mode driver.  Linear probing is used to resolve hash
- *    collisions.
+ *    Entries are stored based on a hash of their key.  Memory allocations are
+ *    kept to a minimum to ensure that this is appropriate for use in a kernel
+ *    mode driver.  Open addressing is used to resolve hash collisions.
+ *
+ *    The table is laid out as an array of one-byte control words followed by
+ *    a flat array of key/value slots.  A control byte says whether its slot
+ *    is empty, deleted, or filled, and for filled slots holds 7 bits of the
+ *    key's hash.  Lookups probe groups of HASHMAP_GROUP_SIZE control bytes at
+ *    a time (with SSE2 or NEON where available), and only compare the keys of
+ *    slots whose hash bits match, so a lookup rarely touches more than one
+ *    cache line of control bytes and one slot.  Groups are probed
+ *    quadratically; the first HASHMAP_GROUP_SIZE control bytes are mirrored
+ *    past the end of the array so that a group never needs to wrap.
  *
  *    This implementation only supports static length keys.  It might be
  *    possible to store the keys outside the table and thus support keys of
@@ -74,7 +93,7 @@
  *      supports string and insensitive string keys and only supports pointer
  *      data.  This means its possible to store entire data structures in
  *      HashMap.
- *    - HashMap uses linear probing to resolve collisions while hashTable uses
+ *    - HashMap uses open addressing to resolve collisions while hashTable uses
  *      chaining.  HashMap will dynamically resize itself as necessary.
  *    - Pointers to HashMap values will be invalidated if the internal structure
  *      is resized.  If this is a problem, you should store the pointer in the
@@ -88,17 +107,30 @@
 
 #define HASHMAP_DEFAULT_ALPHA 2
 
+/*
+ * Control bytes.  Free slots (empty or deleted) have the top bit set, filled
+ * slots hold the low 7 bits of their key's hash.
+ */
+#define HASHMAP_GROUP_SIZE    16
+#define HASHMAP_CTRL_EMPTY    ((uint8) 0x80)
+#define HASHMAP_CTRL_DELETED  ((uint8) 0xFE)
+#define HASHMAP_H1(hash)      ((hash) >> 7)
+#define HASHMAP_H2(hash)      ((uint8) ((hash) & 0x7F))
+
+#define HASHMAP_MAX_ENTRIES   (1U << 31)
+
 struct HashMap {
-   uint8 *entries;
-   uint32 numEntries;
+   uint8 *ctrl;        // numEntries + HASHMAP_GROUP_SIZE control bytes
+   uint8 *slots;       // numEntries key/value slots, same allocation
+   uint32 numEntries;  // Power of 2, at least HASHMAP_GROUP_SIZE
    uint32 count;
+   uint32 deleted;
    uint32 alpha;
 
    size_t keySize;
    size_t dataSize;
    size_t entrySize;
 
-   size_t keyOffset;
    size_t dataOffset;
 };
 
@@ -121,30 +153,126 @@ struct HashMapOnDisk {
 HashMapOnDisk;
 #endif
 
-typedef enum {
-   HashMapState_EMPTY  = 0,
-   HashMapState_FILLED,
-   HashMapState_DELETED,
-} HashMapEntryState;
-
-typedef struct {
-   uint32 state;
-   uint32 hash;
-} HashMapEntryHeader;
-
 #define NO_FREE_INDEX ((uint32) -1)
 
 static Bool InitMap(struct HashMap *map, uint32 numEntries, uint32 alpha,
                     size_t keySize, size_t dataSize);
+static Bool AllocTable(struct HashMap *map, uint32 numEntries);
 static void CalculateEntrySize(struct HashMap *map);
-static void GetEntry(struct HashMap *map, uint32 index, HashMapEntryHeader **header, void **key, void **data);
+static void SetCtrl(struct HashMap *map, uint32 index, uint8 ctrl);
+static void *SlotKey(const struct HashMap *map, uint32 index);
+static void *SlotData(const struct HashMap *map, uint32 index);
 static uint32 ComputeHash(struct HashMap *map, const void *key);
-static Bool LookupKey(struct HashMap* map, const void *key, HashMapEntryHeader **header, void **data, uint32 *freeIndex);
+static Bool LookupKey(struct HashMap *map, const void *key, uint32 hash,
+                      uint32 *index);
+static uint32 FindFree(struct HashMap *map, uint32 hash);
 static Bool CompareKeys(struct HashMap *map, const void *key, const void *compare);
 static Bool NeedsResize(struct HashMap *map);
 static void Resize(struct HashMap *map);
 INLINE void EnsureSanity(HashMap *map);
 
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * GroupMatch --
+ * GroupMatchEmpty --
+ * GroupMatchFree --
+ *
+ *    Compare the HASHMAP_GROUP_SIZE control bytes starting at group with a
+ *    value, with HASHMAP_CTRL_EMPTY, or with any free (empty or deleted)
+ *    control byte.
+ *
+ * Results:
+ *    A mask with bit i set if control byte i matched.
+ *
+ * Side Effects:
+ *    None.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#if defined(HASHMAP_GROUP_SSE2)
+
+static INLINE uint32
+GroupMatch(const uint8 *group,  // IN
+           uint8 ctrl)          // IN
+{
+   __m128i g = _mm_loadu_si128((const __m128i *) group);
+
+   return (uint32) _mm_movemask_epi8(_mm_cmpeq_epi8(g,
+                                                    _mm_set1_epi8(ctrl)));
+}
+
+static INLINE uint32
+GroupMatchFree(const uint8 *group)  // IN
+{
+   return (uint32) _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) group));
+}
+
+#elif defined(HASHMAP_GROUP_NEON)
+
+static INLINE uint32
+GroupMask(uint8x16_t lanes)  // IN: each lane 0x00 or 0xFF
+{
+   static const uint8 bits[HASHMAP_GROUP_SIZE] = {
+      1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128,
+   };
+   uint8x16_t m = vandq_u8(lanes, vld1q_u8(bits));
+
+   return vaddv_u8(vget_low_u8(m)) | ((uint32) vaddv_u8(vget_high_u8(m)) << 8);
+}
+
+static INLINE uint32
+GroupMatch(const uint8 *group,  // IN
+           uint8 ctrl)          // IN
+{
+   return GroupMask(vceqq_u8(vld1q_u8(group), vdupq_n_u8(ctrl)));
+}
+
+static INLINE uint32
+GroupMatchFree(const uint8 *group)  // IN
+{
+   return GroupMask(vtstq_u8(vld1q_u8(group),
+                             vdupq_n_u8(HASHMAP_CTRL_EMPTY)));
+}
+
+#else
+
+static INLINE uint32
+GroupMatch(const uint8 *group,  // IN
+           uint8 ctrl)          // IN
+{
+   uint32 mask = 0;
+   uint32 i;
+
+   for (i = 0; i < HASHMAP_GROUP_SIZE; i++) {
+      mask |= (uint32) (group[i] == ctrl) << i;
+   }
+   return mask;
+}
+
+static INLINE uint32
+GroupMatchFree(const uint8 *group)  // IN
+{
+   uint32 mask = 0;
+   uint32 i;
+
+   for (i = 0; i < HASHMAP_GROUP_SIZE; i++) {
+      mask |= (uint32) (group[i] >> 7) << i;
+   }
+   return mask;
+}
+
+#endif
+
+static INLINE uint32
+GroupMatchEmpty(const uint8 *group)  // IN
+{
+   return GroupMatch(group, HASHMAP_CTRL_EMPTY);
+}
+
+
 /*
  * ----------------------------------------------------------------------------
  *
@@ -165,34 +293,32 @@ INLINE void EnsureSanity(HashMap *map);
 static INLINE Bool
 CheckSanity(HashMap *map)
 {
-   uint32 i, cnt = 0;
+   uint32 i, cnt = 0, del = 0;
 
    ASSERT(map);
+
+   if (!map->numEntries || (map->numEntries & (map->numEntries - 1)) != 0 ||
+       map->numEntries < HASHMAP_GROUP_SIZE) {
+      return FALSE;
+   }
+
    for (i = 0; i < map->numEntries; i++) {
-      HashMapEntryHeader *header = NULL;
-      void *key, *data;
-
-      GetEntry(map, i, &header, &key, &data);
-      ASSERT(header);
-      ASSERT(header->state == HashMapState_FILLED ||
-             header->state == HashMapState_EMPTY ||
-             header->state == HashMapState_DELETED);
-      if (header->state == HashMapState_FILLED) {
+      uint8 ctrl = map->ctrl[i];
+
+      if (i < HASHMAP_GROUP_SIZE && map->ctrl[map->numEntries + i] != ctrl) {
+         return FALSE;
+      }
+      if (ctrl == HASHMAP_CTRL_DELETED) {
+         del++;
+      } else if (ctrl != HASHMAP_CTRL_EMPTY) {
          cnt++;
-         if (header->hash != ComputeHash(map, key)) {
+         if (ctrl != HASHMAP_H2(ComputeHash(map, SlotKey(map, i)))) {
             return FALSE;
          }
       }
    }
 
-   if (cnt != map->count) {
-      return FALSE;
-   }
-
-   if (!map->numEntries) {
-      return FALSE;
-   }
-   return TRUE;
+   return cnt == map->count && del == map->deleted;
 }
 #endif
 
@@ -283,7 +409,7 @@ void
 HashMap_DestroyMap(struct HashMap *map)  // IN
 {
    if (map) {
-      free(map->entries);
+      free(map->ctrl);
    }
    free(map);
 }
@@ -316,6 +442,9 @@ InitMap(struct HashMap *map,     // IN
         size_t keySize,          // IN
         size_t dataSize)         // IN
 {
+   uint32 required;
+   uint32 size = HASHMAP_GROUP_SIZE;
+
    ASSERT(map);
    ASSERT(alpha);
    ASSERT(numEntries);
@@ -324,21 +453,72 @@ InitMap(struct HashMap *map,     // IN
     * Ensure that the entries map is at least large enough to hold all of the
     * entries that were requested taking into account the alpha factor.
     */
-   numEntries *= alpha;
+   Clamped_UMul32(&required, numEntries, alpha);
+   while (size < required && size < HASHMAP_MAX_ENTRIES) {
+      size *= 2;
+   }
 
-   map->numEntries = numEntries;
    map->alpha = alpha;
    map->keySize = keySize;
    map->dataSize = dataSize;
 
    CalculateEntrySize(map);
-   map->entries = calloc(numEntries, map->entrySize);
+   if (!AllocTable(map, size)) {
+      return FALSE;
+   }
+
+   EnsureSanity(map);
+
+   return TRUE;
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * AllocTable --
+ *
+ *    Allocate an empty table of numEntries slots, with their control bytes,
+ *    in a single allocation.
+ *
+ * Results:
+ *    Returns TRUE on success or FALSE if the memory allocation failed, in
+ *    which case the map is unchanged.
+ *
+ * Side Effects:
+ *    Allocates memory.  The previous table, if any, is not freed.
+ *
+ * ----------------------------------------------------------------------------
+ */
 
-   if (map->entries) {
-      EnsureSanity(map);
+static Bool
+AllocTable(struct HashMap *map,  // IN
+           uint32 numEntries)    // IN
+{
+   size_t ctrlSize = ROUNDUP((size_t) numEntries + HASHMAP_GROUP_SIZE, 8);
+   uint8 *table;
+
+   ASSERT((numEntries & (numEntries - 1)) == 0);
+   ASSERT(numEntries >= HASHMAP_GROUP_SIZE);
+
+   if (map->entrySize != 0 &&
+       (~(size_t) 0 - ctrlSize) / map->entrySize < numEntries) {
+      return FALSE;
    }
 
-   return map->entries != NULL;
+   table = malloc(ctrlSize + map->entrySize * numEntries);
+   if (!table) {
+      return FALSE;
+   }
+
+   memset(table, HASHMAP_CTRL_EMPTY, numEntries + HASHMAP_GROUP_SIZE);
+   map->ctrl = table;
+   map->slots = table + ctrlSize;
+   map->numEntries = numEntries;
+   map->count = 0;
+   map->deleted = 0;
+
+   return TRUE;
 }
 
 
@@ -366,41 +546,32 @@ HashMap_Put(struct HashMap *map,    // IN
             const void *key,        // IN
             const void *data)       // IN
 {
-   uint32 freeIndex;
-   HashMapEntryHeader *header;
-   void *tableData;
-
-   if (!LookupKey(map, key, &header, &tableData, &freeIndex)) {
-      uint32 hash = ComputeHash(map, key);
-      void *tableKey;
+   uint32 hash = ComputeHash(map, key);
+   uint32 index;
 
+   if (!LookupKey(map, key, hash, &index)) {
       if (NeedsResize(map)) {
+         /*
+          * If the resize fails, the entry may still fit.
+          */
          Resize(map);
-         if (LookupKey(map, key, &header, &tableData, &freeIndex)) {
-            /*
-             * Somehow our key appeared after resizing the table.
-             */
-            ASSERT(FALSE);
-         }
-         if (freeIndex == NO_FREE_INDEX) {
-            /*
-             * The resize must have failed.
-             */
-            return FALSE;
-         }
       }
 
-      map->count++;
-      GetEntry(map, freeIndex, &header, &tableKey, &tableData);
-      ASSERT(header);
+      index = FindFree(map, hash);
+      if (index == NO_FREE_INDEX) {
+         return FALSE;
+      }
 
-      header->state = HashMapState_FILLED;
-      header->hash = hash;
-      memcpy(tableKey, key, map->keySize);
+      if (map->ctrl[index] == HASHMAP_CTRL_DELETED) {
+         map->deleted--;
+      }
+      SetCtrl(map, index, HASHMAP_H2(hash));
+      map->count++;
+      memcpy(SlotKey(map, index), key, map->keySize);
    }
 
    ASSERT(data || map->dataSize == 0);
-   memcpy(tableData, data, map->dataSize);
+   memcpy(SlotData(map, index), data, map->dataSize);
 
    EnsureSanity(map);
    return TRUE;
@@ -428,12 +599,10 @@ void *
 HashMap_Get(struct HashMap *map,    // IN
             const void *key)        // IN
 {
-   void *data;
-   uint32 freeIndex;
-   HashMapEntryHeader *header;
+   uint32 index;
 
-   if (LookupKey(map, key, &header, &data, &freeIndex)) {
-      return data;
+   if (LookupKey(map, key, ComputeHash(map, key), &index)) {
+      return SlotData(map, index);
    }
 
    return NULL;
@@ -459,17 +628,11 @@ HashMap_Get(struct HashMap *map,    // IN
 void
 HashMap_Clear(struct HashMap *map) // IN
 {
-   int i = 0;
-   HashMapEntryHeader *header;
-   void *key, *data;
-
    ASSERT(map);
-   for (i = 0; i < map->numEntries; i++) {
-      GetEntry(map, i, &header, &key, &data);
-      ASSERT(header);
-      header->state = HashMapState_EMPTY;
-   }
+
+   memset(map->ctrl, HASHMAP_CTRL_EMPTY, map->numEntries + HASHMAP_GROUP_SIZE);
    map->count = 0;
+   map->deleted = 0;
    EnsureSanity(map);
 }
 
@@ -495,20 +658,19 @@ Bool
 HashMap_Remove(struct HashMap *map,   // IN
                const void *key)       // IN
 {
-   uint32 freeIndex;
-   HashMapEntryHeader *header;
-   void *tableData;
+   uint32 index;
 
-   if (!LookupKey(map, key, &header, &tableData, &freeIndex)) {
+   if (!LookupKey(map, key, ComputeHash(map, key), &index)) {
       return FALSE;
    }
 
    /*
-    * XXX: This could be made slightly smarter.  We could check the next entry
-    * to see if it's EMPTY and then mark this one as empty as well.
+    * The slot may be in the middle of another key's probe sequence, so it is
+    * marked deleted rather than empty.  Resize drops deleted slots.
     */
    map->count--;
-   header->state = HashMapState_DELETED;
+   map->deleted++;
+   SetCtrl(map, index, HASHMAP_CTRL_DELETED);
 
    EnsureSanity(map);
 
@@ -544,7 +706,9 @@ HashMap_Count(struct HashMap *map) // IN
  *
  * CalculateEntrySize --
  *
- *    Calculate the size of the entry and the offsets to the key and data.
+ *    Calculate the size of a key/value slot and the offset to the data.  Keys
+ *    and data are 8-byte aligned so that pointers and 64-bit values stored in
+ *    the map can be accessed in place.
  *
  * Results:
  *    None.
@@ -558,20 +722,78 @@ HashMap_Count(struct HashMap *map) // IN
 void
 CalculateEntrySize(struct HashMap *map) // IN
 {
-   size_t alignKeySize, alignDataSize;
-   size_t alignKeyOffset, alignDataOffset;
-
    ASSERT(map);
 
-   alignKeySize = ROUNDUP(map->keySize, 4);
-   alignDataSize = ROUNDUP(map->dataSize, 4);
+   map->dataOffset = ROUNDUP(map->keySize, 8);
+   map->entrySize = map->dataOffset + ROUNDUP(map->dataSize, 8);
+}
 
-   alignKeyOffset = sizeof (HashMapEntryHeader);
-   alignDataOffset = ROUNDUP(alignKeyOffset + alignKeySize, 4);
 
-   map->entrySize = sizeof (HashMapEntryHeader) + alignKeySize + alignDataSize;
-   map->keyOffset = alignKeyOffset;
-   map->dataOffset = alignDataOffset;
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * SetCtrl --
+ *
+ *    Set the control byte of a slot, and its mirror past the end of the
+ *    control array for the first HASHMAP_GROUP_SIZE slots.
+ *
+ * Results:
+ *    None.
+ *
+ * Side Effects:
+ *    None.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+void
+SetCtrl(struct HashMap *map,  // IN
+        uint32 index,         // IN
+        uint8 ctrl)           // IN
+{
+   ASSERT(index < map->numEntries);
+
+   map->ctrl[index] = ctrl;
+   if (index < HASHMAP_GROUP_SIZE) {
+      map->ctrl[map->numEntries + index] = ctrl;
+   }
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * SlotKey --
+ * SlotData --
+ *
+ *    Get a specific slot's key or data.  This does not perform any hash
+ *    compare, it's a simple index based lookup.
+ *
+ * Results:
+ *    Direct pointers into the table.
+ *
+ * Side Effects:
+ *    None.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+void *
+SlotKey(const struct HashMap *map,  // IN
+        uint32 index)               // IN
+{
+   ASSERT(index < map->numEntries);
+
+   return map->slots + map->entrySize * index;
+}
+
+void *
+SlotData(const struct HashMap *map,  // IN
+         uint32 index)               // IN
+{
+   ASSERT(index < map->numEntries);
+
+   return map->slots + map->entrySize * index + map->dataOffset;
 }
 
 
@@ -580,121 +802,103 @@ CalculateEntrySize(struct HashMap *map) // IN
  *
  * LookupKey --
  *
- *    Use linear probing to find a free space in the table or the data that
- *    we're interested in.
+ *    Probe the table for the key, one group of control bytes at a time.
+ *    Only slots whose control byte matches the key's hash bits have their
+ *    keys compared; the search ends at the first group with an empty slot.
  *
  * Returns:
- *    - TRUE if the key was found in the table, FALSE otherwise.
- *    - Returns the entry header on header, data pointer on data and the first
- *    non-filled index that was encountered on freeIndex
+ *    TRUE if the key was found in the table, FALSE otherwise.
  *
  * Side Effects:
- *    - Header and Data are changed.  They should only be considered valid if
- *    the key was found.
- *    - FreeIndex will be updated to point to the first non-filled index.
+ *    The slot of the key is returned in index if found.
  *
  * ----------------------------------------------------------------------------
  */
 
 Bool
-LookupKey(struct HashMap* map,          // IN
-          const void *key,              // IN
-          HashMapEntryHeader **header,  // OUT
-          void **data,                  // OUT
-          uint32 *freeIndex)            // OUT
+LookupKey(struct HashMap *map,  // IN
+          const void *key,      // IN
+          uint32 hash,          // IN
+          uint32 *index)        // OUT
 {
-   uint32 hash = ComputeHash(map, key);
-   uint32 index = hash % map->numEntries;
-   uint32 probe = 0;
-
-   Bool done = FALSE, found = FALSE;
-   void *tableKey;
+   uint32 mask = map->numEntries - 1;
+   uint32 pos = HASHMAP_H1(hash) & mask;
+   uint32 stride = 0;
+   uint8 h2 = HASHMAP_H2(hash);
 
    ASSERT(map);
    ASSERT(key);
-   ASSERT(data);
-   ASSERT(freeIndex);
-
-   *freeIndex = NO_FREE_INDEX;
+   ASSERT(index);
 
-   while (!done && probe < map->numEntries + 1) {
-      uint32 currentIndex = (index + probe) % map->numEntries;
+   for (;;) {
+      const uint8 *group = map->ctrl + pos;
+      uint32 bits = GroupMatch(group, h2);
 
-      GetEntry(map, currentIndex, header, &tableKey, data);
-      ASSERT(header);
+      while (bits) {
+         uint32 i = (pos + lssb32_0(bits)) & mask;
 
-      switch ((*header)->state) {
-      case HashMapState_EMPTY:
-         done = TRUE;
-         /* FALL THROUGH */
-      case HashMapState_DELETED:
-         /*
-          * We're not done if we've found a deleted space.  This may just mean
-          * that the entry was deleted but that the target entry may appear
-          * later.
-          */
-         if (*freeIndex == NO_FREE_INDEX) {
-            *freeIndex = currentIndex;
+         if (CompareKeys(map, key, SlotKey(map, i))) {
+            *index = i;
+            return TRUE;
          }
-         break;
-      case HashMapState_FILLED:
-         if ((*header)->hash == hash) {
-            found = CompareKeys(map, key, tableKey);
-            if (found) {
-               done = TRUE;
-            }
-         }
-         break;
-      default:
-         NOT_REACHED();
+         bits &= bits - 1;
       }
-      probe++;
-   }
 
-   ASSERT(found || *freeIndex != NO_FREE_INDEX || map->count == map->numEntries);
+      if (GroupMatchEmpty(group)) {
+         return FALSE;
+      }
 
-   return found;
+      /*
+       * Triangular probing visits every group once the stride reaches the
+       * table size.
+       */
+      stride += HASHMAP_GROUP_SIZE;
+      if (stride >= map->numEntries) {
+         return FALSE;
+      }
+      pos = (pos + stride) & mask;
+   }
 }
 
 
 /*
  * ----------------------------------------------------------------------------
  *
- * GetEntry --
+ * FindFree --
  *
- *    Get a specific entry from the entries list.  This does not perform any
- *    hash compare, it's a simple index based lookup.
+ *    Find the first free (empty or deleted) slot in the probe sequence of a
+ *    hash value.
  *
- * Results:
- *    The header is stored in header, key in key and the data in data.  These
- *    are all direct pointers into the table.
+ * Returns:
+ *    The slot index, or NO_FREE_INDEX if the table is full.
  *
  * Side Effects:
- *    The header, key and data pointers are modified.
+ *    None.
  *
  * ----------------------------------------------------------------------------
  */
 
-void
-GetEntry(struct HashMap *map,          // IN
-         uint32 index,                 // IN
-         HashMapEntryHeader **header,  // OUT
-         void **key,                   // OUT
-         void **data)                  // OUT
+uint32
+FindFree(struct HashMap *map,  // IN
+         uint32 hash)          // IN
 {
-   uint8 *entry;
+   uint32 mask = map->numEntries - 1;
+   uint32 pos = HASHMAP_H1(hash) & mask;
+   uint32 stride = 0;
 
-   ASSERT(map);
-   ASSERT(header);
-   ASSERT(key);
-   ASSERT(data);
-   ASSERT(index < map->numEntries);
+   for (;;) {
+      uint32 bits = GroupMatchFree(map->ctrl + pos);
 
-   entry = ((uint8 *)map->entries) + (map->entrySize * index);
-   ASSERT(entry);
-   *header = (HashMapEntryHeader *) (entry);
-   *key = (void*) (entry + map->keyOffset);
-   *data = (void*) (entry + map->dataOffset);
+      if (bits) {
+         return (pos + lssb32_0(bits)) & mask;
+      }
+
+      stride += HASHMAP_GROUP_SIZE;
+      if (stride >= map->numEntries) {
+         return NO_FREE_INDEX;
+      }
+      pos = (pos + stride) & mask;
+   }
 }
 
 
@@ -723,9 +927,9 @@ ComputeHash(struct HashMap *map,  // IN
     * djb2, with n == 33. See http://www.cse.yorku.ca/~oz/hash.html.
     *
     * This hash function is largely borrowed from the emmet library in bora/lib
-    * This hash table implementation does a hash compare before comparing the
-    * keys so it's inappropriate for the hash function to take the modulo before
-    * returning.
+    * The result is then mixed (murmur3 finalizer) since the low 7 bits
+    * select the control byte and the others the starting group; small
+    * integer keys would otherwise cluster.
     */
    uint32 h = 5381;
    const uint8 *keyByte;
@@ -735,6 +939,13 @@ ComputeHash(struct HashMap *map,  // IN
       h *= 33;
       h += *keyByte;
    }
+
+   h ^= h >> 16;
+   h *= 0x85EBCA6B;
+   h ^= h >> 13;
+   h *= 0xC2B2AE35;
+   h ^= h >> 16;
+
    return h;
 }
 
@@ -772,7 +983,8 @@ CompareKeys(struct HashMap *map,    // IN
  *
  *    Determine if adding another element to the map will require that the map
  *    be resized.  This takes into account the maximum load factor that is
- *    allowed for this map.
+ *    allowed for this map.  Deleted slots count against the load factor as
+ *    they lengthen probe sequences just like filled ones.
  *
  * Results:
  *    Returns TRUE if the map should be resized.
@@ -788,9 +1000,9 @@ NeedsResize(struct HashMap *map)
 {
    uint32 required;
 
-   Clamped_UMul32(&required, map->count, map->alpha);
+   Clamped_UMul32(&required, map->count + map->deleted + 1, map->alpha);
 
-   return required >= map->numEntries;
+   return required > map->numEntries;
 }
 
 /*
@@ -798,17 +1010,18 @@ NeedsResize(struct HashMap *map)
  *
  * Resize --
  *
- *    Doubles the size of the entries array until it is at least large enough
- *    to ensure the maximum load factor is not exceeded.
+ *    Rebuilds the table, dropping deleted slots.  The table is doubled in
+ *    size until the filled slots take at most half of the maximum load
+ *    factor, so a table that is mostly deleted slots keeps its size.
  *
  * Results:
  *    None.
  *
  * Side Effects:
- *    The entries list is doubled in size and the entries are copied into the
- *    appropriate location.  Callers should not assume that the locations that
- *    were valid before this was called are still valid as all entries may
- *    appear at different locations after this function completes.
+ *    The entries are copied into a new table.  Callers should not assume
+ *    that the locations that were valid before this was called are still
+ *    valid as all entries may appear at different locations after this
+ *    function completes.  If the allocation fails the map is unchanged.
  *
  * ----------------------------------------------------------------------------
  */
@@ -817,82 +1030,49 @@ void
 Resize(struct HashMap *map)   // IN
 {
    struct HashMap oldHashMap = *map;
-   int i;
+   uint32 required;
+   uint32 size = map->numEntries;
+   uint32 i;
 
-   if (map->numEntries == MAX_UINT32) {
-      if (map->count < MAX_UINT32) {
-         /*
-          * We're already at the maximum size of the array and there's still
-          * room for the new entry, don't bother resizing.
-          */
-         return;
-      } else {
-         /*
-          * This situation is fatal, though we're unlikely to ever hit this with
-          * realistic usage.
-          */
-         Panic("Ran out of room in the hashtable\n");
-      }
+   Clamped_UMul32(&required, map->count + 1, map->alpha);
+   Clamped_UMul32(&required, required, 2);
+   while (size < required && size < HASHMAP_MAX_ENTRIES) {
+      size *= 2;
    }
 
-   /*
-    * We might, at some point, want to look at making this grow geometrically
-    * until we hit some threshold and then grow arithmetically after that.  To
-    * keep it simple for now, however, we'll just grow geometrically all the
-    * time.
-    */
-   map->entries = calloc(oldHashMap.numEntries * 2, oldHashMap.entrySize);
-   if (!map->entries) {
-      map->entries = oldHashMap.entries;
+   if (size == map->numEntries && map->deleted == 0) {
+      /*
+       * We're already at the maximum size of the array; the entry still goes
+       * in if there is a free slot left.
+       */
       return;
    }
 
-   do {
-      if (!Clamped_UMul32(&map->numEntries, map->numEntries, 2)) {
-         /* Prevent overflow and */
-         break;
-      }
-   } while (NeedsResize(map));
-
-   map->count = 0;
+   if (!AllocTable(map, size)) {
+      *map = oldHashMap;
+      return;
+   }
 
    for (i = 0; i < oldHashMap.numEntries; i++) {
-      HashMapEntryHeader *oldHeader;
-      HashMapEntryHeader *newHeader;
+      uint8 ctrl = oldHashMap.ctrl[i];
       void *oldKey;
-      void *oldData;
-      void *newKey;
-      void *newData;
-      uint32 freeIndex;
-
-      GetEntry(&oldHashMap, i, &oldHeader, &oldKey, &oldData);
-      switch (oldHeader->state) {
-      case HashMapState_EMPTY:
-      case HashMapState_DELETED:
-         continue;
-      case HashMapState_FILLED:
-         if (!LookupKey(map, oldKey, &newHeader, &newData, &freeIndex)) {
-            GetEntry(map, freeIndex, &newHeader, &newKey, &newData);
-
-            newHeader->hash = oldHeader->hash;
-            newHeader->state = HashMapState_FILLED;
-            memcpy(newKey, oldKey, map->keySize);
-            memcpy(newData, oldData, map->dataSize);
-
-            map->count++;
-         } else {
-            /*
-             * There is only one way that this could happen; the key is in the
-             * old map twice.  That's clearly an error.
-             */
-            ASSERT(FALSE);
-            continue;
-         }
+      uint32 index;
+
+      if (ctrl & HASHMAP_CTRL_EMPTY) {
+         continue;  // Empty or deleted
       }
+
+      oldKey = SlotKey(&oldHashMap, i);
+      index = FindFree(map, ComputeHash(map, oldKey));
+      ASSERT(index != NO_FREE_INDEX);
+
+      SetCtrl(map, index, ctrl);
+      memcpy(SlotKey(map, index), oldKey, map->entrySize);
+      map->count++;
    }
 
    ASSERT(oldHashMap.count == map->count);
-   free(oldHashMap.entries);
+   free(oldHashMap.ctrl);
    EnsureSanity(map);
 }
 
@@ -922,27 +1102,20 @@ HashMap_Iterate(HashMap *map,             // IN
                 Bool clear,               // IN
                 void *userData)           // IN/OUT
 {
-   int i = 0;
-   HashMapEntryHeader *header;
-   void *key, *data;
+   uint32 i;
 
    ASSERT(map);
    ASSERT(itFn);
 
    for (i = 0; i < map->numEntries; i++) {
-      GetEntry(map, i, &header, &key, &data);
-      if (header->state == HashMapState_FILLED) {
-         itFn(key, data, userData);
-         if (clear) {
-            map->count--;
-         }
-      }
-      if (clear) {
-         header->state = HashMapState_EMPTY;
+      if ((map->ctrl[i] & HASHMAP_CTRL_EMPTY) == 0) {
+         itFn(SlotKey(map, i), SlotData(map, i), userData);
       }
    }
 
-   ASSERT(map->count == 0 || !clear);
+   if (clear) {
+      HashMap_Clear(map);
+   }
 }
 
 
@@ -951,10 +1124,10 @@ HashMap_Iterate(HashMap *map,             // IN
  *
  * EnsureSanity --
  *
- *    Ensure that the HashMap contents are still sane.  That is, each entry has
- *    a correctly computed hash, the count is correct and the header states are
- *    valid for all entries.  This should be called at the end of every
- *    function which modifies the map.
+ *    Ensure that the HashMap contents are still sane.  That is, each filled
+ *    slot's control byte matches its key's hash, the mirrored control bytes
+ *    are in sync and the filled and deleted counts are correct.  This should
+ *    be called at the end of every function which modifies the map.
  *
  * Results:
  *    None.
@@ -970,6 +1143,3 @@ EnsureSanity(HashMap *map)
 {
    ASSERT(CheckSanity(map) == TRUE);
 }
-
-
-
@@ -0,0 +1,1155 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsDirNotifyLinux.c --
+ *
+ *	Directory change notification for the Linux HGFS server, using inotify.
+ *
+ *	Subscribers watching the same directory share a single inotify watch.
+ *	A reader thread drains the inotify descriptor into a bounded event
+ *	queue, where repeated identical events are coalesced, and dispatches
+ *	the queued events to the matching subscribers. When the queue is full
+ *	or the kernel queue overflows, every subscriber is sent a single
+ *	HGFS_NOTIFY_EVENTS_DROPPED event instead.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <glib.h>
+
+#include "vmware.h"
+#include "vm_basic_types.h"
+#include "vm_atomic.h"
+#include "dbllnklst.h"
+#include "userlock.h"
+#include "mutexRankLib.h"
+#include "str.h"
+#include "util.h"
+
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsUtil.h"
+#include "hgfsDirNotify.h"
+
+#define LOGLEVEL_MODULE hgfs
+#include "loglevel_user.h"
+
+
+/* Maximum number of distinct events held between two dispatches. */
+#define HGFS_NOTIFY_QUEUE_MAX          256
+
+/* Size of the buffer the reader thread drains the inotify descriptor with. */
+#define HGFS_NOTIFY_READ_BUF_SIZE      (16 * (sizeof (struct inotify_event) + NAME_MAX + 1))
+
+/* Events every subscriber gets regardless of its filter. */
+#define HGFS_NOTIFY_INOTIFY_ALWAYS     (IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct HgfsNotifyShare {
+   DblLnkLst_Links links;
+   HgfsSharedFolderHandle handle;
+   char *path;                         /* Share root in the local file system. */
+} HgfsNotifyShare;
+
+typedef struct HgfsNotifyWatch {
+   DblLnkLst_Links links;
+   int wd;                             /* inotify watch descriptor. */
+   uint32 refCount;                    /* Subscribers sharing the watch. */
+} HgfsNotifyWatch;
+
+typedef struct HgfsNotifySubscriber {
+   DblLnkLst_Links links;
+   HgfsSubscriberHandle handle;
+   HgfsSharedFolderHandle sharedFolder;
+   char *path;                         /* Directory relative to the share root. */
+   uint32 eventFilter;                 /* HGFS_NOTIFY_* events requested. */
+   int wd;
+   HgfsNotifyEventReceiveCb *eventCb;
+   struct HgfsSessionInfo *session;
+} HgfsNotifySubscriber;
+
+typedef struct HgfsNotifyEvent {
+   int wd;
+   uint32 mask;                        /* inotify event mask. */
+   char name[NAME_MAX + 1];
+} HgfsNotifyEvent;
+
+/* A queued event resolved to one subscriber, ready for the callback. */
+typedef struct HgfsNotifyDelivery {
+   HgfsSharedFolderHandle sharedFolder;
+   HgfsSubscriberHandle subscriber;
+   char *name;
+   uint32 mask;
+   HgfsNotifyEventReceiveCb *eventCb;
+   struct HgfsSessionInfo *session;
+} HgfsNotifyDelivery;
+
+typedef struct HgfsNotifyState {
+   /* Protects the lists, the queue and the activation state. */
+   MXUserExclLock *lock;
+
+   /*
+    * Held while callbacks run so that removing subscribers waits for
+    * in-flight events. Never acquired while holding lock.
+    */
+   MXUserExclLock *dispatchLock;
+
+   DblLnkLst_Links shares;
+   DblLnkLst_Links watches;
+   DblLnkLst_Links subscribers;
+   HgfsSharedFolderHandle nextShareHandle;
+   HgfsSubscriberHandle nextSubscriberHandle;
+
+   HgfsNotifyEvent queue[HGFS_NOTIFY_QUEUE_MAX];
+   uint32 queueCount;
+   Bool queueOverflow;
+
+   uint32 deactivateCount;             /* Server sync deactivations. */
+
+   int inotifyFd;
+   int exitPipe[2];
+   GThread *thread;
+} HgfsNotifyState;
+
+static HgfsNotifyState *gNotify = NULL;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFilter2Inotify --
+ *
+ *    Convert HGFS notification events to the inotify events producing them.
+ *
+ * Results:
+ *    inotify event mask.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNotifyFilter2Inotify(uint32 eventFilter)  // IN: HGFS_NOTIFY_* events
+{
+   uint32 mask = HGFS_NOTIFY_INOTIFY_ALWAYS;
+
+   if (eventFilter & HGFS_NOTIFY_ACCESS) {
+      mask |= IN_ACCESS;
+   }
+   if (eventFilter & (HGFS_NOTIFY_ATTRIB | HGFS_NOTIFY_ATIME | HGFS_NOTIFY_CTIME |
+                      HGFS_NOTIFY_CHANGE_EA | HGFS_NOTIFY_CHANGE_SECURITY)) {
+      mask |= IN_ATTRIB;
+   }
+   if (eventFilter & (HGFS_NOTIFY_SIZE | HGFS_NOTIFY_MTIME | HGFS_NOTIFY_MODIFY)) {
+      mask |= IN_MODIFY;
+   }
+   if (eventFilter & HGFS_NOTIFY_OPEN) {
+      mask |= IN_OPEN;
+   }
+   if (eventFilter & HGFS_NOTIFY_CLOSE_WRITE) {
+      mask |= IN_CLOSE_WRITE;
+   }
+   if (eventFilter & HGFS_NOTIFY_CLOSE_NOWRITE) {
+      mask |= IN_CLOSE_NOWRITE;
+   }
+   if (eventFilter & (HGFS_NOTIFY_CREATE_FILE | HGFS_NOTIFY_CREATE_DIR)) {
+      mask |= IN_CREATE;
+   }
+   if (eventFilter & (HGFS_NOTIFY_DELETE_FILE | HGFS_NOTIFY_DELETE_DIR)) {
+      mask |= IN_DELETE;
+   }
+   if (eventFilter & (HGFS_NOTIFY_NAME | HGFS_NOTIFY_OLD_FILE_NAME |
+                      HGFS_NOTIFY_OLD_DIR_NAME)) {
+      mask |= IN_MOVED_FROM;
+   }
+   if (eventFilter & (HGFS_NOTIFY_NAME | HGFS_NOTIFY_NEW_FILE_NAME |
+                      HGFS_NOTIFY_NEW_DIR_NAME)) {
+      mask |= IN_MOVED_TO;
+   }
+
+   return mask;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyInotify2Events --
+ *
+ *    Convert an inotify event mask to HGFS notification events.
+ *
+ * Results:
+ *    HGFS_NOTIFY_* event mask.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNotifyInotify2Events(uint32 mask)  // IN: inotify event mask
+{
+   Bool isDir = (mask & IN_ISDIR) != 0;
+   uint32 events = 0;
+
+   if (mask & IN_ACCESS) {
+      events |= HGFS_NOTIFY_ACCESS;
+   }
+   if (mask & IN_ATTRIB) {
+      events |= HGFS_NOTIFY_ATTRIB;
+   }
+   if (mask & IN_MODIFY) {
+      events |= HGFS_NOTIFY_MODIFY | HGFS_NOTIFY_SIZE | HGFS_NOTIFY_MTIME;
+   }
+   if (mask & IN_OPEN) {
+      events |= HGFS_NOTIFY_OPEN;
+   }
+   if (mask & IN_CLOSE_WRITE) {
+      events |= HGFS_NOTIFY_CLOSE_WRITE;
+   }
+   if (mask & IN_CLOSE_NOWRITE) {
+      events |= HGFS_NOTIFY_CLOSE_NOWRITE;
+   }
+   if (mask & IN_CREATE) {
+      events |= isDir ? HGFS_NOTIFY_CREATE_DIR : HGFS_NOTIFY_CREATE_FILE;
+   }
+   if (mask & IN_DELETE) {
+      events |= isDir ? HGFS_NOTIFY_DELETE_DIR : HGFS_NOTIFY_DELETE_FILE;
+   }
+   if (mask & IN_MOVED_FROM) {
+      events |= isDir ? HGFS_NOTIFY_OLD_DIR_NAME : HGFS_NOTIFY_OLD_FILE_NAME;
+   }
+   if (mask & IN_MOVED_TO) {
+      events |= isDir ? HGFS_NOTIFY_NEW_DIR_NAME : HGFS_NOTIFY_NEW_FILE_NAME;
+   }
+   if (mask & IN_DELETE_SELF) {
+      events |= HGFS_NOTIFY_DELETE_SELF;
+   }
+   if (mask & IN_MOVE_SELF) {
+      events |= HGFS_NOTIFY_MOVE_SELF;
+   }
+   if (mask & IN_IGNORED) {
+      events |= HGFS_NOTIFY_WATCH_DELETED;
+   }
+
+   return events;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFindShare --
+ *
+ *    Find a shared folder by handle. Caller holds the state lock.
+ *
+ * Results:
+ *    The shared folder or NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsNotifyShare *
+HgfsNotifyFindShare(HgfsSharedFolderHandle sharedFolder)  // IN: share handle
+{
+   DblLnkLst_Links *link;
+
+   DblLnkLst_ForEach(link, &gNotify->shares) {
+      HgfsNotifyShare *share = DblLnkLst_Container(link, HgfsNotifyShare, links);
+
+      if (share->handle == sharedFolder) {
+         return share;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyGetWatch --
+ *
+ *    Take a reference on the inotify watch for a directory, adding the
+ *    events to it. Subscribers of the same directory share one watch.
+ *    Caller holds the state lock.
+ *
+ * Results:
+ *    The watch descriptor, or -1 on failure.
+ *
+ * Side effects:
+ *    May add an inotify watch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsNotifyGetWatch(const char *path,    // IN: local directory path
+                   uint32 mask)         // IN: inotify events
+{
+   DblLnkLst_Links *link;
+   HgfsNotifyWatch *watch;
+   int wd;
+
+   wd = inotify_add_watch(gNotify->inotifyFd, path, mask | IN_MASK_ADD | IN_ONLYDIR);
+   if (wd < 0) {
+      LOG(4, ("%s: failed to watch %s: %s\n", __FUNCTION__, path, strerror(errno)));
+      return -1;
+   }
+
+   DblLnkLst_ForEach(link, &gNotify->watches) {
+      watch = DblLnkLst_Container(link, HgfsNotifyWatch, links);
+      if (watch->wd == wd) {
+         watch->refCount++;
+         return wd;
+      }
+   }
+
+   watch = Util_SafeMalloc(sizeof *watch);
+   DblLnkLst_Init(&watch->links);
+   watch->wd = wd;
+   watch->refCount = 1;
+   DblLnkLst_LinkLast(&gNotify->watches, &watch->links);
+
+   return wd;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyPutWatch --
+ *
+ *    Drop a reference on an inotify watch, removing the watch with the last
+ *    one. Caller holds the state lock.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    May remove an inotify watch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyPutWatch(int wd)  // IN: watch descriptor
+{
+   DblLnkLst_Links *link;
+
+   DblLnkLst_ForEach(link, &gNotify->watches) {
+      HgfsNotifyWatch *watch = DblLnkLst_Container(link, HgfsNotifyWatch, links);
+
+      if (watch->wd == wd) {
+         if (--watch->refCount == 0) {
+            /* Fails harmlessly if the kernel already dropped the watch. */
+            inotify_rm_watch(gNotify->inotifyFd, wd);
+            DblLnkLst_Unlink1(&watch->links);
+            free(watch);
+         }
+         return;
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyDestroySubscriber --
+ *
+ *    Unlink and free a subscriber. Caller holds the state lock.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    May remove an inotify watch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyDestroySubscriber(HgfsNotifySubscriber *subscriber)  // IN: subscriber
+{
+   DblLnkLst_Unlink1(&subscriber->links);
+   HgfsNotifyPutWatch(subscriber->wd);
+   free(subscriber->path);
+   free(subscriber);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyQueueEvent --
+ *
+ *    Queue an inotify event for dispatch. An event is coalesced only into
+ *    the latest queued event for the same entry, and only when that one is
+ *    identical, so repeated modifications collapse while the order of
+ *    different events on the entry (e.g. create, delete, create) is kept.
+ *    Caller holds the state lock.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Marks the queue as overflowed when it is full.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyQueueEvent(const struct inotify_event *event)  // IN: inotify event
+{
+   const char *name = event->len > 0 ? event->name : "";
+   HgfsNotifyEvent *queued;
+   uint32 i;
+
+   if (event->mask & IN_Q_OVERFLOW) {
+      gNotify->queueOverflow = TRUE;
+      return;
+   }
+
+   for (i = gNotify->queueCount; i > 0; i--) {
+      queued = &gNotify->queue[i - 1];
+      if (queued->wd == event->wd && strcmp(queued->name, name) == 0) {
+         if (queued->mask == event->mask) {
+            return;
+         }
+         break;
+      }
+   }
+
+   if (gNotify->queueCount == ARRAYSIZE(gNotify->queue)) {
+      gNotify->queueOverflow = TRUE;
+      return;
+   }
+
+   queued = &gNotify->queue[gNotify->queueCount++];
+   queued->wd = event->wd;
+   queued->mask = event->mask;
+   Str_Strcpy(queued->name, name, sizeof queued->name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyBuildName --
+ *
+ *    Build the share relative name reported for an event.
+ *
+ * Results:
+ *    Allocated name.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+HgfsNotifyBuildName(const char *dirPath,   // IN: directory relative to share
+                    const char *name)      // IN: entry name, may be empty
+{
+   if (*name == '\0') {
+      return Util_SafeStrdup(dirPath);
+   }
+   if (*dirPath == '\0') {
+      return Util_SafeStrdup(name);
+   }
+   return Str_SafeAsprintf(NULL, "%s%c%s", dirPath, DIRSEPC, name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyCollectDeliveries --
+ *
+ *    Resolve the queued events to subscriber deliveries and empty the queue.
+ *    Caller holds the state lock.
+ *
+ * Results:
+ *    Array of deliveries, which the caller frees, and its size.
+ *
+ * Side effects:
+ *    Subscribers whose watch the kernel removed are dropped.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsNotifyDelivery *
+HgfsNotifyCollectDeliveries(uint32 *count)  // OUT: number of deliveries
+{
+   HgfsNotifyDelivery *deliveries = NULL;
+   uint32 used = 0;
+   uint32 size = 0;
+   DblLnkLst_Links *link;
+   DblLnkLst_Links *nextLink;
+   uint32 i;
+
+   if (gNotify->deactivateCount > 0) {
+      /* Suspended for a server sync, the events are lost. */
+      gNotify->queueCount = 0;
+      gNotify->queueOverflow = FALSE;
+      *count = 0;
+      return NULL;
+   }
+
+   for (i = 0; i <= gNotify->queueCount; i++) {
+      HgfsNotifyEvent *event = NULL;
+      uint32 events;
+
+      if (i < gNotify->queueCount) {
+         event = &gNotify->queue[i];
+         events = HgfsNotifyInotify2Events(event->mask);
+      } else if (gNotify->queueOverflow) {
+         events = HGFS_NOTIFY_EVENTS_DROPPED;
+      } else {
+         break;
+      }
+
+      DblLnkLst_ForEachSafe(link, nextLink, &gNotify->subscribers) {
+         HgfsNotifySubscriber *subscriber =
+            DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+         uint32 mask;
+
+         if (event != NULL && event->wd != subscriber->wd) {
+            continue;
+         }
+
+         mask = events & (subscriber->eventFilter | HGFS_NOTIFY_DELETE_SELF |
+                          HGFS_NOTIFY_MOVE_SELF | HGFS_NOTIFY_WATCH_DELETED |
+                          HGFS_NOTIFY_EVENTS_DROPPED);
+         if (mask == 0) {
+            continue;
+         }
+
+         if (used == size) {
+            size = size == 0 ? 16 : size * 2;
+            deliveries = Util_SafeRealloc(deliveries, size * sizeof *deliveries);
+         }
+         deliveries[used].sharedFolder = subscriber->sharedFolder;
+         deliveries[used].subscriber = subscriber->handle;
+         deliveries[used].name = HgfsNotifyBuildName(subscriber->path,
+                                                     event != NULL ? event->name : "");
+         deliveries[used].mask = mask;
+         deliveries[used].eventCb = subscriber->eventCb;
+         deliveries[used].session = subscriber->session;
+         used++;
+
+         if (event != NULL && (event->mask & IN_IGNORED)) {
+            /* The kernel removed the watch, nothing more will come. */
+            HgfsNotifyDestroySubscriber(subscriber);
+         }
+      }
+   }
+
+   gNotify->queueCount = 0;
+   gNotify->queueOverflow = FALSE;
+
+   *count = used;
+   return deliveries;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyDispatch --
+ *
+ *    Deliver the queued events to the subscribers.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Subscriber callbacks are invoked.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyDispatch(void)
+{
+   HgfsNotifyDelivery *deliveries;
+   uint32 count;
+   uint32 i;
+
+   MXUser_AcquireExclLock(gNotify->dispatchLock);
+
+   MXUser_AcquireExclLock(gNotify->lock);
+   deliveries = HgfsNotifyCollectDeliveries(&count);
+   MXUser_ReleaseExclLock(gNotify->lock);
+
+   for (i = 0; i < count; i++) {
+      deliveries[i].eventCb(deliveries[i].sharedFolder, deliveries[i].subscriber,
+                            deliveries[i].name, deliveries[i].mask,
+                            deliveries[i].session);
+      free(deliveries[i].name);
+   }
+
+   MXUser_ReleaseExclLock(gNotify->dispatchLock);
+
+   free(deliveries);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyThread --
+ *
+ *    Reader thread: drains the inotify descriptor into the event queue and
+ *    dispatches the queue after each read.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    Subscriber callbacks are invoked from this thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gpointer
+HgfsNotifyThread(gpointer data)  // IN: unused
+{
+   char *buf = Util_SafeMalloc(HGFS_NOTIFY_READ_BUF_SIZE);
+
+   for (;;) {
+      struct pollfd fds[2];
+      ssize_t bytes;
+      ssize_t offset;
+
+      fds[0].fd = gNotify->inotifyFd;
+      fds[0].events = POLLIN;
+      fds[1].fd = gNotify->exitPipe[0];
+      fds[1].events = POLLIN;
+
+      if (poll(fds, ARRAYSIZE(fds), -1) < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         LOG(4, ("%s: poll failed: %s\n", __FUNCTION__, strerror(errno)));
+         break;
+      }
+
+      if (fds[1].revents != 0) {
+         break;
+      }
+
+      bytes = read(gNotify->inotifyFd, buf, HGFS_NOTIFY_READ_BUF_SIZE);
+      if (bytes <= 0) {
+         if (bytes < 0 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+         }
+         LOG(4, ("%s: read failed: %s\n", __FUNCTION__, strerror(errno)));
+         break;
+      }
+
+      MXUser_AcquireExclLock(gNotify->lock);
+      for (offset = 0; offset < bytes; ) {
+         const struct inotify_event *event =
+            (const struct inotify_event *)(buf + offset);
+
+         HgfsNotifyQueueEvent(event);
+         offset += sizeof *event + event->len;
+      }
+      MXUser_ReleaseExclLock(gNotify->lock);
+
+      HgfsNotifyDispatch();
+   }
+
+   free(buf);
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Init --
+ *
+ *    Initialization for the notification component.
+ *
+ * Results:
+ *    HGFS_STATUS_SUCCESS, or an error if inotify is not available.
+ *
+ * Side effects:
+ *    Starts the notification reader thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsNotify_Init(void)
+{
+   HgfsNotifyState *state;
+   GError *err = NULL;
+   HgfsInternalStatus status;
+
+   ASSERT(gNotify == NULL);
+
+   state = Util_SafeCalloc(1, sizeof *state);
+   state->exitPipe[0] = -1;
+   state->exitPipe[1] = -1;
+   state->inotifyFd = inotify_init();
+   if (state->inotifyFd < 0) {
+      status = errno;
+      LOG(4, ("%s: inotify is not available: %s\n", __FUNCTION__,
+              strerror(status)));
+      goto error;
+   }
+   fcntl(state->inotifyFd, F_SETFD, FD_CLOEXEC);
+
+   if (pipe(state->exitPipe) < 0) {
+      status = errno;
+      goto error;
+   }
+
+   state->lock = MXUser_CreateExclLock("hgfsNotifyLock", RANK_hgfsNotifyLock);
+   state->dispatchLock = MXUser_CreateExclLock("hgfsNotifyDispatchLock",
+                                               RANK_hgfsNotifyDispatchLock);
+   DblLnkLst_Init(&state->shares);
+   DblLnkLst_Init(&state->watches);
+   DblLnkLst_Init(&state->subscribers);
+   state->nextShareHandle = 0;
+   state->nextSubscriberHandle = 0;
+
+   gNotify = state;
+   state->thread = g_thread_create(HgfsNotifyThread, NULL, TRUE, &err);
+   if (err != NULL) {
+      LOG(4, ("%s: failed to start thread: %s\n", __FUNCTION__, err->message));
+      g_clear_error(&err);
+      gNotify = NULL;
+      MXUser_DestroyExclLock(state->lock);
+      MXUser_DestroyExclLock(state->dispatchLock);
+      status = HGFS_ERROR_INTERNAL;
+      goto error;
+   }
+
+   return HGFS_STATUS_SUCCESS;
+
+error:
+   if (state->exitPipe[0] >= 0) {
+      close(state->exitPipe[0]);
+      close(state->exitPipe[1]);
+   }
+   if (state->inotifyFd >= 0) {
+      close(state->inotifyFd);
+   }
+   free(state);
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Exit --
+ *
+ *    Exit for the notification component.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Stops the reader thread and removes all shared folders and subscribers.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Exit(void)
+{
+   DblLnkLst_Links *link;
+   DblLnkLst_Links *nextLink;
+   char exitByte = 0;
+
+   if (gNotify == NULL) {
+      return;
+   }
+
+   if (write(gNotify->exitPipe[1], &exitByte, sizeof exitByte) != sizeof exitByte) {
+      LOG(4, ("%s: failed to signal thread: %s\n", __FUNCTION__, strerror(errno)));
+   }
+   g_thread_join(gNotify->thread);
+
+   DblLnkLst_ForEachSafe(link, nextLink, &gNotify->subscribers) {
+      HgfsNotifyDestroySubscriber(DblLnkLst_Container(link, HgfsNotifySubscriber,
+                                                      links));
+   }
+   DblLnkLst_ForEachSafe(link, nextLink, &gNotify->shares) {
+      HgfsNotifyShare *share = DblLnkLst_Container(link, HgfsNotifyShare, links);
+
+      DblLnkLst_Unlink1(&share->links);
+      free(share->path);
+      free(share);
+   }
+
+   close(gNotify->exitPipe[0]);
+   close(gNotify->exitPipe[1]);
+   close(gNotify->inotifyFd);
+   MXUser_DestroyExclLock(gNotify->lock);
+   MXUser_DestroyExclLock(gNotify->dispatchLock);
+   free(gNotify);
+   gNotify = NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Deactivate --
+ *
+ *    Deactivates generating file system change notifications. Events that
+ *    occur while deactivated for a server sync are discarded.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Deactivate(HgfsNotifyActivateReason reason) // IN: reason
+{
+   if (gNotify == NULL || reason != HGFS_NOTIFY_REASON_SERVER_SYNC) {
+      /* Watches only exist while there are subscribers. */
+      return;
+   }
+
+   MXUser_AcquireExclLock(gNotify->lock);
+   gNotify->deactivateCount++;
+   MXUser_ReleaseExclLock(gNotify->lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Activate --
+ *
+ *    Activates generating file system change notifications.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Activate(HgfsNotifyActivateReason reason) // IN: reason
+{
+   if (gNotify == NULL || reason != HGFS_NOTIFY_REASON_SERVER_SYNC) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gNotify->lock);
+   if (gNotify->deactivateCount > 0) {
+      gNotify->deactivateCount--;
+   }
+   MXUser_ReleaseExclLock(gNotify->lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_AddSharedFolder --
+ *
+ *    Allocates memory and initializes new shared folder structure.
+ *
+ * Results:
+ *    Opaque subscriber handle for the new subscriber or HGFS_INVALID_FOLDER_HANDLE
+ *    if adding shared folder fails.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsSharedFolderHandle
+HgfsNotify_AddSharedFolder(const char *path,       // IN: path in the host
+                           const char *shareName)  // IN: name of the shared folder
+{
+   HgfsNotifyShare *share;
+
+   if (gNotify == NULL) {
+      return HGFS_INVALID_FOLDER_HANDLE;
+   }
+
+   share = Util_SafeMalloc(sizeof *share);
+   DblLnkLst_Init(&share->links);
+   share->path = Util_SafeStrdup(path);
+
+   MXUser_AcquireExclLock(gNotify->lock);
+   share->handle = gNotify->nextShareHandle++;
+   DblLnkLst_LinkLast(&gNotify->shares, &share->links);
+   MXUser_ReleaseExclLock(gNotify->lock);
+
+   LOG(8, ("%s: share %s path %s handle %#x\n", __FUNCTION__, shareName, path,
+           share->handle));
+
+   return share->handle;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_AddSubscriber --
+ *
+ *    Allocates memory and initializes new subscriber structure.
+ *    Inserts allocated subscriber into corrspondent array.
+ *
+ *    inotify watches are not recursive, a subscriber asking for the whole
+ *    tree is only notified of changes to the directory itself.
+ *
+ * Results:
+ *    Opaque subscriber handle for the new subscriber or HGFS_INVALID_SUBSCRIBER_HANDLE
+ *    if adding subscriber fails.
+ *
+ * Side effects:
+ *    May add an inotify watch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsSubscriberHandle
+HgfsNotify_AddSubscriber(HgfsSharedFolderHandle sharedFolder, // IN: shared folder handle
+                         const char *path,                    // IN: relative path
+                         uint32 eventFilter,                  // IN: event filter
+                         uint32 recursive,                    // IN: look in subfolders
+                         HgfsNotifyEventReceiveCb eventCb,    // IN notification callback
+                         struct HgfsSessionInfo *session)     // IN: server context
+{
+   HgfsSubscriberHandle result = HGFS_INVALID_SUBSCRIBER_HANDLE;
+   HgfsNotifySubscriber *subscriber;
+   HgfsNotifyShare *share;
+   char *localPath;
+   int wd;
+
+   if (gNotify == NULL) {
+      return HGFS_INVALID_SUBSCRIBER_HANDLE;
+   }
+
+   MXUser_AcquireExclLock(gNotify->lock);
+
+   share = HgfsNotifyFindShare(sharedFolder);
+   if (share == NULL) {
+      LOG(4, ("%s: unknown shared folder %#x\n", __FUNCTION__, sharedFolder));
+      goto exit;
+   }
+
+   localPath = HgfsNotifyBuildName(share->path, path);
+   wd = HgfsNotifyGetWatch(localPath, HgfsNotifyFilter2Inotify(eventFilter));
+   free(localPath);
+   if (wd < 0) {
+      goto exit;
+   }
+
+   subscriber = Util_SafeMalloc(sizeof *subscriber);
+   DblLnkLst_Init(&subscriber->links);
+   subscriber->handle = gNotify->nextSubscriberHandle++;
+   subscriber->sharedFolder = sharedFolder;
+   subscriber->path = Util_SafeStrdup(path);
+   subscriber->eventFilter = eventFilter;
+   subscriber->wd = wd;
+   subscriber->eventCb = eventCb;
+   subscriber->session = session;
+   DblLnkLst_LinkLast(&gNotify->subscribers, &subscriber->links);
+   result = subscriber->handle;
+
+   LOG(8, ("%s: subscriber %"FMT64"x on %s wd %d recursive %u\n", __FUNCTION__,
+           result, path, wd, recursive));
+
+exit:
+   MXUser_ReleaseExclLock(gNotify->lock);
+   return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSharedFolder --
+ *
+ *    Deallcates memory used by shared folder and performs necessary cleanup.
+ *    Also deletes all subscribers that are defined for the shared folder.
+ *
+ * Results:
+ *    TRUE if the shared folder was found, FALSE otherwise.
+ *
+ * Side effects:
+ *    Removes all subscribers that correspond to the shared folder and invalidates
+ *    thier handles.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsNotify_RemoveSharedFolder(HgfsSharedFolderHandle sharedFolder) // IN
+{
+   DblLnkLst_Links *link;
+   DblLnkLst_Links *nextLink;
+   HgfsNotifyShare *share;
+
+   if (gNotify == NULL) {
+      return FALSE;
+   }
+
+   /*
+    * Only the state lock is taken: this is called with the server shared
+    * folders lock held, which event callbacks acquire under the dispatch lock.
+    */
+   MXUser_AcquireExclLock(gNotify->lock);
+
+   share = HgfsNotifyFindShare(sharedFolder);
+   if (share != NULL) {
+      DblLnkLst_ForEachSafe(link, nextLink, &gNotify->subscribers) {
+         HgfsNotifySubscriber *subscriber =
+            DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+         if (subscriber->sharedFolder == sharedFolder) {
+            HgfsNotifyDestroySubscriber(subscriber);
+         }
+      }
+      DblLnkLst_Unlink1(&share->links);
+      free(share->path);
+      free(share);
+   }
+
+   MXUser_ReleaseExclLock(gNotify->lock);
+
+   return share != NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSubscriber --
+ *
+ *    Deallcates memory used by NotificationSubscriber and performs necessary cleanup.
+ *
+ * Results:
+ *    TRUE if the subscriber was found, FALSE otherwise.
+ *
+ * Side effects:
+ *    Waits for events being delivered. May remove an inotify watch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsNotify_RemoveSubscriber(HgfsSubscriberHandle subscriber) // IN
+{
+   DblLnkLst_Links *link;
+   Bool found = FALSE;
+
+   if (gNotify == NULL) {
+      return FALSE;
+   }
+
+   MXUser_AcquireExclLock(gNotify->dispatchLock);
+   MXUser_AcquireExclLock(gNotify->lock);
+
+   DblLnkLst_ForEach(link, &gNotify->subscribers) {
+      HgfsNotifySubscriber *entry =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+      if (entry->handle == subscriber) {
+         HgfsNotifyDestroySubscriber(entry);
+         found = TRUE;
+         break;
+      }
+   }
+
+   MXUser_ReleaseExclLock(gNotify->lock);
+   MXUser_ReleaseExclLock(gNotify->dispatchLock);
+
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSessionSubscribers --
+ *
+ *    Removes all entries that are related to a particular session.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Waits for events being delivered, so that no callback references the
+ *    session once this returns.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_RemoveSessionSubscribers(struct HgfsSessionInfo *session) // IN
+{
+   DblLnkLst_Links *link;
+   DblLnkLst_Links *nextLink;
+
+   if (gNotify == NULL) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gNotify->dispatchLock);
+   MXUser_AcquireExclLock(gNotify->lock);
+
+   DblLnkLst_ForEachSafe(link, nextLink, &gNotify->subscribers) {
+      HgfsNotifySubscriber *subscriber =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+      if (subscriber->session == session) {
+         HgfsNotifyDestroySubscriber(subscriber);
+      }
+   }
+
+   MXUser_ReleaseExclLock(gNotify->lock);
+   MXUser_ReleaseExclLock(gNotify->dispatchLock);
+}
@@ -41,11 +41,14 @@
 #include "codeset.h"
 #include "dbllnklst.h"
 #include "file.h"
+#include "hostinfo.h"
 #include "util.h"
 #include "wiper.h"
 #include "hgfsServer.h"
 #include "hgfsServerParameters.h"
 #include "hgfsServerOplock.h"
+#include "hgfsServerWriteBehind.h"
+#include "hgfsServerStats.h"
 #include "hgfsDirNotify.h"
 #include "userlock.h"
 #include "poll.h"
@@ -128,6 +131,29 @@
 /* Default maximun number of open nodes that have server locks. */
 #define MAX_LOCKED_FILENODES 10
 
+/*
+ * Upper bound for the number of cached open nodes when sized from the process
+ * open file limit, and the share of that limit the node cache may use.
+ */
+#define MAX_ADAPTIVE_CACHED_FILENODES 1024
+#define CACHED_FILENODES_FD_SHARE 4
+
+/*
+ * Bounds of the readahead window advised ahead of sequential reads. The window
+ * starts small and doubles for each refill while the stream stays sequential.
+ */
+#define HGFS_READAHEAD_MIN_WINDOW   (256 * 1024)
+#define HGFS_READAHEAD_MAX_WINDOW   (4 * 1024 * 1024)
+
+/*
+ * Bounds of the resolved name cache. Entries are dropped whenever the guest
+ * changes the namespace through HGFS and expire after HGFS_NAME_CACHE_TTL_MS
+ * so that changes made directly on the host are picked up.
+ */
+#define HGFS_NAME_CACHE_MAX         512
+#define HGFS_NAME_CACHE_BUCKETS     128
+#define HGFS_NAME_CACHE_TTL_MS      1000
+
 
 struct HgfsTransportSessionInfo {
    /* Default session id. */
@@ -175,6 +201,10 @@ typedef struct HgfsInputParam {
    HgfsOp op;                    /* Hgfs operation command code */
    uint32 id;                    /* Request ID to be matched with the reply */
    Bool sessionEnabled;          /* Requests have session enabled headers */
+   Bool compound;                /* Part of a compound request, not sent alone */
+   HgfsInternalStatus compoundStatus; /* Compound part result */
+   size_t compoundReplySize;     /* Compound part reply size with the header */
+   VmTimeType startTime;         /* When the request was received, in us */
 } HgfsInputParam;
 
 /*
@@ -239,6 +269,9 @@ static void HgfsServerSessionSendComplete(HgfsPacket *packet, void *clientData);
 static HgfsSharedFolderHandle HgfsServerRegisterShare(const char *shareName,
                                                       const char *sharePath,
                                                       Bool addFolder);
+static void HgfsNameCacheInit(void);
+static void HgfsNameCacheExit(void);
+static void HgfsNameCacheInvalidate(void);
 
 /*
  * Callback table passed to transport and any channels.
@@ -256,12 +289,39 @@ HgfsServerCallbacks gHgfsServerCBTable = {
    HgfsServerRegisterShare,
 };
 
-/* Lock that protects shared folders list. */
-static MXUserExclLock *gHgfsSharedFoldersLock = NULL;
+/* Lock that protects shared folders list, read on every notification. */
+static MXUserReadMostlyLock *gHgfsSharedFoldersLock = NULL;
 
 /* List of shared folders nodes. */
 static DblLnkLst_Links gHgfsSharedFoldersList;
 
+/*
+ * Cache of local names resolved from cross-platform names. Every entry is
+ * linked into its hash bucket and into the LRU list, most recently inserted
+ * first. Lookups only take the cache lock for read, so rather than moving
+ * entries in the list they mark them referenced, and eviction gives
+ * referenced entries a second chance.
+ */
+typedef struct HgfsNameCacheEntry {
+   DblLnkLst_Links lruLinks;
+   DblLnkLst_Links hashLinks;
+   uint32 hash;
+   Atomic_uint32 referenced;
+   VmTimeType expires;
+   HgfsShareOptions shareOptions;
+   uint32 caseFlags;
+   char *cpName;
+   size_t cpNameSize;
+   char *rootDir;
+   char *localName;
+   size_t localNameLen;
+} HgfsNameCacheEntry;
+
+static MXUserReadMostlyLock *gHgfsNameCacheLock = NULL;
+static DblLnkLst_Links gHgfsNameCacheLru;
+static DblLnkLst_Links gHgfsNameCacheBuckets[HGFS_NAME_CACHE_BUCKETS];
+static uint32 gHgfsNumNameCacheEntries = 0;
+
 static Bool gHgfsInitialized = FALSE;
 
 /*
@@ -271,6 +331,13 @@ static Bool gHgfsInitialized = FALSE;
  */
 static Bool gHgfsDirNotifyActive = FALSE;
 
+/*
+ * Whether the oplock lease monitoring is set up. Breaks are sent to clients
+ * unsolicited, which only shared memory channels can carry, so this is only
+ * done when the first such session is granted oplocks.
+ */
+static Bool gHgfsOplockActive = FALSE;
+
 typedef struct HgfsSharedFolderProperties {
    DblLnkLst_Links links;
    char *name;                                /* Name of the share. */
@@ -278,6 +345,43 @@ typedef struct HgfsSharedFolderProperties {
    Bool markedForDeletion;
 } HgfsSharedFolderProperties;
 
+/* gHgfsSharedFoldersList entries keyed by share name. */
+static HashTable *gHgfsSharedFoldersByName = NULL;
+
+/*
+ * Share generation the shared folders list was last enumerated at, or
+ * MAX_UINT32 if it never was. Protected by gHgfsSharedFoldersLock.
+ */
+static uint32 gHgfsSharedFoldersGeneration = MAX_UINT32;
+
+/*
+ * Bumped every time the host pushes share changes. The cached share names
+ * and the shared folders list are enumerated again when it changes.
+ */
+static Atomic_uint32 gHgfsShareGeneration;
+
+/*
+ * Snapshot of the share names enumerated by the policy, for listings of the
+ * root of the name space. Enumerations in progress hold a reference, so the
+ * snapshot can be replaced under them.
+ */
+typedef struct HgfsShareNameList {
+   Atomic_uint32 refCount;
+   uint32 generation;
+   size_t numNames;
+   char **names;
+   size_t *nameLens;
+} HgfsShareNameList;
+
+/* Enumeration state handed out by HgfsServerResEnumInit. */
+typedef struct HgfsShareNameEnum {
+   HgfsShareNameList *list;
+   size_t next;
+} HgfsShareNameEnum;
+
+static MXUserExclLock *gHgfsShareNamesLock = NULL;
+static HgfsShareNameList *gHgfsShareNames = NULL;
+
 
 /* Allocate/Add sessions helper functions. */
 
@@ -297,11 +401,14 @@ HgfsServerTransportGetSessionInfo(HgfsTransportSessionInfo *transportSession,
 /* Local functions. */
 static void HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,
                                          HgfsSessionInfo *session);
+static void HgfsServerShareNamesRelease(HgfsShareNameList *list);
 static Bool HgfsAddToCacheInternal(HgfsHandle handle,
                                    HgfsSessionInfo *session);
 static Bool HgfsIsCachedInternal(HgfsHandle handle,
                                  HgfsSessionInfo *session);
 static Bool HgfsRemoveLruNode(HgfsSessionInfo *session);
+static void HgfsLinkCachedNode(HgfsFileNode *node,
+                               HgfsSessionInfo *session);
 static Bool HgfsRemoveFromCacheInternal(HgfsHandle handle,
                                         HgfsSessionInfo *session);
 static void HgfsRemoveSearchInternal(HgfsSearch *search,
@@ -380,9 +487,12 @@ static void HgfsServerWriteWin32Stream(HgfsInputParam *input);
 static void HgfsServerCreateSession(HgfsInputParam *input);
 static void HgfsServerDestroySession(HgfsInputParam *input);
 static void HgfsServerClose(HgfsInputParam *input);
+static void HgfsServerFsync(HgfsInputParam *input);
 static void HgfsServerSearchClose(HgfsInputParam *input);
 static void HgfsServerSetDirNotifyWatch(HgfsInputParam *input);
 static void HgfsServerRemoveDirNotifyWatch(HgfsInputParam *input);
+static void HgfsServerOplockBreakAck(HgfsInputParam *input);
+static void HgfsServerCompound(HgfsInputParam *input);
 
 
 /*
@@ -596,19 +706,19 @@ static HgfsFileNode *
 HgfsHandle2FileNode(HgfsHandle handle,        // IN: Hgfs file handle
                     HgfsSessionInfo *session) // IN: Session info
 {
-   unsigned int i;
+   uint32 *index;
    HgfsFileNode *fileNode = NULL;
 
    ASSERT(session);
    ASSERT(session->nodeArray);
+   ASSERT(session->nodeIndex);
 
-   /* XXX: This O(n) lookup can and should be optimized. */
-   for (i = 0; i < session->numNodes; i++) {
-      if (session->nodeArray[i].state != FILENODE_STATE_UNUSED &&
-          session->nodeArray[i].handle == handle) {
-         fileNode = &session->nodeArray[i];
-         break;
-      }
+   index = HashMap_Get(session->nodeIndex, &handle);
+   if (index != NULL) {
+      ASSERT(*index < session->numNodes);
+      fileNode = &session->nodeArray[*index];
+      ASSERT(fileNode->state != FILENODE_STATE_UNUSED);
+      ASSERT(fileNode->handle == handle);
    }
 
    return fileNode;
@@ -1115,6 +1225,7 @@ HgfsGetNodeCopy(HgfsHandle handle,        // IN: Hgfs file handle
    copy->state = original->state;
    copy->handle = original->handle;
    copy->fileCtx = original->fileCtx;
+   copy->serverLock = original->serverLock;
    found = TRUE;
 
 exit:
@@ -1248,6 +1359,11 @@ HgfsUpdateNodeFileDesc(HgfsHandle handle,        // IN: Hgfs file handle
 
    node->fileDesc = fd;
    node->fileCtx = fileCtx;
+   if (node->state == FILENODE_STATE_IN_USE_CACHED) {
+      /* The file context may have changed whether the node can be evicted. */
+      DblLnkLst_Unlink1(&node->links);
+      HgfsLinkCachedNode(node, session);
+   }
    updated = TRUE;
 
 exit:
@@ -1293,7 +1409,23 @@ HgfsUpdateNodeServerLock(fileDesc fd,                // IN: OS handle
       existingFileNode = &session->nodeArray[i];
       if (existingFileNode->state != FILENODE_STATE_UNUSED) {
          if (existingFileNode->fileDesc == fd) {
+            if (existingFileNode->state == FILENODE_STATE_IN_USE_CACHED) {
+               /* Keep the count of cached locked nodes in step. */
+               if (existingFileNode->serverLock == HGFS_LOCK_NONE &&
+                   serverLock != HGFS_LOCK_NONE) {
+                  session->numCachedLockedNodes++;
+               } else if (existingFileNode->serverLock != HGFS_LOCK_NONE &&
+                          serverLock == HGFS_LOCK_NONE) {
+                  ASSERT(session->numCachedLockedNodes > 0);
+                  session->numCachedLockedNodes--;
+               }
+            }
             existingFileNode->serverLock = serverLock;
+            if (existingFileNode->state == FILENODE_STATE_IN_USE_CACHED) {
+               /* The lock may have changed whether the node can be evicted. */
+               DblLnkLst_Unlink1(&existingFileNode->links);
+               HgfsLinkCachedNode(existingFileNode, session);
+            }
             updated = TRUE;
             break;
          }
@@ -1555,9 +1687,11 @@ HgfsGetNewNode(HgfsSessionInfo *session)  // IN: session info
           * because if we are here, it is empty.
           */
 
-         /* Rebase the anchor of the cached file nodes list. */
+         /* Rebase the anchors of the cached file nodes lists. */
          HgfsServerRebase(session->nodeCachedList.prev, DblLnkLst_Links)
          HgfsServerRebase(session->nodeCachedList.next, DblLnkLst_Links)
+         HgfsServerRebase(session->nodePinnedList.prev, DblLnkLst_Links)
+         HgfsServerRebase(session->nodePinnedList.next, DblLnkLst_Links)
 
 #undef HgfsServerRebase
       }
@@ -1592,6 +1726,262 @@ HgfsGetNewNode(HgfsSessionInfo *session)  // IN: session info
 }
 
 
+/*
+ * Open nodes or searches of a session that belong to one share, as indices
+ * into the session's nodeArray or searchArray. Each object records its
+ * position in the indices array (shareSlot), so it can be removed in
+ * constant time.
+ */
+
+typedef struct HgfsShareObjects {
+   uint32 *indices;
+   uint32 count;
+   uint32 capacity;
+} HgfsShareObjects;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsShareObjectsFree --
+ *
+ *    Frees an entry of a share index.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsShareObjectsFree(void *data)  // IN: share index entry
+{
+   HgfsShareObjects *objects = data;
+
+   free(objects->indices);
+   free(objects);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsShareIndexAlloc --
+ *
+ *    Allocates an index of session objects by share root directory.
+ *
+ * Results:
+ *    The index.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HashTable *
+HgfsShareIndexAlloc(void)
+{
+   return HashTable_Alloc(16, HASH_STRING_KEY | HASH_FLAG_COPYKEY,
+                          HgfsShareObjectsFree);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsShareIndexAdd --
+ *
+ *    Records that the object at arrayIndex belongs to the share rooted at
+ *    rootDir.
+ *
+ *    The caller should hold the lock of the array the index belongs to.
+ *
+ * Results:
+ *    The slot of the object, to be passed to HgfsShareIndexRemove.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsShareIndexAdd(HashTable *index,     // IN: share index
+                  const char *rootDir,  // IN: share root directory
+                  uint32 arrayIndex)    // IN: index of the object
+{
+   HgfsShareObjects *objects;
+
+   if (!HashTable_Lookup(index, rootDir, (void **)&objects)) {
+      objects = Util_SafeCalloc(1, sizeof *objects);
+      HashTable_Insert(index, rootDir, objects);
+   }
+
+   if (objects->count == objects->capacity) {
+      objects->capacity = MAX(8, 2 * objects->capacity);
+      objects->indices = Util_SafeRealloc(objects->indices,
+                                          objects->capacity *
+                                          sizeof *objects->indices);
+   }
+
+   objects->indices[objects->count] = arrayIndex;
+
+   return objects->count++;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsShareIndexRemove --
+ *
+ *    Removes the object in the given slot from the share rooted at rootDir.
+ *    The last object of the share takes its slot.
+ *
+ *    The caller should hold the lock of the array the index belongs to.
+ *
+ * Results:
+ *    The index of the object that was moved to the slot, whose shareSlot
+ *    must be updated by the caller, or HGFS_SHARE_SLOT_NONE.
+ *
+ * Side effects:
+ *    The entry of the share is deleted when it becomes empty.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsShareIndexRemove(HashTable *index,     // IN: share index
+                     const char *rootDir,  // IN: share root directory
+                     uint32 slot)          // IN: slot of the object
+{
+   HgfsShareObjects *objects;
+   uint32 moved;
+
+   if (!HashTable_Lookup(index, rootDir, (void **)&objects)) {
+      ASSERT(FALSE);
+      return HGFS_SHARE_SLOT_NONE;
+   }
+
+   ASSERT(slot < objects->count);
+   objects->count--;
+
+   if (objects->count == 0) {
+      HashTable_Delete(index, rootDir);
+      return HGFS_SHARE_SLOT_NONE;
+   }
+
+   if (slot == objects->count) {
+      return HGFS_SHARE_SLOT_NONE;
+   }
+
+   moved = objects->indices[objects->count];
+   objects->indices[slot] = moved;
+
+   return moved;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsShareIndexGetRemoved --
+ *
+ *    Looks for the shares of the index that are not in the list of shares.
+ *
+ *    The caller should hold the lock of the array the index belongs to.
+ *
+ * Results:
+ *    An array of the removed shares root directories. The caller must free
+ *    it and its elements.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char **
+HgfsShareIndexGetRemoved(HashTable *index,         // IN: share index
+                         DblLnkLst_Links *shares,  // IN: list of shares
+                         size_t *numRemoved)       // OUT: number of shares
+{
+   const void **keys;
+   size_t numKeys;
+   char **removed;
+   size_t i;
+
+   HashTable_KeyArray(index, &keys, &numKeys);
+   removed = Util_SafeCalloc(numKeys + 1, sizeof *removed);
+   *numRemoved = 0;
+
+   for (i = 0; i < numKeys; i++) {
+      DblLnkLst_Links *l;
+
+      for (l = shares->next; l != shares; l = l->next) {
+         HgfsSharedFolder *share = DblLnkLst_Container(l, HgfsSharedFolder,
+                                                       links);
+
+         if (strcmp(keys[i], share->path) == 0) {
+            break;
+         }
+      }
+
+      if (l == shares) {
+         removed[(*numRemoved)++] = Util_SafeStrdup(keys[i]);
+      }
+   }
+
+   free((void *)keys);
+
+   return removed;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsShareIndexGetObjects --
+ *
+ *    Copies the indices of the objects of the share rooted at rootDir, so
+ *    they can be removed while walking the copy.
+ *
+ *    The caller should hold the lock of the array the index belongs to.
+ *
+ * Results:
+ *    The indices, to be freed by the caller, or NULL if there is none.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32 *
+HgfsShareIndexGetObjects(HashTable *index,     // IN: share index
+                         const char *rootDir,  // IN: share root directory
+                         uint32 *count)        // OUT: number of objects
+{
+   HgfsShareObjects *objects;
+   uint32 *indices;
+
+   if (!HashTable_Lookup(index, rootDir, (void **)&objects)) {
+      *count = 0;
+      return NULL;
+   }
+
+   indices = Util_SafeMalloc(objects->count * sizeof *indices);
+   memcpy(indices, objects->indices, objects->count * sizeof *indices);
+   *count = objects->count;
+
+   return indices;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1621,6 +2011,18 @@ HgfsRemoveFileNode(HgfsFileNode *node,        // IN: file node
    LOG(4, ("%s: handle %u, name %s, fileId %"FMT64"u\n", __FUNCTION__,
            HgfsFileNode2Handle(node), node->utf8Name, node->localId.fileId));
 
+   if (node->state != FILENODE_STATE_UNUSED) {
+      HgfsHandle handle = HgfsFileNode2Handle(node);
+      uint32 moved;
+
+      HashMap_Remove(session->nodeIndex, &handle);
+      moved = HgfsShareIndexRemove(session->nodeShareIndex,
+                                   node->shareInfo.rootDir, node->shareSlot);
+      if (moved != HGFS_SHARE_SLOT_NONE) {
+         session->nodeArray[moved].shareSlot = node->shareSlot;
+      }
+   }
+
    if (node->shareName) {
       free(node->shareName);
       node->shareName = NULL;
@@ -1735,6 +2137,7 @@ HgfsAddNewFileNode(HgfsFileOpenInfo *openInfo,  // IN: open info struct
 {
    HgfsFileNode *newNode;
    char* rootDir;
+   uint32 nodeIndex;
 
    ASSERT(openInfo);
    ASSERT(localId);
@@ -1809,18 +2212,99 @@ HgfsAddNewFileNode(HgfsFileOpenInfo *openInfo,  // IN: open info struct
       newNode->flags |= HGFS_FILE_NODE_SEQUENTIAL_FL;
    }
 
+   newNode->readAheadNext = 0;
+   newNode->readAheadEnd = 0;
+   newNode->readAheadWindow = 0;
+
    newNode->serverLock = openInfo->acquiredLock;
-   newNode->state = FILENODE_STATE_IN_USE_NOT_CACHED;
    newNode->shareInfo.readPermissions = openInfo->shareInfo.readPermissions;
    newNode->shareInfo.writePermissions = openInfo->shareInfo.writePermissions;
    newNode->shareInfo.handle = openInfo->shareInfo.handle;
 
+   /* Make the node reachable by its handle. */
+   nodeIndex = (uint32)(newNode - session->nodeArray);
+   if (!HashMap_Put(session->nodeIndex, &newNode->handle, &nodeIndex)) {
+      LOG(4, ("%s: out of memory\n", __FUNCTION__));
+      HgfsRemoveFileNode(newNode, session);
+      return NULL;
+   }
+   newNode->shareSlot = HgfsShareIndexAdd(session->nodeShareIndex,
+                                          newNode->shareInfo.rootDir,
+                                          nodeIndex);
+   newNode->state = FILENODE_STATE_IN_USE_NOT_CACHED;
+
    LOG(4, ("%s: got new node, handle %u\n", __FUNCTION__,
            HgfsFileNode2Handle(newNode)));
    return newNode;
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsIsNodePinned --
+ *
+ *    Check if an open node must be kept open while it is in use.
+ *
+ *    Nodes with a server lock or a file context, and nodes opened in
+ *    HGFS_FILE_NODE_SEQUENTIAL_FL mode are never closed to make room in the
+ *    cache. -- On some platforms, the sequential mode does not allow files
+ *    to be closed/re-opened (eg: When restoring a file into a Windows guest
+ *    you cannot use BackupWrite, then close and re-open the file and continue
+ *    to use BackupWrite.
+ *
+ * Results:
+ *    TRUE if the node cannot be evicted, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsIsNodePinned(HgfsFileNode const *node)  // IN: file node
+{
+   return node->serverLock != HGFS_LOCK_NONE ||
+          node->fileCtx != NULL ||
+          (node->flags & HGFS_FILE_NODE_SEQUENTIAL_FL) != 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLinkCachedNode --
+ *
+ *    Append a cached node at the most recently used end of the pinned or
+ *    evictable node list, as appropriate.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsLinkCachedNode(HgfsFileNode *node,        // IN: cached file node
+                   HgfsSessionInfo *session)  // IN: session info
+{
+   ASSERT(node->state == FILENODE_STATE_IN_USE_CACHED);
+
+   if (HgfsIsNodePinned(node)) {
+      DblLnkLst_LinkLast(&session->nodePinnedList, &node->links);
+   } else {
+      DblLnkLst_LinkLast(&session->nodeCachedList, &node->links);
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1870,11 +2354,10 @@ HgfsAddToCacheInternal(HgfsHandle handle,         // IN: HGFS file handle
 
    node = HgfsHandle2FileNode(handle, session);
    ASSERT(node);
+   node->state = FILENODE_STATE_IN_USE_CACHED;
    /* Append at the end of the list. */
-   DblLnkLst_LinkLast(&session->nodeCachedList, &node->links);
-
-   node->state = FILENODE_STATE_IN_USE_CACHED;
-   session->numCachedOpenNodes++;
+   HgfsLinkCachedNode(node, session);
+   session->numCachedOpenNodes++;
 
    /*
     * Keep track of how many open nodes we have with
@@ -1935,6 +2418,10 @@ HgfsRemoveFromCacheInternal(HgfsHandle handle,        // IN: Hgfs handle to the
       DblLnkLst_Unlink1(&node->links);
       node->state = FILENODE_STATE_IN_USE_NOT_CACHED;
       session->numCachedOpenNodes--;
+      if (node->serverLock != HGFS_LOCK_NONE) {
+         ASSERT(session->numCachedLockedNodes > 0);
+         session->numCachedLockedNodes--;
+      }
       LOG(4, ("%s: cache entries %u remove node %s id %"FMT64"u fd %u .\n",
               __FUNCTION__, session->numCachedOpenNodes, node->utf8Name,
               node->localId.fileId, node->fileDesc));
@@ -1950,6 +2437,7 @@ HgfsRemoveFromCacheInternal(HgfsHandle handle,        // IN: Hgfs handle to the
        * Instead, we'll just await the lobotomization of the node cache to
        * really fix this.
        */
+      HgfsWriteBehind_Remove(session, handle);
       if (HgfsPlatformCloseFile(node->fileDesc, node->fileCtx)) {
          LOG(4, ("%s: Could not close fd %u\n", __FUNCTION__, node->fileDesc));
 
@@ -2013,7 +2501,7 @@ HgfsIsCachedInternal(HgfsHandle handle,         // IN: Structure representing fi
        * Move this node to the end of the list.
        */
       DblLnkLst_Unlink1(&node->links);
-      DblLnkLst_LinkLast(&session->nodeCachedList, &node->links);
+      HgfsLinkCachedNode(node, session);
 
       return TRUE;
    }
@@ -2027,7 +2515,8 @@ HgfsIsCachedInternal(HgfsHandle handle,         // IN: Structure representing fi
  *
  * HgfsIsServerLockAllowed --
  *
- *    Check if there's room for another file node with the server lock.
+ *    Check if the session negotiated oplocks and there's room for another
+ *    file node with the server lock.
  *    If there's no room in the cache for the file with the server lock,
  *    then the file will be opened without the lock even if the client
  *    asked for the lock.
@@ -2048,6 +2537,10 @@ HgfsIsServerLockAllowed(HgfsSessionInfo *session)  // IN: session info
 {
    Bool allowed;
 
+   if ((session->flags & HGFS_SESSION_OPLOCK_ENABLED) == 0) {
+      return FALSE;
+   }
+
    MXUser_AcquireExclLock(session->nodeArrayLock);
    allowed = session->numCachedLockedNodes < MAX_LOCKED_FILENODES;
    MXUser_ReleaseExclLock(session->nodeArrayLock);
@@ -2301,6 +2794,7 @@ HgfsGetSearchCopy(HgfsHandle handle,        // IN: Hgfs search handle
 
    copy->handle = original->handle;
    copy->type = original->type;
+   copy->dirFd = (fileDesc)VMW_INVALID_HANDLE;
    found = TRUE;
 
 exit:
@@ -2338,6 +2832,7 @@ HgfsAddNewSearch(char const *utf8Dir,       // IN: UTF8 name of dir to search in
                  HgfsSessionInfo *session)  // IN: Session info
 {
    HgfsSearch *newSearch;
+   uint32 searchIndex;
 
    ASSERT(utf8Dir);
 
@@ -2353,8 +2848,18 @@ HgfsAddNewSearch(char const *utf8Dir,       // IN: UTF8 name of dir to search in
    newSearch->numDents = 0;
    newSearch->flags = 0;
    newSearch->type = type;
+   newSearch->dirFd = (fileDesc)VMW_INVALID_HANDLE;
    newSearch->handle = HgfsServerGetNextHandleCounter();
 
+   /* Make the search reachable by its handle. */
+   searchIndex = (uint32)(newSearch - session->searchArray);
+   if (!HashMap_Put(session->searchIndex, &newSearch->handle, &searchIndex)) {
+      LOG(4, ("%s: out of memory\n", __FUNCTION__));
+      DblLnkLst_LinkFirst(&session->searchFreeList, &newSearch->links);
+
+      return NULL;
+   }
+
    newSearch->utf8DirLen = strlen(utf8Dir);
    newSearch->utf8Dir = Util_SafeStrdup(utf8Dir);
 
@@ -2364,6 +2869,14 @@ HgfsAddNewSearch(char const *utf8Dir,       // IN: UTF8 name of dir to search in
    newSearch->shareInfo.rootDirLen = strlen(rootDir);
    newSearch->shareInfo.rootDir = Util_SafeStrdup(rootDir);
 
+   if (HgfsSearchIsBaseNameSpace(newSearch)) {
+      /* Searches of the base name space are never invalidated. */
+      newSearch->shareSlot = HGFS_SHARE_SLOT_NONE;
+   } else {
+      newSearch->shareSlot = HgfsShareIndexAdd(session->searchShareIndex,
+                                               rootDir, searchIndex);
+   }
+
    LOG(4, ("%s: got new search, handle %u\n", __FUNCTION__,
            HgfsSearch2SearchHandle(newSearch)));
    return newSearch;
@@ -2432,6 +2945,17 @@ HgfsRemoveSearchInternal(HgfsSearch *search,       // IN: search
    LOG(4, ("%s: handle %u, dir %s\n", __FUNCTION__,
            HgfsSearch2SearchHandle(search), search->utf8Dir));
 
+   HashMap_Remove(session->searchIndex, &search->handle);
+   if (search->shareSlot != HGFS_SHARE_SLOT_NONE) {
+      uint32 moved = HgfsShareIndexRemove(session->searchShareIndex,
+                                          search->shareInfo.rootDir,
+                                          search->shareSlot);
+
+      if (moved != HGFS_SHARE_SLOT_NONE) {
+         session->searchArray[moved].shareSlot = search->shareSlot;
+      }
+      search->shareSlot = HGFS_SHARE_SLOT_NONE;
+   }
    HgfsFreeSearchDirents(search);
    free(search->utf8Dir);
    free(search->utf8ShareName);
@@ -2652,19 +3176,19 @@ HgfsSearch *
 HgfsSearchHandle2Search(HgfsHandle handle,         // IN: handle
                         HgfsSessionInfo *session)  // IN: session info
 {
-   unsigned int i;
+   uint32 *index;
    HgfsSearch *search = NULL;
 
    ASSERT(session);
    ASSERT(session->searchArray);
+   ASSERT(session->searchIndex);
 
-   /* XXX: This O(n) lookup can and should be optimized. */
-   for (i = 0; i < session->numSearches; i++) {
-      if (!DblLnkLst_IsLinked(&session->searchArray[i].links) &&
-          session->searchArray[i].handle == handle) {
-         search = &session->searchArray[i];
-         break;
-      }
+   index = HashMap_Get(session->searchIndex, &handle);
+   if (index != NULL) {
+      ASSERT(*index < session->numSearches);
+      search = &session->searchArray[*index];
+      ASSERT(!DblLnkLst_IsLinked(&search->links));
+      ASSERT(search->handle == handle);
    }
 
    return search;
@@ -2758,6 +3282,7 @@ HgfsServerClose(HgfsInputParam *input)  // IN: Input params
 {
    HgfsHandle file;
    HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
+   HgfsInternalStatus flushStatus;
    size_t replyPayloadSize = 0;
 
    HGFS_ASSERT_INPUT(input);
@@ -2766,12 +3291,18 @@ HgfsServerClose(HgfsInputParam *input)  // IN: Input params
                               input->op, &file)) {
       LOG(4, ("%s: close fh %u\n", __FUNCTION__, file));
 
+      /* The close reports failures to write out buffered data. */
+      flushStatus = HgfsWriteBehind_Close(input->session, file);
+
       if (!HgfsRemoveFromCache(file, input->session)) {
          LOG(4, ("%s: Could not remove the node from cache.\n", __FUNCTION__));
          status = HGFS_ERROR_INVALID_HANDLE;
       } else {
          HgfsFreeFileNode(file, input->session);
-         if (!HgfsPackCloseReply(input->packet, input->request, input->op,
+         if (HGFS_ERROR_SUCCESS != flushStatus) {
+            LOG(4, ("%s: buffered writes failed %d\n", __FUNCTION__, flushStatus));
+            status = flushStatus;
+         } else if (!HgfsPackCloseReply(input->packet, input->request, input->op,
                                  &replyPayloadSize, input->session)) {
             status = HGFS_ERROR_INTERNAL;
          }
@@ -2784,6 +3315,57 @@ HgfsServerClose(HgfsInputParam *input)  // IN: Input params
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerFsync --
+ *
+ *    Handle an Fsync request.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Writes out the data buffered for the file by any session and reports
+ *    the failures to write it out that have not been reported yet.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerFsync(HgfsInputParam *input)  // IN: Input params
+{
+   HgfsHandle file;
+   fileDesc fd;
+   HgfsInternalStatus status;
+   size_t replyPayloadSize = 0;
+
+   HGFS_ASSERT_INPUT(input);
+
+   if (HgfsUnpackFsyncRequest(input->payload, input->payloadSize,
+                              input->op, &file)) {
+      LOG(4, ("%s: fsync fh %u\n", __FUNCTION__, file));
+
+      status = HgfsWriteBehind_Sync(input->session, file);
+      if (HGFS_ERROR_SUCCESS == status) {
+         status = HgfsPlatformGetFd(file, input->session, FALSE, &fd);
+      }
+      if (HGFS_ERROR_SUCCESS == status) {
+         status = HgfsPlatformSyncFile(fd);
+      }
+      if (HGFS_ERROR_SUCCESS == status &&
+          !HgfsPackFsyncReply(input->packet, input->request, input->op,
+                              &replyPayloadSize, input->session)) {
+         status = HGFS_ERROR_INTERNAL;
+      }
+   } else {
+      status = HGFS_ERROR_PROTOCOL;
+   }
+
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -2903,6 +3485,23 @@ static struct {
    { HgfsServerRemoveDirNotifyWatch, sizeof (HgfsRequestRemoveWatchV4),            REQ_SYNC},
    { NULL,                       0,                                                REQ_SYNC}, // No Op notify
    { HgfsServerSearchRead,       sizeof (HgfsRequestSearchReadV4),                 REQ_SYNC},
+   { NULL,                       0,                                                REQ_SYNC}, // No Op open
+   { NULL,                       0,                                                REQ_SYNC}, // No Op enum streams
+   { NULL,                       0,                                                REQ_SYNC}, // No Op getattr
+   { NULL,                       0,                                                REQ_SYNC}, // No Op setattr
+   { NULL,                       0,                                                REQ_SYNC}, // No Op delete
+   { NULL,                       0,                                                REQ_SYNC}, // No Op linkmove
+   { NULL,                       0,                                                REQ_SYNC}, // No Op fsctl
+   { NULL,                       0,                                                REQ_SYNC}, // No Op access check
+   { HgfsServerFsync,            sizeof (HgfsRequestFsyncV4),                      REQ_SYNC},
+   { NULL,                       0,                                                REQ_SYNC}, // No Op query volume
+   { NULL,                       0,                                                REQ_SYNC}, // No Op oplock acquire
+   { HgfsServerOplockBreakAck,   sizeof (HgfsReplyOplockBreakV4),                  REQ_SYNC},
+   { NULL,                       0,                                                REQ_SYNC}, // No Op lock byte range
+   { NULL,                       0,                                                REQ_SYNC}, // No Op unlock byte range
+   { NULL,                       0,                                                REQ_SYNC}, // No Op query EAs
+   { NULL,                       0,                                                REQ_SYNC}, // No Op set EAs
+   { HgfsServerCompound,         sizeof (HgfsRequestCompoundV4),                   REQ_SYNC},
 
 };
 
@@ -2950,6 +3549,7 @@ HgfsServerInputAllocInit(HgfsPacket *packet,                        // IN: packe
    localParams->op = requestOp;
    localParams->payload = requestOpArgs;
    localParams->payloadSize = requestOpArgsSize;
+   localParams->startTime = Hostinfo_SystemTimerUS();
 
    if (NULL != localParams->payload) {
       localParams->payloadOffset = (char *)localParams->payload -
@@ -3244,16 +3844,30 @@ HgfsServerCompleteRequest(HgfsInternalStatus status,   // IN: Status of the requ
                            input->id, input->op, HGFS_PACKET_FLAG_REPLY, replyTotalSize,
                            reply)) {
       Log("%s: Error packing header!\n", __FUNCTION__);
+      replySize = 0;
       goto exit;
    }
 
-   if (!HgfsPacketSend(input->packet, input->transportSession, 0)) {
+   HgfsServerStats_RecordRequest(input->op, status,
+                                 input->requestSize + replySize +
+                                 input->packet->dataPacketDataSize,
+                                 Hostinfo_SystemTimerUS() - input->startTime);
+
+   if (input->compound) {
+      /* The reply is sent together with the rest of the compound request. */
+   } else if (!HgfsPacketSend(input->packet, input->transportSession, 0)) {
       /* Send failed. Drop the reply. */
       Log("%s: Error sending reply\n", __FUNCTION__);
    }
 
 exit:
-   HgfsServerInputExit(input);
+   if (input->compound) {
+      /* The input belongs to the compound request. */
+      input->compoundStatus = status;
+      input->compoundReplySize = replySize;
+   } else {
+      HgfsServerInputExit(input);
+   }
 }
 
 
@@ -3609,7 +4223,7 @@ HgfsServerCleanupDeletedFolders(void)
 {
    DblLnkLst_Links *link, *nextElem;
 
-   MXUser_AcquireExclLock(gHgfsSharedFoldersLock);
+   MXUser_AcquireReadMostlyForWrite(gHgfsSharedFoldersLock);
    DblLnkLst_ForEachSafe(link, nextElem, &gHgfsSharedFoldersList) {
       HgfsSharedFolderProperties *folder =
          DblLnkLst_Container(link, HgfsSharedFolderProperties, links);
@@ -3620,11 +4234,13 @@ HgfsServerCleanupDeletedFolders(void)
             LOG(4, ("Problem removing %d shared folder handle\n",
                     folder->notificationHandle));
          }
+         HashTable_Delete(gHgfsSharedFoldersByName, folder->name);
          DblLnkLst_Unlink1(link);
+         free(folder->name);
          free(folder);
       }
    }
-   MXUser_ReleaseExclLock(gHgfsSharedFoldersLock);
+   MXUser_ReleaseReadMostlyForWrite(gHgfsSharedFoldersLock);
 }
 
 
@@ -3661,13 +4277,18 @@ HgfsServerRegisterShare(const char *shareName,   // IN: shared folder name
                         const char *sharePath,   // IN: shared folder path
                         Bool addFolder)          // IN: add or remove folder
 {
-   DblLnkLst_Links *link, *nextElem;
+   HgfsSharedFolderProperties *folder;
    HgfsSharedFolderHandle result = HGFS_INVALID_FOLDER_HANDLE;
 
    LOG(8, ("%s: %s, %s, %s\n", __FUNCTION__,
            (shareName ? shareName : "NULL"), (sharePath ? sharePath : "NULL"),
            (addFolder ? "add" : "remove")));
 
+   if (NULL == shareName) {
+      /* The host is done pushing its shares, the cached names are stale. */
+      Atomic_Inc(&gHgfsShareGeneration);
+   }
+
    if (!gHgfsDirNotifyActive) {
       LOG(8, ("%s: notification disabled\n", __FUNCTION__));
       goto exit;
@@ -3687,30 +4308,25 @@ HgfsServerRegisterShare(const char *shareName,   // IN: shared folder name
       goto exit;
    }
 
-   MXUser_AcquireExclLock(gHgfsSharedFoldersLock);
+   MXUser_AcquireReadMostlyForWrite(gHgfsSharedFoldersLock);
 
-   DblLnkLst_ForEachSafe(link, nextElem, &gHgfsSharedFoldersList) {
-      HgfsSharedFolderProperties *folder =
-         DblLnkLst_Container(link, HgfsSharedFolderProperties, links);
-      if (strcmp(folder->name, shareName) == 0) {
-         result = folder->notificationHandle;
-         folder->markedForDeletion = !addFolder;
-         break;
-      }
-   }
-   if (addFolder && HGFS_INVALID_FOLDER_HANDLE == result) {
+   if (HashTable_Lookup(gHgfsSharedFoldersByName, shareName,
+                        (void **)&folder)) {
+      result = folder->notificationHandle;
+      folder->markedForDeletion = !addFolder;
+   } else if (addFolder) {
       result = HgfsNotify_AddSharedFolder(sharePath, shareName);
       if (HGFS_INVALID_FOLDER_HANDLE != result) {
-         HgfsSharedFolderProperties *folder =
-            (HgfsSharedFolderProperties *)Util_SafeMalloc(sizeof *folder);
+         folder = (HgfsSharedFolderProperties *)Util_SafeMalloc(sizeof *folder);
          folder->notificationHandle = result;
          folder->name = Util_SafeStrdup(shareName);
          folder->markedForDeletion = FALSE;
          DblLnkLst_Init(&folder->links);
          DblLnkLst_LinkLast(&gHgfsSharedFoldersList, &folder->links);
+         HashTable_Insert(gHgfsSharedFoldersByName, folder->name, folder);
       }
    }
-   MXUser_ReleaseExclLock(gHgfsSharedFoldersLock);
+   MXUser_ReleaseReadMostlyForWrite(gHgfsSharedFoldersLock);
 
 exit:
    LOG(8, ("%s: %s, %s, %s exit %#x\n",__FUNCTION__,
@@ -3740,24 +4356,19 @@ exit:
 static HgfsSharedFolderHandle
 HgfsServerGetShareHandle(const char *shareName)  // IN: name of the shared folder
 {
-   DblLnkLst_Links *link;
+   HgfsSharedFolderProperties *folder;
    HgfsSharedFolderHandle result = HGFS_INVALID_FOLDER_HANDLE;
 
    if (!gHgfsDirNotifyActive) {
       return HGFS_INVALID_FOLDER_HANDLE;
    }
 
-   MXUser_AcquireExclLock(gHgfsSharedFoldersLock);
-
-   DblLnkLst_ForEach(link, &gHgfsSharedFoldersList) {
-      HgfsSharedFolderProperties *folder =
-         DblLnkLst_Container(link, HgfsSharedFolderProperties, links);
-      if (strcmp(folder->name, shareName) == 0) {
-         result = folder->notificationHandle;
-         break;
-      }
+   MXUser_AcquireReadMostlyForRead(gHgfsSharedFoldersLock);
+   if (HashTable_Lookup(gHgfsSharedFoldersByName, shareName,
+                        (void **)&folder)) {
+      result = folder->notificationHandle;
    }
-   MXUser_ReleaseExclLock(gHgfsSharedFoldersLock);
+   MXUser_ReleaseReadMostlyForRead(gHgfsSharedFoldersLock);
    return result;
 }
 
@@ -3792,7 +4403,7 @@ HgfsServerGetShareName(HgfsSharedFolderHandle sharedFolder, // IN: Notify handle
       return FALSE;
    }
 
-   MXUser_AcquireExclLock(gHgfsSharedFoldersLock);
+   MXUser_AcquireReadMostlyForRead(gHgfsSharedFoldersLock);
 
    DblLnkLst_ForEach(link, &gHgfsSharedFoldersList) {
       HgfsSharedFolderProperties *folder =
@@ -3804,7 +4415,7 @@ HgfsServerGetShareName(HgfsSharedFolderHandle sharedFolder, // IN: Notify handle
          break;
       }
    }
-   MXUser_ReleaseExclLock(gHgfsSharedFoldersLock);
+   MXUser_ReleaseReadMostlyForRead(gHgfsSharedFoldersLock);
    return result;
 }
 
@@ -3841,6 +4452,22 @@ HgfsServer_InitState(HgfsServerCallbacks **callbackTable,         // IN/OUT: our
       gHgfsCfgSettings = *serverCfgData;
    }
 
+   /*
+    * The configured number of cached open nodes is a minimum, scale it up
+    * when the process is allowed enough file descriptors.
+    */
+   {
+      uint32 adaptiveMax = HgfsPlatformGetOpenFileLimit() /
+                           CACHED_FILENODES_FD_SHARE;
+
+      adaptiveMax = MIN(adaptiveMax, MAX_ADAPTIVE_CACHED_FILENODES);
+      if (adaptiveMax > gHgfsCfgSettings.maxCachedOpenNodes) {
+         gHgfsCfgSettings.maxCachedOpenNodes = adaptiveMax;
+      }
+      LOG(4, ("%s: maximum cached open nodes %u\n", __FUNCTION__,
+              gHgfsCfgSettings.maxCachedOpenNodes));
+   }
+
    /*
     * Initialize the globals for handling the active shared folders.
     */
@@ -3850,13 +4477,20 @@ HgfsServer_InitState(HgfsServerCallbacks **callbackTable,         // IN/OUT: our
    Atomic_Write(&gHgfsAsyncCounter, 0);
 
    DblLnkLst_Init(&gHgfsSharedFoldersList);
-   gHgfsSharedFoldersLock = MXUser_CreateExclLock("sharedFoldersLock",
-                                                  RANK_hgfsSharedFolders);
+   gHgfsSharedFoldersLock = MXUser_CreateReadMostlyLock("sharedFoldersLock",
+                                                        RANK_hgfsSharedFolders,
+                                                        TRUE);
+   gHgfsSharedFoldersByName = HashTable_Alloc(32, HASH_STRING_KEY, NULL);
+   gHgfsSharedFoldersGeneration = MAX_UINT32;
+   gHgfsShareNamesLock = MXUser_CreateExclLock("shareNamesLock",
+                                               RANK_hgfsSharedFolders);
    gHgfsAsyncLock = MXUser_CreateExclLock("asyncLock",
                                           RANK_hgfsSharedFolders);
 
    gHgfsAsyncVar = MXUser_CreateCondVarExclLock(gHgfsAsyncLock);
 
+   HgfsNameCacheInit();
+
    if (!HgfsPlatformInit()) {
       LOG(4, ("Could not initialize server platform specific \n"));
       result = FALSE;
@@ -3870,9 +4504,9 @@ HgfsServer_InitState(HgfsServerCallbacks **callbackTable,         // IN/OUT: our
          Log("%s: initialized notification %s.\n", __FUNCTION__,
              (gHgfsDirNotifyActive ? "active" : "inactive"));
       }
-      if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_OPLOCK_ENABLED)) {
-         if (!HgfsServerOplockInit()) {
-            gHgfsCfgSettings.flags &= ~HGFS_CONFIG_OPLOCK_ENABLED;
+      if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_WRITE_BEHIND_ENABLED)) {
+         if (!HgfsWriteBehind_Init()) {
+            gHgfsCfgSettings.flags &= ~HGFS_CONFIG_WRITE_BEHIND_ENABLED;
          }
       }
       gHgfsInitialized = TRUE;
@@ -3909,8 +4543,12 @@ HgfsServer_ExitState(void)
 {
    gHgfsInitialized = FALSE;
 
-   if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_OPLOCK_ENABLED)) {
+   if (gHgfsOplockActive) {
       HgfsServerOplockDestroy();
+      gHgfsOplockActive = FALSE;
+   }
+   if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_WRITE_BEHIND_ENABLED)) {
+      HgfsWriteBehind_Exit();
    }
    if (gHgfsDirNotifyActive) {
       HgfsNotify_Exit();
@@ -3919,10 +4557,25 @@ HgfsServer_ExitState(void)
    }
 
    if (NULL != gHgfsSharedFoldersLock) {
-      MXUser_DestroyExclLock(gHgfsSharedFoldersLock);
+      MXUser_DestroyReadMostlyLock(gHgfsSharedFoldersLock);
       gHgfsSharedFoldersLock = NULL;
    }
 
+   if (NULL != gHgfsSharedFoldersByName) {
+      HashTable_Free(gHgfsSharedFoldersByName);
+      gHgfsSharedFoldersByName = NULL;
+   }
+
+   if (NULL != gHgfsShareNames) {
+      HgfsServerShareNamesRelease(gHgfsShareNames);
+      gHgfsShareNames = NULL;
+   }
+
+   if (NULL != gHgfsShareNamesLock) {
+      MXUser_DestroyExclLock(gHgfsShareNamesLock);
+      gHgfsShareNamesLock = NULL;
+   }
+
    if (NULL != gHgfsAsyncLock) {
       MXUser_DestroyExclLock(gHgfsAsyncLock);
       gHgfsAsyncLock = NULL;
@@ -3933,6 +4586,8 @@ HgfsServer_ExitState(void)
       gHgfsAsyncVar = NULL;
    }
 
+   HgfsNameCacheExit();
+
    HgfsPlatformDestroy();
    /*
     * Reset the server manager callbacks.
@@ -4067,6 +4722,111 @@ HgfsServerSetSessionCapability(HgfsOp op,                  // IN: operation code
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerShareNamesRelease --
+ *
+ *    Drops a reference to a share names snapshot, freeing it with the last
+ *    one.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerShareNamesRelease(HgfsShareNameList *list)  // IN: snapshot
+{
+   if (Atomic_ReadDec32(&list->refCount) == 1) {
+      size_t i;
+
+      for (i = 0; i < list->numNames; i++) {
+         free(list->names[i]);
+      }
+      free(list->names);
+      free(list->nameLens);
+      free(list);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerShareNamesBuild --
+ *
+ *    Enumerates the shares through the server manager callbacks and saves
+ *    their names.
+ *
+ * Results:
+ *    The snapshot, with one reference, or NULL on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsShareNameList *
+HgfsServerShareNamesBuild(uint32 generation)  // IN: share generation
+{
+   HgfsServerResEnumCallbacks *enumResources = &gHgfsMgrData->enumResources;
+   HgfsShareNameList *list;
+   size_t capacity = 0;
+   void *enumState;
+   Bool success;
+   Bool done = FALSE;
+
+   enumState = enumResources->init();
+   if (NULL == enumState) {
+      return NULL;
+   }
+
+   list = Util_SafeCalloc(1, sizeof *list);
+   Atomic_Write(&list->refCount, 1);
+   list->generation = generation;
+
+   do {
+      char const *name;
+      size_t len;
+
+      success = enumResources->get(enumState, &name, &len, &done);
+      if (success && !done) {
+         if (list->numNames == capacity) {
+            capacity = MAX(8, 2 * capacity);
+            list->names = Util_SafeRealloc(list->names,
+                                           capacity * sizeof *list->names);
+            list->nameLens = Util_SafeRealloc(list->nameLens,
+                                              capacity *
+                                              sizeof *list->nameLens);
+         }
+         list->names[list->numNames] = Util_SafeMalloc(len + 1);
+         memcpy(list->names[list->numNames], name, len);
+         list->names[list->numNames][len] = '\0';
+         list->nameLens[list->numNames] = len;
+         list->numNames++;
+      }
+   } while (success && !done);
+
+   enumResources->exit(enumState);
+
+   if (!success) {
+      HgfsServerShareNamesRelease(list);
+      return NULL;
+   }
+
+   LOG(4, ("%s: %"FMTSZ"u shares at generation %u\n", __FUNCTION__,
+           list->numNames, generation));
+
+   return list;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -4074,6 +4834,10 @@ HgfsServerSetSessionCapability(HgfsOp op,                  // IN: operation code
  *
  *    Initialize an enumeration of all exisitng resources.
  *
+ *    The share names are only enumerated through the server manager when
+ *    the host pushed share changes since the last enumeration; otherwise
+ *    the saved names are handed out.
+ *
  * Results:
  *    The enumeration state object.
  *
@@ -4086,12 +4850,38 @@ HgfsServerSetSessionCapability(HgfsOp op,                  // IN: operation code
 void *
 HgfsServerResEnumInit(void)
 {
-   void *enumState = NULL;
+   HgfsShareNameEnum *enumState;
+   HgfsShareNameList *list;
+   uint32 generation;
 
-    if (gHgfsMgrData != NULL &&
-       gHgfsMgrData->enumResources.init != NULL) {
-      enumState = gHgfsMgrData->enumResources.init();
+   if (gHgfsMgrData == NULL ||
+       gHgfsMgrData->enumResources.init == NULL ||
+       gHgfsMgrData->enumResources.get == NULL ||
+       gHgfsMgrData->enumResources.exit == NULL) {
+      return NULL;
+   }
+
+   generation = Atomic_Read(&gHgfsShareGeneration);
+
+   MXUser_AcquireExclLock(gHgfsShareNamesLock);
+   if (gHgfsShareNames == NULL || gHgfsShareNames->generation != generation) {
+      list = HgfsServerShareNamesBuild(generation);
+      if (list == NULL) {
+         MXUser_ReleaseExclLock(gHgfsShareNamesLock);
+         return NULL;
+      }
+      if (gHgfsShareNames != NULL) {
+         HgfsServerShareNamesRelease(gHgfsShareNames);
+      }
+      gHgfsShareNames = list;
    }
+   list = gHgfsShareNames;
+   Atomic_Inc(&list->refCount);
+   MXUser_ReleaseExclLock(gHgfsShareNamesLock);
+
+   enumState = Util_SafeMalloc(sizeof *enumState);
+   enumState->list = list;
+   enumState->next = 0;
 
    return enumState;
 }
@@ -4119,17 +4909,21 @@ HgfsServerResEnumGet(void *enumState,           // IN/OUT: enumeration state
                      size_t *enumResNameLen,    // OUT: enumerated resource name len
                      Bool *enumResDone)         // OUT: enumerated resources done
 {
-   Bool success = FALSE;
+   HgfsShareNameEnum *state = enumState;
+
+   ASSERT(state);
 
-    if (gHgfsMgrData != NULL &&
-        gHgfsMgrData->enumResources.get != NULL) {
-      success = gHgfsMgrData->enumResources.get(enumState,
-                                                enumResName,
-                                                enumResNameLen,
-                                                enumResDone);
+   if (state->next == state->list->numNames) {
+      *enumResDone = TRUE;
+      return TRUE;
    }
 
-   return success;
+   *enumResName = state->list->names[state->next];
+   *enumResNameLen = state->list->nameLens[state->next];
+   *enumResDone = FALSE;
+   state->next++;
+
+   return TRUE;
 }
 
 
@@ -4152,14 +4946,14 @@ HgfsServerResEnumGet(void *enumState,           // IN/OUT: enumeration state
 Bool
 HgfsServerResEnumExit(void *enumState)           // IN/OUT: enumeration state
 {
-   Bool success = FALSE;
+   HgfsShareNameEnum *state = enumState;
 
-   if (gHgfsMgrData != NULL &&
-       gHgfsMgrData->enumResources.exit != NULL) {
-       success = gHgfsMgrData->enumResources.exit(enumState);
-   }
+   ASSERT(state);
 
-   return success;
+   HgfsServerShareNamesRelease(state->list);
+   free(state);
+
+   return TRUE;
 }
 
 
@@ -4185,8 +4979,20 @@ HgfsServerEnumerateSharedFolders(void)
 {
    void *state;
    Bool success = FALSE;
+   Bool upToDate;
+   uint32 generation = Atomic_Read(&gHgfsShareGeneration);
 
    LOG(8, ("%s: entered\n", __FUNCTION__));
+
+   /* Nothing to do if no share changed since the last enumeration. */
+   MXUser_AcquireReadMostlyForRead(gHgfsSharedFoldersLock);
+   upToDate = gHgfsSharedFoldersGeneration == generation;
+   MXUser_ReleaseReadMostlyForRead(gHgfsSharedFoldersLock);
+   if (upToDate) {
+      LOG(8, ("%s: shared folders are up to date\n", __FUNCTION__));
+      return TRUE;
+   }
+
    state = HgfsServerResEnumInit();
    if (NULL != state) {
       Bool done;
@@ -4216,6 +5022,12 @@ HgfsServerEnumerateSharedFolders(void)
 
       HgfsServerResEnumExit(state);
    }
+
+   if (success) {
+      MXUser_AcquireReadMostlyForWrite(gHgfsSharedFoldersLock);
+      gHgfsSharedFoldersGeneration = generation;
+      MXUser_ReleaseReadMostlyForWrite(gHgfsSharedFoldersLock);
+   }
    LOG(8, ("%s: exit %d\n", __FUNCTION__, success));
    return success;
 }
@@ -4337,6 +5149,7 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
 
    DblLnkLst_Init(&session->nodeFreeList);
    DblLnkLst_Init(&session->nodeCachedList);
+   DblLnkLst_Init(&session->nodePinnedList);
 
    /* Allocate array of FileNodes and add them to free list. */
    session->numNodes = NUM_FILE_NODES;
@@ -4351,6 +5164,13 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
       DblLnkLst_LinkLast(&session->nodeFreeList, &session->nodeArray[i].links);
    }
 
+   /* The handle index grows along with the node array. */
+   session->nodeIndex = HashMap_AllocMap(session->numNodes,
+                                         sizeof (HgfsHandle),
+                                         sizeof (uint32));
+   VERIFY(session->nodeIndex);
+   session->nodeShareIndex = HgfsShareIndexAlloc();
+
    /*
     * Initialize the search handling components.
     */
@@ -4375,6 +5195,12 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
                          &session->searchArray[i].links);
    }
 
+   session->searchIndex = HashMap_AllocMap(session->numSearches,
+                                           sizeof (HgfsHandle),
+                                           sizeof (uint32));
+   VERIFY(session->searchIndex);
+   session->searchShareIndex = HgfsShareIndexAlloc();
+
    /* Get common to all sessions capabiities. */
    HgfsServerGetDefaultCapabilities(session->hgfsSessionCapabilities,
                                     &session->numberOfCapabilities);
@@ -4409,6 +5235,7 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
    *sessionData = session;
 
    Log("%s: init session %p id %"FMT64"x\n", __FUNCTION__, session, session->sessionId);
+   HgfsServerStats_Inc(HGFS_STATS_SESSION_CREATED);
    return TRUE;
 }
 
@@ -4555,6 +5382,11 @@ HgfsServerExitSessionInternal(HgfsSessionInfo *session)    // IN: session contex
 
    ASSERT(session->state == HGFS_SESSION_STATE_CLOSED);
 
+   /* Drop the leases backing this session's oplocks before closing its files. */
+   if (session->flags & HGFS_SESSION_OPLOCK_ENABLED) {
+      HgfsRemoveSessionServerLocks(session);
+   }
+
    /* Check and remove any notification handles we have for this session. */
    if (session->flags & HGFS_SESSION_CHANGENOTIFY_ENABLED) {
       LOG(8, ("%s: calling notify component to disconnect\n", __FUNCTION__));
@@ -4571,6 +5403,10 @@ HgfsServerExitSessionInternal(HgfsSessionInfo *session)    // IN: session contex
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
    Log("%s: exit session %p id %"FMT64"x\n", __FUNCTION__, session, session->sessionId);
+   HgfsServerStats_Inc(HGFS_STATS_SESSION_DESTROYED);
+   Log("%s: node cache max %u hits %u misses %u evictions %u\n", __FUNCTION__,
+       gHgfsCfgSettings.maxCachedOpenNodes, session->numCacheHits,
+       session->numCacheMisses, session->numCacheEvictions);
 
    /* Recycle all nodes that are still in use, then destroy the node pool. */
    for (i = 0; i < session->numNodes; i++) {
@@ -4586,6 +5422,10 @@ HgfsServerExitSessionInternal(HgfsSessionInfo *session)    // IN: session contex
    }
    free(session->nodeArray);
    session->nodeArray = NULL;
+   HashMap_DestroyMap(session->nodeIndex);
+   session->nodeIndex = NULL;
+   HashTable_Free(session->nodeShareIndex);
+   session->nodeShareIndex = NULL;
 
    MXUser_ReleaseExclLock(session->nodeArrayLock);
 
@@ -4604,6 +5444,10 @@ HgfsServerExitSessionInternal(HgfsSessionInfo *session)    // IN: session contex
    }
    free(session->searchArray);
    session->searchArray = NULL;
+   HashMap_DestroyMap(session->searchIndex);
+   session->searchIndex = NULL;
+   HashTable_Free(session->searchShareIndex);
+   session->searchShareIndex = NULL;
 
    MXUser_ReleaseExclLock(session->searchArrayLock);
 
@@ -4740,6 +5584,8 @@ HgfsServer_Quiesce(Bool freeze)  // IN:
          MXUser_WaitCondVarExclLock(gHgfsAsyncLock, gHgfsAsyncVar);
       }
       MXUser_ReleaseExclLock(gHgfsAsyncLock);
+      /* Nothing may be left buffered in a snapshot. */
+      HgfsWriteBehind_FlushSession(NULL);
    } else {
       /* Resume background activity. */
       if (gHgfsDirNotifyActive) {
@@ -4825,8 +5671,9 @@ HgfsPacketSend(HgfsPacket *packet,            // IN/OUT: Hgfs Packet
  *
  * HgfsInvalidateSessionObjects --
  *
- *      Iterates over all nodes and searches, invalidating and removing those
- *      that are no longer within a share.
+ *      Invalidates and removes the nodes and searches that are no longer
+ *      within a share. Only the objects of the removed shares are visited,
+ *      found through the session's share indexes.
  *
  * Results:
  *      None
@@ -4841,7 +5688,9 @@ static void
 HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
                              HgfsSessionInfo *session) // IN: Session info
 {
-   unsigned int i;
+   char **removed;
+   size_t numRemoved;
+   size_t r;
 
    ASSERT(shares);
    ASSERT(session);
@@ -4852,36 +5701,24 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
    /*
-    * Iterate over each node, skipping those that are unused. For each node,
-    * if its filename is no longer within a share, remove it.
+    * For each share that has open nodes but is no longer shared, remove
+    * its nodes.
     */
-   for (i = 0; i < session->numNodes; i++) {
-      HgfsHandle handle;
-      DblLnkLst_Links *l;
-
-      if (session->nodeArray[i].state == FILENODE_STATE_UNUSED) {
-         continue;
-      }
-
-      handle = HgfsFileNode2Handle(&session->nodeArray[i]);
-      LOG(4, ("%s: Examining node with fd %d (%s)\n", __FUNCTION__,
-              handle, session->nodeArray[i].utf8Name));
+   removed = HgfsShareIndexGetRemoved(session->nodeShareIndex, shares,
+                                      &numRemoved);
+   for (r = 0; r < numRemoved; r++) {
+      uint32 *indices;
+      uint32 count;
+      uint32 i;
 
-      /* For each share, is the node within the share? */
-      for (l = shares->next; l != shares; l = l->next) {
-         HgfsSharedFolder *share;
+      indices = HgfsShareIndexGetObjects(session->nodeShareIndex, removed[r],
+                                         &count);
+      LOG(4, ("%s: Share %s is gone, removing %u nodes\n", __FUNCTION__,
+              removed[r], count));
 
-         share = DblLnkLst_Container(l, HgfsSharedFolder, links);
-         ASSERT(share);
-         if (strcmp(session->nodeArray[i].shareInfo.rootDir, share->path) == 0) {
-            LOG(4, ("%s: Node is still valid\n", __FUNCTION__));
-            break;
-         }
-      }
+      for (i = 0; i < count; i++) {
+         HgfsHandle handle = HgfsFileNode2Handle(&session->nodeArray[indices[i]]);
 
-      /* If the node wasn't found in any share, remove it. */
-      if (l == shares) {
-         LOG(4, ("%s: Node is invalid, removing\n", __FUNCTION__));
          if (!HgfsRemoveFromCacheInternal(handle, session)) {
             LOG(4, ("%s: Could not remove node with "
                     "fh %d from the cache.\n", __FUNCTION__, handle));
@@ -4889,49 +5726,40 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
             HgfsFreeFileNodeInternal(handle, session);
          }
       }
+
+      free(indices);
+      free(removed[r]);
    }
+   free(removed);
 
    MXUser_ReleaseExclLock(session->nodeArrayLock);
 
    MXUser_AcquireExclLock(session->searchArrayLock);
 
    /*
-    * Iterate over each search, skipping those that are on the free list. For
-    * each search, if its base name is no longer within a share, remove it.
+    * Same for the searches. Searches of the base name space are not in the
+    * index; they may be stale but it is okay.
     */
-   for (i = 0; i < session->numSearches; i++) {
-      DblLnkLst_Links *l;
-
-      if (DblLnkLst_IsLinked(&session->searchArray[i].links)) {
-         continue;
-      }
-
-      if (HgfsSearchIsBaseNameSpace(&session->searchArray[i])) {
-         /* Skip search of the base name space. Maybe stale but it is okay. */
-         continue;
-      }
-
-      LOG(4, ("%s: Examining search (%s)\n", __FUNCTION__,
-              session->searchArray[i].utf8Dir));
-
-      /* For each share, is the search within the share? */
-      for (l = shares->next; l != shares; l = l->next) {
-         HgfsSharedFolder *share;
-
-         share = DblLnkLst_Container(l, HgfsSharedFolder, links);
-         ASSERT(share);
-         if (strcmp(session->searchArray[i].shareInfo.rootDir, share->path) == 0) {
-            LOG(4, ("%s: Search is still valid\n", __FUNCTION__));
-            break;
-         }
+   removed = HgfsShareIndexGetRemoved(session->searchShareIndex, shares,
+                                      &numRemoved);
+   for (r = 0; r < numRemoved; r++) {
+      uint32 *indices;
+      uint32 count;
+      uint32 i;
+
+      indices = HgfsShareIndexGetObjects(session->searchShareIndex,
+                                         removed[r], &count);
+      LOG(4, ("%s: Share %s is gone, removing %u searches\n", __FUNCTION__,
+              removed[r], count));
+
+      for (i = 0; i < count; i++) {
+         HgfsRemoveSearchInternal(&session->searchArray[indices[i]], session);
       }
 
-      /* If the node wasn't found in any share, remove it. */
-      if (l == shares) {
-         LOG(4, ("%s: Search is invalid, removing\n", __FUNCTION__));
-         HgfsRemoveSearchInternal(&session->searchArray[i], session);
-      }
+      free(indices);
+      free(removed[r]);
    }
+   free(removed);
 
    MXUser_ReleaseExclLock(session->searchArrayLock);
 
@@ -4967,6 +5795,8 @@ HgfsServerSessionInvalidateObjects(void *clientData,         // IN:
    DblLnkLst_Links *curr;
 
    ASSERT(transportSession);
+   HgfsNameCacheInvalidate();
+   Atomic_Inc(&gHgfsShareGeneration);
    MXUser_AcquireExclLock(transportSession->sessionArrayLock);
 
    DblLnkLst_ForEach(curr, &transportSession->sessionArray) {
@@ -5124,57 +5954,409 @@ HgfsServerStatFs(const char *pathName, // IN: Path we're interested in
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerGetLocalNameInfo --
- *
- *    Construct local name based on the crossplatform CPName for the file and the
- *    share information.
+ * HgfsNameCacheInit --
  *
- *    The name returned is allocated and must be freed by the caller.
- *    The name length is optionally returned.
+ *    Sets up the cache of resolved local names.
  *
  * Results:
- *    A status code indicating either success (correspondent share exists) or
- *    a failure status.
+ *    None.
  *
  * Side effects:
- *    Memory allocation in the success case
+ *    Creates the cache lock.
  *
  *-----------------------------------------------------------------------------
  */
 
-static HgfsNameStatus
-HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filename to check
-                           size_t cpNameSize,       // IN:  Size of name cpName
-                           uint32 caseFlags,        // IN:  Case-sensitivity flags
-                           HgfsShareInfo *shareInfo,// OUT: properties of the shared folder
-                           char **bufOut,           // OUT: File name in local fs
-                           size_t *outLen)          // OUT: Length of name out optional
+static void
+HgfsNameCacheInit(void)
 {
-   HgfsNameStatus nameStatus;
-   const char *inEnd;
-   const char *next;
-   char *myBufOut;
-   char *convertedMyBufOut;
-   char *out;
-   size_t outSize;
-   size_t myBufOutLen;
-   size_t convertedMyBufOutLen;
-   int len;
-   uint32 pathNameLen;
-   char tempBuf[HGFS_PATH_MAX];
-   size_t tempSize;
-   char *tempPtr;
-   uint32 startIndex = 0;
-   HgfsShareOptions shareOptions;
+   uint32 i;
 
-   ASSERT(cpName);
-   ASSERT(bufOut);
+   DblLnkLst_Init(&gHgfsNameCacheLru);
+   for (i = 0; i < ARRAYSIZE(gHgfsNameCacheBuckets); i++) {
+      DblLnkLst_Init(&gHgfsNameCacheBuckets[i]);
+   }
+   gHgfsNumNameCacheEntries = 0;
+   gHgfsNameCacheLock = MXUser_CreateReadMostlyLock("nameCacheLock",
+                                                    RANK_hgfsNameCacheLock,
+                                                    TRUE);
+}
 
-   inEnd = cpName + cpNameSize;
 
-   if (!Unicode_IsBufferValid(cpName, cpNameSize, STRING_ENCODING_UTF8)) {
-      LOG(4, ("%s: invalid UTF8 string @ %p\n", __FUNCTION__, cpName));
-      return HGFS_NAME_STATUS_FAILURE;
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNameCacheEntryFree --
+ *
+ *    Unlinks a resolved name entry and frees it. The cache lock must be held
+ *    for write.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNameCacheEntryFree(HgfsNameCacheEntry *entry)  // IN: entry
+{
+   DblLnkLst_Unlink1(&entry->lruLinks);
+   DblLnkLst_Unlink1(&entry->hashLinks);
+   gHgfsNumNameCacheEntries--;
+   free(entry->cpName);
+   free(entry->rootDir);
+   free(entry->localName);
+   free(entry);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNameCacheInvalidate --
+ *
+ *    Drops every resolved name. Called whenever the namespace of a share may
+ *    have changed, a rename of a directory affects all names below it so the
+ *    cache is not pruned selectively.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNameCacheInvalidate(void)
+{
+   DblLnkLst_Links *link, *nextLink;
+
+   if (gHgfsNameCacheLock == NULL) {
+      return;
+   }
+
+   MXUser_AcquireReadMostlyForWrite(gHgfsNameCacheLock);
+   DblLnkLst_ForEachSafe(link, nextLink, &gHgfsNameCacheLru) {
+      HgfsNameCacheEntryFree(DblLnkLst_Container(link, HgfsNameCacheEntry,
+                                                 lruLinks));
+   }
+   ASSERT(gHgfsNumNameCacheEntries == 0);
+   MXUser_ReleaseReadMostlyForWrite(gHgfsNameCacheLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNameCacheExit --
+ *
+ *    Frees all resolved names and the cache lock.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNameCacheExit(void)
+{
+   if (gHgfsNameCacheLock == NULL) {
+      return;
+   }
+
+   HgfsNameCacheInvalidate();
+   MXUser_DestroyReadMostlyLock(gHgfsNameCacheLock);
+   gHgfsNameCacheLock = NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNameCacheHash --
+ *
+ *    Hashes the key of a resolved name (FNV-1a).
+ *
+ * Results:
+ *    The hash value.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNameCacheHash(const char *cpName,           // IN: cross-platform name
+                  size_t cpNameSize,            // IN: size of cpName
+                  uint32 caseFlags,             // IN: case-sensitivity flags
+                  HgfsShareOptions shareOptions)// IN: share options
+{
+   uint32 hash = 2166136261U;
+   size_t i;
+
+   for (i = 0; i < cpNameSize; i++) {
+      hash = (hash ^ (unsigned char)cpName[i]) * 16777619U;
+   }
+   hash = (hash ^ caseFlags) * 16777619U;
+
+   return (hash ^ shareOptions) * 16777619U;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNameCacheFind --
+ *
+ *    Finds the entry for the key. The cache lock must be held, for write when
+ *    pruning. Expired entries met on the way are skipped, and freed when
+ *    pruning.
+ *
+ * Results:
+ *    The entry or NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsNameCacheEntry *
+HgfsNameCacheFind(uint32 hash,                  // IN: key hash
+                  const char *cpName,           // IN: cross-platform name
+                  size_t cpNameSize,            // IN: size of cpName
+                  uint32 caseFlags,             // IN: case-sensitivity flags
+                  HgfsShareOptions shareOptions,// IN: share options
+                  const char *rootDir,          // IN: share root directory
+                  VmTimeType now,               // IN: current time in ms
+                  Bool prune)                   // IN: free expired entries
+{
+   DblLnkLst_Links *bucket = &gHgfsNameCacheBuckets[hash % HGFS_NAME_CACHE_BUCKETS];
+   DblLnkLst_Links *link, *nextLink;
+
+   DblLnkLst_ForEachSafe(link, nextLink, bucket) {
+      HgfsNameCacheEntry *entry =
+         DblLnkLst_Container(link, HgfsNameCacheEntry, hashLinks);
+
+      if (entry->expires <= now) {
+         if (prune) {
+            HgfsNameCacheEntryFree(entry);
+         }
+         continue;
+      }
+      if (entry->hash == hash &&
+          entry->cpNameSize == cpNameSize &&
+          entry->caseFlags == caseFlags &&
+          entry->shareOptions == shareOptions &&
+          memcmp(entry->cpName, cpName, cpNameSize) == 0 &&
+          strcmp(entry->rootDir, rootDir) == 0) {
+         return entry;
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNameCacheLookup --
+ *
+ *    Looks up the local name previously resolved for the cross-platform name
+ *    on the share rooted at rootDir.
+ *
+ * Results:
+ *    TRUE and an allocated copy of the local name on a hit, FALSE otherwise.
+ *
+ * Side effects:
+ *    Marks the entry referenced.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNameCacheLookup(const char *cpName,            // IN: cross-platform name
+                    size_t cpNameSize,             // IN: size of cpName
+                    uint32 caseFlags,              // IN: case-sensitivity flags
+                    HgfsShareOptions shareOptions, // IN: share options
+                    const char *rootDir,           // IN: share root directory
+                    char **bufOut,                 // OUT: local name
+                    size_t *outLen)                // OUT: length of local name
+{
+   uint32 hash = HgfsNameCacheHash(cpName, cpNameSize, caseFlags, shareOptions);
+   HgfsNameCacheEntry *entry;
+   Bool found = FALSE;
+
+   if (gHgfsNameCacheLock == NULL) {
+      return FALSE;
+   }
+
+   MXUser_AcquireReadMostlyForRead(gHgfsNameCacheLock);
+   entry = HgfsNameCacheFind(hash, cpName, cpNameSize, caseFlags, shareOptions,
+                             rootDir, Hostinfo_SystemTimerMS(), FALSE);
+   if (entry != NULL) {
+      if (Atomic_Read(&entry->referenced) == 0) {
+         Atomic_Write(&entry->referenced, 1);
+      }
+      *bufOut = Util_SafeMalloc(entry->localNameLen + 1);
+      memcpy(*bufOut, entry->localName, entry->localNameLen + 1);
+      *outLen = entry->localNameLen;
+      found = TRUE;
+   }
+   MXUser_ReleaseReadMostlyForRead(gHgfsNameCacheLock);
+
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNameCacheInsert --
+ *
+ *    Remembers the local name resolved for the cross-platform name on the
+ *    share rooted at rootDir. When the cache is full, the oldest entry that
+ *    hasn't been referenced since it was last passed over is evicted.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNameCacheInsert(const char *cpName,            // IN: cross-platform name
+                    size_t cpNameSize,             // IN: size of cpName
+                    uint32 caseFlags,              // IN: case-sensitivity flags
+                    HgfsShareOptions shareOptions, // IN: share options
+                    const char *rootDir,           // IN: share root directory
+                    const char *localName,         // IN: resolved local name
+                    size_t localNameLen)           // IN: length of localName
+{
+   uint32 hash = HgfsNameCacheHash(cpName, cpNameSize, caseFlags, shareOptions);
+   VmTimeType now;
+   HgfsNameCacheEntry *entry;
+
+   if (gHgfsNameCacheLock == NULL) {
+      return;
+   }
+
+   MXUser_AcquireReadMostlyForWrite(gHgfsNameCacheLock);
+   now = Hostinfo_SystemTimerMS();
+   if (HgfsNameCacheFind(hash, cpName, cpNameSize, caseFlags, shareOptions,
+                         rootDir, now, TRUE) == NULL) {
+      if (gHgfsNumNameCacheEntries == HGFS_NAME_CACHE_MAX) {
+         HgfsNameCacheEntry *victim;
+
+         /* Ends after one pass over the list at most. */
+         while (TRUE) {
+            victim = DblLnkLst_Container(gHgfsNameCacheLru.prev,
+                                         HgfsNameCacheEntry, lruLinks);
+            if (Atomic_Read(&victim->referenced) == 0) {
+               break;
+            }
+            Atomic_Write(&victim->referenced, 0);
+            DblLnkLst_Unlink1(&victim->lruLinks);
+            DblLnkLst_LinkFirst(&gHgfsNameCacheLru, &victim->lruLinks);
+         }
+         HgfsNameCacheEntryFree(victim);
+      }
+
+      entry = Util_SafeMalloc(sizeof *entry);
+      entry->hash = hash;
+      Atomic_Write(&entry->referenced, 0);
+      entry->expires = now + HGFS_NAME_CACHE_TTL_MS;
+      entry->shareOptions = shareOptions;
+      entry->caseFlags = caseFlags;
+      entry->cpName = Util_SafeMalloc(cpNameSize);
+      memcpy(entry->cpName, cpName, cpNameSize);
+      entry->cpNameSize = cpNameSize;
+      entry->rootDir = Util_SafeStrdup(rootDir);
+      entry->localName = Util_SafeMalloc(localNameLen + 1);
+      memcpy(entry->localName, localName, localNameLen + 1);
+      entry->localNameLen = localNameLen;
+
+      DblLnkLst_Init(&entry->lruLinks);
+      DblLnkLst_Init(&entry->hashLinks);
+      DblLnkLst_LinkFirst(&gHgfsNameCacheLru, &entry->lruLinks);
+      DblLnkLst_LinkFirst(&gHgfsNameCacheBuckets[hash % HGFS_NAME_CACHE_BUCKETS],
+                          &entry->hashLinks);
+      gHgfsNumNameCacheEntries++;
+   }
+   MXUser_ReleaseReadMostlyForWrite(gHgfsNameCacheLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerGetLocalNameInfo --
+ *
+ *    Construct local name based on the crossplatform CPName for the file and the
+ *    share information.
+ *
+ *    The name returned is allocated and must be freed by the caller.
+ *    The name length is optionally returned.
+ *
+ * Results:
+ *    A status code indicating either success (correspondent share exists) or
+ *    a failure status.
+ *
+ * Side effects:
+ *    Memory allocation in the success case
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsNameStatus
+HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filename to check
+                           size_t cpNameSize,       // IN:  Size of name cpName
+                           uint32 caseFlags,        // IN:  Case-sensitivity flags
+                           HgfsShareInfo *shareInfo,// OUT: properties of the shared folder
+                           char **bufOut,           // OUT: File name in local fs
+                           size_t *outLen)          // OUT: Length of name out optional
+{
+   HgfsNameStatus nameStatus;
+   const char *inEnd;
+   const char *next;
+   char *myBufOut;
+   char *convertedMyBufOut;
+   char *out;
+   size_t outSize;
+   size_t myBufOutLen;
+   size_t convertedMyBufOutLen;
+   int len;
+   uint32 pathNameLen;
+   char tempBuf[HGFS_PATH_MAX];
+   size_t tempSize;
+   char *tempPtr;
+   uint32 startIndex = 0;
+   HgfsShareOptions shareOptions;
+   const char *fullCpName = cpName;
+   size_t fullCpNameSize = cpNameSize;
+
+   ASSERT(cpName);
+   ASSERT(bufOut);
+
+   inEnd = cpName + cpNameSize;
+
+   if (!Unicode_IsBufferValid(cpName, cpNameSize, STRING_ENCODING_UTF8)) {
+      LOG(4, ("%s: invalid UTF8 string @ %p\n", __FUNCTION__, cpName));
+      return HGFS_NAME_STATUS_FAILURE;
    }
 
    /*
@@ -5212,6 +6394,34 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
       return nameStatus;
    }
 
+   /*
+    * The share lookup above is repeated every time as it fills in the share
+    * permissions, only the conversion and case lookup below are served from
+    * the cache. The symlink check is repeated too, as a component of the
+    * path may have been replaced by a symlink on the host since.
+    */
+   if (HgfsNameCacheLookup(fullCpName, fullCpNameSize, caseFlags, shareOptions,
+                           shareInfo->rootDir, &myBufOut, &myBufOutLen)) {
+      LOG(4, ("%s: cached name is \"%s\"\n", __FUNCTION__, myBufOut));
+      if (!HgfsServerPolicy_IsShareOptionSet(shareOptions,
+                                             HGFS_SHARE_FOLLOW_SYMLINKS)) {
+         nameStatus = HgfsPlatformPathHasSymlink(myBufOut, myBufOutLen,
+                                                 shareInfo->rootDir,
+                                                 shareInfo->rootDirLen);
+         if (nameStatus != HGFS_NAME_STATUS_COMPLETE) {
+            LOG(4, ("%s: parent path failed to be resolved: %d\n",
+                    __FUNCTION__, nameStatus));
+            goto error;
+         }
+      }
+      if (outLen) {
+         *outLen = myBufOutLen;
+      }
+      *bufOut = myBufOut;
+
+      return HGFS_NAME_STATUS_COMPLETE;
+   }
+
    /* Point to the next component, if any */
    cpNameSize -= next - cpName;
    cpName = next;
@@ -5417,6 +6627,8 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
 
    LOG(4, ("%s: name is \"%s\"\n", __FUNCTION__, myBufOut));
 
+   HgfsNameCacheInsert(fullCpName, fullCpNameSize, caseFlags, shareOptions,
+                       shareInfo->rootDir, myBufOut, myBufOutLen);
    *bufOut = myBufOut;
 
    return HGFS_NAME_STATUS_COMPLETE;
@@ -5778,6 +6990,13 @@ HgfsIsCached(HgfsHandle handle,         // IN: Structure representing file node
 
    MXUser_AcquireExclLock(session->nodeArrayLock);
    cached = HgfsIsCachedInternal(handle, session);
+   if (cached) {
+      session->numCacheHits++;
+      HgfsServerStats_Inc(HGFS_STATS_CACHE_HIT);
+   } else {
+      session->numCacheMisses++;
+      HgfsServerStats_Inc(HGFS_STATS_CACHE_MISS);
+   }
    MXUser_ReleaseExclLock(session->nodeArrayLock);
 
    return cached;
@@ -5789,9 +7008,10 @@ HgfsIsCached(HgfsHandle handle,         // IN: Structure representing file node
  *
  * HgfsRemoveLruNode--
  *
- *    Removes the least recently used node in the cache. The first node is
- *    removed since most recently used nodes are moved to the end of the
- *    list.
+ *    Removes the least recently used node in the cache. The first node of
+ *    the evictable list is removed since most recently used nodes are moved
+ *    to the end of the list. Pinned nodes are kept on their own list and are
+ *    never considered, so this is constant time.
  *
  *    XXX: Right now we do not remove nodes that have server locks on them
  *         This is not correct and should be fixed before the release.
@@ -5816,50 +7036,30 @@ HgfsIsCached(HgfsHandle handle,         // IN: Structure representing file node
 Bool
 HgfsRemoveLruNode(HgfsSessionInfo *session)   // IN: session info
 {
-   HgfsFileNode *lruNode = NULL;
+   HgfsFileNode *lruNode;
    HgfsHandle handle;
-   Bool found = FALSE;
-   uint32 numOpenNodes = session->numCachedOpenNodes;
 
    ASSERT(session);
    ASSERT(session->numCachedOpenNodes > 0);
 
-   /*
-    * Remove the first item from the list that does not have a server lock,
-    * file context or is open in sequential mode.
-    */
-   while (!found && (numOpenNodes-- > 0)) {
-      lruNode = DblLnkLst_Container(session->nodeCachedList.next,
-                                    HgfsFileNode, links);
-
-      ASSERT(lruNode->state == FILENODE_STATE_IN_USE_CACHED);
-      if (lruNode->serverLock != HGFS_LOCK_NONE || lruNode->fileCtx != NULL
-          || (lruNode->flags & HGFS_FILE_NODE_SEQUENTIAL_FL) != 0) {
-         /*
-	  * Move this node with the server lock to the beginning of the list.
-	  * Also, prevent files opened in HGFS_FILE_NODE_SEQUENTIAL_FL mode
-	  * from being closed. -- On some platforms, this mode does not
-	  * allow files to be closed/re-opened (eg: When restoring a file
-	  * into a Windows guest you cannot use BackupWrite, then close and
-	  * re-open the file and continue to use BackupWrite.
-	  */
-         DblLnkLst_Unlink1(&lruNode->links);
-         DblLnkLst_LinkLast(&session->nodeCachedList, &lruNode->links);
-      } else {
-         found = TRUE;
-      }
-   }
-   if (found) {
-      handle = HgfsFileNode2Handle(lruNode);
-      if (!HgfsRemoveFromCacheInternal(handle, session)) {
-         LOG(4, ("%s: Could not remove the node from cache.\n", __FUNCTION__));
-         return FALSE;
-      }
-   } else {
+   if (!DblLnkLst_IsLinked(&session->nodeCachedList)) {
       LOG(4, ("%s: Could not find a node to remove from cache.\n", __FUNCTION__));
       return FALSE;
    }
 
+   lruNode = DblLnkLst_Container(session->nodeCachedList.next,
+                                 HgfsFileNode, links);
+   ASSERT(lruNode->state == FILENODE_STATE_IN_USE_CACHED);
+   ASSERT(!HgfsIsNodePinned(lruNode));
+
+   handle = HgfsFileNode2Handle(lruNode);
+   if (!HgfsRemoveFromCacheInternal(handle, session)) {
+      LOG(4, ("%s: Could not remove the node from cache.\n", __FUNCTION__));
+      return FALSE;
+   }
+   session->numCacheEvictions++;
+   HgfsServerStats_Inc(HGFS_STATS_CACHE_EVICTION);
+
    return TRUE;
 }
 
@@ -6044,6 +7244,85 @@ HgfsAllocInitReply(HgfsPacket *packet,           // IN/OUT: Hgfs Packet
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerReadAhead --
+ *
+ *    Track the read offsets of a file node and, while the reads form a
+ *    sequential stream, advise the platform to read ahead of the client.
+ *
+ *    The advised range is refilled once the client has consumed half of the
+ *    window, so the next requests are served from the page cache instead of
+ *    waiting on the disk between packets. Sequentially opened handles read
+ *    from the file position, so every read on them counts as sequential.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Updates the node readahead state, may start asynchronous IO.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerReadAhead(HgfsHandle file,             // IN: Hgfs file handle
+                    fileDesc readFd,             // IN: OS handle of the file
+                    HgfsSessionInfo *session,    // IN: session info
+                    uint64 offset,               // IN: offset read from
+                    uint32 readSize)             // IN: bytes returned
+{
+   HgfsFileNode *node;
+   uint64 readEnd;
+   uint64 adviseStart = 0;
+   uint32 adviseLength = 0;
+
+   MXUser_AcquireExclLock(session->nodeArrayLock);
+
+   node = HgfsHandle2FileNode(file, session);
+   if (node == NULL) {
+      goto exit;
+   }
+
+   if (node->flags & HGFS_FILE_NODE_SEQUENTIAL_FL) {
+      offset = node->readAheadNext;
+   }
+
+   if (offset != node->readAheadNext || readSize == 0) {
+      /* Random access or end of file, stop streaming. */
+      node->readAheadWindow = 0;
+      node->readAheadEnd = 0;
+      node->readAheadNext = offset + readSize;
+      goto exit;
+   }
+
+   readEnd = offset + readSize;
+   node->readAheadNext = readEnd;
+
+   if (node->readAheadWindow == 0) {
+      node->readAheadWindow = HGFS_READAHEAD_MIN_WINDOW;
+   }
+
+   if (readEnd + node->readAheadWindow / 2 > node->readAheadEnd) {
+      adviseStart = MAX(readEnd, node->readAheadEnd);
+      adviseLength = (uint32)(readEnd + node->readAheadWindow - adviseStart);
+      node->readAheadEnd = readEnd + node->readAheadWindow;
+      node->readAheadWindow = MIN(node->readAheadWindow * 2,
+                                  HGFS_READAHEAD_MAX_WINDOW);
+   }
+
+exit:
+   MXUser_ReleaseExclLock(session->nodeArrayLock);
+
+   if (adviseLength != 0) {
+      LOG(10, ("%s: handle %u readahead %"FMT64"u, %u\n", __FUNCTION__, file,
+               adviseStart, adviseLength));
+      HgfsPlatformReadAhead(readFd, adviseStart, adviseLength);
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -6197,6 +7476,9 @@ HgfsServerRead(HgfsInputParam *input)  // IN: Input params
       goto exit;
    }
 
+   /* Reads must see writes still buffered for the file. */
+   HgfsWriteBehind_Flush(input->session, file);
+
    replyRead = HgfsAllocInitReply(input->packet,
                                   input->request,
                                   replyReadSize,
@@ -6206,37 +7488,49 @@ HgfsServerRead(HgfsInputParam *input)  // IN: Input params
    case HGFS_OP_READ_FAST_V4:
    case HGFS_OP_READ_V3: {
          HgfsReplyReadV3 *reply = replyRead;
-         void *payload;
          Bool readUseDataBuffer = replyReadDataSize != 0;
 
          /*
           * The read data size holds the size of the data to read which will be read
           * into the separate data packet buffer. Zero indicates data is read into the
           * same buffer as the reply arguments.
+          *
+          * The separate data packet buffer is read into directly through the
+          * guest mappings so that a multi-page buffer is not bounced through
+          * an allocated contiguous copy.
           */
          if (readUseDataBuffer) {
-            payload = HSPU_GetDataPacketBuf(input->packet, BUF_WRITEABLE,
-                                            input->transportSession->channelCbTable);
+            HgfsVmxIov *dataIov;
+            uint32 dataIovCount;
+
+            dataIov = HSPU_GetDataPacketIov(input->packet, BUF_WRITEABLE,
+                                            input->transportSession->channelCbTable,
+                                            &dataIovCount);
+            if (NULL == dataIov) {
+               status = HGFS_ERROR_PROTOCOL;
+               LOG(4, ("%s: V4 Failed to map data payload -> PROTOCOL_ERROR.\n",
+                       __FUNCTION__));
+               break;
+            }
+            status = HgfsPlatformReadFileIov(readFd, input->session, offset,
+                                             requiredSize, dataIov, dataIovCount,
+                                             &reply->actualSize);
          } else {
-            payload = &reply->payload[0];
-         }
-         if (payload) {
             status = HgfsPlatformReadFile(readFd, input->session, offset,
-                                          requiredSize, payload,
+                                          requiredSize, &reply->payload[0],
                                           &reply->actualSize);
-            if (HGFS_ERROR_SUCCESS == status) {
-               reply->reserved = 0;
-               replyPayloadSize = sizeof *reply;
+         }
+         if (HGFS_ERROR_SUCCESS == status) {
+            HgfsServerReadAhead(file, readFd, input->session, offset,
+                                reply->actualSize);
+            reply->reserved = 0;
+            replyPayloadSize = sizeof *reply;
 
-               if (readUseDataBuffer) {
-                  HSPU_SetDataPacketSize(input->packet, reply->actualSize);
-               } else {
-                  replyPayloadSize += reply->actualSize;
-               }
+            if (readUseDataBuffer) {
+               HSPU_SetDataPacketSize(input->packet, reply->actualSize);
+            } else {
+               replyPayloadSize += reply->actualSize;
             }
-         } else {
-            status = HGFS_ERROR_PROTOCOL;
-            LOG(4, ("%s: V3/V4 Failed to get payload -> PROTOCOL_ERROR.\n", __FUNCTION__));
          }
          break;
       }
@@ -6246,6 +7540,8 @@ HgfsServerRead(HgfsInputParam *input)  // IN: Input params
          status = HgfsPlatformReadFile(readFd, input->session, offset, requiredSize,
                                        reply->payload, &reply->actualSize);
          if (HGFS_ERROR_SUCCESS == status) {
+            HgfsServerReadAhead(file, readFd, input->session, offset,
+                                reply->actualSize);
             replyPayloadSize = sizeof *reply + reply->actualSize;
          } else {
             LOG(4, ("%s: V1 Failed to read-> %d.\n", __FUNCTION__, status));
@@ -6480,27 +7776,54 @@ HgfsServerWrite(HgfsInputParam *input)  // IN: Input params
    }
 
    if (writeSize > 0) {
+      HgfsVmxIov *dataIov = NULL;
+      uint32 dataIovCount = 0;
+
       if (NULL == writeData) {
-         /* No inline data to write, get it from the transport shared memory. */
+         /*
+          * No inline data to write, write it straight from the transport
+          * shared memory mappings without copying it to a contiguous buffer.
+          */
          HSPU_SetDataPacketSize(input->packet, writeSize);
-         writeData = HSPU_GetDataPacketBuf(input->packet, BUF_READABLE,
-                                           input->transportSession->channelCbTable);
-         if (NULL == writeData) {
+         dataIov = HSPU_GetDataPacketIov(input->packet, BUF_READABLE,
+                                         input->transportSession->channelCbTable,
+                                         &dataIovCount);
+         if (NULL == dataIov) {
             LOG(4, ("%s: Error: Op %d mapping write data buffer\n", __FUNCTION__, input->op));
             status = HGFS_ERROR_PROTOCOL;
             goto exit;
          }
       }
 
-      status = HgfsPlatformWriteFile(writeFd,
-                                     input->session,
-                                     writeOffset,
-                                     writeSize,
-                                     writeFlags,
-                                     writeSequential,
-                                     writeAppend,
-                                     writeData,
-                                     &writtenSize);
+      if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_WRITE_BEHIND_ENABLED) &&
+          !writeSequential && !writeAppend &&
+          0 == (writeFlags & HGFS_WRITE_APPEND) &&
+          HgfsWriteBehind_Write(input->session, writeFile, writeFd,
+                                writeOffset, writeSize, writeData,
+                                dataIov, dataIovCount, &writtenSize, &status)) {
+         /* Buffered or written out together with earlier writes. */
+      } else if (NULL == writeData) {
+         status = HgfsPlatformWriteFileIov(writeFd,
+                                           input->session,
+                                           writeOffset,
+                                           writeSize,
+                                           writeFlags,
+                                           writeSequential,
+                                           writeAppend,
+                                           dataIov,
+                                           dataIovCount,
+                                           &writtenSize);
+      } else {
+         status = HgfsPlatformWriteFile(writeFd,
+                                        input->session,
+                                        writeOffset,
+                                        writeSize,
+                                        writeFlags,
+                                        writeSequential,
+                                        writeAppend,
+                                        writeData,
+                                        &writtenSize);
+      }
       if (HGFS_ERROR_SUCCESS != status) {
          goto exit;
       }
@@ -6763,6 +8086,7 @@ HgfsSymlinkCreate(HgfsSessionInfo *session, // IN: session info,
       localTargetName[trgFileNameLength] = '\0';
 
       status = HgfsPlatformSymlinkCreate(localSymlinkName, localTargetName);
+      HgfsNameCacheInvalidate();
    }
 
    free(localSymlinkName);
@@ -7101,6 +8425,7 @@ HgfsServerRename(HgfsInputParam *input)  // IN: Input params
    if (HGFS_ERROR_SUCCESS == status) {
       status = HgfsPlatformRename(utf8OldName, srcFileDesc, utf8NewName,
          targetFileDesc, hints);
+      HgfsNameCacheInvalidate();
       if (HGFS_ERROR_SUCCESS == status) {
          /* Update all file nodes that refer to this file to contain the new name. */
          HgfsUpdateNodeNames(utf8OldName, utf8NewName, input->session);
@@ -7165,6 +8490,7 @@ HgfsServerCreateDir(HgfsInputParam *input)  // IN: Input params
           */
          if (shareInfo.writePermissions) {
             status = HgfsPlatformCreateDir(&info, utf8Name);
+            HgfsNameCacheInvalidate();
             if (HGFS_ERROR_SUCCESS == status) {
                if (!HgfsPackCreateDirReply(input->packet, input->request, info.requestType,
                                            &replyPayloadSize, input->session)) {
@@ -7293,6 +8619,7 @@ HgfsServerDeleteFile(HgfsInputParam *input)  // IN: Input params
          }
       }
       if (HGFS_ERROR_SUCCESS == status) {
+         HgfsNameCacheInvalidate();
          if (!HgfsPackDeleteReply(input->packet, input->request, input->op,
                                   &replyPayloadSize, input->session)) {
             status = HGFS_ERROR_INTERNAL;
@@ -7399,6 +8726,7 @@ HgfsServerDeleteDir(HgfsInputParam *input)  // IN: Input params
          }
       }
       if (HGFS_ERROR_SUCCESS == status) {
+         HgfsNameCacheInvalidate();
          if (!HgfsPackDeleteReply(input->packet, input->request, input->op,
                                   &replyPayloadSize, input->session)) {
             status = HGFS_ERROR_INTERNAL;
@@ -7642,24 +8970,205 @@ HgfsServerSetDirWatchByName(HgfsInputParam *input,         // IN: Input params
          status = HgfsPlatformConvertFromNameStatus(nameStatus);
       }
    } else {
-      LOG(4, ("%s: file not found.\n", __FUNCTION__));
-      status = HgfsPlatformConvertFromNameStatus(nameStatus);
+      LOG(4, ("%s: file not found.\n", __FUNCTION__));
+      status = HgfsPlatformConvertFromNameStatus(nameStatus);
+   }
+   free(utf8Name);
+   LOG(8, ("%s: exit %u\n",__FUNCTION__, status));
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerSetDirNotifyWatch --
+ *
+ *    Handle a set directory notification watch request.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerSetDirNotifyWatch(HgfsInputParam *input)  // IN: Input params
+{
+   const char *cpName;
+   size_t cpNameSize;
+   HgfsInternalStatus status;
+   HgfsHandle dir;
+   uint32 caseFlags;
+   size_t replyPayloadSize = 0;
+   uint32 flags;
+   uint32 events;
+   HgfsSubscriberHandle watchId = HGFS_INVALID_SUBSCRIBER_HANDLE;
+   Bool useHandle;
+
+   HGFS_ASSERT_INPUT(input);
+
+   LOG(8, ("%s: entered\n", __FUNCTION__));
+
+   /*
+    * If the active session does not support directory change notification - bail out
+    * with an error immediately.
+    * Clients are expected to check the session capabilities and flags but a malicious
+    * or broken client could still issue this to us.
+    */
+   if (0 == (input->session->flags & HGFS_SESSION_CHANGENOTIFY_ENABLED)) {
+      HgfsServerCompleteRequest(HGFS_ERROR_PROTOCOL, 0, input);
+      return;
+   }
+
+   if (HgfsUnpackSetWatchRequest(input->payload, input->payloadSize, input->op,
+                                 &useHandle, &cpName, &cpNameSize, &flags, &events,
+                                 &dir, &caseFlags)) {
+      Bool watchTree = 0 != (flags & HGFS_NOTIFY_FLAG_WATCH_TREE);
+      if (useHandle) {
+         status = HgfsServerSetDirWatchByHandle(input, dir, events, watchTree, &watchId);
+      } else {
+         status = HgfsServerSetDirWatchByName(input, cpName, cpNameSize, caseFlags,
+                                              events, watchTree, &watchId);
+      }
+      if (HGFS_ERROR_SUCCESS == status) {
+         if (!HgfsPackSetWatchReply(input->packet, input->request, input->op,
+                                    watchId, &replyPayloadSize, input->session)) {
+            status = HGFS_ERROR_INTERNAL;
+         }
+      }
+   } else {
+      status = HGFS_ERROR_PROTOCOL;
+   }
+
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+   LOG(8, ("%s: exit %u\n", __FUNCTION__, status));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerRemoveDirNotifyWatch --
+ *
+ *    Handle a remove directory notification watch request.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerRemoveDirNotifyWatch(HgfsInputParam *input)  // IN: Input params
+{
+   HgfsSubscriberHandle watchId;
+   HgfsInternalStatus status;
+   size_t replyPayloadSize = 0;
+
+   LOG(8, ("%s: entered\n", __FUNCTION__));
+   HGFS_ASSERT_INPUT(input);
+
+   /*
+    * If the active session does not support directory change notification - bail out
+    * with an error immediately.
+    * Clients are expected to check the session capabilities and flags but a malicious
+    * or broken client could still issue this to us.
+    */
+   if (0 == (input->session->flags & HGFS_SESSION_CHANGENOTIFY_ENABLED)) {
+      HgfsServerCompleteRequest(HGFS_ERROR_PROTOCOL, 0, input);
+      return;
+   }
+
+   if (HgfsUnpackRemoveWatchRequest(input->payload, input->payloadSize, input->op,
+                                    &watchId)) {
+      LOG(8, ("%s: remove subscriber on subscr id %"FMT64"x\n", __FUNCTION__, watchId));
+      if (HgfsNotify_RemoveSubscriber(watchId)) {
+         status = HGFS_ERROR_SUCCESS;
+      } else {
+         status = HGFS_ERROR_INTERNAL;
+      }
+      LOG(8, ("%s: remove subscriber on subscr id %"FMT64"x result %u\n", __FUNCTION__,
+               watchId, status));
+   } else {
+      status = HGFS_ERROR_PROTOCOL;
+   }
+   if (HGFS_ERROR_SUCCESS == status) {
+      if (!HgfsPackRemoveWatchReply(input->packet, input->request, input->op,
+         &replyPayloadSize, input->session)) {
+            status = HGFS_ERROR_INTERNAL;
+      }
+   }
+
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+   LOG(8, ("%s: exit result %u\n", __FUNCTION__, status));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerOplockBreakAck --
+ *
+ *    Handle the client's acknowledgement of an oplock break that the server
+ *    sent with HgfsServerSendOplockBreak. The acknowledgement carries the
+ *    lock the client kept, which completes the break or downgrade on the
+ *    host file.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerOplockBreakAck(HgfsInputParam *input)  // IN: Input params
+{
+   HgfsHandle file;
+   HgfsLockType replyLock;
+   HgfsInternalStatus status;
+
+   HGFS_ASSERT_INPUT(input);
+
+   if (0 == (input->session->flags & HGFS_SESSION_OPLOCK_ENABLED)) {
+      HgfsServerCompleteRequest(HGFS_ERROR_PROTOCOL, 0, input);
+      return;
+   }
+
+   if (HgfsUnpackOplockBreakAckReply(input->payload, input->payloadSize,
+                                     input->op, &file, &replyLock)) {
+      LOG(4, ("%s: break ack for file %u lock %d\n", __FUNCTION__, file,
+              replyLock));
+      HgfsServerOplockBreakReply(file, replyLock, input->session);
+      status = HGFS_ERROR_SUCCESS;
+   } else {
+      status = HGFS_ERROR_PROTOCOL;
    }
-   free(utf8Name);
-   LOG(8, ("%s: exit %u\n",__FUNCTION__, status));
-   return status;
+
+   HgfsServerCompleteRequest(status, 0, input);
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerSetDirNotifyWatch --
+ * HgfsServerCompoundMaxReply --
  *
- *    Handle a set directory notification watch request.
+ *    Find how much room the reply to a request of a compound request needs,
+ *    not counting read data which the read validates itself.
  *
  * Results:
- *    None.
+ *    The maximum reply size including the header, zero if the operation
+ *    cannot be part of a compound request.
  *
  * Side effects:
  *    None
@@ -7667,66 +9176,235 @@ HgfsServerSetDirWatchByName(HgfsInputParam *input,         // IN: Input params
  *-----------------------------------------------------------------------------
  */
 
-static void
-HgfsServerSetDirNotifyWatch(HgfsInputParam *input)  // IN: Input params
+static size_t
+HgfsServerCompoundMaxReply(HgfsOp op)  // IN: operation
 {
-   const char *cpName;
-   size_t cpNameSize;
-   HgfsInternalStatus status;
-   HgfsHandle dir;
-   uint32 caseFlags;
-   size_t replyPayloadSize = 0;
-   uint32 flags;
-   uint32 events;
-   HgfsSubscriberHandle watchId = HGFS_INVALID_SUBSCRIBER_HANDLE;
-   Bool useHandle;
+   size_t replySize;
 
-   HGFS_ASSERT_INPUT(input);
+   switch (op) {
+   case HGFS_OP_OPEN_V3:
+      replySize = sizeof (HgfsReplyOpenV3);
+      break;
+   case HGFS_OP_READ_V3:
+      replySize = sizeof (HgfsReplyReadV3);
+      break;
+   case HGFS_OP_WRITE_V3:
+      replySize = sizeof (HgfsReplyWriteV3);
+      break;
+   case HGFS_OP_GETATTR_V3:
+      /* The attributes are followed by the target name of a symlink. */
+      replySize = sizeof (HgfsReplyGetattrV3) + HGFS_PATH_MAX;
+      break;
+   case HGFS_OP_SETATTR_V3:
+      replySize = sizeof (HgfsReplySetattrV3);
+      break;
+   case HGFS_OP_CLOSE_V3:
+      replySize = sizeof (HgfsReplyCloseV3);
+      break;
+   default:
+      return 0;
+   }
+   return sizeof (HgfsHeader) + replySize;
+}
 
-   LOG(8, ("%s: entered\n", __FUNCTION__));
 
-   /*
-    * If the active session does not support directory change notification - bail out
-    * with an error immediately.
-    * Clients are expected to check the session capabilities and flags but a malicious
-    * or broken client could still issue this to us.
-    */
-   if (0 == (input->session->flags & HGFS_SESSION_CHANGENOTIFY_ENABLED)) {
-      HgfsServerCompleteRequest(HGFS_ERROR_PROTOCOL, 0, input);
-      return;
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCompoundChainHandle --
+ *
+ *    Replace the chained handle placeholder of a request of a compound
+ *    request with the handle of the file opened earlier in the request.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS, or HGFS_ERROR_INVALID_HANDLE if the request is
+ *    chained but no file was opened.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsServerCompoundChainHandle(HgfsOp op,                  // IN: operation
+                              void *payload,              // IN/OUT: op arguments
+                              size_t payloadSize,         // IN: op arguments size
+                              HgfsHandle chainedHandle)   // IN: last opened file
+{
+   /* The requests are packed, so the handle is copied in and out. */
+   char *fileField = NULL;
+   HgfsHandle file;
+
+   switch (op) {
+   case HGFS_OP_READ_V3:
+      if (payloadSize >= sizeof (HgfsRequestReadV3)) {
+         fileField = (char *)payload + offsetof(HgfsRequestReadV3, file);
+      }
+      break;
+   case HGFS_OP_WRITE_V3:
+      if (payloadSize >= sizeof (HgfsRequestWriteV3) - 1) {
+         fileField = (char *)payload + offsetof(HgfsRequestWriteV3, file);
+      }
+      break;
+   case HGFS_OP_GETATTR_V3:
+      if (payloadSize >= sizeof (HgfsRequestGetattrV3)) {
+         fileField = (char *)payload + offsetof(HgfsRequestGetattrV3, fileName) +
+                     offsetof(HgfsFileNameV3, fid);
+      }
+      break;
+   case HGFS_OP_SETATTR_V3:
+      if (payloadSize >= sizeof (HgfsRequestSetattrV3)) {
+         fileField = (char *)payload + offsetof(HgfsRequestSetattrV3, fileName) +
+                     offsetof(HgfsFileNameV3, fid);
+      }
+      break;
+   case HGFS_OP_CLOSE_V3:
+      if (payloadSize >= sizeof (HgfsRequestCloseV3)) {
+         fileField = (char *)payload + offsetof(HgfsRequestCloseV3, file);
+      }
+      break;
+   default:
+      break;
    }
 
-   if (HgfsUnpackSetWatchRequest(input->payload, input->payloadSize, input->op,
-                                 &useHandle, &cpName, &cpNameSize, &flags, &events,
-                                 &dir, &caseFlags)) {
-      Bool watchTree = 0 != (flags & HGFS_NOTIFY_FLAG_WATCH_TREE);
-      if (useHandle) {
-         status = HgfsServerSetDirWatchByHandle(input, dir, events, watchTree, &watchId);
-      } else {
-         status = HgfsServerSetDirWatchByName(input, cpName, cpNameSize, caseFlags,
-                                              events, watchTree, &watchId);
+   if (NULL == fileField) {
+      return HGFS_ERROR_SUCCESS;
+   }
+
+   memcpy(&file, fileField, sizeof file);
+   if (HGFS_COMPOUND_CHAINED_HANDLE == file) {
+      if (HGFS_INVALID_HANDLE == chainedHandle) {
+         return HGFS_ERROR_INVALID_HANDLE;
       }
-      if (HGFS_ERROR_SUCCESS == status) {
-         if (!HgfsPackSetWatchReply(input->packet, input->request, input->op,
-                                    watchId, &replyPayloadSize, input->session)) {
-            status = HGFS_ERROR_INTERNAL;
-         }
+      memcpy(fileField, &chainedHandle, sizeof chainedHandle);
+   }
+   return HGFS_ERROR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCompoundProcess --
+ *
+ *    Process one request of a compound request with the regular handler,
+ *    placing its reply in the compound reply.
+ *
+ * Results:
+ *    Size of the reply, zero if there is no room for it. The status of the
+ *    request is returned in status.
+ *
+ * Side effects:
+ *    The chained handle is updated by a successful open.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static size_t
+HgfsServerCompoundProcess(HgfsInputParam *input,        // IN: compound request
+                          char *request,                // IN/OUT: request copy
+                          size_t requestSize,           // IN: request size
+                          char *reply,                  // OUT: reply buffer
+                          size_t replySpace,            // IN: reply buffer size
+                          HgfsHandle *chainedHandle,    // IN/OUT: last opened file
+                          HgfsInternalStatus *status)   // OUT: request status
+{
+   HgfsInputParam subInput;
+   HgfsPacket subPacket;
+   HgfsInternalStatus subStatus;
+   Bool sessionEnabled;
+   uint64 sessionId = HGFS_INVALID_SESSION_ID;
+   uint32 requestId;
+   HgfsOp op;
+   const void *payload;
+   size_t payloadSize;
+   size_t maxReply;
+
+   subStatus = HgfsUnpackPacketParams(request, requestSize, &sessionEnabled,
+                                      &sessionId, &requestId, &op,
+                                      &payloadSize, &payload);
+   if (HGFS_ERROR_INTERNAL == subStatus || !sessionEnabled) {
+      /* Without a valid header the request cannot be replied to. */
+      *status = HGFS_ERROR_PROTOCOL;
+      return 0;
+   }
+
+   maxReply = HgfsServerCompoundMaxReply(op);
+   if (replySpace < MAX(maxReply, sizeof (HgfsHeader))) {
+      LOG(4, ("%s: no room for the reply to op %d\n", __FUNCTION__, op));
+      *status = HGFS_ERROR_SUCCESS;
+      return 0;
+   }
+
+   if (HGFS_ERROR_SUCCESS == subStatus) {
+      if (0 == maxReply ||
+          payloadSize < handlers[op].minReqSize) {
+         LOG(4, ("%s: op %d not allowed in a compound request\n",
+                 __FUNCTION__, op));
+         subStatus = HGFS_ERROR_PROTOCOL;
+      } else if (sessionId != input->session->sessionId) {
+         subStatus = HGFS_ERROR_STALE_SESSION;
+      } else {
+         subStatus = HgfsServerCompoundChainHandle(op, (void *)payload,
+                                                   payloadSize, *chainedHandle);
       }
+   }
+
+   memset(&subPacket, 0, sizeof subPacket);
+   subPacket.id = input->packet->id;
+   subPacket.metaPacketSize = requestSize;
+   subPacket.metaPacketDataSize = requestSize;
+   subPacket.replyPacket = reply;
+   subPacket.replyPacketSize = replySpace;
+
+   memset(&subInput, 0, sizeof subInput);
+   subInput.request = request;
+   subInput.requestSize = requestSize;
+   subInput.session = input->session;
+   subInput.transportSession = input->transportSession;
+   subInput.packet = &subPacket;
+   subInput.payload = payload;
+   subInput.payloadOffset = (const char *)payload - request;
+   subInput.payloadSize = payloadSize;
+   subInput.op = op;
+   subInput.id = requestId;
+   subInput.sessionEnabled = TRUE;
+   subInput.compound = TRUE;
+   subInput.startTime = Hostinfo_SystemTimerUS();
+
+   if (HGFS_ERROR_SUCCESS == subStatus) {
+      (*handlers[op].handler)(&subInput);
    } else {
-      status = HGFS_ERROR_PROTOCOL;
+      HgfsServerCompleteRequest(subStatus, 0, &subInput);
    }
 
-   HgfsServerCompleteRequest(status, replyPayloadSize, input);
-   LOG(8, ("%s: exit %u\n", __FUNCTION__, status));
+   *status = subInput.compoundStatus;
+   if (HGFS_OP_OPEN_V3 == op && HGFS_ERROR_SUCCESS == *status &&
+       subInput.compoundReplySize >= sizeof (HgfsHeader) +
+                                     sizeof (HgfsReplyOpenV3)) {
+      const HgfsReplyOpenV3 *openReply =
+         (const HgfsReplyOpenV3 *)(reply + sizeof (HgfsHeader));
+
+      *chainedHandle = openReply->file;
+   }
+   return subInput.compoundReplySize;
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerRemoveDirNotifyWatch --
+ * HgfsServerCompound --
  *
- *    Handle a remove directory notification watch request.
+ *    Handle a compound request. The requests it carries are processed in
+ *    order with the regular handlers and their replies are sent back
+ *    together, so that e.g. reading a small file takes a single round trip
+ *    instead of one each for the open, read and close.
+ *
+ *    Processing stops after the first request that fails, or when there is
+ *    no room left for the next reply, in which case the client sends the
+ *    remaining requests again.
  *
  * Results:
  *    None.
@@ -7738,48 +9416,107 @@ HgfsServerSetDirNotifyWatch(HgfsInputParam *input)  // IN: Input params
  */
 
 static void
-HgfsServerRemoveDirNotifyWatch(HgfsInputParam *input)  // IN: Input params
+HgfsServerCompound(HgfsInputParam *input)  // IN: Input params
 {
-   HgfsSubscriberHandle watchId;
-   HgfsInternalStatus status;
+   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
    size_t replyPayloadSize = 0;
+   HgfsHandle chainedHandle = HGFS_INVALID_HANDLE;
+   HgfsReplyCompoundV4 *reply;
+   const void *requests;
+   size_t requestsSize;
+   char *requestsCopy = NULL;
+   char *cursor;
+   size_t replyCapacity;
+   size_t replyUsed;
+   uint32 numRequests;
+   uint32 numReplies = 0;
+   uint32 i;
 
-   LOG(8, ("%s: entered\n", __FUNCTION__));
    HGFS_ASSERT_INPUT(input);
 
+   if (!input->sessionEnabled ||
+       !HgfsUnpackCompoundRequest(input->payload, input->payloadSize, input->op,
+                                  &numRequests, &requests, &requestsSize)) {
+      status = HGFS_ERROR_PROTOCOL;
+      goto exit;
+   }
+
    /*
-    * If the active session does not support directory change notification - bail out
-    * with an error immediately.
-    * Clients are expected to check the session capabilities and flags but a malicious
-    * or broken client could still issue this to us.
+    * Shared memory channels place the reply over the request, so the
+    * requests are processed from a copy. The copy is also where chained
+    * handles are filled in.
     */
-   if (0 == (input->session->flags & HGFS_SESSION_CHANGENOTIFY_ENABLED)) {
-      HgfsServerCompleteRequest(HGFS_ERROR_PROTOCOL, 0, input);
-      return;
+   requestsCopy = Util_SafeMalloc(requestsSize);
+   memcpy(requestsCopy, requests, requestsSize);
+
+   if (NULL != input->packet->replyPacket) {
+      replyCapacity = input->packet->replyPacketSize;
+   } else if (NULL != input->transportSession->channelCbTable->getWriteVa) {
+      replyCapacity = input->packet->metaPacketSize;
+   } else {
+      replyCapacity = input->session->maxPacketSize;
+   }
+   if (replyCapacity < sizeof (HgfsHeader) + sizeof *reply) {
+      status = HGFS_ERROR_INTERNAL;
+      goto exit;
    }
+   replyCapacity -= sizeof (HgfsHeader);
 
-   if (HgfsUnpackRemoveWatchRequest(input->payload, input->payloadSize, input->op,
-                                    &watchId)) {
-      LOG(8, ("%s: remove subscriber on subscr id %"FMT64"x\n", __FUNCTION__, watchId));
-      if (HgfsNotify_RemoveSubscriber(watchId)) {
-         status = HGFS_ERROR_SUCCESS;
-      } else {
-         status = HGFS_ERROR_INTERNAL;
+   reply = HgfsAllocInitReply(input->packet, input->request, replyCapacity,
+                              input->session);
+   replyUsed = sizeof *reply;
+
+   cursor = requestsCopy;
+   for (i = 0; i < numRequests; i++) {
+      const HgfsHeader *header = (const HgfsHeader *)cursor;
+      HgfsInternalStatus subStatus;
+      size_t requestSize;
+      size_t subReplySize;
+
+      if (requestsSize < sizeof *header ||
+          header->packetSize < sizeof *header ||
+          header->packetSize > requestsSize) {
+         LOG(4, ("%s: malformed request %u\n", __FUNCTION__, i));
+         if (0 == numReplies) {
+            status = HGFS_ERROR_PROTOCOL;
+         }
+         break;
       }
-      LOG(8, ("%s: remove subscriber on subscr id %"FMT64"x result %u\n", __FUNCTION__,
-               watchId, status));
-   } else {
-      status = HGFS_ERROR_PROTOCOL;
+      requestSize = header->packetSize;
+
+      subReplySize = HgfsServerCompoundProcess(input, cursor, requestSize,
+                                               (char *)reply + replyUsed,
+                                               replyCapacity - replyUsed,
+                                               &chainedHandle, &subStatus);
+      if (0 == subReplySize) {
+         if (0 == numReplies && HGFS_ERROR_SUCCESS != subStatus) {
+            status = subStatus;
+         }
+         break;
+      }
+
+      numReplies++;
+      replyUsed += subReplySize;
+      if (HGFS_ERROR_SUCCESS != subStatus) {
+         break;
+      }
+      cursor += requestSize;
+      requestsSize -= requestSize;
    }
+
+   LOG(4, ("%s: processed %u of %u requests\n", __FUNCTION__, numReplies,
+           numRequests));
+
    if (HGFS_ERROR_SUCCESS == status) {
-      if (!HgfsPackRemoveWatchReply(input->packet, input->request, input->op,
-         &replyPayloadSize, input->session)) {
-            status = HGFS_ERROR_INTERNAL;
-      }
+      reply->numReplies = numReplies;
+      reply->reserved1 = 0;
+      reply->reserved2 = 0;
+      replyPayloadSize = replyUsed;
    }
 
+exit:
+   free(requestsCopy);
    HgfsServerCompleteRequest(status, replyPayloadSize, input);
-   LOG(8, ("%s: exit result %u\n", __FUNCTION__, status));
 }
 
 
@@ -7827,6 +9564,7 @@ HgfsServerGetattr(HgfsInputParam *input)  // IN: Input params
          fileDesc fd;
 
          targetNameLen = 0;
+         HgfsWriteBehind_Flush(input->session, file);
          status = HgfsPlatformGetFd(file, input->session, FALSE, &fd);
          if (HGFS_ERROR_SUCCESS == status) {
             status = HgfsPlatformGetattrFromFd(fd, input->session, &attr);
@@ -7860,6 +9598,8 @@ HgfsServerGetattr(HgfsInputParam *input)  // IN: Input params
             nameStatus = HgfsServerPolicy_GetShareOptions(cpName, cpNameSize,
                                                           &configOptions);
             if (HGFS_NAME_STATUS_COMPLETE == nameStatus) {
+               /* The size and times must include buffered writes. */
+               HgfsWriteBehind_FlushSession(NULL);
                status = HgfsPlatformGetattrFromName(localName, configOptions, (char *)cpName, &attr,
                                                     &targetName);
             } else {
@@ -7952,6 +9692,7 @@ HgfsServerSetattr(HgfsInputParam *input)  // IN: Input params
       if (hints & HGFS_ATTR_HINT_USE_FILE_DESC) {
          if (HgfsHandle2ShareMode(file, input->session, &shareMode)) {
             if (HGFS_OPEN_MODE_READ_ONLY != shareMode) {
+               HgfsWriteBehind_Flush(input->session, file);
                status = HgfsPlatformSetattrFromFd(file,
                                                   input->session,
                                                   &attr,
@@ -7980,6 +9721,9 @@ HgfsServerSetattr(HgfsInputParam *input)  // IN: Input params
             HgfsLockType serverLock = HGFS_LOCK_NONE;
             HgfsShareOptions configOptions;
 
+            /* A truncate must not be overtaken by buffered writes. */
+            HgfsWriteBehind_FlushSession(NULL);
+
             /*
              * XXX: If the client has an oplock on this file, it must reuse the
              * handle for the oplocked node (or break the oplock) prior to making
@@ -8193,12 +9937,21 @@ HgfsServerOpen(HgfsInputParam *input)  // IN: Input params
           */
          if (!HgfsFileHasServerLock(openInfo.utf8Name, input->session, &serverLock,
                                     &fileDesc)) {
+            /* An open that truncates must not be overtaken by buffered writes. */
+            HgfsWriteBehind_FlushSession(NULL);
+
             /* See if the name is valid, and if so add it and return the handle. */
             status = HgfsPlatformValidateOpen(&openInfo, followSymlinks, input->session,
                                               &localId, &newHandle);
             if (status == HGFS_ERROR_SUCCESS) {
                ASSERT(newHandle >= 0);
 
+               if ((openInfo.mask & HGFS_OPEN_VALID_FLAGS) &&
+                   openInfo.flags != HGFS_OPEN &&
+                   openInfo.flags != HGFS_OPEN_EMPTY) {
+                  HgfsNameCacheInvalidate();
+               }
+
                /*
                 * Open succeeded, so make new node and return its handle. If we fail,
                 * it's almost certainly an internal server error.
@@ -8583,6 +10336,8 @@ HgfsServerSearchRead(HgfsInputParam *input)  // IN: Input params
          LOG(4, ("%s: Op %d reply buffer failure\n", __FUNCTION__, input->op));
          status = HGFS_ERROR_PROTOCOL;
       } else {
+         /* The sizes and times of the entries must include buffered writes. */
+         HgfsWriteBehind_FlushSession(NULL);
 
          if (HgfsGetSearchCopy(hgfsSearchHandle, input->session, &search)) {
             /* Get the config options. */
@@ -8635,6 +10390,7 @@ HgfsServerSearchRead(HgfsInputParam *input)  // IN: Input params
                                           &info,
                                           &replyInfoSize,
                                           &replyDirentSize);
+               HgfsPlatformCloseSearchDir(&search);
             }
 
             if (HGFS_ERROR_SUCCESS == status) {
@@ -8661,6 +10417,50 @@ HgfsServerSearchRead(HgfsInputParam *input)  // IN: Input params
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerOplockActivate --
+ *
+ *    Set up the oplock lease monitoring the first time a session is granted
+ *    oplocks. If it cannot be set up, oplocks are disabled for good.
+ *
+ * Results:
+ *    TRUE if oplocks can be granted, FALSE otherwise.
+ *
+ * Side effects:
+ *    The platform code may install a signal handler and start a thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsServerOplockActivate(void)
+{
+   static Atomic_Ptr lckStorage;
+   MXUserExclLock *lck = MXUser_CreateSingletonExclLock(&lckStorage,
+                                                        "hgfsOplockActivateLock",
+                                                        RANK_LEAF);
+   Bool result;
+
+   MXUser_AcquireExclLock(lck);
+   if (!gHgfsOplockActive &&
+       0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_OPLOCK_ENABLED)) {
+      if (HgfsServerOplockInit()) {
+         gHgfsOplockActive = TRUE;
+      } else {
+         LOG(4, ("%s: could not set up oplocks, disabling them\n",
+                 __FUNCTION__));
+         gHgfsCfgSettings.flags &= ~HGFS_CONFIG_OPLOCK_ENABLED;
+      }
+   }
+   result = gHgfsOplockActive;
+   MXUser_ReleaseExclLock(lck);
+
+   return result;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -8712,11 +10512,17 @@ HgfsServerCreateSession(HgfsInputParam *input)  // IN: Input params
       /*
        * If the server is enabled for processing oplocks and the client
        * is requesting to use them, then report back to the client oplocks
-       * are enabled by propagating the session flag.
+       * are enabled by propagating the session flag. Breaks are sent to the
+       * client unsolicited, which only shared memory channels can carry.
        */
       if ((0 != (info.flags & HGFS_SESSION_OPLOCK_ENABLED)) &&
-          (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_OPLOCK_ENABLED))) {
+          (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_OPLOCK_ENABLED)) &&
+          (0 != (input->transportSession->channelCapabilities.flags &
+                 HGFS_CHANNEL_SHARED_MEM)) &&
+          HgfsServerOplockActivate()) {
          session->flags |= HGFS_SESSION_OPLOCK_ENABLED;
+         HgfsServerSetSessionCapability(HGFS_OP_OPLOCK_BREAK_V4,
+                                        HGFS_REQUEST_SUPPORTED, session);
       }
 
       if (HgfsPackCreateSessionReply(input->packet, input->request,
@@ -8987,6 +10793,80 @@ exit:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerSendOplockBreak --
+ *
+ *    Called by the oplock component when the host file system wants to break
+ *    or downgrade a lock held by the client.
+ *
+ *    The function builds an oplock break request packet and queues it to be
+ *    sent to the client. The client acknowledges it with an oplock break
+ *    request of its own, which is handled by HgfsServerOplockBreakAck.
+ *
+ * Results:
+ *    TRUE if the break was queued to the client, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsServerSendOplockBreak(HgfsHandle file,           // IN: file to break
+                          HgfsLockType serverLock,   // IN: lock to downgrade to
+                          HgfsSessionInfo *session)  // IN: session info
+{
+   HgfsPacket *packet = NULL;
+   HgfsHeader *packetHeader = NULL;
+   size_t sizeNeeded;
+   Bool result = FALSE;
+
+   LOG(4, ("%s: break file %u to lock %d\n", __FUNCTION__, file, serverLock));
+
+   if (session->state == HGFS_SESSION_STATE_CLOSED) {
+      LOG(4, ("%s: session has been closed drop the break %"FMT64"x\n",
+              __FUNCTION__, session->sessionId));
+      goto exit;
+   }
+
+   sizeNeeded = HgfsPackGetOplockBreakSize();
+
+   /*
+    * As with notifications, the packet and metapacket share a single buffer
+    * which is released by the send complete callback.
+    */
+   packet = Util_SafeCalloc(1, sizeof *packet + sizeNeeded);
+   packetHeader = (HgfsHeader *)((char *)packet + sizeof *packet);
+   packet->metaPacketSize = sizeNeeded;
+   packet->metaPacketDataSize = packet->metaPacketSize;
+   packet->metaPacket = packetHeader;
+
+   if (!HgfsPackOplockBreakRequest(packetHeader, file, serverLock,
+                                   session->sessionId, &sizeNeeded)) {
+      LOG(4, ("%s: failed to pack oplock break request\n", __FUNCTION__));
+      goto exit;
+   }
+
+   if (!HgfsPacketSend(packet, session->transportSession, 0)) {
+      LOG(4, ("%s: failed to send oplock break to the client\n", __FUNCTION__));
+      goto exit;
+   }
+
+   /* The transport will call the server send complete callback to release the packets. */
+   packet = NULL;
+   result = TRUE;
+
+exit:
+   if (packet) {
+      free(packet);
+   }
+   return result;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
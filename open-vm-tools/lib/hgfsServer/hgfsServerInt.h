@@ -38,6 +38,8 @@ struct DirectoryEntry;
 #include "hgfsUtil.h"   // for HgfsInternalStatus
 #include "vm_atomic.h"
 #include "userlock.h"
+#include "hashMap.h"
+#include "hashTable.h"
 #include "hgfsServer.h" // for the server public types
 
 #define HGFS_DEBUG_ASYNC   (0)
@@ -173,6 +175,18 @@ typedef struct HgfsFileNode {
 
    /* Parameters associated with the share. */
    HgfsShareInfo shareInfo;
+
+   /* Sequential read detection: offset following the last read. */
+   uint64 readAheadNext;
+
+   /* End of the file range already advised for readahead. */
+   uint64 readAheadEnd;
+
+   /* Current readahead window size, zero when not streaming. */
+   uint32 readAheadWindow;
+
+   /* Position of the node in the session's nodeShareIndex entry. */
+   uint32 shareSlot;
 } HgfsFileNode;
 
 
@@ -229,8 +243,23 @@ typedef struct HgfsSearch {
 
    /* Parameters associated with the share. */
    HgfsShareInfo shareInfo;
+
+   /*
+    * Directory handle that entry attributes are retrieved relative to while
+    * a search read is in progress. Only a search copy ever has one open.
+    */
+   fileDesc dirFd;
+
+   /*
+    * Position of the search in the session's searchShareIndex entry, or
+    * HGFS_SHARE_SLOT_NONE for searches of the base name space.
+    */
+   uint32 shareSlot;
 } HgfsSearch;
 
+/* Slot of an object that is not in a share index. */
+#define HGFS_SHARE_SLOT_NONE  MAX_UINT32
+
 /* HgfsSearch flags. */
 
 /* TRUE if opened in append mode */
@@ -279,8 +308,8 @@ typedef struct HgfsSessionInfo {
    /*
     ** START NODE ARRAY **************************************************
     *
-    * Lock for the following 6 fields: the node array,
-    * counters and lists for this session.
+    * Lock for the following 12 fields: the node array,
+    * counters, lists and indexes for this session.
     */
    MXUserExclLock *nodeArrayLock;
 
@@ -290,24 +319,38 @@ typedef struct HgfsSessionInfo {
    /* Number of nodes in the nodeArray. */
    uint32 numNodes;
 
+   /* In-use nodes keyed by HgfsHandle, data is the index into nodeArray. */
+   HashMap *nodeIndex;
+
+   /* In-use nodes grouped by share root directory (HgfsShareObjects). */
+   HashTable *nodeShareIndex;
+
    /* Free list of file nodes. LIFO to be cache-friendly. */
    DblLnkLst_Links nodeFreeList;
 
-   /* List of cached open nodes. */
+   /* List of cached open nodes that can be evicted, in LRU order. */
    DblLnkLst_Links nodeCachedList;
 
-   /* Current number of open nodes. */
+   /* List of cached open nodes that must stay open (see HgfsIsNodePinned). */
+   DblLnkLst_Links nodePinnedList;
+
+   /* Current number of open nodes, on both lists. */
    unsigned int numCachedOpenNodes;
 
    /* Number of open nodes having server locks. */
    unsigned int numCachedLockedNodes;
+
+   /* Open node cache statistics. */
+   uint32 numCacheHits;
+   uint32 numCacheMisses;
+   uint32 numCacheEvictions;
    /** END NODE ARRAY ****************************************************/
 
    /*
     ** START SEARCH ARRAY ************************************************
     *
-    * Lock for the following three fields: for the search array
-    * and it's counter and list, for this session.
+    * Lock for the following five fields: for the search array
+    * and it's counter, list and indexes, for this session.
     */
    MXUserExclLock *searchArrayLock;
 
@@ -317,6 +360,12 @@ typedef struct HgfsSessionInfo {
    /* Number of entries in searchArray. */
    uint32 numSearches;
 
+   /* In-use searches keyed by HgfsHandle, data is the index into searchArray. */
+   HashMap *searchIndex;
+
+   /* In-use searches grouped by share root directory (HgfsShareObjects). */
+   HashTable *searchShareIndex;
+
    /* Free list of searches. LIFO. */
    DblLnkLst_Links searchFreeList;
    /** END SEARCH ARRAY ****************************************************/
@@ -620,6 +669,11 @@ HgfsUpdateNodeServerLock(fileDesc fd,                // IN: OS handle
                          HgfsSessionInfo *session,   // IN: session info
                          HgfsLockType serverLock);   // IN: new oplock
 
+Bool
+HgfsServerSendOplockBreak(HgfsHandle file,           // IN: file to break
+                          HgfsLockType serverLock,   // IN: lock to downgrade to
+                          HgfsSessionInfo *session); // IN: session info
+
 Bool
 HgfsUpdateNodeAppendFlag(HgfsHandle handle,        // IN: Hgfs file handle
                          HgfsSessionInfo *session, // IN: session info
@@ -664,9 +718,17 @@ Bool
 HgfsPlatformInit(void);
 void
 HgfsPlatformDestroy(void);
+uint32
+HgfsPlatformGetOpenFileLimit(void);
+void
+HgfsPlatformReadAhead(fileDesc fileDesc,             // IN: OS handle of the file
+                      uint64 offset,                 // IN: start of range
+                      uint32 length);                // IN: length of range
 HgfsInternalStatus
 HgfsPlatformCloseFile(fileDesc fileDesc,            // IN: OS handle of the file
                       void *fileCtx);               // IN: file context
+HgfsInternalStatus
+HgfsPlatformSyncFile(fileDesc fileDesc);            // IN: OS handle of the file
 Bool
 HgfsPlatformDoFilenameLookup(void);
 HgfsNameStatus
@@ -735,6 +797,8 @@ HgfsInternalStatus
 HgfsPlatformRestartSearchDir(HgfsHandle handle,               // IN: search handle
                              HgfsSessionInfo *session,        // IN: session info
                              DirectorySearchType searchType); // IN: Kind of search
+void
+HgfsPlatformCloseSearchDir(HgfsSearch *search);       // IN/OUT: search copy
 #ifdef VMX86_LOG
 void
 HgfsPlatformDirDumpDents(HgfsSearch *search);         // IN: search
@@ -758,6 +822,25 @@ HgfsPlatformWriteFile(fileDesc writeFile,          // IN: file descriptor
                       const void *writeData,       // IN: data to be written
                       uint32 *writtenSize);        // OUT: byte length written
 HgfsInternalStatus
+HgfsPlatformReadFileIov(fileDesc readFile,           // IN: file descriptor
+                        HgfsSessionInfo *session,    // IN: session info
+                        uint64 offset,               // IN: file offset to read from
+                        uint32 requiredSize,         // IN: length of data to read
+                        HgfsVmxIov *iov,             // IN: mapped iovs to read into
+                        uint32 iovCount,             // IN: mapped iov count
+                        uint32 *actualSize);         // OUT: actual length read
+HgfsInternalStatus
+HgfsPlatformWriteFileIov(fileDesc writeFile,          // IN: file descriptor
+                         HgfsSessionInfo *session,    // IN: session info
+                         uint64 writeOffset,          // IN: file offset to write to
+                         uint32 writeDataSize,        // IN: length of data to write
+                         HgfsWriteFlags writeFlags,   // IN: write flags
+                         Bool writeSequential,        // IN: write is sequential
+                         Bool writeAppend,            // IN: write is appended
+                         HgfsVmxIov *iov,             // IN: mapped iovs of data
+                         uint32 iovCount,             // IN: mapped iov count
+                         uint32 *writtenSize);        // OUT: byte length written
+HgfsInternalStatus
 HgfsPlatformWriteWin32Stream(HgfsHandle file,           // IN: packet header
                              char *dataToWrite,         // IN: data to write
                              size_t requiredSize,       // IN: data size
@@ -847,6 +930,12 @@ HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
                       MappingType mappingType,              // IN: Readable/ Writeable ?
                       HgfsServerChannelCallbacks *chanCb);  // IN: Channel callbacks
 
+HgfsVmxIov *
+HSPU_GetDataPacketIov(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
+                      MappingType mappingType,              // IN: Readable/ Writeable ?
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      uint32 *iovCount);                    // OUT: mapped iov count
+
 void
 HSPU_SetDataPacketSize(HgfsPacket *packet,            // IN/OUT: Hgfs Packet
                        size_t dataSize);              // IN: data size
@@ -44,6 +44,7 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <sys/resource.h> // for getrlimit
+#include <sys/uio.h>      // for readv/preadv
 
 #if defined(__FreeBSD__)
 #   include <sys/param.h>
@@ -67,6 +68,10 @@
 #include "codeset.h"
 #include "unicodeOperations.h"
 #include "userlock.h"
+#include "mutexRankLib.h"
+#if defined(__linux__)
+#include "hgfsServerWriteBehind.h"
+#endif
 
 #if defined(linux) && !defined(SYS_getdents64)
 /* For DT_UNKNOWN */
@@ -285,6 +290,12 @@ struct FInfoAttrBuf {
  */
 #define DELETE                           (0x00010000L)
 
+/*
+ * Number of iovec entries described on the stack for vectored IO, enough for
+ * a full large packet of page sized guest mappings.
+ */
+#define HGFS_IOVEC_STACK_COUNT           (HGFS_LARGE_PACKET_MAX / PAGE_SIZE + 2)
+
 /*
  * Server open flags, indexed by HgfsOpenFlags. Stolen from
  * lib/fileIOPosix.c
@@ -313,6 +324,40 @@ static const int HgfsServerOpenMode[] = {
    O_RDWR,
 };
 
+/*
+ * Directory listing snapshots shared by all searches of all sessions. A
+ * snapshot is reused while the directory identity and modification time are
+ * unchanged. Directories modified within the last HGFS_DIR_SNAPSHOT_SETTLE_SEC
+ * seconds of the listing are not cached, as a change in the same timestamp
+ * tick would go unnoticed. Small directories are cheap to read and are not
+ * cached at all.
+ */
+#define HGFS_DIR_SNAPSHOT_MAX            16
+#define HGFS_DIR_SNAPSHOT_MIN_DENTS      64
+#define HGFS_DIR_SNAPSHOT_SETTLE_SEC     1
+
+#if defined(__APPLE__)
+#define HGFS_STAT_MTIME_NSEC(st)         ((st)->st_mtimespec.tv_nsec)
+#else
+#define HGFS_STAT_MTIME_NSEC(st)         ((st)->st_mtim.tv_nsec)
+#endif
+
+typedef struct HgfsDirSnapshot {
+   DblLnkLst_Links links;              /* Most recently used is first. */
+   char *path;
+   Bool followSymlinks;
+   dev_t dev;
+   ino_t ino;
+   time_t mtime;
+   long mtimeNsec;
+   int numDents;
+   DirectoryEntry **dents;
+} HgfsDirSnapshot;
+
+static MXUserExclLock *gHgfsDirSnapshotLock = NULL;
+static DblLnkLst_Links gHgfsDirSnapshots;
+static uint32 gHgfsNumDirSnapshots = 0;
+
 /* Local functions. */
 static HgfsInternalStatus HgfsGetattrResolveAlias(char const *fileName,
                                                   char **targetName);
@@ -328,6 +373,8 @@ static int HgfsFStat(int fd,
                      struct stat *stats,
                      uint64 *creationTime);
 
+static void HgfsDirSnapshotFree(HgfsDirSnapshot *snapshot);
+
 static void HgfsGetSequentialOnlyFlagFromName(const char *fileName,
                                               Bool followSymlinks,
                                               HgfsFileAttrInfo *attr);
@@ -555,6 +602,10 @@ HgfsServerGetOpenFlags(HgfsOpenFlags flagsIn, // IN
 Bool
 HgfsPlatformInit(void)
 {
+   gHgfsDirSnapshotLock = MXUser_CreateExclLock("hgfsDirSnapshotLock",
+                                                RANK_hgfsDirSnapshotLock);
+   DblLnkLst_Init(&gHgfsDirSnapshots);
+   gHgfsNumDirSnapshots = 0;
    return TRUE;
 }
 
@@ -578,6 +629,94 @@ HgfsPlatformInit(void)
 void
 HgfsPlatformDestroy(void)
 {
+   DblLnkLst_Links *link, *nextLink;
+
+   if (gHgfsDirSnapshotLock == NULL) {
+      return;
+   }
+
+   DblLnkLst_ForEachSafe(link, nextLink, &gHgfsDirSnapshots) {
+      HgfsDirSnapshotFree(DblLnkLst_Container(link, HgfsDirSnapshot, links));
+   }
+   gHgfsNumDirSnapshots = 0;
+   MXUser_DestroyExclLock(gHgfsDirSnapshotLock);
+   gHgfsDirSnapshotLock = NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformGetOpenFileLimit --
+ *
+ *      Get the maximum number of file descriptors this process may open.
+ *
+ * Results:
+ *      The soft RLIMIT_NOFILE limit, or 0 if it cannot be determined.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+uint32
+HgfsPlatformGetOpenFileLimit(void)
+{
+   struct rlimit openFiles;
+
+   if (getrlimit(RLIMIT_NOFILE, &openFiles) < 0) {
+      LOG(4, ("%s: Could not get open file limit\n", __FUNCTION__));
+      return 0;
+   }
+
+   if (openFiles.rlim_cur == RLIM_INFINITY || openFiles.rlim_cur > MAX_UINT32) {
+      return MAX_UINT32;
+   }
+
+   return (uint32)openFiles.rlim_cur;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformReadAhead --
+ *
+ *      Hint that a range of the file will be read soon so that the kernel
+ *      starts reading it in before the client asks for it.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Asynchronous IO may be started on the file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsPlatformReadAhead(fileDesc fileDesc,   // IN: OS handle of the file
+                      uint64 offset,       // IN: start of range
+                      uint32 length)       // IN: length of range
+{
+#if defined(__linux__)
+   int error = posix_fadvise(fileDesc, offset, length, POSIX_FADV_WILLNEED);
+
+   if (error != 0) {
+      LOG(4, ("%s: fadvise failed on fd %d: %s\n", __FUNCTION__, fileDesc,
+              strerror(error)));
+   }
+#elif defined(__APPLE__)
+   struct radvisory advice;
+
+   advice.ra_offset = offset;
+   advice.ra_count = length;
+   if (fcntl(fileDesc, F_RDADVISE, &advice) < 0) {
+      LOG(4, ("%s: F_RDADVISE failed on fd %d: %s\n", __FUNCTION__, fileDesc,
+              strerror(errno)));
+   }
+#endif
 }
 
 
@@ -654,6 +793,9 @@ HgfsInternalStatus
 HgfsPlatformCloseFile(fileDesc fileDesc, // IN: File descriptor
                       void *fileCtx)     // IN: File context
 {
+   /* Closing the descriptor releases any lease still held on it. */
+   HgfsRemoveServerLock(fileDesc);
+
    if (close(fileDesc) != 0) {
       int error = errno;
 
@@ -666,6 +808,38 @@ HgfsPlatformCloseFile(fileDesc fileDesc, // IN: File descriptor
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformSyncFile --
+ *
+ *    Writes the data and metadata of an open file to stable storage.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformSyncFile(fileDesc fileDesc) // IN: File descriptor
+{
+   if (fsync(fileDesc) != 0) {
+      int error = errno;
+
+      LOG(4, ("%s: Could not sync fd %d: %s\n", __FUNCTION__, fileDesc,
+              strerror(error)));
+      return error;
+   }
+
+   return 0;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -784,6 +958,7 @@ HgfsPlatformGetFd(HgfsHandle hgfsHandle,    // IN:  HGFS file handle
        * mode.
        */
       if (append && !(node.flags & HGFS_FILE_NODE_APPEND_FL)) {
+         HgfsWriteBehind_Remove(session, hgfsHandle);
          status = HgfsPlatformCloseFile(node.fileDesc, node.fileCtx);
          if (status != 0) {
             LOG(4, ("%s: Couldn't close file \"%s\" for reopening\n",
@@ -1432,6 +1607,7 @@ HgfsConvertComponentCase(char *currentComponent,           // IN
    size_t dentryNameLen;
    char *myConvertedComponent = NULL;
    size_t myConvertedComponentSize;
+   Bool nameIsUtf8;
    int ret;
 
    ASSERT(currentComponent);
@@ -1456,6 +1632,13 @@ HgfsConvertComponentCase(char *currentComponent,           // IN
       goto exit;
    }
 
+   /*
+    * With a UTF-8 default encoding the entry names can be compared as they
+    * are, without an allocation per entry.
+    */
+   nameIsUtf8 = Unicode_ResolveEncoding(STRING_ENCODING_DEFAULT) ==
+                STRING_ENCODING_UTF8;
+
    /*
     * Read all of the directory entries. For each one, convert the name
     * to lower case and then compare it to the lower case component.
@@ -1479,10 +1662,14 @@ HgfsConvertComponentCase(char *currentComponent,           // IN
          continue;
       }
 
-      dentryNameU = Unicode_Alloc(dentryName, STRING_ENCODING_DEFAULT);
+      if (nameIsUtf8) {
+         cmpResult = Unicode_CompareIgnoreCase(currentComponent, dentryName);
+      } else {
+         dentryNameU = Unicode_Alloc(dentryName, STRING_ENCODING_DEFAULT);
 
-      cmpResult = Unicode_CompareIgnoreCase(currentComponent, dentryNameU);
-      free(dentryNameU);
+         cmpResult = Unicode_CompareIgnoreCase(currentComponent, dentryNameU);
+         free(dentryNameU);
+      }
 
       if (cmpResult == 0) {
          /*
@@ -2358,6 +2545,166 @@ exit:
    return status;
 }
 
+#if defined(__linux__)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSearchOpenDir --
+ *
+ *    Open the directory of a search copy, if not yet open, so that the
+ *    attributes of its entries can be retrieved relative to it.
+ *
+ * Results:
+ *    TRUE if search->dirFd is a valid directory descriptor.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsSearchOpenDir(HgfsSearch *search,              // IN/OUT: search copy
+                  HgfsShareOptions configOptions)  // IN: share config options
+{
+   int openFlags = O_RDONLY | O_DIRECTORY | O_NONBLOCK | O_NOFOLLOW;
+
+   if (search->dirFd >= 0) {
+      return TRUE;
+   }
+
+   if (HgfsServerPolicy_IsShareOptionSet(configOptions,
+                                         HGFS_SHARE_FOLLOW_SYMLINKS)) {
+      openFlags &= ~O_NOFOLLOW;
+   }
+
+   search->dirFd = Posix_Open(search->utf8Dir, openFlags);
+   if (search->dirFd < 0) {
+      LOG(4, ("%s: could not open \"%s\": %s\n", __FUNCTION__, search->utf8Dir,
+              strerror(errno)));
+      return FALSE;
+   }
+   fcntl(search->dirFd, F_SETFD, FD_CLOEXEC);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsGetattrAt --
+ *
+ *    Linux search read counterpart of HgfsPlatformGetattrFromName for a
+ *    directory entry: the entry is stat'ed and its effective permissions
+ *    checked relative to the open directory, avoiding a path walk per call.
+ *    Only FIFOs, sockets and character devices are probed for being
+ *    sequential only, every other type always supports positioned reads.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsGetattrAt(int dirFd,                        // IN: directory descriptor
+              const char *entryName,            // IN: entry name in directory
+              char *fullName,                   // IN: full entry path
+              HgfsShareOptions configOptions,   // IN: share config options
+              char *shareName,                  // IN: share name
+              HgfsFileAttrInfo *attr)           // OUT: Struct to copy into
+{
+   struct stat stats;
+   uint64 creationTime;
+   Bool followSymlinks;
+   int statFlags = 0;
+
+   followSymlinks = HgfsServerPolicy_IsShareOptionSet(configOptions,
+                                                      HGFS_SHARE_FOLLOW_SYMLINKS);
+   if (!followSymlinks) {
+      statFlags |= AT_SYMLINK_NOFOLLOW;
+   }
+
+   if (fstatat(dirFd, entryName, &stats, statFlags) < 0) {
+      HgfsInternalStatus status = errno;
+
+      LOG(4, ("%s: error stating file: %s\n", __FUNCTION__, strerror(status)));
+      return status;
+   }
+   creationTime = HgfsGetCreationTime(&stats);
+
+   if (S_ISDIR(stats.st_mode)) {
+      attr->type = HGFS_FILE_TYPE_DIRECTORY;
+   } else if (S_ISLNK(stats.st_mode)) {
+      attr->type = HGFS_FILE_TYPE_SYMLINK;
+   } else {
+      attr->type = HGFS_FILE_TYPE_REGULAR;
+   }
+
+   HgfsStatToFileAttr(&stats, &creationTime, attr);
+   HgfsGetHiddenAttr(fullName, attr);
+
+   if (S_ISFIFO(stats.st_mode) || S_ISSOCK(stats.st_mode) ||
+       S_ISCHR(stats.st_mode)) {
+      HgfsGetSequentialOnlyFlagFromName(fullName, followSymlinks, attr);
+   }
+
+   if (!S_ISLNK(stats.st_mode)) {
+      HgfsOpenMode shareMode;
+
+      if (HgfsServerPolicy_GetShareMode(shareName, strlen(shareName),
+                                        &shareMode) == HGFS_NAME_STATUS_COMPLETE) {
+         attr->effectivePerms = 0;
+         if (faccessat(dirFd, entryName, R_OK, 0) == 0) {
+            attr->effectivePerms |= HGFS_PERM_READ;
+         }
+         if (faccessat(dirFd, entryName, X_OK, 0) == 0) {
+            attr->effectivePerms |= HGFS_PERM_EXEC;
+         }
+         if (shareMode != HGFS_OPEN_MODE_READ_ONLY &&
+             faccessat(dirFd, entryName, W_OK, 0) == 0) {
+            attr->effectivePerms |= HGFS_PERM_WRITE;
+         }
+         attr->mask |= HGFS_ATTR_VALID_EFFECTIVE_PERMS;
+      }
+   }
+
+   return 0;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformCloseSearchDir --
+ *
+ *    Close the directory a search copy retrieved entry attributes through.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsPlatformCloseSearchDir(HgfsSearch *search)  // IN/OUT: search copy
+{
+   if (search->dirFd >= 0) {
+      close(search->dirFd);
+      search->dirFd = -1;
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -3613,6 +3960,12 @@ HgfsPlatformSetDirEntry(HgfsSearch *search,              // IN: partially valid
                LOG(4, ("%s: Reusing existing oplocked handle "
                         "to avoid oplock break deadlock\n", __FUNCTION__));
                status = HgfsPlatformGetattrFromFd(fileDesc, session, entryAttr);
+#if defined(__linux__)
+            } else if (HgfsSearchOpenDir(search, configOptions)) {
+               status = HgfsGetattrAt(search->dirFd, dirEntry->d_name, fullName,
+                                      configOptions, search->utf8ShareName,
+                                      entryAttr);
+#endif
             } else {
                status = HgfsPlatformGetattrFromName(fullName, configOptions,
                                                     search->utf8ShareName,
@@ -3729,10 +4082,9 @@ HgfsPlatformSetDirEntry(HgfsSearch *search,              // IN: partially valid
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsPlatformScandir --
+ * HgfsScandirInt --
  *
- *    The cross-platform HGFS server code will call into this function
- *    in order to populate a list of dents. In the Linux case, we want to avoid
+ *    Read all entries of a directory into a list of dents. In the Linux case, we want to avoid
  *    using scandir(3) because it makes no provisions for not following
  *    symlinks. Instead, we'll open(2) the directory with O_DIRECTORY and
  *    O_NOFOLLOW, call getdents(2) directly, then close(2) the directory.
@@ -3751,12 +4103,11 @@ HgfsPlatformSetDirEntry(HgfsSearch *search,              // IN: partially valid
  *-----------------------------------------------------------------------------
  */
 
-HgfsInternalStatus
-HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search in
-                    size_t baseDirLen,              // IN: Ignored
-                    Bool followSymlinks,            // IN: followSymlinks config option
-                    struct DirectoryEntry ***dents, // OUT: Array of DirectoryEntrys
-                    int *numDents)                  // OUT: Number of DirectoryEntrys
+static HgfsInternalStatus
+HgfsScandirInt(char const *baseDir,            // IN: Directory to search in
+               Bool followSymlinks,            // IN: followSymlinks config option
+               struct DirectoryEntry ***dents, // OUT: Array of DirectoryEntrys
+               int *numDents)                  // OUT: Number of DirectoryEntrys
 {
 #if defined(__APPLE__)
    DIR *fd = NULL;
@@ -3910,6 +4261,235 @@ HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search i
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCopyDents --
+ *
+ *    Duplicate an array of directory entries.
+ *
+ * Results:
+ *    The allocated copy.
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static DirectoryEntry **
+HgfsCopyDents(DirectoryEntry **dents,  // IN: entries to copy
+              int numDents)            // IN: number of entries
+{
+   DirectoryEntry **copy = Util_SafeMalloc(MAX(numDents, 1) * sizeof *copy);
+   int i;
+
+   for (i = 0; i < numDents; i++) {
+      copy[i] = Util_SafeMalloc(dents[i]->d_reclen);
+      memcpy(copy[i], dents[i], dents[i]->d_reclen);
+   }
+   return copy;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDirSnapshotFree --
+ *
+ *    Unlink and free a directory snapshot. Caller holds the snapshot lock.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsDirSnapshotFree(HgfsDirSnapshot *snapshot)  // IN: snapshot
+{
+   int i;
+
+   DblLnkLst_Unlink1(&snapshot->links);
+   gHgfsNumDirSnapshots--;
+   for (i = 0; i < snapshot->numDents; i++) {
+      free(snapshot->dents[i]);
+   }
+   free(snapshot->dents);
+   free(snapshot->path);
+   free(snapshot);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDirSnapshotLookup --
+ *
+ *    Copy the entries of a cached snapshot of the directory, if the directory
+ *    has not changed since the snapshot was taken. A stale snapshot is freed.
+ *
+ * Results:
+ *    TRUE if dents and numDents were filled in from the cache.
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsDirSnapshotLookup(char const *baseDir,            // IN: directory
+                      Bool followSymlinks,            // IN: follow symlinks
+                      struct stat const *st,          // IN: current directory stat
+                      DirectoryEntry ***dents,        // OUT: entries
+                      int *numDents)                  // OUT: number of entries
+{
+   DblLnkLst_Links *link;
+   Bool found = FALSE;
+
+   MXUser_AcquireExclLock(gHgfsDirSnapshotLock);
+
+   DblLnkLst_ForEach(link, &gHgfsDirSnapshots) {
+      HgfsDirSnapshot *snapshot = DblLnkLst_Container(link, HgfsDirSnapshot, links);
+
+      if (snapshot->followSymlinks != followSymlinks ||
+          strcmp(snapshot->path, baseDir) != 0) {
+         continue;
+      }
+
+      if (snapshot->dev != st->st_dev || snapshot->ino != st->st_ino ||
+          snapshot->mtime != st->st_mtime ||
+          snapshot->mtimeNsec != HGFS_STAT_MTIME_NSEC(st)) {
+         LOG(8, ("%s: %s changed, dropping snapshot\n", __FUNCTION__, baseDir));
+         HgfsDirSnapshotFree(snapshot);
+         break;
+      }
+
+      *dents = HgfsCopyDents(snapshot->dents, snapshot->numDents);
+      *numDents = snapshot->numDents;
+      DblLnkLst_Unlink1(&snapshot->links);
+      DblLnkLst_LinkFirst(&gHgfsDirSnapshots, &snapshot->links);
+      found = TRUE;
+      break;
+   }
+
+   MXUser_ReleaseExclLock(gHgfsDirSnapshotLock);
+
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDirSnapshotInsert --
+ *
+ *    Cache a copy of a directory listing, evicting the least recently used
+ *    snapshot if the cache is full.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsDirSnapshotInsert(char const *baseDir,            // IN: directory
+                      Bool followSymlinks,            // IN: follow symlinks
+                      struct stat const *st,          // IN: stat before listing
+                      DirectoryEntry **dents,         // IN: entries
+                      int numDents)                   // IN: number of entries
+{
+   HgfsDirSnapshot *snapshot = Util_SafeMalloc(sizeof *snapshot);
+
+   DblLnkLst_Init(&snapshot->links);
+   snapshot->path = Util_SafeStrdup(baseDir);
+   snapshot->followSymlinks = followSymlinks;
+   snapshot->dev = st->st_dev;
+   snapshot->ino = st->st_ino;
+   snapshot->mtime = st->st_mtime;
+   snapshot->mtimeNsec = HGFS_STAT_MTIME_NSEC(st);
+   snapshot->dents = HgfsCopyDents(dents, numDents);
+   snapshot->numDents = numDents;
+
+   MXUser_AcquireExclLock(gHgfsDirSnapshotLock);
+
+   if (gHgfsNumDirSnapshots == HGFS_DIR_SNAPSHOT_MAX) {
+      HgfsDirSnapshotFree(DblLnkLst_Container(gHgfsDirSnapshots.prev,
+                                              HgfsDirSnapshot, links));
+   }
+   DblLnkLst_LinkFirst(&gHgfsDirSnapshots, &snapshot->links);
+   gHgfsNumDirSnapshots++;
+
+   MXUser_ReleaseExclLock(gHgfsDirSnapshotLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformScandir --
+ *
+ *    The cross-platform HGFS server code will call into this function
+ *    in order to populate a list of dents.
+ *
+ *    Listings of large directories are served from a snapshot cache shared
+ *    by all sessions while the directory is unchanged, so that repeatedly
+ *    listing the same directory does not re-read it from the file system.
+ *
+ * Results:
+ *    Zero on success. numDents contains the number of directory entries found.
+ *    Non-zero on error.
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search in
+                    size_t baseDirLen,              // IN: Ignored
+                    Bool followSymlinks,            // IN: followSymlinks config option
+                    struct DirectoryEntry ***dents, // OUT: Array of DirectoryEntrys
+                    int *numDents)                  // OUT: Number of DirectoryEntrys
+{
+   HgfsInternalStatus status;
+   struct stat st;
+   Bool cacheable;
+   int result;
+
+   /*
+    * A symlink is only listed through the uncached path so that it reports
+    * the same error as before when symlinks are not followed.
+    */
+   result = followSymlinks ? Posix_Stat(baseDir, &st) : Posix_Lstat(baseDir, &st);
+   cacheable = gHgfsDirSnapshotLock != NULL && result == 0 && S_ISDIR(st.st_mode);
+
+   if (cacheable && HgfsDirSnapshotLookup(baseDir, followSymlinks, &st,
+                                          dents, numDents)) {
+      LOG(8, ("%s: %s served from snapshot\n", __FUNCTION__, baseDir));
+      return 0;
+   }
+
+   status = HgfsScandirInt(baseDir, followSymlinks, dents, numDents);
+
+   if (status == 0 && cacheable && *numDents >= HGFS_DIR_SNAPSHOT_MIN_DENTS &&
+       time(NULL) - st.st_mtime > HGFS_DIR_SNAPSHOT_SETTLE_SEC) {
+      HgfsDirSnapshotInsert(baseDir, followSymlinks, &st, *dents, *numDents);
+   }
+
+   return status;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -4329,6 +4909,243 @@ HgfsPlatformWriteFile(fileDesc writeFd,            // IN: file descriptor
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVmxIov2Iovec --
+ *
+ *    Describe the first dataSize bytes of the mapped HGFS iovs as an iovec
+ *    array suitable for vectored IO. The last mapping may be longer than the
+ *    remaining data and is trimmed.
+ *
+ * Results:
+ *    The iovec array, either vecBuf or an allocated array which the caller
+ *    must free.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static struct iovec *
+HgfsVmxIov2Iovec(HgfsVmxIov *iov,           // IN: mapped iovs
+                 uint32 iovCount,           // IN: mapped iov count
+                 uint32 dataSize,           // IN: bytes to describe
+                 struct iovec *vecBuf,      // IN: caller buffer
+                 uint32 vecBufCount,        // IN: caller buffer entries
+                 int *vecCount)             // OUT: iovec entries used
+{
+   struct iovec *vec = vecBuf;
+   uint32 remainingSize = dataSize;
+   uint32 i;
+
+   if (iovCount > vecBufCount) {
+      vec = Util_SafeMalloc(iovCount * sizeof *vec);
+   }
+
+   for (i = 0; i < iovCount && remainingSize > 0; i++) {
+      vec[i].iov_base = iov[i].va;
+      vec[i].iov_len = MIN(iov[i].len, remainingSize);
+      remainingSize -= vec[i].iov_len;
+   }
+
+   *vecCount = i;
+   return vec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformReadFileIov --
+ *
+ *    Reads data from a file directly into the mapped guest iovs.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformReadFileIov(fileDesc file,               // IN: file descriptor
+                        HgfsSessionInfo *session,    // IN: session info
+                        uint64 offset,               // IN: file offset to read from
+                        uint32 requiredSize,         // IN: length of data to read
+                        HgfsVmxIov *iov,             // IN: mapped iovs to read into
+                        uint32 iovCount,             // IN: mapped iov count
+                        uint32 *actualSize)          // OUT: actual length read
+{
+   struct iovec vecBuf[HGFS_IOVEC_STACK_COUNT];
+   struct iovec *vec;
+   int vecCount;
+   ssize_t error;
+   HgfsInternalStatus status = 0;
+   HgfsHandle handle;
+   Bool sequentialOpen;
+
+   ASSERT(session);
+
+   LOG(4, ("%s: read fh %u, offset %"FMT64"u, count %u, iovs %u\n", __FUNCTION__,
+           file, offset, requiredSize, iovCount));
+
+   if (!HgfsFileDesc2Handle(file, session, &handle)) {
+      LOG(4, ("%s: Could not get file handle\n", __FUNCTION__));
+      return EBADF;
+   }
+
+   if (!HgfsHandleIsSequentialOpen(handle, session, &sequentialOpen)) {
+      LOG(4, ("%s: Could not get sequenial open status\n", __FUNCTION__));
+      return EBADF;
+   }
+
+   vec = HgfsVmxIov2Iovec(iov, iovCount, requiredSize, vecBuf,
+                          ARRAYSIZE(vecBuf), &vecCount);
+
+#if defined(__linux__)
+   if (sequentialOpen) {
+      error = readv(file, vec, vecCount);
+   } else {
+      error = preadv(file, vec, vecCount, offset);
+   }
+#else
+   /*
+    * No preadv, seek to the offset and read from the file. Grab the IO lock
+    * to make this and the subsequent read atomic.
+    */
+
+   MXUser_AcquireExclLock(session->fileIOLock);
+   error = sequentialOpen ? 0 : lseek(file, offset, SEEK_SET);
+   if (error >= 0) {
+      error = readv(file, vec, vecCount);
+   } else {
+      LOG(4, ("%s: could not seek to %"FMT64"u: %s\n", __FUNCTION__,
+              offset, strerror(errno)));
+   }
+   {
+      int savedErr = errno;
+      MXUser_ReleaseExclLock(session->fileIOLock);
+      errno = savedErr;
+   }
+#endif
+
+   if (error < 0) {
+      status = errno;
+      LOG(4, ("%s: error reading from file: %s\n", __FUNCTION__,
+              strerror(status)));
+   } else {
+      LOG(4, ("%s: read %d bytes\n", __FUNCTION__, (int)error));
+      *actualSize = error;
+   }
+
+   if (vec != vecBuf) {
+      free(vec);
+   }
+
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformWriteFileIov --
+ *
+ *    Writes data to a file directly from the mapped guest iovs.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformWriteFileIov(fileDesc writeFd,            // IN: file descriptor
+                         HgfsSessionInfo *session,    // IN: session info
+                         uint64 writeOffset,          // IN: file offset to write to
+                         uint32 writeDataSize,        // IN: length of data to write
+                         HgfsWriteFlags writeFlags,   // IN: write flags
+                         Bool writeSequential,        // IN: write is sequential
+                         Bool writeAppend,            // IN: write is appended
+                         HgfsVmxIov *iov,             // IN: mapped iovs of data
+                         uint32 iovCount,             // IN: mapped iov count
+                         uint32 *writtenSize)         // OUT: actual length written
+{
+   struct iovec vecBuf[HGFS_IOVEC_STACK_COUNT];
+   struct iovec *vec;
+   int vecCount;
+   ssize_t error;
+   HgfsInternalStatus status = 0;
+
+   LOG(4, ("%s: write fh %u offset %"FMT64"u, count %u, iovs %u\n",
+           __FUNCTION__, writeFd, writeOffset, writeDataSize, iovCount));
+
+#if !defined(sun)
+   if (!writeSequential) {
+      status = HgfsWriteCheckIORange(writeOffset, writeDataSize);
+      if (status != 0) {
+         return status;
+      }
+   }
+#endif
+
+   vec = HgfsVmxIov2Iovec(iov, iovCount, writeDataSize, vecBuf,
+                          ARRAYSIZE(vecBuf), &vecCount);
+
+#if defined(__linux__)
+   if (writeSequential) {
+      error = writev(writeFd, vec, vecCount);
+   } else {
+      error = pwritev(writeFd, vec, vecCount, writeOffset);
+   }
+#else
+   /*
+    * No pwritev, seek to the offset and write to the file. Grab the IO lock
+    * to make this and the subsequent write atomic.
+    */
+
+   MXUser_AcquireExclLock(session->fileIOLock);
+   error = (writeSequential || writeAppend) ? 0 :
+                                              lseek(writeFd, writeOffset, SEEK_SET);
+   if (error >= 0) {
+      error = writev(writeFd, vec, vecCount);
+   } else {
+      LOG(4, ("%s: could not seek to %"FMT64"u: %s\n", __FUNCTION__,
+              writeOffset, strerror(errno)));
+   }
+   {
+      int savedErr = errno;
+      MXUser_ReleaseExclLock(session->fileIOLock);
+      errno = savedErr;
+   }
+#endif
+
+   if (error < 0) {
+      status = errno;
+      LOG(4, ("%s: error writing to file: %s\n", __FUNCTION__,
+              strerror(status)));
+   } else {
+      *writtenSize = error;
+      LOG(4, ("%s: wrote %d bytes\n", __FUNCTION__, *writtenSize));
+   }
+
+   if (vec != vecBuf) {
+      free(vec);
+   }
+
+   return status;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
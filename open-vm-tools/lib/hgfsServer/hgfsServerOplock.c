@@ -29,14 +29,19 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "vmware.h"
 #include "str.h"
 #include "cpName.h"
 #include "cpNameLite.h"
 #include "hgfsServerInt.h"
+#include "hgfsServerOplock.h"
 #include "hgfsServerOplockInt.h"
 
+#define LOGLEVEL_MODULE hgfs
+#include "loglevel_user.h"
+
 
 
 /*
@@ -132,24 +137,16 @@ HgfsHandle2ServerLock(HgfsHandle handle,        // IN: Hgfs file handle
                       HgfsLockType *lock)       // OUT: Server lock
 {
 #ifdef HGFS_OPLOCKS
-   Bool found = FALSE;
-   HgfsFileNode *fileNode = NULL;
+   HgfsFileNode fileNode;
 
    ASSERT(lock);
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
-   fileNode = HgfsHandle2FileNode(handle, session);
-   if (fileNode == NULL) {
-      goto exit;
+   if (!HgfsGetNodeCopy(handle, session, FALSE, &fileNode)) {
+      return FALSE;
    }
 
-   *lock = fileNode->serverLock;
-   found = TRUE;
-
-exit:
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
-
-   return found;
+   *lock = fileNode.serverLock;
+   return TRUE;
 #else
    *lock = HGFS_LOCK_NONE;
    return TRUE;
@@ -199,7 +196,11 @@ HgfsFileHasServerLock(const char *utf8Name,             // IN: Name in UTF8
 
       if ((existingFileNode->state == FILENODE_STATE_IN_USE_CACHED) &&
           (existingFileNode->serverLock != HGFS_LOCK_NONE) &&
+#if defined(_WIN32)
           (!stricmp(existingFileNode->utf8Name, utf8Name))) {
+#else
+          (!strcmp(existingFileNode->utf8Name, utf8Name))) {
+#endif
          LOG(4, ("Found file with a lock: %s\n", utf8Name));
          *serverLock = existingFileNode->serverLock;
          *fileDesc = existingFileNode->fileDesc;
@@ -218,7 +219,6 @@ HgfsFileHasServerLock(const char *utf8Name,             // IN: Name in UTF8
 
 
 
-#ifdef HGFS_OPLOCKS
 /*
  *-----------------------------------------------------------------------------
  *
@@ -227,9 +227,9 @@ HgfsFileHasServerLock(const char *utf8Name,             // IN: Name in UTF8
  *      The client was sent an oplock break request, and responded with this
  *      reply. It contains the oplock status that the client is now in. Since
  *      the break could have actually been a degrade, it is well within the
- *      client's rights to transition to a non-broken state. We need to make
- *      sure that such a transition was legal, acknowledge the brea
- *      appropriately, and update our own state.
+ *      client's rights to transition to a non-broken state. The platform
+ *      acknowledgement makes sure that such a transition was legal and
+ *      updates our own state.
  *
  * Results:
  *      None.
@@ -241,137 +241,89 @@ HgfsFileHasServerLock(const char *utf8Name,             // IN: Name in UTF8
  */
 
 void
-HgfsServerOplockBreakReply(const unsigned char *packetIn, // IN: Reply packet
-                           unsigned int packetSize,       // IN: Size of packet
-                           void *clientData)              // IN: From request
+HgfsServerOplockBreakReply(HgfsHandle file,           // IN: file the break was for
+                           HgfsLockType replyLock,    // IN: lock the client kept
+                           HgfsSessionInfo *session)  // IN: session info
 {
-   HgfsReplyServerLockChange *reply;
-   ServerLockData *lockData = clientData;
+#ifdef HGFS_OPLOCKS
+   ServerLockData lockData;
 
-   ASSERT(packetIn);
-   ASSERT(clientData);
+   ASSERT(session);
 
-   if (packetSize < sizeof *reply) {
+   if (!HgfsHandle2FileDesc(file, session, &lockData.fileDesc, NULL)) {
+      LOG(4, ("%s: break reply for unknown handle %u\n", __FUNCTION__, file));
       return;
    }
-   reply = (HgfsReplyServerLockChange *)packetIn;
 
-   /*
-    * XXX: It should be safe to ignore the status and id from the actual
-    * HgfsReply. The only information we need to properly acknowledge the break
-    * is the original fd and the new lease, which, in the case of a degrade,
-    * is double checked in HgfsAckOplockBreak, so we'd be safe from a garbage
-    * value.
-    */
-   HgfsAckOplockBreak(lockData, reply->serverLock);
+   lockData.session = session;
+   lockData.event = 0;
+   lockData.serverLock = replyLock;
+   HgfsAckOplockBreak(&lockData, replyLock);
+#endif
 }
 
 
+#ifdef HGFS_OPLOCKS
 /*
  *-----------------------------------------------------------------------------
  *
  * HgfsServerOplockBreak --
  *
  *      When the host FS needs to break the oplock so that another client
- *      can open the file, it signals the event in the overlapped structure
- *      that we used to request an oplock.
+ *      can open the file, the platform code calls this function.
  *      This sets off the following chains of events:
  *      1. Send the oplock break request to the guest.
- *      2. Once the guest acknowledges the oplock break, the completion
- *      routine GuestRpcServerRequestCallback will fire, causing
- *      HgfsServerOplockBreakReply to also fire, which will break the oplock
- *      on the host FS.
+ *      2. Once the guest acknowledges the oplock break, the reply is
+ *      dispatched to HgfsServerOplockBreakReply, which will break or
+ *      downgrade the oplock on the host FS.
  *
  * Results:
- *      None.
+ *      TRUE if the break was sent or acknowledged locally.
+ *      FALSE if the file node is not set up yet and the break should be
+ *      retried later.
  *
  * Side effects:
- *      If successful, allocates memory for the rpc request.
+ *      None.
  *
  *-----------------------------------------------------------------------------
  */
 
-void
-HgfsServerOplockBreak(ServerLockData *lockData)
+Bool
+HgfsServerOplockBreak(ServerLockData *lockData)  // IN: break to send
 {
    HgfsHandle hgfsHandle;
-   char *requestBuffer = NULL;
-   HgfsRequestServerLockChange *request;
    HgfsLockType lock;
 
    LOG(4, ("%s: entered\n", __FUNCTION__));
 
    /*
-    * XXX: Just because the file in not in the cache on the server,
-    * does not mean it was closed on the client. It is possible that
-    * we closed the file on the server because we ran out of space
-    * in cache. That's why for now as long as a file has a lock,
-    * we don't remove it from the node cache. This should be fixed.
-    *
-    * In any case, none of these cache-related failures should cause us to ack
-    * the oplock break locally. That is because if the file wasn't in the
-    * cache, or it had no lock, chances are someone else (maybe the VCPU
-    * thread) broke the oplock and/or closed the file.
+    * The lease is acquired while the file is opened, so there is a short
+    * window before its node is added to the cache. Let the caller retry.
     */
-
-   if (!HgfsFileDesc2Handle(lockData->fileDesc, &hgfsHandle)) {
+   if (!HgfsFileDesc2Handle(lockData->fileDesc, lockData->session, &hgfsHandle)) {
       LOG(4, ("%s: file is not in the cache\n", __FUNCTION__));
-      goto free_and_exit;
+      return FALSE;
    }
 
-   if (!HgfsHandle2ServerLock(hgfsHandle, &lock)) {
+   if (!HgfsHandle2ServerLock(hgfsHandle, lockData->session, &lock)) {
       LOG(4, ("%s: could not retrieve node's lock info.\n", __FUNCTION__));
-      goto free_and_exit;
+      goto ack_and_exit;
    }
 
    if (lock == HGFS_LOCK_NONE) {
       LOG(4, ("%s: the file does not have a server lock.\n", __FUNCTION__));
-      goto free_and_exit;
-   }
-
-   /*
-    * We need to setup the entire request here. The command prefix will be
-    * added later, so save some space for it.
-    *
-    * XXX: This should probably go into a common allocation function that
-    * other out-of-band requests can use.
-    */
-
-   requestBuffer = malloc(sizeof *request + HGFS_CLIENT_CMD_LEN);
-   if (requestBuffer == NULL) {
-      LOG(4, ("%s: could not allocate memory.\n", __FUNCTION__));
       goto ack_and_exit;
    }
 
-   /* Save space for the command prefix. */
-   request = (HgfsRequestServerLockChange *)
-      (requestBuffer + HGFS_CLIENT_CMD_LEN);
-   request->header.op = HGFS_OP_SERVER_LOCK_CHANGE;
-   request->header.id = 0; /* XXX */
-   request->file = hgfsHandle;
-   request->newServerLock = lockData->serverLock;
-
-   /*
-    * Just send the request size for our actual request; our callee will
-    * write in the command prefix and modify the request size appropriately.
-    *
-    * If for some reason we fail, we'll acknowledge the oplock break
-    * immediately.
-    */
-
-   if (HgfsServerManager_SendRequest(requestBuffer, sizeof *request,
-                                     HgfsServerOplockBreakReply, lockData)) {
-      return;
+   /* If for some reason we fail, we'll acknowledge the oplock break immediately. */
+   if (HgfsServerSendOplockBreak(hgfsHandle, lockData->serverLock,
+                                 lockData->session)) {
+      return TRUE;
    }
-   free(requestBuffer);
 
   ack_and_exit:
    HgfsAckOplockBreak(lockData, HGFS_LOCK_NONE);
 
-   return;
-
-  free_and_exit:
-   free(lockData);
+   return TRUE;
 }
 #endif
-
@@ -59,6 +59,11 @@ Bool HgfsFileHasServerLock(const char *utf8Name,
 Bool HgfsAcquireServerLock(fileDesc fileDesc,
                            HgfsSessionInfo *session,
                            HgfsLockType *serverLock);
+void HgfsRemoveServerLock(fileDesc fileDesc);
+void HgfsRemoveSessionServerLocks(HgfsSessionInfo *session);
+void HgfsServerOplockBreakReply(HgfsHandle file,
+                                HgfsLockType replyLock,
+                                HgfsSessionInfo *session);
 
 
 #endif // ifndef _HGFS_SERVER_OPLOCK_H_
@@ -31,21 +31,19 @@
 
 /*
  * Does this platform have oplock support? We define it here to avoid long
- * ifdefs all over the code. For now, Linux and Windows hosts only.
- *
- * XXX: Just kidding, no oplock support yet.
+ * ifdefs all over the code. Linux implements oplocks with kernel file leases.
  */
-#if 0
+#if defined(__linux__)
 #define HGFS_OPLOCKS
 #endif
 
 /*
- * XXX describe the data structure
+ * Server lock break. Describes the file whose lock the host file system
+ * wants to break, and the lock it may be downgraded to.
  */
-
-/* Server lock related structure */
 typedef struct {
    fileDesc fileDesc;
+   HgfsSessionInfo *session;
    int32 event;
    HgfsLockType serverLock;
 } ServerLockData;
@@ -62,7 +60,13 @@ typedef struct {
  */
 
 #ifdef HGFS_OPLOCKS
+Bool
+HgfsPlatformOplockInit(void);
+
 void
+HgfsPlatformOplockDestroy(void);
+
+Bool
 HgfsServerOplockBreak(ServerLockData *data);
 
 void
@@ -16,13 +16,24 @@
  *
  *********************************************************/
 
+
 /*
  * hgfsServerOplockLinux.c --
  *
  *      HGFS server opportunistic lock support for the Linux platform.
+ *
+ *      Oplocks are backed by kernel file leases. Every lease the server holds
+ *      is kept in a registry. When another process opens a leased file, the
+ *      kernel raises SIGIO; the signal handler only wakes a dispatcher thread,
+ *      which queries the pending breaks with F_GETLEASE and forwards them to
+ *      the owning clients. The lease is downgraded or released once the
+ *      client acknowledges the break. Should the client not answer, the
+ *      kernel breaks the lease itself after /proc/sys/fs/lease-break-time.
  */
 
 
+#define _GNU_SOURCE // for F_SETLEASE, F_GETLEASE and F_SETSIG
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
@@ -30,34 +41,409 @@
 
 #include "vmware.h"
 #include "hgfsServerInt.h"
+#include "hgfsServerOplock.h"
 #include "hgfsServerOplockInt.h"
 
 #ifdef HGFS_OPLOCKS
 #   include <signal.h>
-#   include "sig.h"
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/poll.h>
+#   include <glib.h>
+#   include "dbllnklst.h"
+#   include "userlock.h"
+#   include "mutexRankLib.h"
+#   include "util.h"
 #endif
 
+#define LOGLEVEL_MODULE hgfs
+#include "loglevel_user.h"
+
+
+#ifdef HGFS_OPLOCKS
+/* Interval at which breaks for files not yet in the node cache are retried. */
+#define HGFS_OPLOCK_RETRY_MS        50
+
+/* Retries after which such a break is acknowledged on the client's behalf. */
+#define HGFS_OPLOCK_MAX_RETRIES     20
 
 /*
  * Local data
  */
 
+typedef struct HgfsOplockLease {
+   DblLnkLst_Links links;
+   fileDesc fd;
+   HgfsSessionInfo *session;
+   HgfsLockType lock;                  /* Lease currently held. */
+   HgfsLockType breakTo;               /* Lock a pending break allows. */
+   Bool breakPending;                  /* The kernel is breaking the lease. */
+   Bool breakSent;                     /* The client was told about it. */
+   uint32 retries;
+} HgfsOplockLease;
+
+typedef struct HgfsOplockState {
+   /* Protects the lease registry. */
+   MXUserExclLock *lock;
+
+   /*
+    * Held while breaks are delivered so that removing a session's leases
+    * waits for in-flight breaks. Never acquired while holding lock.
+    */
+   MXUserExclLock *dispatchLock;
+
+   DblLnkLst_Links leases;
+
+   int wakePipe[2];                    /* Written by the SIGIO handler. */
+   int exitPipe[2];
+   struct sigaction oldAction;
+   GThread *thread;
+} HgfsOplockState;
+
+static HgfsOplockState *gOplock = NULL;
+
+/* Write end of the wake pipe, the only state the signal handler touches. */
+static volatile int gOplockWakeFd = -1;
+
+
 /*
- * Global data
+ * Local functions
  */
 
+static void HgfsOplockSigIO(int sigNum,
+                            siginfo_t *info,
+                            void *context);
+
 
 /*
- * Local functions
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockWake --
+ *
+ *      Wake the dispatcher thread so that it rescans the leases.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
  */
 
-#ifdef HGFS_OPLOCKS
-static void HgfsServerSigOplockBreak(int sigNum,
-                                     siginfo_t *info,
-                                     ucontext_t *u,
-                                     void *clientData);
-#endif
+static void
+HgfsOplockWake(void)
+{
+   int fd = gOplockWakeFd;
+   char wakeByte = 0;
+
+   /* A full pipe already guarantees a wakeup. */
+   if (fd >= 0 && write(fd, &wakeByte, sizeof wakeByte) < 0) {
+      return;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockSigIO --
+ *
+ *      SIGIO handler. Lease breaks are not queued like real time signals, so
+ *      several breaks may arrive as one signal; the handler therefore does
+ *      not look at the descriptor and only wakes the dispatcher, which checks
+ *      every lease.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsOplockSigIO(int sigNum,       // IN: Signal number
+                siginfo_t *info,  // IN: Additional info about signal
+                void *context)    // IN: Interrupted context
+{
+   int savedErrno = errno;
+
+   HgfsOplockWake();
+   errno = savedErrno;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockFindLease --
+ *
+ *      Look up the registry entry for a descriptor. A NULL session matches
+ *      any session.
+ *
+ *      gOplock->lock should be acquired prior to calling this function.
+ *
+ * Results:
+ *      The entry, or NULL if the descriptor holds no lease.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsOplockLease *
+HgfsOplockFindLease(fileDesc fd,                // IN: OS handle
+                    HgfsSessionInfo *session)   // IN: session or NULL
+{
+   DblLnkLst_Links *link;
+
+   DblLnkLst_ForEach(link, &gOplock->leases) {
+      HgfsOplockLease *lease = DblLnkLst_Container(link, HgfsOplockLease, links);
+
+      if (lease->fd == fd && (session == NULL || lease->session == session)) {
+         return lease;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockCheckBreak --
+ *
+ *      Check whether the kernel is breaking a lease. While a break is pending,
+ *      F_GETLEASE returns the lease the holder is allowed to keep instead of
+ *      the one it holds: F_RDLCK if a write lease may be downgraded, F_UNLCK
+ *      if the lease must go.
+ *
+ *      gOplock->lock should be acquired prior to calling this function.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Marks the lease as breaking.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsOplockCheckBreak(HgfsOplockLease *lease)  // IN/OUT: lease to check
+{
+   int heldLease = lease->lock == HGFS_LOCK_EXCLUSIVE ? F_WRLCK : F_RDLCK;
+   int newLease;
+
+   if (lease->breakPending) {
+      return;
+   }
+
+   newLease = fcntl(lease->fd, F_GETLEASE);
+   if (newLease == -1) {
+      LOG(4, ("%s: Could not get lease for fd %d: %s\n", __FUNCTION__,
+              lease->fd, strerror(errno)));
+      return;
+   }
+   if (newLease == heldLease) {
+      return;
+   }
+
+   LOG(4, ("%s: lease break on fd %d to %s\n", __FUNCTION__, lease->fd,
+           newLease == F_RDLCK ? "read" : "none"));
+   lease->breakTo = newLease == F_RDLCK ? HGFS_LOCK_SHARED : HGFS_LOCK_NONE;
+   lease->breakPending = TRUE;
+   lease->breakSent = FALSE;
+   lease->retries = 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockDispatch --
+ *
+ *      Look for new lease breaks and send them to the clients. A break for a
+ *      file whose node is not cached yet is retried, and acknowledged on the
+ *      client's behalf after HGFS_OPLOCK_MAX_RETRIES attempts so that the
+ *      other opener does not have to wait for the kernel timeout.
+ *
+ * Results:
+ *      TRUE if some breaks still have to be retried, FALSE otherwise.
+ *
+ * Side effects:
+ *      Oplock break requests are sent to the clients.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsOplockDispatch(void)
+{
+   ServerLockData *breaks = NULL;
+   uint32 count = 0;
+   uint32 capacity = 0;
+   uint32 i;
+   Bool retry = FALSE;
+   DblLnkLst_Links *link;
+
+   MXUser_AcquireExclLock(gOplock->dispatchLock);
+
+   MXUser_AcquireExclLock(gOplock->lock);
+   DblLnkLst_ForEach(link, &gOplock->leases) {
+      HgfsOplockLease *lease = DblLnkLst_Container(link, HgfsOplockLease, links);
+
+      HgfsOplockCheckBreak(lease);
+      if (!lease->breakPending || lease->breakSent) {
+         continue;
+      }
+      if (count == capacity) {
+         capacity = capacity == 0 ? 8 : capacity * 2;
+         breaks = Util_SafeRealloc(breaks, capacity * sizeof *breaks);
+      }
+      breaks[count].fileDesc = lease->fd;
+      breaks[count].session = lease->session;
+      breaks[count].event = 0;
+      breaks[count].serverLock = lease->breakTo;
+      count++;
+
+      /* Set before sending, the acknowledgement may arrive at any time. */
+      lease->breakSent = TRUE;
+   }
+   MXUser_ReleaseExclLock(gOplock->lock);
+
+   for (i = 0; i < count; i++) {
+      HgfsOplockLease *lease;
+      Bool giveUp = FALSE;
+
+      if (HgfsServerOplockBreak(&breaks[i])) {
+         continue;
+      }
+
+      MXUser_AcquireExclLock(gOplock->lock);
+      lease = HgfsOplockFindLease(breaks[i].fileDesc, breaks[i].session);
+      if (lease != NULL && lease->breakPending) {
+         lease->breakSent = FALSE;
+         if (++lease->retries >= HGFS_OPLOCK_MAX_RETRIES) {
+            giveUp = TRUE;
+         } else {
+            retry = TRUE;
+         }
+      }
+      MXUser_ReleaseExclLock(gOplock->lock);
+
+      if (giveUp) {
+         LOG(4, ("%s: giving up on break for fd %d\n", __FUNCTION__,
+                 breaks[i].fileDesc));
+         HgfsAckOplockBreak(&breaks[i], HGFS_LOCK_NONE);
+      }
+   }
+
+   MXUser_ReleaseExclLock(gOplock->dispatchLock);
+
+   free(breaks);
+   return retry;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockThread --
+ *
+ *      Dispatcher thread: waits for the SIGIO handler and processes the lease
+ *      breaks.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      Oplock break requests are sent from this thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gpointer
+HgfsOplockThread(gpointer data)  // IN: unused
+{
+   Bool retry = FALSE;
+
+   for (;;) {
+      struct pollfd fds[2];
+      int ready;
+
+      fds[0].fd = gOplock->wakePipe[0];
+      fds[0].events = POLLIN;
+      fds[1].fd = gOplock->exitPipe[0];
+      fds[1].events = POLLIN;
+
+      ready = poll(fds, ARRAYSIZE(fds), retry ? HGFS_OPLOCK_RETRY_MS : -1);
+      if (ready < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         LOG(4, ("%s: poll failed: %s\n", __FUNCTION__, strerror(errno)));
+         break;
+      }
+
+      if (fds[1].revents != 0) {
+         break;
+      }
+
+      if (fds[0].revents != 0) {
+         char buf[64];
+
+         while (read(gOplock->wakePipe[0], buf, sizeof buf) > 0) {
+            continue;
+         }
+      }
+
+      retry = HgfsOplockDispatch();
+   }
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockOpenPipe --
+ *
+ *      Create a close-on-exec pipe, optionally non-blocking.
+ *
+ * Results:
+ *      TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsOplockOpenPipe(int fds[2],        // OUT: pipe descriptors
+                   Bool nonBlocking)  // IN: make both ends non-blocking
+{
+   int i;
 
+   if (pipe(fds) < 0) {
+      fds[0] = -1;
+      fds[1] = -1;
+      return FALSE;
+   }
+   for (i = 0; i < 2; i++) {
+      fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+      if (nonBlocking) {
+         fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+      }
+   }
+   return TRUE;
+}
+#endif
 
 
 /*
@@ -68,10 +454,10 @@ static void HgfsServerSigOplockBreak(int sigNum,
  *      Set up any state needed to start Linux HGFS server oplock support.
  *
  * Results:
- *      TRUE always.
+ *      TRUE on success, FALSE if leases cannot be monitored.
  *
  * Side effects:
- *      None.
+ *      Installs a SIGIO handler and starts the dispatcher thread.
  *
  *-----------------------------------------------------------------------------
  */
@@ -80,10 +466,68 @@ Bool
 HgfsPlatformOplockInit(void)
 {
 #ifdef HGFS_OPLOCKS
-   /* Register a signal handler to catch oplock break signals. */
-   Sig_Callback(SIGIO, SIG_SAFE, HgfsServerSigOplockBreak, NULL);
-#endif
+   HgfsOplockState *state;
+   struct sigaction action;
+   GError *err = NULL;
+
+   ASSERT(gOplock == NULL);
+
+   state = Util_SafeCalloc(1, sizeof *state);
+   state->exitPipe[0] = -1;
+   state->exitPipe[1] = -1;
+   if (!HgfsOplockOpenPipe(state->wakePipe, TRUE) ||
+       !HgfsOplockOpenPipe(state->exitPipe, FALSE)) {
+      LOG(4, ("%s: failed to create pipe: %s\n", __FUNCTION__, strerror(errno)));
+      goto error;
+   }
+
+   state->lock = MXUser_CreateExclLock("hgfsOplockLock", RANK_hgfsOplockLock);
+   state->dispatchLock = MXUser_CreateExclLock("hgfsOplockDispatchLock",
+                                               RANK_hgfsOplockDispatchLock);
+   DblLnkLst_Init(&state->leases);
+
+   gOplock = state;
+   gOplockWakeFd = state->wakePipe[1];
+
+   memset(&action, 0, sizeof action);
+   action.sa_sigaction = HgfsOplockSigIO;
+   action.sa_flags = SA_SIGINFO | SA_RESTART;
+   sigemptyset(&action.sa_mask);
+   if (sigaction(SIGIO, &action, &state->oldAction) < 0) {
+      LOG(4, ("%s: failed to install SIGIO handler: %s\n", __FUNCTION__,
+              strerror(errno)));
+      goto errorLocks;
+   }
+
+   state->thread = g_thread_create(HgfsOplockThread, NULL, TRUE, &err);
+   if (err != NULL) {
+      LOG(4, ("%s: failed to start thread: %s\n", __FUNCTION__, err->message));
+      g_clear_error(&err);
+      sigaction(SIGIO, &state->oldAction, NULL);
+      goto errorLocks;
+   }
+
    return TRUE;
+
+errorLocks:
+   gOplockWakeFd = -1;
+   gOplock = NULL;
+   MXUser_DestroyExclLock(state->lock);
+   MXUser_DestroyExclLock(state->dispatchLock);
+error:
+   if (state->wakePipe[0] >= 0) {
+      close(state->wakePipe[0]);
+      close(state->wakePipe[1]);
+   }
+   if (state->exitPipe[0] >= 0) {
+      close(state->exitPipe[0]);
+      close(state->exitPipe[1]);
+   }
+   free(state);
+   return FALSE;
+#else
+   return TRUE;
+#endif
 }
 
 
@@ -98,7 +542,7 @@ HgfsPlatformOplockInit(void)
  *      None.
  *
  * Side effects:
- *      None.
+ *      Restores the previous SIGIO handler and stops the dispatcher thread.
  *
  *-----------------------------------------------------------------------------
  */
@@ -107,8 +551,38 @@ void
 HgfsPlatformOplockDestroy(void)
 {
 #ifdef HGFS_OPLOCKS
+   DblLnkLst_Links *link;
+   DblLnkLst_Links *nextLink;
+   char exitByte = 0;
+
+   if (gOplock == NULL) {
+      return;
+   }
+
    /* Tear down oplock state, so we no longer catch signals. */
-   Sig_Callback(SIGIO, SIG_NOHANDLER, NULL, NULL);
+   sigaction(SIGIO, &gOplock->oldAction, NULL);
+   gOplockWakeFd = -1;
+
+   if (write(gOplock->exitPipe[1], &exitByte, sizeof exitByte) != sizeof exitByte) {
+      LOG(4, ("%s: failed to signal thread: %s\n", __FUNCTION__, strerror(errno)));
+   }
+   g_thread_join(gOplock->thread);
+
+   DblLnkLst_ForEachSafe(link, nextLink, &gOplock->leases) {
+      HgfsOplockLease *lease = DblLnkLst_Container(link, HgfsOplockLease, links);
+
+      DblLnkLst_Unlink1(&lease->links);
+      free(lease);
+   }
+
+   close(gOplock->wakePipe[0]);
+   close(gOplock->wakePipe[1]);
+   close(gOplock->exitPipe[0]);
+   close(gOplock->exitPipe[1]);
+   MXUser_DestroyExclLock(gOplock->lock);
+   MXUser_DestroyExclLock(gOplock->dispatchLock);
+   free(gOplock);
+   gOplock = NULL;
 #endif
 }
 
@@ -130,7 +604,7 @@ HgfsPlatformOplockDestroy(void)
  *    but since it is opportunistic by nature, it isn't necessary to do so.
  *
  * Side effects:
- *    None.
+ *    The lease is added to the registry.
  *
  *-----------------------------------------------------------------------------
  */
@@ -142,6 +616,7 @@ HgfsAcquireServerLock(fileDesc fileDesc,            // IN: OS handle
 {
 #ifdef HGFS_OPLOCKS
    HgfsLockType desiredLock;
+   HgfsOplockLease *lease;
    int leaseType, error;
 
    ASSERT(serverLock);
@@ -153,16 +628,15 @@ HgfsAcquireServerLock(fileDesc fileDesc,            // IN: OS handle
       return TRUE;
    }
 
-   if (!HgfsIsServerLockAllowed(session)) {
+   if (gOplock == NULL || !HgfsIsServerLockAllowed(session)) {
       return FALSE;
    }
 
    /*
     * First tell the kernel which signal to send us. SIGIO is already the
     * default, but if we skip this step, we won't get the siginfo_t when
-    * a lease break occurs.
-    *
-    * XXX: Do I need to do fcntl(fileDesc, F_SETOWN, getpid())?
+    * a lease break occurs. F_SETLEASE makes us the owner of the descriptor,
+    * so there is no need for F_SETOWN.
     */
    if (fcntl(fileDesc, F_SETSIG, SIGIO)) {
       error = errno;
@@ -216,6 +690,23 @@ HgfsAcquireServerLock(fileDesc fileDesc,            // IN: OS handle
    LOG(4, ("%s: Got %s lease for fd %d\n", __FUNCTION__,
            leaseType == F_WRLCK ? "write" : "read", fileDesc));
    *serverLock = leaseType == F_WRLCK ? HGFS_LOCK_EXCLUSIVE : HGFS_LOCK_SHARED;
+
+   MXUser_AcquireExclLock(gOplock->lock);
+   lease = HgfsOplockFindLease(fileDesc, session);
+   if (lease == NULL) {
+      lease = Util_SafeCalloc(1, sizeof *lease);
+      DblLnkLst_Init(&lease->links);
+      lease->fd = fileDesc;
+      lease->session = session;
+      DblLnkLst_LinkLast(&gOplock->leases, &lease->links);
+   }
+   lease->lock = *serverLock;
+   lease->breakPending = FALSE;
+   lease->breakSent = FALSE;
+   MXUser_ReleaseExclLock(gOplock->lock);
+
+   /* A break may have been signalled before the lease was registered. */
+   HgfsOplockWake();
    return TRUE;
 #else
    return FALSE;
@@ -230,17 +721,18 @@ HgfsAcquireServerLock(fileDesc fileDesc,            // IN: OS handle
  * HgfsAckOplockBreak --
  *
  *    Platform-dependent implementation of oplock break acknowledgement.
- *    This function gets called when the oplock break rpc command is completed.
- *    The rpc oplock break command (HgfsServerOplockBreak) is in hgfsServer.c
+ *    This function gets called when the client acknowledges the break sent
+ *    by HgfsServerOplockBreak, or on its behalf if the break could not be
+ *    delivered.
  *
  *    On Linux, we use fcntl() to downgrade the lease. Then we update the node
- *    cache, free the clientData, and call it a day.
+ *    cache and call it a day.
  *
  * Results:
  *    None
  *
  * Side effects:
- *    None
+ *    The lease is downgraded or released.
  *
  *-----------------------------------------------------------------------------
  */
@@ -249,22 +741,35 @@ void
 HgfsAckOplockBreak(ServerLockData *lockData, // IN: server lock info
                    HgfsLockType replyLock)   // IN: client has this lock
 {
-   int fileDesc, newLock;
+   HgfsOplockLease *lease;
+   fileDesc fileDesc;
+   int newLock;
    HgfsLockType actualLock;
 
    ASSERT(lockData);
    fileDesc = lockData->fileDesc;
    LOG(4, ("%s: Acknowledging break on fd %d\n", __FUNCTION__, fileDesc));
 
+   if (gOplock == NULL) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gOplock->lock);
+   lease = HgfsOplockFindLease(fileDesc, lockData->session);
+   if (lease == NULL || !lease->breakPending) {
+      MXUser_ReleaseExclLock(gOplock->lock);
+      LOG(4, ("%s: no break pending on fd %d\n", __FUNCTION__, fileDesc));
+      return;
+   }
+
    /*
     * The Linux server supports lock downgrading. We only downgrade to a shared
-    * lock if our previous call to fcntl() said we could, and if the client
-    * wants to downgrade to a shared lock. Otherwise, we break altogether.
+    * lock if the kernel said we could, and if the client wants to downgrade
+    * to a shared lock. Otherwise, we break altogether.
     */
-   if (lockData->serverLock == HGFS_LOCK_SHARED &&
-       replyLock == HGFS_LOCK_SHARED) {
+   if (lease->breakTo == HGFS_LOCK_SHARED && replyLock == HGFS_LOCK_SHARED) {
       newLock = F_RDLCK;
-      actualLock = replyLock;
+      actualLock = HGFS_LOCK_SHARED;
    } else {
       newLock = F_UNLCK;
       actualLock = HGFS_LOCK_NONE;
@@ -275,103 +780,109 @@ HgfsAckOplockBreak(ServerLockData *lockData, // IN: server lock info
       int error = errno;
       Log("%s: Could not break lease on fd %d: %s\n",
           __FUNCTION__, fileDesc, strerror(error));
+      if (newLock != F_UNLCK) {
+         fcntl(fileDesc, F_SETLEASE, F_UNLCK);
+         actualLock = HGFS_LOCK_NONE;
+      }
    }
 
+   if (actualLock == HGFS_LOCK_NONE) {
+      DblLnkLst_Unlink1(&lease->links);
+      free(lease);
+   } else {
+      lease->lock = actualLock;
+      lease->breakPending = FALSE;
+      lease->breakSent = FALSE;
+   }
+   MXUser_ReleaseExclLock(gOplock->lock);
+
    /* Cleanup. */
-   HgfsUpdateNodeServerLock(fileDesc, actualLock);
-   free(lockData);
+   HgfsUpdateNodeServerLock(fileDesc, lockData->session, actualLock);
 }
+#endif
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerSigOplockBreak --
+ * HgfsRemoveServerLock --
  *
- *      Handle a pending oplock break. Called from the VMX poll loop context.
- *      All we really do is set up the state for an oplock break and call
- *      HgfsServerOplockBreak which will do the rest of the work.
+ *    Forget the lease held on a descriptor that is about to be closed.
+ *    Closing the descriptor releases the lease itself.
+ *
+ *    This may be called with the session's nodeArrayLock held.
  *
  * Results:
- *      None.
+ *    None
  *
  * Side effects:
- *      None.
+ *    None
  *
  *-----------------------------------------------------------------------------
  */
 
-static void
-HgfsServerSigOplockBreak(int sigNum,       // IN: Signal number
-                         siginfo_t *info,  // IN: Additional info about signal
-                         ucontext_t *u,    // IN: Interrupted context (regs etc)
-                         void *clientData) // IN: Ignored
+void
+HgfsRemoveServerLock(fileDesc fileDesc)  // IN: OS handle
 {
-   ServerLockData *lockData;
-   int newLease, fd;
-   HgfsLockType newServerLock;
+#ifdef HGFS_OPLOCKS
+   HgfsOplockLease *lease;
 
-   ASSERT(sigNum == SIGIO);
-   ASSERT(info);
-   ASSERT(clientData == NULL);
+   if (gOplock == NULL) {
+      return;
+   }
 
-   fd = info->si_fd;
-   LOG(4, ("%s: Received SIGIO for fd %d\n", __FUNCTION__, fd));
+   MXUser_AcquireExclLock(gOplock->lock);
+   lease = HgfsOplockFindLease(fileDesc, NULL);
+   if (lease != NULL) {
+      LOG(4, ("%s: removing lease on fd %d\n", __FUNCTION__, fileDesc));
+      DblLnkLst_Unlink1(&lease->links);
+      free(lease);
+   }
+   MXUser_ReleaseExclLock(gOplock->lock);
+#endif
+}
 
-   /*
-    * We've got all we need from the signal handler, let it continue handling
-    * signals of this type.
-    */
-   Sig_Continue(sigNum);
 
-   /*
-    * According to locks.c in kernel source, doing F_GETLEASE when a lease
-    * break is pending will return the new lease we should use. It'll be
-    * F_RDLCK if we can downgrade, or F_UNLCK if we should break altogether.
-    */
-   newLease = fcntl(fd, F_GETLEASE);
-   if (newLease == F_RDLCK) {
-      newServerLock = HGFS_LOCK_SHARED;
-   } else if (newLease == F_UNLCK) {
-      newServerLock = HGFS_LOCK_NONE;
-   } else if (newLease == -1) {
-      int error = errno;
-      Log("%s: Could not get old lease for fd %d: %s\n", __FUNCTION__,
-          fd, strerror(error));
-      goto error;
-   } else {
-      Log("%s: Unexpected reply to get lease for fd %d: %d\n",
-          __FUNCTION__, fd, newLease);
-      goto error;
-   }
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsRemoveSessionServerLocks --
+ *
+ *    Forget all the leases held for a session that is going away. Waits for
+ *    any break being delivered to the session to complete, so the dispatcher
+ *    no longer refers to the session once this returns.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-   /*
-    * Setup a ServerLockData struct so that we can make use of
-    * HgfsServerOplockBreak which does the heavy lifting of discovering which
-    * HGFS handle we're interested in breaking, sending the break, receiving
-    * the acknowledgement, and firing the platform-specific acknowledgement
-    * function (where we'll downgrade the lease).
-    */
-   lockData = malloc(sizeof *lockData);
-   if (lockData) {
-      lockData->fileDesc = fd;
-      lockData->serverLock = newServerLock;
-      lockData->event = 0; // not needed
+void
+HgfsRemoveSessionServerLocks(HgfsSessionInfo *session)  // IN: session info
+{
+#ifdef HGFS_OPLOCKS
+   DblLnkLst_Links *link;
+   DblLnkLst_Links *nextLink;
 
-      /*
-       * Relinquish control of this data. It'll get freed later, when the RPC
-       * command completes.
-       */
-      HgfsServerOplockBreak(lockData);
+   if (gOplock == NULL) {
       return;
-   } else {
-      Log("%s: Could not allocate memory for lease break on behalf of fd %d\n",
-          __FUNCTION__, fd);
    }
 
-  error:
-   /* Clean up as best we can. */
-   fcntl(fd, F_SETLEASE, F_UNLCK);
-   HgfsUpdateNodeServerLock(fd, HGFS_LOCK_NONE);
+   MXUser_AcquireExclLock(gOplock->dispatchLock);
+   MXUser_AcquireExclLock(gOplock->lock);
+   DblLnkLst_ForEachSafe(link, nextLink, &gOplock->leases) {
+      HgfsOplockLease *lease = DblLnkLst_Container(link, HgfsOplockLease, links);
+
+      if (lease->session == session) {
+         DblLnkLst_Unlink1(&lease->links);
+         free(lease);
+      }
+   }
+   MXUser_ReleaseExclLock(gOplock->lock);
+   MXUser_ReleaseExclLock(gOplock->dispatchLock);
+#endif
 }
-#endif /* HGFS_OPLOCKS */
@@ -407,6 +407,73 @@ HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPU_GetDataPacketIov --
+ *
+ *    Get the data packet of an hgfs packet as an array of guest mappings.
+ *    Unlike HSPU_GetDataPacketBuf a data packet spanning more than one iov
+ *    is not copied into an allocated contiguous buffer, the caller performs
+ *    vectored IO directly on the mappings.
+ *
+ * Results:
+ *    Pointer to the first mapped iov of the data packet, NULL on failure.
+ *
+ * Side effects:
+ *    Guest mappings are held until HSPU_PutDataPacketBuf.
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsVmxIov *
+HSPU_GetDataPacketIov(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
+                      MappingType mappingType,              // IN: Writeable/Readable
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      uint32 *iovCount)                     // OUT: mapped iov count
+{
+   HgfsChannelMapVirtAddrFunc mapVa;
+
+   ASSERT(packet->dataPacket == NULL);
+
+   if (packet->dataPacketMappedIov != 0) {
+      goto exit;
+   }
+
+   if (packet->dataPacketSize == 0 || chanCb == NULL) {
+      return NULL;
+   }
+
+   if (mappingType == BUF_WRITEABLE ||
+       mappingType == BUF_READWRITEABLE) {
+      mapVa = chanCb->getWriteVa;
+   } else {
+      ASSERT(mappingType == BUF_READABLE);
+      mapVa = chanCb->getReadVa;
+   }
+
+   /* Looks like we are in the middle of poweroff. */
+   if (mapVa == NULL) {
+      return NULL;
+   }
+
+   packet->dataMappingType = mappingType;
+   if (!HSPUMapBuf(mapVa,
+                   chanCb->putVa,
+                   packet->dataPacketSize,
+                   packet->dataPacketIovIndex,
+                   packet->iovCount,
+                   packet->iov,
+                   &packet->dataPacketMappedIov)) {
+      /* Guest probably passed us bad physical address */
+      return NULL;
+   }
+
+exit:
+   *iovCount = packet->dataPacketMappedIov;
+   return &packet->iov[packet->dataPacketIovIndex];
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -585,7 +652,8 @@ void
 HSPU_PutDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
                       HgfsServerChannelCallbacks *chanCb)   // IN: Channel callbacks
 {
-   if (packet->dataPacket == NULL) {
+   /* Mappings without a buffer are held by HSPU_GetDataPacketIov. */
+   if (packet->dataPacket == NULL && packet->dataPacketMappedIov == 0) {
       return;
    }
 
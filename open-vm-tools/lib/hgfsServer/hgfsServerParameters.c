@@ -115,7 +115,7 @@ static HgfsCapability hgfsDefaultCapabilityTable[] =
    {HGFS_OP_LINKMOVE_V4,           HGFS_REQUEST_NOT_SUPPORTED},
    {HGFS_OP_FSCTL_V4,              HGFS_REQUEST_NOT_SUPPORTED},
    {HGFS_OP_ACCESS_CHECK_V4,       HGFS_REQUEST_NOT_SUPPORTED},
-   {HGFS_OP_FSYNC_V4,              HGFS_REQUEST_NOT_SUPPORTED},
+   {HGFS_OP_FSYNC_V4,              HGFS_REQUEST_SUPPORTED},
    {HGFS_OP_QUERY_VOLUME_INFO_V4,  HGFS_REQUEST_NOT_SUPPORTED},
    {HGFS_OP_OPLOCK_ACQUIRE_V4,     HGFS_REQUEST_NOT_SUPPORTED},
    {HGFS_OP_OPLOCK_BREAK_V4,       HGFS_REQUEST_NOT_SUPPORTED},
@@ -123,6 +123,7 @@ static HgfsCapability hgfsDefaultCapabilityTable[] =
    {HGFS_OP_UNLOCK_BYTE_RANGE_V4,  HGFS_REQUEST_NOT_SUPPORTED},
    {HGFS_OP_QUERY_EAS_V4,          HGFS_REQUEST_NOT_SUPPORTED},
    {HGFS_OP_SET_EAS_V4,            HGFS_REQUEST_NOT_SUPPORTED},
+   {HGFS_OP_COMPOUND_V4,           HGFS_REQUEST_SUPPORTED},
 };
 
 
@@ -5687,6 +5688,91 @@ HgfsUnpackRemoveWatchRequest(const void *packet,            // IN: HGFS packet
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackFsyncRequest --
+ *
+ *    Unpack hgfs fsync request.
+ *
+ * Results:
+ *    TRUE on success.
+ *    FALSE on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUnpackFsyncRequest(const void *packet,   // IN: HGFS packet
+                       size_t packetSize,    // IN: request packet size
+                       HgfsOp op,            // IN: requested operation
+                       HgfsHandle *file)     // OUT: file handle to sync
+{
+   const HgfsRequestFsyncV4 *requestV4 = packet;
+
+   ASSERT(packet);
+   ASSERT(file);
+
+   ASSERT(HGFS_OP_FSYNC_V4 == op);
+
+   if (HGFS_OP_FSYNC_V4 != op) {
+      return FALSE;
+   } else if (packetSize < sizeof *requestV4) {
+      LOG(4, ("%s: Error decoding HGFS packet\n", __FUNCTION__));
+      return FALSE;
+   }
+
+   *file = requestV4->fid;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPackFsyncReply --
+ *
+ *    Pack hgfs fsync reply to the HgfsReplyFsyncV4 structure.
+ *
+ * Results:
+ *    TRUE if successfully allocated reply request, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsPackFsyncReply(HgfsPacket *packet,           // IN/OUT: Hgfs Packet
+                   const void *packetHeader,     // IN: packet header
+                   HgfsOp     op,                // IN: operation code
+                   size_t *payloadSize,          // OUT: size of packet
+                   HgfsSessionInfo *session)     // IN: Session info
+{
+   Bool result = TRUE;
+   HgfsReplyFsyncV4 *reply;
+
+   HGFS_ASSERT_PACK_PARAMS;
+
+   *payloadSize = 0;
+
+   if (HGFS_OP_FSYNC_V4 != op) {
+      NOT_REACHED();
+      result = FALSE;
+   } else {
+      reply = HgfsAllocInitReply(packet, packetHeader, sizeof *reply,
+                                 session);
+      reply->reserved = 0;
+      *payloadSize = sizeof *reply;
+   }
+   return result;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -5924,6 +6010,53 @@ HgfsUnpackOplockBreakAckReply(const void *packet,            // IN: HGFS packet
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackCompoundRequest --
+ *
+ *    Unpack hgfs compound request.
+ *
+ * Results:
+ *    TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUnpackCompoundRequest(const void *packet,      // IN: HGFS packet
+                          size_t packetSize,       // IN: request packet size
+                          HgfsOp op,               // IN: operation version
+                          uint32 *numRequests,     // OUT: contained requests
+                          const void **requests,   // OUT: first request
+                          size_t *requestsSize)    // OUT: size of all requests
+{
+   const HgfsRequestCompoundV4 *requestV4 = packet;
+
+   ASSERT(numRequests);
+   ASSERT(requests);
+   ASSERT(requestsSize);
+
+   ASSERT(HGFS_OP_COMPOUND_V4 == op);
+
+   if (HGFS_OP_COMPOUND_V4 != op ||
+       packetSize < sizeof *requestV4 ||
+       0 == requestV4->numRequests ||
+       requestV4->numRequests > HGFS_COMPOUND_MAX_REQUESTS) {
+      LOG(4, ("%s: Error unpacking HGFS_OP_COMPOUND_V4 packet\n", __FUNCTION__));
+      return FALSE;
+   }
+
+   *numRequests = requestV4->numRequests;
+   *requests = requestV4 + 1;
+   *requestsSize = packetSize - sizeof *requestV4;
+   return TRUE;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -338,6 +338,17 @@ HgfsPackRemoveWatchReply(HgfsPacket *packet,           // IN/OUT: Hgfs Packet
                          HgfsOp     op,                // IN: operation code
                          size_t *payloadSize,          // OUT: size of packet
                          HgfsSessionInfo *session);    // IN: Session info
+Bool
+HgfsUnpackFsyncRequest(const void *packet,   // IN: HGFS packet
+                       size_t packetSize,    // IN: packet size
+                       HgfsOp op,            // IN: operation code
+                       HgfsHandle *file);    // OUT: file handle
+Bool
+HgfsPackFsyncReply(HgfsPacket *packet,           // IN/OUT: Hgfs Packet
+                   const void *packetHeader,     // IN: packet header
+                   HgfsOp     op,                // IN: operation code
+                   size_t *payloadSize,          // OUT: size of packet
+                   HgfsSessionInfo *session);    // IN: Session info
 size_t
 HgfsPackCalculateNotificationSize(char const *shareName, // IN: shared folder name
                                   char *fileName);       // IN: file name
@@ -350,6 +361,27 @@ HgfsPackChangeNotificationRequest(void *packet,                    // IN/OUT: Hg
                                   uint32 notifyFlags,              // IN: notify flags
                                   HgfsSessionInfo *session,        // IN: session
                                   size_t *bufferSize);             // IN/OUT: packet size
+size_t
+HgfsPackGetOplockBreakSize(void);
+Bool
+HgfsPackOplockBreakRequest(void *packet,                    // IN/OUT: Hgfs Packet
+                           HgfsHandle fileId,               // IN: file ID
+                           HgfsLockType serverLock,         // IN: lock type
+                           uint64 sessionId,                // IN: session ID
+                           size_t *bufferSize);             // IN/OUT: size of packet
+Bool
+HgfsUnpackOplockBreakAckReply(const void *packet,            // IN: HGFS packet
+                              size_t packetSize,             // IN: reply packet size
+                              HgfsOp op,                     // IN: operation version
+                              HgfsHandle *fileId,            // OUT: file Id to remove
+                              HgfsLockType *serverLock);     // OUT: lock type
+Bool
+HgfsUnpackCompoundRequest(const void *packet,      // IN: HGFS packet
+                          size_t packetSize,       // IN: request packet size
+                          HgfsOp op,               // IN: operation version
+                          uint32 *numRequests,     // OUT: contained requests
+                          const void **requests,   // OUT: first request
+                          size_t *requestsSize);   // OUT: size of all requests
 
 
 #endif // ifndef _HGFS_SERVER_PARAMETERS_H_
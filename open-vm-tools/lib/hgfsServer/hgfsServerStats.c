@@ -0,0 +1,283 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsServerStats.c --
+ *
+ *	Request statistics of the HGFS server: for each operation the number
+ *	of requests, failures and bytes transferred and a histogram of the
+ *	request latencies, plus node cache and session counters. They tell
+ *	whether slowness seen by a guest is spent in the server and in which
+ *	operations.
+ *
+ *	Statistics are updated with atomic operations only so recording a
+ *	request never waits on a lock.
+ */
+
+#include <stdio.h>
+
+#include "vmware.h"
+#include "vm_atomic.h"
+#include "hgfsServerStats.h"
+
+/*
+ * Latency histogram buckets: bucket 0 counts requests that took less than
+ * 1us, bucket N those that took from 2^(N-1) up to 2^N us, and the last
+ * bucket everything slower.
+ */
+#define HGFS_STATS_LATENCY_BUCKETS 24
+
+typedef struct HgfsOpStats {
+   Atomic_uint64 count;
+   Atomic_uint64 errors;
+   Atomic_uint64 bytes;
+   Atomic_uint64 totalUS;
+   Atomic_uint64 latency[HGFS_STATS_LATENCY_BUCKETS];
+} HgfsOpStats;
+
+static HgfsOpStats gHgfsOpStats[HGFS_OP_MAX];
+static Atomic_uint64 gHgfsStatsCounters[HGFS_STATS_COUNTER_MAX];
+
+static const char *const gHgfsOpNames[] = {
+   "OPEN",
+   "READ",
+   "WRITE",
+   "CLOSE",
+   "SEARCH_OPEN",
+   "SEARCH_READ",
+   "SEARCH_CLOSE",
+   "GETATTR",
+   "SETATTR",
+   "CREATE_DIR",
+   "DELETE_FILE",
+   "DELETE_DIR",
+   "RENAME",
+   "QUERY_VOLUME_INFO",
+   "OPEN_V2",
+   "GETATTR_V2",
+   "SETATTR_V2",
+   "SEARCH_READ_V2",
+   "CREATE_SYMLINK",
+   "SERVER_LOCK_CHANGE",
+   "CREATE_DIR_V2",
+   "DELETE_FILE_V2",
+   "DELETE_DIR_V2",
+   "RENAME_V2",
+   "OPEN_V3",
+   "READ_V3",
+   "WRITE_V3",
+   "CLOSE_V3",
+   "SEARCH_OPEN_V3",
+   "SEARCH_READ_V3",
+   "SEARCH_CLOSE_V3",
+   "GETATTR_V3",
+   "SETATTR_V3",
+   "CREATE_DIR_V3",
+   "DELETE_FILE_V3",
+   "DELETE_DIR_V3",
+   "RENAME_V3",
+   "QUERY_VOLUME_INFO_V3",
+   "CREATE_SYMLINK_V3",
+   "SERVER_LOCK_CHANGE_V3",
+   "WRITE_WIN32_STREAM_V3",
+   "CREATE_SESSION_V4",
+   "DESTROY_SESSION_V4",
+   "READ_FAST_V4",
+   "WRITE_FAST_V4",
+   "SET_WATCH_V4",
+   "REMOVE_WATCH_V4",
+   "NOTIFY_V4",
+   "SEARCH_READ_V4",
+   "OPEN_V4",
+   "ENUMERATE_STREAMS_V4",
+   "GETATTR_V4",
+   "SETATTR_V4",
+   "DELETE_V4",
+   "LINKMOVE_V4",
+   "FSCTL_V4",
+   "ACCESS_CHECK_V4",
+   "FSYNC_V4",
+   "QUERY_VOLUME_INFO_V4",
+   "OPLOCK_ACQUIRE_V4",
+   "OPLOCK_BREAK_V4",
+   "LOCK_BYTE_RANGE_V4",
+   "UNLOCK_BYTE_RANGE_V4",
+   "QUERY_EAS_V4",
+   "SET_EAS_V4",
+   "COMPOUND_V4",
+};
+
+static const char *const gHgfsCounterNames[] = {
+   "cache hits",
+   "cache misses",
+   "cache evictions",
+   "sessions created",
+   "sessions destroyed",
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStats_RecordRequest --
+ *
+ *    Account for a completed request.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStats_RecordRequest(HgfsOp op,              // IN: operation
+                              uint32 status,          // IN: reply status
+                              uint64 bytes,           // IN: bytes transferred
+                              VmTimeType latencyUS)   // IN: time since receipt
+{
+   HgfsOpStats *stats;
+   uint32 bucket = 0;
+   uint64 remaining;
+
+   if (op >= ARRAYSIZE(gHgfsOpStats)) {
+      return;
+   }
+   stats = &gHgfsOpStats[op];
+
+   if (latencyUS < 0) {
+      latencyUS = 0;
+   }
+   remaining = latencyUS;
+   while (remaining > 0 && bucket < HGFS_STATS_LATENCY_BUCKETS - 1) {
+      remaining >>= 1;
+      bucket++;
+   }
+
+   Atomic_Inc64(&stats->count);
+   if (0 != status) {
+      Atomic_Inc64(&stats->errors);
+   }
+   Atomic_Add64(&stats->bytes, bytes);
+   Atomic_Add64(&stats->totalUS, latencyUS);
+   Atomic_Inc64(&stats->latency[bucket]);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStats_Inc --
+ *
+ *    Increment one of the server counters.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStats_Inc(HgfsStatsCounter counter)  // IN: counter
+{
+   ASSERT(counter < HGFS_STATS_COUNTER_MAX);
+
+   Atomic_Inc64(&gHgfsStatsCounters[counter]);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServer_DumpStats --
+ *
+ *    Print the server statistics, one line at a time. Operations that were
+ *    never requested are skipped, as are empty latency buckets.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServer_DumpStats(HgfsServerStatsPrintFunc printFunc,  // IN: line printer
+                     void *clientData)                    // IN: printer data
+{
+   char line[512];
+   uint64 created;
+   uint64 destroyed;
+   uint32 i;
+
+   ASSERT_ON_COMPILE(ARRAYSIZE(gHgfsOpNames) == HGFS_OP_MAX);
+   ASSERT_ON_COMPILE(ARRAYSIZE(gHgfsCounterNames) == HGFS_STATS_COUNTER_MAX);
+
+   for (i = 0; i < HGFS_STATS_COUNTER_MAX; i++) {
+      snprintf(line, sizeof line, "hgfs %s: %"FMT64"u", gHgfsCounterNames[i],
+               Atomic_Read64(&gHgfsStatsCounters[i]));
+      printFunc(clientData, line);
+   }
+   created = Atomic_Read64(&gHgfsStatsCounters[HGFS_STATS_SESSION_CREATED]);
+   destroyed = Atomic_Read64(&gHgfsStatsCounters[HGFS_STATS_SESSION_DESTROYED]);
+   snprintf(line, sizeof line, "hgfs sessions active: %"FMT64"u",
+            created >= destroyed ? created - destroyed : 0);
+   printFunc(clientData, line);
+
+   for (i = 0; i < HGFS_OP_MAX; i++) {
+      HgfsOpStats *stats = &gHgfsOpStats[i];
+      uint64 count = Atomic_Read64(&stats->count);
+      size_t len;
+      uint32 bucket;
+
+      if (0 == count) {
+         continue;
+      }
+
+      snprintf(line, sizeof line,
+               "hgfs op %s: count %"FMT64"u errors %"FMT64"u bytes %"FMT64"u "
+               "avg %"FMT64"uus", gHgfsOpNames[i], count,
+               Atomic_Read64(&stats->errors), Atomic_Read64(&stats->bytes),
+               Atomic_Read64(&stats->totalUS) / count);
+      printFunc(clientData, line);
+
+      len = snprintf(line, sizeof line, "hgfs op %s: latency", gHgfsOpNames[i]);
+      for (bucket = 0; bucket < HGFS_STATS_LATENCY_BUCKETS; bucket++) {
+         uint64 hits = Atomic_Read64(&stats->latency[bucket]);
+
+         if (0 == hits || len >= sizeof line) {
+            continue;
+         }
+         if (bucket < HGFS_STATS_LATENCY_BUCKETS - 1) {
+            len += snprintf(line + len, sizeof line - len, " <%"FMT64"uus:%"FMT64"u",
+                            CONST64U(1) << bucket, hits);
+         } else {
+            len += snprintf(line + len, sizeof line - len, " >=%"FMT64"uus:%"FMT64"u",
+                            CONST64U(1) << (bucket - 1), hits);
+         }
+      }
+      printFunc(clientData, line);
+   }
+}
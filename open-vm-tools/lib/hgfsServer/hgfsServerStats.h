@@ -0,0 +1,47 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+#ifndef _HGFS_SERVER_STATS_H_
+#define _HGFS_SERVER_STATS_H_
+
+/*
+ * hgfsServerStats.h --
+ *
+ *	Function definitions for the HGFS server request statistics.
+ */
+
+#include "vm_basic_types.h"
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+
+typedef enum {
+   HGFS_STATS_CACHE_HIT,          /* Handle found in the open node cache. */
+   HGFS_STATS_CACHE_MISS,         /* Handle had to be reopened. */
+   HGFS_STATS_CACHE_EVICTION,     /* Node closed to make room in the cache. */
+   HGFS_STATS_SESSION_CREATED,
+   HGFS_STATS_SESSION_DESTROYED,
+   HGFS_STATS_COUNTER_MAX
+} HgfsStatsCounter;
+
+void HgfsServerStats_RecordRequest(HgfsOp op,
+                                   uint32 status,
+                                   uint64 bytes,
+                                   VmTimeType latencyUS);
+void HgfsServerStats_Inc(HgfsStatsCounter counter);
+
+#endif // _HGFS_SERVER_STATS_H_
@@ -0,0 +1,1041 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsServerWriteBehind.c --
+ *
+ *	Write-behind buffering for small positioned HGFS writes.
+ *
+ *	Applications logging into a shared folder issue long runs of small
+ *	writes, each at the offset where the previous one ended. Instead of a
+ *	system call per request, contiguous writes to a handle are copied into
+ *	a per-handle buffer and written out together once the buffer fills, a
+ *	write does not follow on, or HGFS_WRITE_BEHIND_DELAY_MS have passed. A
+ *	write that does not fit is gathered with the buffered data into a
+ *	single pwritev.
+ *
+ *	Buffered data is flushed before the file is read, searched or synced,
+ *	its attributes are queried or changed, a file is opened and before the
+ *	handle is closed, whichever session does so, so no client observes the
+ *	delay. A failure to write out buffered data is kept with the handle and
+ *	returned by the next fsync or by the close of that handle, as the
+ *	failure of a buffered write would be by the file system. Descriptors
+ *	opened with O_SYNC or O_DSYNC are never buffered.
+ *
+ *	Write-behind is off unless enabled in the tools configuration.
+ *
+ *	An entry is owned by at most one thread at a time, marked busy while
+ *	its buffer is filled or written out, so no file I/O is done while
+ *	holding the lock.
+ */
+
+#if defined(__linux__)
+#define HGFS_WRITE_BEHIND
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef HGFS_WRITE_BEHIND
+#   include <fcntl.h>
+#   include <glib.h>
+#endif
+
+#include "vmware.h"
+#include "vm_basic_types.h"
+#include "vm_atomic.h"
+#include "dbllnklst.h"
+#include "userlock.h"
+#include "mutexRankLib.h"
+#include "hostinfo.h"
+#include "util.h"
+
+#include "hgfsServerInt.h"
+#include "hgfsServerWriteBehind.h"
+
+#define LOGLEVEL_MODULE hgfs
+#include "loglevel_user.h"
+
+
+#ifdef HGFS_WRITE_BEHIND
+/* Bytes buffered per handle before they are written out. */
+#define HGFS_WRITE_BEHIND_BUFFER_SIZE   (64 * 1024)
+
+/* How long buffered data may wait for a following write. */
+#define HGFS_WRITE_BEHIND_DELAY_MS      50
+
+/* Handles that can have a buffer at the same time. */
+#define HGFS_WRITE_BEHIND_MAX_ENTRIES   32
+
+/* Write data mappings the gather path describes without allocating. */
+#define HGFS_WRITE_BEHIND_STACK_IOVS    8
+
+typedef struct HgfsWriteBehindEntry {
+   DblLnkLst_Links links;
+   HgfsSessionInfo *session;
+   HgfsHandle file;
+   fileDesc fd;
+   HgfsLocalId localId;
+   Bool sync;                          /* Writes go straight through. */
+   Bool busy;                          /* Owned by a thread outside the lock. */
+
+   /* The fields below are only accessed by the owner of the entry. */
+   uint64 offset;                      /* File offset of the buffered data. */
+   uint32 used;                        /* Bytes buffered. */
+   VmTimeType deadline;                /* When the buffer must be written. */
+   HgfsInternalStatus error;           /* Failure not yet reported. */
+   char *buffer;
+} HgfsWriteBehindEntry;
+
+typedef struct HgfsWriteBehindState {
+   /* Protects the entry list, the busy flags and exiting. */
+   MXUserExclLock *lock;
+   MXUserCondVar *idleVar;             /* An entry stopped being busy. */
+   MXUserCondVar *timerVar;            /* Wakes the flusher thread. */
+   DblLnkLst_Links entries;
+   Bool exiting;
+   GThread *thread;
+} HgfsWriteBehindState;
+
+static HgfsWriteBehindState *gWriteBehind = NULL;
+
+/* Number of entries, read without the lock to skip work when there are none. */
+static Atomic_uint32 gWriteBehindNumEntries;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehindFind --
+ *
+ *    Look up the entry of a handle.
+ *
+ *    gWriteBehind->lock should be acquired prior to calling this function.
+ *
+ * Results:
+ *    The entry, or NULL if the handle has none.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsWriteBehindEntry *
+HgfsWriteBehindFind(HgfsSessionInfo *session,  // IN: session info
+                    HgfsHandle file)           // IN: file handle
+{
+   DblLnkLst_Links *link;
+
+   DblLnkLst_ForEach(link, &gWriteBehind->entries) {
+      HgfsWriteBehindEntry *entry =
+         DblLnkLst_Container(link, HgfsWriteBehindEntry, links);
+
+      if (entry->session == session && entry->file == file) {
+         return entry;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehindGrab --
+ *
+ *    Take ownership of the entry of a handle, waiting for the current owner
+ *    to finish.
+ *
+ *    gWriteBehind->lock should be acquired prior to calling this function.
+ *
+ * Results:
+ *    The entry, marked busy, or NULL if the handle has none.
+ *
+ * Side effects:
+ *    May release and reacquire the lock.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsWriteBehindEntry *
+HgfsWriteBehindGrab(HgfsSessionInfo *session,  // IN: session info
+                    HgfsHandle file)           // IN: file handle
+{
+   HgfsWriteBehindEntry *entry;
+
+   for (;;) {
+      /* Look again after waiting, the entry may have been removed. */
+      entry = HgfsWriteBehindFind(session, file);
+      if (entry == NULL || !entry->busy) {
+         break;
+      }
+      MXUser_WaitCondVarExclLock(gWriteBehind->lock, gWriteBehind->idleVar);
+   }
+
+   if (entry != NULL) {
+      entry->busy = TRUE;
+   }
+   return entry;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehindRelease --
+ *
+ *    Give up ownership of an entry.
+ *
+ *    gWriteBehind->lock should be acquired prior to calling this function.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Wakes the threads waiting for the entry.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsWriteBehindRelease(HgfsWriteBehindEntry *entry)  // IN/OUT: owned entry
+{
+   ASSERT(entry->busy);
+   entry->busy = FALSE;
+   MXUser_BroadcastCondVar(gWriteBehind->idleVar);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehindWriteVec --
+ *
+ *    Write the described data at the entry's buffer offset, continuing
+ *    after short writes. The iovs are consumed as the data is written.
+ *
+ * Results:
+ *    Zero on success, an error otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsWriteBehindWriteVec(HgfsWriteBehindEntry *entry,  // IN: owned entry
+                        HgfsVmxIov *vec,              // IN/OUT: data to write
+                        uint32 count,                 // IN: iov count
+                        uint32 total)                 // IN: bytes to write
+{
+   uint32 done = 0;
+
+   while (done < total) {
+      HgfsInternalStatus status;
+      uint32 written = 0;
+
+      status = HgfsPlatformWriteFileIov(entry->fd, entry->session,
+                                        entry->offset + done, total - done,
+                                        0, FALSE, FALSE, vec, count, &written);
+      if (status != 0) {
+         return status;
+      }
+      if (written == 0) {
+         return EIO;
+      }
+      done += written;
+
+      /* Skip what a short write already took care of. */
+      while (count > 0 && written >= vec->len) {
+         written -= vec->len;
+         vec++;
+         count--;
+      }
+      if (written > 0) {
+         vec->va = (char *)vec->va + written;
+         vec->len -= written;
+      }
+   }
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehindFlushEntry --
+ *
+ *    Write out the buffered data of an owned entry.
+ *
+ * Results:
+ *    Zero on success, an error otherwise. The buffer is empty either way.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsWriteBehindFlushEntry(HgfsWriteBehindEntry *entry)  // IN/OUT: owned entry
+{
+   HgfsVmxIov vec;
+   HgfsInternalStatus status;
+
+   ASSERT(entry->busy);
+
+   if (entry->used == 0) {
+      return 0;
+   }
+
+   memset(&vec, 0, sizeof vec);
+   vec.va = entry->buffer;
+   vec.len = entry->used;
+   status = HgfsWriteBehindWriteVec(entry, &vec, 1, entry->used);
+   if (status != 0) {
+      LOG(4, ("%s: could not write %u bytes at %"FMT64"u to fd %d: %d\n",
+              __FUNCTION__, entry->used, entry->offset, entry->fd, status));
+   }
+   entry->used = 0;
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehindGather --
+ *
+ *    Write out the buffered data of an owned entry together with a write
+ *    that follows it but does not fit in the buffer.
+ *
+ * Results:
+ *    Zero on success, an error otherwise. The buffer is empty either way.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsWriteBehindGather(HgfsWriteBehindEntry *entry,  // IN/OUT: owned entry
+                      uint32 size,                  // IN: bytes to write
+                      const void *data,             // IN: inline data or NULL
+                      HgfsVmxIov *iov,              // IN: mapped data
+                      uint32 iovCount)              // IN: mapped iov count
+{
+   HgfsVmxIov vecBuf[HGFS_WRITE_BEHIND_STACK_IOVS + 1];
+   HgfsVmxIov *vec = vecBuf;
+   uint32 count;
+   HgfsInternalStatus status;
+
+   if (data != NULL) {
+      memset(&vec[1], 0, sizeof vec[1]);
+      vec[1].va = (void *)data;
+      vec[1].len = size;
+      count = 2;
+   } else {
+      if (iovCount + 1 > ARRAYSIZE(vecBuf)) {
+         vec = Util_SafeMalloc((iovCount + 1) * sizeof *vec);
+      }
+      memcpy(&vec[1], iov, iovCount * sizeof *iov);
+      count = iovCount + 1;
+   }
+   memset(&vec[0], 0, sizeof vec[0]);
+   vec[0].va = entry->buffer;
+   vec[0].len = entry->used;
+
+   status = HgfsWriteBehindWriteVec(entry, vec, count, entry->used + size);
+   entry->used = 0;
+
+   if (vec != vecBuf) {
+      free(vec);
+   }
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehindCopy --
+ *
+ *    Append write data to the buffer of an owned entry.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsWriteBehindCopy(HgfsWriteBehindEntry *entry,  // IN/OUT: owned entry
+                    uint32 size,                  // IN: bytes to copy
+                    const void *data,             // IN: inline data or NULL
+                    HgfsVmxIov *iov,              // IN: mapped data
+                    uint32 iovCount)              // IN: mapped iov count
+{
+   char *dst = entry->buffer + entry->used;
+
+   if (data != NULL) {
+      memcpy(dst, data, size);
+   } else {
+      uint32 remaining = size;
+      uint32 i;
+
+      for (i = 0; i < iovCount && remaining > 0; i++) {
+         uint32 len = MIN(iov[i].len, remaining);
+
+         memcpy(dst, iov[i].va, len);
+         dst += len;
+         remaining -= len;
+      }
+      ASSERT(remaining == 0);
+   }
+   entry->used += size;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehindCreate --
+ *
+ *    Create the entry of a handle.
+ *
+ * Results:
+ *    The entry, marked busy, or NULL if too many handles have one.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsWriteBehindEntry *
+HgfsWriteBehindCreate(HgfsSessionInfo *session,  // IN: session info
+                      HgfsHandle file,           // IN: file handle
+                      fileDesc fd)               // IN: OS handle
+{
+   HgfsWriteBehindEntry *entry;
+   HgfsWriteBehindEntry *existing;
+   HgfsFileNode node;
+   int flags;
+
+   if (!HgfsGetNodeCopy(file, session, FALSE, &node)) {
+      return NULL;
+   }
+
+   entry = Util_SafeCalloc(1, sizeof *entry);
+   DblLnkLst_Init(&entry->links);
+   entry->session = session;
+   entry->file = file;
+   entry->fd = fd;
+   entry->localId = node.localId;
+   flags = fcntl(fd, F_GETFL);
+   entry->sync = flags == -1 || (flags & (O_SYNC | O_DSYNC)) != 0;
+   if (!entry->sync) {
+      entry->buffer = Util_SafeMalloc(HGFS_WRITE_BEHIND_BUFFER_SIZE);
+   }
+
+   MXUser_AcquireExclLock(gWriteBehind->lock);
+   existing = HgfsWriteBehindGrab(session, file);
+   if (existing == NULL &&
+       Atomic_Read(&gWriteBehindNumEntries) < HGFS_WRITE_BEHIND_MAX_ENTRIES) {
+      entry->busy = TRUE;
+      DblLnkLst_LinkLast(&gWriteBehind->entries, &entry->links);
+      Atomic_Inc(&gWriteBehindNumEntries);
+      existing = entry;
+      entry = NULL;
+   }
+   MXUser_ReleaseExclLock(gWriteBehind->lock);
+
+   if (entry != NULL) {
+      free(entry->buffer);
+      free(entry);
+   }
+   return existing;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehindFlushMatching --
+ *
+ *    Write out the buffered data of the entries of a session, or of all
+ *    sessions, optionally only those of a given file. Failures are kept in
+ *    the entries to be reported later, unless error is given: then they are
+ *    taken from the matching entries, along with those kept earlier, and the
+ *    first one is returned there.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsWriteBehindFlushMatching(HgfsSessionInfo *session,     // IN: session or NULL
+                             const HgfsLocalId *localId,   // IN: file or NULL
+                             HgfsInternalStatus *error)    // OUT/OPT: failure
+{
+   DblLnkLst_Links *link;
+
+   if (error != NULL) {
+      *error = 0;
+   }
+
+   MXUser_AcquireExclLock(gWriteBehind->lock);
+
+restart:
+   DblLnkLst_ForEach(link, &gWriteBehind->entries) {
+      HgfsWriteBehindEntry *entry =
+         DblLnkLst_Container(link, HgfsWriteBehindEntry, links);
+      HgfsInternalStatus status;
+
+      if ((session != NULL && entry->session != session) ||
+          (localId != NULL && (entry->localId.volumeId != localId->volumeId ||
+                               entry->localId.fileId != localId->fileId))) {
+         continue;
+      }
+
+      if (entry->busy) {
+         MXUser_WaitCondVarExclLock(gWriteBehind->lock, gWriteBehind->idleVar);
+         goto restart;
+      }
+      if (entry->used == 0 && (error == NULL || entry->error == 0)) {
+         continue;
+      }
+
+      entry->busy = TRUE;
+      MXUser_ReleaseExclLock(gWriteBehind->lock);
+
+      status = HgfsWriteBehindFlushEntry(entry);
+      if (status != 0 && entry->error == 0) {
+         entry->error = status;
+      }
+      if (error != NULL) {
+         if (*error == 0) {
+            *error = entry->error;
+         }
+         entry->error = 0;
+      }
+
+      MXUser_AcquireExclLock(gWriteBehind->lock);
+      HgfsWriteBehindRelease(entry);
+      goto restart;
+   }
+
+   MXUser_ReleaseExclLock(gWriteBehind->lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehindThread --
+ *
+ *    Flusher thread: writes out buffers that were not filled in time.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gpointer
+HgfsWriteBehindThread(gpointer data)  // IN: unused
+{
+   MXUser_AcquireExclLock(gWriteBehind->lock);
+
+   while (!gWriteBehind->exiting) {
+      VmTimeType now = Hostinfo_SystemTimerMS();
+      VmTimeType next = 0;
+      HgfsWriteBehindEntry *due = NULL;
+      DblLnkLst_Links *link;
+
+      DblLnkLst_ForEach(link, &gWriteBehind->entries) {
+         HgfsWriteBehindEntry *entry =
+            DblLnkLst_Container(link, HgfsWriteBehindEntry, links);
+
+         if (entry->busy || entry->used == 0) {
+            continue;
+         }
+         if (entry->deadline <= now) {
+            due = entry;
+            break;
+         }
+         if (next == 0 || entry->deadline < next) {
+            next = entry->deadline;
+         }
+      }
+
+      if (due != NULL) {
+         HgfsInternalStatus status;
+
+         due->busy = TRUE;
+         MXUser_ReleaseExclLock(gWriteBehind->lock);
+
+         status = HgfsWriteBehindFlushEntry(due);
+         if (status != 0 && due->error == 0) {
+            due->error = status;
+         }
+
+         MXUser_AcquireExclLock(gWriteBehind->lock);
+         HgfsWriteBehindRelease(due);
+      } else if (next == 0) {
+         MXUser_WaitCondVarExclLock(gWriteBehind->lock, gWriteBehind->timerVar);
+      } else {
+         MXUser_TimedWaitCondVarExclLock(gWriteBehind->lock,
+                                         gWriteBehind->timerVar,
+                                         (uint32)(next - now));
+      }
+   }
+
+   MXUser_ReleaseExclLock(gWriteBehind->lock);
+   return NULL;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehind_Init --
+ *
+ *    Start write-behind buffering.
+ *
+ * Results:
+ *    TRUE on success, FALSE if it is not available.
+ *
+ * Side effects:
+ *    Starts the flusher thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsWriteBehind_Init(void)
+{
+#ifdef HGFS_WRITE_BEHIND
+   HgfsWriteBehindState *state;
+   GError *err = NULL;
+
+   ASSERT(gWriteBehind == NULL);
+
+   state = Util_SafeCalloc(1, sizeof *state);
+   state->lock = MXUser_CreateExclLock("hgfsWriteBehindLock",
+                                       RANK_hgfsWriteBehindLock);
+   state->idleVar = MXUser_CreateCondVarExclLock(state->lock);
+   state->timerVar = MXUser_CreateCondVarExclLock(state->lock);
+   DblLnkLst_Init(&state->entries);
+   Atomic_Write(&gWriteBehindNumEntries, 0);
+
+   gWriteBehind = state;
+   state->thread = g_thread_create(HgfsWriteBehindThread, NULL, TRUE, &err);
+   if (err != NULL) {
+      LOG(4, ("%s: failed to start thread: %s\n", __FUNCTION__, err->message));
+      g_clear_error(&err);
+      gWriteBehind = NULL;
+      MXUser_DestroyCondVar(state->idleVar);
+      MXUser_DestroyCondVar(state->timerVar);
+      MXUser_DestroyExclLock(state->lock);
+      free(state);
+      return FALSE;
+   }
+
+   return TRUE;
+#else
+   return FALSE;
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehind_Exit --
+ *
+ *    Stop write-behind buffering, writing out any data still buffered.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Stops the flusher thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsWriteBehind_Exit(void)
+{
+#ifdef HGFS_WRITE_BEHIND
+   DblLnkLst_Links *link;
+   DblLnkLst_Links *nextLink;
+
+   if (gWriteBehind == NULL) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gWriteBehind->lock);
+   gWriteBehind->exiting = TRUE;
+   MXUser_SignalCondVar(gWriteBehind->timerVar);
+   MXUser_ReleaseExclLock(gWriteBehind->lock);
+   g_thread_join(gWriteBehind->thread);
+
+   HgfsWriteBehindFlushMatching(NULL, NULL, NULL);
+
+   DblLnkLst_ForEachSafe(link, nextLink, &gWriteBehind->entries) {
+      HgfsWriteBehindEntry *entry =
+         DblLnkLst_Container(link, HgfsWriteBehindEntry, links);
+
+      DblLnkLst_Unlink1(&entry->links);
+      free(entry->buffer);
+      free(entry);
+   }
+
+   MXUser_DestroyCondVar(gWriteBehind->idleVar);
+   MXUser_DestroyCondVar(gWriteBehind->timerVar);
+   MXUser_DestroyExclLock(gWriteBehind->lock);
+   free(gWriteBehind);
+   gWriteBehind = NULL;
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehind_Write --
+ *
+ *    Handle a positioned write to a handle. A write following on the data
+ *    buffered for the handle is added to the buffer if it fits, otherwise it
+ *    is written out together with the buffer. Data that does not follow on
+ *    causes the buffer to be written out first.
+ *
+ *    The data is either inline or in the mapped iovs of the request.
+ *
+ * Results:
+ *    FALSE if the caller should write the data itself, TRUE otherwise with
+ *    the result of the write in status and writtenSize. A failure to write
+ *    out earlier buffered data is kept for the next fsync or close.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsWriteBehind_Write(HgfsSessionInfo *session,    // IN: session info
+                      HgfsHandle file,             // IN: file handle
+                      fileDesc fd,                 // IN: OS handle
+                      uint64 offset,               // IN: file offset to write to
+                      uint32 size,                 // IN: length of data to write
+                      const void *data,            // IN: inline data or NULL
+                      HgfsVmxIov *iov,             // IN: mapped data
+                      uint32 iovCount,             // IN: mapped iov count
+                      uint32 *writtenSize,         // OUT: length written
+                      HgfsInternalStatus *status)  // OUT: result
+{
+#ifdef HGFS_WRITE_BEHIND
+   HgfsWriteBehindEntry *entry;
+   Bool handled = TRUE;
+   Bool wake = FALSE;
+
+   if (gWriteBehind == NULL) {
+      return FALSE;
+   }
+
+   MXUser_AcquireExclLock(gWriteBehind->lock);
+   entry = HgfsWriteBehindGrab(session, file);
+   MXUser_ReleaseExclLock(gWriteBehind->lock);
+
+   if (entry == NULL) {
+      /* Large writes alone gain nothing from the buffer. */
+      if (size >= HGFS_WRITE_BEHIND_BUFFER_SIZE) {
+         return FALSE;
+      }
+      entry = HgfsWriteBehindCreate(session, file, fd);
+      if (entry == NULL) {
+         return FALSE;
+      }
+   }
+
+   *status = 0;
+   if (entry->sync) {
+      handled = FALSE;
+      goto exit;
+   }
+
+   if (entry->used > 0 && entry->offset + entry->used != offset) {
+      HgfsInternalStatus flushStatus = HgfsWriteBehindFlushEntry(entry);
+
+      if (flushStatus != 0 && entry->error == 0) {
+         entry->error = flushStatus;
+      }
+   }
+
+   if (entry->used + size <= HGFS_WRITE_BEHIND_BUFFER_SIZE) {
+      if (entry->used == 0) {
+         entry->offset = offset;
+         entry->deadline = Hostinfo_SystemTimerMS() + HGFS_WRITE_BEHIND_DELAY_MS;
+         wake = TRUE;
+      }
+      HgfsWriteBehindCopy(entry, size, data, iov, iovCount);
+      *writtenSize = size;
+      if (entry->used == HGFS_WRITE_BEHIND_BUFFER_SIZE) {
+         *status = HgfsWriteBehindFlushEntry(entry);
+         wake = FALSE;
+      }
+   } else if (entry->used == 0) {
+      handled = FALSE;
+   } else {
+      *status = HgfsWriteBehindGather(entry, size, data, iov, iovCount);
+      *writtenSize = size;
+   }
+
+exit:
+   MXUser_AcquireExclLock(gWriteBehind->lock);
+   HgfsWriteBehindRelease(entry);
+   if (wake) {
+      MXUser_SignalCondVar(gWriteBehind->timerVar);
+   }
+   MXUser_ReleaseExclLock(gWriteBehind->lock);
+
+   return handled;
+#else
+   return FALSE;
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehind_Flush --
+ *
+ *    Write out the data buffered for a file by any handle of any session
+ *    before the file is read or its attributes are used.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsWriteBehind_Flush(HgfsSessionInfo *session,  // IN: session info
+                      HgfsHandle file)           // IN: file handle
+{
+#ifdef HGFS_WRITE_BEHIND
+   HgfsFileNode node;
+
+   if (gWriteBehind == NULL || Atomic_Read(&gWriteBehindNumEntries) == 0) {
+      return;
+   }
+
+   if (HgfsGetNodeCopy(file, session, FALSE, &node)) {
+      HgfsWriteBehindFlushMatching(NULL, &node.localId, NULL);
+   }
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehind_Sync --
+ *
+ *    Write out the data buffered for a file by any handle of any session
+ *    before the file is synced.
+ *
+ * Results:
+ *    Zero on success, otherwise the first failure to write out data buffered
+ *    for the file that has not been returned yet.
+ *
+ * Side effects:
+ *    The failures returned are no longer reported on close.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsWriteBehind_Sync(HgfsSessionInfo *session,  // IN: session info
+                     HgfsHandle file)           // IN: file handle
+{
+#ifdef HGFS_WRITE_BEHIND
+   HgfsFileNode node;
+   HgfsInternalStatus status = 0;
+
+   if (gWriteBehind == NULL || Atomic_Read(&gWriteBehindNumEntries) == 0) {
+      return 0;
+   }
+
+   if (HgfsGetNodeCopy(file, session, FALSE, &node)) {
+      HgfsWriteBehindFlushMatching(NULL, &node.localId, &status);
+   }
+   return status;
+#else
+   return 0;
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehind_FlushSession --
+ *
+ *    Write out the data buffered by all handles of a session, or by all
+ *    sessions if session is NULL.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsWriteBehind_FlushSession(HgfsSessionInfo *session)  // IN: session or NULL
+{
+#ifdef HGFS_WRITE_BEHIND
+   if (gWriteBehind == NULL || Atomic_Read(&gWriteBehindNumEntries) == 0) {
+      return;
+   }
+
+   HgfsWriteBehindFlushMatching(session, NULL, NULL);
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehind_Close --
+ *
+ *    Write out the data buffered for a handle that is being closed and
+ *    forget the handle.
+ *
+ *    This may be called with the session's nodeArrayLock held.
+ *
+ * Results:
+ *    Zero on success, otherwise the failure to write any of the data
+ *    buffered for the handle.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsWriteBehind_Close(HgfsSessionInfo *session,  // IN: session info
+                      HgfsHandle file)           // IN: file handle
+{
+#ifdef HGFS_WRITE_BEHIND
+   HgfsWriteBehindEntry *entry;
+   HgfsInternalStatus status;
+
+   if (gWriteBehind == NULL || Atomic_Read(&gWriteBehindNumEntries) == 0) {
+      return 0;
+   }
+
+   MXUser_AcquireExclLock(gWriteBehind->lock);
+   entry = HgfsWriteBehindGrab(session, file);
+   if (entry != NULL) {
+      DblLnkLst_Unlink1(&entry->links);
+      Atomic_Dec(&gWriteBehindNumEntries);
+   }
+   MXUser_ReleaseExclLock(gWriteBehind->lock);
+
+   if (entry == NULL) {
+      return 0;
+   }
+
+   status = HgfsWriteBehindFlushEntry(entry);
+   if (entry->error != 0) {
+      status = entry->error;
+   }
+
+   /* Waiters look the entry up again and no longer find it. */
+   MXUser_AcquireExclLock(gWriteBehind->lock);
+   MXUser_BroadcastCondVar(gWriteBehind->idleVar);
+   MXUser_ReleaseExclLock(gWriteBehind->lock);
+
+   free(entry->buffer);
+   free(entry);
+   return status;
+#else
+   return 0;
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehind_Remove --
+ *
+ *    Write out the data buffered for a handle whose descriptor is about to be
+ *    closed and forget the handle. Failures can no longer be reported to the
+ *    client and are only logged.
+ *
+ *    This may be called with the session's nodeArrayLock held.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsWriteBehind_Remove(HgfsSessionInfo *session,  // IN: session info
+                       HgfsHandle file)           // IN: file handle
+{
+   HgfsInternalStatus status = HgfsWriteBehind_Close(session, file);
+
+   if (status != 0) {
+      LOG(4, ("%s: lost buffered writes to handle %u: %d\n", __FUNCTION__,
+              file, status));
+   }
+}
@@ -0,0 +1,54 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+#ifndef _HGFS_SERVER_WRITEBEHIND_H_
+#define _HGFS_SERVER_WRITEBEHIND_H_
+
+/*
+ * hgfsServerWriteBehind.h --
+ *
+ *	Function definitions for the write-behind buffering of small positioned
+ *	HGFS writes.
+ */
+
+#include "hgfsServer.h"
+#include "hgfsServerInt.h"
+
+Bool HgfsWriteBehind_Init(void);
+void HgfsWriteBehind_Exit(void);
+Bool HgfsWriteBehind_Write(HgfsSessionInfo *session,
+                           HgfsHandle file,
+                           fileDesc fd,
+                           uint64 offset,
+                           uint32 size,
+                           const void *data,
+                           HgfsVmxIov *iov,
+                           uint32 iovCount,
+                           uint32 *writtenSize,
+                           HgfsInternalStatus *status);
+void HgfsWriteBehind_Flush(HgfsSessionInfo *session,
+                           HgfsHandle file);
+void HgfsWriteBehind_FlushSession(HgfsSessionInfo *session);
+HgfsInternalStatus HgfsWriteBehind_Sync(HgfsSessionInfo *session,
+                                        HgfsHandle file);
+HgfsInternalStatus HgfsWriteBehind_Close(HgfsSessionInfo *session,
+                                         HgfsHandle file);
+void HgfsWriteBehind_Remove(HgfsSessionInfo *session,
+                            HgfsHandle file);
+
+#endif // _HGFS_SERVER_WRITEBEHIND_H_
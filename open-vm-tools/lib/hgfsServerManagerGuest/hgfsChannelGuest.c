@@ -61,9 +61,13 @@
  * during general mutlithreaded operation of the tools processes.
  *
  * In order to support the above, we must track how many users of the shared
- * connection there are. This allows us to tear down the shared connection
+ * channel there are. This allows us to tear down the shared channel
  * when the final plugin that is using it is unloaded, and when no
  * channels are in use the HGFS server state can be torn down.
+ *
+ * Each user gets its own connection on the shared channel, and so its own
+ * HGFS server sessions, so that the requests of one user (e.g. a DnD file
+ * transfer) are not serialized behind those of another (e.g. vix guest ops).
  */
 
 /*
@@ -93,19 +97,34 @@ typedef struct HgfsChannelData {
    const char                 *name;          /* Channel name. */
    HgfsGuestChannelCBTable    *ops;           /* Channel operations. */
    uint32                     state;          /* Channel state (see flags below). */
-   struct HgfsGuestConn       *connection;    /* Opaque server connection */
    HgfsChannelServerData      *serverInfo;    /* HGFS server entry points. */
    Atomic_uint32              refCount;       /* Channel reference count. */
 } HgfsChannelData;
 
+/*
+ * A client's connection on a channel.
+ *
+ * Returned to the client in the server manager data, it references the
+ * shared channel and holds the client's own connection to the server.
+ */
+typedef struct HgfsChannelUser {
+   HgfsChannelData            *channel;       /* Referenced channel. */
+   struct HgfsGuestConn       *connection;    /* Opaque server connection */
+} HgfsChannelUser;
+
 #define HGFS_CHANNEL_STATE_INIT         (1 << 0)
 #define HGFS_CHANNEL_STATE_CBINIT       (1 << 1)
 
 /* Static channel registration - assumes only one for now. */
 static HgfsChannelData gHgfsChannels[] = {
-   { "guest", &gGuestBackdoorOps, 0, NULL, NULL, {0} },
+   { "guest", &gGuestBackdoorOps, 0, NULL, {0} },
 };
 
+/*
+ * Change notification stays off: the backdoor only carries replies to the
+ * host's requests, so the server has no way to push notification packets
+ * and never advertises HGFS_OP_SET_WATCH_V4 on it.
+ */
 static HgfsServerConfig gHgfsGuestCfgSettings = {
    (HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED | HGFS_CONFIG_VOL_INFO_MIN),
    HGFS_MAX_CACHED_FILENODES
@@ -414,7 +433,7 @@ HgfsChannelExitChannel(HgfsChannelData *channel) // IN/OUT: channel object
  *
  * HgfsChannelActivateChannel --
  *
- *      Activate a channel by calling the channels init callback.
+ *      Activate a channel so that its clients can open connections.
  *
  * Results:
  *      TRUE if a channel is active.
@@ -426,22 +445,10 @@ HgfsChannelExitChannel(HgfsChannelData *channel) // IN/OUT: channel object
  */
 
 static Bool
-HgfsChannelActivateChannel(HgfsChannelData *channel,   // IN/OUT: channel object
-                           void *rpc,                  // IN: Rpc channel
-                           void *rpcCallback)          // IN: Rpc callback
+HgfsChannelActivateChannel(HgfsChannelData *channel)   // IN/OUT: channel object
 {
-   Bool success = FALSE;
-   struct HgfsGuestConn *connData = NULL;
-
-   if (channel->ops->init(&channel->serverInfo->serverCBTable->session,
-                          rpc,
-                          rpcCallback,
-                          &connData)) {
-      channel->state |= HGFS_CHANNEL_STATE_CBINIT;
-      channel->connection = connData;
-      success = TRUE;
-   }
-   return success;
+   channel->state |= HGFS_CHANNEL_STATE_CBINIT;
+   return TRUE;
 }
 
 
@@ -450,7 +457,8 @@ HgfsChannelActivateChannel(HgfsChannelData *channel,   // IN/OUT: channel object
  *
  * HgfsChannelDeactivateChannel --
  *
- *      Deactivate a channel by calling the channels exit callback.
+ *      Deactivate a channel. The client connections are closed by the
+ *      clients before they release the channel.
  *
  * Results:
  *      None.
@@ -464,9 +472,71 @@ HgfsChannelActivateChannel(HgfsChannelData *channel,   // IN/OUT: channel object
 static void
 HgfsChannelDeactivateChannel(HgfsChannelData *channel)   // IN/OUT: channel object
 {
-   channel->ops->exit(channel->connection);
    channel->state &= ~HGFS_CHANNEL_STATE_CBINIT;
-   channel->connection = NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsChannelOpenConnection --
+ *
+ *      Open a client connection on a channel by calling the channels init
+ *      callback.
+ *
+ * Results:
+ *      TRUE if the connection is open.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsChannelOpenConnection(HgfsChannelUser *user,   // IN/OUT: client connection
+                          void *rpc,               // IN: Rpc channel
+                          void *rpcCallback)       // IN: Rpc callback
+{
+   HgfsChannelData *channel = user->channel;
+   struct HgfsGuestConn *connData = NULL;
+
+   ASSERT(NULL == user->connection);
+
+   if (!channel->ops->init(&channel->serverInfo->serverCBTable->session,
+                           rpc,
+                           rpcCallback,
+                           &connData)) {
+      return FALSE;
+   }
+   user->connection = connData;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsChannelCloseConnection --
+ *
+ *      Close a client connection by calling the channels exit callback.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsChannelCloseConnection(HgfsChannelUser *user)   // IN/OUT: client connection
+{
+   if (NULL != user->connection) {
+      user->channel->ops->exit(user->connection);
+      user->connection = NULL;
+   }
 }
 
 
@@ -499,7 +569,8 @@ HgfsChannelIsChannelActive(HgfsChannelData *channel) // IN/OUT: channel object
  *
  * HgfsChannelReceive --
  *
- *      Received a request on a channel pass on to the channel callback.
+ *      Received a request on a client connection pass on to the channel
+ *      callback.
  *
  * Results:
  *      TRUE if a channel ws deactivated.
@@ -511,17 +582,17 @@ HgfsChannelIsChannelActive(HgfsChannelData *channel) // IN/OUT: channel object
  */
 
 static Bool
-HgfsChannelReceive(HgfsChannelData *channel,   // IN/OUT: channel object
+HgfsChannelReceive(HgfsChannelUser *user,      // IN/OUT: client connection
                    char const *packetIn,       // IN: incoming packet
                    size_t packetInSize,        // IN: incoming packet size
                    char *packetOut,            // OUT: outgoing packet
                    size_t *packetOutSize)      // IN/OUT: outgoing packet size
 {
-   return channel->ops->receive(channel->connection,
-                                packetIn,
-                                packetInSize,
-                                packetOut,
-                                packetOutSize);
+   return user->channel->ops->receive(user->connection,
+                                      packetIn,
+                                      packetInSize,
+                                      packetOut,
+                                      packetOutSize);
 }
 
 
@@ -571,6 +642,8 @@ HgfsChannelTeardownChannel(HgfsChannelData *channel) // IN/OUT: connection manag
  *      At least one channel should succeed it's initialization
  *      completely, else we fail.
  *
+ *      The caller gets its own connection on the channel.
+ *
  * Results:
  *      TRUE on success, FALSE on failure.
  *
@@ -586,6 +659,7 @@ HgfsChannelGuest_Init(HgfsServerMgrData *mgrData,    // IN/OUT: server manager d
 {
    Bool success = FALSE;
    HgfsChannelData *channel = &gHgfsChannels[0]; // Shared channel (internal RPC)
+   HgfsChannelUser *user;
    uint32 channelRefCount;
 
    ASSERT(NULL != mgrData);
@@ -615,8 +689,14 @@ HgfsChannelGuest_Init(HgfsServerMgrData *mgrData,    // IN/OUT: server manager d
     */
    channelRefCount = HgfsChannelGetChannel(channel);
    /* We have referenced the channel, save it for later dereference. */
-   mgrData->connection = channel;
+   user = Util_SafeCalloc(1, sizeof *user);
+   user->channel = channel;
+   mgrData->connection = user;
    if (0 == channelRefCount) {
+      /* The first caller's settings are used for the shared server. */
+      if (mgrData->writeBehindEnabled) {
+         gHgfsGuestCfgSettings.flags |= HGFS_CONFIG_WRITE_BEHIND_ENABLED;
+      }
 
       /* Initialize channels objects. */
       if (!HgfsChannelInitChannel(channel, mgrCb, &gHgfsChannelServerInfo)) {
@@ -624,15 +704,20 @@ HgfsChannelGuest_Init(HgfsServerMgrData *mgrData,    // IN/OUT: server manager d
          goto exit;
       }
 
-      /* Call the channels initializers. */
-      if (!HgfsChannelActivateChannel(channel,
-                                      mgrData->rpc,
-                                      mgrData->rpcCallback)) {
+      if (!HgfsChannelActivateChannel(channel)) {
          Debug("%s: Could not activate channel.\n", __FUNCTION__);
          goto exit;
       }
    }
 
+   /* Call the channels initializers for our own connection. */
+   if (!HgfsChannelOpenConnection(user,
+                                  mgrData->rpc,
+                                  mgrData->rpcCallback)) {
+      Debug("%s: Could not open connection.\n", __FUNCTION__);
+      goto exit;
+   }
+
    success = TRUE;
 
 exit:
@@ -648,8 +733,8 @@ exit:
  *
  * HgfsChannelGuest_Exit --
  *
- *      Dereference the channel which for the final reference will
- *      close the channel for HGFS.
+ *      Close the caller's connection and dereference the channel which
+ *      for the final reference will close the channel for HGFS.
  *
  * Results:
  *      None.
@@ -663,18 +748,20 @@ exit:
 void
 HgfsChannelGuest_Exit(HgfsServerMgrData *mgrData) // IN/OUT: connection manager object
 {
-   HgfsChannelData *channel;
+   HgfsChannelUser *user;
 
    ASSERT(NULL != mgrData);
    ASSERT(NULL != mgrData->appName);
 
-   channel = mgrData->connection;
+   user = mgrData->connection;
 
-   Debug("%s: app %s rpc = %p rpc cb = %p chn = %p.\n", __FUNCTION__,
-         mgrData->appName, mgrData->rpc, mgrData->rpcCallback, channel);
+   Debug("%s: app %s rpc = %p rpc cb = %p conn = %p.\n", __FUNCTION__,
+         mgrData->appName, mgrData->rpc, mgrData->rpcCallback, user);
 
-   if (NULL != channel) {
-      HgfsChannelPutChannel(channel);
+   if (NULL != user) {
+      HgfsChannelCloseConnection(user);
+      HgfsChannelPutChannel(user->channel);
+      free(user);
       mgrData->connection = NULL;
    }
 }
@@ -704,19 +791,19 @@ HgfsChannelGuest_Receive(HgfsServerMgrData *mgrData, // IN/OUT : conn manager
                          char *packetOut,            // OUT: outgoing packet
                          size_t *packetOutSize)      // IN/OUT: outgoing packet size
 {
-   HgfsChannelData *channel = NULL;
+   HgfsChannelUser *user = NULL;
    Bool result = FALSE;
 
    ASSERT(NULL != mgrData);
    ASSERT(NULL != mgrData->connection);
    ASSERT(NULL != mgrData->appName);
 
-   channel = mgrData->connection;
+   user = mgrData->connection;
 
    Debug("%s: %s Channel receive request.\n", __FUNCTION__, mgrData->appName);
 
-   if (HgfsChannelIsChannelActive(channel)) {
-      result = HgfsChannelReceive(channel,
+   if (HgfsChannelIsChannelActive(user->channel) && NULL != user->connection) {
+      result = HgfsChannelReceive(user,
                                   packetIn,
                                   packetInSize,
                                   packetOut,
@@ -748,20 +835,20 @@ HgfsChannelGuest_Receive(HgfsServerMgrData *mgrData, // IN/OUT : conn manager
 uint32
 HgfsChannelGuest_InvalidateInactiveSessions(HgfsServerMgrData *mgrData) // IN: conn manager
 {
-   HgfsChannelData *channel = NULL;
+   HgfsChannelUser *user = NULL;
    uint32 result = 0;
 
    ASSERT(NULL != mgrData);
    ASSERT(NULL != mgrData->connection);
    ASSERT(NULL != mgrData->appName);
 
-   channel = mgrData->connection;
+   user = mgrData->connection;
 
    Debug("%s: %s Channel. Invalidating inactive sessions.\n",
          __FUNCTION__, mgrData->appName);
 
-   if (HgfsChannelIsChannelActive(channel)) {
-      result = channel->ops->invalidateInactiveSessions(channel->connection);
+   if (HgfsChannelIsChannelActive(user->channel) && NULL != user->connection) {
+      result = user->channel->ops->invalidateInactiveSessions(user->connection);
    }
 
    return result;
@@ -29,6 +29,8 @@
 #include "vm_atomic.h"
 #include "util.h"
 #include "debug.h"
+#include "userlock.h"
+#include "mutexRankLib.h"
 #include "hgfsChannelGuestInt.h"
 #include "hgfsServer.h"
 #include "hgfsServerManager.h"
@@ -40,16 +42,30 @@ typedef enum {
 } HgfsGuestConnState;
 
 
-/* Since there is only one connection we use globals. */
+/*
+ * A server session of a connection.
+ *
+ * The server processes the requests of a session synchronously, one at a
+ * time, so each connection keeps a pool of sessions: a request takes an idle
+ * session, and a new one is connected when all of them are busy. Concurrent
+ * requests of the same user then no longer wait for each other.
+ */
+typedef struct HgfsGuestSession {
+   struct HgfsGuestSession *next;             /* Next session of the connection. */
+   struct HgfsGuestConn *connData;            /* Owning connection. */
+   Bool busy;                                 /* Processing a request. */
+   HgfsServerChannelCallbacks channelCbTable;
+   void *serverSession;
+   size_t packetOutLen;                       /* Reply size of the request. */
+} HgfsGuestSession;
+
+/* One connection for each user of the guest channel. */
 typedef struct HgfsGuestConn {
    Atomic_uint32 refCount;                   /* Reference count. */
    HgfsGuestConnState state;
    HgfsServerSessionCallbacks *serverCbTable; /* Server session callbacks. */
-   HgfsServerChannelCallbacks channelCbTable;
-   void *serverSession;
-   size_t packetOutLen;
-   unsigned char *clientPacketOut;                 /* Client supplied buffer. */
-   unsigned char packetOut[HGFS_LARGE_PACKET_MAX]; /* For RPC msg callbacks. */
+   MXUserExclLock *sessionsLock;              /* Protects the sessions list. */
+   HgfsGuestSession *sessions;                /* Server sessions. */
 } HgfsGuestConn;
 
 
@@ -77,7 +93,7 @@ HgfsGuestChannelCBTable gGuestBackdoorOps = {
 };
 
 /* Private functions. */
-static Bool HgfsChannelGuestConnConnect(HgfsGuestConn *connData);
+static Bool HgfsChannelGuestSessionConnect(HgfsGuestSession *session);
 static void HgfsChannelGuestConnDestroy(HgfsGuestConn *connData);
 static Bool HgfsChannelGuestReceiveInternal(HgfsGuestConn *connData,
                                             char const *packetIn,
@@ -174,6 +190,8 @@ HgfsChannelGuestConnInit(HgfsGuestConn **connData,                   // IN/OUT:
    /* Give ourselves a reference of one. */
    HgfsChannelGuestConnGet(conn);
    conn->serverCbTable = serverCBTable;
+   conn->sessionsLock = MXUser_CreateExclLock("hgfsGuestConnLock",
+                                              RANK_hgfsGuestConnLock);
    conn->state = HGFS_GST_CONN_NOTCONNECTED;
 
    *connData = conn;
@@ -228,11 +246,19 @@ HgfsChannelGuestConnExit(HgfsGuestConn *connData) // IN/OUT: channel object
 static void
 HgfsChannelGuestConnDestroy(HgfsGuestConn *connData) // IN/OUT: channel object
 {
-   /* Make sure the server closes it's own session data. */
-   if (NULL != connData->serverSession) {
-      connData->serverCbTable->close(connData->serverSession);
-      connData->serverSession = NULL;
+   while (NULL != connData->sessions) {
+      HgfsGuestSession *session = connData->sessions;
+
+      ASSERT(!session->busy);
+      connData->sessions = session->next;
+
+      /* Make sure the server closes it's own session data. */
+      if (NULL != session->serverSession) {
+         connData->serverCbTable->close(session->serverSession);
+      }
+      free(session);
    }
+   MXUser_DestroyExclLock(connData->sessionsLock);
    free(connData);
 }
 
@@ -251,8 +277,7 @@ HgfsChannelGuestConnDestroy(HgfsGuestConn *connData) // IN/OUT: channel object
  *      connection object passed. We will have the ability to receive
  *      requests until we unregister our callback.)
  *
- *      NOTE: There is only handler and connction that can be used for
- *      all HGFS guest requests.
+ *      NOTE: Each user of the guest channel has its own connection.
  *
  * Results:
  *      None.
@@ -326,9 +351,9 @@ HgfsChannelGuestConnClose(HgfsGuestConn *connData,    // IN: Connection
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsChannelGuestConnConnect --
+ * HgfsChannelGuestSessionConnect --
  *
- *      Send connection to the server.
+ *      Send connection to the server for a session.
  *
  * Results:
  *      TRUE if server returns a data object, FALSE if not.
@@ -340,22 +365,23 @@ HgfsChannelGuestConnClose(HgfsGuestConn *connData,    // IN: Connection
  */
 
 static Bool
-HgfsChannelGuestConnConnect(HgfsGuestConn *connData)  // IN: our connection data
+HgfsChannelGuestSessionConnect(HgfsGuestSession *session)  // IN: session
 {
+   HgfsGuestConn *connData = session->connData;
    Bool result;
    static HgfsServerChannelData HgfsBdCapData = {
       0,
       HGFS_LARGE_PACKET_MAX
    };
 
-   connData->channelCbTable.getWriteVa = NULL;
-   connData->channelCbTable.getReadVa = NULL;
-   connData->channelCbTable.putVa = NULL;
-   connData->channelCbTable.send = HgfsChannelGuestBdSend;
-   result = connData->serverCbTable->connect(connData,
-                                             &connData->channelCbTable,
+   session->channelCbTable.getWriteVa = NULL;
+   session->channelCbTable.getReadVa = NULL;
+   session->channelCbTable.putVa = NULL;
+   session->channelCbTable.send = HgfsChannelGuestBdSend;
+   result = connData->serverCbTable->connect(session,
+                                             &session->channelCbTable,
                                              &HgfsBdCapData,
-                                             &connData->serverSession);
+                                             &session->serverSession);
    if (result) {
       HgfsChannelGuestConnGet(connData);
    }
@@ -363,12 +389,81 @@ HgfsChannelGuestConnConnect(HgfsGuestConn *connData)  // IN: our connection data
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsChannelGuestSessionGet --
+ *
+ *      Take an idle session of the connection for processing a request,
+ *      creating a new session if all are busy.
+ *
+ * Results:
+ *      The session, marked busy.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsGuestSession *
+HgfsChannelGuestSessionGet(HgfsGuestConn *connData)  // IN: connection
+{
+   HgfsGuestSession *session;
+
+   MXUser_AcquireExclLock(connData->sessionsLock);
+   for (session = connData->sessions; NULL != session; session = session->next) {
+      if (!session->busy) {
+         break;
+      }
+   }
+   if (NULL == session) {
+      session = Util_SafeCalloc(1, sizeof *session);
+      session->connData = connData;
+      session->next = connData->sessions;
+      connData->sessions = session;
+   }
+   session->busy = TRUE;
+   MXUser_ReleaseExclLock(connData->sessionsLock);
+
+   return session;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsChannelGuestSessionPut --
+ *
+ *      Return a session taken with HgfsChannelGuestSessionGet to the idle ones.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsChannelGuestSessionPut(HgfsGuestSession *session)  // IN: session
+{
+   HgfsGuestConn *connData = session->connData;
+
+   MXUser_AcquireExclLock(connData->sessionsLock);
+   ASSERT(session->busy);
+   session->busy = FALSE;
+   MXUser_ReleaseExclLock(connData->sessionsLock);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * HgfsChannelGuestConnDisconnect --
  *
- *      Send disconnect to the server.
+ *      Send disconnect to the server for all the sessions of the connection.
  *
  *      NOTE: The server data will be maintained until
  *      the connection is totally closed (last reference is gone).
@@ -385,11 +480,17 @@ HgfsChannelGuestConnConnect(HgfsGuestConn *connData)  // IN: our connection data
 static void
 HgfsChannelGuestConnDisconnect(HgfsGuestConn *connData)  // IN: connection
 {
-   if (connData->serverSession != NULL) {
-      /* Tell the server to to disconnect the session. */
-      connData->serverCbTable->disconnect(connData->serverSession);
-      HgfsChannelGuestConnPut(connData);
+   HgfsGuestSession *session;
+
+   MXUser_AcquireExclLock(connData->sessionsLock);
+   for (session = connData->sessions; NULL != session; session = session->next) {
+      if (session->serverSession != NULL) {
+         /* Tell the server to to disconnect the session. */
+         connData->serverCbTable->disconnect(session->serverSession);
+         HgfsChannelGuestConnPut(connData);
+      }
    }
+   MXUser_ReleaseExclLock(connData->sessionsLock);
 }
 
 
@@ -431,7 +532,8 @@ HgfsChannelGuestConnCloseInternal(HgfsGuestConn *connData, // IN: Connection dat
  *
  *    This function is used in the HGFS server inside Tools.
  *
- *    Create an internal session if not already created, and process the packet.
+ *    Take an idle session of the connection, connecting a new one to the
+ *    server if there is none, and process the packet on it.
  *
  * Results:
  *    TRUE if received packet ok and processed, FALSE otherwise.
@@ -449,6 +551,7 @@ HgfsChannelGuestReceiveInternal(HgfsGuestConn *connData,  // IN: connection
                                 char *packetOut,          // OUT: outgoing packet
                                 size_t *packetOutSize)    // IN/OUT: outgoing packet size
 {
+   HgfsGuestSession *session;
    HgfsPacket packet;
 
    ASSERT(packetIn);
@@ -466,13 +569,16 @@ HgfsChannelGuestReceiveInternal(HgfsGuestConn *connData,  // IN: connection
       return TRUE;
    }
 
+   session = HgfsChannelGuestSessionGet(connData);
+
    /*
     * Create the session if not already created.
     * This session is destroyed in HgfsServer_ExitState.
     */
-   if (connData->serverSession == NULL) {
+   if (session->serverSession == NULL) {
       /* Do our guest connect now which will inform the server. */
-      if (!HgfsChannelGuestConnConnect(connData)) {
+      if (!HgfsChannelGuestSessionConnect(session)) {
+         HgfsChannelGuestSessionPut(session);
          *packetOutSize = 0;
          return FALSE;
       }
@@ -490,10 +596,13 @@ HgfsChannelGuestReceiveInternal(HgfsGuestConn *connData,  // IN: connection
    packet.replyPacketSize = *packetOutSize;
    packet.state |= HGFS_STATE_CLIENT_REQUEST;
 
+   session->packetOutLen = *packetOutSize;
+
    /* The server will perform a synchronous processing of requests. */
-   connData->serverCbTable->receive(&packet, connData->serverSession);
+   connData->serverCbTable->receive(&packet, session->serverSession);
 
-   *packetOutSize = connData->packetOutLen;
+   *packetOutSize = session->packetOutLen;
+   HgfsChannelGuestSessionPut(session);
 
    return TRUE;
 }
@@ -557,18 +666,12 @@ HgfsChannelGuestBdReceive(HgfsGuestConn *connData,    // IN: connection
       goto exit;
    }
 
-   connData->packetOutLen = *packetOutSize;
-   connData->clientPacketOut = packetOut;
-
    result = HgfsChannelGuestReceiveInternal(connData,
                                             packetIn,
                                             packetInSize,
-                                            connData->clientPacketOut,
+                                            packetOut,
                                             packetOutSize);
 
-   connData->clientPacketOut = NULL;
-   connData->packetOutLen = sizeof connData->packetOut;
-
 exit:
    return result;
 }
@@ -581,6 +684,8 @@ exit:
  *
  *    Sends a request to invalidate all the inactive HGFS server sessions.
  *
+ *    Sessions busy with a request are active and are skipped.
+ *
  * Results:
  *    Number of active sessions remaining inside the HGFS server.
  *
@@ -593,6 +698,9 @@ exit:
 uint32
 HgfsChannelGuestBdInvalidateInactiveSessions(HgfsGuestConn *connData)  // IN: connection
 {
+   HgfsGuestSession *session;
+   uint32 result = 0;
+
    ASSERT(NULL != connData);
 
    if (NULL == connData) {
@@ -604,12 +712,18 @@ HgfsChannelGuestBdInvalidateInactiveSessions(HgfsGuestConn *connData)  // IN: co
       return 0;
    }
 
-   /* The server will perform a synchronous processing of requests. */
-   if (connData->serverSession) {
-      return connData->serverCbTable->invalidateInactiveSessions(connData->serverSession);
+   MXUser_AcquireExclLock(connData->sessionsLock);
+   for (session = connData->sessions; NULL != session; session = session->next) {
+      if (session->busy) {
+         result++;
+      } else if (session->serverSession) {
+         /* The server will perform a synchronous processing of requests. */
+         result += connData->serverCbTable->invalidateInactiveSessions(session->serverSession);
+      }
    }
+   MXUser_ReleaseExclLock(connData->sessionsLock);
 
-   return 0;
+   return result;
 }
 
 
@@ -630,26 +744,26 @@ HgfsChannelGuestBdInvalidateInactiveSessions(HgfsGuestConn *connData)  // IN: co
  */
 
 static Bool
-HgfsChannelGuestBdSend(void *conn,              // IN: our connection data
+HgfsChannelGuestBdSend(void *conn,              // IN: our session data
                        HgfsPacket *packet,      // IN/OUT: Hgfs Packet
                        HgfsSendFlags flags)     // IN: Flags to say how to process
 {
-   HgfsGuestConn *connData = conn;
+   HgfsGuestSession *session = conn;
 
-   ASSERT(NULL != connData);
+   ASSERT(NULL != session);
    ASSERT(NULL != packet);
    ASSERT(NULL != packet->replyPacket);
-   ASSERT(packet->replyPacketDataSize <= connData->packetOutLen);
-   ASSERT(packet->replyPacketSize == connData->packetOutLen);
+   ASSERT(packet->replyPacketDataSize <= session->packetOutLen);
+   ASSERT(packet->replyPacketSize == session->packetOutLen);
 
-   if (packet->replyPacketDataSize > connData->packetOutLen) {
-      packet->replyPacketDataSize = connData->packetOutLen;
+   if (packet->replyPacketDataSize > session->packetOutLen) {
+      packet->replyPacketDataSize = session->packetOutLen;
    }
-   connData->packetOutLen = (uint32)packet->replyPacketDataSize;
+   session->packetOutLen = (uint32)packet->replyPacketDataSize;
 
    if (!(flags & HGFS_SEND_NO_COMPLETE)) {
-      connData->serverCbTable->sendComplete(packet,
-                                            connData->serverSession);
+      session->connData->serverCbTable->sendComplete(packet,
+                                                     session->serverSession);
    }
 
    return TRUE;
@@ -145,6 +145,35 @@ HgfsServerManager_InvalidateInactiveSessions(HgfsServerMgrData *mgrData)  // IN:
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsServerManager_DumpStats --
+ *
+ *    Prints the HGFS server request statistics.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerManager_DumpStats(HgfsServerMgrData *mgrData,              // IN: hgfs mgr
+                            void (*printFunc)(void *clientData,
+                                              const char *line),    // IN: printer
+                            void *clientData)                       // IN: printer data
+{
+   ASSERT(mgrData);
+   ASSERT(printFunc);
+
+   HgfsServer_DumpStats(printFunc, clientData);
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -71,6 +71,8 @@
 #define ASOCKERR_LISTEN            12
 #define ASOCKERR_CONNECTSSL        13
 
+#define ASOCKERR_COUNT             (ASOCKERR_CONNECTSSL + 1)
+
 
 /*
  * Websocket close status codes --
@@ -167,6 +169,31 @@ int AsyncSocket_GetGenericErrno(AsyncSocket *s);
  */
 int AsyncSocket_GetID(AsyncSocket *asock);
 
+/*
+ * I/O counters, per socket and summed over all sockets. Counts are kept for
+ * every socket; times (in microseconds) and the global sums only while
+ * statistics are enabled with AsyncSocket_SetStatsEnabled().
+ */
+typedef struct AsyncSocketStats {
+   uint64 bytesSent;
+   uint64 bytesRecv;
+   uint64 msgsSent;           // Send buffers completed
+   uint64 msgsRecv;           // Receive callbacks fired
+   uint32 sendQueueLen;       // Buffers queued now (per socket only)
+   uint32 sendQueueLenMax;    // High-water mark of sendQueueLen
+   uint64 sendQueueBytes;     // Bytes queued now (per socket only)
+   uint64 sendQueueBytesMax;  // High-water mark of sendQueueBytes
+   uint64 sendBufFullTime;    // Time the socket send buffer was full
+   uint64 callbacks;          // Receive and send callbacks timed
+   uint64 callbackTime;       // Time spent in those callbacks
+   uint64 callbackTimeMax;
+   uint64 errors[ASOCKERR_COUNT];  // Errors reported, by ASOCKERR_* code
+} AsyncSocketStats;
+
+void AsyncSocket_SetStatsEnabled(Bool enabled);
+int AsyncSocket_GetStats(AsyncSocket *asock, AsyncSocketStats *stats);
+void AsyncSocket_GetGlobalStats(AsyncSocketStats *stats);
+
 /*
  * Return the fd corresponding to the socket.
  */
@@ -399,6 +426,13 @@ int AsyncSocket_RecvPartial(AsyncSocket *asock, void *buf, int len,
 int AsyncSocket_RecvPassedFd(AsyncSocket *asock, void *buf, int len,
                              void *cb, void *cbData);
 
+/*
+ * Receive 32-bit length-prefixed packets, firing the receive function once
+ * per packet (see AsyncSocket_RecvPackets in asyncsocket.c).
+ */
+int AsyncSocket_RecvPackets(AsyncSocket *asock, int maxPacketLen,
+                            AsyncSocketRecvFn recvFn, void *clientData);
+
 /*
  * Retrieve socket received via RecvPassedFd.
  */
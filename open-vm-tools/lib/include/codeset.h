@@ -388,6 +388,17 @@ Bool CodeSet_IsValidUTF8(const char *bufIn,  // IN:
 
 Bool CodeSet_IsStringValidUTF8(const char *string);  // IN:
 
+size_t CodeSet_AsciiPrefixLen(const char *buf,  // IN:
+                              size_t size);     // IN:
+
+size_t CodeSet_AsciiToUtf16le(const char *bufIn,  // IN:
+                              size_t sizeIn,      // IN:
+                              utf16_t *bufOut);   // OUT:
+
+size_t CodeSet_Utf16leToAscii(const utf16_t *bufIn,  // IN:
+                              size_t numCodeUnits,   // IN:
+                              char *bufOut);         // OUT:
+
 /*
  *-----------------------------------------------------------------------------
  *
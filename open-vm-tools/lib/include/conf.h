@@ -48,6 +48,7 @@
 #define CONFNAME_POWEROFFSCRIPT           "poweroff-script"
 #define CONFNAME_RESUMESCRIPT             "resume-script"
 #define CONFNAME_SUSPENDSCRIPT            "suspend-script"
+#define CONFNAME_POWEROPS_SCRIPTTIMEOUT   "script-timeout"
 #define CONFNAME_LOG                      "log"
 #define CONFNAME_LOGFILE                  "log.file"
 #define CONFNAME_LOGLEVEL                 "log.level"
@@ -78,6 +79,13 @@
  */
 #define CONFNAME_GUESTINFO_DISABLEQUERYDISKINFO "disable-query-diskinfo"
 
+/**
+ * Lets users disable the rtnetlink watch that refreshes the nic info as soon
+ * as the guest network configuration changes. The nic info is then only
+ * refreshed by the regular poll.
+ */
+#define CONFNAME_GUESTINFO_DISABLENICMONITOR "disable-nic-monitor"
+
 /**
  * Define a custom GuestInfo poll interval (in seconds).
  *
@@ -98,6 +106,45 @@
  */
 #define CONFNAME_GUESTINFO_STATSINTERVAL "stats-interval"
 
+/**
+ * Define the high frequency stats sampling interval (in milliseconds).
+ *
+ * Samples are kept in a ring buffer in the guest and uploaded in batches
+ * every stats interval, or when the host asks for them.
+ *
+ * @param int   Sampling interval, at least 50 ms.  Set to 0 (the default) to
+ *              disable high frequency sampling.
+ */
+#define CONFNAME_GUESTINFO_HFSTATSINTERVAL "hf-stats-interval"
+
+/**
+ * Number of high frequency samples the ring buffer holds. When the buffer
+ * is full the oldest samples are overwritten.
+ *
+ * @param int   Ring buffer size, in samples.
+ */
+#define CONFNAME_GUESTINFO_HFSTATSSAMPLES "hf-stats-samples"
+
+/**
+ * The metric groups included in the high frequency samples.
+ *
+ * @param string  A semicolon separated list of "cpu", "memory", "swap" and
+ *                "disk".  All of them when not set.
+ */
+#define CONFNAME_GUESTINFO_HFSTATSMETRICS "hf-stats-metrics"
+
+/**
+ * The cgroups (v2) to report resource usage stats for, along with the
+ * system-wide guest stats.
+ *
+ * @param string  A semicolon separated list of paths relative to the cgroup2
+ *                mount, e.g. "system.slice;user.slice". A last path
+ *                component of "*" stands for every child of the parent
+ *                cgroup, e.g. every pod under kubepods.slice.  None when
+ *                not set.
+ */
+#define CONFNAME_GUESTINFO_CGROUPSTATS "cgroup-stats"
+
 /**
  * Indicates whether stat results should be written to the log.
  */
@@ -147,6 +194,66 @@
  */
 
 
+/*
+ ******************************************************************************
+ * BEGIN HgfsServer goodies.
+ */
+
+/**
+ * Defines the string used for the HgfsServer config file group.
+ */
+#define CONFGROUPNAME_HGFSSERVER "hgfsServer"
+
+/**
+ * Buffers small sequential writes to a file and writes them out together.
+ * Buffered data is written out before the file is read, synced, its
+ * attributes are used or it is closed, by any session. A failure to write it
+ * out is returned by the next fsync or by the close of the handle.
+ *
+ * @param boolean Set to TRUE to enable write-behind. Defaults to FALSE.
+ */
+#define CONFNAME_HGFSSERVER_WRITEBEHIND "write-behind"
+
+/*
+ * END HgfsServer goodies.
+ ******************************************************************************
+ */
+
+
+/*
+ ******************************************************************************
+ * BEGIN DiskWipe goodies.
+ */
+
+/**
+ * Defines the string used for the disk wipe (toolbox-cmd disk) config file
+ * group.
+ */
+#define CONFGROUPNAME_DISKWIPE "diskWipe"
+
+/**
+ * Caps the rate at which wiper files are written, shared by all the
+ * partitions wiped together, so that a wipe doesn't starve the guest's
+ * other disk I/O.
+ *
+ * @param int   Maximum rate in MB per second. 0 for no limit (default).
+ */
+#define CONFNAME_DISKWIPE_MAXRATE "max-rate"
+
+/**
+ * Slows a wipe down while the guest's disk reads take much longer than
+ * usual (Linux only), so that it can run alongside the guest's workload.
+ *
+ * @param boolean Set to TRUE to enable adaptive pacing. Defaults to FALSE.
+ */
+#define CONFNAME_DISKWIPE_ADAPTIVEPACING "adaptive-pacing"
+
+/*
+ * END DiskWipe goodies.
+ ******************************************************************************
+ */
+
+
 /** Where to find Tools data in the Win32 registry. */
 #define CONF_VMWARE_TOOLS_REGKEY    "Software\\VMware, Inc.\\VMware Tools"
 
@@ -34,6 +34,7 @@
 #define _DATA_MAP_H_
 
 #include "hashMap.h"
+#include "dynbuf.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -73,6 +74,7 @@ typedef enum {
 typedef struct {
    HashMap *map;
    uint64 cookie;   /* so we know the datamap is not some garbage data */
+   struct DataMapArena *arena;   /* entry storage of copied/decoded maps */
 } DataMap;
 
 typedef struct {
@@ -95,9 +97,21 @@ DataMap_Serialize(const DataMap *that,   //IN
                   char **buf,            // OUT
                   uint32 *bufLen);          // OUT
 ErrorCode
+DataMap_SerializeToDynBuf(const DataMap *that,   // IN
+                          DynBuf *buf);          // IN/OUT
+ErrorCode
+DataMap_SerializeHeaderToDynBuf(const DataMap *that,   // IN
+                                DMKeyType fieldId,     // IN
+                                int32 strLen,          // IN
+                                DynBuf *buf);          // IN/OUT
+ErrorCode
 DataMap_Deserialize(const char *bufIn,     // IN
                     const int32 bufLen,    // IN
                     DataMap *that);        // OUT
+ErrorCode
+DataMap_DeserializeNoCopy(const char *bufIn,     // IN
+                          const int32 bufLen,    // IN
+                          DataMap *that);        // OUT
 
 ErrorCode
 DataMap_DeserializeContent(const char *bufIn,     // IN
@@ -58,6 +58,14 @@ Bool
 DynBuf_Enlarge(DynBuf *b,        // IN/OUT
                size_t min_size); // IN
 
+Bool
+DynBuf_Reserve(DynBuf *b,     // IN/OUT
+               size_t extra); // IN
+
+void
+DynBuf_Recycle(DynBuf *b,       // IN/OUT
+               size_t maxKeep); // IN
+
 Bool
 DynBuf_Append(DynBuf *b,        // IN/OUT
               void const *data, // IN
@@ -39,6 +39,7 @@
 #include "vm_basic_types.h"
 
 XDR *DynXdr_Create(XDR *in);
+XDR *DynXdr_CreateWithSize(XDR *in, size_t size);
 Bool DynXdr_AppendRaw(XDR *xdrs, const void *buf, size_t len);
 void *DynXdr_AllocGet(XDR *xdrs);
 void *DynXdr_Get(XDR *xdrs);
@@ -48,6 +48,8 @@
 typedef struct GlibLogger {
    gboolean          shared;        /**< Output is shared with other processes. */
    gboolean          addsTimestamp; /**< Output adds timestamp automatically. */
+   gboolean          batchable;     /**< Several messages may be written in one
+                                         call; domain and level are ignored. */
    GLogFunc          logfn;         /**< The function that writes to the output. */
    GDestroyNotify    dtor;          /**< Destructor. */
 } GlibLogger;
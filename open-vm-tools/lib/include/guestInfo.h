@@ -49,6 +49,9 @@
 #endif // #ifndef N_PLAT_NLM
 
 #define GUEST_INFO_COMMAND "SetGuestInfo"
+
+/* Host request to upload the pending high frequency stats right away. */
+#define GUEST_INFO_HFSTATS_FLUSH_CMD "guestinfo.hfstats.flush"
 #define MAX_VALUE_LEN 100
 
 #define MAX_NICS     16
@@ -73,6 +76,8 @@ typedef enum {
    INFO_MEMORY,
    INFO_IPADDRESS_V2,
    INFO_IPADDRESS_V3,
+   INFO_BATCH,       /* Several updates in one message, see guestinfobatch.x. */
+   INFO_HFSTATS,     /* High frequency stats samples, see guesthfstats.x. */
    INFO_MAX
 } GuestInfoType;
 
@@ -40,6 +40,9 @@
  * Version 4: Dead
  * Version 5: Legacy structure followed by one or more GuestStat
  *            structures and data.
+ * Version 6: Legacy structure followed by the compact encoding described
+ *            below. Only sent once the host has set the
+ *            TOOLSOPTION_GUESTSTATS_COMPACT option.
  */
 
 #define GUESTMEMINFO_V1 1
@@ -47,6 +50,7 @@
 #define GUESTMEMINFO_V3 3
 #define GUESTMEMINFO_V4 4
 #define GUESTMEMINFO_V5 5
+#define GUESTMEMINFO_V6 6
 
 /*
  * Flags for legacy GuestMemInfo
@@ -122,6 +126,50 @@ struct GuestDatumHeader {
 #include "vmware_pack_end.h"
 GuestDatumHeader;
 
+/*
+ * Compact (version 6) encoding.
+ *
+ * All numbers are little endian base 128 varints; signed numbers are zigzag
+ * mapped first. The legacy structure is followed by a flags byte and the
+ * sample's sequence number, then by one record per stat, up to the end of
+ * the message. Stats always come in the same order, and are relative to
+ * GUEST_TOOLS_NAMESPACE unless a namespace record says otherwise. When the
+ * set of stats changes, the sample carries the dictionary.
+ *
+ * When GUESTSTATS_COMPACT_DICTIONARY is set, each record starts with the
+ * stat's ID, value type and units. A record with an ID of 0 (never a valid
+ * stat) instead switches the namespace of the records that follow: it
+ * consists of the namespace's length and UTF8 bytes, and only appears in
+ * samples that carry the dictionary. The guest sends the dictionary in the
+ * first sample of a session, and again (in a key frame) whenever it can't
+ * tell whether the host got the previous sample; other samples omit it.
+ *
+ * The rest of the record is a varint whose low two bits give the kind of
+ * value:
+ *    NONE    The stat has no value in this sample.
+ *    INTEGER The remaining bits are a signed number. For GuestTypeUint64
+ *            stats it's the difference from the value of the record at
+ *            the same position in the previous sample, or the value itself
+ *            in a key frame (GUESTSTATS_COMPACT_KEYFRAME) or when that
+ *            record had no value in the previous sample. For GuestTypeDouble stats it's the
+ *            value itself, which happens to be integral.
+ *    FLOAT   An IEEE 754 single follows.
+ *    RAW64   An 8 byte value follows: a GuestTypeUint64 value in full, or
+ *            an IEEE 754 double.
+ *
+ * The host should ignore samples that are neither key frames nor the
+ * successor of the last sample it decoded.
+ */
+
+#define GUESTSTATS_COMPACT_DICTIONARY  0x01
+#define GUESTSTATS_COMPACT_KEYFRAME    0x02
+
+#define GUESTSTATS_COMPACT_NONE        0
+#define GUESTSTATS_COMPACT_INTEGER     1
+#define GUESTSTATS_COMPACT_FLOAT       2
+#define GUESTSTATS_COMPACT_RAW64       3
+#define GUESTSTATS_COMPACT_KIND_BITS   2
+
 /*
  * Units datum enum.
  * Note: The entirety (all bits) of the units must always be understood by a client.
@@ -262,6 +310,116 @@ typedef enum {
    DEFINE_GUEST_STAT(GuestStatID_Linux_HugePagesTotal,            12, "guest.hugePage.total") \
    DEFINE_GUEST_STAT(GuestStatID_Max,                             13, "__MAX__")
 
+/*
+ * Per cgroup (v2) stats. Each monitored cgroup gets its own namespace:
+ * GUEST_CGROUP_NAMESPACE_PREFIX followed by the cgroup's path relative to the
+ * cgroup2 mount (e.g., "_tools/cgroup/v1/system.slice"). The IDs below are
+ * relative to such a namespace.
+ *
+ * CPU and pressure times are cumulative, in microseconds. Faults, refaults,
+ * throttling events and I/O operations are cumulative counts.
+ *
+ * NOTE: Same rules as GUEST_STAT_TOOLS_IDS: only ever add IDs at the end.
+ */
+#define GUEST_CGROUP_NAMESPACE_PREFIX "_tools/cgroup/v1/"
+
+#define GUEST_STAT_CGROUP_IDS \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_Invalid,                   0,  "__INVALID__") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_None,                      1,  "__NONE__") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_CpuUsage,                  2,  "cgroup.cpu.usage") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_CpuUser,                   3,  "cgroup.cpu.user") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_CpuSystem,                 4,  "cgroup.cpu.system") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_CpuThrottled,              5,  "cgroup.cpu.throttled") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_CpuThrottledCount,         6,  "cgroup.cpu.throttledCount") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_MemCurrent,                7,  "cgroup.mem.current") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_MemAnon,                   8,  "cgroup.mem.anon") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_MemFile,                   9,  "cgroup.mem.file") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_MemSlab,                   10, "cgroup.mem.slab") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_MemShmem,                  11, "cgroup.mem.shmem") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_MemMajorFaults,            12, "cgroup.mem.majorFaults") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_MemRefaults,               13, "cgroup.mem.workingSetRefaults") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_MemPressureSome,           14, "cgroup.mem.pressure.some") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_MemPressureFull,           15, "cgroup.mem.pressure.full") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_MemPressureSomeAvg10,      16, "cgroup.mem.pressure.someAvg10") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_IoReadBytes,               17, "cgroup.io.readBytes") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_IoWriteBytes,              18, "cgroup.io.writeBytes") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_IoReadOps,                 19, "cgroup.io.readOps") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_IoWriteOps,                20, "cgroup.io.writeOps") \
+   DEFINE_GUEST_STAT(GuestCgroupStatID_Max,                       21, "__MAX__")
+
+/*
+ * Balloon driver (vmmemctl) stats, reported when the guest's driver exposes
+ * them: FreeBSD's vm.vmmemctl_stats sysctl, or the Linux vmw_balloon debugfs
+ * file (which lacks the mode and latency stats).
+ *
+ * Sizes are in small pages. Inflated and deflated pages, monitor calls and
+ * their failures, allocation failures, pages the monitor refused and large
+ * page fallbacks are cumulative counts. Batched is 1 when the driver batches
+ * lock and unlock calls. The latencies are percentiles of all lock (or
+ * unlock) calls, in microseconds, rounded up to a power of two.
+ *
+ * NOTE: Same rules as GUEST_STAT_TOOLS_IDS: only ever add IDs at the end.
+ */
+#define GUEST_BALLOON_NAMESPACE "_tools/balloon/v1"
+
+#define GUEST_STAT_BALLOON_IDS \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_Invalid,                  0,  "__INVALID__") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_None,                     1,  "__NONE__") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_Target,                   2,  "balloon.target") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_Current,                  3,  "balloon.current") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_Inflated,                 4,  "balloon.inflated") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_Deflated,                 5,  "balloon.deflated") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_Lock,                     6,  "balloon.lock") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_LockFail,                 7,  "balloon.lockFail") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_Unlock,                   8,  "balloon.unlock") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_UnlockFail,               9,  "balloon.unlockFail") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_AllocFail,                10, "balloon.allocFail") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_RefusedPages,             11, "balloon.refusedPages") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_LPageFallback,            12, "balloon.lpageFallback") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_Batched,                  13, "balloon.batched") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_Chunks,                   14, "balloon.chunks") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_LockLatencyP50,           15, "balloon.lockLatencyP50") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_LockLatencyP99,           16, "balloon.lockLatencyP99") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_UnlockLatencyP50,         17, "balloon.unlockLatencyP50") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_UnlockLatencyP99,         18, "balloon.unlockLatencyP99") \
+   DEFINE_GUEST_STAT(GuestBalloonStatID_Max,                      19, "__MAX__")
+
+/*
+ * Time synchronization stats, reported when the timeSync plugin is loaded.
+ *
+ * Readings, failures, steps, slews, PLL updates and noisy readings (popcorn
+ * spikes the PLL wasn't fed) are cumulative counts. The offset (guest - host
+ * time error of the last reading, a double since it may be negative), its
+ * estimated error and the largest absolute offset seen are in microseconds.
+ * The frequency is the kernel PLL's correction in ppm (a double), without a
+ * value when the guest has no PLL. The slew state is 0 (plain slewing),
+ * 1 (calibrating the PLL) or 2 (PLL). The host read round trip times are the
+ * recent minimum and percentiles of the best round trip time of each reading,
+ * in microseconds, rounded up to a power of two.
+ *
+ * NOTE: Same rules as GUEST_STAT_TOOLS_IDS: only ever add IDs at the end.
+ */
+#define GUEST_TIMESYNC_NAMESPACE "_tools/timesync/v1"
+
+#define GUEST_STAT_TIMESYNC_IDS \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_Invalid,                 0,  "__INVALID__") \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_None,                    1,  "__NONE__") \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_Readings,                2,  "timesync.readings") \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_Failures,                3,  "timesync.failures") \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_Steps,                   4,  "timesync.steps") \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_Slews,                   5,  "timesync.slews") \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_PLLUpdates,              6,  "timesync.pllUpdates") \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_Noisy,                   7,  "timesync.noisy") \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_Offset,                  8,  "timesync.offset") \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_EstError,                9,  "timesync.estError") \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_MaxOffset,               10, "timesync.maxOffset") \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_Frequency,               11, "timesync.frequency") \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_SlewState,               12, "timesync.slewState") \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_RttMin,                  13, "timesync.rttMin") \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_RttP50,                  14, "timesync.rttP50") \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_RttP99,                  15, "timesync.rttP99") \
+   DEFINE_GUEST_STAT(GuestTimeSyncStatID_Max,                     16, "__MAX__")
+
 /*
  * Define stats enumeration
  */
@@ -271,6 +429,18 @@ typedef enum GuestStatToolsID {
    GUEST_STAT_TOOLS_IDS
 } GuestStatToolsID;
 
+typedef enum GuestStatCgroupID {
+   GUEST_STAT_CGROUP_IDS
+} GuestStatCgroupID;
+
+typedef enum GuestStatBalloonID {
+   GUEST_STAT_BALLOON_IDS
+} GuestStatBalloonID;
+
+typedef enum GuestStatTimeSyncID {
+   GUEST_STAT_TIMESYNC_IDS
+} GuestStatTimeSyncID;
+
 /*
  * Enforce ordering and compactness of the enumeration
  */
@@ -278,6 +448,9 @@ typedef enum GuestStatToolsID {
 #define DEFINE_GUEST_STAT(x,y,z) ASSERT_ON_COMPILE(x==y);
 
 MY_ASSERTS(GUEST_STAT_IDS_ARE_WELL_ORDERED, GUEST_STAT_TOOLS_IDS)
+MY_ASSERTS(GUEST_CGROUP_STAT_IDS_ARE_WELL_ORDERED, GUEST_STAT_CGROUP_IDS)
+MY_ASSERTS(GUEST_BALLOON_STAT_IDS_ARE_WELL_ORDERED, GUEST_STAT_BALLOON_IDS)
+MY_ASSERTS(GUEST_TIMESYNC_STAT_IDS_ARE_WELL_ORDERED, GUEST_STAT_TIMESYNC_IDS)
 
 #undef DEFINE_GUEST_STAT
 
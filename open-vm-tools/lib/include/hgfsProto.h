@@ -146,6 +146,7 @@ typedef enum {
    HGFS_OP_UNLOCK_BYTE_RANGE_V4,  /* Release byte range lock. */
    HGFS_OP_QUERY_EAS_V4,          /* Query extended attributes. */
    HGFS_OP_SET_EAS_V4,            /* Add or modify extended attributes. */
+   HGFS_OP_COMPOUND_V4,           /* Sequence of requests processed together. */
 
    HGFS_OP_MAX,                   /* Dummy op, must be last in enum */
    HGFS_OP_NEW_HEADER = 0xff,     /* Header op, must be unique, distinguishes packet headers. */
@@ -2684,4 +2685,41 @@ struct HgfsReplyDeleteFileV4 {
 #include "vmware_pack_end.h"
 HgfsReplyDeleteFileV4;
 
+/*
+ * A compound request carries a sequence of complete requests, each a
+ * session enabled HgfsHeader followed by its arguments, packed back to back
+ * after the compound arguments. The requests are processed in order and
+ * their replies are returned back to back after the compound reply, one for
+ * each request processed. Processing stops after the first request that
+ * fails.
+ *
+ * Only open, read, write, getattr, setattr and close V3 requests can be
+ * part of a compound request, and reads and writes carry their data inline.
+ * A request that uses HGFS_COMPOUND_CHAINED_HANDLE as its file handle
+ * operates on the file opened by the last open in the same compound request.
+ */
+
+#define HGFS_COMPOUND_MAX_REQUESTS    16
+#define HGFS_COMPOUND_CHAINED_HANDLE  ((HgfsHandle)(HGFS_INVALID_HANDLE - 1))
+
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsRequestCompoundV4 {
+   uint32 numRequests;       /* Number of requests that follow. */
+   uint32 reserved1;         /* Reserved for future use */
+   uint64 reserved2;         /* Reserved for future use */
+}
+#include "vmware_pack_end.h"
+HgfsRequestCompoundV4;
+
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsReplyCompoundV4 {
+   uint32 numReplies;        /* Number of replies that follow. */
+   uint32 reserved1;         /* Reserved for future use */
+   uint64 reserved2;         /* Reserved for future use */
+}
+#include "vmware_pack_end.h"
+HgfsReplyCompoundV4;
+
 #endif /* _HGFS_PROTO_H_ */
@@ -116,6 +116,7 @@ typedef uint32 HgfsConfigFlags;
 #define HGFS_CONFIG_VOL_INFO_MIN                     (1 << 2)
 #define HGFS_CONFIG_OPLOCK_ENABLED                   (1 << 3)
 #define HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED    (1 << 4)
+#define HGFS_CONFIG_WRITE_BEHIND_ENABLED             (1 << 5)
 
 typedef struct HgfsServerConfig {
    HgfsConfigFlags flags;
@@ -209,4 +210,9 @@ void HgfsServer_SetHandleCounter(uint32 newHandleCounter);
 
 void HgfsServer_Quiesce(Bool freeze);
 
+/* Receives the server statistics one line at a time. */
+typedef void (*HgfsServerStatsPrintFunc)(void *clientData, const char *line);
+
+void HgfsServer_DumpStats(HgfsServerStatsPrintFunc printFunc, void *clientData);
+
 #endif // _HGFS_SERVER_H_
@@ -42,6 +42,7 @@ typedef struct HgfsServerMgrData {
    void        *rpc;             // RpcChannel unused
    void        *rpcCallback;     // RpcChannelCallback unused
    void        *connection;      // Connection object returned on success
+   Bool        writeBehindEnabled; // Buffer small sequential writes
 } HgfsServerMgrData;
 
 
@@ -51,6 +52,7 @@ typedef struct HgfsServerMgrData {
       (mgr)->rpc           = (_rpc);                               \
       (mgr)->rpcCallback   = (_rpcCallback);                       \
       (mgr)->connection    = NULL;                                 \
+      (mgr)->writeBehindEnabled = FALSE;                           \
    } while (0)
 
 Bool HgfsServerManager_Register(HgfsServerMgrData *data);
@@ -61,6 +63,10 @@ Bool HgfsServerManager_ProcessPacket(HgfsServerMgrData *mgrData,
                                      char *packetOut,
                                      size_t *packetOutSize);
 uint32 HgfsServerManager_InvalidateInactiveSessions(HgfsServerMgrData *mgrData);
+void HgfsServerManager_DumpStats(HgfsServerMgrData *mgrData,
+                                 void (*printFunc)(void *clientData,
+                                                   const char *line),
+                                 void *clientData);
 #endif
 
 #endif // _HGFS_SERVER_MANAGER_H_
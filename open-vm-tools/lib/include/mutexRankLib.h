@@ -53,12 +53,19 @@
 /*
  * hgfs locks
  */
+#define RANK_hgfsGuestConnLock       (RANK_libLockBase + 0x4008)
 #define RANK_hgfsSessionArrayLock    (RANK_libLockBase + 0x4010)
+#define RANK_hgfsNotifyDispatchLock  (RANK_libLockBase + 0x4020)
+#define RANK_hgfsOplockDispatchLock  (RANK_libLockBase + 0x4024)
 #define RANK_hgfsSharedFolders       (RANK_libLockBase + 0x4030)
 #define RANK_hgfsNotifyLock          (RANK_libLockBase + 0x4040)
 #define RANK_hgfsFileIOLock          (RANK_libLockBase + 0x4050)
 #define RANK_hgfsSearchArrayLock     (RANK_libLockBase + 0x4060)
+#define RANK_hgfsDirSnapshotLock     (RANK_libLockBase + 0x4068)
 #define RANK_hgfsNodeArrayLock       (RANK_libLockBase + 0x4070)
+#define RANK_hgfsOplockLock          (RANK_libLockBase + 0x4074)
+#define RANK_hgfsWriteBehindLock     (RANK_libLockBase + 0x407C)
+#define RANK_hgfsNameCacheLock       (RANK_libLockBase + 0x4080)
 
 /*
  * vigor (must be < VMDB range and < disklib, see bug 741290)
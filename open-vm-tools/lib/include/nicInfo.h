@@ -52,6 +52,10 @@ Bool
 GuestInfo_IsEqual_DnsHostname(const DnsHostname *a,
                               const DnsHostname *b);
 
+Bool
+GuestInfo_IsEqual_GuestNicV3(const GuestNicV3 *a,
+                             const GuestNicV3 *b);
+
 Bool
 GuestInfo_IsEqual_InetCidrRouteEntry(const InetCidrRouteEntry *a,
                                      const InetCidrRouteEntry *b,
@@ -251,6 +251,7 @@ typedef struct PollOptions {
 void Poll_InitDefault(void);
 void Poll_InitDefaultEx(const PollOptions *opts);
 void Poll_InitGtk(void); // On top of glib for Linux
+void Poll_InitEpoll(void); // On top of epoll and glib for Linux
 void Poll_InitCF(void);  // On top of CoreFoundation for OSX
 
 
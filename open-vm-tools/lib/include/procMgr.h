@@ -119,6 +119,13 @@ typedef struct ProcMgr_ProcArgs {
     * started.
     */
    char *workingDirectory;
+
+   /*
+    * If non-NULL, the program to run and its arguments: argv[0] (a path) is
+    * executed directly instead of the command line going through the shell,
+    * which then is only used for logging.
+    */
+   char **argv;
 #endif
 } ProcMgr_ProcArgs;
 
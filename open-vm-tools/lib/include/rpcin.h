@@ -84,6 +84,8 @@ unsigned int RpcIn_SetRetVals(char const **result, size_t *resultLen,
 
 void RpcIn_Destruct(RpcIn *in);
 void RpcIn_stop(RpcIn *in);
+void RpcIn_SetBusyPolls(RpcIn *in, unsigned int busyPolls);
+unsigned int RpcIn_GetPickupWait(RpcIn *in);
 
 #ifdef __cplusplus
 } // extern "C"
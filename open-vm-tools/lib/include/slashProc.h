@@ -41,4 +41,16 @@ EXTERN void        SlashProcNet_FreeRoute(GPtrArray *);
 EXTERN GPtrArray  *SlashProcNet_GetRoute6(void);
 EXTERN void        SlashProcNet_FreeRoute6(GPtrArray *);
 
+/*
+ * Decides whether to keep a route, by outgoing interface index.
+ */
+typedef Bool (*SlashProcNetRouteFilter)(unsigned int ifIndex,
+                                        void *clientData);
+
+EXTERN GPtrArray  *SlashProcNet_GetRouteNetlink(int family,
+                                                unsigned int table,
+                                                unsigned int maxRoutes,
+                                                SlashProcNetRouteFilter filter,
+                                                void *clientData);
+
 #endif // ifndef _SLASHPROC_H_
@@ -44,6 +44,7 @@ ssize_t SSL_Write(SSLSock ssl, const char  *buf, size_t num);
 int SSL_Shutdown(SSLSock ssl);
 int SSL_GetFd(SSLSock sSock);
 int SSL_Pending(SSLSock ssl);
+Bool SSL_IsEncrypted(SSLSock ssl);
 int SSL_WantRead(const SSLSock ssl);
 
 
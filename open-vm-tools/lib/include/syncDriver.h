@@ -55,6 +55,16 @@ Bool SyncDriver_Thaw(const SyncDriverHandle handle);
 SyncDriverStatus SyncDriver_QueryStatus(const SyncDriverHandle handle,
                                         int32 timeout);
 void SyncDriver_CloseHandle(SyncDriverHandle *handle);
+#if !defined(_WIN32)
+Bool SyncDriver_Flush(const char *drives, uint32 maxDirtyKB,
+                      uint32 timeoutMs);
+
+typedef void (*SyncDriverVolumeTimesCb)(const char *path, uint64 freezeUS,
+                                        uint64 thawUS, void *clientData);
+void SyncDriver_GetVolumeTimes(const SyncDriverHandle handle,
+                               SyncDriverVolumeTimesCb cb,
+                               void *clientData);
+#endif
 
 #endif
 
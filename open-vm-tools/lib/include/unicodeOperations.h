@@ -99,6 +99,13 @@ char *Unicode_Format(const char *fmt, ...);
 
 UnicodeIndex Unicode_LengthInCodePoints(const char *str);
 
+/*
+ * Case-insensitive hash; strings that Unicode_CompareIgnoreCase considers
+ * equal hash the same.
+ */
+
+uint32 Unicode_HashIgnoreCase(const char *str);
+
 /*
  * Simple in-line functions that may be used below.
  */
@@ -35,6 +35,7 @@
 typedef struct MXUserExclLock   MXUserExclLock;
 typedef struct MXUserRecLock    MXUserRecLock;
 typedef struct MXUserRWLock     MXUserRWLock;
+typedef struct MXUserReadMostlyLock MXUserReadMostlyLock;
 typedef struct MXUserRankLock   MXUserRankLock;
 typedef struct MXUserCondVar    MXUserCondVar;
 typedef struct MXUserSemaphore  MXUserSemaphore;
@@ -153,6 +154,21 @@ MXUserRWLock *MXUser_CreateSingletonRWLock(Atomic_Ptr *lockStorage,
                                            const char *name,
                                            MX_Rank rank);
 
+/*
+ * Read-mostly lock: cheap read acquisitions, expensive write acquisitions.
+ * Read acquisitions aren't recursive and aren't tracked per thread.
+ */
+
+MXUserReadMostlyLock *MXUser_CreateReadMostlyLock(const char *name,
+                                                  MX_Rank rank,
+                                                  Bool writerPreference);
+
+void MXUser_AcquireReadMostlyForRead(MXUserReadMostlyLock *lock);
+void MXUser_ReleaseReadMostlyForRead(MXUserReadMostlyLock *lock);
+void MXUser_AcquireReadMostlyForWrite(MXUserReadMostlyLock *lock);
+void MXUser_ReleaseReadMostlyForWrite(MXUserReadMostlyLock *lock);
+void MXUser_DestroyReadMostlyLock(MXUserReadMostlyLock *lock);
+
 /*
  * Stateful auto-reset event
  */
@@ -257,6 +273,33 @@ void MXUser_SetStatsFunc(void *context,
                          void (*statsFunc)(void *context,
                                            const char *fmt,
                                            va_list ap));
+void MXUser_EnableStatsAllLocks(void);
+
+/*
+ * Statistics of one lock, as reported by MXUser_ForEachLockStats. Times are
+ * in nanoseconds. An acquisition is contended if it waited longer than the
+ * contention duration floor (see MXUser_StatisticsControl).
+ */
+
+#define MXUSER_WAIT_HISTO_BUCKETS 8  // < 1us, < 10us, ..., < 1s, longer
+
+typedef struct MXUserLockStats {
+   const char *name;
+   uint32      serialNumber;
+   uint64      numAttempts;        // Acquisition attempts
+   uint64      numSuccesses;       // Successful acquisitions
+   uint64      numContended;       // Contended successful acquisitions
+   uint64      contentionTime;     // Time spent in contended acquisitions
+   uint64      maxWaitTime;        // Longest acquisition
+   uint64      waitHisto[MXUSER_WAIT_HISTO_BUCKETS];  // Contended, by wait
+   uint64      numHeld;            // Releases; 0 if held times aren't tracked
+   uint64      heldTime;           // Total time held
+   uint64      maxHeldTime;        // Longest time held
+} MXUserLockStats;
+
+void MXUser_ForEachLockStats(void (*cb)(void *clientData,
+                                        const MXUserLockStats *stats),
+                             void *clientData);
 
 void MXUser_SetInPanic(void);
 Bool MXUser_InPanic(void);
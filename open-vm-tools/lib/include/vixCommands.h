@@ -108,6 +108,7 @@ enum {
    VIX_REQUESTMSG_ESCAPE_XML_DATA                     = 0x040,
    VIX_REQUESTMSG_HAS_HASHED_SHARED_SECRET            = 0x080,
    VIX_REQUESTMSG_VIGOR_COMMAND                       = 0x100,
+   VIX_REQUESTMSG_STREAM_FILE_TRANSFER                = 0x200,
 };
 
 
@@ -765,6 +766,35 @@ struct VixCommandInitiateFileTransferToGuestRequest {
 VixCommandInitiateFileTransferToGuestRequest;
 
 
+/*
+ * Streamed file transfers.
+ *
+ * A client sets VIX_REQUESTMSG_STREAM_FILE_TRANSFER in an
+ * InitiateFileTransfer(From|To)Guest request to move the file contents over
+ * a vsock stream instead of HGFS packets. A guest that supports it (and has
+ * it enabled) adds a <streamPort> and a <streamToken> element to the reply.
+ * Older guests ignore the flag and reply as before; the client then falls
+ * back to HGFS.
+ *
+ * The client connects to streamPort on the guest and sends the token, which
+ * is VIX_FILE_STREAM_TOKEN_SIZE bytes, given in hex in the reply.
+ * - From the guest: the guest sends the file size (uint64, little endian)
+ *   followed by the contents, and closes the connection. A shorter stream
+ *   means that the transfer failed.
+ * - To the guest: the client sends the size (uint64, little endian)
+ *   followed by the contents. The guest writes them to a temporary file
+ *   next to the target, which only replaces the target once complete; it
+ *   then sends a VixError (uint64, little endian) and closes the connection.
+ *
+ * The contents aren't framed or acknowledged, so the transfer is only paced
+ * by the socket buffers. The guest stops listening after the first
+ * connection, and gives up on a transfer that makes no progress for
+ * VIX_FILE_STREAM_TIMEOUT seconds.
+ */
+#define VIX_FILE_STREAM_TOKEN_SIZE     16
+#define VIX_FILE_STREAM_TIMEOUT        30
+
+
 /*
  * This is used to reply to several operations, like testing whether
  * a file or registry key exists on the client.
@@ -1609,11 +1639,31 @@ struct VixMsgListProcessesExRequest {
    uint32 offset;
    uint32 numPids;
 
-   // This is followed by the list of uint64s
+   // This is followed by the list of uint64s, and optionally by a
+   // VixMsgListProcessesExFilter.
 }
 #include "vmware_pack_end.h"
 VixMsgListProcessesExRequest;
 
+/*
+ * Further restricts the processes ListProcessesEx reports, on top of the
+ * list of pids. Guests that don't know about it ignore it, and report
+ * every process that matches the pids.
+ */
+typedef
+#include "vmware_pack_begin.h"
+struct VixMsgListProcessesExFilter {
+   // Only report processes owned by this user, if not empty.
+   uint32 userLength;
+
+   // Only report processes whose name starts with this, if not empty.
+   uint32 namePrefixLength;
+
+   // This is followed by the NUL-terminated user and name prefix.
+}
+#include "vmware_pack_end.h"
+VixMsgListProcessesExFilter;
+
 typedef
 #include "vmware_pack_begin.h"
 struct VixMsgReadEnvironmentVariablesRequest {
@@ -2660,6 +2710,29 @@ __VMAutomationMsgParserGetPropertyList(const char *caller,
                                        size_t length,
                                        VixPropertyListImpl *propList);
 
+#define VMAutomationRequestParserGetPropertyListView \
+   VMAutomationMsgParserGetPropertyListView
+#define VMAutomationMsgParserGetPropertyListView(state, length, propState) \
+   __VMAutomationMsgParserGetPropertyListView(__FUNCTION__, __LINE__,       \
+                                              state, length, propState)
+VixError
+__VMAutomationMsgParserGetPropertyListView(const char *caller,
+                                           unsigned int line,
+                                           VMAutomationMsgParser *state,
+                                           size_t length,
+                                           VMAutomationMsgParser *propState);
+
+#define VMAutomationRequestParserGetNextProperty \
+   VMAutomationMsgParserGetNextProperty
+#define VMAutomationMsgParserGetNextProperty(propState, property) \
+   __VMAutomationMsgParserGetNextProperty(__FUNCTION__, __LINE__,       \
+                                          propState, property)
+VixError
+__VMAutomationMsgParserGetNextProperty(const char *caller,
+                                       unsigned int line,
+                                       VMAutomationMsgParser *propState,
+                                       VixPropertyView *property);
+
 #endif   // VIX_HIDE_FROM_JAVA
 
 
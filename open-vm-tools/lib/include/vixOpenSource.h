@@ -350,18 +350,52 @@ typedef struct VixPropertyValue
    Bool                       isDirty;
    Bool                       isSensitive;
    struct VixPropertyValue    *next;
+   struct VixPropertyValue    *nextInBucket;
 } VixPropertyValue;
 
 
 /*
  * This is the entire list.
+ *
+ * The properties are kept in a linked list, in the order they were added.
+ * Each one is also chained in a small table hashed by property ID, so
+ * lookups only walk the properties that share a bucket. Properties with
+ * the same ID stay in list order within their bucket.
  */
+#define VIX_PROPERTY_LIST_BUCKETS   32
+
 typedef struct VixPropertyListImpl
 {
    VixPropertyValue    *properties;
+   VixPropertyValue    *lastProperty;
+   int                 numItems;
+   size_t              serializeSizeHint;
+   VixPropertyValue    *buckets[VIX_PROPERTY_LIST_BUCKETS];
 } VixPropertyListImpl;
 
 
+/*
+ * A property read in place from a serialized property list. String and
+ * blob values point into the serialized buffer and must not be freed.
+ */
+typedef struct VixPropertyView
+{
+   int                        propertyID;
+   VixPropertyType            type;
+
+   union {
+      Bool                    boolValue;
+      const char              *strValue;
+      int                     intValue;
+      int64                   int64Value;
+      struct {
+         const unsigned char  *blobContents;
+         int                  blobSize;
+      } blobValue;
+   } value;
+} VixPropertyView;
+
+
 /*
  * This defines what action Deserialize should take when it encounters
  * a string that is not UTF-8.
@@ -409,6 +443,11 @@ VixPropertyList_DeserializeNoClobber(VixPropertyListImpl *propListImpl,
                                      size_t bufferSize,
                                      VixPropertyListBadEncodingAction action);
 
+VixError VixPropertyList_ReadSerializedProperty(const char *buffer,
+                                                size_t bufferSize,
+                                                size_t *pos,
+                                                VixPropertyView *property);
+
 VixError VixPropertyList_GetString(struct VixPropertyListImpl *propList,
                                    int propertyID,
                                    int index,
@@ -481,6 +481,78 @@ void VMGuestLib_StatFree(char *reply, size_t replySize);
 void VMGuestLib_StatFree(void *reply, size_t replySize);
 #endif
 
+
+/*
+ * Sampling
+ *
+ * For callers that poll a few integral statistics repeatedly. The caller
+ * fills in an array of VMGuestLibSampleStat once, setting 'id' to the
+ * statistic wanted and 'error' to VMGUESTLIB_ERROR_NO_INFO, and passes the
+ * same array to every VMGuestLib_Sample() call. Each call updates the
+ * handle and the array in place: nothing is allocated for the results,
+ * statistics past the highest id in the array are not decoded, and
+ * 'changed' marks the entries whose value or error differs from the
+ * previous sample, so that only deltas need to be reported.
+ *
+ * Because statistics past the highest sampled id are not decoded, the
+ * VMGuestLib_Get* accessors may return VMGUESTLIB_ERROR_UNSUPPORTED_VERSION
+ * for them until the next VMGuestLib_UpdateInfo() on the handle.
+ *
+ * The ids match the ones used by the host protocol.
+ */
+
+typedef enum {
+   VMGUESTLIB_STAT_CPU_RESERVATION_MHZ   = 1,
+   VMGUESTLIB_STAT_CPU_LIMIT_MHZ         = 2,
+   VMGUESTLIB_STAT_CPU_SHARES            = 3,
+   VMGUESTLIB_STAT_CPU_USED_MS           = 4,
+   VMGUESTLIB_STAT_HOST_MHZ              = 5,
+   VMGUESTLIB_STAT_MEM_RESERVATION_MB    = 6,
+   VMGUESTLIB_STAT_MEM_LIMIT_MB          = 7,
+   VMGUESTLIB_STAT_MEM_SHARES            = 8,
+   VMGUESTLIB_STAT_MEM_MAPPED_MB         = 9,
+   VMGUESTLIB_STAT_MEM_ACTIVE_MB         = 10,
+   VMGUESTLIB_STAT_MEM_OVERHEAD_MB       = 11,
+   VMGUESTLIB_STAT_MEM_BALLOONED_MB      = 12,
+   VMGUESTLIB_STAT_MEM_SWAPPED_MB        = 13,
+   VMGUESTLIB_STAT_MEM_SHARED_MB         = 14,
+   VMGUESTLIB_STAT_MEM_SHARED_SAVED_MB   = 15,
+   VMGUESTLIB_STAT_MEM_USED_MB           = 16,
+   VMGUESTLIB_STAT_ELAPSED_MS            = 17,
+   /* 18 is the resource pool path, which cannot be sampled. */
+   VMGUESTLIB_STAT_CPU_STOLEN_MS         = 19,
+   VMGUESTLIB_STAT_MEM_TARGET_SIZE_MB    = 20,
+   VMGUESTLIB_STAT_HOST_CPU_NUM_CORES    = 21,
+   VMGUESTLIB_STAT_HOST_CPU_USED_MS      = 22,
+   VMGUESTLIB_STAT_HOST_MEM_SWAPPED_MB   = 23,
+   VMGUESTLIB_STAT_HOST_MEM_SHARED_MB    = 24,
+   VMGUESTLIB_STAT_HOST_MEM_USED_MB      = 25,
+   VMGUESTLIB_STAT_HOST_MEM_PHYS_MB      = 26,
+   VMGUESTLIB_STAT_HOST_MEM_PHYS_FREE_MB = 27,
+   VMGUESTLIB_STAT_HOST_MEM_KERN_OVHD_MB = 28,
+   VMGUESTLIB_STAT_HOST_MEM_MAPPED_MB    = 29,
+   VMGUESTLIB_STAT_HOST_MEM_UNMAPPED_MB  = 30,
+   VMGUESTLIB_STAT_MEM_ZIPPED_MB         = 31,
+   VMGUESTLIB_STAT_MEM_ZIPSAVED_MB       = 32,
+   VMGUESTLIB_STAT_MEM_LLSWAPPED_MB      = 33,
+   VMGUESTLIB_STAT_MEM_SWAP_TARGET_MB    = 34,
+   VMGUESTLIB_STAT_MEM_BALLOON_TARGET_MB = 35,
+   VMGUESTLIB_STAT_MEM_BALLOON_MAX_MB    = 36
+} VMGuestLibStatId;
+
+typedef struct {
+   VMGuestLibStatId id;     // IN: The statistic to sample
+   VMGuestLibError error;   // OUT: Result of the last sample of the statistic
+   Bool changed;            // OUT: Differs from the previous sample
+   uint64 value;            // OUT: Valid if error is VMGUESTLIB_ERROR_SUCCESS
+} VMGuestLibSampleStat;
+
+VMGuestLibError
+VMGuestLib_Sample(VMGuestLibHandle handle,      // IN
+                  VMGuestLibSampleStat *stats,  // IN/OUT
+                  uint32 numStats,              // IN
+                  uint32 *numChanged);          // OUT: Optional
+
 #ifdef __cplusplus
 }
 #endif
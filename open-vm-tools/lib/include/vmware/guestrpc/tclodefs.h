@@ -53,6 +53,30 @@
 #define GUESTRPC_TCLO_VSOCK_LISTEN_PORT      975
 #define GUESTRPC_RPCI_VSOCK_LISTEN_PORT      976
 
+/*
+ * Bulk transfer of large RPCs (vsock only).
+ *
+ * Before sending an RPC of GUESTRPC_BULK_MIN_SIZE bytes or more, the guest
+ * asks for a side channel with "rpci.bulk.open <size>" on its regular RPCI
+ * channel. A host that supports it replies with "<port> <token>". The guest
+ * then connects to that vsock port on the host, sends "<token> <size>\n"
+ * followed by the RPC itself (unframed), and reads the RPC reply as a single
+ * packet on the same connection. The transfer is paced by the vsock flow
+ * control; the host runs the RPC once it has all of it.
+ *
+ * Hosts that don't know the command reply RPCI_UNKNOWN_COMMAND, and large
+ * RPCs keep going through the regular channel.
+ */
+#define GUESTRPC_BULK_OPEN_CMD               "rpci.bulk.open"
+#define GUESTRPC_BULK_MIN_SIZE               (64 * 1024)
+#define GUESTRPC_BULK_TOKEN_MAX              64
+
+/*
+ * Dispatch statistics of the TCLO channel. The guest replies with one line
+ * per command it has handled, see RpcChannel_ForEachCmdStats().
+ */
+#define GUESTRPC_STATS_CMD                   "rpc.stats"
+
 /*
  * Tools options.
  */
@@ -64,6 +88,8 @@
 #define TOOLSOPTION_MAP_ROOT_HGFS_SHARE           "mapRootHgfsShare"
 #define TOOLSOPTION_LINK_ROOT_HGFS_SHARE          "linkRootHgfsShare"
 #define TOOLSOPTION_ENABLE_MESSAGE_BUS_TUNNEL     "enableMessageBusTunnel"
+#define TOOLSOPTION_GUESTSTATS_COMPACT            "guestStatsCompact"
+#define TOOLSOPTION_LOCK_STATS                    "lockStats"
 
 /*
  * Auto-upgrade commands.
@@ -35,6 +35,8 @@
 #define TOOLSOPTION_SYNCTIME_PERCENTCORRECTION  "time.synchronize.tools.percentCorrection"
 
 #define TIMESYNC_SYNCHRONIZE                    "Time_Synchronize"
+/* Replies with the time sync statistics, as text. */
+#define TIMESYNC_STATS                          "Time_Synchronize_Stats"
 
 #endif /* _TIMESYNC_H_ */
 
@@ -72,6 +72,7 @@
 #define VMBACKUP_EVENT_SNAPSHOT_PREPARE   "prov.snapshotPrepare"
 #define VMBACKUP_EVENT_WRITER_ERROR       "req.writerError"
 #define VMBACKUP_EVENT_KEEP_ALIVE         "req.keepAlive"
+#define VMBACKUP_EVENT_REQUESTOR_TIMELINE "req.timeline"
 
 /* These are the event codes sent with the events */
 typedef enum {
@@ -125,6 +125,58 @@ typedef void (*RpcChannelResetCb)(RpcChannel *chan,
                                   gboolean success,
                                   gpointer data);
 
+/** Number of buckets in the handler time histogram of RpcChannelCmdStats. */
+#define RPCCHANNEL_STATS_BUCKETS 6
+
+/**
+ * Dispatch statistics of one incoming RPC command. Commands without a
+ * registered handler are accounted together, under the name "(unknown)".
+ */
+typedef struct RpcChannelCmdStats {
+   const gchar *name;
+   /** Number of times the command was dispatched, and how many failed. */
+   guint64      count;
+   guint64      errors;
+   /** Time spent in the handler, in us. */
+   guint64      totalUS;
+   guint64      maxUS;
+   /**
+    * Handler time histogram: under 1 ms, 10 ms, 100 ms, 1 s, 10 s, and
+    * 10 s or more.
+    */
+   guint64      histogram[RPCCHANNEL_STATS_BUCKETS];
+   /** Size of the replies, in bytes. */
+   guint64      replyBytes;
+   guint64      maxReplyBytes;
+   /**
+    * Longest time the messages may have waited to be picked up from the
+    * host, in ms. Only known for the backdoor; 0 for vsocket connections.
+    */
+   guint64      totalQueueMS;
+   guint64      maxQueueMS;
+} RpcChannelCmdStats;
+
+typedef void (*RpcChannelCmdStatsCb)(const RpcChannelCmdStats *stats,
+                                     gpointer data);
+
+/**
+ * Signature for the completion callback of RpcChannel_SendAsync().
+ *
+ * @param[in]  chan       The RPC channel.
+ * @param[in]  status     Status from the remote end, as returned by
+ *                        RpcChannel_Send().
+ * @param[in]  result     Response from the other side, or a description of
+ *                        the error. Owned by the library, only valid for the
+ *                        duration of the callback.
+ * @param[in]  resultLen  Number of bytes in response.
+ * @param[in]  data       Client data.
+ */
+typedef void (*RpcChannelSendCb)(RpcChannel *chan,
+                                 gboolean status,
+                                 const char *result,
+                                 size_t resultLen,
+                                 gpointer data);
+
 gboolean
 RpcChannel_Start(RpcChannel *chan);
 
@@ -141,6 +193,13 @@ RpcChannel_Send(RpcChannel *chan,
                 char **result,
                 size_t *resultLen);
 
+void
+RpcChannel_SendAsync(RpcChannel *chan,
+                     char const *data,
+                     size_t dataLen,
+                     RpcChannelSendCb cb,
+                     gpointer cbData);
+
 void
 RpcChannel_Free(void *ptr);
 
@@ -207,6 +266,15 @@ RpcChannel_New(void);
 void
 RpcChannel_SetBackdoorOnly(void);
 
+void
+RpcChannel_SetPollPolicy(guint maxDelay,
+                         guint busyPolls);
+
+void
+RpcChannel_ForEachCmdStats(RpcChannel *chan,
+                           RpcChannelCmdStatsCb cb,
+                           gpointer data);
+
 G_END_DECLS
 
 /** @} */
@@ -43,6 +43,17 @@
  *      - Valid values: std, outputdebugstring (Win32-only), file, file+ (same as
  *        "file", but appends to existing log file), vmx, syslog.
  *      - Default: "syslog".
+ *    - rateLimit: maximum number of messages of each level logged per second.
+ *      Messages over the limit are dropped, and how many were dropped is
+ *      logged with the next message of that level that gets through. Fatal
+ *      errors are never dropped.
+ *      - Default: the default domain's value, or 0 (no limit) for it.
+ *    - rateBurst: number of messages of each level that may be logged at once
+ *      before the rate limit kicks in.
+ *      - Default: 5 seconds worth of rateLimit.
+ *    - debugSampling: log only one in every N debug messages, so that debug
+ *      logging can stay on without flooding the log.
+ *      - Default: the default domain's value, or 0 (log all) for it.
  *
  * For file handlers, the following extra configuration information can be
  * provided:
@@ -109,6 +120,13 @@
  * # Disables core dumps on fatal errors; they're enabled by default.
  * enableCoreDump = false
  *
+ * # Writes messages from a separate thread, so that logging doesn't wait for
+ * # the disk or the host. Messages are dropped when more than asyncQueueSize
+ * # (default: 1024) are waiting to be written. Fatal errors are always
+ * # written right away, after the messages already queued.
+ * asyncLogging = true
+ * asyncQueueSize = 4096
+ *
  * # Defines the "vmsvc" domain, logging to stdout/stderr.
  * vmsvc.level = info
  * vmsvc.handler = std
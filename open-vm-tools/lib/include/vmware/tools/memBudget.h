@@ -0,0 +1,189 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+#ifndef _MEMBUDGET_H_
+#define _MEMBUDGET_H_
+
+/**
+ * @file memBudget.h
+ *
+ * Public interface for vmtoolsd's memory budget.
+ *
+ * @defgroup vmtools_membudget  Memory Budget
+ * @brief Keeping the service's memory footprint in check
+ * @{
+ *
+ * Plugins register the caches they keep with the service, along with a
+ * function that reports how much memory a cache holds and one that releases
+ * some of it. When the configured budget for all caches is exceeded, the
+ * service asks the largest caches to shrink until the total fits again.
+ *
+ * Plugins also report the end of operations that allocate a lot of memory
+ * for a short time (large listings, big messages to the host). The service
+ * then hands the freed heap memory back to the system, instead of letting
+ * the process keep the peak footprint.
+ *
+ * Cache callbacks are always called on the main service thread; caches also
+ * used from other threads must do their own locking.
+ */
+
+#include <glib-object.h>
+#include "vmware/tools/plugin.h"
+
+#define TOOLS_CORE_PROP_MEMBUDGET "tcs_prop_mem_budget"
+
+/**
+ * Type of callback that returns the number of bytes held by a cache.
+ */
+typedef gsize (*ToolsCoreMemCacheSizeCb)(gpointer data);
+
+/**
+ * Type of callback that asks a cache to release at least the given number of
+ * bytes, if it can. Returns the number of bytes actually released.
+ */
+typedef gsize (*ToolsCoreMemCacheEvictCb)(gsize bytes,
+                                          gpointer data);
+
+/**
+ * @brief Public interface of the memory budget.
+ *
+ * This struct is published in the service's TOOLS_CORE_PROP_MEMBUDGET
+ * property. Applications should use the inline functions below.
+ */
+typedef struct ToolsCoreMemBudget {
+   guint (*registerCache)(const gchar *owner,
+                          const gchar *name,
+                          ToolsCoreMemCacheSizeCb size,
+                          ToolsCoreMemCacheEvictCb evict,
+                          gpointer data);
+   void (*unregisterCache)(guint id);
+   void (*transientDone)(const gchar *owner,
+                         gsize bytes);
+} ToolsCoreMemBudget;
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudget_Get --                                              */ /**
+ *
+ * @brief Returns the memory budget instance for the service.
+ *
+ * @param[in] ctx Application context.
+ *
+ * @return The memory budget instance, or NULL if it's not available.
+ *
+ *******************************************************************************
+ */
+
+G_INLINE_FUNC ToolsCoreMemBudget *
+ToolsCoreMemBudget_Get(ToolsAppCtx *ctx)
+{
+   ToolsCoreMemBudget *budget = NULL;
+   g_object_get(ctx->serviceObj, TOOLS_CORE_PROP_MEMBUDGET, &budget, NULL);
+   return budget;
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudget_RegisterCache --                                    */ /**
+ *
+ * @brief Registers a cache with the memory budget.
+ *
+ * @param[in] ctx    Application context.
+ * @param[in] owner  Name under which the cache is reported, usually the
+ *                   plugin name.
+ * @param[in] name   Name of the cache.
+ * @param[in] size   Function that returns the cache size.
+ * @param[in] evict  Function that shrinks the cache.
+ * @param[in] data   Opaque data for the callbacks.
+ *
+ * @return An identifier for the cache, or 0 on error.
+ *
+ *******************************************************************************
+ */
+
+G_INLINE_FUNC guint
+ToolsCoreMemBudget_RegisterCache(ToolsAppCtx *ctx,
+                                 const gchar *owner,
+                                 const gchar *name,
+                                 ToolsCoreMemCacheSizeCb size,
+                                 ToolsCoreMemCacheEvictCb evict,
+                                 gpointer data)
+{
+   ToolsCoreMemBudget *budget = ToolsCoreMemBudget_Get(ctx);
+   if (budget != NULL) {
+      return budget->registerCache(owner, name, size, evict, data);
+   }
+   return 0;
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudget_UnregisterCache --                                  */ /**
+ *
+ * @brief Removes a cache from the memory budget.
+ *
+ * @param[in] ctx    Application context.
+ * @param[in] id     Identifier returned when registering the cache.
+ *
+ *******************************************************************************
+ */
+
+G_INLINE_FUNC void
+ToolsCoreMemBudget_UnregisterCache(ToolsAppCtx *ctx,
+                                   guint id)
+{
+   ToolsCoreMemBudget *budget = ToolsCoreMemBudget_Get(ctx);
+   if (budget != NULL && id != 0) {
+      budget->unregisterCache(id);
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudget_TransientDone --                                    */ /**
+ *
+ * @brief Reports the end of an operation that used a lot of memory.
+ *
+ * May be called from any thread. Returning the memory to the system happens
+ * later, on the main service thread.
+ *
+ * @param[in] ctx    Application context.
+ * @param[in] owner  Name under which the operation is reported.
+ * @param[in] bytes  Approximate amount of memory used by the operation.
+ *
+ *******************************************************************************
+ */
+
+G_INLINE_FUNC void
+ToolsCoreMemBudget_TransientDone(ToolsAppCtx *ctx,
+                                 const gchar *owner,
+                                 gsize bytes)
+{
+   ToolsCoreMemBudget *budget = ToolsCoreMemBudget_Get(ctx);
+   if (budget != NULL) {
+      budget->transientDone(owner, bytes);
+   }
+}
+
+/** @} */
+
+#endif /* _MEMBUDGET_H_ */
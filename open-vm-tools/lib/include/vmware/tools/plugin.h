@@ -127,7 +127,7 @@ ToolsCore_LogState(guint level,
 #define TOOLS_CORE_SIG_CAPABILITIES "tcs_capabilities"
 
 /**
- * Signal sent when the config file is reloaded.
+ * Signal sent when the config file is reloaded and its contents changed.
  *
  * @param[in]  src      The source object.
  * @param[in]  ctx      ToolsAppCtx *: The application context.
@@ -135,6 +135,19 @@ ToolsCore_LogState(guint level,
  */
 #define TOOLS_CORE_SIG_CONF_RELOAD "tcs_conf_reload"
 
+/**
+ * Signal sent once for each config group whose contents changed when the
+ * config file is reloaded, before TOOLS_CORE_SIG_CONF_RELOAD. The group
+ * name is the signal detail, so a plugin interested in a single group can
+ * connect to, e.g., TOOLS_CORE_SIG_CONF_GROUP_RELOAD "::guestinfo".
+ *
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      ToolsAppCtx *: The application context.
+ * @param[in]  group    const gchar *: Name of the group that changed.
+ * @param[in]  data     Client data.
+ */
+#define TOOLS_CORE_SIG_CONF_GROUP_RELOAD "tcs_conf_group_reload"
+
 /**
  * Signal sent when the service receives a request to dump its internal
  * state to the log. This is for debugging purposes, and plugins can
@@ -39,6 +39,11 @@
  * with the lifecycle of the new thread managed by the thread pool so that it
  * is properly notified of service shutdown.
  *
+ * Tasks are queued in one of a few priority classes. Workers always pick the
+ * highest priority task available, and when the pool has more than one
+ * thread, one of them is kept free of normal and low priority work so that
+ * high priority tasks never wait behind long running jobs.
+ *
  * Finally, depending on the configuration, the shared thread pool might not
  * be a thread pool at all: if the configuration has disabled threading, tasks
  * destined to the shared thread pool will be executed on the main service
@@ -54,6 +59,14 @@
 typedef void (*ToolsCorePoolCb)(ToolsAppCtx *ctx,
                                 gpointer data);
 
+/** Priority classes for tasks submitted to the shared thread pool. */
+typedef enum {
+   TOOLS_CORE_POOL_PRIORITY_HIGH,     /**< Short, latency sensitive work. */
+   TOOLS_CORE_POOL_PRIORITY_NORMAL,   /**< Default class. */
+   TOOLS_CORE_POOL_PRIORITY_LOW,      /**< Long running, bulk work. */
+   TOOLS_CORE_POOL_PRIORITY_MAX
+} ToolsCorePoolPriority;
+
 /**
  * @brief Public interface of the shared thread pool.
  *
@@ -74,6 +87,11 @@ typedef struct ToolsCorePool {
                      ToolsCorePoolCb interrupt,
                      gpointer data,
                      GDestroyNotify dtor);
+   guint (*submitPriority)(ToolsAppCtx *ctx,
+                           ToolsCorePoolPriority priority,
+                           ToolsCorePoolCb cb,
+                           gpointer data,
+                           GDestroyNotify dtor);
 } ToolsCorePool;
 
 
@@ -136,6 +154,44 @@ ToolsCorePool_SubmitTask(ToolsAppCtx *ctx,
 }
 
 
+/*
+ *******************************************************************************
+ * ToolsCorePool_SubmitTaskPriority --                                    */ /**
+ *
+ * @brief Submits a task for execution in the thread pool in the given
+ * priority class.
+ *
+ * Same as ToolsCorePool_SubmitTask(), which uses
+ * TOOLS_CORE_POOL_PRIORITY_NORMAL. High priority tasks should be short; work
+ * that may take long, such as scanning processes or the file system, should
+ * use TOOLS_CORE_POOL_PRIORITY_LOW.
+ *
+ * @param[in] ctx       Application context.
+ * @param[in] priority  Priority class of the task.
+ * @param[in] cb        Function to execute the task.
+ * @param[in] data      Opaque data for the task.
+ * @param[in] dtor      Destructor for the task data.
+ *
+ * @return An identifier for the task, or 0 on error.
+ *
+ *******************************************************************************
+ */
+
+G_INLINE_FUNC guint
+ToolsCorePool_SubmitTaskPriority(ToolsAppCtx *ctx,
+                                 ToolsCorePoolPriority priority,
+                                 ToolsCorePoolCb cb,
+                                 gpointer data,
+                                 GDestroyNotify dtor)
+{
+   ToolsCorePool *pool = ToolsCorePool_GetPool(ctx);
+   if (pool != NULL) {
+      return pool->submitPriority(ctx, priority, cb, data, dtor);
+   }
+   return 0;
+}
+
+
 /*
  *******************************************************************************
  * ToolsCorePool_CancelTask --                                            */ /**
@@ -0,0 +1,139 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+#ifndef _TIMESYNCSTATS_H_
+#define _TIMESYNCSTATS_H_
+
+/**
+ * @file timeSyncStats.h
+ *
+ * Time synchronization statistics, published by the timeSync plugin in the
+ * service's TOOLS_CORE_PROP_TIMESYNC_STATS property so that other plugins
+ * (guestInfo) can report them.
+ *
+ * The statistics are updated on the main loop thread, and must only be read
+ * from it.
+ */
+
+#include <glib-object.h>
+#include "vmware/tools/plugin.h"
+
+#define TOOLS_CORE_PROP_TIMESYNC_STATS "tcs_prop_timesync_stats"
+
+/** Number of buckets of the host read round trip time histogram. */
+#define TIMESYNC_STATS_RTT_BUCKETS 16
+
+/** State of the slew correction. */
+typedef enum {
+   TIMESYNC_STATS_SLEW_UNCALIBRATED = 0, /**< Plain slewing, or none. */
+   TIMESYNC_STATS_SLEW_CALIBRATING  = 1, /**< Measuring the frequency error. */
+   TIMESYNC_STATS_SLEW_PLL          = 2, /**< Kernel PLL in charge. */
+} TimeSyncStatsSlewState;
+
+/** Time synchronization statistics. Times are in microseconds. */
+typedef struct TimeSyncStats {
+   guint64  syncs;        /**< Host time readings (periodic and one time). */
+   guint64  failures;     /**< Synchronizations that failed. */
+   guint64  steps;        /**< Time steps. */
+   guint64  slews;        /**< Plain slew adjustments. */
+   guint64  pllUpdates;   /**< Offsets fed to the kernel PLL. */
+   guint64  noisy;        /**< Readings discarded as popcorn spikes. */
+   gint64   offset;       /**< Guest - host time error of the last reading. */
+   gint64   estError;     /**< Estimated error of the last reading. */
+   gint64   maxOffset;    /**< Largest absolute offset seen. */
+   gint64   frequency;    /**< PLL frequency correction, ppm << 16. */
+   gboolean frequencyValid; /**< Whether "frequency" is known. */
+   guint    slewState;    /**< TimeSyncStatsSlewState. */
+   gint64   minRtt;       /**< Lowest recent host read round trip time. */
+   /** Best round trip time of each reading: bucket i counts those < 2^(i+1). */
+   guint64  rttHisto[TIMESYNC_STATS_RTT_BUCKETS];
+} TimeSyncStats;
+
+
+/*
+ *******************************************************************************
+ * TimeSyncStats_Get --                                                   */ /**
+ *
+ * @brief Returns the time synchronization statistics of the service.
+ *
+ * @param[in] ctx Application context.
+ *
+ * @return The statistics, or NULL if the timeSync plugin isn't loaded.
+ *
+ *******************************************************************************
+ */
+
+G_INLINE_FUNC const TimeSyncStats *
+TimeSyncStats_Get(ToolsAppCtx *ctx)
+{
+   TimeSyncStats *stats = NULL;
+
+   if (g_object_class_find_property(G_OBJECT_GET_CLASS(ctx->serviceObj),
+                                    TOOLS_CORE_PROP_TIMESYNC_STATS) != NULL) {
+      g_object_get(ctx->serviceObj, TOOLS_CORE_PROP_TIMESYNC_STATS,
+                   &stats, NULL);
+   }
+   return stats;
+}
+
+
+/*
+ *******************************************************************************
+ * TimeSyncStats_RttPercentile --                                         */ /**
+ *
+ * @brief Works out a percentile of the host read round trip times.
+ *
+ * @param[in]  stats    The statistics.
+ * @param[in]  percent  Percentile wanted.
+ * @param[out] value    Upper bound of the bucket the percentile falls in.
+ *
+ * @return FALSE if there were no readings yet.
+ *
+ *******************************************************************************
+ */
+
+G_INLINE_FUNC gboolean
+TimeSyncStats_RttPercentile(const TimeSyncStats *stats,
+                            guint percent,
+                            guint64 *value)
+{
+   guint64 total = 0;
+   guint64 count = 0;
+   guint64 rank;
+   guint i;
+
+   for (i = 0; i < TIMESYNC_STATS_RTT_BUCKETS; i++) {
+      total += stats->rttHisto[i];
+   }
+   if (total == 0) {
+      return FALSE;
+   }
+
+   rank = (total * percent + 99) / 100;
+   for (i = 0; i < TIMESYNC_STATS_RTT_BUCKETS - 1; i++) {
+      count += stats->rttHisto[i];
+      if (count >= rank) {
+         break;
+      }
+   }
+
+   *value = G_GUINT64_CONSTANT(1) << (i + 1);
+   return TRUE;
+}
+
+#endif /* _TIMESYNCSTATS_H_ */
@@ -163,6 +163,33 @@ VMTools_GetLibdir(void);
 GSource *
 VMTools_CreateTimer(gint timeout);
 
+/** Accounting data of a coalesced timer. */
+typedef struct VMToolsTimerStats {
+   const gchar *name;
+   /** Period and slack of the most recently created timer, in ms. */
+   guint        interval;
+   guint        slack;
+   /** Number of expirations. */
+   guint64      fired;
+   /** Time spent in the callback, in us. */
+   guint64      totalUS;
+   guint64      maxUS;
+   /** Sum of how late each expiration ran, in ms. */
+   guint64      totalDelayMS;
+} VMToolsTimerStats;
+
+typedef void (*VMToolsTimerStatsCb)(const VMToolsTimerStats *stats,
+                                    gpointer data);
+
+GSource *
+VMTools_CreateCoalescedTimer(const gchar *name,
+                             guint interval,
+                             guint slack);
+
+void
+VMTools_ForEachTimerStats(VMToolsTimerStatsCb cb,
+                          gpointer data);
+
 void
 VMTools_SetGuestSDKMode(void);
 
@@ -184,6 +211,12 @@ VMTools_SuspendLogIO(void);
 void
 VMTools_ResumeLogIO(void);
 
+gsize
+VMTools_GetLogCacheSize(void);
+
+gsize
+VMTools_TrimLogCache(void);
+
 GArray *
 VMTools_WrapArray(gconstpointer data,
                   guint elemSize,
@@ -113,4 +113,17 @@ Wiper_State *Wiper_Start(const WiperPartition *p, unsigned int maxWiperFileSize)
 unsigned char *Wiper_Next(Wiper_State **s, unsigned int *progress);
 unsigned char *Wiper_Cancel(Wiper_State **s);
 
+#if !defined(_WIN32)
+/* Throughput of a wipe, see Wiper_GetStats(). */
+typedef struct WiperStats {
+   uint64 bytesDone;    /* Bytes zeroed, or of the file system trimmed */
+   uint64 bytesLeft;    /* Estimate of the bytes left to zero or trim */
+   uint64 elapsedUS;    /* Time spent on them */
+   uint64 bytesPerSec;  /* Average rate, 0 if unknown yet */
+   uint64 etaSec;       /* Estimated time left, 0 if unknown */
+} WiperStats;
+
+void Wiper_GetStats(const Wiper_State *s, WiperStats *stats);
+#endif
+
 #endif /* _WIPER_H_ */
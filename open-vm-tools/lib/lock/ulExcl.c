@@ -129,12 +129,12 @@ MXUser_EnableStatsExclLock(MXUserExclLock *lock,       // IN/OUT:
    ASSERT(lock);
    MXUserValidateHeader(&lock->header, MXUSER_TYPE_EXCL);
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       MXUserEnableStats(trackAcquisitionTime ? &lock->acquireStatsMem : NULL,
                         trackHeldTime        ? &lock->heldStatsMem    : NULL);
    }
 
-   return vmx86_stats;
+   return mxuser_stats;
 }
 
 
@@ -161,11 +161,11 @@ MXUser_DisableStatsExclLock(MXUserExclLock *lock)  // IN/OUT:
    ASSERT(lock);
    MXUserValidateHeader(&lock->header, MXUSER_TYPE_EXCL);
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       MXUserDisableStats(&lock->acquireStatsMem, &lock->heldStatsMem);
    }
 
-   return vmx86_stats;
+   return mxuser_stats;
 }
 
 
@@ -195,7 +195,7 @@ MXUser_SetContentionRatioFloorExclLock(MXUserExclLock *lock,  // IN/OUT:
    ASSERT(lock);
    MXUserValidateHeader(&lock->header, MXUSER_TYPE_EXCL);
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       result = MXUserSetContentionRatioFloor(&lock->acquireStatsMem, ratio);
    } else {
       result = FALSE;
@@ -231,7 +231,7 @@ MXUser_SetContentionCountFloorExclLock(MXUserExclLock *lock,  // IN/OUT:
    ASSERT(lock);
    MXUserValidateHeader(&lock->header, MXUSER_TYPE_EXCL);
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       result = MXUserSetContentionCountFloor(&lock->acquireStatsMem, count);
    } else {
       result = FALSE;
@@ -267,7 +267,7 @@ MXUser_SetContentionDurationFloorExclLock(MXUserExclLock *lock,  // IN/OUT:
    ASSERT(lock);
    MXUserValidateHeader(&lock->header, MXUSER_TYPE_EXCL);
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       result = MXUserSetContentionDurationFloor(&lock->acquireStatsMem,
                                                 duration);
    } else {
@@ -353,22 +353,23 @@ MXUser_CreateExclLock(const char *userName,  // IN:
    lock->header.bits.serialNumber = MXUserAllocSerialNumber();
    lock->header.dumpFunc = MXUserDumpExclLock;
 
+   lock->header.statsFunc = MXUserStatsActionExcl;
+   lock->header.acquireStatsMem = &lock->acquireStatsMem;
+   lock->header.heldStatsMem = &lock->heldStatsMem;
+
    statsMode = MXUserStatsMode();
 
    switch (MXUserStatsMode()) {
    case 0:
       MXUserDisableStats(&lock->acquireStatsMem, &lock->heldStatsMem);
-      lock->header.statsFunc = NULL;
       break;
 
    case 1:
       MXUserEnableStats(&lock->acquireStatsMem, NULL);
-      lock->header.statsFunc = MXUserStatsActionExcl;
       break;
 
    case 2:
       MXUserEnableStats(&lock->acquireStatsMem, &lock->heldStatsMem);
-      lock->header.statsFunc = MXUserStatsActionExcl;
       break;
 
    default:
@@ -413,7 +414,7 @@ MXUser_DestroyExclLock(MXUserExclLock *lock)  // IN:
 
       MXUserRemoveFromList(&lock->header);
 
-      if (vmx86_stats) {
+      if (mxuser_stats) {
          MXUserDisableStats(&lock->acquireStatsMem, &lock->heldStatsMem);
       }
 
@@ -449,7 +450,7 @@ MXUser_AcquireExclLock(MXUserExclLock *lock)  // IN/OUT:
 
    MXUserAcquisitionTracking(&lock->header, TRUE);
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       VmTimeType value = 0;
       MXUserHeldStats *heldStats;
       MXUserAcquireStats *acquireStats;
@@ -513,7 +514,7 @@ MXUser_ReleaseExclLock(MXUserExclLock *lock)  // IN/OUT:
    ASSERT(lock);
    MXUserValidateHeader(&lock->header, MXUSER_TYPE_EXCL);
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       MXUserHeldStats *heldStats = Atomic_ReadPtr(&lock->heldStatsMem);
 
       if (UNLIKELY(heldStats != NULL)) {
@@ -593,7 +594,7 @@ MXUser_TryAcquireExclLock(MXUserExclLock *lock)  // IN/OUT:
       }
    }
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       MXUserAcquireStats *acquireStats;
 
       acquireStats = Atomic_ReadPtr(&lock->acquireStatsMem);
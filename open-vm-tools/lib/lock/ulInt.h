@@ -50,6 +50,18 @@ typedef pthread_t MXUserThreadID;
 #define MXUSER_STAT_CLASS_ACQUISITION "a"
 #define MXUSER_STAT_CLASS_HELD        "h"
 
+/*
+ * Statistics support is compiled into stats builds and into the Tools,
+ * which turn it on at run time (MXUser_SetStatsFunc). Until then it costs
+ * a NULL check per acquisition.
+ */
+
+#if defined(VMX86_STATS) || defined(VMX86_TOOLS)
+#define mxuser_stats 1
+#else
+#define mxuser_stats 0
+#endif
+
 /*
  * A portable recursive lock.
  */
@@ -439,15 +451,16 @@ MXUserCastedThreadID(void)
  */
 
 typedef enum {
-   MXUSER_TYPE_NEVER_USE  = 0,
-   MXUSER_TYPE_RW         = 1,
-   MXUSER_TYPE_REC        = 2,
-   MXUSER_TYPE_RANK       = 3,
-   MXUSER_TYPE_EXCL       = 4,
-   MXUSER_TYPE_SEMA       = 5,
-   MXUSER_TYPE_CONDVAR    = 6,
-   MXUSER_TYPE_BARRIER    = 7,
-   MXUSER_TYPE_EVENT      = 8
+   MXUSER_TYPE_NEVER_USE   = 0,
+   MXUSER_TYPE_RW          = 1,
+   MXUSER_TYPE_REC         = 2,
+   MXUSER_TYPE_RANK        = 3,
+   MXUSER_TYPE_EXCL        = 4,
+   MXUSER_TYPE_SEMA        = 5,
+   MXUSER_TYPE_CONDVAR     = 6,
+   MXUSER_TYPE_BARRIER     = 7,
+   MXUSER_TYPE_EVENT       = 8,
+   MXUSER_TYPE_READ_MOSTLY = 9
 } MXUserObjectType;
 
 /*
@@ -466,6 +479,8 @@ typedef struct MXUserHeader {
 
    void       (*dumpFunc)(struct MXUserHeader *);
    void       (*statsFunc)(struct MXUserHeader *);
+   Atomic_Ptr  *acquireStatsMem;  // Statistics of the lock, if it has any
+   Atomic_Ptr  *heldStatsMem;
    ListItem     item;
 } MXUserHeader;
 
@@ -548,6 +563,7 @@ typedef struct {
    uint64            numSuccessesContended;
    uint64            successContentionTime;
    uint64            totalContentionTime;
+   uint64            waitHisto[MXUSER_WAIT_HISTO_BUCKETS];
 
    MXUserBasicStats  basicStats;
 } MXUserAcquisitionStats;
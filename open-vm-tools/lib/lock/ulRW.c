@@ -433,22 +433,23 @@ MXUser_CreateRWLock(const char *userName,  // IN:
                                           HASH_INT_KEY | HASH_FLAG_ATOMIC,
                                           MXUserFreeHashEntry);
 
+      lock->header.statsFunc = MXUserStatsActionRW;
+      lock->header.acquireStatsMem = &lock->acquireStatsMem;
+      lock->header.heldStatsMem = &lock->heldStatsMem;
+
       statsMode = MXUserStatsMode();
 
       switch (MXUserStatsMode()) {
       case 0:
          MXUserDisableStats(&lock->acquireStatsMem, &lock->heldStatsMem);
-         lock->header.statsFunc = NULL;
          break;
 
       case 1:
          MXUserEnableStats(&lock->acquireStatsMem, NULL);
-         lock->header.statsFunc = MXUserStatsActionRW;
          break;
 
       case 2:
          MXUserEnableStats(&lock->acquireStatsMem, &lock->heldStatsMem);
-         lock->header.statsFunc = MXUserStatsActionRW;
          break;
 
       default:
@@ -505,7 +506,7 @@ MXUser_DestroyRWLock(MXUserRWLock *lock)  // IN:
 
       MXUserRemoveFromList(&lock->header);
 
-      if (vmx86_stats) {
+      if (mxuser_stats) {
          MXUserDisableStats(&lock->acquireStatsMem, &lock->heldStatsMem);
       }
 
@@ -600,7 +601,7 @@ MXUserAcquisition(MXUserRWLock *lock,  // IN/OUT:
                                                                    "Write");
    }
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       VmTimeType value;
       MXUserAcquireStats *acquireStats;
 
@@ -804,7 +805,7 @@ MXUser_ReleaseRWLock(MXUserRWLock *lock)  // IN/OUT:
 
    myContext = MXUserGetHolderContext(lock);
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       MXUserHeldStats *heldStats = Atomic_ReadPtr(&lock->heldStatsMem);
 
       if (UNLIKELY(heldStats != NULL)) {
@@ -0,0 +1,583 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * ulReadMostly.c --
+ *
+ *      A read-write lock for data that is read far more often than it is
+ *      written.
+ *
+ *      Readers don't touch any shared state other than one of several
+ *      reader counts ("stripes"), each on its own cache line, picked by
+ *      thread ID. There is no per-thread holder tracking and no statistics
+ *      on the read side, so a read acquisition costs two atomic operations
+ *      when no writer is around.
+ *
+ *      Writers serialize on a recursive lock, raise the writer flag and wait
+ *      for the reader counts to drain. A reader that finds the writer flag
+ *      raised takes its count back and blocks on the writer lock until the
+ *      writer is done.
+ *
+ *      With writer preference, a writer raises the flag right away, so new
+ *      readers wait behind it. Without it, a writer only keeps the flag when
+ *      no reader is inside; otherwise it lowers the flag, lets the readers
+ *      through and tries again later. Writers may then starve under a
+ *      steady stream of readers.
+ *
+ *      Read acquisitions aren't recursive: a reader that acquires again
+ *      while a writer with preference waits deadlocks.
+ */
+
+#include "vmware.h"
+#include "str.h"
+#include "util.h"
+#include "userlock.h"
+#include "hostinfo.h"
+#include "vm_basic_asm.h"
+#include "ulInt.h"
+
+#define MXUSER_RM_STRIPE_BITS   4
+#define MXUSER_RM_STRIPES       (1 << MXUSER_RM_STRIPE_BITS)
+#define MXUSER_RM_SPINS         1000  // PAUSEs before a writer sleeps
+#define MXUSER_RM_SLEEP_US      50
+
+typedef struct {
+   Atomic_uint32  count;
+   uint8          pad[CACHELINE_SIZE - sizeof (Atomic_uint32)];
+} MXUserReadMostlyStripe;
+
+struct MXUserReadMostlyLock
+{
+   MXUserHeader            header;
+   Bool                    writerPreference;
+   MXRecLock               writerLock;
+   Atomic_Ptr              heldStatsMem;
+   Atomic_Ptr              acquireStatsMem;
+   uint8                   pad[CACHELINE_SIZE];
+   Atomic_uint32           writerActive;
+   uint8                   pad2[CACHELINE_SIZE - sizeof (Atomic_uint32)];
+   MXUserReadMostlyStripe  readers[MXUSER_RM_STRIPES];
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserReadMostlyStripeCount --
+ *
+ *      Return the reader count of the calling thread.
+ *
+ * Results:
+ *      As above.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE Atomic_uint32 *
+MXUserReadMostlyStripeCount(MXUserReadMostlyLock *lock)  // IN:
+{
+   uint64 id = (uint64) (uintptr_t) MXUserNativeThreadID();
+
+   /* Native thread IDs are often addresses; the high bits of a product mix. */
+   return &lock->readers[(id * CONST64U(0x9E3779B97F4A7C15)) >>
+                         (64 - MXUSER_RM_STRIPE_BITS)].count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserReadMostlyHasReaders --
+ *
+ *      Are there readers inside the lock?
+ *
+ * Results:
+ *      TRUE    Yes
+ *      FALSE   No
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+MXUserReadMostlyHasReaders(MXUserReadMostlyLock *lock)  // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < MXUSER_RM_STRIPES; i++) {
+      if (Atomic_Read(&lock->readers[i].count) != 0) {
+         return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserReadMostlyBackoff --
+ *
+ *      Wait a little for readers to leave the lock: spin for a while, then
+ *      sleep.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the spin count.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+MXUserReadMostlyBackoff(uint32 *spins)  // IN/OUT:
+{
+   if (*spins < MXUSER_RM_SPINS) {
+      (*spins)++;
+      PAUSE();
+   } else {
+      Util_Usleep(MXUSER_RM_SLEEP_US);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserStatsActionReadMostly --
+ *
+ *      Perform the statistics action for the specified lock. Only write
+ *      acquisitions have statistics.
+ *
+ * Results:
+ *      As above.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+MXUserStatsActionReadMostly(MXUserHeader *header)  // IN:
+{
+   MXUserReadMostlyLock *lock = (MXUserReadMostlyLock *) header;
+   MXUserHeldStats *heldStats = Atomic_ReadPtr(&lock->heldStatsMem);
+   MXUserAcquireStats *acquireStats = Atomic_ReadPtr(&lock->acquireStatsMem);
+
+   if (UNLIKELY(heldStats != NULL)) {
+      MXUserDumpBasicStats(&heldStats->data, header);
+   }
+
+   if (LIKELY(acquireStats != NULL)) {
+      Bool isHot;
+      Bool doLog;
+      double contentionRatio;
+
+      MXUserDumpAcquisitionStats(&acquireStats->data, header);
+
+      MXUserKitchen(&acquireStats->data, &contentionRatio, &isHot, &doLog);
+
+      if (UNLIKELY(isHot) && doLog) {
+         Log("HOT LOCK (%s); contention ratio %f\n",
+             lock->header.name, contentionRatio);
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserDumpReadMostlyLock --
+ *
+ *      Dump a read-mostly lock.
+ *
+ * Results:
+ *      A dump.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+MXUserDumpReadMostlyLock(MXUserHeader *header)  // IN:
+{
+   MXUserReadMostlyLock *lock = (MXUserReadMostlyLock *) header;
+   uint32 i;
+
+   Warning("%s: Read-mostly lock @ %p\n", __FUNCTION__, lock);
+
+   Warning("\tsignature 0x%X\n", lock->header.signature);
+   Warning("\tname %s\n", lock->header.name);
+   Warning("\trank 0x%X\n", lock->header.rank);
+   Warning("\tserial number %u\n", lock->header.bits.serialNumber);
+
+   Warning("\twriter preference %d\n", lock->writerPreference);
+   Warning("\twriter active %u\n", Atomic_Read(&lock->writerActive));
+   Warning("\twriter lock count %d\n", MXRecLockCount(&lock->writerLock));
+
+   for (i = 0; i < MXUSER_RM_STRIPES; i++) {
+      Warning("\treaders[%u] %u\n", i, Atomic_Read(&lock->readers[i].count));
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_CreateReadMostlyLock --
+ *
+ *      Create a read-mostly lock.
+ *
+ * Results:
+ *      A pointer to a read-mostly lock.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+MXUserReadMostlyLock *
+MXUser_CreateReadMostlyLock(const char *userName,   // IN:
+                            MX_Rank rank,           // IN:
+                            Bool writerPreference)  // IN:
+{
+   uint32 statsMode;
+   char *properName;
+   MXUserReadMostlyLock *lock = Util_SafeCalloc(1, sizeof *lock);
+
+   if (userName == NULL) {
+      properName = Str_SafeAsprintf(NULL, "RM-%p", GetReturnAddress());
+   } else {
+      properName = Util_SafeStrdup(userName);
+   }
+
+   if (UNLIKELY(!MXRecLockInit(&lock->writerLock))) {
+      Panic("%s: native lock initialization routine failed\n", __FUNCTION__);
+   }
+
+   lock->writerPreference = writerPreference;
+
+   lock->header.signature = MXUserGetSignature(MXUSER_TYPE_READ_MOSTLY);
+   lock->header.name = properName;
+   lock->header.rank = rank;
+   lock->header.bits.serialNumber = MXUserAllocSerialNumber();
+   lock->header.dumpFunc = MXUserDumpReadMostlyLock;
+
+   lock->header.statsFunc = MXUserStatsActionReadMostly;
+   lock->header.acquireStatsMem = &lock->acquireStatsMem;
+   lock->header.heldStatsMem = &lock->heldStatsMem;
+
+   statsMode = MXUserStatsMode();
+
+   switch (statsMode) {
+   case 0:
+      MXUserDisableStats(&lock->acquireStatsMem, &lock->heldStatsMem);
+      break;
+
+   case 1:
+      MXUserEnableStats(&lock->acquireStatsMem, NULL);
+      break;
+
+   case 2:
+      MXUserEnableStats(&lock->acquireStatsMem, &lock->heldStatsMem);
+      break;
+
+   default:
+      Panic("%s: unknown stats mode: %d!\n", __FUNCTION__, statsMode);
+   }
+
+   MXUserAddToList(&lock->header);
+
+   return lock;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_DestroyReadMostlyLock --
+ *
+ *      Destroy a read-mostly lock.
+ *
+ * Results:
+ *      Lock is destroyed. Don't use the pointer again.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+MXUser_DestroyReadMostlyLock(MXUserReadMostlyLock *lock)  // IN:
+{
+   if (lock != NULL) {
+      MXUserValidateHeader(&lock->header, MXUSER_TYPE_READ_MOSTLY);
+
+      if (MXRecLockCount(&lock->writerLock) > 0 ||
+          MXUserReadMostlyHasReaders(lock)) {
+         MXUserDumpAndPanic(&lock->header,
+                            "%s: Destroy of an acquired read-mostly lock\n",
+                            __FUNCTION__);
+      }
+
+      MXRecLockDestroy(&lock->writerLock);
+
+      MXUserRemoveFromList(&lock->header);
+
+      if (mxuser_stats) {
+         MXUserDisableStats(&lock->acquireStatsMem, &lock->heldStatsMem);
+      }
+
+      lock->header.signature = 0;  // just in case...
+      free(lock->header.name);
+      lock->header.name = NULL;
+      free(lock);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_AcquireReadMostlyForRead --
+ *
+ *      Acquire a read-mostly lock for read. Must be paired with
+ *      MXUser_ReleaseReadMostlyForRead.
+ *
+ * Results:
+ *      The lock is acquired (locked) for read.
+ *
+ * Side effects:
+ *      May wait for a writer.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+MXUser_AcquireReadMostlyForRead(MXUserReadMostlyLock *lock)  // IN/OUT:
+{
+   Atomic_uint32 *count;
+
+   ASSERT(lock);
+   MXUserValidateHeader(&lock->header, MXUSER_TYPE_READ_MOSTLY);
+
+   MXUserAcquisitionTracking(&lock->header, TRUE);
+
+   count = MXUserReadMostlyStripeCount(lock);
+
+   while (TRUE) {
+      /*
+       * The increment is a full barrier: either the writer sees this count
+       * or this reader sees the writer flag.
+       */
+
+      Atomic_Inc(count);
+
+      if (LIKELY(Atomic_Read(&lock->writerActive) == 0)) {
+         break;
+      }
+
+      Atomic_Dec(count);
+
+      /* The writer holds the writer lock for as long as its flag is up. */
+      MXRecLockAcquire(&lock->writerLock,
+                       NULL);  // non-stats
+      MXRecLockRelease(&lock->writerLock);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_ReleaseReadMostlyForRead --
+ *
+ *      Release a read-mostly lock acquired for read.
+ *
+ * Results:
+ *      The lock is released.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+MXUser_ReleaseReadMostlyForRead(MXUserReadMostlyLock *lock)  // IN/OUT:
+{
+   Atomic_uint32 *count;
+
+   ASSERT(lock);
+   MXUserValidateHeader(&lock->header, MXUSER_TYPE_READ_MOSTLY);
+
+   count = MXUserReadMostlyStripeCount(lock);
+
+   if (vmx86_debug && Atomic_Read(count) == 0) {
+      MXUserDumpAndPanic(&lock->header,
+                         "%s: Release of an unacquired read-mostly lock\n",
+                         __FUNCTION__);
+   }
+
+   MXUserReleaseTracking(&lock->header);
+
+   Atomic_Dec(count);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_AcquireReadMostlyForWrite --
+ *
+ *      Acquire a read-mostly lock for write. Must be paired with
+ *      MXUser_ReleaseReadMostlyForWrite.
+ *
+ * Results:
+ *      The lock is acquired (locked) for write.
+ *
+ * Side effects:
+ *      Waits for the readers inside the lock to leave.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+MXUser_AcquireReadMostlyForWrite(MXUserReadMostlyLock *lock)  // IN/OUT:
+{
+   uint32 spins = 0;
+   VmTimeType begin = 0;
+   MXUserAcquireStats *acquireStats = NULL;
+
+   ASSERT(lock);
+   MXUserValidateHeader(&lock->header, MXUSER_TYPE_READ_MOSTLY);
+
+   MXUserAcquisitionTracking(&lock->header, TRUE);
+
+   if (mxuser_stats) {
+      acquireStats = Atomic_ReadPtr(&lock->acquireStatsMem);
+
+      if (UNLIKELY(acquireStats != NULL)) {
+         begin = Hostinfo_SystemTimerNS();
+      }
+   }
+
+   while (TRUE) {
+      MXRecLockAcquire(&lock->writerLock,
+                       NULL);  // non-stats
+
+      if (vmx86_debug && (MXRecLockCount(&lock->writerLock) > 1)) {
+         MXUserDumpAndPanic(&lock->header,
+                            "%s: Acquire on an acquired read-mostly lock\n",
+                            __FUNCTION__);
+      }
+
+      /* Exchange rather than write: the flag must be seen before the counts. */
+      Atomic_ReadWrite(&lock->writerActive, 1);
+
+      if (lock->writerPreference) {
+         while (MXUserReadMostlyHasReaders(lock)) {
+            MXUserReadMostlyBackoff(&spins);
+         }
+         break;
+      }
+
+      if (!MXUserReadMostlyHasReaders(lock)) {
+         break;
+      }
+
+      /* Let the readers through, including those that just backed off. */
+      Atomic_ReadWrite(&lock->writerActive, 0);
+      MXRecLockRelease(&lock->writerLock);
+
+      MXUserReadMostlyBackoff(&spins);
+   }
+
+   if (UNLIKELY(acquireStats != NULL)) {
+      VmTimeType value = Hostinfo_SystemTimerNS() - begin;
+      MXUserHeldStats *heldStats;
+
+      MXUserAcquisitionSample(&acquireStats->data, TRUE,
+                            value > acquireStats->data.contentionDurationFloor,
+                              value);
+
+      heldStats = Atomic_ReadPtr(&lock->heldStatsMem);
+
+      if (UNLIKELY(heldStats != NULL)) {
+         heldStats->holdStart = Hostinfo_SystemTimerNS();
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_ReleaseReadMostlyForWrite --
+ *
+ *      Release a read-mostly lock acquired for write.
+ *
+ * Results:
+ *      The lock is released.
+ *
+ * Side effects:
+ *      Lets waiting readers in.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+MXUser_ReleaseReadMostlyForWrite(MXUserReadMostlyLock *lock)  // IN/OUT:
+{
+   ASSERT(lock);
+   MXUserValidateHeader(&lock->header, MXUSER_TYPE_READ_MOSTLY);
+
+   if (mxuser_stats) {
+      MXUserHeldStats *heldStats = Atomic_ReadPtr(&lock->heldStatsMem);
+
+      if (UNLIKELY(heldStats != NULL)) {
+         MXUserBasicStatsSample(&heldStats->data,
+                                Hostinfo_SystemTimerNS() - heldStats->holdStart);
+      }
+   }
+
+   if (vmx86_debug && !MXRecLockIsOwner(&lock->writerLock)) {
+      MXUserDumpAndPanic(&lock->header,
+                         "%s: Non-owner release of a read-mostly lock\n",
+                         __FUNCTION__);
+   }
+
+   MXUserReleaseTracking(&lock->header);
+
+   /* Exchange rather than write: the updates must be seen before the flag. */
+   Atomic_ReadWrite(&lock->writerActive, 0);
+   MXRecLockRelease(&lock->writerLock);
+}
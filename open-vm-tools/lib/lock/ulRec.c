@@ -143,12 +143,12 @@ MXUser_EnableStatsRecLock(MXUserRecLock *lock,        // IN/OUT:
    ASSERT(lock);
    MXUserValidateHeader(&lock->header, MXUSER_TYPE_REC);
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       MXUserEnableStats(trackAcquisitionTime ? &lock->acquireStatsMem : NULL,
                         trackHeldTime        ? &lock->heldStatsMem    : NULL);
    }
 
-   return vmx86_stats;
+   return mxuser_stats;
 }
 
 
@@ -175,11 +175,11 @@ MXUser_DisableStatsRecLock(MXUserRecLock *lock)  // IN/OUT:
    ASSERT(lock);
    MXUserValidateHeader(&lock->header, MXUSER_TYPE_REC);
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       MXUserDisableStats(&lock->acquireStatsMem, &lock->heldStatsMem);
    }
 
-   return vmx86_stats;
+   return mxuser_stats;
 }
 
 
@@ -209,7 +209,7 @@ MXUser_SetContentionRatioFloorRecLock(MXUserRecLock *lock,  // IN/OUT:
    ASSERT(lock);
    MXUserValidateHeader(&lock->header, MXUSER_TYPE_REC);
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       result = MXUserSetContentionRatioFloor(&lock->acquireStatsMem, ratio);
    } else {
       result = FALSE;
@@ -245,7 +245,7 @@ MXUser_SetContentionCountFloorRecLock(MXUserRecLock *lock,  // IN/OUT:
    ASSERT(lock);
    MXUserValidateHeader(&lock->header, MXUSER_TYPE_REC);
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       result = MXUserSetContentionCountFloor(&lock->acquireStatsMem, count);
    } else {
       result = FALSE;
@@ -281,7 +281,7 @@ MXUser_SetContentionDurationFloorRecLock(MXUserRecLock *lock,  // IN/OUT:
    ASSERT(lock);
    MXUserValidateHeader(&lock->header, MXUSER_TYPE_REC);
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       result = MXUserSetContentionDurationFloor(&lock->acquireStatsMem,
                                                 duration);
    } else {
@@ -378,22 +378,23 @@ MXUser_CreateRecLock(const char *userName,  // IN:
    lock->header.bits.serialNumber = MXUserAllocSerialNumber();
    lock->header.dumpFunc = MXUserDumpRecLock;
 
+   lock->header.statsFunc = MXUserStatsActionRec;
+   lock->header.acquireStatsMem = &lock->acquireStatsMem;
+   lock->header.heldStatsMem = &lock->heldStatsMem;
+
    statsMode = MXUserStatsMode();
 
    switch (statsMode) {
    case 0:
       MXUserDisableStats(&lock->acquireStatsMem, &lock->heldStatsMem);
-      lock->header.statsFunc = NULL;
       break;
 
    case 1:
       MXUserEnableStats(&lock->acquireStatsMem, NULL);
-      lock->header.statsFunc = MXUserStatsActionRec;
       break;
 
    case 2:
       MXUserEnableStats(&lock->acquireStatsMem, &lock->heldStatsMem);
-      lock->header.statsFunc = MXUserStatsActionRec;
       break;
 
    default:
@@ -446,7 +447,7 @@ MXUserCondDestroyRecLock(MXUserRecLock *lock)  // IN:
 
          MXUserRemoveFromList(&lock->header);
 
-         if (vmx86_stats) {
+         if (mxuser_stats) {
             MXUserDisableStats(&lock->acquireStatsMem, &lock->heldStatsMem);
          }
       }
@@ -499,7 +500,7 @@ MXUser_AcquireRecLock(MXUserRecLock *lock)  // IN/OUT:
       /* Rank checking is only done on the first acquisition */
       MXUserAcquisitionTracking(&lock->header, TRUE);
 
-      if (vmx86_stats) {
+      if (mxuser_stats) {
          VmTimeType value = 0;
          MXUserAcquireStats *acquireStats;
 
@@ -565,7 +566,7 @@ MXUser_ReleaseRecLock(MXUserRecLock *lock)  // IN/OUT:
       ASSERT(MXUserMX_UnlockRec);
       (*MXUserMX_UnlockRec)(lock->vmmLock);
    } else {
-      if (vmx86_stats) {
+      if (mxuser_stats) {
          MXUserHeldStats *heldStats = Atomic_ReadPtr(&lock->heldStatsMem);
 
          if (LIKELY(heldStats != NULL)) {
@@ -658,7 +659,7 @@ MXUser_TryAcquireRecLock(MXUserRecLock *lock)  // IN/OUT:
          MXUserAcquisitionTracking(&lock->header, FALSE);
       }
 
-      if (vmx86_stats) {
+      if (mxuser_stats) {
          MXUserAcquireStats *acquireStats;
 
          acquireStats = Atomic_ReadPtr(&lock->acquireStatsMem);
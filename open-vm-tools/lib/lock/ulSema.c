@@ -467,18 +467,19 @@ MXUser_CreateSemaphore(const char *userName,  // IN:
       sema->header.bits.serialNumber = MXUserAllocSerialNumber();
       sema->header.dumpFunc = MXUserDumpSemaphore;
 
+      sema->header.statsFunc = MXUserStatsActionSema;
+      sema->header.acquireStatsMem = &sema->acquireStatsMem;
+
       statsMode = MXUserStatsMode();
 
       switch (MXUserStatsMode()) {
       case 0:
          MXUserDisableStats(&sema->acquireStatsMem, NULL);
-         sema->header.statsFunc = NULL;
          break;
 
       case 1:
       case 2:
          MXUserEnableStats(&sema->acquireStatsMem, NULL);
-         sema->header.statsFunc = MXUserStatsActionSema;
          break;
 
       default:
@@ -535,7 +536,7 @@ MXUser_DestroySemaphore(MXUserSemaphore *sema)  // IN/OUT:
 
       MXUserRemoveFromList(&sema->header);
 
-      if (vmx86_stats) {
+      if (mxuser_stats) {
          MXUserAcquireStats *acquireStats;
 
          acquireStats = Atomic_ReadPtr(&sema->acquireStatsMem);
@@ -585,7 +586,7 @@ MXUser_DownSemaphore(MXUserSemaphore *sema)  // IN/OUT:
 
    MXUserAcquisitionTracking(&sema->header, TRUE);  // rank checking
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       VmTimeType start = 0;
       Bool tryDownSuccess = FALSE;
       MXUserAcquireStats *acquireStats;
@@ -665,7 +666,7 @@ MXUser_TimedDownSemaphore(MXUserSemaphore *sema,  // IN/OUT:
 
    MXUserAcquisitionTracking(&sema->header, TRUE);  // rank checking
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       VmTimeType start = 0;
       Bool tryDownSuccess = FALSE;
       MXUserAcquireStats *acquireStats;
@@ -758,7 +759,7 @@ MXUser_TryDownSemaphore(MXUserSemaphore *sema)  // IN/OUT:
                          __FUNCTION__, err);
    }
 
-   if (vmx86_stats) {
+   if (mxuser_stats) {
       MXUserAcquireStats *acquireStats;
 
       acquireStats = Atomic_ReadPtr(&sema->acquireStatsMem);
@@ -648,6 +648,7 @@ MXUserAcquisitionStatsSetUp(MXUserAcquisitionStats *stats)  // IN/OUT:
    stats->numSuccessesContended = 0;
    stats->totalContentionTime = 0;
    stats->successContentionTime = 0;
+   memset(stats->waitHisto, 0, sizeof stats->waitHisto);
 }
 
 
@@ -679,9 +680,19 @@ MXUserAcquisitionSample(MXUserAcquisitionStats *stats,  // IN/OUT:
       stats->numSuccesses++;
 
       if (wasContended) {
+         uint64 limit = 1000;  // 1 usec
+         uint32 i = 0;
+
          stats->numSuccessesContended++;
          stats->totalContentionTime += elapsedTime;
          stats->successContentionTime += elapsedTime;
+
+         while (i < MXUSER_WAIT_HISTO_BUCKETS - 1 && elapsedTime >= limit) {
+            limit *= 10;
+            i++;
+         }
+
+         stats->waitHisto[i]++;
       }
 
       MXUserBasicStatsSample(&stats->basicStats, elapsedTime);
@@ -995,7 +1006,7 @@ MXUserForceHeldHisto(Atomic_Ptr *mem,  // IN/OUT:
 uint32
 MXUserStatsMode(void)
 {
-   if (vmx86_stats && (mxUserStatsFunc != NULL) && (mxUserMaxLineLength > 0)) {
+   if (mxuser_stats && (mxUserStatsFunc != NULL) && (mxUserMaxLineLength > 0)) {
       return mxUserTrackHeldTimes ? 2 : 1;
    } else {
       return 0;
@@ -1031,10 +1042,11 @@ MXUser_SetStatsFunc(void *context,                    // IN:
                                       const char *fmt,
                                       va_list ap))
 {
-   ASSERT(maxLineLength >= 1024);   // assert a rational minimum
+   ASSERT(statsFunc == NULL || maxLineLength >= 1024);  // a rational minimum
 
    free(mxUserHistoLine);
-   mxUserHistoLine = Util_SafeMalloc(maxLineLength);
+   mxUserHistoLine = (maxLineLength == 0) ? NULL :
+                                            Util_SafeMalloc(maxLineLength);
 
    mxUserStatsContext = context;
    mxUserMaxLineLength = maxLineLength;
@@ -1112,6 +1124,135 @@ MXUser_PerLockData(void)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_EnableStatsAllLocks --
+ *
+ *      Start statistics collection on the locks that were created before
+ *      statistics were established by MXUser_SetStatsFunc, as appropriate
+ *      for the current statistics mode. Locks created from now on collect
+ *      statistics on their own.
+ *
+ *      Statistics can't be taken away from a live lock safely, so they
+ *      are never disabled here; locks stop collecting when they are
+ *      destroyed.
+ *
+ * Results:
+ *      As above.
+ *
+ * Side effects:
+ *      Memory is allocated.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+MXUser_EnableStatsAllLocks(void)
+{
+   uint32 statsMode = MXUserStatsMode();
+   MXRecLock *listLock = MXUserInternalSingleton(&mxLockMemPtr);
+   ListItem *entry;
+
+   if (statsMode == 0 || listLock == NULL) {
+      return;
+   }
+
+   MXRecLockAcquire(listLock,
+                    NULL);  // non-stats
+
+   CIRC_LIST_SCAN(entry, mxUserLockList) {
+      MXUserHeader *header = CIRC_LIST_CONTAINER(entry, MXUserHeader, item);
+
+      if (header->acquireStatsMem != NULL) {
+         MXUserEnableStats(header->acquireStatsMem,
+                           (statsMode == 2) ? header->heldStatsMem : NULL);
+      }
+   }
+
+   MXRecLockRelease(listLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_ForEachLockStats --
+ *
+ *      Call the specified function with the statistics of each lock that
+ *      has some. As with MXUser_PerLockData, the locks are active so the
+ *      data is approximate.
+ *
+ *      The callback runs with the list of locks locked; it must not create
+ *      or destroy locks. The statistics, including the name, are only
+ *      valid during the callback.
+ *
+ * Results:
+ *      As above.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+MXUser_ForEachLockStats(void (*cb)(void *clientData,                // IN:
+                                   const MXUserLockStats *stats),
+                        void *clientData)                           // IN:
+{
+   MXRecLock *listLock = MXUserInternalSingleton(&mxLockMemPtr);
+   ListItem *entry;
+
+   ASSERT(cb);
+
+   if (listLock == NULL) {
+      return;
+   }
+
+   MXRecLockAcquire(listLock,
+                    NULL);  // non-stats
+
+   CIRC_LIST_SCAN(entry, mxUserLockList) {
+      MXUserHeader *header = CIRC_LIST_CONTAINER(entry, MXUserHeader, item);
+      MXUserAcquireStats *acquireStats;
+      MXUserHeldStats *heldStats;
+      MXUserLockStats stats;
+
+      acquireStats = (header->acquireStatsMem == NULL) ? NULL :
+                                      Atomic_ReadPtr(header->acquireStatsMem);
+
+      if (acquireStats == NULL || acquireStats->data.numAttempts == 0) {
+         continue;
+      }
+
+      memset(&stats, 0, sizeof stats);
+      stats.name = header->name;
+      stats.serialNumber = header->bits.serialNumber;
+      stats.numAttempts = acquireStats->data.numAttempts;
+      stats.numSuccesses = acquireStats->data.numSuccesses;
+      stats.numContended = acquireStats->data.numSuccessesContended;
+      stats.contentionTime = acquireStats->data.successContentionTime;
+      stats.maxWaitTime = acquireStats->data.basicStats.maxTime;
+      memcpy(stats.waitHisto, acquireStats->data.waitHisto,
+             sizeof stats.waitHisto);
+
+      heldStats = (header->heldStatsMem == NULL) ? NULL :
+                                         Atomic_ReadPtr(header->heldStatsMem);
+
+      if (heldStats != NULL) {
+         stats.numHeld = heldStats->data.numSamples;
+         stats.heldTime = heldStats->data.timeSum;
+         stats.maxHeldTime = heldStats->data.maxTime;
+      }
+
+      (*cb)(clientData, &stats);
+   }
+
+   MXRecLockRelease(listLock);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
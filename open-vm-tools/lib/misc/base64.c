@@ -174,6 +174,446 @@ static const signed char base64Reverse[256] = {
    characters followed by one "=" padding character.
 */
 
+/*
+ * Vector implementations of the bulk of the encoding and decoding: AVX2 on
+ * x86, used when the CPU supports it, and NEON on 64-bit ARM, where it is
+ * always available. They handle whole blocks of input; the tail, and on
+ * decoding any block holding whitespace, padding or illegal characters, go
+ * through the scalar code, so the results are the same.
+ */
+#if !defined(VMKERNEL) && defined(__GNUC__) && \
+    (__GNUC__ >= 5 || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define BASE64_USE_AVX2
+#elif !defined(VMKERNEL) && defined(__aarch64__) && defined(__ARM_NEON)
+#define BASE64_USE_NEON
+#endif
+
+#if defined(BASE64_USE_AVX2)
+
+#include <immintrin.h>
+
+#define BASE64_AVX2_TARGET __attribute__((target("avx2")))
+
+/* Bytes of input consumed per block, and bytes read. */
+#define BASE64_ENCODE_BLOCK      24
+#define BASE64_ENCODE_READ       28
+/* Characters of input consumed per block, and bytes written. */
+#define BASE64_DECODE_BLOCK      32
+#define BASE64_DECODE_WRITE      32
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Base64HaveVector --
+ *
+ *      Checks whether the CPU (and OS) support AVX2.
+ *
+ * Results:
+ *      TRUE if the vector code can be used.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static INLINE Bool
+Base64HaveVector(void)
+{
+   static int useAVX2 = -1;
+
+   /* This is safe even if multiple threads race here. */
+   if (useAVX2 == -1) {
+      __builtin_cpu_init();
+      useAVX2 = __builtin_cpu_supports("avx2") != 0;
+   }
+
+   return useAVX2;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Base64EncodeBlocks --
+ *
+ *      Encodes 24-byte blocks of src into 32 characters each, as long as
+ *      there are at least 28 bytes left to read.
+ *
+ * Results:
+ *      The number of bytes of src encoded (a multiple of 24).
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static BASE64_AVX2_TARGET size_t
+Base64EncodeBlocks(uint8 const *src,  // IN:
+                   size_t srcSize,    // IN:
+                   char *dst)         // OUT:
+{
+   /* Each 32-bit lane gets bytes 1 0 2 1 of a 3-byte group. */
+   const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+                                           7, 6, 8, 7, 10, 9, 11, 10,
+                                           1, 0, 2, 1, 4, 3, 5, 4,
+                                           7, 6, 8, 7, 10, 9, 11, 10);
+   /* Offset from a 6-bit value to its character, by range (see below). */
+   const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '+' - 62,
+                                            '/' - 63, 'A', 0, 0,
+                                            'a' - 26, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '+' - 62,
+                                            '/' - 63, 'A', 0, 0);
+   size_t done = 0;
+
+   while (srcSize - done >= BASE64_ENCODE_READ) {
+      __m256i in;
+      __m256i hi;
+      __m256i lo;
+      __m256i idx;
+      __m256i range;
+
+      in = _mm256_inserti128_si256(
+              _mm256_castsi128_si256(
+                 _mm_loadu_si128((const __m128i *)(src + done))),
+              _mm_loadu_si128((const __m128i *)(src + done + 12)), 1);
+      in = _mm256_shuffle_epi8(in, spread);
+
+      /* Move the four 6-bit fields of each lane into their own bytes. */
+      hi = _mm256_mulhi_epu16(_mm256_and_si256(in,
+                                               _mm256_set1_epi32(0x0fc0fc00)),
+                              _mm256_set1_epi32(0x04000040));
+      lo = _mm256_mullo_epi16(_mm256_and_si256(in,
+                                               _mm256_set1_epi32(0x003f03f0)),
+                              _mm256_set1_epi32(0x01000010));
+      idx = _mm256_or_si256(hi, lo);
+
+      /*
+       * Range: 13 for A-Z, 0 for a-z, 1-10 for the digits, 11 for '+' and 12
+       * for '/'.
+       */
+      range = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+      range = _mm256_or_si256(range,
+                 _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx),
+                                  _mm256_set1_epi8(13)));
+
+      _mm256_storeu_si256((__m256i *)(dst + done / 3 * 4),
+                          _mm256_add_epi8(idx, _mm256_shuffle_epi8(offsets,
+                                                                   range)));
+      done += BASE64_ENCODE_BLOCK;
+   }
+
+   return done;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Base64DecodeBlocks --
+ *
+ *      Decodes 32-character blocks of in into 24 bytes each, as long as
+ *      there are at least 32 bytes of room in out, and stops at the first
+ *      block with characters outside of the base64 alphabet (whitespace,
+ *      padding, ...).
+ *
+ * Results:
+ *      The number of characters of in decoded (a multiple of 32).
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static BASE64_AVX2_TARGET size_t
+Base64DecodeBlocks(char const *in,   // IN:
+                   size_t inSize,    // IN:
+                   uint8 *out,       // OUT:
+                   size_t outSize)   // IN:
+{
+   /*
+    * Character classes by low and high nibble; a character is in the
+    * alphabet if its two classes have no bit in common.
+    */
+   const __m256i classLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A,
+                                            0x1B, 0x1B, 0x1B, 0x1A,
+                                            0x15, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A,
+                                            0x1B, 0x1B, 0x1B, 0x1A);
+   const __m256i classHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02,
+                                            0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02,
+                                            0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x10, 0x10);
+   /* Offset from a character to its value, by high nibble ('/' is 1). */
+   const __m256i offsets = _mm256_setr_epi8(0, 63 - '/', 62 - '+', 52 - '0',
+                                            -'A', -'A', 26 - 'a', 26 - 'a',
+                                            0, 0, 0, 0, 0, 0, 0, 0,
+                                            0, 63 - '/', 62 - '+', 52 - '0',
+                                            -'A', -'A', 26 - 'a', 26 - 'a',
+                                            0, 0, 0, 0, 0, 0, 0, 0);
+   /* Packs the 3 bytes of each lane, then the 12 bytes of each half. */
+   const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9,
+                                         8, 14, 13, 12, -1, -1, -1, -1,
+                                         2, 1, 0, 6, 5, 4, 10, 9,
+                                         8, 14, 13, 12, -1, -1, -1, -1);
+   const __m256i gather = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+   const __m256i nibble = _mm256_set1_epi8(0x0f);
+   size_t done = 0;
+   size_t written = 0;
+
+   while (inSize - done >= BASE64_DECODE_BLOCK &&
+          outSize - written >= BASE64_DECODE_WRITE) {
+      __m256i str = _mm256_loadu_si256((const __m256i *)(in + done));
+      __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), nibble);
+      __m256i loNibbles = _mm256_and_si256(str, nibble);
+      __m256i slash;
+      __m256i values;
+
+      if (!_mm256_testz_si256(_mm256_shuffle_epi8(classLo, loNibbles),
+                              _mm256_shuffle_epi8(classHi, hiNibbles))) {
+         break;
+      }
+
+      slash = _mm256_cmpeq_epi8(str, _mm256_set1_epi8('/'));
+      values = _mm256_add_epi8(str,
+                  _mm256_shuffle_epi8(offsets,
+                                      _mm256_add_epi8(slash, hiNibbles)));
+
+      /* Merge the 6-bit values into 24 bits per lane, then pack. */
+      values = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+      values = _mm256_madd_epi16(values, _mm256_set1_epi32(0x00011000));
+      values = _mm256_shuffle_epi8(values, pack);
+      values = _mm256_permutevar8x32_epi32(values, gather);
+
+      _mm256_storeu_si256((__m256i *)(out + written), values);
+      done += BASE64_DECODE_BLOCK;
+      written += BASE64_DECODE_BLOCK / 4 * 3;
+   }
+
+   return done;
+}
+
+#elif defined(BASE64_USE_NEON)
+
+#include <arm_neon.h>
+
+/* Bytes of input consumed per block, and bytes read. */
+#define BASE64_ENCODE_BLOCK      48
+#define BASE64_ENCODE_READ       48
+/* Characters of input consumed per block, and bytes written. */
+#define BASE64_DECODE_BLOCK      64
+#define BASE64_DECODE_WRITE      48
+
+/* base64Reverse for 7-bit characters, with 0xFF for all the specials. */
+static const uint8 base64ReverseNeon[128] = {
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  /* 00-07 */
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  /* 08-0F */
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  /* 10-17 */
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  /* 18-1F */
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  /* 20-27 */
+   0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,  /* 28-2F */
+   0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B,  /* 30-37 */
+   0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  /* 38-3F */
+   0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,  /* 40-47 */
+   0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,  /* 48-4F */
+   0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,  /* 50-57 */
+   0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  /* 58-5F */
+   0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20,  /* 60-67 */
+   0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,  /* 68-6F */
+   0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30,  /* 70-77 */
+   0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF }; /* 78-7F */
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Base64LoadTable --
+ *
+ *      Loads 64 bytes of a table for vqtbl4q_u8.
+ *
+ * Results:
+ *      The table.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static INLINE uint8x16x4_t
+Base64LoadTable(const uint8 *table)  // IN:
+{
+   uint8x16x4_t t;
+
+   t.val[0] = vld1q_u8(table);
+   t.val[1] = vld1q_u8(table + 16);
+   t.val[2] = vld1q_u8(table + 32);
+   t.val[3] = vld1q_u8(table + 48);
+
+   return t;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Base64HaveVector --
+ *
+ *      NEON is part of the 64-bit ARM architecture.
+ *
+ * Results:
+ *      TRUE.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static INLINE Bool
+Base64HaveVector(void)
+{
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Base64EncodeBlocks --
+ *
+ *      Encodes 48-byte blocks of src into 64 characters each.
+ *
+ * Results:
+ *      The number of bytes of src encoded (a multiple of 48).
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static size_t
+Base64EncodeBlocks(uint8 const *src,  // IN:
+                   size_t srcSize,    // IN:
+                   char *dst)         // OUT:
+{
+   const uint8x16x4_t alphabet = Base64LoadTable((const uint8 *)Base64);
+   const uint8x16_t mask = vdupq_n_u8(0x3f);
+   size_t done = 0;
+
+   while (srcSize - done >= BASE64_ENCODE_READ) {
+      uint8x16x3_t in = vld3q_u8(src + done);
+      uint8x16x4_t out;
+
+      out.val[0] = vshrq_n_u8(in.val[0], 2);
+      out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4),
+                                     vshrq_n_u8(in.val[1], 4)), mask);
+      out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2),
+                                     vshrq_n_u8(in.val[2], 6)), mask);
+      out.val[3] = vandq_u8(in.val[2], mask);
+
+      out.val[0] = vqtbl4q_u8(alphabet, out.val[0]);
+      out.val[1] = vqtbl4q_u8(alphabet, out.val[1]);
+      out.val[2] = vqtbl4q_u8(alphabet, out.val[2]);
+      out.val[3] = vqtbl4q_u8(alphabet, out.val[3]);
+
+      vst4q_u8((uint8 *)dst + done / 3 * 4, out);
+      done += BASE64_ENCODE_BLOCK;
+   }
+
+   return done;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Base64DecodeBlocks --
+ *
+ *      Decodes 64-character blocks of in into 48 bytes each, as long as
+ *      there are at least 48 bytes of room in out, and stops at the first
+ *      block with characters outside of the base64 alphabet (whitespace,
+ *      padding, ...).
+ *
+ * Results:
+ *      The number of characters of in decoded (a multiple of 64).
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static size_t
+Base64DecodeBlocks(char const *in,   // IN:
+                   size_t inSize,    // IN:
+                   uint8 *out,       // OUT:
+                   size_t outSize)   // IN:
+{
+   const uint8x16x4_t reverseLo = Base64LoadTable(base64ReverseNeon);
+   const uint8x16x4_t reverseHi = Base64LoadTable(base64ReverseNeon + 64);
+   const uint8x16_t sixtyFour = vdupq_n_u8(64);
+   size_t done = 0;
+   size_t written = 0;
+
+   while (inSize - done >= BASE64_DECODE_BLOCK &&
+          outSize - written >= BASE64_DECODE_WRITE) {
+      uint8x16x4_t str = vld4q_u8((const uint8 *)in + done);
+      uint8x16_t bad = vdupq_n_u8(0);
+      uint8x16x3_t bytes;
+      int i;
+
+      /*
+       * Characters 0-63 come from the first half of the table and 64-127
+       * from the second one. Specials map to 0xFF, and characters 128-255 to
+       * 0; both are caught by the top bit of value | character.
+       */
+      for (i = 0; i < 4; i++) {
+         uint8x16_t c = str.val[i];
+         uint8x16_t v = vqtbl4q_u8(reverseLo, c);
+
+         v = vqtbx4q_u8(v, reverseHi, vsubq_u8(c, sixtyFour));
+         bad = vorrq_u8(bad, vorrq_u8(v, c));
+         str.val[i] = v;
+      }
+
+      if (vmaxvq_u8(bad) & 0x80) {
+         break;
+      }
+
+      bytes.val[0] = vorrq_u8(vshlq_n_u8(str.val[0], 2),
+                              vshrq_n_u8(str.val[1], 4));
+      bytes.val[1] = vorrq_u8(vshlq_n_u8(str.val[1], 4),
+                              vshrq_n_u8(str.val[2], 2));
+      bytes.val[2] = vorrq_u8(vshlq_n_u8(str.val[2], 6), str.val[3]);
+
+      vst3q_u8(out + written, bytes);
+      done += BASE64_DECODE_BLOCK;
+      written += BASE64_DECODE_WRITE;
+   }
+
+   return done;
+}
+
+#endif
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -213,6 +653,16 @@ Base64_Encode(uint8 const *src,  // IN:
       goto exit;
    }
 
+#if defined(BASE64_USE_AVX2) || defined(BASE64_USE_NEON)
+   if (srcSize >= BASE64_ENCODE_READ && Base64HaveVector()) {
+      size_t done = Base64EncodeBlocks(src, srcSize, dst);
+
+      src += done;
+      srcSize -= done;
+      dst += done / 3 * 4;
+   }
+#endif
+
    while (LIKELY(srcSize > 2)) {
       dst[0] = Base64[src[0] >> 2];
       dst[1] = Base64[(src[0] & 0x03) << 4 | src[1] >> 4];
@@ -385,6 +835,10 @@ Base64_ChunkDecode(char const *in,      // IN:
    int n = 0;
    uintptr_t i = 0;
    size_t inputIndex = 0;
+#if defined(BASE64_USE_AVX2) || defined(BASE64_USE_NEON)
+   Bool vector;
+   size_t vectorIndex = 0;
+#endif
 
    ASSERT(in);
    ASSERT(out || outSize == 0);
@@ -392,9 +846,41 @@ Base64_ChunkDecode(char const *in,      // IN:
    ASSERT((inSize == -1) || (inSize % 4) == 0);
    *dataLength = 0;
 
+#if defined(BASE64_USE_AVX2) || defined(BASE64_USE_NEON)
+   /*
+    * The vector code reads whole blocks, so it needs to know where a NUL
+    * terminated input ends; stopping there is the same as at the NUL (EOM).
+    */
+   vector = Base64HaveVector();
+   if (vector && inSize == -1) {
+      inSize = strlen(in);
+   }
+#endif
+
    i = 0;
    for (;inputIndex < inSize;) {
-      int p = base64Reverse[(unsigned char)in[inputIndex]];
+      int p;
+
+#if defined(BASE64_USE_AVX2) || defined(BASE64_USE_NEON)
+      /*
+       * Decode whole blocks at quantum boundaries. After a block the vector
+       * code can't do (whitespace, end of data, lack of room), the scalar
+       * code takes over for the next block worth of characters.
+       */
+      if (vector && n == 0 && inputIndex >= vectorIndex) {
+         size_t done = Base64DecodeBlocks(in + inputIndex, inSize - inputIndex,
+                                          out + i, outSize - i);
+
+         inputIndex += done;
+         i += done / 4 * 3;
+         vectorIndex = inputIndex + BASE64_DECODE_BLOCK;
+         if (inputIndex >= inSize) {
+            break;
+         }
+      }
+#endif
+
+      p = base64Reverse[(unsigned char)in[inputIndex]];
 
       if (UNLIKELY(p < 0)) {
          switch (p) {
@@ -134,11 +134,118 @@
 
 static Bool dontUseIcu = TRUE;
 
+#if !defined(NO_ICU)
+/*
+ * Opening an ICU converter is far more expensive than most conversions
+ * done with it, so each thread keeps the last few converters it released,
+ * keyed by the encoding name they were opened with. Converters are reset
+ * when taken out of the cache; callers set the callbacks they need. A
+ * thread that exits leaks at most CODESET_CONVERTER_CACHE_SIZE converters.
+ */
+#define CODESET_CONVERTER_CACHE_SIZE 4
+#define CODESET_CONVERTER_NAME_MAX   32
+
+typedef struct CodeSetCachedConverter {
+   UConverter *cv;
+   char name[CODESET_CONVERTER_NAME_MAX];
+} CodeSetCachedConverter;
+
+static __thread CodeSetCachedConverter
+   codeSetConverters[CODESET_CONVERTER_CACHE_SIZE];
+static __thread unsigned int codeSetConverterCount;
+#endif
+
 
 /*
  * Functions
  */
 
+#if !defined(NO_ICU)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSetGetConverter --
+ *
+ *    Get a converter for an encoding, from the per-thread cache if one is
+ *    available, otherwise freshly opened. Release it with
+ *    CodeSetPutConverter.
+ *
+ * Results:
+ *    The converter, or NULL with *uerr set on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static UConverter *
+CodeSetGetConverter(const char *name,  // IN: encoding
+                    UErrorCode *uerr)  // OUT: ICU error
+{
+   unsigned int i;
+
+   /* Most recently released converters are at the end. */
+   for (i = codeSetConverterCount; i-- > 0;) {
+      if (strcmp(codeSetConverters[i].name, name) == 0) {
+         UConverter *cv = codeSetConverters[i].cv;
+
+         codeSetConverterCount--;
+         memmove(&codeSetConverters[i], &codeSetConverters[i + 1],
+                 (codeSetConverterCount - i) * sizeof codeSetConverters[0]);
+         ucnv_reset(cv);
+         *uerr = U_ZERO_ERROR;
+         return cv;
+      }
+   }
+
+   *uerr = U_ZERO_ERROR;
+   return ucnv_open(name, uerr);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSetPutConverter --
+ *
+ *    Release a converter obtained from CodeSetGetConverter, keeping it in
+ *    the per-thread cache.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    May close the least recently released converter.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CodeSetPutConverter(UConverter *cv,    // IN: converter
+                    const char *name)  // IN: encoding it was opened for
+{
+   size_t nameLen = strlen(name);
+
+   if (nameLen >= CODESET_CONVERTER_NAME_MAX) {
+      ucnv_close(cv);
+      return;
+   }
+
+   if (codeSetConverterCount == CODESET_CONVERTER_CACHE_SIZE) {
+      ucnv_close(codeSetConverters[0].cv);
+      codeSetConverterCount--;
+      memmove(&codeSetConverters[0], &codeSetConverters[1],
+              codeSetConverterCount * sizeof codeSetConverters[0]);
+   }
+
+   codeSetConverters[codeSetConverterCount].cv = cv;
+   memcpy(codeSetConverters[codeSetConverterCount].name, name, nameLen + 1);
+   codeSetConverterCount++;
+}
+#endif
+
+
 #if !defined NO_ICU
 
 #ifdef _WIN32
@@ -709,8 +816,6 @@ found:
 }
 
 
-#if defined(CURRENT_IS_UTF8)
-
 /*
  *-----------------------------------------------------------------------------
  *
@@ -756,7 +861,36 @@ CodeSetDuplicateUtf8Str(const char *bufIn,  // IN: Input string
    return TRUE;
 }
 
-#endif // defined(CURRENT_IS_UTF8)
+
+#if !defined(CURRENT_IS_UTF8)
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSetIsAsciiForCurrent --
+ *
+ *    Check whether a UTF-8 buffer is pure ASCII while the current code set
+ *    is UTF-8, i.e. whether converting it to or from the current code set
+ *    is a plain copy.
+ *
+ * Results:
+ *    TRUE if so.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+CodeSetIsAsciiForCurrent(const char *bufIn,  // IN
+                         size_t sizeIn)      // IN
+{
+   return strcmp(CodeSet_GetCurrentCodeSet(), "UTF-8") == 0 &&
+          CodeSet_AsciiPrefixLen(bufIn, sizeIn) == sizeIn;
+}
+
+#endif // !defined(CURRENT_IS_UTF8)
 
 
 /*
@@ -823,6 +957,21 @@ CodeSetUtf8ToUtf16le(const char *bufIn,  // IN
                      size_t sizeIn,      // IN
                      DynBuf *db)         // IN
 {
+   size_t size = DynBuf_GetSize(db);
+
+   /*
+    * Pure ASCII only needs widening; leave anything else to the converter.
+    */
+   if (sizeIn <= (~(size_t)0 - size) / sizeof(utf16_t) &&
+       (DynBuf_GetAllocatedSize(db) >= size + sizeIn * sizeof(utf16_t) ||
+        DynBuf_Enlarge(db, size + sizeIn * sizeof(utf16_t))) &&
+       CodeSet_AsciiToUtf16le(bufIn, sizeIn,
+                              (utf16_t *)((char *)DynBuf_Get(db) + size)) ==
+          sizeIn) {
+      DynBuf_SetSize(db, size + sizeIn * sizeof(utf16_t));
+      return TRUE;
+   }
+
    return CodeSet_GenericToGenericDb("UTF-8", bufIn, sizeIn, "UTF-16LE", 0,
                                      db);
 }
@@ -933,14 +1082,12 @@ CodeSet_GenericToGenericDb(const char *codeIn,  // IN
     * Open converters.
     */
 
-   uerr = U_ZERO_ERROR;
-   cvin = ucnv_open(codeIn, &uerr);
+   cvin = CodeSetGetConverter(codeIn, &uerr);
    if (!cvin) {
       goto exit;
    }
 
-   uerr = U_ZERO_ERROR;
-   cvout = ucnv_open(codeOut, &uerr);
+   cvout = CodeSetGetConverter(codeOut, &uerr);
    if (!cvout) {
       goto exit;
    }
@@ -1062,11 +1209,11 @@ CodeSet_GenericToGenericDb(const char *codeIn,  // IN
 
   exit:
    if (cvin) {
-      ucnv_close(cvin);
+      CodeSetPutConverter(cvin, codeIn);
    }
 
    if (cvout) {
-      ucnv_close(cvout);
+      CodeSetPutConverter(cvout, codeOut);
    }
 
    return result;
@@ -1193,6 +1340,10 @@ CodeSet_Utf8ToCurrent(const char *bufIn,  // IN
 #if defined(CURRENT_IS_UTF8)
    return CodeSetDuplicateUtf8Str(bufIn, sizeIn, bufOut, sizeOut);
 #else
+   if (CodeSetIsAsciiForCurrent(bufIn, sizeIn)) {
+      return CodeSetDuplicateUtf8Str(bufIn, sizeIn, bufOut, sizeOut);
+   }
+
    DynBuf_Init(&db);
    ok = CodeSet_GenericToGenericDb("UTF-8", bufIn, sizeIn,
                                    CodeSet_GetCurrentCodeSet(), 0, &db);
@@ -1242,6 +1393,10 @@ CodeSet_CurrentToUtf8(const char *bufIn,  // IN
 #if defined(CURRENT_IS_UTF8)
    return CodeSetDuplicateUtf8Str(bufIn, sizeIn, bufOut, sizeOut);
 #else
+   if (CodeSetIsAsciiForCurrent(bufIn, sizeIn)) {
+      return CodeSetDuplicateUtf8Str(bufIn, sizeIn, bufOut, sizeOut);
+   }
+
    DynBuf_Init(&db);
    ok = CodeSet_GenericToGenericDb(CodeSet_GetCurrentCodeSet(), bufIn, sizeIn,
                                    "UTF-8", 0, &db);
@@ -1280,6 +1435,24 @@ CodeSet_Utf16leToUtf8Db(const char *bufIn, // IN
       return CodeSetOld_Utf16leToUtf8Db(bufIn, sizeIn, db);
    }
 
+   /*
+    * Pure ASCII only needs narrowing; leave anything else to the converter.
+    */
+   if (sizeIn % sizeof(utf16_t) == 0) {
+      size_t size = DynBuf_GetSize(db);
+      size_t numCodeUnits = sizeIn / sizeof(utf16_t);
+
+      if (size + numCodeUnits >= size &&
+          (DynBuf_GetAllocatedSize(db) >= size + numCodeUnits ||
+           DynBuf_Enlarge(db, size + numCodeUnits)) &&
+          CodeSet_Utf16leToAscii((const utf16_t *)bufIn, numCodeUnits,
+                                 (char *)DynBuf_Get(db) + size) ==
+             numCodeUnits) {
+         DynBuf_SetSize(db, size + numCodeUnits);
+         return TRUE;
+      }
+   }
+
    return CodeSet_GenericToGenericDb("UTF-16LE", bufIn, sizeIn, "UTF-8", 0,
                                      db);
 }
@@ -1636,10 +1809,9 @@ CodeSet_IsEncodingSupported(const char *name) // IN
    /*
     * Try to open the encoding.
     */
-   uerr = U_ZERO_ERROR;
-   cv = ucnv_open(name, &uerr);
+   cv = CodeSetGetConverter(name, &uerr);
    if (cv) {
-      ucnv_close(cv);
+      CodeSetPutConverter(cv, name);
 
       return TRUE;
    }
@@ -1699,13 +1871,12 @@ CodeSet_Validate(const char *buf,   // IN: the string
     * is bad.
     */
 
-   uerr = U_ZERO_ERROR;
-   cv = ucnv_open(code, &uerr);
+   cv = CodeSetGetConverter(code, &uerr);
    VERIFY(U_SUCCESS(uerr));
    ucnv_setToUCallBack(cv, UCNV_TO_U_CALLBACK_STOP, NULL, NULL, NULL, &uerr);
    VERIFY(U_SUCCESS(uerr));
    ucnv_toUChars(cv, NULL, 0, buf, size, &uerr);
-   ucnv_close(cv);
+   CodeSetPutConverter(cv, code);
 
    return uerr == U_BUFFER_OVERFLOW_ERROR;
 #endif
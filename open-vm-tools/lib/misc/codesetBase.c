@@ -23,11 +23,30 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "vmware.h"
+#include "vm_basic_asm.h"
 #include "codeset.h"
 #include "codesetOld.h"
 #include "util.h"
 
+/*
+ * Vector widths for the ASCII fast paths. AVX2 is only used when the
+ * compiler targets it; SSE2 is the x86-64 baseline and NEON the aarch64 one.
+ */
+#if defined(__AVX2__)
+#define CODESET_ASCII_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || (defined(_MSC_VER) && \
+    (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#define CODESET_ASCII_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define CODESET_ASCII_NEON
+#include <arm_neon.h>
+#endif
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -414,3 +433,222 @@ CodeSet_UTF32ToUTF8(const char *utf32,  // IN:
    return TRUE;
 }
 
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSet_AsciiPrefixLen --
+ *
+ *    Count the leading ASCII (< 0x80) bytes of a buffer, 16 or 32 bytes at
+ *    a time where the CPU allows it.
+ *
+ * Results:
+ *    The length of the ASCII prefix; 'size' if the buffer is pure ASCII.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+size_t
+CodeSet_AsciiPrefixLen(const char *buf,  // IN:
+                       size_t size)      // IN:
+{
+   const uint8 *p = (const uint8 *) buf;
+   size_t i = 0;
+
+#if defined(CODESET_ASCII_AVX2)
+   for (; i + 32 <= size; i += 32) {
+      __m256i v = _mm256_loadu_si256((const __m256i *) (p + i));
+      uint32 mask = _mm256_movemask_epi8(v);
+
+      if (mask != 0) {
+         return i + lssb32_0(mask);
+      }
+   }
+#endif
+#if defined(CODESET_ASCII_SSE2)
+   for (; i + 16 <= size; i += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+      uint32 mask = _mm_movemask_epi8(v);
+
+      if (mask != 0) {
+         return i + lssb32_0(mask);
+      }
+   }
+#elif defined(CODESET_ASCII_NEON)
+   for (; i + 16 <= size; i += 16) {
+      if (vmaxvq_u8(vld1q_u8(p + i)) >= 0x80) {
+         break;
+      }
+   }
+#else
+   for (; i + sizeof(uint64) <= size; i += sizeof(uint64)) {
+      uint64 word;
+
+      memcpy(&word, p + i, sizeof word);
+      if ((word & CONST64U(0x8080808080808080)) != 0) {
+         break;
+      }
+   }
+#endif
+
+   while (i < size && p[i] < 0x80) {
+      i++;
+   }
+
+   return i;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSet_AsciiToUtf16le --
+ *
+ *    Widen the leading ASCII bytes of a buffer to UTF-16LE code units,
+ *    stopping at the first non-ASCII byte. 'bufOut' must have room for
+ *    'sizeIn' code units.
+ *
+ * Results:
+ *    The number of bytes converted (and code units written).
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+size_t
+CodeSet_AsciiToUtf16le(const char *bufIn,  // IN:
+                       size_t sizeIn,      // IN:
+                       utf16_t *bufOut)    // OUT:
+{
+   const uint8 *p = (const uint8 *) bufIn;
+   size_t i = 0;
+
+#if defined(CODESET_ASCII_AVX2)
+   for (; i + 32 <= sizeIn; i += 32) {
+      __m256i v = _mm256_loadu_si256((const __m256i *) (p + i));
+
+      if (_mm256_movemask_epi8(v) != 0) {
+         break;
+      }
+      _mm256_storeu_si256((__m256i *) (bufOut + i),
+                          _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+      _mm256_storeu_si256((__m256i *) (bufOut + i + 16),
+                          _mm256_cvtepu8_epi16(
+                             _mm256_extracti128_si256(v, 1)));
+   }
+#endif
+#if defined(CODESET_ASCII_SSE2)
+   for (; i + 16 <= sizeIn; i += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+
+      if (_mm_movemask_epi8(v) != 0) {
+         break;
+      }
+      _mm_storeu_si128((__m128i *) (bufOut + i),
+                       _mm_unpacklo_epi8(v, _mm_setzero_si128()));
+      _mm_storeu_si128((__m128i *) (bufOut + i + 8),
+                       _mm_unpackhi_epi8(v, _mm_setzero_si128()));
+   }
+#elif defined(CODESET_ASCII_NEON)
+   for (; i + 16 <= sizeIn; i += 16) {
+      uint8x16_t v = vld1q_u8(p + i);
+
+      if (vmaxvq_u8(v) >= 0x80) {
+         break;
+      }
+      vst1q_u8((uint8 *) (bufOut + i),
+               vreinterpretq_u8_u16(vmovl_u8(vget_low_u8(v))));
+      vst1q_u8((uint8 *) (bufOut + i + 8),
+               vreinterpretq_u8_u16(vmovl_high_u8(v)));
+   }
+#endif
+
+   for (; i < sizeIn && p[i] < 0x80; i++) {
+      bufOut[i] = p[i];
+   }
+
+   return i;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSet_Utf16leToAscii --
+ *
+ *    Narrow the leading ASCII (< 0x80) UTF-16LE code units of a buffer to
+ *    bytes, stopping at the first other code unit. 'bufOut' must have room
+ *    for 'numCodeUnits' bytes.
+ *
+ * Results:
+ *    The number of code units converted (and bytes written).
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+size_t
+CodeSet_Utf16leToAscii(const utf16_t *bufIn,  // IN:
+                       size_t numCodeUnits,   // IN:
+                       char *bufOut)          // OUT:
+{
+   size_t i = 0;
+
+#if defined(CODESET_ASCII_AVX2)
+   for (; i + 32 <= numCodeUnits; i += 32) {
+      __m256i a = _mm256_loadu_si256((const __m256i *) (bufIn + i));
+      __m256i b = _mm256_loadu_si256((const __m256i *) (bufIn + i + 16));
+      __m256i high = _mm256_and_si256(_mm256_or_si256(a, b),
+                                      _mm256_set1_epi16((short) 0xFF80));
+
+      if (!_mm256_testz_si256(high, high)) {
+         break;
+      }
+      /* packus works per 128-bit lane; put the quadwords back in order. */
+      _mm256_storeu_si256((__m256i *) (bufOut + i),
+                          _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b),
+                                                   0xD8));
+   }
+#endif
+#if defined(CODESET_ASCII_SSE2)
+   for (; i + 16 <= numCodeUnits; i += 16) {
+      __m128i a = _mm_loadu_si128((const __m128i *) (bufIn + i));
+      __m128i b = _mm_loadu_si128((const __m128i *) (bufIn + i + 8));
+      __m128i high = _mm_and_si128(_mm_or_si128(a, b),
+                                   _mm_set1_epi16((short) 0xFF80));
+
+      if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) !=
+          0xFFFF) {
+         break;
+      }
+      _mm_storeu_si128((__m128i *) (bufOut + i), _mm_packus_epi16(a, b));
+   }
+#elif defined(CODESET_ASCII_NEON)
+   for (; i + 16 <= numCodeUnits; i += 16) {
+      uint16x8_t a = vreinterpretq_u16_u8(vld1q_u8((const uint8 *)
+                                                   (bufIn + i)));
+      uint16x8_t b = vreinterpretq_u16_u8(vld1q_u8((const uint8 *)
+                                                   (bufIn + i + 8)));
+
+      if (vmaxvq_u16(vorrq_u16(a, b)) >= 0x80) {
+         break;
+      }
+      vst1q_u8((uint8 *) (bufOut + i),
+               vcombine_u8(vmovn_u16(a), vmovn_u16(b)));
+   }
+#endif
+
+   for (; i < numCodeUnits && bufIn[i] < 0x80; i++) {
+      bufOut[i] = (char) bufIn[i];
+   }
+
+   return i;
+}
@@ -101,16 +101,15 @@ swab(const void *__restrict src,  // IN/OUT
 }
 #endif
 
-#if defined(CURRENT_IS_UTF8) || defined(_WIN32)
 /*
  *-----------------------------------------------------------------------------
  *
  * CodeSetOldDuplicateStr --
  *
- *    Duplicate input string, appending zero terminator to its end.  Only
- *    used on Windows and on platforms where current encoding is always
- *    UTF-8, on other iconv-capable platforms we just use iconv even for
- *    UTF-8 to UTF-8 translation.
+ *    Duplicate input string, appending zero terminator to its end.  Used
+ *    on Windows and on platforms where current encoding is always UTF-8.
+ *    On other iconv-capable platforms we only use it for pure ASCII input
+ *    while the current encoding is UTF-8, and use iconv for the rest.
  *
  * Results:
  *    TRUE on success
@@ -150,7 +149,6 @@ CodeSetOldDuplicateStr(const char *bufIn,  // IN: Input string
 
    return TRUE;
 }
-#endif
 
 
 /*
@@ -222,13 +220,36 @@ CodeSetOldUtf8ToUtf16leDb(const char *bufIn,   // IN:
    uint16 *buf;
 
    currentSize = DynBuf_GetSize(db);
+
+   /*
+    * No UTF-8 sequence takes more UTF-16 bytes than it has UTF-8 bytes
+    * times two, so reserving that up front lets the ASCII runs below be
+    * widened without any further checks.
+    */
+   if (sizeIn > (~(size_t)0 - currentSize) / sizeof *buf ||
+       (DynBuf_GetAllocatedSize(db) < currentSize + sizeIn * sizeof *buf &&
+        !DynBuf_Enlarge(db, currentSize + sizeIn * sizeof *buf))) {
+      return FALSE;
+   }
+
    allocatedSize = DynBuf_GetAllocatedSize(db);
    buf = (uint16 *)((char *)DynBuf_Get(db) + currentSize);
    while (bufIn < bufEnd) {
       size_t neededSize;
       uint32 uniChar;
-      int n = CodeSet_GetUtf8(bufIn, bufEnd, &uniChar);
+      int n;
+
+      if ((uint8)*bufIn < 0x80) {
+         size_t numAscii = CodeSet_AsciiToUtf16le(bufIn, bufEnd - bufIn,
+                                                  (utf16_t *)buf);
 
+         bufIn += numAscii;
+         buf += numAscii;
+         currentSize += numAscii * sizeof *buf;
+         continue;
+      }
+
+      n = CodeSet_GetUtf8(bufIn, bufEnd, &uniChar);
       if (n <= 0) {
          return FALSE;
       }
@@ -1237,6 +1258,34 @@ CodeSetOld_GenericToGeneric(const char *codeIn,   // IN:
  */
 
 
+#if defined(USE_ICONV)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSetOldCurrentIsUtf8 --
+ *
+ *    Check whether the current code set is UTF-8, in which case pure ASCII
+ *    input converts to and from it unchanged. Not every code set that looks
+ *    like an ASCII superset is one (some Shift_JIS tables map 0x5C to the
+ *    yen sign), so we only check for UTF-8.
+ *
+ * Results:
+ *    TRUE if the current code set is UTF-8.
+ *
+ * Side effects:
+ *    See CodeSetOld_GetCurrentCodeSet.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+CodeSetOldCurrentIsUtf8(void)
+{
+   return strcmp(CodeSetOld_GetCurrentCodeSet(), "UTF-8") == 0;
+}
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1269,6 +1318,11 @@ CodeSetOld_Utf8ToCurrent(char const *bufIn,  // IN:
    DynBuf db;
    Bool ok;
 
+   if (CodeSetOldCurrentIsUtf8() &&
+       CodeSet_AsciiPrefixLen(bufIn, sizeIn) == sizeIn) {
+      return CodeSetOldDuplicateStr(bufIn, sizeIn, bufOut, sizeOut);
+   }
+
    DynBuf_Init(&db);
    ok = CodeSetOld_GenericToGenericDb("UTF-8", bufIn, sizeIn,
                                       CodeSetOld_GetCurrentCodeSet(),
@@ -1326,6 +1380,11 @@ CodeSetOld_CurrentToUtf8(char const *bufIn,  // IN:
    DynBuf db;
    Bool ok;
 
+   if (CodeSetOldCurrentIsUtf8() &&
+       CodeSet_AsciiPrefixLen(bufIn, sizeIn) == sizeIn) {
+      return CodeSetOldDuplicateStr(bufIn, sizeIn, bufOut, sizeOut);
+   }
+
    DynBuf_Init(&db);
    ok = CodeSetOld_GenericToGenericDb(CodeSetOld_GetCurrentCodeSet(), bufIn,
                                       sizeIn, "UTF-8", 0, &db);
@@ -1390,6 +1449,29 @@ CodeSetOld_Utf16leToUtf8Db(char const *bufIn,  // IN
       size_t size;
       size_t newSize;
 
+      if (utf16In[codeUnitIndex] < 0x80) {
+         /*
+          * Narrow the whole ASCII run at once. Every remaining code unit
+          * needs at least one byte, so reserving that much is never waste.
+          */
+         size_t numAscii = numCodeUnits - codeUnitIndex;
+
+         size = DynBuf_GetSize(db);
+         newSize = size + numAscii;
+         if ((newSize < size) ||  // Prevent integer overflow
+             (DynBuf_GetAllocatedSize(db) < newSize &&
+              DynBuf_Enlarge(db, newSize) == FALSE)) {
+            return FALSE;
+         }
+
+         numAscii = CodeSet_Utf16leToAscii(utf16In + codeUnitIndex, numAscii,
+                                           (char *)DynBuf_Get(db) + size);
+         ASSERT(numAscii > 0);
+         DynBuf_SetSize(db, size + numAscii);
+         codeUnitIndex += numAscii - 1;
+         continue;
+      }
+
       if (utf16In[codeUnitIndex] < 0xD800 ||
           utf16In[codeUnitIndex] > 0xDFFF) {
          // Non-surrogate UTF-16 code units directly represent a code point.
@@ -78,11 +78,16 @@ Bool
 CodeSet_IsValidUTF8(const char *bufIn,  // IN:
                     size_t sizeIn)      // IN:
 {
-   size_t i;
+   size_t i = 0;
    uint32 state = UTF8_ACCEPT;
 
-   for (i = 0; i < sizeIn; i++) {
-      CodeSetDecode(&state, (unsigned char) *bufIn++);
+   while (i < sizeIn) {
+      /* Skip ASCII runs between sequences in bulk. */
+      if (state == UTF8_ACCEPT && (unsigned char) bufIn[i] < 0x80) {
+         i += CodeSet_AsciiPrefixLen(bufIn + i, sizeIn - i);
+         continue;
+      }
+      CodeSetDecode(&state, (unsigned char) bufIn[i++]);
    }
 
    return state == UTF8_ACCEPT;
@@ -251,10 +251,13 @@ DynBuf_Enlarge(DynBuf *b,       // IN/OUT:
 #else
                         /*
                          * Double the previously allocated size if it is less
-                         * than 256KB; otherwise grow it linearly by 256KB
+                         * than 256KB; otherwise grow it by half, so that
+                         * large buffers built by many appends still only
+                         * get copied a logarithmic number of times.
                          */
                         (b->allocated < 256 * 1024 ? b->allocated * 2
-                                                   : b->allocated + 256 * 1024)
+                                                   : b->allocated +
+                                                     b->allocated / 2)
 #endif
                       :
 #if defined(DYNBUF_DEBUG)
@@ -286,6 +289,83 @@ DynBuf_Enlarge(DynBuf *b,       // IN/OUT:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynBuf_Reserve --
+ *
+ *      Make sure there is room for at least 'extra' more bytes at the end of
+ *      a dynamic buffer, so that appending up to that much doesn't
+ *      reallocate. Unlike DynBuf_Enlarge, nothing happens if the room is
+ *      already there, which makes it suitable for buffers that are reused.
+ *      Callers that can estimate the size of what they are about to append
+ *      should reserve it first, to get a single reallocation.
+ *
+ * Results:
+ *      TRUE on success
+ *      FALSE on failure (not enough memory)
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+DynBuf_Reserve(DynBuf *b,     // IN/OUT:
+               size_t extra)  // IN:
+{
+   size_t new_size;
+
+   ASSERT(b);
+
+   if (b->allocated - b->size >= extra) {
+      return TRUE;
+   }
+
+   new_size = b->size + extra;
+   if (new_size < b->size) {  // Prevent integer overflow
+      return FALSE;
+   }
+
+   return DynBuf_Enlarge(b, new_size);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynBuf_Recycle --
+ *
+ *      Empty a dynamic buffer so that it can be filled again, keeping its
+ *      memory. Buffers reused across calls (samples, messages, ...) then
+ *      stop allocating once they have grown to their working size. If the
+ *      buffer holds more than 'maxKeep' bytes, e.g. after a one time large
+ *      use, its memory is released instead.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+DynBuf_Recycle(DynBuf *b,       // IN/OUT:
+               size_t maxKeep)  // IN:
+{
+   ASSERT(b);
+
+   if (b->allocated > maxKeep) {
+      DynBuf_Destroy(b);
+   } else {
+      b->size = 0;
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
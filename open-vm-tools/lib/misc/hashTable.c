@@ -21,6 +21,13 @@
  *
  *      An implementation of hashtable with no removals.
  *      For string keys.
+ *
+ *      Non-atomic hash tables grow as they fill up: once the average chain
+ *      is longer than HASH_MAX_LOAD, the bucket array is doubled and the
+ *      old chains are moved over a few at a time by later insertions and
+ *      deletions, so no single call pays for rehashing the whole table.
+ *      Atomic hash tables keep the size they were created with, which
+ *      lets their lookups and insertions go without locks.
  */
 
 #include <stdio.h>
@@ -41,6 +48,10 @@
 
 #define HASH_ROTATE     5
 
+#define HASH_MAX_LOAD      2    // Average chain length that triggers growth
+#define HASH_MAX_BITS      24   // Don't grow past this many buckets
+#define HASH_MIGRATE_STEP  4    // Old chains moved per insertion/deletion
+
 
 /*
  * Pointer to hash table entry
@@ -70,6 +81,7 @@ typedef Atomic_Ptr HashTableLink;
 typedef struct HashTableEntry {
    HashTableLink     next;
    const void       *keyStr;
+   uint32            hash;        // Full hash of keyStr
    Atomic_Ptr        clientData;
 } HashTableEntry;
 
@@ -87,6 +99,15 @@ struct HashTable {
    HashTableLink         *buckets;
 
    size_t                 numElements;
+
+   /*
+    * While growing, the previous bucket array. Its chains below oldPos
+    * have been moved to 'buckets', the others are still in use.
+    */
+   HashTableLink         *oldBuckets;
+   uint32                 oldNumEntries;
+   uint32                 oldNumBits;
+   uint32                 oldPos;
 };
 
 
@@ -104,10 +125,10 @@ HashTableEntry *HashTableLookupOrInsert(HashTable *ht,
  *
  * HashTableComputeHash --
  *
- *      Compute hash value based on key type and hash size.
+ *      Compute hash value based on key type.
  *
  * Results:
- *      The hash value.
+ *      The full 32-bit hash value, see HashTableFoldHash.
  *
  * Side effects:
  *      None.
@@ -156,20 +177,203 @@ HashTableComputeHash(const HashTable *ht,  // IN: hash table
       NOT_REACHED();
    }
 
-   {
-      int numBits = ht->numBits;
-      uint32 mask = MASK(numBits);
+   return h;
+}
 
-      for (; h > mask; h = (h & mask) ^ (h >> numBits)) {
-      }
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableFoldHash --
+ *
+ *      Fold a full hash value into a bucket index for a table of
+ *      2^numBits buckets.
+ *
+ * Results:
+ *      The bucket index.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE uint32
+HashTableFoldHash(uint32 h,        // IN: full hash value
+                  uint32 numBits)  // IN: log2 of the number of buckets
+{
+   uint32 mask = MASK(numBits);
+
+   if (numBits == 0) {
+      return 0;
    }
 
-   ASSERT(h < ht->numEntries);
+   for (; h > mask; h = (h & mask) ^ (h >> numBits)) {
+   }
 
    return h;
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableBucket --
+ *
+ *      Find the chain holding the entry for a hash value. While the table
+ *      grows, that is the old chain until it has been moved.
+ *
+ * Results:
+ *      The link at the head of the chain.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HashTableLink *
+HashTableBucket(const HashTable *ht,  // IN: hash table
+                uint32 hash)          // IN: full hash value
+{
+   if (ht->oldBuckets != NULL) {
+      uint32 i = HashTableFoldHash(hash, ht->oldNumBits);
+
+      if (i >= ht->oldPos) {
+         return &ht->oldBuckets[i];
+      }
+   }
+
+   return &ht->buckets[HashTableFoldHash(hash, ht->numBits)];
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableNumChains --
+ * HashTableChain --
+ *
+ *      Walk every chain of the table, including the old ones while growing
+ *      (those already moved are empty).
+ *
+ * Results:
+ *      The number of chains; the link at the head of chain 'i'.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE uint32
+HashTableNumChains(const HashTable *ht)  // IN: hash table
+{
+   return ht->numEntries + (ht->oldBuckets != NULL ? ht->oldNumEntries : 0);
+}
+
+static INLINE HashTableLink *
+HashTableChain(const HashTable *ht,  // IN: hash table
+               uint32 i)             // IN: chain index
+{
+   return i < ht->numEntries ? &ht->buckets[i]
+                             : &ht->oldBuckets[i - ht->numEntries];
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableMigrate --
+ *
+ *      Move the next HASH_MIGRATE_STEP chains of a growing table to the
+ *      new bucket array, and drop the old one once it is empty.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Entries change chains.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HashTableMigrate(HashTable *ht)  // IN/OUT: hash table
+{
+   uint32 n;
+
+   ASSERT(!ht->atomic);
+   ASSERT(ht->oldBuckets != NULL);
+
+   for (n = 0; n < HASH_MIGRATE_STEP && ht->oldPos < ht->oldNumEntries; n++) {
+      HashTableLink *chain = &ht->oldBuckets[ht->oldPos];
+      HashTableEntry *entry;
+
+      while ((entry = ENTRY(*chain)) != NULL) {
+         HashTableLink *bucket =
+            &ht->buckets[HashTableFoldHash(entry->hash, ht->numBits)];
+
+         SETENTRY(*chain, ENTRY(entry->next));
+         SETENTRY(entry->next, ENTRY(*bucket));
+         SETENTRY(*bucket, entry);
+      }
+      ht->oldPos++;
+   }
+
+   if (ht->oldPos == ht->oldNumEntries) {
+      free(ht->oldBuckets);
+      ht->oldBuckets = NULL;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableMaybeGrow --
+ *
+ *      Called after each insertion into a non-atomic table. Continues
+ *      growing the table, or starts doubling it if the chains have become
+ *      too long on average.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      May allocate a new bucket array and move entries.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HashTableMaybeGrow(HashTable *ht)  // IN/OUT: hash table
+{
+   ASSERT(!ht->atomic);
+
+   if (ht->oldBuckets != NULL) {
+      HashTableMigrate(ht);
+      return;
+   }
+
+   if (ht->numBits >= HASH_MAX_BITS ||
+       ht->numElements <= (size_t)ht->numEntries * HASH_MAX_LOAD) {
+      return;
+   }
+
+   ht->oldBuckets = ht->buckets;
+   ht->oldNumEntries = ht->numEntries;
+   ht->oldNumBits = ht->numBits;
+   ht->oldPos = 0;
+
+   ht->numBits++;
+   ht->numEntries <<= 1;
+   ht->buckets = Util_SafeCalloc(ht->numEntries, sizeof *ht->buckets);
+
+   HashTableMigrate(ht);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -209,7 +413,8 @@ HashTableEqualKeys(const HashTable *ht,  // IN: hash table
  *
  * HashTable_Alloc --
  *
- *      Create a hash table.
+ *      Create a hash table. 'numEntries' is the initial number of
+ *      buckets; non-atomic tables grow as needed.
  *
  * Results:
  *      The new hashtable.
@@ -248,6 +453,10 @@ HashTable_Alloc(uint32 numEntries,        // IN: must be a power of 2
    ht->freeEntryFn = fn;
    ht->buckets = Util_SafeCalloc(ht->numEntries, sizeof *ht->buckets);
    ht->numElements = 0;
+   ht->oldBuckets = NULL;
+   ht->oldNumEntries = 0;
+   ht->oldNumBits = 0;
+   ht->oldPos = 0;
 
 #ifndef NO_ATOMIC_HASHTABLE
    if (ht->atomic) {
@@ -323,15 +532,16 @@ HashTable_AllocOnce(Atomic_Ptr *var,          // IN/OUT: the atomic var
 static void
 HashTableClearInternal(HashTable *ht)  // IN/OUT:
 {
-   int i;
+   uint32 i;
 
    ht->numElements = 0;
 
-   for (i = 0; i < ht->numEntries; i++) {
+   for (i = 0; i < HashTableNumChains(ht); i++) {
+      HashTableLink *chain = HashTableChain(ht, i);
       HashTableEntry *entry;
 
-      while ((entry = ENTRY(ht->buckets[i])) != NULL) {
-         SETENTRY(ht->buckets[i], ENTRY(entry->next));
+      while ((entry = ENTRY(*chain)) != NULL) {
+         SETENTRY(*chain, ENTRY(entry->next));
          if (ht->copyKey) {
             free((void *) entry->keyStr);
          }
@@ -341,6 +551,9 @@ HashTableClearInternal(HashTable *ht)  // IN/OUT:
          free(entry);
       }
    }
+
+   free(ht->oldBuckets);
+   ht->oldBuckets = NULL;
 }
 
 
@@ -434,14 +647,15 @@ HashTable_FreeUnsafe(HashTable *ht)  // IN/OUT:
 static HashTableEntry *
 HashTableLookup(const HashTable *ht,  // IN:
                 const void *keyStr,   // IN:
-                uint32 hash)          // IN:
+                uint32 hash)          // IN: full hash value
 {
    HashTableEntry *entry;
 
-   for (entry = ENTRY(ht->buckets[hash]);
+   for (entry = ENTRY(*HashTableBucket(ht, hash));
         entry != NULL;
         entry = ENTRY(entry->next)) {
-      if (HashTableEqualKeys(ht, entry->keyStr, keyStr)) {
+      if (entry->hash == hash &&
+          HashTableEqualKeys(ht, entry->keyStr, keyStr)) {
          return entry;
       }
    }
@@ -544,10 +758,11 @@ HashTable_LookupAndDelete(HashTable *ht,       // IN/OUT: the hash table
 
    ASSERT(!ht->atomic);
 
-   for (linkp = &ht->buckets[hash];
+   for (linkp = HashTableBucket(ht, hash);
         (entry = ENTRY(*linkp)) != NULL;
         linkp = &entry->next) {
-      if (HashTableEqualKeys(ht, entry->keyStr, keyStr)) {
+      if (entry->hash == hash &&
+          HashTableEqualKeys(ht, entry->keyStr, keyStr)) {
          SETENTRY(*linkp, ENTRY(entry->next));
          ht->numElements--;
          if (ht->copyKey) {
@@ -560,6 +775,10 @@ HashTable_LookupAndDelete(HashTable *ht,       // IN/OUT: the hash table
          }
          free(entry);
 
+         if (ht->oldBuckets != NULL) {
+            HashTableMigrate(ht);
+         }
+
          return TRUE;
       }
    }
@@ -759,12 +978,13 @@ HashTableLookupOrInsert(HashTable *ht,       // IN/OUT:
                         void *clientData)    // IN/OPT:
 {
    uint32 hash = HashTableComputeHash(ht, keyStr);
+   HashTableLink *bucket = HashTableBucket(ht, hash);
    HashTableEntry *entry = NULL;
    HashTableEntry *oldEntry = NULL;
    HashTableEntry *head;
 
 again:
-   head = ENTRY(ht->buckets[hash]);
+   head = ENTRY(*bucket);
 
    oldEntry = HashTableLookup(ht, keyStr, hash);
    if (oldEntry != NULL) {
@@ -785,19 +1005,24 @@ again:
       } else {
          entry->keyStr = keyStr;
       }
+      entry->hash = hash;
       Atomic_WritePtr(&entry->clientData, clientData);
    }
    SETENTRY(entry->next, head);
    if (ht->atomic) {
-      if (!SETENTRYATOMIC(ht->buckets[hash], head, entry)) {
+      if (!SETENTRYATOMIC(*bucket, head, entry)) {
          goto again;
       }
    } else {
-      SETENTRY(ht->buckets[hash], entry);
+      SETENTRY(*bucket, entry);
    }
 
    ht->numElements++;
 
+   if (!ht->atomic) {
+      HashTableMaybeGrow(ht);
+   }
+
    return NULL;
 }
 
@@ -875,10 +1100,10 @@ HashTable_KeyArray(const HashTable *ht,  // IN:
    *keys = Util_SafeMalloc(*size * sizeof **keys);
 
    /* fill array */
-   for (i = 0, j = 0; i < ht->numEntries; i++) {
+   for (i = 0, j = 0; i < HashTableNumChains(ht); i++) {
       HashTableEntry *entry;
 
-      for (entry = ENTRY(ht->buckets[i]);
+      for (entry = ENTRY(*HashTableChain(ht, i));
            entry != NULL;
            entry = ENTRY(entry->next)) {
          (*keys)[j++] = entry->keyStr;
@@ -931,10 +1156,10 @@ HashTable_ToArray(const HashTable *ht,  // IN:
    *clientDatas = Util_SafeMalloc(*size * sizeof **clientDatas);
 
    /* fill array */
-   for (i = 0, j = 0; i < ht->numEntries; i++) {
+   for (i = 0, j = 0; i < HashTableNumChains(ht); i++) {
       HashTableEntry *entry;
 
-      for (entry = ENTRY(ht->buckets[i]);
+      for (entry = ENTRY(*HashTableChain(ht, i));
            entry != NULL;
            entry = ENTRY(entry->next)) {
          (*clientDatas)[j++] = Atomic_ReadPtr(&entry->clientData);
@@ -967,15 +1192,15 @@ HashTable_ForEach(const HashTable *ht,          // IN:
                   HashTableForEachCallback cb,  // IN:
                   void *clientData)             // IN:
 {
-   int i;
+   uint32 i;
 
    ASSERT(ht);
    ASSERT(cb);
 
-   for (i = 0; i < ht->numEntries; i++) {
+   for (i = 0; i < HashTableNumChains(ht); i++) {
       HashTableEntry *entry;
 
-      for (entry = ENTRY(ht->buckets[i]);
+      for (entry = ENTRY(*HashTableChain(ht, i));
            entry != NULL;
            entry = ENTRY(entry->next)) {
          int result = (*cb)(entry->keyStr, Atomic_ReadPtr(&entry->clientData),
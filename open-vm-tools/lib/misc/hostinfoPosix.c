@@ -395,7 +395,7 @@ Hostinfo_GetTimeOfDay(VmTimeType *time)  // OUT:
 /*
  *----------------------------------------------------------------------------
  *
- * Hostinfo_GetSystemBitness --
+ * HostinfoGetSystemBitness --
  *
  *      Determines the operating system's bitness.
  *
@@ -409,8 +409,8 @@ Hostinfo_GetTimeOfDay(VmTimeType *time)  // OUT:
  *----------------------------------------------------------------------------
  */
 
-int
-Hostinfo_GetSystemBitness(void)
+static int
+HostinfoGetSystemBitness(void)
 {
 #if defined __linux__
    struct utsname u;
@@ -463,6 +463,41 @@ Hostinfo_GetSystemBitness(void)
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Hostinfo_GetSystemBitness --
+ *
+ *      Determines the operating system's bitness. The answer cannot change
+ *      while we run, so it is only worked out once.
+ *
+ * Return value:
+ *      32 or 64 on success.
+ *      -1 on failure. Check errno for more details of error.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+Hostinfo_GetSystemBitness(void)
+{
+   static Atomic_Int bitness;  /* Implicitly initialized to 0. */
+   int result = Atomic_ReadInt(&bitness);
+
+   if (result == 0) {
+      result = HostinfoGetSystemBitness();
+      if (result > 0) {
+         Atomic_WriteInt(&bitness, result);
+      }
+   }
+
+   return result;
+}
+
+
 #if !defined __APPLE__ && !defined USERWORLD
 /*
  *-----------------------------------------------------------------------------
@@ -1167,32 +1202,69 @@ HostinfoOSData(void)
    return TRUE;
 }
 
+#if !defined sun && !defined __APPLE__ && !defined __FreeBSD__
+/*
+ * The CPU counts come from parsing all of /proc/cpuinfo, which is long on
+ * big machines. They are kept until the set of online CPUs changes, which
+ * is cheap to check; where the kernel does not export that set they are
+ * kept for good, as Hostinfo_NumCPUs always did.
+ */
+
+#define HOSTINFO_CPU_ONLINE_PATH "/sys/devices/system/cpu/online"
+
+static struct {
+   pthread_mutex_t lock;
+   Bool valid;
+   char online[256];        // Contents of HOSTINFO_CPU_ONLINE_PATH
+   uint32 logical;
+   uint32 cores;
+   uint32 pkgs;
+} hostinfoCPUInfo = { PTHREAD_MUTEX_INITIALIZER };
+
 
 /*
  *-----------------------------------------------------------------------------
  *
- * Hostinfo_CPUCounts --
+ * HostinfoReadCPUOnline --
  *
- *      Get a count of CPUs for the host.
- *        pkgs := total number of sockets/packages
- *        cores := total number of actual cores (not including hyperthreads)
- *        logical := total schedulable threads, as seen by host scheduler
- *      Depending on available host OS interfaces, these numbers may be
- *      either "active" or "possible", so do not depend upon them for
- *      precision.
+ *      Reads the list of online CPUs, e.g. "0-3,6".
  *
- *      As an example, a 2 socket Nehalem (4 cores + HT) would return:
- *        pkgs = 2, cores = 8, logical = 16
+ * Results:
+ *      The list in buf, an empty string if it is not available.
  *
- *      Again, this interface is generally not useful b/c of its potential
- *      inaccuracy (especially with hotplug!) and because it is only implemented
- *      for a few OSes.
+ * Side effects:
+ *      None
  *
- *      If you are trying to use this interface, it probably means you are doing
- *      something 'clever' with licensing.  Don't.
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HostinfoReadCPUOnline(char *buf,    // OUT:
+                      size_t size)  // IN:
+{
+   ssize_t len = -1;
+   int fd = open(HOSTINFO_CPU_ONLINE_PATH, O_RDONLY);
+
+   if (fd >= 0) {
+      len = read(fd, buf, size - 1);
+      close(fd);
+   }
+
+   buf[len > 0 ? len : 0] = '\0';
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HostinfoGetCPUInfo --
+ *
+ *      Returns the logical CPU, core and package counts, parsing
+ *      /proc/cpuinfo only if the online CPUs changed since it was last
+ *      parsed.
  *
  * Results:
- *      TRUE if sane numbers are populated, FALSE otherwise.
+ *      TRUE on success, FALSE if /proc/cpuinfo cannot be read.
  *
  * Side effects:
  *      None
@@ -1200,27 +1272,32 @@ HostinfoOSData(void)
  *-----------------------------------------------------------------------------
  */
 
-Bool
-Hostinfo_CPUCounts(uint32 *logical,  // OUT
+static Bool
+HostinfoGetCPUInfo(uint32 *logical,  // OUT
                    uint32 *cores,    // OUT
                    uint32 *pkgs)     // OUT
 {
-#if defined __APPLE__
-   /*
-    * Lame logic.  Because Apple doesn't really expose this info,
-    * we'd only use it for licensing anyway, and we just plain
-    * don't need it on Apple except that VMHS stuffs it somewhere
-    * and may result in a division-by-zero if we don't provide it.
-    */
-   *logical = Hostinfo_NumCPUs();
-   *pkgs = *logical > 4 ? 2 : 1;
-   *cores = *logical / *pkgs;
-
-   return TRUE;
-#elif defined __linux__
    FILE *f;
    char *line;
+   char online[sizeof hostinfoCPUInfo.online];
    unsigned count = 0, coresPerProc = 0, siblingsPerProc = 0;
+   Bool cached;
+
+   HostinfoReadCPUOnline(online, sizeof online);
+
+   pthread_mutex_lock(&hostinfoCPUInfo.lock);
+   cached = hostinfoCPUInfo.valid &&
+            strcmp(hostinfoCPUInfo.online, online) == 0;
+   if (cached) {
+      *logical = hostinfoCPUInfo.logical;
+      *cores = hostinfoCPUInfo.cores;
+      *pkgs = hostinfoCPUInfo.pkgs;
+   }
+   pthread_mutex_unlock(&hostinfoCPUInfo.lock);
+
+   if (cached) {
+      return TRUE;
+   }
 
    f = Posix_Fopen("/proc/cpuinfo", "r");
    if (f == NULL) {
@@ -1250,7 +1327,73 @@ Hostinfo_CPUCounts(uint32 *logical,  // OUT
    Log(LGPFX" This machine has %u physical CPUS, %u total cores, and %u "
             "logical CPUs.\n", *pkgs, *cores, *logical);
 
+   if (count > 0) {
+      pthread_mutex_lock(&hostinfoCPUInfo.lock);
+      Str_Strcpy(hostinfoCPUInfo.online, online,
+                 sizeof hostinfoCPUInfo.online);
+      hostinfoCPUInfo.logical = *logical;
+      hostinfoCPUInfo.cores = *cores;
+      hostinfoCPUInfo.pkgs = *pkgs;
+      hostinfoCPUInfo.valid = TRUE;
+      pthread_mutex_unlock(&hostinfoCPUInfo.lock);
+   }
+
+   return TRUE;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Hostinfo_CPUCounts --
+ *
+ *      Get a count of CPUs for the host.
+ *        pkgs := total number of sockets/packages
+ *        cores := total number of actual cores (not including hyperthreads)
+ *        logical := total schedulable threads, as seen by host scheduler
+ *      Depending on available host OS interfaces, these numbers may be
+ *      either "active" or "possible", so do not depend upon them for
+ *      precision.
+ *
+ *      As an example, a 2 socket Nehalem (4 cores + HT) would return:
+ *        pkgs = 2, cores = 8, logical = 16
+ *
+ *      Again, this interface is generally not useful b/c of its potential
+ *      inaccuracy (especially with hotplug!) and because it is only implemented
+ *      for a few OSes.
+ *
+ *      If you are trying to use this interface, it probably means you are doing
+ *      something 'clever' with licensing.  Don't.
+ *
+ * Results:
+ *      TRUE if sane numbers are populated, FALSE otherwise.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+Hostinfo_CPUCounts(uint32 *logical,  // OUT
+                   uint32 *cores,    // OUT
+                   uint32 *pkgs)     // OUT
+{
+#if defined __APPLE__
+   /*
+    * Lame logic.  Because Apple doesn't really expose this info,
+    * we'd only use it for licensing anyway, and we just plain
+    * don't need it on Apple except that VMHS stuffs it somewhere
+    * and may result in a division-by-zero if we don't provide it.
+    */
+   *logical = Hostinfo_NumCPUs();
+   *pkgs = *logical > 4 ? 2 : 1;
+   *cores = *logical / *pkgs;
+
    return TRUE;
+#elif defined __linux__
+   return HostinfoGetCPUInfo(logical, cores, pkgs);
 #else
    NOT_IMPLEMENTED();
 #endif
@@ -1340,14 +1483,13 @@ Hostinfo_NumCPUs(void)
 
    return out;
 #else
-   static int count = 0;
-
-   if (count <= 0) {
-      FILE *f;
-      char *line;
+   uint32 logical, cores, pkgs;
 
 #if defined(VMX86_SERVER)
-      if (HostType_OSIsVMK()) {
+   if (HostType_OSIsVMK()) {
+      static int count = 0;
+
+      if (count <= 0) {
          VMK_ReturnStatus status = VMKernel_GetNumCPUsUsed(&count);
 
          if (status != VMK_OK) {
@@ -1355,30 +1497,17 @@ Hostinfo_NumCPUs(void)
 
             return -1;
          }
-
-         return count;
-      }
-#endif
-      f = Posix_Fopen("/proc/cpuinfo", "r");
-      if (f == NULL) {
-	 return -1;
-      }
-
-      while (StdIO_ReadNextLine(f, &line, 0, NULL) == StdIO_Success) {
-	 if (strncmp(line, "processor", strlen("processor")) == 0) {
-	    count++;
-	 }
-	 free(line);
       }
 
-      fclose(f);
+      return count;
+   }
+#endif
 
-      if (count == 0) {
-	 return -1;
-      }
+   if (!HostinfoGetCPUInfo(&logical, &cores, &pkgs) || logical == 0) {
+      return -1;
    }
 
-   return count;
+   return logical;
 #endif
 }
 
@@ -54,13 +54,13 @@ Posix_Dlopen(const char *pathName,  // IN:
    char *path;
    void *ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return NULL;
    }
 
    ret = dlopen(path, flag);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
    return ret;
 }
 #endif
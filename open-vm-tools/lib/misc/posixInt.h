@@ -76,6 +76,75 @@ PosixConvertToCurrent(const char *in,   // IN: string to convert
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * PosixConvertToCurrentTemp --
+ *
+ *      Like PosixConvertToCurrent, for a string that is only needed
+ *      for the duration of a single system call.
+ *
+ *      When the current encoding is UTF-8, or US-ASCII and the string
+ *      is plain ASCII, the conversion is an identity and the input is
+ *      handed back as is, sparing an allocation and a copy per call.
+ *
+ * Results:
+ *      As PosixConvertToCurrent.  *out may be 'in' itself; release it
+ *      with PosixFreeTemp, never with free().
+ *
+ * Side effects:
+ *      As PosixConvertToCurrent.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static INLINE Bool
+PosixConvertToCurrentTemp(const char *in,   // IN: string to convert
+                          char **out)       // OUT: conversion result
+{
+   StringEncoding encoding = Unicode_GetCurrentEncoding();
+
+   if (encoding == STRING_ENCODING_UTF8 ||
+       (encoding == STRING_ENCODING_US_ASCII &&
+        Unicode_IsBufferValid(in, -1, STRING_ENCODING_US_ASCII))) {
+      *out = (char *) in;
+
+      return TRUE;
+   }
+
+   return PosixConvertToCurrent(in, out);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PosixFreeTemp --
+ *
+ *      Release the result of PosixConvertToCurrentTemp.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      errno is preserved.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static INLINE void
+PosixFreeTemp(const char *in,  // IN: string that was converted
+              char *out)       // IN: conversion result
+{
+   if (out != in) {
+      int e = errno;
+
+      free(out);
+      errno = e;
+   }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
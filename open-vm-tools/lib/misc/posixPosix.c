@@ -116,7 +116,7 @@ Posix_Open(const char *pathName,  // IN:
    mode_t mode = 0;
    int fd;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
@@ -138,7 +138,7 @@ Posix_Open(const char *pathName,  // IN:
 
    fd = open(path, flags, mode);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return fd;
 }
@@ -194,13 +194,13 @@ Posix_Fopen(const char *pathName,  // IN:
 
    ASSERT(mode);
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return NULL;
    }
 
    stream = fopen(path, mode);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return stream;
 }
@@ -230,13 +230,13 @@ Posix_Stat(const char *pathName,  // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = stat(path, statbuf);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return ret;
 }
@@ -266,13 +266,13 @@ Posix_Chmod(const char *pathName,  // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = chmod(path, mode);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
    return ret;
 }
 
@@ -302,18 +302,18 @@ Posix_Rename(const char *fromPathName,  // IN:
    char *fromPath;
    int result;
 
-   if (!PosixConvertToCurrent(fromPathName, &fromPath)) {
+   if (!PosixConvertToCurrentTemp(fromPathName, &fromPath)) {
       return -1;
    }
-   if (!PosixConvertToCurrent(toPathName, &toPath)) {
-      free(fromPath);
+   if (!PosixConvertToCurrentTemp(toPathName, &toPath)) {
+      PosixFreeTemp(fromPathName, fromPath);
       return -1;
    }
 
    result = rename(fromPath, toPath);
 
-   free(toPath);
-   free(fromPath);
+   PosixFreeTemp(toPathName, toPath);
+   PosixFreeTemp(fromPathName, fromPath);
    return result;
 }
 
@@ -341,13 +341,13 @@ Posix_Unlink(const char *pathName)  // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = unlink(path);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
    return ret;
 }
 
@@ -375,13 +375,13 @@ Posix_Rmdir(const char *pathName)  // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = rmdir(path);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return ret;
 }
@@ -414,13 +414,13 @@ Posix_Freopen(const char *pathName,  // IN:
 
    ASSERT(mode);
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return NULL;
    }
 
    stream = freopen(path, mode, input_stream);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
    return stream;
 }
 
@@ -449,7 +449,7 @@ Posix_Access(const char *pathName,  // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
@@ -467,7 +467,7 @@ Posix_Access(const char *pathName,  // IN:
    ret = access(path, mode);
 #endif
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return ret;
 }
@@ -498,13 +498,13 @@ Posix_EuidAccess(const char *pathName,  // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = euidaccess(path, mode);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
    return ret;
 #else
    errno = ENOSYS;
@@ -537,13 +537,13 @@ Posix_Utime(const char *pathName,         // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = utime(path, times);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return ret;
 }
@@ -601,13 +601,13 @@ Posix_Pathconf(const char *pathName,  // IN:
    char *path;
    long ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = pathconf(path, name);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return ret;
 }
@@ -676,13 +676,13 @@ Posix_Mknod(const char *pathName,  // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = mknod(path, mode, dev);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return ret;
 }
@@ -713,13 +713,13 @@ Posix_Chown(const char *pathName,  // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = chown(path, owner, group);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return ret;
 }
@@ -750,13 +750,13 @@ Posix_Lchown(const char *pathName,  // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = lchown(path, owner, group);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return ret;
 }
@@ -787,19 +787,19 @@ Posix_Link(const char *pathName1,  // IN:
    char *path2;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName1, &path1)) {
+   if (!PosixConvertToCurrentTemp(pathName1, &path1)) {
       return -1;
    }
-   if (!PosixConvertToCurrent(pathName2, &path2)) {
-      free(path1);
+   if (!PosixConvertToCurrentTemp(pathName2, &path2)) {
+      PosixFreeTemp(pathName1, path1);
 
       return -1;
    }
 
    ret = link(path1, path2);
 
-   free(path1);
-   free(path2);
+   PosixFreeTemp(pathName1, path1);
+   PosixFreeTemp(pathName2, path2);
 
    return ret;
 }
@@ -830,19 +830,19 @@ Posix_Symlink(const char *pathName1,  // IN:
    char *path2;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName1, &path1)) {
+   if (!PosixConvertToCurrentTemp(pathName1, &path1)) {
       return -1;
    }
-   if (!PosixConvertToCurrent(pathName2, &path2)) {
-      free(path1);
+   if (!PosixConvertToCurrentTemp(pathName2, &path2)) {
+      PosixFreeTemp(pathName1, path1);
 
       return -1;
    }
 
    ret = symlink(path1, path2);
 
-   free(path1);
-   free(path2);
+   PosixFreeTemp(pathName1, path1);
+   PosixFreeTemp(pathName2, path2);
 
    return ret;
 }
@@ -872,13 +872,13 @@ Posix_Mkfifo(const char *pathName,  // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = mkfifo(path, mode);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return ret;
 }
@@ -908,13 +908,13 @@ Posix_Truncate(const char *pathName,  // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = truncate(path, length);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return ret;
 }
@@ -944,13 +944,13 @@ Posix_Utimes(const char *pathName,         // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = utimes(path, times);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return ret;
 }
@@ -1312,13 +1312,13 @@ Posix_Mkdir(const char *pathName,  // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = mkdir(path, mode);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return ret;
 }
@@ -1347,13 +1347,13 @@ Posix_Chdir(const char *pathName)  // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = chdir(path);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return ret;
 }
@@ -1383,13 +1383,13 @@ Posix_RealPath(const char *pathName)  // IN:
    char rpath[PATH_MAX];
    char *p;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return NULL;
    }
 
    p = realpath(path, rpath);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return p == NULL ? NULL : Unicode_Alloc(rpath, STRING_ENCODING_DEFAULT);
 }
@@ -1418,7 +1418,7 @@ Posix_ReadLink(const char *pathName)  // IN:
    char *path = NULL;
    char *result = NULL;
 
-   if (PosixConvertToCurrent(pathName, &path)) {
+   if (PosixConvertToCurrentTemp(pathName, &path)) {
       size_t size = 2 * 1024;
 
       while (TRUE) {
@@ -1442,7 +1442,7 @@ Posix_ReadLink(const char *pathName)  // IN:
       }
    }
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return result;
 }
@@ -1472,13 +1472,13 @@ Posix_Lstat(const char *pathName,  // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = lstat(path, statbuf);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return ret;
 }
@@ -1507,13 +1507,13 @@ Posix_OpenDir(const char *pathName)  // IN:
    char *path;
    DIR *ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return NULL;
    }
 
    ret = opendir(path);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return ret;
 }
@@ -1611,13 +1611,13 @@ Posix_Statfs(const char *pathName,      // IN:
    char *path;
    int ret;
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return -1;
    }
 
    ret = statfs(path, statfsbuf);
 
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return ret;
 }
@@ -1858,11 +1858,11 @@ Posix_Setmntent(const char *pathName,  // IN:
 
    ASSERT(mode != NULL);
 
-   if (!PosixConvertToCurrent(pathName, &path)) {
+   if (!PosixConvertToCurrentTemp(pathName, &path)) {
       return NULL;
    }
    stream = setmntent(path, mode);
-   free(path);
+   PosixFreeTemp(pathName, path);
 
    return stream;
 #endif
@@ -27,6 +27,9 @@
 
 #include <pwd.h>
 #include <grp.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <time.h>
 
 #if (!defined(__FreeBSD__) || __FreeBSD_release >= 503001) && !defined __ANDROID__
 #define VM_SYSTEM_HAS_GETPWNAM_R 1
@@ -45,6 +48,491 @@ static int GetpwInternal_r(struct passwd *pw, char *buf, size_t size,
 #define NO_GETPWENT
 #endif
 
+/*
+ * NSS lookups may go over the network (LDAP, SSSD, NIS), and impersonation,
+ * vix operations, process owner resolution and user checks look up the
+ * same few users and groups over and over. Results of the reentrant
+ * lookups are kept for a short while, "no such entry" results included,
+ * and all entries of a kind are dropped as soon as the local database
+ * file for that kind changes. Lookup errors are never cached.
+ */
+
+#define PWD_CACHE_SIZE          64
+#define PWD_CACHE_TTL           60   // seconds
+#define PWD_CACHE_NEGATIVE_TTL  10   // seconds
+
+typedef enum {
+   PWD_CACHE_PWNAM,
+   PWD_CACHE_PWUID,
+   PWD_CACHE_GRNAM,
+} PwdCacheKind;
+
+typedef struct PwdCacheEntry {
+   PwdCacheKind kind;
+   char *name;                  // Key of by name lookups
+   uid_t uid;                   // Key of by uid lookups
+   time_t expires;              // 0 if the slot is free
+   Bool found;                  // FALSE for a negative entry
+   union {
+      struct passwd pw;
+      struct group gr;
+   } u;
+   char *data;                  // Storage the entry's strings live in
+} PwdCacheEntry;
+
+typedef struct PwdCacheFile {
+   const char *path;
+   Bool exists;
+   struct stat st;
+} PwdCacheFile;
+
+static pthread_mutex_t pwdCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static PwdCacheEntry pwdCache[PWD_CACHE_SIZE];
+static PwdCacheFile pwdCacheFiles[] = {
+   { "/etc/passwd" },
+   { "/etc/group" },
+};
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PwdCacheFree --
+ *
+ *      Empties a cache slot. The cache lock must be held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PwdCacheFree(PwdCacheEntry *entry)  // IN/OUT:
+{
+   free(entry->name);
+   free(entry->data);
+   memset(entry, 0, sizeof *entry);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PwdCacheCheckFile --
+ *
+ *      Drops the entries of a kind if its database file changed since
+ *      it was last looked at.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PwdCacheCheckFile(PwdCacheKind kind)  // IN:
+{
+   Bool isGroup = kind == PWD_CACHE_GRNAM;
+   PwdCacheFile *file = &pwdCacheFiles[isGroup ? 1 : 0];
+   struct stat st;
+   Bool exists;
+   int i;
+
+   exists = stat(file->path, &st) == 0;
+
+   pthread_mutex_lock(&pwdCacheLock);
+   if (file->exists != exists ||
+       (exists &&
+        (st.st_ino != file->st.st_ino ||
+         st.st_size != file->st.st_size ||
+         st.st_mtime != file->st.st_mtime ||
+         st.st_ctime != file->st.st_ctime))) {
+      for (i = 0; i < ARRAYSIZE(pwdCache); i++) {
+         if (pwdCache[i].expires != 0 &&
+             (pwdCache[i].kind == PWD_CACHE_GRNAM) == isGroup) {
+            PwdCacheFree(&pwdCache[i]);
+         }
+      }
+      file->exists = exists;
+      if (exists) {
+         file->st = st;
+      }
+   }
+   pthread_mutex_unlock(&pwdCacheLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PwdCacheFind --
+ *
+ *      Finds the live entry for a key. The cache lock must be held.
+ *
+ * Results:
+ *      The entry or NULL.
+ *
+ * Side effects:
+ *      An expired entry for the key is dropped.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static PwdCacheEntry *
+PwdCacheFind(PwdCacheKind kind,  // IN:
+             const char *name,   // IN: key of by name lookups
+             uid_t uid,          // IN: key of by uid lookups
+             time_t now)         // IN:
+{
+   int i;
+
+   for (i = 0; i < ARRAYSIZE(pwdCache); i++) {
+      PwdCacheEntry *entry = &pwdCache[i];
+
+      if (entry->expires == 0 || entry->kind != kind) {
+         continue;
+      }
+      if (kind == PWD_CACHE_PWUID ? entry->uid != uid
+                                  : strcmp(entry->name, name) != 0) {
+         continue;
+      }
+      if (now >= entry->expires) {
+         PwdCacheFree(entry);
+         return NULL;
+      }
+      return entry;
+   }
+
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PwdCacheCopyString --
+ *
+ *      Copies a string into the next free part of a buffer. With a NULL
+ *      buffer, only accounts for the room it needs.
+ *
+ * Results:
+ *      The copy, or NULL if there is none. Sets *ok to FALSE if the
+ *      buffer is too small.
+ *
+ * Side effects:
+ *      *used is advanced past the copy.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+PwdCacheCopyString(const char *src,  // IN:
+                   char *buf,        // IN/OPT:
+                   size_t size,      // IN:
+                   size_t *used,     // IN/OUT:
+                   Bool *ok)         // IN/OUT:
+{
+   size_t len;
+
+   if (src == NULL || !*ok) {
+      return NULL;
+   }
+
+   len = strlen(src) + 1;
+   if (*used + len > size || *used + len < *used) {
+      *ok = FALSE;
+      return NULL;
+   }
+   *used += len;
+
+   return buf == NULL ? NULL : memcpy(buf + *used - len, src, len);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PwdCachePackPasswd --
+ *
+ *      Copies a passwd structure, placing its strings in buf. With a NULL
+ *      buf, only computes the room needed.
+ *
+ * Results:
+ *      Bytes of buf used, or (size_t)-1 if it is too small.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static size_t
+PwdCachePackPasswd(const struct passwd *src,  // IN:
+                   struct passwd *dst,        // OUT:
+                   char *buf,                 // OUT/OPT:
+                   size_t size)               // IN:
+{
+   size_t used = 0;
+   Bool ok = TRUE;
+
+   *dst = *src;
+   dst->pw_name = PwdCacheCopyString(src->pw_name, buf, size, &used, &ok);
+   dst->pw_passwd = PwdCacheCopyString(src->pw_passwd, buf, size, &used, &ok);
+#if !defined __ANDROID__
+   dst->pw_gecos = PwdCacheCopyString(src->pw_gecos, buf, size, &used, &ok);
+#endif
+   dst->pw_dir = PwdCacheCopyString(src->pw_dir, buf, size, &used, &ok);
+   dst->pw_shell = PwdCacheCopyString(src->pw_shell, buf, size, &used, &ok);
+#if defined(__FreeBSD__)
+   dst->pw_class = PwdCacheCopyString(src->pw_class, buf, size, &used, &ok);
+#endif
+
+   return ok ? used : (size_t)-1;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PwdCachePackGroup --
+ *
+ *      Copies a group structure, placing its member array and strings in
+ *      buf. With a NULL buf, only computes the room needed.
+ *
+ * Results:
+ *      Bytes of buf used, or (size_t)-1 if it is too small.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static size_t
+PwdCachePackGroup(const struct group *src,  // IN:
+                  struct group *dst,        // OUT:
+                  char *buf,                // OUT/OPT:
+                  size_t size)              // IN:
+{
+   size_t used = 0;
+   size_t count = 0;
+   size_t i;
+   Bool ok = TRUE;
+
+   *dst = *src;
+
+   /* The member array goes first, aligned for pointers. */
+   if (src->gr_mem != NULL) {
+      size_t pad = 0;
+
+      while (src->gr_mem[count] != NULL) {
+         count++;
+      }
+      if (buf != NULL) {
+         pad = (sizeof(char *) - (uintptr_t)buf % sizeof(char *)) %
+               sizeof(char *);
+      }
+      used = pad + (count + 1) * sizeof(char *);
+      if (used > size) {
+         return (size_t)-1;
+      }
+      dst->gr_mem = buf == NULL ? NULL : (char **)(buf + pad);
+   }
+
+   dst->gr_name = PwdCacheCopyString(src->gr_name, buf, size, &used, &ok);
+   dst->gr_passwd = PwdCacheCopyString(src->gr_passwd, buf, size, &used, &ok);
+   for (i = 0; i < count; i++) {
+      char *member = PwdCacheCopyString(src->gr_mem[i], buf, size, &used, &ok);
+
+      if (dst->gr_mem != NULL) {
+         dst->gr_mem[i] = member;
+      }
+   }
+   if (dst->gr_mem != NULL) {
+      dst->gr_mem[count] = NULL;
+   }
+
+   return ok ? used : (size_t)-1;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PwdCacheAdd --
+ *
+ *      Caches the result of a successful lookup.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      May evict the entry closest to expiry. Failing to allocate the
+ *      entry is not an error, the result is just not cached.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PwdCacheAdd(PwdCacheKind kind,   // IN:
+            const char *name,    // IN: key of by name lookups
+            uid_t uid,           // IN: key of by uid lookups
+            const void *result)  // IN: passwd or group, NULL if not found
+{
+   PwdCacheEntry entry;
+   PwdCacheEntry *slot;
+   time_t now = time(NULL);
+   size_t size = 0;
+   int i;
+
+   memset(&entry, 0, sizeof entry);
+   entry.kind = kind;
+   entry.uid = uid;
+   entry.found = result != NULL;
+   entry.expires = now + (entry.found ? PWD_CACHE_TTL : PWD_CACHE_NEGATIVE_TTL);
+
+   if (kind != PWD_CACHE_PWUID && (entry.name = strdup(name)) == NULL) {
+      return;
+   }
+
+   if (result != NULL) {
+      if (kind == PWD_CACHE_GRNAM) {
+         size = PwdCachePackGroup(result, &entry.u.gr, NULL, (size_t)-1);
+      } else {
+         size = PwdCachePackPasswd(result, &entry.u.pw, NULL, (size_t)-1);
+      }
+      entry.data = malloc(size + 1);
+      if (entry.data == NULL) {
+         free(entry.name);
+         return;
+      }
+      if (kind == PWD_CACHE_GRNAM) {
+         PwdCachePackGroup(result, &entry.u.gr, entry.data, size);
+      } else {
+         PwdCachePackPasswd(result, &entry.u.pw, entry.data, size);
+      }
+   }
+
+   pthread_mutex_lock(&pwdCacheLock);
+   slot = PwdCacheFind(kind, name, uid, now);
+   if (slot == NULL) {
+      slot = &pwdCache[0];
+      for (i = 1; slot->expires != 0 && i < ARRAYSIZE(pwdCache); i++) {
+         if (pwdCache[i].expires < slot->expires) {
+            slot = &pwdCache[i];
+         }
+      }
+   }
+   PwdCacheFree(slot);
+   *slot = entry;
+   pthread_mutex_unlock(&pwdCacheLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PwdCacheGetPasswd --
+ *
+ *      Answers a passwd lookup from the cache, getpw*_r() style.
+ *
+ * Results:
+ *      TRUE if the cache had the answer, with *ret and *ppw set as the
+ *      lookup would have set them.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+PwdCacheGetPasswd(PwdCacheKind kind,     // IN:
+                  const char *name,      // IN: key of by name lookups
+                  uid_t uid,             // IN: key of by uid lookups
+                  struct passwd *pw,     // OUT:
+                  char *buf,             // OUT:
+                  size_t size,           // IN:
+                  struct passwd **ppw,   // OUT:
+                  int *ret)              // OUT:
+{
+   PwdCacheEntry *entry;
+
+   PwdCacheCheckFile(kind);
+
+   pthread_mutex_lock(&pwdCacheLock);
+   entry = PwdCacheFind(kind, name, uid, time(NULL));
+   if (entry != NULL) {
+      *ret = 0;
+      *ppw = NULL;
+      if (entry->found) {
+         if (PwdCachePackPasswd(&entry->u.pw, pw, buf, size) == (size_t)-1) {
+            *ret = ERANGE;
+         } else {
+            *ppw = pw;
+         }
+      }
+   }
+   pthread_mutex_unlock(&pwdCacheLock);
+
+   return entry != NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PwdCacheGetGroup --
+ *
+ *      Answers a group lookup from the cache, getgr*_r() style.
+ *
+ * Results:
+ *      TRUE if the cache had the answer, with *ret and *pgr set as the
+ *      lookup would have set them.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+PwdCacheGetGroup(const char *name,     // IN:
+                 struct group *gr,     // OUT:
+                 char *buf,            // OUT:
+                 size_t size,          // IN:
+                 struct group **pgr,   // OUT:
+                 int *ret)             // OUT:
+{
+   PwdCacheEntry *entry;
+
+   PwdCacheCheckFile(PWD_CACHE_GRNAM);
+
+   pthread_mutex_lock(&pwdCacheLock);
+   entry = PwdCacheFind(PWD_CACHE_GRNAM, name, 0, time(NULL));
+   if (entry != NULL) {
+      *ret = 0;
+      *pgr = NULL;
+      if (entry->found) {
+         if (PwdCachePackGroup(&entry->u.gr, gr, buf, size) == (size_t)-1) {
+            *ret = ERANGE;
+         } else {
+            *pgr = gr;
+         }
+      }
+   }
+   pthread_mutex_unlock(&pwdCacheLock);
+
+   return entry != NULL;
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -625,6 +1113,11 @@ Posix_Getpwnam_r(const char *name,     // IN:
    int ret;
    char *tmpname;
 
+   if (PwdCacheGetPasswd(PWD_CACHE_PWNAM, name, 0, pw, buf, size, ppw,
+                         &ret)) {
+      return ret;
+   }
+
    if (!PosixConvertToCurrent(name, &tmpname)) {
       /*
        * Act like nonexistent user, almost.
@@ -647,10 +1140,18 @@ Posix_Getpwnam_r(const char *name,     // IN:
 
    // ret is errno on failure, *ppw is NULL if no matching entry found.
    if (ret != 0 || *ppw == NULL) {
+      if (ret == 0) {
+         PwdCacheAdd(PWD_CACHE_PWNAM, name, 0, NULL);
+      }
       return ret;
    }
 
-   return GetpwInternal_r(pw, buf, size, ppw);
+   ret = GetpwInternal_r(pw, buf, size, ppw);
+   if (ret == 0) {
+      PwdCacheAdd(PWD_CACHE_PWNAM, name, 0, *ppw);
+   }
+
+   return ret;
 }
 
 
@@ -680,6 +1181,11 @@ Posix_Getpwuid_r(uid_t uid,            // IN:
 {
    int ret;
 
+   if (PwdCacheGetPasswd(PWD_CACHE_PWUID, NULL, uid, pw, buf, size, ppw,
+                         &ret)) {
+      return ret;
+   }
+
 #if defined(VM_SYSTEM_HAS_GETPWNAM_R)
    ret = getpwuid_r(uid, pw, buf, size, ppw);
 #else
@@ -687,10 +1193,18 @@ Posix_Getpwuid_r(uid_t uid,            // IN:
 #endif
    if (ret != 0 || *ppw == NULL) {
       // ret is errno on failure, *ppw is NULL if no matching entry found.
+      if (ret == 0) {
+         PwdCacheAdd(PWD_CACHE_PWUID, NULL, uid, NULL);
+      }
       return ret;
    }
 
-   return GetpwInternal_r(pw, buf, size, ppw);
+   ret = GetpwInternal_r(pw, buf, size, ppw);
+   if (ret == 0) {
+      PwdCacheAdd(PWD_CACHE_PWUID, NULL, uid, *ppw);
+   }
+
+   return ret;
 }
 
 
@@ -1006,6 +1520,10 @@ Posix_Getgrnam_r(const char *name,     // IN:
    char **grmem = NULL;
    size_t n;
 
+   if (PwdCacheGetGroup(name, gr, buf, size, pgr, &ret)) {
+      return ret;
+   }
+
    if (!PosixConvertToCurrent(name, &tmpname)) {
       /*
        * Act like nonexistent group, almost.
@@ -1027,6 +1545,9 @@ Posix_Getgrnam_r(const char *name,     // IN:
 
    // ret is errno on failure, *pgr is NULL if no matching entry found.
    if (ret != 0 || *pgr == NULL) {
+      if (ret == 0) {
+         PwdCacheAdd(PWD_CACHE_GRNAM, name, 0, NULL);
+      }
       return ret;
    }
 
@@ -1096,6 +1617,7 @@ Posix_Getgrnam_r(const char *name,     // IN:
    }
 
    ret = 0;
+   PwdCacheAdd(PWD_CACHE_GRNAM, name, 0, gr);
 
  exit:
    free(grpasswd);
@@ -51,11 +51,13 @@
  *
  *    10/15: rberinde: Added multibuffer AVX2 code.
  *
+ *    10/16: Added SHA-NI and ARMv8 cryptography extension code.
+ *
  * If any changes are made to this file, please run:
  *    test-esx -n misc/sha1.sh
  */
 
-#if defined(USERLEVEL) || defined(_WIN32)
+#if defined(USERLEVEL) || defined(_WIN32) || defined(OPEN_VM_TOOLS)
 #   include <string.h>
 #   if defined(_WIN32)
 #      include <memory.h>
@@ -346,6 +348,365 @@ SHA1MultiBufferAVX2(uint32 numBuffers,
 #endif
 
 
+/*
+ * SHA-1 instruction implementations: the x86 SHA extensions (SHA-NI) and the
+ * ARMv8 cryptography extension. Both are compiled for the target with
+ * function attributes and only used after checking the CPU supports them, so
+ * that generic builds pick them up on the machines that have them. They are
+ * excluded from the kernel and boot components, where the vector state can't
+ * be used freely.
+ */
+#if !defined(VMKERNEL) && !defined(VMKBOOT) && !defined(VMCORE) && \
+    !defined(_WIN32) && defined(__GNUC__) && \
+    (__GNUC__ >= 5 || defined(__clang__))
+#   if defined(__x86_64__) || defined(__i386__)
+#      define SHA1_USE_SHANI
+#   elif defined(__aarch64__) && (__GNUC__ >= 8 || defined(__clang__)) && \
+         (defined(__linux__) || defined(__APPLE__))
+#      define SHA1_USE_ARMV8
+#   endif
+#endif
+
+#if defined(SHA1_USE_SHANI)
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define SHA1_SHANI_TARGET __attribute__((target("sha,sse4.1,ssse3")))
+
+/*
+ * Four rounds of SHA-1: the quad rounds of group 'g' (0-19) with the message
+ * words in m[g % 4]. 'e' is the E value for this group, 'en' receives the
+ * one for the next. The message schedule for the following groups is
+ * computed along the way.
+ */
+#define SHA1_SHANI_ROUNDS4(g, e, en)                                        \
+   do {                                                                     \
+      if ((g) == 0) {                                                       \
+         e = _mm_add_epi32(e, m[0]);                                        \
+      } else {                                                              \
+         e = _mm_sha1nexte_epu32(e, m[(g) % 4]);                            \
+      }                                                                     \
+      en = abcd;                                                            \
+      if ((g) >= 3 && (g) <= 18) {                                          \
+         m[((g) + 1) % 4] = _mm_sha1msg2_epu32(m[((g) + 1) % 4],            \
+                                               m[(g) % 4]);                 \
+      }                                                                     \
+      abcd = _mm_sha1rnds4_epu32(abcd, e, (g) / 5);                         \
+      if ((g) >= 1 && (g) <= 16) {                                          \
+         m[((g) + 3) % 4] = _mm_sha1msg1_epu32(m[((g) + 3) % 4],            \
+                                               m[(g) % 4]);                 \
+      }                                                                     \
+      if ((g) >= 2 && (g) <= 17) {                                          \
+         m[((g) + 2) % 4] = _mm_xor_si128(m[((g) + 2) % 4], m[(g) % 4]);    \
+      }                                                                     \
+   } while (0)
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SHA1TransformSHANIBlocks --
+ *
+ *    Apply the SHA-1 transformation on 512-bit blocks using the x86 SHA
+ *    extensions.
+ *
+ * Results:
+ *    'state' is updated.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static SHA1_SHANI_TARGET void
+SHA1TransformSHANIBlocks(uint32 state[5],              // IN/OUT
+                         const unsigned char *buffer,  // IN
+                         uint32 numBlocks)             // IN
+{
+   const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL,
+                                        0x08090a0b0c0d0e0fULL);
+   __m128i abcd;
+   __m128i e0;
+   __m128i e1;
+   __m128i m[4];
+
+   abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+   e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+   while (numBlocks > 0) {
+      __m128i abcdSave = abcd;
+      __m128i e0Save = e0;
+      int i;
+
+      for (i = 0; i < 4; i++) {
+         m[i] = _mm_shuffle_epi8(
+                   _mm_loadu_si128((const __m128i *)(buffer + 16 * i)), bswap);
+      }
+
+      SHA1_SHANI_ROUNDS4(0, e0, e1);
+      SHA1_SHANI_ROUNDS4(1, e1, e0);
+      SHA1_SHANI_ROUNDS4(2, e0, e1);
+      SHA1_SHANI_ROUNDS4(3, e1, e0);
+      SHA1_SHANI_ROUNDS4(4, e0, e1);
+      SHA1_SHANI_ROUNDS4(5, e1, e0);
+      SHA1_SHANI_ROUNDS4(6, e0, e1);
+      SHA1_SHANI_ROUNDS4(7, e1, e0);
+      SHA1_SHANI_ROUNDS4(8, e0, e1);
+      SHA1_SHANI_ROUNDS4(9, e1, e0);
+      SHA1_SHANI_ROUNDS4(10, e0, e1);
+      SHA1_SHANI_ROUNDS4(11, e1, e0);
+      SHA1_SHANI_ROUNDS4(12, e0, e1);
+      SHA1_SHANI_ROUNDS4(13, e1, e0);
+      SHA1_SHANI_ROUNDS4(14, e0, e1);
+      SHA1_SHANI_ROUNDS4(15, e1, e0);
+      SHA1_SHANI_ROUNDS4(16, e0, e1);
+      SHA1_SHANI_ROUNDS4(17, e1, e0);
+      SHA1_SHANI_ROUNDS4(18, e0, e1);
+      SHA1_SHANI_ROUNDS4(19, e1, e0);
+
+      e0 = _mm_sha1nexte_epu32(e0, e0Save);
+      abcd = _mm_add_epi32(abcd, abcdSave);
+
+      buffer += 64;
+      numBlocks--;
+   }
+
+   _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+   state[4] = _mm_extract_epi32(e0, 3);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SHA1IsHWSupported --
+ *
+ *    Check whether the CPU has the SHA extensions (and the SSSE3 and SSE4.1
+ *    instructions used along with them).
+ *
+ * Results:
+ *    TRUE if the SHA-NI transform can be used.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+SHA1IsHWSupported(void)
+{
+   unsigned int eax, ebx, ecx, edx;
+
+   if (__get_cpuid_max(0, NULL) < 7) {
+      return FALSE;
+   }
+   __cpuid(1, eax, ebx, ecx, edx);
+   if ((ecx & bit_SSSE3) == 0 || (ecx & bit_SSE4_1) == 0) {
+      return FALSE;
+   }
+   __cpuid_count(7, 0, eax, ebx, ecx, edx);
+   return (ebx & (1 << 29)) != 0;  /* CPUID.(EAX=07H,ECX=0):EBX.SHA */
+}
+
+#define SHA1TransformHWBlocks SHA1TransformSHANIBlocks
+
+#elif defined(SHA1_USE_ARMV8)
+
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#if defined(__clang__)
+#define SHA1_ARMV8_TARGET __attribute__((target("crypto")))
+#else
+#define SHA1_ARMV8_TARGET __attribute__((target("+crypto")))
+#endif
+
+/*
+ * Four rounds of SHA-1: the quad rounds of group 'g' (0-19), with the message
+ * words plus round constant in wk[g % 2]. 'e' is the E value for this
+ * group, 'en' receives the one for the next. The message schedule and the
+ * words for group g + 2 are computed along the way.
+ */
+#define SHA1_ARMV8_ROUNDS4(g, op, e, en)                                    \
+   do {                                                                     \
+      en = vsha1h_u32(vgetq_lane_u32(abcd, 0));                             \
+      abcd = op(abcd, e, wk[(g) % 2]);                                      \
+      if ((g) <= 17) {                                                      \
+         wk[(g) % 2] = vaddq_u32(m[((g) + 2) % 4], k[((g) + 2) / 5]);       \
+      }                                                                     \
+      if ((g) >= 1 && (g) <= 16) {                                          \
+         m[((g) + 3) % 4] = vsha1su1q_u32(m[((g) + 3) % 4],                 \
+                                          m[((g) + 2) % 4]);                \
+      }                                                                     \
+      if ((g) <= 15) {                                                      \
+         m[(g) % 4] = vsha1su0q_u32(m[(g) % 4], m[((g) + 1) % 4],           \
+                                    m[((g) + 2) % 4]);                      \
+      }                                                                     \
+   } while (0)
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SHA1TransformARMv8Blocks --
+ *
+ *    Apply the SHA-1 transformation on 512-bit blocks using the ARMv8
+ *    cryptography extension.
+ *
+ * Results:
+ *    'state' is updated.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static SHA1_ARMV8_TARGET void
+SHA1TransformARMv8Blocks(uint32 state[5],              // IN/OUT
+                         const unsigned char *buffer,  // IN
+                         uint32 numBlocks)             // IN
+{
+   uint32x4_t k[4];
+   uint32x4_t abcd;
+   uint32x4_t m[4];
+   uint32x4_t wk[2];
+   uint32_t e0;
+   uint32_t e1;
+
+   k[0] = vdupq_n_u32(0x5A827999);
+   k[1] = vdupq_n_u32(0x6ED9EBA1);
+   k[2] = vdupq_n_u32(0x8F1BBCDC);
+   k[3] = vdupq_n_u32(0xCA62C1D6);
+
+   abcd = vld1q_u32(state);
+   e0 = state[4];
+
+   while (numBlocks > 0) {
+      uint32x4_t abcdSave = abcd;
+      uint32_t e0Save = e0;
+      int i;
+
+      for (i = 0; i < 4; i++) {
+         m[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(buffer + 16 * i)));
+      }
+      wk[0] = vaddq_u32(m[0], k[0]);
+      wk[1] = vaddq_u32(m[1], k[0]);
+
+      SHA1_ARMV8_ROUNDS4(0, vsha1cq_u32, e0, e1);
+      SHA1_ARMV8_ROUNDS4(1, vsha1cq_u32, e1, e0);
+      SHA1_ARMV8_ROUNDS4(2, vsha1cq_u32, e0, e1);
+      SHA1_ARMV8_ROUNDS4(3, vsha1cq_u32, e1, e0);
+      SHA1_ARMV8_ROUNDS4(4, vsha1cq_u32, e0, e1);
+      SHA1_ARMV8_ROUNDS4(5, vsha1pq_u32, e1, e0);
+      SHA1_ARMV8_ROUNDS4(6, vsha1pq_u32, e0, e1);
+      SHA1_ARMV8_ROUNDS4(7, vsha1pq_u32, e1, e0);
+      SHA1_ARMV8_ROUNDS4(8, vsha1pq_u32, e0, e1);
+      SHA1_ARMV8_ROUNDS4(9, vsha1pq_u32, e1, e0);
+      SHA1_ARMV8_ROUNDS4(10, vsha1mq_u32, e0, e1);
+      SHA1_ARMV8_ROUNDS4(11, vsha1mq_u32, e1, e0);
+      SHA1_ARMV8_ROUNDS4(12, vsha1mq_u32, e0, e1);
+      SHA1_ARMV8_ROUNDS4(13, vsha1mq_u32, e1, e0);
+      SHA1_ARMV8_ROUNDS4(14, vsha1mq_u32, e0, e1);
+      SHA1_ARMV8_ROUNDS4(15, vsha1pq_u32, e1, e0);
+      SHA1_ARMV8_ROUNDS4(16, vsha1pq_u32, e0, e1);
+      SHA1_ARMV8_ROUNDS4(17, vsha1pq_u32, e1, e0);
+      SHA1_ARMV8_ROUNDS4(18, vsha1pq_u32, e0, e1);
+      SHA1_ARMV8_ROUNDS4(19, vsha1pq_u32, e1, e0);
+
+      abcd = vaddq_u32(abcd, abcdSave);
+      e0 += e0Save;
+
+      buffer += 64;
+      numBlocks--;
+   }
+
+   vst1q_u32(state, abcd);
+   state[4] = e0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SHA1IsHWSupported --
+ *
+ *    Check whether the CPU has the ARMv8 SHA-1 instructions.
+ *
+ * Results:
+ *    TRUE if the ARMv8 transform can be used.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+SHA1IsHWSupported(void)
+{
+#if defined(__APPLE__)
+   return TRUE;  /* All Apple arm64 CPUs have it. */
+#else
+   return (getauxval(AT_HWCAP) & HWCAP_SHA1) != 0;
+#endif
+}
+
+#define SHA1TransformHWBlocks SHA1TransformARMv8Blocks
+
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SHA1TransformHW --
+ *
+ *    Speed up transformation with the CPU's SHA-1 instructions if possible.
+ *
+ * Results:
+ *    TRUE if we were able to use the SHA-1 instructions to apply the
+ *    transform.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE Bool
+SHA1TransformHW(uint32 state[5],              // IN/OUT
+                const unsigned char *buffer,  // IN
+                uint32 numBlocks)             // IN
+{
+#if defined(SHA1_USE_SHANI) || defined(SHA1_USE_ARMV8)
+   static int useHW = -1;
+
+   ASSERT(useHW == -1 || useHW == 0 || useHW == 1);
+
+   /* This is safe even if multiple threads race here. */
+   if (useHW == -1) {
+      useHW = SHA1IsHWSupported();
+   }
+
+   if (useHW == 0) {
+      return FALSE;
+   }
+
+   SHA1TransformHWBlocks(state, buffer, numBlocks);
+   return TRUE;
+#else
+   return FALSE;
+#endif
+}
+
+
 /* If the endianess is not defined (it is done in string.h of glibc 2.1.1), we
    default to LE --hpreg */
 #ifndef LITTLE_ENDIAN
@@ -483,6 +844,10 @@ SHA1Transform(uint32 state[5],              // IN/OUT
 {
     uint32 i;
 
+    if (SHA1TransformHW(state, buffer, numBlocks)) {
+       return;
+    }
+
     if (SHA1TransformSSSE3(state, buffer, numBlocks)) {
        return;
     }
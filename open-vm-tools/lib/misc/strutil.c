@@ -993,9 +993,12 @@ StrUtil_VDynBufPrintf(DynBuf *b,        // IN/OUT
       size_t size = DynBuf_GetSize(b);
       size_t allocSize = DynBuf_GetAllocatedSize(b);
 
-      /* Make sure the buffer isn't still unallocated */
-      if (allocSize < minAllocSize) {
-         Bool success = DynBuf_Enlarge(b, minAllocSize);
+      /*
+       * Make sure there is some room to begin with. A buffer that is reused
+       * usually has it already.
+       */
+      if (allocSize - size < minAllocSize) {
+         Bool success = DynBuf_Reserve(b, minAllocSize);
          if (!success) {
             return FALSE;
          }
@@ -111,7 +111,9 @@
 #include "guestApp.h"
 #include "guestInfo.h"
 #include "xdrutil.h"
+#include "dynxdr.h"
 #ifdef USE_SLASH_PROC
+#   include <linux/rtnetlink.h>
 #   include "slashProc.h"
 #endif
 #include "netutil.h"
@@ -144,6 +146,7 @@ static char *ValidateConvertAddress(const struct sockaddr *addr);
 
 #ifdef USE_RESOLVE
 static Bool RecordResolverInfo(NicInfoV3 *nicInfo);
+static DnsConfigInfo *RecordResolverParse(void);
 static void RecordResolverNS(DnsConfigInfo *dnsConfigInfo);
 #endif
 
@@ -522,12 +525,123 @@ ReadInterfaceDetails(const struct intf_entry *entry,  // IN: current interface e
 
 #ifdef USE_RESOLVE
 
+#define RESOLV_CONF "/etc/resolv.conf"
+
+/*
+ * What identifies a version of resolv.conf.  It is taken both through the
+ * link, if it is one, and of the link itself, so that a rewrite of the file
+ * and a retargeted link (ex: systemd-resolved being switched on) both count
+ * as changes.
+ */
+typedef struct ResolverCacheKey {
+   struct {
+      dev_t  dev;
+      ino_t  ino;
+      off_t  size;
+      time_t mtime;
+      time_t ctime;
+   } file[2];
+} ResolverCacheKey;
+
+/*
+ * The resolver settings as of the last parse, without the host name, which
+ * is looked up every time.  Kept XDR-encoded so handing out a copy is a
+ * single decode.
+ */
+static struct {
+   ResolverCacheKey key;
+   void *data;
+   size_t dataLen;
+} resolverCache;
+
+G_LOCK_DEFINE_STATIC(resolverCache);
+
+
+/*
+ ******************************************************************************
+ * ResolverCacheGetKey --                                                */ /**
+ *
+ * @brief Takes the current @ref ResolverCacheKey of @ref RESOLV_CONF.
+ *
+ * @param[out] key      The key.
+ *
+ * @retval TRUE         Key filled in.
+ * @retval FALSE        resolv.conf could not be looked at; don't cache.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+ResolverCacheGetKey(ResolverCacheKey *key)  // OUT
+{
+   struct stat st[2];
+   unsigned int i;
+
+   if (stat(RESOLV_CONF, &st[0]) != 0 || lstat(RESOLV_CONF, &st[1]) != 0) {
+      return FALSE;
+   }
+
+   /* Zero the padding too, keys are compared with memcmp. */
+   memset(key, 0, sizeof *key);
+   for (i = 0; i < ARRAYSIZE(st); i++) {
+      key->file[i].dev = st[i].st_dev;
+      key->file[i].ino = st[i].st_ino;
+      key->file[i].size = st[i].st_size;
+      key->file[i].mtime = st[i].st_mtime;
+      key->file[i].ctime = st[i].st_ctime;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * ResolverCacheStore --                                                 */ /**
+ *
+ * @brief Replaces the cached resolver settings.  Must be called with
+ *        @ref resolverCache locked.
+ *
+ * @param[in] key               Key of the resolv.conf @a dnsConfigInfo came
+ *                              from.
+ * @param[in] dnsConfigInfo     Settings to cache.  Not consumed.
+ *
+ ******************************************************************************
+ */
+
+static void
+ResolverCacheStore(const ResolverCacheKey *key,            // IN
+                   DnsConfigInfo *dnsConfigInfo)           // IN
+{
+   XDR xdrs;
+
+   free(resolverCache.data);
+   resolverCache.data = NULL;
+   resolverCache.dataLen = 0;
+
+   if (DynXdr_Create(&xdrs) == NULL) {
+      return;
+   }
+
+   if (xdr_DnsConfigInfo(&xdrs, dnsConfigInfo)) {
+      resolverCache.dataLen = xdr_getpos(&xdrs);
+      resolverCache.data = DynXdr_AllocGet(&xdrs);
+      resolverCache.key = *key;
+   }
+
+   DynXdr_Destroy(&xdrs, TRUE);
+}
+
+
 /*
  ******************************************************************************
  * RecordResolverInfo --                                                 */ /**
  *
  * @brief Query resolver(3), mapping settings to DnsConfigInfo.
  *
+ * resolv.conf rarely changes, so its settings are only re-read when it
+ * does; otherwise the ones from last time are reused.
+ *
  * @param[out] nicInfo  NicInfoV3 container.
  *
  * @retval TRUE         Values collected, attached to @a nicInfo.
@@ -541,26 +655,84 @@ RecordResolverInfo(NicInfoV3 *nicInfo)  // OUT
 {
    DnsConfigInfo *dnsConfigInfo = NULL;
    char namebuf[DNSINFO_MAX_ADDRLEN + 1];
-   char **s;
+   ResolverCacheKey key;
+   Bool haveKey;
 
-   if (res_init() == -1) {
+   if (!GuestInfoGetFqdn(sizeof namebuf, namebuf)) {
       return FALSE;
    }
 
-   dnsConfigInfo = Util_SafeCalloc(1, sizeof *dnsConfigInfo);
+   G_LOCK(resolverCache);
+
+   haveKey = ResolverCacheGetKey(&key);
+   if (haveKey &&
+       resolverCache.data != NULL &&
+       memcmp(&key, &resolverCache.key, sizeof key) == 0) {
+      dnsConfigInfo = Util_SafeCalloc(1, sizeof *dnsConfigInfo);
+      if (!XdrUtil_Deserialize(resolverCache.data, resolverCache.dataLen,
+                               xdr_DnsConfigInfo, dnsConfigInfo)) {
+         free(dnsConfigInfo);
+         dnsConfigInfo = NULL;
+      }
+   }
+
+   if (dnsConfigInfo == NULL) {
+      dnsConfigInfo = RecordResolverParse();
+      if (dnsConfigInfo == NULL) {
+         G_UNLOCK(resolverCache);
+         return FALSE;
+      }
+
+      if (haveKey) {
+         ResolverCacheStore(&key, dnsConfigInfo);
+      }
+   }
+
+   G_UNLOCK(resolverCache);
 
    /*
     * Copy in the host name.
     */
-   if (!GuestInfoGetFqdn(sizeof namebuf, namebuf)) {
-      goto fail;
-   }
+   ASSERT(dnsConfigInfo->hostName == NULL);
    dnsConfigInfo->hostName =
       Util_SafeCalloc(1, sizeof *dnsConfigInfo->hostName);
    *dnsConfigInfo->hostName = Util_SafeStrdup(namebuf);
 
    /*
-    * Repeat with the domain name.
+    * "Commit" dnsConfigInfo to nicInfo.
+    */
+   nicInfo->dnsConfigInfo = dnsConfigInfo;
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * RecordResolverParse --                                                */ /**
+ *
+ * @brief Has resolver(3) read resolv.conf and maps its settings to a new
+ *        DnsConfigInfo, less the host name.
+ *
+ * @return The settings, or NULL if resolver(3) failed.
+ *
+ ******************************************************************************
+ */
+
+static DnsConfigInfo *
+RecordResolverParse(void)
+{
+   DnsConfigInfo *dnsConfigInfo = NULL;
+   char **s;
+
+   if (res_init() == -1) {
+      return NULL;
+   }
+
+   dnsConfigInfo = Util_SafeCalloc(1, sizeof *dnsConfigInfo);
+
+   /*
+    * Domain name.
     */
    dnsConfigInfo->domainName =
       Util_SafeCalloc(1, sizeof *dnsConfigInfo->domainName);
@@ -589,17 +761,7 @@ RecordResolverInfo(NicInfoV3 *nicInfo)  // OUT
       *suffix = Util_SafeStrdup(*s);
    }
 
-   /*
-    * "Commit" dnsConfigInfo to nicInfo.
-    */
-   nicInfo->dnsConfigInfo = dnsConfigInfo;
-
-   return TRUE;
-
-fail:
-   VMX_XDR_FREE(xdr_DnsConfigInfo, dnsConfigInfo);
-   free(dnsConfigInfo);
-   return FALSE;
+   return dnsConfigInfo;
 }
 
 
@@ -699,6 +861,98 @@ RecordResolverNS(DnsConfigInfo *dnsConfigInfo) // IN
 #ifndef NO_DNET
 
 #ifdef USE_SLASH_PROC
+/*
+ * State for RecordRoutingFilter.  Routes come grouped by interface, so the
+ * last answer is remembered rather than looking the interface up every time.
+ */
+typedef struct RouteFilterData {
+   NicInfoV3 *nicInfo;
+   unsigned int lastIfIndex;
+   Bool lastResult;
+} RouteFilterData;
+
+
+/*
+ ******************************************************************************
+ * RecordRoutingFilter --                                                */ /**
+ *
+ * @brief Route filter for SlashProcNet_GetRouteNetlink: keeps only routes
+ * through NICs that are reported in @a clientData 's NicInfoV3.
+ *
+ * @param[in] ifIndex     Outgoing interface of the route.
+ * @param[in] clientData  RouteFilterData.
+ *
+ * @retval TRUE  Keep the route.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+RecordRoutingFilter(unsigned int ifIndex,
+                    void *clientData)
+{
+   RouteFilterData *data = clientData;
+   uint32_t nicIfIndex;
+
+   if (ifIndex != data->lastIfIndex) {
+      data->lastIfIndex = ifIndex;
+      data->lastResult = GuestInfoGetNicInfoIfIndex(data->nicInfo, ifIndex,
+                                                    &nicIfIndex);
+   }
+
+   return data->lastResult;
+}
+
+
+/*
+ ******************************************************************************
+ * RecordRoutingGetRoutes --                                             */ /**
+ *
+ * @brief Collects the routes of one address family, over rtnetlink if
+ * possible, or else from @c /proc/net.
+ *
+ * Over rtnetlink only routes through known NICs are kept, and no more than
+ * there is still room for in @a nicInfo, so a huge routing table (ex: one
+ * fed by BGP) doesn't cost more than the routes that will be reported.
+ *
+ * @param[in] nicInfo   NicInfoV3 container, with its NIC list populated.
+ * @param[in] family    AF_INET or AF_INET6.
+ *
+ * @return An array to free with SlashProcNet_FreeRoute (AF_INET) or
+ *         SlashProcNet_FreeRoute6 (AF_INET6), or NULL on failure.
+ *
+ ******************************************************************************
+ */
+
+static GPtrArray *
+RecordRoutingGetRoutes(NicInfoV3 *nicInfo,
+                       int family)
+{
+   RouteFilterData data = { nicInfo, 0, FALSE };
+   unsigned int room = NICINFO_MAX_ROUTES - nicInfo->routes.routes_len;
+   GPtrArray *routes;
+
+   /*
+    * /proc/net/route shows only the main table; /proc/net/ipv6_route shows
+    * all of them.  Stick to the same.
+    */
+   routes = SlashProcNet_GetRouteNetlink(family,
+                                         family == AF_INET ? RT_TABLE_MAIN
+                                                           : RT_TABLE_UNSPEC,
+                                         room,
+                                         RecordRoutingFilter,
+                                         &data);
+   if (routes != NULL) {
+      return routes;
+   }
+
+   g_debug("%s: falling back to /proc/net for family %d.\n", __FUNCTION__,
+           family);
+   return family == AF_INET ? SlashProcNet_GetRoute()
+                            : SlashProcNet_GetRoute6();
+}
+
+
 /*
  ******************************************************************************
  * RecordRoutingInfoIPv4 --                                              */ /**
@@ -724,7 +978,13 @@ RecordRoutingInfoIPv4(NicInfoV3 *nicInfo)
    guint i;
    Bool ret = FALSE;
 
-   if ((routes = SlashProcNet_GetRoute()) == NULL) {
+   if (nicInfo->routes.routes_len == NICINFO_MAX_ROUTES) {
+      g_message("%s: route limit (%d) reached, skipping overflow.",
+                __FUNCTION__, NICINFO_MAX_ROUTES);
+      return TRUE;
+   }
+
+   if ((routes = RecordRoutingGetRoutes(nicInfo, AF_INET)) == NULL) {
       return FALSE;
    }
 
@@ -814,7 +1074,13 @@ RecordRoutingInfoIPv6(NicInfoV3 *nicInfo)
    guint i;
    Bool ret = FALSE;
 
-   if ((routes = SlashProcNet_GetRoute6()) == NULL) {
+   if (nicInfo->routes.routes_len == NICINFO_MAX_ROUTES) {
+      g_message("%s: route limit (%d) reached, skipping overflow.",
+                __FUNCTION__, NICINFO_MAX_ROUTES);
+      return TRUE;
+   }
+
+   if ((routes = RecordRoutingGetRoutes(nicInfo, AF_INET6)) == NULL) {
       return FALSE;
    }
 
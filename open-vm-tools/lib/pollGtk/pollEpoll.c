@@ -0,0 +1,1136 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * pollEpoll.c -- a Poll implementation built on top of epoll(7).
+ *
+ * This is meant for headless processes with many AsyncSockets. PollGtk
+ * creates a GIOChannel and a GSource per file descriptor, so every main
+ * loop iteration hands all of them to poll(2), and looking a callback up
+ * for removal walks every registered entry. Here:
+ *
+ *  - all device callbacks live in one epoll set, which GLib sees as a
+ *    single file descriptor. Descriptors are registered edge-triggered and
+ *    one-shot, and re-armed after their callbacks have run; re-arming
+ *    reports whatever readiness the callback left behind, so callbacks
+ *    that don't drain their socket still fire again.
+ *
+ *  - real-time and main-loop callbacks are kept sorted by deadline and
+ *    driven by a single timerfd, which is a member of the same epoll set.
+ *
+ *  - entries are indexed by file descriptor and by client data, so
+ *    adding and removing a callback doesn't depend on how many others are
+ *    registered.
+ *
+ * As with PollGtk, any thread may add or remove callbacks; the callbacks
+ * themselves run on whichever thread dispatches the GLib main context (or
+ * calls Poll_LoopTimeout).
+ */
+
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include <glib.h>
+
+#include "pollImpl.h"
+#include "mutexRankLib.h"
+#include "err.h"
+
+#define LOGLEVEL_MODULE poll
+#include "loglevel_user.h"
+
+
+/* Maximum number of events fetched by a single epoll_wait(). */
+#define POLL_EPOLL_MAX_EVENTS 64
+
+struct PollEpollEntry;
+
+/*
+ * This describes a single callback waiting for an event
+ * or a timeout.
+ */
+typedef struct {
+   int                    flags;
+   PollerFunction         cb;
+   void                  *clientData;
+   PollClassSet           classSet;
+   MXUserRecLock         *cbLock;
+   struct PollEpollEntry *entry;      /* Entry this callback belongs to. */
+} PollEntryInfo;
+
+typedef struct PollEpollEntry {
+   PollEntryInfo  read;
+   PollEntryInfo  write;              /* Only used by POLL_DEVICE. */
+
+   PollEventType  type;
+   PollDevHandle  event;              /* POLL_DEVICE file descriptor or
+                                         POLL_REALTIME delay (us). */
+   gint64         deadline;           /* Timers: monotonic expiry time. */
+   GSequenceIter *timerIter;          /* Timers: position in timerQueue. */
+} PollEpollEntry;
+
+
+/*
+ * GSource that makes the GLib main loop dispatch the epoll set.
+ */
+typedef struct {
+   GSource  source;
+   GPollFD  pfd;
+} PollEpollSource;
+
+
+/*
+ * The global Poll state.
+ */
+typedef struct Poll {
+   MXUserExclLock *lock;
+
+   int             epollFd;
+   int             timerFd;
+   GSource        *source;
+
+   GHashTable     *deviceTable;       /* fd -> PollEpollEntry */
+   GHashTable     *cbTable;           /* clientData -> GSList of
+                                         PollEntryInfo */
+   GSequence      *timerQueue;        /* PollEpollEntry, by deadline */
+} Poll;
+
+static Poll *pollState;
+
+
+#define ASSERT_POLL_LOCKED()                                    \
+   ASSERT(!pollState || !pollState->lock ||                     \
+          MXUser_IsCurThreadHoldingExclLock(pollState->lock))
+
+#define LOG_INFO(_l, _str, _i)                                                \
+   LOG(_l, ("POLL: entry %p (cb %p, data %p, flags %x, type %x)" _str,        \
+            (_i)->entry, (_i)->cb, (_i)->clientData, (_i)->flags,             \
+            (_i)->entry->type))
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * PollEpollLock --
+ * PollEpollUnlock --
+ *
+ *      Locking of the internal poll state.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static INLINE void
+PollEpollLock(void)
+{
+   MXUser_AcquireExclLock(pollState->lock);
+}
+
+
+static INLINE void
+PollEpollUnlock(void)
+{
+   MXUser_ReleaseExclLock(pollState->lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollTimerCompare --
+ *
+ *      GSequence comparison function ordering timers by deadline.
+ *
+ * Results:
+ *      <0, 0 or >0 as a expires before, with or after b.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static gint
+PollEpollTimerCompare(gconstpointer a,   // IN
+                      gconstpointer b,   // IN
+                      gpointer data)     // IN: unused
+{
+   const PollEpollEntry *ea = a;
+   const PollEpollEntry *eb = b;
+
+   return ea->deadline < eb->deadline ? -1 : ea->deadline > eb->deadline;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollArmTimer --
+ *
+ *      Program the timerfd to expire when the earliest timer is due, or
+ *      disarm it if there are no timers.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollArmTimer(void)
+{
+   Poll *poll = pollState;
+   GSequenceIter *first;
+   struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+
+   ASSERT_POLL_LOCKED();
+
+   first = g_sequence_get_begin_iter(poll->timerQueue);
+   if (!g_sequence_iter_is_end(first)) {
+      const PollEpollEntry *entry = g_sequence_get(first);
+      gint64 delay = entry->deadline - g_get_monotonic_time();
+
+      /* An all-zero it_value would disarm the timer. */
+      delay = MAX(delay, 1);
+      its.it_value.tv_sec = delay / G_USEC_PER_SEC;
+      its.it_value.tv_nsec = (delay % G_USEC_PER_SEC) * 1000;
+   }
+
+   if (timerfd_settime(poll->timerFd, 0, &its, NULL) != 0) {
+      Warning("POLL: timerfd_settime failed: %s\n", Err_ErrString());
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollArmDevice --
+ *
+ *      Register (or re-arm) the file descriptor of a device entry in the
+ *      epoll set, waiting for the directions it has callbacks for.
+ *
+ * Results:
+ *      TRUE on success, FALSE if epoll refused the descriptor.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+PollEpollArmDevice(PollEpollEntry *entry,   // IN
+                   int op)                  // IN: EPOLL_CTL_ADD/MOD
+{
+   struct epoll_event ev;
+   int ret;
+
+   ASSERT_POLL_LOCKED();
+   ASSERT(entry->type == POLL_DEVICE);
+
+   ev.events = EPOLLET | EPOLLONESHOT;
+   if (entry->read.cb != NULL) {
+      ev.events |= EPOLLIN | EPOLLPRI;
+   }
+   if (entry->write.cb != NULL) {
+      ev.events |= EPOLLOUT;
+   }
+   ev.data.u64 = 0;
+   ev.data.fd = entry->event;
+
+   ret = epoll_ctl(pollState->epollFd, op, entry->event, &ev);
+   if (ret != 0 && (errno == ENOENT || errno == EEXIST)) {
+      /*
+       * The kernel drops closed descriptors from the set on its own, so
+       * our idea of what is registered can be stale.
+       */
+      op = op == EPOLL_CTL_ADD ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+      ret = epoll_ctl(pollState->epollFd, op, entry->event, &ev);
+   }
+
+   return ret == 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollLinkInfo --
+ * PollEpollUnlinkInfo --
+ *
+ *      Add/remove a callback to/from the client data index.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollLinkInfo(PollEntryInfo *info)  // IN
+{
+   GHashTable *table = pollState->cbTable;
+   GSList *list;
+
+   ASSERT_POLL_LOCKED();
+   list = g_hash_table_lookup(table, info->clientData);
+   g_hash_table_replace(table, info->clientData, g_slist_prepend(list, info));
+}
+
+
+static void
+PollEpollUnlinkInfo(PollEntryInfo *info)  // IN
+{
+   GHashTable *table = pollState->cbTable;
+   GSList *list;
+
+   ASSERT_POLL_LOCKED();
+   list = g_hash_table_lookup(table, info->clientData);
+   list = g_slist_remove(list, info);
+   if (list != NULL) {
+      g_hash_table_replace(table, info->clientData, list);
+   } else {
+      g_hash_table_remove(table, info->clientData);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollRemoveInfo --
+ *
+ *      Remove a single callback. The entry it belongs to is freed once it
+ *      has no callbacks left.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      info (and possibly its entry) must not be used after this returns.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollRemoveInfo(PollEntryInfo *info)  // IN
+{
+   Poll *poll = pollState;
+   PollEpollEntry *entry = info->entry;
+
+   ASSERT_POLL_LOCKED();
+   LOG_INFO(2, " to be removed\n", info);
+
+   PollEpollUnlinkInfo(info);
+   info->flags = 0;
+   info->cb = NULL;
+   info->clientData = NULL;
+   info->cbLock = NULL;
+
+   if (entry->type == POLL_DEVICE) {
+      if (entry->read.cb == NULL && entry->write.cb == NULL) {
+         /* Fails harmlessly if the descriptor was already closed. */
+         epoll_ctl(poll->epollFd, EPOLL_CTL_DEL, entry->event, NULL);
+         g_hash_table_remove(poll->deviceTable,
+                             (gpointer)(intptr_t)entry->event);
+         g_free(entry);
+      } else if (!PollEpollArmDevice(entry, EPOLL_CTL_MOD)) {
+         LOG(1, ("POLL: could not re-arm fd %d: %s\n", (int)entry->event,
+                 Err_ErrString()));
+      }
+   } else {
+      /*
+       * The timerfd is not reprogrammed; if this was the earliest timer,
+       * the next expiry finds nothing due and re-arms for the new head.
+       */
+      g_sequence_remove(entry->timerIter);
+      g_free(entry);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollFindInfo --
+ *
+ *      Look up a registered callback.
+ *
+ *      The lookup is done through the client data index. Only
+ *      Poll_CallbackRemoveOneByCB, which matches any client data, has to
+ *      look at every registered callback.
+ *
+ * Results:
+ *      The matching callback, or NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static PollEntryInfo *
+PollEpollFindInfo(PollClassSet classSet,     // IN
+                  int flags,                 // IN
+                  PollerFunction f,          // IN
+                  void *clientData,          // IN
+                  Bool matchAnyClientData,   // IN
+                  PollEventType type)        // IN
+{
+   GHashTableIter iter;
+   gpointer value;
+   GSList *lists = NULL;
+   GSList *cur;
+   PollEntryInfo *found = NULL;
+
+   ASSERT_POLL_LOCKED();
+
+   if (matchAnyClientData) {
+      g_hash_table_iter_init(&iter, pollState->cbTable);
+      while (g_hash_table_iter_next(&iter, NULL, &value)) {
+         lists = g_slist_prepend(lists, value);
+      }
+   } else {
+      value = g_hash_table_lookup(pollState->cbTable, clientData);
+      if (value != NULL) {
+         lists = g_slist_prepend(lists, value);
+      }
+   }
+
+   while (lists != NULL && found == NULL) {
+      for (cur = lists->data; cur != NULL; cur = g_slist_next(cur)) {
+         PollEntryInfo *info = cur->data;
+
+         if (info->cb == f && info->flags == flags &&
+             info->entry->type == type &&
+             PollClassSet_Equals(info->classSet, classSet)) {
+            found = info;
+            break;
+         }
+      }
+      lists = g_slist_delete_link(lists, lists);
+   }
+   g_slist_free(lists);
+
+   return found;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollFire --
+ *
+ *      Fire a callback. Non-periodic callbacks are removed first, in case
+ *      the callback re-registers itself. Called with the poll lock held;
+ *      the lock is dropped while the callback runs.
+ *
+ * Results:
+ *      TRUE if the callback fired, FALSE if its lock was busy.
+ *
+ * Side effects:
+ *      Depends on the callback. info may be gone when this returns.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+PollEpollFire(PollEntryInfo *info)  // IN
+{
+   PollerFunction cb = info->cb;
+   void *clientData = info->clientData;
+   MXUserRecLock *cbLock = info->cbLock;
+
+   ASSERT_POLL_LOCKED();
+
+   if (cbLock != NULL && !MXUser_TryAcquireRecLock(cbLock)) {
+      LOG_INFO(3, " did not fire\n", info);
+      return FALSE;
+   }
+
+   LOG_INFO(3, " about to fire\n", info);
+   if ((info->flags & POLL_FLAG_PERIODIC) == 0) {
+      PollEpollRemoveInfo(info);
+   }
+
+   PollEpollUnlock();
+   cb(clientData);
+   if (cbLock != NULL) {
+      MXUser_ReleaseRecLock(cbLock);
+   }
+   PollEpollLock();
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollFireDevice --
+ *
+ *      Fire the callbacks of a file descriptor reported by epoll, then
+ *      re-arm it.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Depends on the callbacks.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollFireDevice(int fd,          // IN
+                    uint32 events)   // IN: EPOLL* events
+{
+   GHashTable *table = pollState->deviceTable;
+   PollEpollEntry *entry;
+
+   PollEpollLock();
+
+   /*
+    * Each callback may add or remove callbacks for this descriptor, so the
+    * entry is looked up again every time the lock has been dropped.
+    */
+   entry = g_hash_table_lookup(table, (gpointer)(intptr_t)fd);
+   if (entry != NULL && entry->read.cb != NULL &&
+       (events & (EPOLLIN | EPOLLPRI | EPOLLERR | EPOLLHUP)) != 0) {
+      PollEpollFire(&entry->read);
+      entry = g_hash_table_lookup(table, (gpointer)(intptr_t)fd);
+   }
+   if (entry != NULL && entry->write.cb != NULL &&
+       (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) != 0) {
+      PollEpollFire(&entry->write);
+      entry = g_hash_table_lookup(table, (gpointer)(intptr_t)fd);
+   }
+
+   /*
+    * A callback that did not fire because its lock was busy is reported
+    * again right away, as with PollGtk on Posix.
+    */
+   if (entry != NULL && !PollEpollArmDevice(entry, EPOLL_CTL_MOD)) {
+      LOG(1, ("POLL: could not re-arm fd %d: %s\n", fd, Err_ErrString()));
+   }
+
+   PollEpollUnlock();
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollFireTimers --
+ *
+ *      Fire all timers that are due, then re-arm the timerfd.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Depends on the callbacks.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollFireTimers(void)
+{
+   Poll *poll = pollState;
+   uint64 expirations;
+   gint64 now;
+
+   /* Non-blocking; just clears the readiness of the timerfd. */
+   if (read(poll->timerFd, &expirations, sizeof expirations) < 0 &&
+       errno != EAGAIN) {
+      LOG(1, ("POLL: timerfd read failed: %s\n", Err_ErrString()));
+   }
+
+   PollEpollLock();
+
+   now = g_get_monotonic_time();
+   for (;;) {
+      GSequenceIter *first = g_sequence_get_begin_iter(poll->timerQueue);
+      PollEpollEntry *entry;
+      gint64 next;
+
+      if (g_sequence_iter_is_end(first)) {
+         break;
+      }
+      entry = g_sequence_get(first);
+      if (entry->deadline > now) {
+         break;
+      }
+
+      /*
+       * Periodic timers are rescheduled before firing, and timers whose
+       * lock is busy are retried as 0-delay timers. Both land after "now"
+       * so that this loop ends.
+       */
+      next = g_get_monotonic_time() + 1;
+      if ((entry->read.flags & POLL_FLAG_PERIODIC) != 0) {
+         entry->deadline = next + entry->event;
+         g_sequence_sort_changed(entry->timerIter, PollEpollTimerCompare,
+                                 NULL);
+      }
+      if (!PollEpollFire(&entry->read)) {
+         entry->deadline = next;
+         g_sequence_sort_changed(entry->timerIter, PollEpollTimerCompare,
+                                 NULL);
+      }
+   }
+
+   PollEpollArmTimer();
+   PollEpollUnlock();
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollDispatch --
+ *
+ *      Wait for events on the epoll set and fire the callbacks.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Depends on the callbacks.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollDispatch(int timeout)   // IN: ms, as epoll_wait()
+{
+   struct epoll_event events[POLL_EPOLL_MAX_EVENTS];
+   int n;
+   int i;
+
+   n = epoll_wait(pollState->epollFd, events, ARRAYSIZE(events), timeout);
+   if (n < 0) {
+      if (errno != EINTR) {
+         Warning("POLL: epoll_wait failed: %s\n", Err_ErrString());
+      }
+      return;
+   }
+
+   for (i = 0; i < n; i++) {
+      if (events[i].data.fd == pollState->timerFd) {
+         PollEpollFireTimers();
+      } else {
+         PollEpollFireDevice(events[i].data.fd, events[i].events);
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollSourcePrepare --
+ * PollEpollSourceCheck --
+ * PollEpollSourceDispatch --
+ *
+ *      GSource functions for the epoll set. Timeouts are handled by the
+ *      timerfd, so the source never asks GLib for one.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static gboolean
+PollEpollSourcePrepare(GSource *src,    // IN
+                       gint *timeout)   // OUT
+{
+   *timeout = -1;
+   return FALSE;
+}
+
+
+static gboolean
+PollEpollSourceCheck(GSource *src)   // IN
+{
+   PollEpollSource *source = (PollEpollSource *)src;
+
+   return (source->pfd.revents & G_IO_IN) != 0;
+}
+
+
+static gboolean
+PollEpollSourceDispatch(GSource *src,          // IN
+                        GSourceFunc callback,  // IN: unused
+                        gpointer data)         // IN: unused
+{
+   PollEpollDispatch(0);
+   return TRUE;
+}
+
+
+static GSourceFuncs pollEpollSourceFuncs = {
+   PollEpollSourcePrepare,
+   PollEpollSourceCheck,
+   PollEpollSourceDispatch,
+   NULL,
+};
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollInit --
+ *
+ *      Module initialization.
+ *
+ * Results:
+ *       None
+ *
+ * Side effects:
+ *       Initializes the module-wide state and sets pollState. Attaches
+ *       the epoll set to the default GLib main context.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollInit(void)
+{
+   Poll *poll;
+   PollEpollSource *source;
+   struct epoll_event ev;
+
+   ASSERT(pollState == NULL);
+   poll = g_new0(Poll, 1);
+
+   poll->lock = MXUser_CreateExclLock("pollEpollLock",
+                                      RANK_pollDefaultLock);
+
+   poll->epollFd = epoll_create1(EPOLL_CLOEXEC);
+   if (poll->epollFd < 0) {
+      Panic("POLL: epoll_create1 failed: %s\n", Err_ErrString());
+   }
+   poll->timerFd = timerfd_create(CLOCK_MONOTONIC,
+                                  TFD_NONBLOCK | TFD_CLOEXEC);
+   if (poll->timerFd < 0) {
+      Panic("POLL: timerfd_create failed: %s\n", Err_ErrString());
+   }
+   ev.events = EPOLLIN;
+   ev.data.u64 = 0;
+   ev.data.fd = poll->timerFd;
+   if (epoll_ctl(poll->epollFd, EPOLL_CTL_ADD, poll->timerFd, &ev) != 0) {
+      Panic("POLL: cannot add timerfd to epoll set: %s\n", Err_ErrString());
+   }
+
+   poll->deviceTable = g_hash_table_new(g_direct_hash, g_direct_equal);
+   poll->cbTable = g_hash_table_new(g_direct_hash, g_direct_equal);
+   poll->timerQueue = g_sequence_new(NULL);
+
+   pollState = poll;
+
+   source = (PollEpollSource *)g_source_new(&pollEpollSourceFuncs,
+                                            sizeof *source);
+   source->pfd.fd = poll->epollFd;
+   source->pfd.events = G_IO_IN;
+   g_source_add_poll(&source->source, &source->pfd);
+   g_source_attach(&source->source, NULL);
+   poll->source = &source->source;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollExit --
+ *
+ *      Module exit.
+ *
+ * Results:
+ *       None
+ *
+ * Side effects:
+ *       Discards the module-wide state and clears pollState.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollExit(void)
+{
+   Poll *poll = pollState;
+   GHashTableIter iter;
+   gpointer value;
+
+   ASSERT(poll != NULL);
+
+   g_source_destroy(poll->source);
+   g_source_unref(poll->source);
+
+   PollEpollLock();
+   g_hash_table_iter_init(&iter, poll->deviceTable);
+   while (g_hash_table_iter_next(&iter, NULL, &value)) {
+      g_free(value);
+   }
+   g_hash_table_destroy(poll->deviceTable);
+   g_hash_table_iter_init(&iter, poll->cbTable);
+   while (g_hash_table_iter_next(&iter, NULL, &value)) {
+      g_slist_free(value);
+   }
+   g_hash_table_destroy(poll->cbTable);
+   g_sequence_foreach(poll->timerQueue, (GFunc)g_free, NULL);
+   g_sequence_free(poll->timerQueue);
+   close(poll->timerFd);
+   close(poll->epollFd);
+   PollEpollUnlock();
+
+   MXUser_DestroyExclLock(poll->lock);
+
+   g_free(poll);
+   pollState = NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollLoopTimeout --
+ *
+ *       The poll loop, for programs that don't run a GLib main loop.
+ *       Callback classes are not distinguished.
+ *
+ * Result:
+ *       Void.
+ *
+ * Side effects:
+ *       Fires callbacks.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollLoopTimeout(Bool loop,          // IN: loop forever if TRUE, else do one pass.
+                     Bool *exit,         // IN: NULL or set to TRUE to end loop.
+                     PollClass class,    // IN: class of events (POLL_CLASS_*)
+                     int timeout)        // IN: maximum time to sleep (us)
+{
+   /* Round up so that a short timeout does not become a busy loop. */
+   int timeoutMs = timeout < 0 ? -1 : (timeout + 999) / 1000;
+
+   do {
+      PollEpollDispatch(timeoutMs);
+   } while (loop && (exit == NULL || !*exit));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollCallbackRemoveInt --
+ *
+ *      Remove a callback.
+ *
+ * Results:
+ *      TRUE if entry found and removed, FALSE otherwise
+ *
+ * Side effects:
+ *      A callback may be modified instead of completely removed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+PollEpollCallbackRemoveInt(PollClassSet classSet,           // IN
+                           int flags,                       // IN
+                           PollerFunction f,                // IN
+                           void *clientData,                // IN
+                           Bool matchAnyClientData,         // IN
+                           PollEventType type,              // IN
+                           void **foundClientData)          // OUT
+{
+   PollEntryInfo *info;
+
+   ASSERT(pollState);
+   ASSERT(!clientData || !matchAnyClientData);
+   ASSERT(type >= 0 && type < POLL_NUM_QUEUES);
+   ASSERT(foundClientData);
+
+   switch (type) {
+   case POLL_REALTIME:
+   case POLL_MAIN_LOOP:
+   case POLL_DEVICE:
+      break;
+   case POLL_VIRTUALREALTIME:
+   case POLL_VTIME:
+   default:
+      NOT_IMPLEMENTED();
+   }
+
+   PollEpollLock();
+
+   info = PollEpollFindInfo(classSet, flags, f, clientData,
+                            matchAnyClientData, type);
+   if (info != NULL) {
+      *foundClientData = info->clientData;
+      PollEpollRemoveInfo(info);
+   } else {
+      LOG(1, ("POLL: no matching entry for cb %p, data %p, flags %x, type %x\n",
+              f, clientData, flags, type));
+   }
+
+   PollEpollUnlock();
+   return info != NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollCallbackRemove --
+ *
+ *      Remove a callback.
+ *
+ * Results:
+ *      TRUE if entry found and removed, FALSE otherwise
+ *
+ * Side effects:
+ *      A callback may be modified instead of completely removed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+PollEpollCallbackRemove(PollClassSet classSet,   // IN
+                        int flags,               // IN
+                        PollerFunction f,        // IN
+                        void *clientData,        // IN
+                        PollEventType type)      // IN
+{
+   void *foundClientData;
+
+   return PollEpollCallbackRemoveInt(classSet, flags, f, clientData, FALSE,
+                                     type, &foundClientData);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollCallbackRemoveOneByCB --
+ *
+ *      Remove a callback.
+ *
+ * Results:
+ *      TRUE if entry found and removed (*clientData updated), FALSE otherwise
+ *
+ * Side effects:
+ *      A callback may be modified instead of completely removed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+PollEpollCallbackRemoveOneByCB(PollClassSet classSet,   // IN
+                               int flags,               // IN
+                               PollerFunction f,        // IN
+                               PollEventType type,      // IN
+                               void **clientData)       // OUT
+{
+   return PollEpollCallbackRemoveInt(classSet, flags, f, NULL, TRUE, type,
+                                     clientData);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollCallback --
+ *
+ *      For the POLL_REALTIME or POLL_DEVICE queues, entries can be
+ *      inserted for good, to fire on a periodic basis (by setting the
+ *      POLL_FLAG_PERIODIC flag).
+ *
+ *      Otherwise, the callback fires only once.
+ *
+ *      For periodic POLL_REALTIME callbacks, "info" is the time in
+ *      microseconds between execution of the callback.  For
+ *      POLL_DEVICE callbacks, info is a file descriptor.
+ *
+ * Results:
+ *      VMWARE_STATUS_SUCCESS, or VMWARE_STATUS_ERROR if the descriptor
+ *      cannot be polled by epoll (e.g. a regular file).
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static VMwareStatus
+PollEpollCallback(PollClassSet classSet,   // IN
+                  int flags,               // IN
+                  PollerFunction f,        // IN
+                  void *clientData,        // IN
+                  PollEventType type,      // IN
+                  PollDevHandle info,      // IN
+                  MXUserRecLock *lock)     // IN
+{
+   VMwareStatus result = VMWARE_STATUS_SUCCESS;
+   Poll *poll = pollState;
+   PollEpollEntry *entry;
+   PollEntryInfo *cbInfo;
+
+   ASSERT(f);
+   ASSERT(poll != NULL);
+
+   /*
+    * Every callback must be in POLL_CLASS_MAIN (plus possibly others)
+    */
+   ASSERT(PollClassSet_IsMember(classSet, POLL_CLASS_MAIN) != 0);
+   ASSERT(type >= 0 && type < POLL_NUM_QUEUES);
+
+   PollEpollLock();
+
+   switch (type) {
+   case POLL_MAIN_LOOP:
+      ASSERT(info == 0);
+      /* Fall-through */
+   case POLL_REALTIME:
+      ASSERT(info == (uint32)info);
+      ASSERT(info >= 0);
+      ASSERT((flags & POLL_FLAG_WRITE) == 0);
+
+      entry = g_new0(PollEpollEntry, 1);
+      entry->type = type;
+      entry->event = info;
+      entry->deadline = g_get_monotonic_time() + info;
+      cbInfo = &entry->read;
+      break;
+
+   case POLL_DEVICE:
+      entry = g_hash_table_lookup(poll->deviceTable, (gpointer)(intptr_t)info);
+      if (entry == NULL) {
+         entry = g_new0(PollEpollEntry, 1);
+         entry->type = type;
+         entry->event = info;
+         entry->read.entry = entry;
+         entry->write.entry = entry;
+         g_hash_table_insert(poll->deviceTable, (gpointer)(intptr_t)info,
+                             entry);
+      }
+      ASSERT(entry->type == type);
+      ASSERT(entry->event == info);
+      cbInfo = (flags & POLL_FLAG_WRITE) ? &entry->write : &entry->read;
+      ASSERT(cbInfo->cb == NULL);
+      break;
+
+   case POLL_VIRTUALREALTIME:
+   case POLL_VTIME:
+   default:
+      NOT_IMPLEMENTED();
+   }
+
+   cbInfo->flags = flags;
+   cbInfo->cb = f;
+   cbInfo->clientData = clientData;
+   cbInfo->cbLock = lock;
+   cbInfo->classSet = classSet;
+   cbInfo->entry = entry;
+   PollEpollLinkInfo(cbInfo);
+   LOG_INFO(2, " is being added\n", cbInfo);
+
+   if (type == POLL_DEVICE) {
+      /*
+       * Both new descriptors and descriptors getting their second callback
+       * go through ADD/MOD, which reports readiness that predates this
+       * call.
+       */
+      if (!PollEpollArmDevice(entry, EPOLL_CTL_MOD)) {
+         Warning("POLL: cannot poll fd %d: %s\n", (int)info, Err_ErrString());
+         PollEpollRemoveInfo(cbInfo);
+         result = VMWARE_STATUS_ERROR;
+      }
+   } else {
+      entry->timerIter = g_sequence_insert_sorted(poll->timerQueue, entry,
+                                                  PollEpollTimerCompare,
+                                                  NULL);
+      if (g_sequence_iter_is_begin(entry->timerIter)) {
+         PollEpollArmTimer();
+      }
+   }
+
+   PollEpollUnlock();
+
+   return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Poll_InitEpoll --
+ *
+ *      Public init function for this Poll implementation. Callbacks are
+ *      dispatched from the default GLib main context, or by
+ *      Poll_LoopTimeout for programs that don't run one.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+Poll_InitEpoll(void)
+{
+   static volatile gsize inited = 0;
+
+   static const PollImpl epollImpl =
+   {
+      PollEpollInit,
+      PollEpollExit,
+      PollEpollLoopTimeout,
+      PollEpollCallback,
+      PollEpollCallbackRemove,
+      PollEpollCallbackRemoveOneByCB,
+      PollLockingAlwaysEnabled,
+   };
+
+   if (g_once_init_enter(&inited)) {
+      gsize didInit = 1;
+      Poll_InitWithImpl(&epollImpl);
+      g_once_init_leave(&inited, didInit);
+   }
+}
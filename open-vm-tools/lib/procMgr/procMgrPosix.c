@@ -47,6 +47,11 @@
 #include <time.h>
 #include <grp.h>
 #include <sys/syscall.h>
+#if defined(linux) && !defined(USERWORLD)
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#endif
 #if defined(linux) || defined(__FreeBSD__) || defined(HAVE_SYS_USER_H)
 // sys/param.h is required on FreeBSD before sys/user.h
 #   include <sys/param.h>
@@ -75,6 +80,7 @@
 #include "file.h"
 #include "dynbuf.h"
 #include "dynarray.h"
+#include "hashTable.h"
 #include "su.h"
 #include "str.h"
 #include "strutil.h"
@@ -114,6 +120,7 @@ struct ProcMgr_AsyncProc {
 };
 
 static pid_t ProcMgrStartProcess(char const *cmd,
+                                 char * const *argv,
                                  char * const  *envp,
                                  char const *workingDir);
 
@@ -139,6 +146,34 @@ Bool ProcMgr_PromoteEffectiveToReal(void);
 #define  BASH_PATH "/bin/bash"
 #endif
 
+#if defined(linux) && !defined(USERWORLD)
+/*
+ * Programs are started with a vfork()-style clone() rather than fork(): the
+ * child borrows the parent's address space until it execs, so starting a
+ * program doesn't copy the page tables of a large process, nor take COW
+ * faults on its memory afterwards.
+ *
+ * The child runs on a stack of its own, with the parent's calling thread
+ * suspended. It must not allocate memory, take locks or return; everything
+ * it needs is prepared beforehand.
+ */
+#define PROCMGR_SPAWN_STACK_SIZE  (64 * 1024)
+
+#ifndef MAP_STACK
+#define MAP_STACK 0
+#endif
+
+typedef struct ProcMgrSpawnArgs {
+   char const *path;
+   char * const *argv;
+   char * const *envp;          // NULL to use the current environment
+   char const *workingDir;      // NULL to stay in the current directory
+   sigset_t sigMask;            // The parent's, restored in the child
+   int chdirError;              // OUT: errno of a failed chdir()
+   int execError;               // OUT: errno of a failed exec
+} ProcMgrSpawnArgs;
+#endif
+
 
 /*
  *----------------------------------------------------------------------
@@ -223,6 +258,367 @@ done:
 }
 
 
+/*
+ * The process table kept across ProcMgr_ListProcesses() calls, keyed by pid.
+ * A pid's command line and name are only read when the pid is new, or when
+ * its start time changed (i.e., the pid was reused). The table is thrown
+ * away when the effective uid changes, since what the caller may see depends
+ * on it.
+ */
+typedef struct ProcMgrCachedProc {
+   unsigned long long startTime;   // clock ticks since boot
+   uint32 generation;              // last listing the pid was seen in
+   uid_t uid;
+   char *cmdName;                  // UTF-8, NULL if the process has no name
+   char *cmdLine;                  // UTF-8
+   char *owner;                    // UTF-8
+} ProcMgrCachedProc;
+
+#define PROCMGR_CACHE_BUCKETS 4096
+
+static HashTable *procMgrCache = NULL;
+static uid_t procMgrCacheUid;
+static uint32 procMgrCacheGeneration = 0;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrFreeCachedProc --
+ *
+ *      Frees a process table entry.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ProcMgrFreeCachedProc(void *data)  // IN
+{
+   ProcMgrCachedProc *proc = data;
+
+   free(proc->cmdName);
+   free(proc->cmdLine);
+   free(proc->owner);
+   free(proc);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrCollectStale --
+ *
+ *      HashTable_ForEach callback: collects the pids that weren't seen in
+ *      the current listing.
+ *
+ * Results:
+ *      0, to keep iterating.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ProcMgrCollectStale(const char *key,    // IN
+                    void *value,        // IN
+                    void *clientData)   // IN/OUT
+{
+   ProcMgrCachedProc *proc = value;
+
+   if (proc->generation != procMgrCacheGeneration) {
+      DynBuf_Append(clientData, &key, sizeof key);
+   }
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrReadCmdLine --
+ *
+ *      Reads the command line of a process, and works out its name.
+ *
+ *      Arguments are separated by \0, which we convert to ' '.  Then we add
+ *      a NULL terminator at the end.  Example: "perl -cw try.pl" is read in
+ *      as "perl\0-cw\0try.pl\0", which we convert to "perl -cw try.pl\0".
+ *      It would have been nice to preserve the NUL character so it is easy
+ *      to determine what the command line arguments are without
+ *      using a quote and space parsing heuristic.  But we do this
+ *      to have parity with how Windows reports the command line.
+ *      In the future, we could keep the NUL version around and pass it
+ *      back to the client for easier parsing when retrieving individual
+ *      command line parameters is needed.
+ *
+ * Results:
+ *      TRUE on success, FALSE if the process should not be listed.
+ *
+ * Side effects:
+ *      The returned strings must be freed by caller.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrReadCmdLine(const char *pidStr,   // IN
+                   char **cmdName,       // OUT: NULL if none
+                   char **cmdLine)       // OUT
+{
+   char cmdFilePath[1024];
+   int numRead = 0;   /* number of bytes that read() actually read */
+   int cmdFd;
+   int replaceLoop;
+   char *cmdLineTemp = NULL;
+   char *cmdNameBegin;
+   Bool cmdNameLookup = TRUE;
+
+   *cmdName = NULL;
+   *cmdLine = NULL;
+
+   if (snprintf(cmdFilePath,
+                sizeof cmdFilePath,
+                "/proc/%s/cmdline",
+                pidStr) == -1) {
+      Debug("Giant process id '%s'\n", pidStr);
+      return FALSE;
+   }
+
+   cmdFd = open(cmdFilePath, O_RDONLY);
+   if (-1 == cmdFd) {
+      /*
+       * We may not be able to open the file due to the security reason.
+       * In that case, just ignore and continue.
+       */
+      return FALSE;
+   }
+
+   numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
+   close(cmdFd);
+
+   if (numRead < 0) {
+      return FALSE;
+   }
+
+   if (numRead > 0) {
+      /*
+       * Stop before we hit the final '\0'; want to leave it alone.
+       */
+      for (replaceLoop = 0 ; replaceLoop < (numRead - 1) ; replaceLoop++) {
+         if ('\0' == cmdLineTemp[replaceLoop]) {
+            if (cmdNameLookup) {
+               /*
+                * Store the command name.
+                * Find the last path separator, to get the cmd name.
+                * If no separator is found, then use the whole name.
+                */
+               cmdNameBegin = strrchr(cmdLineTemp, '/');
+               if (NULL == cmdNameBegin) {
+                  cmdNameBegin = cmdLineTemp;
+               } else {
+                  /*
+                   * Skip over the last separator.
+                   */
+                  cmdNameBegin++;
+               }
+               *cmdName = Unicode_Alloc(cmdNameBegin, STRING_ENCODING_DEFAULT);
+               cmdNameLookup = FALSE;
+            }
+            cmdLineTemp[replaceLoop] = ' ';
+         }
+      }
+   } else {
+      /*
+       * Some procs don't have a command line text, so read a name from
+       * the 'status' file (should be the first line). If unable to get a name,
+       * the process is still real, so it should be included in the list, just
+       * without a name.
+       */
+      cmdFd = -1;
+      numRead = 0;
+
+      if (snprintf(cmdFilePath,
+                   sizeof cmdFilePath,
+                   "/proc/%s/status",
+                   pidStr) != -1) {
+         cmdFd = open(cmdFilePath, O_RDONLY);
+      }
+      if (cmdFd != -1) {
+         numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
+         close(cmdFd);
+      }
+      if (numRead > 0) {
+         /*
+          * Extract the part with just the name, by reading until the first
+          * space, then reading the next non-space word after that, and
+          * ignoring everything else. The format looks like this:
+          *     "^Name:[ \t]*(.*)$"
+          * for example:
+          *     "Name:    nfsd"
+          */
+         const char *nameStart;
+         char *copyItr;
+
+         /* Skip non-whitespace. */
+         for (nameStart = cmdLineTemp; *nameStart &&
+                                       *nameStart != ' ' &&
+                                       *nameStart != '\t' &&
+                                       *nameStart != '\n'; ++nameStart);
+         /* Skip whitespace. */
+         for (;*nameStart &&
+               (*nameStart == ' ' ||
+                *nameStart == '\t' ||
+                *nameStart == '\n'); ++nameStart);
+         /* Copy the name to the start of the string and null term it. */
+         for (copyItr = cmdLineTemp; *nameStart && *nameStart != '\n';) {
+            *(copyItr++) = *(nameStart++);
+         }
+         *copyItr = '\0';
+         /*
+          * Store the command name.
+          */
+         *cmdName = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
+      }
+   }
+
+   /*
+    * Store the command line string pointer in dynbuf.
+    */
+   if (cmdLineTemp) {
+      *cmdLine = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
+   } else {
+      *cmdLine = Unicode_Alloc("", STRING_ENCODING_UTF8);
+   }
+
+   free(cmdLineTemp);
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrReadStartTime --
+ *
+ *      Reads the start time of a process from /proc/<pid>/stat.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrReadStartTime(const char *pidStr,                   // IN
+                     unsigned long long *relativeStartTime)  // OUT
+{
+   char cmdFilePath[1024];
+   char *cmdStatTemp = NULL;
+   char *stringBegin;
+   unsigned long long dummy;
+   int numberFound;
+   int numRead;
+   int cmdFd;
+
+   if (snprintf(cmdFilePath,
+                sizeof cmdFilePath,
+                "/proc/%s/stat",
+                pidStr) == -1) {
+      Debug("Giant process id '%s'\n", pidStr);
+      return FALSE;
+   }
+   cmdFd = open(cmdFilePath, O_RDONLY);
+   if (-1 == cmdFd) {
+      return FALSE;
+   }
+   numRead = ProcMgr_ReadProcFile(cmdFd, &cmdStatTemp);
+   close(cmdFd);
+   if (0 >= numRead) {
+      free(cmdStatTemp);
+      return FALSE;
+   }
+
+   /*
+    * Skip over initial process id and process name.  "123 (bash) [...]".
+    * The name may itself contain parentheses, hence the last one.
+    */
+   stringBegin = strrchr(cmdStatTemp, ')');
+   if (NULL == stringBegin || '\0' == stringBegin[1]) {
+      free(cmdStatTemp);
+      return FALSE;
+   }
+   stringBegin += 2;
+
+   numberFound = sscanf(stringBegin, "%c %d %d %d %d %d "
+                        "%lu %lu %lu %lu %lu %Lu %Lu %Lu %Lu %ld %ld "
+                        "%d %ld %Lu",
+                        (char *) &dummy, (int *) &dummy, (int *) &dummy,
+                        (int *) &dummy, (int *) &dummy,  (int *) &dummy,
+                        (unsigned long *) &dummy, (unsigned long *) &dummy,
+                        (unsigned long *) &dummy, (unsigned long *) &dummy,
+                        (unsigned long *) &dummy,
+                        (unsigned long long *) &dummy,
+                        (unsigned long long *) &dummy,
+                        (unsigned long long *) &dummy,
+                        (unsigned long long *) &dummy,
+                        (long *) &dummy, (long *) &dummy,
+                        (int *) &dummy, (long *) &dummy,
+                        relativeStartTime);
+   free(cmdStatTemp);
+
+   return 20 == numberFound;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrLookupOwner --
+ *
+ *      Resolves a uid to a user name, remembering the names resolved during
+ *      the current listing: looking a user up can be slow (e.g., LDAP), and
+ *      most processes belong to the same few users.
+ *
+ * Results:
+ *      The user name, or the uid if it has no name. Owned by the cache.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static const char *
+ProcMgrLookupOwner(HashTable *owners,  // IN/OUT
+                   uid_t uid)          // IN
+{
+   char *owner;
+
+   if (!HashTable_Lookup(owners, (const void *) (uintptr_t) uid,
+                         (void **) &owner)) {
+      struct passwd *pwd = getpwuid(uid);
+      size_t strLen = 0;
+
+      owner = (NULL == pwd)
+              ? Str_SafeAsprintf(&strLen, "%d", (int) uid)
+              : Unicode_Alloc(pwd->pw_name, STRING_ENCODING_DEFAULT);
+      HashTable_Insert(owners, (const void *) (uintptr_t) uid, owner);
+   }
+
+   return owner;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -232,12 +628,17 @@ done:
  *      enumerate. The strings in the returned structure should be all
  *      UTF-8 encoded, although we do not enforce it right now.
  *
+ *      Only the pids that are new since the previous call (or were reused)
+ *      have their command line read; the rest come from the process table.
+ *
  * Results:
  *      
  *      A ProcMgrProcInfoArray.
  *
  * Side effects:
  *
+ *      Updates the process table.
+ *
  *----------------------------------------------------------------------
  */
 
@@ -252,6 +653,9 @@ ProcMgr_ListProcesses(void)
    static time_t hostStartTime = 0;
    static unsigned long long hertz = 100;
    int numberFound;
+   HashTable *owners;
+   DynBuf stale;
+   size_t i;
 
    procList = Util_SafeCalloc(1, sizeof *procList);
    ProcMgrProcInfoArray_Init(procList, 0);
@@ -306,6 +710,18 @@ ProcMgr_ListProcesses(void)
 #endif
    } // if (0 == hostStartTime)
 
+   if (NULL == procMgrCache) {
+      procMgrCache = HashTable_Alloc(PROCMGR_CACHE_BUCKETS, HASH_INT_KEY,
+                                     ProcMgrFreeCachedProc);
+      procMgrCacheUid = geteuid();
+   } else if (procMgrCacheUid != geteuid()) {
+      HashTable_Clear(procMgrCache);
+      procMgrCacheUid = geteuid();
+   }
+   procMgrCacheGeneration++;
+
+   owners = HashTable_Alloc(64, HASH_INT_KEY, free);
+
    /*
     * Scan /proc for any directory that is all numbers.
     * That represents a process id.
@@ -319,19 +735,9 @@ ProcMgr_ListProcesses(void)
    while ((ent = readdir(dir))) {
       struct stat fileStat;
       char cmdFilePath[1024];
-      int statResult;
-      int numRead = 0;   /* number of bytes that read() actually read */
-      int cmdFd;
-      int replaceLoop;
-      struct passwd *pwd;
-      char *cmdLineTemp = NULL;
-      char *cmdStatTemp = NULL;
-      size_t strLen = 0;
-      unsigned long long dummy;
       unsigned long long relativeStartTime;
-      char *stringBegin;
-      char *cmdNameBegin;
-      Bool cmdNameLookup = TRUE;
+      ProcMgrCachedProc *proc = NULL;
+      pid_t pid;
 
       /*
        * We only care about dirs that look like processes.
@@ -340,122 +746,37 @@ ProcMgr_ListProcesses(void)
          continue;
       }
 
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s/cmdline",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         continue;
-      }
-      
-      cmdFd = open(cmdFilePath, O_RDONLY);
-      if (-1 == cmdFd) {
-         /*
-          * We may not be able to open the file due to the security reason.
-          * In that case, just ignore and continue.
-          */
+      /*
+       * Figure out the process start time.  Together with the pid, it
+       * identifies the process.
+       */
+      if (!ProcMgrReadStartTime(ent->d_name, &relativeStartTime)) {
          continue;
       }
 
-      /*
-       * Read in the command and its arguments.  Arguments are separated
-       * by \0, which we convert to ' '.  Then we add a NULL terminator
-       * at the end.  Example: "perl -cw try.pl" is read in as
-       * "perl\0-cw\0try.pl\0", which we convert to "perl -cw try.pl\0".
-       * It would have been nice to preserve the NUL character so it is easy
-       * to determine what the command line arguments are without
-       * using a quote and space parsing heuristic.  But we do this
-       * to have parity with how Windows reports the command line.
-       * In the future, we could keep the NUL version around and pass it
-       * back to the client for easier parsing when retrieving individual
-       * command line parameters is needed.
-       */
-      numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
-      close(cmdFd);
+      pid = (pid_t) atoi(ent->d_name);
 
-      if (numRead < 0) {
-         continue;
+      if (HashTable_Lookup(procMgrCache, (const void *) (uintptr_t) pid,
+                           (void **) &proc) &&
+          proc->startTime != relativeStartTime) {
+         /* The pid was reused. */
+         HashTable_Delete(procMgrCache, (const void *) (uintptr_t) pid);
+         proc = NULL;
       }
 
-      if (numRead > 0) {
-         /*
-          * Stop before we hit the final '\0'; want to leave it alone.
-          */
-         for (replaceLoop = 0 ; replaceLoop < (numRead - 1) ; replaceLoop++) {
-            if ('\0' == cmdLineTemp[replaceLoop]) {
-               if (cmdNameLookup) {
-                  /*
-                   * Store the command name.
-                   * Find the last path separator, to get the cmd name.
-                   * If no separator is found, then use the whole name.
-                   */
-                  cmdNameBegin = strrchr(cmdLineTemp, '/');
-                  if (NULL == cmdNameBegin) {
-                     cmdNameBegin = cmdLineTemp;
-                  } else {
-                     /*
-                      * Skip over the last separator.
-                      */
-                     cmdNameBegin++;
-                  }
-                  procInfo.procCmdName = Unicode_Alloc(cmdNameBegin, STRING_ENCODING_DEFAULT);
-                  cmdNameLookup = FALSE;
-               }
-               cmdLineTemp[replaceLoop] = ' ';
-            }
-         }
-      } else {
-         /*
-          * Some procs don't have a command line text, so read a name from
-          * the 'status' file (should be the first line). If unable to get a name,
-          * the process is still real, so it should be included in the list, just 
-          * without a name.
-          */
-         cmdFd = -1;
-         numRead = 0;
-
-         if (snprintf(cmdFilePath,
-                      sizeof cmdFilePath,
-                      "/proc/%s/status",
-                      ent->d_name) != -1) {
-            cmdFd = open(cmdFilePath, O_RDONLY);
-         }
-         if (cmdFd != -1) {
-            numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
-            close(cmdFd);
-         }
-         if (numRead > 0) {
-            /*
-             * Extract the part with just the name, by reading until the first
-             * space, then reading the next non-space word after that, and
-             * ignoring everything else. The format looks like this:
-             *     "^Name:[ \t]*(.*)$"
-             * for example:
-             *     "Name:    nfsd"
-             */
-            const char *nameStart;
-            char *copyItr;
-
-            /* Skip non-whitespace. */
-            for (nameStart = cmdLineTemp; *nameStart && 
-                                          *nameStart != ' ' &&
-                                          *nameStart != '\t' &&
-                                          *nameStart != '\n'; ++nameStart);
-            /* Skip whitespace. */
-            for (;*nameStart && 
-                  (*nameStart == ' ' ||
-                   *nameStart == '\t' ||
-                   *nameStart == '\n'); ++nameStart);
-            /* Copy the name to the start of the string and null term it. */
-            for (copyItr = cmdLineTemp; *nameStart && *nameStart != '\n';) {
-               *(copyItr++) = *(nameStart++);
-            }
-            *copyItr = '\0';
-            /*
-             * Store the command name.
-             */
-            procInfo.procCmdName = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
+      if (NULL == proc) {
+         char *cmdName;
+         char *cmdLine;
+
+         if (!ProcMgrReadCmdLine(ent->d_name, &cmdName, &cmdLine)) {
+            continue;
          }
+
+         proc = Util_SafeCalloc(1, sizeof *proc);
+         proc->startTime = relativeStartTime;
+         proc->cmdName = cmdName;
+         proc->cmdLine = cmdLine;
+         HashTable_Insert(procMgrCache, (const void *) (uintptr_t) pid, proc);
       }
 
       /*
@@ -467,84 +788,32 @@ ProcMgr_ListProcesses(void)
                    "/proc/%s",
                    ent->d_name) == -1) {
          Debug("Giant process id '%s'\n", ent->d_name);
-         goto next_entry;
+         continue;
       }
 
       /*
        * stat() /proc/<pid> to get the owner.  We use fileStat.st_uid
        * later in this code.  If we can't stat(), ignore and continue.
-       * Maybe we don't have enough permission.
+       * Maybe we don't have enough permission.  The owner changes when the
+       * process switches users, so this is done every time.
        */
-      statResult = stat(cmdFilePath, &fileStat);
-      if (0 != statResult) {
-         goto next_entry;
-      }
-
-      /*
-       * Figure out the process start time.  Open /proc/<pid>/stat
-       * and read the start time and compute it in absolute time.
-       */
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s/stat",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         goto next_entry;
-      }
-      cmdFd = open(cmdFilePath, O_RDONLY);
-      if (-1 == cmdFd) {
-         goto next_entry;
-      }
-      numRead = ProcMgr_ReadProcFile(cmdFd, &cmdStatTemp);
-      close(cmdFd);
-      if (0 >= numRead) {
-         goto next_entry;
-      }
-      /*
-       * Skip over initial process id and process name.  "123 (bash) [...]".
-       */
-      stringBegin = strchr(cmdStatTemp, ')') + 2;
-
-      numberFound = sscanf(stringBegin, "%c %d %d %d %d %d "
-                           "%lu %lu %lu %lu %lu %Lu %Lu %Lu %Lu %ld %ld "
-                           "%d %ld %Lu",
-                           (char *) &dummy, (int *) &dummy, (int *) &dummy,
-                           (int *) &dummy, (int *) &dummy,  (int *) &dummy,
-                           (unsigned long *) &dummy, (unsigned long *) &dummy,
-                           (unsigned long *) &dummy, (unsigned long *) &dummy,
-                           (unsigned long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (long *) &dummy, (long *) &dummy,
-                           (int *) &dummy, (long *) &dummy,
-                           &relativeStartTime);
-      if (20 != numberFound) {
-         goto next_entry;
+      if (0 != stat(cmdFilePath, &fileStat)) {
+         continue;
       }
 
-      /*
-       * Store the command line string pointer in dynbuf.
-       */
-      if (cmdLineTemp) {
-         procInfo.procCmdLine = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
-      } else {
-         procInfo.procCmdLine = Unicode_Alloc("", STRING_ENCODING_UTF8);
+      if (NULL == proc->owner || proc->uid != fileStat.st_uid) {
+         free(proc->owner);
+         proc->owner = Util_SafeStrdup(ProcMgrLookupOwner(owners,
+                                                          fileStat.st_uid));
+         proc->uid = fileStat.st_uid;
       }
+      proc->generation = procMgrCacheGeneration;
 
-      /*
-       * Store the pid in dynbuf.
-       */
-      procInfo.procId = (pid_t) atoi(ent->d_name);
-
-      /*
-       * Store the owner of the process.
-       */
-      pwd = getpwuid(fileStat.st_uid);
-      procInfo.procOwner = (NULL == pwd)
-                           ? Str_SafeAsprintf(&strLen, "%d", (int) fileStat.st_uid)
-                           : Unicode_Alloc(pwd->pw_name, STRING_ENCODING_DEFAULT);
+      procInfo.procId = pid;
+      procInfo.procCmdName = (NULL == proc->cmdName)
+                             ? NULL : Util_SafeStrdup(proc->cmdName);
+      procInfo.procCmdLine = Util_SafeStrdup(proc->cmdLine);
+      procInfo.procOwner = Util_SafeStrdup(proc->owner);
 
       /*
        * Store the time that the process started.
@@ -562,18 +831,27 @@ ProcMgr_ListProcesses(void)
       procInfo.procCmdName = NULL;
       procInfo.procCmdLine = NULL;
       procInfo.procOwner = NULL;
-
-next_entry:
-      free(cmdLineTemp);
-      free(cmdStatTemp);
    } // while readdir
 
    if (0 < ProcMgrProcInfoArray_Count(procList)) {
       failed = FALSE;
    }
 
+   /*
+    * Forget the processes that are gone.
+    */
+   DynBuf_Init(&stale);
+   HashTable_ForEach(procMgrCache, ProcMgrCollectStale, &stale);
+   for (i = 0; i < DynBuf_GetSize(&stale) / sizeof (const char *); i++) {
+      HashTable_Delete(procMgrCache, ((const char **) DynBuf_Get(&stale))[i]);
+   }
+   DynBuf_Destroy(&stale);
+
 abort:
-   closedir(dir);
+   if (NULL != dir) {
+      closedir(dir);
+   }
+   HashTable_Free(owners);
 
    free(procInfo.procCmdName);
    free(procInfo.procCmdLine);
@@ -1214,7 +1492,8 @@ ProcMgr_ExecSync(char const *cmd,                  // IN: UTF-8 command line
 
    Debug("Executing sync command: %s\n", cmd);
 
-   pid = ProcMgrStartProcess(cmd, userArgs ? userArgs->envp : NULL,
+   pid = ProcMgrStartProcess(cmd, userArgs ? userArgs->argv : NULL,
+                             userArgs ? userArgs->envp : NULL,
                              userArgs ? userArgs->workingDirectory : NULL);
 
    if (pid == -1) {
@@ -1225,16 +1504,182 @@ ProcMgr_ExecSync(char const *cmd,                  // IN: UTF-8 command line
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrGetShell --
+ *
+ *      Picks the shell that runs command lines.
+ *
+ * Results:
+ *      The path of the shell; its argv[0] in *argv0.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char const *
+ProcMgrGetShell(char const **argv0)    // OUT
+{
+   static const char bashShellPath[] = BASH_PATH;
+   static const char bourneShellPath[] = "/bin/sh";
+
+   /*
+    * Check bug 772203. To start the program, we start the shell
+    * and specify the program using the option '-c'. We should return the
+    * PID of the app that gets started.
+    *
+    * When the option '-c' is specified,
+    * - bash shell just uses exec() to replace itself. So, 'bash' returns
+    * the PID of the new application that is started.
+    *
+    * - bourne shell does a fork & exec. So two processes are started. We
+    * see the PID of the shell and not the app that it starts. When the PID
+    * is returned to a user to watch, they'll watch the wrong process.
+    *
+    * In order to return the proper PID, use bash if possible. If bash
+    * is not available, then use the bourne shell.
+    */
+   if (File_Exists(bashShellPath)) {
+      *argv0 = "bash";
+      return bashShellPath;
+   }
+
+   *argv0 = "sh";
+   return bourneShellPath;
+}
+
+
+#if defined(linux) && !defined(USERWORLD)
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrSpawnChild --
+ *
+ *      Runs in the child of ProcMgrSpawn(), on the parent's memory, and
+ *      execs the program. Only makes system calls.
+ *
+ * Results:
+ *      Doesn't return.
+ *
+ * Side effects:
+ *	Records why the exec failed, if it did.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ProcMgrSpawnChild(void *data)    // IN
+{
+   ProcMgrSpawnArgs *args = data;
+   int sig;
+
+   /*
+    * The handlers would run on the parent's memory: put the caught signals
+    * back to their defaults (exec would do that anyway) before unblocking.
+    */
+   for (sig = 1; sig < NSIG; sig++) {
+      struct sigaction sa;
+
+      if (sigaction(sig, NULL, &sa) == 0 &&
+          sa.sa_handler != SIG_DFL && sa.sa_handler != SIG_IGN) {
+         memset(&sa, 0, sizeof sa);
+         sa.sa_handler = SIG_DFL;
+         sigaction(sig, &sa, NULL);
+      }
+   }
+   sigprocmask(SIG_SETMASK, &args->sigMask, NULL);
+
+   if (args->workingDir != NULL && chdir(args->workingDir) != 0) {
+      args->chdirError = errno;
+   }
+
+   if (args->envp != NULL) {
+      execve(args->path, args->argv, args->envp);
+   } else {
+      execv(args->path, args->argv);
+   }
+
+   args->execError = errno;
+   _exit(127);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrSpawn --
+ *
+ *      Starts a program with a vfork()-style clone(). Returns once the
+ *      child either exec'd the program or failed to.
+ *
+ * Results:
+ *      The pid of the child, or -1 (with errno set) on an error. A program
+ *      that couldn't be exec'd is an error.
+ *
+ * Side effects:
+ *	The program is run.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static pid_t
+ProcMgrSpawn(ProcMgrSpawnArgs *args)    // IN/OUT
+{
+   sigset_t all;
+   char *stack;
+   pid_t pid;
+   int error;
+
+   stack = mmap(NULL, PROCMGR_SPAWN_STACK_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+   if (stack == MAP_FAILED) {
+      return -1;
+   }
+
+   args->chdirError = 0;
+   args->execError = 0;
+
+   /* No handler may run in the child before it resets them. */
+   sigfillset(&all);
+   sigprocmask(SIG_SETMASK, &all, &args->sigMask);
+
+   pid = clone(ProcMgrSpawnChild, stack + PROCMGR_SPAWN_STACK_SIZE,
+               CLONE_VM | CLONE_VFORK | SIGCHLD, args);
+   error = errno;
+
+   sigprocmask(SIG_SETMASK, &args->sigMask, NULL);
+   munmap(stack, PROCMGR_SPAWN_STACK_SIZE);
+
+   if (pid == -1) {
+      errno = error;
+      return -1;
+   }
+
+   if (args->execError != 0) {
+      while (waitpid(pid, NULL, 0) == -1 && errno == EINTR) {
+      }
+      errno = args->execError;
+      return -1;
+   }
+
+   return pid;
+}
+#endif
+
+
 /*
  *----------------------------------------------------------------------
  *
  * ProcMgrStartProcess --
  *
- *      Fork and execute a command using the shell. This function returns
- *      immediately after the fork() in the parent process.
+ *      Execute a command using the shell, or the program in argv if given.
+ *      This function returns as soon as the program is started.
  *
  * Results:
- *      The pid of the forked process, or -1 on an error.
+ *      The pid of the new process, or -1 on an error.
  *
  * Side effects:
  *	Lots, depending on the program
@@ -1244,13 +1689,19 @@ ProcMgr_ExecSync(char const *cmd,                  // IN: UTF-8 command line
 
 static pid_t
 ProcMgrStartProcess(char const *cmd,            // IN: UTF-8 encoded cmd
+                    char * const *argv,         // IN: UTF-8 args, optional
                     char * const *envp,         // IN: UTF-8 encoded env vars
                     char const *workingDir)     // IN: UTF-8 working directory
 {
    pid_t pid;
    char *cmdCurrent = NULL;
+   char **argvCurrent = NULL;
    char **envpCurrent = NULL;
    char *workDir = NULL;
+   char const *shellArgv0;
+   char const *path;
+   char *shellArgs[] = { NULL, "-c", NULL, NULL };
+   char **args;
 
    if (cmd == NULL) {
       ASSERT(FALSE);
@@ -1258,7 +1709,7 @@ ProcMgrStartProcess(char const *cmd,            // IN: UTF-8 encoded cmd
    }
 
    /*
-    * Convert the strings before the call to fork(), since the conversion
+    * Convert the strings before starting the child, since the conversion
     * routines may rely on locks that do not survive fork().
     */
 
@@ -1270,6 +1721,7 @@ ProcMgrStartProcess(char const *cmd,            // IN: UTF-8 encoded cmd
    if ((NULL != workingDir) &&
        !CodeSet_Utf8ToCurrent(workingDir, strlen(workingDir), &workDir, NULL)) {
       Warning("Could not convert workingDir from UTF-8 to current\n");
+      free(cmdCurrent);
       return -1;
    }
 
@@ -1277,19 +1729,35 @@ ProcMgrStartProcess(char const *cmd,            // IN: UTF-8 encoded cmd
       envpCurrent = Unicode_GetAllocList(envp, -1, STRING_ENCODING_DEFAULT);
    }
 
+   if (NULL != argv) {
+      ASSERT(NULL != argv[0]);
+      argvCurrent = Unicode_GetAllocList(argv, -1, STRING_ENCODING_DEFAULT);
+      path = argvCurrent[0];
+      args = argvCurrent;
+   } else {
+      path = ProcMgrGetShell(&shellArgv0);
+      shellArgs[0] = (char *) shellArgv0;
+      shellArgs[2] = cmdCurrent;
+      args = shellArgs;
+   }
+
 #ifdef USERWORLD
    do {
-      static const char filePath[] = "/bin/sh";
-      char * const argv[] = { "sh", "++group=host/vim/tmp",
-                              "-c", cmdCurrent, NULL };
+      char * const argvUW[] = { "sh", "++group=host/vim/tmp",
+                                "-c", cmdCurrent, NULL };
       int initFds[] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
       int workingDirFd;
       VmkuserStatus_Code status;
       int outPid;
 
+      if (NULL == argvCurrent) {
+         path = "/bin/sh";
+         args = (char **) argvUW;
+      }
+
       workingDirFd = open(workingDir != NULL ? workingDir : "/tmp", O_RDONLY);
-      status = VmkuserCompat_ForkExec(filePath,
-                                      argv,
+      status = VmkuserCompat_ForkExec(path,
+                                      args,
                                       envpCurrent,
                                       workingDirFd,
                                       initFds,
@@ -1308,43 +1776,35 @@ ProcMgrStartProcess(char const *cmd,            // IN: UTF-8 encoded cmd
          pid = -1;
       }
    } while (FALSE);
-#else
-   pid = fork();
+#elif defined(linux)
+   do {
+      ProcMgrSpawnArgs spawnArgs;
 
-   if (pid == -1) {
-      Warning("Unable to fork: %s.\n\n", strerror(errno));
-   } else if (pid == 0) {
-      static const char bashShellPath[] = BASH_PATH;
-      char *bashArgs[] = { "bash", "-c", cmdCurrent, NULL };
-      static const char bourneShellPath[] = "/bin/sh";
-      char *bourneArgs[] = { "sh", "-c", cmdCurrent, NULL };
-      const char *shellPath;
-      char **args;
+      memset(&spawnArgs, 0, sizeof spawnArgs);
+      spawnArgs.path = path;
+      spawnArgs.argv = args;
+      spawnArgs.envp = envpCurrent;
+      spawnArgs.workingDir = workDir;
 
       /*
-       * Check bug 772203. To start the program, we start the shell
-       * and specify the program using the option '-c'. We should return the
-       * PID of the app that gets started.
-       *
-       * When the option '-c' is specified,
-       * - bash shell just uses exec() to replace itself. So, 'bash' returns
-       * the PID of the new application that is started.
-       *
-       * - bourne shell does a fork & exec. So two processes are started. We
-       * see the PID of the shell and not the app that it starts. When the PID
-       * is returned to a user to watch, they'll watch the wrong process.
-       *
-       * In order to return the proper PID, use bash if possible. If bash
-       * is not available, then use the bourne shell.
+       * The credentials set up by ProcMgr_ImpersonateUserStart() are
+       * inherited as with fork().
        */
-      if (File_Exists(bashShellPath)) {
-         shellPath = bashShellPath;
-         args = bashArgs;
-      } else {
-         shellPath = bourneShellPath;
-         args = bourneArgs;
+      pid = ProcMgrSpawn(&spawnArgs);
+      if (pid == -1) {
+         Warning("Unable to execute the \"%s\" command: %s.\n\n",
+                 cmd, strerror(errno));
+      } else if (spawnArgs.chdirError != 0) {
+         Warning("%s: Could not chdir(%s) %s\n", __FUNCTION__, workDir,
+                 strerror(spawnArgs.chdirError));
       }
+   } while (FALSE);
+#else
+   pid = fork();
 
+   if (pid == -1) {
+      Warning("Unable to fork: %s.\n\n", strerror(errno));
+   } else if (pid == 0) {
       /*
        * Child
        */
@@ -1372,9 +1832,9 @@ ProcMgrStartProcess(char const *cmd,            // IN: UTF-8 encoded cmd
       }
 
       if (NULL != envpCurrent) {
-         execve(shellPath, args, envpCurrent);
+         execve(path, args, envpCurrent);
       } else  {
-         execv(shellPath, args);
+         execv(path, args);
       }
 
       /* Failure */
@@ -1389,6 +1849,7 @@ ProcMgrStartProcess(char const *cmd,            // IN: UTF-8 encoded cmd
 
    free(cmdCurrent);
    free(workDir);
+   Util_FreeStringList(argvCurrent, -1);
    Util_FreeStringList(envpCurrent, -1);
    return pid;
 }
@@ -1459,6 +1920,47 @@ ProcMgrWaitForProcCompletion(pid_t pid,                 // IN
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrCloseFdsAround --
+ *
+ *      Closes all fds but stdio and the two given ones, a range at a time.
+ *      With a high fd limit, closing every possible fd one by one takes
+ *      long.
+ *
+ * Results:
+ *      TRUE if done, FALSE if the fds must be closed one by one.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrCloseFdsAround(int fd1,    // IN
+                      int fd2)    // IN
+{
+#if defined(linux) && defined(__NR_close_range)
+   unsigned int lo = MIN(fd1, fd2);
+   unsigned int hi = MAX(fd1, fd2);
+
+   if (lo <= STDERR_FILENO || lo == hi) {
+      return FALSE;
+   }
+
+   return (lo == STDERR_FILENO + 1 ||
+           syscall(__NR_close_range, STDERR_FILENO + 1, lo - 1, 0) == 0) &&
+          (hi == lo + 1 ||
+           syscall(__NR_close_range, lo + 1, hi - 1, 0) == 0) &&
+          syscall(__NR_close_range, hi + 1, ~0U, 0) == 0;
+#else
+   return FALSE;
+#endif
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1522,7 +2024,11 @@ ProcMgr_ExecAsync(char const *cmd,                 // IN: UTF-8 command line
        * should probably call Hostinfo_ResetProcessState(), but that
        * does some stuff with iopl() we don't need
        */
-      maxfd = sysconf(_SC_OPEN_MAX);
+      if (ProcMgrCloseFdsAround(readFd, writeFd)) {
+         maxfd = 0;
+      } else {
+         maxfd = sysconf(_SC_OPEN_MAX);
+      }
       for (i = STDERR_FILENO + 1; i < maxfd; i++) {
          if (i != readFd && i != writeFd) {
             close(i);
@@ -1546,6 +2052,7 @@ ProcMgr_ExecAsync(char const *cmd,                 // IN: UTF-8 command line
        */
       if (status) {
          childPid = ProcMgrStartProcess(cmd,
+                                        userArgs ? userArgs->argv : NULL,
                                         userArgs ? userArgs->envp : NULL,
                                         userArgs ? userArgs->workingDirectory : NULL);
          status = childPid != -1;
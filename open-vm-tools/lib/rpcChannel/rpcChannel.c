@@ -22,16 +22,17 @@
  *    Common functions to all RPC channel implementations.
  */
 
+#include <stdio.h>
 #include <string.h>
 #include "vm_assert.h"
 #include "dynxdr.h"
 #include "rpcChannelInt.h"
 #include "str.h"
-#include "strutil.h"
 #include "vmxrpc.h"
 #include "xdrutil.h"
 #include "rpcin.h"
 #include "debug.h"
+#include "vmware/guestrpc/tclodefs.h"
 
 /** Internal state of a channel. */
 typedef struct RpcChannelInt {
@@ -42,6 +43,8 @@ typedef struct RpcChannelInt {
    GSource                *resetCheck;
    gpointer                appCtx;
    RpcChannelCallback      resetReg;
+   RpcChannelCallback      statsReg;
+   GHashTable             *cmdStats;
    RpcChannelResetCb       resetCb;
    gpointer                resetData;
    gboolean                rpcError;
@@ -53,6 +56,12 @@ typedef struct RpcChannelInt {
 
 #define LGPFX "RpcChannel: "
 
+/* Longest command name dispatched without a heap allocation. */
+#define RPCCHANNEL_DISPATCH_NAME_MAX 128
+
+/* Name under which commands without a handler are accounted. */
+#define RPCCHANNEL_STATS_UNKNOWN "(unknown)"
+
 static gboolean
 RpcChannelPing(RpcInData *data);
 
@@ -69,6 +78,10 @@ static gboolean gUseBackdoorOnly = FALSE;
  */
 static gboolean gVSocketFailed = FALSE;
 
+/* Backdoor poller tunables, see RpcChannel_SetPollPolicy(). */
+static guint gRpcInMaxDelay = RPCIN_MAX_DELAY;
+static guint gRpcInBusyPolls = RPCIN_BUSY_POLLS;
+
 static void RpcChannelStopNoLock(RpcChannel *chan);
 
 /**
@@ -205,6 +218,142 @@ RpcChannelReset(RpcInData *data)
 }
 
 
+/**
+ * Appends the dispatch statistics of one command to the reply of the
+ * statistics RPC.
+ *
+ * @param[in]  stats    The command's statistics.
+ * @param[in]  _reply   The reply being built.
+ */
+
+static void
+RpcChannelFormatStats(const RpcChannelCmdStats *stats,
+                      gpointer _reply)
+{
+   GString *reply = _reply;
+   guint64 count = MAX(stats->count, 1);
+   guint i;
+
+   g_string_append_printf(reply,
+                          "%s count=%"G_GUINT64_FORMAT
+                          " errors=%"G_GUINT64_FORMAT
+                          " avgUS=%"G_GUINT64_FORMAT
+                          " maxUS=%"G_GUINT64_FORMAT" hist=",
+                          stats->name, stats->count, stats->errors,
+                          stats->totalUS / count, stats->maxUS);
+   for (i = 0; i < RPCCHANNEL_STATS_BUCKETS; i++) {
+      g_string_append_printf(reply, "%s%"G_GUINT64_FORMAT,
+                             i > 0 ? "," : "", stats->histogram[i]);
+   }
+   g_string_append_printf(reply,
+                          " avgReply=%"G_GUINT64_FORMAT
+                          " maxReply=%"G_GUINT64_FORMAT
+                          " avgQueueMS=%"G_GUINT64_FORMAT
+                          " maxQueueMS=%"G_GUINT64_FORMAT"\n",
+                          stats->replyBytes / count, stats->maxReplyBytes,
+                          stats->totalQueueMS / count, stats->maxQueueMS);
+}
+
+
+/**
+ * Handles the GUESTRPC_STATS_CMD RPC: replies with the dispatch statistics
+ * of the channel, one command per line.
+ *
+ * @param[in]  data     The RPC data.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+RpcChannelStats(RpcInData *data)
+{
+   GString *reply = g_string_new(NULL);
+
+   RpcChannel_ForEachCmdStats(data->clientData, RpcChannelFormatStats, reply);
+   return RPCIN_SETRETVALSF(data, g_string_free(reply, FALSE), TRUE);
+}
+
+
+/**
+ * Frees the statistics of a command.
+ *
+ * @param[in]  _stats   The statistics.
+ */
+
+static void
+RpcChannelFreeStats(gpointer _stats)
+{
+   RpcChannelCmdStats *stats = _stats;
+   g_free((gchar *) stats->name);
+   g_free(stats);
+}
+
+
+/**
+ * Accounts for a dispatched RPC.
+ *
+ * @param[in]  chan     The RPC channel.
+ * @param[in]  name     Command name, or NULL if it has no handler.
+ * @param[in]  data     The RPC data, after dispatch.
+ * @param[in]  status   Dispatch result.
+ * @param[in]  start    Monotonic time at which the handler was called.
+ */
+
+static void
+RpcChannelRecordStats(RpcChannelInt *chan,
+                      const char *name,
+                      RpcInData *data,
+                      gboolean status,
+                      gint64 start)
+{
+   RpcChannelCmdStats *stats;
+   guint64 elapsed = g_get_monotonic_time() - start;
+   guint64 bucketUS = 1000;
+   guint64 queueMS;
+   guint i;
+
+   if (chan->cmdStats == NULL) {
+      chan->cmdStats = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                             NULL, RpcChannelFreeStats);
+   }
+
+   if (name == NULL) {
+      name = RPCCHANNEL_STATS_UNKNOWN;
+   }
+
+   stats = g_hash_table_lookup(chan->cmdStats, name);
+   if (stats == NULL) {
+      stats = g_new0(RpcChannelCmdStats, 1);
+      stats->name = g_strdup(name);
+      g_hash_table_insert(chan->cmdStats, (gpointer) stats->name, stats);
+   }
+
+   stats->count++;
+   if (!status) {
+      stats->errors++;
+   }
+
+   stats->totalUS += elapsed;
+   stats->maxUS = MAX(stats->maxUS, elapsed);
+   for (i = 0; i < RPCCHANNEL_STATS_BUCKETS - 1; i++) {
+      if (elapsed < bucketUS) {
+         break;
+      }
+      bucketUS *= 10;
+   }
+   stats->histogram[i]++;
+
+   if (data->result != NULL) {
+      stats->replyBytes += data->resultLen;
+      stats->maxReplyBytes = MAX(stats->maxReplyBytes, data->resultLen);
+   }
+
+   queueMS = chan->impl.in != NULL ? RpcIn_GetPickupWait(chan->impl.in) : 0;
+   stats->totalQueueMS += queueMS;
+   stats->maxQueueMS = MAX(stats->maxQueueMS, queueMS);
+}
+
+
 /**
  * A wrapper for standard RPC callback functions which provides automatic
  * XDR serialization / deserialization if requested by the application.
@@ -378,20 +527,36 @@ RpcChannel_Create(void)
 gboolean
 RpcChannel_Dispatch(RpcInData *data)
 {
-   char *name = NULL;
-   unsigned int index = 0;
+   char nameBuf[RPCCHANNEL_DISPATCH_NAME_MAX];
+   char *heapName = NULL;
+   char *name;
    size_t nameLen;
    Bool status;
    RpcChannelCallback *rpc = NULL;
    RpcChannelInt *chan = data->clientData;
+   gint64 start = g_get_monotonic_time();
 
-   name = StrUtil_GetNextToken(&index, data->args, " ");
-   if (name == NULL) {
+   /*
+    * The command name is the first space-delimited token. It is copied to
+    * the stack so that the handler lookup is the only per-message cost;
+    * only unusually long names need the heap.
+    */
+   nameLen = (data->args != NULL) ? strcspn(data->args, " ") : 0;
+   if (nameLen == 0) {
       Debug(LGPFX "Bad command (null) received.\n");
       status = RPCIN_SETRETVALS(data, "Bad command", FALSE);
+      RpcChannelRecordStats(chan, NULL, data, status, start);
       goto exit;
    }
 
+   if (nameLen < sizeof nameBuf) {
+      memcpy(nameBuf, data->args, nameLen);
+      nameBuf[nameLen] = '\0';
+      name = nameBuf;
+   } else {
+      name = heapName = g_strndup(data->args, nameLen);
+   }
+
    if (chan->rpcs != NULL) {
       rpc = g_hash_table_lookup(chan->rpcs, name);
    }
@@ -399,17 +564,18 @@ RpcChannel_Dispatch(RpcInData *data)
    if (rpc == NULL) {
       Debug(LGPFX "Unknown Command '%s': Handler not registered.\n", name);
       status = RPCIN_SETRETVALS(data, "Unknown Command", FALSE);
+      RpcChannelRecordStats(chan, NULL, data, status, start);
       goto exit;
    }
 
    /* Adjust the RPC arguments. */
-   nameLen = strlen(name);
    data->name = name;
    data->args = data->args + nameLen;
    data->argsSize -= nameLen;
    data->appCtx = chan->appCtx;
    data->clientData = rpc->clientData;
 
+   start = g_get_monotonic_time();
    if (rpc->xdrIn != NULL || rpc->xdrOut != NULL) {
       status = RpcChannelXdrWrapper(data, rpc);
    } else {
@@ -417,10 +583,11 @@ RpcChannel_Dispatch(RpcInData *data)
    }
 
    ASSERT(data->result != NULL);
+   RpcChannelRecordStats(chan, name, data, status, start);
 
 exit:
    data->name = NULL;
-   free(name);
+   g_free(heapName);
    return status;
 }
 
@@ -444,6 +611,7 @@ RpcChannel_Destroy(RpcChannel *chan)
    }
 
    RpcChannel_UnregisterCallback(chan, &cdata->resetReg);
+   RpcChannel_UnregisterCallback(chan, &cdata->statsReg);
    for (i = 0; i < ARRAYSIZE(gRpcHandlers); i++) {
       RpcChannel_UnregisterCallback(chan, &gRpcHandlers[i]);
    }
@@ -453,6 +621,11 @@ RpcChannel_Destroy(RpcChannel *chan)
       cdata->rpcs = NULL;
    }
 
+   if (cdata->cmdStats != NULL) {
+      g_hash_table_destroy(cdata->cmdStats);
+      cdata->cmdStats = NULL;
+   }
+
    cdata->resetCb = NULL;
    cdata->resetData = NULL;
    cdata->appCtx = NULL;
@@ -539,8 +712,13 @@ RpcChannel_Setup(RpcChannel *chan,
    cdata->resetReg.callback = RpcChannelReset;
    cdata->resetReg.clientData = chan;
 
+   cdata->statsReg.name = GUESTRPC_STATS_CMD;
+   cdata->statsReg.callback = RpcChannelStats;
+   cdata->statsReg.clientData = chan;
+
    /* Register the callbacks handled by the rpcChannel library. */
    RpcChannel_RegisterCallback(chan, &cdata->resetReg);
+   RpcChannel_RegisterCallback(chan, &cdata->statsReg);
 
    for (i = 0; i < ARRAYSIZE(gRpcHandlers); i++) {
       RpcChannel_RegisterCallback(chan, &gRpcHandlers[i]);
@@ -668,6 +846,57 @@ RpcChannel_SetBackdoorOnly(void)
 }
 
 
+/**
+ * Tune the poller used to receive RPCs when the channel falls back to the
+ * backdoor. vSocket channels are woken up by the socket and do not poll.
+ * This needs to be called before RpcChannel_Start to take effect.
+ *
+ * @param[in]  maxDelay    Longest time (in .01s) to sleep between polls.
+ * @param[in]  busyPolls   Number of empty polls after a message to keep
+ *                         polling at the shortest delay for.
+ */
+
+void
+RpcChannel_SetPollPolicy(guint maxDelay,
+                         guint busyPolls)
+{
+   gRpcInMaxDelay = MAX(maxDelay, 1);
+   gRpcInBusyPolls = busyPolls;
+   Debug(LGPFX "Backdoor poll policy: max delay %u ms, %u busy polls.\n",
+         gRpcInMaxDelay * 10, gRpcInBusyPolls);
+}
+
+
+/**
+ * Calls the given function for the dispatch statistics of each command
+ * received on the channel. Must be called from the thread that dispatches
+ * the channel's RPCs.
+ *
+ * @param[in]  chan  The RPC channel.
+ * @param[in]  cb    Function to call.
+ * @param[in]  data  Data for the function.
+ */
+
+void
+RpcChannel_ForEachCmdStats(RpcChannel *chan,
+                           RpcChannelCmdStatsCb cb,
+                           gpointer data)
+{
+   RpcChannelInt *cdata = (RpcChannelInt *) chan;
+   GHashTableIter iter;
+   gpointer value;
+
+   if (cdata->cmdStats == NULL) {
+      return;
+   }
+
+   g_hash_table_iter_init(&iter, cdata->cmdStats);
+   while (g_hash_table_iter_next(&iter, NULL, &value)) {
+      cb(value, data);
+   }
+}
+
+
 /**
  * Create an RpcChannel instance using a prefered channel implementation,
  * currently this is VSockChannel.
@@ -751,7 +980,8 @@ RpcChannel_Start(RpcChannel *chan)
    }
 
    if (chan->in != NULL && !chan->inStarted) {
-      ok = RpcIn_start(chan->in, RPCIN_MAX_DELAY, RpcChannel_Error, chan);
+      RpcIn_SetBusyPolls(chan->in, gRpcInBusyPolls);
+      ok = RpcIn_start(chan->in, gRpcInMaxDelay, RpcChannel_Error, chan);
       chan->inStarted = ok;
    }
 
@@ -847,11 +1077,104 @@ RpcChannel_Free(void *ptr)
 }
 
 
+/**
+ * Sends a large RPC over a bulk side channel negotiated with the host for
+ * this transfer (see GUESTRPC_BULK_OPEN_CMD). The regular channel is only
+ * used, and locked, for the short negotiation, so other RPCs don't wait for
+ * the transfer.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ * @param[in]  data        Data to send.
+ * @param[in]  dataLen     Number of bytes to send.
+ * @param[out] ok          Status of the RPC, when it was sent.
+ * @param[out] result      Response from other side, when it was sent.
+ * @param[out] resultLen   Number of bytes in response.
+ *
+ * @return TRUE if the RPC reached the host this way. FALSE if the caller
+ *         should send it through the regular channel.
+ */
+
+static gboolean
+RpcChannelSendBulk(RpcChannel *chan,
+                   char const *data,
+                   size_t dataLen,
+                   gboolean *ok,
+                   char **result,
+                   size_t *resultLen)
+{
+   const RpcChannelFuncs *funcs;
+   char *cmd;
+   char *reply = NULL;
+   size_t replyLen = 0;
+   unsigned int port;
+   char token[GUESTRPC_BULK_TOKEN_MAX + 1];
+   gboolean delivered = FALSE;
+   Bool rpcStatus = FALSE;
+   char *res = NULL;
+   size_t resLen = 0;
+
+   g_static_mutex_lock(&chan->outLock);
+   funcs = chan->funcs;
+   if (chan->bulkUnsupported || !chan->outStarted ||
+       funcs->sendBulk == NULL) {
+      funcs = NULL;
+   }
+   g_static_mutex_unlock(&chan->outLock);
+
+   if (funcs == NULL) {
+      return FALSE;
+   }
+
+   cmd = g_strdup_printf(GUESTRPC_BULK_OPEN_CMD " %"FMTSZ"u", dataLen);
+   if (!RpcChannel_Send(chan, cmd, strlen(cmd), &reply, &replyLen)) {
+      if (reply != NULL && strcmp(reply, RPCI_UNKNOWN_COMMAND) == 0) {
+         Debug(LGPFX "Host has no bulk channel, not asking again.\n");
+         chan->bulkUnsupported = TRUE;
+      }
+      goto exit;
+   }
+
+   if (sscanf(reply, "%u %"XSTR(GUESTRPC_BULK_TOKEN_MAX)"s",
+              &port, token) != 2) {
+      Debug(LGPFX "Bad bulk channel reply: %s\n", reply);
+      goto exit;
+   }
+
+   *ok = funcs->sendBulk(chan, port, token, data, dataLen, &delivered,
+                         &rpcStatus, &res, &resLen);
+   if (!delivered) {
+      Debug(LGPFX "Bulk transfer of %"FMTSZ"u bytes failed: %s\n", dataLen,
+            res != NULL ? res : "");
+      free(res);
+      goto exit;
+   }
+
+   Debug(LGPFX "Sent %"FMTSZ"u bytes over bulk channel.\n", dataLen);
+   *ok = *ok && rpcStatus;
+   if (result != NULL) {
+      *result = res;
+   } else {
+      free(res);
+   }
+   if (resultLen != NULL) {
+      *resultLen = resLen;
+   }
+
+exit:
+   free(reply);
+   g_free(cmd);
+   return delivered;
+}
+
+
 /**
  * Send function of an RPC channel struct. Retry once if it fails for
  * non-backdoor Channels. Backdoor channel already tries inside. A second try
  * may create a different type of channel.
  *
+ * RPCs of GUESTRPC_BULK_MIN_SIZE bytes or more go over a bulk side channel
+ * when the channel and the host support it.
+ *
  * @param[in]  chan        The RPC channel instance.
  * @param[in]  data        Data to send.
  * @param[in]  dataLen     Number of bytes to send.
@@ -879,6 +1202,18 @@ RpcChannel_Send(RpcChannel *chan,
 
    ASSERT(chan && chan->funcs);
 
+   if (result != NULL) {
+      *result = NULL;
+   }
+   if (resultLen != NULL) {
+      *resultLen = 0;
+   }
+
+   if (dataLen >= GUESTRPC_BULK_MIN_SIZE &&
+       RpcChannelSendBulk(chan, data, dataLen, &ok, result, resultLen)) {
+      return ok;
+   }
+
    g_static_mutex_lock(&chan->outLock);
 
    funcs = chan->funcs;
@@ -935,6 +1270,145 @@ exit:
 }
 
 
+/** Completion of an asynchronous send, delivered from the main context. */
+typedef struct RpcChannelCompletion {
+   RpcChannel          *chan;
+   RpcChannelSendCb     cb;
+   gpointer             cbData;
+   gboolean             status;
+   char                *result;
+   size_t               resultLen;
+} RpcChannelCompletion;
+
+
+/**
+ * Idle callback that runs the completion callback of an asynchronous send.
+ *
+ * @param[in]  data     The RpcChannelCompletion.
+ *
+ * @return FALSE.
+ */
+
+static gboolean
+RpcChannelRunCompletion(gpointer data)
+{
+   RpcChannelCompletion *c = data;
+
+   c->cb(c->chan, c->status, c->result, c->resultLen, c->cbData);
+   return FALSE;
+}
+
+
+/**
+ * Frees an RpcChannelCompletion.
+ *
+ * @param[in]  data     The RpcChannelCompletion.
+ */
+
+static void
+RpcChannelFreeCompletion(gpointer data)
+{
+   RpcChannelCompletion *c = data;
+
+   free(c->result);
+   g_free(c);
+}
+
+
+/**
+ * Schedules the completion callback of an asynchronous send to run in the
+ * channel's main context. May be called from any thread. Channel
+ * implementations use this to report the outcome of requests queued by
+ * their sendAsync function.
+ *
+ * @param[in]  chan        The RPC channel.
+ * @param[in]  cb          Completion callback.
+ * @param[in]  cbData      Client data for the callback.
+ * @param[in]  status      Status of the RPC.
+ * @param[in]  result      Reply or error description, allocated with
+ *                         malloc(); ownership is taken. May be NULL.
+ * @param[in]  resultLen   Length of the reply.
+ */
+
+void
+RpcChannel_CompleteAsync(RpcChannel *chan,
+                         RpcChannelSendCb cb,
+                         gpointer cbData,
+                         gboolean status,
+                         char *result,
+                         size_t resultLen)
+{
+   RpcChannelCompletion *c = g_new0(RpcChannelCompletion, 1);
+   GSource *src;
+
+   c->chan = chan;
+   c->cb = cb;
+   c->cbData = cbData;
+   c->status = status;
+   c->result = result;
+   c->resultLen = resultLen;
+
+   src = g_idle_source_new();
+   g_source_set_callback(src, RpcChannelRunCompletion, c,
+                         RpcChannelFreeCompletion);
+   g_source_attach(src, chan->mainCtx);
+   g_source_unref(src);
+}
+
+
+/**
+ * Sends an RPC without waiting for the reply. The completion callback is
+ * called exactly once, from the channel's main context, with what
+ * RpcChannel_Send() would have returned.
+ *
+ * Channels that support it (vsocket) keep a bounded number of requests in
+ * flight on a connection of their own, so many RPCs can be issued without
+ * paying a round trip each. Otherwise, or if the request cannot be queued,
+ * the RPC is sent synchronously through RpcChannel_Send(), with its retry
+ * and fallback behavior, and only the completion is deferred.
+ *
+ * Requests still queued when the channel is shut down are failed during the
+ * shutdown. Completions already scheduled still run from the main context,
+ * so a channel must not be destroyed while the main loop may still deliver
+ * completions for it.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ * @param[in]  data        Data to send.
+ * @param[in]  dataLen     Number of bytes to send.
+ * @param[in]  cb          Completion callback.
+ * @param[in]  cbData      Client data for the callback.
+ */
+
+void
+RpcChannel_SendAsync(RpcChannel *chan,
+                     char const *data,
+                     size_t dataLen,
+                     RpcChannelSendCb cb,
+                     gpointer cbData)
+{
+   gboolean queued = FALSE;
+   gboolean ok;
+   char *res = NULL;
+   size_t resLen = 0;
+
+   ASSERT(chan && chan->funcs);
+   ASSERT(cb != NULL);
+
+   g_static_mutex_lock(&chan->outLock);
+   if (chan->funcs->sendAsync != NULL && chan->outStarted) {
+      queued = chan->funcs->sendAsync(chan, data, dataLen, cb, cbData);
+   }
+   g_static_mutex_unlock(&chan->outLock);
+
+   if (queued) {
+      return;
+   }
+
+   ok = RpcChannel_Send(chan, data, dataLen, &res, &resLen);
+   RpcChannel_CompleteAsync(chan, cb, cbData, ok, res, resLen);
+}
+
+
 /**
  * Open/close RpcChannel each time for sending a Rpc message, this is a wrapper
  * for RpcChannel APIs.
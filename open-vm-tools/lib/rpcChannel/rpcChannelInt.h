@@ -30,6 +30,9 @@
 /** Max amount of time (in .01s) that the RpcIn loop will sleep for. */
 #define RPCIN_MAX_DELAY    10
 
+/** Empty polls after a message for which the RpcIn loop keeps a short delay. */
+#define RPCIN_BUSY_POLLS   4
+
 struct RpcIn;
 
 /** a list of interface functions for a channel implementation */
@@ -44,6 +47,11 @@ typedef struct _RpcChannelFuncs{
    RpcChannelType (*getType)(RpcChannel *chan);
    void (*onStartErr)(RpcChannel *);
    gboolean (*stopRpcOut)(RpcChannel *);
+   gboolean (*sendAsync)(RpcChannel *, char const *data, size_t dataLen,
+                         RpcChannelSendCb cb, gpointer cbData);
+   gboolean (*sendBulk)(RpcChannel *, unsigned int port, const char *token,
+                        char const *data, size_t dataLen, gboolean *delivered,
+                        Bool *rpcStatus, char **result, size_t *resultLen);
 } RpcChannelFuncs;
 
 /**
@@ -62,11 +70,19 @@ struct _RpcChannel {
    struct RpcIn              *in;
    gboolean                  inStarted;
    gboolean                  outStarted;
+   gboolean                  bulkUnsupported;
 };
 
 void
 RpcChannel_Error(void *_state,
                  char const *status);
+void
+RpcChannel_CompleteAsync(RpcChannel *chan,
+                         RpcChannelSendCb cb,
+                         gpointer cbData,
+                         gboolean status,
+                         char *result,
+                         size_t resultLen);
 RpcChannel *VSockChannel_New(void);
 RpcChannel *BackdoorChannel_New(void);
 gboolean
@@ -124,6 +124,42 @@ Socket_Close(SOCKET sock)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Socket_Shutdown --
+ *
+ *      Shut down both directions of a socket without closing it. Wakes up
+ *      any thread blocked receiving on it.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+Socket_Shutdown(SOCKET sock)
+{
+   int res;
+
+#if defined(_WIN32)
+   res = shutdown(sock, SD_BOTH);
+#else
+   res = shutdown(sock, SHUT_RDWR);
+#endif
+
+   if (res == SOCKET_ERROR) {
+      int err = SocketGetLastError();
+      Debug(LGPFX "Error in shutting down socket %d: %d[%s]\n",
+            sock, err, Err_Errno2String(err));
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -457,7 +493,7 @@ Socket_DecodePacket(const char *recvBuf,       // IN
    *payloadLen = 0;
 
    /* decoding the packet */
-   res = DataMap_Deserialize(recvBuf, fullPktLen, &map);
+   res = DataMap_DeserializeNoCopy(recvBuf, fullPktLen, &map);
    if (res != DMERR_SUCCESS) {
       Debug(LGPFX "Error in dataMap decoding, error=%d\n", res);
       return FALSE;
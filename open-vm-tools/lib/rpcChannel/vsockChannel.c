@@ -34,6 +34,20 @@
 
 #define LGPFX "VSockChan: "
 
+/*
+ * Max. number of asynchronous requests sent ahead of their replies. The
+ * RPCI protocol has no request tags: the host answers the requests on a
+ * connection in order, so replies are matched to the oldest request in
+ * flight.
+ */
+#define VSOCK_ASYNC_WINDOW    8
+
+/*
+ * Bulk transfers are written in pieces of this size, so that a large RPC is
+ * paced by the vsock flow control instead of being copied into one packet.
+ */
+#define VSOCK_BULK_CHUNK_SIZE (256 * 1024)
+
 typedef struct VSockOut {
    SOCKET fd;
    char *payload;
@@ -41,8 +55,31 @@ typedef struct VSockOut {
    RpcChannelType type;
 } VSockOut;
 
+typedef struct VSockAsyncReq {
+   guint             seq;
+   char             *data;
+   size_t            dataLen;
+   RpcChannelSendCb  cb;
+   gpointer          cbData;
+} VSockAsyncReq;
+
+/*
+ * Asynchronous requests use a connection of their own, so that the replies
+ * a reader thread waits for never get mixed up with synchronous sends.
+ */
+typedef struct VSockAsync {
+   VSockOut         *out;
+   GMutex           *lock;
+   GThread          *reader;
+   GQueue           *inflight;  /* Sent, oldest first. */
+   GQueue           *waiting;   /* Not sent yet, window was full. */
+   guint             nextSeq;
+   gboolean          stopping;  /* Stop in progress, leave the queues alone. */
+} VSockAsync;
+
 typedef struct VSockChannel {
    VSockOut          *out;
+   VSockAsync        *async;
 } VSockChannel;
 
 static void VSockChannelShutdown(RpcChannel *chan);
@@ -53,8 +90,8 @@ static void VSockChannelShutdown(RpcChannel *chan);
  *
  * VSockCreateConn --
  *
- *      Create vsocket connection. we try a privileged connection first,
- *      fallback to unprivileged one if that fails.
+ *      Create vsocket connection to the given host port. we try a privileged
+ *      connection first, fallback to unprivileged one if that fails.
  *
  * Result:
  *      a valid socket/fd on success or INVALID_SOCKET on failure.
@@ -66,15 +103,15 @@ static void VSockChannelShutdown(RpcChannel *chan);
  */
 
 static SOCKET
-VSockCreateConn(gboolean *isPriv)        // OUT
+VSockCreateConn(unsigned int port,       // IN
+                gboolean *isPriv)        // OUT
 {
    ApiError apiErr;
    int sysErr;
    SOCKET fd;
 
    Debug(LGPFX "Creating privileged vsocket ...\n");
-   fd = Socket_ConnectVMCI(VMCI_HYPERVISOR_CONTEXT_ID,
-                           GUESTRPC_RPCI_VSOCK_LISTEN_PORT,
+   fd = Socket_ConnectVMCI(VMCI_HYPERVISOR_CONTEXT_ID, port,
                            TRUE, &apiErr, &sysErr);
 
    if (fd != INVALID_SOCKET) {
@@ -85,8 +122,7 @@ VSockCreateConn(gboolean *isPriv)        // OUT
 
    if (apiErr == SOCKERR_BIND && sysErr == SYSERR_EACCESS) {
       Debug(LGPFX "Creating unprivileged vsocket ...\n");
-      fd = Socket_ConnectVMCI(VMCI_HYPERVISOR_CONTEXT_ID,
-                              GUESTRPC_RPCI_VSOCK_LISTEN_PORT,
+      fd = Socket_ConnectVMCI(VMCI_HYPERVISOR_CONTEXT_ID, port,
                               FALSE, &apiErr, &sysErr);
       if (fd != INVALID_SOCKET) {
          Debug(LGPFX "Successfully created unpriv vsocket %d\n", fd);
@@ -182,7 +218,7 @@ VSockOutStart(VSockOut *out)      // IN
    ASSERT(out);
    ASSERT(out->fd == INVALID_SOCKET);
 
-   out->fd = VSockCreateConn(&isPriv);
+   out->fd = VSockCreateConn(GUESTRPC_RPCI_VSOCK_LISTEN_PORT, &isPriv);
    if (out->fd != INVALID_SOCKET) {
       out->type = isPriv ? RPCCHANNEL_TYPE_PRIV_VSOCK :
                            RPCCHANNEL_TYPE_UNPRIV_VSOCK;
@@ -219,6 +255,44 @@ VSockOutStop(VSockOut *out)    // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockOutParseReply --
+ *
+ *    Split an RPCI reply packet into its status and result.
+ *
+ * Result
+ *    TRUE if the packet is well formed. Otherwise FALSE, and 'reply'
+ *    contains a description of the error.
+ *
+ * Side-effects
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VSockOutParseReply(const char *payload,   // IN
+                   int payloadLen,        // IN
+                   Bool *rpcStatus,       // OUT
+                   const char **reply,    // OUT
+                   size_t *repLen)        // OUT
+{
+   if (payloadLen < 2 ||
+       ((payload[0] != '1') && (payload[0] != '0')) ||
+       payload[1] != ' ') {
+      *reply = "VSockOut: Invalid format for the result of the RPCI command";
+      return FALSE;
+   }
+
+   *reply = payload + 2;
+   *repLen = payloadLen - 2;
+   *rpcStatus = payload[0] == '1';
+   return TRUE;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -274,19 +348,12 @@ VSockOutSend(VSockOut *out,        // IN
       goto error;
    }
 
-   if (out->payloadLen < 2 ||
-       ((out->payload[0] != '1') && (out->payload[0] != '0')) ||
-       out->payload[1] != ' ') {
-      *reply = "VSockOut: Invalid format for the result of the RPCI command";
+   if (!VSockOutParseReply(out->payload, out->payloadLen, rpcStatus,
+                           reply, repLen)) {
       goto error;
    }
 
-   *reply = out->payload + 2;
-   *repLen = out->payloadLen - 2;
-
    Debug("VSockOut: recved %d bytes for conn %d\n", out->payloadLen, out->fd);
-
-   *rpcStatus = out->payload[0] == '1';
    return TRUE;
 
 error:
@@ -296,6 +363,488 @@ error:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockAsyncConstruct --
+ *
+ *      Constructor for the asynchronous send state.
+ *
+ * Results:
+ *      New VSockAsync object.
+ *
+ * Side effects:
+ *      Allocates memory.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VSockAsync *
+VSockAsyncConstruct(void)
+{
+   VSockAsync *async = g_malloc0(sizeof *async);
+
+   async->out = VSockOutConstruct();
+   ASSERT(async->out != NULL);
+   async->lock = g_mutex_new();
+   async->inflight = g_queue_new();
+   async->waiting = g_queue_new();
+
+   return async;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockAsyncReqFree --
+ *
+ *      Free an asynchronous request.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VSockAsyncReqFree(VSockAsyncReq *req)    // IN
+{
+   free(req->data);
+   g_free(req);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockAsyncComplete --
+ *
+ *      Report the outcome of an asynchronous request and free it.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The callback runs in the channel's main context, unless 'now' is set,
+ *      in which case it is called directly.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VSockAsyncComplete(RpcChannel *chan,       // IN
+                   VSockAsyncReq *req,     // IN
+                   gboolean status,        // IN
+                   const char *reply,      // IN
+                   size_t replyLen,        // IN
+                   gboolean now)           // IN
+{
+   char *result = Util_SafeMalloc(replyLen + 1);
+
+   memcpy(result, reply, replyLen);
+   result[replyLen] = '\0';
+
+   if (now) {
+      req->cb(chan, status, result, replyLen, req->cbData);
+      free(result);
+   } else {
+      RpcChannel_CompleteAsync(chan, req->cb, req->cbData, status, result,
+                               replyLen);
+   }
+   VSockAsyncReqFree(req);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockAsyncFailAll --
+ *
+ *      Fail all queued asynchronous requests. Called with the lock held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Empties both queues.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VSockAsyncFailAll(RpcChannel *chan,      // IN
+                  VSockAsync *async,     // IN
+                  const char *reason,    // IN
+                  gboolean now)          // IN
+{
+   VSockAsyncReq *req;
+
+   while ((req = g_queue_pop_head(async->inflight)) != NULL ||
+          (req = g_queue_pop_head(async->waiting)) != NULL) {
+      VSockAsyncComplete(chan, req, FALSE, reason, strlen(reason), now);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockAsyncReader --
+ *
+ *      Reader thread for the asynchronous connection. Matches each reply to
+ *      the oldest request in flight, refills the window from the waiting
+ *      queue, and reports completions. Exits when the connection fails or
+ *      is shut down.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      On failure, fails all queued requests and closes the connection.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gpointer
+VSockAsyncReader(gpointer data)     // IN
+{
+   RpcChannel *chan = data;
+   VSockChannel *vsock = chan->_private;
+   VSockAsync *async = vsock->async;
+   SOCKET fd = async->out->fd;
+
+   while (TRUE) {
+      VSockAsyncReq *req;
+      VSockAsyncReq *next;
+      char *payload = NULL;
+      int payloadLen = 0;
+      const char *reply;
+      size_t replyLen;
+      Bool rpcStatus;
+      gboolean sent = TRUE;
+
+      if (!Socket_RecvPacket(fd, &payload, &payloadLen)) {
+         break;
+      }
+
+      g_mutex_lock(async->lock);
+      req = g_queue_pop_head(async->inflight);
+      next = g_queue_pop_head(async->waiting);
+      if (next != NULL) {
+         sent = Socket_SendPacket(fd, next->data, next->dataLen);
+         g_queue_push_tail(async->inflight, next);
+      }
+      g_mutex_unlock(async->lock);
+
+      if (req == NULL) {
+         Debug(LGPFX "Unexpected reply on async conn %d\n", fd);
+         free(payload);
+         break;
+      }
+
+      Debug(LGPFX "Recved %d bytes for async request %u\n", payloadLen,
+            req->seq);
+      if (VSockOutParseReply(payload, payloadLen, &rpcStatus, &reply,
+                             &replyLen)) {
+         VSockAsyncComplete(chan, req, rpcStatus, reply, replyLen, FALSE);
+      } else {
+         VSockAsyncComplete(chan, req, FALSE, reply, strlen(reply), FALSE);
+      }
+      free(payload);
+
+      if (!sent) {
+         break;
+      }
+   }
+
+   g_mutex_lock(async->lock);
+   if (!async->stopping) {
+      VSockAsyncFailAll(chan, async,
+                        "VSockOut: Unable to receive the result of the RPCI "
+                        "command", FALSE);
+      VSockOutStop(async->out);
+   }
+   g_mutex_unlock(async->lock);
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockAsyncStop --
+ *
+ *      Close the asynchronous connection and wait for its reader thread.
+ *      Requests still queued are failed: from the main context, or right
+ *      away if 'now' is set (the channel is going away).
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VSockAsyncStop(RpcChannel *chan,      // IN
+               VSockAsync *async,     // IN
+               gboolean now)          // IN
+{
+   GThread *reader;
+
+   g_mutex_lock(async->lock);
+   async->stopping = TRUE;
+   if (async->out->fd != INVALID_SOCKET) {
+      Socket_Shutdown(async->out->fd);
+   }
+   reader = async->reader;
+   async->reader = NULL;
+   g_mutex_unlock(async->lock);
+
+   if (reader != NULL) {
+      g_thread_join(reader);
+   }
+
+   g_mutex_lock(async->lock);
+   VSockOutStop(async->out);
+   VSockAsyncFailAll(chan, async, "VSockOut: Channel stopped", now);
+   async->stopping = FALSE;
+   g_mutex_unlock(async->lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockAsyncDestruct --
+ *
+ *      Destructor for the asynchronous send state.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Stops the asynchronous connection, failing queued requests right
+ *      away.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VSockAsyncDestruct(RpcChannel *chan,     // IN
+                   VSockAsync *async)    // IN
+{
+   VSockAsyncStop(chan, async, TRUE);
+   VSockOutDestruct(async->out);
+   g_queue_free(async->inflight);
+   g_queue_free(async->waiting);
+   g_mutex_free(async->lock);
+   g_free(async);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockChannelSendAsync --
+ *
+ *      Queue an RPC on the asynchronous connection, opening it and starting
+ *      its reader thread on first use. Up to VSOCK_ASYNC_WINDOW requests
+ *      are sent ahead of their replies; the rest wait for the window to
+ *      open. Called with the channel lock held.
+ *
+ * Result:
+ *      TRUE if the request was queued and its callback will be called.
+ *      FALSE if the connection can't be used; the caller falls back to a
+ *      synchronous send.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VSockChannelSendAsync(RpcChannel *chan,         // IN
+                      char const *data,         // IN
+                      size_t dataLen,           // IN
+                      RpcChannelSendCb cb,      // IN
+                      gpointer cbData)          // IN
+{
+   VSockChannel *vsock = chan->_private;
+   VSockAsync *async = vsock->async;
+   VSockAsyncReq *req;
+   GThread *stale = NULL;
+   gboolean ret = FALSE;
+
+   if (async == NULL) {
+      return FALSE;
+   }
+
+   g_mutex_lock(async->lock);
+
+   if (async->out->fd == INVALID_SOCKET) {
+      /* A reader that failed has closed the connection and is exiting. */
+      stale = async->reader;
+      async->reader = NULL;
+      g_mutex_unlock(async->lock);
+      if (stale != NULL) {
+         g_thread_join(stale);
+      }
+      g_mutex_lock(async->lock);
+
+      if (async->out->fd == INVALID_SOCKET) {
+         if (!VSockOutStart(async->out)) {
+            goto exit;
+         }
+         async->reader = g_thread_create(VSockAsyncReader, chan, TRUE, NULL);
+         if (async->reader == NULL) {
+            VSockOutStop(async->out);
+            goto exit;
+         }
+      }
+   }
+
+   req = g_malloc0(sizeof *req);
+   req->seq = ++async->nextSeq;
+   req->data = Util_SafeMalloc(dataLen);
+   memcpy(req->data, data, dataLen);
+   req->dataLen = dataLen;
+   req->cb = cb;
+   req->cbData = cbData;
+
+   if (g_queue_get_length(async->inflight) >= VSOCK_ASYNC_WINDOW) {
+      g_queue_push_tail(async->waiting, req);
+      ret = TRUE;
+      goto exit;
+   }
+
+   Debug(LGPFX "Sending async request %u for conn %d, reqLen=%d\n",
+         req->seq, async->out->fd, (int)dataLen);
+   if (!Socket_SendPacket(async->out->fd, req->data, req->dataLen)) {
+      /* Let the reader fail whatever else is in flight. */
+      Socket_Shutdown(async->out->fd);
+      VSockAsyncReqFree(req);
+      goto exit;
+   }
+   g_queue_push_tail(async->inflight, req);
+   ret = TRUE;
+
+exit:
+   g_mutex_unlock(async->lock);
+   return ret;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockChannelSendBulk --
+ *
+ *      Sends a large RPC over a connection of its own to the bulk port the
+ *      host gave out for it, and waits for the reply there. See
+ *      GUESTRPC_BULK_OPEN_CMD for the protocol. Doesn't touch the channel's
+ *      connections, so it runs without the channel lock.
+ *
+ *      The caller must free the result whether the call is successful or
+ *      not.
+ *
+ * Result:
+ *      TRUE on success, FALSE on failure. 'delivered' tells whether the
+ *      whole RPC reached the host; if not, it may be sent again through
+ *      the regular channel.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VSockChannelSendBulk(RpcChannel *chan,         // IN
+                     unsigned int port,        // IN
+                     const char *token,        // IN
+                     char const *data,         // IN
+                     size_t dataLen,           // IN
+                     gboolean *delivered,      // OUT
+                     Bool *rpcStatus,          // OUT
+                     char **result,            // OUT
+                     size_t *resultLen)        // OUT
+{
+   gboolean isPriv;
+   SOCKET fd;
+   char *header;
+   size_t sent;
+   char *payload = NULL;
+   int payloadLen = 0;
+   const char *reply;
+   size_t replyLen;
+   gboolean ret = FALSE;
+
+   *delivered = FALSE;
+   *rpcStatus = FALSE;
+
+   fd = VSockCreateConn(port, &isPriv);
+   if (fd == INVALID_SOCKET) {
+      reply = "VSockOut: Unable to connect to the bulk channel";
+      goto exit;
+   }
+
+   header = g_strdup_printf("%s %"FMTSZ"u\n", token, dataLen);
+   ret = Socket_Send(fd, header, strlen(header));
+   g_free(header);
+
+   for (sent = 0; ret && sent < dataLen; sent += VSOCK_BULK_CHUNK_SIZE) {
+      size_t len = MIN(dataLen - sent, VSOCK_BULK_CHUNK_SIZE);
+
+      ret = Socket_Send(fd, (char *)data + sent, (int)len);
+   }
+   if (!ret) {
+      reply = "VSockOut: Unable to send data over the bulk channel";
+      goto close;
+   }
+
+   /*
+    * From here on the host may run the RPC, so it must not be sent again.
+    */
+   *delivered = TRUE;
+
+   if (!Socket_RecvPacket(fd, &payload, &payloadLen)) {
+      reply = "VSockOut: Unable to receive the result of the RPCI command";
+      ret = FALSE;
+      goto close;
+   }
+
+   ret = VSockOutParseReply(payload, payloadLen, rpcStatus, &reply,
+                            &replyLen);
+   if (ret) {
+      Debug(LGPFX "Bulk sent %"FMTSZ"u bytes to port %u, recved %d bytes\n",
+            dataLen, port, payloadLen);
+      *result = Util_SafeMalloc(replyLen + 1);
+      memcpy(*result, reply, replyLen);
+      (*result)[replyLen] = '\0';
+      *resultLen = replyLen;
+   }
+
+close:
+   Socket_Close(fd);
+exit:
+   if (!ret) {
+      *result = Util_SafeStrdup(reply);
+      *resultLen = strlen(reply);
+   }
+   free(payload);
+   return ret;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -319,6 +868,7 @@ VSockChannelOnStartErr(RpcChannel *chan)    // IN
 
    /* destroy VSockOut part only */
    VSockOutDestruct(vsock->out);
+   VSockAsyncDestruct(chan, vsock->async);
    chan->_private = NULL;
 }
 
@@ -386,6 +936,10 @@ VSockChannelStop(RpcChannel *chan)   // IN
    } else {
       ASSERT(!chan->outStarted);
    }
+
+   if (vsock->async != NULL) {
+      VSockAsyncStop(chan, vsock->async, FALSE);
+   }
 }
 
 
@@ -410,6 +964,8 @@ VSockChannelShutdown(RpcChannel *chan)    // IN
 {
    VSockChannel *vsock = chan->_private;
 
+   VSockAsyncDestruct(chan, vsock->async);
+   vsock->async = NULL;
    VSockChannelStop(chan);
    VSockOutDestruct(vsock->out);
    g_free(vsock);
@@ -571,7 +1127,9 @@ VSockChannel_New(void)
       VSockChannelShutdown,
       VSockChannelGetType,
       VSockChannelOnStartErr,
-      VSockChannelStopRpcOut
+      VSockChannelStopRpcOut,
+      VSockChannelSendAsync,
+      VSockChannelSendBulk
    };
 
    chan = RpcChannel_Create();
@@ -579,6 +1137,7 @@ VSockChannel_New(void)
 
    vsock->out = VSockOutConstruct();
    ASSERT(vsock->out != NULL);
+   vsock->async = VSockAsyncConstruct();
 
    chan->inStarted = FALSE;
    chan->outStarted = FALSE;
@@ -82,6 +82,7 @@
 
 #if !defined(VMTOOLS_USE_GLIB)
 #include "eventManager.h"
+#include "hashTable.h"
 
 /* Which event queue should RPC events be added to? */
 static DblLnkLst_Links *gTimerEventQueue;
@@ -90,14 +91,18 @@ static DblLnkLst_Links *gTimerEventQueue;
  * The RpcIn object
  */
 
-/* The list of TCLO command callbacks we support */
-typedef struct RpcInCallbackList {
+/*
+ * A TCLO command callback we support. Callbacks are kept in a hash table
+ * keyed by their (owned) name, so dispatching a message is a single lookup.
+ */
+typedef struct RpcInCallbackEntry {
    const char *name;
    size_t length; /* Length of name so we don't have to strlen a lot */
    RpcIn_Callback callback;
-   struct RpcInCallbackList *next;
    void *clientData;
-} RpcInCallbackList;
+} RpcInCallbackEntry;
+
+#define RPCIN_CALLBACK_BUCKETS 64
 
 #endif /* VMTOOLS_USE_GLIB */
 
@@ -106,6 +111,7 @@ typedef struct RpcInCallbackList {
 #define RPCIN_HEARTBEAT_INTERVAL              1000             /* 1 second */
 #define RPCIN_MIN_SEND_BUF_SIZE               (64 * 1024)
 #define RPCIN_MIN_RECV_BUF_SIZE               (64 * 1024)
+#define RPCIN_MAX_PACKET_LEN                  (16 * 1024 * 1024)
 
 struct RpcIn;
 
@@ -113,10 +119,6 @@ struct RpcIn;
 typedef struct _ConnInfo {
    AsyncSocket *asock;
 
-   int32 packetLen;
-   char *recvBuf;
-   int recvBufLen;
-
    Bool connected;
    Bool shutDown;
    Bool recvStopped;
@@ -127,8 +129,7 @@ typedef struct _ConnInfo {
    struct RpcIn *in;
 } ConnInfo;
 
-static void RpcInConnRecvHeader(ConnInfo *conn);
-static Bool RpcInConnRecvPacket(ConnInfo *conn, const char **errmsg);
+static void RpcInConnRecvPackets(ConnInfo *conn);
 #endif  /* VMTOOLS_USE_VSOCKET */
 
 
@@ -139,7 +140,7 @@ struct RpcIn {
    RpcIn_Callback dispatch;
    gpointer clientData;
 #else
-   RpcInCallbackList *callbacks;
+   HashTable *callbacks;
    Event *nextEvent;
 #endif
 
@@ -151,6 +152,21 @@ struct RpcIn {
    Message_Channel *channel;
    unsigned int delay;   /* The delay of the previous iteration of RpcInLoop */
    unsigned int maxDelay;  /* The maximum delay to schedule in RpcInLoop */
+   unsigned int busyPolls; /* Empty polls to keep the minimum delay for */
+   unsigned int idlePolls; /* Empty polls since the last message */
+
+   /*
+    * Pickup latency of the backdoor poller, in milliseconds. A message may
+    * have been posted any time since the previous poll, so the time between
+    * polls is the longest it can have waited.
+    */
+   uint64 lastPoll;
+   uint64 pickupReported;
+   uint64 pickupTotal;
+   uint64 pickupMax;
+   unsigned int pickupCount;
+   uint64 lastWait;   /* Pickup wait of the message being dispatched. */
+
    RpcIn_ErrorFunc *errorFunc;
    void *errorData;
 
@@ -180,6 +196,9 @@ struct RpcIn {
    Bool shouldStop; // Stop the channel the next time RpcInLoop exits.
 };
 
+/* How often (in ms) the backdoor poller logs its pickup latency. */
+#define RPCIN_PICKUP_LOG_INTERVAL 60000
+
 static Bool RpcInSend(RpcIn *in, int flags);
 static Bool RpcInScheduleRecvEvent(RpcIn *in);
 static void RpcInStop(RpcIn *in);
@@ -253,12 +272,38 @@ RpcIn_Construct(DblLnkLst_Links *eventQueue)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcInFreeCallback --
+ *
+ *      Free a callback entry. Called by the hash table on removal.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RpcInFreeCallback(void *data) // IN
+{
+   RpcInCallbackEntry *p = data;
+
+   free((void *) p->name);
+   free(p);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * RpcInLookupCallback --
  *
- *      Lookup a callback struct in our list.
+ *      Lookup a callback struct in our table.
  *
  * Results:
  *      The callback if found
@@ -270,22 +315,21 @@ RpcIn_Construct(DblLnkLst_Links *eventQueue)
  *-----------------------------------------------------------------------------
  */
 
-static RpcInCallbackList *
+static RpcInCallbackEntry *
 RpcInLookupCallback(RpcIn *in,        // IN
                     const char *name) // IN
 {
-   RpcInCallbackList *p;
+   void *p = NULL;
 
    ASSERT(in);
    ASSERT(name);
 
-   for (p = in->callbacks; p; p = p->next) {
-      if (strcmp(name, p->name) == 0) {
-         return p;
-      }
+   if (in->callbacks == NULL ||
+       !HashTable_Lookup(in->callbacks, name, &p)) {
+      return NULL;
    }
 
-   return NULL;
+   return p;
 }
 
 
@@ -316,7 +360,7 @@ RpcIn_RegisterCallback(RpcIn *in,               // IN
                        RpcIn_Callback cb,       // IN
                        void *clientData)        // IN
 {
-   RpcInCallbackList *p;
+   RpcInCallbackEntry *p;
 
    Debug("RpcIn: Registering callback '%s'\n", name);
 
@@ -325,17 +369,22 @@ RpcIn_RegisterCallback(RpcIn *in,               // IN
    ASSERT(cb);
    ASSERT(RpcInLookupCallback(in, name) == NULL); // not there yet
 
-   p = (RpcInCallbackList *) malloc(sizeof(RpcInCallbackList));
+   if (in->callbacks == NULL) {
+      in->callbacks = HashTable_Alloc(RPCIN_CALLBACK_BUCKETS, HASH_STRING_KEY,
+                                      RpcInFreeCallback);
+   }
+
+   p = (RpcInCallbackEntry *) malloc(sizeof(RpcInCallbackEntry));
    ASSERT_NOT_IMPLEMENTED(p);
 
    p->length = strlen(name);
    p->name = strdup(name);
+   ASSERT_NOT_IMPLEMENTED(p->name);
    p->callback = cb;
    p->clientData = clientData;
 
-   p->next = in->callbacks;
-
-   in->callbacks = p;
+   /* The entry owns the key. */
+   HashTable_Insert(in->callbacks, p->name, p);
 }
 
 
@@ -359,29 +408,19 @@ void
 RpcIn_UnregisterCallback(RpcIn *in,               // IN
                          const char *name)        // IN
 {
-   RpcInCallbackList *cur, *prev;
-
    ASSERT(in);
    ASSERT(name);
 
    Debug("RpcIn: Unregistering callback '%s'\n", name);
 
-   for (cur = in->callbacks, prev = NULL; cur && strcmp(cur->name, name);
-        prev = cur, cur = cur->next);
-
    /*
     * If we called UnregisterCallback on a name that doesn't exist, we
     * have a problem.
     */
-   ASSERT(cur != NULL);
-
-   if (prev == NULL) {
-      in->callbacks = cur->next;
-   } else {
-      prev->next = cur->next;
+   if (in->callbacks == NULL || !HashTable_Delete(in->callbacks, name)) {
+      Debug("RpcIn: Callback '%s' was not registered\n", name);
+      ASSERT(FALSE);
    }
-   free((void *)cur->name);
-   free(cur);
 }
 
 
@@ -421,7 +460,11 @@ RpcIn_Construct(GMainContext *mainCtx,    // IN
    RpcIn *result;
 
 #if defined(VMTOOLS_USE_VSOCKET)
+#if defined(__linux__)
+   Poll_InitEpoll();
+#else
    Poll_InitGtk();
+#endif
 #endif
 
    ASSERT(mainCtx != NULL);
@@ -469,13 +512,9 @@ RpcIn_Destruct(RpcIn *in) // IN
 #endif
 
 #if !defined(VMTOOLS_USE_GLIB)
-   while (in->callbacks) {
-      RpcInCallbackList *p;
-
-      p = in->callbacks->next;
-      free((void *) in->callbacks->name);
-      free(in->callbacks);
-      in->callbacks = p;
+   if (in->callbacks != NULL) {
+      HashTable_Free(in->callbacks);
+      in->callbacks = NULL;
    }
 
    gTimerEventQueue = NULL;
@@ -551,7 +590,6 @@ RpcInCloseConn(ConnInfo *conn) // IN
    } else {
       Debug("RpcIn: Closing vsocket connection %d\n", fd);
       AsyncSocket_Close(conn->asock);
-      free(conn->recvBuf);
       free(conn);
    }
 }
@@ -811,7 +849,9 @@ static void
 RpcInRegisterHeartbeatCallback(RpcIn *in)      // IN
 {
    ASSERT(in->heartbeatSrc == NULL);
-   in->heartbeatSrc = VMTools_CreateTimer(RPCIN_HEARTBEAT_INTERVAL);
+   in->heartbeatSrc = VMTools_CreateCoalescedTimer("rpcin-heartbeat",
+                                                   RPCIN_HEARTBEAT_INTERVAL,
+                                                   RPCIN_HEARTBEAT_INTERVAL / 4);
    if (in->heartbeatSrc != NULL) {
       g_source_set_callback(in->heartbeatSrc, RpcInHeartbeatCallback, in, NULL);
       g_source_attach(in->heartbeatSrc, in->mainCtx);
@@ -839,19 +879,20 @@ RpcInRegisterHeartbeatCallback(RpcIn *in)      // IN
 
 static gboolean
 RpcInDecodePacket(ConnInfo *conn,       // IN
+                  const char *packet,   // IN: including length header
+                  int packetLen,        // IN
                   char **payload,       // OUT
                   int32 *payloadLen)    // OUT
 {
    ErrorCode res;
    DataMap map;
    int fd = AsyncSocket_GetFd(conn->asock);
-   int fullPacketLen = conn->packetLen + sizeof conn->packetLen;
    char *buf;
    int32 len;
 
 
    /* decoding the packet */
-   res = DataMap_Deserialize(conn->recvBuf, fullPacketLen, &map);
+   res = DataMap_DeserializeNoCopy(packet, packetLen, &map);
    if (res != DMERR_SUCCESS) {
       Debug("RpcIn: Error in dataMap decoding for conn %d, error=%d\n",
             fd, res);
@@ -902,146 +943,87 @@ exit:
  */
 
 static void
-RpcInConnRecvedCb(void *buf,            // IN
+RpcInConnRecvedCb(void *buf,            // IN: packet, including header
                   int len,              // IN
                   AsyncSocket *asock,   // IN
                   void *clientData)     // IN
 {
    ConnInfo *conn = (ConnInfo *)clientData;
    const char *errmsg = NULL;
+   char *payload = NULL;
+   int32 payloadLen = 0;
 
    ASSERT(conn != NULL);
 
-   if (buf == &conn->packetLen) {
-      /* We just received the packet header*/
-      conn->packetLen = ntohl(conn->packetLen);
-      Debug("RpcIn:: Got packet length %d from conn %d.\n",
-            conn->packetLen, AsyncSocket_GetFd(conn->asock));
-      if (!RpcInConnRecvPacket(conn, &errmsg)) {
-         RpcInCloseChannel(conn->in, errmsg);
-      }
-   } else {
-      char *payload = NULL;
-      int32 payloadLen = 0;
+   Debug("RpcIn:: Got packet length %d from conn %d.\n",
+         len, AsyncSocket_GetFd(conn->asock));
 
-      ASSERT(buf == conn->recvBuf + sizeof conn->packetLen);
-      ASSERT(len <= conn->recvBufLen - sizeof conn->packetLen);
-
-      if (!RpcInDecodePacket(conn, &payload, &payloadLen)) {
-         errmsg = "RpcIn: packet error";
-         RpcInCloseChannel(conn->in, errmsg);
-         return;
-      }
+   if (!RpcInDecodePacket(conn, buf, len, &payload, &payloadLen)) {
+      errmsg = "RpcIn: packet error";
+      RpcInCloseChannel(conn->in, errmsg);
+      return;
+   }
 
-      Debug("RpcIn: Got msg from conn %d: [%s]\n",
-            AsyncSocket_GetFd(conn->asock), payload);
-
-      if (RpcInExecRpc(conn->in, payload, payloadLen, &errmsg)) {
-         conn->in->mustSend = TRUE;
-         if (RpcInSend(conn->in, 0)) {
-            if (conn->in->heartbeatSrc == NULL) {
-               /* Register heartbeat callback after the first successful send
-                * so we do not mess with TCLO protocol. */
-               RpcInRegisterHeartbeatCallback(conn->in);
-            }
-            RpcInConnRecvHeader(conn);
-            free(payload);
-            return;
-         } else {
-            errmsg = "RpcIn: Unable to send";
+   Debug("RpcIn: Got msg from conn %d: [%s]\n",
+         AsyncSocket_GetFd(conn->asock), payload);
+
+   /* The socket woke us up, so the message did not wait to be picked up. */
+   conn->in->lastWait = 0;
+   if (RpcInExecRpc(conn->in, payload, payloadLen, &errmsg)) {
+      conn->in->mustSend = TRUE;
+      if (RpcInSend(conn->in, 0)) {
+         if (conn->in->heartbeatSrc == NULL) {
+            /* Register heartbeat callback after the first successful send
+             * so we do not mess with TCLO protocol. */
+            RpcInRegisterHeartbeatCallback(conn->in);
          }
+         /* Packet receive stays registered for the next message. */
+         free(payload);
+         return;
+      } else {
+         errmsg = "RpcIn: Unable to send";
       }
-
-      RpcInCloseChannel(conn->in, errmsg);  /* on error */
-      free(payload);
    }
+
+   RpcInCloseChannel(conn->in, errmsg);  /* on error */
+   free(payload);
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * RpcInConnRecvHeader --
+ * RpcInConnRecvPackets --
  *
- *    Register header recv callback for vsocket connection.
+ *    Start receiving length-prefixed packets on the vsocket connection.
+ *    AsyncSocket buffers the stream and calls RpcInConnRecvedCb once per
+ *    complete packet until the receive is cancelled.
  *
  * Result:
  *    None
  *
  * Side-effects:
- *    None
+ *    Closes the channel on failure.
  *
  *-----------------------------------------------------------------------------
  */
 
 static void
-RpcInConnRecvHeader(ConnInfo *conn)   // IN
+RpcInConnRecvPackets(ConnInfo *conn)   // IN
 {
    int res;
-   res = AsyncSocket_Recv(conn->asock, &conn->packetLen,
-                          sizeof conn->packetLen,
-                          RpcInConnRecvedCb, conn);
+   res = AsyncSocket_RecvPackets(conn->asock, RPCIN_MAX_PACKET_LEN,
+                                 RpcInConnRecvedCb, conn);
 
    conn->recvStopped = res != ASOCKERR_SUCCESS;
    if (res != ASOCKERR_SUCCESS) {
-      Debug("RpcIn: error in recving packet header for conn: %d\n",
+      Debug("RpcIn: error in recving packets for conn: %d\n",
             AsyncSocket_GetFd(conn->asock));
       RpcInCloseChannel(conn->in, "RpcIn: error in recv");
    }
 }
 
 
-/*
- *-----------------------------------------------------------------------------
- *
- * RpcInConnRecvPacket --
- *
- *    Register packet recv callback for vsocket connection.
- *
- * Result:
- *    TRUE on success, FALSE on failure.
- *
- * Side-effects:
- *    None
- *
- *-----------------------------------------------------------------------------
- */
-
-static Bool
-RpcInConnRecvPacket(ConnInfo *conn,         // IN
-                    const char **errmsg)    // OUT
-{
-   int res;
-   int32 pktLen = conn->packetLen;
-   int fullPktLen = pktLen + sizeof pktLen;
-
-   if (conn->recvBuf == NULL || conn->recvBufLen < fullPktLen) {
-      // allocate buffer if needed.
-      conn->recvBufLen = fullPktLen;
-      free(conn->recvBuf);
-      conn->recvBuf = malloc(conn->recvBufLen);
-      if (conn->recvBuf == NULL) {
-         Debug("RpcIn: Could not allocate recv buffer for socket %d, "
-               "closing connection.\n", AsyncSocket_GetFd(conn->asock));
-         *errmsg = "Couldn't allocate enough memory";
-         return FALSE;
-      }
-   }
-
-   *((int32 *)(conn->recvBuf)) = htonl(pktLen);
-   res = AsyncSocket_Recv(conn->asock, conn->recvBuf + sizeof pktLen,
-                          pktLen, RpcInConnRecvedCb, conn);
-
-   conn->recvStopped = res != ASOCKERR_SUCCESS;
-   if (res != ASOCKERR_SUCCESS) {
-      Debug("RpcIn: error in recving packet for conn %d, "
-            "closing connection.\n", AsyncSocket_GetFd(conn->asock));
-      *errmsg = "RpcIn: error in recv";
-   }
-   return res == ASOCKERR_SUCCESS;
-}
-
-
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1114,7 +1096,7 @@ RpcInConnectDone(AsyncSocket *asock,   // IN
    }
 
    conn->connected = TRUE;
-   RpcInConnRecvHeader(conn);
+   RpcInConnRecvPackets(conn);
    return;
 
 exit:
@@ -1278,6 +1260,60 @@ RpcIn_stop(RpcIn *in) // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcIn_SetBusyPolls --
+ *
+ *      Set how many empty polls the backdoor poller keeps polling at its
+ *      minimum delay after a message, before it starts backing off towards
+ *      the max delay. Has no effect on vsocket connections, which are woken
+ *      up by the socket.
+ *
+ * Results:
+ *      None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+RpcIn_SetBusyPolls(RpcIn *in,               // IN
+                   unsigned int busyPolls)  // IN
+{
+   ASSERT(in);
+   in->busyPolls = busyPolls;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcIn_GetPickupWait --
+ *
+ *      Get how long the message being dispatched may have waited on the
+ *      host before the backdoor poller picked it up. Meant to be called
+ *      from the dispatch callback.
+ *
+ * Results:
+ *      The wait in ms, 0 for messages received on a vsocket connection.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+unsigned int
+RpcIn_GetPickupWait(RpcIn *in)   // IN
+{
+   ASSERT(in);
+   return (unsigned int)MIN(in->lastWait, MAX_UINT32);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1321,7 +1357,7 @@ RpcInExecRpc(RpcIn *in,            // IN
 #else
    char *cmd;
    unsigned int index = 0;
-   RpcInCallbackList *cb = NULL;
+   RpcInCallbackEntry *cb = NULL;
 
    cmd = StrUtil_GetNextToken(&index, reply, " ");
    if (cmd != NULL) {
@@ -1368,6 +1404,7 @@ RpcInExecRpc(RpcIn *in,            // IN
     * perfoms a time-consuming job) and continue to loop immediately
     */
    in->delay = 0;
+   in->idlePolls = 0;
 
    return TRUE;
 }
@@ -1379,8 +1416,10 @@ RpcInExecRpc(RpcIn *in,            // IN
  * RpcInUpdateDelayTime --
  *
  *      Calculate new delay time.
- *      Use an exponential back-off, doubling the time to wait each time up to
- *      the max delay.
+ *      For the first busyPolls empty polls after a message, poll at the
+ *      minimum delay so that follow-up messages are picked up quickly. After
+ *      that use an exponential back-off, doubling the time to wait each time
+ *      up to the max delay.
  *
  * Result:
  *      None
@@ -1394,6 +1433,12 @@ RpcInExecRpc(RpcIn *in,            // IN
 static void
 RpcInUpdateDelayTime(RpcIn *in)            // IN
 {
+   if (in->idlePolls < in->busyPolls) {
+      in->idlePolls++;
+      in->delay = MIN(1, in->maxDelay);
+      return;
+   }
+
    if (in->delay < in->maxDelay) {
       if (in->delay > 0) {
          /*
@@ -1490,6 +1535,47 @@ exit:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcInRecordPickup --
+ *
+ *      Account for a message picked up by the backdoor poller, and
+ *      periodically log how long messages waited before being picked up.
+ *
+ * Result:
+ *      None
+ *
+ * Side-effects:
+ *      Resets the statistics once they are logged.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RpcInRecordPickup(RpcIn *in,    // IN
+                  uint64 now,   // IN: ms
+                  uint64 wait)  // IN: ms
+{
+   in->lastWait = wait;
+   in->pickupCount++;
+   in->pickupTotal += wait;
+   in->pickupMax = MAX(in->pickupMax, wait);
+
+   if (now - in->pickupReported >= RPCIN_PICKUP_LOG_INTERVAL) {
+      Debug("RpcIn: picked up %u messages in %u s, wait avg %u ms, "
+            "max %u ms\n", in->pickupCount,
+            (unsigned int)((now - in->pickupReported) / 1000),
+            (unsigned int)(in->pickupTotal / in->pickupCount),
+            (unsigned int)in->pickupMax);
+      in->pickupReported = now;
+      in->pickupTotal = 0;
+      in->pickupMax = 0;
+      in->pickupCount = 0;
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1521,6 +1607,8 @@ RpcInLoop(void *clientData) // IN
    char const *reply;
    size_t repLen;
    Bool resched = FALSE;
+   uint64 now;
+   uint64 wait;
 
 #if defined(VMTOOLS_USE_GLIB)
    unsigned int current;
@@ -1567,15 +1655,19 @@ RpcInLoop(void *clientData) // IN
       goto error;
    }
 
+   now = System_GetTimeMonotonic() * 10;
+   wait = (in->lastPoll != 0) ? now - in->lastPoll : 0;
+   in->lastPoll = now;
+
    if (repLen) {
       char *s = ByteDump(reply, repLen);
       Debug("RpcIn: received %d bytes, content:\"%s\"\n", (int) repLen, s);
+      RpcInRecordPickup(in, now, wait);
       if (!RpcInExecRpc(in, reply, repLen, &errmsg)) {
          goto error;
       }
    } else {
       static uint64 lastPrintMilli = 0;
-      uint64 now = System_GetTimeMonotonic() * 10;
       if ((now - lastPrintMilli) > 5000) {
          /*
           * Throttle the log to write one entry every 5 seconds
@@ -1811,6 +1903,12 @@ RpcIn_start(RpcIn *in,                    // IN
 
    in->delay = 0;
    in->maxDelay = delay;
+   in->idlePolls = 0;
+   in->lastPoll = 0;
+   in->pickupReported = System_GetTimeMonotonic() * 10;
+   in->pickupTotal = 0;
+   in->pickupMax = 0;
+   in->pickupCount = 0;
    in->errorFunc = errorFunc;
    in->errorData = errorData;
 
@@ -0,0 +1,437 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file netlink.c
+ *
+ *	Collects the routing tables with an rtnetlink dump.
+ *
+ *	Returns the same structures as the @c /proc/net parsers in net.c, so
+ *	callers can free the results with SlashProcNet_FreeRoute and
+ *	SlashProcNet_FreeRoute6, but decodes binary messages out of a single
+ *	fixed-size buffer instead of allocating and regex-matching every line.
+ */
+
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include <glib.h>
+
+#include "vmware.h"
+#include "slashProc.h"
+
+
+/*
+ * Local data.
+ */
+
+
+/**
+ * Size of the receive buffer.  The kernel fills each dump message up to a
+ * page or so; anything larger than this is truncated and fails the dump.
+ */
+#define NETLINK_RECV_BUFSIZE (32 * 1024)
+
+
+/**
+ * The parts of an RTM_NEWROUTE message the collector cares about.
+ */
+typedef struct NetlinkRoute {
+   unsigned char        family;
+   unsigned char        dstLen;
+   unsigned int         table;
+   unsigned int         ifIndex;
+   unsigned int         metric;
+   Bool                 hasGateway;
+   const void          *dst;      // NULL for the default route.
+   const void          *gateway;
+} NetlinkRoute;
+
+
+/*
+ * Private function prototypes.
+ */
+
+static Bool NetlinkParseRoute(const struct nlmsghdr *hdr,
+                              NetlinkRoute *route);
+static void NetlinkAddRoute(GPtrArray *routeArray,
+                            const NetlinkRoute *route);
+
+
+/*
+ * Global functions.
+ */
+
+
+/*
+ ******************************************************************************
+ * SlashProcNet_GetRouteNetlink --                                      */ /**
+ *
+ * @brief Dumps a routing table over rtnetlink and returns a @c GPtrArray of
+ *        <tt>struct rtentry</tt>s (@c AF_INET) or
+ *        <tt>struct in6_rtmsg</tt>s (@c AF_INET6).
+ *
+ * Only unicast and local routes are returned.  The kernel sends the whole table no
+ * matter what, but routes that are filtered out or over @a maxRoutes are
+ * dropped as they are decoded, so memory use is bounded by what's kept.
+ *
+ * @param[in] family      @c AF_INET or @c AF_INET6.
+ * @param[in] table       Routing table to collect (ex: @c RT_TABLE_MAIN), or
+ *                        @c RT_TABLE_UNSPEC for all of them.
+ * @param[in] maxRoutes   Stop keeping routes after this many.  0 for no cap.
+ * @param[in] filter      If not @c NULL, called with each route's outgoing
+ *                        interface index; the route is kept (and counted
+ *                        against @a maxRoutes) only if it returns @c TRUE.
+ * @param[in] clientData  Passed to @a filter.
+ *
+ * @note        Caller is responsible for freeing the @c GPtrArray with
+ *              SlashProcNet_FreeRoute or SlashProcNet_FreeRoute6.
+ *
+ * @return      On failure, NULL.  On success, a valid @c GPtrArray.
+ *
+ ******************************************************************************
+ */
+
+GPtrArray *
+SlashProcNet_GetRouteNetlink(int family,
+                             unsigned int table,
+                             unsigned int maxRoutes,
+                             SlashProcNetRouteFilter filter,
+                             void *clientData)
+{
+   struct {
+      struct nlmsghdr hdr;
+      struct rtmsg rtm;
+   } req;
+   struct sockaddr_nl addr;
+   GPtrArray *myArray = NULL;
+   char *buf = NULL;
+   Bool done = FALSE;
+   Bool capped = FALSE;
+   int fd;
+
+   ASSERT(family == AF_INET || family == AF_INET6);
+
+   fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+   if (fd < 0) {
+      Warning("%s: socket: %s\n", __func__, g_strerror(errno));
+      return NULL;
+   }
+
+   memset(&addr, 0, sizeof addr);
+   addr.nl_family = AF_NETLINK;
+
+   memset(&req, 0, sizeof req);
+   req.hdr.nlmsg_len = NLMSG_LENGTH(sizeof req.rtm);
+   req.hdr.nlmsg_type = RTM_GETROUTE;
+   req.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+   req.hdr.nlmsg_seq = 1;
+   req.rtm.rtm_family = family;
+
+   if (sendto(fd, &req, req.hdr.nlmsg_len, 0,
+              (struct sockaddr *)&addr, sizeof addr) < 0) {
+      Warning("%s: sendto: %s\n", __func__, g_strerror(errno));
+      goto out;
+   }
+
+   buf = g_malloc(NETLINK_RECV_BUFSIZE);
+   myArray = g_ptr_array_new();
+
+   while (!done) {
+      struct nlmsghdr *hdr;
+      ssize_t len;
+
+      len = recv(fd, buf, NETLINK_RECV_BUFSIZE, MSG_TRUNC);
+      if (len < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         Warning("%s: recv: %s\n", __func__, g_strerror(errno));
+         goto fail;
+      }
+      if (len > NETLINK_RECV_BUFSIZE) {
+         Warning("%s: message of %d bytes truncated\n", __func__, (int)len);
+         goto fail;
+      }
+      if (len == 0) {
+         Warning("%s: unexpected EOF\n", __func__);
+         goto fail;
+      }
+
+      for (hdr = (struct nlmsghdr *)buf;
+           NLMSG_OK(hdr, len);
+           hdr = NLMSG_NEXT(hdr, len)) {
+         NetlinkRoute route;
+
+         if (hdr->nlmsg_seq != req.hdr.nlmsg_seq) {
+            continue;
+         }
+
+         if (hdr->nlmsg_type == NLMSG_DONE) {
+            done = TRUE;
+            break;
+         }
+
+         if (hdr->nlmsg_type == NLMSG_ERROR) {
+            const struct nlmsgerr *err = NLMSG_DATA(hdr);
+
+            Warning("%s: dump failed: %s\n", __func__,
+                    hdr->nlmsg_len >= NLMSG_LENGTH(sizeof *err) ?
+                       g_strerror(-err->error) : "truncated error");
+            goto fail;
+         }
+
+         if (!NetlinkParseRoute(hdr, &route) ||
+             route.family != family ||
+             (table != RT_TABLE_UNSPEC && route.table != table) ||
+             (filter != NULL && !filter(route.ifIndex, clientData))) {
+            continue;
+         }
+
+         /*
+          * Keep reading to the end of the dump even once capped, so that
+          * a dump the kernel aborts is still reported as a failure.
+          */
+         if (maxRoutes != 0 && myArray->len >= maxRoutes) {
+            capped = TRUE;
+            continue;
+         }
+
+         NetlinkAddRoute(myArray, &route);
+      }
+   }
+
+   if (capped) {
+      g_message("%s: route limit (%u) reached, skipped the rest.\n",
+                __func__, maxRoutes);
+   }
+
+   goto out;
+
+fail:
+   if (family == AF_INET) {
+      SlashProcNet_FreeRoute(myArray);
+   } else {
+      SlashProcNet_FreeRoute6(myArray);
+   }
+   myArray = NULL;
+
+out:
+   g_free(buf);
+   close(fd);
+
+   return myArray;
+}
+
+
+/*
+ * Private functions.
+ */
+
+
+/*
+ ******************************************************************************
+ * NetlinkParseRoute --                                                 */ /**
+ *
+ * @brief Picks the interesting attributes out of an RTM_NEWROUTE message.
+ *
+ * For multipath routes, only the first next hop is reported, the way
+ * @c /proc/net/route does.
+ *
+ * @param[in]  hdr      Netlink message.
+ * @param[out] route    Decoded route.  Pointers refer into @a hdr.
+ *
+ * @return      TRUE if @a hdr is a well-formed unicast or local route.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+NetlinkParseRoute(const struct nlmsghdr *hdr,
+                  NetlinkRoute *route)
+{
+   const struct rtmsg *rtm;
+   const struct rtattr *rta;
+   unsigned int addrLen;
+   int len;
+
+   if (hdr->nlmsg_type != RTM_NEWROUTE ||
+       hdr->nlmsg_len < NLMSG_LENGTH(sizeof *rtm)) {
+      return FALSE;
+   }
+
+   rtm = NLMSG_DATA(hdr);
+   if (rtm->rtm_type != RTN_UNICAST && rtm->rtm_type != RTN_LOCAL) {
+      return FALSE;
+   }
+
+   addrLen = rtm->rtm_family == AF_INET ? sizeof(struct in_addr)
+                                        : sizeof(struct in6_addr);
+
+   memset(route, 0, sizeof *route);
+   route->family = rtm->rtm_family;
+   route->dstLen = rtm->rtm_dst_len;
+   route->table = rtm->rtm_table;
+
+   len = RTM_PAYLOAD(hdr);
+   for (rta = RTM_RTA(rtm); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+      switch (rta->rta_type) {
+      case RTA_DST:
+         if (RTA_PAYLOAD(rta) < addrLen) {
+            return FALSE;
+         }
+         route->dst = RTA_DATA(rta);
+         break;
+      case RTA_GATEWAY:
+         if (RTA_PAYLOAD(rta) < addrLen) {
+            return FALSE;
+         }
+         route->gateway = RTA_DATA(rta);
+         route->hasGateway = TRUE;
+         break;
+      case RTA_OIF:
+         route->ifIndex = *(const uint32 *)RTA_DATA(rta);
+         break;
+      case RTA_PRIORITY:
+         route->metric = *(const uint32 *)RTA_DATA(rta);
+         break;
+      case RTA_TABLE:
+         route->table = *(const uint32 *)RTA_DATA(rta);
+         break;
+      case RTA_MULTIPATH:
+         {
+            const struct rtnexthop *nh = RTA_DATA(rta);
+            const struct rtattr *nhRta;
+            int nhLen;
+
+            if (route->ifIndex != 0 ||
+                RTA_PAYLOAD(rta) < sizeof *nh ||
+                nh->rtnh_len < sizeof *nh ||
+                nh->rtnh_len > RTA_PAYLOAD(rta)) {
+               break;
+            }
+
+            route->ifIndex = nh->rtnh_ifindex;
+            nhLen = nh->rtnh_len - RTNH_LENGTH(0);
+            for (nhRta = RTNH_DATA(nh);
+                 RTA_OK(nhRta, nhLen);
+                 nhRta = RTA_NEXT(nhRta, nhLen)) {
+               if (nhRta->rta_type == RTA_GATEWAY &&
+                   RTA_PAYLOAD(nhRta) >= addrLen) {
+                  route->gateway = RTA_DATA(nhRta);
+                  route->hasGateway = TRUE;
+               }
+            }
+         }
+         break;
+      default:
+         break;
+      }
+   }
+
+   return route->ifIndex != 0;
+}
+
+
+/*
+ ******************************************************************************
+ * NetlinkAddRoute --                                                   */ /**
+ *
+ * @brief Converts a decoded route to the structure SlashProcNet_GetRoute or
+ *        SlashProcNet_GetRoute6 would return for it and appends it to
+ *        @a routeArray.
+ *
+ * @param[in]  routeArray       Array to append to.
+ * @param[in]  route            Decoded route.
+ *
+ ******************************************************************************
+ */
+
+static void
+NetlinkAddRoute(GPtrArray *routeArray,
+                const NetlinkRoute *route)
+{
+   unsigned short flags = RTF_UP;
+
+   if (route->hasGateway) {
+      flags |= RTF_GATEWAY;
+   }
+
+   if (route->family == AF_INET) {
+      struct rtentry *myEntry = g_new0(struct rtentry, 1);
+      struct sockaddr_in *sin;
+      char ifName[IF_NAMESIZE];
+
+      if (if_indextoname(route->ifIndex, ifName) == NULL) {
+         g_snprintf(ifName, sizeof ifName, "if%u", route->ifIndex);
+      }
+      myEntry->rt_dev = g_strdup(ifName);
+
+      sin = (struct sockaddr_in *)&myEntry->rt_dst;
+      sin->sin_family = AF_INET;
+      if (route->dst != NULL) {
+         memcpy(&sin->sin_addr, route->dst, sizeof sin->sin_addr);
+      }
+
+      sin = (struct sockaddr_in *)&myEntry->rt_gateway;
+      sin->sin_family = AF_INET;
+      if (route->hasGateway) {
+         memcpy(&sin->sin_addr, route->gateway, sizeof sin->sin_addr);
+      }
+
+      sin = (struct sockaddr_in *)&myEntry->rt_genmask;
+      sin->sin_family = AF_INET;
+      sin->sin_addr.s_addr = route->dstLen == 0 ?
+                                0 : htonl(~0U << (32 - route->dstLen));
+
+      if (route->dstLen == 32) {
+         flags |= RTF_HOST;
+      }
+      myEntry->rt_flags = flags;
+      myEntry->rt_metric = route->metric;
+
+      g_ptr_array_add(routeArray, myEntry);
+   } else {
+      struct in6_rtmsg *myEntry = g_new0(struct in6_rtmsg, 1);
+
+      if (route->dst != NULL) {
+         memcpy(&myEntry->rtmsg_dst, route->dst, sizeof myEntry->rtmsg_dst);
+      }
+      if (route->hasGateway) {
+         memcpy(&myEntry->rtmsg_gateway, route->gateway,
+                sizeof myEntry->rtmsg_gateway);
+      }
+
+      if (route->dstLen == 128) {
+         flags |= RTF_HOST;
+      }
+      myEntry->rtmsg_dst_len = route->dstLen;
+      myEntry->rtmsg_flags = flags;
+      myEntry->rtmsg_metric = route->metric;
+      myEntry->rtmsg_ifindex = route->ifIndex;
+
+      g_ptr_array_add(routeArray, myEntry);
+   }
+}
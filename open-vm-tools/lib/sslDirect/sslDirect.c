@@ -621,6 +621,32 @@ SSL_Pending(SSLSock ssl) // IN
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * SSL_IsEncrypted()
+ *
+ *    Tells whether the socket has been upgraded to SSL. If not, the
+ *    caller may write to the underlying fd directly.
+ *
+ * Results:
+ *    TRUE if data goes through the SSL connection, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Bool
+SSL_IsEncrypted(SSLSock ssl) // IN
+{
+   ASSERT(ssl);
+
+   return ssl->encrypted;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
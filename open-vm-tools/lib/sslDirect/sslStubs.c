@@ -198,6 +198,29 @@ SSL_Pending(SSLSock sslSock) // IN
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * SSL_IsEncrypted()
+ *
+ *	  Always returns FALSE for non-SSL socket.
+ *
+ * Results:
+ *	  FALSE
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Bool
+SSL_IsEncrypted(SSLSock sslSock) // IN
+{
+   return FALSE;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
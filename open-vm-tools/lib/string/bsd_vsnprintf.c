@@ -1427,6 +1427,265 @@ error:
 #undef FIND_ARGUMENTS
 }
 
+/*
+ * Fast path for the formats most callers use: plain %s, %c, %d, %i, %u,
+ * %x, %X and %%, with no flags, width, precision or positional
+ * arguments, and optionally an l, ll, z or I64 size modifier (so
+ * FMT64 and FMTSZ formats qualify). None of these depend on the locale
+ * or need the state machine in bsd_vsnprintf_core.
+ */
+
+typedef enum {
+   BSDFMT_SIMPLE_INT,
+   BSDFMT_SIMPLE_LONG,
+   BSDFMT_SIMPLE_LLONG,
+   BSDFMT_SIMPLE_SIZET
+} BSDFmt_SimpleSize;
+
+/*
+ * Parse the conversion following a '%'. Returns a pointer to the
+ * conversion character and its argument size, or NULL if the conversion
+ * is not one the fast path handles.
+ */
+static const char *
+BSDFmt_SimpleConversion(const char *fmt, BSDFmt_SimpleSize *argSize)
+{
+   *argSize = BSDFMT_SIMPLE_INT;
+
+   switch (*fmt) {
+   case 'l':
+      fmt++;
+      *argSize = BSDFMT_SIMPLE_LONG;
+      if (*fmt == 'l') {
+         fmt++;
+         *argSize = BSDFMT_SIMPLE_LLONG;
+      }
+      break;
+   case 'z':
+      fmt++;
+      *argSize = BSDFMT_SIMPLE_SIZET;
+      break;
+   case 'I':
+      if (fmt[1] != '6' || fmt[2] != '4') {
+         return NULL;
+      }
+      fmt += 3;
+      *argSize = BSDFMT_SIMPLE_LLONG;
+      break;
+   }
+
+   switch (*fmt) {
+   case '%':
+   case 'c':
+   case 's':
+      /* %lc and %ls are wide characters. */
+      return *argSize == BSDFMT_SIMPLE_INT ? fmt : NULL;
+   case 'd':
+   case 'i':
+   case 'u':
+   case 'x':
+   case 'X':
+      return fmt;
+   default:
+      return NULL;
+   }
+}
+
+static Bool
+BSDFmt_IsSimpleFormat(const char *fmt)
+{
+   BSDFmt_SimpleSize argSize;
+
+   while ((fmt = strchr(fmt, '%')) != NULL) {
+      fmt = BSDFmt_SimpleConversion(fmt + 1, &argSize);
+      if (fmt == NULL) {
+         return FALSE;
+      }
+      fmt++;
+   }
+
+   return TRUE;
+}
+
+/*
+ * Append to 'sbuf', silently truncating like BSDFmt_SFVWrite. A buffer
+ * of size 0 only counts.
+ */
+static void
+BSDFmt_SimpleWrite(BSDFmt_StrBuf *sbuf, const char *p, size_t len)
+{
+   if (sbuf->size > 0) {
+      size_t numToWrite = sbuf->size - sbuf->index - 1;  // -1 for \0
+
+      if (numToWrite > len) {
+         numToWrite = len;
+      }
+      memcpy(sbuf->buf + sbuf->index, p, numToWrite);
+      sbuf->index += numToWrite;
+   }
+}
+
+/*
+ * Format a format accepted by BSDFmt_IsSimpleFormat into 'sbuf'.
+ * Returns the full length of the output, whether or not it fit.
+ */
+static size_t
+BSDFmt_SimpleFormat(BSDFmt_StrBuf *sbuf, const char *fmt, va_list ap)
+{
+   size_t total = 0;
+
+   for (;;) {
+      BSDFmt_SimpleSize argSize;
+      char buf[INT_CONV_BUF];
+      char *end = buf + sizeof buf;
+      const char *cp = fmt;
+      const char *xdigs = xdigs_lower;
+      char *digits;
+      uintmax_t uval;
+      intmax_t sval;
+      size_t len;
+
+      while (*fmt != '\0' && *fmt != '%') {
+         fmt++;
+      }
+      BSDFmt_SimpleWrite(sbuf, cp, fmt - cp);
+      total += fmt - cp;
+      if (*fmt == '\0') {
+         return total;
+      }
+
+      fmt = BSDFmt_SimpleConversion(fmt + 1, &argSize);
+      ASSERT(fmt != NULL);
+
+      /* Fetch arguments with the same types bsd_vsnprintf_core does. */
+      switch (*fmt++) {
+      case '%':
+         cp = "%";
+         len = 1;
+         break;
+      case 'c':
+         buf[0] = va_arg(ap, int);
+         cp = buf;
+         len = 1;
+         break;
+      case 's':
+         cp = va_arg(ap, const char *);
+         if (cp == NULL) {
+            cp = "(null)";
+         }
+         len = strlen(cp);
+         break;
+      case 'd':
+      case 'i':
+         switch (argSize) {
+         case BSDFMT_SIMPLE_LONG:
+            sval = va_arg(ap, long);
+            break;
+         case BSDFMT_SIMPLE_LLONG:
+            sval = va_arg(ap, long long);
+            break;
+         case BSDFMT_SIMPLE_SIZET:
+            sval = (intmax_t) va_arg(ap, size_t);
+            break;
+         default:
+            sval = va_arg(ap, int);
+            break;
+         }
+         uval = sval < 0 ? -(uintmax_t) sval : (uintmax_t) sval;
+         digits = BSDFmt_UJToA(uval, end, 10, 0, xdigs, 0, '\0', NULL);
+         if (sval < 0) {
+            *--digits = '-';
+         }
+         cp = digits;
+         len = end - cp;
+         break;
+      default:
+         switch (argSize) {
+         case BSDFMT_SIMPLE_LONG:
+            uval = va_arg(ap, unsigned long);
+            break;
+         case BSDFMT_SIMPLE_LLONG:
+            uval = va_arg(ap, unsigned long long);
+            break;
+         case BSDFMT_SIMPLE_SIZET:
+            uval = va_arg(ap, size_t);
+            break;
+         default:
+            uval = va_arg(ap, unsigned int);
+            break;
+         }
+         if (fmt[-1] == 'u') {
+            cp = BSDFmt_UJToA(uval, end, 10, 0, xdigs, 0, '\0', NULL);
+         } else {
+            if (fmt[-1] == 'X') {
+               xdigs = xdigs_upper;
+            }
+            cp = BSDFmt_UJToA(uval, end, 16, 0, xdigs, 0, '\0', NULL);
+         }
+         len = end - cp;
+         break;
+      }
+
+      BSDFmt_SimpleWrite(sbuf, cp, len);
+      total += len;
+   }
+}
+
+/*
+ * bsd_vsnprintf for simple formats. When asked to allocate, measure the
+ * output first so the buffer is allocated once, at its final size.
+ */
+static int
+BSDFmt_SimpleVsnprintf(char **outbuf, size_t bufSize, const char *fmt0,
+                       va_list ap)
+{
+   BSDFmt_StrBuf sbuf;
+   size_t len;
+
+   sbuf.alloc = (*outbuf == NULL);
+   sbuf.error = FALSE;
+   sbuf.buf = *outbuf;
+   sbuf.size = bufSize;
+   sbuf.index = 0;
+
+   if (sbuf.alloc) {
+      va_list tmpArgs;
+
+      sbuf.size = 0;
+      va_copy(tmpArgs, ap);
+      len = BSDFmt_SimpleFormat(&sbuf, fmt0, tmpArgs);
+      va_end(tmpArgs);
+
+      if (len > INT_MAX || (sbuf.buf = malloc(len + 1)) == NULL) {
+         return EOF;
+      }
+      sbuf.size = len + 1;
+   }
+
+   len = BSDFmt_SimpleFormat(&sbuf, fmt0, ap);
+
+   if (len > INT_MAX) {
+      if (sbuf.alloc) {
+         free(sbuf.buf);
+      }
+      return EOF;
+   }
+
+   /*
+    * Always null terminate, unless buffer is size 0.
+    */
+
+   if (sbuf.size > 0) {
+      ASSERT(sbuf.index < sbuf.size);
+      sbuf.buf[sbuf.index] = '\0';
+   }
+   if (sbuf.alloc) {
+      *outbuf = sbuf.buf;
+   }
+
+   return (int) len;
+}
+
 int
 bsd_vsnprintf_c_locale(char **outbuf,
                        size_t bufSize,
@@ -1437,6 +1696,10 @@ bsd_vsnprintf_c_locale(char **outbuf,
    char *decimal_point;
    static char dp = '.';
 
+   if (BSDFmt_IsSimpleFormat(fmt0)) {
+      return BSDFmt_SimpleVsnprintf(outbuf, bufSize, fmt0, ap);
+   }
+
    /*
     * Perform a "%f" conversion always using the locale associated
     * with the C locale - "," for thousands, '.' for decimal point.
@@ -1459,6 +1722,10 @@ bsd_vsnprintf(char **outbuf,
    char thousands_sep;
    char *decimal_point;
 
+   if (BSDFmt_IsSimpleFormat(fmt0)) {
+      return BSDFmt_SimpleVsnprintf(outbuf, bufSize, fmt0, ap);
+   }
+
 #if defined(__ANDROID__)
    static char dp = '.';
 
@@ -46,6 +46,9 @@ typedef SyncDriverErr (*SyncFreezeFn)(const GSList *paths,
 typedef struct SyncHandle {
    SyncDriverErr (*thaw)(const SyncDriverHandle handle);
    void (*close)(SyncDriverHandle handle);
+   void (*getVolumeTimes)(const SyncDriverHandle handle,
+                          SyncDriverVolumeTimesCb cb,
+                          void *clientData);
 } SyncHandle;
 
 #if defined(linux)
@@ -53,6 +56,11 @@ SyncDriverErr
 LinuxDriver_Freeze(const GSList *userPaths,
                    SyncDriverHandle *handle);
 
+Bool
+LinuxDriver_Flush(const GSList *paths,
+                  uint32 maxDirtyKB,
+                  uint32 timeoutMs);
+
 SyncDriverErr
 VmSync_Freeze(const GSList *userPaths,
               SyncDriverHandle *handle);
@@ -29,11 +29,14 @@
 #include <string.h>
 #include <unistd.h>
 #include <linux/fs.h>
+#include <stdio.h>
 #include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include "debug.h"
 #include "dynbuf.h"
+#include "hostinfo.h"
 #include "syncDriverInt.h"
 
 /* Out toolchain headers are somewhat outdated and don't define these. */
@@ -42,13 +45,47 @@
 #  define FITHAW          _IOWR('X', 120, int)    /* Thaw */
 #endif
 
+/* How long to wait between flushes while the dirty data stays high. */
+#define LINUX_FLUSH_RETRY_MS  100
+
+/* Most file systems to freeze at the same time. */
+#define LINUX_FREEZE_MAX_THREADS  8
+
+/* Block device major number of loop devices (see linux/major.h). */
+#define LINUX_LOOP_MAJOR  7
+
+
+/* A frozen file system. */
+typedef struct LinuxFiVolume {
+   int         fd;
+   char       *path;
+   uint64      freezeUS;   // Time spent in FIFREEZE
+   uint64      thawUS;     // Time spent in FITHAW, 0 until thawed
+} LinuxFiVolume;
 
 typedef struct LinuxDriver {
-   SyncHandle  driver;
-   size_t      fdCnt;
-   int        *fds;
+   SyncHandle     driver;
+   size_t         fdCnt;
+   LinuxFiVolume *vols;
 } LinuxDriver;
 
+typedef enum {
+   LINUX_FI_SKIPPED,          // Path not there or not a directory
+   LINUX_FI_ERROR,            // Path can't be opened or stat'ed
+   LINUX_FI_IGNORED,          // File system can't be, or already is frozen
+   LINUX_FI_FREEZE_FAILED,
+   LINUX_FI_FROZEN,
+} LinuxFiResult;
+
+typedef struct LinuxFiFreezeOp {
+   const char     *path;
+   int             fd;        // Frozen descriptor
+   int             error;     // errno of a failed freeze
+   uint64          freezeUS;
+   LinuxFiResult   result;
+   GThread        *thread;
+} LinuxFiFreezeOp;
+
 
 /*
  *******************************************************************************
@@ -75,11 +112,15 @@ LinuxFiThaw(const SyncDriverHandle handle)
     * Thaw in the reverse order of freeze
     */
    for (i = sync->fdCnt; i > 0; i--) {
-      Debug(LGPFX "Thawing fd=%d.\n", sync->fds[i-1]);
-      if (ioctl(sync->fds[i-1], FITHAW) == -1) {
-         Debug(LGPFX "Thaw failed for fd=%d.\n", sync->fds[i-1]);
+      LinuxFiVolume *vol = &sync->vols[i-1];
+      VmTimeType start = Hostinfo_SystemTimerUS();
+
+      Debug(LGPFX "Thawing fd=%d.\n", vol->fd);
+      if (ioctl(vol->fd, FITHAW) == -1) {
+         Debug(LGPFX "Thaw failed for fd=%d.\n", vol->fd);
          err = SD_ERROR;
       }
+      vol->thawUS = MAX(1, Hostinfo_SystemTimerUS() - start);
    }
 
    return err;
@@ -108,14 +149,338 @@ LinuxFiClose(SyncDriverHandle handle)
     * Close in the reverse order of open
     */
    for (i = sync->fdCnt; i > 0; i--) {
-      Debug(LGPFX "Closing fd=%d.\n", sync->fds[i-1]);
-      close(sync->fds[i-1]);
+      Debug(LGPFX "Closing fd=%d.\n", sync->vols[i-1].fd);
+      close(sync->vols[i-1].fd);
+      free(sync->vols[i-1].path);
    }
-   free(sync->fds);
+   free(sync->vols);
    free(sync);
 }
 
 
+/*
+ *******************************************************************************
+ * LinuxFiGetVolumeTimes --                                               */ /**
+ *
+ * Reports how long freezing, and thawing if done already, took for each of
+ * the file systems frozen by the given handle, in the order they were frozen.
+ *
+ * @param[in] handle       Handle returned by the freeze call.
+ * @param[in] cb           Callback to call for each file system.
+ * @param[in] clientData   Data for the callback.
+ *
+ *******************************************************************************
+ */
+
+static void
+LinuxFiGetVolumeTimes(const SyncDriverHandle handle,
+                      SyncDriverVolumeTimesCb cb,
+                      void *clientData)
+{
+   LinuxDriver *sync = (LinuxDriver *) handle;
+   size_t i;
+
+   for (i = 0; i < sync->fdCnt; i++) {
+      const LinuxFiVolume *vol = &sync->vols[i];
+
+      cb(vol->path, vol->freezeUS, vol->thawUS, clientData);
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxFiFreezeOne --                                                    */ /**
+ *
+ * Opens and freezes a single path. Runs on a worker thread when independent
+ * file systems are frozen in parallel, so it only reports the outcome in the
+ * given operation; the caller keeps track of the frozen descriptors.
+ *
+ * @param[in] data   The LinuxFiFreezeOp describing the path.
+ *
+ * @return NULL.
+ *
+ *******************************************************************************
+ */
+
+static gpointer
+LinuxFiFreezeOne(gpointer data)
+{
+   LinuxFiFreezeOp *op = data;
+   const char *path = op->path;
+   struct stat sbuf;
+   VmTimeType start;
+   int fd;
+
+   Debug(LGPFX "opening path '%s'.\n", path);
+   fd = open(path, O_RDONLY);
+   if (fd == -1) {
+      switch (errno) {
+      case ENOENT:
+         /*
+          * We sometimes get stale mountpoints or special mountpoints
+          * created by the docker engine.
+          */
+         Debug(LGPFX "cannot find the directory '%s'.\n", path);
+         op->result = LINUX_FI_SKIPPED;
+         return NULL;
+
+      case EACCES:
+         /*
+          * We sometimes get access errors to virtual filesystems mounted
+          * as users with permission 700, so just ignore these.
+          */
+         Debug(LGPFX "cannot access mounted directory '%s'.\n", path);
+         op->result = LINUX_FI_SKIPPED;
+         return NULL;
+
+      case EIO:
+         /*
+          * A mounted HGFS filesystem with the backend disabled will give
+          * us these; probably could use a better way to detect HFGS, but
+          * this should be enough. Just skip.
+          */
+         Debug(LGPFX "I/O error reading directory '%s'.\n", path);
+         op->result = LINUX_FI_SKIPPED;
+         return NULL;
+
+      default:
+         Debug(LGPFX "failed to open '%s': %d (%s)\n",
+               path, errno, strerror(errno));
+         op->result = LINUX_FI_ERROR;
+         return NULL;
+      }
+   }
+
+   if (fstat(fd, &sbuf) == -1) {
+      close(fd);
+      Debug(LGPFX "failed to stat '%s': %d (%s)\n",
+            path, errno, strerror(errno));
+      op->result = LINUX_FI_ERROR;
+      return NULL;
+   }
+
+   if (!S_ISDIR(sbuf.st_mode)) {
+      close(fd);
+      Debug(LGPFX "Skipping a non-directory path '%s'.\n", path);
+      op->result = LINUX_FI_SKIPPED;
+      return NULL;
+   }
+
+   Debug(LGPFX "freezing path '%s' (fd=%d).\n", path, fd);
+   start = Hostinfo_SystemTimerUS();
+   if (ioctl(fd, FIFREEZE) == -1) {
+      int ioctlerr = errno;
+      /*
+       * If the ioctl does not exist, Linux will return ENOTTY. If it's not
+       * supported on the device, we get EOPNOTSUPP. Ignore the latter,
+       * since freezing does not make sense for all fs types, and some
+       * Linux fs drivers may not have been hooked up in the running kernel.
+       *
+       * Also ignore EBUSY since we may try to freeze the same superblock
+       * more than once depending on the OS configuration (e.g., usage of
+       * bind mounts).
+       */
+      close(fd);
+      Debug(LGPFX "freeze on '%s' returned: %d (%s)\n",
+            path, ioctlerr, strerror(ioctlerr));
+      if (ioctlerr != EBUSY && ioctlerr != EOPNOTSUPP) {
+         Debug(LGPFX "failed to freeze '%s': %d (%s)\n",
+               path, ioctlerr, strerror(ioctlerr));
+         op->result = LINUX_FI_FREEZE_FAILED;
+         op->error = ioctlerr;
+      } else {
+         op->result = LINUX_FI_IGNORED;
+      }
+      return NULL;
+   }
+
+   op->freezeUS = MAX(1, Hostinfo_SystemTimerUS() - start);
+   Debug(LGPFX "successfully froze '%s' (fd=%d) in %"FMT64"uus.\n",
+         path, fd, op->freezeUS);
+   op->fd = fd;
+   op->result = LINUX_FI_FROZEN;
+   return NULL;
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxFiUnescapeMountPoint --                                           */ /**
+ *
+ * Undoes the octal escaping (e.g. "\040" for a space) of a mount point in
+ * /proc/self/mountinfo, in place.
+ *
+ * @param[in,out] path  The escaped mount point.
+ *
+ *******************************************************************************
+ */
+
+static void
+LinuxFiUnescapeMountPoint(char *path)
+{
+   char *out = path;
+
+   while (*path != '\0') {
+      if (path[0] == '\\' &&
+          path[1] >= '0' && path[1] <= '3' &&
+          path[2] >= '0' && path[2] <= '7' &&
+          path[3] >= '0' && path[3] <= '7') {
+         *out++ = ((path[1] - '0') << 6) | ((path[2] - '0') << 3) |
+                  (path[3] - '0');
+         path += 4;
+      } else {
+         *out++ = *path++;
+      }
+   }
+   *out = '\0';
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxFiGetParallelMounts --                                            */ /**
+ *
+ * Finds the mount points that can be frozen alongside other file systems:
+ * those of file systems that sit directly on a block device. A loop device
+ * is backed by a file in another file system, and file systems without a
+ * device of their own (overlays, btrfs subvolumes, FUSE, ...) may depend on
+ * others in ways that can't be told from the mount table; freezing them at
+ * the same time as the file system they depend on could deadlock, so they
+ * are frozen on their own, in the usual order.
+ *
+ * Reads /proc/self/mountinfo rather than calling stat(), which could block
+ * on a mount that isn't responding.
+ *
+ * @return Set of mount points, NULL if the mount table can't be read.
+ *
+ *******************************************************************************
+ */
+
+static GHashTable *
+LinuxFiGetParallelMounts(void)
+{
+   char line[4096];
+   GHashTable *mounts;
+   FILE *fp = fopen("/proc/self/mountinfo", "r");
+
+   if (fp == NULL) {
+      Debug(LGPFX "cannot open /proc/self/mountinfo: %d (%s)\n",
+            errno, strerror(errno));
+      return NULL;
+   }
+
+   mounts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+   /*
+    * Each line reads "id parent major:minor root mountpoint ...". Later
+    * entries for the same mount point hide the earlier ones.
+    */
+   while (fgets(line, sizeof line, fp) != NULL) {
+      unsigned int major;
+      unsigned int minor;
+      char mountPoint[sizeof line];
+
+      if (sscanf(line, "%*u %*u %u:%u %*s %s", &major, &minor,
+                 mountPoint) != 3) {
+         continue;
+      }
+      LinuxFiUnescapeMountPoint(mountPoint);
+
+      if (major != 0 && major != LINUX_LOOP_MAJOR) {
+         g_hash_table_replace(mounts, g_strdup(mountPoint),
+                              GINT_TO_POINTER(TRUE));
+      } else {
+         g_hash_table_remove(mounts, mountPoint);
+      }
+   }
+   fclose(fp);
+
+   return mounts;
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxFiIsNested --                                                     */ /**
+ *
+ * Checks whether one of the paths is the other one or lies below it.
+ *
+ * @param[in] a   A path.
+ * @param[in] b   Another path.
+ *
+ * @return TRUE if the paths are nested.
+ *
+ *******************************************************************************
+ */
+
+static Bool
+LinuxFiIsNested(const char *a,
+                const char *b)
+{
+   size_t lenA = strlen(a);
+   size_t lenB = strlen(b);
+   const char *shorter = lenA <= lenB ? a : b;
+   const char *longer = lenA <= lenB ? b : a;
+   size_t len = MIN(lenA, lenB);
+
+   while (len > 1 && shorter[len - 1] == '/') {
+      len--;
+   }
+
+   return strncmp(shorter, longer, len) == 0 &&
+          (longer[len] == '\0' || longer[len] == '/' || shorter[len] == '/');
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxFiFreezeBatch --                                                  */ /**
+ *
+ * Freezes the given paths, which belong to independent file systems, each on
+ * a thread of its own. Falls back to the current thread if a thread can't be
+ * started.
+ *
+ * @param[in,out] ops    Paths to freeze, and their outcome.
+ * @param[in]     count  Number of paths.
+ *
+ *******************************************************************************
+ */
+
+static void
+LinuxFiFreezeBatch(LinuxFiFreezeOp *ops,
+                   size_t count)
+{
+   size_t i;
+
+   if (count == 1) {
+      LinuxFiFreezeOne(&ops[0]);
+      return;
+   }
+
+   Debug(LGPFX "Freezing %"FMTSZ"u file systems in parallel.\n", count);
+
+   for (i = 0; i < count; i++) {
+      GError *err = NULL;
+
+      ops[i].thread = g_thread_create(LinuxFiFreezeOne, &ops[i], TRUE, &err);
+      if (ops[i].thread == NULL) {
+         Debug(LGPFX "cannot start freeze thread: %s\n",
+               err != NULL ? err->message : "unknown error");
+         g_clear_error(&err);
+         LinuxFiFreezeOne(&ops[i]);
+      }
+   }
+
+   for (i = 0; i < count; i++) {
+      if (ops[i].thread != NULL) {
+         g_thread_join(ops[i].thread);
+         ops[i].thread = NULL;
+      }
+   }
+}
+
+
 /*
  *******************************************************************************
  * LinuxDriver_Freeze --                                                  */ /**
@@ -125,6 +490,14 @@ LinuxFiClose(SyncDriverHandle handle)
  * If the first attempt at using the ioctl fails, assume that it doesn't exist
  * and return SD_UNAVAILABLE, so that other means of freezing are tried.
  *
+ * The paths are listed so that a file system comes before the ones it depends
+ * on. Consecutive paths of independent block device file systems, none of
+ * them nested in another, are frozen in parallel (up to
+ * LINUX_FREEZE_MAX_THREADS at a time), so that the time to freeze many
+ * volumes isn't the sum of each volume's freeze time; the rest are frozen
+ * one at a time in the given order. Either way, a batch is only started once
+ * the previous one is frozen, and thawing goes in the reverse order.
+ *
  * NOTE: This function performs two system calls open() and ioctl(). We have
  * seen open() being slow with NFS mount points at times and ioctl() being
  * slow when guest is performing significant IO. Therefore, caller should
@@ -144,11 +517,14 @@ LinuxDriver_Freeze(const GSList *paths,
 {
    ssize_t count = 0;
    Bool first = TRUE;
-   DynBuf fds;
+   DynBuf vols;
    LinuxDriver *sync = NULL;
    SyncDriverErr err = SD_SUCCESS;
+   GHashTable *parallelMounts = NULL;
+   Bool mountsRead = FALSE;
+   LinuxFiFreezeOp ops[LINUX_FREEZE_MAX_THREADS];
 
-   DynBuf_Init(&fds);
+   DynBuf_Init(&vols);
 
    Debug(LGPFX "Freezing using Linux ioctls...\n");
 
@@ -159,6 +535,7 @@ LinuxDriver_Freeze(const GSList *paths,
 
    sync->driver.thaw = LinuxFiThaw;
    sync->driver.close = LinuxFiClose;
+   sync->driver.getVolumeTimes = LinuxFiGetVolumeTimes;
 
    /*
     * Ensure we did not get an empty list
@@ -168,105 +545,105 @@ LinuxDriver_Freeze(const GSList *paths,
    /*
     * Iterate through the requested paths. If we get an error for the first
     * path, and it's not EPERM, assume that the ioctls are not available in
-    * the current kernel.
+    * the current kernel. Paths are frozen one at a time until the ioctl has
+    * been tried once.
     */
-   while (paths != NULL) {
-      int fd;
-      struct stat sbuf;
-      const char *path = paths->data;
-      Debug(LGPFX "opening path '%s'.\n", path);
-      paths = g_slist_next(paths);
-      fd = open(path, O_RDONLY);
-      if (fd == -1) {
-         switch (errno) {
-         case ENOENT:
-            /*
-             * We sometimes get stale mountpoints or special mountpoints
-             * created by the docker engine.
-             */
-            Debug(LGPFX "cannot find the directory '%s'.\n", path);
-            continue;
+   while (paths != NULL && err == SD_SUCCESS) {
+      size_t opCnt = 0;
+      size_t i;
 
-         case EACCES:
-            /*
-             * We sometimes get access errors to virtual filesystems mounted
-             * as users with permission 700, so just ignore these.
-             */
-            Debug(LGPFX "cannot access mounted directory '%s'.\n", path);
-            continue;
+      if (!first && !mountsRead) {
+         parallelMounts = LinuxFiGetParallelMounts();
+         mountsRead = TRUE;
+      }
 
-         case EIO:
-            /*
-             * A mounted HGFS filesystem with the backend disabled will give
-             * us these; probably could use a better way to detect HFGS, but
-             * this should be enough. Just skip.
-             */
-            Debug(LGPFX "I/O error reading directory '%s'.\n", path);
-            continue;
+      do {
+         const char *path = paths->data;
 
-         default:
-            Debug(LGPFX "failed to open '%s': %d (%s)\n",
-                  path, errno, strerror(errno));
-            err = SD_ERROR;
-            goto exit;
+         if (opCnt > 0) {
+            size_t j;
+
+            if (!g_hash_table_lookup(parallelMounts, path)) {
+               break;
+            }
+            for (j = 0; j < opCnt; j++) {
+               if (LinuxFiIsNested(ops[j].path, path)) {
+                  break;
+               }
+            }
+            if (j < opCnt) {
+               break;
+            }
          }
-      }
 
-      if (fstat(fd, &sbuf) == -1) {
-         close(fd);
-         Debug(LGPFX "failed to stat '%s': %d (%s)\n",
-               path, errno, strerror(errno));
-         err = SD_ERROR;
-         goto exit;
-      }
+         memset(&ops[opCnt], 0, sizeof ops[opCnt]);
+         ops[opCnt].path = path;
+         ops[opCnt].fd = -1;
+         opCnt++;
+         paths = g_slist_next(paths);
+      } while (paths != NULL &&
+               opCnt < ARRAYSIZE(ops) &&
+               parallelMounts != NULL &&
+               g_hash_table_lookup(parallelMounts, ops[0].path));
+
+      LinuxFiFreezeBatch(ops, opCnt);
+
+      /*
+       * Record the outcome in list order. Descriptors frozen by the batch are
+       * kept even if another path of the batch failed, so they get thawed.
+       */
+      for (i = 0; i < opCnt; i++) {
+         LinuxFiFreezeOp *op = &ops[i];
+
+         switch (op->result) {
+         case LINUX_FI_SKIPPED:
+            continue;
 
-      if (!S_ISDIR(sbuf.st_mode)) {
-         close(fd);
-         Debug(LGPFX "Skipping a non-directory path '%s'.\n", path);
-         continue;
-      }
+         case LINUX_FI_ERROR:
+            err = SD_ERROR;
+            continue;
 
-      Debug(LGPFX "freezing path '%s' (fd=%d).\n", path, fd);
-      if (ioctl(fd, FIFREEZE) == -1) {
-         int ioctlerr = errno;
-         /*
-          * If the ioctl does not exist, Linux will return ENOTTY. If it's not
-          * supported on the device, we get EOPNOTSUPP. Ignore the latter,
-          * since freezing does not make sense for all fs types, and some
-          * Linux fs drivers may not have been hooked up in the running kernel.
-          *
-          * Also ignore EBUSY since we may try to freeze the same superblock
-          * more than once depending on the OS configuration (e.g., usage of
-          * bind mounts).
-          */
-         close(fd);
-         Debug(LGPFX "freeze on '%s' returned: %d (%s)\n",
-               path, ioctlerr, strerror(ioctlerr));
-         if (ioctlerr != EBUSY && ioctlerr != EOPNOTSUPP) {
-            Debug(LGPFX "failed to freeze '%s': %d (%s)\n",
-                  path, ioctlerr, strerror(ioctlerr));
-            err = first && ioctlerr == ENOTTY ? SD_UNAVAILABLE : SD_ERROR;
+         case LINUX_FI_FREEZE_FAILED:
+            if (err == SD_SUCCESS) {
+               err = first && op->error == ENOTTY ? SD_UNAVAILABLE : SD_ERROR;
+            }
             break;
-         }
-      } else {
-         Debug(LGPFX "successfully froze '%s' (fd=%d).\n", path, fd);
-         if (!DynBuf_Append(&fds, &fd, sizeof fd)) {
-            if (ioctl(fd, FITHAW) == -1) {
-               Warning(LGPFX "failed to thaw '%s': %d (%s)\n",
-                       path, errno, strerror(errno));
+
+         case LINUX_FI_IGNORED:
+            break;
+
+         case LINUX_FI_FROZEN:
+            {
+               LinuxFiVolume vol;
+
+               vol.fd = op->fd;
+               vol.path = strdup(op->path);
+               vol.freezeUS = op->freezeUS;
+               vol.thawUS = 0;
+               if (vol.path == NULL || !DynBuf_Append(&vols, &vol, sizeof vol)) {
+                  if (ioctl(op->fd, FITHAW) == -1) {
+                     Warning(LGPFX "failed to thaw '%s': %d (%s)\n",
+                             op->path, errno, strerror(errno));
+                  }
+                  close(op->fd);
+                  free(vol.path);
+                  err = SD_ERROR;
+                  break;
+               }
+               count++;
             }
-            close(fd);
-            err = SD_ERROR;
             break;
          }
-         count++;
+
+         first = FALSE;
       }
+   }
 
-      first = FALSE;
+   if (parallelMounts != NULL) {
+      g_hash_table_destroy(parallelMounts);
    }
 
-exit:
-   sync->fds = DynBuf_Detach(&fds);
+   sync->vols = DynBuf_Detach(&vols);
    sync->fdCnt = count;
 
    if (err != SD_SUCCESS) {
@@ -278,3 +655,156 @@ exit:
    return err;
 }
 
+
+
+/*
+ *******************************************************************************
+ * LinuxFiSyncPaths --                                                    */ /**
+ *
+ * Writes out the dirty data of the file systems of the given paths with
+ * syncfs(), or of all file systems if the kernel doesn't have syncfs().
+ * Paths that cannot be opened are skipped, like when freezing.
+ *
+ * @param[in] paths    List of paths to flush.
+ *
+ * @return TRUE on success.
+ *
+ *******************************************************************************
+ */
+
+static Bool
+LinuxFiSyncPaths(const GSList *paths)
+{
+   Bool success = TRUE;
+
+#if defined(__NR_syncfs)
+   for (; paths != NULL; paths = g_slist_next(paths)) {
+      const char *path = paths->data;
+      int fd = open(path, O_RDONLY);
+
+      if (fd == -1) {
+         Debug(LGPFX "cannot open '%s' to flush it: %d (%s)\n",
+               path, errno, strerror(errno));
+         continue;
+      }
+
+      if (syscall(__NR_syncfs, fd) == -1) {
+         int syncerr = errno;
+
+         close(fd);
+         if (syncerr == ENOSYS) {
+            break;
+         }
+         Debug(LGPFX "failed to flush '%s': %d (%s)\n",
+               path, syncerr, strerror(syncerr));
+         success = FALSE;
+         continue;
+      }
+      close(fd);
+   }
+
+   if (paths == NULL) {
+      return success;
+   }
+#endif
+
+   sync();
+   return success;
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxFiGetDirtyKB --                                                   */ /**
+ *
+ * Reads the amount of dirty data in the page cache from /proc/meminfo.
+ *
+ * @param[out] dirtyKB  Dirty data, in KiB.
+ *
+ * @return TRUE on success.
+ *
+ *******************************************************************************
+ */
+
+static Bool
+LinuxFiGetDirtyKB(uint64 *dirtyKB)
+{
+   char line[128];
+   Bool found = FALSE;
+   FILE *fp = fopen("/proc/meminfo", "r");
+
+   if (fp == NULL) {
+      Debug(LGPFX "cannot open /proc/meminfo: %d (%s)\n",
+            errno, strerror(errno));
+      return FALSE;
+   }
+
+   while (!found && fgets(line, sizeof line, fp) != NULL) {
+      unsigned long long value;
+
+      if (sscanf(line, "Dirty: %llu kB", &value) == 1) {
+         *dirtyKB = value;
+         found = TRUE;
+      }
+   }
+   fclose(fp);
+
+   return found;
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxDriver_Flush --                                                   */ /**
+ *
+ * Writes out the dirty data of the file systems to be frozen, so that the
+ * FIFREEZE ioctl only has to write out what gets dirtied afterwards. If
+ * maxDirtyKB is not 0, keeps flushing until the dirty data in the page cache
+ * drops below it or timeoutMs elapses.
+ *
+ * @param[in] paths       List of paths to flush.
+ * @param[in] maxDirtyKB  Dirty data (KiB) to wait for, 0 for one pass.
+ * @param[in] timeoutMs   Maximum time to keep flushing.
+ *
+ * @return TRUE if the data was written out and dropped below maxDirtyKB.
+ *
+ *******************************************************************************
+ */
+
+Bool
+LinuxDriver_Flush(const GSList *paths,
+                  uint32 maxDirtyKB,
+                  uint32 timeoutMs)
+{
+   VmTimeType start = Hostinfo_SystemTimerUS();
+   VmTimeType elapsedMs;
+   uint64 dirtyKB = 0;
+
+   Debug(LGPFX "Flushing before freezing...\n");
+
+   for (;;) {
+      if (!LinuxFiSyncPaths(paths)) {
+         return FALSE;
+      }
+      elapsedMs = (Hostinfo_SystemTimerUS() - start) / 1000;
+
+      if (maxDirtyKB == 0) {
+         Debug(LGPFX "Flushed in %"FMT64"dms.\n", elapsedMs);
+         return TRUE;
+      }
+      if (!LinuxFiGetDirtyKB(&dirtyKB)) {
+         return FALSE;
+      }
+      if (dirtyKB <= maxDirtyKB) {
+         Debug(LGPFX "Flushed in %"FMT64"dms, %"FMT64"u KiB dirty.\n",
+               elapsedMs, dirtyKB);
+         return TRUE;
+      }
+      if (elapsedMs >= timeoutMs) {
+         Debug(LGPFX "Still %"FMT64"u KiB dirty after %"FMT64"dms.\n",
+               dirtyKB, elapsedMs);
+         return FALSE;
+      }
+      usleep(LINUX_FLUSH_RETRY_MS * 1000);
+   }
+}
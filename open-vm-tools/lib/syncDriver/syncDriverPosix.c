@@ -23,6 +23,7 @@
  */
 
 #include <stdio.h>
+#include <unistd.h>
 #include <sys/param.h>
 #include <sys/mount.h>
 #include <glib.h>
@@ -201,38 +202,25 @@ SyncDriverFreePath(gpointer data, gpointer userData)
 /*
  *-----------------------------------------------------------------------------
  *
- * SyncDriver_Freeze --
- *
- *    Freeze I/O on the indicated drives. "all" means all drives.
- *    Handle is set to SYNCDRIVER_INVALID_HANDLE on failure.
- *    Freeze operations are currently synchronous in POSIX systems, but
- *    clients should still call SyncDriver_QueryStatus to maintain future
- *    compatibility in case that changes.
+ * SyncDriverGetPaths --
  *
- *    This function will try different available sync implementations. It will
- *    follow the order in the "gBackends" array, and keep on trying different
- *    backends while SD_UNAVAILABLE is returned. If all backends are
- *    unavailable (unlikely given the "null" backend), the the function returns
- *    error. NullDriver will be tried only if enableNullDriver is TRUE.
+ *    Splits the space separated list of paths given to the sync driver.
+ *    "all" means all local mount points.
  *
  * Results:
- *    TRUE on success
- *    FALSE on failure
+ *    GSList* of paths, NULL if there are none. Caller must free each path
+ *    and the list itself.
  *
  * Side effects:
- *    See description.
+ *    None
  *
  *-----------------------------------------------------------------------------
  */
 
-Bool
-SyncDriver_Freeze(const char *userPaths,     // IN
-                  Bool enableNullDriver,     // IN
-                  SyncDriverHandle *handle)  // OUT
+static GSList *
+SyncDriverGetPaths(const char *userPaths)   // IN
 {
    GSList *paths = NULL;
-   SyncDriverErr err = SD_UNAVAILABLE;
-   size_t i = 0;
 
    /*
     * NOTE: Ignore disk UUIDs. We ignore the userPaths if it does
@@ -273,6 +261,47 @@ SyncDriver_Freeze(const char *userPaths,     // IN
       }
    }
 
+   return paths;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SyncDriver_Freeze --
+ *
+ *    Freeze I/O on the indicated drives. "all" means all drives.
+ *    Handle is set to SYNCDRIVER_INVALID_HANDLE on failure.
+ *    Freeze operations are currently synchronous in POSIX systems, but
+ *    clients should still call SyncDriver_QueryStatus to maintain future
+ *    compatibility in case that changes.
+ *
+ *    This function will try different available sync implementations. It will
+ *    follow the order in the "gBackends" array, and keep on trying different
+ *    backends while SD_UNAVAILABLE is returned. If all backends are
+ *    unavailable (unlikely given the "null" backend), the the function returns
+ *    error. NullDriver will be tried only if enableNullDriver is TRUE.
+ *
+ * Results:
+ *    TRUE on success
+ *    FALSE on failure
+ *
+ * Side effects:
+ *    See description.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+SyncDriver_Freeze(const char *userPaths,     // IN
+                  Bool enableNullDriver,     // IN
+                  SyncDriverHandle *handle)  // OUT
+{
+   GSList *paths;
+   SyncDriverErr err = SD_UNAVAILABLE;
+   size_t i = 0;
+
+   paths = SyncDriverGetPaths(userPaths);
    if (paths == NULL) {
       Warning(LGPFX "No paths to freeze.\n");
       return SD_ERROR;
@@ -301,6 +330,59 @@ SyncDriver_Freeze(const char *userPaths,     // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SyncDriver_Flush --
+ *
+ *    Writes out the dirty data of the indicated drives ("all" means all
+ *    drives) ahead of a freeze, while I/O is still allowed. A freeze then
+ *    only has to write out what was dirtied meanwhile, which shortens the
+ *    time applications are blocked.
+ *
+ *    If maxDirtyKB is not 0, additionally waits for the amount of dirty
+ *    data in the system to drop below it, for at most timeoutMs.
+ *
+ *    Like freezing, this can take long; run it in a separate thread.
+ *
+ * Results:
+ *    TRUE if the data was written out (and the dirty data dropped below
+ *    maxDirtyKB), FALSE otherwise. Either way, freezing can go ahead.
+ *
+ * Side effects:
+ *    See description.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+SyncDriver_Flush(const char *userPaths,     // IN
+                 uint32 maxDirtyKB,         // IN
+                 uint32 timeoutMs)          // IN
+{
+#if defined(__linux__) && !defined(USERWORLD)
+   GSList *paths = SyncDriverGetPaths(userPaths);
+   Bool success;
+
+   if (paths == NULL) {
+      Warning(LGPFX "No paths to flush.\n");
+      return FALSE;
+   }
+
+   success = LinuxDriver_Flush(paths, maxDirtyKB, timeoutMs);
+
+   g_slist_foreach(paths, SyncDriverFreePath, NULL);
+   g_slist_free(paths);
+
+   return success;
+#else
+   Debug(LGPFX "Flushing all file systems.\n");
+   sync();
+   return TRUE;
+#endif
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -328,6 +410,36 @@ SyncDriver_Thaw(const SyncDriverHandle handle) // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SyncDriver_GetVolumeTimes --
+ *
+ *    Reports how long each of the file systems frozen through the handle
+ *    took to freeze, and to thaw if already thawed (0 otherwise), in the
+ *    order they were frozen. Backends that don't keep track of individual
+ *    file systems report nothing.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Calls cb once for each file system.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+SyncDriver_GetVolumeTimes(const SyncDriverHandle handle,  // IN
+                          SyncDriverVolumeTimesCb cb,     // IN
+                          void *clientData)               // IN
+{
+   if (handle != NULL && handle->getVolumeTimes != NULL) {
+      handle->getVolumeTimes(handle, cb, clientData);
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -56,6 +56,176 @@ Unicode_LengthInCodePoints(const char *str)  // IN:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * UnicodeNextCodePoint --
+ *
+ *      Decodes the code point at *str and advances *str past it, unless
+ *      it is the terminating NUL. If ignoreCase is TRUE, the code point is
+ *      simple case-folded like UnicodeSimpleCaseFold folds UTF-16 code
+ *      units: ASCII inline, the rest of the BMP through the page table,
+ *      and supplementary code points left as they are.
+ *
+ * Results:
+ *      TRUE on success, FALSE if *str is not valid UTF-8 or does not fit
+ *      in UTF-16 (surrogate code points, values past U+10FFFF).
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE Bool
+UnicodeNextCodePoint(const char **str,     // IN/OUT:
+                     Bool ignoreCase,      // IN:
+                     uint32 *codePoint)    // OUT:
+{
+   const char *p = *str;
+   uint32 c = (uint8) *p;
+   int len;
+
+   if (c < 0x80) {
+      if (ignoreCase && c >= 'A' && c <= 'Z') {
+         c += 'a' - 'A';
+      }
+      *codePoint = c;
+      if (c != 0) {
+         *str = p + 1;
+      }
+
+      return TRUE;
+   }
+
+   /*
+    * CodeSet_GetUtf8 stops at the first byte that is not a continuation
+    * byte, so it never reads past the NUL even if we claim 4 bytes.
+    */
+   len = CodeSet_GetUtf8(p, p + 4, &c);
+   if (len == 0 || U_IS_SURROGATE(c) || c > 0x10FFFF) {
+      return FALSE;
+   }
+
+   if (ignoreCase && c <= 0xFFFF) {
+      c = UnicodeSimpleCaseFold((utf16_t) c);
+   }
+
+   *codePoint = c;
+   *str = p + len;
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * UnicodeSkipCodePoints --
+ *
+ *      Advances *str by 'count' code points, pinned to the end of the
+ *      string. A negative count skips to the end, like Unicode_Substr
+ *      treats a negative start.
+ *
+ * Results:
+ *      TRUE on success, FALSE if invalid UTF-8 was skipped over.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+UnicodeSkipCodePoints(const char **str,     // IN/OUT:
+                      UnicodeIndex count)   // IN:
+{
+   while (count != 0 && **str != '\0') {
+      uint32 codePoint;
+
+      if (!UnicodeNextCodePoint(str, FALSE, &codePoint)) {
+         return FALSE;
+      }
+      if (count > 0) {
+         count--;
+      }
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * UnicodeCompareRangeInPlace --
+ *
+ *      Unicode_CompareRange, decoding and folding both strings as it goes
+ *      instead of converting substrings to UTF-16 first.
+ *
+ * Results:
+ *      TRUE and the comparison result in *result on success.
+ *      FALSE if either string is not valid UTF-8.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+UnicodeCompareRangeInPlace(const char *str1,         // IN:
+                           UnicodeIndex str1Start,   // IN:
+                           UnicodeIndex str1Length,  // IN:
+                           const char *str2,         // IN:
+                           UnicodeIndex str2Start,   // IN:
+                           UnicodeIndex str2Length,  // IN:
+                           Bool ignoreCase,          // IN:
+                           int *result)              // OUT:
+{
+   if (!UnicodeSkipCodePoints(&str1, str1Start) ||
+       !UnicodeSkipCodePoints(&str2, str2Start)) {
+      return FALSE;
+   }
+
+   while (TRUE) {
+      uint32 codePoint1 = 0;
+      uint32 codePoint2 = 0;
+
+      /* A range that is used up compares like the end of the string. */
+      if (str1Length != 0) {
+         if (!UnicodeNextCodePoint(&str1, ignoreCase, &codePoint1)) {
+            return FALSE;
+         }
+         if (str1Length > 0) {
+            str1Length--;
+         }
+      }
+
+      if (str2Length != 0) {
+         if (!UnicodeNextCodePoint(&str2, ignoreCase, &codePoint2)) {
+            return FALSE;
+         }
+         if (str2Length > 0) {
+            str2Length--;
+         }
+      }
+
+      if (codePoint1 != codePoint2) {
+         *result = codePoint1 < codePoint2 ? -1 : 1;
+
+         return TRUE;
+      }
+
+      if (codePoint1 == 0) {
+         *result = 0;
+
+         return TRUE;
+      }
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -115,11 +285,16 @@ Unicode_CompareRange(const char *str1,         // IN:
    uint32 codePoint2;
 
    /*
-    * TODO: Allocating substrings is a performance hit.  We should do this
-    * search in-place.  (However, searching UTF-8 requires tender loving
-    * care, and it's just easier to search UTF-16.)
+    * Valid UTF-8 is compared in place, without allocating. Anything else
+    * takes the original path below (which Panics in Unicode_Substr).
     */
 
+   if (UnicodeCompareRangeInPlace(str1, str1Start, str1Length,
+                                  str2, str2Start, str2Length,
+                                  ignoreCase, &result)) {
+      return result;
+   }
+
    substr1 = Unicode_Substr(str1, str1Start, str1Length);
    if (!substr1) {
       goto out;
@@ -227,6 +402,46 @@ Unicode_CompareRange(const char *str1,         // IN:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Unicode_HashIgnoreCase --
+ *
+ *      Hashes a Unicode string such that strings for which
+ *      Unicode_CompareIgnoreCase returns 0 hash the same, for use in
+ *      case-insensitive hash tables. Does not allocate.
+ *
+ * Results:
+ *      The hash value.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+uint32
+Unicode_HashIgnoreCase(const char *str)  // IN:
+{
+   uint32 hash = 2166136261U;  // FNV-1a
+
+   ASSERT(str);
+
+   while (*str != '\0') {
+      uint32 codePoint;
+
+      if (!UnicodeNextCodePoint(&str, TRUE, &codePoint)) {
+         /* Not valid UTF-8; hash the rest as bytes. */
+         codePoint = (uint8) *str++;
+      }
+
+      hash = (hash ^ codePoint) * 16777619U;
+   }
+
+   return hash;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
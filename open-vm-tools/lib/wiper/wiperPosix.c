@@ -41,9 +41,17 @@
 # endif /* __FreeBSD_version >= 500000 */
 #endif
 #include <unistd.h>
+#if defined(__linux__)
+# include <errno.h>
+# include <fcntl.h>
+# include <string.h>
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+#endif
 
 #include "vmware.h"
 #include "wiper.h"
+#include "hostinfo.h"
 #include "util.h"
 #include "str.h"
 #include "strutil.h"
@@ -52,24 +60,43 @@
 #include "mntinfo.h"
 #include "posix.h"
 #include "util.h"
+#include "memaligned.h"
 
 
-/* Number of bytes per disk sector */
-#define WIPER_SECTOR_SIZE 512
-
-/* Number of disk sectors to write per write system call.
-
-   The bigger it is, the less calls we do and the faster we are.
+/*
+ * Number of bytes to write per write system call.
+ *
+ * Wiper files are written with O_DIRECT where the file system allows it, so
+ * that filling the disk does not evict everybody else's data from the page
+ * cache. A direct write is not split into page sized requests by the cache:
+ * the block layer gets the whole 4 MB (page aligned, hence a multiple of any
+ * sector size) and keeps several device sized requests of it in flight.
+ */
+#define WIPER_WRITE_SIZE (4 << 20)
 
-   This value has been empirically determined to give maximum performance.
+/* Number of write system calls per call to Wiper_Next() */
+#define WIPER_WRITES_PER_NEXT 4
 
---hpreg
-*/
-#define WIPER_SECTOR_STEP 128
+/*
+ * Disk space is an important system resource. Don't fill the partition
+ * completely
+ */
+#define WIPER_MIN_FREE (((uint64)5) << 20) /* 5 MB */
 
 /* Number of device numbers to store for device-mapper */
 #define WIPER_MAX_DM_NUMBERS 8
 
+/*
+ * Mounted Linux file systems can discard their free blocks with the FITRIM
+ * ioctl, which lets the virtual disk reclaim them without writing anything.
+ * This is the number of bytes of the file system to trim per call to
+ * Wiper_Next().
+ */
+#if defined(__linux__) && defined(FITRIM)
+# define WIPER_CAN_TRIM 1
+# define WIPER_TRIM_STEP (((uint64)1) << 30) /* 1 GB */
+#endif
+
 #if defined(sun) || defined(__linux__)
 # define PROCFS "proc"
 #elif defined(__FreeBSD__) || defined(__APPLE__)
@@ -79,6 +106,7 @@
 
 /* Types */
 typedef enum {
+   WIPER_PHASE_TRIM,
    WIPER_PHASE_CREATE,
    WIPER_PHASE_FILL,
 } WiperPhase;
@@ -101,9 +129,23 @@ typedef struct WiperState {
    /* Serial number of the next wiper file to create */
    unsigned int nr;
    /*  Buffer to write in each sector of a wiper file */
-   unsigned char buf[WIPER_SECTOR_STEP * WIPER_SECTOR_SIZE];
+   unsigned char *buf;
+   /* Whether wiper files bypass the page cache */
+   Bool unbuffered;
    /* Effective user id */
    uid_t euid;
+#if defined(WIPER_CAN_TRIM)
+   /* Mount point opened for trimming, or -1 */
+   int trimFd;
+   /* Offset in the file system of the next range to trim */
+   uint64 trimStart;
+#endif
+   /* When the current phase (trimming or zero-filling) started */
+   VmTimeType startTime;
+   /* Bytes zeroed, or of the file system trimmed, since startTime */
+   uint64 bytesDone;
+   /* Bytes left to zero or trim, as of the last call to Wiper_Next() */
+   uint64 bytesLeft;
 } WiperState;
 
 #ifdef sun
@@ -721,13 +763,31 @@ Wiper_Start(const WiperPartition *p,             // IN
       return NULL;
    }
 
+   /* Direct I/O needs a page aligned buffer. */
+   state->buf = Aligned_UnsafeMalloc(WIPER_WRITE_SIZE);
+   if (state->buf == NULL) {
+      free(state);
+      return NULL;
+   }
+
    /* Initialize the state */
    state->phase = WIPER_PHASE_CREATE;
+#if defined(WIPER_CAN_TRIM)
+   state->trimFd = -1;
+   state->trimStart = 0;
+   if (p->attemptUnmaps) {
+      state->phase = WIPER_PHASE_TRIM;
+   }
+#endif
    state->p = p;
    state->f = NULL;
    state->nr = 0;
-   memset(state->buf, 0, WIPER_SECTOR_STEP * WIPER_SECTOR_SIZE);
+   memset(state->buf, 0, WIPER_WRITE_SIZE);
+   state->unbuffered = TRUE;
    state->euid = geteuid();
+   state->startTime = Hostinfo_SystemTimerUS();
+   state->bytesDone = 0;
+   state->bytesLeft = 0;
 
    return (void *)state;
 }
@@ -790,10 +850,75 @@ WiperClean(WiperState *state)      // IN/OUT
       state->f = next;
    }
 
+#if defined(WIPER_CAN_TRIM)
+   if (state->trimFd >= 0) {
+      close(state->trimFd);
+   }
+#endif
+
+   Aligned_Free(state->buf);
    free(state);
 }
 
 
+#if defined(WIPER_CAN_TRIM)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * WiperTrim --
+ *
+ *      Discards the free blocks of the next WIPER_TRIM_STEP bytes of the
+ *      file system with FITRIM. Once the offset reaches the size of the file
+ *      system, does a last call for whatever lies beyond it (the space used
+ *      by metadata isn't counted in the size, so the file system spans a bit
+ *      more).
+ *
+ * Results:
+ *      1 if done, 0 if there is more to trim, -1 if the file system (or the
+ *      device below it, or the user's privileges) does not allow trimming.
+ *
+ * Side Effects:
+ *      Advances the trim offset.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+WiperTrim(WiperState *state,  // IN/OUT
+          uint64 total)       // IN: size of the file system
+{
+   struct fstrim_range range;
+   Bool last = state->trimStart >= total;
+
+   if (state->trimFd < 0) {
+      state->trimFd = Posix_Open(state->p->mountPoint, O_RDONLY);
+      if (state->trimFd < 0) {
+         Log("Cannot open %s to trim it: %s\n", state->p->mountPoint,
+             strerror(errno));
+         return -1;
+      }
+   }
+
+   range.start = state->trimStart;
+   range.len = last ? ~(uint64)0 : WIPER_TRIM_STEP;
+   range.minlen = 0;
+
+   if (ioctl(state->trimFd, FITRIM, &range) == -1) {
+      /* EINVAL past the end of the file system just means we're done. */
+      if (state->trimStart > 0 && errno == EINVAL) {
+         return 1;
+      }
+      Log("Cannot trim %s: %s, writing zeroes instead.\n",
+          state->p->mountPoint, strerror(errno));
+      return -1;
+   }
+
+   state->trimStart += WIPER_TRIM_STEP;
+   return last ? 1 : 0;
+}
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -837,9 +962,7 @@ Wiper_Next(Wiper_State **s,         // IN/OUT
       return error;
    }
 
-   /* Disk space is an important system resource. Don't fill the partition
-      completely */
-   if (free <= (((uint64)5) << 20) /* 5 MB */) {
+   if (free <= WIPER_MIN_FREE) {
       /* We are done */
       WiperClean(*state);
       *state = NULL;
@@ -849,7 +972,37 @@ Wiper_Next(Wiper_State **s,         // IN/OUT
 
    /* We are not done */
    switch ((*state)->phase) {
+#if defined(WIPER_CAN_TRIM)
+   case WIPER_PHASE_TRIM:
+      switch (WiperTrim(*state, total)) {
+      case 1:
+         WiperClean(*state);
+         *state = NULL;
+         *progress = 100;
+         return "";
+
+      case 0:
+         (*state)->bytesDone = (*state)->trimStart;
+         (*state)->bytesLeft = total - MIN((*state)->trimStart, total);
+         *progress = MIN(99, 99 * (*state)->trimStart / total);
+         return "";
+
+      default:
+         /* Zero-fill the free space instead. */
+         if ((*state)->trimFd >= 0) {
+            close((*state)->trimFd);
+            (*state)->trimFd = -1;
+         }
+         (*state)->phase = WIPER_PHASE_CREATE;
+         (*state)->startTime = Hostinfo_SystemTimerUS();
+         (*state)->bytesDone = 0;
+         *progress = 0;
+         return "";
+      }
+#endif
+
    case WIPER_PHASE_CREATE:
+      (*state)->bytesLeft = free - WIPER_MIN_FREE;
       {
          File *new;
 
@@ -879,12 +1032,26 @@ Wiper_Next(Wiper_State **s,         // IN/OUT
             fret = FileIO_Open(&new->fd,
                                new->name,
                                FILEIO_OPEN_ACCESS_WRITE
-                               | FILEIO_OPEN_DELETE_ASAP,
+                               | FILEIO_OPEN_DELETE_ASAP
+                               | ((*state)->unbuffered ?
+                                  FILEIO_OPEN_UNBUFFERED : 0),
                                FILEIO_OPEN_CREATE_SAFE);
             if (FileIO_IsSuccess(fret)) {
                break;
             }
 
+            /*
+             * Some file systems (e.g. ZFS on Linux) refuse O_DIRECT, but only
+             * once they have created the file.
+             */
+            if (fret == FILEIO_ERROR && (*state)->unbuffered) {
+               Log("Cannot open %s for direct I/O, using the page cache.\n",
+                   new->name);
+               Posix_Unlink(new->name);
+               (*state)->unbuffered = FALSE;
+               continue;
+            }
+
             if (fret != FILEIO_OPEN_ERROR_EXIST) {
                WiperClean(*state);
                *state = NULL;
@@ -900,15 +1067,15 @@ Wiper_Next(Wiper_State **s,         // IN/OUT
       break;
 
    case WIPER_PHASE_FILL:
+      (*state)->bytesLeft = free - WIPER_MIN_FREE;
       {
          unsigned int i;
 
          /* Do several write system calls per call to Wiper_Next() */
-         for (i = 0; i < (2 << 20) /* 2 MB */
-                         / (WIPER_SECTOR_STEP * WIPER_SECTOR_SIZE); i++) {
+         for (i = 0; i < WIPER_WRITES_PER_NEXT; i++) {
             FileIOResult fret;
 
-            if ((*state)->f->size + WIPER_SECTOR_STEP * WIPER_SECTOR_SIZE >=
+            if ((*state)->f->size + WIPER_WRITE_SIZE >=
                 (((uint64)2) << 30) /* 2 GB */) {
                /* The file is going to be larger than what most filesystems
                   can support. Create a new file */
@@ -917,7 +1084,7 @@ Wiper_Next(Wiper_State **s,         // IN/OUT
             }
 
             fret = FileIO_Write(&(*state)->f->fd, (*state)->buf,
-                                WIPER_SECTOR_STEP * WIPER_SECTOR_SIZE, NULL);
+                                WIPER_WRITE_SIZE, NULL);
 
             /*
              * We distiguish errors from FilieIO_Write.
@@ -930,6 +1097,19 @@ Wiper_Next(Wiper_State **s,         // IN/OUT
                   break;
                }
 
+               /*
+                * Direct writes can still be refused (EINVAL) when the
+                * device needs a larger alignment than the file system
+                * reported. Continue in a new, buffered file.
+                */
+               if (fret == FILEIO_ERROR && (*state)->unbuffered) {
+                  Log("Direct write to %s failed, using the page cache.\n",
+                      (*state)->f->name);
+                  (*state)->unbuffered = FALSE;
+                  (*state)->phase = WIPER_PHASE_CREATE;
+                  break;
+               }
+
                /*
                 * The disk is full (there may be other process is consuming space),
                 * or the user runs out of his disk quota.
@@ -948,7 +1128,9 @@ Wiper_Next(Wiper_State **s,         // IN/OUT
                                                        "Unable to write to a wiper file";
             }
 
-            (*state)->f->size += WIPER_SECTOR_STEP * WIPER_SECTOR_SIZE;
+            (*state)->f->size += WIPER_WRITE_SIZE;
+            (*state)->bytesDone += WIPER_WRITE_SIZE;
+            (*state)->bytesLeft -= MIN((*state)->bytesLeft, WIPER_WRITE_SIZE);
          }
       }
       break;
@@ -964,6 +1146,51 @@ Wiper_Next(Wiper_State **s,         // IN/OUT
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Wiper_GetStats --
+ *
+ *      Get the throughput of the wipe so far, and an estimate of the time
+ *      left. Both are for the current phase: trimming, or zero-filling when
+ *      the file system cannot be trimmed.
+ *
+ * Results:
+ *      None
+ *
+ * Side Effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+Wiper_GetStats(const Wiper_State *s,  // IN
+               WiperStats *stats)     // OUT
+{
+   const WiperState *state = (const WiperState *)s;
+   VmTimeType elapsed;
+
+   ASSERT(state);
+   ASSERT(stats);
+
+   elapsed = Hostinfo_SystemTimerUS() - state->startTime;
+
+   stats->bytesDone = state->bytesDone;
+   stats->bytesLeft = state->bytesLeft;
+   stats->elapsedUS = elapsed;
+   stats->bytesPerSec = 0;
+   stats->etaSec = 0;
+   if (elapsed > 0 && state->bytesDone > 0) {
+      stats->bytesPerSec = (uint64)((double)state->bytesDone * 1000000 /
+                                    elapsed);
+   }
+   if (stats->bytesPerSec > 0) {
+      stats->etaSec = state->bytesLeft / stats->bytesPerSec;
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
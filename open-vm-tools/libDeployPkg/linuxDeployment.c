@@ -94,6 +94,30 @@ static const int CUST_DNS_ERROR     = 252;
 static const int  DEPLOY_SUCCESS   = 0;
 static const int  DEPLOY_ERROR     = -1;
 
+// Delay between the customization status and enabling the nics (PR 422790)
+static const uint64 ENABLENICSDELAYUSEC = 5000000;
+
+/*
+ * Phases of a deployment, timed and reported to the host in
+ * DEPLOYPHASESGUESTINFO.
+ */
+
+typedef enum {
+   DEPLOY_PHASE_HEADER,       // reading the package header
+   DEPLOY_PHASE_CLOUDINIT,    // checking for cloud-init
+   DEPLOY_PHASE_EXTRACT,      // extracting the package
+   DEPLOY_PHASE_CUSTOMIZE,    // running the customization command
+   DEPLOY_PHASE_CLEANUP,      // removing the extracted package
+   DEPLOY_PHASE_NICS,         // enabling the nics
+   DEPLOY_PHASE_MAX
+} DeployPhase;
+
+static const char* DEPLOYPHASENAMES[DEPLOY_PHASE_MAX] = {
+   "header", "cloudinit", "extract", "customize", "cleanup", "nics"
+};
+
+#define DEPLOYPHASESGUESTINFO "guestinfo.toolsDeployPkg.phases"
+
 /*
  * Linked list definition
  *
@@ -114,6 +138,8 @@ struct List {
 
 // Private functions
 static Bool GetPackageInfo(const char* pkgName, char** cmd, uint8* type, uint8* flags);
+static Bool ExtractCabPackageFiles(const char* pkg, const char* dest,
+                                   const char* const* files);
 static Bool ExtractZipPackage(const char* pkg, const char* dest);
 static Bool CreateDir(const char *path);
 static void Init(void);
@@ -135,6 +161,7 @@ static void NoLogging(int level, const char* fmtstr, ...);
 
 static char* gDeployError = NULL;
 static LogFunction sLog = NoLogging;
+static uint64 gPhaseTimes[DEPLOY_PHASE_MAX];   // in microseconds
 
 // .....................................................................................
 
@@ -962,6 +989,78 @@ done:
 }
 
 
+//......................................................................................
+
+/**
+ *
+ * Get the time from a monotonic clock.
+ *
+ * @returns Time in microseconds
+ *
+ **/
+static uint64
+GetTimeUsec(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//......................................................................................
+
+/**
+ *
+ * Accounts the time since the start of a phase to it, and starts the next
+ * one.
+ *
+ * @param   [IN]     phase  The phase that ended
+ * @param   [IN/OUT] start  Start time of the phase, set to the current time
+ *
+ **/
+static void
+EndPhase(DeployPhase phase,
+         uint64* start)
+{
+   uint64 now = GetTimeUsec();
+
+   gPhaseTimes[phase] += now - *start;
+   *start = now;
+}
+
+//......................................................................................
+
+/**
+ *
+ * Logs how long each phase of the deployment took, and publishes it to the
+ * host as a guestinfo variable, in the form "header=12 cloudinit=80 ...",
+ * with times in milliseconds.
+ *
+ **/
+static void
+ReportPhaseTimes(void)
+{
+   char times[MAXSTRING];
+   size_t len = 0;
+   int i;
+
+   times[0] = '\0';
+   for (i = 0; i < DEPLOY_PHASE_MAX; i++) {
+      len += snprintf(times + len, sizeof times - len, "%s%s=%u",
+                      i == 0 ? "" : " ", DEPLOYPHASENAMES[i],
+                      (unsigned int)(gPhaseTimes[i] / 1000));
+      if (len >= sizeof times) {
+         break;
+      }
+   }
+
+   sLog(log_info, "Deployment phase times (ms): %s\n", times);
+   if (!RpcOut_sendOne(NULL, NULL, "info-set " DEPLOYPHASESGUESTINFO " %s",
+                       times)) {
+      sLog(log_warning, "Unable to report deployment phase times.\n");
+   }
+}
+
 //......................................................................................
 
 /**
@@ -988,8 +1087,14 @@ Deploy(const char* packageName)
    bool forceSkipReboot = false;
    Bool cloudInitEnabled = FALSE;
    const char *cloudInitConfigFilePath = "/etc/cloud/cloud.cfg";
+   // Files cloud-init customization needs, see CloudInitSetup
+   static const char* const cloudInitFiles[] = { "cust.cfg", "nics.txt", NULL };
    char cloudCommand[1024];
    int forkExecResult;
+   uint64 phaseStart = GetTimeUsec();
+   uint64 nicsDelayStart;
+
+   memset(gPhaseTimes, 0, sizeof gPhaseTimes);
 
    TransitionState(NULL, INPROGRESS);
 
@@ -1006,6 +1111,7 @@ Deploy(const char* packageName)
                      GetDeployError());
       return DEPLOY_ERROR;
    }
+   EndPhase(DEPLOY_PHASE_HEADER, &phaseStart);
 
    // Print the header command
 #ifdef VMX86_DEBUG
@@ -1018,8 +1124,23 @@ Deploy(const char* packageName)
       return DEPLOY_ERROR;
    }
 
+   /*
+    * Check if cloud-init is installed, and if so whether it is enabled,
+    * before extracting: cloud-init only needs the customization
+    * configuration, so the rest of a cabinet isn't written out for it.
+    */
+   snprintf(cloudCommand, sizeof(cloudCommand),
+            "/usr/bin/cloud-init -h");
+   cloudCommand[sizeof(cloudCommand) - 1] = '\0';
+   forkExecResult = ForkExecAndWaitCommand(cloudCommand);
+   if (forkExecResult == 0 && IsCloudInitEnabled(cloudInitConfigFilePath)) {
+      cloudInitEnabled = TRUE;
+   }
+   EndPhase(DEPLOY_PHASE_CLOUDINIT, &phaseStart);
+
    if (archiveType == VMWAREDEPLOYPKG_PAYLOAD_TYPE_CAB) {
-      if (!ExtractCabPackage(packageName, EXTRACTPATH)) {
+      if (!ExtractCabPackageFiles(packageName, EXTRACTPATH,
+                                  cloudInitEnabled ? cloudInitFiles : NULL)) {
          free(command);
          return DEPLOY_ERROR;
       }
@@ -1029,15 +1150,9 @@ Deploy(const char* packageName)
          return DEPLOY_ERROR;
       }
    }
+   EndPhase(DEPLOY_PHASE_EXTRACT, &phaseStart);
 
-   // check if cloud-init installed
-   snprintf(cloudCommand, sizeof(cloudCommand),
-            "/usr/bin/cloud-init -h");
-   cloudCommand[sizeof(cloudCommand) - 1] = '\0';
-   forkExecResult = ForkExecAndWaitCommand(cloudCommand);
-   // if cloud-init is installed, check if it is enabled
-   if (forkExecResult == 0 && IsCloudInitEnabled(cloudInitConfigFilePath)) {
-      cloudInitEnabled = TRUE;
+   if (cloudInitEnabled) {
       sSkipReboot = TRUE;
       free(command);
       deployStatus =  CloudInitSetup(EXTRACTPATH);
@@ -1083,6 +1198,10 @@ Deploy(const char* packageName)
       }
    }
 
+   EndPhase(DEPLOY_PHASE_CUSTOMIZE, &phaseStart);
+   nicsDelayStart = phaseStart;
+
+   nics = NULL;
    if (!cloudInitEnabled || DEPLOY_SUCCESS != deployStatus) {
       /*
        * Read in nics to enable from the nics.txt file. We do it irrespective
@@ -1090,23 +1209,16 @@ Deploy(const char* packageName)
        * always have nics enabled.
        */
       nics = GetNicsToEnable(EXTRACTPATH);
-      if (nics) {
-         // XXX: Sleep before the last SetCustomizationStatusInVmx
-         //      This is a temporary-hack for PR 422790
-         sleep(5);
-         sLog(log_info, "Wait before set enable-nics stats in vmx.\n");
-
-         TryToEnableNics(nics);
-
-         free(nics);
-      } else {
-         sLog(log_info, "No nics to enable.\n");
-      }
    }
 
+   /*
+    * The nics are enabled after a delay, and the package isn't needed
+    * anymore once they are read: clean up first, in that time.
+    */
    cleanupCommand = malloc(strlen(CLEANUPCMD) + strlen(CLEANUPPATH) + 1);
    if (!cleanupCommand) {
       SetDeployError("Error allocating memory.");
+      free(nics);
       return DEPLOY_ERROR;
    }
 
@@ -1120,6 +1232,30 @@ Deploy(const char* packageName)
       //TODO: What should be done if cleanup fails ??
    }
    free (cleanupCommand);
+   EndPhase(DEPLOY_PHASE_CLEANUP, &phaseStart);
+
+   if (nics) {
+      uint64 elapsed = phaseStart - nicsDelayStart;
+
+      // XXX: Sleep before the last SetCustomizationStatusInVmx
+      //      This is a temporary-hack for PR 422790
+      if (elapsed < ENABLENICSDELAYUSEC) {
+         uint64 delay = ENABLENICSDELAYUSEC - elapsed;
+         struct timespec ts = { delay / 1000000, (delay % 1000000) * 1000 };
+
+         nanosleep(&ts, NULL);
+      }
+      sLog(log_info, "Wait before set enable-nics stats in vmx.\n");
+
+      TryToEnableNics(nics);
+
+      free(nics);
+      EndPhase(DEPLOY_PHASE_NICS, &phaseStart);
+   } else if (!cloudInitEnabled || DEPLOY_SUCCESS != deployStatus) {
+      sLog(log_info, "No nics to enable.\n");
+   }
+
+   ReportPhaseTimes();
 
    if (flags & VMWAREDEPLOYPKG_HEADER_FLAGS_SKIP_REBOOT) {
       forceSkipReboot = true;
@@ -1161,6 +1297,23 @@ Deploy(const char* packageName)
 Bool
 ExtractCabPackage(const char* cabFileName,
                   const char* destDir)
+{
+   return ExtractCabPackageFiles(cabFileName, destDir, NULL);
+}
+
+/**
+ * Extract the given files into the destination folder.
+ *
+ * @param   [IN]  cabFileName  Package file
+ * @param   [IN]  destDir      Destination folder
+ * @param   [IN]  files        NULL terminated list of the files to extract,
+ *                             or NULL for all of them
+ * @returns TRUE on success
+ */
+static Bool
+ExtractCabPackageFiles(const char* cabFileName,
+                       const char* destDir,
+                       const char* const* files)
 {
    unsigned int error;
 
@@ -1182,7 +1335,7 @@ ExtractCabPackage(const char* cabFileName,
    }
 
    // uncab the cabinet file
-   if ((error = ExpandAllFilesInCab(cabFileName, destDir)) != LINUXCAB_SUCCESS) {
+   if ((error = ExpandFilesInCab(cabFileName, destDir, files)) != LINUXCAB_SUCCESS) {
       SetDeployError("Error expanding cabinet. (%s)", GetLinuxCabErrorMsg(error));
       return FALSE;
    }
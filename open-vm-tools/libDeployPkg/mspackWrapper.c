@@ -32,6 +32,36 @@
 #include <stdarg.h>
 #include <errno.h> 
 
+/*
+ * Members at least this big are preallocated before they are written, so
+ * that the file system can lay them out in one go.
+ */
+
+#define CAB_PREALLOC_MIN_SIZE (1024 * 1024)
+
+/*
+ * mspack I/O on top of stdio, which also knows the size of the member that
+ * is about to be extracted.
+ */
+
+typedef struct CabSystem {
+   struct mspack_system sys;  // must be first
+   off_t writeSize;           // size of the next file opened for writing
+} CabSystem;
+
+struct mspack_file {
+   FILE* fh;
+};
+
+/*
+ * A member of a cabinet, with the position of its data in the cabinet.
+ */
+
+typedef struct CabMember {
+   struct mscabd_file* file;
+   unsigned int folder;
+} CabMember;
+
 /*
  * Template functions
  */
@@ -96,6 +126,205 @@ MspackWrapper_SetLogger(LogFunction log)
    sLog = log;
 }
 
+// .....................................................................................
+
+/**
+ *
+ * Opens a file for mspack. Files opened for writing are preallocated to the
+ * size of the member being extracted.
+ *
+ * @param   [in]  self      The CabSystem
+ * @param   [in]  filename  File to open
+ * @param   [in]  mode      MSPACK_SYS_OPEN_*
+ * @returns The file, or NULL on error
+ *
+ **/
+static struct mspack_file*
+CabSystemOpen(struct mspack_system* self,
+              const char* filename,
+              int mode)
+{
+   CabSystem* cabSys = (CabSystem*)self;
+   struct mspack_file* file;
+   const char* fmode;
+
+   switch (mode) {
+   case MSPACK_SYS_OPEN_READ:   fmode = "rb";  break;
+   case MSPACK_SYS_OPEN_WRITE:  fmode = "wb";  break;
+   case MSPACK_SYS_OPEN_UPDATE: fmode = "r+b"; break;
+   case MSPACK_SYS_OPEN_APPEND: fmode = "ab";  break;
+   default: return NULL;
+   }
+
+   file = malloc(sizeof *file);
+   if (!file) {
+      return NULL;
+   }
+
+   file->fh = fopen(filename, fmode);
+   if (!file->fh) {
+      free(file);
+      return NULL;
+   }
+
+   if (mode == MSPACK_SYS_OPEN_WRITE &&
+       cabSys->writeSize >= CAB_PREALLOC_MIN_SIZE) {
+      int error = posix_fallocate(fileno(file->fh), 0, cabSys->writeSize);
+
+      // Not all file systems can do it, the file is simply written then.
+      if (error != 0) {
+         sLog(log_debug, "Unable to preallocate %s (%s)\n", filename,
+              strerror(error));
+      }
+   }
+
+   return file;
+}
+
+static void
+CabSystemClose(struct mspack_file* file)
+{
+   fclose(file->fh);
+   free(file);
+}
+
+static int
+CabSystemRead(struct mspack_file* file,
+              void* buffer,
+              int bytes)
+{
+   size_t count = fread(buffer, 1, bytes, file->fh);
+
+   return ferror(file->fh) ? -1 : (int)count;
+}
+
+static int
+CabSystemWrite(struct mspack_file* file,
+               void* buffer,
+               int bytes)
+{
+   size_t count = fwrite(buffer, 1, bytes, file->fh);
+
+   return ferror(file->fh) ? -1 : (int)count;
+}
+
+static int
+CabSystemSeek(struct mspack_file* file,
+              off_t offset,
+              int mode)
+{
+   switch (mode) {
+   case MSPACK_SYS_SEEK_START: mode = SEEK_SET; break;
+   case MSPACK_SYS_SEEK_CUR:   mode = SEEK_CUR; break;
+   case MSPACK_SYS_SEEK_END:   mode = SEEK_END; break;
+   default: return -1;
+   }
+
+   return fseeko(file->fh, offset, mode);
+}
+
+static off_t
+CabSystemTell(struct mspack_file* file)
+{
+   return ftello(file->fh);
+}
+
+static void
+CabSystemMessage(struct mspack_file* file,
+                 const char* format,
+                 ...)
+{
+   char msg[256];
+   va_list args;
+
+   va_start(args, format);
+   vsnprintf(msg, sizeof msg, format, args);
+   va_end(args);
+
+   sLog(log_warning, "%s\n", msg);
+}
+
+static void*
+CabSystemAlloc(struct mspack_system* self,
+               size_t bytes)
+{
+   return malloc(bytes);
+}
+
+static void
+CabSystemFree(void* ptr)
+{
+   free(ptr);
+}
+
+static void
+CabSystemCopy(void* src,
+              void* dest,
+              size_t bytes)
+{
+   memcpy(dest, src, bytes);
+}
+
+//......................................................................................
+
+/**
+ *
+ * Orders cabinet members by folder, and by offset within the folder, which
+ * is the order their data is in the cabinet.
+ *
+ **/
+static int
+CompareCabMembers(const void* a,
+                  const void* b)
+{
+   const CabMember* ma = a;
+   const CabMember* mb = b;
+
+   if (ma->folder != mb->folder) {
+      return ma->folder < mb->folder ? -1 : 1;
+   }
+   if (ma->file->offset != mb->file->offset) {
+      return ma->file->offset < mb->file->offset ? -1 : 1;
+   }
+   return 0;
+}
+
+//......................................................................................
+
+/**
+ *
+ * Tells whether a cabinet member is one of the wanted ones.
+ *
+ * @param file     IN: Pointer to the file
+ * @param members  IN: NULL terminated list of names, or NULL for all
+ * @return TRUE if the file is to be extracted
+ *
+ **/
+static int
+IsWantedMember(const struct mscabd_file* file,
+               const char* const* members)
+{
+   if (!members) {
+      return 1;
+   }
+
+   for (; *members; members++) {
+      const char* a = file->filename;
+      const char* b = *members;
+
+      // cabinet names use MS-DOS separators
+      for (; *a && *b; a++, b++) {
+         if (*a != *b && !(*a == '\\' && *b == '/')) {
+            break;
+         }
+      }
+      if (*a == *b) {
+         return 1;
+      }
+   }
+   return 0;
+}
+
 //......................................................................................
 
 /**
@@ -169,6 +398,7 @@ SetupPath (char* path) {
  **/
 static unsigned int
 ExtractFile (struct mscab_decompressor* deflator,
+             CabSystem* cabSys,
              struct mscabd_file* file,
              const char* destDirectory)
 {
@@ -194,6 +424,7 @@ ExtractFile (struct mscab_decompressor* deflator,
       #endif
 
       // Extract File
+      cabSys->writeSize = file->length;
       if (deflator->extract(deflator,file,outCabFile) != MSPACK_ERR_OK) {
          return LINUXCAB_ERR_EXTRACT;
       }
@@ -204,13 +435,89 @@ ExtractFile (struct mscab_decompressor* deflator,
 
 //.............................................................................
 
+/**
+ *
+ * Extracts the wanted members of a cabinet. They are extracted in the order
+ * their data is in the cabinet, so the decompressor goes through each folder
+ * once rather than starting over for a member that comes earlier.
+ *
+ * @param deflator       IN: Pointer to the cabinet decompressor
+ * @param cabSys         IN: I/O used by the decompressor
+ * @param cab            IN: Cabinet
+ * @param destDirectory  IN: Destination directory
+ * @param members        IN: NULL terminated list of names, or NULL for all
+ * @return
+ *  On Success    LINUXCAB_SUCCESS
+ *  On Failure    LINUXCAB_ERROR, LINUXCAB_ERR_EXTRACT
+ *
+ **/
+static unsigned int
+ExtractCabinet(struct mscab_decompressor* deflator,
+               CabSystem* cabSys,
+               struct mscabd_cabinet* cab,
+               const char* destDirectory,
+               const char* const* members)
+{
+   int returnState = LINUXCAB_SUCCESS;
+   struct mscabd_file* file;
+   CabMember* list;
+   unsigned int count = 0;
+   unsigned int i;
+
+   for (file = cab->files; file; file = file->next) {
+      count++;
+   }
+   if (count == 0) {
+      return LINUXCAB_SUCCESS;
+   }
+
+   list = malloc(count * sizeof *list);
+   if (!list) {
+      return LINUXCAB_ERROR;
+   }
+
+   count = 0;
+   for (file = cab->files; file; file = file->next) {
+      struct mscabd_folder* folder;
+      unsigned int index = 0;
+
+      if (!IsWantedMember(file, members)) {
+         continue;
+      }
+      for (folder = cab->folders; folder && folder != file->folder;
+           folder = folder->next) {
+         index++;
+      }
+      list[count].file = file;
+      list[count].folder = index;
+      count++;
+   }
+
+   qsort(list, count, sizeof *list, CompareCabMembers);
+
+   for (i = 0; i < count; i++) {
+      returnState = ExtractFile(deflator, cabSys, list[i].file, destDirectory);
+
+      // error extracting ?
+      if (returnState != LINUXCAB_SUCCESS) {
+         break;
+      }
+   }
+
+   free(list);
+   return returnState;
+}
+
+//.............................................................................
+
 /**
  * 
- * Expands all files in the cabinet into the specified directory. Also returns
- * the command that is specified in the VMware defined header.
+ * Expands the given files in the cabinet into the specified directory.
  *
  * @param cabFileName      IN:   Cabinet file name
  * @param destDirectory    IN:   Destination directory to uncab
+ * @param members          IN:   NULL terminated list of the names of the
+ *                               files to expand, or NULL for all of them
  *
  * @return
  *  On success          LINUXCAB_SUCCESS
@@ -218,19 +525,34 @@ ExtractFile (struct mscab_decompressor* deflator,
  *                      LINUXCAB_EXTRACT, LINUXCAB_ERR_HEADER
  **/
 unsigned int
-ExpandAllFilesInCab (const char* cabFileName,
-                     const char* destDirectory)
+ExpandFilesInCab (const char* cabFileName,
+                  const char* destDirectory,
+                  const char* const* members)
 {
    // set the state as success
    int returnState = LINUXCAB_SUCCESS;
    struct mscabd_cabinet* cab;
    struct mscabd_cabinet* cabToClose;
+   struct mscab_decompressor* deflator;
+   CabSystem cabSys = {
+      {
+         CabSystemOpen,
+         CabSystemClose,
+         CabSystemRead,
+         CabSystemWrite,
+         CabSystemSeek,
+         CabSystemTell,
+         CabSystemMessage,
+         CabSystemAlloc,
+         CabSystemFree,
+         CabSystemCopy,
+         NULL
+      },
+      0
+   };
 
    // Create decompressor instance
-   // Note : I am using NULL for reading file operations meaning requesting it
-   // to use the default routines. It may be a good idea to write that up in the
-   // future
-   struct mscab_decompressor* deflator = mspack_create_cab_decompressor (NULL);
+   deflator = mspack_create_cab_decompressor(&cabSys.sys);
 
    // deflator error ?
    if (!deflator) {
@@ -243,6 +565,7 @@ ExpandAllFilesInCab (const char* cabFileName,
 
    // was the file found ?
    if (!cab) {
+      mspack_destroy_cab_decompressor(deflator);
       return LINUXCAB_ERR_OPEN;
    }
 
@@ -254,21 +577,9 @@ ExpandAllFilesInCab (const char* cabFileName,
 
    // Iterate through the cabinets.
    while(cab) {
-      // Get all files in the cab
-      struct mscabd_file* file = cab->files;
-
-      // iterate through the files
-      while(file) {
-         returnState = ExtractFile(deflator, file, destDirectory);
+      returnState = ExtractCabinet(deflator, &cabSys, cab, destDirectory,
+                                   members);
 
-         // error extracting ?
-         if (returnState != LINUXCAB_SUCCESS) { 
-            break;
-         }
-         
-         file = file->next;
-      }
-      
       // Break - if error
       if (returnState != LINUXCAB_SUCCESS) {
          break;
@@ -296,6 +607,28 @@ ExpandAllFilesInCab (const char* cabFileName,
 
 //.............................................................................
 
+/**
+ * 
+ * Expands all files in the cabinet into the specified directory. Also returns
+ * the command that is specified in the VMware defined header.
+ *
+ * @param cabFileName      IN:   Cabinet file name
+ * @param destDirectory    IN:   Destination directory to uncab
+ *
+ * @return
+ *  On success          LINUXCAB_SUCCESS
+ *  On Error            LINUXCAB_ERROR, LINUXCAB_ERR_OPEN, LINUXCAB_ERR_DECOMPRESS,
+ *                      LINUXCAB_EXTRACT, LINUXCAB_ERR_HEADER
+ **/
+unsigned int
+ExpandAllFilesInCab (const char* cabFileName,
+                     const char* destDirectory)
+{
+   return ExpandFilesInCab(cabFileName, destDirectory, NULL);
+}
+
+//.............................................................................
+
 /**
  * 
  * Does a self check on the library parameters to make sure that the library
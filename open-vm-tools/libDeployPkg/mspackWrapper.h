@@ -93,6 +93,29 @@ ExpandAllFilesInCab(const char* cabFileName,
 
 //......................................................................................
 
+/**
+ * 
+ * Expands the given files in the cabinet into the specified directory. The
+ * files are extracted in the order their data is in the cabinet, and big
+ * ones are preallocated.
+ *
+ * @param cabFileName      IN:   Cabinet file name
+ * @param destDirectory    IN:   Destination directory to uncab
+ * @param members          IN:   NULL terminated list of the names of the
+ *                               files to expand, or NULL for all of them
+ *
+ * @return
+ *  On success          LINUXCAB_SUCCESS
+ *  On Error            LINUXCAB_ERROR, LINUXCAB_ERR_OPEN, LINUXCAB_ERR_DECOMPRESS,
+ *                      LINUXCAB_EXTRACT
+ **/
+unsigned int
+ExpandFilesInCab(const char* cabFileName,
+                 const char* destDirectory,
+                 const char* const* members);
+
+//......................................................................................
+
 /**
  * Does a self check on the library parameters to make sure that the library
  * compilation is compatible with the client compilation. This is funny scenario
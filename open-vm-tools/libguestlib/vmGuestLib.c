@@ -333,7 +333,8 @@ VMGuestLib_CloseHandle(VMGuestLibHandle handle) // IN
  * VMGuestLibUpdateInfo --
  *
  *      Retrieve the bundle of stats over the backdoor and update the pointer to
- *      the Guestlib info in the handle.
+ *      the Guestlib info in the handle. V3 statistics past maxStatId are not
+ *      decoded.
  *
  * Results:
  *      TRUE on success
@@ -346,12 +347,14 @@ VMGuestLib_CloseHandle(VMGuestLibHandle handle) // IN
  */
 
 static VMGuestLibError
-VMGuestLibUpdateInfo(VMGuestLibHandle handle) // IN
+VMGuestLibUpdateInfo(VMGuestLibHandle handle,      // IN
+                     GuestLibV3TypeIds maxStatId)  // IN
 {
    char *reply = NULL;
    size_t replyLen;
    VMGuestLibError ret = VMGUESTLIB_ERROR_INVALID_ARG;
-   uint32 hostVersion = HANDLE_VERSION(handle);
+   uint32 prevVersion = HANDLE_VERSION(handle);
+   uint32 hostVersion = prevVersion;
 
    /* 
     * Starting with the highest supported protocol (major) version, negotiate
@@ -509,12 +512,13 @@ VMGuestLibUpdateInfo(VMGuestLibHandle handle) // IN
          xdr_destroy(&xdrs);
          goto done;
       }
-      if (count >= GUESTLIB_MAX_STATISTIC_ID) {
+      if (count > maxStatId) {
          /* 
-          * Host has more than we can process. So process only what this side
-          * can.
+          * Host has more than we can process, or than the caller wants. So
+          * process only that much.
           */
-         count = GUESTLIB_MAX_STATISTIC_ID - 1;
+         ASSERT(maxStatId < GUESTLIB_MAX_STATISTIC_ID);
+         count = maxStatId;
       }
 
       /* 2. [Re]alloc if the local handle buffer is not big enough. */
@@ -523,6 +527,17 @@ VMGuestLibUpdateInfo(VMGuestLibHandle handle) // IN
          free(HANDLE_DATA(handle));
          HANDLE_DATA(handle) = Util_SafeCalloc(1, dataSize);
          HANDLE_DATASIZE(handle) = dataSize;
+      } else if (prevVersion == 3) {
+         GuestLibV3StatCount c;
+
+         /*
+          * A previous update may have decoded more statistics than this
+          * one will; free those so they are not leaked.
+          */
+         v3stats = HANDLE_DATA(handle);
+         for (c = count; c < v3stats->numStats; c++) {
+            VMX_XDR_FREE(xdr_GuestLibV3Stat, &v3stats->stats[c]);
+         }
       }
 
       /* 3. Unmarshal the array of statistics. */
@@ -601,7 +616,7 @@ VMGuestLib_UpdateInfo(VMGuestLibHandle handle) // IN
     * need to do the test again here.
     */
 
-   error = VMGuestLibUpdateInfo(handle);
+   error = VMGuestLibUpdateInfo(handle, GUESTLIB_MAX_STATISTIC_ID - 1);
    if (error != VMGUESTLIB_ERROR_SUCCESS) {
       Debug("VMGuestLibUpdateInfo failed: %d\n", error);
       HANDLE_SESSIONID(handle) = 0;
@@ -1761,6 +1776,183 @@ VMGuestLib_GetMemBalloonMaxMB(VMGuestLibHandle handle,    // IN
 }
 
 
+/*
+ * The accessors VMGuestLib_Sample() reads statistics with, indexed by
+ * statistic id - 1. Exactly one is set for each integral statistic.
+ */
+
+typedef struct {
+   VMGuestLibError (*get32)(VMGuestLibHandle, uint32 *);
+   VMGuestLibError (*get64)(VMGuestLibHandle, uint64 *);
+} VMGuestLibSampleGetter;
+
+static const VMGuestLibSampleGetter sampleGetters[] = {
+   { VMGuestLib_GetCpuReservationMHz,  NULL },
+   { VMGuestLib_GetCpuLimitMHz,        NULL },
+   { VMGuestLib_GetCpuShares,          NULL },
+   { NULL,                             VMGuestLib_GetCpuUsedMs },
+   { VMGuestLib_GetHostProcessorSpeed, NULL },
+   { VMGuestLib_GetMemReservationMB,   NULL },
+   { VMGuestLib_GetMemLimitMB,         NULL },
+   { VMGuestLib_GetMemShares,          NULL },
+   { VMGuestLib_GetMemMappedMB,        NULL },
+   { VMGuestLib_GetMemActiveMB,        NULL },
+   { VMGuestLib_GetMemOverheadMB,      NULL },
+   { VMGuestLib_GetMemBalloonedMB,     NULL },
+   { VMGuestLib_GetMemSwappedMB,       NULL },
+   { VMGuestLib_GetMemSharedMB,        NULL },
+   { VMGuestLib_GetMemSharedSavedMB,   NULL },
+   { VMGuestLib_GetMemUsedMB,          NULL },
+   { NULL,                             VMGuestLib_GetElapsedMs },
+   { NULL,                             NULL }, // Resource pool path
+   { NULL,                             VMGuestLib_GetCpuStolenMs },
+   { NULL,                             VMGuestLib_GetMemTargetSizeMB },
+   { VMGuestLib_GetHostNumCpuCores,    NULL },
+   { NULL,                             VMGuestLib_GetHostCpuUsedMs },
+   { NULL,                             VMGuestLib_GetHostMemSwappedMB },
+   { NULL,                             VMGuestLib_GetHostMemSharedMB },
+   { NULL,                             VMGuestLib_GetHostMemUsedMB },
+   { NULL,                             VMGuestLib_GetHostMemPhysMB },
+   { NULL,                             VMGuestLib_GetHostMemPhysFreeMB },
+   { NULL,                             VMGuestLib_GetHostMemKernOvhdMB },
+   { NULL,                             VMGuestLib_GetHostMemMappedMB },
+   { NULL,                             VMGuestLib_GetHostMemUnmappedMB },
+   { VMGuestLib_GetMemZippedMB,        NULL },
+   { VMGuestLib_GetMemZipSavedMB,      NULL },
+   { VMGuestLib_GetMemLLSwappedMB,     NULL },
+   { VMGuestLib_GetMemSwapTargetMB,    NULL },
+   { VMGuestLib_GetMemBalloonTargetMB, NULL },
+   { VMGuestLib_GetMemBalloonMaxMB,    NULL },
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMGuestLibGetSampleStat --
+ *
+ *      Read one integral statistic from the handle.
+ *
+ * Results:
+ *      VMGuestLibError
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VMGuestLibError
+VMGuestLibGetSampleStat(VMGuestLibHandle handle, // IN
+                        VMGuestLibStatId id,     // IN
+                        uint64 *value)           // OUT
+{
+   const VMGuestLibSampleGetter *getter = &sampleGetters[id - 1];
+   VMGuestLibError error;
+   uint32 value32;
+
+   /* v2 hosts only have the statistics up to the elapsed time. */
+   if (HANDLE_VERSION(handle) != 3 && id > VMGUESTLIB_STAT_ELAPSED_MS) {
+      return VMGUESTLIB_ERROR_UNSUPPORTED_VERSION;
+   }
+
+   if (getter->get64 != NULL) {
+      return getter->get64(handle, value);
+   }
+
+   error = getter->get32(handle, &value32);
+   if (error == VMGUESTLIB_ERROR_SUCCESS) {
+      *value = value32;
+   }
+   return error;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMGuestLib_Sample --
+ *
+ *      Update the handle and read the given statistics into the caller's
+ *      array. Statistics past the highest id in the array are not decoded.
+ *      An entry is marked changed if its value or error differs from what
+ *      the array held before the call.
+ *
+ * Results:
+ *      VMGuestLibError. On success, the number of changed entries is
+ *      returned in numChanged, if given.
+ *
+ * Side effects:
+ *      Previous stat values will be overwritten.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+VMGuestLibError
+VMGuestLib_Sample(VMGuestLibHandle handle,      // IN
+                  VMGuestLibSampleStat *stats,  // IN/OUT
+                  uint32 numStats,              // IN
+                  uint32 *numChanged)           // OUT: Optional
+{
+   VMGuestLibError error;
+   GuestLibV3TypeIds maxStatId = GUESTLIB_TYPE_RESERVED;
+   uint32 changed = 0;
+   uint32 i;
+
+   ASSERT_ON_COMPILE(ARRAYSIZE(sampleGetters) ==
+                     VMGUESTLIB_STAT_MEM_BALLOON_MAX_MB);
+   ASSERT_ON_COMPILE(VMGUESTLIB_STAT_MEM_BALLOON_MAX_MB ==
+                     (int)GUESTLIB_MEM_BALLOON_MAX_MB);
+
+   if (NULL == handle) {
+      return VMGUESTLIB_ERROR_INVALID_HANDLE;
+   }
+
+   if (NULL == stats || 0 == numStats) {
+      return VMGUESTLIB_ERROR_INVALID_ARG;
+   }
+
+   for (i = 0; i < numStats; i++) {
+      VMGuestLibStatId id = stats[i].id;
+
+      if (id < VMGUESTLIB_STAT_CPU_RESERVATION_MHZ ||
+          id > VMGUESTLIB_STAT_MEM_BALLOON_MAX_MB ||
+          (sampleGetters[id - 1].get32 == NULL &&
+           sampleGetters[id - 1].get64 == NULL)) {
+         return VMGUESTLIB_ERROR_INVALID_ARG;
+      }
+      if ((GuestLibV3TypeIds)id > maxStatId) {
+         maxStatId = (GuestLibV3TypeIds)id;
+      }
+   }
+
+   error = VMGuestLibUpdateInfo(handle, maxStatId);
+   if (error != VMGUESTLIB_ERROR_SUCCESS) {
+      Debug("VMGuestLibUpdateInfo failed: %d\n", error);
+      HANDLE_SESSIONID(handle) = 0;
+      return error;
+   }
+
+   for (i = 0; i < numStats; i++) {
+      VMGuestLibSampleStat *stat = &stats[i];
+      uint64 value = 0;
+
+      error = VMGuestLibGetSampleStat(handle, stat->id, &value);
+      stat->changed = error != stat->error || value != stat->value;
+      if (stat->changed) {
+         changed++;
+      }
+      stat->error = error;
+      stat->value = value;
+   }
+
+   if (numChanged != NULL) {
+      *numChanged = changed;
+   }
+   return VMGUESTLIB_ERROR_SUCCESS;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -19,20 +19,45 @@
 /**
  * @file monotonicTimer.c
  *
- * A GSource that implements a timer backed by a monotonic time source.
+ * A GSource that implements a timer backed by a monotonic time source, and
+ * a periodic variant that coalesces its wakeups with the other timers of
+ * the process.
  */
 
 #include <limits.h>
 #include "vmware.h"
+#include "hostinfo.h"
 #include "system.h"
 #include "vmware/tools/utils.h"
 
+/*
+ * Coalesced timers fire on multiples of a grain of monotonic time. The grain
+ * is the largest power of two multiple of MTIMER_GRAIN_MIN that fits in the
+ * timer's slack, so the grids of all timers nest and timers with different
+ * slacks still meet on the coarser boundaries.
+ */
+#define MTIMER_GRAIN_MIN   250
+#define MTIMER_GRAIN_MAX   (MTIMER_GRAIN_MIN << 6)
+
 typedef struct MTimerSource {
    GSource     src;
    gint        timeout;
    uint64      last;
 } MTimerSource;
 
+typedef struct MTimerCoalescedSource {
+   GSource              src;
+   guint                interval;
+   uint64               grain;
+   uint64               nominal;
+   uint64               due;
+   VMToolsTimerStats   *stats;
+} MTimerCoalescedSource;
+
+/* Cost accounting of coalesced timers, by name. Entries are never freed. */
+static GHashTable *gTimerStats = NULL;
+G_LOCK_DEFINE_STATIC(gTimerStats);
+
 
 /*
  *******************************************************************************
@@ -141,6 +166,133 @@ MTimerSourceFinalize(GSource *src)
 }
 
 
+/*
+ *******************************************************************************
+ * MTimerCoalescedSchedule --                                             */ /**
+ *
+ * Rounds the timer's nominal deadline up to the next multiple of its grain.
+ *
+ * @param[in]  timer    The timer.
+ *
+ *******************************************************************************
+ */
+
+static void
+MTimerCoalescedSchedule(MTimerCoalescedSource *timer)
+{
+   timer->due = (timer->nominal + timer->grain - 1) / timer->grain *
+                timer->grain;
+}
+
+
+/*
+ *******************************************************************************
+ * MTimerCoalescedPrepare --                                              */ /**
+ *
+ * Callback for the "prepare()" event source function of coalesced timers.
+ *
+ * @param[in]  src         The source.
+ * @param[out] timeout     Where to store the timeout.
+ *
+ * @return TRUE if the timer is due.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+MTimerCoalescedPrepare(GSource *src,
+                       gint *timeout)
+{
+   MTimerCoalescedSource *timer = (MTimerCoalescedSource *) src;
+   uint64 now = System_GetTimeMonotonic() * 10;
+
+   if (now >= timer->due) {
+      *timeout = 0;
+      return TRUE;
+   }
+
+   *timeout = MIN(INT_MAX, timer->due - now);
+   return FALSE;
+}
+
+
+/*
+ *******************************************************************************
+ * MTimerCoalescedCheck --                                                */ /**
+ *
+ * Checks whether the coalesced timer is due.
+ *
+ * @param[in]  src     The source.
+ *
+ * @return Whether the timer is due.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+MTimerCoalescedCheck(GSource *src)
+{
+   gint unused;
+   return MTimerCoalescedPrepare(src, &unused);
+}
+
+
+/*
+ *******************************************************************************
+ * MTimerCoalescedDispatch --                                             */ /**
+ *
+ * Calls the callback associated with the timer, accounts for the time it
+ * took, and schedules the next period. Periods are counted from the timer's
+ * creation, so rounding to the grain doesn't make the timer drift; if the
+ * callback ran past the next period, the schedule restarts from now.
+ *
+ * @param[in]  src         The source.
+ * @param[in]  callback    The callback to be called.
+ * @param[in]  data        User-supplied data.
+ *
+ * @return The return value of the callback, or FALSE if the callback is NULL.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+MTimerCoalescedDispatch(GSource *src,
+                        GSourceFunc callback,
+                        gpointer data)
+{
+   MTimerCoalescedSource *timer = (MTimerCoalescedSource *) src;
+   uint64 now = System_GetTimeMonotonic() * 10;
+   uint64 delay = now - timer->nominal;
+   VmTimeType start;
+   VmTimeType cost;
+   gboolean ret;
+
+   if (callback == NULL) {
+      return FALSE;
+   }
+
+   start = Hostinfo_SystemTimerUS();
+   ret = callback(data);
+   cost = Hostinfo_SystemTimerUS() - start;
+
+   G_LOCK(gTimerStats);
+   timer->stats->fired++;
+   timer->stats->totalUS += cost;
+   timer->stats->maxUS = MAX(timer->stats->maxUS, (guint64) cost);
+   timer->stats->totalDelayMS += delay;
+   G_UNLOCK(gTimerStats);
+
+   now = System_GetTimeMonotonic() * 10;
+   timer->nominal += timer->interval;
+   if (timer->nominal <= now) {
+      timer->nominal = now + timer->interval;
+   }
+   MTimerCoalescedSchedule(timer);
+
+   return ret;
+}
+
+
 /**
  *
  * @addtogroup vmtools_utils
@@ -187,5 +339,111 @@ VMTools_CreateTimer(gint timeout)
    return &ret->src;
 }
 
+
+/*
+ *******************************************************************************
+ * VMTools_CreateCoalescedTimer --                                        */ /**
+ *
+ * @brief Create a periodic timer whose wakeups are shared with other timers.
+ *
+ * Like VMTools_CreateTimer(), the timer uses a monotonic clock. Each
+ * expiration may be postponed by up to @a slack milliseconds so that it
+ * falls on a boundary common to all coalesced timers in the process (and in
+ * the other tools processes), letting a mostly idle guest wake up once for
+ * several periodic tasks instead of once for each. Timers with less than
+ * 250ms of slack are not delayed.
+ *
+ * The number of expirations and the time spent in the callback are recorded
+ * under @a name; see VMTools_ForEachTimerStats().
+ *
+ * @param[in] name      Name of the periodic task, for accounting.
+ * @param[in] interval  The timer period in milliseconds, must be > 0.
+ * @param[in] slack     How late each expiration may be, in milliseconds.
+ *
+ * @return The new source.
+ *
+ *******************************************************************************
+ */
+
+GSource *
+VMTools_CreateCoalescedTimer(const gchar *name,
+                             guint interval,
+                             guint slack)
+{
+   static GSourceFuncs srcFuncs = {
+      MTimerCoalescedPrepare,
+      MTimerCoalescedCheck,
+      MTimerCoalescedDispatch,
+      MTimerSourceFinalize,
+      NULL,
+      NULL
+   };
+   MTimerCoalescedSource *ret;
+   VMToolsTimerStats *stats;
+
+   ASSERT(name != NULL);
+   ASSERT(interval > 0);
+
+   G_LOCK(gTimerStats);
+   if (gTimerStats == NULL) {
+      gTimerStats = g_hash_table_new(g_str_hash, g_str_equal);
+   }
+   stats = g_hash_table_lookup(gTimerStats, name);
+   if (stats == NULL) {
+      stats = g_new0(VMToolsTimerStats, 1);
+      stats->name = g_strdup(name);
+      g_hash_table_insert(gTimerStats, (gpointer) stats->name, stats);
+   }
+   stats->interval = interval;
+   stats->slack = slack;
+   G_UNLOCK(gTimerStats);
+
+   ret = (MTimerCoalescedSource *) g_source_new(&srcFuncs, sizeof *ret);
+   ret->interval = interval;
+   ret->grain = 1;
+   if (slack >= MTIMER_GRAIN_MIN) {
+      ret->grain = MTIMER_GRAIN_MIN;
+      while (ret->grain * 2 <= slack && ret->grain < MTIMER_GRAIN_MAX) {
+         ret->grain *= 2;
+      }
+   }
+   ret->nominal = System_GetTimeMonotonic() * 10 + interval;
+   ret->stats = stats;
+   MTimerCoalescedSchedule(ret);
+
+   return &ret->src;
+}
+
+
+/*
+ *******************************************************************************
+ * VMTools_ForEachTimerStats --                                           */ /**
+ *
+ * @brief Calls @a cb with the accounting data of each coalesced timer name
+ * seen by the process.
+ *
+ * @param[in] cb        Callback; must not create timers.
+ * @param[in] data      Data for the callback.
+ *
+ *******************************************************************************
+ */
+
+void
+VMTools_ForEachTimerStats(VMToolsTimerStatsCb cb,
+                          gpointer data)
+{
+   GHashTableIter iter;
+   gpointer value;
+
+   G_LOCK(gTimerStats);
+   if (gTimerStats != NULL) {
+      g_hash_table_iter_init(&iter, gTimerStats);
+      while (g_hash_table_iter_next(&iter, NULL, &value)) {
+         cb(value, data);
+      }
+   }
+   G_UNLOCK(gTimerStats);
+}
+
 /** @}  */
 
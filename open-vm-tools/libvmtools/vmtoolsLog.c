@@ -66,6 +66,27 @@
  */
 #define DEFAULT_MAX_CACHE_ENTRIES      (4*1024)
 
+/* Default max size of the log messages cached when log IO is frozen. */
+#define DEFAULT_MAX_CACHE_BYTES        (1024*1024)
+
+/** Number of log levels that have their own rate limit. */
+#define LOG_RATE_LEVELS                (6)
+
+/** Default burst, in seconds worth of the domain's rate limit. */
+#define LOG_RATE_DEFAULT_BURST_SECS    (5)
+
+/** Default number of messages the asynchronous log queue holds. */
+#define DEFAULT_ASYNC_QUEUE_SIZE       (1024)
+
+/** Most bytes the asynchronous log writer passes to a logger in one call. */
+#define ASYNC_BATCH_MAX_BYTES          (64*1024)
+
+/** How long the asynchronous log writer sleeps when idle, in ms. */
+#define ASYNC_IDLE_WAIT_MS             (1000)
+
+/** How long a flush of the asynchronous log queue may take, in ms. */
+#define ASYNC_FLUSH_TIMEOUT_MS         (5000)
+
 /** The default handler to use if none is specified by the config data. */
 #define DEFAULT_HANDLER "file+"
 
@@ -121,6 +142,13 @@ VMToolsLogOutputDebugString(const gchar *domain,
                             gpointer _data);
 #endif
 
+/** Token bucket limiting the rate of messages of a given level. */
+typedef struct LogRateBucket {
+   gdouble        tokens;
+   uint64         lastRefill;    /* In hundredths of a second. */
+   guint          suppressed;
+} LogRateBucket;
+
 typedef struct LogHandler {
    GlibLogger    *logger;
    gchar         *domain;
@@ -135,6 +163,13 @@ typedef struct LogHandler {
    gboolean       needsFileIO;
    gboolean       isSysLog;
    gchar         *confData;
+   /** Messages per second for each level, 0 = no limit. */
+   guint          rateLimit;
+   guint          rateBurst;
+   /** Only 1 in debugSampling debug messages is logged. */
+   guint          debugSampling;
+   guint          debugCount;
+   LogRateBucket  rate[LOG_RATE_LEVELS];
 } LogHandler;
 
 
@@ -149,10 +184,60 @@ typedef struct LogEntry {
 } LogEntry;
 
 
+/**
+ * Cache of the log messages logged while log IO is suspended: a ring of
+ * entries, allocated once, holding at most gMaxCacheBytes of messages. The
+ * domains of the entries are interned strings, not owned by the cache.
+ */
+typedef struct LogCache {
+   LogEntry        *slots;
+   guint            capacity;
+   guint            first;
+   guint            count;
+   gsize            bytes;
+} LogCache;
+
+
+/**
+ * Slot of the asynchronous log queue. The sequence number tells whether the
+ * slot is free for the producer at that position (seq == pos) or holds the
+ * entry for the consumer (seq == pos + 1).
+ */
+typedef struct LogAsyncSlot {
+   volatile gint    seq;
+   LogEntry        *entry;
+} LogAsyncSlot;
+
+
+/**
+ * Asynchronous log queue: a bounded ring of formatted messages, filled by
+ * the logging threads and written out by a dedicated writer thread.
+ * Producers claim a slot by advancing the head and publish it through the
+ * slot's sequence number, without taking a lock; the mutex and conditions
+ * only put the writer to sleep and wake it up. When the ring is full,
+ * messages are dropped and counted.
+ */
+typedef struct LogAsyncQueue {
+   LogAsyncSlot    *slots;
+   guint            size;         /* Power of 2. */
+   volatile gint    head;
+   volatile gint    tail;         /* Only advanced by the writer thread. */
+   volatile gint    dropped;
+   volatile gint    writerIdle;
+   gboolean         stop;
+   GThread         *thread;
+   GMutex          *lock;
+   GCond           *wakeup;
+   GCond           *drained;
+} LogAsyncQueue;
+
+
 static gchar *gLogDomain = NULL;
-static GPtrArray *gCachedLogs = NULL;
+static LogCache gLogCache = { NULL, 0, 0, 0, 0 };
+static GStaticMutex gLogCacheLock = G_STATIC_MUTEX_INIT;
 static guint gDroppedLogCount = 0;
 static gint gMaxCacheEntries = DEFAULT_MAX_CACHE_ENTRIES;
+static gint gMaxCacheBytes = DEFAULT_MAX_CACHE_BYTES;
 static gboolean gEnableCoreDump = TRUE;
 static gboolean gLogEnabled = FALSE;
 static gboolean gGuestSDKMode = FALSE;
@@ -163,9 +248,17 @@ static LogHandler *gErrorSyslog;
 static GPtrArray *gDomains = NULL;
 static gboolean gLogInitialized = FALSE;
 static GStaticRecMutex gLogStateMutex = G_STATIC_REC_MUTEX_INIT;
+static GStaticMutex gLogRateLock = G_STATIC_MUTEX_INIT;
 static gboolean gLoggingStopped = FALSE;
 static gboolean gLogIOSuspended = FALSE;
 
+/*
+ * The queue outlives its writer thread, so that threads racing with
+ * reconfiguration never see it go away. Its size is set when it's first used.
+ */
+static LogAsyncQueue gLogAsync = { NULL, 0 };
+static volatile gint gLogAsyncActive = FALSE;
+
 /* Internal functions. */
 
 
@@ -389,16 +482,12 @@ VMToolsFreeLogEntry(gpointer data)
 /**
  * Function that calls the log handler.
  *
- * Also, frees the _data to avoid having separate free call.
- *
- * @param[in] _data     LogEntry pointer.
- * @param[in] userData  User data pointer.
+ * @param[in] entry     The log entry.
  */
 
 static void
-VMToolsLogMsg(gpointer _data, gpointer userData)
+VMToolsLogWrite(LogEntry *entry)
 {
-   LogEntry *entry = _data;
    GlibLogger *logger = entry->handler->logger;
    gboolean usedSyslog = FALSE;
 
@@ -418,103 +507,600 @@ VMToolsLogMsg(gpointer _data, gpointer userData)
       gErrorSyslog->logger->logfn(entry->domain, entry->level, entry->msg,
                                   gErrorSyslog->logger);
    }
+}
+
+
+/**
+ * Function that calls the log handler.
+ *
+ * Also, frees the _data to avoid having separate free call.
+ *
+ * @param[in] _data     LogEntry pointer.
+ * @param[in] userData  User data pointer.
+ */
 
+static void
+VMToolsLogMsg(gpointer _data, gpointer userData)
+{
+   LogEntry *entry = _data;
+
+   VMToolsLogWrite(entry);
    VMToolsFreeLogEntry(entry);
 }
 
 
 /**
- * Log handler function that does the common processing of log messages,
- * and delegates the actual printing of the message to the given handler.
+ * Caches a log message while log IO is suspended, dropping the oldest
+ * cached messages if there isn't enough room.
  *
  * @param[in] domain    Log domain.
  * @param[in] level     Log level.
- * @param[in] message   Message to log.
- * @param[in] _data     LogHandler pointer.
+ * @param[in] msg       Formatted message, owned by the cache from now on.
+ * @param[in] handler   Log handler.
  */
 
 static void
-VMToolsLog(const gchar *domain,
-           GLogLevelFlags level,
-           const gchar *message,
-           gpointer _data)
+VMToolsLogCachePut(const gchar *domain,
+                   GLogLevelFlags level,
+                   gchar *msg,
+                   LogHandler *handler)
 {
-   LogHandler *data = _data;
+   gsize len = strlen(msg);
+   LogEntry *slot;
+
+   g_static_mutex_lock(&gLogCacheLock);
 
-   if (SHOULD_LOG(level, data)) {
-      LogEntry *entry;
+   if (gLogCache.slots == NULL ||
+       (gLogCache.count == 0 && gLogCache.capacity != gMaxCacheEntries)) {
+      g_free(gLogCache.slots);
+      gLogCache.slots = g_new0(LogEntry, gMaxCacheEntries);
+      gLogCache.capacity = gMaxCacheEntries;
+      gLogCache.first = 0;
+   }
+
+   if (gMaxCacheBytes > 0 && len > (gsize) gMaxCacheBytes) {
+      g_free(msg);
+      gDroppedLogCount++;
+      goto exit;
+   }
+
+   while (gLogCache.count == gLogCache.capacity ||
+          (gMaxCacheBytes > 0 &&
+           gLogCache.bytes + len > (gsize) gMaxCacheBytes)) {
+      LogEntry *oldest = &gLogCache.slots[gLogCache.first];
+
+      gLogCache.bytes -= strlen(oldest->msg);
+      g_free(oldest->msg);
+      oldest->msg = NULL;
+      gLogCache.first = (gLogCache.first + 1) % gLogCache.capacity;
+      gLogCache.count--;
+      gDroppedLogCount++;
+   }
 
-      data = data->inherited ? gDefaultData : data;
+   slot = &gLogCache.slots[(gLogCache.first + gLogCache.count) %
+                           gLogCache.capacity];
+   slot->domain = (gchar *) g_intern_string(domain);
+   slot->msg = msg;
+   slot->handler = handler;
+   slot->level = level;
+   gLogCache.count++;
+   gLogCache.bytes += len;
 
-      entry = g_malloc0(sizeof(LogEntry));
-      if (entry) {
-         entry->domain = domain ? g_strdup(domain) : NULL;
-         if (domain && !entry->domain) {
-            VMToolsLogPanic();
+exit:
+   g_static_mutex_unlock(&gLogCacheLock);
+}
+
+
+/**
+ * Writes out the log messages cached while log IO was suspended.
+ * Consecutive messages for the same batchable logger are written in one
+ * call.
+ *
+ * @return The number of messages written.
+ */
+
+static guint
+VMToolsLogCacheFlush(void)
+{
+   guint flushed;
+
+   g_static_mutex_lock(&gLogCacheLock);
+
+   flushed = gLogCache.count;
+
+   while (gLogCache.count > 0) {
+      LogEntry *entry = &gLogCache.slots[gLogCache.first];
+      GlibLogger *logger = entry->handler->logger;
+      guint n = 1;
+      guint i;
+
+      if (logger != NULL && logger->batchable) {
+         while (n < gLogCache.count &&
+                gLogCache.slots[(gLogCache.first + n) %
+                                gLogCache.capacity].handler->logger == logger) {
+            n++;
          }
-         entry->handler = data;
-         entry->level = level;
       }
 
-      if (gLogIOSuspended && data->needsFileIO) {
-         if (gMaxCacheEntries == 0) {
-            /* No way to log at this point, drop it */
-            VMToolsFreeLogEntry(entry);
-            gDroppedLogCount++;
-            goto exit;
+      if (n == 1) {
+         VMToolsLogWrite(entry);
+      } else {
+         GString *batch = g_string_sized_new(gLogCache.bytes + 1);
+
+         for (i = 0; i < n; i++) {
+            g_string_append(batch,
+                            gLogCache.slots[(gLogCache.first + i) %
+                                            gLogCache.capacity].msg);
          }
+         logger->logfn(entry->domain, entry->level, batch->str, logger);
+         g_string_free(batch, TRUE);
+      }
 
-         entry->msg = VMToolsLogFormat(message, domain, level, data, TRUE);
+      for (i = 0; i < n; i++) {
+         LogEntry *done = &gLogCache.slots[gLogCache.first];
 
-         /*
-          * Cache the log message
-          */
-         if (!gCachedLogs) {
+         gLogCache.bytes -= strlen(done->msg);
+         g_free(done->msg);
+         done->msg = NULL;
+         gLogCache.first = (gLogCache.first + 1) % gLogCache.capacity;
+      }
+      gLogCache.count -= n;
+   }
 
-            /*
-             * If gMaxCacheEntries > 1K, start with 1/4th size
-             * to avoid frequent allocations
-             */
-            gCachedLogs = g_ptr_array_sized_new(gMaxCacheEntries < 1024 ?
-                                                gMaxCacheEntries :
-                                                gMaxCacheEntries/4);
-            if (!gCachedLogs) {
-               VMToolsLogPanic();
-            }
+   g_static_mutex_unlock(&gLogCacheLock);
 
-            /*
-             * Some builds use glib version 2.16.4 which does not
-             * support g_ptr_array_set_free_func function
-             */
+   return flushed;
+}
+
+
+/**
+ * Queues a log entry for the asynchronous log writer, or drops it if the
+ * queue is full.
+ *
+ * @param[in] entry     The entry, owned by the queue from now on.
+ */
+
+static void
+VMToolsLogAsyncPush(LogEntry *entry)
+{
+   LogAsyncQueue *q = &gLogAsync;
+   gint pos = g_atomic_int_get(&q->head);
+
+   while (TRUE) {
+      LogAsyncSlot *slot = &q->slots[(guint) pos & (q->size - 1)];
+      gint diff = (gint) ((guint) g_atomic_int_get(&slot->seq) - (guint) pos);
+
+      if (diff == 0) {
+         if (g_atomic_int_compare_and_exchange(&q->head, pos,
+                                               (gint) ((guint) pos + 1))) {
+            slot->entry = entry;
+            g_atomic_int_set(&slot->seq, (gint) ((guint) pos + 1));
+            break;
          }
+      } else if (diff < 0) {
+         /* The writer hasn't freed this slot yet: the queue is full. */
+         VMToolsFreeLogEntry(entry);
+         g_atomic_int_inc(&q->dropped);
+         return;
+      }
+      pos = g_atomic_int_get(&q->head);
+   }
 
-         /*
-          * We don't expect logging to be suspended for a long time,
-          * so we can avoid putting a cap on cache size. However, we
-          * still have a default cap of 4K messages, just to be safe.
-          */
-         if (gCachedLogs->len < gMaxCacheEntries) {
-            g_ptr_array_add(gCachedLogs, entry);
+   if (g_atomic_int_get(&q->writerIdle)) {
+      g_mutex_lock(q->lock);
+      g_cond_signal(q->wakeup);
+      g_mutex_unlock(q->lock);
+   }
+}
+
+
+/**
+ * Tells whether the asynchronous log writer has an entry to write.
+ *
+ * @param[in] q      The queue.
+ *
+ * @return Whether the entry at the tail has been published.
+ */
+
+static gboolean
+VMToolsLogAsyncHasEntries(LogAsyncQueue *q)
+{
+   guint tail = (guint) g_atomic_int_get(&q->tail);
+
+   return g_atomic_int_get(&q->slots[tail & (q->size - 1)].seq) ==
+          (gint) (tail + 1);
+}
+
+
+/**
+ * Takes the entry at the tail of the asynchronous log queue. Called by the
+ * writer thread only.
+ *
+ * @param[in] q      The queue.
+ *
+ * @return The entry, or NULL if none has been published.
+ */
+
+static LogEntry *
+VMToolsLogAsyncPop(LogAsyncQueue *q)
+{
+   guint tail = (guint) g_atomic_int_get(&q->tail);
+   LogAsyncSlot *slot = &q->slots[tail & (q->size - 1)];
+   LogEntry *entry;
+
+   if (g_atomic_int_get(&slot->seq) != (gint) (tail + 1)) {
+      return NULL;
+   }
+
+   entry = slot->entry;
+   slot->entry = NULL;
+   g_atomic_int_set(&slot->seq, (gint) (tail + q->size));
+   g_atomic_int_set(&q->tail, (gint) (tail + 1));
+
+   return entry;
+}
+
+
+/**
+ * Writes out everything in the asynchronous log queue. Consecutive messages
+ * for the same batchable logger are written in one call.
+ *
+ * @param[in] q      The queue.
+ */
+
+static void
+VMToolsLogAsyncDrain(LogAsyncQueue *q)
+{
+   LogEntry *next = VMToolsLogAsyncPop(q);
+
+   while (next != NULL) {
+      LogEntry *entry = next;
+      GlibLogger *logger = entry->handler->logger;
+      GString *batch;
+
+      next = VMToolsLogAsyncPop(q);
+
+      if (logger == NULL || !logger->batchable || next == NULL ||
+          next->handler->logger != logger) {
+         VMToolsLogMsg(entry, NULL);
+         continue;
+      }
+
+      batch = g_string_new(entry->msg);
+      while (next != NULL && next->handler->logger == logger &&
+             batch->len + strlen(next->msg) <= ASYNC_BATCH_MAX_BYTES) {
+         g_string_append(batch, next->msg);
+         VMToolsFreeLogEntry(next);
+         next = VMToolsLogAsyncPop(q);
+      }
+
+      logger->logfn(entry->domain, entry->level, batch->str, logger);
+      g_string_free(batch, TRUE);
+      VMToolsFreeLogEntry(entry);
+   }
+}
+
+
+/**
+ * Asynchronous log writer thread.
+ *
+ * @param[in] data   The queue.
+ *
+ * @return NULL.
+ */
+
+static gpointer
+VMToolsLogAsyncThread(gpointer data)
+{
+   LogAsyncQueue *q = data;
+
+   while (TRUE) {
+      gint dropped;
+
+      VMToolsLogAsyncDrain(q);
+
+      /* Goes through the queue, and out on the next iteration. */
+      dropped = g_atomic_int_get(&q->dropped);
+      if (dropped > 0) {
+         g_atomic_int_add(&q->dropped, -dropped);
+         g_warning("Dropped %d log messages, the log queue was full.",
+                   dropped);
+      }
+
+      g_mutex_lock(q->lock);
+      g_cond_broadcast(q->drained);
+      g_atomic_int_set(&q->writerIdle, TRUE);
+      if (!VMToolsLogAsyncHasEntries(q)) {
+         if (q->stop) {
+            g_mutex_unlock(q->lock);
+            break;
          } else {
-            /*
-             * Cache is full, drop the oldest log message. This is not
-             * very efficient but we don't expect this to be a common
-             * case anyway.
-             */
-            LogEntry *oldest = g_ptr_array_remove_index(gCachedLogs, 0);
-            VMToolsFreeLogEntry(oldest);
-            gDroppedLogCount++;
+            GTimeVal timeout;
 
-            g_ptr_array_add(gCachedLogs, entry);
+            g_get_current_time(&timeout);
+            g_time_val_add(&timeout, ASYNC_IDLE_WAIT_MS * 1000);
+            g_cond_timed_wait(q->wakeup, q->lock, &timeout);
          }
+      }
+      g_atomic_int_set(&q->writerIdle, FALSE);
+      g_mutex_unlock(q->lock);
+   }
+
+   return NULL;
+}
+
+
+/**
+ * Waits for the asynchronous log writer to write out what has been queued
+ * so far, for up to ASYNC_FLUSH_TIMEOUT_MS. Does nothing when called by the
+ * writer itself.
+ */
+
+static void
+VMToolsLogAsyncFlush(void)
+{
+   LogAsyncQueue *q = &gLogAsync;
+   GTimeVal timeout;
+   guint target;
+
+   if (!g_atomic_int_get(&gLogAsyncActive) || g_thread_self() == q->thread) {
+      return;
+   }
+
+   target = (guint) g_atomic_int_get(&q->head);
+   g_get_current_time(&timeout);
+   g_time_val_add(&timeout, ASYNC_FLUSH_TIMEOUT_MS * 1000);
 
+   g_mutex_lock(q->lock);
+   while ((gint) ((guint) g_atomic_int_get(&q->tail) - target) < 0) {
+      g_cond_signal(q->wakeup);
+      if (!g_cond_timed_wait(q->drained, q->lock, &timeout)) {
+         break;
+      }
+   }
+   g_mutex_unlock(q->lock);
+}
+
+
+/**
+ * Flushes the asynchronous log queue when the process exits.
+ */
+
+static void
+VMToolsLogAsyncAtExit(void)
+{
+   VMToolsLogAsyncFlush();
+}
+
+
+/**
+ * Starts the asynchronous log writer. Messages logged from now on are
+ * written by it, except fatal ones.
+ *
+ * @param[in] size   Queue size, used when the queue is first set up.
+ */
+
+static void
+VMToolsLogAsyncStart(guint size)
+{
+   LogAsyncQueue *q = &gLogAsync;
+   GError *err = NULL;
+
+   if (g_atomic_int_get(&gLogAsyncActive)) {
+      return;
+   }
+
+   if (q->slots == NULL) {
+      guint i;
+
+      q->size = 16;
+      while (q->size < size && q->size < (1U << 20)) {
+         q->size <<= 1;
+      }
+      q->slots = g_new0(LogAsyncSlot, q->size);
+      for (i = 0; i < q->size; i++) {
+         q->slots[i].seq = (gint) i;
+      }
+      q->lock = g_mutex_new();
+      q->wakeup = g_cond_new();
+      q->drained = g_cond_new();
+      atexit(VMToolsLogAsyncAtExit);
+   }
+
+   q->stop = FALSE;
+   q->thread = g_thread_create(VMToolsLogAsyncThread, q, TRUE, &err);
+   if (q->thread == NULL) {
+      g_warning("Failed to start the log writer thread: %s. "
+                "Logging synchronously.", err->message);
+      g_clear_error(&err);
+      return;
+   }
+
+   g_atomic_int_set(&gLogAsyncActive, TRUE);
+   g_message("Asynchronous logging is enabled with a queue of %u messages.",
+             q->size);
+}
+
+
+/**
+ * Stops the asynchronous log writer once it has written out the queue.
+ * Messages are logged synchronously from then on.
+ */
+
+static void
+VMToolsLogAsyncStop(void)
+{
+   LogAsyncQueue *q = &gLogAsync;
+
+   if (!g_atomic_int_get(&gLogAsyncActive)) {
+      return;
+   }
+
+   g_atomic_int_set(&gLogAsyncActive, FALSE);
+
+   g_mutex_lock(q->lock);
+   q->stop = TRUE;
+   g_cond_signal(q->wakeup);
+   g_mutex_unlock(q->lock);
+
+   g_thread_join(q->thread);
+   q->thread = NULL;
+}
+
+
+/**
+ * Applies the rate limit and the debug sampling of a log domain.
+ *
+ * @param[in]  data        LogHandler of the domain.
+ * @param[in]  level       Log level.
+ * @param[out] suppressed  Number of messages of that level suppressed since
+ *                         the last one logged, if the message is logged.
+ *
+ * @return Whether to log the message.
+ */
+
+static gboolean
+VMToolsLogRateCheck(LogHandler *data,
+                    GLogLevelFlags level,
+                    guint *suppressed)
+{
+   gboolean allowed = TRUE;
+
+   *suppressed = 0;
+
+   if (data->rateLimit == 0 && data->debugSampling <= 1) {
+      return TRUE;
+   }
+
+   g_static_mutex_lock(&gLogRateLock);
+
+   if ((level & G_LOG_LEVEL_DEBUG) && data->debugSampling > 1) {
+      allowed = (data->debugCount++ % data->debugSampling) == 0;
+   }
+
+   if (allowed && data->rateLimit > 0) {
+      LogRateBucket *bucket;
+      uint64 now = System_GetTimeMonotonic();
+      guint i;
+
+      for (i = 0; i < LOG_RATE_LEVELS - 1; i++) {
+         if (level & (G_LOG_LEVEL_ERROR << i)) {
+            break;
+         }
+      }
+      bucket = &data->rate[i];
+
+      if (bucket->lastRefill == 0) {
+         bucket->tokens = data->rateBurst;
+      } else if (now > bucket->lastRefill) {
+         bucket->tokens += (now - bucket->lastRefill) * data->rateLimit / 100.0;
+         bucket->tokens = MIN(bucket->tokens, data->rateBurst);
+      }
+      bucket->lastRefill = now;
+
+      if (bucket->tokens >= 1.0) {
+         bucket->tokens -= 1.0;
+         *suppressed = bucket->suppressed;
+         bucket->suppressed = 0;
       } else {
-         entry->msg = VMToolsLogFormat(message, domain, level, data, FALSE);
-         VMToolsLogMsg(entry, NULL);
+         bucket->suppressed++;
+         allowed = FALSE;
       }
    }
 
-exit:
+   g_static_mutex_unlock(&gLogRateLock);
+
+   return allowed;
+}
+
+
+/**
+ * Formats a log message and hands it to the given handler, directly or
+ * through the log cache or the asynchronous log queue.
+ *
+ * @param[in] domain    Log domain.
+ * @param[in] level     Log level.
+ * @param[in] message   Message to log.
+ * @param[in] data      LogHandler of the domain.
+ */
+
+static void
+VMToolsLogDispatch(const gchar *domain,
+                   GLogLevelFlags level,
+                   const gchar *message,
+                   LogHandler *data)
+{
+   LogEntry *entry;
+
+   data = data->inherited ? gDefaultData : data;
+
+   if (gLogIOSuspended && data->needsFileIO) {
+      if (gMaxCacheEntries == 0) {
+         /* No way to log at this point, drop it */
+         gDroppedLogCount++;
+      } else {
+         VMToolsLogCachePut(domain, level,
+                            VMToolsLogFormat(message, domain, level, data,
+                                             TRUE),
+                            data);
+      }
+      return;
+   }
+
+   entry = g_malloc0(sizeof(LogEntry));
+   if (entry) {
+      entry->domain = domain ? g_strdup(domain) : NULL;
+      if (domain && !entry->domain) {
+         VMToolsLogPanic();
+      }
+      entry->handler = data;
+      entry->level = level;
+   }
+
+   if (!IS_FATAL(level) && g_atomic_int_get(&gLogAsyncActive)) {
+      entry->msg = VMToolsLogFormat(message, domain, level, data, FALSE);
+      VMToolsLogAsyncPush(entry);
+   } else {
+      if (IS_FATAL(level)) {
+         /* Whatever was logged before the fatal error goes out first. */
+         VMToolsLogAsyncFlush();
+      }
+      entry->msg = VMToolsLogFormat(message, domain, level, data, FALSE);
+      VMToolsLogMsg(entry, NULL);
+   }
+}
+
+
+/**
+ * Log handler function that does the common processing of log messages,
+ * and delegates the actual printing of the message to the given handler.
+ *
+ * @param[in] domain    Log domain.
+ * @param[in] level     Log level.
+ * @param[in] message   Message to log.
+ * @param[in] _data     LogHandler pointer.
+ */
+
+static void
+VMToolsLog(const gchar *domain,
+           GLogLevelFlags level,
+           const gchar *message,
+           gpointer _data)
+{
+   LogHandler *data = _data;
+   guint suppressed = 0;
+
+   if (SHOULD_LOG(level, data) &&
+       (IS_FATAL(level) || VMToolsLogRateCheck(data, level, &suppressed))) {
+      if (!IS_FATAL(level) && suppressed > 0) {
+         gchar *summary = g_strdup_printf("%u similar messages suppressed "
+                                          "by the rate limit.", suppressed);
+         VMToolsLogDispatch(domain, level, summary, data);
+         g_free(summary);
+      }
+      VMToolsLogDispatch(domain, level, message, data);
+   }
+
    if (IS_FATAL(level)) {
       VMToolsLogPanic();
    }
@@ -715,6 +1301,73 @@ VMToolsGetLogHandler(const gchar *handler,
 }
 
 
+/**
+ * Reads an optional non-negative integer setting of a log domain.
+ *
+ * @param[in] cfg       Dictionary with config data.
+ * @param[in] domain    Log domain.
+ * @param[in] option    Setting name, without the domain.
+ * @param[in] dflt      Value if the setting is missing or invalid.
+ *
+ * @return The setting's value.
+ */
+
+static guint
+VMToolsGetLogDomainUint(GKeyFile *cfg,
+                        const gchar *domain,
+                        const gchar *option,
+                        guint dflt)
+{
+   gchar key[128];
+   GError *err = NULL;
+   gint value;
+
+   g_snprintf(key, sizeof key, "%s.%s", domain, option);
+   value = g_key_file_get_integer(cfg, LOGGING_GROUP, key, &err);
+   if (err != NULL || value < 0) {
+      g_clear_error(&err);
+      return dflt;
+   }
+   return value;
+}
+
+
+/**
+ * Sets up the rate limit and debug sampling of a log domain. Domains that
+ * don't configure them use those of the default domain.
+ *
+ * @param[in] domain    Name of domain being configured.
+ * @param[in] cfg       Dictionary with config data.
+ * @param[in] isDefault Whether this is the default domain.
+ * @param[in] data      LogHandler of the domain.
+ */
+
+static void
+VMToolsConfigLogRate(const gchar *domain,
+                     GKeyFile *cfg,
+                     gboolean isDefault,
+                     LogHandler *data)
+{
+   LogHandler *dflt = isDefault ? NULL : gDefaultData;
+
+   g_static_mutex_lock(&gLogRateLock);
+
+   data->rateLimit = VMToolsGetLogDomainUint(cfg, domain, "rateLimit",
+                                             dflt ? dflt->rateLimit : 0);
+   data->rateBurst = VMToolsGetLogDomainUint(cfg, domain, "rateBurst",
+                                             data->rateLimit *
+                                             LOG_RATE_DEFAULT_BURST_SECS);
+   data->rateBurst = MAX(data->rateBurst, 1);
+   data->debugSampling = VMToolsGetLogDomainUint(cfg, domain, "debugSampling",
+                                                 dflt ? dflt->debugSampling :
+                                                        0);
+   data->debugCount = 0;
+   memset(data->rate, 0, sizeof data->rate);
+
+   g_static_mutex_unlock(&gLogRateLock);
+}
+
+
 /**
  * Configures the given log domain based on the data provided in the given
  * dictionary. If the log domain being configured doesn't match the default, and
@@ -856,6 +1509,8 @@ VMToolsConfigLogDomain(const gchar *domain,
       data->confData = g_strdup(confData);
    }
 
+   VMToolsConfigLogRate(domain, cfg, isDefault, data);
+
    if (isDefault) {
       gDefaultData = data;
       g_log_set_default_handler(VMToolsLog, gDefaultData);
@@ -1036,7 +1691,9 @@ VMTools_ConfigLogging(const gchar *defaultDomain,
     * If not resetting the logging system, keep the old domains around. After
     * we're done loading the new configuration, we'll go through the old domains
     * and restore any data that needs restoring, and clean up anything else.
+    * Queued messages refer to the current handlers, so write them out first.
     */
+   VMToolsLogAsyncStop();
    VMToolsResetLogging(reset);
    if (!reset) {
       oldDefault = gDefaultData;
@@ -1119,9 +1776,17 @@ VMTools_ConfigLogging(const gchar *defaultDomain,
       }
    }
 
+   gMaxCacheBytes = g_key_file_get_integer(cfg, LOGGING_GROUP,
+                                           "maxCacheBytes", &err);
+   if (err != NULL || gMaxCacheBytes < 0) {
+      /* A value '0' means no limit other than maxCacheEntries. */
+      gMaxCacheBytes = DEFAULT_MAX_CACHE_BYTES;
+      g_clear_error(&err);
+   }
+
    if (gMaxCacheEntries > 0) {
-      g_message("Log caching is enabled with maxCacheEntries=%d.",
-                gMaxCacheEntries);
+      g_message("Log caching is enabled with maxCacheEntries=%d, "
+                "maxCacheBytes=%d.", gMaxCacheEntries, gMaxCacheBytes);
    } else {
       g_message("Log caching is disabled.");
    }
@@ -1131,6 +1796,13 @@ VMTools_ConfigLogging(const gchar *defaultDomain,
                                                "enableCoreDump", NULL);
    }
 
+   if (g_key_file_get_boolean(cfg, LOGGING_GROUP, "asyncLogging", NULL)) {
+      gint size = g_key_file_get_integer(cfg, LOGGING_GROUP,
+                                         "asyncQueueSize", NULL);
+
+      VMToolsLogAsyncStart(size > 0 ? size : DEFAULT_ASYNC_QUEUE_SIZE);
+   }
+
    /* If needed, restore the old configuration. */
    if (!reset) {
       if (oldDomains != NULL) {
@@ -1311,6 +1983,9 @@ void
 VMTools_SuspendLogIO()
 {
    gLogIOSuspended = TRUE;
+
+   /* Messages logged before the suspension may still be queued. */
+   VMToolsLogAsyncFlush();
 }
 
 
@@ -1332,12 +2007,7 @@ VMTools_ResumeLogIO()
    /*
     * Flush the cached log messages, if any
     */
-   if (gCachedLogs) {
-      cachedEntries = gCachedLogs->len;
-      g_ptr_array_foreach(gCachedLogs, VMToolsLogMsg, NULL);
-      g_ptr_array_free(gCachedLogs, TRUE);
-      gCachedLogs = NULL;
-   }
+   cachedEntries = VMToolsLogCacheFlush();
 
    g_debug("Flushed %u log messages from cache after resuming log IO.",
            cachedEntries);
@@ -1349,6 +2019,52 @@ VMTools_ResumeLogIO()
 }
 
 
+/**
+ * Returns the memory held by the cache of messages logged while log IO is
+ * suspended.
+ *
+ * @return Size of the cache in bytes.
+ */
+
+gsize
+VMTools_GetLogCacheSize(void)
+{
+   gsize size;
+
+   g_static_mutex_lock(&gLogCacheLock);
+   size = gLogCache.capacity * sizeof *gLogCache.slots + gLogCache.bytes;
+   g_static_mutex_unlock(&gLogCacheLock);
+
+   return size;
+}
+
+
+/**
+ * Releases the slots of the log cache if it holds no messages. They are
+ * allocated again the next time log IO is suspended.
+ *
+ * @return Number of bytes released.
+ */
+
+gsize
+VMTools_TrimLogCache(void)
+{
+   gsize freed = 0;
+
+   g_static_mutex_lock(&gLogCacheLock);
+   if (gLogCache.count == 0 && gLogCache.slots != NULL) {
+      freed = gLogCache.capacity * sizeof *gLogCache.slots;
+      g_free(gLogCache.slots);
+      gLogCache.slots = NULL;
+      gLogCache.capacity = 0;
+      gLogCache.first = 0;
+   }
+   g_static_mutex_unlock(&gLogCacheLock);
+
+   return freed;
+}
+
+
 /**
  * Called if vmtools lib is used along with Guestlib SDK.
  */
@@ -22,26 +22,216 @@
  * A logger that writes the logs to the VMX log file.
  */
 
+#include <string.h>
 #include "vmtoolsInt.h"
+#include "system.h"
 #include "vmware/tools/guestrpc.h"
 
+/*
+ * Lines are sent in batches: a batch goes out at most VMXLOGGER_FLUSH_WINDOW
+ * after its first line was logged, or as soon as it reaches
+ * VMXLOGGER_BATCH_MAX_BYTES. Each RPC carries at most that many bytes.
+ */
+#define VMXLOGGER_FLUSH_WINDOW_MS      100
+#define VMXLOGGER_BATCH_MAX_BYTES      (16 * 1024)
+
+/*
+ * Back-pressure. The channel is considered congested when the last send
+ * failed or took longer than VMXLOGGER_SLOW_SEND (hundredths of a second),
+ * or when the pending lines pile up past VMXLOGGER_HIGH_WATER_BYTES; debug
+ * lines are then dropped. Past VMXLOGGER_PENDING_MAX_BYTES, everything but
+ * errors and critical messages is dropped.
+ */
+#define VMXLOGGER_SLOW_SEND            5
+#define VMXLOGGER_HIGH_WATER_BYTES     (2 * VMXLOGGER_BATCH_MAX_BYTES)
+#define VMXLOGGER_PENDING_MAX_BYTES    (8 * VMXLOGGER_BATCH_MAX_BYTES)
+
+#define VMXLOGGER_URGENT_LEVELS \
+   (G_LOG_FLAG_FATAL | G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL)
+
 typedef struct VMXLoggerData {
    GlibLogger     handler;
    RpcChannel    *chan;
+   GMutex        *lock;       /* Protects the fields below. */
+   GCond         *wakeup;
+   GThread       *flusher;
+   gboolean       stop;
+   gboolean       congested;
+   GString       *pending;    /* Lines not sent yet. */
+   GTimeVal       deadline;   /* When the pending lines must go out. */
+   guint          dropped;    /* Lines dropped since the last report. */
 } VMXLoggerData;
 
 
+/*
+ *******************************************************************************
+ * VMXLoggerSend --                                                       */ /**
+ *
+ * Sends lines to the VMX, in as few RPCs as VMXLOGGER_BATCH_MAX_BYTES allows.
+ * RPCs are split at line boundaries; a line longer than the limit is sent on
+ * its own.
+ *
+ * The logger uses its own RpcChannel, opening and closing the channel for each
+ * batch sent. This could be improved by providing a way for the application to
+ * provide its own RpcChannel to the logging code, if it uses one, so that this
+ * logger can re-use it.
+ *
+ * @param[in] logger    VMX logger data.
+ * @param[in] lines     Newline-terminated lines to send.
+ *
+ * @return Whether the lines were sent promptly: FALSE if an RPC failed or
+ *         the sends were slow.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+VMXLoggerSend(VMXLoggerData *logger,
+              const GString *lines)
+{
+   gboolean ok = FALSE;
+   uint64 start;
+
+   VMTools_AcquireLogStateLock();
+   /*
+    * To avoid nested logging inside of RpcChannel, we need to disable logging
+    * here. See bug 1069390.
+    */
+
+   VMTools_StopLogging();
+
+   start = System_GetTimeMonotonic();
+   if (RpcChannel_Start(logger->chan)) {
+      GString *msg = g_string_sized_new(VMXLOGGER_BATCH_MAX_BYTES + 4);
+      gsize offset = 0;
+
+      ok = TRUE;
+      while (offset < lines->len) {
+         const gchar *batch = lines->str + offset;
+         gsize len = MIN(lines->len - offset, VMXLOGGER_BATCH_MAX_BYTES);
+
+         if (offset + len < lines->len) {
+            const gchar *end = g_strrstr_len(batch, len, "\n");
+
+            if (end != NULL) {
+               len = end - batch + 1;
+            } else {
+               end = strchr(batch + len, '\n');
+               len = (end != NULL) ? end - batch + 1 : lines->len - offset;
+            }
+         }
+
+         g_string_assign(msg, "log ");
+         g_string_append_len(msg, batch, len);
+         ok &= RpcChannel_Send(logger->chan, msg->str, msg->len, NULL, NULL);
+         offset += len;
+      }
+
+      g_string_free(msg, TRUE);
+      RpcChannel_Stop(logger->chan);
+   }
+   ok &= System_GetTimeMonotonic() - start < VMXLOGGER_SLOW_SEND;
+
+   VMTools_RestartLogging();
+   VMTools_ReleaseLogStateLock();
+
+   return ok;
+}
+
+
+/*
+ *******************************************************************************
+ * VMXLoggerFlush --                                                      */ /**
+ *
+ * Sends the pending lines, followed by a note about the lines dropped since
+ * the last one, and updates the congestion state. Called with the logger lock
+ * held, which is released while sending so that logging doesn't wait for the
+ * VMX.
+ *
+ * @param[in] logger    VMX logger data.
+ *
+ *******************************************************************************
+ */
+
+static void
+VMXLoggerFlush(VMXLoggerData *logger)
+{
+   GString *lines = logger->pending;
+   gboolean ok;
+
+   if (lines->len == 0 && logger->dropped == 0) {
+      return;
+   }
+
+   if (logger->dropped > 0) {
+      g_string_append_printf(lines, "vmxLogger: dropped %u log messages, "
+                             "the channel is congested.\n", logger->dropped);
+      logger->dropped = 0;
+   }
+   logger->pending = g_string_sized_new(lines->len);
+
+   g_mutex_unlock(logger->lock);
+   ok = VMXLoggerSend(logger, lines);
+   g_mutex_lock(logger->lock);
+
+   logger->congested = !ok;
+
+   g_string_free(lines, TRUE);
+}
+
+
+/*
+ *******************************************************************************
+ * VMXLoggerFlusher --                                                    */ /**
+ *
+ * Thread that sends the pending lines when their flush window is over, or
+ * when woken up early because the batch is full.
+ *
+ * @param[in] data      VMX logger data.
+ *
+ * @return NULL.
+ *
+ *******************************************************************************
+ */
+
+static gpointer
+VMXLoggerFlusher(gpointer data)
+{
+   VMXLoggerData *logger = data;
+
+   g_mutex_lock(logger->lock);
+   while (!logger->stop) {
+      if (logger->pending->len == 0 && logger->dropped == 0) {
+         g_cond_wait(logger->wakeup, logger->lock);
+      } else {
+         GTimeVal now;
+
+         g_get_current_time(&now);
+         if (now.tv_sec > logger->deadline.tv_sec ||
+             (now.tv_sec == logger->deadline.tv_sec &&
+              now.tv_usec >= logger->deadline.tv_usec)) {
+            VMXLoggerFlush(logger);
+         } else {
+            g_cond_timed_wait(logger->wakeup, logger->lock, &logger->deadline);
+         }
+      }
+   }
+   g_mutex_unlock(logger->lock);
+
+   return NULL;
+}
+
+
 /*
  *******************************************************************************
  * VMXLoggerLog --                                                        */ /**
  *
  * Logs a message to the VMX using RpcChannel.
  *
- * The logger uses its own RpcChannel, opening and closing the channel for each
- * log message sent. This is not optimal, especially if the application already
- * has an RpcChannel instantiated; this could be fixed by providing a way for
- * the application to provide its own RpcChannel to the logging code, if it uses
- * one, so that this logger can re-use it.
+ * Messages are queued and sent in batches by a flusher thread, so the VMX may
+ * time stamp them up to VMXLOGGER_FLUSH_WINDOW_MS late. Errors and critical
+ * messages are sent right away, and fatal ones before returning. When the
+ * channel can't keep up, debug messages are dropped first.
  *
  * @param[in] domain    Unused.
  * @param[in] level     Log level.
@@ -58,27 +248,54 @@ VMXLoggerLog(const gchar *domain,
              gpointer data)
 {
    VMXLoggerData *logger = data;
+   gboolean urgent = (level & VMXLOGGER_URGENT_LEVELS) != 0;
+
+   g_mutex_lock(logger->lock);
 
-   VMTools_AcquireLogStateLock();
    /*
-    * To avoid nested logging inside of RpcChannel, we need to disable logging
-    * here. See bug 1069390.
+    * Whatever RpcChannel logs while the flusher sends would be sent in the
+    * next batch, logging more, and so on.
     */
+   if (logger->flusher != NULL && g_thread_self() == logger->flusher) {
+      g_mutex_unlock(logger->lock);
+      return;
+   }
 
-   VMTools_StopLogging();
+   if (!urgent &&
+       (logger->pending->len >= VMXLOGGER_PENDING_MAX_BYTES ||
+        ((level & G_LOG_LEVEL_DEBUG) != 0 &&
+         (logger->congested ||
+          logger->pending->len >= VMXLOGGER_HIGH_WATER_BYTES)))) {
+      logger->dropped++;
+      g_mutex_unlock(logger->lock);
+      return;
+   }
 
-   if (RpcChannel_Start(logger->chan)) {
-      gchar *msg;
-      gint cnt = VMToolsAsprintf(&msg, "log %s", message);
+   if (logger->pending->len == 0) {
+      g_get_current_time(&logger->deadline);
+      g_time_val_add(&logger->deadline, VMXLOGGER_FLUSH_WINDOW_MS * 1000);
+   }
+   g_string_append(logger->pending, message);
+   if (message[0] == '\0' || message[strlen(message) - 1] != '\n') {
+      g_string_append_c(logger->pending, '\n');
+   }
 
-      RpcChannel_Send(logger->chan, msg, cnt, NULL, NULL);
+   if (logger->flusher == NULL && !logger->stop) {
+      logger->flusher = g_thread_create(VMXLoggerFlusher, logger, TRUE, NULL);
+      if (logger->flusher == NULL) {
+         /* Can't batch; send each message as it's logged. */
+         logger->stop = TRUE;
+      }
+   }
 
-      g_free(msg);
-      RpcChannel_Stop(logger->chan);
+   if ((level & G_LOG_FLAG_FATAL) != 0 || logger->stop) {
+      VMXLoggerFlush(logger);
+   } else if (urgent || logger->pending->len >= VMXLOGGER_BATCH_MAX_BYTES) {
+      g_get_current_time(&logger->deadline);
+      g_cond_signal(logger->wakeup);
    }
 
-   VMTools_RestartLogging();
-   VMTools_ReleaseLogStateLock();
+   g_mutex_unlock(logger->lock);
 }
 
 
@@ -86,7 +303,8 @@ VMXLoggerLog(const gchar *domain,
  *******************************************************************************
  * VMXLoggerDestroy --                                                    */ /**
  *
- * Cleans up the internal state of a VMX logger.
+ * Cleans up the internal state of a VMX logger, after sending the pending
+ * lines.
  *
  * @param[in] data   VMX logger data.
  *
@@ -97,6 +315,23 @@ static void
 VMXLoggerDestroy(gpointer data)
 {
    VMXLoggerData *logger = data;
+
+   g_mutex_lock(logger->lock);
+   logger->stop = TRUE;
+   g_cond_signal(logger->wakeup);
+   g_mutex_unlock(logger->lock);
+
+   if (logger->flusher != NULL) {
+      g_thread_join(logger->flusher);
+   }
+
+   g_mutex_lock(logger->lock);
+   VMXLoggerFlush(logger);
+   g_mutex_unlock(logger->lock);
+
+   g_string_free(logger->pending, TRUE);
+   g_cond_free(logger->wakeup);
+   g_mutex_free(logger->lock);
    RpcChannel_Destroy(logger->chan);
    g_free(logger);
 }
@@ -122,6 +357,9 @@ VMToolsCreateVMXLogger(void)
    data->handler.shared = TRUE;
    data->handler.dtor = VMXLoggerDestroy;
    data->chan = RpcChannel_New();
+   data->lock = g_mutex_new();
+   data->wakeup = g_cond_new();
+   data->pending = g_string_sized_new(VMXLOGGER_BATCH_MAX_BYTES);
    return &data->handler;
 }
 
@@ -328,7 +328,8 @@ VMBlockInsMntQueDtr(struct vnode *vp, // IN: node to cleanup
  *
  * Side effects:
  *      In case of success takes over ownership of pathname thus caller
- *      has to dispose of it only if error was signalled.
+ *      has to dispose of it only if error was signalled.  If an existing
+ *      node is returned, it keeps its own name and pathname is freed.
  *
  * Original function comment:
  *
@@ -357,6 +358,9 @@ VMBlockNodeGet(struct mount *mp,        // IN: VMBlock fs info
    *vpp = VMBlockHashGet(mp, lowervp);
    if (*vpp != NULL) {
       vrele(lowervp);
+      if (pathname != NULL) {
+         uma_zfree(VMBlockPathnameZone, pathname);
+      }
       return 0;
    }
 
@@ -705,7 +705,7 @@ struct vop_lookup_args {
             panic("VMBlockNodeGet failed");
          }
          *ap->a_vpp = vp;
-         /* The vnode now owns pathname so don't try to free it below. */
+         /* VMBlockNodeGet now owns pathname so don't try to free it below. */
          pathname = NULL;
       }
    }
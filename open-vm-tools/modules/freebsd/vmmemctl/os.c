@@ -56,6 +56,16 @@
 #include "os.h"
 #include "vmballoon.h"
 
+/*
+ * Large (2 MB) pages are physically contiguous, aligned runs of small pages,
+ * as vm_page_alloc_contig() returns them since FreeBSD 10. They take
+ * OS_PMAP_LARGE_WORDS whole words of the page index bitmap.
+ */
+#if __FreeBSD_version >= 1000000
+#define OS_HAVE_LARGE_PAGES
+#define OS_PMAP_LARGE_WORDS (OS_LARGE_2_SMALL_PAGES / (8 * sizeof(unsigned long)))
+#endif
+
 /*
  * Types
  */
@@ -460,6 +470,55 @@ os_pmap_putindex(os_pmap *p,         // IN
 }
 
 
+#ifdef OS_HAVE_LARGE_PAGES
+static vm_pindex_t
+os_pmap_getrange(os_pmap *p) // IN
+{
+   unsigned long nGroups = p->size / sizeof(unsigned long) / OS_PMAP_LARGE_WORDS;
+   unsigned long group = p->hint / OS_PMAP_LARGE_WORDS;
+   unsigned long i;
+
+   /* scan bitmap for OS_LARGE_2_SMALL_PAGES aligned unset bits */
+   for (i = 0; i < nGroups; i++) {
+      unsigned long *words = &p->bitmap[group * OS_PMAP_LARGE_WORDS];
+      unsigned long j;
+
+      for (j = 0; j < OS_PMAP_LARGE_WORDS && !words[j]; j++) {
+      }
+
+      if (j == OS_PMAP_LARGE_WORDS) {
+         for (j = 0; j < OS_PMAP_LARGE_WORDS; j++) {
+            words[j] = ~0UL;
+         }
+         p->hint = group * OS_PMAP_LARGE_WORDS;
+         return group * OS_LARGE_2_SMALL_PAGES;
+      }
+
+      group = (group + 1) % nGroups;
+   }
+
+   /* failed */
+   return (vm_pindex_t)-1;
+}
+
+
+static void
+os_pmap_putrange(os_pmap *p,         // IN
+                 vm_pindex_t pindex) // IN
+{
+   unsigned long *words = &p->bitmap[pindex / (8*sizeof(unsigned long))];
+   unsigned long j;
+
+   ASSERT(pindex % OS_LARGE_2_SMALL_PAGES == 0);
+
+   /* unset bits */
+   for (j = 0; j < OS_PMAP_LARGE_WORDS; j++) {
+      words[j] = 0;
+   }
+}
+#endif
+
+
 static void
 os_kmem_free(vm_page_t page) // IN
 {
@@ -510,6 +569,56 @@ os_kmem_alloc(int alloc_normal_failed) // IN
 }
 
 
+#ifdef OS_HAVE_LARGE_PAGES
+static void
+os_kmem_free_large(vm_page_t page) // IN: First page of the run
+{
+   os_state *state = &global_state;
+   os_pmap *pmap = &state->pmap;
+   vm_pindex_t pindex = page->pindex;
+   int i;
+
+   if ( !vm_page_lookup(state->vmobject, pindex) ) {
+      return;
+   }
+
+   for (i = 0; i < OS_LARGE_2_SMALL_PAGES; i++) {
+      vm_page_free(page + i);
+   }
+   os_pmap_putrange(pmap, pindex);
+}
+
+
+static vm_page_t
+os_kmem_alloc_large(void)
+{
+   vm_page_t page;
+   vm_pindex_t pindex;
+   os_state *state = &global_state;
+   os_pmap *pmap = &state->pmap;
+
+   pindex = os_pmap_getrange(pmap);
+   if (pindex == (vm_pindex_t)-1) {
+      return NULL;
+   }
+
+   /*
+    * Never reclaim or sleep for a large page: when memory is too fragmented
+    * for one, the balloon switches to small pages.
+    */
+   page = vm_page_alloc_contig(state->vmobject, pindex, VM_ALLOC_NORMAL,
+                               OS_LARGE_2_SMALL_PAGES, 0, ~(vm_paddr_t)0,
+                               PAGE_SIZE * OS_LARGE_2_SMALL_PAGES, 0,
+                               VM_MEMATTR_DEFAULT);
+   if (!page) {
+      os_pmap_putrange(pmap, pindex);
+   }
+
+   return page;
+}
+#endif
+
+
 static void
 os_balloonobject_delete(void)
 {
@@ -549,9 +658,12 @@ OS_ReservedPageAlloc(int canSleep,    // IN
 {
    vm_page_t page;
 
+#ifdef OS_HAVE_LARGE_PAGES
+   page = isLargePage ? os_kmem_alloc_large() : os_kmem_alloc(canSleep);
+#else
    ASSERT(!isLargePage);
-
    page = os_kmem_alloc(canSleep);
+#endif
    if (page == NULL) {
       return PAGE_HANDLE_INVALID;
    }
@@ -580,7 +692,14 @@ void
 OS_ReservedPageFree(PageHandle handle, // IN: A valid page handle
                     int isLargePage)   // IN
 {
+#ifdef OS_HAVE_LARGE_PAGES
+   if (isLargePage) {
+      os_kmem_free_large((vm_page_t)handle);
+      return;
+   }
+#else
    ASSERT(!isLargePage);
+#endif
 
    os_kmem_free((vm_page_t)handle);
 }
@@ -609,6 +728,32 @@ OS_Yield(void)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * OS_GetUptimeUs --
+ *
+ *      Reads a monotonic clock, precise enough to time a monitor call.
+ *
+ * Results:
+ *      Microseconds since boot.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+uint64
+OS_GetUptimeUs(void)
+{
+   struct timeval tv;
+
+   microuptime(&tv);
+   return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
 /*
  * vmmemctl_poll -
  *
@@ -757,6 +902,7 @@ vmmemctl_load(module_t mod, // IN: Unused
 
 
 static struct sysctl_oid *oid;
+static struct sysctl_oid *statsOid;
 
 /*
  *-----------------------------------------------------------------------------
@@ -828,6 +974,174 @@ vmmemctl_sysctl(SYSCTL_HANDLER_ARGS)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * vmmemctl_stats_histogram --
+ *
+ *      Formats a latency histogram as a "name count0 count1 ..." line.
+ *
+ * Results:
+ *      The number of characters written.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static size_t
+vmmemctl_stats_histogram(char *buf,              // OUT
+                         size_t size,            // IN
+                         const char *name,       // IN
+                         const uint32 *buckets)  // IN
+{
+   size_t len = snprintf(buf, size, "%s", name);
+   int i;
+
+   for (i = 0; i < BALLOON_LATENCY_BUCKETS; i++) {
+      len += snprintf(buf + len, size - len, " %u", buckets[i]);
+   }
+   len += snprintf(buf + len, size - len, "\n");
+
+   return len;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * vmmemctl_stats_sysctl --
+ *
+ *      Provides the vm.vmmemctl_stats output: every statistic as a
+ *      "name value" line, for tools (guestInfo among them) rather than
+ *      people. Latency lines carry BALLOON_LATENCY_BUCKETS counts, bucket i
+ *      for the calls that took about 2^i microseconds. Names are only ever
+ *      added, so parsers should skip the ones they don't know.
+ *
+ * Results:
+ *      Error, if any
+ *
+ * Side effects:
+ *      Data is written into user-provided buffer
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+vmmemctl_stats_sysctl(SYSCTL_HANDLER_ARGS)
+{
+   char buf[PAGE_SIZE];
+   size_t len = 0;
+   int i;
+   const BalloonStats *stats = Balloon_GetStats();
+
+   len += snprintf(buf + len, sizeof(buf) - len,
+                   "target %u\n"
+                   "current %u\n"
+                   "rateNoSleepAlloc %u\n"
+                   "rateSleepAlloc %u\n"
+                   "rateFree %u\n"
+                   "capabilities %u\n"
+                   "batched %u\n"
+                   "batchMaxEntries %u\n"
+                   "chunks %u\n"
+                   "chunks2m %u\n"
+                   "slowAllocCycles %u\n"
+                   "timer %u\n"
+                   "inflated %u\n"
+                   "deflated %u\n"
+                   "periodInflated %u\n"
+                   "periodDeflated %u\n",
+                   stats->nPagesTarget,
+                   stats->nPages,
+                   stats->rateNoSleepAlloc,
+                   stats->rateAlloc,
+                   stats->rateFree,
+                   stats->capabilities,
+                   stats->batchMaxEntries > 1,
+                   stats->batchMaxEntries,
+                   stats->nChunks[FALSE],
+                   stats->nChunks[TRUE],
+                   stats->slowPageAllocationCycles,
+                   stats->timer,
+                   stats->inflated,
+                   stats->deflated,
+                   stats->periodInflated,
+                   stats->periodDeflated);
+
+   len += snprintf(buf + len, sizeof(buf) - len,
+                   "start %u\n"
+                   "startFail %u\n"
+                   "guestType %u\n"
+                   "guestTypeFail %u\n"
+                   "getTarget %u\n"
+                   "getTargetFail %u\n"
+                   "lock %u\n"
+                   "lockFail %u\n"
+                   "lock2m %u\n"
+                   "lock2mFail %u\n"
+                   "unlock %u\n"
+                   "unlockFail %u\n"
+                   "unlock2m %u\n"
+                   "unlock2mFail %u\n",
+                   stats->start, stats->startFail,
+                   stats->guestType, stats->guestTypeFail,
+                   stats->target, stats->targetFail,
+                   stats->lock[FALSE], stats->lockFail[FALSE],
+                   stats->lock[TRUE], stats->lockFail[TRUE],
+                   stats->unlock[FALSE], stats->unlockFail[FALSE],
+                   stats->unlock[TRUE], stats->unlockFail[TRUE]);
+
+   len += snprintf(buf + len, sizeof(buf) - len,
+                   "primLPageAlloc %u\n"
+                   "primLPageAllocFail %u\n"
+                   "primLPageFallback %u\n"
+                   "primNoSleepAlloc %u\n"
+                   "primNoSleepAllocFail %u\n"
+                   "primCanSleepAlloc %u\n"
+                   "primCanSleepAllocFail %u\n"
+                   "primFree %u\n"
+                   "primFree2m %u\n"
+                   "errAlloc %u\n"
+                   "errFree %u\n",
+                   stats->primAlloc[BALLOON_PAGE_ALLOC_LPAGE],
+                   stats->primAllocFail[BALLOON_PAGE_ALLOC_LPAGE],
+                   stats->primLPageFallback,
+                   stats->primAlloc[BALLOON_PAGE_ALLOC_NOSLEEP],
+                   stats->primAllocFail[BALLOON_PAGE_ALLOC_NOSLEEP],
+                   stats->primAlloc[BALLOON_PAGE_ALLOC_CANSLEEP],
+                   stats->primAllocFail[BALLOON_PAGE_ALLOC_CANSLEEP],
+                   stats->primFree[FALSE],
+                   stats->primFree[TRUE],
+                   stats->primErrorPageAlloc[FALSE] +
+                   stats->primErrorPageAlloc[TRUE],
+                   stats->primErrorPageFree[FALSE] +
+                   stats->primErrorPageFree[TRUE]);
+
+   for (i = BALLOON_SUCCESS + 1; i < BALLOON_ERROR_NR; i++) {
+      len += snprintf(buf + len, sizeof(buf) - len,
+                      "lockRefused.%s %u\n"
+                      "unlockRefused.%s %u\n",
+                      Balloon_GetErrorName(i), stats->lockRefused[i],
+                      Balloon_GetErrorName(i), stats->unlockRefused[i]);
+   }
+
+   len += vmmemctl_stats_histogram(buf + len, sizeof(buf) - len,
+                                   "lockLatency", stats->lockLatency[FALSE]);
+   len += vmmemctl_stats_histogram(buf + len, sizeof(buf) - len,
+                                   "lock2mLatency", stats->lockLatency[TRUE]);
+   len += vmmemctl_stats_histogram(buf + len, sizeof(buf) - len,
+                                   "unlockLatency",
+                                   stats->unlockLatency[FALSE]);
+   len += vmmemctl_stats_histogram(buf + len, sizeof(buf) - len,
+                                   "unlock2mLatency",
+                                   stats->unlockLatency[TRUE]);
+
+   return SYSCTL_OUT(req, buf, len + 1);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -851,6 +1165,10 @@ vmmemctl_init_sysctl(void)
                          BALLOON_NAME, CTLTYPE_STRING | CTLFLAG_RD,
                          0, 0, vmmemctl_sysctl, "A",
                          BALLOON_NAME_VERBOSE);
+   statsOid = sysctl_add_oid(NULL, SYSCTL_STATIC_CHILDREN(_vm), OID_AUTO,
+                             BALLOON_NAME "_stats", CTLTYPE_STRING | CTLFLAG_RD,
+                             0, 0, vmmemctl_stats_sysctl, "A",
+                             BALLOON_NAME_VERBOSE " statistics");
 }
 
 
@@ -873,6 +1191,9 @@ vmmemctl_init_sysctl(void)
 static void
 vmmemctl_deinit_sysctl(void)
 {
+   if (statsOid) {
+      sysctl_remove_oid(statsOid,1,0);
+   }
    if (oid) {
       sysctl_remove_oid(oid,1,0);
    }
@@ -44,6 +44,17 @@
 #   define VXN_NEWNEWBUS
 #endif
 
+/*
+ * TCP segmentation offload needs m_pkthdr.tso_segsz (FreeBSD 7.0) and the
+ * software LRO helpers in tcp_lro.c are usable by drivers from 8.0 onwards.
+ */
+#if __FreeBSD_version >= 700000
+#   define VXN_TSO
+#endif
+#if __FreeBSD_version >= 800000
+#   define VXN_LRO
+#endif
+
 #if __FreeBSD_version < 600000
 #include <machine/bus_pio.h>
 #else
@@ -65,6 +76,16 @@
 
 #include <net/bpf.h>
 
+#if defined(VXN_TSO) || defined(VXN_LRO)
+#include <netinet/in.h>
+#include <netinet/in_systm.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#endif
+#ifdef VXN_LRO
+#include <netinet/tcp_lro.h>
+#endif
+
 #include <vm/vm.h>
 #include <vm/pmap.h>
 
@@ -95,6 +116,14 @@
 /* number of milliseconds to wait for pending transmits to complete on stop */
 #define MAX_TX_WAIT_ON_STOP 2000
 
+/*
+ * A TSO packet may span several chained tx ring entries.  Only the last entry
+ * of a chain holds the mbuf; the others are marked with VXN_TX_CHAINED so the
+ * ring still shows them as busy.
+ */
+#define VXN_TX_CHAINED ((struct mbuf *)1)
+#define VXN_TSO_MAX_TX_ENTRIES 8
+
 static int vxn_probe (device_t);
 static int vxn_attach (device_t);
 static int vxn_detach (device_t);
@@ -123,8 +152,13 @@ typedef struct vxn_softc {
    int                      vxn_tx_pending;
    int                      vxn_rings_allocated;
    uint32                   vxn_max_tx_frags;
+   uint32                   vxn_capabilities;
+   uint32                   vxn_features;
+#ifdef VXN_LRO
+   struct lro_ctrl          vxn_lro;
+#endif
 
-   struct mbuf             *vxn_tx_buffptr[VMXNET2_MAX_NUM_TX_BUFFERS];
+   struct mbuf             *vxn_tx_buffptr[VMXNET2_MAX_NUM_TX_BUFFERS_TSO];
    struct mbuf             *vxn_rx_buffptr[VMXNET2_MAX_NUM_RX_BUFFERS];
 
 } vxn_softc_t;
@@ -306,6 +340,67 @@ vxn_media_change(struct ifnet * ifp)
    return (0);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * vxn_can_tso --
+ *      Check whether the device can segment TCP packets for us.  TSO only
+ *      makes sense with hardware checksum offload, and large packets must be
+ *      chained across several zero-copy tx ring entries.
+ *
+ * Results:
+ *      TRUE if TSO can be offered to the stack, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *-----------------------------------------------------------------------------
+ */
+static int
+vxn_can_tso(const vxn_softc_t *sc)
+{
+#ifdef VXN_TSO
+   return (sc->vxn_capabilities & VMNET_CAP_TSO) &&
+          (sc->vxn_capabilities & (VMNET_CAP_IP4_CSUM | VMNET_CAP_HW_CSUM)) &&
+          (sc->vxn_capabilities & VMNET_CAP_SG) &&
+          (sc->vxn_capabilities & VMNET_CAP_TX_CHAIN) &&
+          (sc->vxn_features & VMXNET_FEATURE_ZERO_COPY_TX) &&
+          (sc->vxn_features & VMXNET_FEATURE_TSO);
+#else
+   return FALSE;
+#endif
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * vxn_set_hwassist --
+ *      Derive the offloads requested from the stack from the enabled
+ *      interface capabilities.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates if_hwassist, may clear IFCAP_TSO4 from if_capenable.
+ *-----------------------------------------------------------------------------
+ */
+static void
+vxn_set_hwassist(struct ifnet *ifp)
+{
+   ifp->if_hwassist = 0;
+
+   if (ifp->if_capenable & IFCAP_TXCSUM) {
+      ifp->if_hwassist |= CSUM_TCP | CSUM_UDP;
+   }
+#ifdef VXN_TSO
+   else {
+      /* the device only segments packets it also checksums */
+      ifp->if_capenable &= ~IFCAP_TSO4;
+   }
+   if (ifp->if_capenable & IFCAP_TSO4) {
+      ifp->if_hwassist |= CSUM_TSO;
+   }
+#endif
+}
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -347,6 +442,8 @@ vxn_attach(device_t dev)
    sc->vxn_tx_pending = 0;
    sc->vxn_rings_allocated = 0;
    sc->vxn_max_tx_frags = 1;
+   sc->vxn_capabilities = 0;
+   sc->vxn_features = 0;
 
    pci_enable_busmaster(dev);
 
@@ -418,6 +515,12 @@ vxn_attach(device_t dev)
       goto fail;
    }
 
+   /*
+    * The offloads we can use decide how large the tx ring has to be
+    */
+   sc->vxn_capabilities = vxn_execute_4(sc, VMXNET_CMD_GET_CAPABILITIES);
+   sc->vxn_features = vxn_execute_4(sc, VMXNET_CMD_GET_FEATURES);
+
    /*
     * allocate and initialize our private and shared data structures
     */
@@ -428,7 +531,11 @@ vxn_attach(device_t dev)
    sc->vxn_num_rx_bufs = r;
 
    r = vxn_execute_4(sc, VMXNET_CMD_GET_NUM_TX_BUFFERS);
-   if (r == 0 || r > VMXNET2_MAX_NUM_TX_BUFFERS) {
+   if (vxn_can_tso(sc)) {
+      if (r == 0 || r > VMXNET2_MAX_NUM_TX_BUFFERS_TSO) {
+         r = VMXNET2_DEFAULT_NUM_TX_BUFFERS_TSO;
+      }
+   } else if (r == 0 || r > VMXNET2_MAX_NUM_TX_BUFFERS) {
       r = VMXNET2_DEFAULT_NUM_TX_BUFFERS;
    }
    sc->vxn_num_tx_bufs = r;
@@ -479,7 +586,27 @@ vxn_attach(device_t dev)
    ifp->if_init = vxn_init;
    ifp->if_baudrate = 1000000000;
    ifp->if_snd.ifq_maxlen = sc->vxn_num_tx_bufs;
+
+   /*
+    * advertise the offloads the device implements
+    */
+   ifp->if_capabilities = IFCAP_RXCSUM;
+   if (sc->vxn_capabilities & (VMNET_CAP_IP4_CSUM | VMNET_CAP_HW_CSUM)) {
+      ifp->if_capabilities |= IFCAP_TXCSUM;
+   }
+#ifdef VXN_TSO
+   if (vxn_can_tso(sc)) {
+      ifp->if_capabilities |= IFCAP_TSO4;
+   }
+#endif
+#ifdef VXN_LRO
+   if (tcp_lro_init(&sc->vxn_lro) == 0) {
+      sc->vxn_lro.ifp = ifp;
+      ifp->if_capabilities |= IFCAP_LRO;
+   }
+#endif
    ifp->if_capenable = ifp->if_capabilities;
+   vxn_set_hwassist(ifp);
 
    /*
     * read the MAC address from the device
@@ -585,6 +712,11 @@ vxn_detach(device_t dev)
    /*
     * Cleanup - release resources and memory
     */
+#ifdef VXN_LRO
+   if (ifp->if_capabilities & IFCAP_LRO) {
+      tcp_lro_free(&sc->vxn_lro);
+   }
+#endif
    VXN_IF_FREE(sc);
    contigfree(sc->vxn_dd, sc->vxn_dd->length, M_DEVBUF);
    bus_teardown_intr(dev, sc->vxn_irq, sc->vxn_intrhand);
@@ -800,9 +932,6 @@ vxn_initl(vxn_softc_t *sc)
    VXN_LOCK_ASSERT(sc);
 
    if (!(VXN_GET_IF_DRV_FLAGS(ifp) & VXN_IFF_RUNNING)) {
-      u_int32_t capabilities;
-      u_int32_t features;
-
       if (vxn_init_rings(sc) != 0) {
          printf("vxn%d: ring intitialization failed\n", VXN_IF_UNIT(ifp));
          return;
@@ -845,10 +974,8 @@ vxn_initl(vxn_softc_t *sc)
          printf("vxn%d: device intitialization failed: %x\n", VXN_IF_UNIT(ifp), r);
          return;
       }
-      capabilities = vxn_execute_4(sc, VMXNET_CMD_GET_CAPABILITIES);
-      features = vxn_execute_4(sc, VMXNET_CMD_GET_FEATURES);
-      if ((capabilities & VMNET_CAP_SG) &&
-          (features & VMXNET_FEATURE_ZERO_COPY_TX)) {
+      if ((sc->vxn_capabilities & VMNET_CAP_SG) &&
+          (sc->vxn_features & VMXNET_FEATURE_ZERO_COPY_TX)) {
          sc->vxn_max_tx_frags = VMXNET2_SG_DEFAULT_LENGTH;
       } else {
          sc->vxn_max_tx_frags = 1;
@@ -889,94 +1016,180 @@ vxn_initl(vxn_softc_t *sc)
 /*
  *-----------------------------------------------------------------------------
  * vxn_encap --
- *     Stick packet address and length in given ring entry
+ *     Stick packet addresses and lengths in ring entries starting at
+ *     txDriverNext.  Ordinary packets use a single entry; TSO packets may be
+ *     chained across several entries with VMXNET2_TX_MORE.
  *
  * Results:
- *      0 on success, 1 on error
+ *      0 on success, ENOBUFS if the ring has no room for the packet, ENOMEM
+ *      if the packet could not be copied or compacted, EFBIG if the packet
+ *      cannot be sent at all (it is freed and *m_headp set to NULL).
  *
  * Side effects:
  *	Allocate a new mbuf cluster and copy data, if mbuf chain is too
- *	fragmented for us to include in our scatter/gather array
+ *	fragmented for us to include in our scatter/gather array.  Advances
+ *	txDriverNext and the pending/deferred counters.  *m_headp is
+ *	updated if the chain was replaced.
  *
  *-----------------------------------------------------------------------------
  */
 static int
 vxn_encap(struct ifnet *ifp,
-	  Vmxnet2_TxRingEntry *xre,
-	  struct mbuf *m_head,
-	  struct mbuf **pbuffptr)
+	  struct mbuf **m_headp)
 {
    vxn_softc_t *sc = ifp->if_softc;
-   int frag = 0;
+   Vmxnet2_DriverData *dd = sc->vxn_dd;
+   struct mbuf *m_head = *m_headp;
+   Vmxnet2_TxRingEntry *first, *xre;
    struct mbuf *m;
+   uint32 idx;
+   int frag, nfrags, nentries, maxEntries;
+   int tso = FALSE;
 
-   xre->sg.length = 0;
-   xre->flags = 0;
+#ifdef VXN_TSO
+   tso = (m_head->m_pkthdr.csum_flags & CSUM_TSO) != 0;
+#endif
+   maxEntries = tso ? VXN_TSO_MAX_TX_ENTRIES : 1;
 
-   /*
-    * Go through mbuf chain and drop packet pointers into ring
-    * scatter/gather array
-    */
+   nfrags = 0;
    for (m = m_head; m != NULL; m = m->m_next) {
       if (m->m_len) {
-         if (frag == sc->vxn_max_tx_frags) {
-            break;
-         }
-
-         xre->sg.sg[frag].addrLow = (uint32)vtophys(mtod(m, vm_offset_t));
-         xre->sg.sg[frag].length = m->m_len;
-         frag++;
+         nfrags++;
       }
    }
 
    /*
     * Allocate a new mbuf cluster and copy data if we can't use the mbuf chain
-    * as such
+    * as such.  TSO packets are larger than a cluster and get compacted
+    * instead.
     */
-   if (m != NULL) {
+   if (nfrags > maxEntries * sc->vxn_max_tx_frags) {
       struct mbuf    *m_new = NULL;
 
-      MGETHDR(m_new, M_DONTWAIT, MT_DATA);
-      if (m_new == NULL) {
-         printf("vxn%d: no memory for tx list\n", VXN_IF_UNIT(ifp));
-         return 1;
+      if (tso) {
+         m_new = m_defrag(m_head, M_DONTWAIT);
+         if (m_new == NULL) {
+            printf("vxn%d: no memory for tx list\n", VXN_IF_UNIT(ifp));
+            return ENOMEM;
+         }
+      } else {
+         MGETHDR(m_new, M_DONTWAIT, MT_DATA);
+         if (m_new == NULL) {
+            printf("vxn%d: no memory for tx list\n", VXN_IF_UNIT(ifp));
+            return ENOMEM;
+         }
+
+         if (m_head->m_pkthdr.len > MHLEN) {
+            MCLGET(m_new, M_DONTWAIT);
+            if (!(m_new->m_flags & M_EXT)) {
+               m_freem(m_new);
+               printf("vxn%d: no memory for tx list\n", VXN_IF_UNIT(ifp));
+               return ENOMEM;
+            }
+         }
+
+         m_copydata(m_head, 0, m_head->m_pkthdr.len,
+             mtod(m_new, caddr_t));
+         m_new->m_pkthdr.len = m_new->m_len = m_head->m_pkthdr.len;
+         m_freem(m_head);
       }
+      m_head = m_new;
+      *m_headp = m_head;
 
-      if (m_head->m_pkthdr.len > MHLEN) {
-         MCLGET(m_new, M_DONTWAIT);
-         if (!(m_new->m_flags & M_EXT)) {
-            m_freem(m_new);
-            printf("vxn%d: no memory for tx list\n", VXN_IF_UNIT(ifp));
-            return 1;
+      nfrags = 0;
+      for (m = m_head; m != NULL; m = m->m_next) {
+         if (m->m_len) {
+            nfrags++;
          }
       }
+   }
 
-      m_copydata(m_head, 0, m_head->m_pkthdr.len,
-          mtod(m_new, caddr_t));
-      m_new->m_pkthdr.len = m_new->m_len = m_head->m_pkthdr.len;
+   if (nfrags == 0 || nfrags > maxEntries * sc->vxn_max_tx_frags) {
       m_freem(m_head);
-      m_head = m_new;
-
-      xre->sg.sg[0].addrLow = (uint32)vtophys(mtod(m_head, vm_offset_t));
-      xre->sg.sg[0].length = m_head->m_pkthdr.len;
-      frag = 1;
+      *m_headp = NULL;
+      return EFBIG;
    }
 
-   xre->sg.length = frag;
+   nentries = (nfrags + sc->vxn_max_tx_frags - 1) / sc->vxn_max_tx_frags;
+   if (sc->vxn_tx_pending + nentries > dd->txRingLength) {
+      return ENOBUFS;
+   }
 
    /*
-    * Mark ring entry as "NIC owned"
+    * Go through mbuf chain and drop packet pointers into ring
+    * scatter/gather arrays.  Entries after the first are handed to the NIC
+    * as they fill up; the device does not look at them before the first
+    * entry changes hands, which happens last.
     */
-   if (frag > 0) {
-      if (m_head->m_pkthdr.csum_flags & (CSUM_TCP | CSUM_UDP)) {
-         xre->flags |= VMXNET2_TX_HW_XSUM;
+   idx = dd->txDriverNext;
+   first = xre = &sc->vxn_tx_ring[idx];
+   xre->flags = 0;
+   frag = 0;
+
+   for (m = m_head; m != NULL; m = m->m_next) {
+      if (m->m_len == 0) {
+         continue;
       }
-      xre->sg.addrType = NET_SG_PHYS_ADDR;
-      *pbuffptr = m_head;
+      if (frag == sc->vxn_max_tx_frags) {
+         xre->sg.length = frag;
+         xre->sg.addrType = NET_SG_PHYS_ADDR;
+         xre->flags |= VMXNET2_TX_MORE;
+         sc->vxn_tx_buffptr[idx] = VXN_TX_CHAINED;
+         if (xre != first) {
+            xre->ownership = VMXNET2_OWNERSHIP_NIC;
+         }
+
+         VMXNET_INC(idx, dd->txRingLength);
+         xre = &sc->vxn_tx_ring[idx];
+         xre->flags = 0;
+         frag = 0;
+      }
+
+      xre->sg.sg[frag].addrLow = (uint32)vtophys(mtod(m, vm_offset_t));
+      xre->sg.sg[frag].length = m->m_len;
+      frag++;
+   }
+
+   xre->sg.length = frag;
+   xre->sg.addrType = NET_SG_PHYS_ADDR;
+   sc->vxn_tx_buffptr[idx] = m_head;
+   if (xre != first) {
       xre->ownership = VMXNET2_OWNERSHIP_NIC;
-      xre->flags |= VMXNET2_TX_CAN_KEEP;
    }
 
+   /*
+    * Only the flags of the first entry are looked at by the device
+    */
+   if (m_head->m_pkthdr.csum_flags & (CSUM_TCP | CSUM_UDP)) {
+      first->flags |= VMXNET2_TX_HW_XSUM;
+   }
+#ifdef VXN_TSO
+   if (tso) {
+      uint16 mss = m_head->m_pkthdr.tso_segsz;
+
+      first->flags |= VMXNET2_TX_TSO | VMXNET2_TX_HW_XSUM;
+      first->tsoMss = mss;
+      dd->txNumDeferred += (m_head->m_pkthdr.len + mss - 1) / mss;
+   } else
+#endif
+   {
+      dd->txNumDeferred++;
+   }
+
+   if (sc->vxn_tx_pending > (dd->txRingLength - 5)) {
+      first->flags |= VMXNET2_TX_RING_LOW;
+   }
+
+   /*
+    * Mark first ring entry as "NIC owned"
+    */
+   first->flags |= VMXNET2_TX_CAN_KEEP;
+   first->ownership = VMXNET2_OWNERSHIP_NIC;
+
+   VMXNET_INC(idx, dd->txRingLength);
+   dd->txDriverNext = idx;
+   sc->vxn_tx_pending += nentries;
+
    return 0;
 }
 
@@ -1042,15 +1255,21 @@ vxn_startl(struct ifnet *ifp)
     */
    while (sc->vxn_tx_buffptr[dd->txDriverNext] == NULL) {
       struct mbuf *m_head = NULL;
-      Vmxnet2_TxRingEntry *xre;
+      int error;
 
       IF_DEQUEUE(&ifp->if_snd, m_head);
       if (m_head == NULL) {
          break;
       }
 
-      xre = &sc->vxn_tx_ring[dd->txDriverNext];
-      if (vxn_encap(ifp, xre, m_head, &(sc->vxn_tx_buffptr[dd->txDriverNext]))) {
+      error = vxn_encap(ifp, &m_head);
+      if (error == EFBIG) {
+         ifp->if_oerrors++;
+         continue;
+      } else if (error) {
+         if (error == ENOBUFS) {
+            dd->txStopped = TRUE;
+         }
          IF_PREPEND(&ifp->if_snd, m_head);
          break;
       }
@@ -1058,15 +1277,8 @@ vxn_startl(struct ifnet *ifp)
       /*
        * Bounce copy to (possible) BPF listener
        */
-      VXN_BPF_MTAP(ifp, sc->vxn_tx_buffptr[dd->txDriverNext]);
+      VXN_BPF_MTAP(ifp, m_head);
 
-      if (sc->vxn_tx_pending > (dd->txRingLength - 5)) {
-         xre->flags |= VMXNET2_TX_RING_LOW;
-      }
-
-      VMXNET_INC(dd->txDriverNext, dd->txRingLength);
-      dd->txNumDeferred++;
-      sc->vxn_tx_pending++;
       ifp->if_opackets++;
    }
 
@@ -1136,6 +1348,18 @@ vxn_ioctl(struct ifnet *ifp, u_long command, caddr_t data)
       error = 0;
       break;
 
+   case SIOCSIFCAP: {
+      struct ifreq *ifr = (struct ifreq *)data;
+      int mask;
+
+      VXN_LOCK(sc);
+      mask = (ifr->ifr_reqcap ^ ifp->if_capenable) & ifp->if_capabilities;
+      ifp->if_capenable ^= mask;
+      vxn_set_hwassist(ifp);
+      VXN_UNLOCK(sc);
+      break;
+   }
+
    case SIOCSIFMEDIA:
    case SIOCGIFMEDIA:
       ifmedia_ioctl(ifp, (struct ifreq *)data, &sc->media, command);
@@ -1291,7 +1515,8 @@ vxn_rx(vxn_softc_t *sc)
             m->m_pkthdr.rcvif = ifp;
             m->m_pkthdr.len = m->m_len = pkt_len;
 
-            if (rre->flags & VMXNET2_RX_HW_XSUM_OK) {
+            if ((ifp->if_capenable & IFCAP_RXCSUM) &&
+                (rre->flags & VMXNET2_RX_HW_XSUM_OK)) {
                m->m_pkthdr.csum_flags |= CSUM_DATA_VALID | CSUM_PSEUDO_HDR;
                m->m_pkthdr.csum_data = 0xffff;
             }
@@ -1308,7 +1533,18 @@ vxn_rx(vxn_softc_t *sc)
              * receive rings are still protected while we give up the mutex.
              */
             VXN_UNLOCK(sc);
-            VXN_ETHER_INPUT(ifp, m);
+#ifdef VXN_LRO
+            /*
+             * Coalesce TCP segments the device already verified; anything
+             * LRO declines goes up on its own.
+             */
+            if (!(ifp->if_capenable & IFCAP_LRO) ||
+                !(m->m_pkthdr.csum_flags & CSUM_DATA_VALID) ||
+                tcp_lro_rx(&sc->vxn_lro, m, 0) != 0)
+#endif
+            {
+               VXN_ETHER_INPUT(ifp, m);
+            }
             VXN_LOCK(sc);
          }
       }
@@ -1319,6 +1555,15 @@ vxn_rx(vxn_softc_t *sc)
       rre->ownership = VMXNET2_OWNERSHIP_NIC;
       VMXNET_INC(dd->rxDriverNext, dd->rxRingLength);
    }
+
+#ifdef VXN_LRO
+   /*
+    * Push the aggregated segments up once the ring is drained
+    */
+   VXN_UNLOCK(sc);
+   VXN_LRO_FLUSH(&sc->vxn_lro);
+   VXN_LOCK(sc);
+#endif
 }
 
 /*
@@ -1340,13 +1585,16 @@ vxn_tx_complete(vxn_softc_t *sc)
 
    while (1) {
       Vmxnet2_TxRingEntry *xre = &sc->vxn_tx_ring[dd->txDriverCur];
+      struct mbuf *m = sc->vxn_tx_buffptr[dd->txDriverCur];
 
-      if (xre->ownership != VMXNET2_OWNERSHIP_DRIVER ||
-	  sc->vxn_tx_buffptr[dd->txDriverCur] == NULL) {
+      if (xre->ownership != VMXNET2_OWNERSHIP_DRIVER || m == NULL) {
          break;
       }
 
-      m_freem(sc->vxn_tx_buffptr[dd->txDriverCur]);
+      /* the mbuf of a chained packet hangs off its last entry */
+      if (m != VXN_TX_CHAINED) {
+         m_freem(m);
+      }
       sc->vxn_tx_buffptr[dd->txDriverCur] = NULL;
       sc->vxn_tx_pending--;
       VMXNET_INC(dd->txDriverCur, dd->txRingLength);
@@ -1498,7 +1746,9 @@ vxn_release_rings(vxn_softc_t *sc)
     */
    for (i = 0; i < sc->vxn_num_tx_bufs; i++) {
       if (sc->vxn_tx_buffptr[i] != NULL) {
-         m_freem(sc->vxn_tx_buffptr[i]);
+         if (sc->vxn_tx_buffptr[i] != VXN_TX_CHAINED) {
+            m_freem(sc->vxn_tx_buffptr[i]);
+         }
          sc->vxn_tx_buffptr[i] = NULL;
       }
    }
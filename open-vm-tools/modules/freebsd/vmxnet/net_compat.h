@@ -178,4 +178,23 @@
 #   define VXN_IF_ADDR_UNLOCK(_ifp)     if_maddr_runlock((_ifp))
 #endif
 
+/*
+ * FreeBSD 11 grew tcp_lro_flush_all(); before that drivers walked the list of
+ * active LRO entries themselves.
+ */
+#ifdef VXN_LRO
+#if __FreeBSD_version >= 1100000
+#   define VXN_LRO_FLUSH(_lro)          tcp_lro_flush_all((_lro))
+#else
+#   define VXN_LRO_FLUSH(_lro) do {                                     \
+      struct lro_entry *_queued;                                        \
+                                                                        \
+      while ((_queued = SLIST_FIRST(&(_lro)->lro_active)) != NULL) {    \
+         SLIST_REMOVE_HEAD(&(_lro)->lro_active, next);                  \
+         tcp_lro_flush((_lro), _queued);                                \
+      }                                                                 \
+   } while (0)
+#endif
+#endif
+
 #endif /* _VXN_NET_COMPAT_H_ */
@@ -34,6 +34,7 @@
 /* With this file you always get the latest version. */
 #include "vmciKernelAPI1.h"
 #include "vmciKernelAPI2.h"
+#include "vmciKernelAPI3.h"
 
 
 #endif /* !__VMCI_KERNELAPI_H__ */
@@ -0,0 +1,62 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ *********************************************************/
+
+/*
+ * vmciKernelAPI3.h --
+ *
+ *    Kernel API (v3) exported from the VMCI host and guest drivers.
+ */
+
+#ifndef __VMCI_KERNELAPI_3_H__
+#define __VMCI_KERNELAPI_3_H__
+
+#define INCLUDE_ALLOW_MODULE
+#define INCLUDE_ALLOW_VMK_MODULE
+#define INCLUDE_ALLOW_VMKERNEL
+#include "includeCheck.h"
+
+
+#include "vmciKernelAPI2.h"
+
+
+/* Define version 3. */
+
+#undef  VMCI_KERNEL_API_VERSION
+#define VMCI_KERNEL_API_VERSION_3 3
+#define VMCI_KERNEL_API_VERSION   VMCI_KERNEL_API_VERSION_3
+
+
+/* VMCI Queue Pair API. */
+
+ssize_t vmci_qpair_enqueue_ready(VMCIQPair *qpair, const void *buf,
+                                 size_t bufSize, int bufType,
+                                 int64 *readyBefore);
+
+#if (defined(__APPLE__) && !defined (VMX86_TOOLS)) || \
+    (defined(__linux__) && defined(__KERNEL__))    || \
+    (defined(_WIN32)    && defined(WINNT_DDK))
+/*
+ * Environments that support struct iovec
+ */
+
+ssize_t vmci_qpair_enquev_ready(VMCIQPair *qpair, void *iov, size_t iovSize,
+                                int mode, int64 *readyBefore);
+#endif /* Systems that support struct iovec */
+
+
+#endif /* !__VMCI_KERNELAPI_3_H__ */
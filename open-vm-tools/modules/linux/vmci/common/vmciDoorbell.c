@@ -101,6 +101,19 @@ static uint32 lastNotifyIdxReserved;
 /* This is a one entry cache used to by the index allocation. */
 static uint32 lastNotifyIdxReleased = PAGE_SIZE;
 
+/*
+ * Upper bound on the number of notifications fired by a single scan of the
+ * notification bitmap. A scan that hits the budget remembers where it
+ * stopped in scanResumeIdx, so the next scan picks up from there and
+ * indexes at the end of the bitmap are not starved by busy ones near the
+ * start. Scans are serialized by the caller (the bitmap tasklet on Linux),
+ * so scanResumeIdx needs no locking.
+ */
+
+#define VMCI_DOORBELL_SCAN_BUDGET 256
+
+static uint32 scanResumeIdx;
+
 
 static void VMCIDoorbellFreeCB(void *clientData);
 static int VMCIDoorbellReleaseCB(void *clientData);
@@ -1078,12 +1091,13 @@ VMCI_RegisterNotificationBitmap(PPN bitmapPPN)
 /*
  *-------------------------------------------------------------------------
  *
- * VMCIDoorbellFireEntries --
+ * VMCIDoorbellFireEntriesLocked --
  *
- *     Executes or schedules the handlers for a given notify index.
+ *     Executes or schedules the handlers for a given notify index. The
+ *     caller must hold the index table lock.
  *
  * Result:
- *     Notification hash entry if found. NULL otherwise.
+ *     None.
  *
  * Side effects:
  *     Whatever the side effects of the handlers are.
@@ -1092,16 +1106,13 @@ VMCI_RegisterNotificationBitmap(PPN bitmapPPN)
  */
 
 static void
-VMCIDoorbellFireEntries(uint32 notifyIdx) // IN
+VMCIDoorbellFireEntriesLocked(uint32 notifyIdx) // IN
 {
    uint32 bucket = VMCI_DOORBELL_HASH(notifyIdx);
    VMCIListItem *iter;
-   VMCILockFlags flags;
 
    ASSERT(VMCI_GuestPersonalityActive());
 
-   VMCI_GrabLock_BH(&vmciDoorbellIT.lock, &flags);
-
    VMCIList_Scan(iter, &vmciDoorbellIT.entries[bucket]) {
       VMCIDoorbellEntry *cur =
          VMCIList_Entry(iter, VMCIDoorbellEntry, idxListItem);
@@ -1117,16 +1128,13 @@ VMCIDoorbellFireEntries(uint32 notifyIdx) // IN
             err = VMCI_ScheduleDelayedWork(VMCIDoorbellDelayedDispatchCB, cur);
             if (err != VMCI_SUCCESS) {
                VMCIResource_Release(&cur->resource);
-               goto out;
+               return;
             }
          } else {
             cur->notifyCB(cur->clientData);
          }
       }
    }
-
-out:
-   VMCI_ReleaseLock_BH(&vmciDoorbellIT.lock, flags);
 }
 
 
@@ -1138,8 +1146,15 @@ out:
  *      Scans the notification bitmap, collects pending notifications,
  *      resets the bitmap and invokes appropriate callbacks.
  *
+ *      All pending notifications are fired under a single acquisition of
+ *      the index table lock, and runs of clear entries are skipped a
+ *      64-bit word at a time. At most VMCI_DOORBELL_SCAN_BUDGET
+ *      notifications are fired per call; when the budget runs out, the
+ *      scan stops and the next call resumes where this one left off.
+ *
  * Results:
- *      None.
+ *      TRUE if the budget was exhausted and the caller should scan again,
+ *      FALSE if the whole bitmap was processed.
  *
  * Side effects:
  *      May schedule tasks, allocate memory and run callbacks.
@@ -1147,20 +1162,72 @@ out:
  *------------------------------------------------------------------------------
  */
 
-void
-VMCI_ScanNotificationBitmap(uint8 *bitmap)
+Bool
+VMCI_ScanNotificationBitmap(uint8 *bitmap) // IN
 {
+   uint32 limit = maxNotifyIdx;
+   uint32 start;
    uint32 idx;
+   uint32 scanned;
+   uint32 fired = 0;
+   VMCILockFlags flags;
+   Bool locked = FALSE;
 
    ASSERT(bitmap);
    ASSERT(VMCI_GuestPersonalityActive());
 
-   for (idx = 0; idx < maxNotifyIdx; idx++) {
-      if (bitmap[idx] & 0x1) {
-         bitmap[idx] &= ~1;
-         VMCIDoorbellFireEntries(idx);
+   if (limit == 0) {
+      return FALSE;
+   }
+
+   start = scanResumeIdx < limit ? scanResumeIdx : 0;
+   idx = start;
+   scanned = 0;
+
+   while (scanned < limit) {
+      /*
+       * The bitmap is page aligned and mostly clear, so skip whole aligned
+       * words of idle entries without touching them byte by byte.
+       */
+
+      if ((idx & (sizeof(uint64) - 1)) == 0 &&
+          idx + sizeof(uint64) <= limit &&
+          scanned + sizeof(uint64) <= limit &&
+          *(volatile uint64 *)(bitmap + idx) == 0) {
+         idx += sizeof(uint64);
+         scanned += sizeof(uint64);
+      } else {
+         if (bitmap[idx] & 0x1) {
+            if (fired == VMCI_DOORBELL_SCAN_BUDGET) {
+               break;
+            }
+            bitmap[idx] &= ~1;
+            if (!locked) {
+               VMCI_GrabLock_BH(&vmciDoorbellIT.lock, &flags);
+               locked = TRUE;
+            }
+            VMCIDoorbellFireEntriesLocked(idx);
+            fired++;
+         }
+         idx++;
+         scanned++;
+      }
+
+      if (idx >= limit) {
+         idx = 0;
       }
    }
+
+   if (locked) {
+      VMCI_ReleaseLock_BH(&vmciDoorbellIT.lock, flags);
+   }
+
+   if (scanned < limit) {
+      scanResumeIdx = idx;
+      return TRUE;
+   }
+   scanResumeIdx = 0;
+   return FALSE;
 }
 
 
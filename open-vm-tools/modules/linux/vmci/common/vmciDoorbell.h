@@ -42,6 +42,6 @@ int VMCIDoorbellHostContextNotify(VMCIId srcCID, VMCIHandle handle);
 int VMCIDoorbellGetPrivFlags(VMCIHandle handle, VMCIPrivilegeFlags *privFlags);
 
 Bool VMCI_RegisterNotificationBitmap(PPN bitmapPPN);
-void VMCI_ScanNotificationBitmap(uint8 *bitmap);
+Bool VMCI_ScanNotificationBitmap(uint8 *bitmap);
 
 #endif // VMCI_DOORBELL_H
@@ -42,8 +42,15 @@
 #define VMCI_HASHTABLE_HASH(_h, _sz) \
    VMCI_HashId(VMCI_HANDLE_TO_RESOURCE_ID(_h), (_sz))
 
-static int HashTableUnlinkEntry(VMCIHashTable *table, VMCIHashEntry *entry);
-static Bool VMCIHashTableEntryExistsLocked(VMCIHashTable *table,
+/*
+ * All lookups and updates only need the bucket of the handle's resource ID,
+ * since entries that match any context ID hash the same way.
+ */
+#define VMCI_HASHTABLE_BUCKET(_t, _h) \
+   (&(_t)->buckets[VMCI_HASHTABLE_HASH((_h), (_t)->size)])
+
+static int HashTableUnlinkEntry(VMCIHashBucket *bucket, VMCIHashEntry *entry);
+static Bool VMCIHashTableEntryExistsLocked(VMCIHashBucket *bucket,
                                            VMCIHandle handle);
 
 
@@ -62,25 +69,31 @@ static Bool VMCIHashTableEntryExistsLocked(VMCIHashTable *table,
 VMCIHashTable *
 VMCIHashTable_Create(int size)
 {
+   int i;
    VMCIHashTable *table = VMCI_AllocKernelMem(sizeof *table,
                                               VMCI_MEMORY_NONPAGED);
    if (table == NULL) {
       return NULL;
    }
 
-   table->entries = VMCI_AllocKernelMem(sizeof *table->entries * size,
+   table->buckets = VMCI_AllocKernelMem(sizeof *table->buckets * size,
                                         VMCI_MEMORY_NONPAGED);
-   if (table->entries == NULL) {
+   if (table->buckets == NULL) {
       VMCI_FreeKernelMem(table, sizeof *table);
       return NULL;
    }
-   memset(table->entries, 0, sizeof *table->entries * size);
+   memset(table->buckets, 0, sizeof *table->buckets * size);
    table->size = size;
-   if (VMCI_InitLock(&table->lock, "VMCIHashTableLock",
-                     VMCI_LOCK_RANK_HASHTABLE) < VMCI_SUCCESS) {
-      VMCI_FreeKernelMem(table->entries, sizeof *table->entries * size);
-      VMCI_FreeKernelMem(table, sizeof *table);
-      return NULL;
+   for (i = 0; i < size; i++) {
+      if (VMCI_InitLock(&table->buckets[i].lock, "VMCIHashTableLock",
+                        VMCI_LOCK_RANK_HASHTABLE) < VMCI_SUCCESS) {
+         while (i-- > 0) {
+            VMCI_CleanupLock(&table->buckets[i].lock);
+         }
+         VMCI_FreeKernelMem(table->buckets, sizeof *table->buckets * size);
+         VMCI_FreeKernelMem(table, sizeof *table);
+         return NULL;
+      }
    }
 
    return table;
@@ -105,7 +118,7 @@ VMCIHashTable_Create(int size)
 void
 VMCIHashTable_Destroy(VMCIHashTable *table)
 {
-   VMCILockFlags flags;
+   int j;
 #if 0
    DEBUG_ONLY(int i;)
    DEBUG_ONLY(int leakingEntries = 0;)
@@ -113,11 +126,10 @@ VMCIHashTable_Destroy(VMCIHashTable *table)
 
    ASSERT(table);
 
-   VMCI_GrabLock_BH(&table->lock, &flags);
 #if 0
 #ifdef VMX86_DEBUG
    for (i = 0; i < table->size; i++) {
-      VMCIHashEntry *head = table->entries[i];
+      VMCIHashEntry *head = table->buckets[i].head;
       while (head) {
          leakingEntries++;
          head = head->next;
@@ -129,10 +141,11 @@ VMCIHashTable_Destroy(VMCIHashTable *table)
    }
 #endif // VMX86_DEBUG
 #endif
-   VMCI_FreeKernelMem(table->entries, sizeof *table->entries * table->size);
-   table->entries = NULL;
-   VMCI_ReleaseLock_BH(&table->lock, flags);
-   VMCI_CleanupLock(&table->lock);
+   for (j = 0; j < table->size; j++) {
+      VMCI_CleanupLock(&table->buckets[j].lock);
+   }
+   VMCI_FreeKernelMem(table->buckets, sizeof *table->buckets * table->size);
+   table->buckets = NULL;
    VMCI_FreeKernelMem(table, sizeof *table);
 }
 
@@ -174,35 +187,33 @@ int
 VMCIHashTable_AddEntry(VMCIHashTable *table,   // IN
                        VMCIHashEntry *entry)   // IN
 {
-   int idx;
+   VMCIHashBucket *bucket;
    VMCILockFlags flags;
 
    ASSERT(entry);
    ASSERT(table);
 
-   VMCI_GrabLock_BH(&table->lock, &flags);
+   bucket = VMCI_HASHTABLE_BUCKET(table, entry->handle);
+   VMCI_GrabLock_BH(&bucket->lock, &flags);
 
    /* Check if creation of a new hashtable entry is allowed. */
    if (!VMCI_CanCreate()) {
-      VMCI_ReleaseLock_BH(&table->lock, flags);
+      VMCI_ReleaseLock_BH(&bucket->lock, flags);
       return VMCI_ERROR_UNAVAILABLE;
    }
 
-   if (VMCIHashTableEntryExistsLocked(table, entry->handle)) {
+   if (VMCIHashTableEntryExistsLocked(bucket, entry->handle)) {
       VMCI_DEBUG_LOG(4, (LGPFX"Entry (handle=0x%x:0x%x) already exists.\n",
                          entry->handle.context, entry->handle.resource));
-      VMCI_ReleaseLock_BH(&table->lock, flags);
+      VMCI_ReleaseLock_BH(&bucket->lock, flags);
       return VMCI_ERROR_DUPLICATE_ENTRY;
    }
 
-   idx = VMCI_HASHTABLE_HASH(entry->handle, table->size);
-   ASSERT(idx < table->size);
-
    /* New entry is added to top/front of hash bucket. */
    entry->refCount++;
-   entry->next = table->entries[idx];
-   table->entries[idx] = entry;
-   VMCI_ReleaseLock_BH(&table->lock, flags);
+   entry->next = bucket->head;
+   bucket->head = entry;
+   VMCI_ReleaseLock_BH(&bucket->lock, flags);
 
    return VMCI_SUCCESS;
 }
@@ -226,15 +237,17 @@ VMCIHashTable_RemoveEntry(VMCIHashTable *table, // IN
                           VMCIHashEntry *entry) // IN
 {
    int result;
+   VMCIHashBucket *bucket;
    VMCILockFlags flags;
 
    ASSERT(table);
    ASSERT(entry);
 
-   VMCI_GrabLock_BH(&table->lock, &flags);
+   bucket = VMCI_HASHTABLE_BUCKET(table, entry->handle);
+   VMCI_GrabLock_BH(&bucket->lock, &flags);
 
    /* First unlink the entry. */
-   result = HashTableUnlinkEntry(table, entry);
+   result = HashTableUnlinkEntry(bucket, entry);
    if (result != VMCI_SUCCESS) {
       /* We failed to find the entry. */
       goto done;
@@ -248,7 +261,7 @@ VMCIHashTable_RemoveEntry(VMCIHashTable *table, // IN
    }
 
   done:
-   VMCI_ReleaseLock_BH(&table->lock, flags);
+   VMCI_ReleaseLock_BH(&bucket->lock, flags);
 
    return result;
 }
@@ -272,18 +285,15 @@ VMCIHashTable_RemoveEntry(VMCIHashTable *table, // IN
  */
 
 static VMCIHashEntry *
-VMCIHashTableGetEntryLocked(VMCIHashTable *table,  // IN
-                            VMCIHandle handle)     // IN
+VMCIHashTableGetEntryLocked(VMCIHashBucket *bucket, // IN
+                            VMCIHandle handle)      // IN
 {
    VMCIHashEntry *cur = NULL;
-   int idx;
 
    ASSERT(!VMCI_HANDLE_EQUAL(handle, VMCI_INVALID_HANDLE));
-   ASSERT(table);
-
-   idx = VMCI_HASHTABLE_HASH(handle, table->size);
+   ASSERT(bucket);
 
-   cur = table->entries[idx];
+   cur = bucket->head;
    while (TRUE) {
       if (cur == NULL) {
          break;
@@ -323,6 +333,7 @@ VMCIHashTable_GetEntry(VMCIHashTable *table,  // IN
                        VMCIHandle handle)     // IN
 {
    VMCIHashEntry *entry;
+   VMCIHashBucket *bucket;
    VMCILockFlags flags;
 
    if (VMCI_HANDLE_EQUAL(handle, VMCI_INVALID_HANDLE)) {
@@ -331,9 +342,10 @@ VMCIHashTable_GetEntry(VMCIHashTable *table,  // IN
 
    ASSERT(table);
 
-   VMCI_GrabLock_BH(&table->lock, &flags);
-   entry = VMCIHashTableGetEntryLocked(table, handle);
-   VMCI_ReleaseLock_BH(&table->lock, flags);
+   bucket = VMCI_HASHTABLE_BUCKET(table, handle);
+   VMCI_GrabLock_BH(&bucket->lock, &flags);
+   entry = VMCIHashTableGetEntryLocked(bucket, handle);
+   VMCI_ReleaseLock_BH(&bucket->lock, flags);
 
    return entry;
 }
@@ -361,14 +373,16 @@ void
 VMCIHashTable_HoldEntry(VMCIHashTable *table, // IN
                         VMCIHashEntry *entry) // IN/OUT
 {
+   VMCIHashBucket *bucket;
    VMCILockFlags flags;
 
    ASSERT(table);
    ASSERT(entry);
 
-   VMCI_GrabLock_BH(&table->lock, &flags);
+   bucket = VMCI_HASHTABLE_BUCKET(table, entry->handle);
+   VMCI_GrabLock_BH(&bucket->lock, &flags);
    entry->refCount++;
-   VMCI_ReleaseLock_BH(&table->lock, flags);
+   VMCI_ReleaseLock_BH(&bucket->lock, flags);
 }
 
 
@@ -392,12 +406,12 @@ VMCIHashTable_HoldEntry(VMCIHashTable *table, // IN
  */
 
 static int
-VMCIHashTableReleaseEntryLocked(VMCIHashTable *table,  // IN
-                                VMCIHashEntry *entry)  // IN
+VMCIHashTableReleaseEntryLocked(VMCIHashBucket *bucket, // IN
+                                VMCIHashEntry *entry)   // IN
 {
    int result = VMCI_SUCCESS;
 
-   ASSERT(table);
+   ASSERT(bucket);
    ASSERT(entry);
 
    entry->refCount--;
@@ -413,7 +427,7 @@ VMCIHashTableReleaseEntryLocked(VMCIHashTable *table,  // IN
        * it detaches.
        */
 
-      HashTableUnlinkEntry(table, entry);
+      HashTableUnlinkEntry(bucket, entry);
       result = VMCI_SUCCESS_ENTRY_DEAD;
    }
 
@@ -438,13 +452,17 @@ int
 VMCIHashTable_ReleaseEntry(VMCIHashTable *table,  // IN
                            VMCIHashEntry *entry)  // IN
 {
+   VMCIHashBucket *bucket;
    VMCILockFlags flags;
    int result;
 
    ASSERT(table);
-   VMCI_GrabLock_BH(&table->lock, &flags);
-   result = VMCIHashTableReleaseEntryLocked(table, entry);
-   VMCI_ReleaseLock_BH(&table->lock, flags);
+   ASSERT(entry);
+
+   bucket = VMCI_HASHTABLE_BUCKET(table, entry->handle);
+   VMCI_GrabLock_BH(&bucket->lock, &flags);
+   result = VMCIHashTableReleaseEntryLocked(bucket, entry);
+   VMCI_ReleaseLock_BH(&bucket->lock, flags);
 
    return result;
 }
@@ -471,13 +489,15 @@ VMCIHashTable_EntryExists(VMCIHashTable *table,  // IN
                           VMCIHandle handle)     // IN
 {
    Bool exists;
+   VMCIHashBucket *bucket;
    VMCILockFlags flags;
 
    ASSERT(table);
 
-   VMCI_GrabLock_BH(&table->lock, &flags);
-   exists = VMCIHashTableEntryExistsLocked(table, handle);
-   VMCI_ReleaseLock_BH(&table->lock, flags);
+   bucket = VMCI_HASHTABLE_BUCKET(table, handle);
+   VMCI_GrabLock_BH(&bucket->lock, &flags);
+   exists = VMCIHashTableEntryExistsLocked(bucket, handle);
+   VMCI_ReleaseLock_BH(&bucket->lock, flags);
 
    return exists;
 }
@@ -500,18 +520,15 @@ VMCIHashTable_EntryExists(VMCIHashTable *table,  // IN
  */
 
 static Bool
-VMCIHashTableEntryExistsLocked(VMCIHashTable *table,   // IN
+VMCIHashTableEntryExistsLocked(VMCIHashBucket *bucket, // IN
                                VMCIHandle handle)      // IN
 
 {
    VMCIHashEntry *entry;
-   int idx;
 
-   ASSERT(table);
-
-   idx = VMCI_HASHTABLE_HASH(handle, table->size);
+   ASSERT(bucket);
 
-   entry = table->entries[idx];
+   entry = bucket->head;
    while (entry) {
       if (VMCI_HANDLE_TO_RESOURCE_ID(entry->handle) ==
           VMCI_HANDLE_TO_RESOURCE_ID(handle)) {
@@ -535,7 +552,7 @@ VMCIHashTableEntryExistsLocked(VMCIHashTable *table,   // IN
  *  HashTableUnlinkEntry --
  *     XXX Factor out the hashtable code to shared amongst API and perhaps
  *     host and guest.
- *     Assumes caller holds table lock.
+ *     Assumes caller holds the bucket lock.
  *
  *  Result:
  *     None.
@@ -544,17 +561,14 @@ VMCIHashTableEntryExistsLocked(VMCIHashTable *table,   // IN
  */
 
 static int
-HashTableUnlinkEntry(VMCIHashTable *table, // IN
-                     VMCIHashEntry *entry) // IN
+HashTableUnlinkEntry(VMCIHashBucket *bucket, // IN
+                     VMCIHashEntry *entry)   // IN
 {
    int result;
    VMCIHashEntry *prev, *cur;
-   int idx;
-
-   idx = VMCI_HASHTABLE_HASH(entry->handle, table->size);
 
    prev = NULL;
-   cur = table->entries[idx];
+   cur = bucket->head;
    while (TRUE) {
       if (cur == NULL) {
          result = VMCI_ERROR_NOT_FOUND;
@@ -567,7 +581,7 @@ HashTableUnlinkEntry(VMCIHashTable *table, // IN
          if (prev) {
             prev->next = cur->next;
          } else {
-            table->entries[idx] = cur->next;
+            bucket->head = cur->next;
          }
          cur->next = NULL;
          result = VMCI_SUCCESS;
@@ -586,7 +600,8 @@ HashTableUnlinkEntry(VMCIHashTable *table, // IN
  * VMCIHashTable_Sync --
  *
  *      Use this as a synchronization point when setting globals, for example,
- *      during device shutdown.
+ *      during device shutdown. Every bucket lock is taken and dropped in turn,
+ *      so any update that started before the call has finished after it.
  *
  * Results:
  *      None.
@@ -600,8 +615,11 @@ HashTableUnlinkEntry(VMCIHashTable *table, // IN
 void
 VMCIHashTable_Sync(VMCIHashTable *table)
 {
+   int i;
    VMCILockFlags flags;
    ASSERT(table);
-   VMCI_GrabLock_BH(&table->lock, &flags);
-   VMCI_ReleaseLock_BH(&table->lock, flags);
+   for (i = 0; i < table->size; i++) {
+      VMCI_GrabLock_BH(&table->buckets[i].lock, &flags);
+      VMCI_ReleaseLock_BH(&table->buckets[i].lock, flags);
+   }
 }
@@ -40,10 +40,19 @@ typedef struct VMCIHashEntry {
    struct VMCIHashEntry *next;
 } VMCIHashEntry;
 
+/*
+ * Each bucket has its own lock, so that lookups of resources in different
+ * buckets (e.g., datagram delivery and doorbell dispatch on different CPUs)
+ * don't serialize on a single table lock.
+ */
+typedef struct VMCIHashBucket {
+   VMCIHashEntry *head;
+   VMCILock       lock;
+} VMCIHashBucket;
+
 typedef struct VMCIHashTable {
-   VMCIHashEntry **entries;
+   VMCIHashBucket *buckets;
    int             size; // Number of buckets in above array.
-   VMCILock        lock;
 } VMCIHashTable;
 
 VMCIHashTable *VMCIHashTable_Create(int size);
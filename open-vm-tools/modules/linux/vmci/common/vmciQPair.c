@@ -924,6 +924,9 @@ vmci_qpair_consume_buf_ready(const VMCIQPair *qpair) // IN
  *
  *      Assumes the queue->mutex has been acquired.
  *
+ *      If readyBefore isn't NULL, it is set to the number of bytes that were
+ *      ready to be dequeued before this call, when anything was enqueued.
+ *
  * Results:
  *      VMCI_ERROR_QUEUEPAIR_NOSPACE if no space was available to enqueue data.
  *      VMCI_ERROR_INVALID_SIZE, if any queue pointer is outside the queue
@@ -947,7 +950,8 @@ EnqueueLocked(VMCIQueue *produceQ,                   // IN
               size_t bufSize,                        // IN
               int bufType,                           // IN
               VMCIMemcpyToQueueFunc memcpyToQueue,   // IN
-              Bool canBlock)                         // IN
+              Bool canBlock,                         // IN
+              int64 *readyBefore)                    // OUT: optional
 {
    int64 freeSpace;
    uint64 tail;
@@ -976,6 +980,12 @@ EnqueueLocked(VMCIQueue *produceQ,                   // IN
       return (ssize_t)freeSpace;
    }
 
+   if (readyBefore != NULL) {
+      *readyBefore = VMCIQueueHeader_BufReady(produceQ->qHeader,
+                                              consumeQ->qHeader,
+                                              produceQSize);
+   }
+
    written = (size_t)(freeSpace > bufSize ? bufSize : freeSpace);
    tail = VMCIQueueHeader_ProducerTail(produceQ->qHeader);
    if (LIKELY(tail + written < produceQSize)) {
@@ -1129,7 +1139,70 @@ vmci_qpair_enqueue(VMCIQPair *qpair,        // IN
                              qpair->flags & VMCI_QPFLAG_LOCAL?
                              VMCIMemcpyToQueueLocal:
                              VMCIMemcpyToQueue,
-                             !(qpair->flags & VMCI_QPFLAG_NONBLOCK));
+                             !(qpair->flags & VMCI_QPFLAG_NONBLOCK), NULL);
+      if (result == VMCI_ERROR_QUEUEPAIR_NOT_READY) {
+         if (!VMCIQPairWaitForReadyQueue(qpair)) {
+            result = VMCI_ERROR_WOULD_BLOCK;
+         }
+      }
+   } while (result == VMCI_ERROR_QUEUEPAIR_NOT_READY);
+
+   VMCIQPairUnlock(qpair);
+
+   return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * vmci_qpair_enqueue_ready --
+ *
+ *      Same as vmci_qpair_enqueue(), but also reports in *readyBefore how
+ *      many bytes were ready to be dequeued just before the data went in.
+ *      This is the flat buffer counterpart of vmci_qpair_enquev_ready(),
+ *      for producers that enqueue from kernel memory such as mapped pages.
+ *
+ * Results:
+ *      Err, if < 0.
+ *      Number of bytes enqueued if >= 0. *readyBefore is only set when
+ *      bytes were enqueued.
+ *
+ * Side effects:
+ *      Windows blocking call.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+VMCI_EXPORT_SYMBOL(vmci_qpair_enqueue_ready)
+ssize_t
+vmci_qpair_enqueue_ready(VMCIQPair *qpair,        // IN
+                         const void *buf,         // IN
+                         size_t bufSize,          // IN
+                         int bufType,             // IN
+                         int64 *readyBefore)      // OUT
+{
+   ssize_t result;
+
+   if (!qpair || !buf || !readyBefore) {
+      return VMCI_ERROR_INVALID_ARGS;
+   }
+
+   result = VMCIQPairLock(qpair);
+   if (result != VMCI_SUCCESS) {
+      return result;
+   }
+
+   do {
+      result = EnqueueLocked(qpair->produceQ,
+                             qpair->consumeQ,
+                             qpair->produceQSize,
+                             buf, bufSize, bufType,
+                             qpair->flags & VMCI_QPFLAG_LOCAL?
+                             VMCIMemcpyToQueueLocal:
+                             VMCIMemcpyToQueue,
+                             !(qpair->flags & VMCI_QPFLAG_NONBLOCK),
+                             readyBefore);
       if (result == VMCI_ERROR_QUEUEPAIR_NOT_READY) {
          if (!VMCIQPairWaitForReadyQueue(qpair)) {
             result = VMCI_ERROR_WOULD_BLOCK;
@@ -1305,7 +1378,73 @@ vmci_qpair_enquev(VMCIQPair *qpair,        // IN
                              qpair->flags & VMCI_QPFLAG_LOCAL?
                              VMCIMemcpyToQueueVLocal:
                              VMCIMemcpyToQueueV,
-                             !(qpair->flags & VMCI_QPFLAG_NONBLOCK));
+                             !(qpair->flags & VMCI_QPFLAG_NONBLOCK), NULL);
+      if (result == VMCI_ERROR_QUEUEPAIR_NOT_READY) {
+         if (!VMCIQPairWaitForReadyQueue(qpair)) {
+            result = VMCI_ERROR_WOULD_BLOCK;
+         }
+      }
+   } while (result == VMCI_ERROR_QUEUEPAIR_NOT_READY);
+
+   VMCIQPairUnlock(qpair);
+
+   return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * vmci_qpair_enquev_ready --
+ *
+ *      Same as vmci_qpair_enquev(), but also reports in *readyBefore how
+ *      many bytes were ready to be dequeued just before the data went in,
+ *      as seen under the same lock and header mapping. A producer that
+ *      signals its peer only when the queue goes from empty to non-empty
+ *      can use it instead of a vmci_qpair_produce_buf_ready() call after
+ *      each enqueue: when *readyBefore isn't 0 the peer hasn't caught up
+ *      with the earlier data yet, so it is awake or already signaled.
+ *
+ * Results:
+ *      Err, if < 0.
+ *      Number of bytes enqueued if >= 0. *readyBefore is only set when
+ *      bytes were enqueued.
+ *
+ * Side effects:
+ *      Windows blocking call.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+VMCI_EXPORT_SYMBOL(vmci_qpair_enquev_ready)
+ssize_t
+vmci_qpair_enquev_ready(VMCIQPair *qpair,        // IN
+                        void *iov,               // IN
+                        size_t iovSize,          // IN
+                        int bufType,             // IN
+                        int64 *readyBefore)      // OUT
+{
+   ssize_t result;
+
+   if (!qpair || !iov || !readyBefore) {
+      return VMCI_ERROR_INVALID_ARGS;
+   }
+
+   result = VMCIQPairLock(qpair);
+   if (result != VMCI_SUCCESS) {
+      return result;
+   }
+
+   do {
+      result = EnqueueLocked(qpair->produceQ,
+                             qpair->consumeQ,
+                             qpair->produceQSize,
+                             iov, iovSize, bufType,
+                             qpair->flags & VMCI_QPFLAG_LOCAL?
+                             VMCIMemcpyToQueueVLocal:
+                             VMCIMemcpyToQueueV,
+                             !(qpair->flags & VMCI_QPFLAG_NONBLOCK),
+                             readyBefore);
       if (result == VMCI_ERROR_QUEUEPAIR_NOT_READY) {
          if (!VMCIQPairWaitForReadyQueue(qpair)) {
             result = VMCI_ERROR_WOULD_BLOCK;
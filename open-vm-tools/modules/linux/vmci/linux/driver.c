@@ -2314,8 +2314,16 @@ process_bitmap(unsigned long data)
       return;
    }
 
+   /*
+    * Under a notification storm the scan stops after a fixed budget so
+    * that one tasklet run can't monopolize the CPU; requeue ourselves to
+    * handle the remainder, NAPI style, instead of waiting for another
+    * interrupt.
+    */
 
-   VMCI_ScanNotificationBitmap(notification_bitmap);
+   if (VMCI_ScanNotificationBitmap(notification_bitmap)) {
+      tasklet_schedule(&vmci_bm_tasklet);
+   }
 }
 
 
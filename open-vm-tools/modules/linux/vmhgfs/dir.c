@@ -37,6 +37,7 @@
 #include "hgfsProto.h"
 #include "hgfsUtil.h"
 #include "module.h"
+#include "notify.h"
 #include "request.h"
 #include "fsutil.h"
 #include "vm_assert.h"
@@ -804,6 +805,9 @@ HgfsDirOpen(struct inode *inode,  // IN: Inode of the dir to open
    if (!result) {
       result = HgfsCreateFileInfo(file, handle);
    }
+   if (!result) {
+      HgfsNotifyWatchDir(file->f_dentry);
+   }
 
    return result;
 }
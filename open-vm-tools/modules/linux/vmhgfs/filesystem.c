@@ -49,6 +49,7 @@
 #include "hgfsProto.h"
 #include "hgfsUtil.h"
 #include "module.h"
+#include "notify.h"
 #include "request.h"
 #include "fsutil.h"
 #include "vm_assert.h"
@@ -898,6 +899,7 @@ HgfsInitFileSystem(void)
    }
 
    /* Initialize the transport. */
+   HgfsNotifyInit();
    HgfsTransportInit();
 
    /*
@@ -947,6 +949,7 @@ HgfsCleanupFileSystem(void)
 
    /* Transport cleanup. */
    HgfsTransportExit();
+   HgfsNotifyExit();
 
    /* Destroy the inode and request slabs. */
    kmem_cache_destroy(hgfsInodeCache);
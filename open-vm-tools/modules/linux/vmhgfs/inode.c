@@ -48,6 +48,7 @@
 #include "hgfsUtil.h"
 #include "inode.h"
 #include "module.h"
+#include "notify.h"
 #include "request.h"
 #include "fsutil.h"
 #include "vm_assert.h"
@@ -2230,9 +2231,11 @@ out:
  *    valid. Called with the dentry that points to the inode we're
  *    interested in.
  *
- *    We call HgfsPrivateGetattr with the inode's remote name, and if
- *    it succeeds we update the inode's attributes and return zero
- *    (success). Otherwise, we return an error.
+ *    Cached attributes are used while the dentry is younger than the
+ *    TTL, or while a host change watch on its parent says nothing has
+ *    changed. Otherwise we call HgfsPrivateGetattr with the inode's
+ *    remote name, and if it succeeds we update the inode's attributes
+ *    and return zero (success). Otherwise, we return an error.
  *
  * Results:
  *    Returns zero if inode is valid, negative error if not.
@@ -2265,7 +2268,12 @@ HgfsRevalidate(struct dentry *dentry)  // IN: Dentry to revalidate
    age = jiffies - dentry->d_time;
    iinfo = INODE_GET_II_P(dentry->d_inode);
 
-   if (age > si->ttl || iinfo->hostFileId == 0) {
+   /*
+    * Past the TTL, a dentry is still trusted while its parent's host watch
+    * vouches for it, see notify.c.
+    */
+   if ((age > si->ttl && !HgfsNotifyDentryIsCurrent(dentry)) ||
+       iinfo->hostFileId == 0) {
       HgfsAttrInfo attr;
       LOG(6, (KERN_DEBUG "VMware hgfs: HgfsRevalidate: dentry is too old, "
               "getting new attributes\n"));
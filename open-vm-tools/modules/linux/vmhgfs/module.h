@@ -178,6 +178,15 @@ typedef struct HgfsInodeInfo {
 
    /* List of open files for this inode. */
    struct list_head files;
+
+   /*
+    * Host change watch on this directory, if any. Protected by the notify
+    * lock, see notify.c.
+    */
+   struct list_head watchLinks;
+   HgfsSubscriberHandle watchId;
+   uint32 watchGeneration;
+   unsigned long watchStart;
 } HgfsInodeInfo;
 
 /*
@@ -0,0 +1,924 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ *********************************************************/
+
+/*
+ * notify.c --
+ *
+ * Directory change notifications for the vmhgfs driver.
+ *
+ * Dentries and attributes are normally trusted for the mount's TTL only,
+ * after which every lookup and stat goes back to the host. When the host
+ * can tell us about changes, we place a watch on each directory the guest
+ * opens and, as long as that watch is intact, keep trusting the dentries
+ * of its children past the TTL. Each event simply ages out the affected
+ * dentry (and its parent) so that the next revalidation fetches fresh
+ * attributes from the host.
+ *
+ * Watches require a V4 session on a channel that can deliver server
+ * initiated packets (VMCI). Whenever the host cannot provide them, or a
+ * watch overflows or goes away, we fall back to plain TTL behavior.
+ */
+
+/* Must come before any kernel header file. */
+#include "driver-config.h"
+
+#include <linux/errno.h>
+#include <linux/list.h>
+#include "compat_fs.h"
+#include "compat_kernel.h"
+#include "compat_mutex.h"
+#include "compat_slab.h"
+#include "compat_spinlock.h"
+#include "compat_workqueue.h"
+
+#include "cpName.h"
+#include "hgfsEscape.h"
+#include "hgfsProto.h"
+#include "module.h"
+#include "request.h"
+#include "fsutil.h"
+#include "notify.h"
+#include "vm_assert.h"
+#include "vm_basic_types.h"
+
+#define HGFS_REQ_PAYLOAD_V4(hgfsReq) \
+   ((char *)HGFS_REQ_PAYLOAD(hgfsReq) + sizeof(HgfsHeader))
+
+/* Watches are looked up by id for every notification the host sends. */
+#define HGFS_NOTIFY_BUCKETS       64
+#define HGFS_NOTIFY_BUCKET(id)    \
+   (&hgfsNotifyWatches[(id) & (HGFS_NOTIFY_BUCKETS - 1)])
+
+/* Bound on host resources we are willing to hold on to. */
+#define HGFS_NOTIFY_MAX_WATCHES   1024
+
+/* Anything that can make a cached child dentry or its attributes stale. */
+#define HGFS_NOTIFY_EVENTS       (HGFS_NOTIFY_ATTRIB |                 \
+                                  HGFS_NOTIFY_SIZE |                   \
+                                  HGFS_NOTIFY_MTIME |                  \
+                                  HGFS_NOTIFY_CTIME |                  \
+                                  HGFS_NOTIFY_NAME |                   \
+                                  HGFS_NOTIFY_CREATE_FILE |            \
+                                  HGFS_NOTIFY_CREATE_DIR |             \
+                                  HGFS_NOTIFY_DELETE_FILE |            \
+                                  HGFS_NOTIFY_DELETE_DIR |             \
+                                  HGFS_NOTIFY_DELETE_SELF |            \
+                                  HGFS_NOTIFY_MODIFY |                 \
+                                  HGFS_NOTIFY_MOVE_SELF |              \
+                                  HGFS_NOTIFY_OLD_FILE_NAME |          \
+                                  HGFS_NOTIFY_NEW_FILE_NAME |          \
+                                  HGFS_NOTIFY_OLD_DIR_NAME |           \
+                                  HGFS_NOTIFY_NEW_DIR_NAME |           \
+                                  HGFS_NOTIFY_CHANGE_SECURITY)
+
+/* Events after which the watch no longer describes the directory. */
+#define HGFS_NOTIFY_EVENTS_GONE  (HGFS_NOTIFY_DELETE_SELF |            \
+                                  HGFS_NOTIFY_MOVE_SELF |              \
+                                  HGFS_NOTIFY_WATCH_DELETED |          \
+                                  HGFS_NOTIFY_EVENTS_DROPPED)
+
+typedef enum {
+   HGFS_NOTIFY_SESSION_NONE,         /* Not tried on this channel yet. */
+   HGFS_NOTIFY_SESSION_READY,        /* Session created, watches supported. */
+   HGFS_NOTIFY_SESSION_UNSUPPORTED,  /* Host can't notify us here. */
+} HgfsNotifySessionState;
+
+/* Deferred processing of a notification or of a watch removal. */
+typedef struct HgfsNotifyWork {
+   compat_work work;
+   HgfsSubscriberHandle watchId;  /* Watch to remove from the host. */
+   uint32 generation;             /* Session the watch belongs to. */
+   size_t packetSize;
+   char packet[0];                /* Notification packet, if any. */
+} HgfsNotifyWork;
+
+/* Serializes session creation and the watch requests sent on it. */
+static compat_define_mutex(hgfsNotifyMutex);
+
+/*
+ * Protects the watch table, the session state and the generation. The
+ * generation is bumped whenever the channel (and with it the host side
+ * session and all its watches) goes away.
+ */
+static spinlock_t hgfsNotifyLock;
+static HgfsNotifySessionState hgfsNotifyState;
+static uint64 hgfsNotifySessionId;
+static uint32 hgfsNotifyGeneration;
+static unsigned int hgfsNotifyWatchCount;
+static struct list_head hgfsNotifyWatches[HGFS_NOTIFY_BUCKETS];
+
+static void HgfsNotifyRemoveWork(compat_work_arg data);
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifySendV4 --
+ *
+ *    Fill in a V4 header for a request whose body has already been
+ *    packed and send it. On success, returns the reply body.
+ *
+ * Results:
+ *    Zero on success, negative error otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsNotifySendV4(HgfsReq *req,         // IN/OUT: Request to send
+                 HgfsOp op,            // IN: Operation
+                 uint64 sessionId,     // IN: Session to send on
+                 size_t requestSize,   // IN: Size of the request body
+                 size_t replySize,     // IN: Minimum reply body size
+                 char **reply)         // OUT: Reply body
+{
+   HgfsHeader *header = (HgfsHeader *)HGFS_REQ_PAYLOAD(req);
+   int result;
+
+   memset(header, 0, sizeof *header);
+   header->version = HGFS_HEADER_VERSION;
+   header->dummy = HGFS_OP_NEW_HEADER;
+   header->packetSize = sizeof *header + requestSize;
+   header->headerSize = sizeof *header;
+   header->requestId = req->id;
+   header->op = op;
+   header->flags = HGFS_PACKET_FLAG_REQUEST;
+   header->sessionId = sessionId;
+   req->payloadSize = header->packetSize;
+
+   result = HgfsSendRequest(req);
+   if (result != 0) {
+      LOG(4, (KERN_DEBUG "VMware hgfs: %s: op %d not sent: %d\n",
+              __func__, op, result));
+      return result;
+   }
+
+   if (req->payloadSize < sizeof *header ||
+       header->headerSize < sizeof *header ||
+       header->headerSize > req->payloadSize) {
+      LOG(4, (KERN_DEBUG "VMware hgfs: %s: malformed reply\n", __func__));
+      return -EPROTO;
+   }
+
+   result = HgfsStatusConvertToLinux(header->status);
+   if (result == 0 && req->payloadSize - header->headerSize < replySize) {
+      LOG(4, (KERN_DEBUG "VMware hgfs: %s: reply too short\n", __func__));
+      result = -EPROTO;
+   }
+
+   *reply = (char *)header + header->headerSize;
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyCreateSession --
+ *
+ *    Create the V4 session watches are placed on and find out whether
+ *    the host supports them. Called with hgfsNotifyMutex held.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Moves the session state out of HGFS_NOTIFY_SESSION_NONE.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyCreateSession(void)
+{
+   HgfsRequestCreateSessionV4 *request;
+   HgfsReplyCreateSessionV4 *reply;
+   HgfsNotifySessionState state = HGFS_NOTIFY_SESSION_UNSUPPORTED;
+   uint32 generation;
+   HgfsReq *req;
+   size_t capsSize;
+   uint32 i;
+
+   spin_lock(&hgfsNotifyLock);
+   generation = hgfsNotifyGeneration;
+   spin_unlock(&hgfsNotifyLock);
+
+   req = HgfsGetNewRequest();
+   if (!req) {
+      /* Transient, try again on the next opendir. */
+      return;
+   }
+
+   request = (HgfsRequestCreateSessionV4 *)HGFS_REQ_PAYLOAD_V4(req);
+   memset(request, 0, sizeof *request);
+   request->maxPacketSize = HGFS_PACKET_MAX;
+   request->flags = HGFS_SESSION_MAXPACKETSIZE_VALID |
+                    HGFS_SESSION_CHANGENOTIFY_ENABLED;
+
+   if (HgfsNotifySendV4(req, HGFS_OP_CREATE_SESSION_V4,
+                        HGFS_INVALID_SESSION_ID, sizeof *request,
+                        offsetof(HgfsReplyCreateSessionV4, capabilities),
+                        (char **)&reply) == 0) {
+      capsSize = req->payloadSize - sizeof(HgfsHeader) -
+                 offsetof(HgfsReplyCreateSessionV4, capabilities);
+      for (i = 0;
+           i < reply->numCapabilities &&
+           (i + 1) * sizeof reply->capabilities[0] <= capsSize;
+           i++) {
+         if (reply->capabilities[i].op == HGFS_OP_SET_WATCH_V4 &&
+             reply->capabilities[i].flags != HGFS_REQUEST_NOT_SUPPORTED) {
+            state = HGFS_NOTIFY_SESSION_READY;
+            break;
+         }
+      }
+
+      spin_lock(&hgfsNotifyLock);
+      if (generation == hgfsNotifyGeneration) {
+         hgfsNotifySessionId = reply->sessionId;
+         hgfsNotifyState = state;
+      }
+      spin_unlock(&hgfsNotifyLock);
+   } else {
+      spin_lock(&hgfsNotifyLock);
+      if (generation == hgfsNotifyGeneration) {
+         hgfsNotifyState = HGFS_NOTIFY_SESSION_UNSUPPORTED;
+      }
+      spin_unlock(&hgfsNotifyLock);
+   }
+
+   LOG(6, (KERN_DEBUG "VMware hgfs: %s: change notification %s\n",
+           __func__,
+           state == HGFS_NOTIFY_SESSION_READY ? "enabled" : "unavailable"));
+   HgfsFreeRequest(req);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyQueueRemove --
+ *
+ *    Queue removal of a watch from the host. Watches belonging to an
+ *    older session died with it and are not worth a round trip.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyQueueRemove(HgfsSubscriberHandle watchId,  // IN: Watch to remove
+                      uint32 generation)             // IN: Its session
+{
+   HgfsNotifyWork *work;
+
+   work = kmalloc(sizeof *work, GFP_KERNEL);
+   if (!work) {
+      LOG(4, (KERN_DEBUG "VMware hgfs: %s: watch %"FMT64"u leaked\n",
+              __func__, watchId));
+      return;
+   }
+
+   work->watchId = watchId;
+   work->generation = generation;
+   work->packetSize = 0;
+   COMPAT_INIT_WORK(&work->work, HgfsNotifyRemoveWork, work);
+   compat_schedule_work(&work->work);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyRemoveWork --
+ *
+ *    Work item removing a watch from the host.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Frees the work item.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyRemoveWork(compat_work_arg data)  // IN: Work item
+{
+   HgfsNotifyWork *work = COMPAT_WORK_GET_DATA(data, HgfsNotifyWork, work);
+   HgfsRequestRemoveWatchV4 *request;
+   uint64 sessionId;
+   Bool current;
+   HgfsReq *req;
+   char *reply;
+
+   compat_mutex_lock(&hgfsNotifyMutex);
+   spin_lock(&hgfsNotifyLock);
+   current = work->generation == hgfsNotifyGeneration &&
+             hgfsNotifyState == HGFS_NOTIFY_SESSION_READY;
+   sessionId = hgfsNotifySessionId;
+   spin_unlock(&hgfsNotifyLock);
+
+   if (current) {
+      req = HgfsGetNewRequest();
+      if (req) {
+         request = (HgfsRequestRemoveWatchV4 *)HGFS_REQ_PAYLOAD_V4(req);
+         request->watchId = work->watchId;
+         HgfsNotifySendV4(req, HGFS_OP_REMOVE_WATCH_V4, sessionId,
+                          sizeof *request, 0, &reply);
+         HgfsFreeRequest(req);
+      }
+   }
+   compat_mutex_unlock(&hgfsNotifyMutex);
+   kfree(work);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyUnlinkWatch --
+ *
+ *    Take an inode off the watch table. Called with hgfsNotifyLock held.
+ *
+ * Results:
+ *    TRUE if the inode had a watch in the current session.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNotifyUnlinkWatch(HgfsInodeInfo *iinfo)  // IN: Watched inode
+{
+   if (list_empty(&iinfo->watchLinks)) {
+      return FALSE;
+   }
+
+   list_del_init(&iinfo->watchLinks);
+   hgfsNotifyWatchCount--;
+   return iinfo->watchGeneration == hgfsNotifyGeneration;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyGrabInode --
+ *
+ *    Find the inode a watch was placed on.
+ *
+ * Results:
+ *    Referenced inode, or NULL if the watch is unknown.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static struct inode *
+HgfsNotifyGrabInode(HgfsSubscriberHandle watchId)  // IN: Watch
+{
+   struct list_head *bucket = HGFS_NOTIFY_BUCKET(watchId);
+   struct inode *inode = NULL;
+   HgfsInodeInfo *iinfo;
+
+   spin_lock(&hgfsNotifyLock);
+   list_for_each_entry(iinfo, bucket, watchLinks) {
+      if (iinfo->watchId == watchId &&
+          iinfo->watchGeneration == hgfsNotifyGeneration) {
+         /* May fail if the inode is already being freed. */
+         inode = igrab(&iinfo->inode);
+         break;
+      }
+   }
+   spin_unlock(&hgfsNotifyLock);
+
+   return inode;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyAgeChild --
+ *
+ *    Age out the child dentry an event refers to. The event carries the
+ *    full cross-platform name; its last component is the child's name
+ *    as the host sees it and must be escaped like readdir does.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyAgeChild(struct dentry *dir,         // IN: Watched directory
+                   const HgfsFileName *name,   // IN: Event file name
+                   size_t nameSize)            // IN: Room for the name
+{
+   char entryName[NAME_MAX + 1];
+   const char *last;
+   struct dentry *child;
+   struct qstr qname;
+   uint32 len;
+   int result;
+
+   len = name->length;
+   if (len == 0 || len > nameSize) {
+      return;
+   }
+
+   for (last = name->name + len; last > name->name && last[-1] != '\0'; last--) {
+      /* Find the start of the last component. */
+   }
+   len -= last - name->name;
+   if (len == 0) {
+      return;
+   }
+
+   result = HgfsEscape_Do(last, len, sizeof entryName, entryName);
+   if (result <= 0) {
+      return;
+   }
+
+   qname.name = entryName;
+   qname.len = result;
+   child = d_hash_and_lookup(dir, &qname);
+   if (child && !IS_ERR(child)) {
+      HgfsDentryAgeForce(child);
+      dput(child);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyProcessWork --
+ *
+ *    Work item processing a notification packet from the host.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Ages out the dentries the notification refers to. Frees the work
+ *    item.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyProcessWork(compat_work_arg data)  // IN: Work item
+{
+   HgfsNotifyWork *work = COMPAT_WORK_GET_DATA(data, HgfsNotifyWork, work);
+   HgfsHeader *header = (HgfsHeader *)work->packet;
+   HgfsRequestNotifyV4 *notify;
+   HgfsNotifyEventV4 *event;
+   struct inode *inode;
+   struct dentry *dir;
+   size_t size;
+   size_t offset;
+   uint32 generation;
+   Bool remove;
+   Bool drop;
+   uint32 i;
+
+   if (work->packetSize < sizeof *header ||
+       header->dummy != HGFS_OP_NEW_HEADER ||
+       header->op != HGFS_OP_NOTIFY_V4 ||
+       header->headerSize < sizeof *header ||
+       header->packetSize > work->packetSize ||
+       header->headerSize > header->packetSize) {
+      LOG(4, (KERN_DEBUG "VMware hgfs: %s: unexpected packet\n", __func__));
+      goto out;
+   }
+
+   size = header->packetSize - header->headerSize;
+   if (size < offsetof(HgfsRequestNotifyV4, events)) {
+      goto out;
+   }
+
+   notify = (HgfsRequestNotifyV4 *)(work->packet + header->headerSize);
+   inode = HgfsNotifyGrabInode(notify->watchId);
+   if (!inode) {
+      goto out;
+   }
+
+   drop = (notify->flags & (HGFS_NOTIFY_FLAG_OVERFLOW |
+                            HGFS_NOTIFY_FLAG_REMOVED)) != 0;
+   dir = d_find_alias(inode);
+   offset = offsetof(HgfsRequestNotifyV4, events);
+   for (i = 0; !drop && i < notify->count; i++) {
+      if (offset + offsetof(HgfsNotifyEventV4, fileName.name) > size) {
+         break;
+      }
+
+      event = (HgfsNotifyEventV4 *)((char *)notify + offset);
+      if (event->mask & HGFS_NOTIFY_EVENTS_GONE) {
+         drop = TRUE;
+      } else if (dir) {
+         HgfsNotifyAgeChild(dir, &event->fileName,
+                            size - offset -
+                            offsetof(HgfsNotifyEventV4, fileName.name));
+      }
+
+      if (event->nextOffset == 0) {
+         break;
+      }
+      offset += event->nextOffset;
+   }
+
+   if (drop) {
+      /*
+       * We may have missed changes, or will not hear about new ones: the
+       * children are back to being trusted for the TTL only.
+       */
+      spin_lock(&hgfsNotifyLock);
+      remove = HgfsNotifyUnlinkWatch(INODE_GET_II_P(inode)) &&
+               !(notify->flags & HGFS_NOTIFY_FLAG_REMOVED);
+      generation = hgfsNotifyGeneration;
+      spin_unlock(&hgfsNotifyLock);
+
+      if (remove) {
+         HgfsNotifyQueueRemove(notify->watchId, generation);
+      }
+   }
+
+   if (dir) {
+      /* Any change to the children changes the directory itself. */
+      HgfsDentryAgeForce(dir);
+      dput(dir);
+   }
+   iput(inode);
+
+out:
+   kfree(work);
+}
+
+
+/*
+ * Public functions (with respect to the entire module).
+ */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyReceive --
+ *
+ *    Called by the channel for every notification packet the host sends.
+ *    May be called in atomic context, so the packet is copied and handled
+ *    from a work item.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsNotifyReceive(const void *packet,  // IN: Notification packet
+                  size_t packetSize)   // IN: Its size
+{
+   HgfsNotifyWork *work;
+
+   work = kmalloc(sizeof *work + packetSize, GFP_ATOMIC);
+   if (!work) {
+      LOG(4, (KERN_DEBUG "VMware hgfs: %s: notification dropped\n",
+              __func__));
+      return;
+   }
+
+   work->packetSize = packetSize;
+   memcpy(work->packet, packet, packetSize);
+   COMPAT_INIT_WORK(&work->work, HgfsNotifyProcessWork, work);
+   compat_schedule_work(&work->work);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyWatchDir --
+ *
+ *    Ask the host to tell us about changes to a directory the guest has
+ *    just opened. Called from opendir; failures are silent since the
+ *    directory simply keeps TTL based revalidation.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    May create the notification session on first use.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsNotifyWatchDir(struct dentry *dentry)  // IN: Directory opened
+{
+   HgfsRequestSetWatchV4 *request;
+   HgfsReplySetWatchV4 *reply;
+   HgfsInodeInfo *iinfo;
+   HgfsNotifySessionState state;
+   unsigned long start;
+   uint64 sessionId;
+   uint32 generation;
+   HgfsReq *req;
+   size_t nameSize;
+   Bool skip;
+   int result;
+
+   ASSERT(dentry);
+   ASSERT(dentry->d_inode);
+
+   iinfo = INODE_GET_II_P(dentry->d_inode);
+
+   spin_lock(&hgfsNotifyLock);
+   skip = hgfsNotifyState == HGFS_NOTIFY_SESSION_UNSUPPORTED ||
+          !list_empty(&iinfo->watchLinks) ||
+          hgfsNotifyWatchCount >= HGFS_NOTIFY_MAX_WATCHES;
+   spin_unlock(&hgfsNotifyLock);
+   if (skip) {
+      return;
+   }
+
+   compat_mutex_lock(&hgfsNotifyMutex);
+
+   spin_lock(&hgfsNotifyLock);
+   state = hgfsNotifyState;
+   spin_unlock(&hgfsNotifyLock);
+   if (state == HGFS_NOTIFY_SESSION_NONE) {
+      HgfsNotifyCreateSession();
+   }
+
+   spin_lock(&hgfsNotifyLock);
+   state = hgfsNotifyState;
+   sessionId = hgfsNotifySessionId;
+   generation = hgfsNotifyGeneration;
+   skip = state != HGFS_NOTIFY_SESSION_READY ||
+          !list_empty(&iinfo->watchLinks);
+   spin_unlock(&hgfsNotifyLock);
+   if (skip) {
+      goto out;
+   }
+
+   req = HgfsGetNewRequest();
+   if (!req) {
+      goto out;
+   }
+
+   request = (HgfsRequestSetWatchV4 *)HGFS_REQ_PAYLOAD_V4(req);
+   request->events = HGFS_NOTIFY_EVENTS;
+   request->flags = HGFS_NOTIFY_FLAG_POSIX_HINT;
+   request->reserved = 0;
+   request->fileName.flags = 0;
+   request->fileName.caseType = HGFS_FILE_NAME_CASE_SENSITIVE;
+   request->fileName.fid = HGFS_INVALID_HANDLE;
+
+   nameSize = req->bufferSize - sizeof(HgfsHeader) - sizeof *request;
+   result = HgfsBuildPath(request->fileName.name, nameSize, dentry);
+   if (result < 0) {
+      goto out_free;
+   }
+   result = CPName_ConvertTo(request->fileName.name, nameSize,
+                             request->fileName.name);
+   if (result < 0) {
+      goto out_free;
+   }
+   request->fileName.length = result;
+
+   /* Changes made while the watch is being set up must not be lost. */
+   start = jiffies;
+   if (HgfsNotifySendV4(req, HGFS_OP_SET_WATCH_V4, sessionId,
+                        sizeof *request + result, sizeof *reply,
+                        (char **)&reply) != 0) {
+      goto out_free;
+   }
+
+   spin_lock(&hgfsNotifyLock);
+   if (generation == hgfsNotifyGeneration &&
+       list_empty(&iinfo->watchLinks)) {
+      iinfo->watchId = reply->watchId;
+      iinfo->watchGeneration = generation;
+      iinfo->watchStart = start;
+      list_add(&iinfo->watchLinks, HGFS_NOTIFY_BUCKET(reply->watchId));
+      hgfsNotifyWatchCount++;
+      LOG(6, (KERN_DEBUG "VMware hgfs: %s: watch %"FMT64"u on \"%s\"\n",
+              __func__, reply->watchId, dentry->d_name.name));
+   }
+   spin_unlock(&hgfsNotifyLock);
+
+out_free:
+   HgfsFreeRequest(req);
+out:
+   compat_mutex_unlock(&hgfsNotifyMutex);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyDentryIsCurrent --
+ *
+ *    Check whether a dentry's cached state is known to be current even
+ *    though its TTL may have run out: its parent is watched, and the
+ *    dentry was last validated after the watch was placed and has not
+ *    been aged out by a notification since.
+ *
+ * Results:
+ *    TRUE if the dentry need not be revalidated with the host.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+Bool
+HgfsNotifyDentryIsCurrent(struct dentry *dentry)  // IN: Dentry to check
+{
+   struct dentry *parent;
+   HgfsInodeInfo *iinfo;
+   Bool current = FALSE;
+
+   if (dentry->d_time == 0) {
+      return FALSE;
+   }
+
+   parent = dget_parent(dentry);
+   if (parent != dentry && parent->d_inode) {
+      iinfo = INODE_GET_II_P(parent->d_inode);
+      spin_lock(&hgfsNotifyLock);
+      current = !list_empty(&iinfo->watchLinks) &&
+                iinfo->watchGeneration == hgfsNotifyGeneration &&
+                time_after_eq(dentry->d_time, iinfo->watchStart);
+      spin_unlock(&hgfsNotifyLock);
+   }
+   dput(parent);
+
+   return current;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyInodeDestroy --
+ *
+ *    Drop the watch, if any, on an inode being freed.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Queues removal of the watch from the host.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsNotifyInodeDestroy(struct inode *inode)  // IN: Inode being freed
+{
+   HgfsInodeInfo *iinfo = INODE_GET_II_P(inode);
+   Bool remove;
+
+   spin_lock(&hgfsNotifyLock);
+   remove = HgfsNotifyUnlinkWatch(iinfo);
+   spin_unlock(&hgfsNotifyLock);
+
+   if (remove) {
+      HgfsNotifyQueueRemove(iinfo->watchId, iinfo->watchGeneration);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyReset --
+ *
+ *    Forget the session and all watches. Called when the channel closes,
+ *    which takes the host side session down with it.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Watched directories fall back to TTL based revalidation.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsNotifyReset(void)
+{
+   HgfsInodeInfo *iinfo;
+   HgfsInodeInfo *next;
+   int i;
+
+   spin_lock(&hgfsNotifyLock);
+   for (i = 0; i < HGFS_NOTIFY_BUCKETS; i++) {
+      list_for_each_entry_safe(iinfo, next, &hgfsNotifyWatches[i],
+                               watchLinks) {
+         list_del_init(&iinfo->watchLinks);
+      }
+   }
+   hgfsNotifyWatchCount = 0;
+   hgfsNotifyGeneration++;
+   hgfsNotifyState = HGFS_NOTIFY_SESSION_NONE;
+   hgfsNotifySessionId = HGFS_INVALID_SESSION_ID;
+   spin_unlock(&hgfsNotifyLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyInit --
+ *
+ *    Initialize the notification state.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsNotifyInit(void)
+{
+   int i;
+
+   spin_lock_init(&hgfsNotifyLock);
+   for (i = 0; i < HGFS_NOTIFY_BUCKETS; i++) {
+      INIT_LIST_HEAD(&hgfsNotifyWatches[i]);
+   }
+   hgfsNotifyWatchCount = 0;
+   hgfsNotifyGeneration = 1;
+   hgfsNotifyState = HGFS_NOTIFY_SESSION_NONE;
+   hgfsNotifySessionId = HGFS_INVALID_SESSION_ID;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyExit --
+ *
+ *    Tear down the notification state. The channel must be closed by now
+ *    so that no new notifications are queued.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Waits for pending work items.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsNotifyExit(void)
+{
+   HgfsNotifyReset();
+   flush_scheduled_work();
+}
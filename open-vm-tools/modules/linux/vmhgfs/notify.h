@@ -0,0 +1,44 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ *********************************************************/
+
+/*
+ * notify.h --
+ *
+ * Directory change notifications for the vmhgfs driver.
+ */
+
+#ifndef _HGFS_DRIVER_NOTIFY_H_
+#define _HGFS_DRIVER_NOTIFY_H_
+
+/* Must come before any kernel header file. */
+#include "driver-config.h"
+
+#include "compat_fs.h"
+#include "vm_basic_types.h"
+
+/* Public functions (with respect to the entire module). */
+void HgfsNotifyInit(void);
+void HgfsNotifyExit(void);
+void HgfsNotifyReset(void);
+void HgfsNotifyWatchDir(struct dentry *dentry);
+void HgfsNotifyInodeDestroy(struct inode *inode);
+Bool HgfsNotifyDentryIsCurrent(struct dentry *dentry);
+void HgfsNotifyReceive(const void *packet,
+                       size_t packetSize);
+
+#endif // _HGFS_DRIVER_NOTIFY_H_
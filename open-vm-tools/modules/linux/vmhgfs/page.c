@@ -73,6 +73,35 @@
 #define HGFS_PAGE_FILE_INDEX(page)          ((page)->index)
 #endif
 
+/*
+ * Upper bound on the number of contiguous pages HgfsReadpages hands to a
+ * single HgfsDoReadpages call. Matches the largest read the server can
+ * satisfy with one large packet.
+ */
+#define HGFS_READPAGES_MAX          HGFS_LARGE_IO_MAX_PAGES
+
+/* Same bound for the runs of dirty pages gathered by HgfsWritepages. */
+#define HGFS_WRITEPAGES_MAX         HGFS_LARGE_IO_MAX_PAGES
+
+/*
+ * write_cache_pages() went in with 2.6.22; older kernels keep sending
+ * single pages through HgfsWritepage.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 22)
+#define HGFS_HAVE_WRITEPAGES
+#endif
+
+/* A run of locked, contiguous dirty pages waiting to be written. */
+typedef struct HgfsWritepagesBatch {
+   struct inode *inode;
+   HgfsHandle handle;
+   Bool haveHandle;
+   int result;                                  /* First error seen */
+   unsigned nrPages;
+   unsigned lastLen;                            /* Bytes valid in last page */
+   struct page *pages[HGFS_WRITEPAGES_MAX];
+} HgfsWritepagesBatch;
+
 /* Private functions. */
 static int HgfsDoWrite(HgfsHandle handle,
                        HgfsDataPacket dataPacket[],
@@ -86,10 +115,20 @@ static int HgfsDoReadpage(HgfsHandle handle,
                           struct page *page,
                           unsigned pageFrom,
                           unsigned pageTo);
+static void HgfsDoReadpages(HgfsHandle handle,
+                            struct page *pages[],
+                            unsigned nrPages);
+static void HgfsGatherWriteData(char *payload,
+                                uint32 size,
+                                HgfsDataPacket dataPacket[],
+                                uint32 numEntries);
 static int HgfsDoWritepage(HgfsHandle handle,
                            struct page *page,
                            unsigned pageFrom,
                            unsigned pageTo);
+#ifdef HGFS_HAVE_WRITEPAGES
+static void HgfsDoWritepages(HgfsWritepagesBatch *batch);
+#endif
 static int HgfsDoWriteBegin(struct file *file,
                             struct page *page,
                             unsigned pageFrom,
@@ -108,8 +147,16 @@ static void HgfsDoExtendFile(struct inode *inode,
 /* HGFS address space operations. */
 static int HgfsReadpage(struct file *file,
                         struct page *page);
+static int HgfsReadpages(struct file *file,
+                         struct address_space *mapping,
+                         struct list_head *pages,
+                         unsigned nrPages);
 static int HgfsWritepage(struct page *page,
                          struct writeback_control *wbc);
+#ifdef HGFS_HAVE_WRITEPAGES
+static int HgfsWritepages(struct address_space *mapping,
+                          struct writeback_control *wbc);
+#endif
 
 /*
  * Write aop interface has changed in 2.6.28. Specifically,
@@ -148,7 +195,11 @@ static int HgfsCommitWrite(struct file *file,
 /* HGFS address space operations structure. */
 struct address_space_operations HgfsAddressSpaceOperations = {
    .readpage      = HgfsReadpage,
+   .readpages     = HgfsReadpages,
    .writepage     = HgfsWritepage,
+#ifdef HGFS_HAVE_WRITEPAGES
+   .writepages    = HgfsWritepages,
+#endif
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 28)
    .write_begin   = HgfsWriteBegin,
    .write_end     = HgfsWriteEnd,
@@ -196,15 +247,18 @@ static Bool HgfsCheckReadModifyWrite(struct file *file,
  *
  * HgfsDoRead --
  *
- *    Do one read request. Called by HgfsReadpage, possibly multiple times
- *    if the size of the read is too big to be handled by one server request.
+ *    Do one read request. Called by HgfsDoReadpage and HgfsDoReadpages,
+ *    possibly multiple times if the size of the read is too big to be
+ *    handled by one server request.
  *
  *    We send a "Read" request to the server with the given handle.
  *
  *    It is assumed that this function is never called with a larger read than
  *    what can be sent in one request.
  *
- *    HgfsDataPacket is an array of pages into which data will be read.
+ *    HgfsDataPacket is an array of pages into which data will be read. The
+ *    entries describe one contiguous file range and are filled in order, so
+ *    a short read leaves the trailing entries untouched.
  *
  * Results:
  *    Returns the number of bytes read on success, or an error on failure.
@@ -228,10 +282,14 @@ HgfsDoRead(HgfsHandle handle,             // IN:  Handle for this file
    char *payload = NULL;
    HgfsStatus replyStatus;
    char *buf;
-   uint32 count;
-   ASSERT(numEntries == 1);
+   uint32 count = 0;
+   uint32 i;
 
-   count = dataPacket[0].len;
+   ASSERT(numEntries > 0);
+
+   for (i = 0; i < numEntries; i++) {
+      count += dataPacket[i].len;
+   }
 
    req = HgfsGetNewRequest();
    if (!req) {
@@ -332,14 +390,24 @@ HgfsDoRead(HgfsHandle handle,             // IN:  Handle for this file
             goto out;
          }
 
-         /* Return result. */
+         /*
+          * Return result. The reply payload may span several of the
+          * caller's pages, so scatter it across the entries in order.
+          */
          if (opUsed == HGFS_OP_READ_V3 || opUsed == HGFS_OP_READ) {
-            buf = kmap(dataPacket[0].page) + dataPacket[0].offset;
-            ASSERT(buf);
-            memcpy(buf, payload, actualSize);
+            uint32 copied = 0;
+
+            for (i = 0; i < numEntries && copied < actualSize; i++) {
+               uint32 chunk = MIN(dataPacket[i].len, actualSize - copied);
+
+               buf = kmap(dataPacket[i].page) + dataPacket[i].offset;
+               ASSERT(buf);
+               memcpy(buf, payload + copied, chunk);
+               kunmap(dataPacket[i].page);
+               copied += chunk;
+            }
             LOG(6, (KERN_WARNING "VMware hgfs: HgfsDoRead: copied %u\n",
                     actualSize));
-            kunmap(dataPacket[0].page);
          }
          break;
 
@@ -389,14 +457,52 @@ out:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsGatherWriteData --
+ *
+ *    Copies the first size bytes described by dataPacket into a request
+ *    payload, walking the entries in order. Used by the write versions that
+ *    carry their data inline rather than handing the pages to the channel.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsGatherWriteData(char *payload,                // OUT: Request payload
+                    uint32 size,                  // IN: Bytes to copy
+                    HgfsDataPacket dataPacket[],  // IN: Data description
+                    uint32 numEntries)            // IN: Number of entries
+{
+   uint32 copied = 0;
+   uint32 i;
+
+   for (i = 0; i < numEntries && copied < size; i++) {
+      uint32 chunk = MIN(dataPacket[i].len, size - copied);
+      char *buf = kmap(dataPacket[i].page) + dataPacket[i].offset;
+
+      memcpy(payload + copied, buf, chunk);
+      kunmap(dataPacket[i].page);
+      copied += chunk;
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * HgfsDoWrite --
  *
- *    Do one write request. Called by HgfsDoWritepage, possibly multiple
- *    times if the size of the write is too big to be handled by one server
- *    request.
+ *    Do one write request. Called by HgfsDoWritepageInt and
+ *    HgfsDoWritepages, possibly multiple times if the size of the write is
+ *    too big to be handled by one server request.
  *
  *    We send a "Write" request to the server with the given handle.
  *
@@ -404,7 +510,7 @@ out:
  *    than what can be sent in one request.
  *
  *    HgfsDataPacket is an array of pages from which data will be written
- *    to file.
+ *    to file. The entries describe one contiguous file range.
  *
  * Results:
  *    Returns the number of bytes written on success, or an error on failure.
@@ -429,11 +535,14 @@ HgfsDoWrite(HgfsHandle handle,             // IN: Handle for this file
    char *payload = NULL;
    uint32 reqSize;
    HgfsStatus replyStatus;
-   char *buf;
-   uint32 count;
-   ASSERT(numEntries == 1);
+   uint32 count = 0;
+   uint32 i;
+
+   ASSERT(numEntries > 0);
 
-   count = dataPacket[0].len;
+   for (i = 0; i < numEntries; i++) {
+      count += dataPacket[i].len;
+   }
 
    req = HgfsGetNewRequest();
    if (!req) {
@@ -495,9 +604,7 @@ HgfsDoWrite(HgfsHandle handle,             // IN: Handle for this file
       reqSize = HGFS_REQ_PAYLOAD_SIZE_V3(request);
       req->dataPacket = NULL;
       req->numEntries = 0;
-      buf = kmap(dataPacket[0].page) + dataPacket[0].offset;
-      memcpy(payload, buf, requiredSize);
-      kunmap(dataPacket[0].page);
+      HgfsGatherWriteData(payload, requiredSize, dataPacket, numEntries);
 
       req->payloadSize = reqSize + requiredSize - 1;
    } else {
@@ -515,9 +622,7 @@ HgfsDoWrite(HgfsHandle handle,             // IN: Handle for this file
       reqSize = sizeof *request;
       req->dataPacket = NULL;
       req->numEntries = 0;
-      buf = kmap(dataPacket[0].page) + dataPacket[0].offset;
-      memcpy(payload, buf, requiredSize);
-      kunmap(dataPacket[0].page);
+      HgfsGatherWriteData(payload, requiredSize, dataPacket, numEntries);
 
       req->payloadSize = reqSize + requiredSize - 1;
    }
@@ -677,6 +782,103 @@ HgfsDoReadpage(HgfsHandle handle,  // IN:     Handle to use for reading
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDoReadpages --
+ *
+ *    Reads in a run of pages that cover one contiguous range of the file.
+ *    Rather than issuing a request per page, each HgfsDoRead call describes
+ *    every page still outstanding, so a single reply fills as much of the
+ *    run as the transport can carry and may cross page boundaries.
+ *
+ *    The pages arrive locked and referenced. Each page is unlocked on the
+ *    way out; pages that could not be read are left !Uptodate so that a
+ *    later HgfsReadpage retries them individually.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsDoReadpages(HgfsHandle handle,     // IN:     Handle to use for reading
+                struct page *pages[],  // IN/OUT: Contiguous pages to read into
+                unsigned nrPages)      // IN:     Number of pages
+{
+   HgfsDataPacket dataPacket[HGFS_READPAGES_MAX];
+   loff_t startOffset = (loff_t)HGFS_PAGE_FILE_INDEX(pages[0]) << PAGE_CACHE_SHIFT;
+   size_t totalCount = (size_t)nrPages << PAGE_CACHE_SHIFT;
+   size_t doneCount = 0;
+   int result = 0;
+   unsigned i;
+
+   ASSERT(nrPages > 0);
+   ASSERT(nrPages <= HGFS_READPAGES_MAX);
+
+   LOG(6, (KERN_WARNING "VMware hgfs: %s: read %u pages from fh %u "
+           "at offset %Lu\n", __func__, nrPages, handle, startOffset));
+
+   /*
+    * Call HgfsDoRead repeatedly until either
+    * - HgfsDoRead returns an error, or
+    * - HgfsDoRead returns 0 (end of file), or
+    * - We have read the whole run.
+    */
+   while (doneCount < totalCount) {
+      unsigned first = doneCount >> PAGE_CACHE_SHIFT;
+      unsigned pageFrom = doneCount & (PAGE_CACHE_SIZE - 1);
+      unsigned numEntries = 0;
+
+      for (i = first; i < nrPages; i++) {
+         dataPacket[numEntries].page = pages[i];
+         dataPacket[numEntries].offset = (i == first) ? pageFrom : 0;
+         dataPacket[numEntries].len = PAGE_CACHE_SIZE -
+                                      dataPacket[numEntries].offset;
+         numEntries++;
+      }
+
+      result = HgfsDoRead(handle, dataPacket, numEntries,
+                          startOffset + doneCount);
+      if (result < 0) {
+         LOG(4, (KERN_WARNING "VMware hgfs: %s: read error %d\n",
+                 __func__, result));
+         break;
+      }
+      if (result == 0) {
+         break;
+      }
+      doneCount += result;
+   }
+
+   for (i = 0; i < nrPages; i++) {
+      size_t pageStart = (size_t)i << PAGE_CACHE_SHIFT;
+
+      /*
+       * After an error only the pages that were read completely can be
+       * trusted. At end of file the remainder of every page is zeroed, as
+       * HgfsDoReadpage does for a single page.
+       */
+      if (result >= 0 || doneCount >= pageStart + PAGE_CACHE_SIZE) {
+         if (doneCount < pageStart + PAGE_CACHE_SIZE) {
+            size_t valid = doneCount > pageStart ? doneCount - pageStart : 0;
+            char *buffer = kmap(pages[i]);
+
+            memset(buffer + valid, 0, PAGE_CACHE_SIZE - valid);
+            kunmap(pages[i]);
+         }
+         flush_dcache_page(pages[i]);
+         SetPageUptodate(pages[i]);
+      }
+      compat_unlock_page(pages[i]);
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -811,6 +1013,112 @@ exit:
 }
 
 
+#ifdef HGFS_HAVE_WRITEPAGES
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDoWritepages --
+ *
+ *    Writes out a run of contiguous dirty pages gathered by HgfsWritepages.
+ *    Each HgfsDoWrite call describes every byte still outstanding, so the
+ *    run goes out in as few server requests as the transport allows rather
+ *    than one request per page.
+ *
+ *    The pages arrive locked, referenced and marked for writeback. Pages
+ *    that were written out completely are dropped from the inode's
+ *    writeback list and marked up to date; the rest get PG_error and the
+ *    error is recorded in the batch and in the mapping. Every page has its
+ *    writeback ended, is unlocked and released, and the batch is emptied.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    May extend the inode's size.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsDoWritepages(HgfsWritepagesBatch *batch) // IN/OUT: Run of pages to write
+{
+   HgfsDataPacket dataPacket[HGFS_WRITEPAGES_MAX];
+   struct page **pages = batch->pages;
+   unsigned nrPages = batch->nrPages;
+   loff_t startOffset = (loff_t)HGFS_PAGE_FILE_INDEX(pages[0]) << PAGE_CACHE_SHIFT;
+   size_t totalCount = ((size_t)(nrPages - 1) << PAGE_CACHE_SHIFT) +
+                       batch->lastLen;
+   size_t doneCount = 0;
+   int result = 0;
+   unsigned i;
+
+   ASSERT(nrPages > 0);
+   ASSERT(nrPages <= HGFS_WRITEPAGES_MAX);
+
+   LOG(4, (KERN_WARNING "VMware hgfs: %s: write %u pages to fh %u "
+           "at offset %Lu\n", __func__, nrPages, batch->handle, startOffset));
+
+   /*
+    * Call HgfsDoWrite repeatedly until either
+    * - HgfsDoWrite returns an error, or
+    * - HgfsDoWrite returns 0 (XXX this probably rarely happens), or
+    * - We have written the whole run.
+    */
+   while (doneCount < totalCount) {
+      unsigned first = doneCount >> PAGE_CACHE_SHIFT;
+      unsigned pageFrom = doneCount & (PAGE_CACHE_SIZE - 1);
+      unsigned numEntries = 0;
+
+      for (i = first; i < nrPages; i++) {
+         unsigned pageTo = (i == nrPages - 1) ? batch->lastLen : PAGE_CACHE_SIZE;
+
+         dataPacket[numEntries].page = pages[i];
+         dataPacket[numEntries].offset = (i == first) ? pageFrom : 0;
+         dataPacket[numEntries].len = pageTo - dataPacket[numEntries].offset;
+         numEntries++;
+      }
+
+      result = HgfsDoWrite(batch->handle, dataPacket, numEntries,
+                           startOffset + doneCount);
+      if (result < 0) {
+         LOG(4, (KERN_WARNING "VMware hgfs: %s: write error %d\n",
+                 __func__, result));
+         break;
+      }
+      if (result == 0) {
+         result = -EIO;
+         break;
+      }
+      doneCount += result;
+
+      /* Update the inode's size now rather than waiting for a revalidate. */
+      HgfsDoExtendFile(batch->inode, startOffset + doneCount);
+   }
+
+   if (result < 0 && batch->result == 0) {
+      batch->result = result;
+   }
+
+   for (i = 0; i < nrPages; i++) {
+      size_t pageEnd = (i == nrPages - 1) ? totalCount :
+                       (size_t)(i + 1) << PAGE_CACHE_SHIFT;
+
+      if (doneCount >= pageEnd) {
+         HgfsInodePageWbRemove(batch->inode, pages[i]);
+         SetPageUptodate(pages[i]);
+      } else {
+         SetPageError(pages[i]);
+         mapping_set_error(pages[i]->mapping, result);
+      }
+      compat_end_page_writeback(pages[i]);
+      compat_unlock_page(pages[i]);
+      page_cache_release(pages[i]);
+   }
+   batch->nrPages = 0;
+}
+#endif
+
+
 /*
  * HGFS address space operations.
  */
@@ -859,6 +1167,85 @@ HgfsReadpage(struct file *file, // IN:     File to read from
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsReadpages --
+ *
+ *    Readahead entry point. The VFS hands us a list of newly allocated pages
+ *    that are not yet in the page cache. We insert each one, gather runs of
+ *    consecutive indices and read every run with as few server requests as
+ *    possible instead of going through HgfsReadpage one page at a time.
+ *
+ *    Pages that can't be added to the page cache (someone else got there
+ *    first) are simply skipped. Readahead is advisory, so read errors are
+ *    not reported here; the affected pages stay !Uptodate and are read
+ *    again through HgfsReadpage when they are actually needed.
+ *
+ * Results:
+ *    Always zero.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsReadpages(struct file *file,              // IN:     File to read from
+              struct address_space *mapping,  // IN:     Mapping to populate
+              struct list_head *pages,        // IN/OUT: Pages to read into
+              unsigned nrPages)               // IN:     Number of pages
+{
+   struct page *batch[HGFS_READPAGES_MAX];
+   unsigned batchCount = 0;
+   HgfsHandle handle;
+   unsigned i;
+
+   ASSERT(file);
+   ASSERT(file->f_dentry);
+   ASSERT(file->f_dentry->d_inode);
+   ASSERT(mapping);
+   ASSERT(pages);
+
+   handle = FILE_GET_FI_P(file)->handle;
+   LOG(6, (KERN_WARNING "VMware hgfs: %s: reading %u pages from handle %u\n",
+           __func__, nrPages, handle));
+
+   for (i = 0; i < nrPages; i++) {
+      struct page *page = list_entry(pages->prev, struct page, lru);
+
+      list_del(&page->lru);
+      if (add_to_page_cache_lru(page, mapping, page->index, GFP_KERNEL)) {
+         page_cache_release(page);
+         continue;
+      }
+
+      if (batchCount > 0 &&
+          (batchCount == HGFS_READPAGES_MAX ||
+           page->index != batch[batchCount - 1]->index + 1)) {
+         unsigned j;
+
+         HgfsDoReadpages(handle, batch, batchCount);
+         for (j = 0; j < batchCount; j++) {
+            page_cache_release(batch[j]);
+         }
+         batchCount = 0;
+      }
+      batch[batchCount++] = page;
+   }
+
+   if (batchCount > 0) {
+      HgfsDoReadpages(handle, batch, batchCount);
+      for (i = 0; i < batchCount; i++) {
+         page_cache_release(batch[i]);
+      }
+   }
+
+   return 0;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -968,6 +1355,138 @@ HgfsWritepage(struct page *page,             // IN: Page to write from
 }
 
 
+#ifdef HGFS_HAVE_WRITEPAGES
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWritepagesFill --
+ *
+ *    write_cache_pages() callback. Receives each dirty page locked and with
+ *    its dirty bit cleared for I/O, and appends it to the current run. The
+ *    run is written out first when the page does not directly follow it,
+ *    when the run is full, or when the run already ends in a partial page.
+ *
+ *    Pages past the end of the file are dropped the same way HgfsWritepage
+ *    drops them.
+ *
+ * Results:
+ *    Zero on success, negative error if no writable handle is available.
+ *
+ * Side effects:
+ *    May write out the previous run.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsWritepagesFill(struct page *page,             // IN: Dirty page
+                   struct writeback_control *wbc, // IN: Ignored
+                   void *data)                    // IN/OUT: Current run
+{
+   HgfsWritepagesBatch *batch = data;
+   pgoff_t lastPageIndex;
+   pgoff_t pageIndex;
+   loff_t currentFileSize;
+   unsigned to = PAGE_CACHE_SIZE;
+   int result;
+
+   /*
+    * The handle is only looked up once there's actually a page to write, so
+    * that syncing a clean file opened read-only doesn't fail.
+    */
+   if (!batch->haveHandle) {
+      result = HgfsGetHandle(batch->inode,
+                             HGFS_OPEN_MODE_WRITE_ONLY + 1,
+                             &batch->handle);
+      if (result) {
+         LOG(4, (KERN_WARNING "VMware hgfs: %s: could not get writable "
+                 "file handle\n", __func__));
+         compat_unlock_page(page);
+         return result;
+      }
+      batch->haveHandle = TRUE;
+   }
+
+   currentFileSize = compat_i_size_read(batch->inode);
+   lastPageIndex = currentFileSize >> PAGE_CACHE_SHIFT;
+   pageIndex = HGFS_PAGE_FILE_INDEX(page);
+   if (pageIndex > lastPageIndex) {
+      compat_unlock_page(page);
+      return 0;
+   } else if (pageIndex == lastPageIndex) {
+      to = currentFileSize & (PAGE_CACHE_SIZE - 1);
+      if (to == 0) {
+         compat_unlock_page(page);
+         return 0;
+      }
+   }
+
+   if (batch->nrPages > 0 &&
+       (batch->nrPages == HGFS_WRITEPAGES_MAX ||
+        batch->lastLen != PAGE_CACHE_SIZE ||
+        pageIndex != HGFS_PAGE_FILE_INDEX(batch->pages[batch->nrPages - 1]) + 1)) {
+      HgfsDoWritepages(batch);
+   }
+
+   page_cache_get(page);
+   compat_set_page_writeback(page);
+   batch->pages[batch->nrPages++] = page;
+   batch->lastLen = to;
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWritepages --
+ *
+ *    Writes out the dirty pages of a mapping. Walks the dirty pages with
+ *    write_cache_pages() and coalesces runs of adjacent pages, so flushing a
+ *    large file written through mmap or the page cache needs one server
+ *    request per run chunk instead of one per page.
+ *
+ *    The kernel already calls us from its flusher threads for background
+ *    writeback; the requests themselves are synchronous, as the backdoor
+ *    channel has no way to keep several in flight.
+ *
+ * Results:
+ *    Zero on success, negative error on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsWritepages(struct address_space *mapping,  // IN: Mapping to write out
+               struct writeback_control *wbc)  // IN: Writeback parameters
+{
+   HgfsWritepagesBatch batch;
+   int result;
+
+   ASSERT(mapping);
+   ASSERT(mapping->host);
+
+   batch.inode = mapping->host;
+   batch.haveHandle = FALSE;
+   batch.result = 0;
+   batch.nrPages = 0;
+   batch.lastLen = 0;
+
+   result = write_cache_pages(mapping, wbc, HgfsWritepagesFill, &batch);
+   if (batch.nrPages > 0) {
+      HgfsDoWritepages(&batch);
+   }
+
+   LOG(4, (KERN_WARNING "VMware hgfs: %s: return %d/%d\n",
+           __func__, result, batch.result));
+   return result ? result : batch.result;
+}
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
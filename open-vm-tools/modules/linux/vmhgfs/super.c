@@ -41,6 +41,7 @@
 #include "fsutil.h"
 #include "hgfsDevLinux.h"
 #include "module.h"
+#include "notify.h"
 #include "vm_assert.h"
 
 
@@ -95,6 +96,11 @@ HgfsAllocInode(struct super_block *sb) // IN: Superblock for the inode
       return NULL;
    }
 
+   INIT_LIST_HEAD(&iinfo->watchLinks);
+   iinfo->watchId = HGFS_INVALID_SUBSCRIBER_HANDLE;
+   iinfo->watchGeneration = 0;
+   iinfo->watchStart = 0;
+
    return &iinfo->inode;
 }
 
@@ -112,7 +118,7 @@ HgfsAllocInode(struct super_block *sb) // IN: Superblock for the inode
  *    None
  *
  * Side effects:
- *    Frees memory associated with inode.
+ *    Frees memory associated with inode, drops any host change watch.
  *
  *-----------------------------------------------------------------------------
  */
@@ -120,6 +126,7 @@ HgfsAllocInode(struct super_block *sb) // IN: Superblock for the inode
 static void
 HgfsDestroyInode(struct inode *inode) // IN: The VFS inode
 {
+   HgfsNotifyInodeDestroy(inode);
    kmem_cache_free(hgfsInodeCache, INODE_GET_II_P(inode));
 }
 
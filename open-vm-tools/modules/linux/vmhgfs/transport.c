@@ -24,9 +24,14 @@
  * actual transport channels (backdoor, tcp, vsock, ...).
  *
  * The sends happen in the process context, where as a kernel thread
- * handles the asynchronous replies. A queue of pending replies is
- * maintained and is protected by a spinlock. The channel opens and close
- * is protected by a mutex.
+ * handles the asynchronous replies. A table of pending replies, hashed by
+ * request id, is maintained and is protected by a spinlock. The channel
+ * opens and close is protected by a mutex.
+ *
+ * The mutex is only held while a request is handed to the channel. With
+ * the backdoor that covers the whole round trip, but the VMCI channel
+ * returns as soon as the datagram is queued, so any number of requests
+ * can be outstanding and their senders wait on their own queues.
  */
 
 /* Must come before any kernel header file. */
@@ -48,15 +53,26 @@
 #include "hgfsDevLinux.h"
 #include "hgfsProto.h"
 #include "module.h"
+#include "notify.h"
 #include "request.h"
 #include "transport.h"
 #include "vm_assert.h"
 
 static HgfsTransportChannel *hgfsChannel;     /* Current active channel. */
 static compat_mutex_t hgfsChannelLock;        /* Lock to protect hgfsChannel. */
-static struct list_head hgfsRepPending;       /* Reply pending queue. */
 static spinlock_t hgfsRepQueueLock;           /* Reply pending queue lock. */
 
+/*
+ * Requests waiting for a reply, hashed by request id so that the channel
+ * callbacks can match an asynchronous reply without walking every request
+ * that is in flight.
+ */
+#define HGFS_REP_PENDING_BUCKETS      64
+#define HGFS_REP_PENDING_BUCKET(id)   \
+   (&hgfsRepPending[(id) & (HGFS_REP_PENDING_BUCKETS - 1)])
+
+static struct list_head hgfsRepPending[HGFS_REP_PENDING_BUCKETS];
+
 /*
  *----------------------------------------------------------------------
  *
@@ -129,6 +145,9 @@ HgfsTransportCloseChannel(HgfsTransportChannel *channel)
 
       channel->ops.close(channel);
       channel->status = HGFS_CHANNEL_NOTCONNECTED;
+
+      /* The host session, and every watch placed on it, is gone. */
+      HgfsNotifyReset();
    }
 }
 
@@ -138,7 +157,8 @@ HgfsTransportCloseChannel(HgfsTransportChannel *channel)
  *
  * HgfsTransportSetupNewChannel --
  *
- *     Find a new workable channel.
+ *     Find a new workable channel. The VMCI channel is preferred as it
+ *     allows multiple outstanding requests; the backdoor is the fallback.
  *
  * Results:
  *     TRUE on success, otherwise FALSE.
@@ -154,6 +174,15 @@ HgfsTransportSetupNewChannel(void)
 {
    HgfsTransportChannel *newChannel;
 
+   newChannel = HgfsGetVmciChannel();
+   if (newChannel != NULL) {
+      LOG(10, (KERN_DEBUG LGPFX "%s CHANNEL: Vmci channel\n", __func__));
+      hgfsChannel = newChannel;
+      if (HgfsTransportOpenChannel(newChannel)) {
+         return TRUE;
+      }
+   }
+
    newChannel = HgfsGetBdChannel();
    LOG(10, (KERN_DEBUG LGPFX "%s CHANNEL: Bd channel\n", __func__));
    ASSERT(newChannel);
@@ -167,7 +196,7 @@ HgfsTransportSetupNewChannel(void)
  *
  * HgfsTransporAddPendingRequest --
  *
- *     Adds a request to the hgfsRepPending queue.
+ *     Adds a request to the hgfsRepPending table.
  *
  * Results:
  *     None
@@ -184,7 +213,7 @@ HgfsTransportAddPendingRequest(HgfsReq *req)   // IN: Request to add
    ASSERT(req);
 
    spin_lock_bh(&hgfsRepQueueLock);
-   list_add_tail(&req->list, &hgfsRepPending);
+   list_add_tail(&req->list, HGFS_REP_PENDING_BUCKET(req->id));
    spin_unlock_bh(&hgfsRepQueueLock);
 }
 
@@ -194,7 +223,7 @@ HgfsTransportAddPendingRequest(HgfsReq *req)   // IN: Request to add
  *
  * HgfsTransportRemovePendingRequest --
  *
- *     Dequeues the request from the hgfsRepPending queue.
+ *     Dequeues the request from the hgfsRepPending table.
  *
  * Results:
  *     None
@@ -237,14 +266,17 @@ static void
 HgfsTransportFlushPendingRequests(void)
 {
    struct HgfsReq *req;
+   unsigned int i;
 
    spin_lock_bh(&hgfsRepQueueLock);
 
-   list_for_each_entry(req, &hgfsRepPending, list) {
-      if (req->state == HGFS_REQ_STATE_SUBMITTED) {
-         LOG(6, (KERN_DEBUG LGPFX "%s: injecting error reply to req id: %d\n",
-                 __func__, req->id));
-         HgfsFailReq(req, -EIO);
+   for (i = 0; i < HGFS_REP_PENDING_BUCKETS; i++) {
+      list_for_each_entry(req, &hgfsRepPending[i], list) {
+         if (req->state == HGFS_REQ_STATE_SUBMITTED) {
+            LOG(6, (KERN_DEBUG LGPFX "%s: injecting error reply to req id: %d\n",
+                    __func__, req->id));
+            HgfsFailReq(req, -EIO);
+         }
       }
    }
 
@@ -256,8 +288,10 @@ HgfsTransportFlushPendingRequests(void)
  *
  * HgfsTransportGetPendingRequest --
  *
- *     Attempts to locate request with specified ID in the queue of
- *     pending (waiting for server's reply) requests.
+ *     Attempts to locate request with specified ID in the table of
+ *     pending (waiting for server's reply) requests. Requests that have
+ *     already been completed, e.g. by a synchronous reply that raced with
+ *     the asynchronous notification, are not returned.
  *
  * Results:
  *     NULL if request not found; otherwise address of the request
@@ -276,9 +310,8 @@ HgfsTransportGetPendingRequest(HgfsHandle id)   // IN: id of the request
 
    spin_lock_bh(&hgfsRepQueueLock);
 
-   list_for_each_entry(cur, &hgfsRepPending, list) {
-      if (cur->id == id) {
-         ASSERT(cur->state == HGFS_REQ_STATE_SUBMITTED);
+   list_for_each_entry(cur, HGFS_REP_PENDING_BUCKET(id), list) {
+      if (cur->id == id && cur->state == HGFS_REQ_STATE_SUBMITTED) {
          req = HgfsRequestGetRef(cur);
          break;
       }
@@ -290,6 +323,47 @@ HgfsTransportGetPendingRequest(HgfsHandle id)   // IN: id of the request
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportFinishRequest --
+ *
+ *     Completes a submitted request on behalf of a channel, either with
+ *     the reply already placed in its payload or with an error. A request
+ *     is only completed once even if the channel reports it twice.
+ *
+ * Results:
+ *     None
+ *
+ * Side effects:
+ *     Drops a reference to the request if do_put is set.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsTransportFinishRequest(HgfsReq *req,   // IN: Request
+                           Bool success,   // IN: Reply is valid
+                           Bool do_put)    // IN: Drop caller's reference
+{
+   ASSERT(req);
+
+   spin_lock_bh(&hgfsRepQueueLock);
+   if (req->state == HGFS_REQ_STATE_SUBMITTED) {
+      if (success) {
+         HgfsCompleteReq(req);
+      } else {
+         HgfsFailReq(req, -EIO);
+      }
+   }
+   spin_unlock_bh(&hgfsRepQueueLock);
+
+   if (do_put) {
+      HgfsRequestPutRef(req);
+   }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -494,7 +568,11 @@ out:
 void
 HgfsTransportInit(void)
 {
-   INIT_LIST_HEAD(&hgfsRepPending);
+   unsigned int i;
+
+   for (i = 0; i < HGFS_REP_PENDING_BUCKETS; i++) {
+      INIT_LIST_HEAD(&hgfsRepPending[i]);
+   }
    spin_lock_init(&hgfsRepQueueLock);
    compat_mutex_init(&hgfsChannelLock);
 
@@ -559,6 +637,8 @@ HgfsTransportMarkDead(void)
 void
 HgfsTransportExit(void)
 {
+   unsigned int i;
+
    LOG(8, (KERN_DEBUG LGPFX "%s entered.\n", __func__));
 
    compat_mutex_lock(&hgfsChannelLock);
@@ -567,7 +647,9 @@ HgfsTransportExit(void)
    hgfsChannel = NULL;
    compat_mutex_unlock(&hgfsChannelLock);
 
-   ASSERT(list_empty(&hgfsRepPending));
+   for (i = 0; i < HGFS_REP_PENDING_BUCKETS; i++) {
+      ASSERT(list_empty(&hgfsRepPending[i]));
+   }
    LOG(8, (KERN_DEBUG LGPFX "%s exited.\n", __func__));
 }
 
@@ -67,5 +67,6 @@ void HgfsTransportFlushRequests(void);
 void HgfsTransportMarkDead(void);
 
 HgfsTransportChannel *HgfsGetBdChannel(void);
+HgfsTransportChannel *HgfsGetVmciChannel(void);
 
 #endif // _HGFS_DRIVER_TRANSPORT_H_
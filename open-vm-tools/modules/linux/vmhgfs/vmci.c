@@ -0,0 +1,690 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ *********************************************************/
+
+/*
+ * vmci.c --
+ *
+ * VMCI datagram channel for HGFS.
+ *
+ * Unlike the backdoor, a VMCI send does not block until the host has
+ * processed the request. The request and reply share one guest buffer,
+ * described to the host as a list of physical pages, and a small status
+ * block at its head tells us whether the host answered synchronously.
+ * Otherwise the host later sends an HGFS_ASYNC_IOREP datagram carrying the
+ * request id, which the callback looks up in the transport's pending table.
+ * Any number of requests can therefore be in flight at the same time.
+ *
+ * We also lend the host a few pages into which it writes the packets it
+ * initiates itself, i.e. directory change notifications, see notify.c.
+ *
+ * The channel needs the VMCI guest driver. It is only built when the
+ * kernel provides vmw_vmci or the VMCI module symbols were found at build
+ * time; otherwise HgfsGetVmciChannel returns NULL and the transport stays
+ * on the backdoor.
+ */
+
+/* Must come before any kernel header file. */
+#include "driver-config.h"
+
+#include <linux/errno.h>
+#include <linux/mm.h>
+#include <asm/io.h>
+
+#include "transport.h"
+#include "hgfsProto.h"
+#include "module.h"
+#include "notify.h"
+#include "request.h"
+#include "vm_assert.h"
+
+#if defined(VMHGFS_HAVE_VMCI) || defined(CONFIG_VMWARE_VMCI) || \
+    defined(CONFIG_VMWARE_VMCI_MODULE)
+#define HGFS_VMCI_CHANNEL
+#endif
+
+#ifdef HGFS_VMCI_CHANNEL
+
+#include "hgfsTransport.h"
+#include "vmciKernelAPI.h"
+
+static Bool HgfsVmciChannelOpen(HgfsTransportChannel *channel);
+static void HgfsVmciChannelClose(HgfsTransportChannel *channel);
+static HgfsReq *HgfsVmciChannelAllocate(size_t payloadSize);
+static void HgfsVmciChannelFree(HgfsReq *req);
+static int HgfsVmciChannelSend(HgfsTransportChannel *channel, HgfsReq *req);
+static int HgfsVmciChannelCallback(void *clientData, VMCIDatagram *dg);
+
+static HgfsTransportChannel channel = {
+   .name = "vmci",
+   .ops.open = HgfsVmciChannelOpen,
+   .ops.close = HgfsVmciChannelClose,
+   .ops.allocate = HgfsVmciChannelAllocate,
+   .ops.free = HgfsVmciChannelFree,
+   .ops.send = HgfsVmciChannelSend,
+   .priv = NULL,
+   .status = HGFS_CHANNEL_NOTCONNECTED
+};
+
+/* Our datagram handle, valid while the channel is connected. */
+static VMCIHandle vmciHandle;
+
+/*
+ * Set once a send has failed on an open channel. The host evidently does
+ * not serve HGFS over VMCI, so stop offering the channel and let the
+ * transport settle on the backdoor instead of cycling through reconnects.
+ */
+static Bool vmciUnusable;
+
+/* Pages lent to the host for server initiated packets. */
+#define HGFS_VMCI_NOTIFY_PAGES   4
+static unsigned long vmciNotifyPages[HGFS_VMCI_NOTIFY_PAGES];
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVmciChannelPassGuestPages --
+ *
+ *      Hand the notification pages to the host. Done when the channel
+ *      opens and again each time the host has consumed them or asks for
+ *      them.
+ *
+ * Results:
+ *      TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsVmciChannelPassGuestPages(gfp_t gfpFlags) // IN: Allocation flags
+{
+   HgfsVmciTransportHeader *transportHeader;
+   VMCIDatagram *dg;
+   size_t dgSize;
+   uint32 i;
+   int ret;
+
+   if (!vmciNotifyPages[0]) {
+      return FALSE;
+   }
+
+   dgSize = sizeof *dg + offsetof(HgfsVmciTransportHeader, asyncIov) +
+            HGFS_VMCI_NOTIFY_PAGES * sizeof transportHeader->asyncIov[0];
+   dg = kmalloc(dgSize, gfpFlags);
+   if (!dg) {
+      return FALSE;
+   }
+
+   dg->dst = VMCI_MAKE_HANDLE(VMCI_HYPERVISOR_CONTEXT_ID, VMCI_HGFS_TRANSPORT);
+   dg->src = vmciHandle;
+   dg->payloadSize = dgSize - sizeof *dg;
+
+   transportHeader = VMCI_DG_PAYLOAD(dg);
+   transportHeader->node.version = HGFS_VMCI_VERSION_1;
+   transportHeader->node.pktType = HGFS_TH_REP_GET_PAGES;
+   transportHeader->iovCount = HGFS_VMCI_NOTIFY_PAGES;
+   for (i = 0; i < HGFS_VMCI_NOTIFY_PAGES; i++) {
+      transportHeader->asyncIov[i].pa = virt_to_phys((void *)vmciNotifyPages[i]);
+      transportHeader->asyncIov[i].va = vmciNotifyPages[i];
+      transportHeader->asyncIov[i].len = PAGE_SIZE;
+      transportHeader->asyncIov[i].index = i;
+      transportHeader->asyncIov[i].chain = FALSE;
+   }
+
+   ret = vmci_datagram_send(dg);
+   kfree(dg);
+   if (ret < VMCI_SUCCESS) {
+      LOG(8, ("VMware hgfs: %s: host did not take notification pages: %d\n",
+              __func__, ret));
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVmciChannelFreeGuestPages --
+ *
+ *      Free the notification pages.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsVmciChannelFreeGuestPages(void)
+{
+   uint32 i;
+
+   for (i = 0; i < HGFS_VMCI_NOTIFY_PAGES; i++) {
+      if (vmciNotifyPages[i]) {
+         free_page(vmciNotifyPages[i]);
+         vmciNotifyPages[i] = 0;
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVmciChannelReceiveShmem --
+ *
+ *      Pass the packets the host wrote into the notification pages on to
+ *      the notification code. A packet spans consecutive iovs as long as
+ *      they are chained.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsVmciChannelReceiveShmem(const HgfsVmciAsyncShmem *shmem) // IN: Packets
+{
+   uint32 first;
+   uint32 last;
+   uint32 i;
+   size_t size;
+   char *packet;
+
+   for (first = 0; first < shmem->count; first = last + 1) {
+      size = 0;
+      for (last = first; last < shmem->count; last++) {
+         if (shmem->iov[last].index >= HGFS_VMCI_NOTIFY_PAGES ||
+             shmem->iov[last].len > PAGE_SIZE) {
+            LOG(4, (KERN_WARNING "VMware hgfs: %s: bad iov\n", __func__));
+            return;
+         }
+         size += shmem->iov[last].len;
+         if (!shmem->iov[last].chain) {
+            break;
+         }
+      }
+      if (last == shmem->count) {
+         /* Chain not terminated. */
+         return;
+      }
+
+      if (first == last) {
+         HgfsNotifyReceive((void *)vmciNotifyPages[shmem->iov[first].index],
+                           size);
+         continue;
+      }
+
+      packet = kmalloc(size, GFP_ATOMIC);
+      if (!packet) {
+         continue;
+      }
+      size = 0;
+      for (i = first; i <= last; i++) {
+         memcpy(packet + size, (void *)vmciNotifyPages[shmem->iov[i].index],
+                shmem->iov[i].len);
+         size += shmem->iov[i].len;
+      }
+      HgfsNotifyReceive(packet, size);
+      kfree(packet);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVmciChannelOpen --
+ *
+ *      Create the datagram handle through which the host delivers
+ *      asynchronous replies, and lend the host the notification pages.
+ *
+ * Results:
+ *      TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsVmciChannelOpen(HgfsTransportChannel *channel) // IN: Channel
+{
+   uint32 i;
+   int ret;
+
+   ASSERT(channel->status == HGFS_CHANNEL_NOTCONNECTED);
+
+   ret = vmci_datagram_create_handle(VMCI_INVALID_ID, VMCI_FLAG_DG_NONE,
+                                     HgfsVmciChannelCallback, NULL,
+                                     &vmciHandle);
+   if (ret < VMCI_SUCCESS) {
+      LOG(8, ("VMware hgfs: %s: failed to create datagram handle: %d\n",
+              __func__, ret));
+      return FALSE;
+   }
+
+   /* Without notification pages we simply never get notifications. */
+   for (i = 0; i < HGFS_VMCI_NOTIFY_PAGES; i++) {
+      vmciNotifyPages[i] = __get_free_page(GFP_KERNEL);
+      if (!vmciNotifyPages[i]) {
+         HgfsVmciChannelFreeGuestPages();
+         break;
+      }
+   }
+   HgfsVmciChannelPassGuestPages(GFP_KERNEL);
+
+   channel->priv = &vmciHandle;
+   LOG(8, ("VMware hgfs: %s: vmci channel opened.\n", __func__));
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVmciChannelClose --
+ *
+ *      Destroy the datagram handle. The transport fails any requests that
+ *      are still waiting for an asynchronous reply.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsVmciChannelClose(HgfsTransportChannel *channel) // IN: Channel
+{
+   ASSERT(channel->priv != NULL);
+
+   vmci_datagram_destroy_handle(vmciHandle);
+   HgfsVmciChannelFreeGuestPages();
+   channel->priv = NULL;
+
+   LOG(8, ("VMware hgfs: %s: vmci channel closed.\n", __func__));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVmciChannelAllocate --
+ *
+ *      Allocate request in a way that is suitable for sending through
+ *      VMCI. The status block the host updates precedes the payload.
+ *
+ * Results:
+ *      NULL on failure; otherwise address of the new request.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsReq *
+HgfsVmciChannelAllocate(size_t payloadSize) // IN: size of requests payload
+{
+   HgfsReq *req;
+
+   req = kmalloc(sizeof(*req) + sizeof(HgfsVmciTransportStatus) + payloadSize,
+                 GFP_KERNEL);
+   if (likely(req)) {
+      req->payload = req->buffer + sizeof(HgfsVmciTransportStatus);
+      req->bufferSize = payloadSize;
+   }
+
+   return req;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVmciChannelFree --
+ *
+ *     Free previously allocated request.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsVmciChannelFree(HgfsReq *req)
+{
+   ASSERT(req);
+   kfree(req);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVmciChannelCountIovs --
+ *
+ *      Number of page-sized iovs needed to describe a kernel buffer.
+ *
+ * Results:
+ *      The iov count.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsVmciChannelCountIovs(const void *buf,   // IN: Start of the buffer
+                         size_t len)        // IN: Length of the buffer
+{
+   unsigned long start = (unsigned long)buf;
+   unsigned long end = start + len;
+
+   return ((end + PAGE_SIZE - 1) >> PAGE_SHIFT) - (start >> PAGE_SHIFT);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVmciChannelFillIovs --
+ *
+ *      Describe a kmalloc'ed buffer as physical page fragments.
+ *
+ * Results:
+ *      Number of iovs filled in.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsVmciChannelFillIovs(HgfsIov *iov,    // OUT: Iovs to fill
+                        void *buf,       // IN: Start of the buffer
+                        size_t len)      // IN: Length of the buffer
+{
+   char *cur = buf;
+   uint32 count = 0;
+
+   while (len > 0) {
+      size_t chunk = MIN(len, PAGE_SIZE - offset_in_page(cur));
+
+      iov[count].pa = virt_to_phys(cur);
+      iov[count].len = chunk;
+      count++;
+      cur += chunk;
+      len -= chunk;
+   }
+
+   return count;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsVmciChannelSend --
+ *
+ *     Send a request via VMCI. The request buffer (status block plus
+ *     payload) and any data packet pages attached by the read and write
+ *     paths are handed to the host by physical address.
+ *
+ *     If the host processed the request synchronously the reply is
+ *     already in place and the request is completed here. Otherwise it
+ *     stays submitted and is completed by HgfsVmciChannelCallback.
+ *
+ * Results:
+ *     0 on success, negative error on failure.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsVmciChannelSend(HgfsTransportChannel *channel, // IN: Channel
+                    HgfsReq *req)                  // IN: request to send
+{
+   HgfsVmciTransportStatus *transportStatus;
+   HgfsVmciTransportHeader *transportHeader;
+   VMCIDatagram *dg;
+   size_t bufferLen;
+   size_t dgSize;
+   uint32 iovCount;
+   uint32 i;
+   int ret;
+
+   ASSERT(req);
+   ASSERT(req->state == HGFS_REQ_STATE_UNSENT);
+   ASSERT(req->payloadSize <= req->bufferSize);
+
+   bufferLen = sizeof *transportStatus + req->bufferSize;
+   iovCount = HgfsVmciChannelCountIovs(req->buffer, bufferLen) +
+              req->numEntries;
+
+   dgSize = sizeof *dg + offsetof(HgfsVmciTransportHeader, iov) +
+            iovCount * sizeof transportHeader->iov[0];
+   dg = kmalloc(dgSize, GFP_KERNEL);
+   if (!dg) {
+      LOG(4, (KERN_WARNING "VMware hgfs: %s: failed to allocate datagram\n",
+              __func__));
+      return -ENOMEM;
+   }
+
+   dg->dst = VMCI_MAKE_HANDLE(VMCI_HYPERVISOR_CONTEXT_ID, VMCI_HGFS_TRANSPORT);
+   dg->src = vmciHandle;
+   dg->payloadSize = dgSize - sizeof *dg;
+
+   transportHeader = VMCI_DG_PAYLOAD(dg);
+   transportHeader->node.version = HGFS_VMCI_VERSION_1;
+   transportHeader->node.pktType = HGFS_TH_REQUEST;
+
+   iovCount = HgfsVmciChannelFillIovs(transportHeader->iov, req->buffer,
+                                      bufferLen);
+   for (i = 0; i < req->numEntries; i++) {
+      transportHeader->iov[iovCount].pa =
+         page_to_phys(req->dataPacket[i].page) + req->dataPacket[i].offset;
+      transportHeader->iov[iovCount].len = req->dataPacket[i].len;
+      iovCount++;
+   }
+   transportHeader->iovCount = iovCount;
+
+   transportStatus = (HgfsVmciTransportStatus *)req->buffer;
+   transportStatus->status = HGFS_TS_IO_PENDING;
+   transportStatus->size = req->payloadSize;
+
+   /* The reply may arrive before vmci_datagram_send returns. */
+   req->state = HGFS_REQ_STATE_SUBMITTED;
+
+   LOG(8, ("VMware hgfs: %s: vmci sending id %u, %u iovs.\n",
+           __func__, req->id, iovCount));
+   ret = vmci_datagram_send(dg);
+   kfree(dg);
+
+   if (ret < VMCI_SUCCESS) {
+      LOG(4, (KERN_WARNING "VMware hgfs: %s: datagram send failed: %d\n",
+              __func__, ret));
+      req->state = HGFS_REQ_STATE_UNSENT;
+      vmciUnusable = TRUE;
+      return -EIO;
+   }
+
+   switch (transportStatus->status) {
+   case HGFS_TS_IO_COMPLETE:
+      if (transportStatus->size > req->bufferSize) {
+         HgfsTransportFinishRequest(req, FALSE, FALSE);
+         break;
+      }
+      req->payloadSize = transportStatus->size;
+      HgfsTransportFinishRequest(req, TRUE, FALSE);
+      break;
+
+   case HGFS_TS_IO_FAILED:
+      HgfsTransportFinishRequest(req, FALSE, FALSE);
+      break;
+
+   default:
+      /* HgfsVmciChannelCallback completes it. */
+      break;
+   }
+
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsVmciChannelCallback --
+ *
+ *     Datagram handler for asynchronous replies from the host. Matches
+ *     the reply to its pending request by id and wakes the sender.
+ *     Also receives the packets the host wrote into our notification
+ *     pages.
+ *
+ * Results:
+ *     VMCI_SUCCESS.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsVmciChannelCallback(void *clientData,   // IN: Unused
+                        VMCIDatagram *dg)   // IN: Datagram from the host
+{
+   HgfsVmciAsyncReply *reply;
+   HgfsVmciTransportStatus *transportStatus;
+   HgfsReq *req;
+
+   if (dg->payloadSize < offsetof(HgfsVmciAsyncReply, response)) {
+      LOG(4, (KERN_WARNING "VMware hgfs: %s: short datagram\n", __func__));
+      return VMCI_SUCCESS;
+   }
+
+   reply = VMCI_DG_PAYLOAD(dg);
+   switch (reply->node.replyType) {
+   case HGFS_ASYNC_IOREQ_SHMEM:
+      if (dg->payloadSize < offsetof(HgfsVmciAsyncReply, shmem.iov) ||
+          dg->payloadSize < offsetof(HgfsVmciAsyncReply, shmem.iov) +
+                            (uint64)reply->shmem.count *
+                            sizeof reply->shmem.iov[0]) {
+         LOG(4, (KERN_WARNING "VMware hgfs: %s: short datagram\n", __func__));
+         break;
+      }
+      HgfsVmciChannelReceiveShmem(&reply->shmem);
+      /* The host has consumed the pages; lend them again. */
+      HgfsVmciChannelPassGuestPages(GFP_ATOMIC);
+      break;
+
+   case HGFS_ASYNC_IOREQ_GET_PAGES:
+      HgfsVmciChannelPassGuestPages(GFP_ATOMIC);
+      break;
+
+   case HGFS_ASYNC_IOREP:
+      if (dg->payloadSize < offsetof(HgfsVmciAsyncReply, response) +
+                            sizeof reply->response) {
+         LOG(4, (KERN_WARNING "VMware hgfs: %s: short datagram\n", __func__));
+         break;
+      }
+      req = HgfsTransportGetPendingRequest((HgfsHandle)reply->response.id);
+      if (!req) {
+         LOG(4, (KERN_WARNING "VMware hgfs: %s: no request with id %u\n",
+                 __func__, (uint32)reply->response.id));
+         break;
+      }
+
+      transportStatus = (HgfsVmciTransportStatus *)req->buffer;
+      if (transportStatus->status != HGFS_TS_IO_COMPLETE ||
+          transportStatus->size > req->bufferSize) {
+         HgfsTransportFinishRequest(req, FALSE, TRUE);
+         break;
+      }
+      req->payloadSize = transportStatus->size;
+      HgfsTransportFinishRequest(req, TRUE, TRUE);
+      break;
+
+   default:
+      LOG(4, (KERN_WARNING "VMware hgfs: %s: unhandled reply type %d\n",
+              __func__, reply->node.replyType));
+      break;
+   }
+
+   return VMCI_SUCCESS;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsGetVmciChannel --
+ *
+ *     Initialize VMCI channel.
+ *
+ * Results:
+ *     Pointer to the VMCI channel, or NULL if it can't be used.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+HgfsTransportChannel*
+HgfsGetVmciChannel(void)
+{
+   return vmciUnusable ? NULL : &channel;
+}
+
+#else /* !HGFS_VMCI_CHANNEL */
+
+HgfsTransportChannel*
+HgfsGetVmciChannel(void)
+{
+   return NULL;
+}
+
+#endif /* HGFS_VMCI_CHANNEL */
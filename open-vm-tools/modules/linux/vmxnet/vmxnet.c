@@ -76,6 +76,10 @@ static compat_irqreturn_t vmxnet_interrupt(int irq, void *dev_id);
 #ifdef VMW_HAVE_POLL_CONTROLLER
 static void vmxnet_netpoll(struct net_device *dev);
 #endif
+#ifdef VMXNET_NAPI
+static int vmxnet_poll(struct napi_struct *napi, int budget);
+static enum hrtimer_restart vmxnet_coalesce_timer(struct hrtimer *timer);
+#endif
 static int vmxnet_close(struct net_device *dev);
 static void vmxnet_set_multicast_list(struct net_device *dev);
 static int vmxnet_set_mac_address(struct net_device *dev, void *addr);
@@ -225,6 +229,22 @@ static int disable_lro = 0;
 #endif
 #endif
 
+#ifdef VMXNET_NAPI
+/* Packets received per NAPI poll. */
+static int rx_budget = 64;
+module_param(rx_budget, int, 0444);
+
+/*
+ * Interrupt moderation. vmxnet2 has no coalescing in the device, so after a
+ * poll the driver may leave interrupts off and poll again when a timer
+ * fires. With adaptive moderation (the default) it only does so after a
+ * busy poll, i.e. under high packet rates. Both can be changed with
+ * "ethtool -C <dev> rx-usecs N adaptive-rx on|off".
+ */
+#define VMXNET_DEFAULT_RX_COALESCE_USECS 50
+#define VMXNET_MAX_RX_COALESCE_USECS     1000
+#endif
+
 #ifdef VMXNET_DEBUG
 #define VMXNET_LOG(msg...) printk(KERN_ERR msg)
 #else
@@ -503,11 +523,78 @@ vmxnet_set_tso(struct net_device *dev, u32 data)
 #endif
 
 
+#ifdef VMXNET_NAPI
+/*
+ *----------------------------------------------------------------------------
+ *
+ *  vmxnet_get_coalesce --
+ *
+ *    Ethtool op to get the receive interrupt moderation settings.
+ *
+ *  Results:
+ *    0.
+ *
+ *  Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+vmxnet_get_coalesce(struct net_device *dev,          // IN:
+                    struct ethtool_coalesce *ec)     // OUT:
+{
+   struct Vmxnet_Private *lp = netdev_priv(dev);
+
+   memset(ec, 0, sizeof *ec);
+   ec->rx_coalesce_usecs = lp->rxCoalesceUsecs;
+   ec->use_adaptive_rx_coalesce = lp->adaptiveRxCoalesce;
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ *  vmxnet_set_coalesce --
+ *
+ *    Ethtool op to set the receive interrupt moderation. A delay of 0
+ *    turns moderation off.
+ *
+ *  Results:
+ *    0 if successful, -EINVAL if the delay is out of range.
+ *
+ *  Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+vmxnet_set_coalesce(struct net_device *dev,          // IN:
+                    struct ethtool_coalesce *ec)     // IN:
+{
+   struct Vmxnet_Private *lp = netdev_priv(dev);
+
+   if (ec->rx_coalesce_usecs > VMXNET_MAX_RX_COALESCE_USECS) {
+      return -EINVAL;
+   }
+   lp->rxCoalesceUsecs = ec->rx_coalesce_usecs;
+   lp->adaptiveRxCoalesce = ec->use_adaptive_rx_coalesce != 0;
+   return 0;
+}
+#endif
+
+
 static struct ethtool_ops
 vmxnet_ethtool_ops = {
    .get_settings        = vmxnet_get_settings,
    .get_drvinfo         = vmxnet_get_drvinfo,
    .get_link            = ethtool_op_get_link,
+#ifdef VMXNET_NAPI
+   .get_coalesce        = vmxnet_get_coalesce,
+   .set_coalesce        = vmxnet_set_coalesce,
+#endif
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2, 6, 39)
    .get_rx_csum         = vmxnet_get_rx_csum,
    .set_rx_csum         = vmxnet_set_rx_csum,
@@ -1151,6 +1238,15 @@ vmxnet_probe_device(struct pci_dev             *pdev, // IN: vmxnet PCI device
    COMPAT_SET_MODULE_OWNER(dev);
    COMPAT_SET_NETDEV_DEV(dev, &pdev->dev);
 
+#ifdef VMXNET_NAPI
+   compat_netif_napi_add(dev, &lp->napi, vmxnet_poll,
+                         rx_budget > 0 ? rx_budget : 64);
+   hrtimer_init(&lp->coalesceTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+   lp->coalesceTimer.function = vmxnet_coalesce_timer;
+   lp->rxCoalesceUsecs = VMXNET_DEFAULT_RX_COALESCE_USECS;
+   lp->adaptiveRxCoalesce = TRUE;
+#endif
+
    if (register_netdev(dev)) {
       printk(KERN_ERR "Unable to register device\n");
       goto free_dev_dd;
@@ -1320,6 +1416,11 @@ vmxnet_probe_features(struct net_device *dev, // IN:
    printk( " rxCsum");
 #endif
 
+#if defined(VMXNET_NAPI) && defined(NETIF_F_GRO)
+   dev->features |= NETIF_F_GRO;
+   printk(" gro");
+#endif
+
 #ifdef VMXNET_DO_ZERO_COPY
    if (lp->capabilities & VMNET_CAP_SG &&
        lp->features & VMXNET_FEATURE_ZERO_COPY_TX){
@@ -1935,6 +2036,12 @@ vmxnet_open(struct net_device *dev)
 
    lp->devOpen = TRUE;
 
+#ifdef VMXNET_NAPI
+   compat_napi_enable(dev, &lp->napi);
+   /* The last close may have left them off for a pending poll. */
+   outl(VMXNET_CMD_INTR_ENABLE, ioaddr + VMXNET_COMMAND_ADDR);
+#endif
+
    COMPAT_NETDEV_MOD_INC_USE_COUNT;
 
    return 0;
@@ -2643,10 +2750,10 @@ vmxnet_rx_frags(Vmxnet_Private *lp, struct sk_buff *skb)
  *
  * vmxnet_rx --
  *
- *      Receive a packet.
+ *      Receive up to budget packets.
  *
  * Results:
- *      0
+ *      The number of rx ring entries processed.
  *
  * Side effects:
  *      None.
@@ -2654,16 +2761,18 @@ vmxnet_rx_frags(Vmxnet_Private *lp, struct sk_buff *skb)
  *-----------------------------------------------------------------------------
  */
 static int
-vmxnet_rx(struct net_device *dev)
+vmxnet_rx(struct net_device *dev, // IN:
+          int budget)             // IN:
 {
    struct Vmxnet_Private *lp = netdev_priv(dev);
    Vmxnet2_DriverData *dd = lp->dd;
+   int received = 0;
 
    if (!lp->devOpen || !dd) {
       return 0;
    }
 
-   while (1) {
+   while (received < budget) {
       struct sk_buff *skb, *newSkb;
       Vmxnet2_RxRingEntry *rre;
 
@@ -2740,7 +2849,15 @@ vmxnet_rx(struct net_device *dev)
          lp->stats.rx_bytes += skb->len;
 #endif
          skb->protocol = eth_type_trans(skb, dev);
+#ifdef VMXNET_NAPI
+#   ifdef NETIF_F_GRO
+         napi_gro_receive(&lp->napi, skb);
+#   else
+         netif_receive_skb(skb);
+#   endif
+#else
          netif_rx(skb);
+#endif
          lp->stats.rx_packets++;
          dd->stats.pktsReceived++;
       }
@@ -2748,17 +2865,172 @@ vmxnet_rx(struct net_device *dev)
 next_pkt:
       rre->ownership = VMXNET2_OWNERSHIP_NIC;
       VMXNET_INC(dd->rxDriverNext, dd->rxRingLength);
+      received++;
    }
 
-   return 0;
+   return received;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * vmxnet_tx_complete --
+ *
+ *      Reaps completed transmits and restarts the queue if the device
+ *      has room again.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+static void
+vmxnet_tx_complete(struct net_device *dev)
+{
+   struct Vmxnet_Private *lp = netdev_priv(dev);
+   Vmxnet2_DriverData *dd = lp->dd;
+
+   if (lp->numTxPending > 0) {
+      spin_lock(&lp->txLock);
+      check_tx_queue(dev);
+      spin_unlock(&lp->txLock);
+   }
+
+   if (netif_queue_stopped(dev) && dd && !dd->txStopped) {
+      netif_wake_queue(dev);
+   }
+}
+
+
+#ifdef VMXNET_NAPI
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * vmxnet_rx_pending --
+ *
+ *      Checks whether the device has handed a packet to the driver.
+ *
+ * Results:
+ *      TRUE if there is a packet to receive.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+static Bool
+vmxnet_rx_pending(struct Vmxnet_Private *lp)
+{
+   Vmxnet2_DriverData *dd = lp->dd;
+
+   return lp->devOpen && dd &&
+          lp->rxRing[dd->rxDriverNext].ownership == VMXNET2_OWNERSHIP_DRIVER;
 }
 
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * vmxnet_poll --
+ *
+ *      NAPI poll routine. Reaps transmits and receives up to budget
+ *      packets with device interrupts off. Once the rx ring is drained,
+ *      either turns interrupts back on, or, if interrupt moderation applies,
+ *      leaves them off and has the coalesce timer schedule the next poll.
+ *
+ * Results:
+ *      The number of packets received.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+static int
+vmxnet_poll(struct napi_struct *napi, // IN:
+            int budget)               // IN:
+{
+   struct net_device *dev = napi->dev;
+   struct Vmxnet_Private *lp = netdev_priv(dev);
+   Bool moderate;
+   int received;
+
+   vmxnet_tx_complete(dev);
+
+   received = vmxnet_rx(dev, budget);
+   if (received >= budget) {
+      /* Stay on the poll list. */
+      return received;
+   }
+
+   compat_napi_complete(dev, napi);
+
+   /*
+    * A busy poll (a quarter of the budget or more) means packets arrive
+    * faster than interrupts could usefully deliver them.
+    */
+   moderate = lp->rxCoalesceUsecs > 0 &&
+              (!lp->adaptiveRxCoalesce || received >= budget / 4);
+   if (moderate && lp->devOpen) {
+      hrtimer_start(&lp->coalesceTimer,
+                    ktime_set(0, lp->rxCoalesceUsecs * NSEC_PER_USEC),
+                    HRTIMER_MODE_REL);
+      return received;
+   }
+
+   outl(VMXNET_CMD_INTR_ENABLE, dev->base_addr + VMXNET_COMMAND_ADDR);
+
+   /*
+    * A packet that came in after the last ring check may not raise an
+    * interrupt, so check again now that interrupts are on.
+    */
+   if (vmxnet_rx_pending(lp)) {
+      outl(VMXNET_CMD_INTR_DISABLE, dev->base_addr + VMXNET_COMMAND_ADDR);
+      compat_napi_schedule(dev, napi);
+   }
+
+   return received;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * vmxnet_coalesce_timer --
+ *
+ *      Interrupt moderation timer. Schedules the next poll, with device
+ *      interrupts still off.
+ *
+ * Results:
+ *      HRTIMER_NORESTART.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+static enum hrtimer_restart
+vmxnet_coalesce_timer(struct hrtimer *timer)
+{
+   struct Vmxnet_Private *lp = container_of(timer, struct Vmxnet_Private,
+                                            coalesceTimer);
+
+   compat_napi_schedule(lp->napi.dev, &lp->napi);
+   return HRTIMER_NORESTART;
+}
+#endif
+
 /*
  *-----------------------------------------------------------------------------
  *
  * vmxnet_interrupt --
  *
- *      Interrupt handler.  Calls vmxnet_rx to receive a packet.
+ *      Interrupt handler. With NAPI it turns device interrupts off and
+ *      schedules vmxnet_poll, otherwise it receives and reaps transmits.
  *
  * Results:
  *      None.
@@ -2801,17 +3073,15 @@ vmxnet_interrupt(int irq, void *dev_id)
    dev->interrupt = 1;
 #endif
 
-   vmxnet_rx(dev);
-
-   if (lp->numTxPending > 0) {
-      spin_lock(&lp->txLock);
-      check_tx_queue(dev);
-      spin_unlock(&lp->txLock);
-   }
-
-   if (netif_queue_stopped(dev) && dd && !dd->txStopped) {
-      netif_wake_queue(dev);
+#ifdef VMXNET_NAPI
+   if (LIKELY(lp->devOpen)) {
+      outl(VMXNET_CMD_INTR_DISABLE, dev->base_addr + VMXNET_COMMAND_ADDR);
+      compat_napi_schedule(dev, &lp->napi);
    }
+#else
+   vmxnet_rx(dev, INT_MAX);
+   vmxnet_tx_complete(dev);
+#endif
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,3,43)
    dev->interrupt = 0;
@@ -2886,6 +3156,11 @@ vmxnet_close(struct net_device *dev)
 
    lp->devOpen = FALSE;
 
+#ifdef VMXNET_NAPI
+   compat_napi_disable(dev, &lp->napi);
+   hrtimer_cancel(&lp->coalesceTimer);
+#endif
+
    spin_lock_irqsave(&lp->txLock, flags);
    if (lp->numTxPending > 0) {
       //Wait absurdly long (2sec) for all the pending packets to be returned.
@@ -53,6 +53,15 @@ typedef enum Vmxnet_TxStatus {
 #endif
 #define ASSERT(cond)        VMXNET_ASSERT(cond)
 
+/*
+ * Receive (and tx completion) is done from a NAPI poll on kernels with
+ * struct napi_struct. Older kernels keep doing it in the interrupt handler.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 24)
+#define VMXNET_NAPI
+#include <linux/hrtimer.h>
+#endif
+
 struct Vmxnet2_TxBuf {
    struct sk_buff *skb;
    char    sgForLinear; /* the sg entry mapping the linear part 
@@ -105,6 +114,12 @@ typedef struct Vmxnet_Private {
    dma_addr_t                   txBufferPA;
    struct pci_dev              *pdev;
    struct timer_list            linkCheckTimer;
+#ifdef VMXNET_NAPI
+   struct napi_struct           napi;
+   struct hrtimer               coalesceTimer;     // Delays the next poll
+   unsigned int                 rxCoalesceUsecs;
+   Bool                         adaptiveRxCoalesce;
+#endif
 } Vmxnet_Private;
 
 #endif /* __VMXNETINT_H__ */
@@ -106,6 +106,7 @@
 #include <linux/list.h>
 #include <linux/wait.h>
 #include <linux/init.h>
+#include <linux/highmem.h>
 #include <asm/io.h>
 #if defined(__x86_64__) && LINUX_VERSION_CODE < KERNEL_VERSION(2, 6, 12)
 #   include <linux/ioctl32.h>
@@ -239,6 +240,8 @@ static int VSockVmciDgramRecvmsg(struct kiocb *kiocb, struct socket *sock,
                                  struct msghdr *msg, size_t len, int flags);
 static int VSockVmciStreamSendmsg(struct kiocb *kiocb,
                                  struct socket *sock, struct msghdr *msg, size_t len);
+static ssize_t VSockVmciStreamSendpage(struct socket *sock, struct page *page,
+                                       int offset, size_t size, int flags);
 static int VSockVmciStreamRecvmsg(struct kiocb *kiocb, struct socket *sock,
                                  struct msghdr *msg, size_t len, int flags);
 
@@ -338,7 +341,7 @@ static struct proto_ops vsockVmciStreamOps = {
    .sendmsg    = VSockVmciStreamSendmsg,
    .recvmsg    = VSockVmciStreamRecvmsg,
    .mmap       = sock_no_mmap,
-   .sendpage   = sock_no_sendpage,
+   .sendpage   = VSockVmciStreamSendpage,
 };
 
 static struct file_operations vsockVmciDeviceOps = {
@@ -1074,6 +1077,7 @@ VSockVmciRecvStreamCB(void *data,           // IN
    pkt = (VSockPacket *)dg;
 
    LOG_PACKET(pkt);
+   VSOCK_STATS_CTLPKT_RECV(pkt->type);
 
    /*
     * Find the socket that should handle this packet.  First we look for
@@ -2503,7 +2507,7 @@ __VSockVmciSendControlPkt(VSockPacket *pkt,           // IN
 
    VSockPacket_Init(pkt, src, dst, type, size, mode, wait, proto, handle);
    LOG_PACKET(pkt);
-   VSOCK_STATS_CTLPKT_LOG(pkt->type);
+   VSOCK_STATS_CTLPKT_SENT(pkt->type);
    err = vmci_datagram_send(&pkt->dg);
    if (convertError && (err < 0)) {
       return VSockVmci_ErrorToVSockError(err);
@@ -2930,6 +2934,7 @@ __VSockVmciCreate(struct net *net,       // IN: Network namespace
    vsk->ignoreConnectingRst = FALSE;
    vsk->attachSubId = vsk->detachSubId = VMCI_INVALID_ID;
    vsk->peerShutdown = 0;
+   memset(&vsk->stats, 0, sizeof vsk->stats);
 
    if (parent) {
       psk = vsock_sk(parent);
@@ -3087,10 +3092,6 @@ VSockVmciSkDestruct(struct sock *sk) // IN
    vsockVmciSocketCount--;
    VSockVmciTestUnregister();
    compat_mutex_unlock(&registrationMutex);
-
-   VSOCK_STATS_CTLPKT_DUMP_ALL();
-   VSOCK_STATS_HIST_DUMP_ALL();
-   VSOCK_STATS_TOTALS_DUMP_ALL();
 }
 
 
@@ -3193,8 +3194,6 @@ VSockVmciUnregisterProto(void)
 #else
    proto_unregister(&vsockVmciProto);
 #endif
-
-   VSOCK_STATS_RESET();
 }
 
 
@@ -4576,9 +4575,10 @@ VSockVmciStreamGetsockopt(struct socket *sock,          // IN
 /*
  *----------------------------------------------------------------------------
  *
- * VSockVmciStreamSendmsg --
+ * VSockVmciStreamSend --
  *
- *    Sends a message on the socket.
+ *    Sends data on a stream socket, either a message's iovec (user memory)
+ *    or, if msg is NULL, a kernel buffer.
  *
  * Results:
  *    Number of bytes sent on success, negative error code on failure.
@@ -4590,12 +4590,12 @@ VSockVmciStreamGetsockopt(struct socket *sock,          // IN
  */
 
 static int
-VSockVmciStreamSendmsg(struct kiocb *kiocb,          // UNUSED
-                       struct socket *sock,          // IN: socket to send on
-                       struct msghdr *msg,           // IN: message to send
-                       size_t len)                   // IN: length of message
+VSockVmciStreamSend(struct sock *sk,       // IN: socket to send on
+                    struct msghdr *msg,    // IN: message to send, or NULL
+                    const char *buf,       // IN: kernel data if msg is NULL
+                    size_t len,            // IN: length of data
+                    int flags)             // IN: MSG_* flags
 {
-   struct sock *sk;
    VSockVmciSock *vsk;
    ssize_t totalWritten;
    long timeout;
@@ -4604,19 +4604,20 @@ VSockVmciStreamSendmsg(struct kiocb *kiocb,          // UNUSED
 
    DEFINE_WAIT(wait);
 
-   sk = sock->sk;
+   ASSERT(msg || buf);
+
    vsk = vsock_sk(sk);
    totalWritten = 0;
    err = 0;
 
-   if (msg->msg_flags & MSG_OOB) {
+   if (flags & MSG_OOB) {
       return -EOPNOTSUPP;
    }
 
    lock_sock(sk);
 
    /* Callers should not provide a destination with stream sockets. */
-   if (msg->msg_namelen) {
+   if (msg && msg->msg_namelen) {
       err = sk->sk_state == SS_CONNECTED ? -EISCONN : -EOPNOTSUPP;
       goto out;
    }
@@ -4642,7 +4643,7 @@ VSockVmciStreamSendmsg(struct kiocb *kiocb,          // UNUSED
    /*
     * Wait for room in the produce queue to enqueue our user's data.
     */
-   timeout = sock_sndtimeo(sk, msg->msg_flags & MSG_DONTWAIT);
+   timeout = sock_sndtimeo(sk, flags & MSG_DONTWAIT);
 
    NOTIFYCALLRET(vsk, err, sendInit, sk, &sendData);
    if (err < 0) {
@@ -4671,6 +4672,12 @@ VSockVmciStreamSendmsg(struct kiocb *kiocb,          // UNUSED
             goto outWait;
          }
 
+         /* The notify protocol polled the queue and found space. */
+         if (sendData.pollReady) {
+            sendData.pollReady = FALSE;
+            continue;
+         }
+
          release_sock(sk);
          timeout = schedule_timeout(timeout);
          lock_sock(sk);
@@ -4698,8 +4705,6 @@ VSockVmciStreamSendmsg(struct kiocb *kiocb,          // UNUSED
          goto outWait;
       }
 
-      VSOCK_STATS_STREAM_PRODUCE_HIST(vsk);
-
       NOTIFYCALLRET(vsk, err, sendPreEnqueue, sk, &sendData);
       if (err < 0) {
          goto outWait;
@@ -4712,14 +4717,23 @@ VSockVmciStreamSendmsg(struct kiocb *kiocb,          // UNUSED
        * able to send.
        */
 
-      written = vmci_qpair_enquev(vsk->qpair, msg->msg_iov,
-                                  len - totalWritten, 0);
+      sendData.readyBefore = 0;
+      if (msg) {
+         written = vmci_qpair_enquev_ready(vsk->qpair, msg->msg_iov,
+                                           len - totalWritten, 0,
+                                           &sendData.readyBefore);
+      } else {
+         written = vmci_qpair_enqueue_ready(vsk->qpair, buf + totalWritten,
+                                            len - totalWritten, 0,
+                                            &sendData.readyBefore);
+      }
       if (written < 0) {
          err = -ENOMEM;
          goto outWait;
       }
 
       totalWritten += written;
+      VSOCK_STATS_STREAM_PRODUCE(vsk, MAX(sendData.readyBefore, 0), written);
 
       NOTIFYCALLRET(vsk, err, sendPostEnqueue, sk, written, &sendData);
       if (err < 0) {
@@ -4731,7 +4745,6 @@ VSockVmciStreamSendmsg(struct kiocb *kiocb,          // UNUSED
 
 outWait:
    if (totalWritten > 0) {
-      VSOCK_STATS_STREAM_PRODUCE(totalWritten);
       err = totalWritten;
    }
    finish_wait(sk_sleep(sk), &wait);
@@ -4741,6 +4754,68 @@ out:
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * VSockVmciStreamSendmsg --
+ *
+ *    Sends a message on the socket.
+ *
+ * Results:
+ *    Number of bytes sent on success, negative error code on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+VSockVmciStreamSendmsg(struct kiocb *kiocb,          // UNUSED
+                       struct socket *sock,          // IN: socket to send on
+                       struct msghdr *msg,           // IN: message to send
+                       size_t len)                   // IN: length of message
+{
+   return VSockVmciStreamSend(sock->sk, msg, NULL, len, msg->msg_flags);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * VSockVmciStreamSendpage --
+ *
+ *    Sends part of a page on the socket, for sendfile() and splice().
+ *    The data is copied straight from the page into the produce queue,
+ *    rather than going through an iovec as sock_no_sendpage() would.
+ *
+ * Results:
+ *    Number of bytes sent on success, negative error code on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static ssize_t
+VSockVmciStreamSendpage(struct socket *sock,   // IN: socket to send on
+                        struct page *page,     // IN: page holding the data
+                        int offset,            // IN: offset in the page
+                        size_t size,           // IN: length of data
+                        int flags)             // IN: MSG_* flags
+{
+   char *kaddr;
+   ssize_t ret;
+
+   kaddr = kmap(page);
+   ret = VSockVmciStreamSend(sock->sk, NULL, kaddr + offset, size, flags);
+   kunmap(page);
+
+   return ret;
+}
+
+
 
 /*
  *----------------------------------------------------------------------------
@@ -4947,8 +5022,6 @@ VSockVmciStreamRecvmsg(struct kiocb *kiocb,          // UNUSED
       } else if (ready > 0) {
          ssize_t read;
 
-         VSOCK_STATS_STREAM_CONSUME_HIST(vsk);
-
          NOTIFYCALLRET(vsk, err, recvPreDequeue, sk, target, &recvData);
          if (err < 0) {
             break;
@@ -4968,6 +5041,10 @@ VSockVmciStreamRecvmsg(struct kiocb *kiocb,          // UNUSED
          ASSERT(read <= INT_MAX);
          copied += read;
 
+         if (!(flags & MSG_PEEK)) {
+            VSOCK_STATS_STREAM_CONSUME(vsk, ready, read);
+         }
+
          NOTIFYCALLRET(vsk, err, recvPostDequeue, sk, target, read,
                        !(flags & MSG_PEEK), &recvData);
          if (err < 0) {
@@ -4994,6 +5071,12 @@ VSockVmciStreamRecvmsg(struct kiocb *kiocb,          // UNUSED
             break;
          }
 
+         /* The notify protocol polled the queue and found data. */
+         if (recvData.pollReady) {
+            recvData.pollReady = FALSE;
+            continue;
+         }
+
          release_sock(sk);
          timeout = schedule_timeout(timeout);
          lock_sock(sk);
@@ -5024,8 +5107,6 @@ VSockVmciStreamRecvmsg(struct kiocb *kiocb,          // UNUSED
        */
 
       if (!(flags & MSG_PEEK)) {
-         VSOCK_STATS_STREAM_CONSUME(copied);
-
          /*
           * If the other side has shutdown for sending and there is nothing more
           * to read, then modify the socket state.
@@ -5433,6 +5514,9 @@ VSockVmciInit(void)
    }
 
    VSockVmciInitTables();
+
+   /* Statistics are only for diagnosis, so carry on without them. */
+   VSockVmciStatsInit();
    return 0;
 }
 
@@ -5456,6 +5540,7 @@ VSockVmciInit(void)
 static void __exit
 VSockVmciExit(void)
 {
+   VSockVmciStatsExit();
    unregister_ioctl32_handlers();
    misc_deregister(&vsockVmciDevice);
    compat_mutex_lock(&registrationMutex);
@@ -33,6 +33,7 @@
 #include "vmciKernelAPI.h"
 
 #include "notify.h"
+#include "stats.h"
 
 #ifdef VMX86_DEVEL
 extern int LOGLEVEL_THRESHOLD;
@@ -77,6 +78,7 @@ typedef struct VSockVmciSock {
    long connectTimeout;
    VSockVmciNotify notify;
    VSockVmciNotifyOps *notifyOps;
+   VSockVmciSockStats stats;
    VMCIId attachSubId;
    VMCIId detachSubId;
    /* Listening socket that this came from. */
@@ -741,6 +741,7 @@ VSockVmciNotifyPktRecvInit(struct sock *sk,               // IN
    }
 #endif
 #endif
+   data->pollReady = FALSE;
 
    return 0;
 }
@@ -921,6 +922,7 @@ VSockVmciNotifyPktSendInit(struct sock *sk,               // IN
    data->consumeHead = 0;
    data->produceTail = 0;
 #endif
+   data->pollReady = FALSE;
 
    return 0;
 }
@@ -70,11 +70,33 @@ typedef struct VSockVmciNotifyPkt {
    uint64 consumeQGeneration;
 } VSockVmciNotifyPkt;
 
+/* Control packet counts of a queue state socket, see notifyQState.c. */
+typedef struct VSockVmciNotifyQStateStats {
+   uint64 readSent;
+   uint64 wroteSent;
+   uint64 readRecv;
+   uint64 wroteRecv;
+   uint64 readDeferred;   // Waiting writer not notified yet due to the window
+   uint64 wroteSkipped;   // Enqueues onto a non-empty queue
+   uint64 pollHits;       // Blocks avoided by polling the queue
+   uint64 pollMisses;
+} VSockVmciNotifyQStateStats;
+
 typedef struct VSockVmciNotifyPktQState {
    uint64 writeNotifyWindow;
    uint64 writeNotifyMinWindow;
    Bool peerWaitingWrite;
    Bool peerWaitingWriteDetected;
+   /* Adaptive mode state. Times are in ns unless noted otherwise. */
+   uint64 drainRate;      // Bytes consumed per ms, 0 if not streaming
+   uint64 drainStart;
+   uint64 drainBytes;
+   uint64 readRtt;        // us from a read notification to more data
+   uint64 readSentAt;     // 0 if no read notification is outstanding
+   uint64 readyAtRead;    // Bytes left from before the read notification
+   uint64 pollBudget;
+   uint64 createdAt;
+   VSockVmciNotifyQStateStats stats;
 } VSockVmciNotifyPktQState;
 
 typedef union VSockVmciNotify {
@@ -86,11 +108,14 @@ typedef struct VSockVmciRecvNotifyData {
    uint64 consumeHead;
    uint64 produceTail;
    Bool notifyOnBlock;
+   Bool pollReady;      // Data showed up while polling in recvPreBlock
 } VSockVmciRecvNotifyData;
 
 typedef struct VSockVmciSendNotifyData {
    uint64 consumeHead;
    uint64 produceTail;
+   int64 readyBefore;   // Bytes in the produce queue before the last enqueue
+   Bool pollReady;      // Space showed up while polling in sendPreBlock
 } VSockVmciSendNotifyData;
 
 /* Socket notification callbacks. */
@@ -26,8 +26,13 @@
 
 #include "driver-config.h"
 
+#include <asm/div64.h>
+#include <linux/hrtimer.h>
+#include <linux/moduleparam.h>
 #include <linux/socket.h>
 
+#include "compat_module.h"
+#include "compat_sched.h"
 #include "compat_sock.h"
 
 #include "notify.h"
@@ -36,6 +41,273 @@
 #define PKT_FIELD(vsk, fieldName) \
    (vsk)->notify.pktQState.fieldName
 
+/*
+ * In adaptive mode the receiver keeps track of how fast it drains the
+ * queue and of how long a blocked writer takes to put more data in after
+ * a read notification. While streaming, it holds read notifications back
+ * until the queue is drained down to what it will consume during that
+ * time, so each notification (and writer wakeup) covers more data. Both
+ * sides also poll the queue for a short while before they block.
+ */
+static compat_mod_param_bool vsockNotifyAdaptive = 0;
+static unsigned int vsockNotifyPollUs = 10;
+
+#define VSOCK_NOTIFY_DRAIN_SAMPLE_NS  1000000   // 1 ms
+#define VSOCK_NOTIFY_DRAIN_IDLE_NS    100000000 // 100 ms
+#define VSOCK_NOTIFY_POLL_MIN_NS      1000
+#define VSOCK_NOTIFY_EWMA(avg, sample) \
+   ((avg) == 0 ? (sample) : ((avg) * 7 + (sample)) / 8)
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * VSockVmciNotifyNow --
+ *
+ *      Returns a monotonic timestamp for the adaptive mode.
+ *
+ * Results:
+ *      The current time in ns.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static INLINE uint64
+VSockVmciNotifyNow(void)
+{
+   return ktime_to_ns(ktime_get());
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * VSockVmciNotifyUpdateDrain --
+ *
+ *      Accounts for data dequeued by the receiver. Updates the drain rate,
+ *      and the read notification round trip once the writer has added
+ *      data to the queue after the last read notification.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+VSockVmciNotifyUpdateDrain(VSockVmciSock *vsk,  // IN
+                           ssize_t copied,      // IN
+                           uint64 readyAfter)   // IN: Bytes left in the queue
+{
+   uint64 now;
+   uint64 elapsed;
+   uint64 sample;
+
+   now = VSockVmciNotifyNow();
+
+   if (PKT_FIELD(vsk, readSentAt) != 0) {
+      if (readyAfter + copied > PKT_FIELD(vsk, readyAtRead)) {
+         sample = now - PKT_FIELD(vsk, readSentAt);
+         do_div(sample, 1000);
+         PKT_FIELD(vsk, readRtt) =
+            VSOCK_NOTIFY_EWMA(PKT_FIELD(vsk, readRtt), sample);
+         PKT_FIELD(vsk, readSentAt) = 0;
+      } else {
+         PKT_FIELD(vsk, readyAtRead) = readyAfter;
+      }
+   }
+
+   PKT_FIELD(vsk, drainBytes) += copied;
+   elapsed = now - PKT_FIELD(vsk, drainStart);
+   if (elapsed < VSOCK_NOTIFY_DRAIN_SAMPLE_NS) {
+      return;
+   }
+
+   if (elapsed > VSOCK_NOTIFY_DRAIN_IDLE_NS) {
+      /* The queue sat idle, so this isn't a stream. */
+      PKT_FIELD(vsk, drainRate) = 0;
+   } else {
+      sample = PKT_FIELD(vsk, drainBytes) * 1000000;
+      do_div(sample, (uint32)elapsed);
+      PKT_FIELD(vsk, drainRate) =
+         VSOCK_NOTIFY_EWMA(PKT_FIELD(vsk, drainRate), sample);
+   }
+   PKT_FIELD(vsk, drainStart) = now;
+   PKT_FIELD(vsk, drainBytes) = 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * VSockVmciNotifyStreamWindow --
+ *
+ *      Computes the smallest write notify window that still lets a blocked
+ *      writer refill the queue before the receiver drains it.
+ *
+ * Results:
+ *      The window in bytes, or 0 if the socket isn't streaming or the
+ *      adaptive mode is off.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static uint64
+VSockVmciNotifyStreamWindow(VSockVmciSock *vsk) // IN
+{
+   uint64 window;
+
+   if (!vsockNotifyAdaptive ||
+       PKT_FIELD(vsk, drainRate) == 0 ||
+       PKT_FIELD(vsk, readRtt) == 0) {
+      return 0;
+   }
+
+   window = PKT_FIELD(vsk, drainRate) * PKT_FIELD(vsk, readRtt);
+   do_div(window, 1000);
+   window = MAX(window, PKT_FIELD(vsk, writeNotifyMinWindow));
+
+   return MIN(window, vsk->consumeSize);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * VSockVmciNotifyPoll --
+ *
+ *      Polls the queue indices for data (or space) before the caller
+ *      blocks. The time spent polling is halved each time it doesn't pay
+ *      off and doubled when it does, up to notify_poll_us.
+ *
+ * Results:
+ *      TRUE if the queue is ready (or in error) and the caller shouldn't
+ *      block, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+VSockVmciNotifyPoll(VSockVmciSock *vsk,  // IN
+                    Bool forRead)        // IN: Wait for data, not space
+{
+   uint64 maxBudget;
+   uint64 deadline;
+   Bool ready;
+
+   if (!vsockNotifyAdaptive || vsockNotifyPollUs == 0) {
+      return FALSE;
+   }
+
+   maxBudget = (uint64)vsockNotifyPollUs * 1000;
+   PKT_FIELD(vsk, pollBudget) = MIN(PKT_FIELD(vsk, pollBudget), maxBudget);
+   deadline = VSockVmciNotifyNow() + PKT_FIELD(vsk, pollBudget);
+
+   do {
+      ready = forRead ? VSockVmciStreamHasData(vsk) != 0 :
+                        VSockVmciStreamHasSpace(vsk) != 0;
+      if (ready) {
+         break;
+      }
+      cpu_relax();
+   } while (VSockVmciNotifyNow() < deadline &&
+            !need_resched() &&
+            !signal_pending(current));
+
+   if (ready) {
+      PKT_FIELD(vsk, stats).pollHits++;
+      PKT_FIELD(vsk, pollBudget) =
+         MIN(MAX(PKT_FIELD(vsk, pollBudget) * 2, VSOCK_NOTIFY_POLL_MIN_NS),
+             maxBudget);
+   } else {
+      PKT_FIELD(vsk, stats).pollMisses++;
+      PKT_FIELD(vsk, pollBudget) = MAX(PKT_FIELD(vsk, pollBudget) / 2,
+                                       VSOCK_NOTIFY_POLL_MIN_NS);
+   }
+
+   return ready;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * VSockVmciNotifyRate --
+ *
+ *      Converts a packet count to a rate.
+ *
+ * Results:
+ *      Packets per second over the given lifetime.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static uint64
+VSockVmciNotifyRate(uint64 count,     // IN
+                    uint64 lifetime)  // IN: ns
+{
+   uint64 ms = lifetime;
+
+   do_div(ms, 1000000);
+   if (ms == 0) {
+      return count * 1000;
+   }
+   count *= 1000;
+   do_div(count, (uint32)MIN(ms, (uint64)MAX_UINT32));
+
+   return count;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * VSockVmciNotifyResetState --
+ *
+ *      Resets the notification state of a socket.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+VSockVmciNotifyResetState(VSockVmciSock *vsk) // IN
+{
+   PKT_FIELD(vsk, writeNotifyWindow) = PAGE_SIZE;
+   PKT_FIELD(vsk, writeNotifyMinWindow) = PAGE_SIZE;
+   PKT_FIELD(vsk, peerWaitingWrite) = FALSE;
+   PKT_FIELD(vsk, peerWaitingWriteDetected) = FALSE;
+   PKT_FIELD(vsk, drainRate) = 0;
+   PKT_FIELD(vsk, drainStart) = VSockVmciNotifyNow();
+   PKT_FIELD(vsk, drainBytes) = 0;
+   PKT_FIELD(vsk, readRtt) = 0;
+   PKT_FIELD(vsk, readSentAt) = 0;
+   PKT_FIELD(vsk, readyAtRead) = 0;
+   PKT_FIELD(vsk, pollBudget) = (uint64)vsockNotifyPollUs * 1000;
+   PKT_FIELD(vsk, createdAt) = PKT_FIELD(vsk, drainStart);
+   memset(&PKT_FIELD(vsk, stats), 0, sizeof PKT_FIELD(vsk, stats));
+}
+
 
 /*
  *----------------------------------------------------------------------------
@@ -73,8 +345,17 @@ VSockVmciNotifyWaitingWrite(VSockVmciSock *vsk)    // IN
     */
 
    if (!PKT_FIELD(vsk, peerWaitingWriteDetected)) {
+      uint64 streamWindow = VSockVmciNotifyStreamWindow(vsk);
+
       PKT_FIELD(vsk, peerWaitingWriteDetected) = TRUE;
-      if (PKT_FIELD(vsk, writeNotifyWindow) < PAGE_SIZE) {
+      if (streamWindow != 0) {
+         /*
+          * While streaming, go straight for the window that just covers
+          * the writer's response time instead of a page at a time.
+          */
+         PKT_FIELD(vsk, writeNotifyWindow) =
+            MAX(PKT_FIELD(vsk, writeNotifyWindow) / 2, streamWindow);
+      } else if (PKT_FIELD(vsk, writeNotifyWindow) < PAGE_SIZE) {
          PKT_FIELD(vsk, writeNotifyWindow) =
             PKT_FIELD(vsk, writeNotifyMinWindow);
       } else {
@@ -108,6 +389,8 @@ VSockVmciNotifyWaitingWrite(VSockVmciSock *vsk)    // IN
        */
 
       PKT_FIELD(vsk, peerWaitingWriteDetected) = FALSE;
+   } else {
+      PKT_FIELD(vsk, stats).readDeferred++;
    }
    return retval;
 }
@@ -136,7 +419,7 @@ VSockVmciHandleRead(struct sock *sk,            // IN
                     struct sockaddr_vm *dst,    // IN: unused
                     struct sockaddr_vm *src)    // IN: unused
 {
-
+   PKT_FIELD(vsock_sk(sk), stats).readRecv++;
    sk->sk_write_space(sk);
 }
 
@@ -164,6 +447,7 @@ VSockVmciHandleWrote(struct sock *sk,            // IN
                      struct sockaddr_vm *dst,    // IN: unused
                      struct sockaddr_vm *src)    // IN: unused
 {
+   PKT_FIELD(vsock_sk(sk), stats).wroteRecv++;
    sk->sk_data_ready(sk, 0);
 }
 
@@ -255,6 +539,16 @@ VSockVmciSendReadNotification(struct sock *sk)  // IN
       } else {
          PKT_FIELD(vsk, peerWaitingWrite) = FALSE;
       }
+
+      if (sentRead) {
+         int64 freeSpace = vmci_qpair_consume_free_space(vsk->qpair);
+
+         PKT_FIELD(vsk, stats).readSent++;
+         if (vsockNotifyAdaptive && freeSpace >= 0) {
+            PKT_FIELD(vsk, readSentAt) = VSockVmciNotifyNow();
+            PKT_FIELD(vsk, readyAtRead) = vsk->consumeSize - freeSpace;
+         }
+      }
    }
    return err;
 }
@@ -283,10 +577,7 @@ VSockVmciNotifyPktSocketInit(struct sock *sk) // IN
    VSockVmciSock *vsk;
    vsk = vsock_sk(sk);
 
-   PKT_FIELD(vsk, writeNotifyWindow) = PAGE_SIZE;
-   PKT_FIELD(vsk, writeNotifyMinWindow) = PAGE_SIZE;
-   PKT_FIELD(vsk, peerWaitingWrite) = FALSE;
-   PKT_FIELD(vsk, peerWaitingWriteDetected) = FALSE;
+   VSockVmciNotifyResetState(vsk);
 }
 
 
@@ -310,12 +601,28 @@ static void
 VSockVmciNotifyPktSocketDestruct(struct sock *sk) // IN
 {
    VSockVmciSock *vsk;
+   VSockVmciNotifyQStateStats *stats;
+   uint64 lifetime;
+
    vsk = vsock_sk(sk);
+   stats = &PKT_FIELD(vsk, stats);
+   lifetime = VSockVmciNotifyNow() - PKT_FIELD(vsk, createdAt);
+
+   if (vsockNotifyAdaptive) {
+      Log("socket %p sent %"FMT64"u read (%"FMT64"u/s) and %"FMT64"u wrote "
+          "(%"FMT64"u/s) notifications, received %"FMT64"u read "
+          "(%"FMT64"u/s) and %"FMT64"u wrote (%"FMT64"u/s); "
+          "deferred %"FMT64"u read, skipped %"FMT64"u wrote; "
+          "polls %"FMT64"u hit, %"FMT64"u missed\n", sk,
+          stats->readSent, VSockVmciNotifyRate(stats->readSent, lifetime),
+          stats->wroteSent, VSockVmciNotifyRate(stats->wroteSent, lifetime),
+          stats->readRecv, VSockVmciNotifyRate(stats->readRecv, lifetime),
+          stats->wroteRecv, VSockVmciNotifyRate(stats->wroteRecv, lifetime),
+          stats->readDeferred, stats->wroteSkipped,
+          stats->pollHits, stats->pollMisses);
+   }
 
-   PKT_FIELD(vsk, writeNotifyWindow) = PAGE_SIZE;
-   PKT_FIELD(vsk, writeNotifyMinWindow) = PAGE_SIZE;
-   PKT_FIELD(vsk, peerWaitingWrite) = FALSE;
-   PKT_FIELD(vsk, peerWaitingWriteDetected) = FALSE;
+   VSockVmciNotifyResetState(vsk);
 }
 
 
@@ -445,6 +752,7 @@ VSockVmciNotifyPktRecvInit(struct sock *sk,               // IN
    data->consumeHead = 0;
    data->produceTail = 0;
    data->notifyOnBlock = FALSE;
+   data->pollReady = FALSE;
 
    if (PKT_FIELD(vsk, writeNotifyMinWindow) < target + 1) {
       ASSERT(target < vsk->consumeSize);
@@ -512,6 +820,10 @@ VSockVmciNotifyPktRecvPreBlock(struct sock *sk,               // IN
       data->notifyOnBlock = FALSE;
    }
 
+   if (VSockVmciNotifyPoll(vsock_sk(sk), TRUE)) {
+      data->pollReady = TRUE;
+   }
+
    return err;
 }
 
@@ -556,6 +868,10 @@ VSockVmciNotifyPktRecvPostDequeue(struct sock *sk,               // IN
       freeSpace = vmci_qpair_consume_free_space(vsk->qpair);
       wasFull = freeSpace == copied;
 
+      if (vsockNotifyAdaptive && freeSpace <= vsk->consumeSize) {
+         VSockVmciNotifyUpdateDrain(vsk, copied, vsk->consumeSize - freeSpace);
+      }
+
       if (wasFull) {
          PKT_FIELD(vsk, peerWaitingWrite) = TRUE;
       }
@@ -597,6 +913,43 @@ VSockVmciNotifyPktSendInit(struct sock *sk,               // IN
 
    data->consumeHead = 0;
    data->produceTail = 0;
+   data->pollReady = FALSE;
+
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * VSockVmciNotifyPktSendPreBlock --
+ *
+ *      Called right before a socket is about to block with the socket lock
+ *      held. The socket lock may have been released between the entry
+ *      function and the preblock call.
+ *
+ *      Note: This function may be called multiple times before the post
+ *      block function is called.
+ *
+ * Results:
+ *      0 on success. A negative error code on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int32
+VSockVmciNotifyPktSendPreBlock(struct sock *sk,               // IN
+                               VSockVmciSendNotifyData *data) // IN
+{
+   ASSERT(sk);
+   ASSERT(data);
+
+   if (VSockVmciNotifyPoll(vsock_sk(sk), FALSE)) {
+      data->pollReady = TRUE;
+   }
 
    return 0;
 }
@@ -635,9 +988,15 @@ VSockVmciNotifyPktSendPostEnqueue(struct sock *sk,               // IN
 
    vsk = vsock_sk(sk);
 
-   Atomic_MFence();
-
-   wasEmpty = (vmci_qpair_produce_buf_ready(vsk->qpair) == written);
+   /*
+    * The peer only sleeps on an empty queue, so it needs a wrote
+    * notification only if this enqueue is what made the queue non-empty.
+    * Otherwise it hasn't caught up with data it was already told about
+    * (or is still reading), and another notification would be wasted.
+    * The enqueue sampled the queue under its own lock, sparing us another
+    * lock and header mapping here.
+    */
+   wasEmpty = written > 0 && data->readyBefore == 0;
    if (wasEmpty) {
       while (!(vsk->peerShutdown & RCV_SHUTDOWN) &&
              !sentWrote &&
@@ -649,6 +1008,12 @@ VSockVmciNotifyPktSendPostEnqueue(struct sock *sk,               // IN
 
          retries++;
       }
+   } else if (written > 0) {
+      PKT_FIELD(vsk, stats).wroteSkipped++;
+   }
+
+   if (sentWrote) {
+      PKT_FIELD(vsk, stats).wroteSent++;
    }
 
    if (retries >= VSOCK_MAX_DGRAM_RESENDS && !sentWrote) {
@@ -783,9 +1148,14 @@ VSockVmciNotifyOps vSockVmciNotifyPktQStateOps = {
    NULL, /* recvPreDequeue */
    VSockVmciNotifyPktRecvPostDequeue,
    VSockVmciNotifyPktSendInit,
-   NULL, /* sendPreBlock */
+   VSockVmciNotifyPktSendPreBlock,
    NULL, /* sendPreEnqueue */
    VSockVmciNotifyPktSendPostEnqueue,
    VSockVmciNotifyPktProcessRequest,
    VSockVmciNotifyPktProcessNegotiate,
 };
+
+module_param_named(notify_adaptive, vsockNotifyAdaptive, bool, 0644);
+MODULE_PARM_DESC(notify_adaptive, "Adapt stream notifications to the drain rate and notification round trip, and log control packet rates on close");
+module_param_named(notify_poll_us, vsockNotifyPollUs, uint, 0644);
+MODULE_PARM_DESC(notify_poll_us, "Microseconds to poll the queue before blocking in adaptive mode (10 by default)");
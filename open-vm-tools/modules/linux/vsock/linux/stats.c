@@ -24,16 +24,223 @@
 
 #include "driver-config.h"
 
+#include <linux/module.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 #include <linux/socket.h>
 #include "compat_sock.h"
+#include "compat_version.h"
 
 #include "af_vsock.h"
 #include "stats.h"
+#include "util.h"
 
-#ifdef VSOCK_GATHER_STATISTICS
-uint64 vSockStatsCtlPktCount[VSOCK_PACKET_TYPE_MAX];
-uint64 vSockStatsConsumeQueueHist[VSOCK_NUM_QUEUE_LEVEL_BUCKETS];
-uint64 vSockStatsProduceQueueHist[VSOCK_NUM_QUEUE_LEVEL_BUCKETS];
-Atomic_uint64 vSockStatsConsumeTotal;
-Atomic_uint64 vSockStatsProduceTotal;
+#define VSOCK_STATS_PROC_NAME "driver/vsock_stats"
+
+DEFINE_PER_CPU(VSockVmciStats, vSockStats);
+
+static struct proc_dir_entry *vsockStatsEntry;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * VSockVmciStatsShowQueue --
+ *
+ *      Prints the byte count and queue level histogram of a queue.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+VSockVmciStatsShowQueue(struct seq_file *m,         // IN
+                        const char *name,           // IN
+                        VSockVmciQueueStats *queue) // IN
+{
+   uint32 index;
+
+   seq_printf(m, " %s %"FMT64"u", name, queue->bytes);
+   for (index = 0; index < ARRAYSIZE(queue->hist); index++) {
+      seq_printf(m, " %"FMT64"u", queue->hist[index]);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * VSockVmciStatsShow --
+ *
+ *      Prints the module wide statistics summed over all CPUs, followed by
+ *      the queue statistics of each connected socket.
+ *
+ *      Control packets are listed as "ctlpkt <type> <sent> <received>".
+ *      Queues are listed as "<produce|consume> <bytes> <10 buckets>", where
+ *      bucket N counts the operations that found the queue between N*10%
+ *      and (N+1)*10% full.
+ *
+ * Results:
+ *      0.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+VSockVmciStatsShow(struct seq_file *m, // IN
+                   void *v)            // IN: unused
+{
+   VSockVmciStats total;
+   uint32 cpu;
+   uint32 i;
+   uint32 index;
+
+   memset(&total, 0, sizeof total);
+
+   for_each_possible_cpu(cpu) {
+      VSockVmciStats *stats = &per_cpu(vSockStats, cpu);
+
+      for (index = 0; index < VSOCK_PACKET_TYPE_MAX; index++) {
+         total.ctlPktSent[index] += stats->ctlPktSent[index];
+         total.ctlPktRecv[index] += stats->ctlPktRecv[index];
+      }
+      for (index = 0; index < VSOCK_NUM_QUEUE_LEVEL_BUCKETS; index++) {
+         total.stream.produce.hist[index] += stats->stream.produce.hist[index];
+         total.stream.consume.hist[index] += stats->stream.consume.hist[index];
+      }
+      total.stream.produce.bytes += stats->stream.produce.bytes;
+      total.stream.consume.bytes += stats->stream.consume.bytes;
+   }
+
+   for (index = 0; index < VSOCK_PACKET_TYPE_MAX; index++) {
+      seq_printf(m, "ctlpkt %s %"FMT64"u %"FMT64"u\n",
+                 vsockPacketTypeStrings[index],
+                 total.ctlPktSent[index], total.ctlPktRecv[index]);
+   }
+
+   seq_printf(m, "stream");
+   VSockVmciStatsShowQueue(m, "produce", &total.stream.produce);
+   VSockVmciStatsShowQueue(m, "consume", &total.stream.consume);
+   seq_printf(m, "\n");
+
+   spin_lock_bh(&vsockTableLock);
+   for (i = 0; i < ARRAYSIZE(vsockConnectedTable); i++) {
+      VSockVmciSock *vsk;
+
+      list_for_each_entry(vsk, &vsockConnectedTable[i], connectedTable) {
+         seq_printf(m, "socket %u:%u %u:%u",
+                    vsk->localAddr.svm_cid, vsk->localAddr.svm_port,
+                    vsk->remoteAddr.svm_cid, vsk->remoteAddr.svm_port);
+         VSockVmciStatsShowQueue(m, "produce", &vsk->stats.produce);
+         VSockVmciStatsShowQueue(m, "consume", &vsk->stats.consume);
+         seq_printf(m, "\n");
+      }
+   }
+   spin_unlock_bh(&vsockTableLock);
+
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * VSockVmciStatsOpen --
+ *
+ *      Opens the statistics proc file.
+ *
+ * Results:
+ *      0 on success, negative error code on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+VSockVmciStatsOpen(struct inode *inode, // IN
+                   struct file *file)   // IN
+{
+   return single_open(file, VSockVmciStatsShow, NULL);
+}
+
+
+static struct file_operations vsockStatsFileOps = {
+   .owner   = THIS_MODULE,
+   .open    = VSockVmciStatsOpen,
+   .read    = seq_read,
+   .llseek  = seq_lseek,
+   .release = single_release,
+};
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * VSockVmciStatsInit --
+ *
+ *      Creates /proc/driver/vsock_stats.
+ *
+ * Results:
+ *      0 on success, -ENOMEM on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+VSockVmciStatsInit(void)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 26)
+   vsockStatsEntry = proc_create(VSOCK_STATS_PROC_NAME, S_IRUGO, NULL,
+                                 &vsockStatsFileOps);
+#else
+   vsockStatsEntry = create_proc_entry(VSOCK_STATS_PROC_NAME, S_IRUGO, NULL);
+   if (vsockStatsEntry) {
+      vsockStatsEntry->proc_fops = &vsockStatsFileOps;
+   }
 #endif
+   if (!vsockStatsEntry) {
+      Warning("Could not create /proc/" VSOCK_STATS_PROC_NAME "\n");
+      return -ENOMEM;
+   }
+
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * VSockVmciStatsExit --
+ *
+ *      Removes /proc/driver/vsock_stats.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+VSockVmciStatsExit(void)
+{
+   if (vsockStatsEntry) {
+      remove_proc_entry(VSOCK_STATS_PROC_NAME, NULL);
+      vsockStatsEntry = NULL;
+   }
+}
@@ -27,6 +27,8 @@
 
 #include "driver-config.h"
 
+#include <linux/percpu.h>
+
 #include "vm_basic_math.h"
 
 #include "vsockCommon.h"
@@ -34,58 +36,74 @@
 
 
 /*
- * Define VSOCK_GATHER_STATISTICS to turn on statistics gathering.
- * Currently this consists of 3 types of stats:
- * 1. The number of control datagram messages sent.
+ * Statistics are always gathered. They consist of:
+ * 1. The number of control datagram messages sent and received, by type.
  * 2. The level of queuepair fullness (in 10% buckets) whenever data is
- *    about to be enqueued or dequeued from the queuepair.
+ *    enqueued or dequeued from the queuepair.
  * 3. The total number of bytes enqueued/dequeued.
+ *
+ * Module wide counters are kept per CPU so that updating them doesn't
+ * bounce a cache line between CPUs. Each socket also keeps its own queue
+ * level histograms and byte counts, updated under the socket lock. All of
+ * it is reported by /proc/driver/vsock_stats.
  */
 
-//#define VSOCK_GATHER_STATISTICS 1
+#define VSOCK_NUM_QUEUE_LEVEL_BUCKETS 10
 
-#ifdef VSOCK_GATHER_STATISTICS
+typedef struct VSockVmciQueueStats {
+   uint64 hist[VSOCK_NUM_QUEUE_LEVEL_BUCKETS];
+   uint64 bytes;
+} VSockVmciQueueStats;
 
-#define VSOCK_NUM_QUEUE_LEVEL_BUCKETS 10
-extern uint64 vSockStatsCtlPktCount[VSOCK_PACKET_TYPE_MAX];
-extern uint64 vSockStatsConsumeQueueHist[VSOCK_NUM_QUEUE_LEVEL_BUCKETS];
-extern uint64 vSockStatsProduceQueueHist[VSOCK_NUM_QUEUE_LEVEL_BUCKETS];
-extern Atomic_uint64 vSockStatsConsumeTotal;
-extern Atomic_uint64 vSockStatsProduceTotal;
+typedef struct VSockVmciSockStats {
+   VSockVmciQueueStats produce;
+   VSockVmciQueueStats consume;
+} VSockVmciSockStats;
+
+typedef struct VSockVmciStats {
+   uint64 ctlPktSent[VSOCK_PACKET_TYPE_MAX];
+   uint64 ctlPktRecv[VSOCK_PACKET_TYPE_MAX];
+   VSockVmciSockStats stream;
+} VSockVmciStats;
 
-#define VSOCK_STATS_STREAM_CONSUME_HIST(vsk)                            \
-   VSockVmciStatsUpdateQueueBucketCount((vsk)->qpair,                   \
-                                        (vsk)->consumeSize,             \
-                               VMCIQPair_ConsumeBufReady((vsk)->qpair), \
-                                        vSockStatsConsumeQueueHist)
-#define VSOCK_STATS_STREAM_PRODUCE_HIST(vsk)                            \
-   VSockVmciStatsUpdateQueueBucketCount((vsk)->qpair,                   \
-                                        (vsk)->produceSize,             \
-                               VMCIQPair_ProduceBufReady((vsk)->qpair), \
-                                        vSockStatsProduceQueueHist)
-#define VSOCK_STATS_CTLPKT_LOG(pktType)                                 \
+DECLARE_PER_CPU(VSockVmciStats, vSockStats);
+
+int VSockVmciStatsInit(void);
+void VSockVmciStatsExit(void);
+
+/*
+ * A bottom half may update the counters of the CPU it interrupted, so an
+ * increment may rarely be lost. That is acceptable for statistics and
+ * cheaper than disabling bottom halves on every update.
+ */
+#define VSOCK_STATS_CTLPKT_COUNT(field, pktType)                        \
    do {                                                                 \
-      ++vSockStatsCtlPktCount[pktType];                                 \
+      if ((pktType) < VSOCK_PACKET_TYPE_MAX) {                          \
+         ++get_cpu_var(vSockStats).field[pktType];                      \
+         put_cpu_var(vSockStats);                                       \
+      }                                                                 \
    } while (0)
-#define VSOCK_STATS_STREAM_CONSUME(bytes)                               \
-   Atomic_ReadAdd64(&vSockStatsConsumeTotal, bytes)
-#define VSOCK_STATS_STREAM_PRODUCE(bytes)                               \
-   Atomic_ReadAdd64(&vSockStatsProduceTotal, bytes)
-#define VSOCK_STATS_CTLPKT_DUMP_ALL() VSockVmciStatsCtlPktDumpAll()
-#define VSOCK_STATS_HIST_DUMP_ALL()   VSockVmciStatsHistDumpAll()
-#define VSOCK_STATS_TOTALS_DUMP_ALL() VSockVmciStatsTotalsDumpAll()
-#define VSOCK_STATS_RESET()           VSockVmciStatsReset()
+#define VSOCK_STATS_CTLPKT_SENT(pktType)                                \
+   VSOCK_STATS_CTLPKT_COUNT(ctlPktSent, pktType)
+#define VSOCK_STATS_CTLPKT_RECV(pktType)                                \
+   VSOCK_STATS_CTLPKT_COUNT(ctlPktRecv, pktType)
+#define VSOCK_STATS_STREAM_CONSUME(vsk, ready, bytes)                   \
+   VSockVmciStatsUpdateQueue(&(vsk)->stats, FALSE, (vsk)->consumeSize,  \
+                             ready, bytes)
+#define VSOCK_STATS_STREAM_PRODUCE(vsk, ready, bytes)                   \
+   VSockVmciStatsUpdateQueue(&(vsk)->stats, TRUE, (vsk)->produceSize,   \
+                             ready, bytes)
+
 
 /*
  *----------------------------------------------------------------------------
  *
- * VSockVmciStatsUpdateQueueBucketCount --
+ * VSockVmciStatsQueueBucket --
  *
- *      Given a queue, determine how much data is enqueued and add that to
- *      the specified queue level statistic bucket.
+ *      Determines the queue level bucket for the amount of data enqueued.
  *
  * Results:
- *      None.
+ *      The bucket index.
  *
  * Side effects:
  *      None.
@@ -93,104 +111,37 @@ extern Atomic_uint64 vSockStatsProduceTotal;
  *----------------------------------------------------------------------------
  */
 
-static INLINE void
-VSockVmciStatsUpdateQueueBucketCount(VMCIQPair *qpair,   // IN
-                                     uint64 queueSize,   // IN
-                                     uint64 dataReady,   // IN
-                                     uint64 queueHist[]) // IN/OUT
+static INLINE uint32
+VSockVmciStatsQueueBucket(uint64 queueSize,   // IN
+                          uint64 dataReady)   // IN
 {
    uint64 bucket = 0;
    uint32 remainder = 0;
 
-   ASSERT(qpair);
-   ASSERT(queueHist);
+   if (queueSize == 0) {
+      return 0;
+   }
 
    /*
     * We can't do 64 / 64 = 64 bit divides on linux because it requires a
-    * libgcc which is not linked into the kernel module. Since this code is
-    * only used by developers we just limit the queueSize to be less than
-    * MAX_UINT for now.
+    * libgcc which is not linked into the kernel module. Queue pairs are
+    * far smaller than 4GB, so we limit the queueSize to MAX_UINT32.
     */
    ASSERT(queueSize <= MAX_UINT32);
-   Div643264(dataReady * 10, queueSize, &bucket, &remainder);
-   ASSERT(bucket < VSOCK_NUM_QUEUE_LEVEL_BUCKETS);
-   ++queueHist[bucket];
-}
-
-
-/*
- *----------------------------------------------------------------------------
- *
- * VSockVmciStatsCtlPktDumpAll --
- *
- *      Prints all stream control packet counts out to the console using
- *      the appropriate platform logging.
- *
- * Results:
- *      None.
- *
- * Side effects:
- *      None.
- *
- *----------------------------------------------------------------------------
- */
-
-static INLINE void
-VSockVmciStatsCtlPktDumpAll(void)
-{
-   uint32 index;
-
-   ASSERT_ON_COMPILE(VSOCK_PACKET_TYPE_MAX ==
-		     ARRAYSIZE(vSockStatsCtlPktCount));
-
-   for (index = 0; index < ARRAYSIZE(vSockStatsCtlPktCount); index++) {
-      Warning("Control packet count: Type = %u, Count = %"FMT64"u\n",
-              index, vSockStatsCtlPktCount[index]);
-   }
-}
-
-
-/*
- *----------------------------------------------------------------------------
- *
- * VSockVmciStatsHistDumpAll --
- *
- *      Prints the produce and consume queue histograms to the console.
- *
- * Results:
- *      None.
- *
- * Side effects:
- *      None.
- *
- *----------------------------------------------------------------------------
- */
-
-static INLINE void
-VSockVmciStatsHistDumpAll(void)
-{
-   uint32 index;
+   Div643264(MIN(dataReady, queueSize) * 10, queueSize, &bucket, &remainder);
 
-   #define VSOCK_DUMP_HIST(strname, name) do {             \
-      for (index = 0; index < ARRAYSIZE(name); index++) {  \
-         Warning(strname " Bucket count %u = %"FMT64"u\n", \
-              index, name[index]);                         \
-      }                                                    \
-   } while (0)
-
-   VSOCK_DUMP_HIST("Produce Queue", vSockStatsProduceQueueHist);
-   VSOCK_DUMP_HIST("Consume Queue", vSockStatsConsumeQueueHist);
-
-   #undef VSOCK_DUMP_HIST
+   /* A full queue goes into the top bucket. */
+   return MIN((uint32)bucket, VSOCK_NUM_QUEUE_LEVEL_BUCKETS - 1);
 }
 
 
 /*
  *----------------------------------------------------------------------------
  *
- * VSockVmciStatsTotalsDumpAll --
+ * VSockVmciStatsUpdateQueue --
  *
- *      Prints the produce and consume totals.
+ *      Accounts for data enqueued to or dequeued from a stream socket's
+ *      queue pair in the socket's and this CPU's statistics.
  *
  * Results:
  *      None.
@@ -202,62 +153,29 @@ VSockVmciStatsHistDumpAll(void)
  */
 
 static INLINE void
-VSockVmciStatsTotalsDumpAll(void)
+VSockVmciStatsUpdateQueue(VSockVmciSockStats *sockStats, // IN/OUT
+                          Bool produce,                  // IN
+                          uint64 queueSize,              // IN
+                          uint64 dataReady,              // IN: before the op
+                          uint64 bytes)                  // IN
 {
-   Warning("Produced %"FMT64"u total bytes\n",
-           Atomic_Read64(&vSockStatsProduceTotal));
-   Warning("Consumed %"FMT64"u total bytes\n",
-           Atomic_Read64(&vSockStatsConsumeTotal));
-}
+   VSockVmciSockStats *cpuStats;
+   VSockVmciQueueStats *queue;
+   uint32 bucket;
 
+   ASSERT(sockStats);
 
-/*
- *----------------------------------------------------------------------------
- *
- * VSockVmciStatsReset --
- *
- *      Reset all VSock statistics.
- *
- * Results:
- *      None.
- *
- * Side effects:
- *      None.
- *
- *----------------------------------------------------------------------------
- */
+   bucket = VSockVmciStatsQueueBucket(queueSize, dataReady);
 
-static INLINE void
-VSockVmciStatsReset(void)
-{
-   uint32 index;
+   queue = produce ? &sockStats->produce : &sockStats->consume;
+   ++queue->hist[bucket];
+   queue->bytes += bytes;
 
-   #define VSOCK_RESET_ARRAY(name) do {                   \
-      for (index = 0; index < ARRAYSIZE(name); index++) { \
-         name[index] = 0;                                 \
-      }                                                   \
-   } while (0)
-
-   VSOCK_RESET_ARRAY(vSockStatsCtlPktCount);
-   VSOCK_RESET_ARRAY(vSockStatsProduceQueueHist);
-   VSOCK_RESET_ARRAY(vSockStatsConsumeQueueHist);
-
-   #undef VSOCK_RESET_ARRAY
-
-   Atomic_Write64(&vSockStatsConsumeTotal, 0);
-   Atomic_Write64(&vSockStatsProduceTotal, 0);
+   cpuStats = &get_cpu_var(vSockStats).stream;
+   queue = produce ? &cpuStats->produce : &cpuStats->consume;
+   ++queue->hist[bucket];
+   queue->bytes += bytes;
+   put_cpu_var(vSockStats);
 }
 
-#else
-#define VSOCK_STATS_STREAM_CONSUME_HIST(vsk)
-#define VSOCK_STATS_STREAM_PRODUCE_HIST(vsk)
-#define VSOCK_STATS_STREAM_PRODUCE(bytes)
-#define VSOCK_STATS_STREAM_CONSUME(bytes)
-#define VSOCK_STATS_CTLPKT_LOG(pktType)
-#define VSOCK_STATS_CTLPKT_DUMP_ALL()
-#define VSOCK_STATS_HIST_DUMP_ALL()
-#define VSOCK_STATS_TOTALS_DUMP_ALL()
-#define VSOCK_STATS_RESET()
-#endif // VSOCK_GATHER_STATISTICS
-
 #endif // __STATS_H__
@@ -36,6 +36,22 @@ struct list_head vsockConnectedTable[VSOCK_HASH_SIZE];
 
 DEFINE_SPINLOCK(vsockTableLock);
 
+char const *vsockPacketTypeStrings[VSOCK_PACKET_TYPE_MAX] = {
+   [VSOCK_PACKET_TYPE_INVALID]        = "INVALID",
+   [VSOCK_PACKET_TYPE_REQUEST]        = "REQUEST",
+   [VSOCK_PACKET_TYPE_NEGOTIATE]      = "NEGOTIATE",
+   [VSOCK_PACKET_TYPE_OFFER]          = "OFFER",
+   [VSOCK_PACKET_TYPE_ATTACH]         = "ATTACH",
+   [VSOCK_PACKET_TYPE_WROTE]          = "WROTE",
+   [VSOCK_PACKET_TYPE_READ]           = "READ",
+   [VSOCK_PACKET_TYPE_RST]            = "RST",
+   [VSOCK_PACKET_TYPE_SHUTDOWN]       = "SHUTDOWN",
+   [VSOCK_PACKET_TYPE_WAITING_WRITE]  = "WAITING_WRITE",
+   [VSOCK_PACKET_TYPE_WAITING_READ]   = "WAITING_READ",
+   [VSOCK_PACKET_TYPE_REQUEST2]       = "REQUEST2",
+   [VSOCK_PACKET_TYPE_NEGOTIATE2]     = "NEGOTIATE2",
+};
+
 
 /*
  *----------------------------------------------------------------------------
@@ -62,21 +78,6 @@ VSockVmciLogPkt(char const *function,   // IN
    char *cur = buf;
    int left = sizeof buf;
    int written = 0;
-   char *typeStrings[] = {
-      [VSOCK_PACKET_TYPE_INVALID]        = "INVALID",
-      [VSOCK_PACKET_TYPE_REQUEST]        = "REQUEST",
-      [VSOCK_PACKET_TYPE_NEGOTIATE]      = "NEGOTIATE",
-      [VSOCK_PACKET_TYPE_OFFER]          = "OFFER",
-      [VSOCK_PACKET_TYPE_ATTACH]         = "ATTACH",
-      [VSOCK_PACKET_TYPE_WROTE]          = "WROTE",
-      [VSOCK_PACKET_TYPE_READ]           = "READ",
-      [VSOCK_PACKET_TYPE_RST]            = "RST",
-      [VSOCK_PACKET_TYPE_SHUTDOWN]       = "SHUTDOWN",
-      [VSOCK_PACKET_TYPE_WAITING_WRITE]  = "WAITING_WRITE",
-      [VSOCK_PACKET_TYPE_WAITING_READ]   = "WAITING_READ",
-      [VSOCK_PACKET_TYPE_REQUEST2]       = "REQUEST2",
-      [VSOCK_PACKET_TYPE_NEGOTIATE2]     = "NEGOTIATE2",
-   };
 
    written = snprintf(cur, left, "PKT: %u:%u -> %u:%u",
                       VMCI_HANDLE_TO_CONTEXT_ID(pkt->dg.src),
@@ -94,13 +95,13 @@ VSockVmciLogPkt(char const *function,   // IN
    case VSOCK_PACKET_TYPE_REQUEST:
    case VSOCK_PACKET_TYPE_NEGOTIATE:
       written = snprintf(cur, left, ", %s, size = %"FMT64"u",
-                         typeStrings[pkt->type], pkt->u.size);
+                         vsockPacketTypeStrings[pkt->type], pkt->u.size);
       break;
 
    case VSOCK_PACKET_TYPE_OFFER:
    case VSOCK_PACKET_TYPE_ATTACH:
       written = snprintf(cur, left, ", %s, handle = %u:%u",
-                         typeStrings[pkt->type],
+                         vsockPacketTypeStrings[pkt->type],
                          VMCI_HANDLE_TO_CONTEXT_ID(pkt->u.handle),
                          VMCI_HANDLE_TO_RESOURCE_ID(pkt->u.handle));
       break;
@@ -108,7 +109,7 @@ VSockVmciLogPkt(char const *function,   // IN
    case VSOCK_PACKET_TYPE_WROTE:
    case VSOCK_PACKET_TYPE_READ:
    case VSOCK_PACKET_TYPE_RST:
-      written = snprintf(cur, left, ", %s", typeStrings[pkt->type]);
+      written = snprintf(cur, left, ", %s", vsockPacketTypeStrings[pkt->type]);
       break;
    case VSOCK_PACKET_TYPE_SHUTDOWN: {
       Bool recv;
@@ -117,7 +118,7 @@ VSockVmciLogPkt(char const *function,   // IN
       recv = pkt->u.mode & RCV_SHUTDOWN;
       send = pkt->u.mode & SEND_SHUTDOWN;
       written = snprintf(cur, left, ", %s, mode = %c%c",
-                         typeStrings[pkt->type],
+                         vsockPacketTypeStrings[pkt->type],
                          recv ? 'R' : ' ',
                          send ? 'S' : ' ');
    }
@@ -126,7 +127,7 @@ VSockVmciLogPkt(char const *function,   // IN
    case VSOCK_PACKET_TYPE_WAITING_WRITE:
    case VSOCK_PACKET_TYPE_WAITING_READ:
       written = snprintf(cur, left, ", %s, generation = %"FMT64"u, "
-                         "offset = %"FMT64"u", typeStrings[pkt->type],
+                         "offset = %"FMT64"u", vsockPacketTypeStrings[pkt->type],
                          pkt->u.wait.generation, pkt->u.wait.offset);
 
       break;
@@ -135,7 +136,7 @@ VSockVmciLogPkt(char const *function,   // IN
    case VSOCK_PACKET_TYPE_NEGOTIATE2:
       written = snprintf(cur, left, ", %s, size = %"FMT64"u, "
                          "proto = %u",
-                         typeStrings[pkt->type], pkt->u.size,
+                         vsockPacketTypeStrings[pkt->type], pkt->u.size,
                          pkt->proto);
       break;
 
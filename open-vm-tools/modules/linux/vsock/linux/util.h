@@ -57,6 +57,8 @@ extern struct list_head vsockConnectedTable[VSOCK_HASH_SIZE];
 
 extern spinlock_t vsockTableLock;
 
+extern char const *vsockPacketTypeStrings[VSOCK_PACKET_TYPE_MAX];
+
 #define VSOCK_HASH(addr)        ((addr)->svm_port % (VSOCK_HASH_SIZE - 1))
 #define vsockBoundSockets(addr) (&vsockBindTable[VSOCK_HASH(addr)])
 #define vsockUnboundSockets     (&vsockBindTable[VSOCK_HASH_SIZE])
@@ -77,6 +77,7 @@
 
 typedef struct BlockInfo {
    DblLnkLst_Links links;
+   uint32 hash;
    os_atomic_t refcount;
    os_blocker_id_t blocker;
    os_completion_t completion;
@@ -84,11 +85,77 @@ typedef struct BlockInfo {
 } BlockInfo;
 
 
-/* XXX: Is it worth turning this into a hash table? */
-static DblLnkLst_Links blockedFiles;
+/*
+ * Blocks are hashed by filename into a fixed number of buckets, since a
+ * DnD of a large selection adds a block for every file in it and every
+ * access to the mount looks them up.
+ */
+#define BLOCK_HASH_BUCKETS 64   /* Must be a power of 2 */
+
+static DblLnkLst_Links blockedFiles[BLOCK_HASH_BUCKETS];
 static os_rwlock_t blockedFilesLock;
 static os_kmem_cache_t *blockInfoCache;
 
+/*
+ * Number of blocks in blockedFiles.  Only changed with the lock held for
+ * writing, but read without the lock so the common case of nothing being
+ * blocked doesn't have to take it at all.
+ */
+static os_atomic_t blockCount;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BlockHashFilename --
+ *
+ *    Hashes the provided filename (FNV-1a).
+ *
+ * Results:
+ *    The hash value.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static uint32
+BlockHashFilename(const char *filename)  // IN: filename to hash
+{
+   uint32 hash = 2166136261U;
+
+   while (*filename != '\0') {
+      hash ^= (unsigned char)*filename++;
+      hash *= 16777619U;
+   }
+
+   return hash;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BlockBucket --
+ *
+ *    Returns the list holding blocks with the provided filename hash.
+ *
+ * Results:
+ *    Pointer to the bucket's list head.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static DblLnkLst_Links *
+BlockBucket(uint32 hash)  // IN: filename hash
+{
+   return &blockedFiles[hash & (BLOCK_HASH_BUCKETS - 1)];
+}
+
 
 /*
  *----------------------------------------------------------------------------
@@ -109,6 +176,8 @@ static os_kmem_cache_t *blockInfoCache;
 int
 BlockInit(void)
 {
+   unsigned int i;
+
    ASSERT(!blockInfoCache);
 
    blockInfoCache = os_kmem_cache_create("blockInfoCache",
@@ -119,7 +188,10 @@ BlockInit(void)
       return OS_ENOMEM;
    }
 
-   DblLnkLst_Init(&blockedFiles);
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      DblLnkLst_Init(&blockedFiles[i]);
+   }
+   os_atomic_set(&blockCount, 0);
    os_rwlock_init(&blockedFilesLock);
 
    return 0;
@@ -145,8 +217,14 @@ BlockInit(void)
 void
 BlockCleanup(void)
 {
+   unsigned int i;
+
    ASSERT(blockInfoCache);
-   ASSERT(!DblLnkLst_IsLinked(&blockedFiles));
+   ASSERT(os_atomic_read(&blockCount) == 0);
+
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      ASSERT(!DblLnkLst_IsLinked(&blockedFiles[i]));
+   }
 
    os_rwlock_destroy(&blockedFilesLock);
    os_kmem_cache_destroy(blockInfoCache);
@@ -191,6 +269,7 @@ AllocBlock(os_kmem_cache_t *cache,        // IN: cache to allocate from
    }
 
    DblLnkLst_Init(&block->links);
+   block->hash = BlockHashFilename(block->filename);
    os_atomic_set(&block->refcount, 1);
    os_completion_init(&block->completion);
    block->blocker = blocker;
@@ -311,7 +390,9 @@ static BlockInfo *
 GetBlock(const char *filename,          // IN: file to find block for
          const os_blocker_id_t blocker) // IN: blocker associated with this block
 {
+   struct DblLnkLst_Links *bucket;
    struct DblLnkLst_Links *curr;
+   uint32 hash;
 
    /*
     * On FreeBSD we have a mechanism to assert (but not simply check)
@@ -325,9 +406,17 @@ GetBlock(const char *filename,          // IN: file to find block for
    ASSERT(os_rwlock_held(&blockedFilesLock));
 #endif
 
-   DblLnkLst_ForEach(curr, &blockedFiles) {
+   if (os_atomic_read(&blockCount) == 0) {
+      return NULL;
+   }
+
+   hash = BlockHashFilename(filename);
+   bucket = BlockBucket(hash);
+
+   DblLnkLst_ForEach(curr, bucket) {
       BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      if ((blocker == OS_UNKNOWN_BLOCKER || currBlock->blocker == blocker) &&
+      if (currBlock->hash == hash &&
+          (blocker == OS_UNKNOWN_BLOCKER || currBlock->blocker == blocker) &&
           strcmp(currBlock->filename, filename) == 0) {
          return currBlock;
       }
@@ -360,6 +449,7 @@ BlockDoRemoveBlock(BlockInfo *block)
    ASSERT(block);
 
    DblLnkLst_Unlink1(&block->links);
+   os_atomic_dec(&blockCount);
 
    /* Wake up waiters, if any */
    LOG(4, "Completing block on [%s] (%d waiters)\n",
@@ -418,7 +508,8 @@ BlockAddFileBlock(const char *filename,           // IN: name of file to block
       goto out;
    }
 
-   DblLnkLst_LinkLast(&blockedFiles, &block->links);
+   DblLnkLst_LinkLast(BlockBucket(block->hash), &block->links);
+   os_atomic_inc(&blockCount);
    LOG(4, "added block for [%s]\n", filename);
    retval = 0;
 
@@ -494,20 +585,23 @@ BlockRemoveAllBlocks(const os_blocker_id_t blocker)  // IN: blocker to remove bl
    struct DblLnkLst_Links *curr;
    struct DblLnkLst_Links *tmp;
    unsigned int removed = 0;
+   unsigned int i;
 
    os_write_lock(&blockedFilesLock);
 
-   DblLnkLst_ForEachSafe(curr, tmp, &blockedFiles) {
-      BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      if (currBlock->blocker == blocker || blocker == OS_UNKNOWN_BLOCKER) {
+   for (i = 0; i < BLOCK_HASH_BUCKETS && os_atomic_read(&blockCount) > 0; i++) {
+      DblLnkLst_ForEachSafe(curr, tmp, &blockedFiles[i]) {
+         BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
+         if (currBlock->blocker == blocker || blocker == OS_UNKNOWN_BLOCKER) {
 
-         BlockDoRemoveBlock(currBlock);
+            BlockDoRemoveBlock(currBlock);
 
-         /*
-          * We count only entries removed from the -list-, regardless of whether
-          * or not other waiters exist.
-          */
-         ++removed;
+            /*
+             * We count only entries removed from the -list-, regardless of
+             * whether or not other waiters exist.
+             */
+            ++removed;
+         }
       }
    }
 
@@ -552,6 +646,11 @@ BlockWaitOnFile(const char *filename,   // IN: file to block on
     * blocking here.)
     */
    if (cookie == NULL) {
+      if (os_atomic_read(&blockCount) == 0) {
+         /* Nothing is blocked at all, don't bother with the lock */
+         return 0;
+      }
+
       os_read_lock(&blockedFilesLock);
       block = GetBlock(filename, OS_UNKNOWN_BLOCKER);
       if (block) {
@@ -606,6 +705,10 @@ BlockLookup(const char *filename,               // IN: pathname to test for
 {
    BlockInfo *block;
 
+   if (os_atomic_read(&blockCount) == 0) {
+      return NULL;
+   }
+
    os_read_lock(&blockedFilesLock);
 
    block = GetBlock(filename, blocker);
@@ -640,14 +743,17 @@ void
 BlockListFileBlocks(void)
 {
    DblLnkLst_Links *curr;
+   unsigned int i;
    int count = 0;
 
    os_read_lock(&blockedFilesLock);
 
-   DblLnkLst_ForEach(curr, &blockedFiles) {
-      BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      LOG(1, "BlockListFileBlocks: (%d) Filename: [%s], Blocker: [%p]\n",
-          count++, currBlock->filename, currBlock->blocker);
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      DblLnkLst_ForEach(curr, &blockedFiles[i]) {
+         BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
+         LOG(1, "BlockListFileBlocks: (%d) Filename: [%s], Blocker: [%p]\n",
+             count++, currBlock->filename, currBlock->blocker);
+      }
    }
 
    os_read_unlock(&blockedFilesLock);
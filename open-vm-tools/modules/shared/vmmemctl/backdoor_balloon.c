@@ -114,6 +114,38 @@ BackdoorCmd(uint16 cmd,     // IN
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * BackdoorStatsLatency --
+ *
+ *      Accounts for a lock or unlock call that started at "start", in its
+ *      log2 latency histogram.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+BackdoorStatsLatency(uint32 *histogram, // IN/OUT
+                     uint64 start)      // IN: OS_GetUptimeUs() at the call
+{
+   uint64 elapsed = OS_GetUptimeUs() - start;
+   unsigned int bucket = 0;
+
+   while (elapsed > 1 && bucket < BALLOON_LATENCY_BUCKETS - 1) {
+      elapsed >>= 1;
+      bucket++;
+   }
+   STATS_INC(histogram[bucket]);
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -274,16 +306,19 @@ Backdoor_MonitorLockPage(Balloon *b,     // IN/OUT
 {
    int status;
    uint32 ppn32 = (uint32)ppn;
+   uint64 start;
 
    /* Ensure PPN fits in 32-bits, i.e. guest memory is limited to 16TB. */
    if (ppn32 != ppn) {
       return BALLOON_ERROR_PPN_INVALID;
    }
 
+   start = OS_GetUptimeUs();
    status = BackdoorCmd(BALLOON_BDOOR_CMD_LOCK, ppn32, 0, target,
                         &b->resetFlag);
 
    /* update stats */
+   BackdoorStatsLatency(b->stats.lockLatency[FALSE], start);
    STATS_INC(b->stats.lock[FALSE]);
    if (status != BALLOON_SUCCESS) {
       STATS_INC(b->stats.lockFail[FALSE]);
@@ -318,16 +353,19 @@ Backdoor_MonitorUnlockPage(Balloon *b,     // IN/OUT
 {
    int status;
    uint32 ppn32 = (uint32)ppn;
+   uint64 start;
 
    /* Ensure PPN fits in 32-bits, i.e. guest memory is limited to 16TB. */
    if (ppn32 != ppn) {
       return BALLOON_ERROR_PPN_INVALID;
    }
 
+   start = OS_GetUptimeUs();
    status = BackdoorCmd(BALLOON_BDOOR_CMD_UNLOCK, ppn32, 0, target,
                         &b->resetFlag);
 
    /* update stats */
+   BackdoorStatsLatency(b->stats.unlockLatency[FALSE], start);
    STATS_INC(b->stats.unlock[FALSE]);
    if (status != BALLOON_SUCCESS) {
       STATS_INC(b->stats.unlockFail[FALSE]);
@@ -361,6 +399,7 @@ Backdoor_MonitorLockPagesBatched(Balloon *b,      // IN/OUT
 {
    int status;
    uint16 cmd;
+   uint64 start;
 
    if (isLargePage) {
       cmd = BALLOON_BDOOR_CMD_BATCHED_2M_LOCK;
@@ -368,9 +407,11 @@ Backdoor_MonitorLockPagesBatched(Balloon *b,      // IN/OUT
       cmd = BALLOON_BDOOR_CMD_BATCHED_LOCK;
    }
 
+   start = OS_GetUptimeUs();
    status = BackdoorCmd(cmd, (size_t)ppn, nPages, target, &b->resetFlag);
 
    /* update stats */
+   BackdoorStatsLatency(b->stats.lockLatency[isLargePage], start);
    STATS_INC(b->stats.lock[isLargePage]);
    if (status != BALLOON_SUCCESS) {
       STATS_INC(b->stats.lockFail[isLargePage]);
@@ -404,6 +445,7 @@ Backdoor_MonitorUnlockPagesBatched(Balloon *b,      // IN/OUT
 {
    int status;
    uint16 cmd;
+   uint64 start;
 
    if (isLargePage) {
       cmd = BALLOON_BDOOR_CMD_BATCHED_2M_UNLOCK;
@@ -411,9 +453,11 @@ Backdoor_MonitorUnlockPagesBatched(Balloon *b,      // IN/OUT
       cmd = BALLOON_BDOOR_CMD_BATCHED_UNLOCK;
    }
 
+   start = OS_GetUptimeUs();
    status = BackdoorCmd(cmd, (size_t)ppn, nPages, target, &b->resetFlag);
 
    /* update stats */
+   BackdoorStatsLatency(b->stats.unlockLatency[isLargePage], start);
    STATS_INC(b->stats.unlock[isLargePage]);
    if (status != BALLOON_SUCCESS) {
       STATS_INC(b->stats.unlockFail[isLargePage]);
@@ -67,7 +67,8 @@
 #define BALLOON_NAME_VERBOSE            "VMware memory control driver"
 
 // Capabilities for Windows are defined at run-tine (see nt/vmballoon.c)
-#if defined __linux__ || (defined __APPLE__ && defined __LP64__)
+#if defined __linux__ || (defined __APPLE__ && defined __LP64__) || \
+    (defined __FreeBSD__ && __FreeBSD__ >= 10)
 #define BALLOON_CAPABILITIES    (BALLOON_BASIC_CMDS|BALLOON_BATCHED_CMDS|\
                                  BALLOON_BATCHED_2M_CMDS)
 #elif defined __FreeBSD__ || (defined __APPLE__ && !defined __LP64__)
@@ -82,14 +83,23 @@
 #define BALLOON_DEBUG_VERBOSE   0
 
 #define BALLOON_POLL_PERIOD             1 /* sec */
-#define BALLOON_NOSLEEP_ALLOC_MAX       16384
+
+/*
+ * Rates are in allocations (or frees) per poll period; a large page counts as
+ * one. The nosleep rate doubles while allocations keep succeeding and the
+ * target isn't met, and halves when they start failing. The other rates
+ * grow by an eighth (at least the increment) after each successful period,
+ * and halve on failure.
+ */
+#define BALLOON_NOSLEEP_ALLOC_MIN       16384
+#define BALLOON_NOSLEEP_ALLOC_MAX       262144
 
 #define BALLOON_RATE_ALLOC_MIN          512
 #define BALLOON_RATE_ALLOC_MAX          2048
 #define BALLOON_RATE_ALLOC_INC          16
 
 #define BALLOON_RATE_FREE_MIN           512
-#define BALLOON_RATE_FREE_MAX           16384
+#define BALLOON_RATE_FREE_MAX           262144
 #define BALLOON_RATE_FREE_INC           16
 
 /*
@@ -100,14 +110,26 @@
  */
 #define BALLOON_PAGE_ALLOC_FAILURE      1000
 
+/* Number of monitor status codes, BALLOON_SUCCESS included. */
+#define BALLOON_ERROR_NR                (BALLOON_ERROR_BUSY + 1)
+
+/*
+ * Lock and unlock hypercall latencies are kept as log2 histograms: bucket i
+ * counts the calls that took from 2^i up to 2^(i+1) microseconds, bucket 0
+ * also the faster ones and the last bucket also the slower ones.
+ */
+#define BALLOON_LATENCY_BUCKETS         16
+
 #define BALLOON_STATS
 
 #ifdef	BALLOON_STATS
 #define	STATS_INC(stat)	(stat)++
 #define	STATS_DEC(stat)	(stat)--
+#define	STATS_ADD(stat, n)	(stat) += (n)
 #else
 #define	STATS_INC(stat)
 #define	STATS_DEC(stat)
+#define	STATS_ADD(stat, n)
 #endif
 
 #define PPN_2_PA(_ppn)  ((PPN64)(_ppn) << PAGE_SHIFT)
@@ -95,6 +95,7 @@ extern void *OS_Malloc(size_t size);
 extern void OS_Free(void *ptr, size_t size);
 
 extern void OS_Yield(void);
+extern uint64 OS_GetUptimeUs(void);
 
 extern unsigned long OS_ReservedPageGetLimit(void);
 extern PA64          OS_ReservedPageGetPA(PageHandle handle);
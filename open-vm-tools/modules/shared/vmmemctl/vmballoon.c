@@ -135,6 +135,18 @@ static const struct BalloonOps balloonOpsBatched = {
    .unlock = BalloonUnlockBatched
 };
 
+static const char *const balloonErrorNames[BALLOON_ERROR_NR] = {
+   [BALLOON_SUCCESS]             = "success",
+   [BALLOON_ERROR_CMD_INVALID]   = "cmdInvalid",
+   [BALLOON_ERROR_PPN_INVALID]   = "ppnInvalid",
+   [BALLOON_ERROR_PPN_LOCKED]    = "ppnLocked",
+   [BALLOON_ERROR_PPN_UNLOCKED]  = "ppnUnlocked",
+   [BALLOON_ERROR_PPN_PINNED]    = "ppnPinned",
+   [BALLOON_ERROR_PPN_NOTNEEDED] = "ppnNotNeeded",
+   [BALLOON_ERROR_RESET]         = "reset",
+   [BALLOON_ERROR_BUSY]          = "busy",
+};
+
 /*
  *----------------------------------------------------------------------
  *
@@ -165,14 +177,75 @@ Balloon_GetStats(void)
     */
    stats->nPages = b->nPages;
    stats->nPagesTarget = b->nPagesTarget;
-   stats->rateNoSleepAlloc = BALLOON_NOSLEEP_ALLOC_MAX;
+   stats->rateNoSleepAlloc = b->rateNoSleepAlloc;
    stats->rateAlloc = b->rateAlloc;
    stats->rateFree = b->rateFree;
 
+   /* and about the way it currently talks to the monitor */
+   stats->capabilities = b->hypervisorCapabilities;
+   stats->batchMaxEntries = b->batchMaxEntries;
+   stats->nChunks[FALSE] = b->pages[FALSE].nChunks;
+   stats->nChunks[TRUE] = b->pages[TRUE].nChunks;
+   stats->slowPageAllocationCycles = b->slowPageAllocationCycles;
+
    return stats;
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * Balloon_GetErrorName --
+ *
+ *      Names a monitor status, e.g. to label the lockRefused and
+ *      unlockRefused statistics.
+ *
+ * Results:
+ *      The name, NULL if status isn't a monitor status.
+ *
+ * Side effects:
+ *      None
+ *
+ *----------------------------------------------------------------------
+ */
+
+const char *
+Balloon_GetErrorName(int status) // IN
+{
+   if (status < 0 || status >= BALLOON_ERROR_NR) {
+      return NULL;
+   }
+   return balloonErrorNames[status];
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BalloonStatsRefused --
+ *
+ *      Accounts for pages the monitor didn't lock or unlock.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+BalloonStatsRefused(uint32 *refused,  // IN/OUT: lockRefused or unlockRefused
+                    int status,       // IN: monitor status
+                    uint32 nPages)    // IN
+{
+   if (status > BALLOON_SUCCESS && status < BALLOON_ERROR_NR) {
+      STATS_ADD(refused[status], nPages);
+   }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -430,6 +503,7 @@ Balloon_QueryAndExecute(void)
 {
    Balloon *b = &globalBalloon;
    uint32 target = 0; // Silence compiler warning.
+   int nPages = b->nPages;
    int status;
 
    /* update stats */
@@ -453,6 +527,12 @@ Balloon_QueryAndExecute(void)
       b->nPagesTarget = target;
       BalloonAdjustSize(b, target);
    }
+
+   /* update stats, resets count as deflation */
+   b->stats.periodInflated = MAX(b->nPages - nPages, 0);
+   b->stats.periodDeflated = MAX(nPages - b->nPages, 0);
+   STATS_ADD(b->stats.inflated, b->stats.periodInflated);
+   STATS_ADD(b->stats.deflated, b->stats.periodDeflated);
 }
 
 
@@ -793,7 +873,7 @@ BalloonInflate(Balloon *b,      // IN/OUT
     * than sleeping allocation rate.
     */
    rate = b->slowPageAllocationCycles ?
-                b->rateAlloc : BALLOON_NOSLEEP_ALLOC_MAX;
+                b->rateAlloc : b->rateNoSleepAlloc;
 
    nEntries = 0;
    while (b->nPages < target &&
@@ -824,6 +904,7 @@ BalloonInflate(Balloon *b,      // IN/OUT
                status = b->balloonOps->lock(b, nEntries, TRUE, &target);
                nEntries = 0;
             }
+            STATS_INC(b->stats.primLPageFallback);
 
             /* Continue with small pages */
             isLargePages = FALSE;
@@ -838,6 +919,8 @@ BalloonInflate(Balloon *b,      // IN/OUT
              * switch to sleeping allocations.
              */
             b->slowPageAllocationCycles = SLOW_PAGE_ALLOCATION_CYCLES;
+            b->rateNoSleepAlloc = MAX(b->rateNoSleepAlloc / 2,
+                                      BALLOON_NOSLEEP_ALLOC_MIN);
 
             /* Lower rate for sleeping allocations. */
             rate = b->rateAlloc;
@@ -893,10 +976,23 @@ BalloonInflate(Balloon *b,      // IN/OUT
    if (status == BALLOON_SUCCESS && allocations >= b->rateAlloc) {
       unsigned int mult = allocations / b->rateAlloc;
 
-      b->rateAlloc = MIN(b->rateAlloc + mult * BALLOON_RATE_ALLOC_INC,
+      b->rateAlloc = MIN(b->rateAlloc + MAX(mult * BALLOON_RATE_ALLOC_INC,
+                                            b->rateAlloc / 8),
                          BALLOON_RATE_ALLOC_MAX);
    }
 
+   /*
+    * The whole nosleep budget went without the guest running short of
+    * memory, and the target is still ahead: the host is waiting for memory,
+    * so allocate faster next time.
+    */
+   if (status == BALLOON_SUCCESS && allocType != BALLOON_PAGE_ALLOC_CANSLEEP &&
+       rate == b->rateNoSleepAlloc && allocations >= rate &&
+       b->nPages < target) {
+      b->rateNoSleepAlloc = MIN(b->rateNoSleepAlloc * 2,
+                                BALLOON_NOSLEEP_ALLOC_MAX);
+   }
+
    /* release non-balloonable pages, succeed */
    BalloonErrorPagesFree(b);
 }
@@ -947,6 +1043,7 @@ BalloonLockBatched(Balloon *b,       // IN/OUT
    }
 
    if (status != BALLOON_SUCCESS) {
+      BalloonStatsRefused(b->stats.lockRefused, status, nEntries);
       for (i = 0; i < nEntries; i++) {
          PA64 pa = Balloon_BatchGetPA(b->batchPage, i);
          handle = OS_ReservedPageGetHandle(pa);
@@ -966,6 +1063,7 @@ BalloonLockBatched(Balloon *b,       // IN/OUT
       handle = OS_ReservedPageGetHandle(pa);
       error = Balloon_BatchGetStatus(b->batchPage, i);
       if (error != BALLOON_SUCCESS) {
+         BalloonStatsRefused(b->stats.lockRefused, error, 1);
          switch (error) {
          case BALLOON_ERROR_PPN_PINNED:
          case BALLOON_ERROR_PPN_INVALID:
@@ -1050,6 +1148,7 @@ BalloonUnlockBatched(Balloon *b,       // IN/OUT
                                                isLargePages, target);
 
    if (status != BALLOON_SUCCESS) {
+      BalloonStatsRefused(b->stats.unlockRefused, status, nEntries);
       for (i = 0; i < nEntries; i++) {
          PA64 pa = Balloon_BatchGetPA(b->batchPage, i);
          PageHandle handle = OS_ReservedPageGetHandle(pa);
@@ -1067,6 +1166,7 @@ BalloonUnlockBatched(Balloon *b,       // IN/OUT
       PageHandle handle = OS_ReservedPageGetHandle(pa);
 
       if (status != BALLOON_SUCCESS) {
+         BalloonStatsRefused(b->stats.unlockRefused, status, 1);
          chunk = BalloonGetChunkOrFallback(b, isLargePages);
          BalloonPageStore(chunk, handle);
          continue;
@@ -1161,6 +1261,8 @@ BalloonLock(Balloon *b,       // IN/OUT
    if (status != BALLOON_SUCCESS) {
       int old_status = status;
 
+      BalloonStatsRefused(b->stats.lockRefused, status, 1);
+
       /* We need to release the chunk if it was just allocated */
       BalloonChunkDestroyEmpty(b, chunk, isLargePage);
 
@@ -1223,6 +1325,8 @@ BalloonUnlock(Balloon *b,      // IN/OUT
 
    if (status != BALLOON_SUCCESS) {
       BalloonChunk *chunk = BalloonGetChunkOrFallback(b, FALSE);
+
+      BalloonStatsRefused(b->stats.unlockRefused, status, 1);
       BalloonPageStore(chunk, b->pageHandle);
       goto out;
    }
@@ -1349,8 +1453,9 @@ BalloonDeflateInt(Balloon *b,       // IN/OUT
 
    if (BALLOON_RATE_ADAPT) {
       if (status == BALLOON_SUCCESS) {
-         /* slowly increase rate if no errors */
-         b->rateFree = MIN(b->rateFree + BALLOON_RATE_FREE_INC,
+         /* increase rate if no errors */
+         b->rateFree = MIN(b->rateFree + MAX(BALLOON_RATE_FREE_INC,
+                                             b->rateFree / 8),
                            BALLOON_RATE_FREE_MAX);
       } else {
          /* quickly decrease rate if error */
@@ -1447,6 +1552,7 @@ Balloon_Init(BalloonGuest guestType)    // IN
    b->guestType = guestType;
 
    /* initialize rates */
+   b->rateNoSleepAlloc = BALLOON_NOSLEEP_ALLOC_MIN;
    b->rateAlloc = BALLOON_RATE_ALLOC_MAX;
    b->rateFree  = BALLOON_RATE_FREE_MAX;
 
@@ -92,15 +92,28 @@ typedef struct {
    uint32 rateAlloc;
    uint32 rateFree;
 
+   /* current mode */
+   uint32 capabilities;
+   uint32 batchMaxEntries;      // 1 when the monitor doesn't batch
+   uint32 nChunks[2];
+   uint32 slowPageAllocationCycles;
+
    /* high-level operations */
    uint32 timer;
 
+   /* size changes (in small pages), overall and in the last poll period */
+   uint32 inflated;
+   uint32 deflated;
+   uint32 periodInflated;
+   uint32 periodDeflated;
+
    /* primitives */
    uint32 primAlloc[BALLOON_PAGE_ALLOC_TYPES_NR];
    uint32 primAllocFail[BALLOON_PAGE_ALLOC_TYPES_NR];
    uint32 primFree[2];
    uint32 primErrorPageAlloc[2];
    uint32 primErrorPageFree[2];
+   uint32 primLPageFallback;    // inflations that fell back to small pages
 
    /* monitor operations */
    uint32 lock[2];
@@ -113,6 +126,14 @@ typedef struct {
    uint32 startFail;
    uint32 guestType;
    uint32 guestTypeFail;
+
+   /* pages the monitor didn't lock or unlock, by status */
+   uint32 lockRefused[BALLOON_ERROR_NR];
+   uint32 unlockRefused[BALLOON_ERROR_NR];
+
+   /* monitor call latencies, see BALLOON_LATENCY_BUCKETS */
+   uint32 lockLatency[2][BALLOON_LATENCY_BUCKETS];
+   uint32 unlockLatency[2][BALLOON_LATENCY_BUCKETS];
 } BalloonStats;
 
 #define BALLOON_ERROR_PAGES             16
@@ -156,6 +177,7 @@ typedef struct {
    int resetFlag;
 
    /* adjustment rates (pages per second) */
+   int rateNoSleepAlloc;
    int rateAlloc;
    int rateFree;
 
@@ -196,5 +218,6 @@ void Balloon_Cleanup(void);
 void Balloon_QueryAndExecute(void);
 
 const BalloonStats *Balloon_GetStats(void);
+const char *Balloon_GetErrorName(int status);
 
 #endif	/* VMBALLOON_H */
@@ -29,8 +29,21 @@
 #include "vm_assert.h"
 #include "debug.h"
 
-static RpcOut *hgfsRpcOut;
-static void *packetBuffer;
+/*
+ * One backdoor channel and transfer buffer for each request of the pool, so
+ * that requests from different threads are dispatched to the host
+ * concurrently instead of one after the other.  A request only uses the
+ * channel matching its id, unless the host refuses to open that channel:
+ * the request then falls back to the first channel.  The mutex of a channel
+ * serializes those fallbacks with the channel's own request.
+ */
+typedef struct HgfsBdChannel {
+   kmutex_t mutex;
+   RpcOut *rpcOut;
+   void *packetBuffer;
+} HgfsBdChannel;
+
+static HgfsBdChannel hgfsBdChannels[HGFS_MAX_OUTSTANDING_REQS];
 
 /*
  * Public function implementations.
@@ -43,6 +56,9 @@ static void *packetBuffer;
  *
  *    Send one request through backdoor and wait for the result.
  *
+ *    Requests are sent on the channel matching their id, so up to
+ *    HGFS_MAX_OUTSTANDING_REQS requests can be outstanding at once.
+ *
  * Results:
  *    0 on success, standard UNIX error code upon failure.
  *
@@ -55,32 +71,48 @@ static void *packetBuffer;
 int
 HgfsBackdoorSendRequest(HgfsReq *req)     // IN/OUT: Request to be sent
 {
+   HgfsBdChannel *channel;
    char const *replyPacket;
    size_t packetSize;
+   Bool opened;
 
    ASSERT(req->state == HGFS_REQ_SUBMITTED);
+   ASSERT(req->id < ARRAYSIZE(hgfsBdChannels));
+
+   channel = &hgfsBdChannels[req->id];
+   mutex_enter(&channel->mutex);
+
+   /*
+    * We should attempt to reopen the backdoor channel with every request,
+    * because the HGFS server in the host can be enabled or disabled at any
+    * time.  The host also limits the number of channels a guest can open,
+    * so if ours can't be opened, share the first one.
+    */
+   opened = HgfsBd_OpenBackdoor(&channel->rpcOut);
+   if (!opened && channel != &hgfsBdChannels[0]) {
+      mutex_exit(&channel->mutex);
+      channel = &hgfsBdChannels[0];
+      mutex_enter(&channel->mutex);
+      opened = HgfsBd_OpenBackdoor(&channel->rpcOut);
+   }
 
    ASSERT(req->packetSize <= HGFS_PACKET_MAX);
-   bcopy(req->packet, packetBuffer, req->packetSize);
+   bcopy(req->packet, channel->packetBuffer, req->packetSize);
    packetSize = req->packetSize;
 
    DEBUG(VM_DEBUG_COMM,
          "HgfsBackdoorSendRequest: Sending packet over backdoor\n");
 
-   /*
-    * We should attempt to reopen the backdoor channel with every request,
-    * because the HGFS server in the host can be enabled or disabled at any
-    * time.
-    */
-   if (!HgfsBd_OpenBackdoor(&hgfsRpcOut)) {
+   if (!opened) {
 
       DEBUG(VM_DEBUG_COMM,
             "HgfsBackdoorSendRequest: HGFS is disabled in the host\n");
 
+      mutex_exit(&channel->mutex);
       req->state = HGFS_REQ_ERROR;
       return ENOSYS;
 
-   } else if (HgfsBd_Dispatch(hgfsRpcOut, packetBuffer,
+   } else if (HgfsBd_Dispatch(channel->rpcOut, channel->packetBuffer,
                               &packetSize, &replyPacket) == 0) {
 
       DEBUG(VM_DEBUG_COMM,
@@ -106,9 +138,11 @@ HgfsBackdoorSendRequest(HgfsReq *req)     // IN/OUT: Request to be sent
        * now. We do this because subsequent requests deserve a chance to
        * reopen it.
        */
-      HgfsBd_CloseBackdoor(&hgfsRpcOut);
+      HgfsBd_CloseBackdoor(&channel->rpcOut);
    }
 
+   mutex_exit(&channel->mutex);
+
    return 0;
 }
 
@@ -143,10 +177,10 @@ HgfsBackdoorCancelRequest(HgfsReq *req)      // IN: Request to be cancelled
  * HgfsBackdoorInit --
  *
  *    This function initializes backdoor transport by allocating transfer
- *    buffer.
+ *    buffers for all the channels.
  *
  * Results:
- *    TRUE if buffer was allocated succsessfully, FALSE otherwise.
+ *    TRUE if buffers were allocated succsessfully, FALSE otherwise.
  *
  * Side effects:
  *    None.
@@ -157,9 +191,25 @@ HgfsBackdoorCancelRequest(HgfsReq *req)      // IN: Request to be cancelled
 Bool
 HgfsBackdoorInit(void)
 {
-   packetBuffer = HgfsBd_GetBuf();
+   int i;
+
+   for (i = 0; i < ARRAYSIZE(hgfsBdChannels); i++) {
+      HgfsBdChannel *channel = &hgfsBdChannels[i];
+
+      channel->rpcOut = NULL;
+      channel->packetBuffer = HgfsBd_GetBuf();
+      if (channel->packetBuffer == NULL) {
+         while (--i >= 0) {
+            HgfsBd_PutBuf(hgfsBdChannels[i].packetBuffer);
+            hgfsBdChannels[i].packetBuffer = NULL;
+            mutex_destroy(&hgfsBdChannels[i].mutex);
+         }
+         return FALSE;
+      }
+      mutex_init(&channel->mutex, NULL, MUTEX_DRIVER, NULL);
+   }
 
-   return packetBuffer != NULL;
+   return TRUE;
 }
 
 
@@ -168,7 +218,7 @@ HgfsBackdoorInit(void)
  *
  * HgfsBackdoorCleanup --
  *
- *    This function closes backdoor channel. It is supposed to be
+ *    This function closes backdoor channels. It is supposed to be
  *    called when we unmount the filesystem.
  *
  * Results:
@@ -183,9 +233,17 @@ HgfsBackdoorInit(void)
 void
 HgfsBackdoorCleanup(void)
 {
+   int i;
+
    DEBUG(VM_DEBUG_COMM, "HgfsBackdoorCleanup: Closing backdoor\n");
 
-   HgfsBd_CloseBackdoor(&hgfsRpcOut);
-   HgfsBd_PutBuf(packetBuffer);
+   for (i = 0; i < ARRAYSIZE(hgfsBdChannels); i++) {
+      HgfsBdChannel *channel = &hgfsBdChannels[i];
+
+      HgfsBd_CloseBackdoor(&channel->rpcOut);
+      HgfsBd_PutBuf(channel->packetBuffer);
+      channel->packetBuffer = NULL;
+      mutex_destroy(&channel->mutex);
+   }
 }
 
@@ -160,7 +160,7 @@ typedef struct HgfsReq {
  * the filesystem and driver.  See docs/synchronization.txt for details.
  */
 typedef struct HgfsSuperInfo {
-   kmutex_t reqMutex;                   /* Serializes sending of requests */
+   kmutex_t reqMutex;                   /* For waiting on replies */
 
    /* Free request list */
    DblLnkLst_Links reqFreeList;         /* Anchor for free request list */
@@ -171,6 +171,7 @@ typedef struct HgfsSuperInfo {
    struct vfs *vfsp;                    /* Our filesystem structure */
    struct vnode *rootVnode;             /* Root vnode of the filesystem */
    HgfsFileHashTable fileHashTable;     /* File hash table */
+   HgfsNegCache negCache;               /* Recently missing files */
 
    int (*sendRequest)(HgfsReq *req);    /* Current transport's sent method */
    void (*cancelRequest)(HgfsReq *req); /* Current transport's cancel method */
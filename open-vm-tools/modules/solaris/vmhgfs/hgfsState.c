@@ -32,6 +32,9 @@
 #include "hgfsState.h"
 #include "debug.h"
 
+#include <sys/ddi.h>            /* ddi_get_lbolt, drv_usectohz */
+#include <sys/sunddi.h>
+
 #include "vm_basic_types.h"
 #include "vm_basic_defs.h"
 #include "vm_assert.h"
@@ -50,6 +53,17 @@
 
 #define HGFS_IS_ROOT_FILE(sip, file)    (HGFS_VP_TO_FP(sip->rootVnode) == file)
 
+/*
+ * Global variables
+ */
+
+/*
+ * Seconds the attributes and failed lookups received from the Hgfs server are
+ * trusted before asking again; 0 disables caching.  Can be tuned with
+ * "set vmhgfs:hgfsAttrCacheTtl = <seconds>" in /etc/system.
+ */
+int hgfsAttrCacheTtl = 1;
+
 /*
  * Prototypes for internal functions
  */
@@ -957,6 +971,362 @@ HgfsClearOpenFileMode(struct vnode *vp) // IN: Vnode to clear mode for
    return 0;
 }
 
+/* Attribute cache functions */
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsCacheIsFresh --
+ *
+ *    Determines whether data received from the Hgfs server at the provided
+ *    time can still be trusted.
+ *
+ * Results:
+ *    Returns TRUE if the data is younger than hgfsAttrCacheTtl seconds,
+ *    FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsCacheIsFresh(clock_t time)  // IN: When the data was received
+{
+   if (hgfsAttrCacheTtl <= 0) {
+      return FALSE;
+   }
+
+   return ddi_get_lbolt() - time <
+          drv_usectohz((clock_t)hgfsAttrCacheTtl * MICROSEC);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsGetCachedAttr --
+ *
+ *    Gets the cached attributes of the file of the provided vnode, if they
+ *    can still be trusted.
+ *
+ * Results:
+ *    Returns TRUE and the attributes in outAttr if they are cached, FALSE if
+ *    a request must be sent to the Hgfs server.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsGetCachedAttr(struct vnode *vp,     // IN:  Vnode to get attributes for
+                  HgfsAttr *outAttr)    // OUT: Cached attributes
+{
+   HgfsFile *fp;
+   Bool found = FALSE;
+
+   ASSERT(vp);
+   ASSERT(outAttr);
+
+   fp = HGFS_VP_TO_FP(vp);
+   if (!fp) {
+      return FALSE;
+   }
+
+   mutex_enter(&fp->mutex);
+
+   if (fp->attrValid && HgfsCacheIsFresh(fp->attrTime)) {
+      *outAttr = fp->attr;
+      found = TRUE;
+   }
+
+   mutex_exit(&fp->mutex);
+
+   return found;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsSetCachedAttr --
+ *
+ *    Caches the attributes just received from the Hgfs server for the file
+ *    of the provided vnode.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+HgfsSetCachedAttr(struct vnode *vp,     // IN: Vnode to set attributes for
+                  const HgfsAttr *attr) // IN: Attributes from the server
+{
+   HgfsFile *fp;
+
+   ASSERT(vp);
+   ASSERT(attr);
+
+   fp = HGFS_VP_TO_FP(vp);
+   if (!fp || hgfsAttrCacheTtl <= 0) {
+      return;
+   }
+
+   mutex_enter(&fp->mutex);
+
+   fp->attr = *attr;
+   fp->attrTime = ddi_get_lbolt();
+   fp->attrValid = TRUE;
+
+   mutex_exit(&fp->mutex);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsInvalidateCachedAttr --
+ *
+ *    Drops the cached attributes of the file of the provided vnode, which we
+ *    are changing.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    The next getattr goes to the Hgfs server.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+HgfsInvalidateCachedAttr(struct vnode *vp)      // IN: Vnode of changed file
+{
+   HgfsFile *fp;
+
+   ASSERT(vp);
+
+   fp = HGFS_VP_TO_FP(vp);
+   if (!fp) {
+      return;
+   }
+
+   mutex_enter(&fp->mutex);
+   fp->attrValid = FALSE;
+   mutex_exit(&fp->mutex);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsInvalidateCachedAttrByName --
+ *
+ *    Drops the cached attributes of the named file, if we have state for it.
+ *    Used for operations that only have the file's name, such as removing
+ *    or renaming it.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    The next getattr goes to the Hgfs server.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+HgfsInvalidateCachedAttrByName(HgfsFileHashTable *htp,  // IN: File hash table
+                               const char *fileName)    // IN: Full name of file
+{
+   HgfsFile *fp;
+
+   ASSERT(htp);
+   ASSERT(fileName);
+
+   mutex_enter(&htp->mutex);
+
+   fp = HgfsFindFile(fileName, htp);
+   if (fp) {
+      mutex_enter(&fp->mutex);
+      fp->attrValid = FALSE;
+      mutex_exit(&fp->mutex);
+   }
+
+   mutex_exit(&htp->mutex);
+}
+
+
+/* Negative lookup cache functions */
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsInitNegCache --
+ *
+ *    Initializes the negative lookup cache.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+HgfsInitNegCache(HgfsNegCache *ncp)     // IN: Cache to initialize
+{
+   ASSERT(ncp);
+
+   mutex_init(&ncp->mutex, NULL, MUTEX_DRIVER, NULL);
+   bzero(ncp->entries, sizeof ncp->entries);
+   ncp->next = 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsNegCacheLookup --
+ *
+ *    Determines whether the Hgfs server recently reported the named file as
+ *    missing.
+ *
+ * Results:
+ *    Returns TRUE if the file is known not to exist, FALSE if a request must
+ *    be sent to the Hgfs server.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsNegCacheLookup(HgfsNegCache *ncp,           // IN: Cache to look in
+                   const char *fileName)        // IN: Full name of file
+{
+   Bool found = FALSE;
+   int i;
+
+   ASSERT(ncp);
+   ASSERT(fileName);
+
+   if (hgfsAttrCacheTtl <= 0) {
+      return FALSE;
+   }
+
+   mutex_enter(&ncp->mutex);
+
+   for (i = 0; i < ARRAYSIZE(ncp->entries); i++) {
+      HgfsNegCacheEntry *entry = &ncp->entries[i];
+
+      if (entry->fileName[0] != '\0' &&
+          strcmp(entry->fileName, fileName) == 0) {
+         if (HgfsCacheIsFresh(entry->time)) {
+            found = TRUE;
+         } else {
+            entry->fileName[0] = '\0';
+         }
+         break;
+      }
+   }
+
+   mutex_exit(&ncp->mutex);
+
+   return found;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsNegCacheAdd --
+ *
+ *    Remembers that the Hgfs server just reported the named file as missing.
+ *    Names that don't fit in an entry are not cached.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    May replace the oldest entry of the cache.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+HgfsNegCacheAdd(HgfsNegCache *ncp,      // IN: Cache to add to
+                const char *fileName)   // IN: Full name of missing file
+{
+   HgfsNegCacheEntry *entry;
+   size_t len;
+
+   ASSERT(ncp);
+   ASSERT(fileName);
+
+   len = strlen(fileName);
+   if (hgfsAttrCacheTtl <= 0 || len > HGFS_NEG_CACHE_NAME_MAX) {
+      return;
+   }
+
+   mutex_enter(&ncp->mutex);
+
+   entry = &ncp->entries[ncp->next];
+   ncp->next = (ncp->next + 1) % ARRAYSIZE(ncp->entries);
+
+   memcpy(entry->fileName, fileName, len + 1);
+   entry->time = ddi_get_lbolt();
+
+   mutex_exit(&ncp->mutex);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsNegCacheFlush --
+ *
+ *    Drops all the entries of the negative lookup cache.  Called whenever
+ *    we create a file, since any of the remembered misses may be it.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+HgfsNegCacheFlush(HgfsNegCache *ncp)    // IN: Cache to flush
+{
+   int i;
+
+   ASSERT(ncp);
+
+   mutex_enter(&ncp->mutex);
+
+   for (i = 0; i < ARRAYSIZE(ncp->entries); i++) {
+      ncp->entries[i].fileName[0] = '\0';
+   }
+
+   mutex_exit(&ncp->mutex);
+}
+
 
 /*
  * Internal functions
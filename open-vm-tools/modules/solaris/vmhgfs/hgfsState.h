@@ -40,7 +40,13 @@
  * Macros
  */
 /* Number of buckets for the HgfsInode hash table */
-#define HGFS_HT_NR_BUCKETS             5
+#define HGFS_HT_NR_BUCKETS             61
+
+/* Number of entries of the negative lookup cache */
+#define HGFS_NEG_CACHE_NR_ENTRIES      32
+
+/* Longest filename kept in the negative lookup cache */
+#define HGFS_NEG_CACHE_NAME_MAX        255
 
 /* Conversion between different state structures */
 #define HGFS_VP_TO_OFP(vp)      ((HgfsOpenFile *)(vp)->v_data)
@@ -112,9 +118,17 @@ typedef struct HgfsFile {
     * entry points.
     */
    krwlock_t rwlock;
-   /* Lock to protect the reference count of this file state. */
+   /* Lock to protect the reference count and attributes of this file state. */
    kmutex_t mutex;
    uint32_t refCount;
+   /*
+    * Attributes of the last reply from the Hgfs server for this file, and
+    * the time (in ticks) it was received.  They are trusted for
+    * hgfsAttrCacheTtl seconds, unless we change the file ourselves first.
+    */
+   HgfsAttr attr;
+   clock_t attrTime;
+   Bool attrValid;
 } HgfsFile;
 
 
@@ -155,9 +169,31 @@ typedef struct HgfsFileHashTable {
    DblLnkLst_Links hashTable[HGFS_HT_NR_BUCKETS];
 } HgfsFileHashTable;
 
+/*
+ * Recent lookups of files the Hgfs server reported as missing.
+ *
+ * Builds probe many files that don't exist along their include and library
+ * paths, so the misses are remembered for hgfsAttrCacheTtl seconds.  Entries
+ * are replaced round robin and all are dropped whenever we create or rename
+ * a file.
+ */
+typedef struct HgfsNegCacheEntry {
+   char fileName[HGFS_NEG_CACHE_NAME_MAX + 1];  /* Empty if unused */
+   clock_t time;                                /* When the miss was received */
+} HgfsNegCacheEntry;
+
+typedef struct HgfsNegCache {
+   kmutex_t mutex;
+   uint32_t next;                               /* Next entry to replace */
+   HgfsNegCacheEntry entries[HGFS_NEG_CACHE_NR_ENTRIES];
+} HgfsNegCache;
+
 /* Forward declaration to prevent circular dependency between this and hgfs.h. */
 struct HgfsSuperInfo;
 
+/* Seconds cached attributes and lookups are trusted for, 0 to disable. */
+extern int hgfsAttrCacheTtl;
+
 
 /*
  * Functions
@@ -186,6 +222,18 @@ int HgfsSetOpenFileMode(struct vnode *vp, HgfsMode mode);
 int HgfsGetOpenFileMode(struct vnode *vp, HgfsMode *outMode);
 int HgfsClearOpenFileMode(struct vnode *vp);
 
+/* Attribute cache functions */
+Bool HgfsGetCachedAttr(struct vnode *vp, HgfsAttr *outAttr);
+void HgfsSetCachedAttr(struct vnode *vp, const HgfsAttr *attr);
+void HgfsInvalidateCachedAttr(struct vnode *vp);
+void HgfsInvalidateCachedAttrByName(HgfsFileHashTable *htp, const char *fileName);
+
+/* Negative lookup cache functions */
+void HgfsInitNegCache(HgfsNegCache *ncp);
+Bool HgfsNegCacheLookup(HgfsNegCache *ncp, const char *fileName);
+void HgfsNegCacheAdd(HgfsNegCache *ncp, const char *fileName);
+void HgfsNegCacheFlush(HgfsNegCache *ncp);
+
 /* Debugging function */
 void HgfsDebugPrintFileHashTable(HgfsFileHashTable *htp, int level);
 
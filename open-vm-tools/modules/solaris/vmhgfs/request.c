@@ -293,8 +293,8 @@ HgfsDestroyReq(HgfsSuperInfo *sip,      // IN: Superinfo containing free list
  *    Sends request for execution. The exact details depend on transport used
  *    to communicate with the host.
  *
- *    Note: this assumes it is called with the list lock held because often
- *    callers will need this function to be atomic with other operations.
+ *    Note: this is called without the request mutex held, so the transport
+ *    must support concurrent requests.
  *
  * Results:
  *    Returns void.
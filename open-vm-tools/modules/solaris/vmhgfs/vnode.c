@@ -775,6 +775,9 @@ HgfsWrite(struct vnode *vp,             // IN: Vnode of file to write to
       return EINVAL;
    }
 
+   /* The size and modification time of the file change. */
+   HgfsInvalidateCachedAttr(vp);
+
    /*
     * We loop around calls to HgfsDoWrite() until either (1) we have written all
     * of our data or (2) an error has occurred.  uiop->uio_resid is decremented
@@ -916,6 +919,7 @@ HgfsGetattr(struct vnode *vp,      // IN: Vnode of file to get attributes for
    HgfsReq *req;
    HgfsRequestGetattr *request;
    HgfsReplyGetattr *reply;
+   HgfsAttr attr;
    int ret;
 
    if (!vp || !vap) {
@@ -939,6 +943,13 @@ HgfsGetattr(struct vnode *vp,      // IN: Vnode of file to get attributes for
 
    ASSERT(HGFS_KNOW_FILENAME(vp));
 
+   /* Attributes received recently are trusted without asking the host. */
+   if (HgfsGetCachedAttr(vp, &attr)) {
+      HgfsAttrToSolaris(vp, &attr, vap);
+      DEBUG(VM_DEBUG_DONE, "%s: done (cached).\n", __func__);
+      return 0;
+   }
+
    req = HgfsGetNewReq(sip);
    if (!req) {
       return EIO;
@@ -1004,6 +1015,7 @@ HgfsGetattr(struct vnode *vp,      // IN: Vnode of file to get attributes for
 
          /* Map the Hgfs attributes into the Solaris attributes */
          HgfsAttrToSolaris(vp, &reply->attr, vap);
+         HgfsSetCachedAttr(vp, &reply->attr);
 
          DEBUG(VM_DEBUG_DONE, "%s: done.\n", __func__);
       }
@@ -1108,6 +1120,8 @@ HgfsSetattr(struct vnode *vp,       // IN: Vnode of file to get attributes for
    /* The request's size includes the request and filename. */
    req->packetSize = sizeof *request + request->fileName.length;
 
+   HgfsInvalidateCachedAttr(vp);
+
    ret = HgfsSubmitRequest(sip, req);
    if (ret) {
       goto out;
@@ -1365,6 +1379,12 @@ HgfsLookup(struct vnode *dvp,      // IN:  Directory to look in
    }
 #endif
 
+   /* The host told us recently that this file doesn't exist. */
+   if (HgfsNegCacheLookup(&sip->negCache, path)) {
+      DEBUG(VM_DEBUG_DONE, "HgfsLookup: \"%s\" is cached as missing.\n", path);
+      return ENOENT;
+   }
+
    /*
     * We don't have any reference to this vnode, so we must send a get
     * attribute request to see if the file exists and create one.
@@ -1426,6 +1446,9 @@ HgfsLookup(struct vnode *dvp,      // IN:  Directory to look in
    if (ret) {
       DEBUG(VM_DEBUG_FAIL, "%s: failed for [%s] with error %d.\n",
             __func__, nm, ret);
+      if (ret == ENOENT) {
+         HgfsNegCacheAdd(&sip->negCache, path);
+      }
       goto out;
    }
 
@@ -1459,6 +1482,9 @@ HgfsLookup(struct vnode *dvp,      // IN:  Directory to look in
    /* HgfsVnodeGet guarantees this. */
    ASSERT(*vpp);
 
+   /* The getattr that usually follows a lookup is answered from the cache. */
+   HgfsSetCachedAttr(*vpp, &reply->attr);
+
    DEBUG(VM_DEBUG_LOAD, "HgfsLookup: assigned vnode %p to %s\n", *vpp, path);
 
    ret = 0;     /* Return success */
@@ -1664,6 +1690,8 @@ HgfsRemove(struct vnode *vp,       // IN: Directory containing file to remove
 
    DEBUG(VM_DEBUG_COMM, "HgfsRemove: removing \"%s\".\n", fullpath);
 
+   HgfsInvalidateCachedAttr(vp);
+
    /* We can now send the delete request. */
    return HgfsDelete(sip, fullpath, HGFS_OP_DELETE_FILE);
 }
@@ -1839,6 +1867,13 @@ HgfsRename(struct vnode *sdvp,     // IN: Source directory that contains file to
    /* The request's size includes the request and both filenames. */
    req->packetSize = sizeof *request + request->oldName.length + newNameP->length;
 
+   /* Both names and directories change, and the destination may be new. */
+   HgfsInvalidateCachedAttrByName(&sip->fileHashTable, srcFullPath);
+   HgfsInvalidateCachedAttrByName(&sip->fileHashTable, dstFullPath);
+   HgfsInvalidateCachedAttr(sdvp);
+   HgfsInvalidateCachedAttr(tdvp);
+   HgfsNegCacheFlush(&sip->negCache);
+
    ret = HgfsSubmitRequest(sip, req);
    if (ret) {
       goto out;
@@ -1976,6 +2011,9 @@ HgfsMkdir(struct vnode *dvp,      // IN: Vnode of directory to create directory
    /* Set the size of this request. */
    req->packetSize = sizeof *request + request->fileName.length;
 
+   HgfsInvalidateCachedAttr(dvp);
+   HgfsNegCacheFlush(&sip->negCache);
+
    /* Send the request. */
    ret = HgfsSubmitRequest(sip, req);
    if (ret) {
@@ -2095,6 +2133,8 @@ HgfsRmdir(struct vnode *vp,       // IN: Dir containing dir to remove
 
    DEBUG(VM_DEBUG_COMM, "HgfsRmdir: removing \"%s\".\n", fullpath);
 
+   HgfsInvalidateCachedAttr(vp);
+
    /* We can now send the delete request. */
    return HgfsDelete(sip, fullpath, HGFS_OP_DELETE_DIR);
 }
@@ -3780,6 +3820,12 @@ HgfsFileOpen(HgfsSuperInfo *sip,        // IN: Superinfo pointer
       goto out;
    }
 
+   /* The open may have created or truncated the file. */
+   if (flag & (FCREAT | FTRUNC)) {
+      HgfsNegCacheFlush(&sip->negCache);
+      HgfsInvalidateCachedAttr(vp);
+   }
+
    /*
     * We successfully received a reply, so we need to save the handle in
     * this file's HgfsOpenFile and return success.
@@ -4398,6 +4444,9 @@ HgfsDelete(HgfsSuperInfo *sip,          // IN: Superinfo
 
    DEBUG(VM_DEBUG_COMM, "HgfsDelete: deleting \"%s\"\n", filename);
 
+   /* The file may still be open, don't trust its cached attributes. */
+   HgfsInvalidateCachedAttrByName(&sip->fileHashTable, filename);
+
    /* Submit our request. */
    ret = HgfsSubmitRequest(sip, req);
    if (ret) {
@@ -4487,6 +4536,7 @@ HgfsInitSuperInfo(struct vfs *vfsp) // IN: pointer to vfs being mounted
 
    HgfsInitRequestList(&hgfsSuperInfo);
    HgfsInitFileHashTable(&hgfsSuperInfo.fileHashTable);
+   HgfsInitNegCache(&hgfsSuperInfo.negCache);
 }
 
 /*
@@ -4509,6 +4559,7 @@ HgfsInitSuperInfo(struct vfs *vfsp) // IN: pointer to vfs being mounted
 void
 HgfsClearSuperInfo(void)
 {
+   HgfsNegCacheFlush(&hgfsSuperInfo.negCache);
    hgfsSuperInfo.vfsp = NULL;
 }
 
@@ -4727,7 +4778,15 @@ HgfsSubmitRequest(HgfsSuperInfo *sip,   // IN: Superinfo containing request list
       goto out;
    }
 
+   /*
+    * The transport is called without the mutex so that several requests can
+    * be outstanding at once.  Asynchronous transports wake us up under the
+    * mutex, and the request's state is checked under it below, so a reply
+    * arriving before we sleep is not lost.
+    */
+   mutex_exit(&sip->reqMutex);
    ret = HgfsSendRequest(sip, req);
+   mutex_enter(&sip->reqMutex);
    if (ret) {
       DEBUG(VM_DEBUG_REQUEST, "HgfsSubmitRequest(): transport failed.\n");
       goto out;
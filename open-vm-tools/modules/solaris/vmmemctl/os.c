@@ -36,6 +36,7 @@
 #include <sys/proc.h>
 #include <sys/disp.h>
 #include <sys/ksynch.h>
+#include <sys/time.h>
 
 #include "os.h"
 #include "vmballoon.h"
@@ -647,6 +648,29 @@ OS_Yield(void)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * OS_GetUptimeUs --
+ *
+ *      Reads a monotonic clock, precise enough to time a monitor call.
+ *
+ * Results:
+ *      Microseconds since an arbitrary point in the past (boot).
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+uint64
+OS_GetUptimeUs(void)
+{
+   return gethrtime() / (NANOSEC / MICROSEC);
+}
+
+
 /*
  * Module linkage
  */
@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <sys/kstat.h>
 #include <sys/errno.h>
+#include <sys/cmn_err.h>
 #include "os.h"
 #include "vmballoon.h"
 #include "vmballoon_kstats.h"
@@ -59,6 +60,14 @@ typedef struct {
    kstat_named_t primFree;
    kstat_named_t primErrorPageAlloc;
    kstat_named_t primErrorPageFree;
+   kstat_named_t inflated;
+   kstat_named_t deflated;
+   kstat_named_t periodInflated;
+   kstat_named_t periodDeflated;
+   kstat_named_t lockRefused[BALLOON_ERROR_NR];
+   kstat_named_t unlockRefused[BALLOON_ERROR_NR];
+   kstat_named_t lockLatency[BALLOON_LATENCY_BUCKETS];
+   kstat_named_t unlockLatency[BALLOON_LATENCY_BUCKETS];
 } BalloonKstats;
 
 /*
@@ -116,6 +125,18 @@ BalloonKstatUpdate(kstat_t *ksp, int rw)
    bkp->primFree.value.ui32 = stats->primFree[FALSE];
    bkp->primErrorPageAlloc.value.ui32 = stats->primErrorPageAlloc[FALSE];
    bkp->primErrorPageFree.value.ui32 = stats->primErrorPageFree[FALSE];
+   bkp->inflated.value.ui32 = stats->inflated;
+   bkp->deflated.value.ui32 = stats->deflated;
+   bkp->periodInflated.value.ui32 = stats->periodInflated;
+   bkp->periodDeflated.value.ui32 = stats->periodDeflated;
+   for (i = 0; i < BALLOON_ERROR_NR; i++) {
+      bkp->lockRefused[i].value.ui32 = stats->lockRefused[i];
+      bkp->unlockRefused[i].value.ui32 = stats->unlockRefused[i];
+   }
+   for (i = 0; i < BALLOON_LATENCY_BUCKETS; i++) {
+      bkp->lockLatency[i].value.ui32 = stats->lockLatency[FALSE][i];
+      bkp->unlockLatency[i].value.ui32 = stats->unlockLatency[FALSE][i];
+   }
 
    return 0;
 }
@@ -129,6 +150,8 @@ BalloonKstatCreate(void)
 {
    kstat_t *ksp;
    BalloonKstats *bkp;
+   char name[KSTAT_STRLEN];
+   int i;
 
    ksp = kstat_create("vmmemctl", 0, "vmmemctl", "vm", KSTAT_TYPE_NAMED,
 		      sizeof (BalloonKstats) / sizeof (kstat_named_t), 0);
@@ -167,6 +190,28 @@ BalloonKstatCreate(void)
    kstat_named_init(&bkp->primFree, "primFree", KSTAT_DATA_UINT32);
    kstat_named_init(&bkp->primErrorPageAlloc, "errAlloc", KSTAT_DATA_UINT32);
    kstat_named_init(&bkp->primErrorPageFree, "errFree", KSTAT_DATA_UINT32);
+   kstat_named_init(&bkp->inflated, "inflated", KSTAT_DATA_UINT32);
+   kstat_named_init(&bkp->deflated, "deflated", KSTAT_DATA_UINT32);
+   kstat_named_init(&bkp->periodInflated, "periodInflated", KSTAT_DATA_UINT32);
+   kstat_named_init(&bkp->periodDeflated, "periodDeflated", KSTAT_DATA_UINT32);
+
+   /* e.g. "lockRefused.ppnPinned"; success is never counted, but kept */
+   for (i = 0; i < BALLOON_ERROR_NR; i++) {
+      (void) snprintf(name, sizeof name, "lockRefused.%s",
+                      Balloon_GetErrorName(i));
+      kstat_named_init(&bkp->lockRefused[i], name, KSTAT_DATA_UINT32);
+      (void) snprintf(name, sizeof name, "unlockRefused.%s",
+                      Balloon_GetErrorName(i));
+      kstat_named_init(&bkp->unlockRefused[i], name, KSTAT_DATA_UINT32);
+   }
+
+   /* bucket i counts the calls that took about 2^i microseconds */
+   for (i = 0; i < BALLOON_LATENCY_BUCKETS; i++) {
+      (void) snprintf(name, sizeof name, "lockLatency%d", i);
+      kstat_named_init(&bkp->lockLatency[i], name, KSTAT_DATA_UINT32);
+      (void) snprintf(name, sizeof name, "unlockLatency%d", i);
+      kstat_named_init(&bkp->unlockLatency[i], name, KSTAT_DATA_UINT32);
+   }
 
    /* set update function to be run when kstats are read */
    ksp->ks_update = BalloonKstatUpdate;
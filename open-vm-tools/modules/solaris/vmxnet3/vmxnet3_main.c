@@ -97,8 +97,74 @@ static ddi_dma_attr_t vmxnet3_dma_attrs_tx = {
    0                      /* dma_attr_flags */
 };
 
+/*
+ * Toeplitz key for RSS, the one from Microsoft's RSS specification that
+ * most NICs use by default.
+ */
+static const uint8_t vmxnet3_rss_key[UPT1_RSS_MAX_KEY_SIZE] = {
+   0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+   0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+   0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+   0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+   0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa
+};
+
+/* Per queue pair statistics, exported as vmxnet3s:<instance>:queue<n> */
+typedef struct vmxnet3_queue_kstats_t {
+   kstat_named_t txPackets;
+   kstat_named_t txBytes;
+   kstat_named_t txErrors;
+   kstat_named_t txDiscards;
+   kstat_named_t txRingFull;
+   kstat_named_t rxPackets;
+   kstat_named_t rxBytes;
+   kstat_named_t rxErrors;
+   kstat_named_t rxNoBuf;
+   kstat_named_t intrs;
+} vmxnet3_queue_kstats_t;
+
 /* --- */
 
+/*
+ *---------------------------------------------------------------------------
+ *
+ * vmxnet3_sum_stats --
+ *
+ *    Add up the device statistics of all the queues of a vmxnet3 device.
+ *    The caller must have issued VMXNET3_CMD_GET_STATS.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *---------------------------------------------------------------------------
+ */
+static void
+vmxnet3_sum_stats(vmxnet3_softc_t *dp,
+                  UPT1_TxStats *txStats,
+                  UPT1_RxStats *rxStats)
+{
+   unsigned int i, j;
+
+   memset(txStats, 0, sizeof *txStats);
+   memset(rxStats, 0, sizeof *rxStats);
+
+   /* Both structures are plain arrays of 64 bits counters */
+   for (i = 0; i < dp->numQueues; i++) {
+      uint64_t *txSrc = (uint64_t *) &VMXNET3_TQDESC(dp, i)->stats;
+      uint64_t *rxSrc = (uint64_t *) &VMXNET3_RQDESC(dp, i)->stats;
+
+      for (j = 0; j < sizeof *txStats / sizeof(uint64_t); j++) {
+         ((uint64_t *) txStats)[j] += txSrc[j];
+      }
+      for (j = 0; j < sizeof *rxStats / sizeof(uint64_t); j++) {
+         ((uint64_t *) rxStats)[j] += rxSrc[j];
+      }
+   }
+}
+
 /*
  *---------------------------------------------------------------------------
  *
@@ -118,8 +184,8 @@ static int
 vmxnet3_getstat(void *data, uint_t stat, uint64_t *val)
 {
    vmxnet3_softc_t *dp = data;
-   UPT1_TxStats *txStats;
-   UPT1_RxStats *rxStats;
+   UPT1_TxStats txStats;
+   UPT1_RxStats rxStats;
 
    VMXNET3_DEBUG(dp, 3, "getstat(%u)\n", stat);
 
@@ -127,9 +193,6 @@ vmxnet3_getstat(void *data, uint_t stat, uint64_t *val)
       return DDI_FAILURE;
    }
 
-   txStats = &VMXNET3_TQDESC(dp)->stats;
-   rxStats = &VMXNET3_RQDESC(dp)->stats;
-
    /*
     * First touch the related register
     */
@@ -160,60 +223,62 @@ vmxnet3_getstat(void *data, uint_t stat, uint64_t *val)
    /*
     * Then fetch the corresponding stat
     */
+   vmxnet3_sum_stats(dp, &txStats, &rxStats);
+
    switch (stat) {
       case MAC_STAT_IFSPEED:
          *val = dp->linkSpeed;
          break;
       case MAC_STAT_MULTIRCV:
-         *val = rxStats->mcastPktsRxOK;
+         *val = rxStats.mcastPktsRxOK;
          break;
       case MAC_STAT_BRDCSTRCV:
-         *val = rxStats->bcastPktsRxOK;
+         *val = rxStats.bcastPktsRxOK;
          break;
       case MAC_STAT_MULTIXMT:
-         *val = txStats->mcastPktsTxOK;
+         *val = txStats.mcastPktsTxOK;
          break;
       case MAC_STAT_BRDCSTXMT:
-         *val = txStats->bcastPktsTxOK;
+         *val = txStats.bcastPktsTxOK;
          break;
       case MAC_STAT_NORCVBUF:
-         *val = rxStats->pktsRxOutOfBuf;
+         *val = rxStats.pktsRxOutOfBuf;
          break;
       case MAC_STAT_IERRORS:
-         *val = rxStats->pktsRxError;
+         *val = rxStats.pktsRxError;
          break;
       case MAC_STAT_NOXMTBUF:
-         *val = txStats->pktsTxDiscard;
+         *val = txStats.pktsTxDiscard;
          break;
       case MAC_STAT_OERRORS:
-         *val = txStats->pktsTxError;
+         *val = txStats.pktsTxError;
          break;
       case MAC_STAT_COLLISIONS:
          *val = 0;
          break;
       case MAC_STAT_RBYTES:
-         *val = rxStats->LROBytesRxOK +
-                rxStats->ucastBytesRxOK +
-                rxStats->mcastBytesRxOK +
-                rxStats->bcastBytesRxOK;
+         *val = rxStats.LROBytesRxOK +
+                rxStats.ucastBytesRxOK +
+                rxStats.mcastBytesRxOK +
+                rxStats.bcastBytesRxOK;
          break;
       case MAC_STAT_IPACKETS:
-         *val = rxStats->LROPktsRxOK +
-                rxStats->ucastPktsRxOK +
-                rxStats->mcastPktsRxOK +
-                rxStats->bcastPktsRxOK;
+         *val = rxStats.LROPktsRxOK +
+                rxStats.ucastPktsRxOK +
+                rxStats.mcastPktsRxOK +
+                rxStats.bcastPktsRxOK;
          break;
       case MAC_STAT_OBYTES:
-         *val = txStats->TSOBytesTxOK +
-                txStats->ucastBytesTxOK +
-                txStats->mcastBytesTxOK +
-                txStats->bcastBytesTxOK;
+         *val = txStats.TSOBytesTxOK +
+                txStats.ucastBytesTxOK +
+                txStats.mcastBytesTxOK +
+                txStats.bcastBytesTxOK;
          break;
       case MAC_STAT_OPACKETS:
-         *val = txStats->TSOPktsTxOK +
-                txStats->ucastPktsTxOK +
-                txStats->mcastPktsTxOK +
-                txStats->bcastPktsTxOK;
+         *val = txStats.TSOPktsTxOK +
+                txStats.ucastPktsTxOK +
+                txStats.mcastPktsTxOK +
+                txStats.bcastPktsTxOK;
          break;
       case ETHER_STAT_LINK_DUPLEX:
          *val = LINK_DUPLEX_FULL;
@@ -246,6 +311,7 @@ vmxnet3_prepare_drivershared(vmxnet3_softc_t *dp)
 {
    Vmxnet3_DriverShared *ds;
    size_t allocSize = sizeof(Vmxnet3_DriverShared);
+   unsigned int i;
 
    if (vmxnet3_alloc_dma_mem_1(dp, &dp->sharedData, allocSize,
                                B_TRUE) != DDI_SUCCESS) {
@@ -254,7 +320,8 @@ vmxnet3_prepare_drivershared(vmxnet3_softc_t *dp)
    ds = VMXNET3_DS(dp);
    memset(ds, 0, allocSize);
 
-   allocSize = sizeof(Vmxnet3_TxQueueDesc) + sizeof(Vmxnet3_RxQueueDesc);
+   allocSize = dp->numQueues *
+               (sizeof(Vmxnet3_TxQueueDesc) + sizeof(Vmxnet3_RxQueueDesc));
    if (vmxnet3_alloc_dma_mem_128(dp, &dp->queueDescs, allocSize,
                                  B_TRUE) != DDI_SUCCESS) {
       vmxnet3_free_dma_mem(&dp->sharedData);
@@ -262,6 +329,34 @@ vmxnet3_prepare_drivershared(vmxnet3_softc_t *dp)
    }
    memset(dp->queueDescs.buf, 0, allocSize);
 
+   /*
+    * With several rx queues, have the device spread the flows over them
+    */
+   if (dp->numQueues > 1) {
+      UPT1_RSSConf *rssConf;
+
+      if (vmxnet3_alloc_dma_mem_1(dp, &dp->rssConf, sizeof(UPT1_RSSConf),
+                                  B_TRUE) != DDI_SUCCESS) {
+         vmxnet3_free_dma_mem(&dp->queueDescs);
+         vmxnet3_free_dma_mem(&dp->sharedData);
+         return DDI_FAILURE;
+      }
+      rssConf = (UPT1_RSSConf *) dp->rssConf.buf;
+      memset(rssConf, 0, sizeof(UPT1_RSSConf));
+
+      rssConf->hashType = UPT1_RSS_HASH_TYPE_IPV4 |
+                          UPT1_RSS_HASH_TYPE_TCP_IPV4 |
+                          UPT1_RSS_HASH_TYPE_IPV6 |
+                          UPT1_RSS_HASH_TYPE_TCP_IPV6;
+      rssConf->hashFunc = UPT1_RSS_HASH_FUNC_TOEPLITZ;
+      rssConf->hashKeySize = UPT1_RSS_MAX_KEY_SIZE;
+      memcpy(rssConf->hashKey, vmxnet3_rss_key, UPT1_RSS_MAX_KEY_SIZE);
+      rssConf->indTableSize = dp->numQueues * 4;
+      for (i = 0; i < rssConf->indTableSize; i++) {
+         rssConf->indTable[i] = i % dp->numQueues;
+      }
+   }
+
    ds->magic = VMXNET3_REV1_MAGIC;
 
    /* Take care of most of devRead */
@@ -282,17 +377,24 @@ vmxnet3_prepare_drivershared(vmxnet3_softc_t *dp)
    ds->devRead.misc.mtu = dp->cur_mtu;
 
    // XXX: ds->devRead.misc.maxNumRxSG
-   ds->devRead.misc.numTxQueues = 1;
-   ds->devRead.misc.numRxQueues = 1;
+   ds->devRead.misc.numTxQueues = dp->numQueues;
+   ds->devRead.misc.numRxQueues = dp->numQueues;
    ds->devRead.misc.queueDescPA = dp->queueDescs.bufPA;
    ds->devRead.misc.queueDescLen = allocSize;
 
    /* TxQueue and RxQueue information is filled in other functions */
 
+   if (dp->rssConf.buf) {
+      ds->devRead.misc.uptFeatures |= UPT1_F_RSS;
+      ds->devRead.rssConfDesc.confVer = 1;
+      ds->devRead.rssConfDesc.confLen = sizeof(UPT1_RSSConf);
+      ds->devRead.rssConfDesc.confPA = dp->rssConf.bufPA;
+   }
+
    ds->devRead.intrConf.autoMask = (dp->intrMaskMode == VMXNET3_IMM_AUTO);
-   ds->devRead.intrConf.numIntrs = 1;
+   ds->devRead.intrConf.numIntrs = dp->intrCount;
    // XXX: ds->intr.modLevels
-   ds->devRead.intrConf.eventIntrIdx = 0;
+   ds->devRead.intrConf.eventIntrIdx = VMXNET3_EVENT_INTR_IDX(dp);
 
    VMXNET3_BAR1_PUT32(dp, VMXNET3_REG_DSAL, VMXNET3_ADDR_LO(dp->sharedData.bufPA));
    VMXNET3_BAR1_PUT32(dp, VMXNET3_REG_DSAH, VMXNET3_ADDR_HI(dp->sharedData.bufPA));
@@ -321,6 +423,9 @@ vmxnet3_destroy_drivershared(vmxnet3_softc_t *dp)
    VMXNET3_BAR1_PUT32(dp, VMXNET3_REG_DSAL, 0);
    VMXNET3_BAR1_PUT32(dp, VMXNET3_REG_DSAH, 0);
 
+   if (dp->rssConf.buf) {
+      vmxnet3_free_dma_mem(&dp->rssConf);
+   }
    vmxnet3_free_dma_mem(&dp->queueDescs);
    vmxnet3_free_dma_mem(&dp->sharedData);
 }
@@ -393,7 +498,7 @@ vmxnet3_alloc_compring(vmxnet3_softc_t *dp, vmxnet3_compring_t *compRing)
  *
  * vmxnet3_prepare_txqueue --
  *
- *    Initialize the tx queue of a vmxnet3 device.
+ *    Initialize a tx queue of a vmxnet3 device.
  *
  * Results:
  *    DDI_SUCCESS or DDI_FAILURE.
@@ -404,10 +509,9 @@ vmxnet3_alloc_compring(vmxnet3_softc_t *dp, vmxnet3_compring_t *compRing)
  *---------------------------------------------------------------------------
  */
 static int
-vmxnet3_prepare_txqueue(vmxnet3_softc_t *dp)
+vmxnet3_prepare_txqueue(vmxnet3_softc_t *dp, vmxnet3_txqueue_t *txq)
 {
-   Vmxnet3_TxQueueDesc *tqdesc = VMXNET3_TQDESC(dp);
-   vmxnet3_txqueue_t *txq = &dp->txQueue;
+   Vmxnet3_TxQueueDesc *tqdesc = VMXNET3_TQDESC(dp, txq->qid);
 
    ASSERT(!(txq->cmdRing.size & VMXNET3_RING_SIZE_MASK));
    ASSERT(!(txq->compRing.size & VMXNET3_RING_SIZE_MASK));
@@ -426,17 +530,26 @@ vmxnet3_prepare_txqueue(vmxnet3_softc_t *dp)
    }
    tqdesc->conf.compRingBasePA = txq->compRing.dma.bufPA;
    tqdesc->conf.compRingSize = txq->compRing.size;
+   tqdesc->conf.intrIdx = VMXNET3_QUEUE_INTR_IDX(dp, txq->qid);
 
    txq->metaRing = kmem_zalloc(txq->cmdRing.size*sizeof(vmxnet3_metatx_t),
                                KM_SLEEP);
    ASSERT(txq->metaRing);
 
-   if (vmxnet3_txqueue_init(dp, txq) != DDI_SUCCESS) {
+   if (ddi_dma_alloc_handle(dp->dip, &vmxnet3_dma_attrs_tx, DDI_DMA_SLEEP,
+                            NULL, &txq->dmaHandle) != DDI_SUCCESS) {
+      VMXNET3_WARN(dp, "ddi_dma_alloc_handle() failed\n");
       goto error_mpring;
    }
 
+   if (vmxnet3_txqueue_init(dp, txq) != DDI_SUCCESS) {
+      goto error_txhandle;
+   }
+
    return DDI_SUCCESS;
 
+error_txhandle:
+   ddi_dma_free_handle(&txq->dmaHandle);
 error_mpring:
    kmem_free(txq->metaRing, txq->cmdRing.size*sizeof(vmxnet3_metatx_t));
    vmxnet3_free_dma_mem(&txq->compRing.dma);
@@ -451,7 +564,7 @@ error:
  *
  * vmxnet3_prepare_rxqueue --
  *
- *    Initialize the rx queue of a vmxnet3 device.
+ *    Initialize a rx queue of a vmxnet3 device.
  *
  * Results:
  *    DDI_SUCCESS or DDI_FAILURE.
@@ -462,10 +575,9 @@ error:
  *---------------------------------------------------------------------------
  */
 static int
-vmxnet3_prepare_rxqueue(vmxnet3_softc_t *dp)
+vmxnet3_prepare_rxqueue(vmxnet3_softc_t *dp, vmxnet3_rxqueue_t *rxq)
 {
-   Vmxnet3_RxQueueDesc *rqdesc = VMXNET3_RQDESC(dp);
-   vmxnet3_rxqueue_t *rxq = &dp->rxQueue;
+   Vmxnet3_RxQueueDesc *rqdesc = VMXNET3_RQDESC(dp, rxq->qid);
 
    ASSERT(!(rxq->cmdRing.size & VMXNET3_RING_SIZE_MASK));
    ASSERT(!(rxq->compRing.size & VMXNET3_RING_SIZE_MASK));
@@ -484,6 +596,7 @@ vmxnet3_prepare_rxqueue(vmxnet3_softc_t *dp)
    }
    rqdesc->conf.compRingBasePA = rxq->compRing.dma.bufPA;
    rqdesc->conf.compRingSize = rxq->compRing.size;
+   rqdesc->conf.intrIdx = VMXNET3_QUEUE_INTR_IDX(dp, rxq->qid);
 
    rxq->bufRing = kmem_zalloc(rxq->cmdRing.size*sizeof(vmxnet3_bufdesc_t),
                               KM_SLEEP);
@@ -509,7 +622,7 @@ error:
  *
  * vmxnet3_destroy_txqueue --
  *
- *    Destroy the tx queue of a vmxnet3 device.
+ *    Destroy a tx queue of a vmxnet3 device.
  *
  * Results:
  *    None.
@@ -520,15 +633,15 @@ error:
  *---------------------------------------------------------------------------
  */
 static void
-vmxnet3_destroy_txqueue(vmxnet3_softc_t *dp)
+vmxnet3_destroy_txqueue(vmxnet3_softc_t *dp, vmxnet3_txqueue_t *txq)
 {
-   vmxnet3_txqueue_t *txq = &dp->txQueue;
-
    ASSERT(txq->metaRing);
    ASSERT(txq->cmdRing.dma.buf && txq->compRing.dma.buf);
 
    vmxnet3_txqueue_fini(dp, txq);
 
+   ddi_dma_free_handle(&txq->dmaHandle);
+
    kmem_free(txq->metaRing, txq->cmdRing.size*sizeof(vmxnet3_metatx_t));
 
    vmxnet3_free_dma_mem(&txq->cmdRing.dma);
@@ -540,7 +653,7 @@ vmxnet3_destroy_txqueue(vmxnet3_softc_t *dp)
  *
  * vmxnet3_destroy_rxqueue --
  *
- *    Destroy the rx queue of a vmxnet3 device.
+ *    Destroy a rx queue of a vmxnet3 device.
  *
  * Results:
  *    None.
@@ -551,10 +664,8 @@ vmxnet3_destroy_txqueue(vmxnet3_softc_t *dp)
  *---------------------------------------------------------------------------
  */
 static void
-vmxnet3_destroy_rxqueue(vmxnet3_softc_t *dp)
+vmxnet3_destroy_rxqueue(vmxnet3_softc_t *dp, vmxnet3_rxqueue_t *rxq)
 {
-   vmxnet3_rxqueue_t *rxq = &dp->rxQueue;
-
    ASSERT(rxq->bufRing);
    ASSERT(rxq->cmdRing.dma.buf && rxq->compRing.dma.buf);
 
@@ -641,9 +752,8 @@ static int
 vmxnet3_start(void *data)
 {
    vmxnet3_softc_t *dp = data;
-   Vmxnet3_TxQueueDesc *tqdesc;
-   Vmxnet3_RxQueueDesc *rqdesc;
    int txQueueSize, rxQueueSize;
+   unsigned int i;
    uint32_t ret32;
 
    VMXNET3_DEBUG(dp, 1, "start()\n");
@@ -655,52 +765,44 @@ vmxnet3_start(void *data)
       VMXNET3_WARN(dp, "vmxnet3_prepare_drivershared() failed\n");
       goto error;
    }
-   tqdesc = VMXNET3_TQDESC(dp);
-   rqdesc = VMXNET3_RQDESC(dp);
 
-   /*
-    * Create and initialize the tx queue
-    */
    txQueueSize = vmxnet3_getprop(dp, "TxRingSize", 32, 4096,
                                  VMXNET3_DEF_TX_RING_SIZE);
-   if (!(txQueueSize & VMXNET3_RING_SIZE_MASK)) {
-      dp->txQueue.cmdRing.size = txQueueSize;
-      dp->txQueue.compRing.size = txQueueSize;
-      dp->txQueue.sharedCtrl = &tqdesc->ctrl;
-      if (vmxnet3_prepare_txqueue(dp) != DDI_SUCCESS) {
-         VMXNET3_WARN(dp, "vmxnet3_prepare_txqueue() failed\n");
-         goto error_shared_data;
-      }
-   } else {
+   if (txQueueSize & VMXNET3_RING_SIZE_MASK) {
       VMXNET3_WARN(dp, "invalid tx ring size (%d)\n", txQueueSize);
       goto error_shared_data;
    }
 
-   /*
-    * Create and initialize the rx queue
-    */
    rxQueueSize = vmxnet3_getprop(dp, "RxRingSize", 32, 4096,
                                  VMXNET3_DEF_RX_RING_SIZE);
-   if (!(rxQueueSize & VMXNET3_RING_SIZE_MASK)) {
-      dp->rxQueue.cmdRing.size = rxQueueSize;
-      dp->rxQueue.compRing.size = rxQueueSize;
-      dp->rxQueue.sharedCtrl = &rqdesc->ctrl;
-      if (vmxnet3_prepare_rxqueue(dp) != DDI_SUCCESS) {
-         VMXNET3_WARN(dp, "vmxnet3_prepare_rxqueue() failed\n");
-         goto error_tx_queue;
-      }
-   } else {
+   if (rxQueueSize & VMXNET3_RING_SIZE_MASK) {
       VMXNET3_WARN(dp, "invalid rx ring size (%d)\n", rxQueueSize);
-      goto error_tx_queue;
+      goto error_shared_data;
    }
 
    /*
-    * Allocate the Tx DMA handle
+    * Create and initialize the tx and rx queues
     */
-   if (ddi_dma_alloc_handle(dp->dip, &vmxnet3_dma_attrs_tx, DDI_DMA_SLEEP,
-                            NULL, &dp->txDmaHandle) != DDI_SUCCESS) {
-      VMXNET3_WARN(dp, "ddi_dma_alloc_handle() failed\n");
-      goto error_rx_queue;
+   for (i = 0; i < dp->numQueues; i++) {
+      vmxnet3_txqueue_t *txq = &dp->txQueue[i];
+      vmxnet3_rxqueue_t *rxq = &dp->rxQueue[i];
+
+      txq->cmdRing.size = txQueueSize;
+      txq->compRing.size = txQueueSize;
+      txq->sharedCtrl = &VMXNET3_TQDESC(dp, i)->ctrl;
+      if (vmxnet3_prepare_txqueue(dp, txq) != DDI_SUCCESS) {
+         VMXNET3_WARN(dp, "vmxnet3_prepare_txqueue(%u) failed\n", i);
+         goto error_queues;
+      }
+
+      rxq->cmdRing.size = rxQueueSize;
+      rxq->compRing.size = rxQueueSize;
+      rxq->sharedCtrl = &VMXNET3_RQDESC(dp, i)->ctrl;
+      if (vmxnet3_prepare_rxqueue(dp, rxq) != DDI_SUCCESS) {
+         VMXNET3_WARN(dp, "vmxnet3_prepare_rxqueue(%u) failed\n", i);
+         vmxnet3_destroy_txqueue(dp, txq);
+         goto error_queues;
+      }
    }
 
    /*
@@ -710,11 +812,14 @@ vmxnet3_start(void *data)
    ret32 = VMXNET3_BAR1_GET32(dp, VMXNET3_REG_CMD);
    if (ret32) {
       VMXNET3_WARN(dp, "ACTIVATE_DEV failed: 0x%x\n", ret32);
-      goto error_txhandle;
+      goto error_queues;
    }
    dp->devEnabled = B_TRUE;
 
-   VMXNET3_BAR0_PUT32(dp, VMXNET3_REG_RXPROD, dp->txQueue.cmdRing.size - 1);
+   for (i = 0; i < dp->numQueues; i++) {
+      VMXNET3_BAR0_PUT32(dp, VMXNET3_BAR0_QREG(VMXNET3_REG_RXPROD, i),
+                         dp->rxQueue[i].cmdRing.size - 1);
+   }
 
    /*
     * Update the RX filters, must be done after ACTIVATE_DEV
@@ -729,18 +834,19 @@ vmxnet3_start(void *data)
    mac_link_update(dp->mac, dp->linkState);
 
    /*
-    * Finally, unmask the interrupt
+    * Finally, unmask the interrupts
     */
-   VMXNET3_BAR0_PUT32(dp, VMXNET3_REG_IMR, 0);
+   for (i = 0; i < dp->intrCount; i++) {
+      VMXNET3_BAR0_PUT32(dp, VMXNET3_BAR0_QREG(VMXNET3_REG_IMR, i), 0);
+   }
 
    return DDI_SUCCESS;
 
-error_txhandle:
-   ddi_dma_free_handle(&dp->txDmaHandle);
-error_rx_queue:
-   vmxnet3_destroy_rxqueue(dp);
-error_tx_queue:
-   vmxnet3_destroy_txqueue(dp);
+error_queues:
+   while (i--) {
+      vmxnet3_destroy_rxqueue(dp, &dp->rxQueue[i]);
+      vmxnet3_destroy_txqueue(dp, &dp->txQueue[i]);
+   }
 error_shared_data:
    vmxnet3_destroy_drivershared(dp);
 error:
@@ -767,25 +873,35 @@ static void
 vmxnet3_stop(void *data)
 {
    vmxnet3_softc_t *dp = data;
+   unsigned int i;
 
    VMXNET3_DEBUG(dp, 1, "stop()\n");
 
    /*
-    * Take the 2 locks related to asynchronous events.
+    * Take the locks related to asynchronous events, in the order the
+    * interrupt handlers take them.
     * These events should always check dp->devEnabled before poking dp.
     */
    mutex_enter(&dp->intrLock);
+   for (i = 0; i < dp->numQueues; i++) {
+      mutex_enter(&dp->rxQueue[i].lock);
+   }
    mutex_enter(&dp->rxPoolLock);
-   VMXNET3_BAR0_PUT32(dp, VMXNET3_REG_IMR, 1);
+   for (i = 0; i < dp->intrCount; i++) {
+      VMXNET3_BAR0_PUT32(dp, VMXNET3_BAR0_QREG(VMXNET3_REG_IMR, i), 1);
+   }
    dp->devEnabled = B_FALSE;
    VMXNET3_BAR1_PUT32(dp, VMXNET3_REG_CMD, VMXNET3_CMD_QUIESCE_DEV);
    mutex_exit(&dp->rxPoolLock);
+   for (i = dp->numQueues; i-- > 0; ) {
+      mutex_exit(&dp->rxQueue[i].lock);
+   }
    mutex_exit(&dp->intrLock);
 
-   ddi_dma_free_handle(&dp->txDmaHandle);
-
-   vmxnet3_destroy_rxqueue(dp);
-   vmxnet3_destroy_txqueue(dp);
+   for (i = 0; i < dp->numQueues; i++) {
+      vmxnet3_destroy_rxqueue(dp, &dp->rxQueue[i]);
+      vmxnet3_destroy_txqueue(dp, &dp->txQueue[i]);
+   }
 
    vmxnet3_destroy_drivershared(dp);
 }
@@ -1316,15 +1432,19 @@ vmxnet3_intr_events(vmxnet3_softc_t *dp)
    if (events) {
       VMXNET3_DEBUG(dp, 2, "events(0x%x)\n", events);
       if (events & (VMXNET3_ECR_RQERR | VMXNET3_ECR_TQERR)) {
-         Vmxnet3_TxQueueDesc *tqdesc = VMXNET3_TQDESC(dp);
-         Vmxnet3_RxQueueDesc *rqdesc = VMXNET3_RQDESC(dp);
+         unsigned int i;
 
          VMXNET3_BAR1_PUT32(dp, VMXNET3_REG_CMD, VMXNET3_CMD_GET_QUEUE_STATUS);
-         if (tqdesc->status.stopped) {
-            VMXNET3_WARN(dp, "tq error 0x%x\n", tqdesc->status.error);
-         }
-         if (rqdesc->status.stopped) {
-            VMXNET3_WARN(dp, "rq error 0x%x\n", rqdesc->status.error);
+         for (i = 0; i < dp->numQueues; i++) {
+            Vmxnet3_TxQueueDesc *tqdesc = VMXNET3_TQDESC(dp, i);
+            Vmxnet3_RxQueueDesc *rqdesc = VMXNET3_RQDESC(dp, i);
+
+            if (tqdesc->status.stopped) {
+               VMXNET3_WARN(dp, "tq%u error 0x%x\n", i, tqdesc->status.error);
+            }
+            if (rqdesc->status.stopped) {
+               VMXNET3_WARN(dp, "rq%u error 0x%x\n", i, rqdesc->status.error);
+            }
          }
 
          if (ddi_taskq_dispatch(dp->resetTask, vmxnet3_reset,
@@ -1352,7 +1472,10 @@ vmxnet3_intr_events(vmxnet3_softc_t *dp)
  *
  * vmxnet3_intr --
  *
- *    Interrupt handler of a vmxnet3 device.
+ *    Interrupt handler of a vmxnet3 device. data2 is the index of the
+ *    vector: it services the events if it is the event vector and the
+ *    queue pair with the same index if there is one. Each queue pair is
+ *    serialized by its rx queue lock, so the vectors run in parallel.
  *
  * Results:
  *    DDI_INTR_CLAIMED or DDI_INTR_UNCLAIMED.
@@ -1366,51 +1489,231 @@ static u_int
 vmxnet3_intr(caddr_t data1, caddr_t data2)
 {
    vmxnet3_softc_t *dp = (void *) data1;
+   unsigned int intrIdx = (uintptr_t) data2;
+   boolean_t isEventIntr = intrIdx == VMXNET3_EVENT_INTR_IDX(dp);
+   vmxnet3_rxqueue_t *rxq = NULL;
+   boolean_t linkStateChanged = B_FALSE;
+   boolean_t mustUpdateTx = B_FALSE;
+   mblk_t *mps = NULL;
 
-   VMXNET3_DEBUG(dp, 3, "intr()\n");
+   VMXNET3_DEBUG(dp, 3, "intr(%u)\n", intrIdx);
 
-   mutex_enter(&dp->intrLock);
+   if (intrIdx < dp->numQueues) {
+      rxq = &dp->rxQueue[intrIdx];
+   }
 
-   if (dp->devEnabled) {
-      boolean_t linkStateChanged;
-      boolean_t mustUpdateTx;
-      mblk_t *mps;
+   if (isEventIntr) {
+      mutex_enter(&dp->intrLock);
+   }
+   if (rxq) {
+      mutex_enter(&rxq->lock);
+   }
 
-      if (dp->intrType == DDI_INTR_TYPE_FIXED &&
-          !VMXNET3_BAR1_GET32(dp, VMXNET3_REG_ICR)) {
-         goto intr_unclaimed;
-      }
+   if (!dp->devEnabled) {
+      goto intr_unclaimed;
+   }
 
-      if (dp->intrMaskMode == VMXNET3_IMM_ACTIVE) {
-         VMXNET3_BAR0_PUT32(dp, VMXNET3_REG_IMR, 1);
-      }
+   if (dp->intrType == DDI_INTR_TYPE_FIXED &&
+       !VMXNET3_BAR1_GET32(dp, VMXNET3_REG_ICR)) {
+      goto intr_unclaimed;
+   }
 
-      linkStateChanged = vmxnet3_intr_events(dp);
-      mustUpdateTx = vmxnet3_tx_complete(dp, &dp->txQueue);
-      mps = vmxnet3_rx_intr(dp, &dp->rxQueue);
+   if (dp->intrMaskMode == VMXNET3_IMM_ACTIVE) {
+      VMXNET3_BAR0_PUT32(dp, VMXNET3_BAR0_QREG(VMXNET3_REG_IMR, intrIdx), 1);
+   }
 
+   if (isEventIntr) {
+      linkStateChanged = vmxnet3_intr_events(dp);
+   }
+   if (rxq) {
+      rxq->intrs++;
+      mustUpdateTx = vmxnet3_tx_complete(dp, &dp->txQueue[intrIdx]);
+      mps = vmxnet3_rx_intr(dp, rxq);
+      mutex_exit(&rxq->lock);
+   }
+   if (isEventIntr) {
       mutex_exit(&dp->intrLock);
-      VMXNET3_BAR0_PUT32(dp, VMXNET3_REG_IMR, 0);
+   }
 
-      if (linkStateChanged) {
-         mac_link_update(dp->mac, dp->linkState);
-      }
-      if (mustUpdateTx) {
-         mac_tx_update(dp->mac);
-      }
-      if (mps) {
-         mac_rx(dp->mac, NULL, mps);
-      }
+   VMXNET3_BAR0_PUT32(dp, VMXNET3_BAR0_QREG(VMXNET3_REG_IMR, intrIdx), 0);
 
-      return DDI_INTR_CLAIMED;
+   if (linkStateChanged) {
+      mac_link_update(dp->mac, dp->linkState);
+   }
+   if (mustUpdateTx) {
+      mac_tx_update(dp->mac);
    }
+   if (mps) {
+      mac_rx(dp->mac, NULL, mps);
+   }
+
+   return DDI_INTR_CLAIMED;
 
 intr_unclaimed:
-   mutex_exit(&dp->intrLock);
+   if (rxq) {
+      mutex_exit(&rxq->lock);
+   }
+   if (isEventIntr) {
+      mutex_exit(&dp->intrLock);
+   }
    return DDI_INTR_UNCLAIMED;
 }
 
 
+/*
+ *---------------------------------------------------------------------------
+ *
+ * vmxnet3_queue_kstat_update --
+ *
+ *    Refresh the statistics of a queue pair.
+ *
+ * Results:
+ *    0 or EACCES.
+ *
+ * Side effects:
+ *    None.
+ *
+ *---------------------------------------------------------------------------
+ */
+static int
+vmxnet3_queue_kstat_update(kstat_t *ks, int rw)
+{
+   vmxnet3_txqueue_t *txq = ks->ks_private;
+   vmxnet3_softc_t *dp = txq->dp;
+   vmxnet3_rxqueue_t *rxq = &dp->rxQueue[txq->qid];
+   vmxnet3_queue_kstats_t *qks = ks->ks_data;
+
+   if (rw == KSTAT_WRITE) {
+      return EACCES;
+   }
+
+   qks->txRingFull.value.ui64 = txq->ringFull;
+   qks->intrs.value.ui64 = rxq->intrs;
+
+   /*
+    * The device counters live in the queue descriptors, which only exist
+    * while the device is started. intrLock keeps vmxnet3_stop() away.
+    */
+   mutex_enter(&dp->intrLock);
+   if (dp->devEnabled) {
+      UPT1_TxStats *txStats = &VMXNET3_TQDESC(dp, txq->qid)->stats;
+      UPT1_RxStats *rxStats = &VMXNET3_RQDESC(dp, txq->qid)->stats;
+
+      VMXNET3_BAR1_PUT32(dp, VMXNET3_REG_CMD, VMXNET3_CMD_GET_STATS);
+
+      qks->txPackets.value.ui64 = txStats->TSOPktsTxOK +
+                                  txStats->ucastPktsTxOK +
+                                  txStats->mcastPktsTxOK +
+                                  txStats->bcastPktsTxOK;
+      qks->txBytes.value.ui64 = txStats->TSOBytesTxOK +
+                                txStats->ucastBytesTxOK +
+                                txStats->mcastBytesTxOK +
+                                txStats->bcastBytesTxOK;
+      qks->txErrors.value.ui64 = txStats->pktsTxError;
+      qks->txDiscards.value.ui64 = txStats->pktsTxDiscard;
+      qks->rxPackets.value.ui64 = rxStats->LROPktsRxOK +
+                                  rxStats->ucastPktsRxOK +
+                                  rxStats->mcastPktsRxOK +
+                                  rxStats->bcastPktsRxOK;
+      qks->rxBytes.value.ui64 = rxStats->LROBytesRxOK +
+                                rxStats->ucastBytesRxOK +
+                                rxStats->mcastBytesRxOK +
+                                rxStats->bcastBytesRxOK;
+      qks->rxErrors.value.ui64 = rxStats->pktsRxError;
+      qks->rxNoBuf.value.ui64 = rxStats->pktsRxOutOfBuf;
+   }
+   mutex_exit(&dp->intrLock);
+
+   return 0;
+}
+
+
+/*
+ *---------------------------------------------------------------------------
+ *
+ * vmxnet3_kstats_init --
+ *
+ *    Create the per queue pair kstats of a vmxnet3 device. A failure is
+ *    not fatal, the queue pair just goes without.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *---------------------------------------------------------------------------
+ */
+static void
+vmxnet3_kstats_init(vmxnet3_softc_t *dp)
+{
+   unsigned int i;
+
+   for (i = 0; i < dp->numQueues; i++) {
+      vmxnet3_queue_kstats_t *qks;
+      char name[KSTAT_STRLEN];
+      kstat_t *ks;
+
+      snprintf(name, sizeof name, "queue%u", i);
+      ks = kstat_create(VMXNET3_MODNAME, dp->instance, name, "net",
+                        KSTAT_TYPE_NAMED,
+                        sizeof(vmxnet3_queue_kstats_t) / sizeof(kstat_named_t),
+                        0);
+      if (!ks) {
+         VMXNET3_WARN(dp, "kstat_create(%s) failed\n", name);
+         continue;
+      }
+
+      qks = ks->ks_data;
+      kstat_named_init(&qks->txPackets, "tx_packets", KSTAT_DATA_UINT64);
+      kstat_named_init(&qks->txBytes, "tx_bytes", KSTAT_DATA_UINT64);
+      kstat_named_init(&qks->txErrors, "tx_errors", KSTAT_DATA_UINT64);
+      kstat_named_init(&qks->txDiscards, "tx_discards", KSTAT_DATA_UINT64);
+      kstat_named_init(&qks->txRingFull, "tx_ring_full", KSTAT_DATA_UINT64);
+      kstat_named_init(&qks->rxPackets, "rx_packets", KSTAT_DATA_UINT64);
+      kstat_named_init(&qks->rxBytes, "rx_bytes", KSTAT_DATA_UINT64);
+      kstat_named_init(&qks->rxErrors, "rx_errors", KSTAT_DATA_UINT64);
+      kstat_named_init(&qks->rxNoBuf, "rx_nobuf", KSTAT_DATA_UINT64);
+      kstat_named_init(&qks->intrs, "intrs", KSTAT_DATA_UINT64);
+
+      ks->ks_update = vmxnet3_queue_kstat_update;
+      ks->ks_private = &dp->txQueue[i];
+      kstat_install(ks);
+
+      dp->queueStats[i] = ks;
+   }
+}
+
+
+/*
+ *---------------------------------------------------------------------------
+ *
+ * vmxnet3_kstats_fini --
+ *
+ *    Delete the per queue pair kstats of a vmxnet3 device.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *---------------------------------------------------------------------------
+ */
+static void
+vmxnet3_kstats_fini(vmxnet3_softc_t *dp)
+{
+   unsigned int i;
+
+   for (i = 0; i < dp->numQueues; i++) {
+      if (dp->queueStats[i]) {
+         kstat_delete(dp->queueStats[i]);
+         dp->queueStats[i] = NULL;
+      }
+   }
+}
+
+
 /*
  *---------------------------------------------------------------------------
  *
@@ -1433,7 +1736,7 @@ vmxnet3_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
    mac_register_t *macr;
    uint16_t vendorId, devId, ret16;
    uint32_t ret32;
-   int ret, err;
+   int ret, err, maxQueues, i;
    uint_t uret;
 
    if (cmd != DDI_ATTACH) {
@@ -1553,9 +1856,19 @@ vmxnet3_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
       goto error_regs_map_1;
    }
 
+   /*
+    * One queue pair per CPU, up to MaxQueues
+    */
+   maxQueues = vmxnet3_getprop(dp, "MaxQueues", 1, VMXNET3_MAX_QUEUES,
+                               VMXNET3_MAX_QUEUES);
+   if (maxQueues > ncpus) {
+      maxQueues = ncpus;
+   }
+
    /*
     * Register the interrupt(s) in this order of preference:
     * MSI-X, MSI, INTx
+    * Only MSI-X gets a vector per queue pair plus one for the events.
     */
    VMXNET3_BAR1_PUT32(dp, VMXNET3_REG_CMD, VMXNET3_CMD_GET_CONF_INTR);
    ret32 = VMXNET3_BAR1_GET32(dp, VMXNET3_REG_CMD);
@@ -1563,21 +1876,24 @@ vmxnet3_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
       case VMXNET3_IT_AUTO:
       case VMXNET3_IT_MSIX:
          dp->intrType = DDI_INTR_TYPE_MSIX;
-         err = ddi_intr_alloc(dip, &dp->intrHandle, dp->intrType, 0, 1,
-                              &ret, DDI_INTR_ALLOC_STRICT);
+         err = ddi_intr_alloc(dip, dp->intrHandles, dp->intrType, 0,
+                              maxQueues > 1 ? maxQueues + 1 : 1,
+                              &dp->intrCount, DDI_INTR_ALLOC_NORMAL);
          if (err == DDI_SUCCESS)
             break;
          VMXNET3_DEBUG(dp, 2, "DDI_INTR_TYPE_MSIX failed, err:%d\n", err);
       case VMXNET3_IT_MSI:
          dp->intrType = DDI_INTR_TYPE_MSI;
-         if (ddi_intr_alloc(dip, &dp->intrHandle, dp->intrType, 0, 1,
-                            &ret, DDI_INTR_ALLOC_STRICT) == DDI_SUCCESS)
+         if (ddi_intr_alloc(dip, dp->intrHandles, dp->intrType, 0, 1,
+                            &dp->intrCount,
+                            DDI_INTR_ALLOC_STRICT) == DDI_SUCCESS)
             break;
          VMXNET3_DEBUG(dp, 2, "DDI_INTR_TYPE_MSI failed\n");
       case VMXNET3_IT_INTX:
          dp->intrType = DDI_INTR_TYPE_FIXED;
-         if (ddi_intr_alloc(dip, &dp->intrHandle, dp->intrType, 0, 1,
-                            &ret, DDI_INTR_ALLOC_STRICT) == DDI_SUCCESS) {
+         if (ddi_intr_alloc(dip, dp->intrHandles, dp->intrType, 0, 1,
+                            &dp->intrCount,
+                            DDI_INTR_ALLOC_STRICT) == DDI_SUCCESS) {
             break;
          }
          VMXNET3_DEBUG(dp, 2, "DDI_INTR_TYPE_INTX failed\n");
@@ -1591,13 +1907,26 @@ vmxnet3_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
       goto error_intr;
    }
 
-   if (ddi_intr_get_pri(dp->intrHandle, &uret) != DDI_SUCCESS) {
+   /*
+    * The system may have granted fewer vectors than asked for. Without
+    * a vector to spare for the events, run a single queue pair.
+    */
+   dp->numQueues = dp->intrCount > 1 ? dp->intrCount - 1 : 1;
+   for (i = 0; i < dp->numQueues; i++) {
+      dp->txQueue[i].dp = dp;
+      dp->txQueue[i].qid = i;
+      dp->rxQueue[i].qid = i;
+   }
+
+   if (ddi_intr_get_pri(dp->intrHandles[0], &uret) != DDI_SUCCESS) {
       VMXNET3_WARN(dp, "ddi_intr_get_pri() failed\n");
       goto error_intr;
    }
 
-   VMXNET3_DEBUG(dp, 2, "intrType=0x%x, intrMaskMode=0x%x, intrPrio=%u\n",
-           dp->intrType, dp->intrMaskMode, uret);
+   VMXNET3_DEBUG(dp, 2, "intrType=0x%x, intrMaskMode=0x%x, intrPrio=%u, "
+                 "intrCount=%d, numQueues=%u\n",
+                 dp->intrType, dp->intrMaskMode, uret,
+                 dp->intrCount, dp->numQueues);
 
    /*
     * Create a task queue to reset the device if it wedges.
@@ -1614,46 +1943,69 @@ vmxnet3_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
     * This _must_ be done before ddi_intr_enable()
     */
    mutex_init(&dp->intrLock, NULL, MUTEX_DRIVER, DDI_INTR_PRI(uret));
-   mutex_init(&dp->txLock, NULL, MUTEX_DRIVER, DDI_INTR_PRI(uret));
    mutex_init(&dp->rxPoolLock, NULL, MUTEX_DRIVER, DDI_INTR_PRI(uret));
+   for (i = 0; i < dp->numQueues; i++) {
+      mutex_init(&dp->txQueue[i].lock, NULL, MUTEX_DRIVER,
+                 DDI_INTR_PRI(uret));
+      mutex_init(&dp->rxQueue[i].lock, NULL, MUTEX_DRIVER,
+                 DDI_INTR_PRI(uret));
+   }
 
-   if (ddi_intr_add_handler(dp->intrHandle, vmxnet3_intr,
-                            dp, NULL) != DDI_SUCCESS) {
-      VMXNET3_WARN(dp, "ddi_intr_add_handler() failed\n");
-      goto error_mutexes;
+   for (i = 0; i < dp->intrCount; i++) {
+      if (ddi_intr_add_handler(dp->intrHandles[i], vmxnet3_intr, dp,
+                               (caddr_t) (uintptr_t) i) != DDI_SUCCESS) {
+         VMXNET3_WARN(dp, "ddi_intr_add_handler(%d) failed\n", i);
+         goto error_intr_handler;
+      }
    }
 
-   err = ddi_intr_get_cap(dp->intrHandle, &dp->intrCap);
+   err = ddi_intr_get_cap(dp->intrHandles[0], &dp->intrCap);
    if (err != DDI_SUCCESS) {
       VMXNET3_WARN(dp, "ddi_intr_get_cap() failed %d", err);
       goto error_intr_handler;
    }
 
+   vmxnet3_kstats_init(dp);
+
    if (dp->intrCap & DDI_INTR_FLAG_BLOCK) {
-      err = ddi_intr_block_enable(&dp->intrHandle, 1);
+      err = ddi_intr_block_enable(dp->intrHandles, dp->intrCount);
       if (err != DDI_SUCCESS) {
          VMXNET3_WARN(dp, "ddi_intr_block_enable() failed, err:%d\n", err);
-         goto error_intr_handler;
+         goto error_kstats;
       }
    } else {
-      err = ddi_intr_enable(dp->intrHandle);
-      if ((err != DDI_SUCCESS)) {
-         VMXNET3_WARN(dp, "ddi_intr_enable() failed, err:%d\n", err);
-         goto error_intr_handler;
+      for (i = 0; i < dp->intrCount; i++) {
+         err = ddi_intr_enable(dp->intrHandles[i]);
+         if ((err != DDI_SUCCESS)) {
+            VMXNET3_WARN(dp, "ddi_intr_enable() failed, err:%d\n", err);
+            while (i--) {
+               ddi_intr_disable(dp->intrHandles[i]);
+            }
+            goto error_kstats;
+         }
       }
    }
 
    return DDI_SUCCESS;
 
+error_kstats:
+   vmxnet3_kstats_fini(dp);
+   i = dp->intrCount;
 error_intr_handler:
-   ddi_intr_remove_handler(dp->intrHandle);
-error_mutexes:
+   while (i--) {
+      ddi_intr_remove_handler(dp->intrHandles[i]);
+   }
+   for (i = 0; i < dp->numQueues; i++) {
+      mutex_destroy(&dp->rxQueue[i].lock);
+      mutex_destroy(&dp->txQueue[i].lock);
+   }
    mutex_destroy(&dp->rxPoolLock);
-   mutex_destroy(&dp->txLock);
    mutex_destroy(&dp->intrLock);
    ddi_taskq_destroy(dp->resetTask);
 error_intr:
-   ddi_intr_free(dp->intrHandle);
+   for (i = 0; i < dp->intrCount; i++) {
+      ddi_intr_free(dp->intrHandles[i]);
+   }
 error_mac:
    mac_unregister(dp->mac);
 error_regs_map_1:
@@ -1688,6 +2040,7 @@ vmxnet3_detach(dev_info_t *dip, ddi_detach_cmd_t cmd)
 {
    vmxnet3_softc_t *dp = ddi_get_driver_private(dip);
    unsigned int retries = 0;
+   int i;
 
    VMXNET3_DEBUG(dp, 1, "detach()\n");
 
@@ -1707,12 +2060,18 @@ vmxnet3_detach(dev_info_t *dip, ddi_detach_cmd_t cmd)
    }
 
    if (dp->intrCap & DDI_INTR_FLAG_BLOCK) {
-      ddi_intr_block_disable(&dp->intrHandle, 1);
+      ddi_intr_block_disable(dp->intrHandles, dp->intrCount);
    } else {
-      ddi_intr_disable(dp->intrHandle);
+      for (i = 0; i < dp->intrCount; i++) {
+         ddi_intr_disable(dp->intrHandles[i]);
+      }
    }
-   ddi_intr_remove_handler(dp->intrHandle);
-   ddi_intr_free(dp->intrHandle);
+   for (i = 0; i < dp->intrCount; i++) {
+      ddi_intr_remove_handler(dp->intrHandles[i]);
+      ddi_intr_free(dp->intrHandles[i]);
+   }
+
+   vmxnet3_kstats_fini(dp);
 
    mac_unregister(dp->mac);
 
@@ -1720,8 +2079,11 @@ vmxnet3_detach(dev_info_t *dip, ddi_detach_cmd_t cmd)
       vmxnet3_free_dma_mem(&dp->mfTable);
    }
 
+   for (i = 0; i < dp->numQueues; i++) {
+      mutex_destroy(&dp->rxQueue[i].lock);
+      mutex_destroy(&dp->txQueue[i].lock);
+   }
    mutex_destroy(&dp->rxPoolLock);
-   mutex_destroy(&dp->txLock);
    mutex_destroy(&dp->intrLock);
    ddi_taskq_destroy(dp->resetTask);
 
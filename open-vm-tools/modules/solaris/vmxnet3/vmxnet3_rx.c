@@ -369,7 +369,7 @@ vmxnet3_rx_intr(vmxnet3_softc_t *dp, vmxnet3_rxqueue_t *rxq)
    Vmxnet3_GenericDesc *compDesc;
    mblk_t *mplist = NULL, **mplistTail = &mplist;
 
-   ASSERT(mutex_owned(&dp->intrLock));
+   ASSERT(mutex_owned(&rxq->lock));
 
    compDesc = VMXNET3_GET_DESC(compRing, compRing->next2comp);
    while (compDesc->rcd.gen == compRing->gen) {
@@ -463,7 +463,8 @@ vmxnet3_rx_intr(vmxnet3_softc_t *dp, vmxnet3_rxqueue_t *rxq)
       } else {
          rxprod = cmdRing->size - 1;
       }
-      VMXNET3_BAR0_PUT32(dp, VMXNET3_REG_RXPROD, rxprod);
+      VMXNET3_BAR0_PUT32(dp, VMXNET3_BAR0_QREG(VMXNET3_REG_RXPROD, rxq->qid),
+                         rxprod);
    }
 
    return mplist;
@@ -26,6 +26,7 @@
 #include <sys/kmem.h>
 #include <sys/stat.h>
 #include <sys/kstat.h>
+#include <sys/cpuvar.h>
 #include <sys/vtrace.h>
 #include <sys/dlpi.h>
 #include <sys/strsun.h>
@@ -85,10 +86,16 @@ typedef struct vmxnet3_metatx_t {
 } vmxnet3_metatx_t;
 
 typedef struct vmxnet3_txqueue_t {
+   struct vmxnet3_softc_t *dp;
+   unsigned int         qid;
+   kmutex_t             lock;
    vmxnet3_cmdring_t    cmdRing;
    vmxnet3_compring_t   compRing;
    vmxnet3_metatx_t    *metaRing;
    Vmxnet3_TxQueueCtrl *sharedCtrl;
+   ddi_dma_handle_t     dmaHandle;
+   boolean_t            mustResched;
+   uint64_t             ringFull;
 } vmxnet3_txqueue_t;
 
 typedef struct vmxnet3_rxbuf_t {
@@ -110,12 +117,21 @@ typedef struct vmxnet3_rxpool_t {
 } vmxnet3_rxpool_t;
 
 typedef struct vmxnet3_rxqueue_t {
+   unsigned int         qid;
+   kmutex_t             lock;
    vmxnet3_cmdring_t    cmdRing;
    vmxnet3_compring_t   compRing;
    vmxnet3_bufdesc_t   *bufRing;
    Vmxnet3_RxQueueCtrl *sharedCtrl;
+   uint64_t             intrs;
 } vmxnet3_rxqueue_t;
 
+/*
+ * Tx and rx queues come in pairs: pair i shares interrupt vector i. With
+ * a single vector, pair 0 and the device events all share vector 0.
+ */
+#define VMXNET3_MAX_QUEUES VMXNET3_MAX_TX_QUEUES
+
 
 typedef struct vmxnet3_softc_t {
    dev_info_t          *dip;
@@ -139,15 +155,16 @@ typedef struct vmxnet3_softc_t {
    int                  intrType;
    int                  intrMaskMode;
    int                  intrCap;
-   ddi_intr_handle_t    intrHandle;
+   int                  intrCount;
+   ddi_intr_handle_t    intrHandles[VMXNET3_MAX_QUEUES + 1];
    ddi_taskq_t         *resetTask;
 
-   kmutex_t             txLock;
-   vmxnet3_txqueue_t    txQueue;
-   ddi_dma_handle_t     txDmaHandle;
-   boolean_t            txMustResched;
+   unsigned int         numQueues;
+   vmxnet3_txqueue_t    txQueue[VMXNET3_MAX_QUEUES];
+   vmxnet3_rxqueue_t    rxQueue[VMXNET3_MAX_QUEUES];
+   vmxnet3_dmabuf_t     rssConf;
+   kstat_t             *queueStats[VMXNET3_MAX_QUEUES];
 
-   vmxnet3_rxqueue_t    rxQueue;
    kmutex_t             rxPoolLock;
    vmxnet3_rxpool_t     rxPool;
    volatile uint32_t    rxNumBufs;
@@ -218,13 +235,23 @@ extern ddi_device_acc_attr_t vmxnet3_dev_attr;
 #define VMXNET3_BAR1_PUT32(Device, Reg, Value) \
    ddi_put32((Device)->bar1Handle, (uint32_t *) ((Device)->bar1 + (Reg)), (Value))
 
+/* Per-queue and per-vector BAR0 registers, e.g. IMR, TXPROD and RXPROD */
+#define VMXNET3_BAR0_QREG(Reg, Idx) ((Reg) + (Idx) * VMXNET3_REG_ALIGN)
+
 /* Misc helpers */
 #define VMXNET3_DS(Device) \
    ((Vmxnet3_DriverShared *) (Device)->sharedData.buf)
-#define VMXNET3_TQDESC(Device) \
-   ((Vmxnet3_TxQueueDesc *) (Device)->queueDescs.buf)
-#define VMXNET3_RQDESC(Device) \
-   ((Vmxnet3_RxQueueDesc *) ((Device)->queueDescs.buf + sizeof(Vmxnet3_TxQueueDesc)))
+#define VMXNET3_TQDESC(Device, Idx) \
+   (((Vmxnet3_TxQueueDesc *) (Device)->queueDescs.buf) + (Idx))
+#define VMXNET3_RQDESC(Device, Idx) \
+   (((Vmxnet3_RxQueueDesc *) ((Device)->queueDescs.buf + \
+                              (Device)->numQueues * \
+                              sizeof(Vmxnet3_TxQueueDesc))) + (Idx))
+
+/* Vector of a queue pair, the event vector is always the last one */
+#define VMXNET3_QUEUE_INTR_IDX(Device, Idx) \
+   ((Device)->intrCount > 1 ? (Idx) : 0)
+#define VMXNET3_EVENT_INTR_IDX(Device) ((Device)->intrCount - 1)
 
 #define VMXNET3_ADDR_LO(addr) ((uint32_t) (addr))
 #define VMXNET3_ADDR_HI(addr) ((uint32_t) (((uint64_t) (addr)) >> 32))
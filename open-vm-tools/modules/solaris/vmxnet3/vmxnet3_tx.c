@@ -226,7 +226,7 @@ vmxnet3_tx_one(vmxnet3_softc_t *dp,
    uint8_t sopGen, curGen;
    mblk_t *mblk;
 
-   mutex_enter(&dp->txLock);
+   mutex_enter(&txq->lock);
 
    sopIdx = eopIdx = cmdRing->next2fill;
    sopGen = cmdRing->gen;
@@ -243,7 +243,7 @@ vmxnet3_tx_one(vmxnet3_softc_t *dp,
          continue;
       }
 
-      if (ddi_dma_addr_bind_handle(dp->txDmaHandle, NULL,
+      if (ddi_dma_addr_bind_handle(txq->dmaHandle, NULL,
                                    (caddr_t) mblk->b_rptr, len,
                                    DDI_DMA_RDWR | DDI_DMA_STREAMING,
                                    DDI_DMA_DONTWAIT, NULL,
@@ -273,13 +273,14 @@ vmxnet3_tx_one(vmxnet3_softc_t *dp,
                   VMXNET3_DEBUG(dp, 2, "overfragmented, frags=%u ring=%hu om=%hu\n",
                                 frags, cmdRing->size, ol->om);
                }
-               ddi_dma_unbind_handle(dp->txDmaHandle);
+               ddi_dma_unbind_handle(txq->dmaHandle);
                ret = VMXNET3_TX_PULLUP;
                goto error;
             }
             if (cmdRing->avail - frags <= 1) {
-               dp->txMustResched = B_TRUE;
-               ddi_dma_unbind_handle(dp->txDmaHandle);
+               txq->mustResched = B_TRUE;
+               txq->ringFull++;
+               ddi_dma_unbind_handle(txq->dmaHandle);
                ret = VMXNET3_TX_RINGFULL;
                goto error;
             }
@@ -315,11 +316,11 @@ vmxnet3_tx_one(vmxnet3_softc_t *dp,
          } while (len);
 
          if (--cookieCount) {
-            ddi_dma_nextcookie(dp->txDmaHandle, &cookie);
+            ddi_dma_nextcookie(txq->dmaHandle, &cookie);
          }
       } while (cookieCount);
 
-      ddi_dma_unbind_handle(dp->txDmaHandle);
+      ddi_dma_unbind_handle(txq->dmaHandle);
    }
 
    /* Update the EOP descriptor */
@@ -365,7 +366,7 @@ error:
    }
 
 done:
-   mutex_exit(&dp->txLock);
+   mutex_exit(&txq->lock);
 
    return ret;
 }
@@ -375,7 +376,9 @@ done:
  *
  * vmxnet3_tx --
  *
- *    Send packets on a vmxnet3 device.
+ *    Send packets on a vmxnet3 device. The whole chain goes to the tx
+ *    queue of the current CPU so that CPUs sending at the same time
+ *    don't contend on the same ring.
  *
  * Results:
  *    NULL in case of success or failure.
@@ -390,7 +393,7 @@ mblk_t *
 vmxnet3_tx(void *data, mblk_t *mps)
 {
    vmxnet3_softc_t *dp = data;
-   vmxnet3_txqueue_t *txq = &dp->txQueue;
+   vmxnet3_txqueue_t *txq = &dp->txQueue[CPU->cpu_seqid % dp->numQueues];
    vmxnet3_cmdring_t *cmdRing = &txq->cmdRing;
    Vmxnet3_TxQueueCtrl *txqCtrl = txq->sharedCtrl;
    vmxnet3_txstatus status = VMXNET3_TX_OK;
@@ -467,12 +470,13 @@ vmxnet3_tx(void *data, mblk_t *mps)
    }
 
    /* Notify the device */
-   mutex_enter(&dp->txLock);
+   mutex_enter(&txq->lock);
    if (txqCtrl->txNumDeferred >= txqCtrl->txThreshold) {
       txqCtrl->txNumDeferred = 0;
-      VMXNET3_BAR0_PUT32(dp, VMXNET3_REG_TXPROD, cmdRing->next2fill);
+      VMXNET3_BAR0_PUT32(dp, VMXNET3_BAR0_QREG(VMXNET3_REG_TXPROD, txq->qid),
+                         cmdRing->next2fill);
    }
-   mutex_exit(&dp->txLock);
+   mutex_exit(&txq->lock);
 
    return mps;
 }
@@ -501,7 +505,7 @@ vmxnet3_tx_complete(vmxnet3_softc_t *dp, vmxnet3_txqueue_t *txq)
    boolean_t completedTx = B_FALSE;
    boolean_t ret = B_FALSE;
 
-   mutex_enter(&dp->txLock);
+   mutex_enter(&txq->lock);
 
    compDesc = VMXNET3_GET_DESC(compRing, compRing->next2comp);
    while (compDesc->tcd.gen == compRing->gen) {
@@ -533,12 +537,12 @@ vmxnet3_tx_complete(vmxnet3_softc_t *dp, vmxnet3_txqueue_t *txq)
       compDesc = VMXNET3_GET_DESC(compRing, compRing->next2comp);
    }
 
-   if (dp->txMustResched && completedTx) {
-      dp->txMustResched = B_FALSE;
+   if (txq->mustResched && completedTx) {
+      txq->mustResched = B_FALSE;
       ret = B_TRUE;
    }
 
-   mutex_exit(&dp->txLock);
+   mutex_exit(&txq->lock);
 
    return ret;
 }
@@ -40,8 +40,14 @@
 #define NSDB_GET_VALUE_USER_CMD  "get-value"
 #define NSDB_SET_KEY_USER_CMD    "set-key"
 #define NSDB_DEL_KEY_USER_CMD    "delete-key"
+#define NSDB_UPDATE_KEYS_USER_CMD "update-keys"
+
+// update-keys input groups
+#define NSDB_UPDATE_SET_GROUP    "set"
+#define NSDB_UPDATE_DELETE_GROUP "delete"
 
 #define SUPPORTED_FILE_SIZE_IN_BYTES (16 * 1024) // Refer to namespaceDb.h
+#define SUPPORTED_UPDATE_SIZE_IN_BYTES (64 * SUPPORTED_FILE_SIZE_IN_BYTES)
 
 /*
  * Aggregation of command options.
@@ -50,7 +56,8 @@
 typedef struct NamespaceOptionsState {
    gchar *cmdName;
    gchar *nsName;
-   gchar *keyName;    //for command set-key or delete-key or get-value
+   gchar *keyName;    //for command set-key or delete-key
+   gchar **getKeyNames; //for command get-value, one or more keys
    gchar *valueToSet;
    gchar *oldValueToSet;
    gchar *getValueFromFile;
@@ -103,6 +110,8 @@ GetInternalNamespaceCommand(const gchar *cmd)
       return NSDB_PRIV_SET_KEYS_CMD;
    } else if (g_strcmp0(cmd, NSDB_DEL_KEY_USER_CMD) == 0) {
       return NSDB_PRIV_SET_KEYS_CMD;
+   } else if (g_strcmp0(cmd, NSDB_UPDATE_KEYS_USER_CMD) == 0) {
+      return NSDB_PRIV_SET_KEYS_CMD;
    } else {
       return NULL;
    }
@@ -127,7 +136,8 @@ ValidateNSCommands(const gchar *cmdName)
 {
    if ((g_strcmp0(cmdName, NSDB_GET_VALUE_USER_CMD) == 0) ||
        (g_strcmp0(cmdName, NSDB_SET_KEY_USER_CMD) == 0) ||
-       (g_strcmp0(cmdName, NSDB_DEL_KEY_USER_CMD) == 0)) {
+       (g_strcmp0(cmdName, NSDB_DEL_KEY_USER_CMD) == 0) ||
+       (g_strcmp0(cmdName, NSDB_UPDATE_KEYS_USER_CMD) == 0)) {
       return TRUE;
    } else {
       fprintf(stderr, "Invalid command \"%s\"\n", cmdName);
@@ -186,6 +196,7 @@ PrintInternalCommand(const char *data, size_t dataSize)
  *                       by an extra nul character, but there may be other
  *                       nuls in the intervening data.
  * @param[Out]  length   return length of standard input strings.
+ * @param[in]   maxLength  largest length accepted.
  *
  * @return TRUE on success or FALSE if stdin data is empty or more than Max
  *         limit
@@ -194,7 +205,7 @@ PrintInternalCommand(const char *data, size_t dataSize)
  */
 
 static Bool
-GetValueFromStdin(gchar **data, gsize *length)
+GetValueFromStdin(gchar **data, gsize *length, gsize maxLength)
 {
    GError *gErr = NULL;
    GIOStatus status;
@@ -215,10 +226,10 @@ GetValueFromStdin(gchar **data, gsize *length)
               gAppName, status, (gErr != NULL ? gErr->message : ""));
       retVal = FALSE;
    } else {
-      if (*length > SUPPORTED_FILE_SIZE_IN_BYTES) {
+      if (*length > maxLength) {
          retVal = FALSE;
-         fprintf(stderr, "%s: stdin data must not exceed %d bytes\n",
-               gAppName, SUPPORTED_FILE_SIZE_IN_BYTES);
+         fprintf(stderr, "%s: stdin data must not exceed %"FMTSZ"u bytes\n",
+               gAppName, maxLength);
       } else  if (*length == 0) {
          retVal = FALSE;
          fprintf(stderr, "%s: stdin data must not be empty\n", gAppName);
@@ -243,6 +254,7 @@ GetValueFromStdin(gchar **data, gsize *length)
  * @param[in]  filePath       file path
  * @param[out] fileContents   file contents
  * @param[out] length         length of file
+ * @param[in]  maxLength      largest length accepted
  *
  * @return TRUE on success or FALSE if file is empty or more than Max limit
  *
@@ -250,7 +262,8 @@ GetValueFromStdin(gchar **data, gsize *length)
  */
 
 static Bool
-GetValueFromFile(const char *filePath, char **fileContents, gsize *length)
+GetValueFromFile(const char *filePath, char **fileContents, gsize *length,
+                 gsize maxLength)
 {
    GError *gErr = NULL;
    Bool retVal = FALSE;
@@ -260,10 +273,10 @@ GetValueFromFile(const char *filePath, char **fileContents, gsize *length)
               (gErr != NULL ? gErr->message : "Failed while reading file"),
               filePath);
    } else {
-      if (*length > SUPPORTED_FILE_SIZE_IN_BYTES) {
+      if (*length > maxLength) {
          retVal = FALSE;
-         fprintf(stderr, "%s: File size must not exceed %d bytes\n",
-                 gAppName, SUPPORTED_FILE_SIZE_IN_BYTES);
+         fprintf(stderr, "%s: File size must not exceed %"FMTSZ"u bytes\n",
+                 gAppName, maxLength);
       } else  if (*length == 0) {
          retVal = FALSE;
          fprintf(stderr, "%s: File must not be empty\n", gAppName);
@@ -279,6 +292,102 @@ GetValueFromFile(const char *filePath, char **fileContents, gsize *length)
 }
 
 
+/*
+ ******************************************************************************
+ * AppendUpdateOps --
+ *
+ * Appends the operations for the keys of one group of an update-keys input
+ * file to a namespace-priv-set-keys request.
+ *
+ * @param[in,out] buf       request buffer.
+ * @param[in]     updates   parsed update-keys input.
+ * @param[in]     group     NSDB_UPDATE_SET_GROUP or NSDB_UPDATE_DELETE_GROUP.
+ * @param[in,out] numOps    incremented by the number of operations appended.
+ *
+ * @return TRUE on success, FALSE if the group holds an invalid entry or the
+ *         request could not be built.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+AppendUpdateOps(DynBuf *buf, GKeyFile *updates, const gchar *group,
+                guint *numOps)
+{
+   Bool isDelete = g_strcmp0(group, NSDB_UPDATE_DELETE_GROUP) == 0;
+   gchar **keys;
+   gchar **key;
+   Bool retVal = TRUE;
+
+   keys = g_key_file_get_keys(updates, group, NULL, NULL);
+   if (keys == NULL) {
+      return TRUE;
+   }
+
+   for (key = keys; *key != NULL && retVal; key++) {
+      gchar *value = NULL;
+
+      if (!isDelete) {
+         value = g_key_file_get_string(updates, group, *key, NULL);
+         if (value == NULL || *value == '\0') {
+            fprintf(stderr, "%s: Value of key %s must not be empty\n",
+                    gAppName, *key);
+            retVal = FALSE;
+         } else if (strlen(value) > SUPPORTED_FILE_SIZE_IN_BYTES) {
+            fprintf(stderr, "%s: Value of key %s must not exceed %d bytes\n",
+                    gAppName, *key, SUPPORTED_FILE_SIZE_IN_BYTES);
+            retVal = FALSE;
+         }
+      }
+      if (retVal &&
+          (!DynBuf_AppendString(buf, "0") || // unconditional
+           !DynBuf_AppendString(buf, *key) ||
+           !DynBuf_AppendString(buf, isDelete ? "" : value) ||
+           !DynBuf_AppendString(buf, ""))) {
+         fprintf(stderr, "Could not construct request buffer\n");
+         retVal = FALSE;
+      }
+      if (retVal) {
+         (*numOps)++;
+      }
+      g_free(value);
+   }
+
+   g_strfreev(keys);
+   return retVal;
+}
+
+
+/*
+ ******************************************************************************
+ * PrintUpdatedKeys --
+ *
+ * Prints, one per line, the keys an update-keys request set or deleted.
+ *
+ * @param[in]  updates   parsed update-keys input.
+ *
+ ******************************************************************************
+ */
+
+static void
+PrintUpdatedKeys(GKeyFile *updates)
+{
+   static const gchar *groups[] = { NSDB_UPDATE_SET_GROUP,
+                                    NSDB_UPDATE_DELETE_GROUP };
+   guint i;
+
+   for (i = 0; i < G_N_ELEMENTS(groups); i++) {
+      gchar **keys = g_key_file_get_keys(updates, groups[i], NULL, NULL);
+      gchar **key;
+
+      for (key = keys; key != NULL && *key != NULL; key++) {
+         printf("%s %s\n", groups[i], *key);
+      }
+      g_strfreev(keys);
+   }
+}
+
+
 /*
  ******************************************************************************
  * RunNamespaceCommand --
@@ -301,6 +410,8 @@ RunNamespaceCommand(NamespaceOptionsState *nsOptions)
    gchar *opCode = NULL;
    gchar *keyValueData = NULL;
    gsize keyValueLength = 0;
+   guint numKeys = 0;
+   GKeyFile *updates = NULL;
 
    const char *nscmd = GetInternalNamespaceCommand(nsOptions->cmdName);
 
@@ -319,10 +430,15 @@ RunNamespaceCommand(NamespaceOptionsState *nsOptions)
       opCode = g_strdup("1");
    }
    if (g_strcmp0(nsOptions->cmdName, NSDB_GET_VALUE_USER_CMD) == 0) {
-      ASSERT(nsOptions->keyName);
-      if (!DynBuf_AppendString(&buf, nsOptions->keyName)) {
-         fprintf(stderr, "Could not construct request buffer\n");
-         goto exit;
+      gchar **key;
+
+      ASSERT(nsOptions->getKeyNames);
+      for (key = nsOptions->getKeyNames; *key != NULL; key++) {
+         if (!DynBuf_AppendString(&buf, *key)) {
+            fprintf(stderr, "Could not construct request buffer\n");
+            goto exit;
+         }
+         numKeys++;
       }
    } else if (g_strcmp0(nsOptions->cmdName, NSDB_SET_KEY_USER_CMD) == 0) {
       ASSERT(nsOptions->keyName);
@@ -344,7 +460,8 @@ RunNamespaceCommand(NamespaceOptionsState *nsOptions)
                goto exit;
             }
          } else {
-            if (GetValueFromStdin(&keyValueData, &keyValueLength) == FALSE) {
+            if (GetValueFromStdin(&keyValueData, &keyValueLength,
+                                  SUPPORTED_FILE_SIZE_IN_BYTES) == FALSE) {
                goto exit;
             }
             if (!DynBuf_Append(&buf, keyValueData, keyValueLength + 1) ||
@@ -355,7 +472,8 @@ RunNamespaceCommand(NamespaceOptionsState *nsOptions)
          }
       } else {
          if (GetValueFromFile(nsOptions->getValueFromFile,
-                              &keyValueData, &keyValueLength) == FALSE) {
+                              &keyValueData, &keyValueLength,
+                              SUPPORTED_FILE_SIZE_IN_BYTES) == FALSE) {
             goto exit;
          }
          if (!DynBuf_Append(&buf, keyValueData, keyValueLength + 1) ||
@@ -364,6 +482,58 @@ RunNamespaceCommand(NamespaceOptionsState *nsOptions)
             goto exit;
          }
       }
+   } else if (g_strcmp0(nsOptions->cmdName, NSDB_UPDATE_KEYS_USER_CMD) == 0) {
+      GError *gErr = NULL;
+      DynBuf ops;
+      guint numOps = 0;
+      gchar numOpsStr[16];
+      Bool built;
+
+      if (nsOptions->getValueFromFile != NULL) {
+         if (GetValueFromFile(nsOptions->getValueFromFile,
+                              &keyValueData, &keyValueLength,
+                              SUPPORTED_UPDATE_SIZE_IN_BYTES) == FALSE) {
+            goto exit;
+         }
+      } else if (GetValueFromStdin(&keyValueData, &keyValueLength,
+                                   SUPPORTED_UPDATE_SIZE_IN_BYTES) == FALSE) {
+         goto exit;
+      }
+
+      updates = g_key_file_new();
+      if (!g_key_file_load_from_data(updates, keyValueData, keyValueLength,
+                                     G_KEY_FILE_NONE, &gErr)) {
+         fprintf(stderr, "%s: Invalid update list: %s\n", gAppName,
+                 gErr != NULL ? gErr->message : "");
+         g_clear_error(&gErr);
+         goto exit;
+      }
+
+      /*
+       * All the updates go in one request, which the namespace DB applies
+       * as a whole.
+       */
+      DynBuf_Init(&ops);
+      built = AppendUpdateOps(&ops, updates, NSDB_UPDATE_SET_GROUP,
+                              &numOps) &&
+              AppendUpdateOps(&ops, updates, NSDB_UPDATE_DELETE_GROUP,
+                              &numOps);
+      if (built && numOps == 0) {
+         fprintf(stderr, "%s: No keys to update\n", gAppName);
+         built = FALSE;
+      }
+      if (built) {
+         g_snprintf(numOpsStr, sizeof numOpsStr, "%u", numOps);
+         if (!DynBuf_AppendString(&buf, numOpsStr) ||
+             !DynBuf_Append(&buf, DynBuf_Get(&ops), DynBuf_GetSize(&ops))) {
+            fprintf(stderr, "Could not construct request buffer\n");
+            built = FALSE;
+         }
+      }
+      DynBuf_Destroy(&ops);
+      if (!built) {
+         goto exit;
+      }
    } else if (g_strcmp0(nsOptions->cmdName, NSDB_DEL_KEY_USER_CMD) == 0) {
       ASSERT(nsOptions->keyName);
       if (!DynBuf_AppendString(&buf, "1") ||
@@ -387,6 +557,9 @@ RunNamespaceCommand(NamespaceOptionsState *nsOptions)
             result && *result ? result : "unknown");
    } else {
       char *p = result;
+      if (updates != NULL) {
+         PrintUpdatedKeys(updates);
+      }
       if (resultLen == 0) {
          if (nsOptions->verboseLogFlag) {
             printf("success\n");
@@ -396,7 +569,16 @@ RunNamespaceCommand(NamespaceOptionsState *nsOptions)
             printf("success - result:");
          }
          while (p < result + resultLen) {
-            printf("%s", p);
+            /*
+             * With several keys, each value is printed as its length on
+             * a line of its own followed by the value and a newline, so
+             * values holding newlines (PEM certs) can be split apart.
+             */
+            if (numKeys > 1) {
+               printf("%"FMTSZ"u\n%s\n", strlen(p), p);
+            } else {
+               printf("%s", p);
+            }
             p += strlen(p) + 1;
          }
       }
@@ -409,6 +591,9 @@ RunNamespaceCommand(NamespaceOptionsState *nsOptions)
    fflush(stderr);
    g_free(keyValueData);
    g_free(opCode);
+   if (updates != NULL) {
+      g_key_file_free(updates);
+   }
    return status;
 }
 
@@ -448,7 +633,7 @@ PostVerifyGetValueOptions(GOptionContext *context, GOptionGroup *group,
       return FALSE;
    }
    if (g_strcmp0(nsOptions->cmdName, NSDB_GET_VALUE_USER_CMD) == 0) {
-      if (nsOptions->keyName == NULL) {
+      if (nsOptions->getKeyNames == NULL || *nsOptions->getKeyNames == NULL) {
          g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
                       "Key name must be specified");
          return FALSE;
@@ -565,6 +750,53 @@ PostVerifySetKeyOptions(GOptionContext *context, GOptionGroup *group,
 }
 
 
+/*
+ ******************************************************************************
+ * PostVerifyUpdateKeysOptions --
+ *
+ * Post parse hook to verify namespace command update-keys
+ *
+ * @param[in]  context    Unused.
+ * @param[in]  group      Unused.
+ * @param[in]  data       Unused.
+ * @param[out] error      Setting error message to display in case of invalid
+ *                        command line options.
+ *
+ * @return TRUE if successful, FALSE if option is invalid.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+PostVerifyUpdateKeysOptions(GOptionContext *context, GOptionGroup *group,
+                            gpointer data, GError **error)
+{
+   NamespaceOptionsState *nsOptions;
+   ASSERT(data);
+   nsOptions = (NamespaceOptionsState *) data;
+
+   if (nsOptions->cmdName == NULL) {
+      g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                  "Namespace command must be specified");
+      return FALSE;
+   }
+   if (nsOptions->nsName == NULL) {
+      g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                  "Namespace name must be specified");
+      return FALSE;
+   }
+   if (g_strcmp0(nsOptions->cmdName, NSDB_UPDATE_KEYS_USER_CMD) == 0) {
+      if ((nsOptions->getValueFromFile != NULL) ==
+          (nsOptions->standardInput == 1)) {
+         g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                     "Updates must be specified with either -f or -s");
+         return FALSE;
+      }
+   }
+   return TRUE;
+}
+
+
 /*
  ******************************************************************************
  * main --
@@ -587,7 +819,7 @@ main(int argc, char *argv[])
    GOptionContext *optCtx;
    GOptionGroup *gr;
    gchar *summary;
-   NamespaceOptionsState nsOptions = { NULL, NULL, NULL, NULL, "",
+   NamespaceOptionsState nsOptions = { NULL, NULL, NULL, NULL, NULL, "",
                                        NULL, FALSE, FALSE};
 
    //Options for namespacetool commands
@@ -598,8 +830,9 @@ main(int argc, char *argv[])
       { NULL }
    };
    GOptionEntry getValuesEntry[] = {
-      { "key", 'k', G_OPTION_FLAG_NOALIAS, G_OPTION_ARG_STRING, &nsOptions.keyName,
-        "Key value to return", "<key-name>" },
+      { "key", 'k', G_OPTION_FLAG_NOALIAS, G_OPTION_ARG_STRING_ARRAY,
+         &nsOptions.getKeyNames, "Key value to return, may be repeated to "
+        "return several values at once", "<key-name>" },
       { NULL }
    };
    GOptionEntry setKeysEntry[] = {
@@ -625,12 +858,19 @@ main(int argc, char *argv[])
         "the namespace for delete operation to proceed", "<old-value>"},
       { NULL }
    };
+   GOptionEntry updateKeysEntry[] = {
+      { "fromFile", 'f', 0, G_OPTION_ARG_STRING, &nsOptions.getValueFromFile,
+        "Updates to read from file path", "<file-path>"},
+      { "stdin", 's', 0, G_OPTION_ARG_NONE, &nsOptions.standardInput,
+        "Updates to read from standard input", NULL},
+      { NULL }
+   };
 
    gAppName = g_path_get_basename(argv[0]);
    g_set_prgname(gAppName);
 
-   optCtx = g_option_context_new("[get-value | set-key | delete-key] "
-                                  "[<namespace-name>]");
+   optCtx = g_option_context_new("[get-value | set-key | delete-key | "
+                                 "update-keys] [<namespace-name>]");
 
    gr = g_option_group_new("namespace commands", "", "", optCtx, NULL);
    g_option_group_add_entries(gr, mainEntry);
@@ -643,8 +883,13 @@ main(int argc, char *argv[])
                              "<namespace-name> -k <key-name> -s\n  %s "
                              "delete-key  <namespace-name> -k <key-name>"
                              "\n  %s get-value <namespace-name> "
-                             "-k <key-name>\n", gAppName,
-                              gAppName, gAppName, gAppName, gAppName);
+                             "-k <key-name> [-k <key-name> ...]\n  %s "
+                             "update-keys <namespace-name> -f <file-path>\n"
+                             "\nThe update-keys input is a key file: the "
+                             "keys of its [set] group are\nset to their "
+                             "values, the keys of its [delete] group are "
+                             "deleted.\n", gAppName, gAppName, gAppName,
+                             gAppName, gAppName, gAppName);
    g_option_context_set_summary(optCtx, summary);
 
    if (argc > 1) {
@@ -695,6 +940,21 @@ main(int argc, char *argv[])
    g_option_context_add_group(optCtx, gr);
    g_option_group_set_parse_hooks(gr, NULL, PostVerifyDeleteKeyOptions);
 
+   //Namespacetool command - namespace-set-keys for several keys at once
+   descriptionBuf = g_strdup_printf("%s command %s:- Set and delete several "
+                                    "keys at once\n",
+                                    gAppName, NSDB_UPDATE_KEYS_USER_CMD);
+   helpBuf = g_strdup_printf("Show help for command \"%s\"",
+                              NSDB_UPDATE_KEYS_USER_CMD);
+
+   gr = g_option_group_new(NSDB_UPDATE_KEYS_USER_CMD, descriptionBuf, helpBuf,
+                           &nsOptions, NULL);
+   g_free(descriptionBuf);
+   g_free(helpBuf);
+   g_option_group_add_entries(gr, updateKeysEntry);
+   g_option_context_add_group(optCtx, gr);
+   g_option_group_set_parse_hooks(gr, NULL, PostVerifyUpdateKeysOptions);
+
    if (!g_option_context_parse(optCtx, &argc, &argv, &gErr)) {
       PrintUsage(optCtx);
       fprintf(stderr, "%s: %s\n", gAppName, (gErr != NULL ? gErr->message : ""));
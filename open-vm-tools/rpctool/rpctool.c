@@ -35,10 +35,29 @@
 #include "rpcout.h"
 #include "str.h"
 #include "backdoor_def.h"
+#include "vmware/tools/guestrpc.h"
 
 #define NOT_VMWARE_ERROR "Failed sending message to VMware.\n"
 
+/* The guest variable used by the built-in benchmark RPC. */
+#define BENCH_PING_VAR "guestinfo.rpctool.ping"
+#define BENCH_DEFAULT_COUNT 1000
+
+/* State of one benchmark sender thread. */
+typedef struct BenchSender {
+   const char *request;
+   unsigned int count;      // Requests to send
+   gint64 start;            // Monotonic time to start at, in usec
+   gint64 interval;         // Time between sends in usec, 0 for closed loop
+   gint64 *latencies;       // Round trip time of each request sent, in usec
+   unsigned int sent;
+   unsigned int failed;
+   RpcChannelType type;
+   GThread *thread;
+} BenchSender;
+
 int RpcToolCommand(int argc, char *argv[]);
+static int RpcToolBench(int argc, char *argv[]);
 
 #ifndef _WIN32
 static Bool SetSignalHandler(int sig,
@@ -50,7 +69,17 @@ void
 PrintUsage(void)
 {
    fprintf(stderr, "rpctool syntax:\n\n");
-   fprintf(stderr, "  rpctool <text>\n\n");
+   fprintf(stderr, "  rpctool <text>\n");
+   fprintf(stderr, "  rpctool --bench <backdoor|vsock> [-n <requests>] "
+                   "[-c <senders>] [-r <rate>] [<text>]\n\n");
+   fprintf(stderr, "--bench sends <text> (by default, a guestinfo read) "
+                   "<requests> times, %d by\n", BENCH_DEFAULT_COUNT);
+   fprintf(stderr, "default, from <senders> threads with a channel each, "
+                   "and reports the\n");
+   fprintf(stderr, "throughput and round trip latency percentiles. The "
+                   "senders send back to\n");
+   fprintf(stderr, "back unless <rate> gives a target total number of "
+                   "requests per second.\n\n");
 }
 
 
@@ -170,6 +199,10 @@ RpcToolCommand(int argc, char *argv[])
    char *result = NULL;
    Bool status = FALSE;
 
+   if (strcmp(argv[0], "--bench") == 0) {
+      return RpcToolBench(argc - 1, argv + 1);
+   }
+
    status = RpcOut_sendOne(&result, NULL, "%s", argv[0]);
    if (!status) {
       fprintf(stderr, "%s\n", result ? result : "NULL");
@@ -180,6 +213,263 @@ RpcToolCommand(int argc, char *argv[])
    return (status == TRUE ? 0 : 1);
 }
 
+
+
+/*
+ * Runs one benchmark sender: opens its own channel, then sends its share
+ * of the requests, at the paced times if there is a target rate.
+ */
+
+static gpointer
+BenchSenderRun(gpointer data)
+{
+   BenchSender *sender = data;
+   RpcChannel *chan;
+   gint64 now;
+   unsigned int i;
+
+   chan = RpcChannel_New();
+   if (chan == NULL || !RpcChannel_Start(chan)) {
+      fprintf(stderr, "Unable to open the RPC channel.\n");
+      sender->failed = sender->count;
+      goto exit;
+   }
+   sender->type = RpcChannel_GetType(chan);
+
+   now = g_get_monotonic_time();
+   if (now < sender->start) {
+      g_usleep(sender->start - now);
+   }
+
+   for (i = 0; i < sender->count; i++) {
+      char *reply = NULL;
+      size_t replyLen;
+      gint64 sendTime;
+
+      if (sender->interval != 0) {
+         gint64 due = sender->start + i * sender->interval;
+
+         /* A sender that falls behind sends right away; it does not burst. */
+         now = g_get_monotonic_time();
+         if (now < due) {
+            g_usleep(due - now);
+         }
+      }
+
+      sendTime = g_get_monotonic_time();
+      if (!RpcChannel_Send(chan, sender->request, strlen(sender->request),
+                           &reply, &replyLen)) {
+         sender->failed++;
+      }
+      sender->latencies[sender->sent++] = g_get_monotonic_time() - sendTime;
+      RpcChannel_Free(reply);
+   }
+
+exit:
+   if (chan != NULL) {
+      RpcChannel_Stop(chan);
+      RpcChannel_Destroy(chan);
+   }
+   return NULL;
+}
+
+
+static int
+BenchCompareLatency(const void *a,
+                    const void *b)
+{
+   gint64 la = *(const gint64 *)a;
+   gint64 lb = *(const gint64 *)b;
+
+   return la < lb ? -1 : la > lb;
+}
+
+
+static gint64
+BenchPercentile(const gint64 *sorted,
+                unsigned int count,
+                double percentile)
+{
+   unsigned int idx = (unsigned int)(count * percentile / 100.0);
+
+   return sorted[MIN(idx, count - 1)];
+}
+
+
+static Bool
+BenchParseUint(const char *str,
+               unsigned int *value)
+{
+   char *end;
+   unsigned long val = strtoul(str, &end, 10);
+
+   if (*str == '\0' || *end != '\0' || val > MAX_UINT32) {
+      return FALSE;
+   }
+   *value = (unsigned int)val;
+   return TRUE;
+}
+
+
+/*
+ * rpctool --bench <backdoor|vsock> [-n <requests>] [-c <senders>]
+ *                 [-r <rate>] [<text>]
+ *
+ * Drives an RPC through the given channel type and reports throughput and
+ * latency percentiles. Each sender uses its own channel, so the senders
+ * only contend on the host side.
+ */
+
+static int
+RpcToolBench(int argc, char *argv[])
+{
+   Bool vsock;
+   unsigned int count = BENCH_DEFAULT_COUNT;
+   unsigned int numSenders = 1;
+   unsigned int rate = 0;
+   const char *request = "info-get " BENCH_PING_VAR;
+   BenchSender *senders;
+   gint64 *latencies;
+   gint64 start;
+   gint64 elapsed;
+   unsigned int sent = 0;
+   unsigned int failed = 0;
+   RpcChannelType type = RPCCHANNEL_TYPE_INACTIVE;
+   unsigned int i;
+   int arg;
+
+   if (argc < 1) {
+      PrintUsage();
+      return 1;
+   }
+   if (strcmp(argv[0], "backdoor") == 0) {
+      vsock = FALSE;
+   } else if (strcmp(argv[0], "vsock") == 0) {
+      vsock = TRUE;
+   } else {
+      PrintUsage();
+      return 1;
+   }
+
+   for (arg = 1; arg < argc; arg++) {
+      unsigned int *value = NULL;
+
+      if (strcmp(argv[arg], "-n") == 0) {
+         value = &count;
+      } else if (strcmp(argv[arg], "-c") == 0) {
+         value = &numSenders;
+      } else if (strcmp(argv[arg], "-r") == 0) {
+         value = &rate;
+      } else if (arg == argc - 1) {
+         request = argv[arg];
+         break;
+      }
+      if (value == NULL || ++arg == argc || !BenchParseUint(argv[arg], value)) {
+         PrintUsage();
+         return 1;
+      }
+   }
+   if (count == 0 || numSenders == 0) {
+      PrintUsage();
+      return 1;
+   }
+   numSenders = MIN(numSenders, count);
+
+   if (!g_thread_supported()) {
+      g_thread_init(NULL);
+   }
+   if (!vsock) {
+      RpcChannel_SetBackdoorOnly();
+   }
+
+   /* Make sure the built-in request has something to read. */
+   if (strcmp(request, "info-get " BENCH_PING_VAR) == 0) {
+      char *reply = NULL;
+
+      if (!RpcChannel_SendOne(&reply, NULL, "info-set %s 1", BENCH_PING_VAR)) {
+         fprintf(stderr, "%s\n", reply ? reply : "NULL");
+         RpcChannel_Free(reply);
+         return 1;
+      }
+      RpcChannel_Free(reply);
+   }
+
+   senders = g_new0(BenchSender, numSenders);
+   latencies = g_new(gint64, count);
+
+   /* Give the senders time to open their channels before the clock starts. */
+   start = g_get_monotonic_time() + 100 * 1000;
+   for (i = 0; i < numSenders; i++) {
+      BenchSender *sender = &senders[i];
+
+      sender->request = request;
+      sender->count = count / numSenders + (i < count % numSenders);
+      sender->start = start;
+      sender->interval = rate ? (gint64)numSenders * 1000000 / rate : 0;
+      sender->latencies = latencies + sent;
+      sent += sender->count;
+      sender->thread = g_thread_create(BenchSenderRun, sender, TRUE, NULL);
+      if (sender->thread == NULL) {
+         fprintf(stderr, "Unable to start a sender thread.\n");
+         sender->failed = sender->count;
+      }
+   }
+
+   sent = 0;
+   for (i = 0; i < numSenders; i++) {
+      BenchSender *sender = &senders[i];
+
+      if (sender->thread != NULL) {
+         g_thread_join(sender->thread);
+      }
+      /* Pack the latencies of the requests actually sent. */
+      memmove(latencies + sent, sender->latencies,
+              sender->sent * sizeof *latencies);
+      sent += sender->sent;
+      failed += sender->failed;
+      if (sender->type != RPCCHANNEL_TYPE_INACTIVE) {
+         type = sender->type;
+      }
+   }
+   elapsed = MAX(g_get_monotonic_time() - start, 1);
+
+   if (vsock && type == RPCCHANNEL_TYPE_BKDOOR) {
+      fprintf(stderr, "The vsock channel is not available, "
+                      "the backdoor was used instead.\n");
+   }
+
+   printf("channel: %s\n",
+          type == RPCCHANNEL_TYPE_BKDOOR ? "backdoor" :
+          type == RPCCHANNEL_TYPE_PRIV_VSOCK ? "vsock (privileged)" :
+          type == RPCCHANNEL_TYPE_UNPRIV_VSOCK ? "vsock" : "none");
+   printf("request: %s\n", request);
+   printf("senders: %u, target rate: ", numSenders);
+   if (rate != 0) {
+      printf("%u/s\n", rate);
+   } else {
+      printf("closed loop\n");
+   }
+   printf("sent: %u, failed: %u, elapsed: %.3f s, throughput: %.1f/s\n",
+          sent, failed, elapsed / 1000000.0, sent * 1000000.0 / elapsed);
+
+   if (sent != 0) {
+      qsort(latencies, sent, sizeof *latencies, BenchCompareLatency);
+      printf("latency (us): min %"FMT64"d, p50 %"FMT64"d, p90 %"FMT64"d, "
+             "p99 %"FMT64"d, p99.9 %"FMT64"d, max %"FMT64"d\n",
+             latencies[0],
+             BenchPercentile(latencies, sent, 50),
+             BenchPercentile(latencies, sent, 90),
+             BenchPercentile(latencies, sent, 99),
+             BenchPercentile(latencies, sent, 99.9),
+             latencies[sent - 1]);
+   }
+
+   g_free(latencies);
+   g_free(senders);
+   return (sent != 0 && failed == 0) ? 0 : 1;
+}
+
+
 void
 Panic(const char *fmt, ...)
 {
@@ -506,5 +506,7 @@ CopyPasteDnDX11::GetCaps()
           DND_CP_CAP_CP |
           DND_CP_CAP_FORMATS_ALL |
           DND_CP_CAP_ACTIVE_CP |
-          DND_CP_CAP_BIG_BUFFER;
+          DND_CP_CAP_BIG_BUFFER |
+          DND_CP_CAP_CP_PROMISED |
+          DND_CP_CAP_FILELIST_COMPACT;
 }
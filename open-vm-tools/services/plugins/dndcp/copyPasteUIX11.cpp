@@ -105,6 +105,41 @@ GdkAtom GDK_SELECTION_TYPE_UTF8_STRING;
 #endif
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TargetsInclude --
+ *
+ *    Looks up a target in a list obtained with gtk_clipboard_wait_for_targets.
+ *    This replaces gtk_clipboard_wait_is_target_available, which asks the
+ *    selection owner for its TARGETS, and spins a nested main loop, on every
+ *    call.
+ *
+ * Results:
+ *    true if the target is in the list.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static bool
+TargetsInclude(const GdkAtom *targets, // IN
+               gint nTargets,          // IN
+               const char *name)       // IN: target name
+{
+   GdkAtom atom = gdk_atom_intern(name, FALSE);
+
+   for (gint i = 0; i < nTargets; i++) {
+      if (targets[i] == atom) {
+         return true;
+      }
+   }
+   return false;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -181,6 +216,8 @@ CopyPasteUIX11::Init()
       sigc::mem_fun(this, &CopyPasteUIX11::GetRemoteClipboardCB));
    mCP->destRequestClipChanged.connect(
       sigc::mem_fun(this, &CopyPasteUIX11::GetLocalClipboard));
+   mCP->destRequestItemsChanged.connect(
+      sigc::mem_fun(this, &CopyPasteUIX11::GetLocalClipboardItems));
    mCP->getFilesDoneChanged.connect(
       sigc::mem_fun(this, &CopyPasteUIX11::GetLocalFilesDone));
 
@@ -713,57 +750,157 @@ again:
 
    CPClipboard_Clear(&mClipboard);
 
+   /*
+    * Ask the selection owner for its targets once, and only convert the
+    * selection to the targets we are going to send.
+    */
+   GdkAtom *targets = NULL;
+   gint nTargets = 0;
+   if (!gtk_clipboard_wait_for_targets(refClipboard->gobj(), &targets,
+                                       &nTargets)) {
+      targets = NULL;
+      nTargets = 0;
+   }
+
    /* First check for URIs. This must always be done first */
    bool haveURIs = false;
    std::string format;
-   if (mCP->CheckCapability(DND_CP_CAP_FILE_CP) && refClipboard->wait_is_target_available(FCP_TARGET_NAME_GNOME_COPIED_FILES)) {
+   if (mCP->CheckCapability(DND_CP_CAP_FILE_CP) &&
+       TargetsInclude(targets, nTargets, FCP_TARGET_NAME_GNOME_COPIED_FILES)) {
       format = FCP_TARGET_NAME_GNOME_COPIED_FILES;
       haveURIs = true;
-   } else if (mCP->CheckCapability(DND_CP_CAP_FILE_CP) && refClipboard->wait_is_target_available(FCP_TARGET_NAME_URI_LIST)) {
+   } else if (mCP->CheckCapability(DND_CP_CAP_FILE_CP) &&
+              TargetsInclude(targets, nTargets, FCP_TARGET_NAME_URI_LIST)) {
       format = FCP_TARGET_NAME_URI_LIST;
       haveURIs = true;
    }
 
    if (haveURIs) {
+      g_free(targets);
       refClipboard->request_contents(format,
                                      sigc::mem_fun(this,
                                                    &CopyPasteUIX11::LocalReceivedFileListCB));
       return;
    }
 
-   /* Try to get image data from clipboard. */
-   Glib::RefPtr<Gdk::Pixbuf> img = refClipboard->wait_for_image();
+   /*
+    * If the host fetches promised items on demand, only plain text, which
+    * nearly every paste wants, is sent now; the image and RTF are promised.
+    */
+   if (mCP->CheckCapability(DND_CP_CAP_CP_PROMISED)) {
+      validDataInClip = LocalGetSelectionItems(refClipboard,
+                                               targets, nTargets,
+                                               CPFORMAT_BIT(CPFORMAT_TEXT),
+                                               CPFORMAT_BIT(CPFORMAT_IMG_PNG) |
+                                               CPFORMAT_BIT(CPFORMAT_RTF));
+   } else {
+      validDataInClip = LocalGetSelectionItems(refClipboard,
+                                               targets, nTargets,
+                                               CPFORMAT_BIT(CPFORMAT_TEXT) |
+                                               CPFORMAT_BIT(CPFORMAT_IMG_PNG) |
+                                               CPFORMAT_BIT(CPFORMAT_RTF),
+                                               0);
+   }
+   g_free(targets);
+
+   if (validDataInClip) {
+      /*
+       * RTF or text data (or both) in the clipboard.
+       */
+      mCP->DestUISendClip(&mClipboard);
+   } else if (!flipped) {
+      /*
+       * If we get here, we got nothing (no image, URI, text) so
+       * try the other selection.
+       */
+      g_debug("%s: got nothing for this selection, try the other.\n",
+            __FUNCTION__);
+      mGHSelection = mGHSelection == GDK_SELECTION_PRIMARY ?
+                     GDK_SELECTION_CLIPBOARD : GDK_SELECTION_PRIMARY;
+      flipped = true;
+      goto again;
+   } else {
+      g_debug("%s: got nothing, send empty clip back.\n",
+            __FUNCTION__);
+      mCP->DestUISendClip(&mClipboard);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CopyPasteUIX11::LocalGetSelectionItems --
+ *
+ *    Puts the image, RTF and text available in a selection into mClipboard.
+ *    The formats in fetch are copied from the selection, those in promise are
+ *    only announced as promised items, to be fetched if the host pastes them.
+ *    targets is the selection's target list; the selection is only converted
+ *    to the targets that are fetched.
+ *
+ * Results:
+ *    true if anything was put into mClipboard.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+bool
+CopyPasteUIX11::LocalGetSelectionItems(Glib::RefPtr<Gtk::Clipboard> refClipboard, // IN
+                                       const GdkAtom *targets, // IN
+                                       gint nTargets,  // IN
+                                       uint32 fetch,   // IN: CPFORMAT_BIT mask
+                                       uint32 promise) // IN: CPFORMAT_BIT mask
+{
+   bool validDataInClip = false;
+   std::string format;
    gsize bufSize;
-   if (mCP->CheckCapability(DND_CP_CAP_IMAGE_CP) && img) {
-      gchar *buf = NULL;
 
-      img->save_to_buffer(buf, bufSize, Glib::ustring("png"));
-      if (bufSize > 0  &&
-          bufSize <= (int)CPCLIPITEM_MAX_SIZE_V3 &&
-          CPClipboard_SetItem(&mClipboard, CPFORMAT_IMG_PNG,
-                              buf, bufSize)) {
-         validDataInClip = true;
-         g_debug("%s: Got PNG: %" FMTSZ "u\n", __FUNCTION__, bufSize);
-      } else {
-         g_debug("%s: Failed to get PNG\n", __FUNCTION__);
+   /* Try to get image data from clipboard. */
+   if (!mCP->CheckCapability(DND_CP_CAP_IMAGE_CP) ||
+       !gtk_targets_include_image((GdkAtom *)targets, nTargets, FALSE)) {
+      /* Not supported or not available. */
+   } else if (fetch & CPFORMAT_BIT(CPFORMAT_IMG_PNG)) {
+      Glib::RefPtr<Gdk::Pixbuf> img = refClipboard->wait_for_image();
+      if (img) {
+         gchar *buf = NULL;
+
+         img->save_to_buffer(buf, bufSize, Glib::ustring("png"));
+         if (bufSize > 0  &&
+             bufSize <= (int)CPCLIPITEM_MAX_SIZE_V3 &&
+             CPClipboard_SetItem(&mClipboard, CPFORMAT_IMG_PNG,
+                                 buf, bufSize)) {
+            validDataInClip = true;
+            g_debug("%s: Got PNG: %" FMTSZ "u\n", __FUNCTION__, bufSize);
+         } else {
+            g_debug("%s: Failed to get PNG\n", __FUNCTION__);
+         }
+         g_free(buf);
       }
-      g_free(buf);
+   } else if ((promise & CPFORMAT_BIT(CPFORMAT_IMG_PNG)) &&
+              CPClipboard_SetItem(&mClipboard, CPFORMAT_IMG_PNG, NULL, 0)) {
+      validDataInClip = true;
+      g_debug("%s: Promised PNG\n", __FUNCTION__);
    }
 
    /* Try to get RTF data from clipboard. */
    bool haveRTF = false;
-   if (refClipboard->wait_is_target_available(TARGET_NAME_APPLICATION_RTF)) {
+   if (TargetsInclude(targets, nTargets, TARGET_NAME_APPLICATION_RTF)) {
       g_debug("%s: RTF is available\n", __FUNCTION__);
       format = TARGET_NAME_APPLICATION_RTF;
       haveRTF = true;
    }
-   if (refClipboard->wait_is_target_available(TARGET_NAME_TEXT_RICHTEXT)) {
+   if (TargetsInclude(targets, nTargets, TARGET_NAME_TEXT_RICHTEXT)) {
       g_debug("%s: RICHTEXT is available\n", __FUNCTION__);
       format = TARGET_NAME_TEXT_RICHTEXT;
       haveRTF = true;
    }
 
-   if (mCP->CheckCapability(DND_CP_CAP_RTF_CP) && haveRTF) {
+   if (!mCP->CheckCapability(DND_CP_CAP_RTF_CP) || !haveRTF) {
+      /* Not available. */
+   } else if (fetch & CPFORMAT_BIT(CPFORMAT_RTF)) {
       /*
        * There is a function for waiting for rtf data, but that was leading
        * to crashes. It's use required we instantiate a class that implements
@@ -783,11 +920,18 @@ again:
          g_debug("%s: Failed to get RTF size %d max %d\n",
                __FUNCTION__, (int) bufSize, (int)CPCLIPITEM_MAX_SIZE_V3);
       }
+   } else if ((promise & CPFORMAT_BIT(CPFORMAT_RTF)) &&
+              CPClipboard_SetItem(&mClipboard, CPFORMAT_RTF, NULL, 0)) {
+      validDataInClip = true;
+      g_debug("%s: Promised RTF\n", __FUNCTION__);
    }
 
    /* Try to get Text data from clipboard. */
-   if (mCP->CheckCapability(DND_CP_CAP_PLAIN_TEXT_CP) &&
-       refClipboard->wait_is_text_available()) {
+   if (!mCP->CheckCapability(DND_CP_CAP_PLAIN_TEXT_CP) ||
+       !((fetch | promise) & CPFORMAT_BIT(CPFORMAT_TEXT)) ||
+       !gtk_targets_include_text((GdkAtom *)targets, nTargets)) {
+      /* Not available. */
+   } else if (fetch & CPFORMAT_BIT(CPFORMAT_TEXT)) {
       g_debug("%s: ask for text\n", __FUNCTION__);
       Glib::ustring str = refClipboard->wait_for_text();
       bufSize = str.bytes();
@@ -800,29 +944,57 @@ again:
       } else {
          g_debug("%s: Failed to get TEXT\n", __FUNCTION__);
       }
+   } else if (CPClipboard_SetItem(&mClipboard, CPFORMAT_TEXT, NULL, 0)) {
+      validDataInClip = true;
+      g_debug("%s: Promised TEXT\n", __FUNCTION__);
    }
 
-   if (validDataInClip) {
-      /*
-       * RTF or text data (or both) in the clipboard.
-       */
-      mCP->DestUISendClip(&mClipboard);
-   } else if (!flipped) {
-      /*
-       * If we get here, we got nothing (no image, URI, text) so
-       * try the other selection.
-       */
-      g_debug("%s: got nothing for this selection, try the other.\n",
-            __FUNCTION__);
-      mGHSelection = mGHSelection == GDK_SELECTION_PRIMARY ?
-                     GDK_SELECTION_CLIPBOARD : GDK_SELECTION_PRIMARY;
-      flipped = true;
-      goto again;
-   } else {
-      g_debug("%s: got nothing, send empty clip back.\n",
-            __FUNCTION__);
-      mCP->DestUISendClip(&mClipboard);
+   return validDataInClip;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CopyPasteUIX11::GetLocalClipboardItems --
+ *
+ *    Retrieves the data of the clipboard items we promised to the host, in
+ *    the selection they were announced from, and sends it. For guest->host
+ *    copy/paste.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+CopyPasteUIX11::GetLocalClipboardItems(uint32 formats) // IN: CPFORMAT_BIT mask
+{
+   g_debug("%s: enter, formats %#x.\n", __FUNCTION__, formats);
+
+   if (!mCP->IsCopyPasteAllowed()) {
+      g_debug("%s: copyPaste is not allowed\n", __FUNCTION__);
+      return;
+   }
+
+   Glib::RefPtr<Gtk::Clipboard> refClipboard = Gtk::Clipboard::get(mGHSelection);
+   GdkAtom *targets = NULL;
+   gint nTargets = 0;
+
+   if (!gtk_clipboard_wait_for_targets(refClipboard->gobj(), &targets,
+                                       &nTargets)) {
+      targets = NULL;
+      nTargets = 0;
    }
+
+   CPClipboard_Clear(&mClipboard);
+   LocalGetSelectionItems(refClipboard, targets, nTargets, formats, 0);
+   g_free(targets);
+   mCP->DestUISendClip(&mClipboard);
 }
 
 
@@ -1032,9 +1204,15 @@ CopyPasteUIX11::LocalGetSelectionFileList(const Gtk::SelectionData& sd)      //
    DynBuf_Init(&buf);
    fileList.SetFileSize(totalSize);
    g_debug("%s: totalSize is %" FMT64 "u\n", __FUNCTION__, totalSize);
-   fileList.ToCPClipboard(&buf, false);
-   CPClipboard_SetItem(&mClipboard, CPFORMAT_FILELIST, DynBuf_Get(&buf),
-                       DynBuf_GetSize(&buf));
+   if (mCP->CheckCapability(DND_CP_CAP_FILELIST_COMPACT)) {
+      fileList.ToCompactCPClipboard(&buf);
+      CPClipboard_SetItem(&mClipboard, CPFORMAT_FILELIST_COMPACT,
+                          DynBuf_Get(&buf), DynBuf_GetSize(&buf));
+   } else {
+      fileList.ToCPClipboard(&buf, false);
+      CPClipboard_SetItem(&mClipboard, CPFORMAT_FILELIST, DynBuf_Get(&buf),
+                          DynBuf_GetSize(&buf));
+   }
    DynBuf_Destroy(&buf);
 }
 
@@ -1266,10 +1444,11 @@ CopyPasteUIX11::GetRemoteClipboardCB(const CPClipboard *clip) // IN
       return;
    }
 
-   if (CPClipboard_GetItem(clip, CPFORMAT_FILELIST, &buf, &sz)) {
+   if (CPClipboard_ItemExists(clip, CPFORMAT_FILELIST) ||
+       CPClipboard_ItemExists(clip, CPFORMAT_FILELIST_COMPACT)) {
       g_debug("%s: File data.\n", __FUNCTION__);
       DnDFileList flist;
-      flist.FromCPClipboard(buf, sz);
+      flist.FromCPClipboard(clip);
       mTotalFileSize = flist.GetFileSize();
       mHGFCPData = flist.GetRelPathsStr();
 
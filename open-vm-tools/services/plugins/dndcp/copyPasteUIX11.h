@@ -95,6 +95,12 @@ private:
    void GetLocalClipboard(void);
    void LocalClipboardTimestampCB(const Gtk::SelectionData& sd);
    void LocalPrimTimestampCB(const Gtk::SelectionData& sd);
+   bool LocalGetSelectionItems(Glib::RefPtr<Gtk::Clipboard> refClipboard,
+                               const GdkAtom *targets,
+                               gint nTargets,
+                               uint32 fetch,
+                               uint32 promise);
+   void GetLocalClipboardItems(uint32 formats);
    void LocalReceivedFileListCB(const Gtk::SelectionData& selection_data);
    void GetLocalFilesDone(bool success);
    void SendClipNotChanged(void);
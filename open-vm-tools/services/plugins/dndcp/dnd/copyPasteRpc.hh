@@ -46,6 +46,7 @@ public:
 
    /* sigc signal for CopyPaste destination callback. */
    sigc::signal<void, uint32, bool> destRequestClipChanged;
+   sigc::signal<void, uint32, uint32> destRequestItemsChanged;
 
    /* sigc signal for ping reply callback. */
    sigc::signal<void, uint32> pingReplyChanged;
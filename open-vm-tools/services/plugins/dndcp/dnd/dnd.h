@@ -107,6 +107,7 @@ typedef enum
    CPFORMAT_FILECONTENTS,
    CPFORMAT_IMG_PNG,
    CPFORMAT_FILEATTRIBUTES,
+   CPFORMAT_FILELIST_COMPACT, /* CPFORMAT_FILELIST, front coded. */
    CPFORMAT_MAX,
 } DND_CPFORMAT;
 
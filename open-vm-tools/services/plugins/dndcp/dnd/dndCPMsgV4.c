@@ -28,6 +28,10 @@
 #include "dndCPMsgV4.h"
 #include "util.h"
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 
 /**
  * Check if received packet is valid or not.
@@ -293,6 +297,107 @@ DnDCPMsgV4_UnserializeMultiple(DnDCPMsgV4 *msg,
 }
 
 
+/**
+ * Compress the binary of a message to be sent with DND_CP_MSG_SRC_COMPRESSED:
+ * the uncompressed size as a uint32, followed by the zlib stream. Binaries
+ * that don't shrink by at least an eighth, such as PNG images, are not worth
+ * it and are left alone.
+ *
+ * @param[in] binary
+ * @param[in] binarySize
+ * @param[out] packed the compressed binary, to be freed by the caller.
+ * @param[out] packedSize
+ *
+ * @return TRUE if the binary was compressed, FALSE otherwise.
+ */
+
+Bool
+DnDCPMsgV4_CompressBinary(const uint8 *binary,
+                          uint32 binarySize,
+                          uint8 **packed,
+                          uint32 *packedSize)
+{
+#ifdef HAVE_ZLIB
+   uLongf destLen;
+   uint8 *dest;
+
+   ASSERT(binary);
+   ASSERT(packed);
+   ASSERT(packedSize);
+
+   if (binarySize < DND_CP_MSG_COMPRESS_MIN_SIZE_V4) {
+      return FALSE;
+   }
+
+   destLen = binarySize - binarySize / 8 - sizeof binarySize;
+   dest = Util_SafeMalloc(sizeof binarySize + destLen);
+   memcpy(dest, &binarySize, sizeof binarySize);
+
+   /* Z_BUF_ERROR means it didn't fit, so it didn't shrink enough. */
+   if (compress2(dest + sizeof binarySize, &destLen, binary, binarySize,
+                 Z_BEST_SPEED) != Z_OK) {
+      free(dest);
+      return FALSE;
+   }
+
+   *packed = dest;
+   *packedSize = sizeof binarySize + destLen;
+   return TRUE;
+#else
+   return FALSE;
+#endif
+}
+
+
+/**
+ * Replace the binary of a message received with DND_CP_MSG_SRC_COMPRESSED
+ * by its uncompressed contents.
+ *
+ * @param[in/out] msg the message.
+ *
+ * @return TRUE if succeed, FALSE if the binary is not valid.
+ */
+
+Bool
+DnDCPMsgV4_UncompressBinary(DnDCPMsgV4 *msg)
+{
+#ifdef HAVE_ZLIB
+   uint32 binarySize;
+   uLongf destLen;
+   uint8 *dest;
+
+   ASSERT(msg);
+   ASSERT(msg->hdr.src & DND_CP_MSG_SRC_COMPRESSED);
+
+   if (!msg->binary || msg->hdr.binarySize < sizeof binarySize) {
+      return FALSE;
+   }
+
+   memcpy(&binarySize, msg->binary, sizeof binarySize);
+   if (binarySize == 0 || binarySize > DND_CP_MSG_MAX_BINARY_SIZE_V4) {
+      return FALSE;
+   }
+
+   dest = Util_SafeMalloc(binarySize);
+   destLen = binarySize;
+   if (uncompress(dest, &destLen, msg->binary + sizeof binarySize,
+                  msg->hdr.binarySize - sizeof binarySize) != Z_OK ||
+       destLen != binarySize) {
+      free(dest);
+      return FALSE;
+   }
+
+   free(msg->binary);
+   msg->binary = dest;
+   msg->hdr.binarySize = binarySize;
+   msg->hdr.src &= ~DND_CP_MSG_SRC_COMPRESSED;
+   return TRUE;
+#else
+   return FALSE;
+#endif
+}
+
+
 /**
  * Map a command to a string.
  *
@@ -344,11 +449,14 @@ DnDCPMsgV4_LookupCmd(uint32 cmd)
       { CP_CMD_SEND_CLIPBOARD,         "CP_CMD_SEND_CLIPBOARD" },
       { CP_CMD_GET_FILES_DONE,         "CP_CMD_GET_FILES_DONE" },
       { CP_CMD_SEND_FILES_DONE,        "CP_CMD_SEND_FILES_DONE" },
+      { CP_CMD_REQUEST_CLIPBOARD_ITEMS, "CP_CMD_REQUEST_CLIPBOARD_ITEMS" },
 
       { FT_CMD_HGFS_REQUEST,           "FT_CMD_HGFS_REQUEST" },
       { FT_CMD_HGFS_REPLY,             "FT_CMD_HGFS_REPLY" },
       { FT_CMD_UPDATE_PROGRESS,        "FT_CMD_UPDATE_PROGRESS" },
       { FT_CMD_PROGRESS_REPLY,         "FT_CMD_PROGRESS_REPLY" },
+      { FT_CMD_HGFS_REQUEST_BATCH,     "FT_CMD_HGFS_REQUEST_BATCH" },
+      { FT_CMD_HGFS_REPLY_BATCH,       "FT_CMD_HGFS_REPLY_BATCH" },
    };
    size_t i;
 
@@ -106,6 +106,7 @@ typedef enum {
    CP_CMD_SEND_CLIPBOARD,
    CP_CMD_GET_FILES_DONE,
    CP_CMD_SEND_FILES_DONE,
+   CP_CMD_REQUEST_CLIPBOARD_ITEMS,
 } CopyPasteCmdV4;
 
 /* File transfer commands. */
@@ -113,7 +114,9 @@ typedef enum {
    FT_CMD_HGFS_REQUEST = 3000,
    FT_CMD_HGFS_REPLY,
    FT_CMD_UPDATE_PROGRESS,
-   FT_CMD_PROGRESS_REPLY
+   FT_CMD_PROGRESS_REPLY,
+   FT_CMD_HGFS_REQUEST_BATCH,
+   FT_CMD_HGFS_REPLY_BATCH,
 } FileTransferCmdV4;
 
 /* Message types. */
@@ -173,6 +176,37 @@ typedef enum DnDCPMsgPacketType {
 #define DND_CP_CAP_ACTIVE_CP        (1 << 13)
 #define DND_CP_CAP_GUEST_PROGRESS   (1 << 14)
 #define DND_CP_CAP_BIG_BUFFER       (1 << 15)
+/*
+ * The sender of a multi-packet message may have several packets in flight
+ * instead of waiting for a DNDCP_CMD_REQUEST_NEXT before each one. The
+ * receiver still requests the next packet after each one it gets, with the
+ * number of bytes received so far in requestNextCmd.payloadOffset, which
+ * acknowledges everything up to there.
+ */
+#define DND_CP_CAP_PACKET_WINDOW    (1 << 16)
+/*
+ * The clipboard sent with CP_CMD_SEND_CLIPBOARD may hold promised items,
+ * which only announce that a format is available. The receiver fetches the
+ * ones it pastes with CP_CMD_REQUEST_CLIPBOARD_ITEMS, the CPFORMAT_BIT mask
+ * of the formats in cpInfo.formats, and gets them in another
+ * CP_CMD_SEND_CLIPBOARD.
+ */
+#define DND_CP_CAP_CP_PROMISED      (1 << 17)
+/*
+ * The binary of a message may be compressed, see DND_CP_MSG_SRC_COMPRESSED.
+ * Only advertised by builds with zlib.
+ */
+#define DND_CP_CAP_COMPRESS         (1 << 18)
+/*
+ * The HGFS server takes FT_CMD_HGFS_REQUEST_BATCH, and may be sent several
+ * requests before replying. See DND_CP_FT_BATCH_MAX_V4.
+ */
+#define DND_CP_CAP_FT_BATCH         (1 << 19)
+/*
+ * Clipboards may carry CPFORMAT_FILELIST_COMPACT in place of
+ * CPFORMAT_FILELIST, which is much smaller for big selections.
+ */
+#define DND_CP_CAP_FILELIST_COMPACT (1 << 20)
 
 #define DND_CP_CAP_FORMATS_CP       (DND_CP_CAP_PLAIN_TEXT_CP   | \
                                      DND_CP_CAP_RTF_CP          | \
@@ -219,6 +253,28 @@ DnDCPMsgHdrV4;
 #define DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4 (DND_MAX_TRANSPORT_PACKET_SIZE - \
                                            DND_CP_MSG_HEADERSIZE_V4)
 #define DND_CP_MSG_MAX_BINARY_SIZE_V4 (1 << 22)
+/* Packets of a message in flight when the peer has DND_CP_CAP_PACKET_WINDOW. */
+#define DND_CP_PACKET_WINDOW_V4 8
+
+/*
+ * Or'ed into DnDCPMsgHdrV4.src when the binary is compressed, which is only
+ * done if the peer has DND_CP_CAP_COMPRESS. The binary then holds the
+ * uncompressed size as a uint32, followed by a zlib stream. Smaller binaries
+ * are never compressed.
+ */
+#define DND_CP_MSG_SRC_COMPRESSED (1U << 31)
+#define DND_CP_MSG_COMPRESS_MIN_SIZE_V4 4096
+
+/*
+ * The binary of FT_CMD_HGFS_REQUEST_BATCH is a sequence of HGFS requests,
+ * each a uint32 size followed by the packet, for any mix of files. They are
+ * run in order in the same HGFS session, and the FT_CMD_HGFS_REPLY_BATCH
+ * holds their replies the same way, in the same order. This many requests at
+ * most, so that the replies fit in a message. A batch that can't be run is
+ * answered with an empty FT_CMD_HGFS_REPLY_BATCH whose status says why; none
+ * of its requests have been run then.
+ */
+#define DND_CP_FT_BATCH_MAX_V4 64
 
 /* DnD version 4 message. */
 typedef struct DnDCPMsgV4 {
@@ -241,6 +297,11 @@ Bool DnDCPMsgV4_UnserializeSingle(DnDCPMsgV4 *msg,
 Bool DnDCPMsgV4_UnserializeMultiple(DnDCPMsgV4 *msg,
                                     const uint8 *packet,
                                     size_t packetSize);
+Bool DnDCPMsgV4_CompressBinary(const uint8 *binary,
+                               uint32 binarySize,
+                               uint8 **packed,
+                               uint32 *packedSize);
+Bool DnDCPMsgV4_UncompressBinary(DnDCPMsgV4 *msg);
 const char *DnDCPMsgV4_LookupCmd(uint32 cmd);
 #endif
 #endif // DND_CP_MSG_V4_H
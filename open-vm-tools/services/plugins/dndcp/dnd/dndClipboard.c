@@ -454,6 +454,41 @@ CPClipboard_IsEmpty(const CPClipboard *clip)    // IN: the clipboard
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipboard_GetPromisedFormats  --
+ *
+ *      Get the formats promised by the clipboard, that is the items which
+ *      exist but have no data yet.
+ *
+ * Results:
+ *      Mask of the CPFORMAT_BIT of the promised formats.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+uint32
+CPClipboard_GetPromisedFormats(const CPClipboard *clip) // IN: the clipboard
+{
+   unsigned int i;
+   uint32 formats = 0;
+
+   ASSERT(clip);
+
+   for (i = CPFORMAT_MIN; i < CPFORMAT_MAX; ++i) {
+      if (clip->items[CPFormatToIndex(i)].exists &&
+          clip->items[CPFormatToIndex(i)].size == 0) {
+         formats |= CPFORMAT_BIT(i);
+      }
+   }
+   return formats;
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -601,13 +636,21 @@ CPClipboard_Serialize(const CPClipboard *clip, // IN
    ASSERT(clip);
    ASSERT(buf);
 
+   /*
+    * Peers that predate CPFORMAT_FILELIST_COMPACT never get one, so leave
+    * it out and keep the clipboard exactly as they know it.
+    */
+   if (!CPClipboard_ItemExists(clip, CPFORMAT_FILELIST_COMPACT)) {
+      maxFmt = CPFORMAT_FILELIST_COMPACT;
+   }
+
    /* First append number of formats in clip. */
    if (!DynBuf_Append(buf, &maxFmt, sizeof maxFmt)) {
       return FALSE;
    }
 
    /* Append format data one by one. */
-   for (fmt = CPFORMAT_MIN; fmt < CPFORMAT_MAX; ++fmt) {
+   for (fmt = CPFORMAT_MIN; fmt < maxFmt; ++fmt) {
       CPClipItem *item = (CPClipItem *)&(clip->items[CPFormatToIndex(fmt)]);
       if (!DynBuf_Append(buf, &item->exists, sizeof item->exists) ||
           !DynBuf_Append(buf, &item->size, sizeof item->size)) {
@@ -746,6 +789,7 @@ CPClipboard_Strip(CPClipboard *clip,    // IN/OUT: the clipboard
    if (!(mask & DND_CP_CAP_FILE_DND) && !(mask & DND_CP_CAP_FILE_CP)) {
       CPClipboard_ClearItem(clip, CPFORMAT_FILELIST);
       CPClipboard_ClearItem(clip, CPFORMAT_FILELIST_URI);
+      CPClipboard_ClearItem(clip, CPFORMAT_FILELIST_COMPACT);
    }
    if (!(mask & DND_CP_CAP_FILE_CONTENT_DND) &&
        !(mask & DND_CP_CAP_FILE_CONTENT_CP)) {
@@ -61,6 +61,16 @@ CPFileList;
 
 #define CPFILELIST_HEADER_SIZE (1* sizeof(uint64) + 2 * sizeof(uint32))
 
+/*
+ * CPFORMAT_FILELIST_COMPACT uses the CPFileList header, but each of the two
+ * lists is front coded: the number of entries, then for each entry the
+ * number of leading bytes it shares with the previous entry, the number of
+ * bytes that follow and those bytes. Counts and lengths are varints, 7 bits
+ * per byte with the high bit set on all but the last byte. Relative path
+ * entries have no NUL terminator, full path entries are the CPName without
+ * its length prefix.
+ */
+
 typedef
 #include "vmware_pack_begin.h"
 struct UriFileList {
@@ -113,6 +123,9 @@ typedef enum
 
 #define CPFORMAT_MIN CPFORMAT_TEXT
 
+/* Bit of a format in a format mask. */
+#define CPFORMAT_BIT(fmt) (1U << (fmt))
+
 /* CPClipboard */
 void CPClipboard_Init(CPClipboard *clip);
 void CPClipboard_Destroy(CPClipboard *clip);
@@ -127,6 +140,7 @@ Bool CPClipboard_GetItem(const CPClipboard *clip, DND_CPFORMAT fmt,
                          void **buf, size_t *size);
 Bool CPClipboard_ItemExists(const CPClipboard *clip, DND_CPFORMAT fmt);
 Bool CPClipboard_IsEmpty(const CPClipboard *clip);
+uint32 CPClipboard_GetPromisedFormats(const CPClipboard *clip);
 #if !defined(SWIG)
 size_t CPClipboard_GetTotalSize(const CPClipboard *clip);
 #endif
@@ -41,6 +41,7 @@ public:
 
    sigc::signal<void, uint32, const uint8 *, size_t> HgfsPacketReceived;
    sigc::signal<void, uint32, const uint8 *, size_t> HgfsReplyReceived;
+   sigc::signal<void, uint32, const uint8 *, size_t> HgfsBatchReceived;
 
    virtual void Init(void) = 0;
    virtual bool SendHgfsPacket(uint32 sessionId,
@@ -49,6 +50,10 @@ public:
    virtual bool SendHgfsReply(uint32 sessionId,
                               const uint8 *packet,
                               uint32 packetSize) = 0;
+   virtual bool SendHgfsReplyBatch(uint32 sessionId,
+                                   uint32 status,
+                                   const uint8 *batch,
+                                   uint32 batchSize) = 0;
 };
 
 #endif // FILE_TRANSFER_RPC_HH
@@ -48,6 +48,10 @@ public:
    virtual bool SendHgfsReply(uint32 sessionId,
                               const uint8 *packet,
                               uint32 packetSize);
+   virtual bool SendHgfsReplyBatch(uint32 sessionId,
+                                   uint32 status,
+                                   const uint8 *batch,
+                                   uint32 batchSize);
    virtual void HandleMsg(RpcParams *params,
                           const uint8 *binary,
                           uint32 binarySize);
@@ -85,6 +85,7 @@ typedef struct RpcParams {
          uint32 minor;
          uint32 capability;
          uint32 isActive;
+         uint32 formats;
       } cpInfo;
 
       struct {
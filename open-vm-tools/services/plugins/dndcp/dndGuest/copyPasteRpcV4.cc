@@ -286,6 +286,10 @@ CopyPasteRpcV4::HandleMsg(RpcParams *params,
       destRequestClipChanged.emit(params->sessionId,
                                   1 == params->optional.cpInfo.isActive);
       break;
+   case CP_CMD_REQUEST_CLIPBOARD_ITEMS:
+      destRequestItemsChanged.emit(params->sessionId,
+                                   params->optional.cpInfo.formats);
+      break;
    case CP_CMD_REQUEST_FILES:
       requestFilesChanged.emit(params->sessionId, binary, binarySize);
       break;
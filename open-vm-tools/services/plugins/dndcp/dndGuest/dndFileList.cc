@@ -46,6 +46,8 @@
 #include <afx.h>
 #endif
 
+#include <algorithm>
+
 #include "dndFileList.hh"
 
 extern "C" {
@@ -685,6 +687,369 @@ DnDFileList::AttributesToCPClipboard(DynBuf *out) // IN
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DnDFileListAppendVarint --
+ *
+ *      Appends a value in the varint encoding of CPFORMAT_FILELIST_COMPACT.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+DnDFileListAppendVarint(std::string &out,       // IN/OUT:
+                        uint64 value)           // IN:
+{
+   while (value >= 0x80) {
+      out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+      value >>= 7;
+   }
+   out.push_back(static_cast<char>(value));
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DnDFileListReadVarint --
+ *
+ *      Reads a value in the varint encoding of CPFORMAT_FILELIST_COMPACT.
+ *
+ * Results:
+ *      false if the buffer ends first or the value is too big, true
+ *      otherwise.
+ *
+ * Side effects:
+ *      pos is moved past the value.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static bool
+DnDFileListReadVarint(const uint8 *&pos,        // IN/OUT:
+                      const uint8 *end,         // IN:
+                      uint64 *value)            // OUT:
+{
+   uint64 result = 0;
+   unsigned int shift;
+
+   for (shift = 0; shift < 64 && pos < end; shift += 7) {
+      uint8 byte = *pos++;
+
+      result |= static_cast<uint64>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+         *value = result;
+         return true;
+      }
+   }
+   return false;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DnDFileListFrontCode --
+ *
+ *      Front codes a list of paths: each is stored as the length of the
+ *      prefix it shares with the previous one and the rest of it. The paths
+ *      of a selection are listed directory by directory, so most of each
+ *      path is shared.
+ *
+ * Results:
+ *      The encoded list.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static std::string
+DnDFileListFrontCode(const std::vector<std::string> &paths)   // IN:
+{
+   std::string out;
+   std::vector<std::string>::const_iterator i;
+   const std::string *prev = NULL;
+
+   DnDFileListAppendVarint(out, paths.size());
+   for (i = paths.begin(); i != paths.end(); ++i) {
+      size_t shared = 0;
+
+      if (prev) {
+         size_t max = std::min(prev->size(), i->size());
+
+         while (shared < max && (*prev)[shared] == (*i)[shared]) {
+            shared++;
+         }
+      }
+      DnDFileListAppendVarint(out, shared);
+      DnDFileListAppendVarint(out, i->size() - shared);
+      out.append(*i, shared, std::string::npos);
+      prev = &*i;
+   }
+   return out;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DnDFileListFrontDecode --
+ *
+ *      Decodes a list encoded by DnDFileListFrontCode.
+ *
+ * Results:
+ *      false if the list is not valid, true otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static bool
+DnDFileListFrontDecode(const uint8 *buf,                   // IN:
+                       size_t len,                         // IN:
+                       std::vector<std::string> &paths)    // OUT:
+{
+   const uint8 *pos = buf;
+   const uint8 *end = buf + len;
+   std::string path;
+   uint64 count;
+
+   /* Each entry takes at least two bytes. */
+   if (!DnDFileListReadVarint(pos, end, &count) || count > len / 2) {
+      return false;
+   }
+
+   paths.clear();
+   paths.reserve(count);
+   while (count-- > 0) {
+      uint64 shared;
+      uint64 rest;
+
+      if (!DnDFileListReadVarint(pos, end, &shared) ||
+          !DnDFileListReadVarint(pos, end, &rest) ||
+          shared > path.size() ||
+          rest > static_cast<uint64>(end - pos)) {
+         return false;
+      }
+      path.resize(shared);
+      path.append(reinterpret_cast<const char *>(pos), rest);
+      pos += rest;
+      paths.push_back(path);
+   }
+   return pos == end;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DnDFileList::GetCPNamePaths --
+ *
+ *      Gets the full paths as CPNames, as they are serialized by
+ *      GetFullPathsStr(false) but without their length prefixes.
+ *
+ * Results:
+ *      The CPNames.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+std::vector<std::string>
+DnDFileList::GetCPNamePaths()
+   const
+{
+   std::vector<std::string> cpNames;
+
+   if (mFullPathsBinary.empty()) {
+      std::vector<std::string>::const_iterator i;
+
+      for (i = mFullPaths.begin(); i != mFullPaths.end(); ++i) {
+         char outPath[FILE_MAXPATH + 100];
+         int32 outPathLen;
+
+         outPathLen = CPNameUtil_ConvertToRoot(i->c_str(),
+                                               sizeof outPath,
+                                               outPath);
+         if (outPathLen >= 0) {
+            cpNames.push_back(std::string(outPath, outPathLen));
+         }
+      }
+   } else {
+      size_t pos = 0;
+
+      while (mFullPathsBinary.size() - pos >= sizeof(int32)) {
+         int32 len;
+
+         memcpy(&len, mFullPathsBinary.data() + pos, sizeof len);
+         pos += sizeof len;
+         if (len < 0 ||
+             static_cast<size_t>(len) > mFullPathsBinary.size() - pos) {
+            break;
+         }
+         cpNames.push_back(mFullPathsBinary.substr(pos, len));
+         pos += len;
+      }
+   }
+   return cpNames;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DnDFileList::ToCompactCPClipboard --
+ *
+ *      Serializes contents for CPClipboard in CPFORMAT_FILELIST_COMPACT
+ *      format, which carries what ToCPClipboard(out, false) does.
+ *
+ * Results:
+ *      false on error, true on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+bool
+DnDFileList::ToCompactCPClipboard(DynBuf *out)  // OUT: Initialized buffer
+   const
+{
+   std::string strListRel;
+   std::string strListFul;
+   CPFileList header;
+
+   if (!out) {
+      return false;
+   }
+
+   strListRel = DnDFileListFrontCode(mRelPaths);
+   strListFul = DnDFileListFrontCode(GetCPNamePaths());
+
+   /* Check if the size is too big. */
+   if (strListRel.size() > MAX_UINT32 ||
+       strListFul.size() > MAX_UINT32) {
+      return false;
+   }
+
+   header.fileSize = mFileSize;
+   header.relPathsLen = strListRel.size();
+   header.fulPathsLen = strListFul.size();
+
+   DynBuf_Append(out, &header, CPFILELIST_HEADER_SIZE);
+   DynBuf_Append(out, strListRel.data(), header.relPathsLen);
+   DynBuf_Append(out, strListFul.data(), header.fulPathsLen);
+
+   return true;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DnDFileList::FromCompactCPClipboard --
+ *
+ *      Loads the filelist from a CPFORMAT_FILELIST_COMPACT buffer. The result
+ *      is the same as FromCPClipboard of the equivalent CPFORMAT_FILELIST.
+ *
+ * Results:
+ *      false if the buffer is not valid, true otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+bool
+DnDFileList::FromCompactCPClipboard(const void *buf,    // IN: Source buffer
+                                    size_t len)         // IN: Buffer length
+{
+   const CPFileList *flist;
+   std::vector<std::string> relPaths;
+   std::vector<std::string> cpNames;
+   std::vector<std::string>::const_iterator i;
+
+   if (!buf || len < CPFILELIST_HEADER_SIZE) {
+      return false;
+   }
+
+   flist = reinterpret_cast<const CPFileList *>(buf);
+   if (flist->relPathsLen > len - CPFILELIST_HEADER_SIZE ||
+       flist->fulPathsLen > len - CPFILELIST_HEADER_SIZE - flist->relPathsLen) {
+      return false;
+   }
+
+   if (!DnDFileListFrontDecode(flist->filelists, flist->relPathsLen,
+                               relPaths) ||
+       !DnDFileListFrontDecode(flist->filelists + flist->relPathsLen,
+                               flist->fulPathsLen, cpNames)) {
+      return false;
+   }
+
+   Clear();
+   mFileSize = flist->fileSize;
+   mRelPaths.swap(relPaths);
+   for (i = cpNames.begin(); i != cpNames.end(); ++i) {
+      int32 cpNameLen = i->size();
+
+      mFullPathsBinary.append(reinterpret_cast<const char *>(&cpNameLen),
+                              sizeof cpNameLen);
+      mFullPathsBinary.append(*i);
+   }
+
+   return true;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DnDFileList::FromCPClipboard --
+ *
+ *      Loads the filelist from a clipboard, from whichever of
+ *      CPFORMAT_FILELIST_COMPACT and CPFORMAT_FILELIST it has.
+ *
+ * Results:
+ *      false if it has neither or the one it has is not valid, true
+ *      otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+bool
+DnDFileList::FromCPClipboard(const CPClipboard *clip)   // IN: Source clipboard
+{
+   void *buf;
+   size_t sz;
+
+   if (CPClipboard_GetItem(clip, CPFORMAT_FILELIST_COMPACT, &buf, &sz)) {
+      return FromCompactCPClipboard(buf, sz);
+   }
+   if (CPClipboard_GetItem(clip, CPFORMAT_FILELIST, &buf, &sz)) {
+      return FromCPClipboard(buf, sz);
+   }
+   return false;
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
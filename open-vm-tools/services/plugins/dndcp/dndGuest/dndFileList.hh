@@ -67,9 +67,15 @@ class DnDFileList {
       bool FromCPClipboard(const void *buf, size_t len);
       bool AttributesFromCPClipboard(const void *buf, size_t len);
 
+      /* CPFORMAT_FILELIST_COMPACT */
+      bool ToCompactCPClipboard(DynBuf *out) const;
+      bool FromCompactCPClipboard(const void *buf, size_t len);
+      bool FromCPClipboard(const CPClipboard *clip);
+
       void Clear();
 
    private:
+      std::vector<std::string> GetCPNamePaths() const;
 
       std::vector<std::string> mRelPaths;
       std::vector<std::string> mFullPaths;
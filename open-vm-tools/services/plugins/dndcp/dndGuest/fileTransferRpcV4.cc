@@ -69,8 +69,6 @@ FileTransferRpcV4::FileTransferRpcV4(DnDCPTransport *transport)
 /**
  * Init. Register the rpc with transport. Send a ping message to controller to
  * to let it know our version and capability.
- *
- * XXX Capability is not implemented yet.
  */
 
 void
@@ -78,6 +76,8 @@ FileTransferRpcV4::Init(void)
 {
    ASSERT(mTransport);
    mTransport->RegisterRpc(this, mTransportInterface);
+   mUtil.SendPingMsg(DEFAULT_CONNECTION_ID,
+                     DND_CP_CAP_VALID | DND_CP_CAP_FT_BATCH);
 }
 
 
@@ -133,6 +133,35 @@ FileTransferRpcV4::SendHgfsReply(uint32 sessionId,
 }
 
 
+/**
+ * Sends the replies to a batch of hgfs requests back to peer.
+ *
+ * @param[in] sessionId DnD/CopyPaste session id.
+ * @param[in] status DND_CP_MSG_STATUS_SUCCESS, or why the batch failed.
+ * @param[in] batch the replies, see DND_CP_FT_BATCH_MAX_V4.
+ * @param[in] batchSize batch size.
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+FileTransferRpcV4::SendHgfsReplyBatch(uint32 sessionId,
+                                      uint32 status,
+                                      const uint8 *batch,
+                                      uint32 batchSize)
+{
+   RpcParams params;
+
+   memset(&params, 0, sizeof params);
+   params.addrId = DEFAULT_CONNECTION_ID;
+   params.cmd = FT_CMD_HGFS_REPLY_BATCH;
+   params.status = status;
+   params.sessionId = sessionId;
+
+   return mUtil.SendMsg(&params, batch, batchSize);
+}
+
+
 /**
  * Send a packet.
  *
@@ -178,6 +207,9 @@ FileTransferRpcV4::HandleMsg(RpcParams *params,
    case FT_CMD_HGFS_REPLY:
       HgfsReplyReceived.emit(params->sessionId, binary, binarySize);
       break;
+   case FT_CMD_HGFS_REQUEST_BATCH:
+      HgfsBatchReceived.emit(params->sessionId, binary, binarySize);
+      break;
    case DNDCP_CMD_PING_REPLY:
       break;
    default:
@@ -52,6 +52,7 @@ public:
 
    sigc::signal<void, const CPClipboard*> srcRecvClipChanged;
    sigc::signal<void> destRequestClipChanged;
+   sigc::signal<void, uint32> destRequestItemsChanged;
    sigc::signal<void, bool> getFilesDoneChanged;
 
    GUEST_CP_STATE GetState(void) { return mCPState; }
@@ -79,6 +80,8 @@ private:
                          const CPClipboard *clip);
    void OnRpcDestRequestClip(uint32 sessionId,
                              bool isActive);
+   void OnRpcDestRequestItems(uint32 sessionId,
+                              uint32 formats);
    void OnPingReply(uint32 capabilities);
    GuestCopyPasteSrc *mSrc;
    GuestCopyPasteDest *mDest;
@@ -127,10 +130,12 @@ public:
    void UISendClip(const CPClipboard *clip);
    /* Callbacks from rpc for CopyPaste destination. */
    void OnRpcRequestClip(bool isActive);
+   void OnRpcRequestItems(uint32 formats);
 
 private:
    GuestCopyPasteMgr *mMgr;
    bool mIsActive;
+   uint32 mPromisedFormats;
 };
 
 
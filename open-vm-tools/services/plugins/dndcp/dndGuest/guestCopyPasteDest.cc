@@ -39,14 +39,17 @@ extern "C" {
  */
 
 GuestCopyPasteDest::GuestCopyPasteDest(GuestCopyPasteMgr *mgr)
- : mMgr(mgr)
+ : mMgr(mgr),
+   mPromisedFormats(0)
 {
    ASSERT(mMgr);
 }
 
 
 /**
- * Got valid clipboard data from UI. Send sendClip cmd to controller.
+ * Got valid clipboard data from UI. Send sendClip cmd to controller. The
+ * clipboard may promise some items, which the host fetches later with
+ * requestItems.
  *
  * @param[in] clip cross-platform clipboard data.
  */
@@ -68,6 +71,8 @@ GuestCopyPasteDest::UISendClip(const CPClipboard *clip)
       goto error;
    }
 
+   mPromisedFormats |= CPClipboard_GetPromisedFormats(clip);
+
    return;
 
 error:
@@ -89,3 +94,23 @@ GuestCopyPasteDest::OnRpcRequestClip(bool isActive)
    mMgr->destRequestClipChanged.emit();
 }
 
+
+/**
+ * Host is asking for the data of promised clipboard items. Emit
+ * destRequestItemsChanged signal with the ones we promised.
+ *
+ * @param[in] formats CPFORMAT_BIT mask of the formats wanted.
+ */
+
+void
+GuestCopyPasteDest::OnRpcRequestItems(uint32 formats)
+{
+   g_debug("%s: state is %d, formats %#x, promised %#x\n", __FUNCTION__,
+           mMgr->GetState(), formats, mPromisedFormats);
+
+   formats &= mPromisedFormats;
+   if (formats == 0) {
+      return;
+   }
+   mMgr->destRequestItemsChanged.emit(formats);
+}
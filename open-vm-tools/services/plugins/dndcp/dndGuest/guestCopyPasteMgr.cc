@@ -47,7 +47,12 @@ GuestCopyPasteMgr::GuestCopyPasteMgr(DnDCPTransport *transport)
    mTransport(transport),
    mSessionId(0),
    mCopyPasteAllowed(false),
-   mResolvedCaps(0xffffffff)
+   /*
+    * Promised items need the peer to fetch them, and the compact file list
+    * needs it to read it, so wait for its ping reply.
+    */
+   mResolvedCaps(0xffffffff &
+                 ~(DND_CP_CAP_CP_PROMISED | DND_CP_CAP_FILELIST_COMPACT))
 {
    ASSERT(transport);
 }
@@ -221,6 +226,34 @@ GuestCopyPasteMgr::OnRpcDestRequestClip(uint32 sessionId,
 }
 
 
+/**
+ * Host is asking for the data of clipboard items promised in the current
+ * session.
+ * @param[in] sessionId active session id
+ * @param[in] formats CPFORMAT_BIT mask of the formats wanted.
+ */
+
+void
+GuestCopyPasteMgr::OnRpcDestRequestItems(uint32 sessionId,
+                                         uint32 formats)
+{
+   TRACE_CALL();
+
+   if (!mCopyPasteAllowed) {
+      g_debug("%s: CopyPaste is not allowed.\n", __FUNCTION__);
+      return;
+   }
+
+   if (!mDest || sessionId != mSessionId) {
+      g_debug("%s: no clipboard was sent in session %u\n", __FUNCTION__,
+              sessionId);
+      return;
+   }
+
+   mDest->OnRpcRequestItems(formats);
+}
+
+
 /**
  * Wrapper for mDest->UISendClip.
  *
@@ -276,9 +309,13 @@ GuestCopyPasteMgr::VmxCopyPasteVersionChanged(uint32 version)
          sigc::mem_fun(this, &GuestCopyPasteMgr::OnRpcSrcRecvClip));
       mRpc->destRequestClipChanged.connect(
          sigc::mem_fun(this, &GuestCopyPasteMgr::OnRpcDestRequestClip));
+      mRpc->destRequestItemsChanged.connect(
+         sigc::mem_fun(this, &GuestCopyPasteMgr::OnRpcDestRequestItems));
       mRpc->Init();
       mRpc->SendPing(GuestDnDCPMgr::GetInstance()->GetCaps() &
-                     (DND_CP_CAP_CP | DND_CP_CAP_FORMATS_CP | DND_CP_CAP_VALID));
+                     (DND_CP_CAP_CP | DND_CP_CAP_FORMATS_CP |
+                      DND_CP_CAP_CP_PROMISED | DND_CP_CAP_FILELIST_COMPACT |
+                      DND_CP_CAP_VALID));
    }
 
    ResetCopyPaste();
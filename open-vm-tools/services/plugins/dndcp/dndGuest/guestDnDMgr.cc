@@ -123,7 +123,8 @@ GuestDnDMgr::GuestDnDMgr(DnDCPTransport *transport,
    mToolsAppCtx(ctx),
    mDnDAllowed(false),
    mDnDTransport(transport),
-   mCapabilities(0xffffffff)
+   /* The compact file list needs the peer to read it, so wait for its reply. */
+   mCapabilities(0xffffffff & ~DND_CP_CAP_FILELIST_COMPACT)
 {
    ASSERT(transport);
    ASSERT(mToolsAppCtx);
@@ -667,7 +668,7 @@ GuestDnDMgr::VmxDnDVersionChanged(uint32 version)
       mRpc->Init();
       mRpc->SendPing(GuestDnDCPMgr::GetInstance()->GetCaps() &
                      (DND_CP_CAP_DND | DND_CP_CAP_FORMATS_DND |
-                      DND_CP_CAP_VALID));
+                      DND_CP_CAP_FILELIST_COMPACT | DND_CP_CAP_VALID));
    }
 
    ResetDnD();
@@ -184,7 +184,8 @@ GuestDnDSrc::OnRpcDrop(uint32 sessionId,
    }
    mMgr->srcDropChanged.emit();
 
-   if (CPClipboard_ItemExists(&mClipboard, CPFORMAT_FILELIST)) {
+   if (CPClipboard_ItemExists(&mClipboard, CPFORMAT_FILELIST) ||
+       CPClipboard_ItemExists(&mClipboard, CPFORMAT_FILELIST_COMPACT)) {
       /* Convert staging name to CP format. */
       cpNameSize = CPNameUtil_ConvertToRoot(mStagingDir.c_str(),
                                             sizeof cpName,
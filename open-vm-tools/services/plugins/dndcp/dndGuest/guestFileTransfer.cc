@@ -27,9 +27,13 @@
 
 extern "C" {
    #include "debug.h"
+   #include "dynbuf.h"
    #include "hgfsServer.h"
 }
 
+/* Progress of a transfer is logged each time this many more bytes moved. */
+#define GUEST_FT_PROGRESS_STEP (16 * 1024 * 1024)
+
 
 /**
  * Create transport object and register callback.
@@ -38,12 +42,18 @@ extern "C" {
  */
 
 GuestFileTransfer::GuestFileTransfer(DnDCPTransport *transport)
+   : mSessionId(0),
+     mRequests(0),
+     mBytes(0),
+     mReportedBytes(0)
 {
    ASSERT(transport);
    mRpc = new FileTransferRpcV4(transport);
    mRpc->Init();
    mRpc->HgfsPacketReceived.connect(
       sigc::mem_fun(this, &GuestFileTransfer::OnRpcRecvHgfsPacket));
+   mRpc->HgfsBatchReceived.connect(
+      sigc::mem_fun(this, &GuestFileTransfer::OnRpcRecvHgfsBatch));
    HgfsServerManager_DataInit(&mHgfsServerMgrData,
                               "DnDGuestHgfsMgr",
                               NULL,
@@ -57,6 +67,7 @@ GuestFileTransfer::GuestFileTransfer(DnDCPTransport *transport)
  */
 GuestFileTransfer::~GuestFileTransfer(void)
 {
+   ReportProgress();
    delete mRpc;
    mRpc = NULL;
    HgfsServerManager_Unregister(&mHgfsServerMgrData);
@@ -77,7 +88,7 @@ GuestFileTransfer::OnRpcRecvHgfsPacket(uint32 sessionId,
                                        size_t packetSize)
 {
    char replyPacket[HGFS_LARGE_PACKET_MAX];
-   size_t replyPacketSize;
+   size_t replyPacketSize = sizeof replyPacket;
 
    ASSERT(packet);
    ASSERT(mRpc);
@@ -89,5 +100,148 @@ GuestFileTransfer::OnRpcRecvHgfsPacket(uint32 sessionId,
                                    replyPacket,
                                    &replyPacketSize);
    mRpc->SendHgfsReply(sessionId, (const uint8 *)replyPacket, replyPacketSize);
+   UpdateProgress(sessionId, 1, packetSize + replyPacketSize);
+}
+
+
+/**
+ * Callback after received a batch of hgfs requests. They are run in order,
+ * and their replies sent back together. The whole batch is checked before
+ * any request is run. A batch that can't be run is still answered, with an
+ * empty reply and an error status, so the peer is never left waiting.
+ *
+ * @param[in] sessionId dnd session id.
+ * @param[in] batch hgfs requests from the peer, see DND_CP_FT_BATCH_MAX_V4.
+ * @param[in] batchSize batch size.
+ */
+
+void
+GuestFileTransfer::OnRpcRecvHgfsBatch(uint32 sessionId,
+                                      const uint8 *batch,
+                                      size_t batchSize)
+{
+   DynBuf replies;
+   size_t offset = 0;
+   uint32 count = 0;
+   uint32 i;
+   uint32 status;
+
+   ASSERT(mRpc);
+
+   DynBuf_Init(&replies);
+
+   /* Check the framing of the whole batch first. */
+   while (offset < batchSize) {
+      uint32 packetSize;
+
+      if (count == DND_CP_FT_BATCH_MAX_V4 ||
+          batchSize - offset < sizeof packetSize) {
+         goto invalid;
+      }
+      memcpy(&packetSize, batch + offset, sizeof packetSize);
+      offset += sizeof packetSize;
+      if (packetSize == 0 || packetSize > batchSize - offset) {
+         goto invalid;
+      }
+      offset += packetSize;
+      count++;
+   }
+
+   /* Room for every reply, so that running out can't stop a batch midway. */
+   if (!DynBuf_Reserve(&replies,
+                       count * (sizeof(uint32) + HGFS_LARGE_PACKET_MAX))) {
+      Debug("%s: out of memory\n", __FUNCTION__);
+      status = DND_CP_MSG_STATUS_ERROR;
+      goto fail;
+   }
+
+   offset = 0;
+   for (i = 0; i < count; i++) {
+      uint32 packetSize;
+      uint32 replySize;
+      size_t replyOffset = DynBuf_GetSize(&replies);
+      size_t replyPacketSize = HGFS_LARGE_PACKET_MAX;
+
+      memcpy(&packetSize, batch + offset, sizeof packetSize);
+      offset += sizeof packetSize;
+
+      /* The reply goes straight after its size in the batch of replies. */
+      HgfsServerManager_ProcessPacket(&mHgfsServerMgrData,
+                                      (const char *)batch + offset,
+                                      packetSize,
+                                      (char *)DynBuf_Get(&replies) +
+                                         replyOffset + sizeof replySize,
+                                      &replyPacketSize);
+      replySize = (uint32)replyPacketSize;
+      memcpy((char *)DynBuf_Get(&replies) + replyOffset, &replySize,
+             sizeof replySize);
+      DynBuf_SetSize(&replies, replyOffset + sizeof replySize + replyPacketSize);
+
+      offset += packetSize;
+   }
+
+   mRpc->SendHgfsReplyBatch(sessionId,
+                            DND_CP_MSG_STATUS_SUCCESS,
+                            (const uint8 *)DynBuf_Get(&replies),
+                            (uint32)DynBuf_GetSize(&replies));
+   UpdateProgress(sessionId, count, batchSize + DynBuf_GetSize(&replies));
+   goto exit;
+
+invalid:
+   Debug("%s: invalid batch of %" FMTSZ "u bytes.\n", __FUNCTION__, batchSize);
+   status = DND_CP_MSG_STATUS_INVALID_PACKET;
+
+fail:
+   mRpc->SendHgfsReplyBatch(sessionId, status, NULL, 0);
+
+exit:
+   DynBuf_Destroy(&replies);
+}
+
+
+/**
+ * Account for HGFS requests served, and log the progress of the transfer
+ * every GUEST_FT_PROGRESS_STEP bytes. Requests for any number of files, in
+ * batches or not, count towards the same session.
+ *
+ * @param[in] sessionId dnd session id.
+ * @param[in] requests number of requests served.
+ * @param[in] bytes bytes of the requests and their replies.
+ */
+
+void
+GuestFileTransfer::UpdateProgress(uint32 sessionId,
+                                  uint32 requests,
+                                  uint64 bytes)
+{
+   if (sessionId != mSessionId) {
+      ReportProgress();
+      mSessionId = sessionId;
+      mRequests = 0;
+      mBytes = 0;
+      mReportedBytes = 0;
+   }
+
+   mRequests += requests;
+   mBytes += bytes;
+   if (mBytes - mReportedBytes >= GUEST_FT_PROGRESS_STEP) {
+      ReportProgress();
+   }
+}
+
+
+/**
+ * Log the progress of the current transfer session.
+ */
+
+void
+GuestFileTransfer::ReportProgress(void)
+{
+   if (mRequests == 0 || mBytes == mReportedBytes) {
+      return;
+   }
+   Debug("%s: session %u: %u HGFS requests, %" FMT64 "u bytes.\n",
+         __FUNCTION__, mSessionId, mRequests, mBytes);
+   mReportedBytes = mBytes;
 }
 
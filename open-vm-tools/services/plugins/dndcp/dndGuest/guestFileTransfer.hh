@@ -43,9 +43,20 @@ private:
    void OnRpcRecvHgfsPacket(uint32 sessionId,
                             const uint8 *packet,
                             size_t packetSize);
+   void OnRpcRecvHgfsBatch(uint32 sessionId,
+                           const uint8 *batch,
+                           size_t batchSize);
+   void UpdateProgress(uint32 sessionId,
+                       uint32 requests,
+                       uint64 bytes);
+   void ReportProgress(void);
 
    FileTransferRpc *mRpc;
    HgfsServerMgrData mHgfsServerMgrData;
+   uint32 mSessionId;      // Session the progress below is for.
+   uint32 mRequests;       // HGFS requests served in the session.
+   uint64 mBytes;          // Bytes of HGFS requests and replies.
+   uint64 mReportedBytes;  // mBytes when progress was last reported.
 };
 
 #endif // GUEST_FILE_TRANSFER_HH
@@ -45,6 +45,72 @@ extern "C" {
 }
 
 
+/* Capabilities of the message layer itself, added to those pinged. */
+#ifdef HAVE_ZLIB
+#define RPC_V4_UTIL_CAPS (DND_CP_CAP_PACKET_WINDOW | DND_CP_CAP_COMPRESS)
+#else
+#define RPC_V4_UTIL_CAPS DND_CP_CAP_PACKET_WINDOW
+#endif
+
+
+/*
+ * BodySource for a binary that is already in memory. It takes over the
+ * buffer, and frees it.
+ */
+
+class RpcV4BufferSource
+   : public RpcV4Util::BodySource
+{
+public:
+   RpcV4BufferSource(uint8 *buf) : mBuf(buf) {}
+   virtual ~RpcV4BufferSource(void) { free(mBuf); }
+   virtual bool Read(uint32 offset, uint8 *buf, uint32 size)
+   {
+      memcpy(buf, mBuf + offset, size);
+      return true;
+   }
+
+private:
+   uint8 *mBuf;
+};
+
+
+/**
+ * Fill in the header of a message to be sent.
+ *
+ * @param[out] msg the message
+ * @param[in] params parameter list for the message
+ * @param[in] msgType the type of message (DnD/CP/FT)
+ * @param[in] msgSrc source of the message (host/guest/controller)
+ * @param[in] binarySize size of the binary of the message
+ */
+
+static void
+RpcV4UtilInitMsg(DnDCPMsgV4 *msg,
+                 const RpcParams *params,
+                 uint32 msgType,
+                 uint32 msgSrc,
+                 uint32 binarySize)
+{
+   msg->addrId = params->addrId;
+   msg->hdr.cmd = params->cmd;
+   msg->hdr.type = msgType;
+   msg->hdr.src = msgSrc;
+   msg->hdr.sessionId = params->sessionId;
+   msg->hdr.status = params->status;
+   msg->hdr.param1 = params->optional.genericParams.param1;
+   msg->hdr.param2 = params->optional.genericParams.param2;
+   msg->hdr.param3 = params->optional.genericParams.param3;
+   msg->hdr.param4 = params->optional.genericParams.param4;
+   msg->hdr.param5 = params->optional.genericParams.param5;
+   msg->hdr.param6 = params->optional.genericParams.param6;
+   msg->hdr.binarySize = binarySize;
+   msg->hdr.payloadOffset = 0;
+   msg->hdr.payloadSize = 0;
+   msg->binary = NULL;
+}
+
+
 
 /**
  * Constructor.
@@ -52,7 +118,11 @@ extern "C" {
 
 RpcV4Util::RpcV4Util(void)
    : mVersionMajor(4),
-     mVersionMinor(0)
+     mVersionMinor(0),
+     mBigMsgOutBody(NULL),
+     mBigMsgOutAcked(0),
+     mPacketBuf(NULL),
+     mPeerCaps(0)
 {
    DnDCPMsgV4_Init(&mBigMsgIn);
    DnDCPMsgV4_Init(&mBigMsgOut);
@@ -68,7 +138,8 @@ RpcV4Util::RpcV4Util(void)
 RpcV4Util::~RpcV4Util(void)
 {
    DnDCPMsgV4_Destroy(&mBigMsgIn);
-   DnDCPMsgV4_Destroy(&mBigMsgOut);
+   DestroyBigMsgOut();
+   free(mPacketBuf);
 
    while (DblLnkLst_IsLinked(&mRpcSentListeners)) {
       DnDRpcSentListenerNode *node =
@@ -128,6 +199,8 @@ RpcV4Util::SendMsg(RpcParams *params,
                    const CPClipboard *clip)
 {
    DynBuf buf;
+   uint8 *packed;
+   uint32 packedSize;
    bool ret = false;
 
    ASSERT(params);
@@ -143,9 +216,28 @@ RpcV4Util::SendMsg(RpcParams *params,
       goto exit;
    }
 
-   ret = SendMsg(params,
-                 (const uint8 *)DynBuf_Get(&buf),
-                 (uint32)DynBuf_GetSize(&buf));
+   if (CompressBinary((const uint8 *)DynBuf_Get(&buf),
+                      (uint32)DynBuf_GetSize(&buf),
+                      &packed, &packedSize)) {
+      ret = SendBodyMsg(params, new RpcV4BufferSource(packed), packedSize,
+                        mMsgSrc | DND_CP_MSG_SRC_COMPRESSED);
+      goto exit;
+   }
+
+   if (DynBuf_GetSize(&buf) > DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4) {
+      /* Hand the serialized clipboard over rather than copy it. */
+      uint32 binarySize = (uint32)DynBuf_GetSize(&buf);
+
+      ret = SendBodyMsg(params,
+                        new RpcV4BufferSource((uint8 *)DynBuf_Detach(&buf)),
+                        binarySize, mMsgSrc);
+      goto exit;
+   }
+
+   ret = SendShortMsg(params,
+                      (const uint8 *)DynBuf_Get(&buf),
+                      (uint32)DynBuf_GetSize(&buf),
+                      mMsgSrc);
 
 exit:
    DynBuf_Destroy(&buf);
@@ -154,7 +246,8 @@ exit:
 
 
 /**
- * Serialize the message and send it to destId.
+ * Serialize the message and send it to destId. The binary is compressed if
+ * the peer supports it and it is worth it.
  *
  * @param[in] params parameter list for the message
  * @param[in] binary
@@ -168,57 +261,298 @@ RpcV4Util::SendMsg(RpcParams *params,
                    const uint8 *binary,
                    uint32 binarySize)
 {
-   bool ret = false;
-   DnDCPMsgV4 *msgOut = NULL;
-   DnDCPMsgV4 shortMsg;
+   uint8 *packed;
+   uint32 packedSize;
 
    ASSERT(params);
 
-   DnDCPMsgV4_Init(&shortMsg);
+   if (CompressBinary(binary, binarySize, &packed, &packedSize)) {
+      return SendBodyMsg(params, new RpcV4BufferSource(packed), packedSize,
+                         mMsgSrc | DND_CP_MSG_SRC_COMPRESSED);
+   }
 
    if (binarySize > DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4) {
       /*
-       * For big message, all information should be cached in mBigMsgOut
-       * because multiple packets and sends are needed.
+       * For big message, the binary has to be kept around because multiple
+       * packets and sends are needed.
        */
-      DnDCPMsgV4_Destroy(&mBigMsgOut);
-      msgOut = &mBigMsgOut;
-   } else {
-      /* For short message, the temporary shortMsg is enough. */
-      msgOut = &shortMsg;
-   }
-
-   msgOut->addrId = params->addrId;
-   msgOut->hdr.cmd = params->cmd;
-   msgOut->hdr.type = mMsgType;
-   msgOut->hdr.src = mMsgSrc;
-   msgOut->hdr.sessionId = params->sessionId;
-   msgOut->hdr.status = params->status;
-   msgOut->hdr.param1 = params->optional.genericParams.param1;
-   msgOut->hdr.param2 = params->optional.genericParams.param2;
-   msgOut->hdr.param3 = params->optional.genericParams.param3;
-   msgOut->hdr.param4 = params->optional.genericParams.param4;
-   msgOut->hdr.param5 = params->optional.genericParams.param5;
-   msgOut->hdr.param6 = params->optional.genericParams.param6;
-   msgOut->hdr.binarySize = binarySize;
-   msgOut->hdr.payloadOffset = 0;
-   msgOut->hdr.payloadSize = 0;
-   msgOut->binary = NULL;
-   if (binarySize > 0) {
-      msgOut->binary = (uint8 *)(Util_SafeMalloc(binarySize));
-      memcpy(msgOut->binary, binary,binarySize);
+      uint8 *copy = (uint8 *)Util_SafeMalloc(binarySize);
+
+      memcpy(copy, binary, binarySize);
+      return SendBodyMsg(params, new RpcV4BufferSource(copy), binarySize,
+                         mMsgSrc);
    }
 
-   ret = SendMsg(msgOut);
-   /* The mBigMsgOut is destroyed when the message sending was failed. */
-   if (!ret && msgOut == &mBigMsgOut) {
-      DnDCPMsgV4_Destroy(&mBigMsgOut);
+   return SendShortMsg(params, binary, binarySize, mMsgSrc);
+}
+
+
+/**
+ * Serialize a message that fits in one packet and send it to destId.
+ *
+ * @param[in] params parameter list for the message
+ * @param[in] binary
+ * @param[in] binarySize
+ * @param[in] msgSrc source of the message, with its flags
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+RpcV4Util::SendShortMsg(RpcParams *params,
+                        const uint8 *binary,
+                        uint32 binarySize,
+                        uint32 msgSrc)
+{
+   bool ret = false;
+   DnDCPMsgV4 shortMsg;
+
+   ASSERT(binarySize <= DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4);
+
+   /* For short message, the temporary shortMsg is enough. */
+   DnDCPMsgV4_Init(&shortMsg);
+   RpcV4UtilInitMsg(&shortMsg, params, mMsgType, msgSrc, binarySize);
+   if (binarySize > 0) {
+      shortMsg.binary = (uint8 *)(Util_SafeMalloc(binarySize));
+      memcpy(shortMsg.binary, binary, binarySize);
    }
+
+   ret = SendMsg(&shortMsg);
    DnDCPMsgV4_Destroy(&shortMsg);
    return ret;
 }
 
 
+/**
+ * Compress a binary to be sent, if the peer has DND_CP_CAP_COMPRESS.
+ *
+ * @param[in] binary
+ * @param[in] binarySize
+ * @param[out] packed the compressed binary, to be freed by the caller.
+ * @param[out] packedSize
+ *
+ * @return true if the binary was compressed, false otherwise.
+ */
+
+bool
+RpcV4Util::CompressBinary(const uint8 *binary,
+                          uint32 binarySize,
+                          uint8 **packed,
+                          uint32 *packedSize)
+{
+   if (!(mPeerCaps & DND_CP_CAP_COMPRESS) || NULL == binary) {
+      return false;
+   }
+
+   if (!DnDCPMsgV4_CompressBinary(binary, binarySize, packed, packedSize)) {
+      return false;
+   }
+
+   LOG(4, ("%s: compressed %u bytes to %u.\n", __FUNCTION__, binarySize,
+           *packedSize));
+   return true;
+}
+
+
+/**
+ * Send a message whose binary is read from body as it goes out, and send it
+ * to destId. Big messages are sent in several packets: with a peer that
+ * has DND_CP_CAP_PACKET_WINDOW, up to DND_CP_PACKET_WINDOW_V4 of them are in
+ * flight at a time, otherwise each waits for the peer to request it.
+ *
+ * @param[in] params parameter list for the message
+ * @param[in] body source of the binary, deleted once it is no longer needed
+ * @param[in] binarySize
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+RpcV4Util::SendStreamMsg(RpcParams *params,
+                         BodySource *body,
+                         uint32 binarySize)
+{
+   return SendBodyMsg(params, body, binarySize, mMsgSrc);
+}
+
+
+/**
+ * Send a message whose binary is read from body, see SendStreamMsg.
+ *
+ * @param[in] params parameter list for the message
+ * @param[in] body source of the binary, deleted once it is no longer needed
+ * @param[in] binarySize
+ * @param[in] msgSrc source of the message, with its flags
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+RpcV4Util::SendBodyMsg(RpcParams *params,
+                       BodySource *body,
+                       uint32 binarySize,
+                       uint32 msgSrc)
+{
+   ASSERT(params);
+   ASSERT(body);
+
+   if (binarySize <= DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4) {
+      uint8 *binary = NULL;
+      bool ret;
+
+      if (binarySize > 0) {
+         binary = (uint8 *)Util_SafeMalloc(binarySize);
+      }
+      ret = body->Read(0, binary, binarySize) &&
+            SendShortMsg(params, binary, binarySize, msgSrc);
+      free(binary);
+      delete body;
+      return ret;
+   }
+
+   /* A new big message replaces any that is still being sent. */
+   DestroyBigMsgOut();
+   RpcV4UtilInitMsg(&mBigMsgOut, params, mMsgType, msgSrc, binarySize);
+   mBigMsgOutBody = body;
+
+   if (!SendBigMsgPackets()) {
+      DestroyBigMsgOut();
+      return false;
+   }
+   return true;
+}
+
+
+/**
+ * Send the next packet of mBigMsgOut. The packet is built in mPacketBuf,
+ * with its payload read straight from the message body.
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+RpcV4Util::SendBigMsgPacket(void)
+{
+   DnDCPMsgHdrV4 hdr = mBigMsgOut.hdr;
+   uint32 payloadSize;
+
+   ASSERT(mBigMsgOutBody);
+   ASSERT(hdr.payloadOffset < hdr.binarySize);
+
+   payloadSize = MIN(hdr.binarySize - hdr.payloadOffset,
+                     DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4);
+   hdr.payloadSize = payloadSize;
+
+   if (NULL == mPacketBuf) {
+      mPacketBuf = (uint8 *)Util_SafeMalloc(DND_CP_MSG_HEADERSIZE_V4 +
+                                            DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4);
+   }
+   memcpy(mPacketBuf, &hdr, DND_CP_MSG_HEADERSIZE_V4);
+   if (!mBigMsgOutBody->Read(hdr.payloadOffset,
+                             mPacketBuf + DND_CP_MSG_HEADERSIZE_V4,
+                             payloadSize)) {
+      LOG(1, ("%s: reading the message body failed.\n", __FUNCTION__));
+      return false;
+   }
+
+   if (!mRpc->SendPacket(mBigMsgOut.addrId, mPacketBuf,
+                         DND_CP_MSG_HEADERSIZE_V4 + payloadSize)) {
+      return false;
+   }
+
+   mBigMsgOut.hdr.payloadOffset += payloadSize;
+   FireRpcSentCallbacks(mBigMsgOut.hdr.cmd,
+                        mBigMsgOut.addrId,
+                        mBigMsgOut.hdr.sessionId);
+   return true;
+}
+
+
+/**
+ * Send as many packets of mBigMsgOut as the window allows: all those up to
+ * DND_CP_PACKET_WINDOW_V4 packets past what the peer acknowledged if it
+ * supports it, otherwise one. mBigMsgOut is destroyed once it has been sent
+ * in full.
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+RpcV4Util::SendBigMsgPackets(void)
+{
+   uint32 window = DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4;
+
+   if (mPeerCaps & DND_CP_CAP_PACKET_WINDOW) {
+      window *= DND_CP_PACKET_WINDOW_V4;
+   }
+
+   while (mBigMsgOut.hdr.payloadOffset < mBigMsgOut.hdr.binarySize &&
+          mBigMsgOut.hdr.payloadOffset - mBigMsgOutAcked < window) {
+      if (!SendBigMsgPacket()) {
+         return false;
+      }
+   }
+
+   if (mBigMsgOut.hdr.payloadOffset == mBigMsgOut.hdr.binarySize) {
+      DestroyBigMsgOut();
+   }
+   return true;
+}
+
+
+/**
+ * Handle a DNDCP_CMD_REQUEST_NEXT from the receiver of mBigMsgOut: move
+ * the window forward and send the packets it lets through.
+ *
+ * @param[in] ack the request.
+ */
+
+void
+RpcV4Util::OnBigMsgAck(const DnDCPMsgV4 *ack)
+{
+   if (NULL == mBigMsgOutBody) {
+      /* Late request for a message that went out in full. */
+      return;
+   }
+
+   if (mPeerCaps & DND_CP_CAP_PACKET_WINDOW) {
+      uint32 acked = ack->hdr.param3;  // requestNextCmd.payloadOffset
+
+      if (ack->hdr.sessionId != mBigMsgOut.hdr.sessionId) {
+         return;
+      }
+      if (acked < mBigMsgOutAcked || acked > mBigMsgOut.hdr.payloadOffset) {
+         LOG(1, ("%s: invalid acknowledged offset %u.\n", __FUNCTION__,
+                 acked));
+         return;
+      }
+      mBigMsgOutAcked = acked;
+   } else {
+      /* One packet at a time; the request is for the next one. */
+      mBigMsgOutAcked = mBigMsgOut.hdr.payloadOffset;
+   }
+
+   if (!SendBigMsgPackets()) {
+      LOG(1, ("%s: SendBigMsgPackets failed. \n", __FUNCTION__));
+      DestroyBigMsgOut();
+   }
+}
+
+
+/**
+ * Drop mBigMsgOut, and its body.
+ */
+
+void
+RpcV4Util::DestroyBigMsgOut(void)
+{
+   delete mBigMsgOutBody;
+   mBigMsgOutBody = NULL;
+   mBigMsgOutAcked = 0;
+   DnDCPMsgV4_Destroy(&mBigMsgOut);
+}
+
+
 /**
  * Construct a DNDCP_CMD_PING message and send it to destId.
  *
@@ -238,7 +572,7 @@ RpcV4Util::SendPingMsg(uint32 destId,
    params.cmd = DNDCP_CMD_PING;
    params.optional.version.major = mVersionMajor;
    params.optional.version.minor = mVersionMinor;
-   params.optional.version.capability = capability;
+   params.optional.version.capability = capability | RPC_V4_UTIL_CAPS;
 
    return SendMsg(&params);
 }
@@ -263,7 +597,7 @@ RpcV4Util::SendPingReplyMsg(uint32 destId,
    params.cmd = DNDCP_CMD_PING_REPLY;
    params.optional.version.major = mVersionMajor;
    params.optional.version.minor = mVersionMinor;
-   params.optional.version.capability = capability;
+   params.optional.version.capability = capability | RPC_V4_UTIL_CAPS;
 
    return SendMsg(&params);
 }
@@ -312,8 +646,8 @@ RpcV4Util::RequestNextPacket(void)
    params.cmd = DNDCP_CMD_REQUEST_NEXT;
    params.sessionId = mBigMsgIn.hdr.sessionId;
    params.optional.requestNextCmd.cmd = mBigMsgIn.hdr.cmd;
-   params.optional.requestNextCmd.cmd = mBigMsgIn.hdr.binarySize;
-   params.optional.requestNextCmd.cmd = mBigMsgIn.hdr.payloadOffset;
+   params.optional.requestNextCmd.binarySize = mBigMsgIn.hdr.binarySize;
+   params.optional.requestNextCmd.payloadOffset = mBigMsgIn.hdr.payloadOffset;
 
    return SendMsg(&params);
 }
@@ -476,19 +810,21 @@ RpcV4Util::HandleMsg(DnDCPMsgV4 *msgIn)
        * of data. For details about big buffer support, please refer to
        * https://wiki.eng.vmware.com/DnDVersion4Message#Binary_Buffer
        */
-      bool ret = SendMsg(&mBigMsgOut);
+      OnBigMsgAck(msgIn);
+      return;
+   }
 
-      if (!ret) {
-         LOG(1, ("%s: SendMsg failed. \n", __FUNCTION__));
-      }
+   if (DNDCP_CMD_PING == msgIn->hdr.cmd ||
+       DNDCP_CMD_PING_REPLY == msgIn->hdr.cmd) {
+      /* Whether big messages can be sent to the peer with a window. */
+      mPeerCaps = msgIn->hdr.param3;  // version.capability
+   }
 
-      /*
-       * mBigMsgOut will be destroyed if SendMsg failed or whole message has
-       * been sent.
-       */
-      if (!ret || mBigMsgOut.hdr.payloadOffset == mBigMsgOut.hdr.binarySize) {
-         DnDCPMsgV4_Destroy(&mBigMsgOut);
-      }
+   if ((msgIn->hdr.src & DND_CP_MSG_SRC_COMPRESSED) &&
+       !DnDCPMsgV4_UncompressBinary(msgIn)) {
+      LOG(1, ("%s: invalid compressed binary.\n", __FUNCTION__));
+      SendCmdReplyMsg(msgIn->addrId, DNDCP_CMD_INVALID,
+                      DND_CP_MSG_STATUS_INVALID_FORMAT);
       return;
    }
 
@@ -57,6 +57,17 @@ typedef struct DnDRpcSentListenerNode
 class LIB_EXPORT RpcV4Util
 {
 public:
+   /*
+    * Supplies the binary of a message as it is sent, one packet at a time,
+    * so that it doesn't have to be in memory in full first.
+    */
+   class BodySource
+   {
+   public:
+      virtual ~BodySource(void) {}
+      virtual bool Read(uint32 offset, uint8 *buf, uint32 size) = 0;
+   };
+
    RpcV4Util(void);
    virtual ~RpcV4Util(void);
 
@@ -75,6 +86,9 @@ public:
                 uint32 binarySize);
    bool SendMsg(RpcParams *params,
                 const CPClipboard *clip);
+   bool SendStreamMsg(RpcParams *params,
+                      BodySource *body,
+                      uint32 binarySize);
    bool SendMsg(RpcParams *params)
       { return SendMsg(params, NULL, 0); }
    uint32 GetVersionMajor(void) { return mVersionMajor; }
@@ -89,6 +103,22 @@ private:
    void FireRpcReceivedCallbacks(uint32 cmd, uint32 src, uint32 session);
    void FireRpcSentCallbacks(uint32 cmd, uint32 dest, uint32 session);
    bool SendMsg(DnDCPMsgV4 *msg);
+   bool SendShortMsg(RpcParams *params,
+                     const uint8 *binary,
+                     uint32 binarySize,
+                     uint32 msgSrc);
+   bool SendBodyMsg(RpcParams *params,
+                    BodySource *body,
+                    uint32 binarySize,
+                    uint32 msgSrc);
+   bool CompressBinary(const uint8 *binary,
+                       uint32 binarySize,
+                       uint8 **packed,
+                       uint32 *packedSize);
+   bool SendBigMsgPacket(void);
+   bool SendBigMsgPackets(void);
+   void OnBigMsgAck(const DnDCPMsgV4 *ack);
+   void DestroyBigMsgOut(void);
    bool RequestNextPacket(void);
    void HandlePacket(uint32 srcId,
                      const uint8 *packet,
@@ -104,6 +134,10 @@ private:
    uint32 mVersionMinor;
    DnDCPMsgV4 mBigMsgIn;
    DnDCPMsgV4 mBigMsgOut;
+   BodySource *mBigMsgOutBody;
+   uint32 mBigMsgOutAcked;
+   uint8 *mPacketBuf;
+   uint32 mPeerCaps;
    uint32 mMsgType;
    uint32 mMsgSrc;
    DblLnkLst_Links mRpcSentListeners;
@@ -369,7 +369,8 @@ DnDUIX11::OnSrcDragBegin(const CPClipboard *clip,       // IN
     */
    targets = Gtk::TargetList::create(std::vector<Gtk::TargetEntry>());
 
-   if (CPClipboard_ItemExists(&mClipboard, CPFORMAT_FILELIST)) {
+   if (CPClipboard_ItemExists(&mClipboard, CPFORMAT_FILELIST) ||
+       CPClipboard_ItemExists(&mClipboard, CPFORMAT_FILELIST_COMPACT)) {
       mHGStagingDir = stagingDir;
       if (!mHGStagingDir.empty()) {
          targets->add(Glib::ustring(DRAG_TARGET_NAME_URI_LIST));
@@ -1053,7 +1054,8 @@ DnDUIX11::OnGtkDragDataGet(
    }
 
    if (   target == DRAG_TARGET_NAME_URI_LIST
-       && CPClipboard_GetItem(&mClipboard, CPFORMAT_FILELIST, &buf, &sz)) {
+       && (   CPClipboard_ItemExists(&mClipboard, CPFORMAT_FILELIST)
+           || CPClipboard_ItemExists(&mClipboard, CPFORMAT_FILELIST_COMPACT))) {
 
       /* Provide path within vmblock file system instead of actual path. */
       stagingDirName = GetLastDirName(mHGStagingDir);
@@ -1063,7 +1065,7 @@ DnDUIX11::OnGtkDragDataGet(
          return;
       }
 
-      if (!fList.FromCPClipboard(buf, sz)) {
+      if (!fList.FromCPClipboard(&mClipboard)) {
          g_debug("%s: Can't get data from clipboard\n", __FUNCTION__);
          return;
       }
@@ -1448,7 +1450,12 @@ DnDUIX11::SetCPClipboardFromGtk(const Gtk::SelectionData& sd) // IN
 
       DynBuf_Init(&buf);
       fileList.SetFileSize(totalSize);
-      if (fileList.ToCPClipboard(&buf, false)) {
+      if (mDnD->CheckCapability(DND_CP_CAP_FILELIST_COMPACT)) {
+         if (fileList.ToCompactCPClipboard(&buf)) {
+            CPClipboard_SetItem(&mClipboard, CPFORMAT_FILELIST_COMPACT,
+                                DynBuf_Get(&buf), DynBuf_GetSize(&buf));
+         }
+      } else if (fileList.ToCPClipboard(&buf, false)) {
           CPClipboard_SetItem(&mClipboard, CPFORMAT_FILELIST, DynBuf_Get(&buf),
                               DynBuf_GetSize(&buf));
       }
@@ -22,6 +22,7 @@
  * Guest RabbitMQ proxy, routing traffic to VMX RabbitMQ proxy.
  */
 
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -76,11 +77,26 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
 #define GUEST_RABBITMQ_PROXY_VERSION             "1.0"
 #define CONFGROUP_GRABBITMQ_PROXY                "grabbitmqproxy"
 
+/*
+ * Recv from a connection stops once its peer has more than the high
+ * watermark queued for send, and resumes when that drops to the low one.
+ */
 #define DEFAULT_MAX_SEND_QUEUE_LEN               (256 * 1024)
+#define DEFAULT_SEND_QUEUE_LOW_WATERMARK         (DEFAULT_MAX_SEND_QUEUE_LEN / 4)
 
 /*user level recv buffer */
 #define RMQ_CLIENT_CONN_RECV_BUFF_SIZE           (64 * 1024)
 
+/* largest dataMap packet accepted from VMX */
+#define VMX_CONN_MAX_PACKET_LEN                  (16 * 1024 * 1024)
+
+/* relay buffers kept by each connection for the data it forwards */
+#define RELAY_RING_LEN                           8
+#define RELAY_BUF_SIZE                           RMQ_CLIENT_CONN_RECV_BUFF_SIZE
+
+/* room for the serialized dataMap fields sent ahead of a client payload */
+#define RELAY_BUF_HEADER_SIZE                    128
+
 /* these are socket level send/recv buffers */
 #define DEFAULT_RMQCLIENT_CONN_RECV_BUFF_SIZE    (64 * 1024)
 #define DEFAULT_RMQCLIENT_CONN_SEND_BUFF_SIZE    (64 * 1024)
@@ -89,6 +105,25 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
 
 #define VC_UUID_SIZE 36
 
+/*
+ * A buffer holding data on its way from one connection to the other. It
+ * stays queued on the destination socket until sent, so it may outlive the
+ * source connection; ring buffers keep their ring alive with a reference.
+ */
+typedef struct _RelayBuf {
+   struct _RelayRing *ring;   /* NULL if allocated on its own */
+   gboolean inUse;
+   int headerLen;
+   char header[RELAY_BUF_HEADER_SIZE];   /* dataMap fields ahead of data */
+   char data[1];
+} RelayBuf;
+
+typedef struct _RelayRing {
+   int refCount;              /* owning connection plus buffers in use */
+   int next;
+   RelayBuf *bufs[RELAY_RING_LEN];   /* allocated on first use */
+} RelayRing;
+
 /*  container for each connection details */
 typedef struct _ConnInfo {
    Bool isRmqClient;
@@ -99,14 +134,18 @@ typedef struct _ConnInfo {
 
    gboolean shutDown;
 
-   int32 packetLen;
-   char *recvBuf;
-   int recvBufLen;
+   RelayBuf *recvBuf;         /* client connection recv target */
+   RelayRing *ring;
 
    int sendQueueLen;
 
    gboolean recvStopped;
 
+   /* send queue metrics, reported when the connection is closed */
+   int peakSendQueueLen;
+   uint64 bytesSent;
+   int recvStopCount;       /* times the peer was paused for this queue */
+
    struct _ConnInfo *toConn;  /* the corresponding vmx connection for RabbitMq
                                  client connection, or vice versa. */
 } ConnInfo;
@@ -119,11 +158,20 @@ typedef struct {
                                 * we do not need a list for vmx connection as
                                 * each vmx connection is attached to a RabbitMQ
                                 * client connection. */
+   GList *spareVmxConnList;    /* vmx connections connected ahead of time,
+                                * waiting for a RabbitMQ client connection */
+   int spareVmxConnPending;    /* connect requests made for spares */
+   int vmxConnPoolSize;        /* number of spares to keep */
 
    ToolsAppCtx *ctx;           /* tools context */
    gboolean messageTunnellingEnabled;    /* Status of Message bus Tunnelling */
 
-   int maxSendQueueLen;
+   int sendQueueHighWatermark;
+   int sendQueueLowWatermark;
+
+   DataMap dataHeaderMap;      /* fields sent ahead of each client payload */
+   gboolean dataHeaderMapReady;
+   DynBuf dataHeaderBuf;
 } GuestProxyData;
 
 static GuestProxyData proxyData;
@@ -134,6 +182,138 @@ static void
 CloseConn(ConnInfo *conn);  // IN
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RelayRingRelease --
+ *
+ *      Drop a reference to a relay ring, freeing it and its buffers with
+ *      the last one.
+ *
+ * Result:
+ *      None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RelayRingRelease(RelayRing *ring)   // IN
+{
+   int i;
+
+   ASSERT(ring->refCount > 0);
+   if (--ring->refCount > 0) {
+      return;
+   }
+
+   for (i = 0; i < RELAY_RING_LEN; i++) {
+      free(ring->bufs[i]);
+   }
+   free(ring);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * GetRelayBuf --
+ *
+ *      Get a buffer for 'size' bytes of data forwarded from a connection.
+ *      A free buffer of the connection's ring is reused when the data fits,
+ *      otherwise a buffer of its own is allocated.
+ *
+ * Result:
+ *      The buffer, or NULL if out of memory.
+ *
+ * Side-effects:
+ *      Creates the connection's ring on first use.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static RelayBuf *
+GetRelayBuf(ConnInfo *conn,   // IN
+            int size)         // IN
+{
+   RelayRing *ring;
+   RelayBuf *buf;
+   int i;
+
+   if (conn->ring == NULL) {
+      conn->ring = calloc(1, sizeof *conn->ring);
+      if (conn->ring != NULL) {
+         conn->ring->refCount = 1;
+      }
+   }
+
+   ring = conn->ring;
+   if (ring != NULL && size <= RELAY_BUF_SIZE) {
+      for (i = 0; i < RELAY_RING_LEN; i++) {
+         int slot = (ring->next + i) % RELAY_RING_LEN;
+
+         buf = ring->bufs[slot];
+         if (buf == NULL) {
+            buf = malloc(offsetof(RelayBuf, data) + RELAY_BUF_SIZE);
+            if (buf == NULL) {
+               break;
+            }
+            buf->ring = ring;
+            ring->bufs[slot] = buf;
+         } else if (buf->inUse) {
+            continue;
+         }
+
+         buf->inUse = TRUE;
+         buf->headerLen = 0;
+         ring->refCount++;
+         ring->next = (slot + 1) % RELAY_RING_LEN;
+         return buf;
+      }
+   }
+
+   buf = malloc(offsetof(RelayBuf, data) + MAX(size, 1));
+   if (buf != NULL) {
+      buf->ring = NULL;
+      buf->inUse = TRUE;
+      buf->headerLen = 0;
+   }
+   return buf;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PutRelayBuf --
+ *
+ *      Give back a buffer taken with GetRelayBuf.
+ *
+ * Result:
+ *      None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+PutRelayBuf(RelayBuf *buf)   // IN
+{
+   ASSERT(buf->inUse);
+
+   if (buf->ring == NULL) {
+      free(buf);
+   } else {
+      buf->inUse = FALSE;
+      RelayRingRelease(buf->ring);
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -297,17 +477,29 @@ CloseConn(ConnInfo *conn)   // IN
       ShutDownConn(conn->toConn);
       conn->toConn = NULL;
    }
-   g_info("Closing %s connection %d\n", GetConnName(conn),
-          AsyncSocket_GetFd(conn->asock));
+   g_info("Closing %s connection %d, sent %"FMT64"u bytes, "
+          "peak sendQueueLen = %d, peer paused %d times\n",
+          GetConnName(conn), AsyncSocket_GetFd(conn->asock),
+          conn->bytesSent, conn->peakSendQueueLen, conn->recvStopCount);
 
    AsyncSocket_Close(conn->asock);
    conn->asock = NULL;
-   free(conn->recvBuf);
-   conn->recvBuf = NULL;
+   if (conn->recvBuf != NULL) {
+      PutRelayBuf(conn->recvBuf);
+      conn->recvBuf = NULL;
+   }
+   if (conn->ring != NULL) {
+      /* buffers still queued on the peer keep the ring alive */
+      RelayRingRelease(conn->ring);
+      conn->ring = NULL;
+   }
 
    /* remove the connection from corresponding conn list */
    if (conn->isRmqClient) {
       proxyData.rmqConnList = g_list_remove(proxyData.rmqConnList, conn);
+   } else {
+      proxyData.spareVmxConnList = g_list_remove(proxyData.spareVmxConnList,
+                                                 conn);
    }
    free(conn);
 }
@@ -351,7 +543,9 @@ AssignVmxConn(ConnInfo *conn)    // IN
  *
  * StartRecvFromRmqClient --
  *
- *      Register recv callback for RabbitMQ client connection.
+ *      Register recv callback for RabbitMQ client connection. The data is
+ *      received into a relay buffer, leaving room in front for the dataMap
+ *      fields, and sent on to VMX from there.
  *
  * Result:
  *      TURE on success, FALSE otherwise.
@@ -370,8 +564,7 @@ StartRecvFromRmqClient(ConnInfo *conn)   // IN
    ASSERT(AsyncSocket_GetState(conn->asock) == AsyncSocketConnected);
 
    if (conn->recvBuf == NULL) {
-      conn->recvBufLen = RMQ_CLIENT_CONN_RECV_BUFF_SIZE;
-      conn->recvBuf = malloc(conn->recvBufLen);
+      conn->recvBuf = GetRelayBuf(conn, RELAY_BUF_SIZE);
       if (conn->recvBuf == NULL) {
          g_info("Error in allocating recv buffer for socket %d, "
                 "closing connection.\n",
@@ -381,8 +574,8 @@ StartRecvFromRmqClient(ConnInfo *conn)   // IN
       }
    }
 
-   res = AsyncSocket_RecvPartial(conn->asock, conn->recvBuf,
-                                 conn->recvBufLen,
+   res = AsyncSocket_RecvPartial(conn->asock, conn->recvBuf->data,
+                                 RELAY_BUF_SIZE,
                                  conn->recvCb, conn);
    if (res != ASOCKERR_SUCCESS) {
       g_info("Error in AsyncSocket_RecvPartial for socket %d: %s\n",
@@ -399,7 +592,9 @@ StartRecvFromRmqClient(ConnInfo *conn)   // IN
  *
  * StartRecvFromVmx --
  *
- *      Register recv callback for VMX connection.
+ *      Register packet recv callback for VMX connection. AsyncSocket
+ *      delivers each length-prefixed dataMap packet, header included,
+ *      until the recv is cancelled.
  *
  * Result:
  *      TURE on success, FALSE otherwise.
@@ -414,11 +609,10 @@ static gboolean
 StartRecvFromVmx(ConnInfo *conn)   // IN
 {
    int res;
-   res = AsyncSocket_Recv(conn->asock, &conn->packetLen,
-                          sizeof conn->packetLen,
-                          conn->recvCb, conn);
+   res = AsyncSocket_RecvPackets(conn->asock, VMX_CONN_MAX_PACKET_LEN,
+                                 conn->recvCb, conn);
    if (res != ASOCKERR_SUCCESS) {
-      g_info("Error in AsyncSocket_Recv for socket %d: %s\n",
+      g_info("Error in AsyncSocket_RecvPackets for socket %d: %s\n",
              AsyncSocket_GetFd(conn->asock), AsyncSocket_Err2String(res));
       CloseConn(conn);
       return FALSE;
@@ -430,33 +624,54 @@ StartRecvFromVmx(ConnInfo *conn)   // IN
 /*
  *-----------------------------------------------------------------------------
  *
- * RecvPacketFromVmxConn --
+ * ConnSendDone --
  *
- *      Wrapper function for recving a dataMap packet from VMX connection.
+ *      Account for some data sent over a connection, closing it if it is
+ *      being shut down and has now sent everything, and resuming recv on
+ *      its peer once the send queue has drained enough.
  *
- * Result:
- *      TURE on success, FALSE otherwise.
+ * Results:
+ *      None.
  *
- * Side-effects:
- *      None
+ * Side effects:
+ *      None.
  *
  *-----------------------------------------------------------------------------
  */
 
-static gboolean
-RecvPacketFromVmxConn(ConnInfo *conn, int len)
+static void
+ConnSendDone(ConnInfo *dst,          // IN
+             int len)                // IN
 {
-   int res;
+   ConnInfo *src = dst->toConn;
 
-   res = AsyncSocket_Recv(conn->asock, conn->recvBuf + sizeof conn->packetLen,
-         len, conn->recvCb, conn);
-   if (res != ASOCKERR_SUCCESS) {
-      g_info("Error in AsyncSocket_Recv for socket %d: %s\n",
-             AsyncSocket_GetFd(conn->asock), AsyncSocket_Err2String(res));
-      CloseConn(conn);
-      return FALSE;
+   dst->sendQueueLen -= len;
+   dst->bytesSent += len;
+   ASSERT(dst->sendQueueLen >= 0);
+
+   if (dst->sendQueueLen == 0 && dst->shutDown) {
+      g_info("Closing %s connection %d as sendbuffer is now empty.\n",
+             GetConnName(dst), AsyncSocket_GetFd(dst->asock));
+      CloseConn(dst);
+      return;
+   }
+
+   g_debug("%d bytes sent to %s connection %d, sendQueueLen = %d\n",
+           len, GetConnName(dst), AsyncSocket_GetFd(dst->asock),
+           dst->sendQueueLen);
+
+   if ((!(dst->shutDown)) && src->recvStopped &&
+       (dst->sendQueueLen <= proxyData.sendQueueLowWatermark)) {
+      g_debug("Restart reading from connection %d, sendQueueLen = %d.\n",
+              AsyncSocket_GetFd(src->asock), dst->sendQueueLen);
+
+      src->recvStopped = FALSE;
+      if (src->isRmqClient) {
+         StartRecvFromRmqClient(src);
+      } else {
+         StartRecvFromVmx(src);
+      }
    }
-   return TRUE;
 }
 
 
@@ -465,7 +680,8 @@ RecvPacketFromVmxConn(ConnInfo *conn, int len)
  *
  * ConnSendDoneCb --
  *
- *      Callback function when some data is sent over a connection.
+ *      Callback function when the data of a relay buffer is sent over a
+ *      connection.
  *
  * Results:
  *      None.
@@ -483,11 +699,10 @@ ConnSendDoneCb(void *buf,            // IN
                void *clientData)     // IN
 {
    ConnInfo *dst = (ConnInfo *)clientData;
-   ConnInfo *src = dst->toConn;
 
    g_debug("Entering %s\n", __FUNCTION__);
 
-   free(buf);
+   PutRelayBuf((RelayBuf *)((char *)buf - offsetof(RelayBuf, data)));
 
    if (AsyncSocket_GetState(asock) != AsyncSocketConnected) {
       /* this callback may be called after the connection is closed to
@@ -495,32 +710,41 @@ ConnSendDoneCb(void *buf,            // IN
       return;
    }
 
-   dst->sendQueueLen -= len;
-   ASSERT(dst->sendQueueLen >= 0);
+   ConnSendDone(dst, len);
+}
 
-   if (dst->sendQueueLen == 0 && dst->shutDown) {
-      g_info("Closing %s connection %d as sendbuffer is now empty.\n",
-             GetConnName(dst), AsyncSocket_GetFd(dst->asock));
-      CloseConn(dst);
-      return;
-   }
 
-   g_debug("%d bytes sent to %s connection %d, sendQueueLen = %d\n",
-           len, GetConnName(dst), AsyncSocket_GetFd(dst->asock),
-           dst->sendQueueLen);
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ConnHeaderSendDoneCb --
+ *
+ *      Callback function when the dataMap fields in front of a relay
+ *      buffer's data are sent over a connection. The buffer is given back
+ *      once its data is sent, which always comes later.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-   if ((!(dst->shutDown)) && src->recvStopped &&
-       (dst->sendQueueLen < proxyData.maxSendQueueLen)) {
-      g_debug("Restart reading from connection %d.\n",
-              AsyncSocket_GetFd(src->asock));
+static void
+ConnHeaderSendDoneCb(void *buf,            // IN
+                     int len,              // IN
+                     AsyncSocket *asock,   // IN
+                     void *clientData)     // IN
+{
+   g_debug("Entering %s\n", __FUNCTION__);
 
-      src->recvStopped = FALSE;
-      if (src->isRmqClient) {
-         StartRecvFromRmqClient(src);
-      } else {
-         StartRecvFromVmx(src);
-      }
+   if (AsyncSocket_GetState(asock) != AsyncSocketConnected) {
+      return;
    }
+
+   ConnSendDone((ConnInfo *)clientData, len);
 }
 
 
@@ -557,7 +781,9 @@ StopRecvFromConn(ConnInfo *conn)   // IN
  *
  * SendToConn --
  *
- *      Call AsyncSocket_Send to queue the buffer for send.
+ *      Call AsyncSocket_Send to queue a relay buffer for send, its header
+ *      first if it has one. Both go out in one vectored write on a socket
+ *      without SSL.
  *      - If there is too much data queued, then recv from
  *        source connection is temporarily stopped.
  *
@@ -565,40 +791,54 @@ StopRecvFromConn(ConnInfo *conn)   // IN
  *      TRUE on success, FALSE otherwise.
  *
  * Side-effects:
- *      None
+ *      The relay buffer is given back once sent, or right away on error.
  *
  *-----------------------------------------------------------------------------
  */
 
 static gboolean
 SendToConn(ConnInfo *dst,          // IN/OUT
-           char *buf,              // IN
+           RelayBuf *buf,          // IN
            int len)                // IN
 {
    ConnInfo *src = dst->toConn;
-   int res;
+   int res = ASOCKERR_SUCCESS;
 
    g_debug("Entering %s\n", __FUNCTION__);
 
-   res = AsyncSocket_Send(dst->asock, buf, len, dst->sendCb, dst);
+   if (buf->headerLen > 0) {
+      res = AsyncSocket_Send(dst->asock, buf->header, buf->headerLen,
+                             ConnHeaderSendDoneCb, dst);
+      if (res == ASOCKERR_SUCCESS) {
+         dst->sendQueueLen += buf->headerLen;
+      }
+   }
+   if (res == ASOCKERR_SUCCESS) {
+      res = AsyncSocket_Send(dst->asock, buf->data, len, dst->sendCb, dst);
+   }
 
    if (res != ASOCKERR_SUCCESS) {
       g_info("Error in AsyncSocket_Send for socket %d, "
              "closing connection: %s\n",
              AsyncSocket_GetFd(dst->asock), AsyncSocket_Err2String(res));
-      free(buf);     /* need to free here */
+      PutRelayBuf(buf);     /* need to give back here */
       CloseConn(dst);
       return FALSE;
    }
 
-   g_debug("Sending %d bytes to socket %d\n", len,
+   g_debug("Sending %d bytes to socket %d\n", buf->headerLen + len,
            AsyncSocket_GetFd(dst->asock));
 
    dst->sendQueueLen += len;
+   if (dst->sendQueueLen > dst->peakSendQueueLen) {
+      dst->peakSendQueueLen = dst->sendQueueLen;
+   }
    g_debug("Socket %d sendQueueLen = %d\n",
            AsyncSocket_GetFd(dst->asock), dst->sendQueueLen);
 
-   if ((!src->recvStopped) && (dst->sendQueueLen > proxyData.maxSendQueueLen)) {
+   if ((!src->recvStopped) &&
+       (dst->sendQueueLen > proxyData.sendQueueHighWatermark)) {
+      dst->recvStopCount++;
       StopRecvFromConn(src);
       return FALSE;
    }
@@ -662,12 +902,13 @@ SendVmxConnectRequest(void)
 /*
  *-----------------------------------------------------------------------------
  *
- * SendToVmxRmqProxy --
+ * GetDataHeaderMap --
  *
- *      Package RabbitMQ Client data and send it to VMX RabbitMQ Proxy.
+ *      Get the dataMap fields sent with every RabbitMQ client payload,
+ *      building them on first use.
  *
  * Result:
- *      TRUE on sucess, FALSE on error
+ *      The map, or NULL on error.
  *
  * Side-effects:
  *      None
@@ -675,66 +916,97 @@ SendVmxConnectRequest(void)
  *-----------------------------------------------------------------------------
  */
 
-static gboolean
-SendToVmxRmqProxy(ConnInfo *cli,     // IN
-                  char *buf,         // IN
-                  int len)           // IN
+static DataMap *
+GetDataHeaderMap(ErrorCode *res)   // OUT
 {
-   DataMap map;
-   ErrorCode res;
-   char *newBuf;
-   char *serBuf;
-   int bufLen;
-   gboolean mapCreated = FALSE;
+   DataMap *map = &proxyData.dataHeaderMap;
    char *ver;
 
-   res = DataMap_Create(&map);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
+   if (proxyData.dataHeaderMapReady) {
+      return map;
    }
 
-   mapCreated = TRUE;
+   *res = DataMap_Create(map);
+   if (*res != DMERR_SUCCESS) {
+      return NULL;
+   }
 
-   res = DataMap_SetInt64(&map, RMQPROXYDM_FLD_COMMAND,
-                          COMMAND_DATA, TRUE);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
+   *res = DataMap_SetInt64(map, RMQPROXYDM_FLD_COMMAND,
+                           COMMAND_DATA, TRUE);
+   if (*res != DMERR_SUCCESS) {
+      goto error;
    }
 
    ver = strdup(GUEST_RABBITMQ_PROXY_VERSION);
    if (ver == NULL) {
-      res = DMERR_INSUFFICIENT_MEM;
-      goto quit;
+      *res = DMERR_INSUFFICIENT_MEM;
+      goto error;
    }
-   res = DataMap_SetString(&map, RMQPROXYDM_FLD_GUEST_VER_ID, ver, -1, TRUE);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
+   *res = DataMap_SetString(map, RMQPROXYDM_FLD_GUEST_VER_ID, ver, -1, TRUE);
+   if (*res != DMERR_SUCCESS) {
+      goto error;
    }
 
-   newBuf = malloc(len);
-   if (newBuf == NULL) {
-      g_warning("Error in allocating memory.\n");
+   DynBuf_Init(&proxyData.dataHeaderBuf);
+   proxyData.dataHeaderMapReady = TRUE;
+   return map;
+
+error:
+   DataMap_Destroy(map);
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SendToVmxRmqProxy --
+ *
+ *      Package RabbitMQ Client data and send it to VMX RabbitMQ Proxy.
+ *      The dataMap fields are written into the relay buffer's header, and
+ *      the data is sent from where it was received.
+ *
+ * Result:
+ *      TRUE on sucess, FALSE on error
+ *
+ * Side-effects:
+ *      The relay buffer is given back.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+SendToVmxRmqProxy(ConnInfo *cli,     // IN
+                  RelayBuf *buf,     // IN
+                  int len)           // IN
+{
+   DataMap *map;
+   DynBuf *headerBuf = &proxyData.dataHeaderBuf;
+   ErrorCode res = DMERR_SUCCESS;
+
+   map = GetDataHeaderMap(&res);
+   if (map == NULL) {
       goto quit;
    }
-   memcpy(newBuf, buf, len);
-   res = DataMap_SetString(&map, RMQPROXYDM_FLD_PAYLOAD, newBuf,
-                           len, TRUE);
+
+   DynBuf_Recycle(headerBuf, RELAY_BUF_HEADER_SIZE);
+   res = DataMap_SerializeHeaderToDynBuf(map, RMQPROXYDM_FLD_PAYLOAD, len,
+                                         headerBuf);
    if (res != DMERR_SUCCESS) {
       goto quit;
    }
-
-   res = DataMap_Serialize(&map, &serBuf, &bufLen);
-   if (res != DMERR_SUCCESS) {
+   if (DynBuf_GetSize(headerBuf) > sizeof buf->header) {
+      res = DMERR_BUFFER_TOO_SMALL;
       goto quit;
    }
 
-   DataMap_Destroy(&map);
-   return SendToConn(cli->toConn, serBuf, bufLen);
+   buf->headerLen = DynBuf_GetSize(headerBuf);
+   memcpy(buf->header, DynBuf_Get(headerBuf), buf->headerLen);
+
+   return SendToConn(cli->toConn, buf, len);
 
 quit:
-   if (mapCreated) {
-      DataMap_Destroy(&map);
-   }
+   PutRelayBuf(buf);
    g_info("Error in dataMap encoding for socket %d, error=%d, "
           "closing connection.\n",
           AsyncSocket_GetFd(cli->asock), res);
@@ -766,13 +1038,17 @@ RmqClientConnRecvedCb(void *buf,            // IN
                       void *clientData)     // IN
 {
    ConnInfo *conn = (ConnInfo *)clientData;
+   RelayBuf *relayBuf = conn->recvBuf;
 
    g_debug("Entering %s\n", __FUNCTION__);
 
    g_debug("Recved %d bytes from client connection %d\n", len,
            AsyncSocket_GetFd(conn->asock));
-   ASSERT(buf == conn->recvBuf);
-   if (SendToVmxRmqProxy(conn, conn->recvBuf, len)) {
+   ASSERT(relayBuf != NULL && buf == relayBuf->data);
+
+   /* the buffer goes with the send; the next recv takes another one */
+   conn->recvBuf = NULL;
+   if (SendToVmxRmqProxy(conn, relayBuf, len)) {
       StartRecvFromRmqClient(conn);
    }
 }
@@ -807,17 +1083,19 @@ ProcessVmxDataPacket(ConnInfo *cli,     // IN
    switch (cmdType) {
       case COMMAND_DATA:
          {
-            char *buf;
+            RelayBuf *buf;
             int payloadLen;
             char *payload;
 
             res = DataMap_GetString(map, RMQPROXYDM_FLD_PAYLOAD,
                                     &payload, &payloadLen);
             ASSERT(res == DMERR_SUCCESS && payloadLen > 0);
-            buf = malloc(payloadLen); /* get rid of this ? */
+
+            /* the packet buffer is reused once this returns */
+            buf = GetRelayBuf(cli->toConn, payloadLen);
 
             if (buf) {
-               memcpy(buf, payload, payloadLen);
+               memcpy(buf->data, payload, payloadLen);
                return SendToConn(cli, buf, payloadLen);
             } else {
                g_warning("Could not allocate buffer for socket %d, "
@@ -848,47 +1126,6 @@ ProcessVmxDataPacket(ConnInfo *cli,     // IN
 }
 
 
-/*
- *-----------------------------------------------------------------------------
- *
- * ProcessPacketHeaderLen --
- *
- *      Helper function to handle once a dataMap packet length is known.
- *
- * Results:
- *      None
- *
- * Side effects:
- *      None
- *
- *-----------------------------------------------------------------------------
- */
-
-static void
-ProcessPacketHeaderLen(ConnInfo *conn,   // IN
-                       int len)          // IN
-{
-   int pktLen = ntohl(conn->packetLen);
-
-   g_debug("Entering %s\n", __FUNCTION__);
-
-   if (conn->recvBuf == NULL || conn->recvBufLen < pktLen + len) {
-      conn->recvBufLen = pktLen + len;
-      free(conn->recvBuf);
-      conn->recvBuf = malloc(pktLen + len);
-      if (conn->recvBuf == NULL) {
-         g_info("Could not allocate recv buffer for socket %d, "
-                "closing connection.\n", AsyncSocket_GetFd(conn->asock));
-         CloseConn(conn);
-         return;
-      }
-   }
-
-   *((int32 *)(conn->recvBuf)) = conn->packetLen;
-   RecvPacketFromVmxConn(conn, pktLen);
-}
-
-
 /*
  *-----------------------------------------------------------------------------
  *
@@ -906,34 +1143,41 @@ ProcessPacketHeaderLen(ConnInfo *conn,   // IN
  */
 
 static void
-VmxConnRecvedCb(void *buf,            // IN
+VmxConnRecvedCb(void *buf,            // IN: packet, including header
                 int len,              // IN
                 AsyncSocket *asock,   // IN
                 void *clientData)     // IN
 {
    ConnInfo *conn = (ConnInfo *)clientData;
+   DataMap map;
+   ErrorCode res;
 
    g_debug("Entering %s\n", __FUNCTION__);
 
-   if (buf == &conn->packetLen) {
-      ASSERT(len == sizeof conn->packetLen);
-      ProcessPacketHeaderLen(conn, len);
-   } else {
-      DataMap map;
-      ErrorCode res;
-      int packetLen = len + sizeof conn->packetLen;
+   /* decoding the packet */
+   res = DataMap_DeserializeNoCopy(buf, len, &map);
+   ASSERT(res == DMERR_SUCCESS);
 
-      /* decoding the packet */
-      res = DataMap_Deserialize(conn->recvBuf, packetLen, &map);
-      ASSERT(res == DMERR_SUCCESS);
+   if (conn->toConn == NULL) {
+      int64 cmdType;
 
-      if (ProcessVmxDataPacket(conn->toConn, &map)) {
-         StartRecvFromVmx(conn); /* continue to recv next packet */
+      /* a spare has nothing to relay to, and only expects a connect */
+      if (DataMap_GetInt64(&map, RMQPROXYDM_FLD_COMMAND,
+                           &cmdType) != DMERR_SUCCESS ||
+          cmdType != COMMAND_CONNECT) {
+         g_info("Closing spare vmx connection %d on unexpected packet.\n",
+                AsyncSocket_GetFd(conn->asock));
+         CloseConn(conn);
       }
-
-      DataMap_Destroy(&map);
+   } else {
+      /*
+       * The packet recv stays registered; on failure the connection has
+       * either been closed or had its recv stopped for flow control.
+       */
+      ProcessVmxDataPacket(conn->toConn, &map);
    }
 
+   DataMap_Destroy(&map);
 }
 
 
@@ -969,6 +1213,75 @@ ConnErrorHandlerCb(int err,             // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ParkSpareVmxConn --
+ *
+ *      Keep a vmx connection that no RabbitMQ client connection is waiting
+ *      for as a spare, if the pool has room. Its recv is started so the
+ *      connection closing is noticed while it waits.
+ *
+ * Result:
+ *      TRUE if the connection was taken, FALSE if the pool is full.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+ParkSpareVmxConn(ConnInfo *conn)    // IN
+{
+   if (g_list_length(proxyData.spareVmxConnList) >=
+       proxyData.vmxConnPoolSize) {
+      return FALSE;
+   }
+
+   if (proxyData.spareVmxConnPending > 0) {
+      proxyData.spareVmxConnPending--;
+   }
+
+   g_debug("Keeping vmx connection %d as a spare.\n",
+           AsyncSocket_GetFd(conn->asock));
+   proxyData.spareVmxConnList = g_list_append(proxyData.spareVmxConnList,
+                                              conn);
+   StartRecvFromVmx(conn);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TopUpVmxConnPool --
+ *
+ *      Ask VMX for enough connections to refill the spare pool, counting
+ *      those already asked for.
+ *
+ * Result:
+ *      None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TopUpVmxConnPool(void)
+{
+   while (g_list_length(proxyData.spareVmxConnList) +
+          proxyData.spareVmxConnPending < proxyData.vmxConnPoolSize) {
+      if (!SendVmxConnectRequest()) {
+         break;
+      }
+      proxyData.spareVmxConnPending++;
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1028,6 +1341,9 @@ VmxListenSockConnectedCb(AsyncSocket *asock,    // IN
    }
 
    if (!AssignVmxConn(conn)) {
+      if (ParkSpareVmxConn(conn)) {
+         return;
+      }
       g_warning("Could not find RabbitMQ client connection for vmx connection, "
                 "closing connection ...\n");
       goto exit;
@@ -1081,12 +1397,6 @@ RmqClientSockHandShakeCb(Bool status,           // IN
 
    g_info("Established new RabbitMQ client connection %d.\n", fd);
 
-   if (!SendVmxConnectRequest()) {
-      g_warning("Closing RabbitMQ client connection %d due to error in "
-                "sending connection request!\n", fd);
-      goto exit;
-   }
-
    /* add to the client connection list */
    conn = calloc(1, sizeof *conn);
    if (conn == NULL) {
@@ -1111,6 +1421,25 @@ RmqClientSockHandShakeCb(Bool status,           // IN
 
    /* we start recv only after the vmx connection is established,
       so we do not need to buffer no-destination content */
+   if (proxyData.spareVmxConnList != NULL) {
+      ConnInfo *vmx = (ConnInfo *)(proxyData.spareVmxConnList->data);
+
+      proxyData.spareVmxConnList =
+         g_list_delete_link(proxyData.spareVmxConnList,
+                            proxyData.spareVmxConnList);
+      g_debug("Using spare vmx connection %d for client connection %d.\n",
+              AsyncSocket_GetFd(vmx->asock), fd);
+      conn->toConn = vmx;
+      vmx->toConn = conn;
+      StartRecvFromRmqClient(conn);
+   } else if (!SendVmxConnectRequest()) {
+      g_warning("Closing RabbitMQ client connection %d due to error in "
+                "sending connection request!\n", fd);
+      CloseConn(conn);
+      return;
+   }
+
+   TopUpVmxConnPool();
    return;
 
 exit:
@@ -1556,8 +1885,28 @@ InitProxyData(ToolsAppCtx *ctx)   // IN
 
    proxyData.ctx = ctx;
    proxyData.messageTunnellingEnabled = FALSE;
-   proxyData.maxSendQueueLen = GetConfigInt("maxSendQueueLen",
-                                            DEFAULT_MAX_SEND_QUEUE_LEN);
+   /* maxSendQueueLen is the older name of the high watermark */
+   proxyData.sendQueueHighWatermark =
+      GetConfigInt("sendQueueHighWatermark",
+                   GetConfigInt("maxSendQueueLen",
+                                DEFAULT_MAX_SEND_QUEUE_LEN));
+   proxyData.sendQueueLowWatermark =
+      GetConfigInt("sendQueueLowWatermark",
+                   MIN(DEFAULT_SEND_QUEUE_LOW_WATERMARK,
+                       proxyData.sendQueueHighWatermark / 2));
+   /*
+    * Spare vmx connections save new RabbitMQ clients the connect request
+    * round trip through VMX. Off by default.
+    */
+   proxyData.vmxConnPoolSize = MAX(GetConfigInt("vmxConnPoolSize", 0), 0);
+
+   if (proxyData.sendQueueLowWatermark < 0 ||
+       proxyData.sendQueueLowWatermark > proxyData.sendQueueHighWatermark) {
+      g_warning("Invalid sendQueueLowWatermark %d, using %d.\n",
+                proxyData.sendQueueLowWatermark,
+                proxyData.sendQueueHighWatermark / 2);
+      proxyData.sendQueueLowWatermark = proxyData.sendQueueHighWatermark / 2;
+   }
 }
 
 
@@ -1745,6 +2094,12 @@ GRabbitmqProxyDisableMessageTunnelling()
       CloseConn(cli);
    }
 
+   while (proxyData.spareVmxConnList != NULL) {
+      ConnInfo *vmx = (ConnInfo *)(proxyData.spareVmxConnList->data);
+      CloseConn(vmx);
+   }
+   proxyData.spareVmxConnPending = 0;
+
    proxyData.messageTunnellingEnabled = FALSE;
 }
 
@@ -1799,6 +2154,7 @@ GRabbitmqProxyEnableMessageTunnelling()
    }
 
    proxyData.messageTunnellingEnabled = TRUE;
+   TopUpVmxConnPool();
 }
 
 
@@ -1828,6 +2184,12 @@ GRabbitmqProxyShutdown(gpointer src,                 // IN
    if (proxyData.messageTunnellingEnabled) {
       GRabbitmqProxyDisableMessageTunnelling();
    }
+
+   if (proxyData.dataHeaderMapReady) {
+      DataMap_Destroy(&proxyData.dataHeaderMap);
+      DynBuf_Destroy(&proxyData.dataHeaderBuf);
+      proxyData.dataHeaderMapReady = FALSE;
+   }
 }
 
 
@@ -1944,7 +2306,12 @@ ToolsOnLoad(ToolsAppCtx *ctx)           // IN
    };
 
    InitProxyData(ctx);
+   /* Must match the Poll implementation picked by RpcIn_Construct(). */
+#if defined(__linux__)
+   Poll_InitEpoll();
+#else
    Poll_InitGtk();
+#endif
    SSL_Init(GRabbitmqProxyGetSSLLibPath, NULL, NULL);
 
    if (!TOOLS_IS_MAIN_SERVICE(ctx) && !TOOLS_IS_USER_SERVICE(ctx)) {
@@ -22,10 +22,306 @@
  * Contains POSIX-specific bits of gettting disk information.
  */
 
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/poll.h>
+#include <string.h>
+#include <unistd.h>
+#endif
+
 #include "util.h"
 #include "vmware.h"
 #include "guestInfoInt.h"
 
+#if defined(__linux__)
+#include "hostinfo.h"
+#include "posix.h"
+#include "str.h"
+#include "wiper.h"
+
+#define MOUNTINFO_FILE "/proc/self/mountinfo"
+
+/*
+ * A mount whose statfs() takes longer than this (in microseconds) is
+ * considered slow (e.g., a busy network file system): its free space is then
+ * only refreshed every DISKINFO_SLOW_INTERVAL, and the last figures are
+ * reported in between.
+ */
+#define DISKINFO_SLOW_STATFS     (500 * 1000)
+#define DISKINFO_SLOW_INTERVAL   (300 * 1000 * 1000LL)
+
+typedef struct DiskInfoMount {
+   WiperPartition *part;
+   uint64          freeBytes;
+   uint64          totalBytes;
+   VmTimeType      nextRefresh;  // 0 to refresh on every pass
+} DiskInfoMount;
+
+/*
+ * The supported partitions, as last enumerated by the wiper library. The list
+ * is only enumerated again when /proc/self/mountinfo reports a change to the
+ * mount table. Only the disk info collector uses it, and never runs twice
+ * concurrently.
+ */
+static struct {
+   int                  mountInfoFd;
+   Bool                 valid;
+   WiperPartition_List *pl;
+   GArray              *mounts;
+} gDiskInfoCache = { -1, FALSE, NULL, NULL };
+
+
+/*
+ ******************************************************************************
+ * DiskInfoMountsChanged --                                              */ /**
+ *
+ * Checks whether the mount table changed since the last check. The kernel
+ * flags an open mountinfo file with POLLPRI | POLLERR when that happens.
+ *
+ * @return TRUE if the mounts (may) have changed.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+DiskInfoMountsChanged(void)
+{
+   struct pollfd pfd;
+   int ret;
+
+   if (gDiskInfoCache.mountInfoFd < 0) {
+      gDiskInfoCache.mountInfoFd = Posix_Open(MOUNTINFO_FILE,
+                                              O_RDONLY | O_CLOEXEC);
+      if (gDiskInfoCache.mountInfoFd < 0) {
+         g_debug("%s: can't open %s: %s\n", __FUNCTION__, MOUNTINFO_FILE,
+                 strerror(errno));
+      }
+
+      /* Either way, changes made before now went unnoticed. */
+      return TRUE;
+   }
+
+   pfd.fd = gDiskInfoCache.mountInfoFd;
+   pfd.events = POLLPRI;
+   pfd.revents = 0;
+
+   do {
+      ret = poll(&pfd, 1, 0);
+   } while (ret < 0 && errno == EINTR);
+
+   if (ret < 0) {
+      close(gDiskInfoCache.mountInfoFd);
+      gDiskInfoCache.mountInfoFd = -1;
+      return TRUE;
+   }
+
+   return ret > 0 && (pfd.revents & (POLLPRI | POLLERR)) != 0;
+}
+
+
+/*
+ ******************************************************************************
+ * DiskInfoFreeMounts --                                                 */ /**
+ *
+ * Forgets the enumerated partitions.
+ *
+ ******************************************************************************
+ */
+
+static void
+DiskInfoFreeMounts(void)
+{
+   if (gDiskInfoCache.mounts != NULL) {
+      g_array_free(gDiskInfoCache.mounts, TRUE);
+      gDiskInfoCache.mounts = NULL;
+      WiperPartition_Close(gDiskInfoCache.pl);
+      g_free(gDiskInfoCache.pl);
+      gDiskInfoCache.pl = NULL;
+   }
+   gDiskInfoCache.valid = FALSE;
+}
+
+
+/*
+ ******************************************************************************
+ * DiskInfoLoadMounts --                                                 */ /**
+ *
+ * Enumerates the supported partitions with the wiper library. Free space
+ * figures (and the slowness) of mounts that are still there are kept.
+ *
+ * @return TRUE on success.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+DiskInfoLoadMounts(void)
+{
+   GArray *old = gDiskInfoCache.mounts;
+   WiperPartition_List *pl = g_new(WiperPartition_List, 1);
+   GArray *mounts;
+   DblLnkLst_Links *curr;
+   Bool success = TRUE;
+
+   if (!WiperPartition_Open(pl)) {
+      g_warning("GetDiskInfo: ERROR: could not get partition list\n");
+      g_free(pl);
+      DiskInfoFreeMounts();
+      return FALSE;
+   }
+
+   mounts = g_array_new(FALSE, TRUE, sizeof (DiskInfoMount));
+
+   DblLnkLst_ForEach(curr, &pl->link) {
+      WiperPartition *part = DblLnkLst_Container(curr, WiperPartition, link);
+      DiskInfoMount mount;
+      guint i;
+
+      if (part->type == PARTITION_UNSUPPORTED) {
+         continue;
+      }
+
+      if (strlen(part->mountPoint) + 1 >
+          sizeof ((PartitionEntry *) NULL)->name) {
+         g_warning("GetDiskInfo: ERROR: Partition name buffer too small\n");
+         success = FALSE;
+         break;
+      }
+
+      memset(&mount, 0, sizeof mount);
+      mount.part = part;
+
+      for (i = 0; old != NULL && i < old->len; i++) {
+         DiskInfoMount *prev = &g_array_index(old, DiskInfoMount, i);
+
+         if (strcmp(prev->part->mountPoint, part->mountPoint) == 0) {
+            mount.freeBytes = prev->freeBytes;
+            mount.totalBytes = prev->totalBytes;
+            mount.nextRefresh = prev->nextRefresh;
+            break;
+         }
+      }
+
+      g_array_append_val(mounts, mount);
+   }
+
+   /* The figures were copied over; the old list can go. */
+   DiskInfoFreeMounts();
+
+   gDiskInfoCache.pl = pl;
+   gDiskInfoCache.mounts = mounts;
+   if (!success) {
+      DiskInfoFreeMounts();
+      return FALSE;
+   }
+
+   g_debug("%s: %u partitions.\n", __FUNCTION__, mounts->len);
+   gDiskInfoCache.valid = TRUE;
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_GetDiskInfo --                                              */ /**
+ *
+ * Reports the utilization of the fixed volumes. The volumes are enumerated
+ * with the wiper library when the mount table changes; otherwise only their
+ * free space is looked up.
+ *
+ * @return Pointer to a GuestDiskInfo structure on success or NULL on failure.
+ *         Caller should free returned pointer with GuestInfoFreeDiskInfo.
+ *
+ ******************************************************************************
+ */
+
+GuestDiskInfo *
+GuestInfo_GetDiskInfo(void)
+{
+   GuestDiskInfo *di;
+   VmTimeType now;
+   guint i;
+   Bool changed = DiskInfoMountsChanged();
+
+   if ((changed || !gDiskInfoCache.valid) && !DiskInfoLoadMounts()) {
+      return NULL;
+   }
+
+   di = Util_SafeCalloc(1, sizeof *di);
+   if (gDiskInfoCache.mounts->len > 0) {
+      di->partitionList = Util_SafeCalloc(gDiskInfoCache.mounts->len,
+                                          sizeof *di->partitionList);
+   }
+
+   now = Hostinfo_SystemTimerUS();
+
+   for (i = 0; i < gDiskInfoCache.mounts->len; i++) {
+      DiskInfoMount *mount = &g_array_index(gDiskInfoCache.mounts,
+                                            DiskInfoMount, i);
+      PPartitionEntry partEntry = &di->partitionList[i];
+
+      if (now >= mount->nextRefresh) {
+         VmTimeType start = Hostinfo_SystemTimerUS();
+         VmTimeType elapsed;
+         unsigned char *error;
+
+         error = WiperSinglePartition_GetSpace(mount->part, &mount->freeBytes,
+                                               &mount->totalBytes);
+         if (strlen(error)) {
+            g_warning("GetDiskInfo: ERROR: could not get space for partition %s: %s\n",
+                      mount->part->mountPoint, error);
+
+            /* Most likely unmounted meanwhile; enumerate again next time. */
+            gDiskInfoCache.valid = FALSE;
+            GuestInfo_FreeDiskInfo(di);
+            return NULL;
+         }
+
+         elapsed = Hostinfo_SystemTimerUS() - start;
+         if (elapsed > DISKINFO_SLOW_STATFS) {
+            g_debug("%s: statfs(%s) took %"FMT64"dus, refreshing it every "
+                    "%"FMT64"ds.\n", __FUNCTION__, mount->part->mountPoint,
+                    elapsed, DISKINFO_SLOW_INTERVAL / (1000 * 1000));
+            mount->nextRefresh = now + elapsed + DISKINFO_SLOW_INTERVAL;
+         } else {
+            mount->nextRefresh = 0;
+         }
+      }
+
+      Str_Strcpy(partEntry->name, mount->part->mountPoint,
+                 sizeof partEntry->name);
+      partEntry->freeBytes = mount->freeBytes;
+      partEntry->totalBytes = mount->totalBytes;
+   }
+
+   di->numEntries = gDiskInfoCache.mounts->len;
+   return di;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_DiskInfoShutdown --                                         */ /**
+ *
+ * Frees the cached partition list. Must not be called while the disk info is
+ * being collected.
+ *
+ ******************************************************************************
+ */
+
+void
+GuestInfo_DiskInfoShutdown(void)
+{
+   DiskInfoFreeMounts();
+   if (gDiskInfoCache.mountInfoFd >= 0) {
+      close(gDiskInfoCache.mountInfoFd);
+      gDiskInfoCache.mountInfoFd = -1;
+   }
+}
+
+#else
+
 
 /*
  ******************************************************************************
@@ -44,3 +340,5 @@ GuestInfo_GetDiskInfo(void)
 {
    return GuestInfoGetDiskInfoWiper();
 }
+
+#endif
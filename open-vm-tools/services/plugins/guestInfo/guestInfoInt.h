@@ -31,6 +31,7 @@
 
 #include "nicInfo.h"
 #include "dynbuf.h"
+#include "guestrpc/guesthfstats.h"
 
 /*
  * Internal stat IDs used by intermediate stats collected
@@ -60,6 +61,9 @@ GuestInfo_ServerReportStats(ToolsAppCtx *ctx,  // IN
 gboolean
 GuestInfo_StatProviderPoll(gpointer data);
 
+void
+GuestInfo_StatProviderShutdown(void);
+
 GuestDiskInfo *
 GuestInfoGetDiskInfoWiper(void);
 
@@ -69,5 +73,37 @@ GuestInfo_GetDiskInfo(void);
 void
 GuestInfo_FreeDiskInfo(GuestDiskInfo *di);
 
+#if defined(__linux__) && !defined(USERWORLD)
+/** Called on the main loop when links, addresses or routes changed. */
+typedef void (*GuestInfoNicMonitorCb)(ToolsAppCtx *ctx);
+
+gboolean
+GuestInfo_StartNicMonitor(ToolsAppCtx *ctx,
+                          GuestInfoNicMonitorCb callback);
+
+void
+GuestInfo_StopNicMonitor(void);
+
+gboolean
+GuestInfo_IsNicMonitorActive(void);
+
+Bool
+GuestInfo_ServerReportHfStats(ToolsAppCtx *ctx,     // IN
+                              GuestHfStats *stats); // IN
+
+void
+GuestInfo_HfStatsConfigure(ToolsAppCtx *ctx,
+                           gboolean enable);
+
+Bool
+GuestInfo_HfStatsFlush(void);
+
+void
+GuestInfo_StatProviderSetCompact(Bool enable);
+
+void
+GuestInfo_DiskInfoShutdown(void);
+#endif
+
 #endif /* _GUESTINFOINT_H_ */
 
@@ -45,6 +45,7 @@
 #include "hostinfo.h"
 #include "guestInfoInt.h"
 #include "guest_msg_def.h" // For GUESTMSG_MAX_IN_SIZE
+#include "guestrpc/guestinfobatch.h"
 #include "netutil.h"
 #include "rpcvmx.h"
 #include "procMgr.h"
@@ -56,7 +57,9 @@
 #include "vmsupport.h"
 #include "vmware/guestrpc/tclodefs.h"
 #include "vmware/tools/log.h"
+#include "vmware/tools/memBudget.h"
 #include "vmware/tools/plugin.h"
+#include "vmware/tools/threadPool.h"
 #include "vmware/tools/utils.h"
 #include "vmware/tools/vmbackup.h"
 
@@ -85,6 +88,21 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
 
 #define GUESTINFO_DEFAULT_DELIMITER ' '
 
+/**
+ * When the nic monitor reports network changes as they happen, the gather
+ * loop only rescans the NICs this often (in seconds), in case an event was
+ * missed.
+ */
+#define GUESTINFO_NIC_RESCAN_INTERVAL 300
+
+/**
+ * How long (in seconds) the gather loop waits for the disk and nic info
+ * collectors before sending what it has. A late collector's result is sent
+ * on its own when it arrives.
+ */
+#define GUESTINFO_DISK_DEADLINE 10
+#define GUESTINFO_NIC_DEADLINE  5
+
 /*
  * Define what guest info types and nic info versions could be sent
  * to update nic info at VMX. The order defines a sequence of fallback
@@ -99,6 +117,21 @@ typedef enum NicInfoMethod {
    NIC_INFO_METHOD_MAX
 } NicInfoMethod;
 
+/*
+ * Number of NIC_INFO_V3_DELTA deltas sent between two full snapshots, so
+ * that a VMX that lost track of the nic info state recovers eventually.
+ */
+#define NIC_INFO_DELTA_SNAPSHOT_INTERVAL 20
+
+/*
+ * State of the delta encoded nic info updates.
+ */
+typedef struct NicInfoDeltaState {
+   Bool    unsupported;     /* VMX rejected a snapshot; send plain V3. */
+   uint32  sequence;        /* Sequence number of the last update sent. */
+   uint32  sinceSnapshot;   /* Deltas sent since the last snapshot. */
+} NicInfoDeltaState;
+
 /*
  * Stores information about all guest information sent to the vmx.
  */
@@ -109,6 +142,7 @@ typedef struct _GuestInfoCache {
    NicInfoV3     *nicInfo;
    GuestDiskInfo *diskInfo;
    NicInfoMethod  method;
+   NicInfoDeltaState delta;
 } GuestInfoCache;
 
 
@@ -147,6 +181,58 @@ static GSource *gatherStatsTimeoutSource = NULL;
 /* Local cache of the guest information that was last sent to vmx. */
 static GuestInfoCache gInfoCache;
 
+/* The time when the nic info was last gathered. */
+static time_t gNicInfoLastScan = 0;
+
+/* Registration of gInfoCache with the memory budget. */
+static guint gInfoCacheBudgetId = 0;
+
+/*
+ * Collectors that may block (statfs() on a hung NFS mount, parsing the
+ * resolver configuration, walking the interfaces and routes) run on the
+ * shared thread pool. Their results are published from the main loop.
+ */
+
+typedef struct GuestInfoCollector {
+   const char  *name;
+   guint        deadline;           /* Seconds. */
+   gpointer   (*collect)(void);     /* Worker thread. */
+   void       (*publish)(ToolsAppCtx *ctx, gpointer result);
+   Bool         busy;               /* Submitted, result not published yet. */
+   Bool         inPass;             /* The current gather pass waits for it. */
+   Bool         rerun;              /* Collect again once it's done. */
+   GSource     *deadlineSource;
+   ToolsAppCtx *ctx;
+   guint        missedDeadlines;
+} GuestInfoCollector;
+
+typedef struct GuestInfoCollectJob {
+   ToolsAppCtx        *ctx;
+   GuestInfoCollector *collector;
+   gpointer            result;
+} GuestInfoCollectJob;
+
+static gpointer GuestInfoCollectDiskInfo(void);
+static void GuestInfoPublishDiskInfo(ToolsAppCtx *ctx, gpointer result);
+static gpointer GuestInfoCollectNicInfo(void);
+static void GuestInfoPublishNicInfo(ToolsAppCtx *ctx, gpointer result);
+
+static GuestInfoCollector gDiskCollector = {
+   "disk", GUESTINFO_DISK_DEADLINE,
+   GuestInfoCollectDiskInfo, GuestInfoPublishDiskInfo,
+};
+
+static GuestInfoCollector gNicCollector = {
+   "nic", GUESTINFO_NIC_DEADLINE,
+   GuestInfoCollectNicInfo, GuestInfoPublishNicInfo,
+};
+
+/* Collectors the current gather pass is still waiting for. */
+static guint gPassPending = 0;
+
+/* Cleared at shutdown, so that late results are dropped. */
+static Bool gCollectorsActive = FALSE;
+
 /*
  * A boolean flag that specifies whether the state of the VM was
  * changed since the last time guest info was sent to the VMX.
@@ -155,6 +241,21 @@ static GuestInfoCache gInfoCache;
 
 static Bool vmResumed;
 
+/*
+ * Updates queued during a gather pass, to be sent to the VMX as a single
+ * INFO_BATCH message. NULL when updates are sent as soon as they're made.
+ */
+
+static GArray *gInfoBatch = NULL;
+static size_t gInfoBatchSize = 0;
+
+/*
+ * Set when the VMX rejected a batch; updates are then sent one at a time
+ * until the channel is reset (e.g., after a vMotion to a different host).
+ */
+
+static Bool gInfoBatchUnsupported = FALSE;
+
 
 /*
  * Local functions
@@ -168,9 +269,21 @@ static Bool GuestInfoUpdateVmdb(ToolsAppCtx *ctx,
 static Bool SetGuestInfo(ToolsAppCtx *ctx, GuestInfoType key,
                          const char *value);
 static void SendUptime(ToolsAppCtx *ctx);
+static void GuestInfoStartCollector(ToolsAppCtx *ctx,
+                                    GuestInfoCollector *collector,
+                                    Bool inPass);
+static void GuestInfoRefreshNicInfo(ToolsAppCtx *ctx);
+static Bool GuestInfoNicScanDue(void);
+static void GuestInfoBeginBatch(void);
+static Bool GuestInfoQueueUpdate(GuestInfoType type, const void *data,
+                                 size_t dataLen);
+static void GuestInfoFlushBatch(ToolsAppCtx *ctx);
 static Bool DiskInfoChanged(const GuestDiskInfo *diskInfo);
 static void GuestInfoClearCache(void);
 static GuestNicList *NicInfoV3ToV2(const NicInfoV3 *infoV3);
+static void NicInfoV3ToDelta(const NicInfoV3 *base, const NicInfoV3 *info,
+                             NicInfoV3Delta *delta);
+static void NicInfoFreeDelta(NicInfoV3Delta *delta);
 static void TweakGatherLoops(ToolsAppCtx *ctx, gboolean enable);
 
 
@@ -260,6 +373,33 @@ GuestInfoVMSupport(RpcInData *data)
 }
 
 
+#if defined(__linux__) && !defined(USERWORLD)
+/*
+ ******************************************************************************
+ * GuestInfoHfStatsFlushRpc --                                           */ /**
+ *
+ * Uploads the pending high frequency stats samples without waiting for the
+ * next stats poll.
+ *
+ * @param[in]   data     RPC request data.
+ *
+ * @return      TRUE if the samples were sent.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+GuestInfoHfStatsFlushRpc(RpcInData *data)
+{
+   if (!GuestInfo_HfStatsFlush()) {
+      return RPCIN_SETRETVALS(data, "Failed to send the samples", FALSE);
+   }
+
+   return RPCIN_SETRETVALS(data, "", TRUE);
+}
+#endif
+
+
 /*
  ******************************************************************************
  * GuestInfoCheckIfRunningSlow --                                        */ /**
@@ -333,16 +473,30 @@ GuestInfoGather(gpointer data)
    char *osString = NULL;
 #if !defined(USERWORLD)
    gboolean disableQueryDiskInfo;
-   GuestDiskInfo *diskInfo = NULL;
 #endif
-   NicInfoV3 *nicInfo = NULL;
    ToolsAppCtx *ctx = data;
 
    g_debug("Entered guest info gather.\n");
 
    GuestInfoCheckIfRunningSlow(ctx);
 
-   /* Send tools version. */
+   /*
+    * Collect everything that changed during this pass and send it in one go
+    * once the uptime has been updated and the collectors are done. A pass
+    * that's still waiting (only possible with a poll interval shorter than
+    * the collector deadlines) is sent with what it has.
+    */
+   if (gPassPending > 0) {
+      gPassPending = 0;
+      gDiskCollector.inPass = FALSE;
+      gNicCollector.inPass = FALSE;
+      GuestInfoFlushBatch(ctx);
+   }
+
+   /*
+    * Send tools version. This goes out on its own, ahead of the batch, so
+    * that its failure is seen here.
+    */
    if (!GuestInfoUpdateVmdb(ctx, INFO_BUILD_NUMBER, BUILD_NUMBER, 0)) {
       /*
        * An older vmx talking to new tools wont be able to handle
@@ -352,6 +506,8 @@ GuestInfoGather(gpointer data)
       g_warning("Failed to update VMDB with tools version.\n");
    }
 
+   GuestInfoBeginBatch();
+
    /* Gather all the relevant guest information. */
    osString = Hostinfo_GetOSName();
    if (osString == NULL) {
@@ -378,17 +534,7 @@ GuestInfoGather(gpointer data)
       g_key_file_get_boolean(ctx->config, CONFGROUPNAME_GUESTINFO,
                              CONFNAME_GUESTINFO_DISABLEQUERYDISKINFO, NULL);
    if (!disableQueryDiskInfo) {
-      if ((diskInfo = GuestInfo_GetDiskInfo()) == NULL) {
-         g_warning("Failed to get disk info.\n");
-      } else {
-         if (GuestInfoUpdateVmdb(ctx, INFO_DISK_FREE_SPACE, diskInfo, 0)) {
-            GuestInfo_FreeDiskInfo(gInfoCache.diskInfo);
-            gInfoCache.diskInfo = diskInfo;
-         } else {
-            g_warning("Failed to update VMDB\n.");
-            GuestInfo_FreeDiskInfo(diskInfo);
-         }
-      }
+      GuestInfoStartCollector(ctx, &gDiskCollector, TRUE);
    }
 #endif
 
@@ -399,6 +545,286 @@ GuestInfoGather(gpointer data)
    }
 
    /* Get NIC information. */
+   if (GuestInfoNicScanDue()) {
+      gNicInfoLastScan = time(NULL);
+      GuestInfoStartCollector(ctx, &gNicCollector, TRUE);
+   }
+
+   /* Send the uptime to VMX so that it can detect soft resets. */
+   SendUptime(ctx);
+
+   if (gPassPending == 0) {
+      GuestInfoFlushBatch(ctx);
+   }
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoCollectorLeavePass --                                        */ /**
+ *
+ * Called when a collector the current gather pass was waiting for finished
+ * or missed its deadline. Sends the pass' updates once nothing is left to
+ * wait for.
+ *
+ * @param[in]  ctx         The application context.
+ * @param[in]  collector   The collector.
+ *
+ ******************************************************************************
+ */
+
+static void
+GuestInfoCollectorLeavePass(ToolsAppCtx *ctx,
+                            GuestInfoCollector *collector)
+{
+   if (!collector->inPass) {
+      return;
+   }
+
+   collector->inPass = FALSE;
+   ASSERT(gPassPending > 0);
+   if (--gPassPending == 0) {
+      GuestInfoFlushBatch(ctx);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoCollectDone --                                               */ /**
+ *
+ * Main loop callback: publishes a collector's result.
+ *
+ * @param[in]  data     The GuestInfoCollectJob.
+ *
+ * @return FALSE.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+GuestInfoCollectDone(gpointer data)
+{
+   GuestInfoCollectJob *job = data;
+   GuestInfoCollector *collector = job->collector;
+   ToolsAppCtx *ctx = job->ctx;
+
+   if (!gCollectorsActive) {
+      /*
+       * Shutting down. Results aren't freed here since we don't know their
+       * type anymore; the process is about to exit anyway.
+       */
+      g_free(job);
+      return FALSE;
+   }
+
+   if (collector->deadlineSource != NULL) {
+      g_source_destroy(collector->deadlineSource);
+      g_source_unref(collector->deadlineSource);
+      collector->deadlineSource = NULL;
+   }
+
+   collector->busy = FALSE;
+   collector->publish(ctx, job->result);
+   g_free(job);
+
+   GuestInfoCollectorLeavePass(ctx, collector);
+
+   if (collector->rerun) {
+      collector->rerun = FALSE;
+      GuestInfoStartCollector(ctx, collector, FALSE);
+   }
+
+   return FALSE;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoCollectTask --                                               */ /**
+ *
+ * Thread pool task: runs a collector and hands the result back to the main
+ * loop.
+ *
+ * @param[in]  ctx      The application context.
+ * @param[in]  data     The GuestInfoCollectJob.
+ *
+ ******************************************************************************
+ */
+
+static void
+GuestInfoCollectTask(ToolsAppCtx *ctx,
+                     gpointer data)
+{
+   GuestInfoCollectJob *job = data;
+   GSource *src;
+
+   job->result = job->collector->collect();
+
+   src = g_idle_source_new();
+   VMTOOLSAPP_ATTACH_SOURCE(ctx, src, GuestInfoCollectDone, job, NULL);
+   g_source_unref(src);
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoCollectDeadline --                                           */ /**
+ *
+ * Timeout callback: a collector is taking too long. The gather pass stops
+ * waiting for it; its result is sent on its own whenever it arrives.
+ *
+ * @param[in]  data     The collector.
+ *
+ * @return FALSE.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+GuestInfoCollectDeadline(gpointer data)
+{
+   GuestInfoCollector *collector = data;
+
+   g_source_unref(collector->deadlineSource);
+   collector->deadlineSource = NULL;
+   collector->missedDeadlines++;
+
+   g_warning("The %s info collector didn't finish within %us "
+             "(%u time(s) so far), not waiting for it.\n", collector->name,
+             collector->deadline, collector->missedDeadlines);
+
+   GuestInfoCollectorLeavePass(collector->ctx, collector);
+   return FALSE;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoStartCollector --                                            */ /**
+ *
+ * Submits a collector to the thread pool, unless it's still running from an
+ * earlier request. If there's no thread pool, the collector runs right
+ * away.
+ *
+ * @param[in]  ctx         The application context.
+ * @param[in]  collector   The collector.
+ * @param[in]  inPass      Whether the current gather pass should wait for
+ *                         the result before sending its updates.
+ *
+ ******************************************************************************
+ */
+
+static void
+GuestInfoStartCollector(ToolsAppCtx *ctx,
+                        GuestInfoCollector *collector,
+                        Bool inPass)
+{
+   GuestInfoCollectJob *job;
+
+   if (collector->busy) {
+      /*
+       * Don't pile more threads onto a collector that's stuck. An explicit
+       * refresh request is remembered so that the change isn't missed.
+       */
+      g_debug("The %s info collector is still running.\n", collector->name);
+      if (!inPass) {
+         collector->rerun = TRUE;
+      }
+      return;
+   }
+
+   collector->busy = TRUE;
+   collector->ctx = ctx;
+   if (inPass) {
+      collector->inPass = TRUE;
+      gPassPending++;
+   }
+
+   collector->deadlineSource = g_timeout_source_new(collector->deadline * 1000);
+   VMTOOLSAPP_ATTACH_SOURCE(ctx, collector->deadlineSource,
+                            GuestInfoCollectDeadline, collector, NULL);
+
+   job = g_new0(GuestInfoCollectJob, 1);
+   job->ctx = ctx;
+   job->collector = collector;
+
+   if (ToolsCorePool_SubmitTask(ctx, GuestInfoCollectTask, job, NULL) == 0) {
+      GuestInfoCollectTask(ctx, job);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoCollectDiskInfo --                                           */ /**
+ *
+ * Disk info collector; runs on a worker thread.
+ *
+ * @return A GuestDiskInfo, or NULL on failure.
+ *
+ ******************************************************************************
+ */
+
+static gpointer
+GuestInfoCollectDiskInfo(void)
+{
+#if !defined(USERWORLD)
+   return GuestInfo_GetDiskInfo();
+#else
+   return NULL;
+#endif
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoPublishDiskInfo --                                           */ /**
+ *
+ * Sends the collected disk info to the VMX if it changed.
+ *
+ * @param[in]  ctx      The application context.
+ * @param[in]  result   The GuestDiskInfo; ownership is taken.
+ *
+ ******************************************************************************
+ */
+
+static void
+GuestInfoPublishDiskInfo(ToolsAppCtx *ctx,
+                         gpointer result)
+{
+   GuestDiskInfo *diskInfo = result;
+
+   if (diskInfo == NULL) {
+      g_warning("Failed to get disk info.\n");
+   } else if (GuestInfoUpdateVmdb(ctx, INFO_DISK_FREE_SPACE, diskInfo, 0)) {
+      GuestInfo_FreeDiskInfo(gInfoCache.diskInfo);
+      gInfoCache.diskInfo = diskInfo;
+   } else {
+      g_warning("Failed to update VMDB\n.");
+      GuestInfo_FreeDiskInfo(diskInfo);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoCollectNicInfo --                                            */ /**
+ *
+ * NIC info collector; runs on a worker thread.
+ *
+ * @return A NicInfoV3, empty if the NICs couldn't be enumerated.
+ *
+ ******************************************************************************
+ */
+
+static gpointer
+GuestInfoCollectNicInfo(void)
+{
+   NicInfoV3 *nicInfo = NULL;
+
    if (!GuestInfo_GetNicInfo(&nicInfo)) {
       g_warning("Failed to get nic info.\n");
       /*
@@ -407,6 +833,28 @@ GuestInfoGather(gpointer data)
       nicInfo = Util_SafeCalloc(1, sizeof (struct NicInfoV3));
    }
 
+   return nicInfo;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoPublishNicInfo --                                            */ /**
+ *
+ * Sends the collected NIC info to the VMX if it changed.
+ *
+ * @param[in]  ctx      The application context.
+ * @param[in]  result   The NicInfoV3; ownership is taken.
+ *
+ ******************************************************************************
+ */
+
+static void
+GuestInfoPublishNicInfo(ToolsAppCtx *ctx,
+                        gpointer result)
+{
+   NicInfoV3 *nicInfo = result;
+
    if (GuestInfo_IsEqual_NicInfoV3(nicInfo, gInfoCache.nicInfo)) {
       g_debug("Nic info not changed.\n");
       GuestInfo_FreeNicInfo(nicInfo);
@@ -421,9 +869,54 @@ GuestInfoGather(gpointer data)
       g_warning("Failed to update VMDB.\n");
       GuestInfo_FreeNicInfo(nicInfo);
    }
+}
 
-   /* Send the uptime to VMX so that it can detect soft resets. */
-   SendUptime(ctx);
+
+/*
+ ******************************************************************************
+ * GuestInfoRefreshNicInfo --                                            */ /**
+ *
+ * Collects and sends the NIC info outside of a gather pass; used when the
+ * nic monitor reports that the network configuration changed.
+ *
+ * @param[in]  ctx      The application context.
+ *
+ ******************************************************************************
+ */
+
+static void
+GuestInfoRefreshNicInfo(ToolsAppCtx *ctx)
+{
+   gNicInfoLastScan = time(NULL);
+   GuestInfoStartCollector(ctx, &gNicCollector, FALSE);
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoNicScanDue --                                                */ /**
+ *
+ * Checks whether the gather loop should rescan the NICs. Without the nic
+ * monitor that's every pass; with it, changes are picked up as they happen,
+ * so the gather loop only rescans every GUESTINFO_NIC_RESCAN_INTERVAL
+ * seconds, or when there is nothing cached (e.g., after a resume).
+ *
+ * @return TRUE if the NICs should be scanned now.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+GuestInfoNicScanDue(void)
+{
+#if defined(__linux__) && !defined(USERWORLD)
+   if (GuestInfo_IsNicMonitorActive() &&
+       gInfoCache.nicInfo != NULL &&
+       time(NULL) - gNicInfoLastScan < GUESTINFO_NIC_RESCAN_INTERVAL) {
+      g_debug("Nic info kept up to date by the nic monitor.\n");
+      return FALSE;
+   }
+#endif
 
    return TRUE;
 }
@@ -604,16 +1097,22 @@ GuestInfoSendNicInfoXdr(ToolsAppCtx *ctx,          // IN
                         GuestNicProto *message,    // IN
                         GuestInfoType type)        // IN
 {
+   static u_int lastBytes = 0;
    Bool status = FALSE;
    XDR xdrs;
    gchar *request;
    char *reply = NULL;
    size_t replyLen;
+   u_int bytes;
 
    /* Add the RPC preamble: message name, and type. */
    request = g_strdup_printf("%s  %d ", GUEST_INFO_COMMAND, type);
 
-   if (DynXdr_Create(&xdrs) == NULL) {
+   /*
+    * NIC info rarely changes size between polls, so start from the size
+    * of the previous update instead of growing the buffer every time.
+    */
+   if (DynXdr_CreateWithSize(&xdrs, lastBytes) == NULL) {
       goto exit;
    }
 
@@ -621,6 +1120,10 @@ GuestInfoSendNicInfoXdr(ToolsAppCtx *ctx,          // IN
    if (!DynXdr_AppendRaw(&xdrs, request, strlen(request)) ||
        !xdr_GuestNicProto(&xdrs, message)) {
       g_warning("Error serializing nic info v%d data.", message->ver);
+   } else if (GuestInfoQueueUpdate(type,
+                                   (char *) DynXdr_Get(&xdrs) + strlen(request),
+                                   xdr_getpos(&xdrs) - strlen(request))) {
+      status = TRUE;
    } else {
       status = RpcChannel_Send(ctx->rpc, DynXdr_Get(&xdrs), xdr_getpos(&xdrs),
                                &reply, &replyLen);
@@ -630,7 +1133,10 @@ GuestInfoSendNicInfoXdr(ToolsAppCtx *ctx,          // IN
       }
       vm_free(reply);
    }
+   bytes = xdr_getpos(&xdrs);
+   lastBytes = bytes;
    DynXdr_Destroy(&xdrs, TRUE);
+   ToolsCoreMemBudget_TransientDone(ctx, "guestInfo", bytes);
 
 exit:
    g_free(request);
@@ -732,6 +1238,74 @@ GuestNicInfoV3ToV3_64(NicInfoV3 *info)             // IN
 }
 
 
+/*
+ ******************************************************************************
+ * GuestInfoSendNicInfoDelta --                                          */ /**
+ *
+ * Push updated nic info to the VMX as a NIC_INFO_V3_DELTA update: only what
+ * changed since the last confirmed update, or a full snapshot when there's
+ * no usable base or a snapshot is due. A rejected delta is retried as a
+ * snapshot; a rejected snapshot means the VMX doesn't know the protocol.
+ *
+ * @param[in] ctx   Application context.
+ * @param[in] info  NicInfoV3 container.
+ *
+ * @retval TRUE  Update sent successfully.
+ * @retval FALSE Delta updates unsupported, or transmission failed.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+GuestInfoSendNicInfoDelta(ToolsAppCtx *ctx,        // IN
+                          NicInfoV3 *info)         // IN
+{
+   NicInfoDeltaState *state = &gInfoCache.delta;
+   NicInfoV3 *base = gInfoCache.nicInfo;
+   GuestNicProto message = {0};
+   NicInfoV3Delta delta;
+
+   if (state->unsupported) {
+      return FALSE;
+   }
+
+   message.ver = NIC_INFO_V3_DELTA;
+   message.GuestNicProto_u.nicInfoV3Delta = &delta;
+
+   if (base != NULL && base != info &&
+       state->sinceSnapshot < NIC_INFO_DELTA_SNAPSHOT_INTERVAL) {
+      Bool status;
+
+      NicInfoV3ToDelta(base, info, &delta);
+      delta.baseSequence = state->sequence;
+      delta.sequence = ++state->sequence;
+      status = GuestInfoSendNicInfoXdr(ctx, &message, INFO_IPADDRESS_V3);
+      NicInfoFreeDelta(&delta);
+
+      if (status) {
+         state->sinceSnapshot++;
+         return TRUE;
+      }
+      g_debug("Nic info delta %u rejected, sending a snapshot.\n",
+              state->sequence);
+   }
+
+   memset(&delta, 0, sizeof delta);
+   delta.sequence = ++state->sequence;
+   delta.snapshot = info;
+
+   if (!GuestInfoSendNicInfoXdr(ctx, &message, INFO_IPADDRESS_V3)) {
+      g_message("VMX doesn't accept delta encoded nic info; sending full "
+                "updates.\n");
+      state->unsupported = TRUE;
+      return FALSE;
+   }
+
+   state->sinceSnapshot = 0;
+   return TRUE;
+}
+
+
 /*
  ******************************************************************************
  * GuestInfoSendNicInfo --                                               */ /**
@@ -760,6 +1334,10 @@ GuestInfoSendNicInfo(ToolsAppCtx *ctx,             // IN
    do {
       switch (gInfoCache.method) {
       case NIC_INFO_V3_WITH_INFO_IPADDRESS_V3:
+         if (GuestInfoSendNicInfoDelta(ctx, info)) {
+            status = TRUE;
+            break;
+         }
          message.ver = NIC_INFO_V3;
          message.GuestNicProto_u.nicInfoV3 = info;
          if (GuestInfoSendNicInfoXdr(ctx, &message, INFO_IPADDRESS_V3)) {
@@ -814,6 +1392,7 @@ GuestInfoSendNicInfo(ToolsAppCtx *ctx,             // IN
       g_debug("Updating nicInfo successfully: method=%d\n", gInfoCache.method);
    } else {
       gInfoCache.method = NIC_INFO_V3_WITH_INFO_IPADDRESS_V3;
+      gInfoCache.delta.unsupported = FALSE;
       g_warning("Fail to send nicInfo: method=%d status=%d\n",
                 gInfoCache.method, status);
    }
@@ -917,6 +1496,7 @@ GuestInfoUpdateVmdb(ToolsAppCtx *ctx,       // IN: Application context
           */
          unsigned int requestSize = sizeof GUEST_INFO_COMMAND + 2 +
                                     3 * sizeof (char);
+         size_t dataSize;
          uint8 partitionCount;
          size_t offset;
          char *request;
@@ -933,6 +1513,8 @@ GuestInfoUpdateVmdb(ToolsAppCtx *ctx,       // IN: Application context
          ASSERT((pdi->numEntries && pdi->partitionList) ||
                 (!pdi->numEntries && !pdi->partitionList));
 
+         dataSize = sizeof partitionCount +
+                    sizeof *pdi->partitionList * pdi->numEntries;
          requestSize += sizeof pdi->numEntries +
                         sizeof *pdi->partitionList * pdi->numEntries;
          request = Util_SafeCalloc(requestSize, sizeof *request);
@@ -971,6 +1553,13 @@ GuestInfoUpdateVmdb(ToolsAppCtx *ctx,       // IN: Application context
                    sizeof *pdi->partitionList * pdi->numEntries);
          }
 
+         if (GuestInfoQueueUpdate(INFO_DISK_FREE_SPACE, request + offset,
+                                  dataSize)) {
+            vm_free(request);
+            g_debug("Queued disk info information\n");
+            break;
+         }
+
          g_debug("sizeof request is %d\n", requestSize);
          status = RpcChannel_Send(ctx->rpc, request, requestSize, &reply,
                                   &replyLen);
@@ -1053,30 +1642,356 @@ SetGuestInfo(ToolsAppCtx *ctx,
    gchar *msg;
    size_t replyLen;
 
-   ASSERT(key);
-   ASSERT(value);
+   ASSERT(key);
+   ASSERT(value);
+
+   if (GuestInfoQueueUpdate(key, value, strlen(value) + 1)) {
+      return TRUE;
+   }
+
+   /*
+    * XXX Consider retiring this runtime "delimiter" business and just
+    * insert raw spaces into the format string.
+    */
+   msg = g_strdup_printf("%s %c%d%c%s", GUEST_INFO_COMMAND,
+                         GUESTINFO_DEFAULT_DELIMITER, key,
+                         GUESTINFO_DEFAULT_DELIMITER, value);
+
+   status = RpcChannel_Send(ctx->rpc, msg, strlen(msg) + 1, &reply, &replyLen);
+   g_free(msg);
+
+   if (!status) {
+      g_warning("Error sending rpc message: %s\n", reply ? reply : "NULL");
+      vm_free(reply);
+      return FALSE;
+   }
+
+   /* The reply indicates whether the key,value pair was updated in VMDB. */
+   status = (*reply == '\0');
+   vm_free(reply);
+   return status;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoBeginBatch --                                                */ /**
+ *
+ * Starts queueing updates, so that everything that changed during a gather
+ * pass reaches the VMX in a single RPC. Does nothing if the VMX is known not
+ * to understand INFO_BATCH messages.
+ *
+ ******************************************************************************
+ */
+
+static void
+GuestInfoBeginBatch(void)
+{
+   ASSERT(gInfoBatch == NULL);
+
+   if (!gInfoBatchUnsupported) {
+      gInfoBatch = g_array_new(FALSE, FALSE, sizeof (GuestInfoBatchEntry));
+      gInfoBatchSize = 0;
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoQueueUpdate --                                               */ /**
+ *
+ * Adds an update to the current batch, if there is one and it has room for
+ * it. The data is copied.
+ *
+ * @param[in] type      Guest information type.
+ * @param[in] data      What would follow the "SetGuestInfo  <type> " preamble
+ *                      if the update was sent on its own.
+ * @param[in] dataLen   Length of @a data.
+ *
+ * @retval TRUE  Update queued.
+ * @retval FALSE No batch in progress, or it's full; caller should send the
+ *               update itself.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+GuestInfoQueueUpdate(GuestInfoType type,      // IN
+                     const void *data,        // IN
+                     size_t dataLen)          // IN
+{
+   GuestInfoBatchEntry entry;
+
+   /*
+    * Leave room for the preamble and the XDR framing (type, length and
+    * padding) of each entry.
+    */
+   if (gInfoBatch == NULL ||
+       gInfoBatch->len == GUESTINFO_BATCH_MAX_ENTRIES ||
+       gInfoBatchSize + dataLen + 3 * sizeof (uint32) + 64 >
+          GUESTMSG_MAX_IN_SIZE) {
+      return FALSE;
+   }
+
+   entry.type = type;
+   entry.data.data_len = dataLen;
+   entry.data.data_val = g_memdup(data, dataLen);
+   g_array_append_val(gInfoBatch, entry);
+   gInfoBatchSize += dataLen + 3 * sizeof (uint32);
+
+   g_debug("Queued update for infotype %d (%"FMTSZ"u bytes).\n", type,
+           dataLen);
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoInvalidateCache --                                           */ /**
+ *
+ * Forgets the cached value for the given type, so that the next gather pass
+ * sends it again.
+ *
+ * @param[in] type      Guest information type.
+ *
+ ******************************************************************************
+ */
+
+static void
+GuestInfoInvalidateCache(GuestInfoType type)    // IN
+{
+   switch (type) {
+   case INFO_DISK_FREE_SPACE:
+      GuestInfo_FreeDiskInfo(gInfoCache.diskInfo);
+      gInfoCache.diskInfo = NULL;
+      break;
+
+   case INFO_IPADDRESS:
+   case INFO_IPADDRESS_V2:
+   case INFO_IPADDRESS_V3:
+      /*
+       * Without a cached base the next update is a snapshot. If what failed
+       * already was one, the VMX doesn't understand delta updates.
+       */
+      if (gInfoCache.delta.sinceSnapshot == 0) {
+         gInfoCache.delta.unsupported = TRUE;
+      }
+      GuestInfo_FreeNicInfo(gInfoCache.nicInfo);
+      gInfoCache.nicInfo = NULL;
+      break;
+
+   default:
+      if (type > INFO_ERROR && type < INFO_MAX) {
+         free(gInfoCache.value[type]);
+         gInfoCache.value[type] = NULL;
+      }
+      break;
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoSendBatchEntry --                                            */ /**
+ *
+ * Sends a queued update on its own, the way it would have been sent had no
+ * batch been in progress.
+ *
+ * @param[in] ctx       Application context.
+ * @param[in] entry     The update.
+ *
+ * @retval TRUE  Update sent successfully.
+ * @retval FALSE Had trouble with transmission.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+GuestInfoSendBatchEntry(ToolsAppCtx *ctx,                // IN
+                        const GuestInfoBatchEntry *entry) // IN
+{
+   Bool status;
+   gchar *request;
+   size_t requestLen;
+   char *message;
+   char *reply = NULL;
+   size_t replyLen;
+
+   /*
+    * Nic info goes through the usual fallback sequence, in case the VMX
+    * doesn't understand the version we queued.
+    */
+   if (entry->type == INFO_IPADDRESS_V3 ||
+       entry->type == INFO_IPADDRESS_V2) {
+      return gInfoCache.nicInfo != NULL &&
+             GuestInfoSendNicInfo(ctx, gInfoCache.nicInfo);
+   }
+
+   request = g_strdup_printf("%s  %d ", GUEST_INFO_COMMAND, entry->type);
+   requestLen = strlen(request);
+   message = g_malloc(requestLen + entry->data.data_len);
+   memcpy(message, request, requestLen);
+   memcpy(message + requestLen, entry->data.data_val, entry->data.data_len);
+
+   status = RpcChannel_Send(ctx->rpc, message,
+                            requestLen + entry->data.data_len,
+                            &reply, &replyLen);
+   if (status) {
+      status = (*reply == '\0');
+   }
+   if (!status) {
+      g_warning("%s: update failed: request \"%s\", reply \"%s\".\n",
+                __FUNCTION__, request, reply ? reply : "NULL");
+   }
+
+   vm_free(reply);
+   g_free(message);
+   g_free(request);
+   return status;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoSendBatch --                                                 */ /**
+ *
+ * Sends all queued updates as a single INFO_BATCH message, and drops the
+ * cached value of each update the VMX reports as failed so that it's sent
+ * again on the next gather pass.
+ *
+ * @param[in] ctx       Application context.
+ * @param[in] batch     Queued updates.
+ *
+ * @retval TRUE  The VMX processed the batch.
+ * @retval FALSE The VMX rejected the batch as a whole; nothing was applied.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+GuestInfoSendBatch(ToolsAppCtx *ctx,         // IN
+                   GArray *batch)            // IN
+{
+   Bool status = FALSE;
+   XDR xdrs;
+   gchar *request;
+   char *reply = NULL;
+   size_t replyLen;
+   GuestInfoBatch message;
+   GuestInfoBatchV1 batchV1;
+   GuestInfoBatchReply result;
+   guint i;
+
+   batchV1.entries.entries_len = batch->len;
+   batchV1.entries.entries_val = (GuestInfoBatchEntry *) batch->data;
+   message.ver = GUESTINFO_BATCH_V1;
+   message.GuestInfoBatch_u.batchV1 = &batchV1;
+
+   request = g_strdup_printf("%s  %d ", GUEST_INFO_COMMAND, INFO_BATCH);
+
+   if (DynXdr_Create(&xdrs) == NULL) {
+      g_free(request);
+      return FALSE;
+   }
+
+   if (!DynXdr_AppendRaw(&xdrs, request, strlen(request)) ||
+       !xdr_GuestInfoBatch(&xdrs, &message)) {
+      g_warning("Error serializing guest info batch.\n");
+      goto exit;
+   }
+
+   if (!RpcChannel_Send(ctx->rpc, DynXdr_Get(&xdrs), xdr_getpos(&xdrs),
+                        &reply, &replyLen)) {
+      g_message("VMX doesn't accept batched guest info updates (%s); "
+                "sending them one at a time.\n", reply ? reply : "NULL");
+      gInfoBatchUnsupported = TRUE;
+      goto exit;
+   }
+
+   memset(&result, 0, sizeof result);
+   if (!XdrUtil_Deserialize(reply, replyLen, xdr_GuestInfoBatchReply,
+                            &result)) {
+      g_warning("Invalid reply to guest info batch; sending updates one at "
+                "a time.\n");
+      gInfoBatchUnsupported = TRUE;
+      goto exit;
+   }
+
+   status = TRUE;
+
+   /*
+    * Anything the VMX didn't report on is considered failed: the cache only
+    * keeps what the VMX confirmed.
+    */
+   for (i = 0; i < batch->len; i++) {
+      GuestInfoBatchEntry *entry = &g_array_index(batch,
+                                                  GuestInfoBatchEntry, i);
+      GuestInfoBatchReplyV1 *replyV1 = result.GuestInfoBatchReply_u.replyV1;
+
+      if (replyV1 == NULL ||
+          i >= replyV1->status.status_len ||
+          replyV1->status.status_val[i].type != entry->type ||
+          !replyV1->status.status_val[i].success) {
+         g_warning("Failed to update guest info type %d.\n", entry->type);
+         GuestInfoInvalidateCache(entry->type);
+      }
+   }
+   g_debug("Sent %u guest info updates in one batch.\n", batch->len);
+
+   VMX_XDR_FREE(xdr_GuestInfoBatchReply, &result);
+
+exit:
+   vm_free(reply);
+   DynXdr_Destroy(&xdrs, TRUE);
+   g_free(request);
+   return status;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoFlushBatch --                                                */ /**
+ *
+ * Sends the updates queued since GuestInfoBeginBatch() and stops queueing.
+ * A batch holding a single update is sent as a plain update. If the VMX
+ * rejects the batch, every update is sent on its own.
+ *
+ * @param[in] ctx       Application context.
+ *
+ ******************************************************************************
+ */
+
+static void
+GuestInfoFlushBatch(ToolsAppCtx *ctx)     // IN
+{
+   GArray *batch = gInfoBatch;
+   Bool sent = FALSE;
+   guint i;
+
+   if (batch == NULL) {
+      return;
+   }
+
+   /* Updates sent from here on go straight to the VMX. */
+   gInfoBatch = NULL;
+   gInfoBatchSize = 0;
 
-   /*
-    * XXX Consider retiring this runtime "delimiter" business and just
-    * insert raw spaces into the format string.
-    */
-   msg = g_strdup_printf("%s %c%d%c%s", GUEST_INFO_COMMAND,
-                         GUESTINFO_DEFAULT_DELIMITER, key,
-                         GUESTINFO_DEFAULT_DELIMITER, value);
+   if (batch->len > 1) {
+      sent = GuestInfoSendBatch(ctx, batch);
+   }
 
-   status = RpcChannel_Send(ctx->rpc, msg, strlen(msg) + 1, &reply, &replyLen);
-   g_free(msg);
+   for (i = 0; i < batch->len; i++) {
+      GuestInfoBatchEntry *entry = &g_array_index(batch,
+                                                  GuestInfoBatchEntry, i);
 
-   if (!status) {
-      g_warning("Error sending rpc message: %s\n", reply ? reply : "NULL");
-      vm_free(reply);
-      return FALSE;
+      if (!sent && !GuestInfoSendBatchEntry(ctx, entry)) {
+         g_warning("Failed to update guest info type %d.\n", entry->type);
+         GuestInfoInvalidateCache(entry->type);
+      }
+      g_free(entry->data.data_val);
    }
 
-   /* The reply indicates whether the key,value pair was updated in VMDB. */
-   status = (*reply == '\0');
-   vm_free(reply);
-   return status;
+   g_array_free(batch, TRUE);
 }
 
 
@@ -1211,6 +2126,80 @@ GuestInfoClearCache(void)
    gInfoCache.nicInfo = NULL;
 
    gInfoCache.method = NIC_INFO_V3_WITH_INFO_IPADDRESS_V3;
+   memset(&gInfoCache.delta, 0, sizeof gInfoCache.delta);
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoCacheSize --                                                 */ /**
+ *
+ * Estimates the memory held by the cached guest info, for the memory budget.
+ *
+ * @param[in]  data     Unused.
+ *
+ * @return Size of the cache in bytes.
+ *
+ ******************************************************************************
+ */
+
+static gsize
+GuestInfoCacheSize(gpointer data)
+{
+   gsize size = 0;
+   u_int i;
+
+   for (i = 0; i < INFO_MAX; i++) {
+      if (gInfoCache.value[i] != NULL) {
+         size += strlen(gInfoCache.value[i]) + 1;
+      }
+   }
+
+   if (gInfoCache.nicInfo != NULL) {
+      NicInfoV3 *nicInfo = gInfoCache.nicInfo;
+
+      size += sizeof *nicInfo;
+      size += nicInfo->nics.nics_len * sizeof *nicInfo->nics.nics_val;
+      for (i = 0; i < nicInfo->nics.nics_len; i++) {
+         size += nicInfo->nics.nics_val[i].ips.ips_len *
+                 sizeof *nicInfo->nics.nics_val[i].ips.ips_val;
+      }
+      size += nicInfo->routes.routes_len * sizeof *nicInfo->routes.routes_val;
+   }
+
+   if (gInfoCache.diskInfo != NULL) {
+      size += sizeof *gInfoCache.diskInfo;
+      size += gInfoCache.diskInfo->numEntries *
+              sizeof *gInfoCache.diskInfo->partitionList;
+   }
+
+   return size;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoCacheEvict --                                                */ /**
+ *
+ * Drops the cached guest info at the request of the memory budget. The next
+ * gather pass sends everything to the VMX again.
+ *
+ * @param[in]  bytes    Unused; the cache is dropped as a whole.
+ * @param[in]  data     Unused.
+ *
+ * @return Number of bytes released.
+ *
+ ******************************************************************************
+ */
+
+static gsize
+GuestInfoCacheEvict(gsize bytes,
+                    gpointer data)
+{
+   gsize size = GuestInfoCacheSize(NULL);
+
+   GuestInfoClearCache();
+   return size;
 }
 
 
@@ -1273,6 +2262,258 @@ NicInfoV3ToV2(const NicInfoV3 *infoV3)
 }
 
 
+/*
+ ***********************************************************************
+ * NicInfoFindIndex --                                          */ /**
+ *
+ * @brief Looks up a NIC by MAC address.
+ *
+ * @param[in]  info        NicInfoV3 container.
+ * @param[in]  macAddress  MAC address to look for.
+ *
+ * @return Index of the NIC in @a info, or -1 if not found.
+ *
+ ***********************************************************************
+ */
+
+static int
+NicInfoFindIndex(const NicInfoV3 *info,
+                 const char *macAddress)
+{
+   unsigned int i;
+
+   XDRUTIL_FOREACH(i, info, nics) {
+      if (strcasecmp(info->nics.nics_val[i].macAddress, macAddress) == 0) {
+         return i;
+      }
+   }
+
+   return -1;
+}
+
+
+/*
+ ***********************************************************************
+ * NicInfoHasIp --                                              */ /**
+ *
+ * @brief Checks whether a NIC has the given address.
+ *
+ * @param[in]  nic     NIC to look into.
+ * @param[in]  entry   Address to look for.
+ *
+ * @return TRUE if found.
+ *
+ ***********************************************************************
+ */
+
+static Bool
+NicInfoHasIp(const GuestNicV3 *nic,
+             const IpAddressEntry *entry)
+{
+   unsigned int i;
+
+   XDRUTIL_FOREACH(i, nic, ips) {
+      if (GuestInfo_IsEqual_IpAddressEntry(XDRUTIL_GETITEM(nic, ips, i),
+                                           entry)) {
+         return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+
+/*
+ ***********************************************************************
+ * NicInfoHasRoute --                                           */ /**
+ *
+ * @brief Checks whether a NicInfoV3 has the given route.
+ *
+ * @param[in]  info        NicInfoV3 container to look into.
+ * @param[in]  route       Route to look for.
+ * @param[in]  routeInfo   NicInfoV3 container @a route belongs to.
+ *
+ * @return TRUE if found.
+ *
+ ***********************************************************************
+ */
+
+static Bool
+NicInfoHasRoute(const NicInfoV3 *info,
+                const InetCidrRouteEntry *route,
+                const NicInfoV3 *routeInfo)
+{
+   unsigned int i;
+
+   XDRUTIL_FOREACH(i, info, routes) {
+      if (GuestInfo_IsEqual_InetCidrRouteEntry(XDRUTIL_GETITEM(info, routes, i),
+                                               route, info, routeInfo)) {
+         return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+
+/*
+ ***********************************************************************
+ * NicInfoV3ToDelta --                                          */ /**
+ *
+ * @brief Computes what changed between two NicInfoV3 containers.
+ *
+ * @note  Like NicInfoV3ToV2, this performs @e shallow copies: the
+ *        delta points into @a info, and must be released with
+ *        NicInfoFreeDelta before @a info is freed.
+ *
+ * @param[in]  base    State last sent to the VMX.
+ * @param[in]  info    Current state.
+ * @param[out] delta   Changes from @a base to @a info. Sequence numbers
+ *                     are left for the caller to fill in.
+ *
+ ***********************************************************************
+ */
+
+static void
+NicInfoV3ToDelta(const NicInfoV3 *base,
+                 const NicInfoV3 *info,
+                 NicInfoV3Delta *delta)
+{
+   unsigned int i, j;
+
+   memset(delta, 0, sizeof *delta);
+
+   (void)XDRUTIL_ARRAYAPPEND(delta, nicOrder, info->nics.nics_len);
+   XDRUTIL_FOREACH(i, info, nics) {
+      GuestNicV3 *nic = XDRUTIL_GETITEM(info, nics, i);
+      int baseIdx = NicInfoFindIndex(base, nic->macAddress);
+      GuestNicV3 *baseNic = NULL;
+      GuestNicV3Delta *nicDelta;
+
+      delta->nicOrder.nicOrder_val[i] = nic->macAddress;
+
+      if (baseIdx >= 0) {
+         baseNic = XDRUTIL_GETITEM(base, nics, baseIdx);
+         if (GuestInfo_IsEqual_GuestNicV3(baseNic, nic)) {
+            continue;
+         }
+      }
+
+      nicDelta = XDRUTIL_ARRAYAPPEND(delta, nics, 1);
+      nicDelta->macAddress = nic->macAddress;
+
+      XDRUTIL_FOREACH(j, nic, ips) {
+         IpAddressEntry *ip = XDRUTIL_GETITEM(nic, ips, j);
+
+         if (baseNic == NULL || !NicInfoHasIp(baseNic, ip)) {
+            *XDRUTIL_ARRAYAPPEND(nicDelta, ipsAdded, 1) = *ip;
+         }
+      }
+
+      if (baseNic != NULL) {
+         XDRUTIL_FOREACH(j, baseNic, ips) {
+            IpAddressEntry *ip = XDRUTIL_GETITEM(baseNic, ips, j);
+
+            if (!NicInfoHasIp(nic, ip)) {
+               *XDRUTIL_ARRAYAPPEND(nicDelta, ipsRemoved, 1) = *ip;
+            }
+         }
+      }
+
+      if (baseNic == NULL ||
+          !GuestInfo_IsEqual_DnsConfigInfo(baseNic->dnsConfigInfo,
+                                           nic->dnsConfigInfo) ||
+          !GuestInfo_IsEqual_WinsConfigInfo(baseNic->winsConfigInfo,
+                                            nic->winsConfigInfo) ||
+          !GuestInfo_IsEqual_DhcpConfigInfo(baseNic->dhcpConfigInfov4,
+                                            nic->dhcpConfigInfov4) ||
+          !GuestInfo_IsEqual_DhcpConfigInfo(baseNic->dhcpConfigInfov6,
+                                            nic->dhcpConfigInfov6)) {
+         nicDelta->config = Util_SafeCalloc(1, sizeof *nicDelta->config);
+         nicDelta->config->dnsConfigInfo = nic->dnsConfigInfo;
+         nicDelta->config->winsConfigInfo = nic->winsConfigInfo;
+         nicDelta->config->dhcpConfigInfov4 = nic->dhcpConfigInfov4;
+         nicDelta->config->dhcpConfigInfov6 = nic->dhcpConfigInfov6;
+      }
+   }
+
+   /* New routes already refer to the current NIC order. */
+   XDRUTIL_FOREACH(i, info, routes) {
+      InetCidrRouteEntry *route = XDRUTIL_GETITEM(info, routes, i);
+
+      if (!NicInfoHasRoute(base, route, info)) {
+         *XDRUTIL_ARRAYAPPEND(delta, routesAdded, 1) = *route;
+      }
+   }
+
+   /*
+    * Routes through NICs that went away disappear with them; the others
+    * get their interface index remapped to the current NIC order.
+    */
+   XDRUTIL_FOREACH(i, base, routes) {
+      InetCidrRouteEntry *route = XDRUTIL_GETITEM(base, routes, i);
+      const char *mac = base->nics.nics_val[route->inetCidrRouteIfIndex].macAddress;
+      int idx = NicInfoFindIndex(info, mac);
+
+      if (idx >= 0 && !NicInfoHasRoute(info, route, base)) {
+         InetCidrRouteEntry *removed = XDRUTIL_ARRAYAPPEND(delta,
+                                                           routesRemoved, 1);
+         *removed = *route;
+         removed->inetCidrRouteIfIndex = idx;
+      }
+   }
+
+   if (!GuestInfo_IsEqual_DnsConfigInfo(base->dnsConfigInfo,
+                                        info->dnsConfigInfo) ||
+       !GuestInfo_IsEqual_WinsConfigInfo(base->winsConfigInfo,
+                                         info->winsConfigInfo) ||
+       !GuestInfo_IsEqual_DhcpConfigInfo(base->dhcpConfigInfov4,
+                                         info->dhcpConfigInfov4) ||
+       !GuestInfo_IsEqual_DhcpConfigInfo(base->dhcpConfigInfov6,
+                                         info->dhcpConfigInfov6)) {
+      delta->config = Util_SafeCalloc(1, sizeof *delta->config);
+      delta->config->dnsConfigInfo = info->dnsConfigInfo;
+      delta->config->winsConfigInfo = info->winsConfigInfo;
+      delta->config->dhcpConfigInfov4 = info->dhcpConfigInfov4;
+      delta->config->dhcpConfigInfov6 = info->dhcpConfigInfov6;
+   }
+}
+
+
+/*
+ ***********************************************************************
+ * NicInfoFreeDelta --                                          */ /**
+ *
+ * @brief Frees the arrays allocated by NicInfoV3ToDelta. The data they
+ *        point to is owned by the source NicInfoV3 and is left alone.
+ *
+ * @param[in]  delta   Delta to free.
+ *
+ ***********************************************************************
+ */
+
+static void
+NicInfoFreeDelta(NicInfoV3Delta *delta)
+{
+   unsigned int i;
+
+   XDRUTIL_FOREACH(i, delta, nics) {
+      GuestNicV3Delta *nicDelta = XDRUTIL_GETITEM(delta, nics, i);
+
+      free(nicDelta->ipsAdded.ipsAdded_val);
+      free(nicDelta->ipsRemoved.ipsRemoved_val);
+      free(nicDelta->config);
+   }
+
+   free(delta->nicOrder.nicOrder_val);
+   free(delta->nics.nics_val);
+   free(delta->routesAdded.routesAdded_val);
+   free(delta->routesRemoved.routesRemoved_val);
+   free(delta->config);
+   memset(delta, 0, sizeof *delta);
+}
+
+
 /*
  ******************************************************************************
  * TweakGatherLoop --                                                    */ /**
@@ -1356,7 +2597,12 @@ TweakGatherLoop(ToolsAppCtx *ctx,
    if (*currInterval) {
       g_info("New value for %s is %us.\n", cfgKey, *currInterval / 1000);
 
-      *timeoutSource = g_timeout_source_new(*currInterval);
+      /*
+       * Let the loop share wakeups with the other periodic tasks, within a
+       * tenth of its interval.
+       */
+      *timeoutSource = VMTools_CreateCoalescedTimer(cfgKey, *currInterval,
+                                                    *currInterval / 10);
       VMTOOLSAPP_ATTACH_SOURCE(ctx, *timeoutSource, callback, ctx, NULL);
       g_source_unref(*timeoutSource);
    } else {
@@ -1405,6 +2651,9 @@ TweakGatherLoops(ToolsAppCtx *ctx,
                       GuestInfo_StatProviderPoll,
                       &guestInfoStatsInterval,
                       &gatherStatsTimeoutSource);
+#if defined(__linux__) && !defined(USERWORLD)
+      GuestInfo_HfStatsConfigure(ctx, enable);
+#endif
    } else {
       /*
        * Destroy the existing timeout source, if it exists.
@@ -1415,6 +2664,9 @@ TweakGatherLoops(ToolsAppCtx *ctx,
 
          g_info("PerfMon gather loop disabled.\n");
       }
+#if defined(__linux__) && !defined(USERWORLD)
+      GuestInfo_HfStatsConfigure(ctx, FALSE);
+#endif
    }
 #endif
 
@@ -1427,6 +2679,20 @@ TweakGatherLoops(ToolsAppCtx *ctx,
                    GuestInfoGather,
                    &guestInfoPollInterval,
                    &gatherInfoTimeoutSource);
+
+#if defined(__linux__) && !defined(USERWORLD)
+   /*
+    * Watch for network changes while guest info is being gathered, unless
+    * the user asked not to.
+    */
+   if (enable && guestInfoPollInterval != 0 &&
+       !g_key_file_get_boolean(ctx->config, CONFGROUPNAME_GUESTINFO,
+                               CONFNAME_GUESTINFO_DISABLENICMONITOR, NULL)) {
+      GuestInfo_StartNicMonitor(ctx, GuestInfoRefreshNicInfo);
+   } else {
+      GuestInfo_StopNicMonitor();
+   }
+#endif
 }
 
 
@@ -1458,6 +2724,62 @@ GuestInfo_ServerReportStats(
 }
 
 
+#if defined(__linux__) && !defined(USERWORLD)
+/*
+ ******************************************************************************
+ *
+ * GuestInfo_ServerReportHfStats --
+ *
+ *      Report a batch of high frequency stats samples.
+ *
+ * Results:
+ *      Samples sent to the VMX. Returns FALSE on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ ******************************************************************************
+ */
+
+Bool
+GuestInfo_ServerReportHfStats(
+   ToolsAppCtx *ctx,     // IN
+   GuestHfStats *stats)  // IN
+{
+   static u_int lastBytes = 0;
+   Bool status = FALSE;
+   XDR xdrs;
+   gchar *request;
+   char *reply = NULL;
+   size_t replyLen;
+
+   request = g_strdup_printf("%s  %d ", GUEST_INFO_COMMAND, INFO_HFSTATS);
+
+   if (DynXdr_CreateWithSize(&xdrs, lastBytes) == NULL) {
+      goto exit;
+   }
+
+   if (!DynXdr_AppendRaw(&xdrs, request, strlen(request)) ||
+       !xdr_GuestHfStats(&xdrs, stats)) {
+      g_warning("Error serializing high frequency stats.\n");
+   } else {
+      status = RpcChannel_Send(ctx->rpc, DynXdr_Get(&xdrs), xdr_getpos(&xdrs),
+                               &reply, &replyLen);
+      if (!status) {
+         g_debug("%s: update failed: reply \"%s\".\n", __FUNCTION__, reply);
+      }
+      vm_free(reply);
+   }
+   lastBytes = xdr_getpos(&xdrs);
+   DynXdr_Destroy(&xdrs, TRUE);
+
+exit:
+   g_free(request);
+   return status;
+}
+#endif
+
+
 /*
  ******************************************************************************
  * BEGIN Tools Core Services goodies.
@@ -1468,10 +2790,12 @@ GuestInfo_ServerReportStats(
  ******************************************************************************
  * GuestInfoServerConfReload --                                          */ /**
  *
- * @brief Reconfigures the poll loop interval upon config file reload.
+ * @brief Reconfigures the poll loop interval when the guestinfo config group
+ * changes.
  *
  * @param[in]  src     The source object.
  * @param[in]  ctx     The application context.
+ * @param[in]  group   Unused.
  * @param[in]  data    Unused.
  *
  ******************************************************************************
@@ -1480,6 +2804,7 @@ GuestInfo_ServerReportStats(
 static void
 GuestInfoServerConfReload(gpointer src,
                           ToolsAppCtx *ctx,
+                          const gchar *group,
                           gpointer data)
 {
    TweakGatherLoops(ctx, TRUE);
@@ -1529,8 +2854,22 @@ GuestInfoServerShutdown(gpointer src,
                         ToolsAppCtx *ctx,
                         gpointer data)
 {
+   ToolsCoreMemBudget_UnregisterCache(ctx, gInfoCacheBudgetId);
+   gInfoCacheBudgetId = 0;
    GuestInfoClearCache();
 
+   gCollectorsActive = FALSE;
+   if (gDiskCollector.deadlineSource != NULL) {
+      g_source_destroy(gDiskCollector.deadlineSource);
+      g_source_unref(gDiskCollector.deadlineSource);
+      gDiskCollector.deadlineSource = NULL;
+   }
+   if (gNicCollector.deadlineSource != NULL) {
+      g_source_destroy(gNicCollector.deadlineSource);
+      g_source_unref(gNicCollector.deadlineSource);
+      gNicCollector.deadlineSource = NULL;
+   }
+
    if (gatherInfoTimeoutSource != NULL) {
       g_source_destroy(gatherInfoTimeoutSource);
       gatherInfoTimeoutSource = NULL;
@@ -1541,6 +2880,16 @@ GuestInfoServerShutdown(gpointer src,
       gatherStatsTimeoutSource = NULL;
    }
 
+#if defined(__linux__) && !defined(USERWORLD)
+   GuestInfo_StopNicMonitor();
+   GuestInfo_StatProviderShutdown();
+
+   /* A pool thread may still be using the cached partitions. */
+   if (!gDiskCollector.busy) {
+      GuestInfo_DiskInfoShutdown();
+   }
+#endif
+
 #ifdef _WIN32
    GuestInfo_StatProviderShutdown();
    NetUtil_FreeIpHlpApiDll();
@@ -1568,6 +2917,12 @@ GuestInfoServerReset(gpointer src,
                      gpointer data)
 {
    vmResumed = TRUE;
+   gInfoBatchUnsupported = FALSE;
+
+#if defined(__linux__) && !defined(USERWORLD)
+   /* The new host (if any) has to opt in to the compact stats again. */
+   GuestInfo_StatProviderSetCompact(FALSE);
+#endif
 }
 
 
@@ -1609,7 +2964,8 @@ GuestInfoServerSendCaps(gpointer src,
  * GuestInfoServerSetOption --                                           */ /**
  *
  * Responds to a "broadcastIP" Set_Option command, by sending the primary IP
- * back to the VMX.
+ * back to the VMX, and to a "guestStatsCompact" one, by switching the stats
+ * encoding.
  *
  * @param[in]  src      The source object.
  * @param[in]  ctx      The application context.
@@ -1631,6 +2987,16 @@ GuestInfoServerSetOption(gpointer src,
    Bool ret = FALSE;
    gchar *msg;
 
+#if defined(__linux__) && !defined(USERWORLD)
+   if (strcmp(option, TOOLSOPTION_GUESTSTATS_COMPACT) == 0) {
+      if (strcmp(value, "0") == 0 || strcmp(value, "1") == 0) {
+         GuestInfo_StatProviderSetCompact(strcmp(value, "1") == 0);
+         ret = TRUE;
+      }
+      goto exit;
+   }
+#endif
+
    if (strcmp(option, TOOLSOPTION_BROADCASTIP) != 0) {
       goto exit;
    }
@@ -1684,11 +3050,16 @@ ToolsOnLoad(ToolsAppCtx *ctx)
     */
    if (ctx->rpc != NULL) {
       RpcChannelCallback rpcs[] = {
-         { RPC_VMSUPPORT_START, GuestInfoVMSupport, &regData, NULL, NULL, 0 }
+         { RPC_VMSUPPORT_START, GuestInfoVMSupport, &regData, NULL, NULL, 0 },
+#if defined(__linux__) && !defined(USERWORLD)
+         { GUEST_INFO_HFSTATS_FLUSH_CMD, GuestInfoHfStatsFlushRpc, NULL, NULL,
+           NULL, 0 },
+#endif
       };
       ToolsPluginSignalCb sigs[] = {
          { TOOLS_CORE_SIG_CAPABILITIES, GuestInfoServerSendCaps, NULL },
-         { TOOLS_CORE_SIG_CONF_RELOAD, GuestInfoServerConfReload, NULL },
+         { TOOLS_CORE_SIG_CONF_GROUP_RELOAD "::" CONFGROUPNAME_GUESTINFO,
+           GuestInfoServerConfReload, NULL },
          { TOOLS_CORE_SIG_IO_FREEZE, GuestInfoServerIOFreeze, NULL },
          { TOOLS_CORE_SIG_RESET, GuestInfoServerReset, NULL },
          { TOOLS_CORE_SIG_SET_OPTION, GuestInfoServerSetOption, NULL },
@@ -1712,7 +3083,13 @@ ToolsOnLoad(ToolsAppCtx *ctx)
 
       memset(&gInfoCache, 0, sizeof gInfoCache);
       vmResumed = FALSE;
+      gCollectorsActive = TRUE;
       gInfoCache.method = NIC_INFO_V3_WITH_INFO_IPADDRESS_V3;
+      gInfoCacheBudgetId =
+         ToolsCoreMemBudget_RegisterCache(ctx, regData.name, "guest info",
+                                          GuestInfoCacheSize,
+                                          GuestInfoCacheEvict,
+                                          NULL);
 
       /*
        * Set up the GuestInfo gather loops.
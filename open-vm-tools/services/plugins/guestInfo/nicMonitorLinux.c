@@ -0,0 +1,327 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * nicMonitorLinux.c --
+ *
+ *      Watches rtnetlink for link, address and route changes, so that the
+ *      guest info server can refresh the nic info as soon as something
+ *      changes instead of waiting for the next gather pass.
+ */
+
+#if defined(__linux__) && !defined(USERWORLD)
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "vmware.h"
+#include "guestInfoInt.h"
+
+/*
+ * How long to wait after a change before refreshing (in milliseconds).
+ * Bringing an interface up usually produces a burst of link, address and
+ * route messages; this folds them into a single refresh.
+ */
+#define NIC_MONITOR_SETTLE_TIME 100
+
+typedef struct NicMonitor {
+   ToolsAppCtx         *ctx;
+   int                  fd;
+   GSource             *watch;
+   GSource             *settle;
+   GuestInfoNicMonitorCb callback;
+   uint64               events;
+} NicMonitor;
+
+static NicMonitor *gNicMonitor = NULL;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NicMonitorSettled --
+ *
+ *      Timeout callback: the burst of changes is over, let the guest info
+ *      server refresh the nic info.
+ *
+ * Results:
+ *      FALSE, to remove the timeout source.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static gboolean
+NicMonitorSettled(gpointer data)  // IN
+{
+   NicMonitor *mon = data;
+
+   g_source_unref(mon->settle);
+   mon->settle = NULL;
+
+   g_debug("%s: refreshing nic info after %"FMT64"u change(s).\n",
+           __FUNCTION__, mon->events);
+   mon->events = 0;
+   mon->callback(mon->ctx);
+   return FALSE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NicMonitorIsChange --
+ *
+ *      Checks whether a netlink message reports a change the nic info
+ *      cares about.
+ *
+ * Results:
+ *      TRUE if so.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+NicMonitorIsChange(const struct nlmsghdr *hdr)  // IN
+{
+   switch (hdr->nlmsg_type) {
+   case RTM_NEWLINK:
+   case RTM_DELLINK:
+   case RTM_NEWADDR:
+   case RTM_DELADDR:
+   case RTM_NEWROUTE:
+   case RTM_DELROUTE:
+      return TRUE;
+   default:
+      return FALSE;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NicMonitorRead --
+ *
+ *      Drains the netlink socket and schedules a refresh if any of the
+ *      queued messages was a relevant change. An overrun (ENOBUFS) means
+ *      messages were lost, which is treated as a change too.
+ *
+ * Results:
+ *      TRUE to keep watching, FALSE if the socket is unusable.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static gboolean
+NicMonitorRead(GIOChannel *chan,       // IN
+               GIOCondition cond,      // IN
+               gpointer data)          // IN
+{
+   NicMonitor *mon = data;
+   char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+   Bool changed = FALSE;
+
+   for (;;) {
+      ssize_t len = recv(mon->fd, buf, sizeof buf, MSG_DONTWAIT);
+      struct nlmsghdr *hdr;
+
+      if (len < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         if (errno == ENOBUFS) {
+            changed = TRUE;
+            continue;
+         }
+         if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            g_warning("%s: netlink recv failed: %s\n", __FUNCTION__,
+                      strerror(errno));
+            g_source_unref(mon->watch);
+            mon->watch = NULL;
+            return FALSE;
+         }
+         break;
+      }
+
+      for (hdr = (struct nlmsghdr *) buf;
+           NLMSG_OK(hdr, len);
+           hdr = NLMSG_NEXT(hdr, len)) {
+         if (NicMonitorIsChange(hdr)) {
+            changed = TRUE;
+            mon->events++;
+         }
+      }
+   }
+
+   if (changed && mon->settle == NULL) {
+      mon->settle = g_timeout_source_new(NIC_MONITOR_SETTLE_TIME);
+      VMTOOLSAPP_ATTACH_SOURCE(mon->ctx, mon->settle, NicMonitorSettled,
+                               mon, NULL);
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfo_StartNicMonitor --
+ *
+ *      Subscribes to rtnetlink link, IPv4/IPv6 address and IPv4/IPv6
+ *      route notifications. @callback runs on the main loop shortly after
+ *      something changes.
+ *
+ * Results:
+ *      TRUE if the monitor is running (or already was).
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+gboolean
+GuestInfo_StartNicMonitor(ToolsAppCtx *ctx,                // IN
+                          GuestInfoNicMonitorCb callback)  // IN
+{
+   NicMonitor *mon;
+   struct sockaddr_nl addr;
+   GIOChannel *chan;
+   int fd;
+
+   if (gNicMonitor != NULL) {
+      return TRUE;
+   }
+
+   fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+               NETLINK_ROUTE);
+   if (fd < 0) {
+      g_warning("%s: failed to create netlink socket: %s\n", __FUNCTION__,
+                strerror(errno));
+      return FALSE;
+   }
+
+   memset(&addr, 0, sizeof addr);
+   addr.nl_family = AF_NETLINK;
+   addr.nl_groups = RTMGRP_LINK |
+                    RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR |
+                    RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+
+   if (bind(fd, (struct sockaddr *) &addr, sizeof addr) < 0) {
+      g_warning("%s: failed to bind netlink socket: %s\n", __FUNCTION__,
+                strerror(errno));
+      close(fd);
+      return FALSE;
+   }
+
+   mon = g_new0(NicMonitor, 1);
+   mon->ctx = ctx;
+   mon->fd = fd;
+   mon->callback = callback;
+
+   chan = g_io_channel_unix_new(fd);
+   g_io_channel_set_encoding(chan, NULL, NULL);
+   g_io_channel_set_buffered(chan, FALSE);
+   mon->watch = g_io_create_watch(chan, G_IO_IN | G_IO_HUP | G_IO_ERR);
+   g_io_channel_unref(chan);   // Ownership transferred to the watch.
+
+   VMTOOLSAPP_ATTACH_SOURCE(ctx, mon->watch, NicMonitorRead, mon, NULL);
+
+   gNicMonitor = mon;
+   g_info("Watching rtnetlink for network changes.\n");
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfo_StopNicMonitor --
+ *
+ *      Stops watching for network changes. A refresh that is pending is
+ *      dropped.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+GuestInfo_StopNicMonitor(void)
+{
+   NicMonitor *mon = gNicMonitor;
+
+   if (mon == NULL) {
+      return;
+   }
+
+   if (mon->settle != NULL) {
+      g_source_destroy(mon->settle);
+      g_source_unref(mon->settle);
+   }
+   if (mon->watch != NULL) {
+      g_source_destroy(mon->watch);
+      g_source_unref(mon->watch);
+   }
+   close(mon->fd);
+   g_free(mon);
+   gNicMonitor = NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfo_IsNicMonitorActive --
+ *
+ *      Checks whether the nic info is kept up to date by the monitor.
+ *
+ * Results:
+ *      TRUE if the monitor is running.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+gboolean
+GuestInfo_IsNicMonitorActive(void)
+{
+   return gNicMonitor != NULL && gNicMonitor->watch != NULL;
+}
+
+#endif // __linux__ && !USERWORLD
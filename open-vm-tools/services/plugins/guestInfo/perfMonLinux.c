@@ -22,6 +22,11 @@
 #include <unistd.h>
 #include <sys/wait.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#if defined(__FreeBSD__)
+#include <sys/sysctl.h>
+#endif
 
 #include "vm_basic_defs.h"
 #include "vmware.h"
@@ -31,8 +36,14 @@
 #include "guestStats.h"
 #include "posix.h"
 #include "hashTable.h"
+#include "hostinfo.h"
+#include "conf.h"
+#include "util.h"
+#include "vmware/tools/timeSyncStats.h"
 
 #define GUEST_INFO_PREALLOC_SIZE 4096
+#define GUEST_INFO_STATBUF_MAX_KEEP (64 * 1024)
+#define GUEST_INFO_PROC_BUF_SIZE (16 * 1024)
 #define INT_AS_HASHKEY(x) ((const void *)(uintptr_t)(x))
 
 #define STAT_FILE        "/proc/stat"
@@ -41,6 +52,16 @@
 #define MEMINFO_FILE     "/proc/meminfo"
 #define ZONEINFO_FILE    "/proc/zoneinfo"
 #define SWAPPINESS_FILE  "/proc/sys/vm/swappiness"
+#define DISKSTATS_FILE   "/proc/diskstats"
+#define PSI_MEMORY_FILE  "/proc/pressure/memory"
+
+#define CGROUP2_ROOT          "/sys/fs/cgroup"
+#define CGROUP2_HYBRID_ROOT   "/sys/fs/cgroup/unified"
+#define CGROUP_MAX_MONITORED  64
+
+#define BALLOON_STATS_FILE        "/sys/kernel/debug/vmmemctl"
+#define BALLOON_STATS_SYSCTL      "vm.vmmemctl_stats"
+#define BALLOON_LATENCY_BUCKETS   16
 
 
 /*
@@ -113,46 +134,241 @@ typedef struct {
    double           timeStamp;
 } GuestInfoCollector;
 
+/*
+ * The /proc files samples are taken from. They're kept open and re-read from
+ * offset 0 every time; the kernel regenerates the contents on each read.
+ *
+ * lineMap caches, for each line of the file, the index of the stat the line
+ * feeds, GUESTINFO_LINE_NONE if it feeds none, or GUESTINFO_LINE_UNKNOWN.
+ * The layout of these files doesn't change while the system runs, so after
+ * the first sample only the lines of interest are parsed. The map is rebuilt
+ * when the number of lines changes (e.g., a memory zone comes online), and
+ * an entry is looked up again if its line no longer has the expected name.
+ */
+
+#define GUESTINFO_LINE_NONE     (-1)
+#define GUESTINFO_LINE_UNKNOWN  (-2)
+
+typedef struct {
+   const char      *path;
+   Bool             memInfoFormat;  // "Name:   value kB" lines
+   int              fd;
+   uint32           numLines;
+   int             *lineMap;
+} GuestInfoProcFile;
+
+static GuestInfoProcFile guestInfoProcFiles[] = {
+   { MEMINFO_FILE,  TRUE,  -1, 0, NULL },
+   { VMSTAT_FILE,   FALSE, -1, 0, NULL },
+   { STAT_FILE,     FALSE, -1, 0, NULL },
+   { ZONEINFO_FILE, FALSE, -1, 0, NULL },
+};
+
+#define N_PROC_FILES (sizeof guestInfoProcFiles / sizeof(GuestInfoProcFile))
+
+static GuestInfoProcFile guestInfoUpTimeFile = { UPTIME_FILE, FALSE, -1, 0, NULL };
+
+/* The /proc files are read into this buffer; it only ever grows. */
+static char *guestInfoProcBuf = NULL;
+static size_t guestInfoProcBufSize = 0;
+
+/* Sample state, kept across samples so that taking one doesn't allocate. */
+static GuestInfoCollector *guestInfoCurrent = NULL;
+static GuestInfoCollector *guestInfoPrevious = NULL;
+static DynBuf guestInfoStatBuf;
+static Bool guestInfoStatBufInited = FALSE;
+
+/*
+ * Compact (GUESTMEMINFO_V6) encoding state, see guestStats.h. The host opts
+ * in with TOOLSOPTION_GUESTSTATS_COMPACT.
+ */
+#define GUEST_INFO_COMPACT_KEYFRAME_INTERVAL 30
+
+typedef struct {
+   Bool      enabled;
+   Bool      resync;        // Next sample must carry the dictionary
+   Bool      dictionary;    // Sample being encoded carries the dictionary
+   Bool      keyFrame;      // Sample being encoded has absolute values
+   uint32    sequence;
+   uint32    sinceKeyFrame;
+   char     *nameSpace;     // Namespace of the next record, NULL for tools
+   uint32    record;        // Position of the next record in the sample
+   uint32    lastRecords;   // Number of records in the previous sample
+   uint32    maxRecords;    // Size of the arrays below
+   Bool     *haveValue;     // Indexed by record position
+   uint64   *previous;
+} GuestInfoCompactState;
+
+static GuestInfoCompactState guestInfoCompact;
+
 
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoGetUpTime --
+ * GuestInfoReadProcFile --
  *
- *      What time is it?
+ *      Reads the whole contents of a /proc file into the shared buffer,
+ *      (re)opening the file if needed.
  *
  * Results:
- *      TRUE   Success! *now is populated
- *      FALSE  Failure! *now remains unchanged
+ *      The NUL-terminated contents, and their length in *len; NULL on
+ *      failure.
  *
  * Side effects:
- *      None.
+ *      Grows the shared buffer if the file doesn't fit.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+GuestInfoReadProcFile(GuestInfoProcFile *file,  // IN/OUT:
+                      size_t *len)              // OUT:
+{
+   size_t total = 0;
+
+   if (guestInfoProcBuf == NULL) {
+      guestInfoProcBuf = malloc(GUEST_INFO_PROC_BUF_SIZE);
+      if (guestInfoProcBuf == NULL) {
+         return NULL;
+      }
+      guestInfoProcBufSize = GUEST_INFO_PROC_BUF_SIZE;
+   }
+
+   if (file->fd < 0) {
+      file->fd = Posix_Open(file->path, O_RDONLY | O_CLOEXEC);
+      if (file->fd < 0) {
+         return NULL;
+      }
+   }
+
+   for (;;) {
+      ssize_t n;
+
+      if (total == guestInfoProcBufSize - 1) {
+         char *newBuf = realloc(guestInfoProcBuf, 2 * guestInfoProcBufSize);
+
+         if (newBuf == NULL) {
+            return NULL;
+         }
+         guestInfoProcBuf = newBuf;
+         guestInfoProcBufSize *= 2;
+      }
+
+      n = pread(file->fd, guestInfoProcBuf + total,
+                guestInfoProcBufSize - 1 - total, total);
+      if (n < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         close(file->fd);
+         file->fd = -1;
+         return NULL;
+      }
+      if (n == 0) {
+         break;
+      }
+      total += n;
+   }
+
+   guestInfoProcBuf[total] = '\0';
+   *len = total;
+   return guestInfoProcBuf;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoParseLine --
+ *
+ *      Splits a "name value ..." line, in place. For meminfo style lines
+ *      the ':' after the name is stripped.
+ *
+ * Results:
+ *      TRUE   Success! *name and *value are populated
+ *      FALSE  The line doesn't start with a name followed by a number
+ *
+ * Side effects:
+ *      Modifies the line.
  *
  *----------------------------------------------------------------------
  */
 
 static Bool
-GuestInfoGetUpTime(double *now)  // OUT:
+GuestInfoParseLine(char *line,          // IN/OUT:
+                   Bool memInfoFormat,  // IN:
+                   char **name,         // OUT:
+                   uint64 *value)       // OUT:
 {
-   char line[512];
-   Bool result = FALSE;
-   FILE *fp = Posix_Fopen(UPTIME_FILE, "r");
+   char *p = line;
+
+   while (*p == ' ' || *p == '\t') {
+      p++;
+   }
+   if (*p == '\0') {
+      return FALSE;
+   }
 
-   if (fp == NULL) {
-      return result;
+   *name = p;
+   while (*p != '\0' && *p != ' ' && *p != '\t') {
+      p++;
+   }
+   if (*p == '\0') {
+      return FALSE;
    }
+   *p++ = '\0';
 
-   if (fgets(line, sizeof line, fp) != NULL) {
-      double idle;
+   if (memInfoFormat) {
+      char *colon = strrchr(*name, ':');
 
-      if (sscanf(line, "%lf %lf", now, &idle) == 2) {
-         result = TRUE;
+      if (colon == NULL) {
+         return FALSE;
       }
+      *colon = '\0';
    }
 
-   fclose(fp);
+   while (*p == ' ' || *p == '\t') {
+      p++;
+   }
+   if (*p < '0' || *p > '9') {
+      return FALSE;
+   }
+
+   *value = 0;
+   while (*p >= '0' && *p <= '9') {
+      *value = *value * 10 + (*p - '0');
+      p++;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoGetUpTime --
+ *
+ *      What time is it?
+ *
+ * Results:
+ *      TRUE   Success! *now is populated
+ *      FALSE  Failure! *now remains unchanged
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+GuestInfoGetUpTime(double *now)  // OUT:
+{
+   double idle;
+   size_t len;
+   char *line = GuestInfoReadProcFile(&guestInfoUpTimeFile, &len);
 
-   return result;
+   return line != NULL && sscanf(line, "%lf %lf", now, &idle) == 2;
 }
 
 
@@ -213,16 +429,16 @@ GuestInfoStoreStat(const char *pathName,  // IN: file stat is in
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoCollectStat --
+ * GuestInfoLookupStat --
  *
- *      Collect a stat.
+ *      Finds the stat a field feeds.
  *
  *      NOTE: Exact match data cannot be used in a regExp. This is a
  *            performance choice. We can discuss this when we have full
  *            programmability.
  *
  * Results:
- *      None.
+ *      The stat, or NULL if the field isn't collected.
  *
  * Side effects:
  *      None.
@@ -230,11 +446,9 @@ GuestInfoStoreStat(const char *pathName,  // IN: file stat is in
  *----------------------------------------------------------------------
  */
 
-static void
-GuestInfoCollectStat(const char *pathName,           // IN:
-                     GuestInfoCollector *collector,  // IN/OUT:
-                     const char *fieldName,          // IN:
-                     uint64 value)                   // IN:
+static GuestInfoStat *
+GuestInfoLookupStat(GuestInfoCollector *collector,  // IN:
+                    const char *fieldName)          // IN:
 {
    GuestInfoStat *stat = NULL;
 
@@ -250,22 +464,19 @@ GuestInfoCollectStat(const char *pathName,           // IN:
       }
    }
 
-   if (stat != NULL) {
-      GuestInfoStoreStat(pathName, stat, value);
-   }
+   return stat;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoReadProcMemInfoData --
+ * GuestInfoStatMatches --
  *
- *      Reads /proc/meminfo to contribute to a collection.
+ *      Checks whether a field still feeds the stat a line was mapped to.
  *
  * Results:
- *      TRUE   Success!
- *      FALSE  Failure!
+ *      TRUE if so.
  *
  * Side effects:
  *      None.
@@ -274,44 +485,14 @@ GuestInfoCollectStat(const char *pathName,           // IN:
  */
 
 static Bool
-GuestInfoProcMemInfoData(GuestInfoCollector *collector)  // IN:
+GuestInfoStatMatches(const GuestInfoStat *stat,  // IN:
+                     const char *fieldName)      // IN:
 {
-   char line[512];
-   FILE *fp = Posix_Fopen(MEMINFO_FILE, "r");
-
-   if (fp == NULL) {
-      g_warning("%s: Error opening " MEMINFO_FILE ".\n", __FUNCTION__);
-      return FALSE;
-   }
-
-   while (fgets(line, sizeof line, fp) == line) {
-      char *p;
-      uint64 value = 0;
-      char *fieldName = strtok(line, " \t");
-      char *fieldData = strtok(NULL, " \t");
-
-      if (fieldName == NULL) {
-         continue;
-      }
-
-      p = strrchr(fieldName, ':');
-      if (p == NULL) {
-         continue;
-      } else {
-        *p = '\0';
-      }
-
-      if ((fieldData == NULL) ||
-          (sscanf(fieldData, "%"FMT64"u", &value) != 1)) {
-         continue;
-      }
-
-      GuestInfoCollectStat(MEMINFO_FILE, collector, fieldName, value);
+   if (stat->query->isRegExp) {
+      return StrUtil_StartsWith(fieldName, stat->query->locatorString);
    }
 
-   fclose(fp);
-
-   return TRUE;
+   return strcmp(fieldName, stat->query->locatorString) == 0;
 }
 
 
@@ -327,41 +508,81 @@ GuestInfoProcMemInfoData(GuestInfoCollector *collector)  // IN:
  *      FALSE  Failure!
  *
  * Side effects:
- *      None.
+ *      Updates the file's line map.
  *
  *----------------------------------------------------------------------
  */
 
 static Bool
-GuestInfoProcData(const char *pathName,           // IN: path name
+GuestInfoProcData(GuestInfoProcFile *file,        // IN/OUT:
                   GuestInfoCollector *collector)  // IN:
 {
-   char line[4096];
-   FILE *fp = Posix_Fopen(pathName, "r");
+   size_t len;
+   uint32 i;
+   uint32 numLines = 0;
+   char *line;
+   char *end;
+   char *buf = GuestInfoReadProcFile(file, &len);
 
-   if (fp == NULL) {
-      g_warning("%s: Error opening %s.\n", __FUNCTION__, pathName);
+   if (buf == NULL) {
+      g_warning("%s: Error reading %s.\n", __FUNCTION__, file->path);
       return FALSE;
    }
+   end = buf + len;
 
-   while (fgets(line, sizeof line, fp) != NULL) {
-      uint64 value = 0;
-      char *fieldName = strtok(line, " \t");
-      char *fieldData = strtok(NULL, " \t");
+   for (line = buf; line < end; numLines++) {
+      char *eol = memchr(line, '\n', end - line);
 
-      if (fieldName == NULL) {
-         continue;
+      line = (eol == NULL) ? end : eol + 1;
+   }
+
+   if (file->lineMap == NULL || numLines != file->numLines) {
+      int *lineMap = realloc(file->lineMap, MAX(numLines, 1) * sizeof *lineMap);
+
+      if (lineMap == NULL) {
+         return FALSE;
       }
+      for (i = 0; i < numLines; i++) {
+         lineMap[i] = GUESTINFO_LINE_UNKNOWN;
+      }
+      file->lineMap = lineMap;
+      file->numLines = numLines;
+   }
 
-      if ((fieldData == NULL) ||
-          (sscanf(fieldData, "%"FMT64"u", &value) != 1)) {
-         continue;
+   for (i = 0, line = buf; i < numLines; i++) {
+      char *eol = memchr(line, '\n', end - line);
+      char *next = (eol == NULL) ? end : eol + 1;
+      int idx = file->lineMap[i];
+      char *fieldName;
+      uint64 value;
+
+      if (eol != NULL) {
+         *eol = '\0';
       }
 
-      GuestInfoCollectStat(pathName, collector, fieldName, value);
-   }
+      if (idx != GUESTINFO_LINE_NONE &&
+          GuestInfoParseLine(line, file->memInfoFormat, &fieldName, &value)) {
+         if (idx >= 0 &&
+             !GuestInfoStatMatches(&collector->stats[idx], fieldName)) {
+            idx = GUESTINFO_LINE_UNKNOWN;
+         }
 
-   fclose(fp);
+         if (idx == GUESTINFO_LINE_UNKNOWN) {
+            GuestInfoStat *stat = GuestInfoLookupStat(collector, fieldName);
+
+            idx = (stat == NULL) ? GUESTINFO_LINE_NONE : stat - collector->stats;
+            file->lineMap[i] = idx;
+         }
+
+         if (idx >= 0) {
+            GuestInfoStoreStat(file->path, &collector->stats[idx], value);
+         }
+      } else if (idx == GUESTINFO_LINE_UNKNOWN) {
+         file->lineMap[i] = GUESTINFO_LINE_NONE;
+      }
+
+      line = next;
+   }
 
    return TRUE;
 }
@@ -477,10 +698,9 @@ GuestInfoCollect(GuestInfoCollector *collector)  // IN:
    }
 
    /* Collect new values */
-   GuestInfoProcMemInfoData(collector);
-   GuestInfoProcData(VMSTAT_FILE, collector);
-   GuestInfoProcData(STAT_FILE, collector);
-   GuestInfoProcData(ZONEINFO_FILE, collector);
+   for (i = 0; i < N_PROC_FILES; i++) {
+      GuestInfoProcData(&guestInfoProcFiles[i], collector);
+   }
    GuestInfoDeriveSwapData(collector);
 
    collector->timeData = GuestInfoGetUpTime(&collector->timeStamp);
@@ -612,91 +832,36 @@ GuestInfoBytesNeededUIntDatum(uint64 value)  // IN:
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoAppendStat --
+ * GuestInfoZigZag --
  *
- *      Append information about the specified stat to the DynBuf of stat
- *      data.
+ *      Maps a signed difference to an unsigned number, small magnitudes
+ *      to small numbers: 0, -1, 1, -2, ... become 0, 1, 2, 3, ...
  *
  * Results:
- *      None.
+ *      The mapped value.
  *
  * Side effects:
- *      Memory may be dynamically allocated (via DynBuf).
+ *      None.
  *
  *----------------------------------------------------------------------
  */
 
-static void
-GuestInfoAppendStat(int errnoValue,                // IN:
-                    Bool emitNameSpace,            // IN:
-                    GuestStatToolsID reportID,     // IN:
-                    GuestValueUnits units,         // IN:
-                    GuestValueType valueType,      // IN:
-                    void *value,                   // IN:
-                    size_t valueSize,              // IN:
-                    DynBuf *stats)                 // IN/OUT:
+static uint64
+GuestInfoZigZag(uint64 delta)  // IN: two's complement difference
 {
-   const char *NameSpace = GUEST_TOOLS_NAMESPACE;
-   uint64 value64;
-   GuestStatHeader header;
-   GuestDatumHeader datum;
-
-   header.datumFlags = GUEST_DATUM_ID |
-                       GUEST_DATUM_VALUE_TYPE_ENUM |
-                       GUEST_DATUM_VALUE_UNIT_ENUM;
-   if (emitNameSpace) {
-      header.datumFlags |= GUEST_DATUM_NAMESPACE;
-   }
-   if (errnoValue == 0) {
-      header.datumFlags |= GUEST_DATUM_VALUE;
-   }
-   DynBuf_Append(stats, &header, sizeof header);
-
-   if (header.datumFlags & GUEST_DATUM_NAMESPACE) {
-      size_t nameSpaceLen = strlen(NameSpace) + 1;
-      datum.dataSize = nameSpaceLen;
-      DynBuf_Append(stats, &datum, sizeof datum);
-      DynBuf_Append(stats, NameSpace, nameSpaceLen);
-   }
-
-   if (header.datumFlags & GUEST_DATUM_ID) {
-      value64 = reportID;
-      datum.dataSize = GuestInfoBytesNeededUIntDatum(value64);
-      DynBuf_Append(stats, &datum, sizeof datum);
-      DynBuf_Append(stats, &value64, datum.dataSize);
-   }
-
-   if (header.datumFlags & GUEST_DATUM_VALUE_TYPE_ENUM) {
-      value64 = valueType;
-      datum.dataSize = GuestInfoBytesNeededUIntDatum(value64);
-      DynBuf_Append(stats, &datum, sizeof datum);
-      DynBuf_Append(stats, &value64, datum.dataSize);
-   }
-
-   if (header.datumFlags & GUEST_DATUM_VALUE_UNIT_ENUM) {
-      value64 = units;
-      datum.dataSize = GuestInfoBytesNeededUIntDatum(value64);
-      DynBuf_Append(stats, &datum, sizeof datum);
-      DynBuf_Append(stats, &value64, datum.dataSize);
-   }
-
-   if (header.datumFlags & GUEST_DATUM_VALUE) {
-      datum.dataSize = valueSize;
-      DynBuf_Append(stats, &datum, sizeof datum);
-      DynBuf_Append(stats, value, valueSize);
-   }
+   return (delta << 1) ^ (uint64) ((int64) delta >> 63);
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoAppendRate --
+ * GuestInfoAppendVarint --
  *
- *      Compute a rate and then append it to the stat buffer.
+ *      Appends a little endian base 128 varint.
  *
  * Results:
- *      None.
+ *      FALSE if out of memory.
  *
  * Side effects:
  *      None.
@@ -704,69 +869,34 @@ GuestInfoAppendStat(int errnoValue,                // IN:
  *----------------------------------------------------------------------
  */
 
-static void
-GuestInfoAppendRate(Bool emitNameSpace,             // IN:
-                    GuestStatToolsID reportID,      // IN: Id of the stat
-                    GuestInfoCollector *current,    // IN: current collection
-                    GuestInfoCollector *previous,   // IN: previous collection
-                    DynBuf *statBuf)                // IN/OUT: stat data
+static Bool
+GuestInfoAppendVarint(DynBuf *buf,   // IN/OUT:
+                      uint64 value)  // IN:
 {
-   double valueDouble = 0.0;
-   int errnoValue = ENOENT;
-   GuestInfoStat *currentStat = NULL;
-   GuestInfoStat *previousStat = NULL;
-
-   HashTable_Lookup(current->reportMap,
-                    INT_AS_HASHKEY(reportID),
-                    (void **) &currentStat);
-
-   HashTable_Lookup(previous->reportMap,
-                    INT_AS_HASHKEY(reportID),
-                    (void **) &previousStat);
-
-   if (current->timeData &&
-       previous->timeData &&
-       ((currentStat != NULL) && (currentStat->err == 0)) &&
-       ((previousStat != NULL) && (previousStat->err == 0))) {
-      double timeDelta = current->timeStamp - previous->timeStamp;
-      double valueDelta = currentStat->value - previousStat->value;
-
-      valueDouble = valueDelta / timeDelta;
-      errnoValue = 0;
-   }
-
-   if (currentStat != NULL) {
-      float valueFloat;
-      void *valuePointer;
-      size_t valueSize;
-
-      if (valueDouble == 0) {
-         valuePointer = NULL;
-         valueSize = 0;
-      } else {
-         valueFloat = (float)valueDouble;
-         if ((double)valueFloat == valueDouble) {
-            valuePointer = &valueFloat;
-            valueSize = sizeof valueFloat;
-         } else {
-            valuePointer = &valueDouble;
-            valueSize = sizeof valueDouble;
-         }
+   unsigned char bytes[10];
+   size_t n = 0;
+
+   do {
+      bytes[n] = value & 0x7F;
+      value >>= 7;
+      if (value != 0) {
+         bytes[n] |= 0x80;
       }
+      n++;
+   } while (value != 0);
 
-      GuestInfoAppendStat(errnoValue, emitNameSpace, reportID,
-                          currentStat->query->units, GuestTypeDouble,
-                          valuePointer, valueSize, statBuf);
-   }
+   return DynBuf_Append(buf, bytes, n);
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoAppendMemNeeded --
+ * GuestInfoBeginCompact --
  *
- *      Synthesize memNeeded and append it to the stat buffer.
+ *      Starts a compact sample: decides whether it's a key frame and
+ *      whether it carries the dictionary, and appends its flags and
+ *      sequence number.
  *
  * Results:
  *      None.
@@ -778,141 +908,2385 @@ GuestInfoAppendRate(Bool emitNameSpace,             // IN:
  */
 
 static void
-GuestInfoAppendMemNeeded(GuestInfoCollector *current,  // IN: current collection
-                         Bool emitNameSpace,           // IN:
-                         DynBuf *statBuf)              // IN/OUT: stats data
+GuestInfoBeginCompact(DynBuf *statBuf)  // IN/OUT:
 {
-   uint64 memNeeded;
-   uint64 memNeededReservation;
-   uint64 memAvailable = 0;
+   GuestInfoCompactState *st = &guestInfoCompact;
+   uint8 flags = 0;
+
+   st->dictionary = st->resync;
+   st->keyFrame = st->resync ||
+                  st->sinceKeyFrame >= GUEST_INFO_COMPACT_KEYFRAME_INTERVAL;
+   st->resync = FALSE;
+
+   if (st->keyFrame) {
+      st->sinceKeyFrame = 0;
+      flags |= GUESTSTATS_COMPACT_KEYFRAME;
+   }
+   if (st->dictionary) {
+      flags |= GUESTSTATS_COMPACT_DICTIONARY;
+   }
+   st->sinceKeyFrame++;
+
+   st->record = 0;
+   free(st->nameSpace);
+   st->nameSpace = NULL;
+
+   DynBuf_Append(statBuf, &flags, sizeof flags);
+   GuestInfoAppendVarint(statBuf, st->sequence++);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoEndCompact --
+ *
+ *      Finishes a compact sample.
+ *
+ * Results:
+ *      FALSE if the sample has a different number of records than the
+ *      previous one but no dictionary; it must be encoded again, with the
+ *      dictionary.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+GuestInfoEndCompact(void)
+{
+   GuestInfoCompactState *st = &guestInfoCompact;
+   Bool consistent = st->dictionary || st->record == st->lastRecords;
+
+   st->lastRecords = st->record;
+   if (!consistent) {
+      st->resync = TRUE;
+   }
+   return consistent;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoFreeCompact --
+ *
+ *      Frees the compact encoding state and disables the encoding.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoFreeCompact(void)
+{
+   free(guestInfoCompact.nameSpace);
+   free(guestInfoCompact.haveValue);
+   free(guestInfoCompact.previous);
+   memset(&guestInfoCompact, 0, sizeof guestInfoCompact);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoAppendCompactStat --
+ *
+ *      Appends a stat record in the compact encoding.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Remembers the value, for the next sample's delta.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoAppendCompactStat(int errnoValue,             // IN:
+                           const char *nameSpace,      // IN: NULL: unchanged
+                           uint32 reportID,            // IN:
+                           GuestValueUnits units,      // IN:
+                           GuestValueType valueType,   // IN:
+                           void *value,                // IN:
+                           size_t valueSize,           // IN:
+                           DynBuf *stats)              // IN/OUT:
+{
+   GuestInfoCompactState *st = &guestInfoCompact;
+   uint32 record = st->record++;
+
+   ASSERT(reportID != 0);
+
+   if (record >= st->maxRecords) {
+      uint32 maxRecords = MAX(64, 2 * st->maxRecords);
+
+      st->haveValue = Util_SafeRealloc(st->haveValue,
+                                       maxRecords * sizeof *st->haveValue);
+      st->previous = Util_SafeRealloc(st->previous,
+                                      maxRecords * sizeof *st->previous);
+      memset(st->haveValue + st->maxRecords, 0,
+             (maxRecords - st->maxRecords) * sizeof *st->haveValue);
+      st->maxRecords = maxRecords;
+   }
+
+   if (nameSpace != NULL) {
+      const char *current = (st->nameSpace != NULL) ? st->nameSpace
+                                                    : GUEST_TOOLS_NAMESPACE;
+
+      if (strcmp(current, nameSpace) != 0) {
+         /* Namespace records only go with the dictionary. */
+         if (st->dictionary) {
+            size_t len = strlen(nameSpace);
+
+            GuestInfoAppendVarint(stats, 0);
+            GuestInfoAppendVarint(stats, len);
+            DynBuf_Append(stats, nameSpace, len);
+         }
+         free(st->nameSpace);
+         st->nameSpace = Util_SafeStrdup(nameSpace);
+      }
+   }
+
+   if (st->dictionary) {
+      GuestInfoAppendVarint(stats, reportID);
+      GuestInfoAppendVarint(stats, valueType);
+      GuestInfoAppendVarint(stats, units);
+   }
+
+   if (errnoValue != 0) {
+      GuestInfoAppendVarint(stats, GUESTSTATS_COMPACT_NONE);
+      st->haveValue[record] = FALSE;
+      return;
+   }
+
+   if (valueType == GuestTypeUint64) {
+      uint64 value64 = 0;
+      uint64 base;
+      uint64 zigZag;
+
+      /* The value is sent truncated to its significant (little endian) bytes. */
+      ASSERT(valueSize <= sizeof value64);
+      memcpy(&value64, value, valueSize);
+
+      base = (st->keyFrame || !st->haveValue[record]) ? 0
+                                                      : st->previous[record];
+      zigZag = GuestInfoZigZag(value64 - base);
+
+      if (zigZag >> (64 - GUESTSTATS_COMPACT_KIND_BITS) == 0) {
+         GuestInfoAppendVarint(stats,
+                               (zigZag << GUESTSTATS_COMPACT_KIND_BITS) |
+                               GUESTSTATS_COMPACT_INTEGER);
+      } else {
+         GuestInfoAppendVarint(stats, GUESTSTATS_COMPACT_RAW64);
+         DynBuf_Append(stats, &value64, sizeof value64);
+      }
+
+      st->previous[record] = value64;
+      st->haveValue[record] = TRUE;
+   } else {
+      double valueDouble = 0.0;
+      float valueFloat;
+
+      ASSERT(valueType == GuestTypeDouble);
+
+      if (valueSize == sizeof valueFloat) {
+         memcpy(&valueFloat, value, sizeof valueFloat);
+         valueDouble = valueFloat;
+      } else if (valueSize == sizeof valueDouble) {
+         memcpy(&valueDouble, value, sizeof valueDouble);
+      } else {
+         ASSERT(valueSize == 0);
+      }
+
+      if (valueDouble >= MIN_INT32 && valueDouble <= MAX_INT32 &&
+          valueDouble == (double) (int32) valueDouble) {
+         uint64 zigZag = GuestInfoZigZag((uint64) (int64) (int32) valueDouble);
+
+         GuestInfoAppendVarint(stats,
+                               (zigZag << GUESTSTATS_COMPACT_KIND_BITS) |
+                               GUESTSTATS_COMPACT_INTEGER);
+      } else if (valueSize == sizeof valueFloat) {
+         GuestInfoAppendVarint(stats, GUESTSTATS_COMPACT_FLOAT);
+         DynBuf_Append(stats, &valueFloat, sizeof valueFloat);
+      } else {
+         GuestInfoAppendVarint(stats, GUESTSTATS_COMPACT_RAW64);
+         DynBuf_Append(stats, &valueDouble, sizeof valueDouble);
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoAppendStat --
+ *
+ *      Append information about the specified stat to the DynBuf of stat
+ *      data.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Memory may be dynamically allocated (via DynBuf).
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoAppendStat(int errnoValue,                // IN:
+                    const char *nameSpace,         // IN: NULL: unchanged
+                    uint32 reportID,               // IN:
+                    GuestValueUnits units,         // IN:
+                    GuestValueType valueType,      // IN:
+                    void *value,                   // IN:
+                    size_t valueSize,              // IN:
+                    DynBuf *stats)                 // IN/OUT:
+{
+   uint64 value64;
+   GuestStatHeader header;
+   GuestDatumHeader datum;
+
+   if (guestInfoCompact.enabled) {
+      GuestInfoAppendCompactStat(errnoValue, nameSpace, reportID, units,
+                                 valueType, value, valueSize, stats);
+      return;
+   }
+
+   header.datumFlags = GUEST_DATUM_ID |
+                       GUEST_DATUM_VALUE_TYPE_ENUM |
+                       GUEST_DATUM_VALUE_UNIT_ENUM;
+   if (nameSpace != NULL) {
+      header.datumFlags |= GUEST_DATUM_NAMESPACE;
+   }
+   if (errnoValue == 0) {
+      header.datumFlags |= GUEST_DATUM_VALUE;
+   }
+   DynBuf_Append(stats, &header, sizeof header);
+
+   if (header.datumFlags & GUEST_DATUM_NAMESPACE) {
+      size_t nameSpaceLen = strlen(nameSpace) + 1;
+      datum.dataSize = nameSpaceLen;
+      DynBuf_Append(stats, &datum, sizeof datum);
+      DynBuf_Append(stats, nameSpace, nameSpaceLen);
+   }
+
+   if (header.datumFlags & GUEST_DATUM_ID) {
+      value64 = reportID;
+      datum.dataSize = GuestInfoBytesNeededUIntDatum(value64);
+      DynBuf_Append(stats, &datum, sizeof datum);
+      DynBuf_Append(stats, &value64, datum.dataSize);
+   }
+
+   if (header.datumFlags & GUEST_DATUM_VALUE_TYPE_ENUM) {
+      value64 = valueType;
+      datum.dataSize = GuestInfoBytesNeededUIntDatum(value64);
+      DynBuf_Append(stats, &datum, sizeof datum);
+      DynBuf_Append(stats, &value64, datum.dataSize);
+   }
+
+   if (header.datumFlags & GUEST_DATUM_VALUE_UNIT_ENUM) {
+      value64 = units;
+      datum.dataSize = GuestInfoBytesNeededUIntDatum(value64);
+      DynBuf_Append(stats, &datum, sizeof datum);
+      DynBuf_Append(stats, &value64, datum.dataSize);
+   }
+
+   if (header.datumFlags & GUEST_DATUM_VALUE) {
+      datum.dataSize = valueSize;
+      DynBuf_Append(stats, &datum, sizeof datum);
+      DynBuf_Append(stats, value, valueSize);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoAppendRate --
+ *
+ *      Compute a rate and then append it to the stat buffer.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoAppendRate(Bool emitNameSpace,             // IN:
+                    GuestStatToolsID reportID,      // IN: Id of the stat
+                    GuestInfoCollector *current,    // IN: current collection
+                    GuestInfoCollector *previous,   // IN: previous collection
+                    DynBuf *statBuf)                // IN/OUT: stat data
+{
+   double valueDouble = 0.0;
+   int errnoValue = ENOENT;
+   GuestInfoStat *currentStat = NULL;
+   GuestInfoStat *previousStat = NULL;
+
+   HashTable_Lookup(current->reportMap,
+                    INT_AS_HASHKEY(reportID),
+                    (void **) &currentStat);
+
+   HashTable_Lookup(previous->reportMap,
+                    INT_AS_HASHKEY(reportID),
+                    (void **) &previousStat);
+
+   if (current->timeData &&
+       previous->timeData &&
+       ((currentStat != NULL) && (currentStat->err == 0)) &&
+       ((previousStat != NULL) && (previousStat->err == 0))) {
+      double timeDelta = current->timeStamp - previous->timeStamp;
+      double valueDelta = currentStat->value - previousStat->value;
+
+      valueDouble = valueDelta / timeDelta;
+      errnoValue = 0;
+   }
+
+   if (currentStat != NULL) {
+      float valueFloat;
+      void *valuePointer;
+      size_t valueSize;
+
+      if (valueDouble == 0) {
+         valuePointer = NULL;
+         valueSize = 0;
+      } else {
+         valueFloat = (float)valueDouble;
+         if ((double)valueFloat == valueDouble) {
+            valuePointer = &valueFloat;
+            valueSize = sizeof valueFloat;
+         } else {
+            valuePointer = &valueDouble;
+            valueSize = sizeof valueDouble;
+         }
+      }
+
+      GuestInfoAppendStat(errnoValue,
+                          emitNameSpace ? GUEST_TOOLS_NAMESPACE : NULL,
+                          reportID,
+                          currentStat->query->units, GuestTypeDouble,
+                          valuePointer, valueSize, statBuf);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoAppendMemNeeded --
+ *
+ *      Synthesize memNeeded and append it to the stat buffer.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoAppendMemNeeded(GuestInfoCollector *current,  // IN: current collection
+                         Bool emitNameSpace,           // IN:
+                         DynBuf *statBuf)              // IN/OUT: stats data
+{
+   uint64 memNeeded;
+   uint64 memNeededReservation;
+   uint64 memAvailable = 0;
    GuestInfoStat *memAvail = NULL;
    GuestInfoStat *memPhysUsable = NULL;
 
-   HashTable_Lookup(current->reportMap,
-                    INT_AS_HASHKEY(GuestStatID_MemPhysUsable),
-                    (void **) &memPhysUsable);
+   HashTable_Lookup(current->reportMap,
+                    INT_AS_HASHKEY(GuestStatID_MemPhysUsable),
+                    (void **) &memPhysUsable);
+
+   ASSERT(memPhysUsable != NULL);
+
+   HashTable_Lookup(current->reportMap,
+                    INT_AS_HASHKEY(GuestStatID_Linux_MemAvailable),
+                    (void **) &memAvail);
+
+   if ((memAvail != NULL) && (memAvail->err == 0)) {
+      memAvailable = memAvail->value;
+   } else {
+      GuestInfoStat *memFree = NULL;
+      GuestInfoStat *memCache = NULL;
+      GuestInfoStat *memBuffers = NULL;
+      GuestInfoStat *memActiveFile = NULL;
+      GuestInfoStat *memSlabReclaim = NULL;
+      GuestInfoStat *memInactiveFile = NULL;
+      GuestInfoStat *lowWaterMark = NULL;
+
+      HashTable_Lookup(current->reportMap,
+                       INT_AS_HASHKEY(GuestStatID_MemFree),
+                       (void **) &memFree);
+      HashTable_Lookup(current->reportMap,
+                       INT_AS_HASHKEY(GuestStatID_Linux_MemCached),
+                       (void **) &memCache);
+      HashTable_Lookup(current->reportMap,
+                       INT_AS_HASHKEY(GuestStatID_Linux_MemBuffers),
+                       (void **) &memBuffers);
+      HashTable_Lookup(current->reportMap,
+                       INT_AS_HASHKEY(GuestStatID_MemActiveFileCache),
+                       (void **) &memActiveFile);
+      HashTable_Lookup(current->reportMap,
+                       INT_AS_HASHKEY(GuestStatID_Linux_MemSlabReclaim),
+                       (void **) &memSlabReclaim);
+      HashTable_Lookup(current->reportMap,
+                       INT_AS_HASHKEY(GuestStatID_Linux_MemInactiveFile),
+                       (void **) &memInactiveFile);
+      HashTable_Lookup(current->reportMap,
+                       INT_AS_HASHKEY(GuestStatID_Linux_LowWaterMark),
+                       (void **) &lowWaterMark);
+
+      if (((memFree != NULL) && (memFree->err == 0)) &&
+          ((memCache != NULL) && (memCache->err == 0)) &&
+          ((memBuffers != NULL) && (memBuffers->err == 0)) &&
+          (memActiveFile != NULL) &&
+          (memSlabReclaim != NULL) &&
+          (memInactiveFile != NULL) &&
+          ((lowWaterMark != NULL) && (lowWaterMark->err == 0))) {
+         uint64 pageCache;
+         unsigned long kbPerPage = sysconf(_SC_PAGESIZE) / 1024UL;
+         uint64 lowWaterMarkValue = lowWaterMark->value * kbPerPage;
+
+         memAvailable = memFree->value - lowWaterMarkValue;
+
+         if ((memActiveFile->err == 0) && (memInactiveFile->err == 0)) {
+            pageCache = memActiveFile->value + memInactiveFile->value;
+         } else {
+            /*
+             * If the kernel is too old to expose Active/Inactive file,
+             * this is the best approxmation for pageCache.
+             */
+            pageCache = memCache->value + memBuffers->value;
+         }
+
+         pageCache -= MIN(pageCache / 2, lowWaterMarkValue);
+         memAvailable += pageCache;
+
+         if (memSlabReclaim->err == 0) {
+            memAvailable += memSlabReclaim->value -
+                            MIN(memSlabReclaim->value / 2, lowWaterMarkValue);
+         }
+
+         if ((int64)memAvailable < 0) {
+            memAvailable = 0;
+         }
+      }
+   }
+
+   if (memPhysUsable->err == 0) {
+      /*
+       * Reserve 5% of physical RAM for surges.
+       */
+      memNeededReservation = memPhysUsable->value / 20;
+
+      if (memAvailable > memNeededReservation) {
+         memAvailable -= memNeededReservation;
+      } else {
+         memAvailable = 0;
+      }
+
+      /*
+       * We got these values from one read of /proc/meminfo. Everything should
+       * really be coherent.
+       */
+      ASSERT(memPhysUsable->value >= memAvailable);
+      memNeeded = memPhysUsable->value - memAvailable;
+   } else {
+      memNeeded = 0;
+      memNeededReservation = 0;
+   }
+
+   GuestInfoAppendStat(0,
+                       emitNameSpace ? GUEST_TOOLS_NAMESPACE : NULL,
+                       GuestStatID_MemNeeded,
+                       GuestUnitsKiB, GuestTypeUint64,
+                       &memNeeded,
+                       GuestInfoBytesNeededUIntDatum(memNeeded),
+                       statBuf);
+
+   emitNameSpace = FALSE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoIsRate --
+ *
+ *      Is the specified unit a rate?
+ *
+ * Results:
+ *      TRUE  Yes
+ *      FALSE No
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+GuestInfoIsRate(GuestValueUnits units)  // IN:
+{
+   return ((units & GuestUnitsModifier_Rate) != 0);
+}
+
+
+/*
+ * Per cgroup stats.
+ *
+ * The cgroups listed in CONFNAME_GUESTINFO_CGROUPSTATS are sampled along with
+ * the system-wide stats, from their cgroup2 interface files. Each cgroup is
+ * reported in its own namespace (see GUEST_STAT_CGROUP_IDS), right after the
+ * tools stats.
+ */
+
+typedef struct {
+   const char          *file;
+   const char          *key;
+   GuestStatCgroupID    reportID;
+} GuestInfoCgroupKey;
+
+/*
+ * The "key value" stats. Keys that map to the same stat are summed:
+ * kernels before 5.9 only have workingset_refault, later ones split it.
+ */
+static const GuestInfoCgroupKey guestInfoCgroupKeys[] = {
+   { "cpu.stat",    "usage_usec",              GuestCgroupStatID_CpuUsage },
+   { "cpu.stat",    "user_usec",               GuestCgroupStatID_CpuUser },
+   { "cpu.stat",    "system_usec",             GuestCgroupStatID_CpuSystem },
+   { "cpu.stat",    "throttled_usec",          GuestCgroupStatID_CpuThrottled },
+   { "cpu.stat",    "nr_throttled",            GuestCgroupStatID_CpuThrottledCount },
+   { "memory.stat", "anon",                    GuestCgroupStatID_MemAnon },
+   { "memory.stat", "file",                    GuestCgroupStatID_MemFile },
+   { "memory.stat", "slab",                    GuestCgroupStatID_MemSlab },
+   { "memory.stat", "shmem",                   GuestCgroupStatID_MemShmem },
+   { "memory.stat", "pgmajfault",              GuestCgroupStatID_MemMajorFaults },
+   { "memory.stat", "workingset_refault",      GuestCgroupStatID_MemRefaults },
+   { "memory.stat", "workingset_refault_anon", GuestCgroupStatID_MemRefaults },
+   { "memory.stat", "workingset_refault_file", GuestCgroupStatID_MemRefaults },
+};
+
+static const GuestValueUnits guestInfoCgroupUnits[GuestCgroupStatID_Max] = {
+   [GuestCgroupStatID_CpuUsage]             = GuestUnitsMicroSeconds,
+   [GuestCgroupStatID_CpuUser]              = GuestUnitsMicroSeconds,
+   [GuestCgroupStatID_CpuSystem]            = GuestUnitsMicroSeconds,
+   [GuestCgroupStatID_CpuThrottled]         = GuestUnitsMicroSeconds,
+   [GuestCgroupStatID_CpuThrottledCount]    = GuestUnitsNumber,
+   [GuestCgroupStatID_MemCurrent]           = GuestUnitsBytes,
+   [GuestCgroupStatID_MemAnon]              = GuestUnitsBytes,
+   [GuestCgroupStatID_MemFile]              = GuestUnitsBytes,
+   [GuestCgroupStatID_MemSlab]              = GuestUnitsBytes,
+   [GuestCgroupStatID_MemShmem]             = GuestUnitsBytes,
+   [GuestCgroupStatID_MemMajorFaults]       = GuestUnitsNumber,
+   [GuestCgroupStatID_MemRefaults]          = GuestUnitsNumber,
+   [GuestCgroupStatID_MemPressureSome]      = GuestUnitsMicroSeconds,
+   [GuestCgroupStatID_MemPressureFull]      = GuestUnitsMicroSeconds,
+   [GuestCgroupStatID_MemPressureSomeAvg10] = GuestUnitsPercent,
+   [GuestCgroupStatID_IoReadBytes]          = GuestUnitsBytes,
+   [GuestCgroupStatID_IoWriteBytes]         = GuestUnitsBytes,
+   [GuestCgroupStatID_IoReadOps]            = GuestUnitsNumber,
+   [GuestCgroupStatID_IoWriteOps]           = GuestUnitsNumber,
+};
+
+typedef struct {
+   Bool    found[GuestCgroupStatID_Max];
+   uint64  value[GuestCgroupStatID_Max];
+   double  someAvg10;      // GuestCgroupStatID_MemPressureSomeAvg10
+} GuestInfoCgroupSample;
+
+/* CONFNAME_GUESTINFO_CGROUPSTATS, and the cgroups it expanded to. */
+static gchar *guestInfoCgroupConfig = NULL;
+static const char *guestInfoCgroupRoot = NULL;
+static GPtrArray *guestInfoCgroups = NULL;
+static gchar *guestInfoCgroupSignature = NULL;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoCgroupRoot --
+ *
+ *      Looks up where the cgroup2 hierarchy is mounted: /sys/fs/cgroup on
+ *      unified systems, /sys/fs/cgroup/unified on hybrid ones.
+ *
+ * Results:
+ *      The mount point, NULL if there is no cgroup2 hierarchy.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static const char *
+GuestInfoCgroupRoot(void)
+{
+   if (access(CGROUP2_ROOT "/cgroup.controllers", F_OK) == 0) {
+      return CGROUP2_ROOT;
+   }
+   if (access(CGROUP2_HYBRID_ROOT "/cgroup.controllers", F_OK) == 0) {
+      return CGROUP2_HYBRID_ROOT;
+   }
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoCgroupAdd --
+ *
+ *      Adds a cgroup to the monitored list, unless it is already there or
+ *      the list is full.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoCgroupAdd(GPtrArray *cgroups,  // IN/OUT:
+                   const char *root,    // IN: cgroup2 mount point
+                   gchar *path)         // IN: relative path, consumed
+{
+   gchar *dir = g_build_filename(root, path, NULL);
+   Bool isCgroup = g_file_test(dir, G_FILE_TEST_IS_DIR);
+   guint i;
+
+   g_free(dir);
+
+   for (i = 0; isCgroup && i < cgroups->len; i++) {
+      if (strcmp(g_ptr_array_index(cgroups, i), path) == 0) {
+         isCgroup = FALSE;
+      }
+   }
+
+   if (!isCgroup) {
+      g_free(path);
+   } else if (cgroups->len == CGROUP_MAX_MONITORED) {
+      g_debug("%s: not monitoring %s, too many cgroups.\n", __FUNCTION__,
+              path);
+      g_free(path);
+   } else {
+      g_ptr_array_add(cgroups, path);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoCgroupCompare --
+ *
+ *      g_ptr_array_sort() callback ordering cgroup paths.
+ *
+ * Results:
+ *      As strcmp().
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static gint
+GuestInfoCgroupCompare(gconstpointer a,  // IN:
+                       gconstpointer b)  // IN:
+{
+   return strcmp(*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoCgroupExpand --
+ *
+ *      Expands CONFNAME_GUESTINFO_CGROUPSTATS into the list of cgroups that
+ *      currently exist. A last path component of "*" stands for every child
+ *      cgroup of its parent, in name order, so that the list (and the layout
+ *      of the samples) stays the same from one sample to the next.
+ *
+ * Results:
+ *      The relative paths (never NULL, possibly empty).
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static GPtrArray *
+GuestInfoCgroupExpand(const char *root)  // IN: cgroup2 mount point
+{
+   GPtrArray *cgroups = g_ptr_array_new();
+   gchar **entries;
+   gchar **entry;
+
+   entries = g_strsplit(guestInfoCgroupConfig, ";", 0);
+   for (entry = entries; *entry != NULL; entry++) {
+      gchar *path = g_strstrip(*entry);
+      size_t len;
+
+      while (*path == '/') {
+         path++;
+      }
+      len = strlen(path);
+      while (len > 0 && path[len - 1] == '/') {
+         path[--len] = '\0';
+      }
+
+      if (len == 0) {
+         continue;
+      }
+      if (strstr(path, "..") != NULL) {
+         g_warning("Ignoring cgroup \"%s\".\n", path);
+         continue;
+      }
+
+      if (strcmp(path, "*") == 0 || g_str_has_suffix(path, "/*")) {
+         gchar *parent = g_strndup(path, len - 1);
+         gchar *dirName = g_build_filename(root, parent, NULL);
+         GDir *dir = g_dir_open(dirName, 0, NULL);
+         GPtrArray *children = g_ptr_array_new();
+         const gchar *name;
+         guint i;
+
+         while (dir != NULL && (name = g_dir_read_name(dir)) != NULL) {
+            g_ptr_array_add(children, g_strconcat(parent, name, NULL));
+         }
+         if (dir != NULL) {
+            g_dir_close(dir);
+         }
+
+         g_ptr_array_sort(children, GuestInfoCgroupCompare);
+         for (i = 0; i < children->len; i++) {
+            GuestInfoCgroupAdd(cgroups, root,
+                               g_ptr_array_index(children, i));
+         }
+
+         g_ptr_array_free(children, TRUE);
+         g_free(dirName);
+         g_free(parent);
+      } else {
+         GuestInfoCgroupAdd(cgroups, root, g_strdup(path));
+      }
+   }
+   g_strfreev(entries);
+
+   return cgroups;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoCgroupRead --
+ *
+ *      Reads one of a cgroup's interface files. Unlike the /proc files,
+ *      these aren't kept open: cgroups come and go.
+ *
+ * Results:
+ *      The NUL-terminated contents (in the shared buffer), NULL on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+GuestInfoCgroupRead(const char *dir,   // IN: the cgroup's directory
+                    const char *name)  // IN: interface file
+{
+   gchar *path = g_build_filename(dir, name, NULL);
+   GuestInfoProcFile file = { path, FALSE, -1, 0, NULL };
+   size_t len;
+   char *contents = GuestInfoReadProcFile(&file, &len);
+
+   if (file.fd >= 0) {
+      close(file.fd);
+   }
+   g_free(path);
+
+   return contents;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoCgroupParseKeys --
+ *
+ *      Parses the "key value" lines of cpu.stat or memory.stat.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the sample with the values found.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoCgroupParseKeys(const char *fileName,           // IN:
+                         char *contents,                 // IN/OUT:
+                         GuestInfoCgroupSample *sample)  // IN/OUT:
+{
+   char *line;
+   char *next;
+
+   for (line = contents; line != NULL && *line != '\0'; line = next) {
+      char *value;
+      uint64 number;
+      uint32 i;
+
+      next = strchr(line, '\n');
+      if (next != NULL) {
+         *next++ = '\0';
+      }
+
+      value = strchr(line, ' ');
+      if (value == NULL) {
+         continue;
+      }
+      *value++ = '\0';
+
+      if (!StrUtil_StrToUint64(&number, value)) {
+         continue;
+      }
+
+      for (i = 0; i < ARRAYSIZE(guestInfoCgroupKeys); i++) {
+         const GuestInfoCgroupKey *key = &guestInfoCgroupKeys[i];
+
+         if (strcmp(key->key, line) == 0 && strcmp(key->file, fileName) == 0) {
+            sample->value[key->reportID] += number;
+            sample->found[key->reportID] = TRUE;
+         }
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoCgroupParsePressure --
+ *
+ *      Parses memory.pressure:
+ *
+ *        some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+ *        full avg10=0.00 avg60=0.00 avg300=0.00 total=0
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the sample with the values found.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoCgroupParsePressure(const char *contents,           // IN:
+                             GuestInfoCgroupSample *sample)  // IN/OUT:
+{
+   const char *line;
+
+   for (line = contents; line != NULL && *line != '\0'; ) {
+      double avg10;
+      uint64 total;
+      Bool some = strncmp(line, "some ", 5) == 0;
+      Bool full = strncmp(line, "full ", 5) == 0;
+
+      if ((some || full) &&
+          sscanf(line + 5, "avg10=%lf avg60=%*f avg300=%*f total=%"FMT64"u",
+                 &avg10, &total) == 2) {
+         GuestStatCgroupID id = some ? GuestCgroupStatID_MemPressureSome
+                                     : GuestCgroupStatID_MemPressureFull;
+
+         sample->value[id] = total;
+         sample->found[id] = TRUE;
+         if (some) {
+            /* Percent doubles go from 0.0 to 1.0. */
+            sample->someAvg10 = avg10 / 100.0;
+            sample->found[GuestCgroupStatID_MemPressureSomeAvg10] = TRUE;
+         }
+      }
+
+      line = strchr(line, '\n');
+      if (line != NULL) {
+         line++;
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoCgroupParseIo --
+ *
+ *      Parses io.stat, one line per device:
+ *
+ *        8:0 rbytes=1459200 wbytes=314773504 rios=192 wios=353 dbytes=0 dios=0
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the sample with the totals over all devices.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoCgroupParseIo(const char *contents,           // IN:
+                       GuestInfoCgroupSample *sample)  // IN/OUT:
+{
+   static const struct {
+      const char         *key;
+      GuestStatCgroupID   reportID;
+   } keys[] = {
+      { "rbytes=", GuestCgroupStatID_IoReadBytes },
+      { "wbytes=", GuestCgroupStatID_IoWriteBytes },
+      { "rios=",   GuestCgroupStatID_IoReadOps },
+      { "wios=",   GuestCgroupStatID_IoWriteOps },
+   };
+   const char *field = contents;
+   uint32 i;
+
+   /* Even a cgroup that did no I/O yet has these. */
+   for (i = 0; i < ARRAYSIZE(keys); i++) {
+      sample->value[keys[i].reportID] = 0;
+      sample->found[keys[i].reportID] = TRUE;
+   }
+
+   while (*field != '\0') {
+      size_t len = strcspn(field, " \n");
+
+      for (i = 0; i < ARRAYSIZE(keys); i++) {
+         size_t keyLen = strlen(keys[i].key);
+
+         if (len > keyLen && strncmp(field, keys[i].key, keyLen) == 0) {
+            sample->value[keys[i].reportID] +=
+               g_ascii_strtoull(field + keyLen, NULL, 10);
+            break;
+         }
+      }
+
+      field += len;
+      field += strspn(field, " \n");
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoCgroupSampleOne --
+ *
+ *      Samples one cgroup. Files that are missing (e.g., the controller is
+ *      not enabled for the cgroup, or the kernel has no PSI) leave their
+ *      stats unset.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoCgroupSampleOne(const char *root,               // IN:
+                         const char *path,               // IN:
+                         GuestInfoCgroupSample *sample)  // OUT:
+{
+   gchar *dir = g_build_filename(root, path, NULL);
+   char *contents;
+
+   memset(sample, 0, sizeof *sample);
+
+   contents = GuestInfoCgroupRead(dir, "cpu.stat");
+   if (contents != NULL) {
+      GuestInfoCgroupParseKeys("cpu.stat", contents, sample);
+   }
+
+   contents = GuestInfoCgroupRead(dir, "memory.current");
+   if (contents != NULL &&
+       StrUtil_StrToUint64(&sample->value[GuestCgroupStatID_MemCurrent],
+                           g_strchomp(contents))) {
+      sample->found[GuestCgroupStatID_MemCurrent] = TRUE;
+   }
+
+   contents = GuestInfoCgroupRead(dir, "memory.stat");
+   if (contents != NULL) {
+      GuestInfoCgroupParseKeys("memory.stat", contents, sample);
+   }
+
+   contents = GuestInfoCgroupRead(dir, "memory.pressure");
+   if (contents != NULL) {
+      GuestInfoCgroupParsePressure(contents, sample);
+   }
+
+   contents = GuestInfoCgroupRead(dir, "io.stat");
+   if (contents != NULL) {
+      GuestInfoCgroupParseIo(contents, sample);
+   }
+
+   g_free(dir);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoCgroupUpdate --
+ *
+ *      Works out the cgroups to sample this time. When they differ from
+ *      the previous sample's, the compact encoding can't send deltas, so
+ *      this must be done before the sample is encoded.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoCgroupUpdate(void)
+{
+   const char *root = NULL;
+   gchar *signature;
+
+   if (guestInfoCgroups != NULL) {
+      g_ptr_array_foreach(guestInfoCgroups, (GFunc) g_free, NULL);
+      g_ptr_array_free(guestInfoCgroups, TRUE);
+      guestInfoCgroups = NULL;
+   }
+
+   if (guestInfoCgroupConfig != NULL) {
+      root = GuestInfoCgroupRoot();
+   }
+
+   if (root != NULL) {
+      guestInfoCgroups = GuestInfoCgroupExpand(root);
+      g_ptr_array_add(guestInfoCgroups, NULL);
+      signature = g_strjoinv(";", (gchar **) guestInfoCgroups->pdata);
+      g_ptr_array_remove_index(guestInfoCgroups, guestInfoCgroups->len - 1);
+   } else {
+      signature = NULL;
+   }
+
+   if (g_strcmp0(signature, guestInfoCgroupSignature) != 0) {
+      g_debug("%s: monitoring cgroups \"%s\".\n", __FUNCTION__,
+              signature != NULL ? signature : "");
+      guestInfoCompact.resync = TRUE;
+   }
+   g_free(guestInfoCgroupSignature);
+   guestInfoCgroupSignature = signature;
+   guestInfoCgroupRoot = root;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoAppendCgroupStats --
+ *
+ *      Samples the monitored cgroups and appends their stats. Each cgroup
+ *      always contributes the same stats, in the same order; the ones that
+ *      couldn't be read have no value.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoAppendCgroupStats(DynBuf *statBuf)  // IN/OUT: stats data
+{
+   guint i;
+
+   if (guestInfoCgroups == NULL) {
+      return;
+   }
+
+   for (i = 0; i < guestInfoCgroups->len; i++) {
+      const char *path = g_ptr_array_index(guestInfoCgroups, i);
+      gchar *nameSpace = g_strconcat(GUEST_CGROUP_NAMESPACE_PREFIX, path,
+                                     NULL);
+      GuestInfoCgroupSample sample;
+      uint32 id;
+
+      GuestInfoCgroupSampleOne(guestInfoCgroupRoot, path, &sample);
+
+      for (id = GuestCgroupStatID_None + 1; id < GuestCgroupStatID_Max; id++) {
+         int err = sample.found[id] ? 0 : ENOENT;
+         const char *statNameSpace = (id == GuestCgroupStatID_None + 1) ?
+                                     nameSpace : NULL;
+
+         if (id == GuestCgroupStatID_MemPressureSomeAvg10) {
+            GuestInfoAppendStat(err, statNameSpace, id,
+                                guestInfoCgroupUnits[id], GuestTypeDouble,
+                                &sample.someAvg10, sizeof sample.someAvg10,
+                                statBuf);
+         } else {
+            GuestInfoAppendStat(err, statNameSpace, id,
+                                guestInfoCgroupUnits[id], GuestTypeUint64,
+                                &sample.value[id],
+                                GuestInfoBytesNeededUIntDatum(sample.value[id]),
+                                statBuf);
+         }
+      }
+
+      g_free(nameSpace);
+   }
+}
+
+
+/*
+ * Balloon driver stats.
+ *
+ * Sampled from the driver's stats, when it has any, and reported in the
+ * GUEST_BALLOON_NAMESPACE namespace after the cgroups. Both sources are
+ * "name value" lines: the vm.vmmemctl_stats sysctl of the FreeBSD driver, and
+ * the Linux vmw_balloon debugfs file, whose lines look like
+ *
+ *    target:             1024 pages
+ *    lock:                 12 (   0 failed)
+ *
+ * and which also reports monitor commands by name (e.g., its second "target"
+ * line), so only the first line with a given name counts. Latency lines carry
+ * BALLOON_LATENCY_BUCKETS counts, bucket i for the calls that took about 2^i
+ * microseconds.
+ */
+
+typedef struct {
+   const char          *key;
+   GuestStatBalloonID   reportID;
+} GuestInfoBalloonKey;
+
+/* Keys that map to the same stat are summed, e.g. small and large pages. */
+static const GuestInfoBalloonKey guestInfoBalloonKeys[] = {
+   { "target",                GuestBalloonStatID_Target },
+   { "current",               GuestBalloonStatID_Current },
+   { "inflated",              GuestBalloonStatID_Inflated },
+   { "deflated",              GuestBalloonStatID_Deflated },
+   { "lock",                  GuestBalloonStatID_Lock },
+   { "lock2m",                GuestBalloonStatID_Lock },
+   { "lockFail",              GuestBalloonStatID_LockFail },
+   { "lock2mFail",            GuestBalloonStatID_LockFail },
+   { "unlock",                GuestBalloonStatID_Unlock },
+   { "unlock2m",              GuestBalloonStatID_Unlock },
+   { "unlockFail",            GuestBalloonStatID_UnlockFail },
+   { "unlock2mFail",          GuestBalloonStatID_UnlockFail },
+   { "primNoSleepAllocFail",  GuestBalloonStatID_AllocFail },
+   { "primCanSleepAllocFail", GuestBalloonStatID_AllocFail },
+   { "errAlloc",              GuestBalloonStatID_RefusedPages },
+   { "primLPageFallback",     GuestBalloonStatID_LPageFallback },
+   { "batched",               GuestBalloonStatID_Batched },
+   { "chunks",                GuestBalloonStatID_Chunks },
+   { "chunks2m",              GuestBalloonStatID_Chunks },
+};
+
+static const GuestValueUnits guestInfoBalloonUnits[GuestBalloonStatID_Max] = {
+   [GuestBalloonStatID_Target]           = GuestUnitsPages,
+   [GuestBalloonStatID_Current]          = GuestUnitsPages,
+   [GuestBalloonStatID_Inflated]         = GuestUnitsPages,
+   [GuestBalloonStatID_Deflated]         = GuestUnitsPages,
+   [GuestBalloonStatID_Lock]             = GuestUnitsNumber,
+   [GuestBalloonStatID_LockFail]         = GuestUnitsNumber,
+   [GuestBalloonStatID_Unlock]           = GuestUnitsNumber,
+   [GuestBalloonStatID_UnlockFail]       = GuestUnitsNumber,
+   [GuestBalloonStatID_AllocFail]        = GuestUnitsNumber,
+   [GuestBalloonStatID_RefusedPages]     = GuestUnitsPages,
+   [GuestBalloonStatID_LPageFallback]    = GuestUnitsNumber,
+   [GuestBalloonStatID_Batched]          = GuestUnitsNumber,
+   [GuestBalloonStatID_Chunks]           = GuestUnitsNumber,
+   [GuestBalloonStatID_LockLatencyP50]   = GuestUnitsMicroSeconds,
+   [GuestBalloonStatID_LockLatencyP99]   = GuestUnitsMicroSeconds,
+   [GuestBalloonStatID_UnlockLatencyP50] = GuestUnitsMicroSeconds,
+   [GuestBalloonStatID_UnlockLatencyP99] = GuestUnitsMicroSeconds,
+};
+
+typedef struct {
+   Bool    found[GuestBalloonStatID_Max];
+   uint64  value[GuestBalloonStatID_Max];
+   Bool    seen[ARRAYSIZE(guestInfoBalloonKeys)];
+   uint64  lockLatency[BALLOON_LATENCY_BUCKETS];
+   uint64  unlockLatency[BALLOON_LATENCY_BUCKETS];
+} GuestInfoBalloonSample;
+
+/* The sample for the stats being encoded, when the driver has stats. */
+static GuestInfoBalloonSample guestInfoBalloon;
+static Bool guestInfoBalloonPresent = FALSE;
+#if !defined(__FreeBSD__)
+static GuestInfoProcFile guestInfoBalloonFile =
+   { BALLOON_STATS_FILE, FALSE, -1, 0, NULL };
+#endif
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoBalloonStore --
+ *
+ *      Accounts for the value of the first line named "name".
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the sample.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoBalloonStore(const char *name,                // IN:
+                      uint64 value,                    // IN:
+                      GuestInfoBalloonSample *sample)  // IN/OUT:
+{
+   uint32 i;
+
+   for (i = 0; i < ARRAYSIZE(guestInfoBalloonKeys); i++) {
+      const GuestInfoBalloonKey *key = &guestInfoBalloonKeys[i];
+
+      if (!sample->seen[i] && strcmp(key->key, name) == 0) {
+         sample->seen[i] = TRUE;
+         sample->value[key->reportID] += value;
+         sample->found[key->reportID] = TRUE;
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoBalloonParse --
+ *
+ *      Parses the driver's "name value" lines. A "(N failed)" after the
+ *      value is the value of "nameFail".
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the sample with the values found. Modifies the contents.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoBalloonParse(char *contents,                  // IN/OUT:
+                      GuestInfoBalloonSample *sample)  // IN/OUT:
+{
+   char *line;
+   char *next;
+
+   for (line = contents; line != NULL && *line != '\0'; line = next) {
+      uint64 *histogram = NULL;
+      char *value;
+      char *end;
+      uint64 number;
+      uint64 failed;
+
+      next = strchr(line, '\n');
+      if (next != NULL) {
+         *next++ = '\0';
+      }
+
+      value = line + strcspn(line, ": ");
+      if (*value == '\0') {
+         continue;
+      }
+      *value++ = '\0';
+      value += strspn(value, ": ");
+
+      if (strcmp(line, "lockLatency") == 0 ||
+          strcmp(line, "lock2mLatency") == 0) {
+         histogram = sample->lockLatency;
+      } else if (strcmp(line, "unlockLatency") == 0 ||
+                 strcmp(line, "unlock2mLatency") == 0) {
+         histogram = sample->unlockLatency;
+      }
+
+      if (histogram != NULL) {
+         uint32 i;
+
+         for (i = 0; i < BALLOON_LATENCY_BUCKETS; i++) {
+            number = g_ascii_strtoull(value, &end, 10);
+            if (end == value) {
+               break;
+            }
+            histogram[i] += number;
+            value = end;
+         }
+         continue;
+      }
+
+      number = g_ascii_strtoull(value, &end, 10);
+      if (end == value) {
+         continue;
+      }
+      GuestInfoBalloonStore(line, number, sample);
+
+      if (sscanf(end, " (%"FMT64"u failed)", &failed) == 1) {
+         gchar *name = g_strconcat(line, "Fail", NULL);
+
+         GuestInfoBalloonStore(name, failed, sample);
+         g_free(name);
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoBalloonPercentile --
+ *
+ *      Works out a percentile of a latency histogram.
+ *
+ * Results:
+ *      TRUE and the upper bound of the bucket the percentile falls in, in
+ *      microseconds, in *value. FALSE if the histogram is empty.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+GuestInfoBalloonPercentile(const uint64 *histogram,  // IN:
+                           uint32 percent,           // IN:
+                           uint64 *value)            // OUT:
+{
+   uint64 total = 0;
+   uint64 count = 0;
+   uint64 rank;
+   uint32 i;
+
+   for (i = 0; i < BALLOON_LATENCY_BUCKETS; i++) {
+      total += histogram[i];
+   }
+   if (total == 0) {
+      return FALSE;
+   }
+
+   rank = (total * percent + 99) / 100;
+   for (i = 0; i < BALLOON_LATENCY_BUCKETS - 1; i++) {
+      count += histogram[i];
+      if (count >= rank) {
+         break;
+      }
+   }
+
+   *value = CONST64U(1) << (i + 1);
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoBalloonUpdate --
+ *
+ *      Samples the balloon driver's stats. When the driver comes or goes,
+ *      the compact encoding can't send deltas, so this must be done before
+ *      the sample is encoded.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoBalloonUpdate(void)
+{
+   GuestInfoBalloonSample *sample = &guestInfoBalloon;
+   Bool present = FALSE;
+   char *contents;
+   uint64 value;
+
+   memset(sample, 0, sizeof *sample);
+
+#if defined(__FreeBSD__)
+   {
+      size_t len = 0;
+
+      contents = NULL;
+      if (sysctlbyname(BALLOON_STATS_SYSCTL, NULL, &len, NULL, 0) == 0) {
+         contents = g_malloc(len + 1);
+         if (sysctlbyname(BALLOON_STATS_SYSCTL, contents, &len,
+                          NULL, 0) == 0) {
+            contents[len] = '\0';
+            GuestInfoBalloonParse(contents, sample);
+            present = TRUE;
+         }
+         g_free(contents);
+      }
+   }
+#else
+   {
+      size_t len;
+
+      contents = GuestInfoReadProcFile(&guestInfoBalloonFile, &len);
+      if (contents != NULL) {
+         GuestInfoBalloonParse(contents, sample);
+         present = TRUE;
+      }
+   }
+#endif
+
+   if (GuestInfoBalloonPercentile(sample->lockLatency, 50, &value)) {
+      sample->value[GuestBalloonStatID_LockLatencyP50] = value;
+      sample->found[GuestBalloonStatID_LockLatencyP50] = TRUE;
+   }
+   if (GuestInfoBalloonPercentile(sample->lockLatency, 99, &value)) {
+      sample->value[GuestBalloonStatID_LockLatencyP99] = value;
+      sample->found[GuestBalloonStatID_LockLatencyP99] = TRUE;
+   }
+   if (GuestInfoBalloonPercentile(sample->unlockLatency, 50, &value)) {
+      sample->value[GuestBalloonStatID_UnlockLatencyP50] = value;
+      sample->found[GuestBalloonStatID_UnlockLatencyP50] = TRUE;
+   }
+   if (GuestInfoBalloonPercentile(sample->unlockLatency, 99, &value)) {
+      sample->value[GuestBalloonStatID_UnlockLatencyP99] = value;
+      sample->found[GuestBalloonStatID_UnlockLatencyP99] = TRUE;
+   }
+
+   if (present != guestInfoBalloonPresent) {
+      g_debug("%s: balloon driver stats %s.\n", __FUNCTION__,
+              present ? "found" : "gone");
+      guestInfoCompact.resync = TRUE;
+   }
+   guestInfoBalloonPresent = present;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoAppendBalloonStats --
+ *
+ *      Appends the balloon driver's stats, when it has any. They are always
+ *      the same stats, in the same order; the ones the driver doesn't
+ *      report have no value.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoAppendBalloonStats(DynBuf *statBuf)  // IN/OUT: stats data
+{
+   GuestInfoBalloonSample *sample = &guestInfoBalloon;
+   uint32 id;
+
+   if (!guestInfoBalloonPresent) {
+      return;
+   }
+
+   for (id = GuestBalloonStatID_None + 1; id < GuestBalloonStatID_Max; id++) {
+      int err = sample->found[id] ? 0 : ENOENT;
+      const char *statNameSpace = (id == GuestBalloonStatID_None + 1) ?
+                                  GUEST_BALLOON_NAMESPACE : NULL;
+
+      GuestInfoAppendStat(err, statNameSpace, id, guestInfoBalloonUnits[id],
+                          GuestTypeUint64, &sample->value[id],
+                          GuestInfoBytesNeededUIntDatum(sample->value[id]),
+                          statBuf);
+   }
+}
+
+
+/*
+ * Time sync stats, copied from the timeSync plugin's TimeSyncStats (when it is
+ * loaded) before each sample is taken, and reported in the
+ * GUEST_TIMESYNC_NAMESPACE namespace after the balloon stats.
+ */
+
+static TimeSyncStats guestInfoTimeSync;
+static Bool guestInfoTimeSyncPresent = FALSE;
+
+static const GuestValueUnits guestInfoTimeSyncUnits[GuestTimeSyncStatID_Max] = {
+   [GuestTimeSyncStatID_Readings]   = GuestUnitsNumber,
+   [GuestTimeSyncStatID_Failures]   = GuestUnitsNumber,
+   [GuestTimeSyncStatID_Steps]      = GuestUnitsNumber,
+   [GuestTimeSyncStatID_Slews]      = GuestUnitsNumber,
+   [GuestTimeSyncStatID_PLLUpdates] = GuestUnitsNumber,
+   [GuestTimeSyncStatID_Noisy]      = GuestUnitsNumber,
+   [GuestTimeSyncStatID_Offset]     = GuestUnitsMicroSeconds,
+   [GuestTimeSyncStatID_EstError]   = GuestUnitsMicroSeconds,
+   [GuestTimeSyncStatID_MaxOffset]  = GuestUnitsMicroSeconds,
+   [GuestTimeSyncStatID_Frequency]  = GuestUnitsNumber,
+   [GuestTimeSyncStatID_SlewState]  = GuestUnitsNumber,
+   [GuestTimeSyncStatID_RttMin]     = GuestUnitsMicroSeconds,
+   [GuestTimeSyncStatID_RttP50]     = GuestUnitsMicroSeconds,
+   [GuestTimeSyncStatID_RttP99]     = GuestUnitsMicroSeconds,
+};
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoAppendTimeSyncStats --
+ *
+ *      Appends the time sync stats, when the timeSync plugin is loaded.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoAppendTimeSyncStats(DynBuf *statBuf)  // IN/OUT: stats data
+{
+   const TimeSyncStats *stats = &guestInfoTimeSync;
+   uint64 value[GuestTimeSyncStatID_Max] = { 0 };
+   Bool found[GuestTimeSyncStatID_Max] = { FALSE };
+   double offset = stats->offset;
+   double frequency = stats->frequency / 65536.0;
+   uint32 id;
+
+   if (!guestInfoTimeSyncPresent) {
+      return;
+   }
+
+   value[GuestTimeSyncStatID_Readings] = stats->syncs;
+   value[GuestTimeSyncStatID_Failures] = stats->failures;
+   value[GuestTimeSyncStatID_Steps] = stats->steps;
+   value[GuestTimeSyncStatID_Slews] = stats->slews;
+   value[GuestTimeSyncStatID_PLLUpdates] = stats->pllUpdates;
+   value[GuestTimeSyncStatID_Noisy] = stats->noisy;
+   value[GuestTimeSyncStatID_EstError] = stats->estError;
+   value[GuestTimeSyncStatID_MaxOffset] = stats->maxOffset;
+   value[GuestTimeSyncStatID_SlewState] = stats->slewState;
+   value[GuestTimeSyncStatID_RttMin] = stats->minRtt;
+   for (id = GuestTimeSyncStatID_None + 1; id < GuestTimeSyncStatID_Max; id++) {
+      found[id] = TRUE;
+   }
+   found[GuestTimeSyncStatID_Frequency] = stats->frequencyValid;
+   found[GuestTimeSyncStatID_RttP50] =
+      TimeSyncStats_RttPercentile(stats, 50,
+                                  &value[GuestTimeSyncStatID_RttP50]);
+   found[GuestTimeSyncStatID_RttP99] =
+      TimeSyncStats_RttPercentile(stats, 99,
+                                  &value[GuestTimeSyncStatID_RttP99]);
+
+   for (id = GuestTimeSyncStatID_None + 1; id < GuestTimeSyncStatID_Max; id++) {
+      int err = found[id] ? 0 : ENOENT;
+      const char *statNameSpace = (id == GuestTimeSyncStatID_None + 1) ?
+                                  GUEST_TIMESYNC_NAMESPACE : NULL;
+
+      if (id == GuestTimeSyncStatID_Offset) {
+         GuestInfoAppendStat(err, statNameSpace, id, guestInfoTimeSyncUnits[id],
+                             GuestTypeDouble, &offset, sizeof offset, statBuf);
+      } else if (id == GuestTimeSyncStatID_Frequency) {
+         GuestInfoAppendStat(err, statNameSpace, id, guestInfoTimeSyncUnits[id],
+                             GuestTypeDouble, &frequency, sizeof frequency,
+                             statBuf);
+      } else {
+         GuestInfoAppendStat(err, statNameSpace, id, guestInfoTimeSyncUnits[id],
+                             GuestTypeUint64, &value[id],
+                             GuestInfoBytesNeededUIntDatum(value[id]),
+                             statBuf);
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoEncodeStats --
+ *
+ *      Encode the guest stats.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoEncodeStats(GuestInfoCollector *current,   // IN: current collection
+                     GuestInfoCollector *previous,  // IN: previous collection
+                     DynBuf *statBuf)               // IN/OUT: stats data
+{
+   uint32 i;
+   GuestMemInfo legacy;
+   Bool emitNameSpace = TRUE;
+
+   /* Provide legacy data for backwards compatibility */
+   GuestInfoLegacy(current, &legacy);
+
+   if (guestInfoCompact.enabled) {
+      legacy.version = GUESTMEMINFO_V6;
+   }
+
+   /* May require a dictionary. */
+   GuestInfoCgroupUpdate();
+   GuestInfoBalloonUpdate();
+
+   DynBuf_Append(statBuf, &legacy, sizeof legacy);
+
+   if (guestInfoCompact.enabled) {
+      GuestInfoBeginCompact(statBuf);
+   }
+
+   /* Provide data in the new, extensible format. */
+   for (i = 0; i < current->numStats; i++) {
+      GuestInfoStat *stat = &current->stats[i];
+
+      if (!stat->query->publish) {
+         continue;
+      }
+
+      if (GuestInfoIsRate(stat->query->units)) {
+         ASSERT(stat->query->dataType == GuestTypeDouble);
+         GuestInfoAppendRate(emitNameSpace, stat->query->reportID,
+                             current, previous, statBuf);
+      } else {
+         ASSERT(stat->query->dataType == GuestTypeUint64);
+         GuestInfoAppendStat(stat->err,
+                             emitNameSpace ? GUEST_TOOLS_NAMESPACE : NULL,
+                             stat->query->reportID,
+                             stat->query->units,
+                             stat->query->dataType,
+                             &stat->value,
+                             GuestInfoBytesNeededUIntDatum(stat->value),
+                             statBuf);
+      }
+
+      emitNameSpace = FALSE; // use the smallest representation
+   }
+
+   GuestInfoAppendMemNeeded(current, emitNameSpace, statBuf);
+
+   GuestInfoAppendCgroupStats(statBuf);
+
+   GuestInfoAppendBalloonStats(statBuf);
+
+   GuestInfoAppendTimeSyncStats(statBuf);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoDestroyCollector --
+ *
+ *      Destroy the collector representation.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoDestroyCollector(GuestInfoCollector *collector)  // IN:
+{
+   if (collector != NULL) {
+      HashTable_Free(collector->exactMatches);
+      HashTable_Free(collector->reportMap);
+      free(collector->regExps);
+      free(collector->stats);
+      free(collector);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoConstructCollector --
+ *
+ *      Construct a collector.
+ *
+ * Results:
+ *      NULL Failure!
+ *     !NULL Success! Collector representation.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static GuestInfoCollector *
+GuestInfoConstructCollector(GuestInfoQuery *queries,  // IN:
+                            uint32 numQueries)        // IN:
+{
+   uint32 i;
+   uint32 regExp = 0;
+   GuestInfoCollector *collector = calloc(1, sizeof *collector);
+
+   if (collector == NULL) {
+      return NULL;
+   }
+
+   collector->reportMap = HashTable_Alloc(256, HASH_INT_KEY, NULL);
+
+   collector->exactMatches = HashTable_Alloc(256,
+                                           HASH_STRING_KEY | HASH_FLAG_COPYKEY,
+                                             NULL);
+
+   collector->numRegExps = 0;
+   for (i = 0; i < numQueries; i++) {
+      if (queries[i].isRegExp && queries[i].collect) {
+         collector->numRegExps++;
+      }
+   }
+
+   collector->numStats = numQueries;
+   collector->stats = calloc(numQueries, sizeof *collector->stats);
+   collector->regExps = calloc(collector->numRegExps, sizeof(GuestInfoStat *));
+
+   if ((collector->exactMatches == NULL) ||
+       (collector->reportMap == NULL) ||
+       ((collector->numRegExps != 0) && (collector->regExps == NULL)) ||
+       ((collector->numStats != 0) && (collector->stats == NULL))) {
+      GuestInfoDestroyCollector(collector);
+      return NULL;
+   }
+
+   regExp = 0;
+
+   for (i = 0; i < numQueries; i++) {
+      GuestInfoQuery *query = &queries[i];
+      GuestInfoStat *stat = &collector->stats[i];
+
+      ASSERT(query->reportID);
+
+      stat->query = query;
+
+      if (!query->collect) {
+         continue;
+      }
+
+      if (query->isRegExp) {
+         ASSERT(query->locatorString);
+
+         collector->regExps[regExp++] = stat;
+      } else {
+         if (query->locatorString != NULL) {
+            HashTable_Insert(collector->exactMatches, query->locatorString,
+                              stat);
+         }
+      }
+
+      /* The report lookup */
+      HashTable_Insert(collector->reportMap, INT_AS_HASHKEY(query->reportID),
+                       stat);
+   }
+
+   return collector;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoTakeSample --
+ *
+ *      Gather performance stats.
+ *
+ * Results:
+ *      TRUE   Success! statBuf contains collected data
+ *      FALSE  Failure! statBuf contains no collected data
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Bool
+GuestInfoTakeSample(DynBuf *statBuf)  // IN/OUT: inited, ready to fill
+{
+   GuestInfoCollector *temp;
+
+   ASSERT(statBuf && DynBuf_GetSize(statBuf) == 0);
+
+   /*
+    * Preallocate space to minimize realloc operations. The buffer is reused
+    * from one sample to the next, so this normally finds the room there.
+    */
+   if (!DynBuf_Reserve(statBuf, GUEST_INFO_PREALLOC_SIZE)) {
+      return FALSE;
+   }
+
+   /* First time through, allocate all necessary memory */
+   if (guestInfoPrevious == NULL) {
+      guestInfoCurrent = GuestInfoConstructCollector(guestInfoQuerySpecTable,
+                                                     N_QUERIES);
+
+      guestInfoPrevious = GuestInfoConstructCollector(guestInfoQuerySpecTable,
+                                                      N_QUERIES);
+   }
+
+   if ((guestInfoCurrent == NULL) ||
+       (guestInfoPrevious == NULL)) {
+      GuestInfoDestroyCollector(guestInfoCurrent);
+      guestInfoCurrent = NULL;
+      GuestInfoDestroyCollector(guestInfoPrevious);
+      guestInfoPrevious = NULL;
+      return FALSE;
+   }
+
+   /* Collect the current data */
+   GuestInfoCollect(guestInfoCurrent);
+
+   /* Encode the captured data */
+   GuestInfoEncodeStats(guestInfoCurrent, guestInfoPrevious, statBuf);
+
+   if (guestInfoCompact.enabled && !GuestInfoEndCompact()) {
+      /* The set of stats changed; send it along. */
+      DynBuf_SetSize(statBuf, 0);
+      GuestInfoEncodeStats(guestInfoCurrent, guestInfoPrevious, statBuf);
+      GuestInfoEndCompact();
+   }
+
+   /* Switch the collections for next time. */
+   temp = guestInfoCurrent;
+   guestInfoCurrent = guestInfoPrevious;
+   guestInfoPrevious = temp;
+
+   return TRUE;
+}
+
+
+/*
+ * High frequency sampling.
+ *
+ * When enabled, a few key metrics are sampled every hf-stats-interval ms into
+ * a fixed size ring buffer. The ring is uploaded in compact batches (see
+ * lib/guestRpc/guesthfstats.x) every time the regular stats are sent, or when
+ * the host asks for it with GUEST_INFO_HFSTATS_FLUSH_CMD.
+ */
+
+#define GUESTINFO_HF_MIN_INTERVAL     50
+#define GUESTINFO_HF_DEFAULT_SAMPLES  1024
+#define GUESTINFO_HF_MAX_SAMPLES      65536
 
-   ASSERT(memPhysUsable != NULL);
+#define GUESTINFO_HF_CPU_VALUES       5
+#define GUESTINFO_HF_MEMORY_VALUES    3
+#define GUESTINFO_HF_SWAP_VALUES      3
+#define GUESTINFO_HF_DISK_VALUES      4
 
-   HashTable_Lookup(current->reportMap,
-                    INT_AS_HASHKEY(GuestStatID_Linux_MemAvailable),
-                    (void **) &memAvail);
+#define GUESTINFO_HF_ALL_METRICS (GUESTHF_METRIC_CPU | GUESTHF_METRIC_MEMORY | \
+                                  GUESTHF_METRIC_SWAP | GUESTHF_METRIC_DISK)
 
-   if ((memAvail != NULL) && (memAvail->err == 0)) {
-      memAvailable = memAvail->value;
+typedef struct {
+   ToolsAppCtx     *ctx;
+   GSource         *timer;
+   uint32           interval;   // ms
+   uint32           metrics;    // GuestHfMetric mask
+   Bool             uploaded;   // At least one batch was accepted
+
+   uint32           numDisks;
+   char             disks[GUESTHFSTATS_MAX_DISKS][GUESTHFSTATS_MAX_DISK_NAME + 1];
+
+   uint32           stride;     // Values per sample, including the time
+   uint32           capacity;   // Samples the ring holds
+   uint32           head;       // Oldest sample
+   uint32           count;
+   uint32           dropped;
+   uint64          *ring;
+   uint64          *prev;       // Scratch sample used when encoding
+
+   DynBuf           data;
+} GuestInfoHfState;
+
+static GuestInfoHfState *guestInfoHf = NULL;
+
+static GuestInfoProcFile guestInfoHfStatFile = { STAT_FILE, FALSE, -1, 0, NULL };
+static GuestInfoProcFile guestInfoHfVmStatFile = { VMSTAT_FILE, FALSE, -1, 0, NULL };
+static GuestInfoProcFile guestInfoHfMemInfoFile = { MEMINFO_FILE, TRUE, -1, 0, NULL };
+static GuestInfoProcFile guestInfoHfPsiFile = { PSI_MEMORY_FILE, FALSE, -1, 0, NULL };
+static GuestInfoProcFile guestInfoHfDiskFile = { DISKSTATS_FILE, FALSE, -1, 0, NULL };
+
+static GuestInfoProcFile *guestInfoHfFiles[] = {
+   &guestInfoHfStatFile,
+   &guestInfoHfVmStatFile,
+   &guestInfoHfMemInfoFile,
+   &guestInfoHfPsiFile,
+   &guestInfoHfDiskFile,
+};
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoHfParseNumbers --
+ *
+ *      Parses up to maxValues blank separated numbers.
+ *
+ * Results:
+ *      The number of values parsed; *cursor points after the last one.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static uint32
+GuestInfoHfParseNumbers(const char **cursor,  // IN/OUT:
+                        uint64 *values,       // OUT:
+                        uint32 maxValues)     // IN:
+{
+   const char *p = *cursor;
+   uint32 n = 0;
+
+   while (n < maxValues) {
+      while (*p == ' ' || *p == '\t') {
+         p++;
+      }
+      if (*p < '0' || *p > '9') {
+         break;
+      }
+
+      values[n] = 0;
+      while (*p >= '0' && *p <= '9') {
+         values[n] = values[n] * 10 + (*p - '0');
+         p++;
+      }
+      n++;
+   }
+
+   *cursor = p;
+   return n;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoHfNextLine --
+ *
+ *      Terminates the line starting at *cursor and advances past it.
+ *
+ * Results:
+ *      The line, or NULL at the end of the buffer.
+ *
+ * Side effects:
+ *      Modifies the buffer.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+GuestInfoHfNextLine(char **cursor,    // IN/OUT:
+                    const char *end)  // IN:
+{
+   char *line = *cursor;
+   char *eol;
+
+   if (line >= end) {
+      return NULL;
+   }
+
+   eol = memchr(line, '\n', end - line);
+   if (eol == NULL) {
+      *cursor = (char *) end;
    } else {
-      GuestInfoStat *memFree = NULL;
-      GuestInfoStat *memCache = NULL;
-      GuestInfoStat *memBuffers = NULL;
-      GuestInfoStat *memActiveFile = NULL;
-      GuestInfoStat *memSlabReclaim = NULL;
-      GuestInfoStat *memInactiveFile = NULL;
-      GuestInfoStat *lowWaterMark = NULL;
+      *eol = '\0';
+      *cursor = eol + 1;
+   }
 
-      HashTable_Lookup(current->reportMap,
-                       INT_AS_HASHKEY(GuestStatID_MemFree),
-                       (void **) &memFree);
-      HashTable_Lookup(current->reportMap,
-                       INT_AS_HASHKEY(GuestStatID_Linux_MemCached),
-                       (void **) &memCache);
-      HashTable_Lookup(current->reportMap,
-                       INT_AS_HASHKEY(GuestStatID_Linux_MemBuffers),
-                       (void **) &memBuffers);
-      HashTable_Lookup(current->reportMap,
-                       INT_AS_HASHKEY(GuestStatID_MemActiveFileCache),
-                       (void **) &memActiveFile);
-      HashTable_Lookup(current->reportMap,
-                       INT_AS_HASHKEY(GuestStatID_Linux_MemSlabReclaim),
-                       (void **) &memSlabReclaim);
-      HashTable_Lookup(current->reportMap,
-                       INT_AS_HASHKEY(GuestStatID_Linux_MemInactiveFile),
-                       (void **) &memInactiveFile);
-      HashTable_Lookup(current->reportMap,
-                       INT_AS_HASHKEY(GuestStatID_Linux_LowWaterMark),
-                       (void **) &lowWaterMark);
+   return line;
+}
 
-      if (((memFree != NULL) && (memFree->err == 0)) &&
-          ((memCache != NULL) && (memCache->err == 0)) &&
-          ((memBuffers != NULL) && (memBuffers->err == 0)) &&
-          (memActiveFile != NULL) &&
-          (memSlabReclaim != NULL) &&
-          (memInactiveFile != NULL) &&
-          ((lowWaterMark != NULL) && (lowWaterMark->err == 0))) {
-         uint64 pageCache;
-         unsigned long kbPerPage = sysconf(_SC_PAGESIZE) / 1024UL;
-         uint64 lowWaterMarkValue = lowWaterMark->value * kbPerPage;
 
-         memAvailable = memFree->value - lowWaterMarkValue;
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoHfSampleCpu --
+ *
+ *      Reads the aggregate CPU times from /proc/stat.
+ *
+ * Results:
+ *      TRUE on success, values populated.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
 
-         if ((memActiveFile->err == 0) && (memInactiveFile->err == 0)) {
-            pageCache = memActiveFile->value + memInactiveFile->value;
-         } else {
-            /*
-             * If the kernel is too old to expose Active/Inactive file,
-             * this is the best approxmation for pageCache.
-             */
-            pageCache = memCache->value + memBuffers->value;
-         }
+static Bool
+GuestInfoHfSampleCpu(uint64 *values)  // OUT:
+{
+   uint64 cpu[8];
+   size_t len;
+   const char *p = GuestInfoReadProcFile(&guestInfoHfStatFile, &len);
 
-         pageCache -= MIN(pageCache / 2, lowWaterMarkValue);
-         memAvailable += pageCache;
+   /* "cpu  user nice system idle iowait irq softirq steal ..." */
+   if (p == NULL || strncmp(p, "cpu ", 4) != 0) {
+      return FALSE;
+   }
+   p += 4;
 
-         if (memSlabReclaim->err == 0) {
-            memAvailable += memSlabReclaim->value -
-                            MIN(memSlabReclaim->value / 2, lowWaterMarkValue);
+   memset(cpu, 0, sizeof cpu);
+   if (GuestInfoHfParseNumbers(&p, cpu, ARRAYSIZE(cpu)) < 4) {
+      return FALSE;
+   }
+
+   values[0] = cpu[0] + cpu[1];
+   values[1] = cpu[2] + cpu[5] + cpu[6];
+   values[2] = cpu[3];
+   values[3] = cpu[4];
+   values[4] = cpu[7];
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoHfSampleMemory --
+ *
+ *      Reads the memory and swap values enabled in metrics from
+ *      /proc/meminfo, /proc/vmstat and /proc/pressure/memory.
+ *
+ * Results:
+ *      None. A value that can't be read is left untouched.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoHfSampleMemory(uint32 metrics,  // IN:
+                        uint64 *mem,     // IN/OUT: memory values
+                        uint64 *swap)    // IN/OUT: swap values
+{
+   size_t len;
+   char *buf;
+   char *cursor;
+   char *line;
+   char *name;
+   uint64 value;
+   uint64 pgscan = 0;
+   Bool havePgscan = FALSE;
+
+   buf = GuestInfoReadProcFile(&guestInfoHfMemInfoFile, &len);
+   if (buf != NULL) {
+      cursor = buf;
+      while ((line = GuestInfoHfNextLine(&cursor, buf + len)) != NULL) {
+         if (!GuestInfoParseLine(line, TRUE, &name, &value)) {
+            continue;
+         }
+         if ((metrics & GUESTHF_METRIC_MEMORY) &&
+             strcmp(name, "MemAvailable") == 0) {
+            mem[0] = value;
+         } else if ((metrics & GUESTHF_METRIC_SWAP) &&
+                    strcmp(name, "SwapFree") == 0) {
+            swap[2] = value;
          }
+      }
+   }
 
-         if ((int64)memAvailable < 0) {
-            memAvailable = 0;
+   buf = GuestInfoReadProcFile(&guestInfoHfVmStatFile, &len);
+   if (buf != NULL) {
+      cursor = buf;
+      while ((line = GuestInfoHfNextLine(&cursor, buf + len)) != NULL) {
+         if (!GuestInfoParseLine(line, FALSE, &name, &value)) {
+            continue;
+         }
+         if (strcmp(name, "pgscan_kswapd") == 0 ||
+             strcmp(name, "pgscan_direct") == 0) {
+            pgscan += value;
+            havePgscan = TRUE;
+         } else if ((metrics & GUESTHF_METRIC_SWAP) == 0) {
+            continue;
+         } else if (strcmp(name, "pswpin") == 0) {
+            swap[0] = value;
+         } else if (strcmp(name, "pswpout") == 0) {
+            swap[1] = value;
          }
       }
    }
 
-   if (memPhysUsable->err == 0) {
-      /*
-       * Reserve 5% of physical RAM for surges.
-       */
-      memNeededReservation = memPhysUsable->value / 20;
+   if ((metrics & GUESTHF_METRIC_MEMORY) == 0) {
+      return;
+   }
 
-      if (memAvailable > memNeededReservation) {
-         memAvailable -= memNeededReservation;
-      } else {
-         memAvailable = 0;
+   if (havePgscan) {
+      mem[1] = pgscan;
+   }
+
+   /* "some avg10=0.00 avg60=0.00 avg300=0.00 total=0"; absent on old kernels. */
+   buf = GuestInfoReadProcFile(&guestInfoHfPsiFile, &len);
+   if (buf != NULL) {
+      const char *total = strstr(buf, "total=");
+
+      if (total != NULL) {
+         total += sizeof "total=" - 1;
+         GuestInfoHfParseNumbers(&total, &mem[2], 1);
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoHfSampleDisks --
+ *
+ *      Reads the I/O counters of the sampled disks from /proc/diskstats.
+ *
+ * Results:
+ *      None. The values of a disk that isn't found are left untouched.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoHfSampleDisks(GuestInfoHfState *hf,  // IN:
+                       uint64 *values)        // IN/OUT:
+{
+   size_t len;
+   char *buf = GuestInfoReadProcFile(&guestInfoHfDiskFile, &len);
+   char *cursor = buf;
+   char *line;
+   uint32 next = 0;
+
+   if (buf == NULL) {
+      return;
+   }
+
+   /*
+    * "major minor name reads merged sectors ms writes merged sectors ms
+    *  in-flight io-ms ..."
+    */
+   while ((line = GuestInfoHfNextLine(&cursor, buf + len)) != NULL) {
+      char name[GUESTHFSTATS_MAX_DISK_NAME + 1];
+      uint64 counters[10];
+      const char *p;
+      int offset;
+      uint32 i;
+
+      if (sscanf(line, "%*u %*u %32s%n", name, &offset) != 1) {
+         continue;
+      }
+
+      /* The disks are usually listed in the order they were found. */
+      for (i = 0; i < hf->numDisks; i++) {
+         uint32 disk = (next + i) % hf->numDisks;
+
+         if (strcmp(hf->disks[disk], name) == 0) {
+            break;
+         }
+      }
+      if (i == hf->numDisks) {
+         continue;
+      }
+      i = (next + i) % hf->numDisks;
+      next = i + 1;
+
+      p = line + offset;
+      if (GuestInfoHfParseNumbers(&p, counters,
+                                  ARRAYSIZE(counters)) == ARRAYSIZE(counters)) {
+         uint64 *disk = &values[i * GUESTINFO_HF_DISK_VALUES];
+
+         disk[0] = counters[2];
+         disk[1] = counters[6];
+         disk[2] = counters[0] + counters[4];
+         disk[3] = counters[9];
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoHfFindDisks --
+ *
+ *      Picks the disks to sample: the whole disks listed in /proc/diskstats
+ *      (i.e., the ones with a /sys/block entry), except loop and RAM disks.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoHfFindDisks(GuestInfoHfState *hf)  // IN/OUT:
+{
+   size_t len;
+   char *buf = GuestInfoReadProcFile(&guestInfoHfDiskFile, &len);
+   char *cursor = buf;
+   char *line;
+
+   hf->numDisks = 0;
+
+   if (buf == NULL) {
+      return;
+   }
+
+   while ((line = GuestInfoHfNextLine(&cursor, buf + len)) != NULL &&
+          hf->numDisks < GUESTHFSTATS_MAX_DISKS) {
+      char *name = hf->disks[hf->numDisks];
+      gchar *sysPath;
+      Bool wholeDisk;
+
+      if (sscanf(line, "%*u %*u %32s", name) != 1 ||
+          strncmp(name, "loop", 4) == 0 ||
+          strncmp(name, "ram", 3) == 0) {
+         continue;
+      }
+
+      sysPath = g_strdup_printf("/sys/block/%s", name);
+      wholeDisk = g_file_test(sysPath, G_FILE_TEST_IS_DIR);
+      g_free(sysPath);
+
+      if (wholeDisk) {
+         hf->numDisks++;
       }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoHfLayout --
+ *
+ *      (Re)allocates the ring for the current metrics and disks. The ring
+ *      must be empty.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+GuestInfoHfLayout(GuestInfoHfState *hf)  // IN/OUT:
+{
+   uint32 stride = 1;
+   uint64 *ring;
+   uint64 *prev;
+
+   ASSERT(hf->count == 0);
+
+   if (hf->metrics & GUESTHF_METRIC_CPU) {
+      stride += GUESTINFO_HF_CPU_VALUES;
+   }
+   if (hf->metrics & GUESTHF_METRIC_MEMORY) {
+      stride += GUESTINFO_HF_MEMORY_VALUES;
+   }
+   if (hf->metrics & GUESTHF_METRIC_SWAP) {
+      stride += GUESTINFO_HF_SWAP_VALUES;
+   }
+   if (hf->metrics & GUESTHF_METRIC_DISK) {
+      stride += hf->numDisks * GUESTINFO_HF_DISK_VALUES;
+   }
 
-      /*
-       * We got these values from one read of /proc/meminfo. Everything should
-       * really be coherent.
-       */
-      ASSERT(memPhysUsable->value >= memAvailable);
-      memNeeded = memPhysUsable->value - memAvailable;
-   } else {
-      memNeeded = 0;
-      memNeededReservation = 0;
+   if (stride == hf->stride && hf->ring != NULL) {
+      return TRUE;
    }
 
-   GuestInfoAppendStat(0,
-                       emitNameSpace,
-                       GuestStatID_MemNeeded,
-                       GuestUnitsKiB, GuestTypeUint64,
-                       &memNeeded,
-                       GuestInfoBytesNeededUIntDatum(memNeeded),
-                       statBuf);
+   ring = realloc(hf->ring, (size_t) hf->capacity * stride * sizeof *ring);
+   if (ring == NULL) {
+      return FALSE;
+   }
+   hf->ring = ring;
 
-   emitNameSpace = FALSE;
+   prev = realloc(hf->prev, stride * sizeof *prev);
+   if (prev == NULL) {
+      return FALSE;
+   }
+   hf->prev = prev;
+
+   hf->stride = stride;
+   hf->head = 0;
+   return TRUE;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoIsRate --
+ * GuestInfoHfSample --
  *
- *      Is the specified unit a rate?
+ *      Timer callback: takes a sample into the ring, overwriting the oldest
+ *      one if the ring is full.
  *
  * Results:
- *      TRUE  Yes
- *      FALSE No
+ *      TRUE, to keep the timer.
  *
  * Side effects:
  *      None.
@@ -920,22 +3294,73 @@ GuestInfoAppendMemNeeded(GuestInfoCollector *current,  // IN: current collection
  *----------------------------------------------------------------------
  */
 
-static Bool
-GuestInfoIsRate(GuestValueUnits units)  // IN:
+static gboolean
+GuestInfoHfSample(gpointer data)  // IN:
 {
-   return ((units & GuestUnitsModifier_Rate) != 0);
+   GuestInfoHfState *hf = data;
+   uint64 *sample;
+   uint64 *values;
+
+   if (hf->count == hf->capacity) {
+      hf->head = (hf->head + 1) % hf->capacity;
+      hf->count--;
+      hf->dropped++;
+   }
+
+   sample = &hf->ring[(size_t) ((hf->head + hf->count) % hf->capacity) *
+                      hf->stride];
+
+   /* A value that can't be read repeats the previous sample's. */
+   if (hf->count > 0) {
+      uint32 last = (hf->head + hf->count - 1) % hf->capacity;
+
+      memcpy(sample, &hf->ring[(size_t) last * hf->stride],
+             hf->stride * sizeof *sample);
+   } else {
+      memset(sample, 0, hf->stride * sizeof *sample);
+   }
+
+   sample[0] = Hostinfo_SystemTimerUS() / 1000;
+   values = &sample[1];
+
+   if (hf->metrics & GUESTHF_METRIC_CPU) {
+      GuestInfoHfSampleCpu(values);
+      values += GUESTINFO_HF_CPU_VALUES;
+   }
+
+   if (hf->metrics & (GUESTHF_METRIC_MEMORY | GUESTHF_METRIC_SWAP)) {
+      uint64 *mem = values;
+      uint64 *swap = values;
+
+      if (hf->metrics & GUESTHF_METRIC_MEMORY) {
+         swap += GUESTINFO_HF_MEMORY_VALUES;
+      }
+      GuestInfoHfSampleMemory(hf->metrics, mem, swap);
+      values = swap;
+      if (hf->metrics & GUESTHF_METRIC_SWAP) {
+         values += GUESTINFO_HF_SWAP_VALUES;
+      }
+   }
+
+   if ((hf->metrics & GUESTHF_METRIC_DISK) && hf->numDisks > 0) {
+      GuestInfoHfSampleDisks(hf, values);
+   }
+
+   hf->count++;
+   return TRUE;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoEncodeStats --
+ * GuestInfoHfSendBatch --
  *
- *      Encode the guest stats.
+ *      Encodes as many of the oldest samples as fit in one batch and sends
+ *      them.
  *
  * Results:
- *      None.
+ *      The number of samples sent, 0 on failure.
  *
  * Side effects:
  *      None.
@@ -943,57 +3368,74 @@ GuestInfoIsRate(GuestValueUnits units)  // IN:
  *----------------------------------------------------------------------
  */
 
-static void
-GuestInfoEncodeStats(GuestInfoCollector *current,   // IN: current collection
-                     GuestInfoCollector *previous,  // IN: previous collection
-                     DynBuf *statBuf)               // IN/OUT: stats data
+static uint32
+GuestInfoHfSendBatch(GuestInfoHfState *hf)  // IN/OUT:
 {
+   GuestHfStats msg;
+   GuestHfStatsV1 v1;
+   GuestHfDiskName names[GUESTHFSTATS_MAX_DISKS];
+   uint64 startTime = hf->ring[(size_t) hf->head * hf->stride];
+   uint32 numSamples;
    uint32 i;
-   GuestMemInfo legacy;
-   Bool emitNameSpace = TRUE;
 
-   /* Provide legacy data for backwards compatibility */
-   GuestInfoLegacy(current, &legacy);
+   DynBuf_SetSize(&hf->data, 0);
+   memset(hf->prev, 0, hf->stride * sizeof *hf->prev);
+   hf->prev[0] = startTime;
 
-   DynBuf_Append(statBuf, &legacy, sizeof legacy);
+   for (numSamples = 0; numSamples < hf->count; numSamples++) {
+      uint32 slot = (hf->head + numSamples) % hf->capacity;
+      const uint64 *sample = &hf->ring[(size_t) slot * hf->stride];
+      size_t mark = DynBuf_GetSize(&hf->data);
 
-   /* Provide data in the new, extensible format. */
-   for (i = 0; i < current->numStats; i++) {
-      GuestInfoStat *stat = &current->stats[i];
+      for (i = 0; i < hf->stride; i++) {
+         if (!GuestInfoAppendVarint(&hf->data,
+                                    GuestInfoZigZag(sample[i] - hf->prev[i]))) {
+            return 0;
+         }
+      }
 
-      if (!stat->query->publish) {
-         continue;
+      if (DynBuf_GetSize(&hf->data) > GUESTHFSTATS_MAX_DATA) {
+         DynBuf_SetSize(&hf->data, mark);
+         break;
       }
+      memcpy(hf->prev, sample, hf->stride * sizeof *sample);
+   }
 
-      if (GuestInfoIsRate(stat->query->units)) {
-         ASSERT(stat->query->dataType == GuestTypeDouble);
-         GuestInfoAppendRate(emitNameSpace, stat->query->reportID,
-                             current, previous, statBuf);
-      } else {
-         ASSERT(stat->query->dataType == GuestTypeUint64);
-         GuestInfoAppendStat(stat->err,
-                             emitNameSpace,
-                             stat->query->reportID,
-                             stat->query->units,
-                             stat->query->dataType,
-                             &stat->value,
-                             GuestInfoBytesNeededUIntDatum(stat->value),
-                             statBuf);
+   ASSERT(numSamples > 0);
+
+   memset(&v1, 0, sizeof v1);
+   v1.startTime = startTime;
+   v1.interval = hf->interval;
+   v1.metrics = hf->metrics;
+   v1.numSamples = numSamples;
+   v1.dropped = hf->dropped;
+   if (hf->metrics & GUESTHF_METRIC_DISK) {
+      for (i = 0; i < hf->numDisks; i++) {
+         names[i] = hf->disks[i];
       }
+      v1.disks.disks_len = hf->numDisks;
+      v1.disks.disks_val = names;
+   }
+   v1.data.data_len = DynBuf_GetSize(&hf->data);
+   v1.data.data_val = DynBuf_Get(&hf->data);
 
-      emitNameSpace = FALSE; // use the smallest representation
+   msg.ver = GUESTHFSTATS_V1;
+   msg.GuestHfStats_u.statsV1 = &v1;
+
+   if (!GuestInfo_ServerReportHfStats(hf->ctx, &msg)) {
+      return 0;
    }
 
-   GuestInfoAppendMemNeeded(current, emitNameSpace, statBuf);
+   return numSamples;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoDestroyCollector --
+ * GuestInfoHfDestroy --
  *
- *      Destroy the collector representation.
+ *      Stops sampling and frees the ring. Pending samples are lost.
  *
  * Results:
  *      None.
@@ -1005,14 +3447,30 @@ GuestInfoEncodeStats(GuestInfoCollector *current,   // IN: current collection
  */
 
 static void
-GuestInfoDestroyCollector(GuestInfoCollector *collector)  // IN:
+GuestInfoHfDestroy(void)
 {
-   if (collector != NULL) {
-      HashTable_Free(collector->exactMatches);
-      HashTable_Free(collector->reportMap);
-      free(collector->regExps);
-      free(collector->stats);
-      free(collector);
+   GuestInfoHfState *hf = guestInfoHf;
+   uint32 i;
+
+   if (hf == NULL) {
+      return;
+   }
+
+   if (hf->timer != NULL) {
+      g_source_destroy(hf->timer);
+      g_source_unref(hf->timer);
+   }
+   DynBuf_Destroy(&hf->data);
+   free(hf->ring);
+   free(hf->prev);
+   free(hf);
+   guestInfoHf = NULL;
+
+   for (i = 0; i < ARRAYSIZE(guestInfoHfFiles); i++) {
+      if (guestInfoHfFiles[i]->fd >= 0) {
+         close(guestInfoHfFiles[i]->fd);
+         guestInfoHfFiles[i]->fd = -1;
+      }
    }
 }
 
@@ -1020,13 +3478,17 @@ GuestInfoDestroyCollector(GuestInfoCollector *collector)  // IN:
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoConstructCollector --
+ * GuestInfo_HfStatsFlush --
  *
- *      Construct a collector.
+ *      Uploads the samples in the ring. Once the ring is empty, the set of
+ *      disks to sample is refreshed, so that added or removed disks show up
+ *      in the next batch.
+ *
+ *      If the host never accepted a batch, it's assumed not to support high
+ *      frequency stats, and sampling stops until the configuration changes.
  *
  * Results:
- *      NULL Failure!
- *     !NULL Success! Collector representation.
+ *      TRUE if nothing is left to upload.
  *
  * Side effects:
  *      None.
@@ -1034,87 +3496,59 @@ GuestInfoDestroyCollector(GuestInfoCollector *collector)  // IN:
  *----------------------------------------------------------------------
  */
 
-static GuestInfoCollector *
-GuestInfoConstructCollector(GuestInfoQuery *queries,  // IN:
-                            uint32 numQueries)        // IN:
+Bool
+GuestInfo_HfStatsFlush(void)
 {
-   uint32 i;
-   uint32 regExp = 0;
-   GuestInfoCollector *collector = calloc(1, sizeof *collector);
+   GuestInfoHfState *hf = guestInfoHf;
 
-   if (collector == NULL) {
-      return NULL;
+   if (hf == NULL) {
+      return TRUE;
    }
 
-   collector->reportMap = HashTable_Alloc(256, HASH_INT_KEY, NULL);
-
-   collector->exactMatches = HashTable_Alloc(256,
-                                           HASH_STRING_KEY | HASH_FLAG_COPYKEY,
-                                             NULL);
-
-   collector->numRegExps = 0;
-   for (i = 0; i < numQueries; i++) {
-      if (queries[i].isRegExp && queries[i].collect) {
-         collector->numRegExps++;
+   while (hf->count > 0) {
+      uint32 sent = GuestInfoHfSendBatch(hf);
+
+      if (sent == 0) {
+         if (!hf->uploaded) {
+            g_info("Host doesn't accept high frequency stats; "
+                   "stopping the sampling.\n");
+            g_source_destroy(hf->timer);
+            g_source_unref(hf->timer);
+            hf->timer = NULL;
+            hf->count = 0;
+         }
+         return FALSE;
       }
-   }
-
-   collector->numStats = numQueries;
-   collector->stats = calloc(numQueries, sizeof *collector->stats);
-   collector->regExps = calloc(collector->numRegExps, sizeof(GuestInfoStat *));
 
-   if ((collector->exactMatches == NULL) ||
-       (collector->reportMap == NULL) ||
-       ((collector->numRegExps != 0) && (collector->regExps == NULL)) ||
-       ((collector->numStats != 0) && (collector->stats == NULL))) {
-      GuestInfoDestroyCollector(collector);
-      return NULL;
+      hf->uploaded = TRUE;
+      hf->head = (hf->head + sent) % hf->capacity;
+      hf->count -= sent;
+      hf->dropped = 0;
    }
 
-   regExp = 0;
-
-   for (i = 0; i < numQueries; i++) {
-      GuestInfoQuery *query = &queries[i];
-      GuestInfoStat *stat = &collector->stats[i];
-
-      ASSERT(query->reportID);
-
-      stat->query = query;
-
-      if (!query->collect) {
-         continue;
-      }
-
-      if (query->isRegExp) {
-         ASSERT(query->locatorString);
-
-         collector->regExps[regExp++] = stat;
-      } else {
-         if (query->locatorString != NULL) {
-            HashTable_Insert(collector->exactMatches, query->locatorString,
-                              stat);
-         }
+   if (hf->metrics & GUESTHF_METRIC_DISK) {
+      GuestInfoHfFindDisks(hf);
+      if (!GuestInfoHfLayout(hf)) {
+         g_warning("Failed to allocate the high frequency stats ring.\n");
+         GuestInfoHfDestroy();
       }
-
-      /* The report lookup */
-      HashTable_Insert(collector->reportMap, INT_AS_HASHKEY(query->reportID),
-                       stat);
    }
 
-   return collector;
+   return TRUE;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoTakeSample --
+ * GuestInfo_HfStatsConfigure --
  *
- *      Gather performance stats.
+ *      Starts, stops or reconfigures high frequency sampling according to
+ *      the hf-stats-* settings. Samples taken with a previous configuration
+ *      are uploaded first.
  *
  * Results:
- *      TRUE   Success! statBuf contains collected data
- *      FALSE  Failure! statBuf contains no collected data
+ *      None.
  *
  * Side effects:
  *      None.
@@ -1122,50 +3556,126 @@ GuestInfoConstructCollector(GuestInfoQuery *queries,  // IN:
  *----------------------------------------------------------------------
  */
 
-Bool
-GuestInfoTakeSample(DynBuf *statBuf)  // IN/OUT: inited, ready to fill
+void
+GuestInfo_HfStatsConfigure(ToolsAppCtx *ctx,  // IN:
+                           gboolean enable)   // IN:
 {
-   GuestInfoCollector *temp;
-   static GuestInfoCollector *current = NULL;
-   static GuestInfoCollector *previous = NULL;
-
-   ASSERT(statBuf && DynBuf_GetSize(statBuf) == 0);
+   GuestInfoHfState *hf;
+   GError *gError = NULL;
+   gint interval = 0;
+   gint capacity = GUESTINFO_HF_DEFAULT_SAMPLES;
+   uint32 metrics = GUESTINFO_HF_ALL_METRICS;
+
+   if (enable) {
+      interval = g_key_file_get_integer(ctx->config, CONFGROUPNAME_GUESTINFO,
+                                        CONFNAME_GUESTINFO_HFSTATSINTERVAL,
+                                        &gError);
+      if (gError != NULL || interval < 0) {
+         if (g_key_file_has_key(ctx->config, CONFGROUPNAME_GUESTINFO,
+                                CONFNAME_GUESTINFO_HFSTATSINTERVAL, NULL)) {
+            g_warning("Invalid %s.%s value. High frequency stats disabled.\n",
+                      CONFGROUPNAME_GUESTINFO,
+                      CONFNAME_GUESTINFO_HFSTATSINTERVAL);
+         }
+         interval = 0;
+      } else if (interval > 0 && interval < GUESTINFO_HF_MIN_INTERVAL) {
+         g_warning("%s.%s is too small. Using %ums.\n",
+                   CONFGROUPNAME_GUESTINFO, CONFNAME_GUESTINFO_HFSTATSINTERVAL,
+                   GUESTINFO_HF_MIN_INTERVAL);
+         interval = GUESTINFO_HF_MIN_INTERVAL;
+      }
+      g_clear_error(&gError);
+   }
 
-   /* Preallocate space to minimize realloc operations. */
-   if (!DynBuf_Enlarge(statBuf, GUEST_INFO_PREALLOC_SIZE)) {
-      return FALSE;
+   if (interval > 0 &&
+       g_key_file_has_key(ctx->config, CONFGROUPNAME_GUESTINFO,
+                          CONFNAME_GUESTINFO_HFSTATSSAMPLES, NULL)) {
+      capacity = g_key_file_get_integer(ctx->config, CONFGROUPNAME_GUESTINFO,
+                                        CONFNAME_GUESTINFO_HFSTATSSAMPLES,
+                                        &gError);
+      if (gError != NULL || capacity <= 0 ||
+          capacity > GUESTINFO_HF_MAX_SAMPLES) {
+         g_warning("Invalid %s.%s value. Using default %u.\n",
+                   CONFGROUPNAME_GUESTINFO, CONFNAME_GUESTINFO_HFSTATSSAMPLES,
+                   GUESTINFO_HF_DEFAULT_SAMPLES);
+         capacity = GUESTINFO_HF_DEFAULT_SAMPLES;
+      }
+      g_clear_error(&gError);
    }
 
-   /* First time through, allocate all necessary memory */
-   if (previous == NULL) {
-      current = GuestInfoConstructCollector(guestInfoQuerySpecTable,
-                                            N_QUERIES);
+   if (interval > 0) {
+      gchar **names = g_key_file_get_string_list(ctx->config,
+                                                 CONFGROUPNAME_GUESTINFO,
+                                              CONFNAME_GUESTINFO_HFSTATSMETRICS,
+                                                 NULL, NULL);
+
+      if (names != NULL) {
+         gchar **name;
+
+         metrics = 0;
+         for (name = names; *name != NULL; name++) {
+            g_strstrip(*name);
+            if (strcmp(*name, "cpu") == 0) {
+               metrics |= GUESTHF_METRIC_CPU;
+            } else if (strcmp(*name, "memory") == 0) {
+               metrics |= GUESTHF_METRIC_MEMORY;
+            } else if (strcmp(*name, "swap") == 0) {
+               metrics |= GUESTHF_METRIC_SWAP;
+            } else if (strcmp(*name, "disk") == 0) {
+               metrics |= GUESTHF_METRIC_DISK;
+            } else if (**name != '\0') {
+               g_warning("Unknown high frequency metric \"%s\".\n", *name);
+            }
+         }
+         g_strfreev(names);
 
-      previous = GuestInfoConstructCollector(guestInfoQuerySpecTable,
-                                             N_QUERIES);
+         if (metrics == 0) {
+            g_warning("No high frequency metric enabled.\n");
+            interval = 0;
+         }
+      }
    }
 
-   if ((current == NULL) ||
-       (previous == NULL)) {
-      GuestInfoDestroyCollector(current);
-      current = NULL;
-      GuestInfoDestroyCollector(previous);
-      previous = NULL;
-      return FALSE;
+   hf = guestInfoHf;
+   if (hf != NULL) {
+      if (hf->interval == interval && hf->capacity == capacity &&
+          hf->metrics == metrics && hf->timer != NULL) {
+         return;
+      }
+      GuestInfo_HfStatsFlush();
+      GuestInfoHfDestroy();
    }
 
-   /* Collect the current data */
-   GuestInfoCollect(current);
+   if (interval == 0) {
+      return;
+   }
 
-   /* Encode the captured data */
-   GuestInfoEncodeStats(current, previous, statBuf);
+   hf = calloc(1, sizeof *hf);
+   if (hf == NULL) {
+      g_warning("Failed to allocate the high frequency stats state.\n");
+      return;
+   }
+   hf->ctx = ctx;
+   hf->interval = interval;
+   hf->capacity = capacity;
+   hf->metrics = metrics;
+   DynBuf_Init(&hf->data);
+   guestInfoHf = hf;
+
+   if (metrics & GUESTHF_METRIC_DISK) {
+      GuestInfoHfFindDisks(hf);
+   }
+   if (!GuestInfoHfLayout(hf)) {
+      g_warning("Failed to allocate the high frequency stats ring.\n");
+      GuestInfoHfDestroy();
+      return;
+   }
 
-   /* Switch the collections for next time. */
-   temp = current;
-   current = previous;
-   previous = temp;
+   hf->timer = g_timeout_source_new(interval);
+   VMTOOLSAPP_ATTACH_SOURCE(ctx, hf->timer, GuestInfoHfSample, hf, NULL);
 
-   return TRUE;
+   g_info("Sampling high frequency stats every %ums, %u samples buffered.\n",
+          interval, capacity);
 }
 
 
@@ -1189,19 +3699,138 @@ gboolean
 GuestInfo_StatProviderPoll(gpointer data)
 {
    ToolsAppCtx *ctx = data;
-   DynBuf stats;
+   const TimeSyncStats *timeSync;
 
    g_debug("Entered guest info stats gather.\n");
 
-   /* Send the vmstats to the VMX. */
-   DynBuf_Init(&stats);
+   /*
+    * The buffer is reused from one sample to the next, unless an unusually
+    * large sample left it big.
+    */
+   if (!guestInfoStatBufInited) {
+      DynBuf_Init(&guestInfoStatBuf);
+      guestInfoStatBufInited = TRUE;
+   }
+   DynBuf_Recycle(&guestInfoStatBuf, GUEST_INFO_STATBUF_MAX_KEEP);
+
+   g_free(guestInfoCgroupConfig);
+   guestInfoCgroupConfig = g_key_file_get_string(ctx->config,
+                                                 CONFGROUPNAME_GUESTINFO,
+                                                 CONFNAME_GUESTINFO_CGROUPSTATS,
+                                                 NULL);
+
+   timeSync = TimeSyncStats_Get(ctx);
+   guestInfoTimeSyncPresent = timeSync != NULL;
+   if (timeSync != NULL) {
+      guestInfoTimeSync = *timeSync;
+   }
 
-   if (!GuestInfoTakeSample(&stats)) {
+   /* Send the vmstats to the VMX. */
+   if (!GuestInfoTakeSample(&guestInfoStatBuf)) {
       g_warning("Failed to get vmstats.\n");
-   } else if (!GuestInfo_ServerReportStats(ctx, &stats)) {
+   } else if (!GuestInfo_ServerReportStats(ctx, &guestInfoStatBuf)) {
       g_warning("Failed to send vmstats.\n");
+
+      /* The host may have missed this sample; don't send deltas against it. */
+      guestInfoCompact.resync = TRUE;
    }
 
-   DynBuf_Destroy(&stats);
+   /* Upload the high frequency samples taken since the last poll. */
+   GuestInfo_HfStatsFlush();
+
    return TRUE;
 }
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfo_StatProviderSetCompact --
+ *
+ *      Switches between the GUESTMEMINFO_V5 and the compact GUESTMEMINFO_V6
+ *      encodings. Enabling the compact encoding starts a new session: the
+ *      next sample carries the dictionary.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+GuestInfo_StatProviderSetCompact(Bool enable)  // IN:
+{
+   if (enable && !guestInfoCompact.enabled) {
+      g_info("Using the compact stats encoding.\n");
+   }
+
+   GuestInfoFreeCompact();
+   guestInfoCompact.enabled = enable;
+   guestInfoCompact.resync = TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfo_StatProviderShutdown --
+ *
+ *      Closes the /proc files and frees the sample state.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+GuestInfo_StatProviderShutdown(void)
+{
+   uint32 i;
+
+   for (i = 0; i <= N_PROC_FILES; i++) {
+      GuestInfoProcFile *file = (i < N_PROC_FILES) ? &guestInfoProcFiles[i]
+                                                   : &guestInfoUpTimeFile;
+
+      if (file->fd >= 0) {
+         close(file->fd);
+         file->fd = -1;
+      }
+      free(file->lineMap);
+      file->lineMap = NULL;
+      file->numLines = 0;
+   }
+
+   free(guestInfoProcBuf);
+   guestInfoProcBuf = NULL;
+   guestInfoProcBufSize = 0;
+
+   GuestInfoDestroyCollector(guestInfoCurrent);
+   guestInfoCurrent = NULL;
+   GuestInfoDestroyCollector(guestInfoPrevious);
+   guestInfoPrevious = NULL;
+
+   if (guestInfoStatBufInited) {
+      DynBuf_Destroy(&guestInfoStatBuf);
+      guestInfoStatBufInited = FALSE;
+   }
+
+   if (guestInfoCgroups != NULL) {
+      g_ptr_array_foreach(guestInfoCgroups, (GFunc) g_free, NULL);
+      g_ptr_array_free(guestInfoCgroups, TRUE);
+      guestInfoCgroups = NULL;
+   }
+   g_free(guestInfoCgroupSignature);
+   guestInfoCgroupSignature = NULL;
+   g_free(guestInfoCgroupConfig);
+   guestInfoCgroupConfig = NULL;
+
+   GuestInfoFreeCompact();
+   GuestInfoHfDestroy();
+}
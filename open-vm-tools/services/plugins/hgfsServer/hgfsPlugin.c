@@ -29,6 +29,7 @@
 
 #define G_LOG_DOMAIN "hgfsd"
 
+#include "conf.h"
 #include "hgfs.h"
 #include "hgfsServerManager.h"
 #include "vm_basic_defs.h"
@@ -66,6 +67,38 @@ HgfsServerShutdown(gpointer src,
 }
 
 
+/**
+ * Logs one line of HGFS server statistics.
+ *
+ * @param[in]  clientData  Unused.
+ * @param[in]  line        Statistics line.
+ */
+
+static void
+HgfsServerLogStats(void *clientData,
+                   const char *line)
+{
+   ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN, "%s\n", line);
+}
+
+
+/**
+ * Dumps the HGFS server request statistics to the state log.
+ *
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      Unused.
+ * @param[in]  plugin   Plugin registration data.
+ */
+
+static void
+HgfsServerDumpState(gpointer src,
+                    ToolsAppCtx *ctx,
+                    ToolsPluginData *plugin)
+{
+   HgfsServerManager_DumpStats(plugin->_private, HgfsServerLogStats, NULL);
+}
+
+
 /**
  * Handles hgfs requests.
  *
@@ -264,6 +297,10 @@ ToolsOnLoad(ToolsAppCtx *ctx)
                               NULL,       // rpc channel unused
                               NULL);      // no rpc callback
 
+   mgrData->writeBehindEnabled =
+      VMTools_ConfigGetBoolean(ctx->config, CONFGROUPNAME_HGFSSERVER,
+                               CONFNAME_HGFSSERVER_WRITEBEHIND, FALSE);
+
    if (!HgfsServerManager_Register(mgrData)) {
       g_warning("HgfsServer_InitState() failed, aborting HGFS server init.\n");
       g_free(mgrData);
@@ -276,6 +313,7 @@ ToolsOnLoad(ToolsAppCtx *ctx)
       };
       ToolsPluginSignalCb sigs[] = {
          { TOOLS_CORE_SIG_CAPABILITIES, HgfsServerCapReg, &regData },
+         { TOOLS_CORE_SIG_DUMP_STATE, HgfsServerDumpState, &regData },
          { TOOLS_CORE_SIG_SHUTDOWN, HgfsServerShutdown, &regData }
       };
       ToolsAppReg regs[] = {
@@ -28,6 +28,7 @@
 #include "vm_basic_defs.h"
 
 #include "conf.h"
+#include "hostinfo.h"
 #include "procMgr.h"
 #include "system.h"
 #include "vmware/guestrpc/powerops.h"
@@ -38,9 +39,17 @@
 #  define INVALID_PID NULL
 #else
 #  define INVALID_PID (GPid) -1
+#include <signal.h>
 #include <sys/wait.h>
 #endif
 
+/*
+ * Directory, under the Tools install path, holding one subdirectory per
+ * power operation (see stateChgDirNames). The scripts found there run
+ * alongside the configured script.
+ */
+#define POWEROPS_SCRIPT_DIR      "powerOpsScripts.d"
+
 #if !defined(__APPLE__)
 #include "vm_version.h"
 #include "embed_version.h"
@@ -57,16 +66,41 @@ static const char *stateChgConfNames[] = {
    CONFNAME_SUSPENDSCRIPT,
 };
 
+static const char *stateChgDirNames[] = {
+   NULL,
+   "poweroff",
+   "poweroff",
+   "poweron",
+   "resume",
+   "suspend",
+};
 
-/** Internal plugin state. */
-typedef struct PowerOpState {
-   GuestOsState         stateChgInProgress;
-   GuestOsState         lastFailedStateChg;
+
+struct PowerOpState;
+
+/** A state change script being run. */
+typedef struct PowerOpScript {
+   struct PowerOpState *state;
+   gchar               *path;
 #if defined(G_PLATFORM_WIN32)
    ProcMgr_AsyncProc   *pid;
 #else
    GPid                 pid;
 #endif
+   GSource             *watch;
+   VmTimeType           start;
+   VmTimeType           end;      // 0 while running
+   gboolean             success;
+} PowerOpScript;
+
+
+/** Internal plugin state. */
+typedef struct PowerOpState {
+   GuestOsState         stateChgInProgress;
+   GuestOsState         lastFailedStateChg;
+   GPtrArray           *scripts;  // Scripts of the state change in progress
+   guint                running;  // How many of them have not exited yet
+   GSource             *timeout;  // Kills the scripts that run too long
    ToolsAppCtx         *ctx;
    gboolean             scriptEnabled[GUESTOS_STATECHANGE_LAST];
 } PowerOpState;
@@ -157,6 +191,14 @@ PowerOpsShutdown(gpointer src,
                  ToolsPluginData *plugin)
 {
    PowerOpState *state = plugin->_private;
+
+   if (state->timeout != NULL) {
+      g_source_destroy(state->timeout);
+      g_source_unref(state->timeout);
+   }
+   if (state->scripts != NULL) {
+      g_ptr_array_free(state->scripts, TRUE);
+   }
    g_free(state);
 }
 
@@ -219,32 +261,172 @@ PowerOpsStateChangeDone(PowerOpState *state,
 }
 
 
+/**
+ * Frees a script entry. Used as the free function of the script array.
+ *
+ * @param[in]  data     The script.
+ */
+
+static void
+PowerOpsScriptFree(gpointer data)
+{
+   PowerOpScript *script = data;
+
+   if (script->watch != NULL) {
+      g_source_destroy(script->watch);
+      g_source_unref(script->watch);
+   }
+   if (script->pid != INVALID_PID) {
+#if defined(G_PLATFORM_WIN32)
+      ProcMgr_Free(script->pid);
+#else
+      g_spawn_close_pid(script->pid);
+#endif
+   }
+   g_free(script->path);
+   g_free(script);
+}
+
+
+/**
+ * Called when all the scripts of a state change are done. Reports how long
+ * each script took to the VMX log, then completes the state change; it
+ * succeeds only if all the scripts did.
+ *
+ * @param[in]  state    Plugin state.
+ */
+
+static void
+PowerOpsScriptsDone(PowerOpState *state)
+{
+   gboolean success = TRUE;
+   GString *msg = g_string_new("log powerops: script durations:");
+   guint i;
+
+   if (state->timeout != NULL) {
+      g_source_destroy(state->timeout);
+      g_source_unref(state->timeout);
+      state->timeout = NULL;
+   }
+
+   for (i = 0; i < state->scripts->len; i++) {
+      PowerOpScript *script = g_ptr_array_index(state->scripts, i);
+      gchar *name = g_path_get_basename(script->path);
+
+      success = success && script->success;
+      g_string_append_printf(msg, " %s=%"FMT64"dms(%s)", name,
+                             (script->end - script->start) / 1000,
+                             script->success ? "ok" : "failed");
+      g_free(name);
+   }
+
+   g_message("%s\n", msg->str + sizeof "log");
+   if (!RpcChannel_Send(state->ctx->rpc, msg->str, msg->len + 1, NULL, NULL)) {
+      g_debug("Unable to log the script durations to the VMX.\n");
+   }
+   g_string_free(msg, TRUE);
+
+   g_ptr_array_free(state->scripts, TRUE);
+   state->scripts = NULL;
+
+   PowerOpsStateChangeDone(state, success);
+}
+
+
+/**
+ * Records the exit of a script. Completes the state change once the last
+ * running script exits.
+ *
+ * @param[in]  script   The script.
+ * @param[in]  success  Whether the script succeeded.
+ */
+
+static void
+PowerOpsScriptExited(PowerOpScript *script,
+                     gboolean success)
+{
+   PowerOpState *state = script->state;
+
+   script->end = Hostinfo_SystemTimerUS();
+   script->success = success;
+
+   /* The source is removed by the caller returning FALSE. */
+   g_source_unref(script->watch);
+   script->watch = NULL;
+
 #if defined(G_PLATFORM_WIN32)
+   ProcMgr_Free(script->pid);
+#else
+   g_spawn_close_pid(script->pid);
+#endif
+   script->pid = INVALID_PID;
+
+   ASSERT(state->running > 0);
+   if (--state->running == 0) {
+      PowerOpsScriptsDone(state);
+   }
+}
+
+
 /**
- * Callback for when the script process finishes on Win32 systems.
+ * Kills the scripts still running when the script timeout expires. Their
+ * exit is then reported through the usual callbacks, as a failure.
  *
- * @param[in]  _state      Plugin state.
+ * @param[in]  _state   Plugin state.
  *
- * @return TRUE if the process is not finished yet.
+ * @return FALSE.
  */
 
 static gboolean
-PowerOpsScriptCallback(gpointer _state)
+PowerOpsScriptTimeout(gpointer _state)
 {
    PowerOpState *state = _state;
+   guint i;
+
+   g_source_unref(state->timeout);
+   state->timeout = NULL;
+
+   for (i = 0; i < state->scripts->len; i++) {
+      PowerOpScript *script = g_ptr_array_index(state->scripts, i);
+
+      if (script->end == 0 && script->pid != INVALID_PID) {
+         g_warning("Script '%s' timed out, killing it.\n", script->path);
+#if defined(G_PLATFORM_WIN32)
+         ProcMgr_KillByPid(ProcMgr_GetPid(script->pid));
+#else
+         kill(script->pid, SIGKILL);
+#endif
+      }
+   }
+   return FALSE;
+}
 
-   ASSERT(state->pid != INVALID_PID);
 
-   if (!ProcMgr_IsAsyncProcRunning(state->pid)) {
+#if defined(G_PLATFORM_WIN32)
+/**
+ * Callback for when a script process finishes on Win32 systems.
+ *
+ * @param[in]  _script     The script.
+ *
+ * @return TRUE if the process is not finished yet.
+ */
+
+static gboolean
+PowerOpsScriptCallback(gpointer _script)
+{
+   PowerOpScript *script = _script;
+
+   ASSERT(script->pid != INVALID_PID);
+
+   if (!ProcMgr_IsAsyncProcRunning(script->pid)) {
       int exitcode;
       gboolean success;
 
-      success = (ProcMgr_GetExitCode(state->pid, &exitcode) == 0 &&
+      success = (ProcMgr_GetExitCode(script->pid, &exitcode) == 0 &&
                  exitcode == 0);
-      g_message("Script exit code: %d, success = %d\n", exitcode, success);
-      PowerOpsStateChangeDone(state, success);
-      ProcMgr_Free(state->pid);
-      state->pid = INVALID_PID;
+      g_message("Script '%s' exit code: %d, success = %d\n",
+                script->path, exitcode, success);
+      PowerOpsScriptExited(script, success);
       return FALSE;
    }
    return TRUE;
@@ -261,15 +443,13 @@ PowerOpsScriptCallback(gpointer _state)
  * process and why it's not working, this should probably be merged with the
  * POSIX code below.
  *
- * @param[in]  state    Plugin state.
- * @param[in]  script   Path to the script to be run.
+ * @param[in]  script   The script to be run.
  *
  * @return Whether started the process successfully.
  */
 
 static gboolean
-PowerOpsRunScript(PowerOpState *state,
-                  gchar *script)
+PowerOpsRunScript(PowerOpScript *script)
 {
    gchar *quoted = NULL;
    ProcMgr_ProcArgs procArgs;
@@ -283,19 +463,21 @@ PowerOpsRunScript(PowerOpState *state,
    procArgs.dwCreationFlags = CREATE_NO_WINDOW;
 
    /* Quote the path if it's not yet quoted. */
-   if (script[0] != '"') {
-      quoted = g_strdup_printf("\"%s\"", script);
+   if (script->path[0] != '"') {
+      quoted = g_strdup_printf("\"%s\"", script->path);
    }
 
-   g_message("Executing script: %s\n", (quoted != NULL) ? quoted : script);
-   state->pid = ProcMgr_ExecAsync((quoted != NULL) ? quoted : script, &procArgs);
+   g_message("Executing script: %s\n",
+             (quoted != NULL) ? quoted : script->path);
+   script->pid = ProcMgr_ExecAsync((quoted != NULL) ? quoted : script->path,
+                                   &procArgs);
    g_free(quoted);
 
-   if (state->pid != NULL) {
-      HANDLE h = ProcMgr_GetAsyncProcSelectable(state->pid);
-      GSource *watch = VMTools_NewHandleSource(h);
-      VMTOOLSAPP_ATTACH_SOURCE(state->ctx, watch, PowerOpsScriptCallback, state, NULL);
-      g_source_unref(watch);
+   if (script->pid != NULL) {
+      HANDLE h = ProcMgr_GetAsyncProcSelectable(script->pid);
+      script->watch = VMTools_NewHandleSource(h);
+      VMTOOLSAPP_ATTACH_SOURCE(script->state->ctx, script->watch,
+                               PowerOpsScriptCallback, script, NULL);
       return TRUE;
    } else {
       g_warning("Failed to start script: out of memory?\n");
@@ -306,11 +488,11 @@ PowerOpsRunScript(PowerOpState *state,
 #else
 
 /**
- * Callback for when the script process finishes on POSIX systems.
+ * Callback for when a script process finishes on POSIX systems.
  *
  * @param[in]  pid         Child pid.
  * @param[in]  exitStatus  Exit status of script.
- * @param[in]  _state      Plugin state.
+ * @param[in]  _script     The script.
  *
  * @return FALSE.
  */
@@ -318,28 +500,27 @@ PowerOpsRunScript(PowerOpState *state,
 static gboolean
 PowerOpsScriptCallback(GPid pid,
                        gint exitStatus,
-                       gpointer _state)
+                       gpointer _script)
 {
-   PowerOpState *state = _state;
+   PowerOpScript *script = _script;
    gboolean success = exitStatus == 0;
 
-   ASSERT(state->pid != INVALID_PID);
+   ASSERT(script->pid != INVALID_PID);
 
    if (WIFEXITED(exitStatus)) {
-      g_message("Script exit code: %d, success = %d\n",
-                WEXITSTATUS(exitStatus), success);
+      g_message("Script '%s' exit code: %d, success = %d\n",
+                script->path, WEXITSTATUS(exitStatus), success);
    } else if (WIFSIGNALED(exitStatus)) {
-      g_message("Script killed by signal: %d, success = %d\n",
-                WTERMSIG(exitStatus), success);
+      g_message("Script '%s' killed by signal: %d, success = %d\n",
+                script->path, WTERMSIG(exitStatus), success);
    } else if (WIFSTOPPED(exitStatus)) {
-      g_message("Script stopped by signal: %d, success = %d\n",
-                WSTOPSIG(exitStatus), success);
+      g_message("Script '%s' stopped by signal: %d, success = %d\n",
+                script->path, WSTOPSIG(exitStatus), success);
    } else {
-      g_message("Script exit status: %d, success = %d\n", exitStatus, success);
+      g_message("Script '%s' exit status: %d, success = %d\n",
+                script->path, exitStatus, success);
    }
-   PowerOpsStateChangeDone(_state, success);
-   g_spawn_close_pid(state->pid);
-   state->pid = INVALID_PID;
+   PowerOpsScriptExited(script, success);
    return FALSE;
 }
 
@@ -350,21 +531,18 @@ PowerOpsScriptCallback(GPid pid,
  * (instead of having to poll the process every once in a while when using
  * ProcMgr.)
  *
- * @param[in]  state    Plugin state.
- * @param[in]  script   Path to the script to be run.
+ * @param[in]  script   The script to be run.
  *
  * @return Whether started the process successfully.
  */
 
 static gboolean
-PowerOpsRunScript(PowerOpState *state,
-                  gchar *script)
+PowerOpsRunScript(PowerOpScript *script)
 {
    gchar *argv[2];
-   GSource *watch;
    GError *err = NULL;
 
-   argv[0] = g_locale_from_utf8(script, -1, NULL, NULL, &err);
+   argv[0] = g_locale_from_utf8(script->path, -1, NULL, NULL, &err);
    if (err != NULL) {
       g_debug("Conversion error: %s\n", err->message);
       g_clear_error(&err);
@@ -372,11 +550,11 @@ PowerOpsRunScript(PowerOpState *state,
        * If we could not convert to current locate let's hope that
        * what we have is a useable script name and use it directly.
        */
-      argv[0] = g_strdup(script);
+      argv[0] = g_strdup(script->path);
    }
    argv[1] = NULL;
 
-   g_message("Executing script: '%s'\n", script);
+   g_message("Executing script: '%s'\n", script->path);
    if (!g_spawn_async(NULL,
                       argv,
                       NULL,
@@ -385,7 +563,7 @@ PowerOpsRunScript(PowerOpState *state,
                       G_SPAWN_STDERR_TO_DEV_NULL,
                       NULL,
                       NULL,
-                      &state->pid,
+                      &script->pid,
                       &err)) {
          g_warning("Error starting script: %s\n", err->message);
          g_clear_error(&err);
@@ -394,15 +572,135 @@ PowerOpsRunScript(PowerOpState *state,
    }
 
    /* Setup a watch for when the child is done. */
-   watch = g_child_watch_source_new(state->pid);
-   VMTOOLSAPP_ATTACH_SOURCE(state->ctx, watch, PowerOpsScriptCallback, state, NULL);
-   g_source_unref(watch);
+   script->watch = g_child_watch_source_new(script->pid);
+   VMTOOLSAPP_ATTACH_SOURCE(script->state->ctx, script->watch,
+                            PowerOpsScriptCallback, script, NULL);
    g_free(argv[0]);
    return TRUE;
 }
 #endif
 
 
+/**
+ * Adds a script to the scripts of the state change in progress.
+ *
+ * @param[in]  state    Plugin state.
+ * @param[in]  path     Path to the script; ownership is taken.
+ */
+
+static void
+PowerOpsAddScript(PowerOpState *state,
+                  gchar *path)
+{
+   PowerOpScript *script = g_new0(PowerOpScript, 1);
+
+   script->state = state;
+   script->path = path;
+   script->pid = INVALID_PID;
+   g_ptr_array_add(state->scripts, script);
+}
+
+
+/**
+ * Adds the scripts of the power operation's script directory, if there is
+ * one, to the scripts of the state change in progress. Hidden files and
+ * subdirectories are ignored.
+ *
+ * @param[in]  state    Plugin state.
+ * @param[in]  op       Name of the operation's subdirectory.
+ */
+
+static void
+PowerOpsAddScriptDir(PowerOpState *state,
+                     const char *op)
+{
+   char *installPath = GuestApp_GetInstallPath();
+   gchar *dirPath;
+   GDir *dir;
+   const gchar *name;
+
+   if (installPath == NULL) {
+      return;
+   }
+
+   dirPath = g_build_filename(installPath, POWEROPS_SCRIPT_DIR, op, NULL);
+   vm_free(installPath);
+
+   dir = g_dir_open(dirPath, 0, NULL);
+   if (dir == NULL) {
+      g_free(dirPath);
+      return;
+   }
+
+   while ((name = g_dir_read_name(dir)) != NULL) {
+      gchar *path;
+
+      if (name[0] == '.') {
+         continue;
+      }
+
+      path = g_build_filename(dirPath, name, NULL);
+      if (g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+         gchar *utf8 = g_filename_to_utf8(path, -1, NULL, NULL, NULL);
+
+         if (utf8 != NULL) {
+            PowerOpsAddScript(state, utf8);
+         } else {
+            g_warning("Skipping script with an invalid name in %s.\n",
+                      dirPath);
+         }
+      }
+      g_free(path);
+   }
+
+   g_dir_close(dir);
+   g_free(dirPath);
+}
+
+
+/**
+ * Starts all the scripts of the state change in progress at once, and arms
+ * the script timeout if one is configured. Since the scripts start together,
+ * the timeout bounds each script as well as the whole state change.
+ *
+ * @param[in]  state    Plugin state.
+ *
+ * @return Whether at least one script was started.
+ */
+
+static gboolean
+PowerOpsRunScripts(PowerOpState *state)
+{
+   gint timeout;
+   guint i;
+
+   for (i = 0; i < state->scripts->len; i++) {
+      PowerOpScript *script = g_ptr_array_index(state->scripts, i);
+
+      script->start = Hostinfo_SystemTimerUS();
+      if (PowerOpsRunScript(script)) {
+         state->running++;
+      } else {
+         script->end = script->start;
+         script->success = FALSE;
+      }
+   }
+
+   if (state->running == 0) {
+      return FALSE;
+   }
+
+   timeout = VMTools_ConfigGetInteger(state->ctx->config, "powerops",
+                                      CONFNAME_POWEROPS_SCRIPTTIMEOUT, 0);
+   if (timeout > 0) {
+      state->timeout = g_timeout_source_new_seconds(timeout);
+      VMTOOLSAPP_ATTACH_SOURCE(state->ctx, state->timeout,
+                               PowerOpsScriptTimeout, state, NULL);
+   }
+   return TRUE;
+}
+
+
 /**
  * Handler for commands which invoke state change scripts. Runs the configured
  * script for the power operation signaled by the host.
@@ -418,7 +716,7 @@ PowerOpsStateChange(RpcInData *data)
    size_t i;
    PowerOpState *state = data->clientData;
 
-   if (state->pid != INVALID_PID) {
+   if (state->scripts != NULL) {
       g_debug("State change already in progress.\n");
       return RPCIN_SETRETVALS(data,  "State change already in progress", FALSE);
    }
@@ -442,6 +740,8 @@ PowerOpsStateChange(RpcInData *data)
             return RPCIN_SETRETVALS(data, "", TRUE);
          }
 
+         state->scripts = g_ptr_array_new_with_free_func(PowerOpsScriptFree);
+
          confName = stateChgConfNames[stateChangeCmdTable[i].id];
          script = g_key_file_get_string(state->ctx->config,
                                         "powerops",
@@ -454,20 +754,18 @@ PowerOpsStateChange(RpcInData *data)
             if (dfltScript == NULL) {
                g_debug("No default script to run for state change %s.\n",
                        stateChangeCmdTable[i].name);
-               PowerOpsStateChangeDone(state, TRUE);
-               return RPCIN_SETRETVALS(data, "", TRUE);
+            } else {
+               script = g_strdup(dfltScript);
             }
-            script = g_strdup(dfltScript);
          } else if (strlen(script) == 0) {
             g_debug("No script to run for state change %s.\n",
                     stateChangeCmdTable[i].name);
             g_free(script);
-            PowerOpsStateChangeDone(state, TRUE);
-            return RPCIN_SETRETVALS(data, "", TRUE);
+            script = NULL;
          }
 
          /* If script path is not absolute, assume the Tools install path. */
-         if (!g_path_is_absolute(script)) {
+         if (script != NULL && !g_path_is_absolute(script)) {
             char *dfltPath;
             char *tmp;
 
@@ -493,16 +791,30 @@ PowerOpsStateChange(RpcInData *data)
             script = tmp;
          }
 
-         if (PowerOpsRunScript(state, script)) {
+         if (script != NULL) {
+            PowerOpsAddScript(state, script);
+         }
+         PowerOpsAddScriptDir(state,
+                              stateChgDirNames[stateChangeCmdTable[i].id]);
+
+         if (state->scripts->len == 0) {
+            g_ptr_array_free(state->scripts, TRUE);
+            state->scripts = NULL;
+            PowerOpsStateChangeDone(state, TRUE);
+            return RPCIN_SETRETVALS(data, "", TRUE);
+         }
+
+         if (PowerOpsRunScripts(state)) {
             result = "";
             ret = TRUE;
          } else {
+            g_ptr_array_free(state->scripts, TRUE);
+            state->scripts = NULL;
             PowerOpsStateChangeDone(state, FALSE);
             result = "Error starting script";
             ret = FALSE;
          }
 
-         g_free(script);
          return RPCIN_SETRETVALS(data, (char *) result, ret);
       }
    }
@@ -544,7 +856,6 @@ ToolsOnLoad(ToolsAppCtx *ctx)
 
    state = g_malloc0(sizeof *state);
    state->ctx = ctx;
-   state->pid = INVALID_PID;
 
    for (i = 0; i < GUESTOS_STATECHANGE_LAST; i++) {
       state->scriptEnabled[i] = TRUE;
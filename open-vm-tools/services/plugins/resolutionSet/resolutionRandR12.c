@@ -365,6 +365,8 @@ RandR12GetInfo(Display *display,     // IN: Pointer to our display connection
  *      The function disables crtcs and associated outputs
  *      1) whose scanout area is too big for the new fb size.
  *      2) that are going to be disabled with the new topology.
+ *      Crtcs that are already disabled are left alone, so that no
+ *      crtc costs more than one server round-trip here.
  *
  * Results:
  *      TRUE on success, FALSE on failure.
@@ -387,7 +389,7 @@ RandR12CrtcDisable(Display *display,       // IN: Pointer to display
 {
    XRRScreenResources *xrrRes = info->xrrRes;
    XRRCrtcInfo *crtc;
-   unsigned int i;
+   unsigned int i, j;
 
    for (i = 0; i < info->nCrtc; ++i) {
       crtc = info->crtcs[i];
@@ -400,19 +402,25 @@ RandR12CrtcDisable(Display *display,       // IN: Pointer to display
              Success) {
             return FALSE;
          }
+
+         for (j = 0; j < info->nOutput; ++j) {
+            if (info->outputs[j].crtc == i) {
+               info->outputs[j].mode = None;
+            }
+         }
       }
    }
 
    for (i = ndisplays; i < info->nOutput; ++i) {
-      crtc = info->crtcs[info->outputs[i].crtc];
+      RandR12Output *rrOutput = &info->outputs[i];
 
-      if (crtc->mode != None &&
-          XRRSetCrtcConfig(display, xrrRes, xrrRes->crtcs[i],
+      if (rrOutput->mode != None &&
+          XRRSetCrtcConfig(display, xrrRes, xrrRes->crtcs[rrOutput->crtc],
                            CurrentTime, 0, 0, None, RR_Rotate_0, NULL, 0) !=
           Success) {
          return FALSE;
       }
-      info->outputs[i].mode = None;
+      rrOutput->mode = None;
    }
 
    return TRUE;
@@ -528,6 +536,8 @@ RandR12GetDpi(Display *display,   // IN: Pointer to the display connection
  *      Set a new fb size, verify that the change went through and update
  *      the display structure.
  *
+ *      Nothing is sent to the server if the fb already has the new size.
+ *
  * Results:
  *      Returns TRUE if function succeeds, FALSE otherwise. Upon failure,
  *      the function will make an attempt to restore the previous dimensions.
@@ -554,6 +564,11 @@ RandR12SetSizeVerify(Display *display,  // IN/OUT: Pointer to the display
    unsigned int ymm;
    Bool event = FALSE;
 
+   if (width == info->origWidth && height == info->origHeight) {
+      g_debug("%s: Keeping screenSize %d %d\n", __func__, width, height);
+      return TRUE;
+   }
+
    xmm = (int)(MILLIS_PER_INCH * width / ((double)info->xdpi) + 0.5);
    ymm = (int)(MILLIS_PER_INCH * height / ((double)info->ydpi) + 0.5);
 
@@ -755,6 +770,8 @@ RandR12MatchMode(Display *display,        // IN: Pointer to display connection
  *
  *      Set up an output and it's associated CRTC to scanout and show a
  *      specified region of the frame-buffer.
+ *      If the CRTC already shows that region with the right mode, it is
+ *      left untouched, to avoid a needless mode set and round-trip.
  *
  * Results:
  *      Returns TRUE on success. FALSE on failure.
@@ -779,6 +796,7 @@ RandR12SetupOutput(Display *display,        // IN: The display connection
                    int height)              // IN: Height of scanout area
 {
    RRCrtc crtcID = info->xrrRes->crtcs[rrOutput->crtc];
+   XRRCrtcInfo *crtc = info->crtcs[rrOutput->crtc];
    XRRModeInfo *mode;
    Status ret;
 
@@ -792,6 +810,18 @@ RandR12SetupOutput(Display *display,        // IN: The display connection
       return FALSE;
    }
 
+   /*
+    * rrOutput->mode is None if the crtc was disabled since the crtc info
+    * was read, in which case it needs to be set up again.
+    */
+
+   if (rrOutput->mode == mode->id && crtc->mode == mode->id &&
+       crtc->x == x && crtc->y == y && crtc->rotation == RR_Rotate_0 &&
+       crtc->noutput == 1 && crtc->outputs[0] == rrOutput->id) {
+      g_debug("%s: Crtc %d is unchanged.\n", __func__, (int)crtcID);
+      return TRUE;
+   }
+
    ret = XRRSetCrtcConfig(display, info->xrrRes, crtcID, CurrentTime, x, y,
                           mode->id, RR_Rotate_0, &rrOutput->id, 1);
    if (ret == Success) {
@@ -1042,8 +1072,10 @@ RandR12_SetTopology(Display *dpy,           // IN/OUT: The display connection
 
  out_ungrab:
 
-   g_debug("%s: Deleting unused autofit modes.\n", __func__);
-   RandR12DeleteModes(dpy, info);
+   if (info) {
+      g_debug("%s: Deleting unused autofit modes.\n", __func__);
+      RandR12DeleteModes(dpy, info);
+   }
 
    XSync(dpy, FALSE);
    RandR12FreeInfo(info);
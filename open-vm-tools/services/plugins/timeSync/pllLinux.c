@@ -99,6 +99,40 @@ TimeSync_PLLSetFrequency(int64 ppmCorrection)
 }
 
 
+/*
+ ******************************************************************************
+ * TimeSync_PLLGetFrequency --                                          */ /**
+ *
+ * Get the current frequency correction of the PLL.
+ *
+ * @param[out] ppmCorrection The parts per million error being corrected,
+ *                           shifted left by 16 to match NTP.
+ *
+ * @return TRUE on success.
+ *
+ ******************************************************************************
+ */
+
+Bool
+TimeSync_PLLGetFrequency(int64 *ppmCorrection)
+{
+   struct timex tx;
+   int error;
+
+   tx.modes = 0;
+
+   error = adjtimex(&tx);
+   if (error == -1) {
+      g_debug("%s: adjtimex failed: %d %s\n", __FUNCTION__,
+              error, strerror(errno));
+      return FALSE;
+   }
+   *ppmCorrection = tx.freq;
+
+   return TRUE;
+}
+
+
 /*
  ******************************************************************************
  * TimeSync_PLLUpdate --                                                */ /**
@@ -106,6 +140,7 @@ TimeSync_PLLSetFrequency(int64 ppmCorrection)
  * Updates the PLL with a new offset.
  *
  * @param[in] offset         The offset between the host and the guest.
+ * @param[in] estError       Estimated error of the offset, in microseconds.
  *
  * @return TRUE on success.
  *
@@ -113,7 +148,8 @@ TimeSync_PLLSetFrequency(int64 ppmCorrection)
  */
 
 Bool
-TimeSync_PLLUpdate(int64 offset)
+TimeSync_PLLUpdate(int64 offset,
+                   int64 estError)
 {
    struct timex tx;
    int error;
@@ -130,8 +166,8 @@ TimeSync_PLLUpdate(int64 offset)
 
    tx.modes = ADJ_OFFSET | ADJ_MAXERROR | ADJ_ESTERROR;
    tx.offset = offset;
-   tx.esterror = 0;
-   tx.maxerror = 0;
+   tx.esterror = estError;
+   tx.maxerror = estError;
 
    error = adjtimex(&tx);
    if (error == -1) {
@@ -155,8 +191,8 @@ TimeSync_PLLUpdate(int64 offset)
     * We want to set the time constant to as low a value as possible.  The
     * core NTP PLL that the kernel discipline implements is built assuming
     * that there is a clock filter with a variable delay of up to 8.
-    * Since TimeSyncReadHostAndGuest retries if the error is large, we
-    * don't need to implement the clock filter.  Hence we want a time
+    * TimeSyncReadHostAndGuest filters a burst of samples each period
+    * instead, so there is no such delay.  Hence we want a time
     * constant of 60/8 = 7, but settle for the lowest available: 16.  This
     * allows us to react to changes relatively fast.
     */
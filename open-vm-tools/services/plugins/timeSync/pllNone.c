@@ -69,6 +69,28 @@ TimeSync_PLLSetFrequency(int64 ppmCorrection)
 }
 
 
+/*
+ ******************************************************************************
+ * TimeSync_PLLGetFrequency --                                          */ /**
+ *
+ * Get the current frequency correction of the PLL.
+ *
+ * @param[out] ppmCorrection The parts per million error being corrected,
+ *                           shifted left by 16 to match NTP.
+ *
+ * @return FALSE
+ *
+ ******************************************************************************
+ */
+
+Bool
+TimeSync_PLLGetFrequency(int64 *ppmCorrection)
+{
+   NOT_IMPLEMENTED();
+   return FALSE;
+}
+
+
 /*
  ******************************************************************************
  * TimeSync_PLLUpdate --                                                */ /**
@@ -76,6 +98,7 @@ TimeSync_PLLSetFrequency(int64 ppmCorrection)
  * Updates the PLL with a new offset.
  *
  * @param[in] offset         The offset between the host and the guest.
+ * @param[in] estError       Estimated error of the offset.
  *
  * @return FALSE
  *
@@ -83,7 +106,8 @@ TimeSync_PLLSetFrequency(int64 ppmCorrection)
  */
 
 Bool
-TimeSync_PLLUpdate(int64 offset)
+TimeSync_PLLUpdate(int64 offset,
+                   int64 estError)
 {
    NOT_IMPLEMENTED();
    return FALSE;
@@ -94,6 +94,7 @@
 #include "system.h"
 #include "vmware/guestrpc/timesync.h"
 #include "vmware/tools/plugin.h"
+#include "vmware/tools/timeSyncStats.h"
 #include "vmware/tools/utils.h"
 
 #if !defined(__APPLE__)
@@ -110,11 +111,20 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
 #define TIMESYNC_PERCENT_CORRECTION 50
 
 /* When measuring the difference between time on the host and time in the
- * guest we try up to TIMESYNC_MAX_SAMPLES times to read a sample
- * where the two host reads are within TIMESYNC_GOOD_SAMPLE_THRESHOLD
- * microseconds. */
-#define TIMESYNC_MAX_SAMPLES 4
+ * guest we read a burst of up to TIMESYNC_MAX_SAMPLES samples, each a guest
+ * read between two host reads, and keep the TIMESYNC_KEEP_SAMPLES with the
+ * lowest round trip time (RTT), NTP clock filter style.  The burst stops
+ * early once that many samples are within TIMESYNC_GOOD_SAMPLE_THRESHOLD
+ * microseconds, or within twice the lowest RTT seen recently (but no less
+ * than TIMESYNC_RTT_SLACK). */
+#define TIMESYNC_MAX_SAMPLES 8
+#define TIMESYNC_KEEP_SAMPLES 3
 #define TIMESYNC_GOOD_SAMPLE_THRESHOLD 2000
+#define TIMESYNC_RTT_SLACK 100
+/* A burst whose best RTT is more than TIMESYNC_POPCORN_FACTOR times the
+ * lowest RTT seen recently (a "popcorn spike") isn't used to update the
+ * PLL. */
+#define TIMESYNC_POPCORN_FACTOR 4
 
 /* Once the error drops below TIMESYNC_PLL_ACTIVATE, activate the PLL.
  * 500ppm error acumulated over a 60 second interval can produce 30ms of
@@ -125,6 +135,9 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
 /* Period during which the frequency error of guest time is measured. */
 #define TIMESYNC_CALIBRATION_DURATION (15 * 60 * US_PER_SEC) /* 15min. */
 
+/* Number of readings kept for the state dump and the stats RPC. */
+#define TIMESYNC_HISTORY 16
+
 typedef enum TimeSyncState {
    TIMESYNC_INITIALIZING,
    TIMESYNC_STOPPED,
@@ -132,11 +145,34 @@ typedef enum TimeSyncState {
 } TimeSyncState;
 
 typedef enum TimeSyncSlewState {
-   TimeSyncUncalibrated,
-   TimeSyncCalibrating,
-   TimeSyncPLL,
+   TimeSyncUncalibrated = TIMESYNC_STATS_SLEW_UNCALIBRATED,
+   TimeSyncCalibrating = TIMESYNC_STATS_SLEW_CALIBRATING,
+   TimeSyncPLL = TIMESYNC_STATS_SLEW_PLL,
 } TimeSyncSlewState;
 
+/* What a reading led to. */
+typedef enum TimeSyncAction {
+   TimeSyncActionNone,
+   TimeSyncActionStep,
+   TimeSyncActionSlew,
+   TimeSyncActionCalibrate,
+   TimeSyncActionPLL,
+   TimeSyncActionNoisy,
+   TimeSyncActionFailed,
+} TimeSyncAction;
+
+static const char *timeSyncActionNames[] = {
+   "none", "step", "slew", "calibrate", "pll", "noisy", "failed"
+};
+
+typedef struct TimeSyncHistory {
+   int64              time;         /* Guest time of the reading. */
+   int64              offset;       /* Guest - host time error. */
+   int64              estError;
+   int64              rtt;
+   TimeSyncAction     action;
+} TimeSyncHistory;
+
 typedef struct TimeSyncData {
    gboolean           slewActive;
    gboolean           slewCorrection;
@@ -145,8 +181,26 @@ typedef struct TimeSyncData {
    TimeSyncState      state;
    TimeSyncSlewState  slewState;
    GSource           *timer;
+   int64              minRtt;       /* Lowest recent host read RTT, in us. */
+   int64              estError;     /* Estimated error of the last reading. */
+   int64              rtt;          /* Best RTT of the last reading. */
+   gboolean           noisy;        /* Last reading was a popcorn spike. */
+   TimeSyncAction     action;       /* What the last reading led to. */
+   TimeSyncStats      stats;
+   TimeSyncHistory    history[TIMESYNC_HISTORY];
+   guint              historyNext;
+   gboolean           statsPublished;
 } TimeSyncData;
 
+typedef struct TimeSyncSample {
+   int64              host;         /* Midpoint of the host reads. */
+   int64              guest;
+   int64              rtt;
+   int64              apparentError;
+   Bool               apparentErrorValid;
+   int64              maxTimeError;
+} TimeSyncSample;
+
 /*
  * See bug 1395378
  * Set default value to FALSE. This serves two purposes.
@@ -269,9 +323,17 @@ TimeSyncReadHost(int64 *host, int64 *apparentError, Bool *apparentErrorValid,
  * 3. Host time      - the time reported by the host operating system.
  *
  * This function reports the host time, the guest time and the difference
- * between apparent time and host time (apparentError).  The host and
- * guest time may be sampled multiple times to ensure an accurate reading.
+ * between apparent time and host time (apparentError).
  *
+ * The latency of the backdoor calls adds directly to the error of a single
+ * sample, so a burst of samples is read and filtered: the offset reported
+ * (guest - host) is the mean of the offsets of the samples with the lowest
+ * round trip times, leaving out those more than twice as slow as the best
+ * one.  The estimated error of the reading (half the best round trip time
+ * plus the spread of the kept offsets), and whether it is a popcorn spike,
+ * are left in data for the PLL.
+ *
+ * @param[in]   data                Structure tracking time sync state.
  * @param[out]  host                Time on the Host.
  * @param[out]  guest               Time in the Guest.
  * @param[out]  apparentError       Apparent time error = apparent - real.
@@ -283,67 +345,114 @@ TimeSyncReadHost(int64 *host, int64 *apparentError, Bool *apparentErrorValid,
  */
 
 static gboolean
-TimeSyncReadHostAndGuest(int64 *host, int64 *guest, 
+TimeSyncReadHostAndGuest(TimeSyncData *data,
+                         int64 *host, int64 *guest,
                          int64 *apparentError, Bool *apparentErrorValid,
                          int64 *maxTimeError)
 {
-   int64 host1, host2, hostDiff;
-   int64 tmpGuest, tmpApparentError, tmpMaxTimeError;
-   Bool tmpApparentErrorValid;
-   int64 bestHostDiff = MAX_INT64;
-   int iter = 0;
+   TimeSyncSample samples[TIMESYNC_MAX_SAMPLES];
+   TimeSyncSample *best;
+   int64 host1, host2;
+   int64 rttLimit;
+   int64 offset = 0;
+   int64 spread = 0;
+   int nSamples = 0;
+   int nGood = 0;
+   int nKept = 0;
+   int i, j;
    DEBUG_ONLY(static int64 lastHost = 0);
 
    *apparentErrorValid = FALSE;
    *host = *guest = *apparentError = *maxTimeError = 0;
 
-   if (!TimeSyncReadHost(&host2, &tmpApparentError, 
-                         &tmpApparentErrorValid, &tmpMaxTimeError)) {
+   rttLimit = data->minRtt > 0 ? MAX(2 * data->minRtt, TIMESYNC_RTT_SLACK)
+                               : TIMESYNC_GOOD_SAMPLE_THRESHOLD;
+   rttLimit = MIN(rttLimit, TIMESYNC_GOOD_SAMPLE_THRESHOLD);
+
+   if (!TimeSyncReadHost(&host2, apparentError,
+                         apparentErrorValid, maxTimeError)) {
       return FALSE;
    }
 
    do {
-      iter++;
+      TimeSyncSample *sample = &samples[nSamples];
+
       host1 = host2;
 
-      if (!TimeSync_GetCurrentTime(&tmpGuest)) {
+      if (!TimeSync_GetCurrentTime(&sample->guest)) {
          g_warning("Unable to retrieve the guest OS time: %s.\n\n", 
                    Msg_ErrString());
          return FALSE;
       }
       
-      if (!TimeSyncReadHost(&host2, &tmpApparentError, 
-                            &tmpApparentErrorValid, &tmpMaxTimeError)) {
+      if (!TimeSyncReadHost(&host2, &sample->apparentError,
+                            &sample->apparentErrorValid,
+                            &sample->maxTimeError)) {
          return FALSE;
       }
-      
-      if (host1 < host2) {
-         hostDiff = host2 - host1;
-      } else {
-         hostDiff = 0;
+
+      sample->rtt = host1 < host2 ? host2 - host1 : 0;
+      sample->host = host1 + sample->rtt / 2;
+
+      /* Insertion sort by increasing RTT. */
+      for (j = nSamples; j > 0 && samples[j - 1].rtt > sample->rtt; j--) {
+         TimeSyncSample tmp = samples[j];
+         samples[j] = samples[j - 1];
+         samples[j - 1] = tmp;
+      }
+      nSamples++;
+
+      if (samples[j].rtt <= rttLimit) {
+         nGood++;
       }
+   } while (nSamples < TIMESYNC_MAX_SAMPLES && nGood < TIMESYNC_KEEP_SAMPLES);
 
-      if (hostDiff <= bestHostDiff) {
-         bestHostDiff = hostDiff;
-         *host = host1 + hostDiff / 2;
-         *guest = tmpGuest;
-         *apparentError = tmpApparentError;
-         *apparentErrorValid = tmpApparentErrorValid;
-         *maxTimeError = tmpMaxTimeError;
+   best = &samples[0];
+   for (i = 0; i < nSamples && i < TIMESYNC_KEEP_SAMPLES; i++) {
+      if (samples[i].rtt > 2 * best->rtt) {
+         break;
       }
-   } while (iter < TIMESYNC_MAX_SAMPLES && 
-            bestHostDiff > TIMESYNC_GOOD_SAMPLE_THRESHOLD);
+      offset += samples[i].guest - samples[i].host;
+      nKept++;
+   }
+   offset /= nKept;
+   for (i = 0; i < nKept; i++) {
+      int64 dev = samples[i].guest - samples[i].host - offset;
+      spread += dev < 0 ? -dev : dev;
+   }
+   spread /= nKept;
+
+   *guest = best->guest;
+   *host = best->guest - offset;
+   *apparentError = best->apparentError;
+   *apparentErrorValid = best->apparentErrorValid;
+   *maxTimeError = best->maxTimeError;
+
+   data->estError = best->rtt / 2 + spread;
+   data->rtt = best->rtt;
+   data->noisy = best->rtt > TIMESYNC_GOOD_SAMPLE_THRESHOLD ||
+                 (data->minRtt > 0 &&
+                  best->rtt > TIMESYNC_POPCORN_FACTOR * data->minRtt &&
+                  best->rtt > TIMESYNC_RTT_SLACK);
+
+   /* Follow decreases right away, and increases (e.g. a new host) slowly. */
+   if (data->minRtt == 0 || best->rtt < data->minRtt) {
+      data->minRtt = MAX(best->rtt, 1);
+   } else {
+      data->minRtt += (best->rtt - data->minRtt) / 16;
+   }
 
    ASSERT(*host != 0 && *guest != 0);
 
 #ifdef VMX86_DEBUG
    g_debug("Daemon: Guest vs host error %.6fs; guest vs apparent error %.6fs; "
-           "limit=%.2fs; apparentError %.6fs; iter=%d error=%.6fs; "
-           "%.6f secs since last update\n",
+           "limit=%.2fs; apparentError %.6fs; samples=%d kept=%d "
+           "rtt=%.6fs estError=%.6fs%s; %.6f secs since last update\n",
            (*guest - *host) / 1000000.0, 
            (*guest - *host - *apparentError) / 1000000.0, 
            *maxTimeError / 1000000.0, *apparentError / 1000000.0,
-           iter, bestHostDiff / 1000000.0,
+           nSamples, nKept, best->rtt / 1000000.0,
+           data->estError / 1000000.0, data->noisy ? " (noisy)" : "",
            (*host - lastHost) / 1000000.0);
    lastHost = *host;
 #endif
@@ -383,6 +492,7 @@ TimeSyncStepTime(TimeSyncData *data, int64 adjustment)
     */
    bp.in.cx.halfs.low = BDOOR_CMD_STOPCATCHUP;
    Backdoor(&bp);
+   data->action = TimeSyncActionStep;
 
    if (vmx86_debug) {
       TimeSync_GetCurrentTime(&after);
@@ -443,6 +553,7 @@ TimeSyncSlewTime(TimeSyncData *data, int64 adjustment)
          data->slewState = TimeSyncUncalibrated;
          return FALSE;
       }
+      data->action = TimeSyncActionSlew;
       if (adjustment < TIMESYNC_PLL_ACTIVATE && TimeSync_PLLSupported()) {
          g_debug("Starting PLL calibration.\n");
          calibrationStart = now;
@@ -463,9 +574,10 @@ TimeSyncSlewTime(TimeSyncData *data, int64 adjustment)
          if (ppmErr >> 16 < 500 && ppmErr >> 16 > -500) {
             g_debug("Activating PLL ppmEst=%"FMT64"d (%"FMT64"d)\n", 
                     ppmErr >> 16, ppmErr);
-            TimeSync_PLLUpdate(adjustment);
+            TimeSync_PLLUpdate(adjustment, data->estError);
             TimeSync_PLLSetFrequency(ppmErr);
             data->slewState = TimeSyncPLL;
+            data->action = TimeSyncActionPLL;
          } else {
             /* PPM error is too large to try the PLL. */
             g_debug("PPM error too large: %"FMT64"d (%"FMT64"d) "
@@ -479,12 +591,22 @@ TimeSyncSlewTime(TimeSyncData *data, int64 adjustment)
          }
          calibrationAdjustment += slewDiff;
          calibrationAdjustment -= remaining;
+         data->action = TimeSyncActionCalibrate;
       }
    } else {
       ASSERT(data->slewState == TimeSyncPLL);
-      g_debug("Updating PLL: adjustment %"FMT64"d\n", adjustment);
-      if (!TimeSync_PLLUpdate(adjustment)) {
-         TimeSyncResetSlew(data);
+      if (data->noisy) {
+         /* The kernel discipline keeps going on its frequency estimate. */
+         g_debug("Not updating PLL: noisy sample, adjustment %"FMT64"d\n",
+                 adjustment);
+         data->action = TimeSyncActionNoisy;
+      } else {
+         g_debug("Updating PLL: adjustment %"FMT64"d\n", adjustment);
+         if (TimeSync_PLLUpdate(adjustment, data->estError)) {
+            data->action = TimeSyncActionPLL;
+         } else {
+            TimeSyncResetSlew(data);
+         }
       }
    }
    return TRUE;
@@ -505,12 +627,140 @@ TimeSyncResetSlew(TimeSyncData *data)
    data->slewState = TimeSyncUncalibrated;
    TimeSync_Slew(0, timeSyncPeriodUS, &remaining);
    if (TimeSync_PLLSupported()) {
-      TimeSync_PLLUpdate(0);
+      TimeSync_PLLUpdate(0, 0);
       TimeSync_PLLSetFrequency(0);
    }
 }
 
 
+/**
+ * Accounts for a reading in the time sync statistics and history.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ * @param[in]  guest             Guest time of the reading.
+ * @param[in]  gosError          Guest OS time error measured.
+ */
+
+static void
+TimeSyncStatsUpdate(TimeSyncData *data,
+                    int64 guest,
+                    int64 gosError)
+{
+   TimeSyncStats *stats = &data->stats;
+   TimeSyncHistory *entry = &data->history[data->historyNext];
+   int64 frequency;
+   guint bucket = 0;
+
+   stats->syncs++;
+   stats->offset = gosError;
+   stats->estError = data->estError;
+   stats->maxOffset = MAX(stats->maxOffset, gosError < 0 ? -gosError
+                                                         : gosError);
+   stats->minRtt = data->minRtt;
+   stats->slewState = data->slewState;
+   while (bucket < TIMESYNC_STATS_RTT_BUCKETS - 1 &&
+          data->rtt >= (CONST64(2) << bucket)) {
+      bucket++;
+   }
+   stats->rttHisto[bucket]++;
+
+   switch (data->action) {
+   case TimeSyncActionStep:
+      stats->steps++;
+      break;
+   case TimeSyncActionSlew:
+   case TimeSyncActionCalibrate:
+      stats->slews++;
+      break;
+   case TimeSyncActionPLL:
+      stats->pllUpdates++;
+      break;
+   case TimeSyncActionNoisy:
+      stats->noisy++;
+      break;
+   case TimeSyncActionFailed:
+      stats->failures++;
+      break;
+   default:
+      break;
+   }
+
+   stats->frequencyValid = TimeSync_PLLSupported() &&
+                           TimeSync_PLLGetFrequency(&frequency);
+   stats->frequency = stats->frequencyValid ? frequency : 0;
+
+   entry->time = guest;
+   entry->offset = gosError;
+   entry->estError = data->estError;
+   entry->rtt = data->rtt;
+   entry->action = data->action;
+   data->historyNext = (data->historyNext + 1) % TIMESYNC_HISTORY;
+}
+
+
+/**
+ * Formats the time sync statistics and the most recent readings, one line
+ * per string.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ *
+ * @return NULL-terminated array of lines, to free with g_strfreev.
+ */
+
+static gchar **
+TimeSyncStatsFormat(TimeSyncData *data)
+{
+   static const char *slewStates[] = { "uncalibrated", "calibrating", "PLL" };
+   const TimeSyncStats *stats = &data->stats;
+   GPtrArray *lines = g_ptr_array_new();
+   guint64 rttP50 = 0;
+   guint64 rttP99 = 0;
+   int64 now = 0;
+   guint i;
+
+   g_ptr_array_add(lines, g_strdup_printf(
+      "Time sync: %s, period %us, slew correction %s (%u%%), slew state %s",
+      data->state == TIMESYNC_RUNNING ? "running" : "stopped",
+      data->timeSyncPeriod, data->slewCorrection ? "on" : "off",
+      data->slewPercentCorrection, slewStates[data->slewState]));
+   g_ptr_array_add(lines, g_strdup_printf(
+      "Readings %"FMT64"u, failed %"FMT64"u, steps %"FMT64"u, "
+      "slews %"FMT64"u, PLL updates %"FMT64"u, noisy %"FMT64"u",
+      stats->syncs, stats->failures, stats->steps, stats->slews,
+      stats->pllUpdates, stats->noisy));
+   g_ptr_array_add(lines, g_strdup_printf(
+      "Offset %"FMT64"dus, estimated error %"FMT64"dus, "
+      "max offset %"FMT64"dus, frequency %s%.3fppm",
+      stats->offset, stats->estError, stats->maxOffset,
+      stats->frequencyValid ? "" : "(unknown) ",
+      stats->frequency / 65536.0));
+   if (TimeSyncStats_RttPercentile(stats, 50, &rttP50) &&
+       TimeSyncStats_RttPercentile(stats, 99, &rttP99)) {
+      g_ptr_array_add(lines, g_strdup_printf(
+         "Host read RTT: min %"FMT64"dus, P50 <%"FMT64"uus, "
+         "P99 <%"FMT64"uus", stats->minRtt, rttP50, rttP99));
+   }
+
+   TimeSync_GetCurrentTime(&now);
+   for (i = 0; i < TIMESYNC_HISTORY; i++) {
+      const TimeSyncHistory *entry =
+         &data->history[(data->historyNext + i) % TIMESYNC_HISTORY];
+
+      if (entry->time == 0) {
+         continue;
+      }
+      g_ptr_array_add(lines, g_strdup_printf(
+         "%"FMT64"ds ago: offset %"FMT64"dus, error %"FMT64"dus, "
+         "rtt %"FMT64"dus, %s", (now - entry->time) / US_PER_SEC,
+         entry->offset, entry->estError, entry->rtt,
+         timeSyncActionNames[entry->action]));
+   }
+
+   g_ptr_array_add(lines, NULL);
+   return (gchar **) g_ptr_array_free(lines, FALSE);
+}
+
+
 /**
  * Update whether slewing is used for time correction.
  *
@@ -551,18 +801,21 @@ TimeSyncDoSync(Bool slewCorrection,
    int64 guest, host;
    int64 gosError, apparentError, maxTimeError;
    Bool apparentErrorValid;
+   gboolean ok = TRUE;
    TimeSyncData *data = _data;
 
    g_debug("Synchronizing time: "
            "syncOnce %d, slewCorrection %d, allowBackwardSync %d.\n",
            syncOnce, slewCorrection, allowBackwardSync);
 
-   if (!TimeSyncReadHostAndGuest(&host, &guest, &apparentError, 
+   if (!TimeSyncReadHostAndGuest(data, &host, &guest, &apparentError,
                                  &apparentErrorValid, &maxTimeError)) {
+      data->stats.failures++;
       return FALSE;
    }
 
    gosError = guest - host - apparentError;
+   data->action = TimeSyncActionNone;
 
    if (syncOnce) {
 
@@ -577,9 +830,7 @@ TimeSyncDoSync(Bool slewCorrection,
       if (gosError < -maxTimeError || 
           (gosError + apparentError > 0 && allowBackwardSync)) {
          g_debug("One time synchronization: stepping time.\n");
-         if (!TimeSyncStepTime(data, -gosError + -apparentError)) {
-            return FALSE;
-         }
+         ok = TimeSyncStepTime(data, -gosError + -apparentError);
       } else {
          g_debug("One time synchronization: correction not needed.\n");
       }
@@ -597,18 +848,19 @@ TimeSyncDoSync(Bool slewCorrection,
 
       if (gosError < -maxTimeError) {
          g_debug("Periodic synchronization: stepping time.\n");
-         if (!TimeSyncStepTime(data, -gosError + -apparentError)) {
-            return FALSE;
-         }
+         ok = TimeSyncStepTime(data, -gosError + -apparentError);
       } else if (slewCorrection && apparentErrorValid) {
          g_debug("Periodic synchronization: slewing time.\n");
-         if (!TimeSyncSlewTime(data, -gosError)) {
-            return FALSE;
-         }
+         ok = TimeSyncSlewTime(data, -gosError);
       }
    }
 
-   return TRUE;
+   if (!ok) {
+      data->action = TimeSyncActionFailed;
+   }
+   TimeSyncStatsUpdate(data, guest, gosError);
+
+   return ok;
 }
 
 
@@ -665,7 +917,9 @@ TimeSyncStartLoop(ToolsAppCtx *ctx,
       g_warning("Unable to synchronize time when starting time loop.\n");
    }
 
-   data->timer = g_timeout_source_new(data->timeSyncPeriod * 1000);
+   data->timer = VMTools_CreateCoalescedTimer("timesync",
+                                              data->timeSyncPeriod * 1000,
+                                              data->timeSyncPeriod * 50);
    VMTOOLSAPP_ATTACH_SOURCE(ctx, data->timer, ToolsDaemonTimeSyncLoop, data, NULL);
 
    data->state = TIMESYNC_RUNNING;
@@ -723,6 +977,26 @@ TimeSyncTcloHandler(RpcInData *data)
 }
 
 
+/**
+ * Replies with the time sync statistics and the most recent readings, one
+ * per line.
+ *
+ * @param[in]  data     RPC request data.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+TimeSyncStatsTcloHandler(RpcInData *data)
+{
+   gchar **lines = TimeSyncStatsFormat(data->clientData);
+   gchar *reply = g_strjoinv("\n", lines);
+
+   g_strfreev(lines);
+   return RPCIN_SETRETVALSF(data, reply, TRUE);
+}
+
+
 /**
  * Parses boolean option string.
  *
@@ -768,6 +1042,16 @@ TimeSyncSetOption(gpointer src,
    static gboolean syncBeforeLoop;
    TimeSyncData *data = plugin->_private;
 
+   /*
+    * The stats property is registered once ToolsOnLoad returns; the VMX
+    * sends the time sync options right after the service starts.
+    */
+   if (!data->statsPublished) {
+      g_object_set(ctx->serviceObj, TOOLS_CORE_PROP_TIMESYNC_STATS,
+                   &data->stats, NULL);
+      data->statsPublished = TRUE;
+   }
+
    if (strcmp(option, TOOLSOPTION_SYNCTIME) == 0) {
       gboolean start;
       if (!ParseBoolOption(value, &start)) {
@@ -879,6 +1163,29 @@ TimeSyncSetOption(gpointer src,
 }
 
 
+/**
+ * Logs the time sync statistics and the most recent readings.
+ *
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      The app context.
+ * @param[in]  plugin   Plugin registration data.
+ */
+
+static void
+TimeSyncDumpState(gpointer src,
+                  ToolsAppCtx *ctx,
+                  ToolsPluginData *plugin)
+{
+   gchar **lines = TimeSyncStatsFormat(plugin->_private);
+   guint i;
+
+   for (i = 0; lines[i] != NULL; i++) {
+      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN, "%s\n", lines[i]);
+   }
+   g_strfreev(lines);
+}
+
+
 /**
  * Handles a shutdown callback; cleans up internal plugin state.
  *
@@ -898,6 +1205,10 @@ TimeSyncShutdown(gpointer src,
       TimeSyncStopLoop(ctx, data);
    }
 
+   if (data->statsPublished) {
+      g_object_set(ctx->serviceObj, TOOLS_CORE_PROP_TIMESYNC_STATS, NULL, NULL);
+   }
+
    g_free(data);
 }
 
@@ -920,17 +1231,23 @@ ToolsOnLoad(ToolsAppCtx *ctx)
       NULL
    };
 
-   TimeSyncData *data = g_malloc(sizeof (TimeSyncData));
+   TimeSyncData *data = g_malloc0(sizeof (TimeSyncData));
    RpcChannelCallback rpcs[] = {
-      { TIMESYNC_SYNCHRONIZE, TimeSyncTcloHandler, data, NULL, NULL, 0 }
+      { TIMESYNC_SYNCHRONIZE, TimeSyncTcloHandler, data, NULL, NULL, 0 },
+      { TIMESYNC_STATS, TimeSyncStatsTcloHandler, data, NULL, NULL, 0 }
    };
    ToolsPluginSignalCb sigs[] = {
+      { TOOLS_CORE_SIG_DUMP_STATE, TimeSyncDumpState, &regData },
       { TOOLS_CORE_SIG_SET_OPTION, TimeSyncSetOption, &regData },
       { TOOLS_CORE_SIG_SHUTDOWN, TimeSyncShutdown, &regData }
    };
+   ToolsServiceProperty props[] = {
+      { TOOLS_CORE_PROP_TIMESYNC_STATS }
+   };
    ToolsAppReg regs[] = {
       { TOOLS_APP_GUESTRPC, VMTools_WrapArray(rpcs, sizeof *rpcs, ARRAYSIZE(rpcs)) },
-      { TOOLS_APP_SIGNALS, VMTools_WrapArray(sigs, sizeof *sigs, ARRAYSIZE(sigs)) }
+      { TOOLS_APP_SIGNALS, VMTools_WrapArray(sigs, sizeof *sigs, ARRAYSIZE(sigs)) },
+      { TOOLS_SVC_PROPERTY, VMTools_WrapArray(props, sizeof *props, ARRAYSIZE(props)) }
    };
 
    data->slewActive = FALSE;
@@ -940,6 +1257,9 @@ ToolsOnLoad(ToolsAppCtx *ctx)
    data->slewState = TimeSyncUncalibrated;
    data->timeSyncPeriod = TIMESYNC_TIME;
    data->timer = NULL;
+   data->minRtt = 0;
+   data->estError = 0;
+   data->noisy = FALSE;
 
    regData.regs = VMTools_WrapArray(regs, sizeof *regs, ARRAYSIZE(regs));
    regData._private = data;
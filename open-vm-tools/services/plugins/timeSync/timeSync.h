@@ -45,11 +45,15 @@ Bool
 TimeSync_DisableTimeSlew(void);
 
 Bool
-TimeSync_PLLUpdate(int64 offset);
+TimeSync_PLLUpdate(int64 offset,
+                   int64 estError);
 
 Bool
 TimeSync_PLLSetFrequency(int64 ppmCorrection);
 
+Bool
+TimeSync_PLLGetFrequency(int64 *ppmCorrection);
+
 Bool
 TimeSync_PLLSupported(void);
 
@@ -60,6 +60,7 @@
 #include <glib/gstdio.h>
 
 #include "vixPluginInt.h"
+#include "vmware/tools/memBudget.h"
 #include "vmware/tools/utils.h"
 
 #include "util.h"
@@ -119,6 +120,7 @@ static VixError ToolsDaemonTcloGetEncodedQuotedString(const char *args,
 gboolean ToolsDaemonTcloReceiveVixCommand(RpcInData *data);
 
 static HgfsServerMgrData gFoundryHgfsBkdrConn;
+static guint gListProcCacheId;
 gboolean ToolsDaemonHgfsImpersonated(RpcInData *data);
 
 #if defined(linux) || defined(_WIN32)
@@ -350,6 +352,39 @@ abort:
 } // FoundryToolsDaemonGetToolsProperties
 
 
+/**
+ * Reports the size of the cached ListProcessesEx results to the memory
+ * budget.
+ *
+ * @param[in]  data     Unused.
+ *
+ * @return Size of the cache in bytes.
+ */
+
+static gsize
+FoundryToolsDaemonListProcCacheSize(gpointer data)
+{
+   return VixTools_GetListProcCacheSize();
+}
+
+
+/**
+ * Drops cached ListProcessesEx results at the request of the memory budget.
+ *
+ * @param[in]  bytes    Number of bytes to release.
+ * @param[in]  data     Unused.
+ *
+ * @return Number of bytes released.
+ */
+
+static gsize
+FoundryToolsDaemonListProcCacheEvict(gsize bytes,
+                                     gpointer data)
+{
+   return VixTools_TrimListProcCache(bytes);
+}
+
+
 /**
  * Initializes internal state of the Foundry daemon.
  *
@@ -388,6 +423,12 @@ FoundryToolsDaemon_Initialize(ToolsAppCtx *ctx)
                               NULL);   // rpc callback
    HgfsServerManager_Register(&gFoundryHgfsBkdrConn);
 
+   gListProcCacheId =
+      ToolsCoreMemBudget_RegisterCache(ctx, "vix",
+                                       "list processes",
+                                       FoundryToolsDaemonListProcCacheSize,
+                                       FoundryToolsDaemonListProcCacheEvict,
+                                       NULL);
 }
 
 
@@ -400,6 +441,8 @@ FoundryToolsDaemon_Initialize(ToolsAppCtx *ctx)
 void
 FoundryToolsDaemon_Uninitialize(ToolsAppCtx *ctx)
 {
+   ToolsCoreMemBudget_UnregisterCache(ctx, gListProcCacheId);
+   gListProcCacheId = 0;
    HgfsServerManager_Unregister(&gFoundryHgfsBkdrConn);
    VixTools_Uninitialize();
 }
@@ -419,6 +462,32 @@ FoundryToolsDaemon_RestrictVixCommands(ToolsAppCtx *ctx, gboolean restricted)
 }
 
 
+/**
+ * Notifies the VIX commands that the configuration was reloaded.
+ *
+ * @param[in]  ctx      Application context.
+ */
+
+void
+FoundryToolsDaemon_ConfReload(ToolsAppCtx *ctx)
+{
+   VixTools_ConfigReloaded();
+}
+
+
+/**
+ * Logs the VIX command statistics.
+ *
+ * @param[in]  ctx      Application context.
+ */
+
+void
+FoundryToolsDaemon_DumpState(ToolsAppCtx *ctx)
+{
+   VixTools_DumpState();
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -834,6 +903,7 @@ ToolsDaemonTcloMountHGFS(RpcInData *data) // IN
 
    vmhgfsExecProcArgs.envp = NULL;
    vmhgfsExecProcArgs.workingDirectory = NULL;
+   vmhgfsExecProcArgs.argv = NULL;
 
    execRes = ProcMgr_ExecSync("/usr/bin/vmhgfs-fuse --enabled", &vmhgfsExecProcArgs);
    if (!execRes) {
@@ -1320,6 +1390,8 @@ abort:
    }
    free(requestName);
 
+   ToolsCoreMemBudget_TransientDone(ctx, "vix", resultValueLength);
+
    return TRUE;
 } // ToolsDaemonTcloReceiveVixCommand
 
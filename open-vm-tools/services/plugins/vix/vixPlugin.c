@@ -58,6 +58,40 @@ VixIOFreeze(gpointer src,
    FoundryToolsDaemon_RestrictVixCommands(ctx, freeze);
 }
 
+/**
+ * Configuration reload signal handler.
+ *
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      The application context.
+ * @param[in]  data     Unused.
+ */
+
+static void
+VixConfReload(gpointer src,
+              ToolsAppCtx *ctx,
+              gpointer data)
+{
+   FoundryToolsDaemon_ConfReload(ctx);
+}
+
+
+/**
+ * Dumps the VIX command statistics to the state log.
+ *
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      The application context.
+ * @param[in]  data     Unused.
+ */
+
+static void
+VixDumpState(gpointer src,
+             ToolsAppCtx *ctx,
+             gpointer data)
+{
+   FoundryToolsDaemon_DumpState(ctx);
+}
+
+
 /**
  * Clean up internal state on shutdown.
  *
@@ -105,6 +139,8 @@ ToolsOnLoad(ToolsAppCtx *ctx)
          ToolsDaemonTcloMountHGFS, NULL, NULL, NULL, 0 },
    };
    ToolsPluginSignalCb sigs[] = {
+      { TOOLS_CORE_SIG_CONF_RELOAD, VixConfReload, NULL },
+      { TOOLS_CORE_SIG_DUMP_STATE, VixDumpState, NULL },
       { TOOLS_CORE_SIG_SHUTDOWN, VixShutdown, &regData }
    };
    ToolsAppReg regs[] = {
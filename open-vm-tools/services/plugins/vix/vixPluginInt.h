@@ -39,6 +39,12 @@ FoundryToolsDaemon_Uninitialize(ToolsAppCtx *ctx);
 void
 FoundryToolsDaemon_RestrictVixCommands(ToolsAppCtx *ctx, gboolean restricted);
 
+void
+FoundryToolsDaemon_ConfReload(ToolsAppCtx *ctx);
+
+void
+FoundryToolsDaemon_DumpState(ToolsAppCtx *ctx);
+
 gboolean
 FoundryToolsDaemonGetToolsProperties(RpcInData *data);
 
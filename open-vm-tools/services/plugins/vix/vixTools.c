@@ -24,7 +24,7 @@
 
 /*
  * When adding new functions, be sure to update
- * VixToolsCheckIfVixCommandEnabled() and VixToolsSetAPIEnabledProperties()
+ * vixToolsCommandAPINames[] and VixToolsSetAPIEnabledProperties()
  * (adding a property and associated code in apps/lib/foundry/foundryVM.c
  * if necessary).  The enabled properties provide hints to an API developer
  * as to which APIs are available, and can be affected to guest OS attributes
@@ -106,6 +106,8 @@
 #include "posix.h"
 #include "unicode.h"
 #include "hashTable.h"
+#include "random.h"
+#include "sha1.h"
 #include "su.h"
 #include "escape.h"
 
@@ -117,6 +119,7 @@
 #include "vixOpenSource.h"
 #include "vixToolsInt.h"
 #include "vmware/tools/plugin.h"
+#include "vmware/tools/utils.h"
 
 #ifdef _WIN32
 #include "registryWin32.h"
@@ -193,6 +196,40 @@ static gchar *gCurrentUsername = NULL;
 
 static VGAuthUserHandle *currentUserHandle = NULL;
 
+/*
+ * Guest operations tend to come in bursts, each request with the same
+ * credentials. The VGAuth user handle of a validated name-password or SAML
+ * token is therefore kept for credentialCacheTimeout seconds (0 disables
+ * this), and a request with the same credentials impersonates that handle
+ * right away instead of validating them again. Only a salted SHA-1 digest of
+ * the credentials is kept.
+ *
+ * The timeout isn't extended by later hits, so it bounds how long a changed
+ * password or an expired token still gets in. Removing an alias empties the
+ * cache.
+ */
+#define VIXTOOLS_CONFIG_CREDENTIAL_CACHE_TIMEOUT "credentialCacheTimeout"
+#define VIX_TOOLS_CREDENTIAL_CACHE_TIMEOUT_DEFAULT 30
+#define VIX_TOOLS_CREDENTIAL_CACHE_MAX 16
+
+typedef struct VixToolsCachedCredential {
+   unsigned char digest[SHA1_HASH_LEN];
+   VGAuthUserHandle *userHandle;
+   VmTimeType expires;            // Hostinfo_SystemTimerUS()
+} VixToolsCachedCredential;
+
+static GList *credentialCache = NULL;      // most recently used first
+static unsigned char credentialCacheSalt[16];
+static Bool credentialCacheSalted = FALSE;
+
+/*
+ * Whether currentUserHandle belongs to the credential cache, in which case
+ * VixToolsLogoutUser() must leave it alone.
+ */
+static Bool currentUserHandleCached = FALSE;
+
+static void VixToolsFlushCredentialCache(void);
+
 #endif
 
 /*
@@ -202,6 +239,11 @@ static VGAuthUserHandle *currentUserHandle = NULL;
 char *gImpersonatedUsername = NULL;
 
 
+/*
+ * Programs started by the guest operations are watched for their exit
+ * through their async proc's selectable. While commands are restricted
+ * (IO frozen), the cleanup of a program that exited is retried this often.
+ */
 #define SECONDS_BETWEEN_POLL_TEST_FINISHED     1
 
 /*
@@ -354,9 +396,41 @@ static GHashTable *listProcessesResultsTable = NULL;
  */
 #define  SECONDS_UNTIL_LISTPROC_CACHE_CLEANUP   (10 * 60)
 
+/*
+ * One process reported by ListProcessesEx.
+ */
+typedef struct VixToolsListProcEntry {
+   char *cmdName;
+   char *cmdLine;
+   char *user;
+   uint64 pid;
+   int startTime;
+   int exitCode;
+   int endTime;
+   size_t xmlLen;          // length of the entry, once formatted
+} VixToolsListProcEntry;
+
+/*
+ * Which processes ListProcessesEx reports.
+ */
+typedef struct VixToolsListProcFilter {
+   uint32 numPids;
+   const uint64 *pids;     // all processes if numPids is 0
+   const char *user;       // NULL for any user
+   const char *namePrefix; // NULL for any name
+} VixToolsListProcFilter;
+
+/*
+ * The result of a ListProcessesEx call. Rather than the result itself, this
+ * holds the processes it reports; each reply formats the entries it covers.
+ * The cursor remembers where the previous reply stopped, since the Vix side
+ * fetches the result in order.
+ */
 typedef struct VixToolsCachedListProcessesResult {
-   char *resultBuffer;
-   size_t resultBufferLen;
+   GArray *entries;        // VixToolsListProcEntry
+   size_t resultBufferLen; // formatted size, including the final NUL
+   guint nextEntry;        // cursor: the entry the next reply starts in
+   size_t nextEntryStart;  // cursor: the offset of that entry in the result
    int key;
 #ifdef _WIN32
    wchar_t *userName;
@@ -370,6 +444,73 @@ typedef struct VixToolsCachedListProcessesResult {
  */
 static uint32 listProcessesResultsKey = 1;
 
+/*
+ * ListFilesInGuest pages through large directories with one request per
+ * page. Rather than reading and sorting the directory again for every page,
+ * the listing is kept for a while, with the entries matching the pattern
+ * already worked out; the next page then starts right where the previous
+ * one stopped. Only the entries that are returned are stat()ed.
+ *
+ * A listing is kept as long as it has entries left to return, and until it
+ * has been idle for ListFilesInGuest.cursorTimeout seconds (0 disables it).
+ */
+#define  VIX_TOOLS_CONFIG_LISTFILES_CURSOR_TIMEOUT     VIX_TOOLS_CONFIG_API_LIST_FILES_NAME ".cursorTimeout"
+#define  VIX_TOOLS_LISTFILES_CURSOR_TIMEOUT_DEFAULT    60
+#define  VIX_TOOLS_LISTFILES_MAX_CURSORS               8
+
+/*
+ * Per-opcode state of VixTools_ProcessVixCommand(): whether the opcode is
+ * enabled by the configuration, and request statistics for the state dump.
+ * Only opcodes below VIX_COMMAND_LAST_NORMAL_COMMAND are tracked separately,
+ * all others share the last slot.
+ *
+ * Latency histogram buckets: bucket 0 counts requests that took less than
+ * 1us, bucket N those that took from 2^(N-1) up to 2^N us, and the last
+ * bucket everything slower.
+ */
+#define VIX_TOOLS_STATS_LATENCY_BUCKETS 28
+
+typedef struct VixToolsCommandState {
+   Bool enabledValid;
+   Bool enabled;
+   uint64 count;
+   uint64 errors;
+   uint64 totalUS;
+   uint64 latency[VIX_TOOLS_STATS_LATENCY_BUCKETS];
+} VixToolsCommandState;
+
+static VixToolsCommandState
+   vixToolsCommandState[VIX_COMMAND_LAST_NORMAL_COMMAND + 1];
+
+/*
+ * The configuration the cached enabled states were worked out from.
+ */
+static GKeyFile *vixToolsCommandStateConf = NULL;
+
+/*
+ * Whether InitiateFileTransfer(From|To)Guest offer to stream the file over
+ * vsock when the client asks for it (VIX_REQUESTMSG_STREAM_FILE_TRANSFER).
+ */
+#define  VIX_TOOLS_CONFIG_FILE_TRANSFER_STREAM         "InitiateFileTransfer.stream"
+
+typedef struct VixToolsListFilesCursor {
+   char *dirPathName;
+   char *pattern;          // NULL if none
+#ifdef _WIN32
+   wchar_t *userName;
+#else
+   uid_t euid;
+#endif
+   Bool listingSingleFile;
+   int numFiles;
+   char **fileNameList;
+   int *matchesFrom;       // entries from i on that match the pattern
+   GSource *timer;
+} VixToolsListFilesCursor;
+
+/* Most recently used first. */
+static GList *listFilesCursors = NULL;
+
 static void VixToolsFreeCachedResult(gpointer p);
 
 /*
@@ -419,6 +560,12 @@ typedef struct VixToolsEnvironmentTableIterator {
  * Stores the environment variables to use when executing guest applications.
  */
 static HashTable *userEnvironmentTable = NULL;
+
+/*
+ * userEnvironmentTable as an envp array, shared by the programs started
+ * until the table changes. Use VixToolsGetUserEnvp().
+ */
+static char **userEnvironmentEnvp = NULL;
 #endif
 static HgfsServerMgrData gVixHgfsBkdrConn;
 
@@ -431,6 +578,10 @@ static VixError VixToolsSetFileAttributes(VixCommandRequestHeader *requestMsg);
 
 static gboolean VixToolsMonitorAsyncProc(void *clientData);
 static gboolean VixToolsMonitorStartProgram(void *clientData);
+static void VixToolsWatchAsyncProc(ProcMgr_AsyncProc *procState,
+                                   GMainLoop *eventQueue,
+                                   GSourceFunc callback,
+                                   gpointer clientData);
 static void VixToolsRegisterHgfsSessionInvalidator(void *clientData);
 static gboolean VixToolsInvalidateInactiveHGFSSessions(void *clientData);
 
@@ -555,12 +706,27 @@ static VixError VixToolsListDirectory(VixCommandRequestHeader *requestMsg,
 
 static VixError VixToolsListFiles(VixCommandRequestHeader *requestMsg,
                                   size_t maxBufferSize,
+                                  GKeyFile *confDictRef,
+                                  void *eventQueue,
                                   char **result);
 
+static void VixToolsFreeListFilesCursor(VixToolsListFilesCursor *cursor);
+
 static VixError VixToolsInitiateFileTransferFromGuest(VixCommandRequestHeader *requestMsg,
+                                                      GMainLoop *eventQueue,
                                                       char **result);
 
-static VixError VixToolsInitiateFileTransferToGuest(VixCommandRequestHeader *requestMsg);
+static VixError VixToolsInitiateFileTransferToGuest(VixCommandRequestHeader *requestMsg,
+                                                    GMainLoop *eventQueue,
+                                                    char **result);
+
+#if defined(__linux__)
+static char *VixToolsStartFileStream(VixCommandRequestHeader *requestMsg,
+                                     Bool toGuest,
+                                     const char *filePathName,
+                                     Bool overwrite,
+                                     GMainLoop *eventQueue);
+#endif
 
 static VixError VixToolsKillProcess(VixCommandRequestHeader *requestMsg);
 
@@ -661,6 +827,10 @@ static int VixToolsEnvironmentTableEntryToEnvpEntry(const char *key, void *value
 
 static void VixToolsFreeEnvp(char **envp);
 
+static char **VixToolsGetUserEnvp(void);
+
+static void VixToolsUserEnvironmentChanged(void);
+
 #endif
 
 static VixError FoundryToolsDaemon_TranslateSystemErr(void);
@@ -800,6 +970,24 @@ VixTools_Uninitialize(void) // IN
    }
 
    HgfsServerManager_Unregister(&gVixHgfsBkdrConn);
+
+   while (NULL != listFilesCursors) {
+      VixToolsFreeListFilesCursor(listFilesCursors->data);
+      listFilesCursors = g_list_delete_link(listFilesCursors,
+                                            listFilesCursors);
+   }
+
+#if defined(__linux__)
+   VixToolsStream_Shutdown();
+#endif
+
+#if SUPPORT_VGAUTH
+   VixToolsFlushCredentialCache();
+#endif
+
+#ifndef _WIN32
+   VixToolsUserEnvironmentChanged();
+#endif
 }
 
 
@@ -866,6 +1054,7 @@ VixToolsBuildUserEnvironmentTable(const char * const *envp)   // IN: optional
        * in case they ever do this will cover it.
        */
       HashTable_Clear(userEnvironmentTable);
+      VixToolsUserEnvironmentChanged();
    }
 
    for (; NULL != *envp; envp++) {
@@ -1005,6 +1194,59 @@ VixToolsFreeEnvp(char **envp)   // IN
       free(envp);
    }
 }
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsGetUserEnvp --
+ *
+ *      Gets the environment to start programs with, as an envp array. It is
+ *      only built again after userEnvironmentTable changed.
+ *
+ * Results:
+ *      char ** - envp array as per environ(7), NULL to use the current
+ *      environment. Owned by this module; valid until the table changes.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char **
+VixToolsGetUserEnvp(void)
+{
+   if (NULL == userEnvironmentEnvp) {
+      userEnvironmentEnvp = VixToolsEnvironmentTableToEnvp(userEnvironmentTable);
+   }
+
+   return userEnvironmentEnvp;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsUserEnvironmentChanged --
+ *
+ *      Must be called after userEnvironmentTable changed.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      Frees the envp array returned by VixToolsGetUserEnvp().
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsUserEnvironmentChanged(void)
+{
+   VixToolsFreeEnvp(userEnvironmentEnvp);
+   userEnvironmentEnvp = NULL;
+}
 #endif  // #ifndef _WIN32
 
 
@@ -1416,7 +1658,6 @@ VixToolsRunProgramImpl(char *requestName,      // IN
    STARTUPINFO si;
    wchar_t *envBlock = NULL;
 #endif
-   GSource *timer;
 
    if (NULL != pid) {
       *pid = (int64) -1;
@@ -1525,7 +1766,7 @@ VixToolsRunProgramImpl(char *requestName,      // IN
    si.wShowWindow = (VIX_RUNPROGRAM_ACTIVATE_WINDOW & runProgramOptions)
                      ? SW_SHOWNORMAL : SW_MINIMIZE;
 #elif !defined(__FreeBSD__)
-   procArgs.envp = VixToolsEnvironmentTableToEnvp(userEnvironmentTable);
+   procArgs.envp = VixToolsGetUserEnvp();
 #endif
 
    asyncState->procState = ProcMgr_ExecAsync(fullCommandLine, &procArgs);
@@ -1535,7 +1776,6 @@ VixToolsRunProgramImpl(char *requestName,      // IN
       Impersonate_UnforceRoot();
    }
 #else
-   VixToolsFreeEnvp(procArgs.envp);
    DEBUG_ONLY(procArgs.envp = NULL;)
 #endif
 
@@ -1549,13 +1789,11 @@ VixToolsRunProgramImpl(char *requestName,      // IN
    }
 
    /*
-    * Start a periodic procedure to check the app periodically
+    * Get called back when the app exits.
     */
    asyncState->eventQueue = eventQueue;
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, eventQueue,
+                          VixToolsMonitorAsyncProc, asyncState);
 
    /*
     * VixToolsMonitorAsyncProc will clean asyncState up when the program finishes.
@@ -1624,7 +1862,6 @@ VixToolsStartProgramImpl(const char *requestName,            // IN
    wchar_t *envBlock = NULL;
    Bool envBlockFromMalloc = TRUE;
 #endif
-   GSource *timer;
 
    /*
     * Initialize this here so we can call free on its member variables in abort
@@ -1805,13 +2042,11 @@ VixToolsStartProgramImpl(const char *requestName,            // IN
            __FUNCTION__, fullCommandLine, *pid);
 
    /*
-    * Start a periodic procedure to check the app periodically
+    * Get called back when the app exits.
     */
    asyncState->eventQueue = eventQueue;
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorStartProgram, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, eventQueue,
+                          VixToolsMonitorStartProgram, asyncState);
 
    /*
     * VixToolsMonitorStartProgram will clean asyncState up when the program
@@ -1840,14 +2075,97 @@ abort:
 } // VixToolsStartProgramImpl
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsAsyncProcReady --
+ *
+ *    Watch callback: the program's selectable is ready, meaning it exited.
+ *
+ * Return value:
+ *    FALSE, the callback takes it from there.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef _WIN32
+typedef struct VixToolsAsyncProcWatch {
+   GSourceFunc callback;
+   gpointer clientData;
+} VixToolsAsyncProcWatch;
+
+static gboolean
+VixToolsAsyncProcReady(GIOChannel *chan,       // IN
+                       GIOCondition cond,      // IN
+                       gpointer data)          // IN
+{
+   VixToolsAsyncProcWatch *watch = data;
+
+   watch->callback(watch->clientData);
+   return FALSE;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsWatchAsyncProc --
+ *
+ *    Has @callback called on the main loop once the program started as
+ *    @procState exits. The exit is noticed right away: ProcMgr makes the
+ *    program's selectable (the waiter's pipe on POSIX, the process handle on
+ *    Windows) ready when the program ends, so there is no need to poll.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsWatchAsyncProc(ProcMgr_AsyncProc *procState,   // IN
+                       GMainLoop *eventQueue,          // IN
+                       GSourceFunc callback,           // IN
+                       gpointer clientData)            // IN
+{
+   GSource *source;
+#ifdef _WIN32
+   source = VMTools_NewHandleSource(ProcMgr_GetAsyncProcSelectable(procState));
+   g_source_set_callback(source, callback, clientData, NULL);
+#else
+   VixToolsAsyncProcWatch *watch = Util_SafeMalloc(sizeof *watch);
+   GIOChannel *chan;
+
+   watch->callback = callback;
+   watch->clientData = clientData;
+
+   chan = g_io_channel_unix_new(ProcMgr_GetAsyncProcSelectable(procState));
+   source = g_io_create_watch(chan, G_IO_IN | G_IO_HUP | G_IO_ERR);
+   g_io_channel_unref(chan);   // Ownership transferred to the watch.
+
+   g_source_set_callback(source, (GSourceFunc) VixToolsAsyncProcReady, watch,
+                         free);
+#endif
+   g_source_attach(source, g_main_loop_get_context(eventQueue));
+   g_source_unref(source);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * VixToolsMonitorAsyncProc --
  *
- *    This polls a program running in the guest to see if it has completed.
- *    It is used by the test/dev code to detect when a test application
- *    completes.
+ *    This is called when a program running in the guest has completed,
+ *    and reports it. It is used by the test/dev code to detect when a test
+ *    application completes.
  *
  * Return value:
  *    TRUE on non-glib implementation.
@@ -1882,15 +2200,22 @@ VixToolsMonitorAsyncProc(void *clientData) // IN
     * that freeze the filesystem.
     */
    procIsRunning = ProcMgr_IsAsyncProcRunning(asyncState->procState);
-   if (!procIsRunning) {
-      if (gRestrictCommands) {
-         g_debug("%s: Deferring RunScript cleanup due to IO freeze\n",
-                 __FUNCTION__);
-      } else {
-         goto cleanup;
-      }
+   if (procIsRunning) {
+      VixToolsWatchAsyncProc(asyncState->procState, asyncState->eventQueue,
+                             VixToolsMonitorAsyncProc, asyncState);
+      return FALSE;
+   }
+
+   if (!gRestrictCommands) {
+      goto cleanup;
    }
 
+   /*
+    * The program's selectable stays ready; retry on a timer until commands
+    * are allowed again.
+    */
+   g_debug("%s: Deferring RunScript cleanup due to IO freeze\n",
+           __FUNCTION__);
    timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
    g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
    g_source_attach(timer, g_main_loop_get_context(asyncState->eventQueue));
@@ -2024,9 +2349,9 @@ VixToolsRegisterHgfsSessionInvalidator(void *clientData)    // IN:
  *
  * VixToolsMonitorStartProgram --
  *
- *    This polls a program started by StartProgram to see if it has completed.
- *    If it has, saves off its exitCode and endTime so they can be queried
- *    via ListProcessesEx.
+ *    This is called when a program started by StartProgram has completed.
+ *    Saves off its exitCode and endTime so they can be queried via
+ *    ListProcessesEx.
  *
  * Return value:
  *    TRUE on non-glib implementation.
@@ -2047,7 +2372,6 @@ VixToolsMonitorStartProgram(void *clientData) // IN
    ProcMgr_Pid pid = -1;
    int result = -1;
    VixToolsStartedProgramState *spState;
-   GSource *timer;
 
    asyncState = (VixToolsStartProgramState *) clientData;
    ASSERT(asyncState);
@@ -2060,10 +2384,8 @@ VixToolsMonitorStartProgram(void *clientData) // IN
       goto done;
    }
 
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorStartProgram, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(asyncState->eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, asyncState->eventQueue,
+                          VixToolsMonitorStartProgram, asyncState);
    return FALSE;
 
 done:
@@ -4199,7 +4521,7 @@ VixToolsGetAllEnvVarsForUser(void *userToken,     // IN
       err = VIX_E_FAIL;
       return err;
    }
-   envp = VixToolsEnvironmentTableToEnvp(userEnvironmentTable);
+   envp = VixToolsGetUserEnvp();
 #endif
 
    if (NULL == result) {
@@ -4277,9 +4599,6 @@ VixToolsGetAllEnvVarsForUser(void *userToken,     // IN
 
 abort:
    VixToolsDestroyEnvIterator(itr);
-#ifdef __FreeBSD__
-   VixToolsFreeEnvp(envp);
-#endif
    *result = resultLocal;
 
    return err;
@@ -4368,6 +4687,7 @@ VixToolsWriteVariable(VixCommandRequestHeader *requestMsg)   // IN
           */
          HashTable_ReplaceOrInsert(userEnvironmentTable, valueName,
                                    Util_SafeStrdup(value));
+         VixToolsUserEnvironmentChanged();
       }
 #endif
       break;
@@ -4623,6 +4943,9 @@ abort:
  *    InitiateFileTransferFromGuest VI guest operation. Specified filepath
  *    should not point to a directory or a symlink.
  *
+ *    If the client asks for it, the contents are offered over a vsock
+ *    stream; see VIX_REQUESTMSG_STREAM_FILE_TRANSFER.
+ *
  * Return value:
  *    VixError
  *
@@ -4634,6 +4957,7 @@ abort:
 
 VixError
 VixToolsInitiateFileTransferFromGuest(VixCommandRequestHeader *requestMsg,    // IN
+                                      GMainLoop *eventQueue,                  // IN
                                       char **result)                          // OUT
 {
    VixError err = VIX_OK;
@@ -4695,6 +5019,21 @@ VixToolsInitiateFileTransferFromGuest(VixCommandRequestHeader *requestMsg,    //
 
    resultBuffer = VixToolsPrintFileExtendedInfoEx(filePathName, filePathName);
 
+#if defined(__linux__)
+   {
+      char *stream = VixToolsStartFileStream(requestMsg, FALSE, filePathName,
+                                             FALSE, eventQueue);
+
+      if (NULL != stream) {
+         char *tmp = Str_SafeAsprintf(NULL, "%s%s", resultBuffer, stream);
+
+         free(resultBuffer);
+         free(stream);
+         resultBuffer = tmp;
+      }
+   }
+#endif
+
 abort:
    if (impersonatingVMWareUser) {
       VixToolsUnimpersonateUser(userToken);
@@ -4720,6 +5059,13 @@ abort:
  *
  * VixToolsInitiateFileTransferToGuest --
  *
+ *    This function is called to implement InitiateFileTransferToGuest VI
+ *    guest operation. Checks that the file can be created or overwritten.
+ *
+ *    If the client asks for it, the contents may be sent over a vsock
+ *    stream; the reply then says where. See
+ *    VIX_REQUESTMSG_STREAM_FILE_TRANSFER.
+ *
  * Return value:
  *    VixError
  *
@@ -4730,9 +5076,12 @@ abort:
  */
 
 VixError
-VixToolsInitiateFileTransferToGuest(VixCommandRequestHeader *requestMsg)  // IN
+VixToolsInitiateFileTransferToGuest(VixCommandRequestHeader *requestMsg,  // IN
+                                    GMainLoop *eventQueue,                // IN
+                                    char **result)                        // OUT
 {
    VixError err = VIX_OK;
+   char *resultBuffer = NULL;
    const char *guestPathName = NULL;
    Bool impersonatingVMWareUser = FALSE;
    void *userToken = NULL;
@@ -4839,7 +5188,7 @@ VixToolsInitiateFileTransferToGuest(VixCommandRequestHeader *requestMsg)  // IN
                        __FUNCTION__, guestPathName);
          }
       }
-      goto abort;
+      goto done;
    }
 
    File_GetPathName(guestPathName, &dirName, &baseName);
@@ -4924,6 +5273,14 @@ VixToolsInitiateFileTransferToGuest(VixCommandRequestHeader *requestMsg)  // IN
    }
 #endif
 
+done:
+#if defined(__linux__)
+   if (VIX_OK == err) {
+      resultBuffer = VixToolsStartFileStream(requestMsg, TRUE, guestPathName,
+                                             overwrite, eventQueue);
+   }
+#endif
+
 abort:
    free(baseName);
    free(dirName);
@@ -4933,6 +5290,8 @@ abort:
    }
    VixToolsLogoutUser(userToken);
 
+   *result = resultBuffer;
+
    g_message("%s: opcode %d returning %"FMT64"d\n", __FUNCTION__,
              requestMsg->opCode, err);
 
@@ -4940,6 +5299,46 @@ abort:
 } // VixToolsInitiateFileTransferToGuest
 
 
+#if defined(__linux__)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStartFileStream --
+ *
+ *    Offers to stream the file of an InitiateFileTransfer(From|To)Guest
+ *    request over vsock, if the client asked for it and the config allows
+ *    it. Must be called while impersonating.
+ *
+ * Return value:
+ *    The elements to append to the reply (caller frees), or NULL if the
+ *    client is to use HGFS.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+VixToolsStartFileStream(VixCommandRequestHeader *requestMsg,   // IN
+                        Bool toGuest,                          // IN
+                        const char *filePathName,              // IN
+                        Bool overwrite,                        // IN
+                        GMainLoop *eventQueue)                 // IN
+{
+   if (!(requestMsg->requestFlags & VIX_REQUESTMSG_STREAM_FILE_TRANSFER) ||
+       !VixTools_ConfigGetBoolean(gConfDictRef,
+                                  VIX_TOOLS_CONFIG_API_GROUPNAME,
+                                  VIX_TOOLS_CONFIG_FILE_TRANSFER_STREAM,
+                                  TRUE)) {
+      return NULL;
+   }
+
+   return VixToolsStream_Start(toGuest, filePathName, overwrite, eventQueue);
+}
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -5124,6 +5523,43 @@ abort:
 } // VixToolsListProcesses
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsFreeListProcEntries --
+ *
+ *    Frees the processes of a ListProcessesEx result.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsFreeListProcEntries(GArray *entries)    // IN
+{
+   guint i;
+
+   if (NULL == entries) {
+      return;
+   }
+
+   for (i = 0; i < entries->len; i++) {
+      VixToolsListProcEntry *entry = &g_array_index(entries,
+                                                    VixToolsListProcEntry, i);
+
+      free(entry->cmdName);
+      free(entry->cmdLine);
+      free(entry->user);
+   }
+   g_array_free(entries, TRUE);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -5146,7 +5582,7 @@ VixToolsFreeCachedResult(gpointer ptr)          // IN
    VixToolsCachedListProcessesResult *p = (VixToolsCachedListProcessesResult *) ptr;
 
    if (NULL != p) {
-      free(p->resultBuffer);
+      VixToolsFreeListProcEntries(p->entries);
 #ifdef _WIN32
       free(p->userName);
 #endif
@@ -5187,59 +5623,268 @@ VixToolsListProcCacheCleanup(void *clientData) // IN
 /*
  *-----------------------------------------------------------------------------
  *
- * VixToolsListProcessesExGenerateData --
+ * VixTools_GetListProcCacheSize --
  *
- *    Does the work to generate the results into a string buffer.
+ *    Estimates the memory held by the cached ListProcessesEx results
+ *    waiting to be fetched by the host.
  *
  * Return value:
- *    VixError
+ *    Size in bytes.
  *
  * Side effects:
- *    Allocates and creates the result buffer.
+ *    None
  *
  *-----------------------------------------------------------------------------
  */
 
-VixError
-VixToolsListProcessesExGenerateData(uint32 numPids,          // IN
-                                    const uint64 *pids,      // IN
-                                    size_t *resultSize,      // OUT
-                                    char **resultBuffer)     // OUT
+size_t
+VixTools_GetListProcCacheSize(void)
 {
-   VixError err = VIX_OK;
-   ProcMgrProcInfoArray *procList = NULL;
-   ProcMgrProcInfo *procInfo;
-   DynBuf dynBuffer;
-   VixToolsStartedProgramState *spList;
-   int numReported = 0;
-   int i;
-   int j;
-   Bool bRet;
-   size_t procCount;
+   GHashTableIter iter;
+   gpointer value;
+   size_t size = 0;
 
-   DynBuf_Init(&dynBuffer);
+   if (NULL == listProcessesResultsTable) {
+      return 0;
+   }
+
+   g_hash_table_iter_init(&iter, listProcessesResultsTable);
+   while (g_hash_table_iter_next(&iter, NULL, &value)) {
+      VixToolsCachedListProcessesResult *result = value;
+
+      size += sizeof *result + result->resultBufferLen +
+              result->entries->len * sizeof (VixToolsListProcEntry);
+   }
+
+   return size;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixTools_TrimListProcCache --
+ *
+ *    Drops cached ListProcessesEx results, oldest first, until at least
+ *    'bytes' bytes are released. The host gets an error if it asks for
+ *    the rest of a dropped result, and has to list the processes again.
+ *
+ * Return value:
+ *    Number of bytes released.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+size_t
+VixTools_TrimListProcCache(size_t bytes) // IN
+{
+   size_t freed = 0;
+
+   if (NULL == listProcessesResultsTable) {
+      return 0;
+   }
+
+   while (freed < bytes && g_hash_table_size(listProcessesResultsTable) > 0) {
+      GHashTableIter iter;
+      gpointer value;
+      VixToolsCachedListProcessesResult *oldest = NULL;
+      int key;
+
+      g_hash_table_iter_init(&iter, listProcessesResultsTable);
+      while (g_hash_table_iter_next(&iter, NULL, &value)) {
+         VixToolsCachedListProcessesResult *result = value;
+
+         if (NULL == oldest || result->key < oldest->key) {
+            oldest = result;
+         }
+      }
+
+      key = oldest->key;
+      freed += sizeof *oldest + oldest->resultBufferLen +
+               oldest->entries->len * sizeof (VixToolsListProcEntry);
+      g_hash_table_remove(listProcessesResultsTable, &key);
+      g_debug("%s: purged list proc cache key %d\n", __FUNCTION__, key);
+   }
+
+   return freed;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListProcMatches --
+ *
+ *    Checks whether a process passes the user and name filters. The pid
+ *    filter is applied by the caller, which reports processes in the order
+ *    of the requested pids.
+ *
+ * Return value:
+ *    TRUE if the process should be reported.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+VixToolsListProcMatches(const VixToolsListProcFilter *filter,  // IN
+                        const char *cmdName,                   // IN
+                        const char *user)                      // IN
+{
+   if (NULL != filter->user &&
+       (NULL == user || 0 != strcmp(user, filter->user))) {
+      return FALSE;
+   }
+
+   if (NULL != filter->namePrefix &&
+       (NULL == cmdName ||
+        0 != strncmp(cmdName, filter->namePrefix,
+                     strlen(filter->namePrefix)))) {
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListProcAddStarted --
+ *
+ *    Adds a process started via StartProgram to a ListProcessesEx result.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsListProcAddStarted(GArray *entries,                          // IN/OUT
+                           const VixToolsListProcFilter *filter,     // IN
+                           const VixToolsStartedProgramState *state) // IN
+{
+   VixToolsListProcEntry entry;
+
+   if (!VixToolsListProcMatches(filter, state->cmdName, state->user)) {
+      return;
+   }
+
+   entry.cmdName = Util_SafeStrdup(state->cmdName);
+   entry.cmdLine = Util_SafeStrdup(state->fullCommandLine);
+   entry.user = Util_SafeStrdup(state->user);
+   entry.pid = state->pid;
+   entry.startTime = (int) state->startTime;
+   entry.exitCode = state->exitCode;
+   entry.endTime = (int) state->endTime;
+   entry.xmlLen = 0;
+   g_array_append_val(entries, entry);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListProcAddRunning --
+ *
+ *    Adds a process listed by the OS to a ListProcessesEx result. The
+ *    strings are taken over from procInfo.
+ *
+ *    Note that we set endTime and exitCode to dummy values, since we'll be
+ *    getting results on the Vix side with GetNthProperty, and can have a
+ *    mix of live and dead processes.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsListProcAddRunning(GArray *entries,                       // IN/OUT
+                           const VixToolsListProcFilter *filter,  // IN
+                           ProcMgrProcInfo *procInfo)             // IN/OUT
+{
+   VixToolsListProcEntry entry;
+   const char *user = (NULL == procInfo->procOwner) ? ""
+                                                    : procInfo->procOwner;
+
+   if (!VixToolsListProcMatches(filter, procInfo->procCmdName, user)) {
+      return;
+   }
+
+   entry.cmdName = procInfo->procCmdName;
+   entry.cmdLine = procInfo->procCmdLine;
+   entry.user = (NULL == procInfo->procOwner) ? Util_SafeStrdup("")
+                                              : procInfo->procOwner;
+   entry.pid = procInfo->procId;
+   entry.startTime = (int) procInfo->procStartTime;
+   entry.exitCode = 0;
+   entry.endTime = 0;
+   entry.xmlLen = 0;
+   g_array_append_val(entries, entry);
+
+   procInfo->procCmdName = NULL;
+   procInfo->procCmdLine = NULL;
+   procInfo->procOwner = NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListProcessesExCollect --
+ *
+ *    Works out the processes to report, in the order they are reported.
+ *
+ * Return value:
+ *    VixError
+ *
+ * Side effects:
+ *    Allocates the entries.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VixError
+VixToolsListProcessesExCollect(const VixToolsListProcFilter *filter,  // IN
+                               GArray **result)                       // OUT
+{
+   VixError err = VIX_OK;
+   ProcMgrProcInfoArray *procList = NULL;
+   ProcMgrProcInfo *procInfo;
+   VixToolsStartedProgramState *spList;
+   GArray *entries;
+   int numReported = 0;
+   int i;
+   int j;
+   size_t procCount;
+
+   entries = g_array_new(FALSE, FALSE, sizeof (VixToolsListProcEntry));
 
    /*
     * First check the processes we've started via StartProgram, which
     * will find those running and recently deceased.
     */
    VixToolsUpdateStartedProgramList(NULL);
-   if (numPids > 0) {
-      for (i = 0; i < numPids; i++) {
+   if (filter->numPids > 0) {
+      for (i = 0; i < filter->numPids; i++) {
          spList = startedProcessList;
          while (spList) {
-            if (pids[i] == spList->pid) {
-               err = VixToolsPrintProcInfoEx(&dynBuffer,
-                                             spList->cmdName,
-                                             spList->fullCommandLine,
-                                             spList->pid,
-                                             spList->user,
-                                             (int) spList->startTime,
-                                             spList->exitCode,
-                                             (int) spList->endTime);
-               if (VIX_OK != err) {
-                  goto abort;
-               }
+            if (filter->pids[i] == spList->pid) {
+               VixToolsListProcAddStarted(entries, filter, spList);
                numReported++;
                break;
             }
@@ -5249,17 +5894,7 @@ VixToolsListProcessesExGenerateData(uint32 numPids,          // IN
    } else {
       spList = startedProcessList;
       while (spList) {
-         err = VixToolsPrintProcInfoEx(&dynBuffer,
-                                       spList->cmdName,
-                                       spList->fullCommandLine,
-                                       spList->pid,
-                                       spList->user,
-                                       (int) spList->startTime,
-                                       spList->exitCode,
-                                       (int) spList->endTime);
-         if (VIX_OK != err) {
-            goto abort;
-         }
+         VixToolsListProcAddStarted(entries, filter, spList);
          spList = spList->next;
       }
    }
@@ -5268,9 +5903,9 @@ VixToolsListProcessesExGenerateData(uint32 numPids,          // IN
     * If we found data for all requested processes from the startedProcess
     * list, then we're done.
     */
-   if (numPids > 0 && (numPids == numReported)) {
+   if (filter->numPids > 0 && (filter->numPids == numReported)) {
       g_debug("%s: found all %d requested pids on the startedProcess list; finished\n",
-              __FUNCTION__, numPids);
+              __FUNCTION__, filter->numPids);
       goto done;
    }
 
@@ -5289,34 +5924,20 @@ VixToolsListProcessesExGenerateData(uint32 numPids,          // IN
       goto abort;
    }
 
-
    /*
-    * Now look at the running list.  Note that we set endTime
-    * and exitCode to dummy values, since we'll be getting results on
-    * the Vix side with GetNthProperty, and can have a mix of live and
-    * dead processes.
+    * Now look at the running list.
     */
    procCount = ProcMgrProcInfoArray_Count(procList);
-   if (numPids > 0) {
-      for (i = 0; i < numPids; i++) {
+   if (filter->numPids > 0) {
+      for (i = 0; i < filter->numPids; i++) {
          // ignore it if its on the started list -- we added it above
-         if (VixToolsFindStartedProgramState(pids[i])) {
+         if (VixToolsFindStartedProgramState(filter->pids[i])) {
             continue;
          }
          for (j = 0; j < procCount; j++) {
             procInfo = ProcMgrProcInfoArray_AddressOf(procList, j);
-            if (pids[i] == procInfo->procId) {
-               err = VixToolsPrintProcInfoEx(&dynBuffer,
-                                             procInfo->procCmdName,
-                                             procInfo->procCmdLine,
-                                             procInfo->procId,
-                                             (NULL == procInfo->procOwner)
-                                             ? "" : procInfo->procOwner,
-                                             (int) procInfo->procStartTime,
-                                             0, 0);
-               if (VIX_OK != err) {
-                  goto abort;
-               }
+            if (filter->pids[i] == procInfo->procId) {
+               VixToolsListProcAddRunning(entries, filter, procInfo);
             }
          }
       }
@@ -5327,45 +5948,272 @@ VixToolsListProcessesExGenerateData(uint32 numPids,          // IN
          if (VixToolsFindStartedProgramState(procInfo->procId)) {
             continue;
          }
-         err = VixToolsPrintProcInfoEx(&dynBuffer,
-                                       procInfo->procCmdName,
-                                       procInfo->procCmdLine,
-                                       procInfo->procId,
-                                       (NULL == procInfo->procOwner)
-                                       ? "" : procInfo->procOwner,
-                                       (int) procInfo->procStartTime,
-                                       0, 0);
-         if (VIX_OK != err) {
-            goto abort;
-         }
+         VixToolsListProcAddRunning(entries, filter, procInfo);
       }
    }
 
 done:
+   *result = entries;
+   entries = NULL;
 
-   // add the final NUL
-   bRet = DynBuf_Append(&dynBuffer, "", 1);
-   if (!bRet) {
-      err = VIX_E_OUT_OF_MEMORY;
-      goto abort;
+abort:
+   VixToolsFreeListProcEntries(entries);
+   ProcMgr_FreeProcList(procList);
+   return err;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsFormatListProcEntry --
+ *
+ *    Formats one process of a ListProcessesEx result.
+ *
+ * Return value:
+ *    VixError
+ *
+ * Side effects:
+ *    Replaces the contents of the buffer.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VixError
+VixToolsFormatListProcEntry(const VixToolsListProcEntry *entry,  // IN
+                            DynBuf *buf)                         // IN/OUT
+{
+   DynBuf_SetSize(buf, 0);
+   return VixToolsPrintProcInfoEx(buf,
+                                  entry->cmdName,
+                                  entry->cmdLine,
+                                  entry->pid,
+                                  entry->user,
+                                  entry->startTime,
+                                  entry->exitCode,
+                                  entry->endTime);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListProcessesExMeasure --
+ *
+ *    Works out the size of a ListProcessesEx result, which the first reply
+ *    must announce. The entries are formatted one at a time, and thrown
+ *    away.
+ *
+ * Return value:
+ *    VixError
+ *
+ * Side effects:
+ *    Sets the length of every entry.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VixError
+VixToolsListProcessesExMeasure(VixToolsCachedListProcessesResult *result) // IN/OUT
+{
+   VixError err = VIX_OK;
+   DynBuf scratch;
+   guint i;
+
+   DynBuf_Init(&scratch);
+   result->resultBufferLen = 0;
+
+   for (i = 0; i < result->entries->len; i++) {
+      VixToolsListProcEntry *entry = &g_array_index(result->entries,
+                                                    VixToolsListProcEntry, i);
+
+      err = VixToolsFormatListProcEntry(entry, &scratch);
+      if (VIX_OK != err) {
+         goto abort;
+      }
+      entry->xmlLen = DynBuf_GetSize(&scratch);
+      result->resultBufferLen += entry->xmlLen;
    }
 
-   DynBuf_Trim(&dynBuffer);
-   *resultSize = DynBuf_GetSize(&dynBuffer);
-   *resultBuffer  = DynBuf_Detach(&dynBuffer);
+   // and the final NUL
+   result->resultBufferLen++;
+
+   result->nextEntry = 0;
+   result->nextEntryStart = 0;
 
 abort:
-   DynBuf_Destroy(&dynBuffer);
-   ProcMgr_FreeProcList(procList);
+   DynBuf_Destroy(&scratch);
+   return err;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListProcessesExFill --
+ *
+ *    Formats the part of a ListProcessesEx result that starts at offset,
+ *    len bytes, into dst. Only the entries the part covers are formatted.
+ *
+ * Return value:
+ *    VixError
+ *
+ * Side effects:
+ *    Moves the cursor past the part.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VixError
+VixToolsListProcessesExFill(VixToolsCachedListProcessesResult *result, // IN/OUT
+                            size_t offset,                             // IN
+                            size_t len,                                // IN
+                            char *dst)                                 // OUT
+{
+   VixError err = VIX_OK;
+   GArray *entries = result->entries;
+   DynBuf scratch;
+
+   ASSERT(offset + len <= result->resultBufferLen);
+
+   /*
+    * The Vix side asks for the result in order, but start over if it went
+    * back (e.g., retried a reply that got lost).
+    */
+   if (offset < result->nextEntryStart) {
+      result->nextEntry = 0;
+      result->nextEntryStart = 0;
+   }
+   while (result->nextEntry < entries->len &&
+          result->nextEntryStart +
+          g_array_index(entries, VixToolsListProcEntry,
+                        result->nextEntry).xmlLen <= offset) {
+      result->nextEntryStart += g_array_index(entries, VixToolsListProcEntry,
+                                              result->nextEntry).xmlLen;
+      result->nextEntry++;
+   }
+
+   DynBuf_Init(&scratch);
+
+   while (len > 0) {
+      size_t skip = offset - result->nextEntryStart;
+      size_t chunk;
+
+      if (result->nextEntry == entries->len) {
+         // only the final NUL is left
+         ASSERT(1 == len && 0 == skip);
+         *dst = '\0';
+         break;
+      }
+
+      err = VixToolsFormatListProcEntry(&g_array_index(entries,
+                                                       VixToolsListProcEntry,
+                                                       result->nextEntry),
+                                        &scratch);
+      if (VIX_OK != err) {
+         goto abort;
+      }
+      ASSERT(DynBuf_GetSize(&scratch) > skip);
+
+      chunk = MIN(len, DynBuf_GetSize(&scratch) - skip);
+      memcpy(dst, (char *) DynBuf_Get(&scratch) + skip, chunk);
+      dst += chunk;
+      offset += chunk;
+      len -= chunk;
+
+      if (skip + chunk == DynBuf_GetSize(&scratch)) {
+         result->nextEntryStart += DynBuf_GetSize(&scratch);
+         result->nextEntry++;
+      }
+   }
+
+abort:
+   DynBuf_Destroy(&scratch);
    return err;
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListProcessesExParseFilter --
+ *
+ *    Extracts the filter from a ListProcessesEx request.
+ *
+ * Return value:
+ *    VixError
+ *
+ * Side effects:
+ *    The filter points into the request.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VixError
+VixToolsListProcessesExParseFilter(VixMsgListProcessesExRequest *listRequest, // IN
+                                   VixToolsListProcFilter *filter)            // OUT
+{
+   VixCommandRequestHeader *requestMsg = &listRequest->header;
+   uint64 msgLen = (uint64) requestMsg->commonHeader.headerLength +
+                   requestMsg->commonHeader.bodyLength;
+   uint64 pidsEnd = sizeof *listRequest +
+                    (uint64) listRequest->numPids * sizeof (uint64);
+   VixMsgListProcessesExFilter *msgFilter;
+   const char *user;
+   const char *namePrefix;
+
+   memset(filter, 0, sizeof *filter);
+
+   if (msgLen < pidsEnd) {
+      g_warning("%s: Invalid request message received\n", __FUNCTION__);
+      return VIX_E_INVALID_MESSAGE_BODY;
+   }
+
+   filter->numPids = listRequest->numPids;
+   if (filter->numPids > 0) {
+      filter->pids = (uint64 *)((char *)listRequest + sizeof *listRequest);
+   }
+
+   if (msgLen == pidsEnd) {
+      return VIX_OK;
+   }
+
+   msgFilter = (VixMsgListProcessesExFilter *)((char *)listRequest + pidsEnd);
+   if (msgLen < pidsEnd + sizeof *msgFilter ||
+       msgLen != pidsEnd + sizeof *msgFilter +
+                 (uint64) msgFilter->userLength + 1 +
+                 (uint64) msgFilter->namePrefixLength + 1) {
+      g_warning("%s: Invalid request message received\n", __FUNCTION__);
+      return VIX_E_INVALID_MESSAGE_BODY;
+   }
+
+   user = (const char *)msgFilter + sizeof *msgFilter;
+   namePrefix = user + msgFilter->userLength + 1;
+   if ('\0' != user[msgFilter->userLength] ||
+       '\0' != namePrefix[msgFilter->namePrefixLength]) {
+      g_warning("%s: Invalid request message received\n", __FUNCTION__);
+      return VIX_E_INVALID_MESSAGE_BODY;
+   }
+
+   if (msgFilter->userLength > 0) {
+      filter->user = user;
+   }
+   if (msgFilter->namePrefixLength > 0) {
+      filter->namePrefix = namePrefix;
+   }
+
+   return VIX_OK;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * VixToolsListProcessesEx --
  *
+ *    Lists processes. A result that doesn't fit in one reply is kept, as
+ *    the list of processes, until the Vix side fetched all of it; each
+ *    reply only formats the processes it covers.
  *
  * Return value:
  *    VixError
@@ -5383,20 +6231,18 @@ VixToolsListProcessesEx(VixCommandRequestHeader *requestMsg, // IN
                         char **result)                       // OUT
 {
    VixError err = VIX_OK;
-   char *fullResultBuffer = NULL;
    char *finalResultBuffer = NULL;
-   size_t fullResultSize = 0;
    size_t curPacketLen = 0;
    int32 leftToSend = 0;
    Bool impersonatingVMWareUser = FALSE;
    void *userToken = NULL;
    VixMsgListProcessesExRequest *listRequest;
-   uint64 *pids = NULL;
-   uint32 numPids;
+   VixToolsListProcFilter filter;
    uint32 key;
    uint32 offset;
    int len;
    VixToolsCachedListProcessesResult *cachedResult = NULL;
+   VixToolsCachedListProcessesResult *newResult = NULL;
    GSource *timer;
 #ifdef _WIN32
    Bool bRet;
@@ -5505,44 +6351,49 @@ VixToolsListProcessesEx(VixCommandRequestHeader *requestMsg, // IN
 
    } else {
       /*
-       * No key, so this is the initial/only request.  Generate data,
-       * cache if necessary.
+       * No key, so this is the initial/only request.  Work out what to
+       * report, cache it if necessary.
        */
-
-      numPids = listRequest->numPids;
-      if (numPids > 0) {
-         pids = (uint64 *)((char *)requestMsg + sizeof(*listRequest));
+      err = VixToolsListProcessesExParseFilter(listRequest, &filter);
+      if (VIX_OK != err) {
+         goto abort;
       }
 
-      err = VixToolsListProcessesExGenerateData(numPids, pids,
-                                                &fullResultSize,
-                                                &fullResultBuffer);
+      newResult = Util_SafeCalloc(1, sizeof *newResult);
+      err = VixToolsListProcessesExCollect(&filter, &newResult->entries);
+      if (VIX_OK != err) {
+         goto abort;
+      }
+      err = VixToolsListProcessesExMeasure(newResult);
+      if (VIX_OK != err) {
+         goto abort;
+      }
 
       /*
        * Check if the result is large enough to require more than one trip.
        * Stuff it in the hash table if so.
        */
-      if ((fullResultSize + resultHeaderSize) > maxBufferSize) {
+      if ((newResult->resultBufferLen + resultHeaderSize) > maxBufferSize) {
          g_debug("%s: answer requires caching.  have %d bytes\n",
-                 __FUNCTION__, (int) (fullResultSize + resultHeaderSize));
+                 __FUNCTION__,
+                 (int) (newResult->resultBufferLen + resultHeaderSize));
          /*
           * Save it off in the hashtable.
           */
          key = listProcessesResultsKey++;
-         cachedResult = Util_SafeMalloc(sizeof(*cachedResult));
-         cachedResult->resultBufferLen = fullResultSize;
-         cachedResult->resultBuffer = fullResultBuffer;
-         cachedResult->key = key;
+         newResult->key = key;
 #ifdef _WIN32
-         bRet = VixToolsGetUserName(&cachedResult->userName);
+         bRet = VixToolsGetUserName(&newResult->userName);
          if (!bRet) {
             g_warning("%s: failed to get current userName\n", __FUNCTION__);
             goto abort;
          }
 #else
-         cachedResult->euid = Id_GetEUid();
+         newResult->euid = Id_GetEUid();
 #endif
 
+         cachedResult = newResult;
+         newResult = NULL;
          g_hash_table_replace(listProcessesResultsTable, &cachedResult->key,
                               cachedResult);
 
@@ -5597,8 +6448,14 @@ VixToolsListProcessesEx(VixCommandRequestHeader *requestMsg, // IN
                            leftToSend);
       }
 
-      memcpy(finalResultBuffer + len,
-             cachedResult->resultBuffer + offset, curPacketLen);
+      err = VixToolsListProcessesExFill(cachedResult, offset, curPacketLen,
+                                        finalResultBuffer + len);
+      if (VIX_OK != err) {
+         free(finalResultBuffer);
+         finalResultBuffer = NULL;
+         g_hash_table_remove(listProcessesResultsTable, &key);
+         goto abort;
+      }
       finalResultBuffer[curPacketLen + len] = '\0';
 
       /*
@@ -5612,11 +6469,19 @@ VixToolsListProcessesEx(VixCommandRequestHeader *requestMsg, // IN
       /*
        * In the simple/common case, just return the basic proces info.
        */
-      finalResultBuffer = fullResultBuffer;
+      finalResultBuffer = Util_SafeMalloc(newResult->resultBufferLen);
+      err = VixToolsListProcessesExFill(newResult, 0,
+                                        newResult->resultBufferLen,
+                                        finalResultBuffer);
+      if (VIX_OK != err) {
+         free(finalResultBuffer);
+         finalResultBuffer = NULL;
+      }
    }
 
 
 abort:
+   VixToolsFreeCachedResult(newResult);
 #ifdef _WIN32
    free(userName);
 #endif
@@ -5667,10 +6532,6 @@ VixToolsPrintProcInfoEx(DynBuf *dstBuffer,             // IN/OUT
    char *escapedName = NULL;
    char *escapedCmd = NULL;
    char *escapedUser = NULL;
-   char *cmdNamePtr = NULL;
-   size_t bytesPrinted;
-   char *procInfoEntry;
-   Bool success;
 
    if (NULL != cmd) {
       escapedCmd = VixToolsEscapeXMLString(cmd);
@@ -5678,9 +6539,6 @@ VixToolsPrintProcInfoEx(DynBuf *dstBuffer,             // IN/OUT
          err = VIX_E_OUT_OF_MEMORY;
          goto abort;
       }
-      cmdNamePtr = Str_SafeAsprintf(NULL, "<cmd>%s</cmd>", escapedCmd);
-   } else {
-      cmdNamePtr = Util_SafeStrdup("");
    }
 
    escapedName = VixToolsEscapeXMLString(name);
@@ -5695,26 +6553,22 @@ VixToolsPrintProcInfoEx(DynBuf *dstBuffer,             // IN/OUT
       goto abort;
    }
 
-   procInfoEntry = Str_SafeAsprintf(&bytesPrinted,
-                                    "<proc>"
-                                    "%s"              // has <cmd>...</cmd> tags if there is cmd, else "";
-                                    "<name>%s</name>"
-                                    "<pid>%"FMT64"d</pid>"
-                                    "<user>%s</user>"
-                                    "<start>%d</start>"
-                                    "<eCode>%d</eCode>"
-                                    "<eTime>%d</eTime>"
-                                    "</proc>",
-                                    cmdNamePtr, escapedName, pid, escapedUser,
-                                    start, exitCode, exitTime);
-   if (NULL == procInfoEntry) {
-      err = VIX_E_OUT_OF_MEMORY;
-      goto abort;
-   }
-
-   success = DynBuf_Append(dstBuffer, procInfoEntry, bytesPrinted);
-   free(procInfoEntry);
-   if (!success) {
+   /* Formatted in place; dstBuffer is reused from one entry to the next. */
+   if (!StrUtil_DynBufPrintf(dstBuffer,
+                             "<proc>"
+                             "%s%s%s"          // <cmd>...</cmd> if there is cmd
+                             "<name>%s</name>"
+                             "<pid>%"FMT64"d</pid>"
+                             "<user>%s</user>"
+                             "<start>%d</start>"
+                             "<eCode>%d</eCode>"
+                             "<eTime>%d</eTime>"
+                             "</proc>",
+                             NULL != escapedCmd ? "<cmd>" : "",
+                             NULL != escapedCmd ? escapedCmd : "",
+                             NULL != escapedCmd ? "</cmd>" : "",
+                             escapedName, pid, escapedUser,
+                             start, exitCode, exitTime)) {
       err = VIX_E_OUT_OF_MEMORY;
       goto abort;
    }
@@ -5722,7 +6576,6 @@ VixToolsPrintProcInfoEx(DynBuf *dstBuffer,             // IN/OUT
    err = VIX_OK;
 
 abort:
-   free(cmdNamePtr);
    free(escapedName);
    free(escapedUser);
    free(escapedCmd);
@@ -6201,13 +7054,296 @@ abort:
       free(fileNameList);
    }
 
-   // XXX result too large for g_debug()
+   // XXX result too large for g_debug()
+
+   g_message("%s: opcode %d returning %"FMT64"d\n", __FUNCTION__,
+             requestMsg->opCode, err);
+
+   return err;
+} // VixToolsListDirectory
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsFreeListFilesCursor --
+ *
+ *    Frees a ListFilesInGuest listing.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsFreeListFilesCursor(VixToolsListFilesCursor *cursor)  // IN
+{
+   int fileNum;
+
+   if (NULL == cursor) {
+      return;
+   }
+
+   if (NULL != cursor->timer) {
+      g_source_destroy(cursor->timer);
+      g_source_unref(cursor->timer);
+   }
+
+   for (fileNum = 0; fileNum < cursor->numFiles; fileNum++) {
+      free(cursor->fileNameList[fileNum]);
+   }
+   free(cursor->fileNameList);
+   free(cursor->matchesFrom);
+   free(cursor->dirPathName);
+   free(cursor->pattern);
+#ifdef _WIN32
+   free(cursor->userName);
+#endif
+   free(cursor);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListFilesCursorExpired --
+ *
+ *    Timer callback: drops a listing nobody asked for in a while.
+ *
+ * Return value:
+ *    FALSE -- tells glib not to call again
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VixToolsListFilesCursorExpired(void *clientData) // IN
+{
+   VixToolsListFilesCursor *cursor = clientData;
+
+   g_debug("%s: dropping listing of '%s'\n", __FUNCTION__,
+           cursor->dirPathName);
+
+   listFilesCursors = g_list_remove(listFilesCursors, cursor);
+
+   g_source_unref(cursor->timer);
+   cursor->timer = NULL;
+   VixToolsFreeListFilesCursor(cursor);
+
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsTakeListFilesCursor --
+ *
+ *    Looks for the listing of a directory the current user has been paging
+ *    through, and takes it off the list.
+ *
+ * Return value:
+ *    The listing, NULL if there is none.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VixToolsListFilesCursor *
+VixToolsTakeListFilesCursor(const char *dirPathName,  // IN
+                            const char *pattern)      // IN
+{
+   GList *l;
+#ifdef _WIN32
+   wchar_t *userName = NULL;
+
+   if (NULL != listFilesCursors && !VixToolsGetUserName(&userName)) {
+      g_warning("%s: VixToolsGetUserName() failed\n", __FUNCTION__);
+      return NULL;
+   }
+#endif
+
+   for (l = listFilesCursors; NULL != l; l = l->next) {
+      VixToolsListFilesCursor *cursor = l->data;
+
+#ifdef _WIN32
+      if (0 != wcscmp(userName, cursor->userName)) {
+         continue;
+      }
+#else
+      if (cursor->euid != Id_GetEUid()) {
+         continue;
+      }
+#endif
+      if (0 != strcmp(cursor->dirPathName, dirPathName) ||
+          (NULL == pattern) != (NULL == cursor->pattern) ||
+          (NULL != pattern && 0 != strcmp(cursor->pattern, pattern))) {
+         continue;
+      }
+
+      listFilesCursors = g_list_delete_link(listFilesCursors, l);
+      if (NULL != cursor->timer) {
+         g_source_destroy(cursor->timer);
+         g_source_unref(cursor->timer);
+         cursor->timer = NULL;
+      }
+#ifdef _WIN32
+      free(userName);
+#endif
+      return cursor;
+   }
+
+#ifdef _WIN32
+   free(userName);
+#endif
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsKeepListFilesCursor --
+ *
+ *    Keeps a listing for the next page, until it's been idle for timeout
+ *    seconds.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    May drop the least recently used listing.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsKeepListFilesCursor(VixToolsListFilesCursor *cursor,  // IN
+                            int timeout,                      // IN
+                            void *eventQueue)                 // IN
+{
+   if (g_list_length(listFilesCursors) >= VIX_TOOLS_LISTFILES_MAX_CURSORS) {
+      GList *last = g_list_last(listFilesCursors);
+
+      VixToolsFreeListFilesCursor(last->data);
+      listFilesCursors = g_list_delete_link(listFilesCursors, last);
+   }
+
+#ifdef _WIN32
+   if (NULL == cursor->userName &&
+       !VixToolsGetUserName(&cursor->userName)) {
+      g_warning("%s: failed to get current userName\n", __FUNCTION__);
+      VixToolsFreeListFilesCursor(cursor);
+      return;
+   }
+#else
+   cursor->euid = Id_GetEUid();
+#endif
+
+   cursor->timer = g_timeout_source_new(timeout * 1000);
+   g_source_set_callback(cursor->timer, VixToolsListFilesCursorExpired,
+                         cursor, NULL);
+   g_source_attach(cursor->timer, g_main_loop_get_context(eventQueue));
+
+   listFilesCursors = g_list_prepend(listFilesCursors, cursor);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsNewListFilesCursor --
+ *
+ *    Lists a directory (or a single file) for ListFilesInGuest, and works
+ *    out which entries match the pattern.
+ *
+ * Return value:
+ *    VixError
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VixError
+VixToolsNewListFilesCursor(const char *dirPathName,          // IN
+                           const char *pattern,              // IN
+                           GRegex *regex,                    // IN
+                           VixToolsListFilesCursor **result) // OUT
+{
+   VixToolsListFilesCursor *cursor;
+   int fileNum;
+
+   cursor = Util_SafeCalloc(1, sizeof *cursor);
+   cursor->dirPathName = Util_SafeStrdup(dirPathName);
+   cursor->pattern = Util_SafeStrdup(pattern);
+
+   /*
+    * First check for symlink -- File_IsDirectory() will lie
+    * if its a symlink to a directory.
+    */
+   if (!File_IsSymLink(dirPathName) && File_IsDirectory(dirPathName)) {
+      char **fileNameList = NULL;
+      int numFiles = File_ListDirectory(dirPathName, &fileNameList);
+
+      if (numFiles < 0) {
+         VixToolsFreeListFilesCursor(cursor);
+         return FoundryToolsDaemon_TranslateSystemErr();
+      }
+      /*
+       * File_ListDirectory() doesn't return '.' and '..', but we want them,
+       * so add '.' and '..' to the list.  Place them in front since that's
+       * a more normal location.
+       */
+      cursor->numFiles = numFiles + 2;
+      cursor->fileNameList = Util_SafeMalloc(cursor->numFiles * sizeof(char *));
+      cursor->fileNameList[0] = Unicode_Alloc(".", STRING_ENCODING_UTF8);
+      cursor->fileNameList[1] = Unicode_Alloc("..", STRING_ENCODING_UTF8);
+      memcpy(cursor->fileNameList + 2, fileNameList, numFiles * sizeof(char *));
+      free(fileNameList);
+   } else {
+      if (File_Exists(dirPathName)) {
+         cursor->listingSingleFile = TRUE;
+         cursor->numFiles = 1;
+         cursor->fileNameList = Util_SafeMalloc(sizeof(char *));
+         cursor->fileNameList[0] = Util_SafeStrdup(dirPathName);
+      } else {
+         /*
+          * We don't know what they intended to list, but we'll
+          * assume file since that gives a fairly sane error.
+          */
+         VixError err = FoundryToolsDaemon_TranslateSystemErr();
+
+         VixToolsFreeListFilesCursor(cursor);
+         return err;
+      }
+   }
+
+   cursor->matchesFrom = Util_SafeMalloc((cursor->numFiles + 1) *
+                                         sizeof *cursor->matchesFrom);
+   cursor->matchesFrom[cursor->numFiles] = 0;
+   for (fileNum = cursor->numFiles - 1; fileNum >= 0; fileNum--) {
+      Bool matches = NULL == regex ||
+                     g_regex_match(regex, cursor->fileNameList[fileNum], 0,
+                                   NULL);
 
-   g_message("%s: opcode %d returning %"FMT64"d\n", __FUNCTION__,
-             requestMsg->opCode, err);
+      cursor->matchesFrom[fileNum] = cursor->matchesFrom[fileNum + 1] +
+                                     (matches ? 1 : 0);
+   }
 
-   return err;
-} // VixToolsListDirectory
+   *result = cursor;
+   return VIX_OK;
+}
 
 
 /*
@@ -6229,15 +7365,19 @@ abort:
 VixError
 VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
                   size_t maxBufferSize,                   // IN
+                  GKeyFile *confDictRef,                  // IN
+                  void *eventQueue,                       // IN
                   char **result)                          // OUT
 {
    VixError err = VIX_OK;
    const char *dirPathName = NULL;
    char *fileList = NULL;
-   char **fileNameList = NULL;
+   char **fileNameList;
+   VixToolsListFilesCursor *cursor = NULL;
+   int cursorTimeout = VIX_TOOLS_LISTFILES_CURSOR_TIMEOUT_DEFAULT;
    size_t resultBufferSize = 0;
    size_t lastGoodResultBufferSize = 0;
-   int numFiles = 0;
+   int numFiles;
    int fileNum;
    char *currentFileName;
    char *destPtr;
@@ -6318,48 +7458,37 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
       }
    }
 
+   if (confDictRef != NULL &&
+       g_key_file_has_key(confDictRef, VIX_TOOLS_CONFIG_API_GROUPNAME,
+                          VIX_TOOLS_CONFIG_LISTFILES_CURSOR_TIMEOUT, NULL)) {
+      cursorTimeout = g_key_file_get_integer(confDictRef,
+                                             VIX_TOOLS_CONFIG_API_GROUPNAME,
+                                     VIX_TOOLS_CONFIG_LISTFILES_CURSOR_TIMEOUT,
+                                             NULL);
+   }
+
    /*
-    * First check for symlink -- File_IsDirectory() will lie
-    * if its a symlink to a directory.
+    * A request for a later page of a listing we kept picks up from there;
+    * a request for the first page lists the directory again.
     */
-   if (!File_IsSymLink(dirPathName) && File_IsDirectory(dirPathName)) {
-      numFiles = File_ListDirectory(dirPathName, &fileNameList);
-      if (numFiles < 0) {
-         err = FoundryToolsDaemon_TranslateSystemErr();
-         goto abort;
-      }
-      /*
-       * File_ListDirectory() doesn't return '.' and '..', but we want them,
-       * so add '.' and '..' to the list.  Place them in front since that's
-       * a more normal location.
-       */
-      numFiles += 2;
-      {
-         char **newFileNameList = NULL;
-
-         newFileNameList = Util_SafeMalloc(numFiles * sizeof(char *));
-         newFileNameList[0] = Unicode_Alloc(".", STRING_ENCODING_UTF8);
-         newFileNameList[1] = Unicode_Alloc("..", STRING_ENCODING_UTF8);
-         memcpy(newFileNameList + 2, fileNameList, (numFiles - 2) * sizeof(char *));
-         free(fileNameList);
-         fileNameList = newFileNameList;
+   if (cursorTimeout > 0) {
+      cursor = VixToolsTakeListFilesCursor(dirPathName, pattern);
+      if (NULL != cursor && 0 == offset + index) {
+         VixToolsFreeListFilesCursor(cursor);
+         cursor = NULL;
       }
-   } else {
-      if (File_Exists(dirPathName)) {
-         listingSingleFile = TRUE;
-         numFiles = 1;
-         fileNameList = Util_SafeMalloc(sizeof(char *));
-         fileNameList[0] = Util_SafeStrdup(dirPathName);
-      } else {
-         /*
-          * We don't know what they intended to list, but we'll
-          * assume file since that gives a fairly sane error.
-          */
-         err = FoundryToolsDaemon_TranslateSystemErr();
+   }
+   if (NULL == cursor) {
+      err = VixToolsNewListFilesCursor(dirPathName, pattern, regex, &cursor);
+      if (VIX_OK != err) {
          goto abort;
       }
    }
 
+   numFiles = cursor->numFiles;
+   fileNameList = cursor->fileNameList;
+   listingSingleFile = cursor->listingSingleFile;
+
    /*
     * Calculate the size of the result buffer and keep track of the
     * max number of entries we can store.  Also compute the number
@@ -6377,17 +7506,15 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
 
       currentFileName = fileNameList[fileNum];
 
-      if (regex) {
-         if (!g_regex_match(regex, currentFileName, 0, NULL)) {
-            continue;
-         }
+      if (cursor->matchesFrom[fileNum] == cursor->matchesFrom[fileNum + 1]) {
+         continue;   // doesn't match the pattern
       }
 
       if (count < maxResults) {
          count++;
       } else {
-         remaining++;
-         continue;   // stop computing buffersize
+         remaining = cursor->matchesFrom[fileNum];
+         break;      // stop computing buffersize
       }
 
       if (listingSingleFile) {
@@ -6441,10 +7568,8 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
 
       currentFileName = fileNameList[fileNum];
 
-      if (regex) {
-         if (!g_regex_match(regex, currentFileName, 0, NULL)) {
-            continue;
-         }
+      if (cursor->matchesFrom[fileNum] == cursor->matchesFrom[fileNum + 1]) {
+         continue;
       }
 
       if (listingSingleFile) {
@@ -6462,6 +7587,15 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
    } // for (fileNum = 0; fileNum < lastGoodNumFiles; fileNum++)
    *destPtr = '\0';
 
+   /*
+    * Keep the listing if the caller has more to fetch.
+    */
+   if ((truncated || remaining > 0) && !listingSingleFile &&
+       cursorTimeout > 0) {
+      VixToolsKeepListFilesCursor(cursor, cursorTimeout, eventQueue);
+      cursor = NULL;
+   }
+
 abort:
    if (impersonatingVMWareUser) {
       VixToolsUnimpersonateUser(userToken);
@@ -6473,12 +7607,7 @@ abort:
    }
    *result = fileList;
 
-   if (NULL != fileNameList) {
-      for (fileNum = 0; fileNum < numFiles; fileNum++) {
-         free(fileNameList[fileNum]);
-      }
-      free(fileNameList);
-   }
+   VixToolsFreeListFilesCursor(cursor);
 
    // XXX result too large for g_debug()
 
@@ -7215,7 +8344,6 @@ VixToolsRunScript(VixCommandRequestHeader *requestMsg,  // IN
    Bool forcedRoot = FALSE;
    wchar_t *envBlock = NULL;
 #endif
-   GSource *timer;
    VMAutomationRequestParser parser;
 
    err = VMAutomationRequestParserInit(&parser,
@@ -7456,7 +8584,7 @@ VixToolsRunScript(VixCommandRequestHeader *requestMsg,  // IN
    procArgs.dwCreationFlags = CREATE_UNICODE_ENVIRONMENT;
    procArgs.lpEnvironment = envBlock;
 #else
-   procArgs.envp = VixToolsEnvironmentTableToEnvp(userEnvironmentTable);
+   procArgs.envp = VixToolsGetUserEnvp();
 #endif
 
    asyncState->procState = ProcMgr_ExecAsync(fullCommandLine, &procArgs);
@@ -7466,7 +8594,6 @@ VixToolsRunScript(VixCommandRequestHeader *requestMsg,  // IN
       Impersonate_UnforceRoot();
    }
 #else
-   VixToolsFreeEnvp(procArgs.envp);
    DEBUG_ONLY(procArgs.envp = NULL;)
 #endif
 
@@ -7478,10 +8605,8 @@ VixToolsRunScript(VixCommandRequestHeader *requestMsg,  // IN
    pid = (int64) ProcMgr_GetPid(asyncState->procState);
 
    asyncState->eventQueue = eventQueue;
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, eventQueue,
+                          VixToolsMonitorAsyncProc, asyncState);
 
    /*
     * VixToolsMonitorAsyncProc will clean asyncState up when the program finishes.
@@ -7598,95 +8723,435 @@ VixToolsImpersonateUser(VixCommandRequestHeader *requestMsg,   // IN
          (VixCommandNamePassword *) credentialField;
       credentialField += sizeof(*namePasswordStruct);
 
-      err = VixToolsImpersonateUserImplEx(NULL,
-                                          credentialType,
-                                          credentialField,
-                                          userToken);
-      if ((VIX_OK != err)
-          && ((VIX_USER_CREDENTIAL_NAME_PASSWORD_OBFUSCATED == credentialType)
-              || (VIX_USER_CREDENTIAL_NAME_PASSWORD == credentialType))) {
-         /*
-          * Windows does not allow you to login with an empty password. Only
-          * the console allows this login, which means the console does not
-          * call the simple public LogonUser api.
-          *
-          * See the description for ERROR_ACCOUNT_RESTRICTION.
-          * For example, the error codes are described here:
-          *      http://support.microsoft.com/kb/155012
-          */
-#ifdef _WIN32
-         if (namePasswordStruct->passwordLength <= 0) {
-            err = VIX_E_EMPTY_PASSWORD_NOT_ALLOWED_IN_GUEST;
-         }
-#endif
+      err = VixToolsImpersonateUserImplEx(NULL,
+                                          credentialType,
+                                          credentialField,
+                                          userToken);
+      if ((VIX_OK != err)
+          && ((VIX_USER_CREDENTIAL_NAME_PASSWORD_OBFUSCATED == credentialType)
+              || (VIX_USER_CREDENTIAL_NAME_PASSWORD == credentialType))) {
+         /*
+          * Windows does not allow you to login with an empty password. Only
+          * the console allows this login, which means the console does not
+          * call the simple public LogonUser api.
+          *
+          * See the description for ERROR_ACCOUNT_RESTRICTION.
+          * For example, the error codes are described here:
+          *      http://support.microsoft.com/kb/155012
+          */
+#ifdef _WIN32
+         if (namePasswordStruct->passwordLength <= 0) {
+            err = VIX_E_EMPTY_PASSWORD_NOT_ALLOWED_IN_GUEST;
+         }
+#endif
+      }
+      break;
+   }
+#if SUPPORT_VGAUTH
+   case VIX_USER_CREDENTIAL_SAML_BEARER_TOKEN:
+   {
+      VixCommandSAMLToken *samlStruct =
+         (VixCommandSAMLToken *) credentialField;
+      credentialField += sizeof(*samlStruct);
+
+      err = VixToolsImpersonateUserImplEx(NULL,
+                                          credentialType,
+                                          credentialField,
+                                          userToken);
+      break;
+   }
+#endif
+   case VIX_USER_CREDENTIAL_SSPI:
+      /*
+       * SSPI currently only supported in ticketed sessions
+       */
+   default:
+      g_warning("%s: Unsupported credentialType = %d\n",
+                __FUNCTION__, credentialType);
+      err = VIX_E_NOT_SUPPORTED;
+   }
+
+done:
+   if (err != VIX_OK) {
+      g_warning("%s: impersonation failed (%"FMT64"d)\n",
+                  __FUNCTION__, err);
+   } else {
+      g_debug("%s: successfully impersonated user %s\n", __FUNCTION__,
+              IMPERSONATED_USERNAME);
+   }
+
+   return(err);
+} // VixToolsImpersonateUser
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsImpersonateUserImpl --
+ *
+ *    Little compatability wrapper for legacy Foundry Tools implementations.
+ *
+ * Return value:
+ *    TRUE on success
+ *    FALSE on failure
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+VixToolsImpersonateUserImpl(char const *credentialTypeStr,         // IN
+                            int credentialType,                    // IN
+                            char const *obfuscatedNamePassword,    // IN
+                            void **userToken)                      // OUT
+{
+   return(VIX_OK == VixToolsImpersonateUserImplEx(credentialTypeStr,
+                                                  credentialType,
+                                                  obfuscatedNamePassword,
+                                                  userToken));
+} // VixToolsImpersonateUserImpl
+
+
+#if SUPPORT_VGAUTH
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsGetCredentialCacheTimeout --
+ *
+ *      Looks up how long validated credentials are kept.
+ *
+ * Results:
+ *      The timeout in seconds, 0 or less if credentials aren't cached.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+VixToolsGetCredentialCacheTimeout(void)
+{
+   if (gConfDictRef != NULL &&
+       g_key_file_has_key(gConfDictRef, VIX_TOOLS_CONFIG_API_GROUPNAME,
+                          VIXTOOLS_CONFIG_CREDENTIAL_CACHE_TIMEOUT, NULL)) {
+      return g_key_file_get_integer(gConfDictRef,
+                                    VIX_TOOLS_CONFIG_API_GROUPNAME,
+                                    VIXTOOLS_CONFIG_CREDENTIAL_CACHE_TIMEOUT,
+                                    NULL);
+   }
+
+   return VIX_TOOLS_CREDENTIAL_CACHE_TIMEOUT_DEFAULT;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsCredentialDigest --
+ *
+ *      Computes the salted digest the credentials are cached under.
+ *
+ * Results:
+ *      TRUE on success, FALSE if no salt could be generated.
+ *
+ * Side effects:
+ *      Generates the salt on first use.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+VixToolsCredentialDigest(int credentialType,                     // IN
+                         char const *obfuscatedNamePassword,     // IN
+                         unsigned char digest[SHA1_HASH_LEN])    // OUT
+{
+   SHA1_CTX sha1Ctx;
+
+   if (!credentialCacheSalted) {
+      if (!Random_Crypto(sizeof credentialCacheSalt, credentialCacheSalt)) {
+         g_warning("%s: Unable to generate a salt\n", __FUNCTION__);
+         return FALSE;
+      }
+      credentialCacheSalted = TRUE;
+   }
+
+   SHA1Init(&sha1Ctx);
+   SHA1Update(&sha1Ctx, credentialCacheSalt, sizeof credentialCacheSalt);
+   SHA1Update(&sha1Ctx, (const unsigned char *) &credentialType,
+              sizeof credentialType);
+   SHA1Update(&sha1Ctx, (const unsigned char *) obfuscatedNamePassword,
+              strlen(obfuscatedNamePassword) + 1);
+   SHA1Final(digest, &sha1Ctx);
+   memset(&sha1Ctx, 0, sizeof sha1Ctx);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsFreeCachedCredential --
+ *
+ *      Frees a credential cache entry. A user handle that is being
+ *      impersonated is left to VixToolsLogoutUser().
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsFreeCachedCredential(VixToolsCachedCredential *entry)    // IN
+{
+   if (entry->userHandle == currentUserHandle) {
+      currentUserHandleCached = FALSE;
+   } else {
+      VGAuth_UserHandleFree(entry->userHandle);
+   }
+   free(entry);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsFlushCredentialCache --
+ *
+ *      Forgets all the cached credentials.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsFlushCredentialCache(void)
+{
+   while (NULL != credentialCache) {
+      VixToolsFreeCachedCredential(credentialCache->data);
+      credentialCache = g_list_delete_link(credentialCache, credentialCache);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsImpersonateCachedCredential --
+ *
+ *      Impersonates the user handle cached for the credentials, if any.
+ *      Expired entries are dropped on the way, all of them if caching was
+ *      turned off.
+ *
+ * Results:
+ *      TRUE if the user is being impersonated, FALSE if the credentials
+ *      must be validated.
+ *
+ * Side effects:
+ *      Current process impersonates.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+VixToolsImpersonateCachedCredential(int credentialType,                 // IN
+                                    char const *obfuscatedNamePassword, // IN
+                                    void **userToken)                   // OUT
+{
+   unsigned char digest[SHA1_HASH_LEN];
+   VmTimeType now = Hostinfo_SystemTimerUS();
+   VixToolsCachedCredential *entry = NULL;
+   VGAuthContext *ctx;
+   VGAuthError vgErr;
+   GList *l = credentialCache;
+
+   if (VixToolsGetCredentialCacheTimeout() <= 0) {
+      VixToolsFlushCredentialCache();
+      return FALSE;
+   }
+
+   while (NULL != l) {
+      GList *next = l->next;
+      VixToolsCachedCredential *cur = l->data;
+
+      if (now >= cur->expires) {
+         VixToolsFreeCachedCredential(cur);
+         credentialCache = g_list_delete_link(credentialCache, l);
+      }
+      l = next;
+   }
+
+   if (NULL == credentialCache || NULL == obfuscatedNamePassword ||
+       !VixToolsCredentialDigest(credentialType, obfuscatedNamePassword,
+                                 digest)) {
+      return FALSE;
+   }
+
+   for (l = credentialCache; NULL != l; l = l->next) {
+      VixToolsCachedCredential *cur = l->data;
+
+      if (memcmp(cur->digest, digest, sizeof digest) == 0) {
+         entry = cur;
+         break;
       }
-      break;
    }
-#if SUPPORT_VGAUTH
-   case VIX_USER_CREDENTIAL_SAML_BEARER_TOKEN:
-   {
-      VixCommandSAMLToken *samlStruct =
-         (VixCommandSAMLToken *) credentialField;
-      credentialField += sizeof(*samlStruct);
+   if (NULL == entry) {
+      return FALSE;
+   }
 
-      err = VixToolsImpersonateUserImplEx(NULL,
-                                          credentialType,
-                                          credentialField,
-                                          userToken);
-      break;
+   credentialCache = g_list_delete_link(credentialCache, l);
+
+   vgErr = TheVGAuthContext(&ctx);
+   if (VGAUTH_FAILED(vgErr)) {
+      VixToolsFreeCachedCredential(entry);
+      return FALSE;
+   }
+
+   vgErr = VGAuth_Impersonate(ctx, entry->userHandle, 0, NULL);
+   if (VGAUTH_FAILED(vgErr)) {
+      g_debug("%s: Impersonating a cached user handle failed: "VGAUTHERR_FMT64X
+              "\n", __FUNCTION__, vgErr);
+      VixToolsFreeCachedCredential(entry);
+      return FALSE;
+   }
+
+#ifdef _WIN32
+   // this is making a copy of the token, be sure to close it
+   vgErr = VGAuth_UserHandleAccessToken(ctx, entry->userHandle, userToken);
+   if (VGAUTH_FAILED(vgErr)) {
+      GuestAuthUnimpersonate();
+      VixToolsFreeCachedCredential(entry);
+      return FALSE;
    }
 #endif
-   case VIX_USER_CREDENTIAL_SSPI:
-      /*
-       * SSPI currently only supported in ticketed sessions
-       */
-   default:
-      g_warning("%s: Unsupported credentialType = %d\n",
-                __FUNCTION__, credentialType);
-      err = VIX_E_NOT_SUPPORTED;
+
+   credentialCache = g_list_prepend(credentialCache, entry);
+   currentUserHandle = entry->userHandle;
+   currentUserHandleCached = TRUE;
+   gImpersonatedUsername = VixToolsGetImpersonatedUsername(NULL);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsCacheCredential --
+ *
+ *      Keeps the user handle that was just validated for the credentials,
+ *      evicting the least recently used entry when the cache is full.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      The cache takes over currentUserHandle.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsCacheCredential(int credentialType,                 // IN
+                        char const *obfuscatedNamePassword, // IN
+                        void *userToken)                    // IN
+{
+   VixToolsCachedCredential *entry;
+   int timeout = VixToolsGetCredentialCacheTimeout();
+
+   /*
+    * The local SYSTEM bypass doesn't impersonate anyone; don't keep it.
+    */
+   if (timeout <= 0 || NULL == currentUserHandle ||
+       PROCESS_CREATOR_USER_TOKEN == userToken) {
+      return;
    }
 
-done:
-   if (err != VIX_OK) {
-      g_warning("%s: impersonation failed (%"FMT64"d)\n",
-                  __FUNCTION__, err);
-   } else {
-      g_debug("%s: successfully impersonated user %s\n", __FUNCTION__,
-              IMPERSONATED_USERNAME);
+   entry = Util_SafeCalloc(1, sizeof *entry);
+   if (!VixToolsCredentialDigest(credentialType, obfuscatedNamePassword,
+                                 entry->digest)) {
+      free(entry);
+      return;
    }
 
-   return(err);
-} // VixToolsImpersonateUser
+   if (g_list_length(credentialCache) >= VIX_TOOLS_CREDENTIAL_CACHE_MAX) {
+      GList *last = g_list_last(credentialCache);
+
+      VixToolsFreeCachedCredential(last->data);
+      credentialCache = g_list_delete_link(credentialCache, last);
+   }
+
+   entry->userHandle = currentUserHandle;
+   entry->expires = Hostinfo_SystemTimerUS() + timeout * 1000000LL;
+   credentialCache = g_list_prepend(credentialCache, entry);
+   currentUserHandleCached = TRUE;
+}
+#endif
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * VixToolsImpersonateUserImpl --
+ * VixToolsGuestAuthImpersonate --
  *
- *    Little compatability wrapper for legacy Foundry Tools implementations.
+ *      Impersonates the user of name-password or SAML token credentials
+ *      with the GuestAuth library, validating them unless they were
+ *      validated recently.
  *
- * Return value:
- *    TRUE on success
- *    FALSE on failure
+ * Results:
+ *      VIX_OK if successful. Other VixError code otherwise.
  *
  * Side effects:
- *    None
+ *      Current process impersonates.
  *
  *-----------------------------------------------------------------------------
  */
 
-Bool
-VixToolsImpersonateUserImpl(char const *credentialTypeStr,         // IN
-                            int credentialType,                    // IN
-                            char const *obfuscatedNamePassword,    // IN
-                            void **userToken)                      // OUT
+static VixError
+VixToolsGuestAuthImpersonate(int credentialType,                 // IN
+                             char const *obfuscatedNamePassword, // IN
+                             void **userToken)                   // OUT
 {
-   return(VIX_OK == VixToolsImpersonateUserImplEx(credentialTypeStr,
-                                                  credentialType,
-                                                  obfuscatedNamePassword,
-                                                  userToken));
-} // VixToolsImpersonateUserImpl
+   VixError err;
+
+#if SUPPORT_VGAUTH
+   if (VixToolsImpersonateCachedCredential(credentialType,
+                                           obfuscatedNamePassword,
+                                           userToken)) {
+      return VIX_OK;
+   }
+
+   if (VIX_USER_CREDENTIAL_SAML_BEARER_TOKEN == credentialType) {
+      err = GuestAuthSAMLAuthenticateAndImpersonate(obfuscatedNamePassword,
+                                                    userToken);
+   } else {
+      err = GuestAuthPasswordAuthenticateImpersonate(obfuscatedNamePassword,
+                                                     userToken);
+   }
+
+   if (VIX_OK == err) {
+      VixToolsCacheCredential(credentialType, obfuscatedNamePassword,
+                              *userToken);
+   }
+#else
+   err = GuestAuthPasswordAuthenticateImpersonate(obfuscatedNamePassword,
+                                                  userToken);
+#endif
+
+   return err;
+}
 
 
 /*
@@ -7835,16 +9300,17 @@ VixToolsImpersonateUserImplEx(char const *credentialTypeStr,         // IN
       if (GuestAuthEnabled() &&
           (VIX_USER_CREDENTIAL_NAME_PASSWORD == credentialType ||
            VIX_USER_CREDENTIAL_NAME_PASSWORD_OBFUSCATED == credentialType)) {
-         err =
-            GuestAuthPasswordAuthenticateImpersonate(obfuscatedNamePassword,
-                                                     userToken);
+         err = VixToolsGuestAuthImpersonate(credentialType,
+                                            obfuscatedNamePassword,
+                                            userToken);
       }
 
 #if SUPPORT_VGAUTH
       else if (VIX_USER_CREDENTIAL_SAML_BEARER_TOKEN == credentialType) {
          if (GuestAuthEnabled()) {
-            err = GuestAuthSAMLAuthenticateAndImpersonate(obfuscatedNamePassword,
-                                                          userToken);
+            err = VixToolsGuestAuthImpersonate(credentialType,
+                                               obfuscatedNamePassword,
+                                               userToken);
          } else {
             err = VIX_E_NOT_SUPPORTED;
          }
@@ -8002,8 +9468,11 @@ VixToolsLogoutUser(void *userToken)    // IN
       // close the handle we copied out
       CloseHandle((HANDLE) userToken);
 #endif
-      VGAuth_UserHandleFree(currentUserHandle);
+      if (!currentUserHandleCached) {
+         VGAuth_UserHandleFree(currentUserHandle);
+      }
       currentUserHandle = NULL;
+      currentUserHandleCached = FALSE;
       return;
    }
 #endif
@@ -8513,6 +9982,242 @@ abort:
 } // VixToolsProcessHgfsPacket
 
 
+#ifdef linux
+/*
+ * Listing file systems stats every mount point, and statfs() of a dead
+ * NFS or CIFS server hangs for minutes. Each statfs() therefore runs on a
+ * thread of its own, all of them at once, and the listing waits for them
+ * for at most fileSystemStatTimeout seconds. Mount points that haven't
+ * answered by then are listed with no size, as drives whose size can't be
+ * read are on Windows.
+ *
+ * A statfs() that hangs can't be interrupted. Its result is kept in
+ * fsStatCache and is waited for, not started again, by later listings, so
+ * a hung mount ties up a single thread. Results are also reused for
+ * VIX_TOOLS_FS_STAT_CACHE_TTL seconds, for the listings that come in
+ * bursts. Entries are per user, since not every user can stat every mount
+ * point.
+ */
+#define VIXTOOLS_CONFIG_FS_STAT_TIMEOUT "fileSystemStatTimeout"
+#define VIX_TOOLS_FS_STAT_TIMEOUT_DEFAULT 5
+#define VIX_TOOLS_FS_STAT_CACHE_TTL 2
+
+typedef struct VixToolsFsStat {
+   int refCount;                  // Protected by fsStatLock, as is the rest
+   char *mountPoint;
+   Bool done;
+   Bool ok;
+   uint64 size;
+   uint64 freeSpace;
+   VmTimeType finished;           // Hostinfo_SystemTimerUS()
+} VixToolsFsStat;
+
+typedef struct VixToolsFsMount {
+   char *name;
+   char *type;
+   VixToolsFsStat *fsStat;
+} VixToolsFsMount;
+
+static GHashTable *fsStatCache = NULL;   // "<euid>:<mount point>"
+static GThreadPool *fsStatPool = NULL;
+static GMutex *fsStatLock = NULL;
+static GCond *fsStatDone = NULL;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsFsStatUnref --
+ *
+ *      Releases a reference to a mount point's statfs() result. Must be
+ *      called with fsStatLock held.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      The result is freed along with the last reference.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsFsStatUnref(gpointer data)   // IN
+{
+   VixToolsFsStat *fsStat = data;
+
+   ASSERT(fsStat->refCount > 0);
+   if (--fsStat->refCount == 0) {
+      g_free(fsStat->mountPoint);
+      g_free(fsStat);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsFsStatIsExpired --
+ *
+ *      g_hash_table_foreach_remove() callback for dropping the cached
+ *      results that are too old to be used.
+ *
+ * Results:
+ *      TRUE if the result should be dropped.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VixToolsFsStatIsExpired(gpointer key,    // IN
+                        gpointer value,  // IN
+                        gpointer now)    // IN: VmTimeType *
+{
+   VixToolsFsStat *fsStat = value;
+
+   return fsStat->done &&
+          *(VmTimeType *) now - fsStat->finished >=
+             VIX_TOOLS_FS_STAT_CACHE_TTL * 1000000LL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsFsStatWorker --
+ *
+ *      Thread pool function that calls statfs() on a mount point.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      Fills in the result and wakes up the listings waiting for it.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsFsStatWorker(gpointer data,     // IN: VixToolsFsStat
+                     gpointer unused)   // IN
+{
+   VixToolsFsStat *fsStat = data;
+   struct statfs statfsbuf;
+   Bool ok;
+
+   ok = Posix_Statfs(fsStat->mountPoint, &statfsbuf) == 0;
+
+   g_mutex_lock(fsStatLock);
+   fsStat->ok = ok;
+   if (ok) {
+      fsStat->size = (uint64) statfsbuf.f_blocks * (uint64) statfsbuf.f_bsize;
+      fsStat->freeSpace = (uint64) statfsbuf.f_bfree *
+                        (uint64) statfsbuf.f_bsize;
+   }
+   fsStat->done = TRUE;
+   fsStat->finished = Hostinfo_SystemTimerUS();
+   g_cond_broadcast(fsStatDone);
+   VixToolsFsStatUnref(fsStat);
+   g_mutex_unlock(fsStatLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsFsStatStart --
+ *
+ *      Starts statfs() of a mount point on the thread pool, unless a recent
+ *      result, or a statfs() still in progress, can be used.
+ *
+ * Results:
+ *      A reference to the result, to be released with VixToolsFsStatUnref().
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VixToolsFsStat *
+VixToolsFsStatStart(const char *mountPoint)   // IN
+{
+   char *key = g_strdup_printf("%u:%s", (unsigned int) geteuid(), mountPoint);
+   VixToolsFsStat *fsStat;
+   GError *gErr = NULL;
+
+   g_mutex_lock(fsStatLock);
+
+   fsStat = g_hash_table_lookup(fsStatCache, key);
+   if (NULL != fsStat) {
+      g_free(key);
+      fsStat->refCount++;
+      g_mutex_unlock(fsStatLock);
+      return fsStat;
+   }
+
+   fsStat = g_new0(VixToolsFsStat, 1);
+   fsStat->refCount = 3;            // The cache, the job and the caller
+   fsStat->mountPoint = g_strdup(mountPoint);
+   g_hash_table_insert(fsStatCache, key, fsStat);
+
+   g_mutex_unlock(fsStatLock);
+
+   if (!g_thread_pool_push(fsStatPool, fsStat, &gErr)) {
+      g_warning("%s: unable to stat mount point %s: %s\n", __FUNCTION__,
+                mountPoint, gErr->message);
+      g_clear_error(&gErr);
+
+      g_mutex_lock(fsStatLock);
+      fsStat->done = TRUE;
+      fsStat->finished = Hostinfo_SystemTimerUS();
+      VixToolsFsStatUnref(fsStat);
+      g_mutex_unlock(fsStatLock);
+   }
+
+   return fsStat;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsGetFsStatTimeout --
+ *
+ *      Gets how long a file system listing waits for the mount points.
+ *
+ * Results:
+ *      The timeout in seconds.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+VixToolsGetFsStatTimeout(void)
+{
+   if (gConfDictRef != NULL &&
+       g_key_file_has_key(gConfDictRef, VIX_TOOLS_CONFIG_API_GROUPNAME,
+                          VIXTOOLS_CONFIG_FS_STAT_TIMEOUT, NULL)) {
+      int timeout = g_key_file_get_integer(gConfDictRef,
+                                           VIX_TOOLS_CONFIG_API_GROUPNAME,
+                                           VIXTOOLS_CONFIG_FS_STAT_TIMEOUT,
+                                           NULL);
+      if (timeout > 0) {
+         return timeout;
+      }
+   }
+
+   return VIX_TOOLS_FS_STAT_TIMEOUT_DEFAULT;
+}
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -8555,6 +10260,11 @@ VixToolsListFileSystems(VixCommandRequestHeader *requestMsg, // IN
    MNTHANDLE fp;
    DECLARE_MNTINFO(mnt);
    const char *mountfile = NULL;
+   GPtrArray *mounts = NULL;
+   GTimeVal deadline;
+   VmTimeType now;
+   Bool timedOut = FALSE;
+   guint i;
 #endif
 
    destPtr = resultBuffer;
@@ -8632,26 +10342,87 @@ VixToolsListFileSystems(VixCommandRequestHeader *requestMsg, // IN
       goto abort;
    }
 
+   if (NULL == fsStatPool) {
+      GError *gErr = NULL;
+
+      fsStatPool = g_thread_pool_new(VixToolsFsStatWorker, NULL, -1, FALSE,
+                                     &gErr);
+      if (NULL == fsStatPool) {
+         g_warning("%s: unable to create the statfs threads: %s\n",
+                   __FUNCTION__, gErr->message);
+         g_clear_error(&gErr);
+         CLOSE_MNTFILE(fp);
+         err = VIX_E_OUT_OF_MEMORY;
+         goto abort;
+      }
+      fsStatCache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                          VixToolsFsStatUnref);
+      fsStatLock = g_mutex_new();
+      fsStatDone = g_cond_new();
+   }
+
+   now = Hostinfo_SystemTimerUS();
+   g_mutex_lock(fsStatLock);
+   g_hash_table_foreach_remove(fsStatCache, VixToolsFsStatIsExpired, &now);
+   g_mutex_unlock(fsStatLock);
+
+   mounts = g_ptr_array_new();
    while (GETNEXT_MNTINFO(fp, mnt)) {
-      struct statfs statfsbuf;
-      uint64 size, freeSpace;
+      VixToolsFsMount *mount = g_new0(VixToolsFsMount, 1);
+
+      mount->name = g_strdup(MNTINFO_NAME(mnt));
+      mount->type = g_strdup(MNTINFO_FSTYPE(mnt));
+      mount->fsStat = VixToolsFsStatStart(MNTINFO_MNTPT(mnt));
+      g_ptr_array_add(mounts, mount);
+   }
+   CLOSE_MNTFILE(fp);
+
+   /*
+    * The mount points are all stat'ed at once, so one deadline covers
+    * each of them as well as the whole listing.
+    */
+   g_get_current_time(&deadline);
+   g_time_val_add(&deadline, VixToolsGetFsStatTimeout() * G_USEC_PER_SEC);
+
+   g_mutex_lock(fsStatLock);
+   for (i = 0; i < mounts->len && !timedOut; i++) {
+      VixToolsFsMount *mount = g_ptr_array_index(mounts, i);
+
+      while (!mount->fsStat->done) {
+         if (!g_cond_timed_wait(fsStatDone, fsStatLock, &deadline)) {
+            timedOut = TRUE;
+            break;
+         }
+      }
+   }
+   g_mutex_unlock(fsStatLock);
+
+   for (i = 0; i < mounts->len; i++) {
+      VixToolsFsMount *mount = g_ptr_array_index(mounts, i);
+      VixToolsFsStat fsStat;
 
-      if (Posix_Statfs(MNTINFO_MNTPT(mnt), &statfsbuf)) {
+      g_mutex_lock(fsStatLock);
+      fsStat = *mount->fsStat;
+      g_mutex_unlock(fsStatLock);
+
+      if (!fsStat.done) {
+         g_warning("%s: mount point %s is not responding\n",
+                   __FUNCTION__, fsStat.mountPoint);
+         fsStat.size = 0;
+         fsStat.freeSpace = 0;
+      } else if (!fsStat.ok) {
          g_warning("%s unable to stat mount point %s\n",
-                   __FUNCTION__, MNTINFO_MNTPT(mnt));
+                   __FUNCTION__, fsStat.mountPoint);
          continue;
       }
-      size = (uint64) statfsbuf.f_blocks * (uint64) statfsbuf.f_bsize;
-      freeSpace = (uint64) statfsbuf.f_bfree * (uint64) statfsbuf.f_bsize;
       err = VixToolsPrintFileSystemInfo(&destPtr, endDestPtr,
-                                        MNTINFO_NAME(mnt), size, freeSpace,
-                                        MNTINFO_FSTYPE(mnt), escapeStrs,
-                                        &truncated);
+                                        mount->name, fsStat.size,
+                                        fsStat.freeSpace, mount->type,
+                                        escapeStrs, &truncated);
       if ((VIX_OK != err) || truncated) {
          goto abort;
       }
    }
-   CLOSE_MNTFILE(fp);
 #else
    err = VIX_E_NOT_SUPPORTED;
 #endif
@@ -8664,6 +10435,21 @@ abort:
 
    free(driveList);
 #endif
+#ifdef linux
+   if (NULL != mounts) {
+      for (i = 0; i < mounts->len; i++) {
+         VixToolsFsMount *mount = g_ptr_array_index(mounts, i);
+
+         g_mutex_lock(fsStatLock);
+         VixToolsFsStatUnref(mount->fsStat);
+         g_mutex_unlock(fsStatLock);
+         g_free(mount->name);
+         g_free(mount->type);
+         g_free(mount);
+      }
+      g_ptr_array_free(mounts, TRUE);
+   }
+#endif
 
    if (impersonatingVMWareUser) {
       VixToolsUnimpersonateUser(userToken);
@@ -9011,9 +10797,9 @@ VixToolsSetGuestNetworkingConfig(VixCommandRequestHeader *requestMsg)    // IN
    Bool impersonatingVMWareUser = FALSE;
    void *userToken = NULL;
    VixMsgSetGuestNetworkingConfigRequest *setGuestNetworkingConfigRequest = NULL;
-   VixPropertyListImpl propList;
-   VixPropertyValue *propertyPtr = NULL;
-   char *messageBody = NULL;
+   VMAutomationRequestParser parser;
+   VMAutomationRequestParser propParser;
+   VixPropertyView property;
    char ipAddr[IP_ADDR_SIZE];
    char subnetMask[IP_ADDR_SIZE];
    Bool dhcpEnabled = FALSE;
@@ -9033,33 +10819,47 @@ VixToolsSetGuestNetworkingConfig(VixCommandRequestHeader *requestMsg)    // IN
    g_debug("%s: User: %s\n",
            __FUNCTION__, IMPERSONATED_USERNAME);
 
+   err = VMAutomationRequestParserInit(&parser, requestMsg,
+                                       sizeof *setGuestNetworkingConfigRequest);
+   if (VIX_OK != err) {
+      goto abort;
+   }
+
    setGuestNetworkingConfigRequest = (VixMsgSetGuestNetworkingConfigRequest *)requestMsg;
-   messageBody = (char *) requestMsg + sizeof(*setGuestNetworkingConfigRequest);
 
-   VixPropertyList_Initialize(&propList);
-   err = VixPropertyList_Deserialize(&propList,
-                                     messageBody,
-                                     setGuestNetworkingConfigRequest -> bufferSize,
-                                     VIX_PROPERTY_LIST_BAD_ENCODING_ERROR);
+   /*
+    * Read the properties in place rather than deserializing a copy of
+    * the list.  A repeated property overrides the earlier ones, as it
+    * did with a deserialized list.
+    */
+   err = VMAutomationRequestParserGetPropertyListView(&parser,
+                                    setGuestNetworkingConfigRequest->bufferSize,
+                                                      &propParser);
    if (VIX_OK != err) {
       goto abort;
    }
 
-   propertyPtr = propList.properties;
-   while (propertyPtr != NULL) {
-      switch (propertyPtr->propertyID) {
+   while (VIX_OK == (err = VMAutomationRequestParserGetNextProperty(&propParser,
+                                                                    &property))) {
+      switch (property.propertyID) {
       ///////////////////////////////////////////
       case VIX_PROPERTY_VM_DHCP_ENABLED:
-         if (propertyPtr->value.boolValue) {
-            dhcpEnabled = TRUE;
+         if (VIX_PROPERTYTYPE_BOOL != property.type) {
+            err = VIX_E_TYPE_MISMATCH;
+            goto abort;
          }
+         dhcpEnabled = property.value.boolValue ? TRUE : FALSE;
          break;
 
       ///////////////////////////////////////////
       case VIX_PROPERTY_VM_IP_ADDRESS:
-         if (strlen(propertyPtr->value.strValue) < sizeof ipAddr) {
+         if (VIX_PROPERTYTYPE_STRING != property.type) {
+            err = VIX_E_TYPE_MISMATCH;
+            goto abort;
+         }
+         if (strlen(property.value.strValue) < sizeof ipAddr) {
             Str_Strcpy(ipAddr,
-                       propertyPtr->value.strValue,
+                       property.value.strValue,
                        sizeof ipAddr);
             } else {
                err = VIX_E_INVALID_ARG;
@@ -9069,9 +10869,13 @@ VixToolsSetGuestNetworkingConfig(VixCommandRequestHeader *requestMsg)    // IN
 
       ///////////////////////////////////////////
       case VIX_PROPERTY_VM_SUBNET_MASK:
-         if (strlen(propertyPtr->value.strValue) < sizeof subnetMask) {
+         if (VIX_PROPERTYTYPE_STRING != property.type) {
+            err = VIX_E_TYPE_MISMATCH;
+            goto abort;
+         }
+         if (strlen(property.value.strValue) < sizeof subnetMask) {
             Str_Strcpy(subnetMask,
-                       propertyPtr->value.strValue,
+                       property.value.strValue,
                        sizeof subnetMask);
          } else {
             err = VIX_E_INVALID_ARG;
@@ -9086,9 +10890,12 @@ VixToolsSetGuestNetworkingConfig(VixCommandRequestHeader *requestMsg)    // IN
           */
          break;
       } // switch
+   } // while (VIX_OK == err)
 
-      propertyPtr = propertyPtr->next;
-   } // while {propList.properties != NULL)
+   if (VIX_E_NOT_FOUND != err) {
+      goto abort;
+   }
+   err = VIX_OK;
 
    if (dhcpEnabled) {
       hrErr = VixToolsEnableDHCPOnPrimary();
@@ -9113,8 +10920,6 @@ VixToolsSetGuestNetworkingConfig(VixCommandRequestHeader *requestMsg)    // IN
    }
 
 abort:
-   VixPropertyList_RemoveAllWithoutHandles(&propList);
-
    if (impersonatingVMWareUser) {
       VixToolsUnimpersonateUser(userToken);
    }
@@ -9382,6 +11187,9 @@ VixToolsRemoveAuthAlias(VixCommandRequestHeader *requestMsg)    // IN
    }
    if (VGAUTH_FAILED(vgErr)) {
       err = VixToolsTranslateVGAuthError(vgErr);
+   } else {
+      /* Tokens validated against the alias must not get in anymore. */
+      VixToolsFlushCredentialCache();
    }
 
 abort:
@@ -10205,19 +12013,39 @@ VixToolsPidRefersToThisProcess(ProcMgr_Pid pid)  // IN
 /*
  *-----------------------------------------------------------------------------
  *
- * VixToolsCheckIfVixCommandEnabled --
+ * VixToolsGetCommandState --
  *
- *    Checks to see if the opcode has been disabled via the tools
- *    configuration.
+ *    Finds the dispatcher state of an opcode.
  *
- *    This does not affect VIX_COMMAND_GET_TOOLS_STATE; that always
- *    needs to work.
+ * Return value:
+ *    The state, shared by all unknown opcodes.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VixToolsCommandState *
+VixToolsGetCommandState(int opcode)                                   // IN
+{
+   if (opcode < 0 || opcode >= VIX_COMMAND_LAST_NORMAL_COMMAND) {
+      opcode = VIX_COMMAND_LAST_NORMAL_COMMAND;
+   }
+
+   return &vixToolsCommandState[opcode];
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsRecordCommand --
  *
- *    Many non-VMODL APIs do not have an API specific option; those
- *    are only affected by the global setting.
+ *    Accounts for a request that was processed.
  *
  * Return value:
- *    TRUE if enabled, FALSE otherwise.
+ *    None
  *
  * Side effects:
  *    None
@@ -10225,196 +12053,261 @@ VixToolsPidRefersToThisProcess(ProcMgr_Pid pid)  // IN
  *-----------------------------------------------------------------------------
  */
 
-static Bool
-VixToolsCheckIfVixCommandEnabled(int opcode,                          // IN
-                                 GKeyFile *confDictRef)               // IN
+static void
+VixToolsRecordCommand(int opcode,                                     // IN
+                      VixError err,                                   // IN
+                      VmTimeType latencyUS)                           // IN
 {
-   Bool enabled = TRUE;
-   switch (opcode) {
-      /*
-       * We always let this through, since its needed to do basic
-       * init work.
-       */
-      case VIX_COMMAND_GET_TOOLS_STATE:
-         enabled = TRUE;
-         break;
+   VixToolsCommandState *state = VixToolsGetCommandState(opcode);
+   uint32 bucket = 0;
+   uint64 remaining;
 
-      case VIX_COMMAND_LIST_PROCESSES:
-      case VIX_COMMAND_LIST_PROCESSES_EX:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                    VIX_TOOLS_CONFIG_API_LIST_PROCESSES_NAME);
-         break;
+   if (latencyUS < 0) {
+      latencyUS = 0;
+   }
+   remaining = latencyUS;
+   while (remaining > 0 && bucket < VIX_TOOLS_STATS_LATENCY_BUCKETS - 1) {
+      remaining >>= 1;
+      bucket++;
+   }
 
-      case VIX_COMMAND_LIST_FILES:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                   VIX_TOOLS_CONFIG_API_LIST_FILES_NAME);
-         break;
-      case VIX_COMMAND_DELETE_GUEST_FILE:
-      case VIX_COMMAND_DELETE_GUEST_FILE_EX:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                   VIX_TOOLS_CONFIG_API_DELETE_FILE_NAME);
-         break;
-      case VIX_COMMAND_DELETE_GUEST_DIRECTORY:
-      case VIX_COMMAND_DELETE_GUEST_EMPTY_DIRECTORY:
-      case VIX_COMMAND_DELETE_GUEST_DIRECTORY_EX:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                   VIX_TOOLS_CONFIG_API_DELETE_DIRECTORY_NAME);
-         break;
-      case VIX_COMMAND_KILL_PROCESS:
-      case VIX_COMMAND_TERMINATE_PROCESS:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                   VIX_TOOLS_CONFIG_API_TERMINATE_PROCESS_NAME);
-         break;
-      case VIX_COMMAND_CREATE_DIRECTORY:
-      case VIX_COMMAND_CREATE_DIRECTORY_EX:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                   VIX_TOOLS_CONFIG_API_MAKE_DIRECTORY_NAME);
-         break;
-      case VIX_COMMAND_MOVE_GUEST_FILE:
-      case VIX_COMMAND_MOVE_GUEST_FILE_EX:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                   VIX_TOOLS_CONFIG_API_MOVE_FILE_NAME);
-         break;
-      case VIX_COMMAND_MOVE_GUEST_DIRECTORY:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                   VIX_TOOLS_CONFIG_API_MOVE_DIRECTORY_NAME);
-         break;
-      case VIX_COMMAND_START_PROGRAM:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                   VIX_TOOLS_CONFIG_API_START_PROGRAM_NAME);
-         break;
-      case VIX_COMMAND_CREATE_TEMPORARY_FILE:
-      case VIX_COMMAND_CREATE_TEMPORARY_FILE_EX:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                   VIX_TOOLS_CONFIG_API_CREATE_TMP_FILE_NAME);
-         break;
-      case VIX_COMMAND_CREATE_TEMPORARY_DIRECTORY:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                VIX_TOOLS_CONFIG_API_CREATE_TMP_DIRECTORY_NAME);
-         break;
-      case VIX_COMMAND_READ_ENV_VARIABLES:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                VIX_TOOLS_CONFIG_API_READ_ENV_VARS_NAME);
-         break;
-      case VIX_COMMAND_SET_GUEST_FILE_ATTRIBUTES:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                VIX_TOOLS_CONFIG_API_CHANGE_FILE_ATTRS_NAME);
-         break;
+   state->count++;
+   if (VIX_FAILED(err)) {
+      state->errors++;
+   }
+   state->totalUS += latencyUS;
+   state->latency[bucket]++;
+}
 
-      case VIX_COMMAND_INITIATE_FILE_TRANSFER_FROM_GUEST:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                VIX_TOOLS_CONFIG_API_INITIATE_FILE_TRANSFER_FROM_GUEST_NAME);
-         break;
 
-      case VIX_COMMAND_INITIATE_FILE_TRANSFER_TO_GUEST:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                VIX_TOOLS_CONFIG_API_INITIATE_FILE_TRANSFER_TO_GUEST_NAME);
-         break;
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixTools_ConfigReloaded --
+ *
+ *    Forgets which opcodes are enabled, so that they are looked up in the
+ *    configuration again.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-      case VIX_COMMAND_VALIDATE_CREDENTIALS:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                VIX_TOOLS_CONFIG_API_VALIDATE_CREDENTIALS_NAME);
-         break;
+void
+VixTools_ConfigReloaded(void)
+{
+   size_t i;
 
-      case VIX_COMMAND_ACQUIRE_CREDENTIALS:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                VIX_TOOLS_CONFIG_API_ACQUIRE_CREDENTIALS_NAME);
-         break;
+   for (i = 0; i < ARRAYSIZE(vixToolsCommandState); i++) {
+      vixToolsCommandState[i].enabledValid = FALSE;
+   }
+   vixToolsCommandStateConf = NULL;
+}
 
-      case VIX_COMMAND_RELEASE_CREDENTIALS:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                VIX_TOOLS_CONFIG_API_RELEASE_CREDENTIALS_NAME);
-         break;
 
-      case VIX_COMMAND_ADD_AUTH_ALIAS:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                VIX_TOOLS_CONFIG_API_ADD_GUEST_ALIAS_NAME);
-         break;
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixTools_DumpState --
+ *
+ *    Logs the request statistics of each opcode that was requested:
+ *    number of requests and failures, average latency and a latency
+ *    histogram (empty buckets are skipped).
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-      case VIX_COMMAND_REMOVE_AUTH_ALIAS:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                               VIX_TOOLS_CONFIG_API_REMOVE_GUEST_ALIAS_NAME);
-         break;
+void
+VixTools_DumpState(void)
+{
+   char line[512];
+   int opcode;
 
-      case VIX_COMMAND_REMOVE_AUTH_ALIAS_BY_CERT:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                               VIX_TOOLS_CONFIG_API_REMOVE_GUEST_ALIAS_BY_CERT_NAME);
-         break;
+   for (opcode = 0; opcode <= VIX_COMMAND_LAST_NORMAL_COMMAND; opcode++) {
+      VixToolsCommandState *state = &vixToolsCommandState[opcode];
+      const char *name;
+      size_t len;
+      uint32 bucket;
 
-      case VIX_COMMAND_LIST_AUTH_PROVIDER_ALIASES:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                VIX_TOOLS_CONFIG_API_LIST_GUEST_ALIASES_NAME);
-         break;
+      if (0 == state->count) {
+         continue;
+      }
 
-      case VIX_COMMAND_LIST_AUTH_MAPPED_ALIASES:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                              VIX_TOOLS_CONFIG_API_LIST_GUEST_MAPPED_ALIASES_NAME);
-         break;
+      name = opcode < VIX_COMMAND_LAST_NORMAL_COMMAND ?
+             VixAsyncOp_GetDebugStrForOpCode(opcode) : "other";
+      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                         "command %d (%s): count %"FMT64"u errors %"FMT64"u "
+                         "avg %"FMT64"uus\n", opcode, name, state->count,
+                         state->errors, state->totalUS / state->count);
 
-      case VIX_COMMAND_CREATE_REGISTRY_KEY:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                VIX_TOOLS_CONFIG_API_CREATE_REGISTRY_KEY_NAME);
-         break;
+      len = 0;
+      line[0] = '\0';
+      for (bucket = 0; bucket < VIX_TOOLS_STATS_LATENCY_BUCKETS; bucket++) {
+         int n;
 
-      case VIX_COMMAND_LIST_REGISTRY_KEYS:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                VIX_TOOLS_CONFIG_API_LIST_REGISTRY_KEYS_NAME);
-         break;
+         if (0 == state->latency[bucket]) {
+            continue;
+         }
+         if (bucket < VIX_TOOLS_STATS_LATENCY_BUCKETS - 1) {
+            n = Str_Snprintf(line + len, sizeof line - len,
+                             " <%"FMT64"uus:%"FMT64"u",
+                             CONST64U(1) << bucket, state->latency[bucket]);
+         } else {
+            n = Str_Snprintf(line + len, sizeof line - len,
+                             " >=%"FMT64"uus:%"FMT64"u",
+                             CONST64U(1) << (bucket - 1),
+                             state->latency[bucket]);
+         }
+         if (n < 0) {
+            break;
+         }
+         len += n;
+      }
+      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN, "command %d latency:%s\n",
+                         opcode, line);
+   }
+}
 
-      case VIX_COMMAND_DELETE_REGISTRY_KEY:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                VIX_TOOLS_CONFIG_API_DELETE_REGISTRY_KEY_NAME);
-         break;
 
-      case VIX_COMMAND_SET_REGISTRY_VALUE:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                VIX_TOOLS_CONFIG_API_SET_REGISTRY_VALUE_NAME);
-         break;
+/*
+ * The configuration names of the guest operations that can be disabled
+ * individually, by opcode. Other opcodes are only affected by the global
+ * setting; many non-VMODL APIs do not have an API specific option.
+ */
+static const struct {
+   int opCode;
+   const char *apiName;
+} vixToolsCommandAPINames[] = {
+   { VIX_COMMAND_LIST_PROCESSES,       VIX_TOOLS_CONFIG_API_LIST_PROCESSES_NAME },
+   { VIX_COMMAND_LIST_PROCESSES_EX,    VIX_TOOLS_CONFIG_API_LIST_PROCESSES_NAME },
+   { VIX_COMMAND_LIST_FILES,           VIX_TOOLS_CONFIG_API_LIST_FILES_NAME },
+   { VIX_COMMAND_DELETE_GUEST_FILE,    VIX_TOOLS_CONFIG_API_DELETE_FILE_NAME },
+   { VIX_COMMAND_DELETE_GUEST_FILE_EX, VIX_TOOLS_CONFIG_API_DELETE_FILE_NAME },
+   { VIX_COMMAND_DELETE_GUEST_DIRECTORY,
+                                 VIX_TOOLS_CONFIG_API_DELETE_DIRECTORY_NAME },
+   { VIX_COMMAND_DELETE_GUEST_EMPTY_DIRECTORY,
+                                 VIX_TOOLS_CONFIG_API_DELETE_DIRECTORY_NAME },
+   { VIX_COMMAND_DELETE_GUEST_DIRECTORY_EX,
+                                 VIX_TOOLS_CONFIG_API_DELETE_DIRECTORY_NAME },
+   { VIX_COMMAND_KILL_PROCESS,      VIX_TOOLS_CONFIG_API_TERMINATE_PROCESS_NAME },
+   { VIX_COMMAND_TERMINATE_PROCESS, VIX_TOOLS_CONFIG_API_TERMINATE_PROCESS_NAME },
+   { VIX_COMMAND_CREATE_DIRECTORY,    VIX_TOOLS_CONFIG_API_MAKE_DIRECTORY_NAME },
+   { VIX_COMMAND_CREATE_DIRECTORY_EX, VIX_TOOLS_CONFIG_API_MAKE_DIRECTORY_NAME },
+   { VIX_COMMAND_MOVE_GUEST_FILE,      VIX_TOOLS_CONFIG_API_MOVE_FILE_NAME },
+   { VIX_COMMAND_MOVE_GUEST_FILE_EX,   VIX_TOOLS_CONFIG_API_MOVE_FILE_NAME },
+   { VIX_COMMAND_MOVE_GUEST_DIRECTORY, VIX_TOOLS_CONFIG_API_MOVE_DIRECTORY_NAME },
+   { VIX_COMMAND_START_PROGRAM,        VIX_TOOLS_CONFIG_API_START_PROGRAM_NAME },
+   { VIX_COMMAND_CREATE_TEMPORARY_FILE,
+                                 VIX_TOOLS_CONFIG_API_CREATE_TMP_FILE_NAME },
+   { VIX_COMMAND_CREATE_TEMPORARY_FILE_EX,
+                                 VIX_TOOLS_CONFIG_API_CREATE_TMP_FILE_NAME },
+   { VIX_COMMAND_CREATE_TEMPORARY_DIRECTORY,
+                                 VIX_TOOLS_CONFIG_API_CREATE_TMP_DIRECTORY_NAME },
+   { VIX_COMMAND_READ_ENV_VARIABLES,   VIX_TOOLS_CONFIG_API_READ_ENV_VARS_NAME },
+   { VIX_COMMAND_SET_GUEST_FILE_ATTRIBUTES,
+                                 VIX_TOOLS_CONFIG_API_CHANGE_FILE_ATTRS_NAME },
+   { VIX_COMMAND_INITIATE_FILE_TRANSFER_FROM_GUEST,
+                 VIX_TOOLS_CONFIG_API_INITIATE_FILE_TRANSFER_FROM_GUEST_NAME },
+   { VIX_COMMAND_INITIATE_FILE_TRANSFER_TO_GUEST,
+                 VIX_TOOLS_CONFIG_API_INITIATE_FILE_TRANSFER_TO_GUEST_NAME },
+   { VIX_COMMAND_VALIDATE_CREDENTIALS,
+                                 VIX_TOOLS_CONFIG_API_VALIDATE_CREDENTIALS_NAME },
+   { VIX_COMMAND_ACQUIRE_CREDENTIALS,
+                                 VIX_TOOLS_CONFIG_API_ACQUIRE_CREDENTIALS_NAME },
+   { VIX_COMMAND_RELEASE_CREDENTIALS,
+                                 VIX_TOOLS_CONFIG_API_RELEASE_CREDENTIALS_NAME },
+   { VIX_COMMAND_ADD_AUTH_ALIAS,  VIX_TOOLS_CONFIG_API_ADD_GUEST_ALIAS_NAME },
+   { VIX_COMMAND_REMOVE_AUTH_ALIAS, VIX_TOOLS_CONFIG_API_REMOVE_GUEST_ALIAS_NAME },
+   { VIX_COMMAND_REMOVE_AUTH_ALIAS_BY_CERT,
+                         VIX_TOOLS_CONFIG_API_REMOVE_GUEST_ALIAS_BY_CERT_NAME },
+   { VIX_COMMAND_LIST_AUTH_PROVIDER_ALIASES,
+                                 VIX_TOOLS_CONFIG_API_LIST_GUEST_ALIASES_NAME },
+   { VIX_COMMAND_LIST_AUTH_MAPPED_ALIASES,
+                         VIX_TOOLS_CONFIG_API_LIST_GUEST_MAPPED_ALIASES_NAME },
+   { VIX_COMMAND_CREATE_REGISTRY_KEY,
+                                 VIX_TOOLS_CONFIG_API_CREATE_REGISTRY_KEY_NAME },
+   { VIX_COMMAND_LIST_REGISTRY_KEYS,
+                                 VIX_TOOLS_CONFIG_API_LIST_REGISTRY_KEYS_NAME },
+   { VIX_COMMAND_DELETE_REGISTRY_KEY,
+                                 VIX_TOOLS_CONFIG_API_DELETE_REGISTRY_KEY_NAME },
+   { VIX_COMMAND_SET_REGISTRY_VALUE,
+                                 VIX_TOOLS_CONFIG_API_SET_REGISTRY_VALUE_NAME },
+   { VIX_COMMAND_LIST_REGISTRY_VALUES,
+                                 VIX_TOOLS_CONFIG_API_LIST_REGISTRY_VALUES_NAME },
+   { VIX_COMMAND_DELETE_REGISTRY_VALUE,
+                                 VIX_TOOLS_CONFIG_API_DELETE_REGISTRY_VALUE_NAME },
+};
 
-      case VIX_COMMAND_LIST_REGISTRY_VALUES:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                VIX_TOOLS_CONFIG_API_LIST_REGISTRY_VALUES_NAME);
-         break;
 
-      case VIX_COMMAND_DELETE_REGISTRY_VALUE:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef,
-                                VIX_TOOLS_CONFIG_API_DELETE_REGISTRY_VALUE_NAME);
-         break;
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsCheckIfVixCommandEnabled --
+ *
+ *    Checks to see if the opcode has been disabled via the tools
+ *    configuration.
+ *
+ *    This does not affect VIX_COMMAND_GET_TOOLS_STATE; that always
+ *    needs to work.
+ *
+ *    The answer is kept per opcode until the configuration is reloaded,
+ *    rather than looked up in the configuration on every request.
+ *
+ * Return value:
+ *    TRUE if enabled, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-      /*
-       * None of these opcode have a matching config entry (yet),
-       * so they can all share.
-       */
-      case VIX_COMMAND_CHECK_USER_ACCOUNT:
-      case VIX_COMMAND_LOGOUT_IN_GUEST:
-      case VIX_COMMAND_GUEST_FILE_EXISTS:
-      case VIX_COMMAND_DIRECTORY_EXISTS:
-      case VIX_COMMAND_GET_FILE_INFO:
-      case VIX_COMMAND_LIST_FILESYSTEMS:
-      case VIX_COMMAND_READ_VARIABLE:
-      case VIX_COMMAND_WRITE_VARIABLE:
-      case VIX_COMMAND_GET_GUEST_NETWORKING_CONFIG:
-      case VIX_COMMAND_SET_GUEST_NETWORKING_CONFIG:
+static Bool
+VixToolsCheckIfVixCommandEnabled(int opcode,                          // IN
+                                 GKeyFile *confDictRef)               // IN
+{
+   VixToolsCommandState *state = VixToolsGetCommandState(opcode);
+   const char *apiName = NULL;
+   size_t i;
 
-      case VIX_COMMAND_REGISTRY_KEY_EXISTS:
-      case VIX_COMMAND_READ_REGISTRY:
-      case VIX_COMMAND_WRITE_REGISTRY:
-      case VIX_COMMAND_DELETE_GUEST_REGISTRY_KEY:
+   /*
+    * We always let this through, since its needed to do basic
+    * init work.
+    */
+   if (VIX_COMMAND_GET_TOOLS_STATE == opcode) {
+      return TRUE;
+   }
 
-      /*
-       * These may want to use the VMODL API name that most closely
-       * matches, but for now, leave them alone.
-       */
-      case VIX_COMMAND_RUN_SCRIPT_IN_GUEST:
-      case VIX_COMMAND_RUN_PROGRAM:
-      case VIX_COMMAND_LIST_DIRECTORY:
-      case VMXI_HGFS_SEND_PACKET_COMMAND:
-      default:
-         enabled = !VixToolsGetAPIDisabledFromConf(confDictRef, NULL);
+   if (confDictRef != vixToolsCommandStateConf) {
+      VixTools_ConfigReloaded();
+      vixToolsCommandStateConf = confDictRef;
+   }
+
+   if (state->enabledValid) {
+      return state->enabled;
+   }
+
+   for (i = 0; i < ARRAYSIZE(vixToolsCommandAPINames); i++) {
+      if (vixToolsCommandAPINames[i].opCode == opcode) {
+         apiName = vixToolsCommandAPINames[i].apiName;
          break;
+      }
    }
 
-   return enabled;
+   state->enabled = !VixToolsGetAPIDisabledFromConf(confDictRef, apiName);
+   state->enabledValid = TRUE;
+
+   return state->enabled;
 }
 
 
@@ -10493,6 +12386,7 @@ VixTools_ProcessVixCommand(VixCommandRequestHeader *requestMsg,   // IN
    size_t resultValueLength = 0;
    Bool mustSetResultValueLength = TRUE;
    Bool deleteResultValue = FALSE;
+   VmTimeType start = Hostinfo_SystemTimerUS();
 
 
    if (NULL != resultBuffer) {
@@ -10612,6 +12506,8 @@ VixTools_ProcessVixCommand(VixCommandRequestHeader *requestMsg,   // IN
       case VIX_COMMAND_LIST_FILES:
          err = VixToolsListFiles(requestMsg,
                                  maxResultBufferSize,
+                                 confDictRef,
+                                 eventQueue,
                                  &resultValue);
          deleteResultValue = TRUE;
          break;
@@ -10769,13 +12665,17 @@ VixTools_ProcessVixCommand(VixCommandRequestHeader *requestMsg,   // IN
       ////////////////////////////////////
       case VIX_COMMAND_INITIATE_FILE_TRANSFER_FROM_GUEST:
          err = VixToolsInitiateFileTransferFromGuest(requestMsg,
+                                                     eventQueue,
                                                      &resultValue);
          deleteResultValue = TRUE;
          break;
 
       ////////////////////////////////////
       case VIX_COMMAND_INITIATE_FILE_TRANSFER_TO_GUEST:
-         err = VixToolsInitiateFileTransferToGuest(requestMsg);
+         err = VixToolsInitiateFileTransferToGuest(requestMsg,
+                                                   eventQueue,
+                                                   &resultValue);
+         deleteResultValue = TRUE;
          break;
 
       ////////////////////////////////////
@@ -10915,6 +12815,9 @@ abort:
     */
    err = VixToolsRewriteError(requestMsg->opCode, err);
 
+   VixToolsRecordCommand(requestMsg->opCode, err,
+                         Hostinfo_SystemTimerUS() - start);
+
    /*
     * Reset the global reference to configuration dictionary
     */
@@ -11753,12 +13656,10 @@ TheVGAuthContext(VGAuthContext **ctx) // OUT
    VGAuthError vgaCode = VGAUTH_E_OK;
 
    /*
-    * XXX This needs to handle errors better -- if the VGAuthService
-    * service gets reset, the context will point to junk and anything
-    * using it will fail.
-    *
-    * Maybe add a no-op API here to poke it?  Or make the underlying
-    * VGAuth code smarter.
+    * The context keeps its connection to the VGAuthService between
+    * requests, so this saves the session setup on each of them.  If the
+    * service gets reset, the library notices the dropped connection and
+    * makes a new one.
     */
    if (vgaCtx == NULL) {
       vgaCode = VGAuth_Init(VMTOOLSD_APP_NAME, 0, NULL, &vgaCtx);
@@ -75,6 +75,14 @@ gboolean VixTools_ConfigGetBoolean(GKeyFile *confDictRef,
 
 void VixTools_RestrictCommands(gboolean restricted);
 
+void VixTools_ConfigReloaded(void);
+
+size_t VixTools_GetListProcCacheSize(void);
+
+size_t VixTools_TrimListProcCache(size_t bytes);
+
+void VixTools_DumpState(void);
+
 /*
  * These are internal procedures that are exposed for the legacy
  * tclo callbacks.
@@ -137,6 +145,15 @@ char *VixToolsGetEnvVarFromEnvBlock(const wchar_t *envBlock,
 
 char *VixToolsEscapeXMLString(const char *str);
 
+#if defined(__linux__)
+char *VixToolsStream_Start(Bool toGuest,
+                           const char *filePathName,
+                           Bool overwrite,
+                           GMainLoop *eventQueue);
+
+void VixToolsStream_Shutdown(void);
+#endif
+
 #ifdef _WIN32
 VixError VixToolsInitializeWin32();
 
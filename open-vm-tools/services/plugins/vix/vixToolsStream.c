@@ -0,0 +1,906 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * vixToolsStream.c --
+ *
+ *      Moves the contents of the files of InitiateFileTransfer(From|To)Guest
+ *      over a vsock stream, instead of one HGFS packet per VIX command.
+ *      See VIX_REQUESTMSG_STREAM_FILE_TRANSFER in vixCommands.h for the
+ *      protocol.
+ *
+ *      Streams are driven from the plugin's main loop with non-blocking
+ *      sockets. The file is opened while impersonating the user that
+ *      initiated the transfer, so that the transfer itself doesn't need the
+ *      user's credentials.
+ */
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#define G_LOG_DOMAIN  "vix"
+
+#include "vmware.h"
+#include "util.h"
+#include "str.h"
+#include "file.h"
+#include "posix.h"
+#include "random.h"
+#include "vmci_defs.h"
+#include "vmci_sockets.h"
+#include "vixOpenSource.h"
+#include "vixToolsInt.h"
+
+/*
+ * Size of the reads and writes of the file. The vsock buffers are made large
+ * enough to hold several of them, so both ends keep busy.
+ */
+#define VIX_TOOLS_STREAM_CHUNK_SIZE    (256 * 1024)
+#define VIX_TOOLS_STREAM_BUFFER_SIZE   (4 * 1024 * 1024)
+
+/* Transfers that may be in progress at once. */
+#define VIX_TOOLS_STREAM_MAX_STREAMS   8
+
+typedef enum {
+   VIX_TOOLS_STREAM_LISTENING,
+   VIX_TOOLS_STREAM_HANDSHAKE,
+   VIX_TOOLS_STREAM_DATA,
+   VIX_TOOLS_STREAM_STATUS,
+} VixToolsStreamState;
+
+typedef struct VixToolsStream {
+   Bool                 toGuest;
+   VixToolsStreamState  state;
+   GMainContext        *context;
+   int                  vsockDev;
+   int                  sock;        // Listening, then connected socket.
+   GSource             *watch;
+   GSource             *timer;
+   Bool                 progress;    // Since the last tick of the timer.
+
+   int                  fd;          // The file.
+   int                  dirFd;       // To the guest: the target's directory.
+   char                *tempName;    // To the guest: until committed.
+   char                *baseName;    // To the guest: the target.
+   Bool                 overwrite;
+
+   uint8                token[VIX_FILE_STREAM_TOKEN_SIZE];
+   uint8                header[VIX_FILE_STREAM_TOKEN_SIZE + sizeof (uint64)];
+   size_t               headerLen;
+   size_t               headerDone;
+
+   uint64               size;
+   uint64               done;
+   char                *buf;
+   size_t               bufLen;
+   size_t               bufOff;
+} VixToolsStream;
+
+static GList *gStreams = NULL;
+
+static gboolean VixToolsStreamIo(GIOChannel *chan,
+                                 GIOCondition cond,
+                                 gpointer data);
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStreamPutUint64 --
+ * VixToolsStreamGetUint64 --
+ *
+ *    Encode and decode the little endian integers of the protocol.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsStreamPutUint64(uint8 *buf,    // OUT
+                        uint64 val)    // IN
+{
+   unsigned int i;
+
+   for (i = 0; i < sizeof val; i++) {
+      buf[i] = (uint8) (val >> (8 * i));
+   }
+}
+
+static uint64
+VixToolsStreamGetUint64(const uint8 *buf)    // IN
+{
+   uint64 val = 0;
+   unsigned int i;
+
+   for (i = 0; i < sizeof val; i++) {
+      val |= (uint64) buf[i] << (8 * i);
+   }
+   return val;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStreamFree --
+ *
+ *    Frees a stream. A file that was being transferred to the guest and wasn't
+ *    committed is removed.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    Destroys the stream's event sources.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsStreamFree(VixToolsStream *stream)    // IN
+{
+   if (NULL != stream->watch) {
+      g_source_destroy(stream->watch);
+      g_source_unref(stream->watch);
+   }
+   if (NULL != stream->timer) {
+      g_source_destroy(stream->timer);
+      g_source_unref(stream->timer);
+   }
+   if (stream->sock >= 0) {
+      close(stream->sock);
+   }
+   if (stream->fd >= 0) {
+      close(stream->fd);
+   }
+   if (NULL != stream->tempName) {
+      unlinkat(stream->dirFd, stream->tempName, 0);
+   }
+   if (stream->dirFd >= 0) {
+      close(stream->dirFd);
+   }
+   VMCISock_ReleaseAFValueFd(stream->vsockDev);
+
+   free(stream->tempName);
+   free(stream->baseName);
+   free(stream->buf);
+   free(stream);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStreamFinish --
+ *
+ *    Ends a transfer, successful or not.
+ *
+ * Return value:
+ *    FALSE, for the event source callbacks to return.
+ *
+ * Side effects:
+ *    The stream is freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VixToolsStreamFinish(VixToolsStream *stream,    // IN
+                     const char *why)           // IN: NULL on success
+{
+   if (NULL == why) {
+      g_debug("%s: streamed %"FMT64"u bytes %s the guest.\n", __FUNCTION__,
+              stream->done, stream->toGuest ? "to" : "from");
+   } else {
+      g_warning("%s: stream %s the guest failed after %"FMT64"u of "
+                "%"FMT64"u bytes: %s\n", __FUNCTION__,
+                stream->toGuest ? "to" : "from", stream->done, stream->size,
+                why);
+   }
+
+   gStreams = g_list_remove(gStreams, stream);
+   VixToolsStreamFree(stream);
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStreamWatch --
+ *
+ *    Waits for the stream's socket to become ready for @cond, instead of
+ *    whatever was waited on before.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsStreamWatch(VixToolsStream *stream,   // IN
+                    GIOCondition cond)        // IN
+{
+   GIOChannel *chan;
+
+   if (NULL != stream->watch) {
+      g_source_destroy(stream->watch);
+      g_source_unref(stream->watch);
+   }
+
+   chan = g_io_channel_unix_new(stream->sock);
+   stream->watch = g_io_create_watch(chan, cond | G_IO_HUP | G_IO_ERR);
+   g_io_channel_unref(chan);   // Ownership transferred to the watch.
+
+   g_source_set_callback(stream->watch, (GSourceFunc) VixToolsStreamIo,
+                         stream, NULL);
+   g_source_attach(stream->watch, stream->context);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStreamTimeout --
+ *
+ *    Gives up on a transfer that made no progress since the last tick.
+ *
+ * Return value:
+ *    TRUE to keep the timer running.
+ *
+ * Side effects:
+ *    The stream may be freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VixToolsStreamTimeout(gpointer data)    // IN
+{
+   VixToolsStream *stream = data;
+
+   if (!stream->progress) {
+      return VixToolsStreamFinish(stream,
+                                  stream->state == VIX_TOOLS_STREAM_LISTENING ?
+                                  "no connection" : "timed out");
+   }
+   stream->progress = FALSE;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStreamCommit --
+ *
+ *    Moves a file that was completely transferred to the guest in place.
+ *    This runs without impersonation, so it only touches names in
+ *    the directory that was opened as the user.
+ *
+ * Return value:
+ *    VixError
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VixError
+VixToolsStreamCommit(VixToolsStream *stream)    // IN
+{
+   if (close(stream->fd) < 0) {
+      stream->fd = -1;
+      return Vix_TranslateErrno(errno);
+   }
+   stream->fd = -1;
+
+   if (stream->overwrite) {
+      if (renameat(stream->dirFd, stream->tempName,
+                   stream->dirFd, stream->baseName) < 0) {
+         return Vix_TranslateErrno(errno);
+      }
+   } else {
+      /* Unlike rename(), link() doesn't replace a file created meanwhile. */
+      if (linkat(stream->dirFd, stream->tempName,
+                 stream->dirFd, stream->baseName, 0) < 0) {
+         return EEXIST == errno ? VIX_E_FILE_ALREADY_EXISTS
+                                : Vix_TranslateErrno(errno);
+      }
+      unlinkat(stream->dirFd, stream->tempName, 0);
+   }
+
+   free(stream->tempName);
+   stream->tempName = NULL;
+   return VIX_OK;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStreamSetStatus --
+ *
+ *    Queues the status that ends a transfer to the guest.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsStreamSetStatus(VixToolsStream *stream,   // IN
+                        VixError err)             // IN
+{
+   if (VIX_OK != err) {
+      g_warning("%s: transfer to the guest failed: %"FMT64"d\n",
+                __FUNCTION__, err);
+   }
+
+   VixToolsStreamPutUint64((uint8 *) stream->buf, err);
+   stream->bufLen = sizeof (uint64);
+   stream->bufOff = 0;
+   stream->state = VIX_TOOLS_STREAM_STATUS;
+   VixToolsStreamWatch(stream, G_IO_OUT);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStreamAccept --
+ *
+ *    Accepts the client's connection. Only the host may connect.
+ *
+ * Return value:
+ *    TRUE to keep listening.
+ *
+ * Side effects:
+ *    The listening socket is closed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VixToolsStreamAccept(VixToolsStream *stream)   // IN
+{
+   struct sockaddr_vm addr;
+   socklen_t addrLen = sizeof addr;
+   int sock;
+
+   sock = accept4(stream->sock, (struct sockaddr *) &addr, &addrLen,
+                  SOCK_NONBLOCK | SOCK_CLOEXEC);
+   if (sock < 0) {
+      if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) {
+         return TRUE;
+      }
+      return VixToolsStreamFinish(stream, strerror(errno));
+   }
+
+   if (VMCI_HOST_CONTEXT_ID != addr.svm_cid) {
+      g_warning("%s: refusing connection from context %u.\n", __FUNCTION__,
+                addr.svm_cid);
+      close(sock);
+      return TRUE;
+   }
+
+   close(stream->sock);
+   stream->sock = sock;
+   stream->state = VIX_TOOLS_STREAM_HANDSHAKE;
+   stream->progress = TRUE;
+   VixToolsStreamWatch(stream, G_IO_IN);
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStreamHandshake --
+ *
+ *    Reads the token (and, for a transfer to the guest, the file size) sent
+ *    by the client.
+ *
+ * Return value:
+ *    TRUE to keep reading.
+ *
+ * Side effects:
+ *    The stream may be freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VixToolsStreamHandshake(VixToolsStream *stream)   // IN
+{
+   ssize_t n;
+   unsigned int i;
+   uint8 diff = 0;
+
+   n = recv(stream->sock, stream->header + stream->headerDone,
+            stream->headerLen - stream->headerDone, 0);
+   if (n < 0) {
+      if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) {
+         return TRUE;
+      }
+      return VixToolsStreamFinish(stream, strerror(errno));
+   }
+   if (0 == n) {
+      return VixToolsStreamFinish(stream, "connection closed");
+   }
+
+   stream->headerDone += n;
+   stream->progress = TRUE;
+   if (stream->headerDone < stream->headerLen) {
+      return TRUE;
+   }
+
+   for (i = 0; i < sizeof stream->token; i++) {
+      diff |= stream->header[i] ^ stream->token[i];
+   }
+   if (0 != diff) {
+      return VixToolsStreamFinish(stream, "bad token");
+   }
+
+   stream->state = VIX_TOOLS_STREAM_DATA;
+
+   if (stream->toGuest) {
+      stream->size = VixToolsStreamGetUint64(stream->header +
+                                             sizeof stream->token);
+      if (0 == stream->size) {
+         VixToolsStreamSetStatus(stream, VixToolsStreamCommit(stream));
+         return FALSE;
+      }
+      return TRUE;
+   }
+
+   VixToolsStreamPutUint64((uint8 *) stream->buf, stream->size);
+   stream->bufLen = sizeof (uint64);
+   stream->bufOff = 0;
+   VixToolsStreamWatch(stream, G_IO_OUT);
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStreamReceive --
+ *
+ *    Writes the next piece of a file transferred to the guest. Once all of it
+ *    is there, commits the file and queues the status.
+ *
+ * Return value:
+ *    TRUE to keep reading.
+ *
+ * Side effects:
+ *    The stream may be freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VixToolsStreamReceive(VixToolsStream *stream)   // IN
+{
+   size_t len = VIX_TOOLS_STREAM_CHUNK_SIZE;
+   size_t off = 0;
+   ssize_t n;
+
+   if (len > stream->size - stream->done) {
+      len = stream->size - stream->done;
+   }
+
+   n = recv(stream->sock, stream->buf, len, 0);
+   if (n < 0) {
+      if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) {
+         return TRUE;
+      }
+      return VixToolsStreamFinish(stream, strerror(errno));
+   }
+   if (0 == n) {
+      return VixToolsStreamFinish(stream, "connection closed");
+   }
+
+   while (off < (size_t) n) {
+      ssize_t written = write(stream->fd, stream->buf + off, n - off);
+
+      if (written < 0) {
+         if (EINTR == errno) {
+            continue;
+         }
+         VixToolsStreamSetStatus(stream, Vix_TranslateErrno(errno));
+         return FALSE;
+      }
+      off += written;
+   }
+
+   stream->done += n;
+   stream->progress = TRUE;
+   if (stream->done < stream->size) {
+      return TRUE;
+   }
+
+   VixToolsStreamSetStatus(stream, VixToolsStreamCommit(stream));
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStreamSend --
+ *
+ *    Sends whatever is buffered: the size or the next piece of a file
+ *    transferred from the guest, or the status of a transfer to the guest.
+ *    Reads the next piece of the file once the buffer is empty.
+ *
+ * Return value:
+ *    TRUE to keep writing.
+ *
+ * Side effects:
+ *    The stream may be freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VixToolsStreamSend(VixToolsStream *stream)   // IN
+{
+   ssize_t n;
+
+   if (stream->bufOff == stream->bufLen) {
+      size_t len = VIX_TOOLS_STREAM_CHUNK_SIZE;
+
+      if (stream->toGuest || stream->done == stream->size) {
+         shutdown(stream->sock, SHUT_WR);
+         return VixToolsStreamFinish(stream, NULL);
+      }
+
+      if (len > stream->size - stream->done) {
+         len = stream->size - stream->done;
+      }
+
+      do {
+         n = read(stream->fd, stream->buf, len);
+      } while (n < 0 && EINTR == errno);
+
+      if (n <= 0) {
+         /* The client notices the short stream. */
+         return VixToolsStreamFinish(stream, n < 0 ? strerror(errno)
+                                                   : "file truncated");
+      }
+
+      stream->bufLen = n;
+      stream->bufOff = 0;
+      stream->done += n;
+   }
+
+   n = send(stream->sock, stream->buf + stream->bufOff,
+            stream->bufLen - stream->bufOff, MSG_NOSIGNAL);
+   if (n < 0) {
+      if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) {
+         return TRUE;
+      }
+      return VixToolsStreamFinish(stream, strerror(errno));
+   }
+
+   stream->bufOff += n;
+   stream->progress = TRUE;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStreamIo --
+ *
+ *    Socket callback: moves the transfer along.
+ *
+ * Return value:
+ *    TRUE to keep waiting for the same condition.
+ *
+ * Side effects:
+ *    The stream may be freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VixToolsStreamIo(GIOChannel *chan,       // IN
+                 GIOCondition cond,      // IN
+                 gpointer data)          // IN
+{
+   VixToolsStream *stream = data;
+
+   switch (stream->state) {
+   case VIX_TOOLS_STREAM_LISTENING:
+      return VixToolsStreamAccept(stream);
+   case VIX_TOOLS_STREAM_HANDSHAKE:
+      return VixToolsStreamHandshake(stream);
+   case VIX_TOOLS_STREAM_DATA:
+      return stream->toGuest ? VixToolsStreamReceive(stream)
+                             : VixToolsStreamSend(stream);
+   case VIX_TOOLS_STREAM_STATUS:
+      return VixToolsStreamSend(stream);
+   default:
+      NOT_REACHED();
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStreamOpenFile --
+ *
+ *    Opens the file to transfer. A file transferred to the guest is first
+ *    written to a temporary file in the target's directory.
+ *
+ * Return value:
+ *    TRUE on success.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+VixToolsStreamOpenFile(VixToolsStream *stream,      // IN/OUT
+                       const char *filePathName)    // IN
+{
+   struct stat st;
+   char *dirName = NULL;
+   uint32 rand;
+
+   if (!stream->toGuest) {
+      stream->fd = Posix_Open(filePathName,
+                              O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+      if (stream->fd < 0 || fstat(stream->fd, &st) < 0) {
+         g_warning("%s: can't open %s: %s\n", __FUNCTION__, filePathName,
+                   strerror(errno));
+         return FALSE;
+      }
+      if (!S_ISREG(st.st_mode)) {
+         return FALSE;
+      }
+      stream->size = st.st_size;
+      return TRUE;
+   }
+
+   File_GetPathName(filePathName, &dirName, &stream->baseName);
+   if (NULL == dirName || NULL == stream->baseName ||
+       '\0' == *stream->baseName) {
+      free(dirName);
+      return FALSE;
+   }
+
+   stream->dirFd = Posix_Open(dirName, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   free(dirName);
+   if (stream->dirFd < 0 || !Random_Crypto(sizeof rand, &rand)) {
+      return FALSE;
+   }
+
+   stream->tempName = Str_SafeAsprintf(NULL, ".vmtools-transfer-%08x", rand);
+   stream->fd = openat(stream->dirFd, stream->tempName,
+                       O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+                       0666);
+   if (stream->fd < 0) {
+      g_warning("%s: can't create a file next to %s: %s\n", __FUNCTION__,
+                filePathName, strerror(errno));
+      free(stream->tempName);
+      stream->tempName = NULL;
+      return FALSE;
+   }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStreamListen --
+ *
+ *    Creates the vsock socket the client connects to, with buffers large
+ *    enough to keep the stream going.
+ *
+ * Return value:
+ *    The port listened on, or VMADDR_PORT_ANY on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned int
+VixToolsStreamListen(VixToolsStream *stream)      // IN/OUT
+{
+   struct sockaddr_vm addr;
+   socklen_t addrLen = sizeof addr;
+   unsigned long long bufSize = VIX_TOOLS_STREAM_BUFFER_SIZE;
+   int family;
+
+   family = VMCISock_GetAFValueFd(&stream->vsockDev);
+   if (family < 0) {
+      g_debug("%s: vsock isn't available.\n", __FUNCTION__);
+      return VMADDR_PORT_ANY;
+   }
+
+   stream->sock = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                         0);
+   if (stream->sock < 0) {
+      goto fail;
+   }
+
+   /* Accepted sockets inherit the sizes; not fatal if they are refused. */
+   if (setsockopt(stream->sock, family, SO_VMCI_BUFFER_MAX_SIZE,
+                  &bufSize, sizeof bufSize) < 0 ||
+       setsockopt(stream->sock, family, SO_VMCI_BUFFER_SIZE,
+                  &bufSize, sizeof bufSize) < 0) {
+      g_debug("%s: can't grow vsock buffers: %s\n", __FUNCTION__,
+              strerror(errno));
+   }
+
+   memset(&addr, 0, sizeof addr);
+   addr.svm_family = family;
+   addr.svm_cid = VMADDR_CID_ANY;
+   addr.svm_port = VMADDR_PORT_ANY;
+
+   if (bind(stream->sock, (struct sockaddr *) &addr, sizeof addr) < 0 ||
+       listen(stream->sock, 1) < 0 ||
+       getsockname(stream->sock, (struct sockaddr *) &addr, &addrLen) < 0) {
+      goto fail;
+   }
+
+   return addr.svm_port;
+
+fail:
+   g_warning("%s: can't listen on vsock: %s\n", __FUNCTION__,
+             strerror(errno));
+   return VMADDR_PORT_ANY;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStream_Start --
+ *
+ *    Sets up the streamed transfer of @filePathName to or from the guest.
+ *    Must be called while impersonating the user that asked for the
+ *    transfer, once the usual checks on the path passed.
+ *
+ * Return value:
+ *    The elements to add to the reply, which the caller must free, or NULL
+ *    if the file can't be streamed (the client then uses HGFS).
+ *
+ * Side effects:
+ *    Starts listening on a vsock port.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+char *
+VixToolsStream_Start(Bool toGuest,                // IN
+                     const char *filePathName,    // IN
+                     Bool overwrite,              // IN
+                     GMainLoop *eventQueue)       // IN
+{
+   VixToolsStream *stream;
+   char token[2 * VIX_FILE_STREAM_TOKEN_SIZE + 1];
+   unsigned int port;
+   unsigned int i;
+
+   if (NULL == eventQueue ||
+       g_list_length(gStreams) >= VIX_TOOLS_STREAM_MAX_STREAMS) {
+      return NULL;
+   }
+
+   stream = Util_SafeCalloc(1, sizeof *stream);
+   stream->toGuest = toGuest;
+   stream->overwrite = overwrite;
+   stream->vsockDev = -1;
+   stream->sock = -1;
+   stream->fd = -1;
+   stream->dirFd = -1;
+   stream->headerLen = sizeof stream->token +
+                       (toGuest ? sizeof (uint64) : 0);
+
+   if (!VixToolsStreamOpenFile(stream, filePathName) ||
+       !Random_Crypto(sizeof stream->token, stream->token)) {
+      goto fail;
+   }
+
+   port = VixToolsStreamListen(stream);
+   if (VMADDR_PORT_ANY == port) {
+      goto fail;
+   }
+
+   stream->buf = Util_SafeMalloc(VIX_TOOLS_STREAM_CHUNK_SIZE);
+   stream->context = g_main_loop_get_context(eventQueue);
+   stream->state = VIX_TOOLS_STREAM_LISTENING;
+   VixToolsStreamWatch(stream, G_IO_IN);
+
+   stream->timer = g_timeout_source_new(VIX_FILE_STREAM_TIMEOUT * 1000);
+   g_source_set_callback(stream->timer, VixToolsStreamTimeout, stream, NULL);
+   g_source_attach(stream->timer, stream->context);
+
+   gStreams = g_list_prepend(gStreams, stream);
+
+   for (i = 0; i < sizeof stream->token; i++) {
+      Str_Sprintf(token + 2 * i, sizeof token - 2 * i, "%02x",
+                  stream->token[i]);
+   }
+
+   g_debug("%s: streaming %s %s the guest on port %u.\n", __FUNCTION__,
+           filePathName, toGuest ? "to" : "from", port);
+
+   return Str_SafeAsprintf(NULL,
+                           "<streamPort>%u</streamPort>"
+                           "<streamToken>%s</streamToken>",
+                           port, token);
+
+fail:
+   VixToolsStreamFree(stream);
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsStream_Shutdown --
+ *
+ *    Aborts the transfers in progress.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    Files not completely transferred to the guest are removed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+VixToolsStream_Shutdown(void)
+{
+   while (NULL != gStreams) {
+      VixToolsStreamFree(gStreams->data);
+      gStreams = g_list_delete_link(gStreams, gStreams);
+   }
+}
+
+#endif // __linux__
@@ -30,9 +30,11 @@
 #include "vm_basic_defs.h"
 #include "file.h"
 #include "guestApp.h"
+#include "hostinfo.h"
 #include "procMgr.h"
 #include "str.h"
 #include "util.h"
+#include "vmware/tools/utils.h"
 
 /*
  * These are legacy scripts used before the vmbackup-based backups. To
@@ -53,9 +55,21 @@
 #endif
 
 
+/*
+ * A subdirectory of the scripts directory with this suffix holds a group of
+ * scripts that are run concurrently, at the position of the directory in the
+ * sorted script list.
+ */
+#define PARALLEL_GROUP_SUFFIX   ".parallel"
+
+
 typedef struct VmBackupScript {
    char *path;
    ProcMgr_AsyncProc *proc;
+   guint group;            // Parallel group, 0 if run on its own
+   Bool skip;              // Freezing failed, don't thaw
+   VmTimeType deadline;    // When to kill the script, 0 for never
+   GSource *watch;         // Notifies the exit of the script
 } VmBackupScript;
 
 
@@ -63,8 +77,11 @@ typedef struct VmBackupScriptOp {
    VmBackupOp callbacks;
    Bool canceled;
    Bool thawFailed;
+   Bool stepFailed;
    VmBackupScriptType type;
    VmBackupState *state;
+   ssize_t stepStart;      // Scripts run by the current step,
+   ssize_t stepEnd;        // from stepStart to stepEnd
 } VmBackupScriptOp;
 
 
@@ -101,16 +118,204 @@ VmBackupGetScriptPath(void)
 }
 
 
+#if defined(_WIN32)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupScriptExited --
+ *
+ *    Watch callback: the process handle of a script is signaled, meaning
+ *    that it exited.
+ *
+ * Result
+ *    FALSE, to remove the watch.
+ *
+ * Side effects:
+ *    Runs the state machine.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VmBackupScriptExited(gpointer data)  // IN
+{
+   VmBackup_PollNow();
+   return FALSE;
+}
+
+#else
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupScriptExited --
+ *
+ *    Watch callback: the selectable of a script is ready, meaning that it
+ *    exited.
+ *
+ * Result
+ *    FALSE, to remove the watch.
+ *
+ * Side effects:
+ *    Runs the state machine.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VmBackupScriptExited(GIOChannel *chan,       // IN
+                     GIOCondition cond,      // IN
+                     gpointer data)          // IN
+{
+   VmBackup_PollNow();
+   return FALSE;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupStartScript --
+ *
+ *    Starts a script, and watches it so that the state machine learns about
+ *    its exit right away instead of at its next poll.
+ *
+ * Result
+ *    TRUE if the script was started.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+VmBackupStartScript(VmBackupScriptOp *op,        // IN
+                    VmBackupScript *script,      // IN/OUT
+                    const char *scriptOp)        // IN
+{
+   char *cmd;
+   GSource *source;
+#if !defined(_WIN32)
+   GIOChannel *chan;
+#endif
+
+   if (op->state->scriptArg != NULL) {
+      cmd = Str_Asprintf(NULL, "\"%s\" %s \"%s\"", script->path,
+                         scriptOp, op->state->scriptArg);
+   } else {
+      cmd = Str_Asprintf(NULL, "\"%s\" %s", script->path,
+                         scriptOp);
+   }
+   if (cmd != NULL) {
+      g_debug("Running script: %s\n", cmd);
+      script->proc = ProcMgr_ExecAsync(cmd, NULL);
+   } else {
+      g_debug("Failed to allocate memory to run script: %s\n",
+              script->path);
+      script->proc = NULL;
+   }
+   vm_free(cmd);
+
+   if (script->proc == NULL) {
+      return FALSE;
+   }
+
+   script->deadline = 0;
+   if (op->state->scriptTimeout != 0) {
+      script->deadline = Hostinfo_SystemTimerUS() +
+                         op->state->scriptTimeout * 1000000LL;
+   }
+
+#if defined(_WIN32)
+   source = VMTools_NewHandleSource(ProcMgr_GetAsyncProcSelectable(script->proc));
+#else
+   chan = g_io_channel_unix_new(ProcMgr_GetAsyncProcSelectable(script->proc));
+   source = g_io_create_watch(chan, G_IO_IN | G_IO_HUP | G_IO_ERR);
+   g_io_channel_unref(chan);   // Ownership transferred to the watch.
+#endif
+   VMTOOLSAPP_ATTACH_SOURCE(op->state->ctx, source, VmBackupScriptExited,
+                            NULL, NULL);
+   script->watch = source;
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupScriptDone --
+ *
+ *    Forgets about a script process that exited (or was killed).
+ *
+ * Result
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VmBackupScriptDone(VmBackupScript *script)  // IN/OUT
+{
+   if (script->watch != NULL) {
+      g_source_destroy(script->watch);
+      g_source_unref(script->watch);
+      script->watch = NULL;
+   }
+   if (script->proc != NULL) {
+      ProcMgr_Free(script->proc);
+      script->proc = NULL;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupKillScript --
+ *
+ *    Kills a running script and waits for it to go away.
+ *
+ * Result
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VmBackupKillScript(VmBackupScript *script)  // IN/OUT
+{
+   ProcMgr_Pid pid = ProcMgr_GetPid(script->proc);
+
+   if (!ProcMgr_KillByPid(pid)) {
+      // XXX: what to do in this situation? other than log and cry?
+   } else {
+      int exitCode;
+      ProcMgr_GetExitCode(script->proc, &exitCode);
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * VmBackupRunNextScript --
  *
- *    Runs the next script for the given operation. If thawing (or running
- *    scripts after a failure), this function will try as much as possible
- *    to start a script, meaning that if it fails to start a script it will
- *    try to start the preceding one until one script is run, or it runs out
- *    of scripts to try.
+ *    Runs the next step of scripts for the given operation: the next script,
+ *    or all the scripts of the next parallel group at once. If thawing (or
+ *    running scripts after a failure), this function will try as much as
+ *    possible to start a script, meaning that if it fails to start the
+ *    scripts of a step it will try the preceding one until one script is
+ *    run, or it runs out of scripts to try. Scripts whose freeze failed are
+ *    not run when thawing.
  *
  * Results:
  *    -1: an error occurred.
@@ -127,23 +332,20 @@ static int
 VmBackupRunNextScript(VmBackupScriptOp *op)  // IN/OUT
 {
    const char *scriptOp;
-   int ret = 0;
-   ssize_t index;
+   Bool forward = FALSE;
    VmBackupScript *scripts = op->state->scripts;
 
    switch (op->type) {
    case VMBACKUP_SCRIPT_FREEZE:
-      index = ++op->state->currentScript;
+      forward = TRUE;
       scriptOp = "freeze";
       break;
 
    case VMBACKUP_SCRIPT_FREEZE_FAIL:
-      index = --op->state->currentScript;
       scriptOp = "freezeFail";
       break;
 
    case VMBACKUP_SCRIPT_THAW:
-      index = --op->state->currentScript;
       scriptOp = "thaw";
       break;
 
@@ -151,64 +353,73 @@ VmBackupRunNextScript(VmBackupScriptOp *op)  // IN/OUT
       NOT_REACHED();
    }
 
-   while (index >= 0 && scripts[index].path != NULL) {
-      char *cmd;
+   for (;;) {
+      ssize_t index;
+      ssize_t i;
+      int started = 0;
 
-      if (File_IsFile(scripts[index].path)) {
-         if (op->state->scriptArg != NULL) {
-            cmd = Str_Asprintf(NULL, "\"%s\" %s \"%s\"", scripts[index].path,
-                               scriptOp, op->state->scriptArg);
+      if (forward) {
+         index = ++op->state->currentScript;
+      } else {
+         index = --op->state->currentScript;
+      }
+      if (index < 0 || scripts[index].path == NULL) {
+         op->stepStart = 0;
+         op->stepEnd = -1;
+         return 0;
+      }
+
+      /* Take in the rest of the script's parallel group. */
+      op->stepStart = index;
+      op->stepEnd = index;
+      if (scripts[index].group != 0) {
+         if (forward) {
+            while (scripts[op->stepEnd + 1].path != NULL &&
+                   scripts[op->stepEnd + 1].group == scripts[index].group) {
+               op->stepEnd++;
+            }
+            op->state->currentScript = op->stepEnd;
          } else {
-            cmd = Str_Asprintf(NULL, "\"%s\" %s", scripts[index].path,
-                               scriptOp);
+            while (op->stepStart > 0 &&
+                   scripts[op->stepStart - 1].group == scripts[index].group) {
+               op->stepStart--;
+            }
+            op->state->currentScript = op->stepStart;
          }
-         if (cmd != NULL) {
-            g_debug("Running script: %s\n", cmd);
-            scripts[index].proc = ProcMgr_ExecAsync(cmd, NULL);
-         } else {
-            g_debug("Failed to allocate memory to run script: %s\n",
-                    scripts[index].path);
-            scripts[index].proc = NULL;
+      }
+
+      for (i = op->stepStart; i <= op->stepEnd; i++) {
+         VmBackupScript *script = &scripts[i];
+
+         if (script->skip || !File_IsFile(script->path)) {
+            continue;
          }
-         vm_free(cmd);
-
-         if (scripts[index].proc == NULL) {
-            if (op->type == VMBACKUP_SCRIPT_FREEZE) {
-               ret = -1;
-               break;
-            } else {
-               op->thawFailed = TRUE;
-            }
+
+         if (VmBackupStartScript(op, script, scriptOp)) {
+            started++;
+         } else if (op->type == VMBACKUP_SCRIPT_FREEZE) {
+            script->skip = TRUE;
+            op->stepFailed = TRUE;
          } else {
-            ret = 1;
-            break;
+            op->thawFailed = TRUE;
          }
       }
 
-      if (op->type == VMBACKUP_SCRIPT_FREEZE) {
-         index = ++op->state->currentScript;
-      } else {
-         index = --op->state->currentScript;
+      if (op->stepFailed) {
+         /*
+          * Scripts of the step that did freeze still need to run their
+          * "freezeFail" action.
+          */
+         op->state->currentScript = op->stepEnd + 1;
+         if (started == 0) {
+            return -1;
+         }
       }
 
-      /*
-       * This happens if all thaw/fail scripts failed to start. Since the first
-       * entry may be a legacy script (which may not exist), need to check
-       * whether the interesting failure is the first or the second entry in
-       * the script list.
-       */
-      if (index == -1) {
-         size_t failIdx = 0;
-         if (!File_IsFile(scripts[0].path)) {
-            failIdx = 1;
-         }
-         if (scripts[failIdx].proc == NULL && scripts[failIdx].path != NULL) {
-            ret = -1;
-         }
+      if (started > 0) {
+         return 1;
       }
    }
-
-   return ret;
 }
 
 
@@ -241,9 +452,10 @@ VmBackupStringCompare(const void *str1,   // IN
  *
  *  VmBackupScriptOpQuery --
  *
- *    Checks the status of the current running script. If the script is
- *    finished, run the next script in the queue or, if no scripts are left,
- *    return a "finished" status.
+ *    Checks the status of the currently running scripts, and kills those
+ *    that ran for longer than allowed. Once they're all finished, runs the
+ *    next script (or group of scripts) in the queue or, if no scripts are
+ *    left, returns a "finished" status.
  *
  * Result
  *    The status of the operation.
@@ -260,54 +472,79 @@ VmBackupScriptOpQuery(VmBackupOp *_op) // IN
    VmBackupOpStatus ret = VMBACKUP_STATUS_PENDING;
    VmBackupScriptOp *op = (VmBackupScriptOp *) _op;
    VmBackupScript *scripts = op->state->scripts;
-   VmBackupScript *currScript = NULL;
-
-   if (scripts != NULL && op->state->currentScript >= 0) {
-      currScript = &scripts[op->state->currentScript];
-   }
+   Bool running = FALSE;
+   VmTimeType now;
+   ssize_t i;
 
    if (op->canceled) {
       ret = VMBACKUP_STATUS_CANCELED;
       goto exit;
-   } else if (scripts == NULL || currScript == NULL || currScript->proc == NULL) {
-      ret = VMBACKUP_STATUS_FINISHED;
+   } else if (scripts == NULL || op->stepStart > op->stepEnd) {
+      ret = op->thawFailed ? VMBACKUP_STATUS_ERROR : VMBACKUP_STATUS_FINISHED;
       goto exit;
    }
 
-   if (!ProcMgr_IsAsyncProcRunning(currScript->proc)) {
-      int exitCode;
+   now = Hostinfo_SystemTimerUS();
+   for (i = op->stepStart; i <= op->stepEnd; i++) {
+      VmBackupScript *script = &scripts[i];
       Bool succeeded;
+      int exitCode;
 
-      succeeded = (ProcMgr_GetExitCode(currScript->proc, &exitCode) == 0 &&
-                   exitCode == 0);
-      ProcMgr_Free(currScript->proc);
-      currScript->proc = NULL;
+      if (script->proc == NULL) {
+         continue;
+      }
+
+      if (ProcMgr_IsAsyncProcRunning(script->proc)) {
+         if (script->deadline == 0 || now < script->deadline) {
+            running = TRUE;
+            continue;
+         }
+         g_warning("Script %s did not finish in %u seconds, killing it.\n",
+                   script->path, op->state->scriptTimeout);
+         VmBackupKillScript(script);
+         succeeded = FALSE;
+      } else {
+         succeeded = (ProcMgr_GetExitCode(script->proc, &exitCode) == 0 &&
+                      exitCode == 0);
+      }
+      VmBackupScriptDone(script);
 
       /*
        * If thaw scripts fail, keep running and only notify the failure after
-       * all others have run.
+       * all others have run. If a freeze script fails, let the rest of its
+       * group finish before failing.
        */
       if (!succeeded) {
-          if (op->type == VMBACKUP_SCRIPT_FREEZE) {
-             ret = VMBACKUP_STATUS_ERROR;
-             goto exit;
-          } else if (op->type == VMBACKUP_SCRIPT_THAW) {
-             op->thawFailed = TRUE;
-          }
+         if (op->type == VMBACKUP_SCRIPT_FREEZE) {
+            script->skip = TRUE;
+            op->stepFailed = TRUE;
+         } else if (op->type == VMBACKUP_SCRIPT_THAW) {
+            op->thawFailed = TRUE;
+         }
       }
+   }
 
-      switch (VmBackupRunNextScript(op)) {
-      case -1:
-         ret = VMBACKUP_STATUS_ERROR;
-         break;
+   if (running) {
+      goto exit;
+   }
 
-      case 0:
-         ret = op->thawFailed ? VMBACKUP_STATUS_ERROR : VMBACKUP_STATUS_FINISHED;
-         break;
+   if (op->stepFailed) {
+      op->state->currentScript = op->stepEnd + 1;
+      ret = VMBACKUP_STATUS_ERROR;
+      goto exit;
+   }
 
-      default:
-         break;
-      }
+   switch (VmBackupRunNextScript(op)) {
+   case -1:
+      ret = VMBACKUP_STATUS_ERROR;
+      break;
+
+   case 0:
+      ret = op->thawFailed ? VMBACKUP_STATUS_ERROR : VMBACKUP_STATUS_FINISHED;
+      break;
+
+   default:
+      break;
    }
 
 exit:
@@ -348,10 +585,8 @@ VmBackupScriptOpRelease(VmBackupOp *_op)  // IN
    if (op->type != VMBACKUP_SCRIPT_FREEZE && op->state->scripts != NULL) {
       VmBackupScript *scripts = op->state->scripts;
       for (i = 0; scripts[i].path != NULL; i++) {
+         VmBackupScriptDone(&scripts[i]);
          free(scripts[i].path);
-         if (scripts[i].proc != NULL) {
-            ProcMgr_Free(scripts[i].proc);
-         }
       }
       free(op->state->scripts);
       op->state->scripts = NULL;
@@ -367,7 +602,7 @@ VmBackupScriptOpRelease(VmBackupOp *_op)  // IN
  *
  *  VmBackupScriptOpCancel --
  *
- *    Cancels the current operation. Kills any currently running script and
+ *    Cancels the current operation. Kills any currently running scripts and
  *    flags the operation as canceled.
  *
  * Result
@@ -384,23 +619,127 @@ VmBackupScriptOpCancel(VmBackupOp *_op)   // IN
 {
    VmBackupScriptOp *op = (VmBackupScriptOp *) _op;
    VmBackupScript *scripts = op->state->scripts;
-   VmBackupScript *currScript = NULL;
-   ProcMgr_Pid pid;
+   ssize_t i;
 
    if (scripts != NULL) {
-      currScript = &scripts[op->state->currentScript];
-      ASSERT(currScript->proc != NULL);
+      for (i = op->stepStart; i <= op->stepEnd; i++) {
+         if (scripts[i].proc != NULL) {
+            VmBackupKillScript(&scripts[i]);
+            VmBackupScriptDone(&scripts[i]);
+            scripts[i].skip = TRUE;
+         }
+      }
+      if (op->type == VMBACKUP_SCRIPT_FREEZE && op->stepStart <= op->stepEnd) {
+         op->state->currentScript = op->stepEnd + 1;
+      }
+   }
+
+   op->canceled = TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupAddScript --
+ *
+ *    Appends a script to the NULL terminated script list.
+ *
+ * Result
+ *    None.
+ *
+ * Side effects:
+ *    Takes ownership of "path"; may reallocate the list.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VmBackupAddScript(VmBackupScript **scripts,   // IN/OUT
+                  size_t *count,              // IN/OUT
+                  char *path,                 // IN
+                  guint group)                // IN
+{
+   VmBackupScript *script;
 
-      pid = ProcMgr_GetPid(currScript->proc);
-      if (!ProcMgr_KillByPid(pid)) {
-         // XXX: what to do in this situation? other than log and cry?
+   *scripts = Util_SafeRealloc(*scripts, (*count + 2) * sizeof **scripts);
+   script = &(*scripts)[(*count)++];
+   memset(script, 0, 2 * sizeof *script);
+   script->path = path;
+   script->group = group;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupAddScriptDir --
+ *
+ *    Appends the scripts directly under the given directory to the script
+ *    list, in ascending order. Scripts in a "*.parallel" subdirectory are
+ *    added as a parallel group; other subdirectories are ignored.
+ *
+ * Result
+ *    FALSE if out of memory.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+VmBackupAddScriptDir(const char *dir,              // IN
+                     guint group,                  // IN
+                     guint *lastGroup,             // IN/OUT
+                     VmBackupScript **scripts,     // IN/OUT
+                     size_t *count)                // IN/OUT
+{
+   Bool success = TRUE;
+   char **fileList = NULL;
+   int numFiles = 0;
+   int i;
+
+   if (File_IsDirectory(dir)) {
+      numFiles = File_ListDirectory(dir, &fileList);
+   }
+
+   if (numFiles > 1) {
+      qsort(fileList, (size_t) numFiles, sizeof *fileList, VmBackupStringCompare);
+   }
+
+   for (i = 0; i < numFiles; i++) {
+      char *script;
+      size_t len = strlen(fileList[i]);
+
+      script = Str_Asprintf(NULL, "%s%c%s", dir, DIRSEPC, fileList[i]);
+      if (script == NULL) {
+         success = FALSE;
+         break;
+      } else if (File_IsFile(script)) {
+         VmBackupAddScript(scripts, count, script, group);
+      } else if (group == 0 &&
+                 len > sizeof PARALLEL_GROUP_SUFFIX - 1 &&
+                 strcmp(fileList[i] + len - (sizeof PARALLEL_GROUP_SUFFIX - 1),
+                        PARALLEL_GROUP_SUFFIX) == 0 &&
+                 File_IsDirectory(script)) {
+         success = VmBackupAddScriptDir(script, ++*lastGroup, lastGroup,
+                                        scripts, count);
+         free(script);
+         if (!success) {
+            break;
+         }
       } else {
-         int exitCode;
-         ProcMgr_GetExitCode(currScript->proc, &exitCode);
+         free(script);
       }
    }
 
-   op->canceled = TRUE;
+   for (i = 0; i < numFiles; i++) {
+      free(fileList[i]);
+   }
+   free(fileList);
+
+   return success;
 }
 
 
@@ -432,10 +771,7 @@ VmBackup_NewScriptOp(VmBackupScriptType type, // IN
                      VmBackupState *state)    // IN
 {
    Bool fail = FALSE;
-   char **fileList = NULL;
    char *scriptDir = NULL;
-   int numFiles = 0;
-   size_t i;
    VmBackupScriptOp *op = NULL;
 
    scriptDir = VmBackupGetScriptPath();
@@ -450,6 +786,8 @@ VmBackup_NewScriptOp(VmBackupScriptType type, // IN
 
    op->state = state;
    op->type = type;
+   op->stepStart = 0;
+   op->stepEnd = -1;
    op->callbacks.queryFn = VmBackupScriptOpQuery;
    op->callbacks.cancelFn = VmBackupScriptOpCancel;
    op->callbacks.releaseFn = VmBackupScriptOpRelease;
@@ -461,38 +799,38 @@ VmBackup_NewScriptOp(VmBackupScriptType type, // IN
     * used later in case of failure, or when thawing, in reverse order.
     *
     * This logic won't recurse into directories, so only files directly under
-    * the script dir will be considered.
+    * the script dir (or a parallel group directory, see below) will be
+    * considered.
     *
     * Legacy scripts will be the first ones to run (or last ones in the
     * case of thawing). If either the legacy freeze or thaw script
     * exist, the first entry in the script list will be reserved for
     * them, and their path might not exist (in case, for example, the
     * freeze script exists but the thaw script doesn't).
+    *
+    * The scripts in a "*.parallel" subdirectory form a group, run at the
+    * position of the directory in the list. The scripts of a group run
+    * concurrently, and the next script only starts once they all finished.
     */
    if (type == VMBACKUP_SCRIPT_FREEZE) {
       VmBackupScript *scripts = NULL;
-      int legacy = 0;
-      size_t idx = 0;
+      size_t count = 0;
+      guint lastGroup = 0;
 
       state->scripts = NULL;
       state->currentScript = 0;
 
       if (File_IsFile(LEGACY_FREEZE_SCRIPT) ||
           File_IsFile(LEGACY_THAW_SCRIPT)) {
-         legacy = 1;
+         VmBackupAddScript(&scripts, &count,
+                           Util_SafeStrdup(LEGACY_FREEZE_SCRIPT), 0);
       }
 
-      if (File_IsDirectory(scriptDir)) {
-         numFiles = File_ListDirectory(scriptDir, &fileList);
+      if (!VmBackupAddScriptDir(scriptDir, 0, &lastGroup, &scripts, &count)) {
+         fail = TRUE;
       }
 
-      if (numFiles + legacy > 0) {
-         scripts = calloc(numFiles + legacy + 1, sizeof *scripts);
-         if (scripts == NULL) {
-            fail = TRUE;
-            goto exit;
-         }
-
+      if (count > 0) {
          /*
           * VmBackupRunNextScript increments the index, so need to make it point
           * to "before the first script".
@@ -501,30 +839,8 @@ VmBackup_NewScriptOp(VmBackupScriptType type, // IN
          state->scripts = scripts;
       }
 
-      if (legacy > 0) {
-         scripts[idx++].path = Util_SafeStrdup(LEGACY_FREEZE_SCRIPT);
-      }
-
-      if (numFiles > 0) {
-         size_t i;
-
-         if (numFiles > 1) {
-            qsort(fileList, (size_t) numFiles, sizeof *fileList, VmBackupStringCompare);
-         }
-
-         for (i = 0; i < numFiles; i++) {
-            char *script;
-
-            script = Str_Asprintf(NULL, "%s%c%s", scriptDir, DIRSEPC, fileList[i]);
-            if (script == NULL) {
-               fail = TRUE;
-               goto exit;
-            } else if (File_IsFile(script)) {
-               scripts[idx++].path = script;
-            } else {
-               free(script);
-            }
-         }
+      if (fail) {
+         goto exit;
       }
    } else if (state->scripts != NULL) {
       VmBackupScript *scripts = state->scripts;
@@ -543,12 +859,6 @@ VmBackup_NewScriptOp(VmBackupScriptType type, // IN
    fail = (state->scripts != NULL && VmBackupRunNextScript(op) == -1);
 
 exit:
-   /* Free the file list. */
-   for (i = 0; i < numFiles; i++) {
-      free(fileList[i]);
-   }
-   free(fileList);
-
    if (fail && op != NULL) {
       VmBackup_Release((VmBackupOp *) op);
       op = NULL;
@@ -39,6 +39,7 @@
 #include <glib-object.h>
 #include <gmodule.h>
 #include "guestApp.h"
+#include "hostinfo.h"
 #include "str.h"
 #include "strutil.h"
 #include "util.h"
@@ -86,7 +87,34 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
 #define VMBACKUP_CONFIG_GET_INT(config, key, defVal)        \
    VMTools_ConfigGetInteger(config, "vmbackup", key, defVal)
 
+/*
+ * Timelines of the last few backup operations: the time spent in each state
+ * of the state machine (as seen by the main loop, so state changes detected
+ * by polling are late by up to a poll period), and the time it took to freeze
+ * and thaw each file system. Only accessed from the main thread.
+ */
+#define VMBACKUP_TIMELINE_HISTORY            8
+#define VMBACKUP_TIMELINE_MAX_EVENT_VOLUMES  64
+
+typedef struct VmBackupVolumeTimes {
+   gchar         *path;
+   uint64         freezeUS;
+   uint64         thawUS;
+} VmBackupVolumeTimes;
+
+typedef struct VmBackupTimeline {
+   VmTimeType     startUS;
+   VmTimeType     stateStartUS;
+   VmTimeType     totalUS;
+   VmTimeType     stateUS[VMBACKUP_MSTATE_SYNC_ERROR + 1];
+   guint          errors;
+   Bool           sendEvent;
+   GArray        *volumes;       // VmBackupVolumeTimes, in freeze order
+} VmBackupTimeline;
+
 static VmBackupState *gBackupState = NULL;
+static VmBackupTimeline *gTimeline = NULL;
+static GQueue *gTimelineHistory = NULL;
 
 static Bool
 VmBackupEnableSync(void);
@@ -143,6 +171,182 @@ VmBackupGetStateName(VmBackupMState state)
 }
 
 
+/**
+ * Starts the timeline of a new backup operation.
+ *
+ * @param[in]  ctx      The app context.
+ */
+
+static void
+VmBackupTimelineStart(ToolsAppCtx *ctx)
+{
+   VmBackupTimeline *tl = g_new0(VmBackupTimeline, 1);
+
+   tl->startUS = Hostinfo_SystemTimerUS();
+   tl->stateStartUS = tl->startUS;
+   tl->sendEvent = VMBACKUP_CONFIG_GET_BOOL(ctx->config, "timelineEvent",
+                                            FALSE);
+   tl->volumes = g_array_new(FALSE, FALSE, sizeof (VmBackupVolumeTimes));
+
+   ASSERT(gTimeline == NULL);
+   gTimeline = tl;
+}
+
+
+/**
+ * Frees a timeline.
+ *
+ * @param[in]  tl       The timeline.
+ */
+
+static void
+VmBackupTimelineFree(VmBackupTimeline *tl)
+{
+   guint i;
+
+   for (i = 0; i < tl->volumes->len; i++) {
+      g_free(g_array_index(tl->volumes, VmBackupVolumeTimes, i).path);
+   }
+   g_array_free(tl->volumes, TRUE);
+   g_free(tl);
+}
+
+
+/**
+ * Moves the state machine to the given state, and charges the time spent
+ * in the previous state to the timeline of the backup operation.
+ *
+ * @param[in]  state    The new state.
+ */
+
+static void
+VmBackupSetMachineState(VmBackupMState state)
+{
+   if (gTimeline != NULL) {
+      VmTimeType now = Hostinfo_SystemTimerUS();
+
+      gTimeline->stateUS[gBackupState->machineState] +=
+         now - gTimeline->stateStartUS;
+      gTimeline->stateStartUS = now;
+      if (state != gBackupState->machineState) {
+         g_debug("Quiesce state %s -> %s at %"FMT64"dus.\n",
+                 VmBackupGetStateName(gBackupState->machineState),
+                 VmBackupGetStateName(state),
+                 now - gTimeline->startUS);
+      }
+   }
+   gBackupState->machineState = state;
+}
+
+
+/**
+ * Formats a timeline as a list of space separated "name=microseconds" items:
+ * first the total time, then the time spent in each state the backup went
+ * through, then the freeze and thaw times of each file system
+ * ("vol:<path>=<freeze>/<thaw>").
+ *
+ * @param[in]  tl          The timeline.
+ * @param[in]  maxVolumes  Most file systems to list.
+ *
+ * @return The formatted timeline, to be freed with g_free().
+ */
+
+static gchar *
+VmBackupTimelineFormat(const VmBackupTimeline *tl,
+                       guint maxVolumes)
+{
+   GString *str = g_string_new(NULL);
+   guint i;
+
+   g_string_append_printf(str, "total=%"FMT64"d errors=%u",
+                          tl->totalUS, tl->errors);
+   for (i = 0; i < ARRAYSIZE(tl->stateUS); i++) {
+      if (tl->stateUS[i] != 0 && i != VMBACKUP_MSTATE_IDLE) {
+         g_string_append_printf(str, " %s=%"FMT64"d",
+                                VmBackupGetStateName(i), tl->stateUS[i]);
+      }
+   }
+   for (i = 0; i < tl->volumes->len && i < maxVolumes; i++) {
+      const VmBackupVolumeTimes *vol = &g_array_index(tl->volumes,
+                                                      VmBackupVolumeTimes, i);
+      g_string_append_printf(str, " vol:%s=%"FMT64"u/%"FMT64"u",
+                             vol->path, vol->freezeUS, vol->thawUS);
+   }
+   if (i < tl->volumes->len) {
+      g_string_append_printf(str, " more=%u", tl->volumes->len - i);
+   }
+
+   return g_string_free(str, FALSE);
+}
+
+
+/**
+ * Completes the timeline of the current backup operation: logs it, sends it
+ * to the host if configured to, and adds it to the history kept for the
+ * state dump.
+ */
+
+static void
+VmBackupTimelineFinish(void)
+{
+   VmBackupTimeline *tl = gTimeline;
+   gchar *desc;
+
+   if (tl == NULL) {
+      return;
+   }
+
+   VmBackupSetMachineState(gBackupState->machineState);
+   gTimeline = NULL;
+   tl->totalUS = tl->stateStartUS - tl->startUS;
+
+   desc = VmBackupTimelineFormat(tl, VMBACKUP_TIMELINE_MAX_EVENT_VOLUMES);
+   g_debug("Quiesce timeline (us): %s\n", desc);
+   if (tl->sendEvent) {
+      VmBackup_SendEvent(VMBACKUP_EVENT_REQUESTOR_TIMELINE,
+                         VMBACKUP_SUCCESS, desc);
+   }
+   g_free(desc);
+
+   if (gTimelineHistory == NULL) {
+      gTimelineHistory = g_queue_new();
+   }
+   g_queue_push_head(gTimelineHistory, tl);
+   while (g_queue_get_length(gTimelineHistory) > VMBACKUP_TIMELINE_HISTORY) {
+      VmBackupTimelineFree(g_queue_pop_tail(gTimelineHistory));
+   }
+}
+
+
+/**
+ * Records how long freezing and thawing a file system took in the timeline of
+ * the current backup operation. Must be called from the main thread.
+ *
+ * @param[in]  path        Mount point of the file system.
+ * @param[in]  freezeUS    Time spent freezing it.
+ * @param[in]  thawUS      Time spent thawing it.
+ * @param[in]  clientData  Unused.
+ */
+
+void
+VmBackup_RecordVolumeTimes(const char *path,
+                           uint64 freezeUS,
+                           uint64 thawUS,
+                           void *clientData)
+{
+   VmBackupVolumeTimes vol;
+
+   if (gTimeline == NULL) {
+      return;
+   }
+
+   vol.path = g_strdup(path);
+   vol.freezeUS = freezeUS;
+   vol.thawUS = thawUS;
+   g_array_append_val(gTimeline->volumes, vol);
+}
+
+
 /**
  * Sends a keep alive backup event to the VMX.
  *
@@ -273,7 +477,10 @@ VmBackup_SendEvent(const char *event,
    vm_free(result);
    g_free(msg);
 
-   gBackupState->keepAlive = g_timeout_source_new(VMBACKUP_KEEP_ALIVE_PERIOD / 2);
+   gBackupState->keepAlive =
+      VMTools_CreateCoalescedTimer("vmbackup-keepalive",
+                                   VMBACKUP_KEEP_ALIVE_PERIOD / 2,
+                                   VMBACKUP_KEEP_ALIVE_PERIOD / 10);
    VMTOOLSAPP_ATTACH_SOURCE(gBackupState->ctx,
                             gBackupState->keepAlive,
                             VmBackupKeepAliveCallback,
@@ -305,6 +512,7 @@ VmBackupFinalize(void)
    }
    g_static_mutex_unlock(&gBackupState->opLock);
 
+   VmBackupTimelineFinish();
    VmBackup_SendEvent(VMBACKUP_EVENT_REQUESTOR_DONE, VMBACKUP_SUCCESS, "");
 
    if (gBackupState->timerEvent != NULL) {
@@ -377,7 +585,7 @@ VmBackupStartScripts(VmBackupScriptType type)
       return FALSE;
    }
 
-   gBackupState->machineState = nextState;
+   VmBackupSetMachineState(nextState);
    return TRUE;
 }
 
@@ -393,12 +601,16 @@ VmBackupStartScripts(VmBackupScriptType type)
 static gboolean
 VmBackupOnError(void)
 {
+   if (gTimeline != NULL) {
+      gTimeline->errors++;
+   }
+
    switch (gBackupState->machineState) {
    case VMBACKUP_MSTATE_SCRIPT_FREEZE:
    case VMBACKUP_MSTATE_SYNC_ERROR:
       /* Next state is "script error". */
       if (!VmBackupStartScripts(VMBACKUP_SCRIPT_FREEZE_FAIL)) {
-         gBackupState->machineState = VMBACKUP_MSTATE_IDLE;
+         VmBackupSetMachineState(VMBACKUP_MSTATE_IDLE);
       }
       break;
 
@@ -407,7 +619,7 @@ VmBackupOnError(void)
    case VMBACKUP_MSTATE_SYNC_THAW:
       /* Next state is "sync error". */
       gBackupState->pollPeriod = 1000;
-      gBackupState->machineState = VMBACKUP_MSTATE_SYNC_ERROR;
+      VmBackupSetMachineState(VMBACKUP_MSTATE_SYNC_ERROR);
       g_signal_emit_by_name(gBackupState->ctx->serviceObj,
                             TOOLS_CORE_SIG_IO_FREEZE,
                             gBackupState->ctx,
@@ -417,7 +629,7 @@ VmBackupOnError(void)
    case VMBACKUP_MSTATE_SCRIPT_THAW:
    case VMBACKUP_MSTATE_COMPLETE_WAIT:
       /* Next state is "idle". */
-      gBackupState->machineState = VMBACKUP_MSTATE_IDLE;
+      VmBackupSetMachineState(VMBACKUP_MSTATE_IDLE);
       break;
 
    default:
@@ -665,7 +877,7 @@ VmBackupAsyncCallback(void *clientData)
    case VMBACKUP_MSTATE_SCRIPT_ERROR:
    case VMBACKUP_MSTATE_COMPLETE_WAIT:
       /* Next state is "idle". */
-      gBackupState->machineState = VMBACKUP_MSTATE_IDLE;
+      VmBackupSetMachineState(VMBACKUP_MSTATE_IDLE);
       break;
 
    case VMBACKUP_MSTATE_SYNC_ERROR:
@@ -692,6 +904,31 @@ exit:
 }
 
 
+/**
+ * Runs the state machine right away rather than at the end of the current
+ * poll period. Used by operations that get notified of their completion, so
+ * that the backup doesn't sit idle until the next poll. Must be called from
+ * the main thread.
+ */
+
+void
+VmBackup_PollNow(void)
+{
+   if (gBackupState == NULL || gBackupState->timerEvent == NULL) {
+      return;
+   }
+
+   g_source_destroy(gBackupState->timerEvent);
+   g_source_unref(gBackupState->timerEvent);
+   gBackupState->timerEvent = g_timeout_source_new(0);
+   VMTOOLSAPP_ATTACH_SOURCE(gBackupState->ctx,
+                            gBackupState->timerEvent,
+                            VmBackupAsyncCallback,
+                            NULL,
+                            NULL);
+}
+
+
 /**
  * Calls the sync provider's start function and moves the state
  * machine to next state.
@@ -743,11 +980,11 @@ VmBackupEnableSyncWait(void)
 
 #if defined(_WIN32)
    /* Move to next state */
-   gBackupState->machineState = VMBACKUP_MSTATE_SYNC_FREEZE;
+   VmBackupSetMachineState(VMBACKUP_MSTATE_SYNC_FREEZE);
 #else
    g_debug("Submitted backup start task.");
    /* Move to next state */
-   gBackupState->machineState = VMBACKUP_MSTATE_SYNC_FREEZE_WAIT;
+   VmBackupSetMachineState(VMBACKUP_MSTATE_SYNC_FREEZE_WAIT);
 #endif
 
    return TRUE;
@@ -769,7 +1006,7 @@ VmBackupEnableCompleteWait(void)
    g_debug("*** %s\n", __FUNCTION__);
 
    if (gBackupState->completer == NULL) {
-      gBackupState->machineState = VMBACKUP_MSTATE_IDLE;
+      VmBackupSetMachineState(VMBACKUP_MSTATE_IDLE);
       goto exit;
    }
 
@@ -797,7 +1034,7 @@ VmBackupEnableCompleteWait(void)
    if (gBackupState->completer->start(gBackupState,
                                       gBackupState->completer->clientData)) {
       /* Move to next state */
-      gBackupState->machineState = VMBACKUP_MSTATE_COMPLETE_WAIT;
+      VmBackupSetMachineState(VMBACKUP_MSTATE_COMPLETE_WAIT);
    } else {
       VmBackup_SendEvent(VMBACKUP_EVENT_REQUESTOR_ERROR,
                          VMBACKUP_SYNC_ERROR,
@@ -834,7 +1071,7 @@ VmBackupEnableSync(void)
    } else if (gBackupState->freezeStatus == VMBACKUP_FREEZE_CANCELED ||
               gBackupState->freezeStatus == VMBACKUP_FREEZE_FINISHED) {
       /* Move to next state */
-      gBackupState->machineState = VMBACKUP_MSTATE_SYNC_FREEZE;
+      VmBackupSetMachineState(VMBACKUP_MSTATE_SYNC_FREEZE);
    } else {
       ASSERT(gBackupState->freezeStatus == VMBACKUP_FREEZE_PENDING);
    }
@@ -945,13 +1182,37 @@ VmBackupStartCommon(RpcInData *data,
                                                              "enableNullDriver",
                                                              TRUE);
 
+   /*
+    * Optionally write out the dirty data of the file systems right before
+    * freezing them, while applications can still do I/O. The freeze then
+    * blocks them only for as long as it takes to write out what was dirtied
+    * meanwhile. With preFreezeMaxDirtyKB, flushing goes on until the dirty
+    * data drops below it, for at most preFreezeFlushTimeout seconds.
+    */
+   gBackupState->preFreezeFlush = VMBACKUP_CONFIG_GET_BOOL(ctx->config,
+                                                           "preFreezeFlush",
+                                                           FALSE);
+   gBackupState->preFreezeMaxDirtyKB =
+      MAX(0, VMBACKUP_CONFIG_GET_INT(ctx->config, "preFreezeMaxDirtyKB", 0));
+   gBackupState->preFreezeFlushTimeout =
+      MAX(0, VMBACKUP_CONFIG_GET_INT(ctx->config, "preFreezeFlushTimeout",
+                                     10));
+
+   /* How long (in seconds) each custom quiesce script may run; 0 for ever. */
+   gBackupState->scriptTimeout =
+      MAX(0, VMBACKUP_CONFIG_GET_INT(ctx->config, "scriptTimeout", 0));
+
    g_debug("Using quiesceApps = %d, quiesceFS = %d, allowHWProvider = %d,"
            " execScripts = %d, scriptArg = %s, timeout = %u,"
-           " enableNullDriver = %d, forceQuiesce = %d\n",
+           " enableNullDriver = %d, forceQuiesce = %d, preFreezeFlush = %d,"
+           " preFreezeMaxDirtyKB = %u, preFreezeFlushTimeout = %u,"
+           " scriptTimeout = %u\n",
            gBackupState->quiesceApps, gBackupState->quiesceFS,
            gBackupState->allowHWProvider, gBackupState->execScripts,
            (gBackupState->scriptArg != NULL) ? gBackupState->scriptArg : "",
-           gBackupState->timeout, gBackupState->enableNullDriver, forceQuiesce);
+           gBackupState->timeout, gBackupState->enableNullDriver, forceQuiesce,
+           gBackupState->preFreezeFlush, gBackupState->preFreezeMaxDirtyKB,
+           gBackupState->preFreezeFlushTimeout, gBackupState->scriptTimeout);
    g_debug("Quiescing volumes: %s",
            (gBackupState->volumes) ? gBackupState->volumes : "(null)");
 
@@ -963,6 +1224,7 @@ VmBackupStartCommon(RpcInData *data,
 
    VmBackup_SendEvent(VMBACKUP_EVENT_RESET, VMBACKUP_SUCCESS, "");
 
+   VmBackupTimelineStart(ctx);
    if (!VmBackupStartScripts(VMBACKUP_SCRIPT_FREEZE)) {
       goto error;
    }
@@ -1000,6 +1262,10 @@ VmBackupStartCommon(RpcInData *data,
    return RPCIN_SETRETVALS(data, "", TRUE);
 
 error:
+   if (gTimeline != NULL) {
+      VmBackupTimelineFree(gTimeline);
+      gTimeline = NULL;
+   }
    if (gBackupState->keepAlive != NULL) {
       g_source_destroy(gBackupState->keepAlive);
       g_source_unref(gBackupState->keepAlive);
@@ -1243,7 +1509,7 @@ VmBackupSnapshotDone(RpcInData *data)
             VmBackupFinalize();
          }
       } else {
-         gBackupState->machineState = VMBACKUP_MSTATE_SYNC_THAW;
+         VmBackupSetMachineState(VMBACKUP_MSTATE_SYNC_THAW);
       }
       return RPCIN_SETRETVALS(data, "", TRUE);
    }
@@ -1302,6 +1568,9 @@ VmBackupDumpState(gpointer src,
                   ToolsAppCtx *ctx,
                   gpointer data)
 {
+   GList *l;
+   VmTimeType now = Hostinfo_SystemTimerUS();
+
    if (gBackupState == NULL) {
       ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN, "Backup is idle.\n");
    } else {
@@ -1309,6 +1578,18 @@ VmBackupDumpState(gpointer src,
                          "Backup is in state: %s\n",
                          VmBackupGetStateName(gBackupState->machineState));
    }
+
+   for (l = gTimelineHistory != NULL ? gTimelineHistory->head : NULL;
+        l != NULL;
+        l = l->next) {
+      const VmBackupTimeline *tl = l->data;
+      gchar *desc = VmBackupTimelineFormat(tl, G_MAXUINT);
+
+      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                         "Backup started %"FMT64"ds ago (us): %s\n",
+                         (now - tl->startUS) / (1000 * 1000), desc);
+      g_free(desc);
+   }
 }
 
 
@@ -1345,6 +1626,15 @@ VmBackupShutdown(gpointer src,
    if (gBackupState != NULL) {
       VmBackupFinalize();
    }
+   if (gTimelineHistory != NULL) {
+      VmBackupTimeline *tl;
+
+      while ((tl = g_queue_pop_head(gTimelineHistory)) != NULL) {
+         VmBackupTimelineFree(tl);
+      }
+      g_queue_free(gTimelineHistory);
+      gTimelineHistory = NULL;
+   }
 }
 
 
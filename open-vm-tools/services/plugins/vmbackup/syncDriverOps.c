@@ -48,8 +48,8 @@ typedef struct VmBackupDriverOp {
  *
  * VmBackupDriverThaw --
  *
- *    Thaws the frozen filesystems, and cleans up internal state kept by the
- *    code.
+ *    Thaws the frozen filesystems, records how long freezing and thawing
+ *    each of them took, and cleans up internal state kept by the code.
  *
  * Results:
  *    Whether thawing was successful.
@@ -64,6 +64,9 @@ static Bool
 VmBackupDriverThaw(SyncDriverHandle *handle)
 {
    Bool success = SyncDriver_Thaw(*handle);
+#if !defined(_WIN32)
+   SyncDriver_GetVolumeTimes(*handle, VmBackup_RecordVolumeTimes, NULL);
+#endif
    SyncDriver_CloseHandle(handle);
    return success;
 }
@@ -226,6 +229,14 @@ VmBackupNewDriverOp(VmBackupState *state,       // IN
    *op->syncHandle = (handle != NULL) ? *handle : SYNCDRIVER_INVALID_HANDLE;
 
    if (freeze) {
+#if !defined(_WIN32)
+      if (state->preFreezeFlush &&
+          !SyncDriver_Flush(op->volumes, state->preFreezeMaxDirtyKB,
+                            state->preFreezeFlushTimeout * 1000)) {
+         /* Not fatal: the freeze writes out whatever is left. */
+         g_debug("Flushing filesystems before freezing was incomplete.\n");
+      }
+#endif
       success = SyncDriver_Freeze(op->volumes,
                                   useNullDriverPrefs ?
                                   state->enableNullDriver : FALSE,
@@ -120,8 +120,12 @@ typedef struct VmBackupState {
    Bool           allowHWProvider;
    Bool           execScripts;
    Bool           enableNullDriver;
+   Bool           preFreezeFlush;
+   guint          preFreezeMaxDirtyKB;
+   guint          preFreezeFlushTimeout;  // seconds
    Bool           needsPriv;
    gchar         *scriptArg;
+   guint          scriptTimeout;  // seconds, 0 for none
    guint          timeout;
    gpointer       clientData;
    void          *scripts;
@@ -294,5 +298,14 @@ VmBackup_SendEvent(const char *event,
                    const uint32 code,
                    const char *desc);
 
+void
+VmBackup_PollNow(void);
+
+void
+VmBackup_RecordVolumeTimes(const char *path,
+                           uint64 freezeUS,
+                           uint64 thawUS,
+                           void *clientData);
+
 #endif /* _VMBACKUPINT_H_*/
 
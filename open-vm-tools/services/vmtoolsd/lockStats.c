@@ -0,0 +1,298 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file lockStats.c
+ *
+ * Lock contention profiling. When turned on, with the "lockStats" key in the
+ * service's config section or the "lockStats" Set_Option, the MXUser locks in
+ * the process (HGFS server, poll loop, file library, ...) collect acquisition
+ * and held time statistics, and the state dump lists the most contended ones.
+ * Locks with the same name, such as the per-session HGFS locks, are reported
+ * together.
+ */
+
+#include <string.h>
+#include "vmware.h"
+#include "toolsCoreInt.h"
+#include "userlock.h"
+#include "vmware/guestrpc/tclodefs.h"
+
+/* Number of locks listed in the state dump. */
+#define LOCKSTATS_TOP_LOCKS         10
+
+/* Shorter waits don't count as contention. */
+#define LOCKSTATS_CONTENTION_NS     1000
+
+/* Line length of the raw MXUser statistics, see MXUser_SetStatsFunc. */
+#define LOCKSTATS_LINE_LENGTH       1024
+
+/* Statistics of the locks with a given name. */
+typedef struct LockStatsEntry {
+   gchar            *name;
+   guint             count;
+   MXUserLockStats   stats;
+} LockStatsEntry;
+
+static gboolean gLockStatsEnabled = FALSE;
+
+
+/**
+ * Writes the raw MXUser statistics lines (MXUser_PerLockData) to the debug
+ * log.
+ *
+ * @param[in]  context  Unused.
+ * @param[in]  fmt      Format string.
+ * @param[in]  args     Format arguments.
+ */
+
+static void
+ToolsCoreLockStatsLog(void *context,
+                      const char *fmt,
+                      va_list args)
+{
+   g_logv(G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, fmt, args);
+}
+
+
+/**
+ * Turns lock statistics on or off. Locks that already collect statistics
+ * keep doing so when they are turned off (the MXUser library can't take them
+ * away from live locks), but new locks don't, and nothing is reported.
+ *
+ * @param[in]  enable   Whether to collect lock statistics.
+ */
+
+void
+ToolsCoreLockStats_Enable(gboolean enable)
+{
+   if (enable == gLockStatsEnabled) {
+      return;
+   }
+
+   if (enable) {
+      /* Only the contention duration floor matters; locks never go "hot". */
+      MXUser_StatisticsControl(1.0, 0, LOCKSTATS_CONTENTION_NS);
+      MXUser_SetStatsFunc(NULL, LOCKSTATS_LINE_LENGTH, TRUE,
+                          ToolsCoreLockStatsLog);
+      MXUser_EnableStatsAllLocks();
+   } else {
+      MXUser_SetStatsFunc(NULL, 0, FALSE, NULL);
+   }
+
+   gLockStatsEnabled = enable;
+   g_message("Lock statistics %s.\n", enable ? "enabled" : "disabled");
+}
+
+
+/**
+ * Handles the "lockStats" Set_Option: "1" turns lock statistics on, "0"
+ * turns them off.
+ *
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      The application context.
+ * @param[in]  option   Option name.
+ * @param[in]  value    Option value.
+ * @param[in]  data     Unused.
+ *
+ * @return Whether the option was handled.
+ */
+
+gboolean
+ToolsCoreLockStats_SetOption(gpointer src,
+                             ToolsAppCtx *ctx,
+                             const gchar *option,
+                             const gchar *value,
+                             gpointer data)
+{
+   if (strcmp(option, TOOLSOPTION_LOCK_STATS) != 0) {
+      return FALSE;
+   }
+
+   if (strcmp(value, "0") != 0 && strcmp(value, "1") != 0) {
+      return FALSE;
+   }
+
+   ToolsCoreLockStats_Enable(strcmp(value, "1") == 0);
+   return TRUE;
+}
+
+
+/**
+ * Adds the statistics of a lock to those of the locks with the same name.
+ * Called with the MXUser lock list locked.
+ *
+ * @param[in]  clientData  Hash table of LockStatsEntry by name.
+ * @param[in]  stats       Statistics of the lock.
+ */
+
+static void
+ToolsCoreLockStatsCollect(void *clientData,
+                          const MXUserLockStats *stats)
+{
+   GHashTable *locks = clientData;
+   LockStatsEntry *entry = g_hash_table_lookup(locks, stats->name);
+   guint i;
+
+   if (entry == NULL) {
+      entry = g_new0(LockStatsEntry, 1);
+      entry->name = g_strdup(stats->name);
+      entry->stats = *stats;
+      entry->stats.name = entry->name;
+      g_hash_table_insert(locks, entry->name, entry);
+   } else {
+      entry->stats.numAttempts += stats->numAttempts;
+      entry->stats.numSuccesses += stats->numSuccesses;
+      entry->stats.numContended += stats->numContended;
+      entry->stats.contentionTime += stats->contentionTime;
+      entry->stats.maxWaitTime = MAX(entry->stats.maxWaitTime,
+                                     stats->maxWaitTime);
+      for (i = 0; i < MXUSER_WAIT_HISTO_BUCKETS; i++) {
+         entry->stats.waitHisto[i] += stats->waitHisto[i];
+      }
+      entry->stats.numHeld += stats->numHeld;
+      entry->stats.heldTime += stats->heldTime;
+      entry->stats.maxHeldTime = MAX(entry->stats.maxHeldTime,
+                                     stats->maxHeldTime);
+   }
+   entry->count++;
+}
+
+
+/**
+ * Orders lock statistics by decreasing time spent waiting for the lock, then
+ * by decreasing number of contended acquisitions.
+ *
+ * @param[in]  a     Pointer to the first LockStatsEntry pointer.
+ * @param[in]  b     Pointer to the second LockStatsEntry pointer.
+ *
+ * @return The comparison result.
+ */
+
+static gint
+ToolsCoreLockStatsCompare(gconstpointer a,
+                          gconstpointer b)
+{
+   const MXUserLockStats *sa = &(*(LockStatsEntry * const *) a)->stats;
+   const MXUserLockStats *sb = &(*(LockStatsEntry * const *) b)->stats;
+
+   if (sa->contentionTime != sb->contentionTime) {
+      return sa->contentionTime > sb->contentionTime ? -1 : 1;
+   }
+   if (sa->numContended != sb->numContended) {
+      return sa->numContended > sb->numContended ? -1 : 1;
+   }
+   return 0;
+}
+
+
+/**
+ * Frees a LockStatsEntry.
+ *
+ * @param[in]  data     The entry.
+ */
+
+static void
+ToolsCoreLockStatsFree(gpointer data)
+{
+   LockStatsEntry *entry = data;
+
+   g_free(entry->name);
+   g_free(entry);
+}
+
+
+/**
+ * Logs the most contended locks: how often they were acquired and had to
+ * wait, how long the waits were, and how long the locks were held.
+ */
+
+void
+ToolsCoreLockStats_DumpState(void)
+{
+   static const char *bucketNames[] = {
+      "<1us", "<10us", "<100us", "<1ms", "<10ms", "<100ms", "<1s", ">=1s"
+   };
+   GHashTable *locks;
+   GPtrArray *sorted;
+   GHashTableIter iter;
+   gpointer value;
+   guint i;
+
+   ASSERT_ON_COMPILE(ARRAYSIZE(bucketNames) == MXUSER_WAIT_HISTO_BUCKETS);
+
+   if (!gLockStatsEnabled) {
+      return;
+   }
+
+   locks = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                 NULL, ToolsCoreLockStatsFree);
+   MXUser_ForEachLockStats(ToolsCoreLockStatsCollect, locks);
+
+   sorted = g_ptr_array_sized_new(g_hash_table_size(locks));
+   g_hash_table_iter_init(&iter, locks);
+   while (g_hash_table_iter_next(&iter, NULL, &value)) {
+      g_ptr_array_add(sorted, value);
+   }
+   g_ptr_array_sort(sorted, ToolsCoreLockStatsCompare);
+
+   ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                      "Lock statistics: %u lock names, most contended:\n",
+                      sorted->len);
+
+   for (i = 0; i < sorted->len && i < LOCKSTATS_TOP_LOCKS; i++) {
+      LockStatsEntry *entry = g_ptr_array_index(sorted, i);
+      MXUserLockStats *stats = &entry->stats;
+      GString *histo;
+      guint j;
+
+      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                         "%s (%u): %"FMT64"u acquired, %"FMT64"u contended "
+                         "(%.2f%%), wait %"FMT64"u us max %"FMT64"u us, "
+                         "held avg %"FMT64"u us max %"FMT64"u us\n",
+                         entry->name, entry->count,
+                         stats->numSuccesses, stats->numContended,
+                         100.0 * stats->numContended /
+                            MAX(stats->numSuccesses, 1),
+                         stats->contentionTime / 1000,
+                         stats->maxWaitTime / 1000,
+                         stats->heldTime / MAX(stats->numHeld, 1) / 1000,
+                         stats->maxHeldTime / 1000);
+
+      if (stats->numContended == 0) {
+         continue;
+      }
+
+      histo = g_string_new(NULL);
+      for (j = 0; j < MXUSER_WAIT_HISTO_BUCKETS; j++) {
+         if (stats->waitHisto[j] != 0) {
+            g_string_append_printf(histo, " %s:%"FMT64"u",
+                                   bucketNames[j], stats->waitHisto[j]);
+         }
+      }
+      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                         "%s waits:%s\n", entry->name, histo->str);
+      g_string_free(histo, TRUE);
+   }
+
+   g_ptr_array_free(sorted, TRUE);
+   g_hash_table_destroy(locks);
+
+   /* The raw per-lock data goes to the debug log. */
+   MXUser_PerLockData();
+}
@@ -29,9 +29,17 @@
 #endif
 
 #include <stdlib.h>
+#if defined(__linux__)
+#  include <errno.h>
+#  include <string.h>
+#  include <sys/inotify.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
 #include "toolsCoreInt.h"
 #include "conf.h"
 #include "guestApp.h"
+#include "hostinfo.h"
 #include "serviceObj.h"
 #include "system.h"
 #include "util.h"
@@ -43,6 +51,21 @@
 #include "vmware/tools/utils.h"
 #include "vmware/tools/vmbackup.h"
 
+/* AsyncSocket is only built where the vsock RPC channel is used. */
+#if (defined(__linux__) && !defined(USERWORLD)) || defined(_WIN32)
+#  define TOOLSCORE_HAVE_ASYNCSOCKET
+#  include "asyncsocket.h"
+#endif
+
+/* Max. number of entries in the startup timeline. */
+#define TOOLSCORE_TIMELINE_MAX 128
+
+/* An entry in the startup timeline. */
+typedef struct ToolsStartupMark {
+   VmTimeType     time;
+   gchar         *what;
+} ToolsStartupMark;
+
 /*
  ******************************************************************************
  * ToolsCoreCleanup --                                                  */ /**
@@ -60,6 +83,15 @@ ToolsCoreCleanup(ToolsServiceState *state)
 {
    ToolsCorePool_Shutdown(&state->ctx);
    ToolsCore_UnloadPlugins(state);
+   ToolsCoreMemBudget_Shutdown(&state->ctx);
+   if (state->timeline != NULL) {
+      guint i;
+      for (i = 0; i < state->timeline->len; i++) {
+         g_free(g_array_index(state->timeline, ToolsStartupMark, i).what);
+      }
+      g_array_free(state->timeline, TRUE);
+      state->timeline = NULL;
+   }
 #if defined(__linux__)
    if (state->mainService) {
       ToolsCore_ReleaseVsockFamily(state);
@@ -70,6 +102,18 @@ ToolsCoreCleanup(ToolsServiceState *state)
       RpcChannel_Destroy(state->ctx.rpc);
       state->ctx.rpc = NULL;
    }
+   if (state->configCheckTask != 0) {
+      g_source_remove(state->configCheckTask);
+      state->configCheckTask = 0;
+   }
+#if defined(__linux__)
+   if (state->configWatch != NULL) {
+      g_io_channel_unref(state->configWatch);
+      state->configWatch = NULL;
+   }
+   g_free(state->configWatchName);
+   state->configWatchName = NULL;
+#endif
    g_key_file_free(state->ctx.config);
    g_main_loop_unref(state->ctx.mainLoop);
 
@@ -146,6 +190,196 @@ ToolsCoreConfFileCb(gpointer clientData)
 }
 
 
+/**
+ * Starts polling the config file every CONF_POLL_TIME seconds, sharing
+ * wakeups with the other periodic tasks of the service.
+ *
+ * @param[in]  state    Service state.
+ *
+ * @return ID of the event source.
+ */
+
+static guint
+ToolsCoreAddConfPollTimer(ToolsServiceState *state)
+{
+   GSource *src = VMTools_CreateCoalescedTimer("config-poll",
+                                               CONF_POLL_TIME * 1000,
+                                               1000);
+   guint id;
+
+   g_source_set_callback(src, ToolsCoreConfFileCb, state, NULL);
+   id = g_source_attach(src, g_main_loop_get_context(state->ctx.mainLoop));
+   g_source_unref(src);
+
+   return id;
+}
+
+
+#if defined(__linux__)
+/**
+ * Sets up an inotify watch on the directory holding the config file, so
+ * that edits are picked up without polling. The directory is watched rather
+ * than the file since editors and package managers usually replace the file
+ * by renaming a new one over it.
+ *
+ * A config file that is a symlink is left to the poll timer, since changes
+ * to the link target would not be seen.
+ *
+ * @param[in]  state    Service state.
+ *
+ * @return An I/O channel for the inotify instance, or NULL if the file can't
+ *         be watched.
+ */
+
+static GIOChannel *
+ToolsCoreOpenConfWatch(ToolsServiceState *state)
+{
+   GIOChannel *chan = NULL;
+   gchar *path;
+   gchar *dir;
+   struct stat st;
+   int fd;
+
+   if (state->configFile != NULL) {
+      path = g_strdup(state->configFile);
+   } else {
+      char *confPath = GuestApp_GetConfPath();
+
+      if (confPath == NULL) {
+         return NULL;
+      }
+      path = g_build_filename(confPath, CONF_FILE, NULL);
+      free(confPath);
+   }
+
+   if (lstat(path, &st) == 0 && S_ISLNK(st.st_mode)) {
+      g_debug("Config file %s is a symlink, polling for changes.\n", path);
+      g_free(path);
+      return NULL;
+   }
+
+   fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (fd == -1) {
+      g_debug("inotify_init1 failed: %s\n", g_strerror(errno));
+      g_free(path);
+      return NULL;
+   }
+
+   dir = g_path_get_dirname(path);
+   if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO |
+                                  IN_MOVED_FROM | IN_DELETE |
+                                  IN_DELETE_SELF | IN_MOVE_SELF |
+                                  IN_ONLYDIR) == -1) {
+      g_debug("Cannot watch %s: %s\n", dir, g_strerror(errno));
+      close(fd);
+   } else {
+      g_free(state->configWatchName);
+      state->configWatchName = g_path_get_basename(path);
+      chan = g_io_channel_unix_new(fd);
+      g_io_channel_set_close_on_unref(chan, TRUE);
+   }
+
+   g_free(dir);
+   g_free(path);
+   return chan;
+}
+
+
+/**
+ * I/O callback for the config file's inotify watch. Reloads the config file
+ * when it was written, replaced or removed. If the watched directory itself
+ * goes away, falls back to polling.
+ *
+ * @param[in]  chan        The inotify channel.
+ * @param[in]  cond        Unused.
+ * @param[in]  clientData  Service state.
+ *
+ * @return Whether to keep the watch.
+ */
+
+static gboolean
+ToolsCoreConfWatchCb(GIOChannel *chan,
+                     GIOCondition cond,
+                     gpointer clientData)
+{
+   ToolsServiceState *state = clientData;
+   char buf[4096]
+      __attribute__ ((aligned(__alignof__(struct inotify_event))));
+   gboolean changed = FALSE;
+   gboolean lost = FALSE;
+   ssize_t len;
+
+   while ((len = read(g_io_channel_unix_get_fd(chan), buf, sizeof buf)) > 0) {
+      char *p = buf;
+
+      while (p < buf + len) {
+         const struct inotify_event *ev = (const struct inotify_event *) p;
+
+         if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+            lost = TRUE;
+         } else if ((ev->mask & IN_Q_OVERFLOW) ||
+                    (ev->len > 0 &&
+                     strcmp(ev->name, state->configWatchName) == 0)) {
+            changed = TRUE;
+         }
+         p += sizeof *ev + ev->len;
+      }
+   }
+
+   if (len == -1 && errno != EAGAIN && errno != EINTR) {
+      g_warning("Error reading config file events: %s\n", g_strerror(errno));
+      lost = TRUE;
+   }
+
+   if (changed || lost) {
+      /*
+       * The modification time has a one second granularity, so force the
+       * file to be read; unchanged contents don't reach the plugins.
+       */
+      state->configMtime = 0;
+      ToolsCore_ReloadConfig(state, FALSE);
+   }
+
+   if (lost) {
+      g_message("Lost the config file watch, polling for changes.\n");
+      g_io_channel_unref(state->configWatch);
+      state->configWatch = NULL;
+      state->configCheckTask = ToolsCoreAddConfPollTimer(state);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+#endif
+
+
+/**
+ * Starts watching the config file for changes: with inotify where
+ * available, or else by polling it every CONF_POLL_TIME seconds.
+ *
+ * @param[in]  state    Service state.
+ *
+ * @return ID of the event source.
+ */
+
+static guint
+ToolsCoreStartConfCheck(ToolsServiceState *state)
+{
+#if defined(__linux__)
+   if (state->configWatch == NULL) {
+      state->configWatch = ToolsCoreOpenConfWatch(state);
+   }
+   if (state->configWatch != NULL) {
+      return g_io_add_watch(state->configWatch,
+                            G_IO_IN | G_IO_ERR | G_IO_HUP,
+                            ToolsCoreConfWatchCb,
+                            state);
+   }
+#endif
+   return ToolsCoreAddConfPollTimer(state);
+}
+
+
 /**
  * IO freeze signal handler. Disables the conf file check task if I/O is
  * frozen, re-enable it otherwise. See bug 529653.
@@ -168,13 +402,27 @@ ToolsCoreIOFreezeCb(gpointer src,
       VMTools_SuspendLogIO();
    } else if (state->configCheckTask == 0 && !freeze) {
       VMTools_ResumeLogIO();
-      state->configCheckTask = g_timeout_add(CONF_POLL_TIME * 1000,
-                                             ToolsCoreConfFileCb,
-                                             state);
+      state->configCheckTask = ToolsCoreStartConfCheck(state);
    }
 }
 
 
+/**
+ * Idle callback that records the main loop's first iteration.
+ *
+ * @param[in]  clientData  Service state.
+ *
+ * @return FALSE.
+ */
+
+static gboolean
+ToolsCoreMainLoopRunning(gpointer clientData)
+{
+   ToolsCore_MarkStartup(clientData, "main loop running");
+   return FALSE;
+}
+
+
 /*
  ******************************************************************************
  * ToolsCoreRunLoop --                                                  */ /**
@@ -202,10 +450,12 @@ ToolsCoreRunLoop(ToolsServiceState *state)
    if (state->ctx.rpc && !RpcChannel_Start(state->ctx.rpc)) {
       return 1;
    }
+   ToolsCore_MarkStartup(state, "RPC channel started");
 
    if (!ToolsCore_LoadPlugins(state)) {
       return 1;
    }
+   ToolsCore_MarkStartup(state, "plugins loaded");
 
 #if defined(__linux__)
    /*
@@ -231,6 +481,7 @@ ToolsCoreRunLoop(ToolsServiceState *state)
         ToolsCore_GetTcloName(state) == NULL ||
         state->debugPlugin != NULL)) {
       ToolsCore_RegisterPlugins(state);
+      ToolsCore_MarkStartup(state, "plugins registered");
 
       /*
        * Listen for the I/O freeze signal. We have to disable the config file
@@ -245,9 +496,14 @@ ToolsCoreRunLoop(ToolsServiceState *state)
                           state);
       }
 
-      state->configCheckTask = g_timeout_add(CONF_POLL_TIME * 1000,
-                                             ToolsCoreConfFileCb,
-                                             state);
+      state->configCheckTask = ToolsCoreStartConfCheck(state);
+
+      g_signal_connect(state->ctx.serviceObj,
+                       TOOLS_CORE_SIG_SET_OPTION,
+                       G_CALLBACK(ToolsCoreLockStats_SetOption),
+                       NULL);
+
+      g_idle_add(ToolsCoreMainLoopRunning, state);
 
 #if defined(__APPLE__)
       ToolsCore_CFRunLoop(state);
@@ -261,6 +517,119 @@ ToolsCoreRunLoop(ToolsServiceState *state)
 }
 
 
+#if defined(TOOLSCORE_HAVE_ASYNCSOCKET)
+/*
+ ******************************************************************************
+ * ToolsCoreDumpAsyncSocketStats --                                     */ /**
+ *
+ * Logs the I/O statistics summed over the service's AsyncSockets (the vsock
+ * RPC channels and any plugin connections).
+ *
+ ******************************************************************************
+ */
+
+static void
+ToolsCoreDumpAsyncSocketStats(void)
+{
+   AsyncSocketStats stats;
+   uint64 callbacks;
+   int i;
+
+   AsyncSocket_GetGlobalStats(&stats);
+   callbacks = MAX(stats.callbacks, 1);
+
+   ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                      "AsyncSocket: sent %"FMT64"u bytes in %"FMT64"u msgs, "
+                      "received %"FMT64"u bytes in %"FMT64"u msgs\n",
+                      stats.bytesSent, stats.msgsSent,
+                      stats.bytesRecv, stats.msgsRecv);
+   ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                      "send queue max %u buffers, %"FMT64"u bytes; "
+                      "send buffer full %"FMT64"u ms\n",
+                      stats.sendQueueLenMax, stats.sendQueueBytesMax,
+                      stats.sendBufFullTime / 1000);
+   ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                      "%"FMT64"u callbacks, avg %"FMT64"u max %"FMT64"u us\n",
+                      stats.callbacks, stats.callbackTime / callbacks,
+                      stats.callbackTimeMax);
+
+   for (i = 0; i < ASOCKERR_COUNT; i++) {
+      if (stats.errors[i] != 0) {
+         ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                            "error '%s': %"FMT64"u\n",
+                            AsyncSocket_Err2String(i), stats.errors[i]);
+      }
+   }
+}
+#endif
+
+
+/*
+ ******************************************************************************
+ * ToolsCoreDumpTimerStatsCb --                                         */ /**
+ *
+ * Logs the accounting data of one coalesced timer.
+ *
+ * @param[in]  stats    The timer's statistics.
+ * @param[in]  data     Unused.
+ *
+ ******************************************************************************
+ */
+
+static void
+ToolsCoreDumpTimerStatsCb(const VMToolsTimerStats *stats,
+                          gpointer data)
+{
+   guint64 fired = MAX(stats->fired, 1);
+
+   ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                      "%s: every %u ms (slack %u ms), fired %"FMT64"u times, "
+                      "late avg %"FMT64"u ms, cost avg %"FMT64"u max "
+                      "%"FMT64"u us, total %"FMT64"u ms\n",
+                      stats->name, stats->interval, stats->slack,
+                      stats->fired, stats->totalDelayMS / fired,
+                      stats->totalUS / fired, stats->maxUS,
+                      stats->totalUS / 1000);
+}
+
+
+/*
+ ******************************************************************************
+ * ToolsCoreDumpRpcStatsCb --                                           */ /**
+ *
+ * Logs the dispatch statistics of one incoming RPC command.
+ *
+ * @param[in]  stats    The command's statistics.
+ * @param[in]  data     Unused.
+ *
+ ******************************************************************************
+ */
+
+static void
+ToolsCoreDumpRpcStatsCb(const RpcChannelCmdStats *stats,
+                        gpointer data)
+{
+   guint64 count = MAX(stats->count, 1);
+
+   ASSERT_ON_COMPILE(RPCCHANNEL_STATS_BUCKETS == 6);
+
+   ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                      "%s: %"FMT64"u calls, %"FMT64"u errors, cost avg "
+                      "%"FMT64"u max %"FMT64"u us (<1ms %"FMT64"u, "
+                      "<10ms %"FMT64"u, <100ms %"FMT64"u, <1s %"FMT64"u, "
+                      "<10s %"FMT64"u, more %"FMT64"u), reply avg %"FMT64"u "
+                      "max %"FMT64"u bytes, queued avg %"FMT64"u max "
+                      "%"FMT64"u ms\n",
+                      stats->name, stats->count, stats->errors,
+                      stats->totalUS / count, stats->maxUS,
+                      stats->histogram[0], stats->histogram[1],
+                      stats->histogram[2], stats->histogram[3],
+                      stats->histogram[4], stats->histogram[5],
+                      stats->replyBytes / count, stats->maxReplyBytes,
+                      stats->totalQueueMS / count, stats->maxQueueMS);
+}
+
+
 /**
  * Logs some information about the runtime state of the service: loaded
  * plugins, registered GuestRPC callbacks, etc. Also fires a signal so
@@ -308,6 +677,20 @@ ToolsCore_DumpState(ToolsServiceState *state)
       }
    }
 
+   ToolsCorePool_DumpState();
+   ToolsCoreMemBudget_DumpState();
+   ToolsCoreLockStats_DumpState();
+#if defined(TOOLSCORE_HAVE_ASYNCSOCKET)
+   ToolsCoreDumpAsyncSocketStats();
+#endif
+   ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER, "Periodic timers:\n");
+   VMTools_ForEachTimerStats(ToolsCoreDumpTimerStatsCb, NULL);
+   if (state->ctx.rpc != NULL) {
+      ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER, "Incoming RPCs:\n");
+      RpcChannel_ForEachCmdStats(state->ctx.rpc, ToolsCoreDumpRpcStatsCb,
+                                 NULL);
+   }
+   ToolsCore_DumpStartup(state);
    ToolsCore_DumpPluginInfo(state);
 
    g_signal_emit_by_name(state->ctx.serviceObj,
@@ -316,6 +699,79 @@ ToolsCore_DumpState(ToolsServiceState *state)
 }
 
 
+/**
+ * Adds an entry to the service's startup timeline. Entries are also logged
+ * as they are recorded, with the time since the first one.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  fmt      Format string describing the event.
+ */
+
+void
+ToolsCore_MarkStartup(ToolsServiceState *state,
+                      const gchar *fmt,
+                      ...)
+{
+   ToolsStartupMark mark;
+   va_list args;
+
+   if (state->timeline == NULL) {
+      state->timeline = g_array_new(FALSE, TRUE, sizeof (ToolsStartupMark));
+   }
+
+   if (state->timeline->len >= TOOLSCORE_TIMELINE_MAX) {
+      return;
+   }
+
+   va_start(args, fmt);
+   mark.what = g_strdup_vprintf(fmt, args);
+   va_end(args);
+   mark.time = Hostinfo_SystemTimerUS();
+   g_array_append_val(state->timeline, mark);
+
+   g_debug("Startup: +%"G_GINT64_FORMAT" ms: %s\n",
+           (gint64) (mark.time -
+                     g_array_index(state->timeline, ToolsStartupMark, 0).time) /
+           1000,
+           mark.what);
+}
+
+
+/**
+ * Logs the service's startup timeline: the time of each entry since the
+ * first one, and since the entry before it.
+ *
+ * @param[in]  state    The service state.
+ */
+
+void
+ToolsCore_DumpStartup(ToolsServiceState *state)
+{
+   guint i;
+   VmTimeType start;
+   VmTimeType prev;
+
+   if (state->timeline == NULL || state->timeline->len == 0) {
+      return;
+   }
+
+   ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER, "Startup timeline:\n");
+
+   start = prev = g_array_index(state->timeline, ToolsStartupMark, 0).time;
+   for (i = 0; i < state->timeline->len; i++) {
+      ToolsStartupMark *mark = &g_array_index(state->timeline,
+                                              ToolsStartupMark, i);
+      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                         "+%"G_GINT64_FORMAT" ms (+%"G_GINT64_FORMAT" ms): "
+                         "%s\n",
+                         (gint64) (mark->time - start) / 1000,
+                         (gint64) (mark->time - prev) / 1000,
+                         mark->what);
+      prev = mark->time;
+   }
+}
+
+
 /**
  * Returns the name of the TCLO app name. This will only return non-NULL
  * if the service is either the tools "guestd" or "userd" service.
@@ -338,6 +794,88 @@ ToolsCore_GetTcloName(ToolsServiceState *state)
 }
 
 
+/**
+ * Returns whether a config group has the same keys and values in both
+ * dictionaries.
+ *
+ * @param[in]  a        A config dictionary.
+ * @param[in]  b        Another config dictionary.
+ * @param[in]  group    Name of a group present in @a b.
+ *
+ * @return TRUE if the group is the same in both.
+ */
+
+static gboolean
+ToolsCoreConfGroupEqual(GKeyFile *a,
+                        GKeyFile *b,
+                        const gchar *group)
+{
+   gchar **keys;
+   gsize numKeys;
+   gsize numKeysA = 0;
+   gsize i;
+   gboolean equal;
+
+   if (!g_key_file_has_group(a, group)) {
+      return FALSE;
+   }
+
+   g_strfreev(g_key_file_get_keys(a, group, &numKeysA, NULL));
+   keys = g_key_file_get_keys(b, group, &numKeys, NULL);
+   equal = keys != NULL && numKeys == numKeysA;
+
+   for (i = 0; equal && i < numKeys; i++) {
+      gchar *valueA = g_key_file_get_value(a, group, keys[i], NULL);
+      gchar *valueB = g_key_file_get_value(b, group, keys[i], NULL);
+
+      equal = g_strcmp0(valueA, valueB) == 0;
+      g_free(valueA);
+      g_free(valueB);
+   }
+
+   g_strfreev(keys);
+   return equal;
+}
+
+
+/**
+ * Lists the config groups that were added, removed or modified between two
+ * versions of the config dictionary.
+ *
+ * @param[in]  oldConf  The previous config dictionary.
+ * @param[in]  newConf  The new config dictionary.
+ *
+ * @return Array of group names; the caller frees the names and the array.
+ */
+
+static GPtrArray *
+ToolsCoreConfChangedGroups(GKeyFile *oldConf,
+                           GKeyFile *newConf)
+{
+   GPtrArray *changed = g_ptr_array_new();
+   gchar **groups;
+   guint i;
+
+   groups = g_key_file_get_groups(newConf, NULL);
+   for (i = 0; groups[i] != NULL; i++) {
+      if (!ToolsCoreConfGroupEqual(oldConf, newConf, groups[i])) {
+         g_ptr_array_add(changed, g_strdup(groups[i]));
+      }
+   }
+   g_strfreev(groups);
+
+   groups = g_key_file_get_groups(oldConf, NULL);
+   for (i = 0; groups[i] != NULL; i++) {
+      if (!g_key_file_has_group(newConf, groups[i])) {
+         g_ptr_array_add(changed, g_strdup(groups[i]));
+      }
+   }
+   g_strfreev(groups);
+
+   return changed;
+}
+
+
 /**
  * Reloads the config file and re-configure the logging subsystem if the
  * log file was updated. If the config file is being loaded for the first
@@ -354,22 +892,64 @@ ToolsCore_ReloadConfig(ToolsServiceState *state,
 {
    gboolean first = state->ctx.config == NULL;
    gboolean loaded;
+   GKeyFile *config = NULL;
+
+   if (first) {
+      ToolsCore_MarkStartup(state, "loading config");
+   }
 
    loaded = VMTools_LoadConfig(state->configFile,
                                G_KEY_FILE_NONE,
-                               &state->ctx.config,
+                               &config,
                                &state->configMtime);
 
-   if (!first && loaded) {
-      g_debug("Config file reloaded.\n");
+   if (first) {
+      ToolsCore_MarkStartup(state, "config loaded");
+      state->ctx.config = config;
+   } else if (loaded) {
+      GKeyFile *oldConfig = state->ctx.config;
+      GPtrArray *changed = ToolsCoreConfChangedGroups(oldConfig, config);
+      guint i;
+
+      if (changed->len == 0) {
+         /*
+          * Only the timestamp changed; keep the current dictionary so that
+          * plugins caching anything derived from it don't start over.
+          */
+         g_debug("Config file unchanged.\n");
+         g_key_file_free(config);
+         loaded = FALSE;
+      } else {
+         g_debug("Config file reloaded, %u group(s) changed.\n", changed->len);
+         state->ctx.config = config;
+
+         /*
+          * Inform plugins of config file update, first for each group that
+          * changed and then for the file as a whole.
+          */
+         ASSERT(state->ctx.serviceObj != NULL);
+         for (i = 0; i < changed->len; i++) {
+            const gchar *group = g_ptr_array_index(changed, i);
+            gchar *signame = g_strdup_printf("%s::%s",
+                                             TOOLS_CORE_SIG_CONF_GROUP_RELOAD,
+                                             group);
+
+            g_signal_emit_by_name(state->ctx.serviceObj,
+                                  signame,
+                                  &state->ctx,
+                                  group);
+            g_free(signame);
+         }
+         g_signal_emit_by_name(state->ctx.serviceObj,
+                               TOOLS_CORE_SIG_CONF_RELOAD,
+                               &state->ctx);
+         g_key_file_free(oldConfig);
+      }
 
-      /*
-       * Inform plugins of config file update.
-       */
-      ASSERT(state->ctx.serviceObj != NULL);
-      g_signal_emit_by_name(state->ctx.serviceObj,
-                            TOOLS_CORE_SIG_CONF_RELOAD,
-                            &state->ctx);
+      for (i = 0; i < changed->len; i++) {
+         g_free(g_ptr_array_index(changed, i));
+      }
+      g_ptr_array_free(changed, TRUE);
    }
 
    if (state->ctx.config == NULL) {
@@ -377,6 +957,13 @@ ToolsCore_ReloadConfig(ToolsServiceState *state,
       state->ctx.config = g_key_file_new();
    }
 
+   if (first || loaded) {
+      ToolsCoreLockStats_Enable(g_key_file_get_boolean(state->ctx.config,
+                                                       state->name,
+                                                       "lockStats",
+                                                       NULL));
+   }
+
    if (reset || loaded) {
       VMTools_ConfigLogging(state->name,
                             state->ctx.config,
@@ -432,11 +1019,17 @@ ToolsCore_Setup(ToolsServiceState *state)
                                      &ctxProp);
    g_object_set(state->ctx.serviceObj, TOOLS_CORE_PROP_CTX, &state->ctx, NULL);
    ToolsCorePool_Init(&state->ctx);
+   ToolsCoreMemBudget_Init(&state->ctx);
+#if defined(TOOLSCORE_HAVE_ASYNCSOCKET)
+   AsyncSocket_SetStatsEnabled(TRUE);
+#endif
 
    /* Initializes the debug library if needed. */
    if (state->debugPlugin != NULL) {
       ToolsCoreInitializeDebug(state);
    }
+
+   ToolsCore_MarkStartup(state, "service set up");
 }
 
 
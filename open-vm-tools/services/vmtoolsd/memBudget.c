@@ -0,0 +1,722 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file memBudget.c
+ *
+ * Implementation of the memory budget defined in memBudget.h.
+ *
+ * The budget is configured in the service's group of the config file:
+ *
+ *    memBudget.cacheKB          Total size allowed for the registered
+ *                               caches; 0 (the default) means no limit.
+ *    memBudget.trimThresholdKB  Free heap memory above which it is returned
+ *                               to the system after a transient operation.
+ *    memBudget.checkInterval    Seconds between two checks of the caches.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(__GLIBC__)
+#  include <malloc.h>
+#endif
+#include "vmware.h"
+#include "toolsCoreInt.h"
+#include "serviceObj.h"
+#include "vmware/tools/memBudget.h"
+#include "vmware/tools/utils.h"
+
+#define DEFAULT_CACHE_KB            0
+#define DEFAULT_TRIM_THRESHOLD_KB   1024
+#define DEFAULT_CHECK_INTERVAL      60
+
+/* A cache registered by a plugin. */
+typedef struct MemCache {
+   guint                      id;
+   gchar                     *owner;
+   gchar                     *name;
+   ToolsCoreMemCacheSizeCb    size;
+   ToolsCoreMemCacheEvictCb   evict;
+   gpointer                   data;
+   gsize                      lastSize;
+   guint64                    evictions;
+   guint64                    evictedBytes;
+} MemCache;
+
+/* Transient operations reported under an owner name. */
+typedef struct MemOwnerStats {
+   guint64        count;
+   guint64        totalBytes;
+   gsize          maxBytes;
+} MemOwnerStats;
+
+
+typedef struct MemBudgetState {
+   ToolsCoreMemBudget   funcs;
+   ToolsAppCtx         *ctx;
+   GMutex              *lock;
+   GPtrArray           *caches;
+   GHashTable          *owners;
+   guint                nextId;
+   gsize                budget;
+   gsize                trimThreshold;
+   guint                checkInterval;
+   GSource             *timer;
+   guint                idleCheck;
+   guint                logCacheId;
+   guint64              trims;
+} MemBudgetState;
+
+
+static MemBudgetState gState;
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudgetTrimHeap --                                          */ /**
+ *
+ * Returns free heap memory to the system if there is enough of it.
+ *
+ *******************************************************************************
+ */
+
+static void
+ToolsCoreMemBudgetTrimHeap(void)
+{
+#if defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 33)
+   struct mallinfo2 mi = mallinfo2();
+#else
+   struct mallinfo mi = mallinfo();
+#endif
+
+   if ((gsize) mi.fordblks >= gState.trimThreshold) {
+      g_debug("Returning %"G_GSIZE_FORMAT" KB of free heap to the system.\n",
+              (gsize) mi.fordblks / 1024);
+      malloc_trim(0);
+      gState.trims++;
+   }
+#endif
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudgetCompareSize --                                       */ /**
+ *
+ * Sorts caches by decreasing size.
+ *
+ * @param[in] p1  Pointer to a MemCache pointer.
+ * @param[in] p2  Pointer to a MemCache pointer.
+ *
+ * @return < 0, 0, > 0 if the first cache is larger, equal, or smaller.
+ *
+ *******************************************************************************
+ */
+
+static gint
+ToolsCoreMemBudgetCompareSize(gconstpointer p1,
+                              gconstpointer p2)
+{
+   const MemCache *c1 = *(MemCache * const *) p1;
+   const MemCache *c2 = *(MemCache * const *) p2;
+
+   if (c1->lastSize == c2->lastSize) {
+      return 0;
+   }
+   return (c1->lastSize > c2->lastSize) ? -1 : 1;
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudgetCheck --                                             */ /**
+ *
+ * Measures the registered caches, and if they exceed the budget, asks the
+ * largest ones to shrink until the total fits. Then returns free heap memory
+ * to the system if caches were shrunk or @a trim is set.
+ *
+ * Must be called on the main service thread, which is the only one that
+ * adds or removes caches.
+ *
+ * @param[in] trim   Whether to trim the heap even if no cache was shrunk.
+ *
+ *******************************************************************************
+ */
+
+static void
+ToolsCoreMemBudgetCheck(gboolean trim)
+{
+   GPtrArray *caches;
+   gsize total = 0;
+   gsize evicted = 0;
+   guint i;
+
+   g_mutex_lock(gState.lock);
+   caches = g_ptr_array_sized_new(gState.caches->len);
+   for (i = 0; i < gState.caches->len; i++) {
+      g_ptr_array_add(caches, g_ptr_array_index(gState.caches, i));
+   }
+   g_mutex_unlock(gState.lock);
+
+   for (i = 0; i < caches->len; i++) {
+      MemCache *cache = g_ptr_array_index(caches, i);
+      cache->lastSize = cache->size(cache->data);
+      total += cache->lastSize;
+   }
+
+   if (gState.budget > 0 && total > gState.budget) {
+      g_ptr_array_sort(caches, ToolsCoreMemBudgetCompareSize);
+
+      for (i = 0; i < caches->len && total > gState.budget; i++) {
+         MemCache *cache = g_ptr_array_index(caches, i);
+         gsize freed;
+
+         if (cache->lastSize == 0) {
+            break;
+         }
+
+         freed = cache->evict(total - gState.budget, cache->data);
+         if (freed > 0) {
+            freed = MIN(freed, total);
+            cache->evictions++;
+            cache->evictedBytes += freed;
+            cache->lastSize -= MIN(freed, cache->lastSize);
+            total -= freed;
+            evicted += freed;
+         }
+      }
+
+      g_debug("Caches over budget, released %"G_GSIZE_FORMAT" KB, "
+              "%"G_GSIZE_FORMAT" KB left.\n", evicted / 1024, total / 1024);
+   }
+
+   g_ptr_array_free(caches, TRUE);
+
+   if (trim || evicted > 0) {
+      ToolsCoreMemBudgetTrimHeap();
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudgetTimerCb --                                           */ /**
+ *
+ * Periodic check of the cache budget.
+ *
+ * @param[in] data   Unused.
+ *
+ * @return TRUE.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+ToolsCoreMemBudgetTimerCb(gpointer data)
+{
+   ToolsCoreMemBudgetCheck(FALSE);
+   return TRUE;
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudgetIdleCb --                                            */ /**
+ *
+ * Runs the check requested after a transient operation.
+ *
+ * @param[in] data   Unused.
+ *
+ * @return FALSE.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+ToolsCoreMemBudgetIdleCb(gpointer data)
+{
+   g_mutex_lock(gState.lock);
+   gState.idleCheck = 0;
+   g_mutex_unlock(gState.lock);
+
+   ToolsCoreMemBudgetCheck(TRUE);
+   return FALSE;
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudgetRegisterCache --                                     */ /**
+ *
+ * Registers a cache. See ToolsCoreMemBudget_RegisterCache().
+ *
+ * @param[in] owner  Owner of the cache.
+ * @param[in] name   Name of the cache.
+ * @param[in] size   Size callback.
+ * @param[in] evict  Eviction callback.
+ * @param[in] data   Data for the callbacks.
+ *
+ * @return Identifier of the cache.
+ *
+ *******************************************************************************
+ */
+
+static guint
+ToolsCoreMemBudgetRegisterCache(const gchar *owner,
+                                const gchar *name,
+                                ToolsCoreMemCacheSizeCb size,
+                                ToolsCoreMemCacheEvictCb evict,
+                                gpointer data)
+{
+   MemCache *cache;
+
+   g_return_val_if_fail(owner != NULL && name != NULL, 0);
+   g_return_val_if_fail(size != NULL && evict != NULL, 0);
+
+   cache = g_new0(MemCache, 1);
+   cache->owner = g_strdup(owner);
+   cache->name = g_strdup(name);
+   cache->size = size;
+   cache->evict = evict;
+   cache->data = data;
+
+   g_mutex_lock(gState.lock);
+   cache->id = ++gState.nextId;
+   g_ptr_array_add(gState.caches, cache);
+   g_mutex_unlock(gState.lock);
+
+   return cache->id;
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudgetUnregisterCache --                                   */ /**
+ *
+ * Removes a cache. See ToolsCoreMemBudget_UnregisterCache().
+ *
+ * @param[in] id     Identifier of the cache.
+ *
+ *******************************************************************************
+ */
+
+static void
+ToolsCoreMemBudgetUnregisterCache(guint id)
+{
+   MemCache *cache = NULL;
+   guint i;
+
+   g_mutex_lock(gState.lock);
+   for (i = 0; i < gState.caches->len; i++) {
+      if (((MemCache *) g_ptr_array_index(gState.caches, i))->id == id) {
+         cache = g_ptr_array_remove_index(gState.caches, i);
+         break;
+      }
+   }
+   g_mutex_unlock(gState.lock);
+
+   if (cache != NULL) {
+      g_free(cache->owner);
+      g_free(cache->name);
+      g_free(cache);
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudgetTransientDone --                                     */ /**
+ *
+ * Records a transient operation, and schedules a heap trim on the main
+ * thread if it was large. See ToolsCoreMemBudget_TransientDone().
+ *
+ * @param[in] owner  Owner of the operation.
+ * @param[in] bytes  Memory used by the operation.
+ *
+ *******************************************************************************
+ */
+
+static void
+ToolsCoreMemBudgetTransientDone(const gchar *owner,
+                                gsize bytes)
+{
+   MemOwnerStats *stats;
+
+   g_return_if_fail(owner != NULL);
+
+   g_mutex_lock(gState.lock);
+
+   stats = g_hash_table_lookup(gState.owners, owner);
+   if (stats == NULL) {
+      stats = g_new0(MemOwnerStats, 1);
+      g_hash_table_insert(gState.owners, g_strdup(owner), stats);
+   }
+   stats->count++;
+   stats->totalBytes += bytes;
+   stats->maxBytes = MAX(stats->maxBytes, bytes);
+
+   if (bytes >= gState.trimThreshold && gState.idleCheck == 0) {
+      gState.idleCheck = g_idle_add(ToolsCoreMemBudgetIdleCb, NULL);
+   }
+
+   g_mutex_unlock(gState.lock);
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudgetLogCacheSize --                                      */ /**
+ *
+ * Size callback for the log cache.
+ *
+ * @param[in] data   Unused.
+ *
+ * @return Size of the log cache.
+ *
+ *******************************************************************************
+ */
+
+static gsize
+ToolsCoreMemBudgetLogCacheSize(gpointer data)
+{
+   return VMTools_GetLogCacheSize();
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudgetLogCacheEvict --                                     */ /**
+ *
+ * Eviction callback for the log cache: releases it if empty. Cached messages
+ * are never dropped to meet the budget.
+ *
+ * @param[in] bytes  Unused.
+ * @param[in] data   Unused.
+ *
+ * @return Bytes released.
+ *
+ *******************************************************************************
+ */
+
+static gsize
+ToolsCoreMemBudgetLogCacheEvict(gsize bytes,
+                                gpointer data)
+{
+   return VMTools_TrimLogCache();
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudgetConfigure --                                         */ /**
+ *
+ * Reads the budget settings from the config file, and starts or stops the
+ * periodic check accordingly.
+ *
+ * @param[in] ctx    Application context.
+ *
+ *******************************************************************************
+ */
+
+static void
+ToolsCoreMemBudgetConfigure(ToolsAppCtx *ctx)
+{
+   gint cacheKB;
+   gint trimKB;
+   gint interval;
+   GError *err = NULL;
+
+   cacheKB = g_key_file_get_integer(ctx->config, ctx->name,
+                                    "memBudget.cacheKB", &err);
+   if (err != NULL || cacheKB < 0) {
+      cacheKB = DEFAULT_CACHE_KB;
+      g_clear_error(&err);
+   }
+
+   trimKB = g_key_file_get_integer(ctx->config, ctx->name,
+                                   "memBudget.trimThresholdKB", &err);
+   if (err != NULL || trimKB <= 0) {
+      trimKB = DEFAULT_TRIM_THRESHOLD_KB;
+      g_clear_error(&err);
+   }
+
+   interval = g_key_file_get_integer(ctx->config, ctx->name,
+                                     "memBudget.checkInterval", &err);
+   if (err != NULL || interval <= 0) {
+      interval = DEFAULT_CHECK_INTERVAL;
+      g_clear_error(&err);
+   }
+
+   g_mutex_lock(gState.lock);
+   gState.budget = (gsize) cacheKB * 1024;
+   gState.trimThreshold = (gsize) trimKB * 1024;
+   g_mutex_unlock(gState.lock);
+
+   if (gState.timer != NULL &&
+       (gState.budget == 0 || gState.checkInterval != (guint) interval)) {
+      g_source_destroy(gState.timer);
+      g_source_unref(gState.timer);
+      gState.timer = NULL;
+   }
+
+   gState.checkInterval = interval;
+
+   if (gState.timer == NULL && gState.budget > 0) {
+      gState.timer = VMTools_CreateCoalescedTimer("mem-budget",
+                                                  interval * 1000,
+                                                  interval * 100);
+      g_source_set_callback(gState.timer, ToolsCoreMemBudgetTimerCb,
+                            NULL, NULL);
+      g_source_attach(gState.timer, g_main_loop_get_context(ctx->mainLoop));
+      g_message("Cache memory budget: %d KB, checked every %d s.\n",
+                cacheKB, interval);
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudgetConfReload --                                        */ /**
+ *
+ * Re-reads the budget settings when the service's config group changes.
+ *
+ * @param[in] src    Unused.
+ * @param[in] ctx    Application context.
+ * @param[in] group  Unused.
+ * @param[in] data   Unused.
+ *
+ *******************************************************************************
+ */
+
+static void
+ToolsCoreMemBudgetConfReload(gpointer src,
+                             ToolsAppCtx *ctx,
+                             const gchar *group,
+                             gpointer data)
+{
+   ToolsCoreMemBudgetConfigure(ctx);
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudget_DumpState --                                        */ /**
+ *
+ * Logs the heap usage, and the memory held by the caches and used by the
+ * transient operations of each owner.
+ *
+ *******************************************************************************
+ */
+
+void
+ToolsCoreMemBudget_DumpState(void)
+{
+   GHashTable *owned;
+   GHashTableIter iter;
+   gpointer key;
+   gpointer value;
+   gsize total = 0;
+   guint i;
+
+   if (gState.lock == NULL) {
+      return;
+   }
+
+   owned = g_hash_table_new(g_str_hash, g_str_equal);
+
+   g_mutex_lock(gState.lock);
+
+   for (i = 0; i < gState.caches->len; i++) {
+      MemCache *cache = g_ptr_array_index(gState.caches, i);
+      gsize *sum;
+
+      cache->lastSize = cache->size(cache->data);
+      total += cache->lastSize;
+
+      sum = g_hash_table_lookup(owned, cache->owner);
+      if (sum == NULL) {
+         sum = g_new0(gsize, 1);
+         g_hash_table_insert(owned, cache->owner, sum);
+      }
+      *sum += cache->lastSize;
+   }
+
+   ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                      "Memory: caches %"G_GSIZE_FORMAT" KB of %"
+                      G_GSIZE_FORMAT" KB budget%s, %"G_GUINT64_FORMAT
+                      " heap trims\n",
+                      total / 1024, gState.budget / 1024,
+                      gState.budget == 0 ? " (unlimited)" : "",
+                      gState.trims);
+
+#if defined(__GLIBC__)
+   {
+#if __GLIBC_PREREQ(2, 33)
+      struct mallinfo2 mi = mallinfo2();
+#else
+      struct mallinfo mi = mallinfo();
+#endif
+      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                         "heap: %"G_GSIZE_FORMAT" KB in use, %"
+                         G_GSIZE_FORMAT" KB free\n",
+                         (gsize) (mi.uordblks + mi.hblkhd) / 1024,
+                         (gsize) mi.fordblks / 1024);
+   }
+#endif
+
+   g_hash_table_iter_init(&iter, owned);
+   while (g_hash_table_iter_next(&iter, &key, &value)) {
+      MemOwnerStats *stats = g_hash_table_lookup(gState.owners, key);
+
+      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                         "%s: caches %"G_GSIZE_FORMAT" KB\n",
+                         (const gchar *) key, *(gsize *) value / 1024);
+      for (i = 0; i < gState.caches->len; i++) {
+         MemCache *cache = g_ptr_array_index(gState.caches, i);
+         if (strcmp(cache->owner, key) == 0) {
+            ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                               "   %s: %"G_GSIZE_FORMAT" KB, evicted %"
+                               G_GUINT64_FORMAT" times, %"G_GUINT64_FORMAT
+                               " KB\n",
+                               cache->name, cache->lastSize / 1024,
+                               cache->evictions, cache->evictedBytes / 1024);
+         }
+      }
+      if (stats != NULL) {
+         ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                            "   transient: %"G_GUINT64_FORMAT" ops, avg %"
+                            G_GUINT64_FORMAT" KB max %"G_GSIZE_FORMAT" KB\n",
+                            stats->count,
+                            stats->totalBytes / MAX(stats->count, 1) / 1024,
+                            stats->maxBytes / 1024);
+      }
+      g_free(value);
+   }
+
+   g_hash_table_iter_init(&iter, gState.owners);
+   while (g_hash_table_iter_next(&iter, &key, &value)) {
+      MemOwnerStats *stats = value;
+
+      if (g_hash_table_lookup(owned, key) != NULL) {
+         continue;
+      }
+      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                         "%s: transient %"G_GUINT64_FORMAT" ops, avg %"
+                         G_GUINT64_FORMAT" KB max %"G_GSIZE_FORMAT" KB\n",
+                         (const gchar *) key, stats->count,
+                         stats->totalBytes / MAX(stats->count, 1) / 1024,
+                         stats->maxBytes / 1024);
+   }
+
+   g_mutex_unlock(gState.lock);
+
+   g_hash_table_destroy(owned);
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudget_Init --                                             */ /**
+ *
+ * Initializes the memory budget and publishes it in the service object.
+ *
+ * @param[in] ctx    Application context.
+ *
+ *******************************************************************************
+ */
+
+void
+ToolsCoreMemBudget_Init(ToolsAppCtx *ctx)
+{
+   ToolsServiceProperty prop = { TOOLS_CORE_PROP_MEMBUDGET };
+   gchar *signame;
+
+   gState.funcs.registerCache = ToolsCoreMemBudgetRegisterCache;
+   gState.funcs.unregisterCache = ToolsCoreMemBudgetUnregisterCache;
+   gState.funcs.transientDone = ToolsCoreMemBudgetTransientDone;
+   gState.ctx = ctx;
+   gState.lock = g_mutex_new();
+   gState.caches = g_ptr_array_new();
+   gState.owners = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                         g_free, g_free);
+
+   ToolsCoreMemBudgetConfigure(ctx);
+
+   gState.logCacheId =
+      ToolsCoreMemBudgetRegisterCache("vmtoolsd", "log cache",
+                                      ToolsCoreMemBudgetLogCacheSize,
+                                      ToolsCoreMemBudgetLogCacheEvict,
+                                      NULL);
+
+   signame = g_strdup_printf("%s::%s", TOOLS_CORE_SIG_CONF_GROUP_RELOAD,
+                             ctx->name);
+   g_signal_connect(ctx->serviceObj, signame,
+                    G_CALLBACK(ToolsCoreMemBudgetConfReload), NULL);
+   g_free(signame);
+
+   ToolsCoreService_RegisterProperty(ctx->serviceObj, &prop);
+   g_object_set(ctx->serviceObj, TOOLS_CORE_PROP_MEMBUDGET, &gState.funcs,
+                NULL);
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCoreMemBudget_Shutdown --                                         */ /**
+ *
+ * Stops the memory budget. Plugins are expected to have removed their
+ * caches by now.
+ *
+ * @param[in] ctx    Application context.
+ *
+ *******************************************************************************
+ */
+
+void
+ToolsCoreMemBudget_Shutdown(ToolsAppCtx *ctx)
+{
+   if (gState.lock == NULL) {
+      return;
+   }
+
+   g_object_set(ctx->serviceObj, TOOLS_CORE_PROP_MEMBUDGET, NULL, NULL);
+
+   if (gState.timer != NULL) {
+      g_source_destroy(gState.timer);
+      g_source_unref(gState.timer);
+      gState.timer = NULL;
+   }
+   if (gState.idleCheck != 0) {
+      g_source_remove(gState.idleCheck);
+      gState.idleCheck = 0;
+   }
+
+   ToolsCoreMemBudgetUnregisterCache(gState.logCacheId);
+   while (gState.caches->len > 0) {
+      MemCache *cache = g_ptr_array_index(gState.caches, 0);
+      g_warning("Cache '%s' of '%s' still registered at shutdown.\n",
+                cache->name, cache->owner);
+      ToolsCoreMemBudgetUnregisterCache(cache->id);
+   }
+
+   g_ptr_array_free(gState.caches, TRUE);
+   g_hash_table_destroy(gState.owners);
+   g_mutex_free(gState.lock);
+   memset(&gState, 0, sizeof gState);
+}
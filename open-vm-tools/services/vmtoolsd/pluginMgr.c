@@ -22,15 +22,18 @@
  *    Provides functions for loading and manipulating Tools plugins.
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include "toolsCoreInt.h"
 
 #include "vm_assert.h"
 #include "guestApp.h"
+#include "hostinfo.h"
 #include "serviceObj.h"
 #include "util.h"
 #include "vmware/tools/i18n.h"
 #include "vmware/tools/log.h"
+#include "vmware/tools/threadPool.h"
 #include "vmware/tools/utils.h"
 
 
@@ -40,9 +43,58 @@ typedef struct ToolsPlugin {
    GModule             *module;
    ToolsPluginOnLoad    onload;
    ToolsPluginData     *data;
+   gboolean             concurrent;   /* ToolsOnLoad may run in the pool. */
+   gboolean             initialized;
+   VmTimeType           loadTime;     /* How long ToolsOnLoad took, in us. */
 } ToolsPlugin;
 
 
+/** Tracks plugins being initialized in the thread pool. */
+typedef struct ToolsPluginInitBatch {
+   GMutex              *lock;
+   GCond               *done;
+   guint                pending;
+} ToolsPluginInitBatch;
+
+/** A plugin initialization task. */
+typedef struct ToolsPluginInitTask {
+   ToolsPlugin          *plugin;
+   ToolsPluginInitBatch *batch;
+} ToolsPluginInitTask;
+
+
+/** Key file group holding the declarations in a plugin manifest. */
+#define TOOLSCORE_MANIFEST_GROUP "manifest"
+
+/** An emission hook installed on behalf of a plugin that isn't loaded. */
+typedef struct ToolsLazyHook {
+   guint                sigId;
+   gulong               hookId;
+} ToolsLazyHook;
+
+/**
+ * A plugin with a manifest, whose module is only loaded when one of the
+ * RPCs or signals it declares is first used. Until then, the capabilities
+ * from the manifest are reported on its behalf.
+ */
+typedef struct ToolsLazyPlugin {
+   ToolsServiceState   *state;
+   gchar               *path;
+   gchar               *fileName;
+   gchar               *name;
+   gchar              **rpcNames;
+   gchar              **sigNames;
+   gchar              **capNames;
+   GArray              *rpcs;        /* RpcChannelCallback placeholders. */
+   GArray              *hooks;       /* ToolsLazyHook. */
+   GArray              *caps;        /* ToolsAppCapability. */
+   gulong               capsHandler;
+   gboolean             concurrentLoad;
+   gboolean             tried;
+   gboolean             loaded;
+} ToolsLazyPlugin;
+
+
 #ifdef USE_APPLOADER
 static Bool (*LoadDependencies)(char *libName, Bool useShipped);
 #endif
@@ -303,6 +355,73 @@ ToolsCoreRegisterProvider(ToolsServiceState *state,
 }
 
 
+/**
+ * Iterates through a plugin's app registration data, calling the given
+ * callback for each piece of data.
+ *
+ * @param[in]  state       Service state.
+ * @param[in]  plugin      The plugin.
+ * @param[in]  appRegCb    Callback called for each application registration.
+ */
+
+static void
+ToolsCoreForEachApp(ToolsServiceState *state,
+                    ToolsPlugin *plugin,
+                    PluginAppRegCallback appRegCb)
+{
+   GArray *regs = (plugin->data != NULL) ? plugin->data->regs : NULL;
+   guint j;
+
+   if (regs == NULL) {
+      return;
+   }
+
+   for (j = 0; j < regs->len; j++) {
+      guint k;
+      guint pregIdx;
+      ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, j);
+      ToolsAppProviderReg *preg = NULL;
+
+      /* Find the provider for the desired reg type. */
+      for (k = 0; k < state->providers->len; k++) {
+         ToolsAppProviderReg *tmp = &g_array_index(state->providers,
+                                                   ToolsAppProviderReg,
+                                                   k);
+         if (tmp->prov->regType == reg->type) {
+            preg = tmp;
+            pregIdx = k;
+            break;
+         }
+      }
+
+      if (preg == NULL) {
+         g_message("Cannot find provider for app type %d, plugin %s may not work.\n",
+                   reg->type, plugin->data->name);
+         if (plugin->data->errorCb != NULL &&
+             !plugin->data->errorCb(&state->ctx, reg->type, NULL, plugin->data)) {
+            break;
+         }
+         continue;
+      }
+
+      for (k = 0; k < reg->data->len; k++) {
+         gpointer appdata = &reg->data->data[preg->prov->regSize * k];
+         if (!appRegCb(state, plugin->data, reg->type, preg, appdata)) {
+            /* Break out of the outer loop. */
+            j = regs->len;
+            break;
+         }
+
+         /*
+          * The registration callback may have modified the provider array,
+          * so we need to re-read the provider pointer.
+          */
+         preg = &g_array_index(state->providers, ToolsAppProviderReg, pregIdx);
+      }
+   }
+}
+
+
 /**
  * Iterates through the list of plugins, and through each plugin's app
  * registration data, calling the appropriate callback for each piece
@@ -326,59 +445,13 @@ ToolsCoreForEachPlugin(ToolsServiceState *state,
 
    for (i = 0; i < state->plugins->len; i++) {
       ToolsPlugin *plugin = g_ptr_array_index(state->plugins, i);
-      GArray *regs = (plugin->data != NULL) ? plugin->data->regs : NULL;
-      guint j;
 
       if (pluginCb != NULL) {
          pluginCb(state, plugin->data);
       }
 
-      if (regs == NULL || appRegCb == NULL) {
-         continue;
-      }
-
-      for (j = 0; j < regs->len; j++) {
-         guint k;
-         guint pregIdx;
-         ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, j);
-         ToolsAppProviderReg *preg = NULL;
-
-         /* Find the provider for the desired reg type. */
-         for (k = 0; k < state->providers->len; k++) {
-            ToolsAppProviderReg *tmp = &g_array_index(state->providers,
-                                                      ToolsAppProviderReg,
-                                                      k);
-            if (tmp->prov->regType == reg->type) {
-               preg = tmp;
-               pregIdx = k;
-               break;
-            }
-         }
-
-         if (preg == NULL) {
-            g_message("Cannot find provider for app type %d, plugin %s may not work.\n",
-                      reg->type, plugin->data->name);
-            if (plugin->data->errorCb != NULL &&
-                !plugin->data->errorCb(&state->ctx, reg->type, NULL, plugin->data)) {
-               break;
-            }
-            continue;
-         }
-
-         for (k = 0; k < reg->data->len; k++) {
-            gpointer appdata = &reg->data->data[preg->prov->regSize * k];
-            if (!appRegCb(state, plugin->data, reg->type, preg, appdata)) {
-               /* Break out of the outer loop. */
-               j = regs->len;
-               break;
-            }
-
-            /*
-             * The registration callback may have modified the provider array,
-             * so we need to re-read the provider pointer.
-             */
-            preg = &g_array_index(state->providers, ToolsAppProviderReg, pregIdx);
-         }
+      if (appRegCb != NULL) {
+         ToolsCoreForEachApp(state, plugin, appRegCb);
       }
    }
 }
@@ -488,19 +561,420 @@ ToolsCoreStrPtrCompare(gconstpointer _str1,
 }
 
 
+/**
+ * Opens a plugin's module and looks up its entry point.
+ *
+ * @param[in]  path        Path to the plugin's module.
+ * @param[in]  entry       File name of the module.
+ *
+ * @return A new ToolsPlugin instance, or NULL on failure.
+ */
+
+static ToolsPlugin *
+ToolsCoreOpenPlugin(const gchar *path,
+                    const gchar *entry)
+{
+   GModule *module = NULL;
+   ToolsPlugin *plugin = NULL;
+   ToolsPluginOnLoad onload;
+
+#ifdef USE_APPLOADER
+   /* Trying loading the plugins with system libraries */
+   if (!LoadDependencies((char *) path, FALSE)) {
+      g_warning("Loading of library dependencies for %s failed.\n", entry);
+      goto exit;
+   }
+#endif
+
+   module = g_module_open(path, G_MODULE_BIND_LOCAL);
+#ifdef USE_APPLOADER
+   if (module == NULL) {
+      g_info("Opening plugin '%s' with system libraries failed: %s\n",
+                entry, g_module_error());
+      /* Falling back to the shipped libraries */
+      if (!LoadDependencies((char *) path, TRUE)) {
+         g_warning("Loading of shipped library dependencies for %s failed.\n",
+                  entry);
+         goto exit;
+      }
+      module = g_module_open(path, G_MODULE_BIND_LOCAL);
+   }
+#endif
+   if (module == NULL) {
+      g_warning("Opening plugin '%s' failed: %s.\n", entry, g_module_error());
+      goto exit;
+   }
+
+   if (!g_module_symbol(module, "ToolsOnLoad", (gpointer *) &onload)) {
+      g_warning("Lookup of plugin entry point for '%s' failed.\n", entry);
+      goto exit;
+   }
+
+   plugin = g_malloc(sizeof *plugin);
+   plugin->fileName = g_strdup(entry);
+   plugin->data = NULL;
+   plugin->module = module;
+   plugin->onload = onload;
+   plugin->concurrent = FALSE;
+   plugin->initialized = FALSE;
+   plugin->loadTime = 0;
+
+exit:
+   if (plugin == NULL && module != NULL) {
+      if (!g_module_close(module)) {
+         g_warning("Error unloading plugin '%s': %s\n", entry, g_module_error());
+      }
+   }
+   return plugin;
+}
+
+
+/**
+ * Calls a plugin's entry point, timing how long it takes.
+ *
+ * @param[in]  ctx      Application context.
+ * @param[in]  plugin   The plugin.
+ */
+
+static void
+ToolsCoreInitPlugin(ToolsAppCtx *ctx,
+                    ToolsPlugin *plugin)
+{
+   VmTimeType start = Hostinfo_SystemTimerUS();
+
+   plugin->data = plugin->onload(ctx);
+   plugin->loadTime = Hostinfo_SystemTimerUS() - start;
+   plugin->initialized = TRUE;
+}
+
+
+/**
+ * Thread pool task that initializes a plugin.
+ *
+ * @param[in]  ctx      Application context.
+ * @param[in]  data     A ToolsPluginInitTask.
+ */
+
+static void
+ToolsCoreInitPluginTask(ToolsAppCtx *ctx,
+                        gpointer data)
+{
+   ToolsPluginInitTask *task = data;
+
+   ToolsCoreInitPlugin(ctx, task->plugin);
+
+   g_mutex_lock(task->batch->lock);
+   task->batch->pending--;
+   g_cond_signal(task->batch->done);
+   g_mutex_unlock(task->batch->lock);
+}
+
+
+/**
+ * Initializes the given plugins, adding the ones that provide registration
+ * data to the service's plugin list in the order they were loaded, and
+ * freeing the others.
+ *
+ * Plugins that can be initialized concurrently are handed to the thread
+ * pool first, and the others are initialized in this thread meanwhile. If a
+ * plugin asks the container to quit, the remaining plugins are not
+ * initialized here, but the ones in the pool still finish.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  plugins  Plugins to initialize. Emptied on return.
+ */
+
+static void
+ToolsCoreInitPlugins(ToolsServiceState *state,
+                     GPtrArray *plugins)
+{
+   ToolsPluginInitBatch batch = { NULL, NULL, 0 };
+   ToolsPlugin *quitter = NULL;
+   gboolean threaded = ToolsCorePool_IsThreaded();
+   guint i;
+
+   if (threaded) {
+      batch.lock = g_mutex_new();
+      batch.done = g_cond_new();
+   }
+
+   for (i = 0; i < plugins->len; i++) {
+      ToolsPlugin *plugin = g_ptr_array_index(plugins, i);
+      ToolsPluginInitTask *task;
+
+      if (!plugin->concurrent) {
+         continue;
+      } else if (!threaded) {
+         plugin->concurrent = FALSE;
+         continue;
+      }
+
+      task = g_malloc(sizeof *task);
+      task->plugin = plugin;
+      task->batch = &batch;
+
+      g_mutex_lock(batch.lock);
+      batch.pending++;
+      g_mutex_unlock(batch.lock);
+
+      if (ToolsCorePool_SubmitTaskPriority(&state->ctx,
+                                           TOOLS_CORE_POOL_PRIORITY_HIGH,
+                                           ToolsCoreInitPluginTask,
+                                           task, g_free) == 0) {
+         g_mutex_lock(batch.lock);
+         batch.pending--;
+         g_mutex_unlock(batch.lock);
+         g_free(task);
+         plugin->concurrent = FALSE;
+      }
+   }
+
+   for (i = 0; i < plugins->len; i++) {
+      ToolsPlugin *plugin = g_ptr_array_index(plugins, i);
+
+      if (plugin->concurrent) {
+         continue;
+      }
+
+      /* Stop early if a plugin has requested the container to quit. */
+      if (state->ctx.errorCode != 0) {
+         break;
+      }
+
+      ToolsCoreInitPlugin(&state->ctx, plugin);
+      if (state->ctx.errorCode != 0) {
+         quitter = plugin;
+      }
+   }
+
+   if (threaded) {
+      g_mutex_lock(batch.lock);
+      while (batch.pending > 0) {
+         g_cond_wait(batch.done, batch.lock);
+      }
+      g_mutex_unlock(batch.lock);
+      g_cond_free(batch.done);
+      g_mutex_free(batch.lock);
+   }
+
+   for (i = 0; i < plugins->len; i++) {
+      ToolsPlugin *plugin = g_ptr_array_index(plugins, i);
+
+      if (!plugin->initialized || plugin == quitter) {
+         ToolsCoreFreePlugin(plugin);
+      } else if (plugin->data == NULL) {
+         g_info("Plugin '%s' didn't provide deployment data, unloading.\n",
+                plugin->fileName);
+         ToolsCoreFreePlugin(plugin);
+      } else {
+         ASSERT(plugin->data->name != NULL);
+         g_module_make_resident(plugin->module);
+         g_ptr_array_add(state->plugins, plugin);
+         VMTools_BindTextDomain(plugin->data->name, NULL, NULL);
+         g_message("Plugin '%s' initialized.\n", plugin->data->name);
+         ToolsCore_MarkStartup(state, "plugin '%s' initialized (%u ms%s)",
+                               plugin->data->name,
+                               (guint) (plugin->loadTime / 1000),
+                               plugin->concurrent ? ", in the pool" : "");
+      }
+   }
+   g_ptr_array_set_size(plugins, 0);
+}
+
+
+/**
+ * Removes the placeholders registered for a lazily loaded plugin.
+ *
+ * @param[in]  lazy     The plugin.
+ * @param[in]  skipSig  Signal whose emission hook not to remove, because it
+ *                      is being run and will remove itself. 0 for none.
+ */
+
+static void
+ToolsCoreDisarmLazyPlugin(ToolsLazyPlugin *lazy,
+                          guint skipSig)
+{
+   guint i;
+
+   if (lazy->state->ctx.rpc != NULL) {
+      for (i = 0; i < lazy->rpcs->len; i++) {
+         RpcChannel_UnregisterCallback(lazy->state->ctx.rpc,
+                                       &g_array_index(lazy->rpcs,
+                                                      RpcChannelCallback, i));
+      }
+   }
+   g_array_set_size(lazy->rpcs, 0);
+
+   for (i = 0; i < lazy->hooks->len; i++) {
+      ToolsLazyHook *hook = &g_array_index(lazy->hooks, ToolsLazyHook, i);
+      if (hook->sigId != skipSig) {
+         g_signal_remove_emission_hook(hook->sigId, hook->hookId);
+      }
+   }
+   g_array_set_size(lazy->hooks, 0);
+}
+
+
+/**
+ * Frees a lazily loaded plugin's data, removing anything it still has
+ * registered with the service.
+ *
+ * @param[in]  lazy     The plugin.
+ */
+
+static void
+ToolsCoreFreeLazyPlugin(ToolsLazyPlugin *lazy)
+{
+   if (lazy->state != NULL) {
+      ToolsCoreDisarmLazyPlugin(lazy, 0);
+      if (lazy->capsHandler != 0) {
+         g_signal_handler_disconnect(lazy->state->ctx.serviceObj,
+                                     lazy->capsHandler);
+      }
+   }
+
+   g_array_free(lazy->rpcs, TRUE);
+   g_array_free(lazy->hooks, TRUE);
+   g_array_free(lazy->caps, TRUE);
+   g_strfreev(lazy->rpcNames);
+   g_strfreev(lazy->sigNames);
+   g_strfreev(lazy->capNames);
+   g_free(lazy->name);
+   g_free(lazy->fileName);
+   g_free(lazy->path);
+   g_free(lazy);
+}
+
+
+/**
+ * Reads the manifest of a plugin, if it has one. The manifest is a key file
+ * next to the plugin's module, with the same name and a ".manifest" suffix,
+ * and lists the RPCs, signals and capabilities the plugin handles:
+ *
+ * @verbatim
+[manifest]
+name = example
+rpcs = example.start;example.stop
+signals = tcs_set_option
+capabilities = example_version=2;42=1
+concurrentLoad = true
+@endverbatim
+ *
+ * Capabilities are old-style capability names or, when numeric, new-style
+ * capability indices. A capability without a value is an old-style one
+ * that takes no argument. They are only needed when the host must see them
+ * before it uses any of the RPCs; once loaded, the plugin reports its own,
+ * which are checked against the manifest. "concurrentLoad" says that the
+ * plugin's ToolsOnLoad doesn't depend on other plugins and is safe to run in
+ * the thread pool, concurrently with other plugins being initialized.
+ *
+ * @param[in]  path        Path to the plugin's module.
+ * @param[in]  entry       File name of the module.
+ *
+ * @return The plugin's manifest data, or NULL if the plugin has no usable
+ *         manifest.
+ */
+
+static ToolsLazyPlugin *
+ToolsCoreReadManifest(const gchar *path,
+                      const gchar *entry)
+{
+   gchar *manifestPath;
+   GKeyFile *manifest = NULL;
+   GError *err = NULL;
+   ToolsLazyPlugin *lazy = NULL;
+   guint i;
+
+   manifestPath = g_strdup_printf("%.*s.manifest",
+                                  (int) (strlen(path) -
+                                         strlen("." G_MODULE_SUFFIX)),
+                                  path);
+   if (!g_file_test(manifestPath, G_FILE_TEST_IS_REGULAR)) {
+      goto exit;
+   }
+
+   manifest = g_key_file_new();
+   if (!g_key_file_load_from_file(manifest, manifestPath, G_KEY_FILE_NONE,
+                                  &err)) {
+      g_warning("Error reading plugin manifest '%s': %s\n", manifestPath,
+                err->message);
+      g_clear_error(&err);
+      goto exit;
+   }
+
+   lazy = g_malloc0(sizeof *lazy);
+   lazy->path = g_strdup(path);
+   lazy->fileName = g_strdup(entry);
+   lazy->name = g_key_file_get_string(manifest, TOOLSCORE_MANIFEST_GROUP,
+                                      "name", NULL);
+   if (lazy->name == NULL) {
+      lazy->name = g_strdup(entry);
+   }
+   lazy->rpcNames = g_key_file_get_string_list(manifest,
+                                               TOOLSCORE_MANIFEST_GROUP,
+                                               "rpcs", NULL, NULL);
+   lazy->sigNames = g_key_file_get_string_list(manifest,
+                                               TOOLSCORE_MANIFEST_GROUP,
+                                               "signals", NULL, NULL);
+   lazy->capNames = g_key_file_get_string_list(manifest,
+                                               TOOLSCORE_MANIFEST_GROUP,
+                                               "capabilities", NULL, NULL);
+   lazy->concurrentLoad = g_key_file_get_boolean(manifest,
+                                                 TOOLSCORE_MANIFEST_GROUP,
+                                                 "concurrentLoad", NULL);
+   lazy->rpcs = g_array_new(FALSE, TRUE, sizeof (RpcChannelCallback));
+   lazy->hooks = g_array_new(FALSE, TRUE, sizeof (ToolsLazyHook));
+   lazy->caps = g_array_new(FALSE, TRUE, sizeof (ToolsAppCapability));
+
+   for (i = 0; lazy->capNames != NULL && lazy->capNames[i] != NULL; i++) {
+      ToolsAppCapability cap = { TOOLS_CAP_OLD_NOVAL, NULL, 0, 0 };
+      gchar *name = g_strstrip(lazy->capNames[i]);
+      gchar *value = strchr(name, '=');
+
+      if (value != NULL) {
+         *value++ = '\0';
+         g_strstrip(name);
+         cap.type = TOOLS_CAP_OLD;
+         cap.value = (guint) strtoul(value, NULL, 10);
+      }
+
+      if (*name == '\0') {
+         continue;
+      } else if (g_ascii_isdigit(*name)) {
+         cap.type = TOOLS_CAP_NEW;
+         cap.index = (GuestCapabilities) strtoul(name, NULL, 10);
+      } else {
+         cap.name = name;
+      }
+      g_array_append_val(lazy->caps, cap);
+   }
+
+exit:
+   if (manifest != NULL) {
+      g_key_file_free(manifest);
+   }
+   g_free(manifestPath);
+   return lazy;
+}
+
+
 /**
  * Loads all the plugins found in the given directory, adding the registration
- * data to the given array.
+ * data to the given array. If the caller asks for lazy plugins, plugins with
+ * a manifest are not loaded but added to that array instead.
  *
  * @param[in]  ctx         Application context.
  * @param[in]  pluginPath  Path where to look for plugins.
  * @param[out] regs        Array where to store plugin registration info.
+ * @param[out] lazyRegs    Array where to store lazily loaded plugins, or NULL
+ *                         to load all plugins.
  */
 
 static gboolean
 ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
                        const gchar *pluginPath,
-                       GPtrArray *regs)
+                       GPtrArray *regs,
+                       GPtrArray *lazyRegs)
 {
    gboolean ret = FALSE;
    const gchar *staticEntry;
@@ -534,9 +1008,8 @@ ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
    for (i = 0; i < plugins->len; i++) {
       gchar *entry;
       gchar *path;
-      GModule *module = NULL;
-      ToolsPlugin *plugin = NULL;
-      ToolsPluginOnLoad onload;
+      ToolsPlugin *plugin;
+      ToolsLazyPlugin *lazy = NULL;
 
       entry = g_ptr_array_index(plugins, i);
       path = g_strdup_printf("%s%c%s", pluginPath, DIRSEPC, entry);
@@ -546,52 +1019,32 @@ ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
          goto next;
       }
 
-#ifdef USE_APPLOADER
-      /* Trying loading the plugins with system libraries */
-      if (!LoadDependencies(path, FALSE)) {
-         g_warning("Loading of library dependencies for %s failed.\n", entry);
-         goto next;
-      }
-#endif
-
-      module = g_module_open(path, G_MODULE_BIND_LOCAL);
-#ifdef USE_APPLOADER
-      if (module == NULL) {
-         g_info("Opening plugin '%s' with system libraries failed: %s\n",
-                   entry, g_module_error());
-         /* Falling back to the shipped libraries */
-         if (!LoadDependencies(path, TRUE)) {
-            g_warning("Loading of shipped library dependencies for %s failed.\n",
-                     entry);
+      lazy = ToolsCoreReadManifest(path, entry);
+      if (lazy != NULL && lazyRegs != NULL) {
+         if (lazy->rpcNames != NULL || lazy->sigNames != NULL) {
+            g_ptr_array_add(lazyRegs, lazy);
+            lazy = NULL;
             goto next;
          }
-         module = g_module_open(path, G_MODULE_BIND_LOCAL);
-      }
-#endif
-      if (module == NULL) {
-         g_warning("Opening plugin '%s' failed: %s.\n", entry, g_module_error());
-         goto next;
+         /* A manifest may only be there for concurrentLoad. */
+         if (lazy->capNames != NULL) {
+            g_warning("Manifest of plugin '%s' doesn't declare any RPC or "
+                      "signal, loading the plugin right away.\n", entry);
+         }
       }
 
-      if (!g_module_symbol(module, "ToolsOnLoad", (gpointer *) &onload)) {
-         g_warning("Lookup of plugin entry point for '%s' failed.\n", entry);
-         goto next;
+      plugin = ToolsCoreOpenPlugin(path, entry);
+      if (plugin != NULL) {
+         plugin->concurrent = (lazy != NULL && lazy->concurrentLoad);
+         g_ptr_array_add(regs, plugin);
       }
 
-      plugin = g_malloc(sizeof *plugin);
-      plugin->fileName = entry;
-      plugin->data = NULL;
-      plugin->module = module;
-      plugin->onload = onload;
-      g_ptr_array_add(regs, plugin);
-
    next:
-      g_free(path);
-      if (plugin == NULL && module != NULL) {
-         if (!g_module_close(module)) {
-            g_warning("Error unloading plugin '%s': %s\n", entry, g_module_error());
-         }
+      if (lazy != NULL) {
+         ToolsCoreFreeLazyPlugin(lazy);
       }
+      g_free(path);
+      g_free(entry);
    }
 
    g_ptr_array_free(plugins, TRUE);
@@ -602,6 +1055,351 @@ exit:
 }
 
 
+/**
+ * Returns whether two capabilities are the same.
+ *
+ * @param[in]  a        A capability.
+ * @param[in]  b        Another capability.
+ *
+ * @return Whether the capabilities are the same.
+ */
+
+static gboolean
+ToolsCoreCapabilityEqual(const ToolsAppCapability *a,
+                         const ToolsAppCapability *b)
+{
+   if (a->type != b->type) {
+      return FALSE;
+   } else if (a->type == TOOLS_CAP_NEW) {
+      return a->index == b->index && a->value == b->value;
+   } else if (strcmp(a->name, b->name) != 0) {
+      return FALSE;
+   }
+   return a->type == TOOLS_CAP_OLD_NOVAL || a->value == b->value;
+}
+
+
+/**
+ * Returns the number of capabilities in one list that are not in the other.
+ *
+ * @param[in]  caps     The capabilities to look for.
+ * @param[in]  other    The capabilities to look in.
+ *
+ * @return The number of capabilities not found.
+ */
+
+static guint
+ToolsCoreCapabilitiesMissing(GArray *caps,
+                             GArray *other)
+{
+   guint missing = 0;
+   guint i;
+
+   for (i = 0; i < caps->len; i++) {
+      guint k;
+
+      for (k = 0; k < other->len; k++) {
+         if (ToolsCoreCapabilityEqual(&g_array_index(caps, ToolsAppCapability, i),
+                                      &g_array_index(other, ToolsAppCapability, k))) {
+            break;
+         }
+      }
+      if (k == other->len) {
+         missing++;
+      }
+   }
+   return missing;
+}
+
+
+/**
+ * Reports the capabilities of a plugin that was just loaded on demand. The
+ * capabilities signal has usually been emitted long before, so the plugin's
+ * own handlers are called directly: they may do more than what the manifest
+ * can describe, such as negotiating a protocol version with the host. What
+ * they return is sent to the host and checked against the manifest.
+ *
+ * @param[in]  lazy     The plugin's manifest data.
+ * @param[in]  plugin   The plugin.
+ */
+
+static void
+ToolsCoreReportLazyCapabilities(ToolsLazyPlugin *lazy,
+                                ToolsPlugin *plugin)
+{
+   ToolsServiceState *state = lazy->state;
+   GArray *regs = plugin->data->regs;
+   GArray *caps = g_array_new(FALSE, TRUE, sizeof (ToolsAppCapability));
+   guint i;
+
+   for (i = 0; regs != NULL && i < regs->len; i++) {
+      ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, i);
+      guint k;
+
+      if (reg->type != TOOLS_APP_SIGNALS) {
+         continue;
+      }
+
+      for (k = 0; k < reg->data->len; k++) {
+         ToolsPluginSignalCb *sig = &g_array_index(reg->data,
+                                                   ToolsPluginSignalCb, k);
+         GArray *(*capsCb)(gpointer, ToolsAppCtx *, gboolean, gpointer);
+         GArray *pcaps;
+
+         if (strcmp(sig->signame, TOOLS_CORE_SIG_CAPABILITIES) != 0) {
+            continue;
+         }
+
+         capsCb = sig->callback;
+         pcaps = capsCb(state->ctx.serviceObj, &state->ctx, TRUE,
+                        sig->clientData);
+         if (pcaps != NULL) {
+            g_array_append_vals(caps, pcaps->data, pcaps->len);
+            g_array_free(pcaps, TRUE);
+         }
+      }
+   }
+
+   if (ToolsCoreCapabilitiesMissing(lazy->caps, caps) > 0 ||
+       ToolsCoreCapabilitiesMissing(caps, lazy->caps) > 0) {
+      g_warning("Capabilities in the manifest of plugin '%s' don't match "
+                "the %u reported by the plugin.\n", lazy->name, caps->len);
+   }
+
+   if (caps->len > 0 && state->ctx.rpc != NULL) {
+      ToolsCore_SetCapabilities(state->ctx.rpc, caps, TRUE);
+   }
+   g_array_free(caps, TRUE);
+}
+
+
+/**
+ * Loads and initializes a lazily loaded plugin, and registers its apps. This
+ * is only tried once; the placeholders that trigger the load are removed
+ * whether it succeeds or not.
+ *
+ * @param[in]  lazy     The plugin.
+ * @param[in]  skipSig  See ToolsCoreDisarmLazyPlugin().
+ *
+ * @return Whether the plugin is loaded.
+ */
+
+static gboolean
+ToolsCoreLoadLazyPlugin(ToolsLazyPlugin *lazy,
+                        guint skipSig)
+{
+   ToolsServiceState *state = lazy->state;
+   ToolsPlugin *plugin;
+
+   if (lazy->tried) {
+      return lazy->loaded;
+   }
+   lazy->tried = TRUE;
+
+   ToolsCoreDisarmLazyPlugin(lazy, skipSig);
+
+   plugin = ToolsCoreOpenPlugin(lazy->path, lazy->fileName);
+   if (plugin == NULL) {
+      return FALSE;
+   }
+
+   ToolsCoreInitPlugin(&state->ctx, plugin);
+
+   if (plugin->data == NULL) {
+      g_info("Plugin '%s' didn't provide deployment data, unloading.\n",
+             plugin->fileName);
+      ToolsCoreFreePlugin(plugin);
+      return FALSE;
+   } else if (state->ctx.errorCode != 0) {
+      /* The plugin has requested the container to quit. */
+      ToolsCoreFreePlugin(plugin);
+      return FALSE;
+   }
+
+   ASSERT(plugin->data->name != NULL);
+   g_module_make_resident(plugin->module);
+   g_ptr_array_add(state->plugins, plugin);
+   VMTools_BindTextDomain(plugin->data->name, NULL, NULL);
+   g_message("Plugin '%s' initialized on demand.\n", plugin->data->name);
+   ToolsCore_MarkStartup(state, "plugin '%s' initialized on demand (%u ms)",
+                         plugin->data->name,
+                         (guint) (plugin->loadTime / 1000));
+
+   lazy->loaded = TRUE;
+   ToolsCoreForEachApp(state, plugin, ToolsCoreRegisterProvider);
+   ToolsCoreForEachApp(state, plugin, ToolsCoreRegisterApp);
+   ToolsCoreReportLazyCapabilities(lazy, plugin);
+   return TRUE;
+}
+
+
+/**
+ * Placeholder for an RPC handled by a plugin that isn't loaded yet. Loads
+ * the plugin, which replaces the placeholder with its own handler, and
+ * dispatches the RPC again.
+ *
+ * @param[in]  data     The RPC data.
+ *
+ * @return Whether the RPC was handled successfully.
+ */
+
+static gboolean
+ToolsCoreLazyRpc(RpcInData *data)
+{
+   ToolsLazyPlugin *lazy = data->clientData;
+   size_t nameLen = strlen(data->name);
+
+   if (!ToolsCoreLoadLazyPlugin(lazy, 0)) {
+      return RPCIN_SETRETVALS(data, "Plugin failed to load", FALSE);
+   }
+
+   /* Undo RpcChannel_Dispatch's adjustment of the arguments. */
+   data->args -= nameLen;
+   data->argsSize += nameLen;
+   data->clientData = lazy->state->ctx.rpc;
+   return RpcChannel_Dispatch(data);
+}
+
+
+/**
+ * Emission hook for a signal handled by a plugin that isn't loaded yet.
+ * Loads the plugin; the emission hooks of a signal run before its handlers,
+ * so the handlers the plugin connects see the emission that loaded it.
+ *
+ * @param[in]  ihint    Signal invocation hint.
+ * @param[in]  nParams  Unused.
+ * @param[in]  params   Unused.
+ * @param[in]  data     The plugin.
+ *
+ * @return FALSE, to remove the hook.
+ */
+
+static gboolean
+ToolsCoreLazySignalHook(GSignalInvocationHint *ihint,
+                        guint nParams,
+                        const GValue *params,
+                        gpointer data)
+{
+   ToolsCoreLoadLazyPlugin(data, ihint->signal_id);
+   return FALSE;
+}
+
+
+/**
+ * Reports the capabilities from the manifest of a plugin that isn't loaded.
+ * Once loaded, the plugin reports its own.
+ *
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      Unused.
+ * @param[in]  set      Whether capabilities are being set.
+ * @param[in]  data     The plugin.
+ *
+ * @return A copy of the manifest's capabilities, or NULL.
+ */
+
+static GArray *
+ToolsCoreLazyCapabilities(gpointer src,
+                          ToolsAppCtx *ctx,
+                          gboolean set,
+                          gpointer data)
+{
+   ToolsLazyPlugin *lazy = data;
+   GArray *caps;
+
+   if (lazy->loaded || (lazy->tried && set)) {
+      return NULL;
+   }
+
+   caps = g_array_sized_new(FALSE, TRUE, sizeof (ToolsAppCapability),
+                            lazy->caps->len);
+   g_array_append_vals(caps, lazy->caps->data, lazy->caps->len);
+   return caps;
+}
+
+
+/**
+ * Registers the placeholders that load a plugin when one of the RPCs or
+ * signals in its manifest is first used.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  lazy     The plugin.
+ */
+
+static void
+ToolsCoreArmLazyPlugin(ToolsServiceState *state,
+                       ToolsLazyPlugin *lazy)
+{
+   guint i;
+
+   lazy->state = state;
+
+   for (i = 0; state->ctx.rpc != NULL &&
+               lazy->rpcNames != NULL && lazy->rpcNames[i] != NULL; i++) {
+      RpcChannelCallback rpc = { NULL, ToolsCoreLazyRpc, lazy, NULL, NULL, 0 };
+      rpc.name = g_strstrip(lazy->rpcNames[i]);
+      if (*rpc.name != '\0') {
+         g_array_append_val(lazy->rpcs, rpc);
+      }
+   }
+
+   /* Register once the array is complete, since it may move as it grows. */
+   for (i = 0; i < lazy->rpcs->len; i++) {
+      RpcChannel_RegisterCallback(state->ctx.rpc,
+                                  &g_array_index(lazy->rpcs,
+                                                 RpcChannelCallback, i));
+   }
+
+   for (i = 0; lazy->sigNames != NULL && lazy->sigNames[i] != NULL; i++) {
+      const gchar *signame = g_strstrip(lazy->sigNames[i]);
+      ToolsLazyHook hook;
+      GQuark detail;
+      guint k;
+
+      /*
+       * Capabilities come from the manifest, and a plugin that isn't loaded
+       * has no state to dump or shut down.
+       */
+      if (strcmp(signame, TOOLS_CORE_SIG_CAPABILITIES) == 0 ||
+          strcmp(signame, TOOLS_CORE_SIG_DUMP_STATE) == 0 ||
+          strcmp(signame, TOOLS_CORE_SIG_SHUTDOWN) == 0) {
+         g_debug("Plugin '%s' doesn't need to be loaded for signal '%s'.\n",
+                 lazy->name, signame);
+         continue;
+      }
+
+      if (!g_signal_parse_name(signame, G_OBJECT_TYPE(state->ctx.serviceObj),
+                               &hook.sigId, &detail, FALSE)) {
+         g_warning("Plugin '%s' declares unknown signal '%s'.\n", lazy->name,
+                   signame);
+         continue;
+      }
+
+      for (k = 0; k < lazy->hooks->len; k++) {
+         if (g_array_index(lazy->hooks, ToolsLazyHook, k).sigId == hook.sigId) {
+            break;
+         }
+      }
+      if (k < lazy->hooks->len) {
+         continue;
+      }
+
+      hook.hookId = g_signal_add_emission_hook(hook.sigId, detail,
+                                               ToolsCoreLazySignalHook,
+                                               lazy, NULL);
+      g_array_append_val(lazy->hooks, hook);
+   }
+
+   if (lazy->caps->len > 0) {
+      lazy->capsHandler = g_signal_connect(state->ctx.serviceObj,
+                                           TOOLS_CORE_SIG_CAPABILITIES,
+                                           G_CALLBACK(ToolsCoreLazyCapabilities),
+                                           lazy);
+   }
+
+   g_message("Plugin '%s' will be loaded on demand.\n", lazy->name);
+}
+
+
 /**
  * State dump callback for logging information about loaded plugins.
  *
@@ -611,11 +1409,22 @@ exit:
 void
 ToolsCore_DumpPluginInfo(ToolsServiceState *state)
 {
+   guint i;
+
    if (state->plugins == NULL) {
       g_message("   No plugins loaded.");
    } else {
       ToolsCoreForEachPlugin(state, ToolsCoreDumpPluginInfo, ToolsCoreDumpAppInfo);
    }
+
+   for (i = 0; state->lazyPlugins != NULL && i < state->lazyPlugins->len; i++) {
+      ToolsLazyPlugin *lazy = g_ptr_array_index(state->lazyPlugins, i);
+      if (!lazy->loaded) {
+         ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                            "Plugin: %s (%s)\n", lazy->name,
+                            lazy->tried ? "failed to load" : "not loaded yet");
+      }
+   }
 }
 
 
@@ -624,6 +1433,10 @@ ToolsCore_DumpPluginInfo(ToolsServiceState *state)
  * is NULL, then default directories are used in case the service is either
  * the main tools service of the user daemon, otherwise failure is returned.
  *
+ * When "plugins.lazyLoad" is set in the service's configuration, plugins
+ * that have a manifest are not loaded until one of the RPCs or signals
+ * they declare is first used.
+ *
  * @param[in]  state    The service state.
  *
  * @return Whether loading the plugins was successful.
@@ -635,8 +1448,8 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    gboolean pluginDirExists;
    gboolean ret = FALSE;
    gchar *pluginRoot;
-   guint i;
    GPtrArray *plugins = NULL;
+   GPtrArray *lazyPlugins = NULL;
 
 #if defined(sun) && defined(__x86_64__)
    const char *subdir = "/amd64";
@@ -673,6 +1486,12 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
 
    plugins = g_ptr_array_new();
 
+   if (g_key_file_get_boolean(state->ctx.config, state->name,
+                              "plugins.lazyLoad", NULL)) {
+      state->lazyPlugins = g_ptr_array_new();
+      lazyPlugins = state->lazyPlugins;
+   }
+
    /*
     * First, load plugins from the common directory. The common directory
     * is not required to exist unless provided on the command line.
@@ -689,7 +1508,8 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    }
 
    if (g_file_test(state->commonPath, G_FILE_TEST_IS_DIR) &&
-       !ToolsCoreLoadDirectory(&state->ctx, state->commonPath, plugins)) {
+       !ToolsCoreLoadDirectory(&state->ctx, state->commonPath, plugins,
+                               lazyPlugins)) {
       goto exit;
    }
 
@@ -713,7 +1533,8 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    }
 
    if (pluginDirExists &&
-       !ToolsCoreLoadDirectory(&state->ctx, state->pluginPath, plugins)) {
+       !ToolsCoreLoadDirectory(&state->ctx, state->pluginPath, plugins,
+                               lazyPlugins)) {
       goto exit;
    }
 
@@ -721,30 +1542,10 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    /*
     * All plugins are loaded, now initialize them.
     */
+   ToolsCore_MarkStartup(state, "plugin modules opened");
 
    state->plugins = g_ptr_array_new();
-
-   for (i = 0; i < plugins->len; i++) {
-      ToolsPlugin *plugin = g_ptr_array_index(plugins, i);
-
-      plugin->data = plugin->onload(&state->ctx);
-
-      if (plugin->data == NULL) {
-         g_info("Plugin '%s' didn't provide deployment data, unloading.\n",
-                plugin->fileName);
-         ToolsCoreFreePlugin(plugin);
-      } else if (state->ctx.errorCode != 0) {
-         /* Break early if a plugin has requested the container to quit. */
-         ToolsCoreFreePlugin(plugin);
-         break;
-      } else {
-         ASSERT(plugin->data->name != NULL);
-         g_module_make_resident(plugin->module);
-         g_ptr_array_add(state->plugins, plugin);
-         VMTools_BindTextDomain(plugin->data->name, NULL, NULL);
-         g_message("Plugin '%s' initialized.\n", plugin->data->name);
-      }
-   }
+   ToolsCoreInitPlugins(state, plugins);
 
 
    /*
@@ -772,6 +1573,30 @@ exit:
 }
 
 
+/**
+ * Emission hook that records the first emission of a service signal in the
+ * startup timeline.
+ *
+ * @param[in]  ihint    Signal invocation hint.
+ * @param[in]  nParams  Unused.
+ * @param[in]  params   Unused.
+ * @param[in]  data     The service state.
+ *
+ * @return FALSE, to remove the hook.
+ */
+
+static gboolean
+ToolsCoreFirstSignalHook(GSignalInvocationHint *ihint,
+                         guint nParams,
+                         const GValue *params,
+                         gpointer data)
+{
+   ToolsCore_MarkStartup(data, "first '%s' signal",
+                         g_signal_name(ihint->signal_id));
+   return FALSE;
+}
+
+
 /**
  * Registers all RPC handlers provided by the loaded and enabled plugins.
  *
@@ -783,6 +1608,9 @@ ToolsCore_RegisterPlugins(ToolsServiceState *state)
 {
    ToolsAppProvider *fakeProv;
    ToolsAppProviderReg fakeReg;
+   guint *sigIds;
+   guint nSigIds;
+   guint i;
 
    if (state->plugins == NULL) {
       return;
@@ -852,6 +1680,22 @@ ToolsCore_RegisterPlugins(ToolsServiceState *state)
     * individual app providers as necessary.
     */
    ToolsCoreForEachPlugin(state, NULL, ToolsCoreRegisterApp);
+
+   /*
+    * Finally, set up the RPCs and signals that load the remaining plugins
+    * when they're needed.
+    */
+   for (i = 0; state->lazyPlugins != NULL && i < state->lazyPlugins->len; i++) {
+      ToolsCoreArmLazyPlugin(state, g_ptr_array_index(state->lazyPlugins, i));
+   }
+
+   /* Record when plugins first hear from each of the service's signals. */
+   sigIds = g_signal_list_ids(G_OBJECT_TYPE(state->ctx.serviceObj), &nSigIds);
+   for (i = 0; i < nSigIds; i++) {
+      g_signal_add_emission_hook(sigIds[i], 0, ToolsCoreFirstSignalHook,
+                                 state, NULL);
+   }
+   g_free(sigIds);
 }
 
 
@@ -893,6 +1737,18 @@ ToolsCore_UnloadPlugins(ToolsServiceState *state)
       }
    }
 
+   /*
+    * Plugins that were never loaded have nothing to shut down; make sure
+    * none gets loaded from now on.
+    */
+   if (state->lazyPlugins != NULL) {
+      for (i = 0; i < state->lazyPlugins->len; i++) {
+         ToolsCoreFreeLazyPlugin(g_ptr_array_index(state->lazyPlugins, i));
+      }
+      g_ptr_array_free(state->lazyPlugins, TRUE);
+      state->lazyPlugins = NULL;
+   }
+
    /*
     * Stop all app providers, and free the memory we allocated for the
     * internal app providers.
@@ -25,6 +25,7 @@
 #include <limits.h>
 #include <string.h>
 #include "vmware.h"
+#include "hostinfo.h"
 #include "toolsCoreInt.h"
 #include "serviceObj.h"
 #include "vmware/tools/threadPool.h"
@@ -33,24 +34,41 @@
 #define DEFAULT_MAX_THREADS         5
 #define DEFAULT_MAX_UNUSED_THREADS  0
 
+/* Queue-wait and run-time statistics of a priority class, in microseconds. */
+typedef struct PoolClassStats {
+   guint64        completed;
+   guint64        waitTotal;
+   guint64        waitMax;
+   guint64        runTotal;
+   guint64        runMax;
+} PoolClassStats;
+
+
 typedef struct ThreadPoolState {
    ToolsCorePool  funcs;
    gboolean       active;
    ToolsAppCtx   *ctx;
    GThreadPool   *pool;
-   GQueue        *workQueue;
+   GQueue        *workQueues[TOOLS_CORE_POOL_PRIORITY_MAX];
    GPtrArray     *threads;
    GMutex        *lock;
    guint          nextWorkId;
+   gint           maxThreads;
+   guint          bgRunning;    /* Normal and low priority tasks running. */
+   guint          bgLimit;      /* Max. normal and low priority tasks running. */
+   guint          running[TOOLS_CORE_POOL_PRIORITY_MAX];
+   PoolClassStats stats[TOOLS_CORE_POOL_PRIORITY_MAX];
 } ThreadPoolState;
 
 
 typedef struct WorkerTask {
-   guint             id;
-   guint             srcId;
-   ToolsCorePoolCb   cb;
-   gpointer          data;
-   GDestroyNotify    dtor;
+   guint                   id;
+   guint                   srcId;
+   ToolsCorePoolPriority   priority;
+   VmTimeType              queuedAt;
+   ToolsCorePoolCb         cb;
+   gpointer                data;
+   GDestroyNotify          dtor;
 } WorkerTask;
 
 
@@ -151,7 +169,7 @@ ToolsCorePoolDestroyTask(gpointer data)
  *******************************************************************************
  * ToolsCorePoolDoWork --                                                 */ /**
  *
- * Execute a work item.
+ * Execute a work item, accounting for the time it spent queued and running.
  *
  * @param[in] data   A WorkerTask.
  *
@@ -164,6 +182,9 @@ static gboolean
 ToolsCorePoolDoWork(gpointer data)
 {
    WorkerTask *work = data;
+   PoolClassStats *stats = &gState.stats[work->priority];
+   VmTimeType start;
+   VmTimeType end;
 
    /*
     * In single threaded mode, remove the task being executed from the queue.
@@ -171,11 +192,22 @@ ToolsCorePoolDoWork(gpointer data)
     */
    if (gState.pool == NULL) {
       g_mutex_lock(gState.lock);
-      g_queue_remove(gState.workQueue, work);
+      g_queue_remove(gState.workQueues[work->priority], work);
       g_mutex_unlock(gState.lock);
    }
 
+   start = Hostinfo_SystemTimerUS();
    work->cb(gState.ctx, work->data);
+   end = Hostinfo_SystemTimerUS();
+
+   g_mutex_lock(gState.lock);
+   stats->completed++;
+   stats->waitTotal += start - work->queuedAt;
+   stats->waitMax = MAX(stats->waitMax, (guint64)(start - work->queuedAt));
+   stats->runTotal += end - start;
+   stats->runMax = MAX(stats->runMax, (guint64)(end - start));
+   g_mutex_unlock(gState.lock);
+
    return FALSE;
 }
 
@@ -238,12 +270,60 @@ ToolsCorePoolRunThread(gpointer data)
 }
 
 
+/*
+ *******************************************************************************
+ * ToolsCorePoolNextTask --                                               */ /**
+ *
+ * Dequeues the oldest task of the highest priority class that has one. Normal
+ * and low priority tasks are only handed out while fewer than bgLimit of them
+ * are running, which keeps a worker available for high priority tasks.
+ *
+ * Must be called with the pool lock held.
+ *
+ * @return The task to run, or NULL.
+ *
+ *******************************************************************************
+ */
+
+static WorkerTask *
+ToolsCorePoolNextTask(void)
+{
+   guint i;
+
+   for (i = 0; i < TOOLS_CORE_POOL_PRIORITY_MAX; i++) {
+      WorkerTask *work;
+
+      if (g_queue_is_empty(gState.workQueues[i])) {
+         continue;
+      }
+
+      if (i != TOOLS_CORE_POOL_PRIORITY_HIGH) {
+         if (gState.bgRunning >= gState.bgLimit) {
+            break;
+         }
+         gState.bgRunning++;
+      }
+
+      work = g_queue_pop_tail(gState.workQueues[i]);
+      gState.running[i]++;
+      return work;
+   }
+
+   return NULL;
+}
+
+
 /*
  *******************************************************************************
  * ToolsCorePoolRunWorker --                                              */ /**
  *
- * Thread pool callback function. Dequeues the next work item from the work
- * queue and execute it.
+ * Thread pool callback function. Executes queued work items, highest
+ * priority first, until there is nothing left this worker may run.
+ *
+ * Every submitted task pushes one item to the GThreadPool, but the item does
+ * not own the task: a worker keeps dequeuing after finishing a task, so a
+ * task held back because all background slots were busy is picked up by the
+ * first worker that frees one. An item may thus find nothing left to do.
  *
  * @param[in] state        Description of state.
  * @param[in] clientData   Description of clientData.
@@ -258,28 +338,36 @@ ToolsCorePoolRunWorker(gpointer state,
    WorkerTask *work;
 
    g_mutex_lock(gState.lock);
-   work = g_queue_pop_tail(gState.workQueue);
-   g_mutex_unlock(gState.lock);
+   while ((work = ToolsCorePoolNextTask()) != NULL) {
+      ToolsCorePoolPriority priority = work->priority;
 
-   ASSERT(work != NULL);
+      g_mutex_unlock(gState.lock);
+      ToolsCorePoolDoWork(work);
+      ToolsCorePoolDestroyTask(work);
+      g_mutex_lock(gState.lock);
 
-   ToolsCorePoolDoWork(work);
-   ToolsCorePoolDestroyTask(work);
+      gState.running[priority]--;
+      if (priority != TOOLS_CORE_POOL_PRIORITY_HIGH) {
+         gState.bgRunning--;
+      }
+   }
+   g_mutex_unlock(gState.lock);
 }
 
 
 /*
  *******************************************************************************
- * ToolsCorePoolSubmit --                                                 */ /**
+ * ToolsCorePoolSubmitPriority --                                         */ /**
  *
  * Submits a new task for execution in one of the shared worker threads.
  *
- * @see ToolsCorePool_SubmitTask()
+ * @see ToolsCorePool_SubmitTaskPriority()
  *
- * @param[in] ctx    Application context.
- * @param[in] cb     Function to execute the task.
- * @param[in] data   Opaque data for the task.
- * @param[in] dtor   Destructor for the task data.
+ * @param[in] ctx       Application context.
+ * @param[in] priority  Priority class of the task.
+ * @param[in] cb        Function to execute the task.
+ * @param[in] data      Opaque data for the task.
+ * @param[in] dtor      Destructor for the task data.
  *
  * @return New task's ID, or 0 on error.
  *
@@ -287,15 +375,22 @@ ToolsCorePoolRunWorker(gpointer state,
  */
 
 static guint
-ToolsCorePoolSubmit(ToolsAppCtx *ctx,
-                    ToolsCorePoolCb cb,
-                    gpointer data,
-                    GDestroyNotify dtor)
+ToolsCorePoolSubmitPriority(ToolsAppCtx *ctx,
+                            ToolsCorePoolPriority priority,
+                            ToolsCorePoolCb cb,
+                            gpointer data,
+                            GDestroyNotify dtor)
 {
    guint id = 0;
-   WorkerTask *task = g_malloc0(sizeof *task);
+   gint idlePriority;
+   WorkerTask *task;
 
+   g_return_val_if_fail(priority < TOOLS_CORE_POOL_PRIORITY_MAX, 0);
+
+   task = g_malloc0(sizeof *task);
    task->srcId = 0;
+   task->priority = priority;
+   task->queuedAt = Hostinfo_SystemTimerUS();
    task->cb = cb;
    task->data = data;
    task->dtor = dtor;
@@ -328,7 +423,7 @@ ToolsCorePoolSubmit(ToolsAppCtx *ctx,
     * that it can be canceled. In single threaded mode, it's unlikely someone
     * will be able to cancel it before it runs, but they can try.
     */
-   g_queue_push_head(gState.workQueue, task);
+   g_queue_push_head(gState.workQueues[priority], task);
 
    if (gState.pool != NULL) {
       GError *err = NULL;
@@ -345,7 +440,20 @@ ToolsCorePoolSubmit(ToolsAppCtx *ctx,
    }
 
    /* Run the task in the service's thread. */
-   task->srcId = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
+   switch (priority) {
+   case TOOLS_CORE_POOL_PRIORITY_HIGH:
+      idlePriority = G_PRIORITY_HIGH_IDLE;
+      break;
+
+   case TOOLS_CORE_POOL_PRIORITY_LOW:
+      idlePriority = G_PRIORITY_LOW;
+      break;
+
+   default:
+      idlePriority = G_PRIORITY_DEFAULT_IDLE;
+      break;
+   }
+   task->srcId = g_idle_add_full(idlePriority,
                                  ToolsCorePoolDoWork,
                                  task,
                                  ToolsCorePoolDestroyTask);
@@ -356,6 +464,36 @@ exit:
 }
 
 
+/*
+ *******************************************************************************
+ * ToolsCorePoolSubmit --                                                 */ /**
+ *
+ * Submits a new normal priority task for execution in one of the shared
+ * worker threads.
+ *
+ * @see ToolsCorePool_SubmitTask()
+ *
+ * @param[in] ctx    Application context.
+ * @param[in] cb     Function to execute the task.
+ * @param[in] data   Opaque data for the task.
+ * @param[in] dtor   Destructor for the task data.
+ *
+ * @return New task's ID, or 0 on error.
+ *
+ *******************************************************************************
+ */
+
+static guint
+ToolsCorePoolSubmit(ToolsAppCtx *ctx,
+                    ToolsCorePoolCb cb,
+                    gpointer data,
+                    GDestroyNotify dtor)
+{
+   return ToolsCorePoolSubmitPriority(ctx, TOOLS_CORE_POOL_PRIORITY_NORMAL,
+                                      cb, data, dtor);
+}
+
+
 /*
  *******************************************************************************
  * ToolsCorePoolCancel --                                                 */ /**
@@ -375,6 +513,7 @@ ToolsCorePoolCancel(guint id)
    GList *taskLnk;
    WorkerTask *task = NULL;
    WorkerTask search = { id, };
+   guint i;
 
    g_return_if_fail(id != 0);
 
@@ -383,10 +522,14 @@ ToolsCorePoolCancel(guint id)
       goto exit;
    }
 
-   taskLnk = g_queue_find_custom(gState.workQueue, &search, ToolsCorePoolCompareTask);
-   if (taskLnk != NULL) {
-      task = taskLnk->data;
-      g_queue_delete_link(gState.workQueue, taskLnk);
+   for (i = 0; i < TOOLS_CORE_POOL_PRIORITY_MAX; i++) {
+      taskLnk = g_queue_find_custom(gState.workQueues[i], &search,
+                                    ToolsCorePoolCompareTask);
+      if (taskLnk != NULL) {
+         task = taskLnk->data;
+         g_queue_delete_link(gState.workQueues[i], taskLnk);
+         break;
+      }
    }
 
 exit:
@@ -459,6 +602,81 @@ exit:
 }
 
 
+/*
+ *******************************************************************************
+ * ToolsCorePool_DumpState --                                             */ /**
+ *
+ * Logs the thread pool's configuration, queue lengths and, for each priority
+ * class, how long its tasks waited in the queue and how long they ran.
+ *
+ *******************************************************************************
+ */
+
+void
+ToolsCorePool_DumpState(void)
+{
+   static const char *classNames[] = {
+      "high",
+      "normal",
+      "low",
+   };
+   guint i;
+
+   ASSERT_ON_COMPILE(ARRAYSIZE(classNames) == TOOLS_CORE_POOL_PRIORITY_MAX);
+
+   if (gState.lock == NULL) {
+      return;
+   }
+
+   g_mutex_lock(gState.lock);
+
+   ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                      "Thread pool: %d threads, %u for normal/low priority, "
+                      "%u dedicated\n",
+                      gState.maxThreads, gState.bgLimit, gState.threads->len);
+
+   for (i = 0; i < TOOLS_CORE_POOL_PRIORITY_MAX; i++) {
+      PoolClassStats *stats = &gState.stats[i];
+      guint64 done = MAX(stats->completed, 1);
+
+      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                         "%s priority: %u queued, %u running, "
+                         "%"G_GUINT64_FORMAT" done, "
+                         "wait avg %"G_GUINT64_FORMAT" max %"G_GUINT64_FORMAT" ms, "
+                         "run avg %"G_GUINT64_FORMAT" max %"G_GUINT64_FORMAT" ms\n",
+                         classNames[i],
+                         g_queue_get_length(gState.workQueues[i]),
+                         gState.running[i],
+                         stats->completed,
+                         stats->waitTotal / done / 1000,
+                         stats->waitMax / 1000,
+                         stats->runTotal / done / 1000,
+                         stats->runMax / 1000);
+   }
+
+   g_mutex_unlock(gState.lock);
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCorePool_IsThreaded --                                            */ /**
+ *
+ * Tells whether tasks submitted to the pool run in worker threads, as opposed
+ * to the service's main loop.
+ *
+ * @return TRUE if the pool has worker threads.
+ *
+ *******************************************************************************
+ */
+
+gboolean
+ToolsCorePool_IsThreaded(void)
+{
+   return gState.pool != NULL;
+}
+
+
 /*
  *******************************************************************************
  * ToolsCorePool_Init --                                                  */ /**
@@ -477,6 +695,7 @@ void
 ToolsCorePool_Init(ToolsAppCtx *ctx)
 {
    gint maxThreads;
+   guint i;
    GError *err = NULL;
 
    ToolsServiceProperty prop = { TOOLS_CORE_PROP_TPOOL };
@@ -484,6 +703,7 @@ ToolsCorePool_Init(ToolsAppCtx *ctx)
    gState.funcs.submit = ToolsCorePoolSubmit;
    gState.funcs.cancel = ToolsCorePoolCancel;
    gState.funcs.start = ToolsCorePoolStart;
+   gState.funcs.submitPriority = ToolsCorePoolSubmitPriority;
    gState.ctx = ctx;
 
    maxThreads = g_key_file_get_integer(ctx->config, ctx->name,
@@ -493,6 +713,13 @@ ToolsCorePool_Init(ToolsAppCtx *ctx)
       g_clear_error(&err);
    }
 
+   /*
+    * Keep one worker for high priority tasks whenever there is more than one.
+    * Otherwise, priorities only affect the order in which tasks run.
+    */
+   gState.maxThreads = MAX(maxThreads, 0);
+   gState.bgLimit = (maxThreads > 1) ? maxThreads - 1 : 1;
+
    if (maxThreads > 0) {
       gState.pool = g_thread_pool_new(ToolsCorePoolRunWorker,
                                       NULL, maxThreads, FALSE, &err);
@@ -528,7 +755,9 @@ ToolsCorePool_Init(ToolsAppCtx *ctx)
    gState.active = TRUE;
    gState.lock = g_mutex_new();
    gState.threads = g_ptr_array_new();
-   gState.workQueue = g_queue_new();
+   for (i = 0; i < TOOLS_CORE_POOL_PRIORITY_MAX; i++) {
+      gState.workQueues[i] = g_queue_new();
+   }
 
    ToolsCoreService_RegisterProperty(ctx->serviceObj, &prop);
    g_object_set(ctx->serviceObj, TOOLS_CORE_PROP_TPOOL, &gState.funcs, NULL);
@@ -577,18 +806,22 @@ ToolsCorePool_Shutdown(ToolsAppCtx *ctx)
    }
 
    /* Destroy all pending tasks. */
-   while (1) {
-      WorkerTask *task = g_queue_pop_tail(gState.workQueue);
-      if (task != NULL) {
-         ToolsCorePoolDestroyTask(task);
-      } else {
-         break;
+   for (i = 0; i < TOOLS_CORE_POOL_PRIORITY_MAX; i++) {
+      while (1) {
+         WorkerTask *task = g_queue_pop_tail(gState.workQueues[i]);
+         if (task != NULL) {
+            ToolsCorePoolDestroyTask(task);
+         } else {
+            break;
+         }
       }
    }
 
    /* Cleanup. */
    g_ptr_array_free(gState.threads, TRUE);
-   g_queue_free(gState.workQueue);
+   for (i = 0; i < TOOLS_CORE_POOL_PRIORITY_MAX; i++) {
+      g_queue_free(gState.workQueues[i]);
+   }
    g_mutex_free(gState.lock);
    memset(&gState, 0, sizeof gState);
    g_object_set(ctx->serviceObj, TOOLS_CORE_PROP_TPOOL, NULL, NULL);
@@ -71,11 +71,17 @@ typedef struct ToolsServiceState {
    gchar         *configFile;
    time_t         configMtime;
    guint          configCheckTask;
+#if defined(__linux__)
+   GIOChannel    *configWatch;
+   gchar         *configWatchName;
+#endif
    gboolean       mainService;
    gboolean       capsRegistered;
    gchar         *commonPath;
    gchar         *pluginPath;
    GPtrArray     *plugins;
+   GPtrArray     *lazyPlugins;
+   GArray        *timeline;
 #if defined(_WIN32)
    gchar         *displayName;
 #else
@@ -154,11 +160,47 @@ void
 ToolsCore_CFRunLoop(ToolsServiceState *state);
 #endif
 
+void
+ToolsCorePool_DumpState(void);
+
+void
+ToolsCoreLockStats_Enable(gboolean enable);
+
+gboolean
+ToolsCoreLockStats_SetOption(gpointer src,
+                             ToolsAppCtx *ctx,
+                             const gchar *option,
+                             const gchar *value,
+                             gpointer data);
+
+void
+ToolsCoreLockStats_DumpState(void);
+
+gboolean
+ToolsCorePool_IsThreaded(void);
+
+void
+ToolsCore_MarkStartup(ToolsServiceState *state,
+                      const gchar *fmt,
+                      ...) G_GNUC_PRINTF(2, 3);
+
+void
+ToolsCore_DumpStartup(ToolsServiceState *state);
+
 void
 ToolsCorePool_Init(ToolsAppCtx *ctx);
 
 void
 ToolsCorePool_Shutdown(ToolsAppCtx *ctx);
 
+void
+ToolsCoreMemBudget_DumpState(void);
+
+void
+ToolsCoreMemBudget_Init(ToolsAppCtx *ctx);
+
+void
+ToolsCoreMemBudget_Shutdown(ToolsAppCtx *ctx);
+
 #endif /* _TOOLSCOREINT_H_ */
 
@@ -44,6 +44,10 @@
 #include "vmci_sockets.h"
 #endif
 
+/* Backdoor poller defaults, matching the RPC channel library's own. */
+#define DEFAULT_RPC_MAX_POLL_DELAY 100
+#define DEFAULT_RPC_BUSY_POLLS     4
+
 /**
  * Take action after an RPC channel reset.
  *
@@ -218,6 +222,9 @@ ToolsCoreRpcCapReg(RpcInData *data)
       g_free(toolsVersion);
    }
 
+   if (!state->capsRegistered) {
+      ToolsCore_MarkStartup(state, "capabilities registered");
+   }
    state->capsRegistered = TRUE;
    free(confPath);
    return RPCIN_SETRETVALS(data, "", TRUE);
@@ -269,6 +276,41 @@ ToolsCoreRpcSetOption(RpcInData *data)
 }
 
 
+/**
+ * Configures how the RPC channel polls for messages when it has to use the
+ * backdoor: "rpc.maxPollDelay" is the longest time, in milliseconds, to sleep
+ * between polls, and "rpc.busyPolls" the number of empty polls after a
+ * message that are done at the shortest delay. vSocket channels don't poll.
+ *
+ * @param[in]  state    The service state.
+ */
+
+static void
+ToolsCoreRpcSetPollPolicy(ToolsServiceState *state)
+{
+   gint maxDelay;
+   gint busyPolls;
+   GError *err = NULL;
+
+   maxDelay = g_key_file_get_integer(state->ctx.config, state->name,
+                                     "rpc.maxPollDelay", &err);
+   if (err != NULL || maxDelay <= 0) {
+      maxDelay = DEFAULT_RPC_MAX_POLL_DELAY;
+      g_clear_error(&err);
+   }
+
+   busyPolls = g_key_file_get_integer(state->ctx.config, state->name,
+                                      "rpc.busyPolls", &err);
+   if (err != NULL || busyPolls < 0) {
+      busyPolls = DEFAULT_RPC_BUSY_POLLS;
+      g_clear_error(&err);
+   }
+
+   /* The channel counts its delays in hundredths of a second. */
+   RpcChannel_SetPollPolicy((maxDelay + 9) / 10, busyPolls);
+}
+
+
 /**
  * Initializes the RPC channel. Currently this instantiates an RpcIn loop.
  * This function should only be called once.
@@ -311,6 +353,7 @@ ToolsCore_InitRpc(ToolsServiceState *state)
                 state->name);
          state->ctx.rpc = NULL;
       } else {
+         ToolsCoreRpcSetPollPolicy(state);
          state->ctx.rpc = RpcChannel_New();
       }
       app = ToolsCore_GetTcloName(state);
@@ -340,6 +383,67 @@ ToolsCore_InitRpc(ToolsServiceState *state)
 }
 
 
+/**
+ * Completion callback for capabilities sent with ToolsCoreSendCapability().
+ *
+ * @param[in]  chan        The RPC channel.
+ * @param[in]  status      Whether the host accepted the capability.
+ * @param[in]  result      Reply from the host.
+ * @param[in]  resultLen   Length of the reply.
+ * @param[in]  data        Name of the capability.
+ */
+
+static void
+ToolsCoreCapabilitySent(RpcChannel *chan,
+                        gboolean status,
+                        const char *result,
+                        size_t resultLen,
+                        gpointer data)
+{
+   if (!status) {
+      g_warning("Error sending capability %s: %s\n", (gchar *) data,
+                result != NULL ? result : "");
+   }
+   g_free(data);
+}
+
+
+/**
+ * Sends a capability to the host. When setting capabilities, the RPCs are
+ * sent asynchronously so that channels that support it can pipeline them
+ * instead of waiting for each reply in turn; unsetting happens during
+ * shutdown, when the main loop will not run the completions anymore.
+ *
+ * @param[in]  chan     The RPC channel.
+ * @param[in]  name     Name of the capability, for logging.
+ * @param[in]  msg      The RPC message.
+ * @param[in]  msgLen   Length of the message.
+ * @param[in]  async    Whether to send the message asynchronously.
+ */
+
+static void
+ToolsCoreSendCapability(RpcChannel *chan,
+                        const gchar *name,
+                        const gchar *msg,
+                        size_t msgLen,
+                        gboolean async)
+{
+   char *result = NULL;
+   size_t resultLen;
+
+   if (async) {
+      RpcChannel_SendAsync(chan, msg, msgLen, ToolsCoreCapabilitySent,
+                           g_strdup(name));
+      return;
+   }
+
+   if (!RpcChannel_Send(chan, msg, msgLen, &result, &resultLen)) {
+      g_warning("Error sending capability %s: %s\n", name, result);
+   }
+   vm_free(result);
+}
+
+
 /**
  * Sends a list of capabilities to the host.
  *
@@ -363,14 +467,10 @@ ToolsCore_SetCapabilities(RpcChannel *chan,
       ToolsAppCapability *cap =  &g_array_index(caps, ToolsAppCapability, i);
       switch (cap->type) {
       case TOOLS_CAP_OLD:
-         result = NULL;
          tmp = g_strdup_printf("tools.capability.%s %u",
                                cap->name,
                                set ? cap->value : 0);
-         if (!RpcChannel_Send(chan, tmp, strlen(tmp) + 1, &result, &resultLen)) {
-            g_warning("Error sending capability %s: %s\n", cap->name, result);
-         }
-         vm_free(result);
+         ToolsCoreSendCapability(chan, cap->name, tmp, strlen(tmp) + 1, set);
          g_free(tmp);
          break;
 
@@ -385,10 +485,7 @@ ToolsCore_SetCapabilities(RpcChannel *chan,
           */
          if (set) {
             tmp = g_strdup_printf("tools.capability.%s ", cap->name);
-            if (!RpcChannel_Send(chan, tmp, strlen(tmp), &result, &resultLen)) {
-               g_warning("Error sending capability %s: %s\n", cap->name, result);
-            }
-            vm_free(result);
+            ToolsCoreSendCapability(chan, cap->name, tmp, strlen(tmp), set);
             g_free(tmp);
          }
          break;
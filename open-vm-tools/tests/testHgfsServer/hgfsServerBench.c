@@ -0,0 +1,1199 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsServerBench.c --
+ *
+ *   Benchmark for the HGFS server. Packets are handed straight to the
+ *   server session receive callback through an in-memory channel, so the
+ *   numbers reflect the server request processing only, without any
+ *   backdoor or VMCI transport cost.
+ *
+ *   Synthetic workloads operate on files below a temporary directory which
+ *   is reached through the guest "root" share. A packet stream can also be
+ *   recorded with -o and played back later with -r. Replayed streams should
+ *   be recorded against a fresh server instance so that the file and search
+ *   handles they contain are handed out again in the same order.
+ */
+
+#if !defined(__linux__)
+# error "hgfsServerBench.c needs to be ported to your OS."
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "vmware.h"
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsServerPolicy.h"
+#include "hostinfo.h"
+#include "util.h"
+#include "str.h"
+
+#define BENCH_REPLY_SIZE            HGFS_LARGE_PACKET_MAX
+#define BENCH_IO_SIZE               HGFS_LARGE_IO_MAX
+#define BENCH_SMALL_WRITE_SIZE      4096
+
+#define BENCH_DEFAULT_FILES         1000
+#define BENCH_DEFAULT_READ_MB       64
+#define BENCH_DEFAULT_WRITES        10000
+#define BENCH_RANDWRITE_FILE_SIZE   (16 * 1024 * 1024)
+
+#define BENCH_META_DIR              "meta"
+#define BENCH_SEQREAD_FILE          "seqread.dat"
+#define BENCH_RANDWRITE_FILE        "randwrite.dat"
+
+#define BENCH_ARGS(ctx)             ((ctx)->request + sizeof (HgfsHeader))
+#define BENCH_REPLY_ARGS(ctx)       ((ctx)->reply + sizeof (HgfsHeader))
+
+typedef struct BenchContext {
+   HgfsServerCallbacks *serverCb;        /* Server session callbacks. */
+   void *serverSession;                  /* Transport session of the server. */
+   uint64 sessionId;                     /* HGFS session created at startup. */
+   uint32 requestId;                     /* Next request id. */
+   char *request;                        /* Request packet being built. */
+   char *reply;                          /* Reply packet written by the server. */
+   size_t replyLen;                      /* Set by the send callback. */
+   char *shareDir;                       /* Local directory holding the files. */
+   FILE *recordFile;                     /* Stream of dispatched packets or NULL. */
+} BenchContext;
+
+typedef struct BenchResult {
+   const char *name;
+   VmTimeType *latencies;                /* Per request latency in us. */
+   uint32 count;
+   uint32 size;
+   uint32 errors;
+   uint64 bytes;                         /* File payload moved by the workload. */
+   VmTimeType startUS;
+   VmTimeType elapsedUS;
+} BenchResult;
+
+typedef Bool (*BenchWorkloadFunc)(BenchContext *ctx, BenchResult *result);
+
+static uint32 gNumFiles = BENCH_DEFAULT_FILES;
+static uint32 gReadMB = BENCH_DEFAULT_READ_MB;
+static uint32 gNumWrites = BENCH_DEFAULT_WRITES;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchChannelSend --
+ *
+ *    In-memory channel send callback: records the reply size and completes
+ *    the send right away.
+ *
+ * Results:
+ *    Always TRUE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchChannelSend(void *opaqueSession,   // IN: our context
+                 HgfsPacket *packet,    // IN/OUT: packet with the reply
+                 HgfsSendFlags flags)   // IN: send flags
+{
+   BenchContext *ctx = opaqueSession;
+
+   ASSERT(packet->replyPacket == ctx->reply);
+   ASSERT(packet->replyPacketDataSize <= BENCH_REPLY_SIZE);
+
+   ctx->replyLen = packet->replyPacketDataSize;
+
+   if (!(flags & HGFS_SEND_NO_COMPLETE)) {
+      ctx->serverCb->session.sendComplete(packet, ctx->serverSession);
+   }
+
+   return TRUE;
+}
+
+
+static HgfsServerChannelCallbacks gBenchChannelCb = {
+   NULL,                  // getReadVa: requests live in our own memory
+   NULL,                  // getWriteVa
+   NULL,                  // putVa
+   BenchChannelSend,
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchResultAdd --
+ *
+ *    Records the outcome of a single request.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Grows the latency array as needed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchResultAdd(BenchResult *result,     // IN/OUT:
+               HgfsStatus status,       // IN: reply status
+               VmTimeType latencyUS)    // IN:
+{
+   if (result->count == result->size) {
+      result->size = result->size == 0 ? 1024 : result->size * 2;
+      result->latencies = Util_SafeRealloc(result->latencies,
+                                           result->size *
+                                           sizeof *result->latencies);
+   }
+   result->latencies[result->count++] = latencyUS;
+   if (HGFS_STATUS_SUCCESS != status) {
+      result->errors++;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchDispatch --
+ *
+ *    Hands a complete request packet to the server and waits for the reply.
+ *    Requests are processed synchronously since the channel does not
+ *    advertise HGFS_CHANNEL_ASYNC.
+ *
+ * Results:
+ *    Reply status, HGFS_STATUS_PROTOCOL_ERROR if no usable reply came back.
+ *
+ * Side effects:
+ *    Appends the packet to the record file, if any.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchDispatch(BenchContext *ctx,        // IN:
+              char *packetIn,           // IN: request packet
+              size_t packetInSize,      // IN: request size
+              BenchResult *result)      // IN/OUT/OPT: latency collection
+{
+   HgfsPacket packet;
+   VmTimeType start;
+   VmTimeType latency;
+   HgfsStatus status;
+
+   if (NULL != ctx->recordFile) {
+      uint32 recordLen = (uint32)packetInSize;
+
+      if (fwrite(&recordLen, sizeof recordLen, 1, ctx->recordFile) != 1 ||
+          fwrite(packetIn, packetInSize, 1, ctx->recordFile) != 1) {
+         fprintf(stderr, "Failed to record packet: %s\n", strerror(errno));
+         fclose(ctx->recordFile);
+         ctx->recordFile = NULL;
+      }
+   }
+
+   memset(&packet, 0, sizeof packet);
+   packet.iov[0].va = packetIn;
+   packet.iov[0].len = (uint32)packetInSize;
+   packet.iovCount = 1;
+   packet.metaPacket = packetIn;
+   packet.metaPacketDataSize = packetInSize;
+   packet.metaPacketSize = packetInSize;
+   packet.replyPacket = ctx->reply;
+   packet.replyPacketSize = BENCH_REPLY_SIZE;
+   packet.state |= HGFS_STATE_CLIENT_REQUEST;
+
+   ctx->replyLen = 0;
+   start = Hostinfo_SystemTimerUS();
+   ctx->serverCb->session.receive(&packet, ctx->serverSession);
+   latency = Hostinfo_SystemTimerUS() - start;
+
+   if (ctx->replyLen < sizeof (HgfsHeader)) {
+      status = HGFS_STATUS_PROTOCOL_ERROR;
+   } else {
+      status = ((HgfsHeader *)ctx->reply)->status;
+   }
+
+   if (NULL != result) {
+      BenchResultAdd(result, status, latency);
+   }
+
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchSend --
+ *
+ *    Fills in the session header for the arguments already placed at
+ *    BENCH_ARGS and dispatches the request.
+ *
+ * Results:
+ *    Reply status.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchSend(BenchContext *ctx,    // IN:
+          HgfsOp op,            // IN: request opcode
+          size_t argsSize,      // IN: size of the request arguments
+          BenchResult *result)  // IN/OUT/OPT: latency collection
+{
+   HgfsHeader *header = (HgfsHeader *)ctx->request;
+
+   ASSERT(sizeof *header + argsSize <= BENCH_REPLY_SIZE);
+
+   memset(header, 0, sizeof *header);
+   header->version = HGFS_HEADER_VERSION;
+   header->dummy = HGFS_OP_NEW_HEADER;
+   header->packetSize = (uint32)(sizeof *header + argsSize);
+   header->headerSize = sizeof *header;
+   header->requestId = ctx->requestId++;
+   header->op = op;
+   header->flags = HGFS_PACKET_FLAG_REQUEST;
+   header->sessionId = ctx->sessionId;
+
+   return BenchDispatch(ctx, ctx->request, header->packetSize, result);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchFileName --
+ *
+ *    Converts a path relative to the share directory into an HGFS V3 file
+ *    name on the guest "root" share: the share name followed by each
+ *    component of the absolute local path, all NUL separated.
+ *
+ * Results:
+ *    Size of the file name structure including the name.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static size_t
+BenchFileName(BenchContext *ctx,          // IN:
+              const char *relPath,        // IN/OPT: path below the share dir
+              HgfsFileNameV3 *fileName)   // OUT:
+{
+   char *localPath;
+   char *component;
+   char *savePtr = NULL;
+   size_t len;
+
+   localPath = relPath == NULL ? Util_SafeStrdup(ctx->shareDir)
+                               : Str_SafeAsprintf(NULL, "%s/%s",
+                                                  ctx->shareDir, relPath);
+
+   len = Str_Strlen("root", HGFS_PACKET_MAX);
+   memcpy(fileName->name, "root", len);
+   for (component = strtok_r(localPath, "/", &savePtr);
+        component != NULL;
+        component = strtok_r(NULL, "/", &savePtr)) {
+      size_t compLen = strlen(component);
+
+      VERIFY(len + 1 + compLen < HGFS_PACKET_MAX);
+      fileName->name[len++] = '\0';
+      memcpy(fileName->name + len, component, compLen);
+      len += compLen;
+   }
+   fileName->name[len] = '\0';
+   free(localPath);
+
+   fileName->length = (uint32)len;
+   fileName->flags = 0;
+   fileName->caseType = HGFS_FILE_NAME_CASE_SENSITIVE;
+   fileName->fid = HGFS_INVALID_HANDLE;
+
+   return sizeof *fileName + len;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchOpen --
+ *
+ *    Opens a file below the share directory.
+ *
+ * Results:
+ *    Reply status, the server handle in *file on success.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchOpen(BenchContext *ctx,       // IN:
+          const char *relPath,     // IN: path below the share dir
+          HgfsOpenMode mode,       // IN:
+          HgfsOpenFlags flags,     // IN:
+          BenchResult *result,     // IN/OUT/OPT:
+          HgfsHandle *file)        // OUT:
+{
+   HgfsRequestOpenV3 *request = (HgfsRequestOpenV3 *)BENCH_ARGS(ctx);
+   size_t nameSize;
+   HgfsStatus status;
+
+   memset(request, 0, sizeof *request);
+   request->mask = HGFS_OPEN_VALID_MODE | HGFS_OPEN_VALID_FLAGS |
+                   HGFS_OPEN_VALID_OWNER_PERMS | HGFS_OPEN_VALID_FILE_NAME;
+   request->mode = mode;
+   request->flags = flags;
+   request->ownerPerms = HGFS_PERM_READ | HGFS_PERM_WRITE;
+   request->desiredLock = HGFS_LOCK_NONE;
+   nameSize = BenchFileName(ctx, relPath, &request->fileName);
+
+   status = BenchSend(ctx, HGFS_OP_OPEN_V3,
+                      offsetof(HgfsRequestOpenV3, fileName) + nameSize, result);
+   if (HGFS_STATUS_SUCCESS == status) {
+      *file = ((HgfsReplyOpenV3 *)BENCH_REPLY_ARGS(ctx))->file;
+   }
+
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchClose --
+ *
+ *    Closes a server file handle.
+ *
+ * Results:
+ *    Reply status.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+BenchClose(BenchContext *ctx,      // IN:
+           HgfsHandle file,        // IN:
+           BenchResult *result)    // IN/OUT/OPT:
+{
+   HgfsRequestCloseV3 *request = (HgfsRequestCloseV3 *)BENCH_ARGS(ctx);
+
+   memset(request, 0, sizeof *request);
+   request->file = file;
+
+   return BenchSend(ctx, HGFS_OP_CLOSE_V3, sizeof *request, result);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCreateLocalFile --
+ *
+ *    Creates a file of the given size below the share directory, bypassing
+ *    the server.
+ *
+ * Results:
+ *    TRUE on success.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchCreateLocalFile(BenchContext *ctx,    // IN:
+                     const char *relPath,  // IN:
+                     uint64 size)          // IN:
+{
+   char *path = Str_SafeAsprintf(NULL, "%s/%s", ctx->shareDir, relPath);
+   char buf[BENCH_SMALL_WRITE_SIZE];
+   Bool success = FALSE;
+   int fd;
+
+   fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0) {
+      fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+      goto exit;
+   }
+
+   memset(buf, 'h', sizeof buf);
+   while (size > 0) {
+      size_t chunk = MIN(size, sizeof buf);
+
+      if (write(fd, buf, chunk) != (ssize_t)chunk) {
+         fprintf(stderr, "Cannot write %s: %s\n", path, strerror(errno));
+         close(fd);
+         goto exit;
+      }
+      size -= chunk;
+   }
+   close(fd);
+   success = TRUE;
+
+exit:
+   free(path);
+   return success;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchMetadata --
+ *
+ *    Metadata storm: getattr by name followed by an open/close pair for
+ *    every file of a directory.
+ *
+ * Results:
+ *    TRUE if the workload ran.
+ *
+ * Side effects:
+ *    Creates the files on first use.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchMetadata(BenchContext *ctx,       // IN:
+              BenchResult *result)     // IN/OUT:
+{
+   char *dir = Str_SafeAsprintf(NULL, "%s/%s", ctx->shareDir, BENCH_META_DIR);
+   uint32 i;
+
+   if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+      fprintf(stderr, "Cannot create %s: %s\n", dir, strerror(errno));
+      free(dir);
+      return FALSE;
+   }
+   free(dir);
+
+   for (i = 0; i < gNumFiles; i++) {
+      char name[64];
+
+      Str_Sprintf(name, sizeof name, "%s/file%u", BENCH_META_DIR, i);
+      if (!BenchCreateLocalFile(ctx, name, 0)) {
+         return FALSE;
+      }
+   }
+
+   result->startUS = Hostinfo_SystemTimerUS();
+   for (i = 0; i < gNumFiles; i++) {
+      HgfsRequestGetattrV3 *request = (HgfsRequestGetattrV3 *)BENCH_ARGS(ctx);
+      HgfsHandle file;
+      char name[64];
+      size_t nameSize;
+
+      Str_Sprintf(name, sizeof name, "%s/file%u", BENCH_META_DIR, i);
+
+      memset(request, 0, sizeof *request);
+      nameSize = BenchFileName(ctx, name, &request->fileName);
+      BenchSend(ctx, HGFS_OP_GETATTR_V3,
+                offsetof(HgfsRequestGetattrV3, fileName) + nameSize, result);
+
+      if (HGFS_STATUS_SUCCESS == BenchOpen(ctx, name, HGFS_OPEN_MODE_READ_ONLY,
+                                           HGFS_OPEN, result, &file)) {
+         BenchClose(ctx, file, result);
+      }
+   }
+   result->elapsedUS = Hostinfo_SystemTimerUS() - result->startUS;
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchSeqRead --
+ *
+ *    Reads a large file front to back in the largest chunks the session
+ *    allows, with the data returned inline in the reply.
+ *
+ * Results:
+ *    TRUE if the workload ran.
+ *
+ * Side effects:
+ *    Creates the file on first use.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchSeqRead(BenchContext *ctx,        // IN:
+             BenchResult *result)      // IN/OUT:
+{
+   uint64 size = (uint64)gReadMB * 1024 * 1024;
+   uint64 offset;
+   HgfsHandle file;
+
+   if (!BenchCreateLocalFile(ctx, BENCH_SEQREAD_FILE, size)) {
+      return FALSE;
+   }
+
+   if (HGFS_STATUS_SUCCESS != BenchOpen(ctx, BENCH_SEQREAD_FILE,
+                                        HGFS_OPEN_MODE_READ_ONLY |
+                                        HGFS_OPEN_SEQUENTIAL,
+                                        HGFS_OPEN, NULL, &file)) {
+      fprintf(stderr, "Cannot open %s through the server\n", BENCH_SEQREAD_FILE);
+      return FALSE;
+   }
+
+   result->startUS = Hostinfo_SystemTimerUS();
+   for (offset = 0; offset < size; offset += BENCH_IO_SIZE) {
+      HgfsRequestReadV3 *request = (HgfsRequestReadV3 *)BENCH_ARGS(ctx);
+
+      memset(request, 0, sizeof *request);
+      request->file = file;
+      request->offset = offset;
+      request->requiredSize = BENCH_IO_SIZE;
+
+      if (HGFS_STATUS_SUCCESS == BenchSend(ctx, HGFS_OP_READ_V3,
+                                           sizeof *request, result)) {
+         HgfsReplyReadV3 *reply = (HgfsReplyReadV3 *)BENCH_REPLY_ARGS(ctx);
+
+         if (reply->actualSize == 0) {
+            break;
+         }
+         result->bytes += reply->actualSize;
+      }
+   }
+   result->elapsedUS = Hostinfo_SystemTimerUS() - result->startUS;
+
+   BenchClose(ctx, file, NULL);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRandWrite --
+ *
+ *    Small writes at random page aligned offsets of a single file.
+ *
+ * Results:
+ *    TRUE if the workload ran.
+ *
+ * Side effects:
+ *    Creates or truncates the file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchRandWrite(BenchContext *ctx,      // IN:
+               BenchResult *result)    // IN/OUT:
+{
+   uint32 numBlocks = BENCH_RANDWRITE_FILE_SIZE / BENCH_SMALL_WRITE_SIZE;
+   unsigned int seed = 0x4867;
+   HgfsHandle file;
+   uint32 i;
+
+   if (HGFS_STATUS_SUCCESS != BenchOpen(ctx, BENCH_RANDWRITE_FILE,
+                                        HGFS_OPEN_MODE_READ_WRITE,
+                                        HGFS_OPEN_CREATE_EMPTY, NULL, &file)) {
+      fprintf(stderr, "Cannot create %s through the server\n",
+              BENCH_RANDWRITE_FILE);
+      return FALSE;
+   }
+
+   result->startUS = Hostinfo_SystemTimerUS();
+   for (i = 0; i < gNumWrites; i++) {
+      HgfsRequestWriteV3 *request = (HgfsRequestWriteV3 *)BENCH_ARGS(ctx);
+
+      memset(request, 0, offsetof(HgfsRequestWriteV3, payload));
+      request->file = file;
+      request->offset = (uint64)(rand_r(&seed) % numBlocks) *
+                        BENCH_SMALL_WRITE_SIZE;
+      request->requiredSize = BENCH_SMALL_WRITE_SIZE;
+      memset(request->payload, (int)(i & 0xff), BENCH_SMALL_WRITE_SIZE);
+
+      if (HGFS_STATUS_SUCCESS == BenchSend(ctx, HGFS_OP_WRITE_V3,
+                                           offsetof(HgfsRequestWriteV3, payload) +
+                                           BENCH_SMALL_WRITE_SIZE, result)) {
+         result->bytes += BENCH_SMALL_WRITE_SIZE;
+      }
+   }
+
+   /* Writes that are merely buffered by the server get paid for on close. */
+   BenchClose(ctx, file, result);
+   result->elapsedUS = Hostinfo_SystemTimerUS() - result->startUS;
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchDirList --
+ *
+ *    Enumerates the metadata directory, one search read per entry.
+ *
+ * Results:
+ *    TRUE if the workload ran.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchDirList(BenchContext *ctx,        // IN:
+             BenchResult *result)      // IN/OUT:
+{
+   HgfsRequestSearchOpenV3 *openRequest;
+   HgfsRequestSearchCloseV3 *closeRequest;
+   HgfsHandle search;
+   size_t nameSize;
+   uint32 offset;
+   uint32 i;
+
+   /* Share the directory with the metadata workload when it already ran. */
+   for (i = 0; i < gNumFiles; i++) {
+      char name[64];
+      struct stat statBuf;
+      char *path;
+      Bool exists;
+
+      Str_Sprintf(name, sizeof name, "%s/file%u", BENCH_META_DIR, i);
+      path = Str_SafeAsprintf(NULL, "%s/%s", ctx->shareDir, name);
+      exists = stat(path, &statBuf) == 0;
+      free(path);
+
+      if (!exists) {
+         if (i == 0) {
+            char *dir = Str_SafeAsprintf(NULL, "%s/%s", ctx->shareDir,
+                                         BENCH_META_DIR);
+
+            (void)mkdir(dir, 0755);
+            free(dir);
+         }
+         if (!BenchCreateLocalFile(ctx, name, 0)) {
+            return FALSE;
+         }
+      }
+   }
+
+   result->startUS = Hostinfo_SystemTimerUS();
+
+   openRequest = (HgfsRequestSearchOpenV3 *)BENCH_ARGS(ctx);
+   memset(openRequest, 0, sizeof *openRequest);
+   nameSize = BenchFileName(ctx, BENCH_META_DIR, &openRequest->dirName);
+   if (HGFS_STATUS_SUCCESS != BenchSend(ctx, HGFS_OP_SEARCH_OPEN_V3,
+                                        offsetof(HgfsRequestSearchOpenV3,
+                                                 dirName) + nameSize,
+                                        result)) {
+      fprintf(stderr, "Cannot open a search on %s\n", BENCH_META_DIR);
+      return FALSE;
+   }
+   search = ((HgfsReplySearchOpenV3 *)BENCH_REPLY_ARGS(ctx))->search;
+
+   for (offset = 0; ; offset++) {
+      HgfsRequestSearchReadV3 *request =
+         (HgfsRequestSearchReadV3 *)BENCH_ARGS(ctx);
+
+      memset(request, 0, sizeof *request);
+      request->search = search;
+      request->offset = offset;
+
+      if (HGFS_STATUS_SUCCESS != BenchSend(ctx, HGFS_OP_SEARCH_READ_V3,
+                                           sizeof *request, result) ||
+          ((HgfsReplySearchReadV3 *)BENCH_REPLY_ARGS(ctx))->count == 0) {
+         break;
+      }
+   }
+
+   closeRequest = (HgfsRequestSearchCloseV3 *)BENCH_ARGS(ctx);
+   memset(closeRequest, 0, sizeof *closeRequest);
+   closeRequest->search = search;
+   BenchSend(ctx, HGFS_OP_SEARCH_CLOSE_V3, sizeof *closeRequest, result);
+
+   result->elapsedUS = Hostinfo_SystemTimerUS() - result->startUS;
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchReplay --
+ *
+ *    Dispatches the packets of a recorded stream. Each record is a native
+ *    endian 32-bit length followed by the packet. Session headers get the
+ *    id of the current session patched in.
+ *
+ * Results:
+ *    TRUE if the stream was read to the end.
+ *
+ * Side effects:
+ *    Whatever the recorded requests do.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchReplay(BenchContext *ctx,         // IN:
+            const char *replayPath,    // IN: recorded stream
+            BenchResult *result)       // IN/OUT:
+{
+   FILE *stream;
+   uint32 recordLen;
+   Bool success = TRUE;
+
+   stream = fopen(replayPath, "rb");
+   if (NULL == stream) {
+      fprintf(stderr, "Cannot open %s: %s\n", replayPath, strerror(errno));
+      return FALSE;
+   }
+
+   result->startUS = Hostinfo_SystemTimerUS();
+   while (fread(&recordLen, sizeof recordLen, 1, stream) == 1) {
+      HgfsHeader *header = (HgfsHeader *)ctx->request;
+
+      if (recordLen > BENCH_REPLY_SIZE ||
+          fread(ctx->request, recordLen, 1, stream) != 1) {
+         fprintf(stderr, "Truncated or corrupt record in %s\n", replayPath);
+         success = FALSE;
+         break;
+      }
+
+      if (recordLen >= sizeof *header &&
+          HGFS_OP_NEW_HEADER == header->dummy) {
+         if (HGFS_OP_CREATE_SESSION_V4 == header->op ||
+             HGFS_OP_DESTROY_SESSION_V4 == header->op) {
+            /* The benchmark owns the session, keep it alive. */
+            continue;
+         }
+         header->sessionId = ctx->sessionId;
+      }
+
+      BenchDispatch(ctx, ctx->request, recordLen, result);
+   }
+   result->elapsedUS = Hostinfo_SystemTimerUS() - result->startUS;
+
+   fclose(stream);
+   return success;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCompareLatency --
+ *
+ *    qsort comparison function for latencies.
+ *
+ * Results:
+ *    <0, 0, >0 as for qsort.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+BenchCompareLatency(const void *a,   // IN:
+                    const void *b)   // IN:
+{
+   VmTimeType la = *(const VmTimeType *)a;
+   VmTimeType lb = *(const VmTimeType *)b;
+
+   return la < lb ? -1 : la > lb ? 1 : 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchReport --
+ *
+ *    Prints throughput and latency percentiles of a workload.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Sorts the latency array.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchReport(BenchResult *result)   // IN/OUT:
+{
+   double seconds;
+
+   if (result->count == 0) {
+      printf("%-10s no requests\n", result->name);
+      return;
+   }
+
+   qsort(result->latencies, result->count, sizeof *result->latencies,
+         BenchCompareLatency);
+   seconds = MAX(result->elapsedUS, 1) / 1000000.0;
+
+#define BENCH_PCT(p) result->latencies[(result->count - 1) * (p) / 100]
+
+   printf("%-10s %8u ops %10.0f ops/s  p50 %6"FMT64"d p90 %6"FMT64"d "
+          "p99 %6"FMT64"d max %6"FMT64"d us  %u errors",
+          result->name, result->count, result->count / seconds,
+          BENCH_PCT(50), BENCH_PCT(90), BENCH_PCT(99),
+          result->latencies[result->count - 1], result->errors);
+   if (result->bytes != 0) {
+      printf("  %.1f MB/s", result->bytes / seconds / (1024.0 * 1024.0));
+   }
+   printf("\n");
+
+#undef BENCH_PCT
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRemoveTree --
+ *
+ *    Removes the files created below the share directory, one level of
+ *    subdirectories deep, and the directory itself.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchRemoveTree(const char *path,   // IN:
+                int depth)          // IN: subdirectory levels to descend
+{
+   DIR *dir = opendir(path);
+   struct dirent *entry;
+
+   if (NULL == dir) {
+      return;
+   }
+
+   while ((entry = readdir(dir)) != NULL) {
+      char *child;
+
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+         continue;
+      }
+      child = Str_SafeAsprintf(NULL, "%s/%s", path, entry->d_name);
+      if (unlink(child) < 0 && errno == EISDIR && depth > 0) {
+         BenchRemoveTree(child, depth - 1);
+      }
+      free(child);
+   }
+   closedir(dir);
+   rmdir(path);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCreateSession --
+ *
+ *    Connects to the server through the in-memory channel and establishes
+ *    an HGFS V4 session.
+ *
+ * Results:
+ *    TRUE on success.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchCreateSession(BenchContext *ctx)   // IN/OUT:
+{
+   HgfsServerChannelData channelData = { 0, HGFS_LARGE_PACKET_MAX };
+   HgfsRequestCreateSessionV4 *request;
+
+   if (!ctx->serverCb->session.connect(ctx, &gBenchChannelCb, &channelData,
+                                       &ctx->serverSession)) {
+      fprintf(stderr, "Cannot connect to the HGFS server\n");
+      return FALSE;
+   }
+
+   request = (HgfsRequestCreateSessionV4 *)BENCH_ARGS(ctx);
+   memset(request, 0, sizeof *request);
+   request->maxPacketSize = HGFS_LARGE_PACKET_MAX;
+   request->flags = HGFS_SESSION_MAXPACKETSIZE_VALID;
+
+   ctx->sessionId = HGFS_INVALID_SESSION_ID;
+   if (HGFS_STATUS_SUCCESS != BenchSend(ctx, HGFS_OP_CREATE_SESSION_V4,
+                                        sizeof *request, NULL)) {
+      fprintf(stderr, "Cannot create an HGFS session\n");
+      return FALSE;
+   }
+   ctx->sessionId =
+      ((HgfsReplyCreateSessionV4 *)BENCH_REPLY_ARGS(ctx))->sessionId;
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchDestroySession --
+ *
+ *    Destroys the HGFS session and drops the channel connection.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchDestroySession(BenchContext *ctx)  // IN/OUT:
+{
+   HgfsRequestDestroySessionV4 *request;
+
+   if (NULL == ctx->serverSession) {
+      return;
+   }
+
+   if (HGFS_INVALID_SESSION_ID != ctx->sessionId) {
+      request = (HgfsRequestDestroySessionV4 *)BENCH_ARGS(ctx);
+      memset(request, 0, sizeof *request);
+      BenchSend(ctx, HGFS_OP_DESTROY_SESSION_V4, sizeof *request, NULL);
+   }
+
+   ctx->serverCb->session.disconnect(ctx->serverSession);
+   ctx->serverCb->session.close(ctx->serverSession);
+   ctx->serverSession = NULL;
+}
+
+
+static void
+Usage(const char *prog)
+{
+   fprintf(stderr,
+           "Usage: %s [-d dir] [-w workloads] [-n files] [-s MB] [-c writes]\n"
+           "          [-r replay] [-o record] [-W] [-k]\n"
+           "  -d dir        directory holding the benchmark files "
+           "(default: new temp dir)\n"
+           "  -w workloads  comma separated list of metadata, seqread, "
+           "randwrite, dirlist\n"
+           "  -n files      files for the metadata and dirlist workloads "
+           "(default %u)\n"
+           "  -s MB         size of the sequentially read file (default %u)\n"
+           "  -c writes     number of %u byte random writes (default %u)\n"
+           "  -r replay     dispatch a recorded packet stream instead\n"
+           "  -o record     record the dispatched packets to a file\n"
+           "  -W            enable server write-behind\n"
+           "  -k            keep the benchmark files\n",
+           prog, BENCH_DEFAULT_FILES, BENCH_DEFAULT_READ_MB,
+           BENCH_SMALL_WRITE_SIZE, BENCH_DEFAULT_WRITES);
+}
+
+
+int
+main(int argc,
+     char *argv[])
+{
+   static const struct {
+      const char *name;
+      BenchWorkloadFunc func;
+   } workloads[] = {
+      { "metadata",  BenchMetadata },
+      { "seqread",   BenchSeqRead },
+      { "randwrite", BenchRandWrite },
+      { "dirlist",   BenchDirList },
+   };
+   HgfsServerConfig config = {
+      HGFS_CONFIG_VOL_INFO_MIN,
+      HGFS_MAX_CACHED_FILENODES
+   };
+   HgfsServerMgrCallbacks mgrCb;
+   BenchContext ctx;
+   const char *workloadList = "metadata,seqread,randwrite,dirlist";
+   const char *replayPath = NULL;
+   const char *recordPath = NULL;
+   char *shareDir = NULL;
+   Bool keep = FALSE;
+   Bool tempDir = FALSE;
+   int ret = EXIT_FAILURE;
+   int opt;
+   size_t i;
+
+   while ((opt = getopt(argc, argv, "d:w:n:s:c:r:o:Wkh")) != -1) {
+      switch (opt) {
+      case 'd':
+         shareDir = Util_SafeStrdup(optarg);
+         break;
+      case 'w':
+         workloadList = optarg;
+         break;
+      case 'n':
+         gNumFiles = strtoul(optarg, NULL, 0);
+         break;
+      case 's':
+         gReadMB = strtoul(optarg, NULL, 0);
+         break;
+      case 'c':
+         gNumWrites = strtoul(optarg, NULL, 0);
+         break;
+      case 'r':
+         replayPath = optarg;
+         break;
+      case 'o':
+         recordPath = optarg;
+         break;
+      case 'W':
+         config.flags |= HGFS_CONFIG_WRITE_BEHIND_ENABLED;
+         break;
+      case 'k':
+         keep = TRUE;
+         break;
+      default:
+         Usage(argv[0]);
+         return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+      }
+   }
+
+   memset(&ctx, 0, sizeof ctx);
+   ctx.sessionId = HGFS_INVALID_SESSION_ID;
+   ctx.request = Util_SafeMalloc(BENCH_REPLY_SIZE);
+   ctx.reply = Util_SafeMalloc(BENCH_REPLY_SIZE);
+
+   if (NULL == shareDir && NULL == replayPath) {
+      char template[] = "/tmp/hgfsbench.XXXXXX";
+
+      if (NULL == mkdtemp(template)) {
+         fprintf(stderr, "Cannot create a temp dir: %s\n", strerror(errno));
+         goto exit;
+      }
+      shareDir = Util_SafeStrdup(template);
+      tempDir = TRUE;
+   }
+   ctx.shareDir = shareDir;
+
+   if (NULL != recordPath) {
+      ctx.recordFile = fopen(recordPath, "wb");
+      if (NULL == ctx.recordFile) {
+         fprintf(stderr, "Cannot open %s: %s\n", recordPath, strerror(errno));
+         goto exit;
+      }
+   }
+
+   /* The guest policy exports the whole file system as the "root" share. */
+   memset(&mgrCb, 0, sizeof mgrCb);
+   if (!HgfsServerPolicy_Init(NULL, NULL, &mgrCb.enumResources)) {
+      fprintf(stderr, "Cannot initialize the HGFS server policy\n");
+      goto exit;
+   }
+
+   if (!HgfsServer_InitState(&ctx.serverCb, &config, &mgrCb)) {
+      fprintf(stderr, "Cannot initialize the HGFS server\n");
+      HgfsServerPolicy_Cleanup();
+      goto exit;
+   }
+
+   if (BenchCreateSession(&ctx)) {
+      ret = EXIT_SUCCESS;
+
+      if (NULL != replayPath) {
+         BenchResult result;
+
+         memset(&result, 0, sizeof result);
+         result.name = "replay";
+         if (!BenchReplay(&ctx, replayPath, &result)) {
+            ret = EXIT_FAILURE;
+         }
+         BenchReport(&result);
+         free(result.latencies);
+      } else {
+         for (i = 0; i < ARRAYSIZE(workloads); i++) {
+            BenchResult result;
+
+            if (strstr(workloadList, workloads[i].name) == NULL) {
+               continue;
+            }
+
+            memset(&result, 0, sizeof result);
+            result.name = workloads[i].name;
+            if (workloads[i].func(&ctx, &result)) {
+               BenchReport(&result);
+            } else {
+               ret = EXIT_FAILURE;
+            }
+            free(result.latencies);
+         }
+      }
+   }
+
+   BenchDestroySession(&ctx);
+   HgfsServer_ExitState();
+   HgfsServerPolicy_Cleanup();
+
+exit:
+   if (NULL != ctx.recordFile) {
+      fclose(ctx.recordFile);
+   }
+   if (tempDir && !keep) {
+      BenchRemoveTree(shareDir, 1);
+   }
+   free(shareDir);
+   free(ctx.request);
+   free(ctx.reply);
+
+   return ret;
+}
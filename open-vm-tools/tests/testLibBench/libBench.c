@@ -0,0 +1,819 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * libBench.c --
+ *
+ *   Microbenchmarks for the primitives in lib/misc, lib/string, lib/unicode,
+ *   lib/hashMap, lib/dataMap and lib/lock that the service and its plugins
+ *   sit on. Inputs are modeled after what those primitives actually see:
+ *   HGFS path names, guest RPC strings and vix XML replies.
+ *
+ *   Each benchmark is calibrated to run for at least the requested time,
+ *   then measured several times; the median is reported so that a single
+ *   preempted run does not skew the numbers. The output has one
+ *   tab-separated line per benchmark, which stays stable across versions
+ *   so that results can be diffed and tracked over time:
+ *
+ *      name <TAB> iterations <TAB> ns/op <TAB> MB/s
+ *
+ *   MB/s is 0 for benchmarks that do not process a byte stream.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "vmware.h"
+#include "base64.h"
+#include "codeset.h"
+#include "dataMap.h"
+#include "dynbuf.h"
+#include "hashMap.h"
+#include "hashTable.h"
+#include "hostinfo.h"
+#include "sha1.h"
+#include "str.h"
+#include "unicode.h"
+#include "unicodeTransforms.h"
+#include "userlock.h"
+#include "util.h"
+
+#define BENCH_DEFAULT_MIN_MS     200
+#define BENCH_DEFAULT_REPEATS    5
+#define BENCH_SHA1_BLOCK_SIZE    (64 * 1024)
+
+typedef struct LibBench {
+   const char *name;
+   void (*setup)(void);                  /* May be NULL. */
+   void (*run)(uint32 iterations);
+   void (*cleanup)(void);                /* May be NULL. */
+   size_t bytesPerOp;                    /* Set by setup, 0 if meaningless. */
+} LibBench;
+
+/* Keeps the compiler from dropping the work done by the benchmarks. */
+static volatile uintptr_t gSink;
+
+/* Relative paths as sent by HGFS clients, some of them non-ASCII. */
+static const char *gPaths[] = {
+   "home/user/projects/open-vm-tools/lib/misc/hashTable.c",
+   "home/user/projects/open-vm-tools/lib/include/vm_basic_types.h",
+   "home/user/Documents/Quarterly Report 2026.xlsx",
+   "home/user/Documents/R\xc3\xa9sum\xc3\xa9 \xc3\x89milie.docx",
+   "home/user/Pictures/\xe5\x86\x99\xe7\x9c\x9f/\xe6\x97\x85\xe8\xa1\x8c/"
+      "IMG_0001.JPG",
+   "home/user/.cache/mozilla/firefox/abcd1234.default/cache2/entries/"
+      "0A1B2C3D4E5F60718293A4B5C6D7E8F901234567",
+   "usr/share/locale/de/LC_MESSAGES/vmware-toolbox-cmd.mo",
+   "var/log/vmware-vmsvc-root.log",
+   "home/user/\xd0\x94\xd0\xbe\xd0\xba\xd1\x83\xd0\xbc\xd0\xb5\xd0\xbd"
+      "\xd1\x82\xd1\x8b/\xd0\x9e\xd1\x82\xd1\x87\xd1\x91\xd1\x82.pdf",
+   "home/user/projects/build/CMakeFiles/3.28.1/CompilerIdC/a.out",
+   "opt/app/node_modules/@types/node/ts4.8/assert.d.ts",
+   "home/user/Music/Bj\xc3\xb6rk/Homogenic/01 - Hunter.flac",
+};
+
+/* Same paths with different case, for the case-insensitive operations. */
+static const char *gPathsUpper[] = {
+   "HOME/USER/PROJECTS/OPEN-VM-TOOLS/LIB/MISC/HASHTABLE.C",
+   "HOME/USER/PROJECTS/OPEN-VM-TOOLS/LIB/INCLUDE/VM_BASIC_TYPES.H",
+   "HOME/USER/DOCUMENTS/QUARTERLY REPORT 2026.XLSX",
+   "HOME/USER/DOCUMENTS/R\xc3\x89SUM\xc3\x89 \xc3\x89MILIE.DOCX",
+   "HOME/USER/PICTURES/\xe5\x86\x99\xe7\x9c\x9f/\xe6\x97\x85\xe8\xa1\x8c/"
+      "img_0001.jpg",
+   "HOME/USER/.CACHE/MOZILLA/FIREFOX/ABCD1234.DEFAULT/CACHE2/ENTRIES/"
+      "0a1b2c3d4e5f60718293a4b5c6d7e8f901234567",
+   "USR/SHARE/LOCALE/DE/LC_MESSAGES/VMWARE-TOOLBOX-CMD.MO",
+   "VAR/LOG/VMWARE-VMSVC-ROOT.LOG",
+   "HOME/USER/\xd0\x94\xd0\x9e\xd0\x9a\xd0\xa3\xd0\x9c\xd0\x95\xd0\x9d"
+      "\xd0\xa2\xd0\xab/\xd0\x9e\xd0\xa2\xd0\xa7\xd0\x81\xd0\xa2.PDF",
+   "HOME/USER/PROJECTS/BUILD/CMAKEFILES/3.28.1/COMPILERIDC/A.OUT",
+   "OPT/APP/NODE_MODULES/@TYPES/NODE/TS4.8/ASSERT.D.TS",
+   "HOME/USER/MUSIC/BJ\xc3\x96RK/HOMOGENIC/01 - HUNTER.FLAC",
+};
+
+/* Guest RPCs exchanged with the VMX during normal operation. */
+static const char *gRpcs[] = {
+   "tools.capability.hgfs_server toolbox 1",
+   "tools.set.version 12389",
+   "info-set guestinfo.ip 192.168.10.21",
+   "Set_Option synctime 1",
+   "vmx.capability.unified_loop toolbox",
+   "log powerops: poweron-vm-default exited with status 0 after 43 ms",
+   "guestinfo.appInfo {\"version\":\"1\",\"updateCounter\":\"12\"}",
+   "tools.os.statechange.status 1 2",
+   "Capabilities_Register",
+   "deployPkg.update.state 4 0 ",
+};
+
+/* A typical vix file listing reply. */
+static const char gVixXml[] =
+   "<FileInfo><Name>hashTable.c</Name><FileFlags>0</FileFlags>"
+   "<FileSize>18423</FileSize><ModTime>1760486400</ModTime>"
+   "<CreateTime>1760400000</CreateTime><AccessTime>1760486400</AccessTime>"
+   "<Uid>1000</Uid><Gid>1000</Gid><Permissions>420</Permissions>"
+   "<SymlinkTarget></SymlinkTarget></FileInfo>"
+   "<FileInfo><Name>R\xc3\xa9sum\xc3\xa9 \xc3\x89milie.docx</Name>"
+   "<FileFlags>0</FileFlags><FileSize>1048576</FileSize>"
+   "<ModTime>1760486400</ModTime><CreateTime>1760400000</CreateTime>"
+   "<AccessTime>1760486400</AccessTime><Uid>1000</Uid><Gid>1000</Gid>"
+   "<Permissions>420</Permissions><SymlinkTarget></SymlinkTarget></FileInfo>"
+   "<FileInfo><Name>lib</Name><FileFlags>1</FileFlags>"
+   "<FileSize>4096</FileSize><ModTime>1760486400</ModTime>"
+   "<CreateTime>1760400000</CreateTime><AccessTime>1760486400</AccessTime>"
+   "<Uid>1000</Uid><Gid>1000</Gid><Permissions>493</Permissions>"
+   "<SymlinkTarget></SymlinkTarget></FileInfo>";
+
+/* State shared by the setup, run and cleanup functions of a benchmark. */
+static struct {
+   HashTable *table;
+   HashMap *map;
+   char **utf16Paths;
+   size_t *utf16Sizes;
+   char *base64;
+   uint8 *block;
+   DataMap dataMap;
+   MXUserExclLock *exclLock;
+   MXUserRWLock *rwLock;
+} gState;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Bench Functions --
+ *
+ *    One set per benchmark. The run functions perform the benchmarked
+ *    operation the given number of times; what one operation is is noted
+ *    in the table at the end of this section.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchHashTableLookupSetup(void)
+{
+   size_t i;
+
+   gState.table = HashTable_Alloc(256, HASH_STRING_KEY, NULL);
+   for (i = 0; i < ARRAYSIZE(gPaths); i++) {
+      HashTable_Insert(gState.table, gPaths[i], (void *)(uintptr_t)i);
+   }
+}
+
+
+static void
+BenchHashTableLookup(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      void *data;
+
+      if (HashTable_Lookup(gState.table, gPaths[i % ARRAYSIZE(gPaths)],
+                           &data)) {
+         gSink += (uintptr_t)data;
+      }
+   }
+}
+
+
+static void
+BenchHashTableCleanup(void)
+{
+   HashTable_Free(gState.table);
+   gState.table = NULL;
+}
+
+
+static void
+BenchHashTableInsert(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      HashTable *table = HashTable_Alloc(256,
+                                         HASH_ISTRING_KEY | HASH_FLAG_COPYKEY,
+                                         NULL);
+      size_t j;
+
+      for (j = 0; j < ARRAYSIZE(gPaths); j++) {
+         HashTable_Insert(table, gPaths[j], NULL);
+      }
+      HashTable_Free(table);
+   }
+}
+
+
+static void
+BenchHashMapSetup(void)
+{
+   uint32 key;
+
+   gState.map = HashMap_AllocMap(1024, sizeof key, sizeof key);
+   for (key = 0; key < 1000; key++) {
+      HashMap_Put(gState.map, &key, &key);
+   }
+}
+
+
+static void
+BenchHashMapGet(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      uint32 key = (i * 7919) % 1000;
+      uint32 *data = HashMap_Get(gState.map, &key);
+
+      gSink += *data;
+   }
+}
+
+
+static void
+BenchHashMapCleanup(void)
+{
+   HashMap_DestroyMap(gState.map);
+   gState.map = NULL;
+}
+
+
+static void
+BenchDynBufAppend(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      DynBuf buf;
+      size_t j;
+
+      DynBuf_Init(&buf);
+      for (j = 0; j < ARRAYSIZE(gRpcs); j++) {
+         DynBuf_AppendString(&buf, gRpcs[j]);
+      }
+      gSink += DynBuf_GetSize(&buf);
+      DynBuf_Destroy(&buf);
+   }
+}
+
+
+static void
+BenchCodeSetSetup(void)
+{
+   size_t i;
+
+   gState.utf16Paths = Util_SafeCalloc(ARRAYSIZE(gPaths),
+                                       sizeof *gState.utf16Paths);
+   gState.utf16Sizes = Util_SafeCalloc(ARRAYSIZE(gPaths),
+                                       sizeof *gState.utf16Sizes);
+   for (i = 0; i < ARRAYSIZE(gPaths); i++) {
+      if (!CodeSet_Utf8ToUtf16le(gPaths[i], strlen(gPaths[i]),
+                                 &gState.utf16Paths[i],
+                                 &gState.utf16Sizes[i])) {
+         Panic("Cannot convert %s to UTF-16\n", gPaths[i]);
+      }
+   }
+}
+
+
+static void
+BenchCodeSetCleanup(void)
+{
+   size_t i;
+
+   for (i = 0; i < ARRAYSIZE(gPaths); i++) {
+      free(gState.utf16Paths[i]);
+   }
+   free(gState.utf16Paths);
+   free(gState.utf16Sizes);
+   gState.utf16Paths = NULL;
+   gState.utf16Sizes = NULL;
+}
+
+
+static void
+BenchCodeSetUtf8ToUtf16(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      const char *path = gPaths[i % ARRAYSIZE(gPaths)];
+      char *out;
+      size_t outLen;
+
+      if (CodeSet_Utf8ToUtf16le(path, strlen(path), &out, &outLen)) {
+         gSink += outLen;
+         free(out);
+      }
+   }
+}
+
+
+static void
+BenchCodeSetUtf16ToUtf8(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      size_t idx = i % ARRAYSIZE(gPaths);
+      char *out;
+      size_t outLen;
+
+      if (CodeSet_Utf16leToUtf8(gState.utf16Paths[idx],
+                                gState.utf16Sizes[idx], &out, &outLen)) {
+         gSink += outLen;
+         free(out);
+      }
+   }
+}
+
+
+static void
+BenchStrSnprintf(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      char buf[256];
+
+      gSink += Str_Snprintf(buf, sizeof buf, "%s %d %u %s",
+                            gRpcs[i % ARRAYSIZE(gRpcs)], -(int)i, i,
+                            gPaths[i % ARRAYSIZE(gPaths)]);
+   }
+}
+
+
+static void
+BenchUnicodeCompareIgnoreCase(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      size_t idx = i % ARRAYSIZE(gPaths);
+
+      gSink += Unicode_CompareIgnoreCase(gPaths[idx], gPathsUpper[idx]);
+   }
+}
+
+
+static void
+BenchUnicodeFoldCase(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      char *folded = Unicode_FoldCase(gPathsUpper[i % ARRAYSIZE(gPaths)]);
+
+      gSink += (uintptr_t)folded[0];
+      free(folded);
+   }
+}
+
+
+static void
+BenchUnicodeHashIgnoreCase(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      gSink += Unicode_HashIgnoreCase(gPaths[i % ARRAYSIZE(gPaths)]);
+   }
+}
+
+
+static void
+BenchBase64Setup(void)
+{
+   if (!Base64_EasyEncode((const uint8 *)gVixXml, sizeof gVixXml - 1,
+                          &gState.base64)) {
+      Panic("Cannot encode the vix XML\n");
+   }
+}
+
+
+static void
+BenchBase64Cleanup(void)
+{
+   free(gState.base64);
+   gState.base64 = NULL;
+}
+
+
+static void
+BenchBase64Encode(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      char *out;
+
+      if (Base64_EasyEncode((const uint8 *)gVixXml, sizeof gVixXml - 1,
+                            &out)) {
+         gSink += (uintptr_t)out[0];
+         free(out);
+      }
+   }
+}
+
+
+static void
+BenchBase64Decode(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      uint8 *out;
+      size_t outLen;
+
+      if (Base64_EasyDecode(gState.base64, &out, &outLen)) {
+         gSink += outLen;
+         free(out);
+      }
+   }
+}
+
+
+static void
+BenchSHA1Small(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      SHA1_CTX ctx;
+      unsigned char digest[SHA1_HASH_LEN];
+
+      SHA1Init(&ctx);
+      SHA1Update(&ctx, (const unsigned char *)gVixXml, sizeof gVixXml - 1);
+      SHA1Final(digest, &ctx);
+      gSink += digest[0];
+   }
+}
+
+
+static void
+BenchSHA1BlockSetup(void)
+{
+   size_t i;
+
+   gState.block = Util_SafeMalloc(BENCH_SHA1_BLOCK_SIZE);
+   for (i = 0; i < BENCH_SHA1_BLOCK_SIZE; i++) {
+      gState.block[i] = (uint8)(i * 31);
+   }
+}
+
+
+static void
+BenchSHA1BlockCleanup(void)
+{
+   free(gState.block);
+   gState.block = NULL;
+}
+
+
+static void
+BenchSHA1Block(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      SHA1_CTX ctx;
+      unsigned char digest[SHA1_HASH_LEN];
+
+      SHA1Init(&ctx);
+      SHA1Update(&ctx, gState.block, BENCH_SHA1_BLOCK_SIZE);
+      SHA1Final(digest, &ctx);
+      gSink += digest[0];
+   }
+}
+
+
+static void
+BenchDataMapSetup(void)
+{
+   int32 i;
+
+   if (DataMap_Create(&gState.dataMap) != DMERR_SUCCESS) {
+      Panic("Cannot create a DataMap\n");
+   }
+   for (i = 0; i < 8; i++) {
+      DataMap_SetInt64(&gState.dataMap, i, (int64)i * 1000003, TRUE);
+   }
+   for (i = 0; i < (int32)ARRAYSIZE(gPaths); i++) {
+      DataMap_SetString(&gState.dataMap, 100 + i,
+                        Util_SafeStrdup(gPaths[i]), -1, TRUE);
+   }
+}
+
+
+static void
+BenchDataMapSerialize(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      char *buf;
+      uint32 bufLen;
+
+      if (DataMap_Serialize(&gState.dataMap, &buf, &bufLen) ==
+          DMERR_SUCCESS) {
+         gSink += bufLen;
+         free(buf);
+      }
+   }
+}
+
+
+static void
+BenchDataMapCleanup(void)
+{
+   DataMap_Destroy(&gState.dataMap);
+}
+
+
+static void
+BenchMXUserSetup(void)
+{
+   gState.exclLock = MXUser_CreateExclLock("libBenchExcl", RANK_UNRANKED);
+   gState.rwLock = MXUser_CreateRWLock("libBenchRW", RANK_UNRANKED);
+}
+
+
+static void
+BenchMXUserCleanup(void)
+{
+   MXUser_DestroyExclLock(gState.exclLock);
+   MXUser_DestroyRWLock(gState.rwLock);
+   gState.exclLock = NULL;
+   gState.rwLock = NULL;
+}
+
+
+static void
+BenchMXUserExcl(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      MXUser_AcquireExclLock(gState.exclLock);
+      gSink++;
+      MXUser_ReleaseExclLock(gState.exclLock);
+   }
+}
+
+
+static void
+BenchMXUserRead(uint32 iterations)   // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      MXUser_AcquireForRead(gState.rwLock);
+      gSink++;
+      MXUser_ReleaseRWLock(gState.rwLock);
+   }
+}
+
+
+/*
+ * One operation is: a lookup / a table of all gPaths built and freed /
+ * all gRpcs appended to a new buffer / one path converted / one formatted
+ * RPC / one path compared, folded or hashed / the vix XML encoded, decoded
+ * or hashed / a 64KB block hashed / the DataMap serialized / one lock
+ * acquired and released.
+ */
+static LibBench gBenchmarks[] = {
+   { "hashtable.lookup", BenchHashTableLookupSetup, BenchHashTableLookup,
+     BenchHashTableCleanup, 0 },
+   { "hashtable.insert", NULL, BenchHashTableInsert, NULL, 0 },
+   { "hashmap.get", BenchHashMapSetup, BenchHashMapGet, BenchHashMapCleanup,
+     0 },
+   { "dynbuf.append", NULL, BenchDynBufAppend, NULL, 0 },
+   { "codeset.utf8_to_utf16le", BenchCodeSetSetup, BenchCodeSetUtf8ToUtf16,
+     BenchCodeSetCleanup, 0 },
+   { "codeset.utf16le_to_utf8", BenchCodeSetSetup, BenchCodeSetUtf16ToUtf8,
+     BenchCodeSetCleanup, 0 },
+   { "str.snprintf", NULL, BenchStrSnprintf, NULL, 0 },
+   { "unicode.compare_ignorecase", NULL, BenchUnicodeCompareIgnoreCase, NULL,
+     0 },
+   { "unicode.foldcase", NULL, BenchUnicodeFoldCase, NULL, 0 },
+   { "unicode.hash_ignorecase", NULL, BenchUnicodeHashIgnoreCase, NULL, 0 },
+   { "base64.encode", BenchBase64Setup, BenchBase64Encode, BenchBase64Cleanup,
+     sizeof gVixXml - 1 },
+   { "base64.decode", BenchBase64Setup, BenchBase64Decode, BenchBase64Cleanup,
+     sizeof gVixXml - 1 },
+   { "sha1.vixxml", NULL, BenchSHA1Small, NULL, sizeof gVixXml - 1 },
+   { "sha1.64k", BenchSHA1BlockSetup, BenchSHA1Block, BenchSHA1BlockCleanup,
+     BENCH_SHA1_BLOCK_SIZE },
+   { "datamap.serialize", BenchDataMapSetup, BenchDataMapSerialize,
+     BenchDataMapCleanup, 0 },
+   { "mxuser.excl", BenchMXUserSetup, BenchMXUserExcl, BenchMXUserCleanup,
+     0 },
+   { "mxuser.rw_read", BenchMXUserSetup, BenchMXUserRead, BenchMXUserCleanup,
+     0 },
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchTime --
+ *
+ *    Runs a benchmark for the given number of iterations.
+ *
+ * Results:
+ *    Elapsed time in ns.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VmTimeType
+BenchTime(const LibBench *bench,   // IN:
+          uint32 iterations)       // IN:
+{
+   VmTimeType start = Hostinfo_SystemTimerNS();
+
+   bench->run(iterations);
+   return Hostinfo_SystemTimerNS() - start;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCompareTime --
+ *
+ *    Compares two times.
+ *
+ * Results:
+ *    <0, 0, >0 as for qsort.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+BenchCompareTime(const void *a,   // IN:
+                 const void *b)   // IN:
+{
+   VmTimeType ta = *(const VmTimeType *)a;
+   VmTimeType tb = *(const VmTimeType *)b;
+
+   return ta < tb ? -1 : ta > tb ? 1 : 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *    Calibrates a benchmark so that one measurement lasts at least minNS,
+ *    measures it the given number of times and prints the median.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Prints a line to stdout.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchRun(const LibBench *bench,   // IN:
+         VmTimeType minNS,        // IN:
+         uint32 repeats)          // IN:
+{
+   VmTimeType *times = Util_SafeCalloc(repeats, sizeof *times);
+   VmTimeType elapsed;
+   uint32 iterations = 1;
+   double nsPerOp;
+   double mbPerSec = 0;
+   uint32 i;
+
+   if (bench->setup != NULL) {
+      bench->setup();
+   }
+
+   /* Also warms up the caches and the allocator. */
+   while ((elapsed = BenchTime(bench, iterations)) < minNS &&
+          iterations < MAX_UINT32 / 2) {
+      uint64 next = elapsed > 0 ? (uint64)iterations * minNS / elapsed
+                                : (uint64)iterations * 2;
+
+      iterations = (uint32)MIN(MAX(next + next / 10, (uint64)iterations * 2),
+                               MAX_UINT32 / 2);
+   }
+
+   for (i = 0; i < repeats; i++) {
+      times[i] = BenchTime(bench, iterations);
+   }
+   qsort(times, repeats, sizeof *times, BenchCompareTime);
+
+   nsPerOp = (double)times[repeats / 2] / iterations;
+   if (bench->bytesPerOp != 0) {
+      mbPerSec = bench->bytesPerOp * 1000.0 / nsPerOp;
+   }
+   printf("%s\t%u\t%.1f\t%.1f\n", bench->name, iterations, nsPerOp,
+          mbPerSec);
+   fflush(stdout);
+
+   if (bench->cleanup != NULL) {
+      bench->cleanup();
+   }
+   free(times);
+}
+
+
+static void
+Usage(const char *prog)
+{
+   fprintf(stderr,
+           "Usage: %s [-t ms] [-r repeats] [-l] [name...]\n"
+           "  -t ms       minimum duration of one measurement (default %u)\n"
+           "  -r repeats  measurements per benchmark; the median is "
+           "reported (default %u)\n"
+           "  -l          list the benchmarks\n"
+           "  name        run only the benchmarks starting with name\n",
+           prog, BENCH_DEFAULT_MIN_MS, BENCH_DEFAULT_REPEATS);
+}
+
+
+int
+main(int argc,
+     char *argv[])
+{
+   uint32 minMS = BENCH_DEFAULT_MIN_MS;
+   uint32 repeats = BENCH_DEFAULT_REPEATS;
+   Bool list = FALSE;
+   int opt;
+   size_t i;
+
+   while ((opt = getopt(argc, argv, "t:r:lh")) != -1) {
+      switch (opt) {
+      case 't':
+         minMS = strtoul(optarg, NULL, 0);
+         break;
+      case 'r':
+         repeats = MAX(strtoul(optarg, NULL, 0), 1);
+         break;
+      case 'l':
+         list = TRUE;
+         break;
+      default:
+         Usage(argv[0]);
+         return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+      }
+   }
+
+   if (!list) {
+      printf("# name\titerations\tns/op\tMB/s\n");
+   }
+
+   for (i = 0; i < ARRAYSIZE(gBenchmarks); i++) {
+      const LibBench *bench = &gBenchmarks[i];
+
+      if (optind < argc) {
+         int j;
+
+         for (j = optind; j < argc; j++) {
+            if (strncmp(bench->name, argv[j], strlen(argv[j])) == 0) {
+               break;
+            }
+         }
+         if (j == argc) {
+            continue;
+         }
+      }
+
+      if (list) {
+         printf("%s\n", bench->name);
+      } else {
+         BenchRun(bench, (VmTimeType)minMS * 1000 * 1000, repeats);
+      }
+   }
+
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,508 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file benchmark.c
+ *
+ * Benchmark mode of the debug channel. Instead of the 100ms trickle used for
+ * functional tests, RPCs are dispatched to the service at a given rate, and
+ * the time each takes to be handled is recorded. When the run ends, a report
+ * with per-command latency percentiles, the CPU time used and the heap growth
+ * is written out.
+ *
+ * The mode is set up with environment variables, since the debug library
+ * gets no options from the service:
+ *
+ * - VMRPCDBG_BENCH_SCRIPT: file with the RPC mix to replay, one RPC per line,
+ *   with C escapes for special characters. Empty lines and lines starting
+ *   with '#' are skipped. Without a script, the debug plugin's RPCs are
+ *   dispatched, and timed.
+ * - VMRPCDBG_BENCH_LOOPS: how many times to replay the script (default 1).
+ * - VMRPCDBG_BENCH_RATE: RPCs per second to dispatch; 0, the default,
+ *   dispatches them as fast as the service takes them.
+ * - VMRPCDBG_BENCH_BURST: RPCs dispatched back to back at each tick of the
+ *   rate (default 1), to model a host sending several requests at once.
+ * - VMRPCDBG_BENCH_REPORT: file the report is written to; "-" or unset is
+ *   stdout.
+ *
+ * The mode is on when VMRPCDBG_BENCH_SCRIPT or VMRPCDBG_BENCH_REPORT is set.
+ * Passing "bench" as the debug plugin (vmtoolsd --debug=bench) loads a
+ * built-in debug plugin that accepts everything the service sends, so that
+ * the regular plugins (guestInfo, vix, vmbackup, hgfsServer...) can be
+ * benchmarked with a script alone.
+ */
+
+#define G_LOG_DOMAIN "rpcdbg"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__GLIBC__)
+#  include <malloc.h>
+#endif
+#if !defined(_WIN32)
+#  include <sys/resource.h>
+#endif
+
+#include "vmrpcdbgInt.h"
+
+/** Measurements of one RPC command. */
+typedef struct RpcDebugBenchStat {
+   GArray           *latencies;    // gint64, in microseconds
+   guint             failures;
+   gint64            heapGrowth;   // Bytes, summed over all the calls
+} RpcDebugBenchStat;
+
+/** A message of the script. */
+typedef struct RpcDebugBenchMsg {
+   gchar            *message;
+   size_t            messageLen;
+} RpcDebugBenchMsg;
+
+static struct {
+   gboolean          active;
+   GArray           *script;       // RpcDebugBenchMsg
+   guint             loops;
+   guint             next;         // Index in the script, over all the loops
+   guint             rate;
+   guint             burst;
+   gchar            *reportPath;
+   GHashTable       *stats;        // Command name -> RpcDebugBenchStat
+   gint64            firstStart;   // Monotonic time of the first RPC, or 0
+   gint64            lastEnd;
+#if !defined(_WIN32)
+   struct rusage     firstUsage;
+#endif
+} gBench;
+
+/** Built-in debug plugin: sends nothing, accepts everything. */
+static RpcDebugPlugin gBenchPlugin;
+
+
+/**
+ * Returns the unsigned integer in an environment variable.
+ *
+ * @param[in]  name     Name of the variable.
+ * @param[in]  dflt     Value to use if the variable is not set or invalid.
+ *
+ * @return The value.
+ */
+
+static guint
+RpcDebugBenchGetEnvUInt(const char *name,
+                        guint dflt)
+{
+   const char *str = g_getenv(name);
+   char *end;
+   unsigned long val;
+
+   if (str == NULL || *str == '\0') {
+      return dflt;
+   }
+
+   val = strtoul(str, &end, 10);
+   if (*end != '\0' || val > G_MAXUINT) {
+      g_warning("Ignoring invalid value for %s: %s\n", name, str);
+      return dflt;
+   }
+   return (guint) val;
+}
+
+
+/**
+ * Loads the RPC script.
+ *
+ * @param[in]  path     Path to the script.
+ */
+
+static void
+RpcDebugBenchLoadScript(const char *path)
+{
+   gchar *contents;
+   gchar **lines;
+   gchar **line;
+   GError *err = NULL;
+
+   if (!g_file_get_contents(path, &contents, NULL, &err)) {
+      g_error("Can't read benchmark script %s: %s\n", path, err->message);
+   }
+
+   gBench.script = g_array_new(FALSE, FALSE, sizeof (RpcDebugBenchMsg));
+   lines = g_strsplit(contents, "\n", -1);
+   g_free(contents);
+
+   for (line = lines; *line != NULL; line++) {
+      RpcDebugBenchMsg msg;
+
+      g_strchomp(*line);
+      if (**line == '\0' || **line == '#') {
+         continue;
+      }
+      msg.message = g_strcompress(*line);
+      msg.messageLen = strlen(msg.message);
+      g_array_append_val(gBench.script, msg);
+   }
+   g_strfreev(lines);
+
+   if (gBench.script->len == 0) {
+      g_error("Benchmark script %s has no RPCs.\n", path);
+   }
+}
+
+
+/**
+ * Frees the measurements of a command.
+ *
+ * @param[in]  data     The measurements.
+ */
+
+static void
+RpcDebugBenchFreeStat(gpointer data)
+{
+   RpcDebugBenchStat *cmd = data;
+   g_array_free(cmd->latencies, TRUE);
+   g_free(cmd);
+}
+
+
+/**
+ * Returns the bytes of heap in use, if the C library can tell.
+ *
+ * @return Bytes in use, or 0.
+ */
+
+static gint64
+RpcDebugBenchHeapInUse(void)
+{
+#if defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 33)
+   struct mallinfo2 mi = mallinfo2();
+#else
+   struct mallinfo mi = mallinfo();
+#endif
+   return (gint64) mi.uordblks + (gint64) mi.hblkhd;
+#else
+   return 0;
+#endif
+}
+
+
+/**
+ * Compares two latencies, for qsort().
+ */
+
+static int
+RpcDebugBenchCompareLatency(const void *a,
+                            const void *b)
+{
+   gint64 la = *(const gint64 *) a;
+   gint64 lb = *(const gint64 *) b;
+   return (la > lb) - (la < lb);
+}
+
+
+/**
+ * Returns a percentile of sorted latencies.
+ *
+ * @param[in]  sorted   Sorted latencies.
+ * @param[in]  pct      Percentile.
+ *
+ * @return The latency.
+ */
+
+static gint64
+RpcDebugBenchPercentile(GArray *sorted,
+                        guint pct)
+{
+   return g_array_index(sorted, gint64, (sorted->len - 1) * pct / 100);
+}
+
+
+/**
+ * Writes the report of one command. Used with g_hash_table_foreach().
+ *
+ * @param[in]  key      Command name.
+ * @param[in]  value    Measurements.
+ * @param[in]  out      Output file.
+ */
+
+static void
+RpcDebugBenchReportStat(gpointer key,
+                        gpointer value,
+                        gpointer out)
+{
+   RpcDebugBenchStat *cmd = value;
+   GArray *sorted = cmd->latencies;
+
+   qsort(sorted->data, sorted->len, sizeof (gint64),
+         RpcDebugBenchCompareLatency);
+
+   fprintf(out, "%-40s %8u %6u %10"G_GINT64_FORMAT" %10"G_GINT64_FORMAT
+           " %10"G_GINT64_FORMAT" %10"G_GINT64_FORMAT" %12"G_GINT64_FORMAT"\n",
+           (const char *) key, sorted->len, cmd->failures,
+           RpcDebugBenchPercentile(sorted, 50),
+           RpcDebugBenchPercentile(sorted, 90),
+           RpcDebugBenchPercentile(sorted, 99),
+           g_array_index(sorted, gint64, sorted->len - 1),
+           cmd->heapGrowth / (gint64) sorted->len);
+}
+
+
+/**
+ * Sets up the benchmark mode from the environment.
+ *
+ * @param[in]  dbgPlugin   Path to the debug plugin.
+ *
+ * @return The built-in debug plugin if @a dbgPlugin is "bench", NULL if the
+ *         debug plugin should be loaded.
+ */
+
+RpcDebugPlugin *
+RpcDebugBench_Init(const gchar *dbgPlugin)
+{
+   const char *script = g_getenv("VMRPCDBG_BENCH_SCRIPT");
+   const char *report = g_getenv("VMRPCDBG_BENCH_REPORT");
+
+   memset(&gBench, 0, sizeof gBench);
+
+   if (script != NULL || report != NULL) {
+      gBench.active = TRUE;
+      gBench.loops = RpcDebugBenchGetEnvUInt("VMRPCDBG_BENCH_LOOPS", 1);
+      gBench.rate = RpcDebugBenchGetEnvUInt("VMRPCDBG_BENCH_RATE", 0);
+      gBench.burst = MAX(RpcDebugBenchGetEnvUInt("VMRPCDBG_BENCH_BURST", 1), 1);
+      gBench.reportPath = g_strdup(report);
+      gBench.stats = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                           RpcDebugBenchFreeStat);
+      if (script != NULL) {
+         RpcDebugBenchLoadScript(script);
+      }
+   }
+
+   return strcmp(dbgPlugin, "bench") == 0 ? &gBenchPlugin : NULL;
+}
+
+
+/**
+ * Returns how often the debug channel should dispatch RPCs.
+ *
+ * @return Interval between two dispatches, in milliseconds.
+ */
+
+guint
+RpcDebugBench_GetInterval(void)
+{
+   if (!gBench.active) {
+      return 100;
+   }
+   return gBench.rate > 0 ? 1000 * gBench.burst / gBench.rate : 0;
+}
+
+
+/**
+ * Returns how many RPCs the debug channel should dispatch at once.
+ *
+ * @return Number of RPCs.
+ */
+
+guint
+RpcDebugBench_GetBurst(void)
+{
+   return gBench.active ? gBench.burst : 1;
+}
+
+
+/**
+ * Gets the next RPC to dispatch: from the script if there is one, from the
+ * debug plugin otherwise.
+ *
+ * @param[in]  plugin   The debug plugin.
+ * @param[out] rpcdata  The RPC.
+ *
+ * @return FALSE if there are no more RPCs, and the run should finish.
+ */
+
+gboolean
+RpcDebugBench_GetNext(RpcDebugPlugin *plugin,
+                      RpcDebugMsgMapping *rpcdata)
+{
+   RpcDebugBenchMsg *msg;
+
+   if (gBench.script == NULL) {
+      return plugin->sendFn != NULL && plugin->sendFn(rpcdata);
+   }
+
+   if (gBench.next >= gBench.script->len * gBench.loops) {
+      return FALSE;
+   }
+
+   msg = &g_array_index(gBench.script, RpcDebugBenchMsg,
+                        gBench.next % gBench.script->len);
+   gBench.next++;
+
+   rpcdata->message = msg->message;
+   rpcdata->messageLen = msg->messageLen;
+   rpcdata->validateFn = NULL;
+   rpcdata->freeMsg = FALSE;
+   return TRUE;
+}
+
+
+/**
+ * Takes the measurements that precede the dispatch of an RPC.
+ *
+ * @param[out] sample   Where to store them.
+ */
+
+void
+RpcDebugBench_Begin(RpcDebugBenchSample *sample)
+{
+   if (!gBench.active) {
+      return;
+   }
+
+   if (gBench.firstStart == 0) {
+#if !defined(_WIN32)
+      getrusage(RUSAGE_SELF, &gBench.firstUsage);
+#endif
+      gBench.firstStart = g_get_monotonic_time();
+   }
+
+   sample->heap = RpcDebugBenchHeapInUse();
+   sample->start = g_get_monotonic_time();
+}
+
+
+/**
+ * Records the measurements of an RPC once it has been dispatched.
+ *
+ * @param[in]  sample      Measurements taken before the dispatch.
+ * @param[in]  rpcdata     The RPC.
+ * @param[in]  success     Whether the service handled the RPC successfully.
+ *
+ * @return @a success, or TRUE when replaying a script: failed RPCs are
+ *         counted in the report instead of stopping the run.
+ */
+
+gboolean
+RpcDebugBench_End(RpcDebugBenchSample *sample,
+                  RpcDebugMsgMapping *rpcdata,
+                  gboolean success)
+{
+   RpcDebugBenchStat *cmd;
+   gint64 latency;
+   gchar *name;
+   const char *end;
+
+   if (!gBench.active) {
+      return success;
+   }
+
+   gBench.lastEnd = g_get_monotonic_time();
+   latency = gBench.lastEnd - sample->start;
+
+   end = memchr(rpcdata->message, ' ', rpcdata->messageLen);
+   name = g_strndup(rpcdata->message,
+                    end != NULL ? end - rpcdata->message
+                                : rpcdata->messageLen);
+
+   cmd = g_hash_table_lookup(gBench.stats, name);
+   if (cmd == NULL) {
+      cmd = g_new0(RpcDebugBenchStat, 1);
+      cmd->latencies = g_array_new(FALSE, FALSE, sizeof (gint64));
+      g_hash_table_insert(gBench.stats, name, cmd);
+   } else {
+      g_free(name);
+   }
+
+   g_array_append_val(cmd->latencies, latency);
+   if (!success) {
+      cmd->failures++;
+   }
+   cmd->heapGrowth += RpcDebugBenchHeapInUse() - sample->heap;
+
+   return success || gBench.script != NULL;
+}
+
+
+/**
+ * Writes the benchmark report and frees the benchmark state.
+ */
+
+void
+RpcDebugBench_Report(void)
+{
+   FILE *out = stdout;
+   gint64 wall;
+   guint i;
+
+   if (!gBench.active) {
+      return;
+   }
+
+   if (gBench.reportPath != NULL && strcmp(gBench.reportPath, "-") != 0) {
+      out = fopen(gBench.reportPath, "w");
+      if (out == NULL) {
+         g_warning("Can't open benchmark report %s, using stdout.\n",
+                   gBench.reportPath);
+         out = stdout;
+      }
+   }
+
+   wall = gBench.lastEnd - gBench.firstStart;
+   fprintf(out, "# rate %u/s, burst %u, wall time %"G_GINT64_FORMAT" us\n",
+           gBench.rate, gBench.burst, wall);
+
+#if !defined(_WIN32)
+   if (gBench.firstStart != 0) {
+      struct rusage usage;
+      gint64 user;
+      gint64 sys;
+
+      getrusage(RUSAGE_SELF, &usage);
+      user = (usage.ru_utime.tv_sec - gBench.firstUsage.ru_utime.tv_sec) *
+             G_GINT64_CONSTANT(1000000) +
+             (usage.ru_utime.tv_usec - gBench.firstUsage.ru_utime.tv_usec);
+      sys = (usage.ru_stime.tv_sec - gBench.firstUsage.ru_stime.tv_sec) *
+            G_GINT64_CONSTANT(1000000) +
+            (usage.ru_stime.tv_usec - gBench.firstUsage.ru_stime.tv_usec);
+      fprintf(out, "# cpu user %"G_GINT64_FORMAT" us, sys %"G_GINT64_FORMAT
+              " us, max rss %ld KB\n", user, sys, (long) usage.ru_maxrss);
+   }
+#endif
+
+   fprintf(out, "%-40s %8s %6s %10s %10s %10s %10s %12s\n", "# command",
+           "count", "failed", "p50 us", "p90 us", "p99 us", "max us",
+           "heap B/rpc");
+   g_hash_table_foreach(gBench.stats, RpcDebugBenchReportStat, out);
+
+   if (out != stdout) {
+      fclose(out);
+   } else {
+      fflush(out);
+   }
+
+   g_hash_table_destroy(gBench.stats);
+   if (gBench.script != NULL) {
+      for (i = 0; i < gBench.script->len; i++) {
+         g_free(g_array_index(gBench.script, RpcDebugBenchMsg, i).message);
+      }
+      g_array_free(gBench.script, TRUE);
+   }
+   g_free(gBench.reportPath);
+   memset(&gBench, 0, sizeof gBench);
+}
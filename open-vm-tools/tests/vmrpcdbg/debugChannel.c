@@ -45,31 +45,34 @@ typedef struct DbgChannelData {
 } DbgChannelData;
 
 /**
- * Reads one RPC from the plugin and dispatches it to the application.
- * This function will ask the service process to stop running if a
- * failure occurs, where failure is defined either by the validation
- * function returning FALSE, or, if no validation function is provided,
- * the application's callback returning FALSE.
+ * Reads one RPC from the plugin (or the benchmark script) and dispatches it
+ * to the application. This function will ask the service process to stop
+ * running if a failure occurs, where failure is defined either by the
+ * validation function returning FALSE, or, if no validation function is
+ * provided, the application's callback returning FALSE.
  *
- * @param[in]  _chan    The RPC channel instance.
+ * @param[in]  chan     The RPC channel instance.
+ * @param[out] sent     Whether an RPC was dispatched.
  *
  * @return TRUE if the callback should continue to be scheduled.
  */
 
 static gboolean
-RpcDebugDispatch(gpointer _chan)
+RpcDebugDispatchOne(RpcChannel *chan,
+                    gboolean *sent)
 {
    gboolean ret;
-   RpcChannel *chan = _chan;
    DbgChannelData *cdata = chan->_private;
    RpcDebugPlugin *plugin = cdata->plugin;
    RpcInData data;
    RpcDebugMsgMapping rpcdata;
+   RpcDebugBenchSample sample;
 
    memset(&data, 0, sizeof data);
    memset(&rpcdata, 0, sizeof rpcdata);
+   *sent = FALSE;
 
-   if (plugin->sendFn == NULL || !plugin->sendFn(&rpcdata)) {
+   if (!RpcDebugBench_GetNext(plugin, &rpcdata)) {
       RpcDebug_DecRef(cdata->ctx);
       cdata->hasLibRef = FALSE;
       return FALSE;
@@ -81,12 +84,15 @@ RpcDebugDispatch(gpointer _chan)
       return TRUE;
    }
 
+   *sent = TRUE;
    data.clientData = chan;
    data.appCtx = cdata->ctx;
    data.args = rpcdata.message;
    data.argsSize = rpcdata.messageLen;
 
+   RpcDebugBench_Begin(&sample);
    ret = RpcChannel_Dispatch(&data);
+   ret = RpcDebugBench_End(&sample, &rpcdata, ret);
    if (rpcdata.validateFn != NULL) {
       ret = rpcdata.validateFn(&data, ret);
    } else if (!ret) {
@@ -111,10 +117,40 @@ RpcDebugDispatch(gpointer _chan)
 }
 
 
+/**
+ * Timer callback that dispatches the next RPCs: one normally, a burst of
+ * them in benchmark mode.
+ *
+ * @param[in]  _chan    The RPC channel instance.
+ *
+ * @return TRUE if the callback should continue to be scheduled.
+ */
+
+static gboolean
+RpcDebugDispatch(gpointer _chan)
+{
+   guint burst = RpcDebugBench_GetBurst();
+   guint i;
+
+   for (i = 0; i < burst; i++) {
+      gboolean sent;
+
+      if (!RpcDebugDispatchOne(_chan, &sent)) {
+         return FALSE;
+      }
+      if (!sent) {
+         break;
+      }
+   }
+   return TRUE;
+}
+
+
 /**
  * Starts sending data to the service. The function will send one RPC
  * approximately every 100ms, to somewhat mimic the behavior of the
- * backdoor-based channel.
+ * backdoor-based channel. In benchmark mode, RPCs are sent at the
+ * configured rate instead.
  *
  * @param[in]  chan     The RPC channel instance.
  *
@@ -129,7 +165,7 @@ RpcDebugStart(RpcChannel *chan)
    ASSERT(data->ctx != NULL);
    ASSERT(data->msgTimer == NULL);
 
-   data->msgTimer = g_timeout_source_new(100);
+   data->msgTimer = g_timeout_source_new(RpcDebugBench_GetInterval());
    VMTOOLSAPP_ATTACH_SOURCE(data->ctx,
                             data->msgTimer,
                             RpcDebugDispatch,
@@ -110,6 +110,7 @@ RpcDebugRun(ToolsAppCtx *ctx,
    CU_ErrorCode err;
    CU_Suite *suite;
    CU_Test *test;
+   const gchar *name = gPlugin != NULL ? g_module_name(gPlugin) : "bench";
 
    ASSERT(runMainLoop != NULL);
    ASSERT(ldata != NULL);
@@ -117,10 +118,10 @@ RpcDebugRun(ToolsAppCtx *ctx,
    err = CU_initialize_registry();
    ASSERT(err == CUE_SUCCESS);
 
-   suite = CU_add_suite(g_module_name(gPlugin), NULL, NULL);
+   suite = CU_add_suite(name, NULL, NULL);
    ASSERT(suite != NULL);
 
-   test = CU_add_test(suite, g_module_name(gPlugin), RpcDebugRunLoop);
+   test = CU_add_test(suite, name, RpcDebugRunLoop);
    ASSERT_NOT_IMPLEMENTED(test != NULL);
 
    gLibRunData.ctx = ctx;
@@ -129,6 +130,7 @@ RpcDebugRun(ToolsAppCtx *ctx,
    gLibRunData.loopData = runData;
 
    err = CU_basic_run_tests();
+   RpcDebugBench_Report();
 
    /* Clean up internal library / debug plugin state. */
    ASSERT(g_atomic_int_get(&gLibRunData.refCount) >= 0);
@@ -178,7 +180,8 @@ RpcDebug_IncRef(void)
 
 /**
  * Initializes the debug library and loads the debug plugin at the given path.
- * This function panics if something goes wrong.
+ * The path "bench" selects the built-in benchmark plugin instead (see
+ * benchmark.c). This function panics if something goes wrong.
  *
  * @param[in]  ctx         The application context.
  * @param[in]  dbgPlugin   Path to the debug plugin.
@@ -196,6 +199,13 @@ RpcDebug_Initialize(ToolsAppCtx *ctx,
    ASSERT(gPlugin == NULL);
 
    ldata = g_malloc(sizeof *ldata);
+   ldata->newDebugChannel = RpcDebug_NewDebugChannel;
+   ldata->run = RpcDebugRun;
+
+   ldata->debugPlugin = RpcDebugBench_Init(dbgPlugin);
+   if (ldata->debugPlugin != NULL) {
+      return ldata;
+   }
 
    gPlugin = g_module_open(dbgPlugin, G_MODULE_BIND_LOCAL);
    if (gPlugin == NULL) {
@@ -211,9 +221,6 @@ RpcDebug_Initialize(ToolsAppCtx *ctx,
       g_error("No registration data from plugin %s\n", dbgPlugin);
    }
 
-   ldata->newDebugChannel = RpcDebug_NewDebugChannel;
-   ldata->run = RpcDebugRun;
-
    return ldata;
 }
 
@@ -31,5 +31,35 @@ RpcChannel *
 RpcDebug_NewDebugChannel(ToolsAppCtx *ctx,
                          RpcDebugLibData *data);
 
+/** Measurements taken before dispatching an RPC in benchmark mode. */
+typedef struct RpcDebugBenchSample {
+   gint64   start;
+   gint64   heap;
+} RpcDebugBenchSample;
+
+RpcDebugPlugin *
+RpcDebugBench_Init(const gchar *dbgPlugin);
+
+guint
+RpcDebugBench_GetInterval(void);
+
+guint
+RpcDebugBench_GetBurst(void);
+
+gboolean
+RpcDebugBench_GetNext(RpcDebugPlugin *plugin,
+                      RpcDebugMsgMapping *rpcdata);
+
+void
+RpcDebugBench_Begin(RpcDebugBenchSample *sample);
+
+gboolean
+RpcDebugBench_End(RpcDebugBenchSample *sample,
+                  RpcDebugMsgMapping *rpcdata,
+                  gboolean success);
+
+void
+RpcDebugBench_Report(void);
+
 #endif /* _VMRPCDBGINT_H_ */
 
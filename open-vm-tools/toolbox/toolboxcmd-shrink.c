@@ -31,11 +31,13 @@
 #endif
 
 #include "vm_assert.h"
+#include "conf.h"
 #include "toolboxCmdInt.h"
 #include "guestApp.h"
 #include "wiper.h"
 #include "vmware/guestrpc/tclodefs.h"
 #include "vmware/tools/i18n.h"
+#include "vmware/tools/utils.h"
 
 #ifndef _WIN32
 static void ShrinkWiperDestroy(int signal);
@@ -63,16 +65,70 @@ static void ShrinkWiperDestroy(int signal);
    "Please close and reopen the Toolbox to synchronize "    \
    "it with the host.\n"
 
-static Wiper_State *wiper = NULL;
-
 #define WIPER_STATE_CMD "disk.wiper.enable"
 
+/* How often to update the progress while threads do the wiping (us) */
+#define SHRINK_PROGRESS_INTERVAL (200 * 1000)
+
 typedef enum {
    WIPER_UNAVAILABLE,
    WIPER_DISABLED,
    WIPER_ENABLED,
 } WiperState;
 
+/* A partition being wiped. */
+typedef struct ShrinkWipeJob {
+   WiperPartition *part;
+   Wiper_State *wiper;
+   volatile gint progress;
+   volatile gint done;
+   unsigned char *err;       // Error returned by Wiper_Next, if any
+   uint64 maxRate;           // Bytes per second, 0 for no limit
+   uint64 startFree;         // Free bytes when the wipe started
+   GTimer *timer;            // Started with the wipe
+   GThread *thread;          // NULL when wiped by the main thread
+#if !defined(_WIN32)
+   Bool haveStats;
+   WiperStats stats;         // Protected by gShrinkStatsLock
+#endif
+} ShrinkWipeJob;
+
+/* Set while partitions are being wiped, and when SIGINT cancels them. */
+static volatile Bool gShrinkWiping = FALSE;
+static volatile gint gShrinkCanceled = FALSE;
+
+/* Pause after each step of a wipe (us), raised by adaptive pacing. */
+static volatile gint gShrinkPaceDelay = 0;
+
+#if !defined(_WIN32)
+G_LOCK_DEFINE_STATIC(gShrinkStatsLock);
+#endif
+
+#if defined(__linux__)
+#define DISKSTATS_FILE "/proc/diskstats"
+
+/* How often adaptive pacing checks the guest's disk read latency (s) */
+#define SHRINK_PACE_INTERVAL     1.0
+
+/* Read latency that adaptive pacing always tolerates (ms) */
+#define SHRINK_PACE_MIN_TARGET   10.0
+
+/* Bounds of the pause adaptive pacing adds after each step (us) */
+#define SHRINK_PACE_MIN_DELAY    (10 * 1000)
+#define SHRINK_PACE_MAX_DELAY    (1000 * 1000)
+
+/*
+ * Adaptive pacing watches the latency of the guest's disk reads: the wiper
+ * only writes, so that's the latency the guest's workload sees behind it.
+ */
+typedef struct ShrinkPacer {
+   GTimer *timer;            // Since the last sample
+   uint64 reads;             // Reads completed as of the last sample
+   uint64 readMS;            // Time spent reading as of the last sample
+   gdouble targetMS;         // Read latency to stay under
+} ShrinkPacer;
+#endif
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -312,13 +368,413 @@ ShrinkDoAllDiskShrinkOnly(void)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ShrinkLoadConfig  --
+ *
+ *      Gets the configured cap on the rate at which wiper files are written,
+ *      and whether to pace the wipe by the guest's disk latency.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+ShrinkLoadConfig(uint64 *maxRate,         // OUT: bytes per second, 0 for none
+                 gboolean *adaptive)      // OUT
+{
+   GKeyFile *conf = NULL;
+   gint rate = 0;
+
+   *adaptive = FALSE;
+
+   VMTools_LoadConfig(NULL, G_KEY_FILE_NONE, &conf, NULL);
+   if (conf != NULL) {
+      rate = VMTools_ConfigGetInteger(conf, CONFGROUPNAME_DISKWIPE,
+                                      CONFNAME_DISKWIPE_MAXRATE, 0);
+      *adaptive = VMTools_ConfigGetBoolean(conf, CONFGROUPNAME_DISKWIPE,
+                                           CONFNAME_DISKWIPE_ADAPTIVEPACING,
+                                           FALSE);
+      g_key_file_free(conf);
+   }
+
+   *maxRate = rate > 0 ? ((uint64)rate) << 20 : 0;
+}
+
+
+#if defined(__linux__)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ShrinkReadDiskStats  --
+ *
+ *      Sums up the reads completed by the guest's disks since boot, and the
+ *      time spent on them, from /proc/diskstats. Partitions are left out
+ *      (they are counted in their disk already), and so are RAM disks and
+ *      loop devices.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+ShrinkReadDiskStats(uint64 *reads,   // OUT
+                    uint64 *readMS)  // OUT
+{
+   FILE *f = fopen(DISKSTATS_FILE, "r");
+   char line[256];
+
+   if (f == NULL) {
+      g_debug("Unable to open %s\n", DISKSTATS_FILE);
+      return FALSE;
+   }
+
+   *reads = 0;
+   *readMS = 0;
+   while (fgets(line, sizeof line, f) != NULL) {
+      char name[64];
+      char sysPath[128];
+      uint64 r;
+      uint64 ms;
+
+      if (sscanf(line, "%*u %*u %63s %"FMT64"u %*u %*u %"FMT64"u",
+                 name, &r, &ms) != 3 ||
+          strncmp(name, "loop", 4) == 0 ||
+          strncmp(name, "ram", 3) == 0 ||
+          strncmp(name, "zram", 4) == 0) {
+         continue;
+      }
+
+      g_snprintf(sysPath, sizeof sysPath, "/sys/block/%s", name);
+      if (!g_file_test(sysPath, G_FILE_TEST_EXISTS)) {
+         continue;
+      }
+
+      *reads += r;
+      *readMS += ms;
+   }
+
+   fclose(f);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ShrinkPacerInit  --
+ *
+ *      Starts adaptive pacing. The latency to stay under is twice the
+ *      guest's average read latency since boot, or SHRINK_PACE_MIN_TARGET if
+ *      that is more.
+ *
+ * Results:
+ *      TRUE on success, FALSE if the disk statistics are not available.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+ShrinkPacerInit(ShrinkPacer *pacer)  // OUT
+{
+   if (!ShrinkReadDiskStats(&pacer->reads, &pacer->readMS)) {
+      return FALSE;
+   }
+
+   pacer->targetMS = SHRINK_PACE_MIN_TARGET;
+   if (pacer->reads > 0) {
+      pacer->targetMS = MAX(pacer->targetMS,
+                            2.0 * pacer->readMS / pacer->reads);
+   }
+   pacer->timer = g_timer_new();
+   g_debug("Pacing the wipe to keep disk reads under %.1f ms.\n",
+           pacer->targetMS);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ShrinkPacerUpdate  --
+ *
+ *      Every SHRINK_PACE_INTERVAL, compares the guest's read latency over the
+ *      last interval with the target. The pause after each wipe step doubles
+ *      while the latency is above it, and shrinks by a quarter while it's
+ *      below (no reads, no change).
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates gShrinkPaceDelay.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+ShrinkPacerUpdate(ShrinkPacer *pacer)  // IN/OUT
+{
+   uint64 reads;
+   uint64 readMS;
+   gint delay;
+
+   if (g_timer_elapsed(pacer->timer, NULL) < SHRINK_PACE_INTERVAL ||
+       !ShrinkReadDiskStats(&reads, &readMS)) {
+      return;
+   }
+   g_timer_start(pacer->timer);
+
+   delay = g_atomic_int_get(&gShrinkPaceDelay);
+   if (reads > pacer->reads) {
+      gdouble latency = (gdouble)(readMS - pacer->readMS) /
+                        (reads - pacer->reads);
+
+      if (latency > pacer->targetMS) {
+         delay = MIN(MAX(2 * delay, SHRINK_PACE_MIN_DELAY),
+                     SHRINK_PACE_MAX_DELAY);
+      } else {
+         delay -= delay / 4;
+         if (delay < SHRINK_PACE_MIN_DELAY) {
+            delay = 0;
+         }
+      }
+
+      if (delay != g_atomic_int_get(&gShrinkPaceDelay)) {
+         g_debug("Read latency %.1f ms, pausing %d ms per wipe step.\n",
+                 latency, delay / 1000);
+         g_atomic_int_set(&gShrinkPaceDelay, delay);
+      }
+   }
+
+   pacer->reads = reads;
+   pacer->readMS = readMS;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ShrinkFindPartition  --
+ *
+ *      Looks up the partition mounted at the given mount point, preferring a
+ *      supported one if there are several, and detaches it from the list.
+ *
+ * Results:
+ *      The partition, to be freed with WiperSinglePartition_Close, or NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static WiperPartition *
+ShrinkFindPartition(WiperPartition_List *plist,  // IN/OUT
+                    const char *mountPoint)      // IN
+{
+   WiperPartition *part = NULL;
+   DblLnkLst_Links *curr, *nextElem;
+
+   DblLnkLst_ForEachSafe(curr, nextElem, &plist->link) {
+      WiperPartition *p = DblLnkLst_Container(curr, WiperPartition, link);
+      if (toolbox_strcmp(p->mountPoint, mountPoint) == 0) {
+         WiperSinglePartition_Close(part);
+         part = p;
+         /*
+          * Detach the element we are interested in so it is not
+          * destroyed when we call WiperPartition_Close.
+          */
+         DblLnkLst_Unlink1(&part->link);
+         if (part->type != PARTITION_UNSUPPORTED) {
+            break;
+         }
+      }
+   }
+
+   return part;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ShrinkWipeStep  --
+ *
+ *      Does one call to Wiper_Next for the given partition, then waits if the
+ *      partition is being wiped faster than its share of the maximum rate.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets job->done once the wipe is complete, failed or was canceled.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+ShrinkWipeStep(ShrinkWipeJob *job)  // IN/OUT
+{
+   unsigned int progress;
+   unsigned char *err;
+   uint64 free;
+   uint64 total;
+
+   if (g_atomic_int_get(&gShrinkCanceled)) {
+      Wiper_Cancel(&job->wiper);
+      g_atomic_int_set(&job->done, TRUE);
+      return;
+   }
+
+   err = Wiper_Next(&job->wiper, &progress);
+   if (strlen(err) > 0) {
+      job->err = err;
+      g_atomic_int_set(&job->done, TRUE);
+      return;
+   }
+
+   g_atomic_int_set(&job->progress, progress);
+   if (progress >= 100 || job->wiper == NULL) {
+      g_atomic_int_set(&job->done, TRUE);
+      return;
+   }
+
+#if !defined(_WIN32)
+   G_LOCK(gShrinkStatsLock);
+   Wiper_GetStats(job->wiper, &job->stats);
+   job->haveStats = TRUE;
+   G_UNLOCK(gShrinkStatsLock);
+#endif
+
+   /*
+    * Whatever the wiper wrote shows up as used space. Sleep until the time
+    * writing it would have taken at the maximum rate, but never for long at
+    * once so that a cancel is still noticed (other processes may be using up
+    * space too).
+    */
+   if (job->maxRate != 0 &&
+       *WiperSinglePartition_GetSpace(job->part, &free, &total) == '\0' &&
+       free < job->startFree) {
+      gdouble due = (gdouble)(job->startFree - free) / job->maxRate;
+      gdouble ahead = due - g_timer_elapsed(job->timer, NULL);
+
+      if (ahead > 0) {
+         g_usleep((gulong)(MIN(ahead, 1.0) * G_USEC_PER_SEC));
+      }
+   }
+
+   if (g_atomic_int_get(&gShrinkPaceDelay) > 0) {
+      g_usleep(g_atomic_int_get(&gShrinkPaceDelay));
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ShrinkPrintProgress  --
+ *
+ *      Prints the progress of the wipe, with the throughput and the time left
+ *      when the wiper has an estimate of them.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+ShrinkPrintProgress(ShrinkWipeJob *jobs,  // IN
+                    int numJobs,          // IN
+                    int progress)         // IN
+{
+   int i;
+   char rate[64] = "";
+#if !defined(_WIN32)
+   uint64 bytesPerSec = 0;
+   uint64 etaSec = 0;
+
+   G_LOCK(gShrinkStatsLock);
+   for (i = 0; i < numJobs; i++) {
+      if (jobs[i].haveStats && !g_atomic_int_get(&jobs[i].done)) {
+         bytesPerSec += jobs[i].stats.bytesPerSec;
+         etaSec = MAX(etaSec, jobs[i].stats.etaSec);
+      }
+   }
+   G_UNLOCK(gShrinkStatsLock);
+
+   if (bytesPerSec > 0) {
+      g_snprintf(rate, sizeof rate, "%.1f MB/s, %u:%02u:%02u left",
+                 (double)bytesPerSec / (1 << 20), (unsigned)(etaSec / 3600),
+                 (unsigned)(etaSec / 60 % 60), (unsigned)(etaSec % 60));
+   }
+#endif
+
+   g_print(SU_(disk.wiper.progress, "\rProgress: %d"), progress);
+   g_print(" [");
+   for (i = 0; i <= progress / 10; i++) {
+      putchar('=');
+   }
+   g_print(">%*c %-32s", 10 - i + 1, ']', rate);
+   fflush(stdout);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ShrinkWipeRun  --
+ *
+ *      Thread wiping a single partition.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      See ShrinkWipeStep.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gpointer
+ShrinkWipeRun(gpointer data)  // IN: ShrinkWipeJob
+{
+   ShrinkWipeJob *job = data;
+
+   while (!g_atomic_int_get(&job->done)) {
+      ShrinkWipeStep(job);
+   }
+   return NULL;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * ShrinkDoWipeAndShrink  --
  *
- *      Wipe a single partition, returning only when the wiper
- *      operation is done or canceled.
+ *      Wipe the given partitions, returning only when the wiper operations
+ *      are done or canceled. Several partitions are wiped concurrently, one
+ *      thread each, sharing the configured maximum rate.
  *      Caller can optionally indicate whether a disk shrink operation is required
  *      to be performed after the wipe operation or not.
  *
@@ -328,22 +784,29 @@ ShrinkDoAllDiskShrinkOnly(void)
  *      EX_TEMPFAIL on failure.
  *
  * Side effects:
- *      The wipe operation will fill the partition with dummy files.
+ *      The wipe operation will fill the partitions with dummy files.
  *      Prints to stderr on errors.
  *
  *-----------------------------------------------------------------------------
  */
 
 static int
-ShrinkDoWipeAndShrink(char *mountPoint,         // IN: mount point
+ShrinkDoWipeAndShrink(char **mountPoints,       // IN: mount points
+                      int numMountPoints,       // IN
                       gboolean quiet,           // IN: verbosity flag
                       gboolean performShrink)   // IN: perform a shrink operation
 {
    int i;
-   int progress = 0;
-   unsigned char *err;
-   WiperPartition *part = NULL;
+   int numDone;
+   Bool complete = TRUE;
+   ShrinkWipeJob *jobs;
    WiperPartition_List plist;
+   WiperState wstate;
+   uint64 maxRate;
+   gboolean adaptive;
+#if defined(__linux__)
+   ShrinkPacer pacer;
+#endif
    int rc;
 
 #if defined(_WIN32)
@@ -352,51 +815,47 @@ ShrinkDoWipeAndShrink(char *mountPoint,         // IN: mount point
    signal(SIGINT, ShrinkWiperDestroy);
 #endif
 
+   jobs = g_new0(ShrinkWipeJob, numMountPoints);
+
    if (ShrinkGetMountPoints(&plist)) {
-      DblLnkLst_Links *curr, *nextElem;
-      DblLnkLst_ForEachSafe(curr, nextElem, &plist.link) {
-         WiperPartition *p = DblLnkLst_Container(curr, WiperPartition, link);
-         if (toolbox_strcmp(p->mountPoint, mountPoint) == 0) {
-            WiperSinglePartition_Close(part);
-            part = p;
-            /*
-             * Detach the element we are interested in so it is not
-             * destroyed when we call WiperPartition_Close.
-             */
-            DblLnkLst_Unlink1(&part->link);
-            if (part->type != PARTITION_UNSUPPORTED) {
-               break;
-            }
-         }
+      for (i = 0; i < numMountPoints; i++) {
+         jobs[i].part = ShrinkFindPartition(&plist, mountPoints[i]);
       }
       WiperPartition_Close(&plist);
    }
 
-   if (part == NULL) {
-      ToolsCmd_PrintErr(SU_(disk.shrink.partition.notfound,
-                            "Unable to find partition %s\n"),
-                        mountPoint);
-      return EX_OSFILE;
-   }
+   wstate = ShrinkGetWiperState();
 
-   if (part->type == PARTITION_UNSUPPORTED) {
-      ToolsCmd_PrintErr(SU_(disk.shrink.partition.unsupported,
-                            "Partition %s is not shrinkable\n"),
-                        part->mountPoint);
-      rc = EX_UNAVAILABLE;
-      goto out;
-   }
+   for (i = 0; i < numMountPoints; i++) {
+      WiperPartition *part = jobs[i].part;
 
-   /*
-    * Verify that wiping/shrinking are permitted before going through with the
-    * wiping operation.
-    */
-   if (ShrinkGetWiperState() != WIPER_ENABLED && !Wiper_IsWipeSupported(part)) {
-      g_debug("%s cannot be wiped / shrunk\n", mountPoint);
-      ToolsCmd_PrintErr("%s",
-                        SU_(disk.shrink.disabled, SHRINK_DISABLED_ERR));
-      rc = EX_TEMPFAIL;
-      goto out;
+      if (part == NULL) {
+         ToolsCmd_PrintErr(SU_(disk.shrink.partition.notfound,
+                               "Unable to find partition %s\n"),
+                           mountPoints[i]);
+         rc = EX_OSFILE;
+         goto out;
+      }
+
+      if (part->type == PARTITION_UNSUPPORTED) {
+         ToolsCmd_PrintErr(SU_(disk.shrink.partition.unsupported,
+                               "Partition %s is not shrinkable\n"),
+                           part->mountPoint);
+         rc = EX_UNAVAILABLE;
+         goto out;
+      }
+
+      /*
+       * Verify that wiping/shrinking are permitted before going through with
+       * the wiping operation.
+       */
+      if (wstate != WIPER_ENABLED && !Wiper_IsWipeSupported(part)) {
+         g_debug("%s cannot be wiped / shrunk\n", mountPoints[i]);
+         ToolsCmd_PrintErr("%s",
+                           SU_(disk.shrink.disabled, SHRINK_DISABLED_ERR));
+         rc = EX_TEMPFAIL;
+         goto out;
+      }
    }
 
    /*
@@ -416,7 +875,29 @@ ShrinkDoWipeAndShrink(char *mountPoint,         // IN: mount point
                                "for the duration of wipe process.\n"));
    }
 
-   wiper = Wiper_Start(part, MAX_WIPER_FILE_SIZE);
+   ShrinkLoadConfig(&maxRate, &adaptive);
+   maxRate /= numMountPoints;
+#if defined(__linux__)
+   adaptive = adaptive && ShrinkPacerInit(&pacer);
+#else
+   adaptive = FALSE;
+#endif
+   gShrinkWiping = TRUE;
+
+   for (i = 0; i < numMountPoints; i++) {
+      uint64 total;
+
+      jobs[i].maxRate = maxRate;
+      jobs[i].timer = g_timer_new();
+      if (maxRate != 0) {
+         WiperSinglePartition_GetSpace(jobs[i].part, &jobs[i].startFree,
+                                       &total);
+      }
+      jobs[i].wiper = Wiper_Start(jobs[i].part, MAX_WIPER_FILE_SIZE);
+      if (jobs[i].wiper == NULL) {
+         jobs[i].done = TRUE;
+      }
+   }
 
 #if defined(_WIN32)
    /*
@@ -428,31 +909,72 @@ ShrinkDoWipeAndShrink(char *mountPoint,         // IN: mount point
    }
 #endif
 
-   while (progress < 100 && wiper != NULL) {
-      err = Wiper_Next(&wiper, &progress);
-      if (strlen(err) > 0) {
-         if (strcmp(err, "error.create") == 0) {
-            ToolsCmd_PrintErr("%s",
-                              SU_(disk.wiper.file.error,
-                                  "Error, Unable to create wiper file.\n"));
-         } else {
-            ToolsCmd_PrintErr(SU_(disk.wiper.error, "Error: %s"), err);
+   /*
+    * Partitions that could not get a thread of their own (and a single
+    * partition) are wiped from here, between progress updates.
+    */
+   if (numMountPoints > 1) {
+      if (!g_thread_supported()) {
+         g_thread_init(NULL);
+      }
+
+      for (i = 0; i < numMountPoints; i++) {
+         GError *err = NULL;
+
+         jobs[i].thread = g_thread_create(ShrinkWipeRun, &jobs[i], TRUE, &err);
+         if (jobs[i].thread == NULL) {
+            g_debug("Unable to start a thread to wipe %s: %s\n",
+                    mountPoints[i], err != NULL ? err->message : "");
+            g_clear_error(&err);
          }
+      }
+   }
 
-         rc = EX_TEMPFAIL;
-         break;
+   do {
+      Bool stepped = FALSE;
+      int progress = 0;
+
+      numDone = 0;
+      for (i = 0; i < numMountPoints; i++) {
+         if (jobs[i].thread == NULL && !g_atomic_int_get(&jobs[i].done)) {
+            ShrinkWipeStep(&jobs[i]);
+            stepped = TRUE;
+         }
+         if (g_atomic_int_get(&jobs[i].done)) {
+            numDone++;
+         }
+         progress += g_atomic_int_get(&jobs[i].progress);
       }
+      progress /= numMountPoints;
 
       if (!quiet) {
-         g_print(SU_(disk.wiper.progress, "\rProgress: %d"), progress);
-         g_print(" [");
-         for (i = 0; i <= progress / 10; i++) {
-            putchar('=');
-         }
-         g_print(">%*c", 10 - i + 1, ']');
-         fflush(stdout);
+         ShrinkPrintProgress(jobs, numMountPoints, progress);
+      }
+
+#if defined(__linux__)
+      if (adaptive) {
+         ShrinkPacerUpdate(&pacer);
+      }
+#endif
+
+      if (!stepped && numDone < numMountPoints) {
+         g_usleep(SHRINK_PROGRESS_INTERVAL);
+      }
+   } while (numDone < numMountPoints);
+
+   for (i = 0; i < numMountPoints; i++) {
+      if (jobs[i].thread != NULL) {
+         g_thread_join(jobs[i].thread);
+         jobs[i].thread = NULL;
       }
    }
+   gShrinkWiping = FALSE;
+   g_atomic_int_set(&gShrinkPaceDelay, 0);
+#if defined(__linux__)
+   if (adaptive) {
+      g_timer_destroy(pacer.timer);
+   }
+#endif
 
 #if defined(_WIN32)
    /* Go back to our original priority. */
@@ -461,11 +983,33 @@ ShrinkDoWipeAndShrink(char *mountPoint,         // IN: mount point
    }
 #endif
 
-   rc = EXIT_SUCCESS;
    g_print("\n");
-   if (progress >= 100 && performShrink) {
+   for (i = 0; i < numMountPoints; i++) {
+      if (jobs[i].err != NULL) {
+         if (numMountPoints > 1) {
+            ToolsCmd_PrintErr("%s: ", jobs[i].part->mountPoint);
+         }
+         if (strcmp(jobs[i].err, "error.create") == 0) {
+            ToolsCmd_PrintErr("%s",
+                              SU_(disk.wiper.file.error,
+                                  "Error, Unable to create wiper file.\n"));
+         } else {
+            ToolsCmd_PrintErr(SU_(disk.wiper.error, "Error: %s"), jobs[i].err);
+         }
+      }
+      if (jobs[i].progress < 100) {
+         complete = FALSE;
+      }
+   }
+
+   rc = EXIT_SUCCESS;
+   if (gShrinkCanceled) {
+      goto out;
+   }
+
+   if (complete && performShrink) {
       rc = ShrinkDiskSendRPC();
-   } else if (progress < 100) {
+   } else if (!complete) {
       rc = EX_TEMPFAIL;
    } else {
       g_debug("Shrinking skipped.\n");
@@ -477,9 +1021,19 @@ ShrinkDoWipeAndShrink(char *mountPoint,         // IN: mount point
    }
 
 out:
-   WiperSinglePartition_Close(part);
-   free(wiper);
-   wiper = NULL;
+   for (i = 0; i < numMountPoints; i++) {
+      Wiper_Cancel(&jobs[i].wiper);
+      if (jobs[i].timer != NULL) {
+         g_timer_destroy(jobs[i].timer);
+      }
+      WiperSinglePartition_Close(jobs[i].part);
+   }
+   g_free(jobs);
+
+   if (gShrinkCanceled) {
+      ToolsCmd_Print("%s", SU_(disk.shrink.canceled, "Disk shrink canceled.\n"));
+      exit(EXIT_SUCCESS);
+   }
    return rc;
 }
 
@@ -505,9 +1059,10 @@ out:
 void
 ShrinkWiperDestroy(int signal)	// IN: Signal caught
 {
-   if (wiper != NULL) {
-      Wiper_Cancel(&wiper);
-      wiper = NULL;
+   if (gShrinkWiping) {
+      /* The wipers notice, clean up and ShrinkDoWipeAndShrink exits. */
+      g_atomic_int_set(&gShrinkCanceled, TRUE);
+      return;
    }
    ToolsCmd_Print("%s", SU_(disk.shrink.canceled, "Disk shrink canceled.\n"));
    exit(EXIT_SUCCESS);
@@ -543,14 +1098,14 @@ Disk_Command(char **argv,      // IN: command line arguments
       if (++optind >= argc) {
          ToolsCmd_MissingEntityError(argv[0], SU_(arg.mountpoint, "mount point"));
       } else {
-         return ShrinkDoWipeAndShrink(argv[optind], quiet,
+         return ShrinkDoWipeAndShrink(argv + optind, argc - optind, quiet,
                                       TRUE /* perform shrink */);
       }
    } else if (toolbox_strcmp(argv[optind], "wipe") == 0) {
       if (++optind >= argc) {
          ToolsCmd_MissingEntityError(argv[0], SU_(arg.mountpoint, "mount point"));
       } else {
-         return ShrinkDoWipeAndShrink(argv[optind], quiet,
+         return ShrinkDoWipeAndShrink(argv + optind, argc - optind, quiet,
                                       FALSE /* do not perform shrink */);
       }
    } else if (toolbox_strcmp(argv[optind], "shrinkonly") == 0) {
@@ -588,9 +1143,9 @@ Disk_Help(const char *progName, // IN: The name of the program obtained from arg
                           "Usage: %s %s <subcommand> [args]\n\n"
                           "Subcommands:\n"
                           "   list: list available locations\n"
-                          "   shrink <location>: wipes and shrinks a file system at the given location\n"
+                          "   shrink <location>...: wipes and shrinks the file systems at the given locations\n"
                           "   shrinkonly: shrinks all disks\n"
-                          "   wipe <location>: wipes a file system at the given location\n"),
+                          "   wipe <location>...: wipes the file systems at the given locations\n"),
            cmd, progName, cmd);
 }
 
@@ -26,6 +26,7 @@
 #include "toolboxCmdInt.h"
 #include "backdoor.h"
 #include "backdoor_def.h"
+#include "vm_basic_defs.h"
 #include "vmware/tools/i18n.h"
 
 
@@ -524,6 +525,249 @@ StatGetRaw(const char *encoding,  // IN
 }
 
 
+/*
+ * The stats "batch" and "watch" can sample from a single guestlib update.
+ * Exactly one getter is set for each.
+ */
+
+typedef struct StatSampleField {
+   const char *name;
+   VMGuestLibError (*get32)(VMGuestLibHandle, uint32 *);
+   VMGuestLibError (*get64)(VMGuestLibHandle, uint64 *);
+} StatSampleField;
+
+static const StatSampleField statSampleFields[] = {
+   { "sessionid", NULL,                           VMGuestLib_GetSessionId },
+   { "balloon",   VMGuestLib_GetMemBalloonedMB,   NULL },
+   { "swap",      VMGuestLib_GetMemSwappedMB,     NULL },
+   { "memlimit",  VMGuestLib_GetMemLimitMB,       NULL },
+   { "memres",    VMGuestLib_GetMemReservationMB, NULL },
+   { "memactive", VMGuestLib_GetMemActiveMB,      NULL },
+   { "memused",   VMGuestLib_GetMemUsedMB,        NULL },
+   { "cpures",    VMGuestLib_GetCpuReservationMHz, NULL },
+   { "cpulimit",  VMGuestLib_GetCpuLimitMHz,      NULL },
+   { "cpuused",   NULL,                           VMGuestLib_GetCpuUsedMs },
+   { "cpustolen", NULL,                           VMGuestLib_GetCpuStolenMs },
+   { "elapsed",   NULL,                           VMGuestLib_GetElapsedMs },
+};
+
+typedef enum {
+   STAT_FORMAT_CSV,
+   STAT_FORMAT_JSON
+} StatSampleFormat;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * StatPrintSample  --
+ *
+ *      Prints one line with the requested stats from the last update of
+ *      the handle, as CSV or as a JSON object. A stat the host does not
+ *      provide is left empty (CSV) or null (JSON).
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+StatPrintSample(VMGuestLibHandle glHandle,          // IN
+                const StatSampleField **fields,     // IN
+                int numFields,                      // IN
+                StatSampleFormat format)            // IN
+{
+   GString *line = g_string_new(NULL);
+   int i;
+
+   if (format == STAT_FORMAT_JSON) {
+      g_string_append_printf(line, "{\"time\": %"FMT64"d",
+                             (int64)time(NULL));
+   } else {
+      g_string_append_printf(line, "%"FMT64"d", (int64)time(NULL));
+   }
+
+   for (i = 0; i < numFields; i++) {
+      const StatSampleField *field = fields[i];
+      VMGuestLibError glError;
+      uint32 value32 = 0;
+      uint64 value64 = 0;
+
+      if (format == STAT_FORMAT_JSON) {
+         g_string_append_printf(line, ", \"%s\": ", field->name);
+      } else {
+         g_string_append_c(line, ',');
+      }
+
+      if (field->get32 != NULL) {
+         glError = field->get32(glHandle, &value32);
+         value64 = value32;
+      } else {
+         glError = field->get64(glHandle, &value64);
+      }
+
+      if (glError != VMGUESTLIB_ERROR_SUCCESS) {
+         if (format == STAT_FORMAT_JSON) {
+            g_string_append(line, "null");
+         }
+      } else if (field->get64 == VMGuestLib_GetSessionId) {
+         /* too wide for JSON numbers; printed as "stat sessionid" does */
+         g_string_append_printf(line,
+                                format == STAT_FORMAT_JSON ?
+                                   "\"0x%"FMT64"x\"" : "0x%"FMT64"x",
+                                value64);
+      } else {
+         g_string_append_printf(line, "%"FMT64"u", value64);
+      }
+   }
+
+   if (format == STAT_FORMAT_JSON) {
+      g_string_append_c(line, '}');
+   }
+   g_print("%s\n", line->str);
+   fflush(stdout);
+   g_string_free(line, TRUE);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * StatSample  --
+ *
+ *      Handles "batch <format> [<stat>...]" and
+ *      "watch <interval> <format> [<stat>...]". All the stats of a sample
+ *      come from one update of a single guestlib handle; watch keeps the
+ *      handle open and prints a sample every interval seconds until the
+ *      process is interrupted. All stats are sampled if none are named.
+ *
+ * Results:
+ *      EXIT_SUCCESS on success.
+ *      EX_USAGE on bad arguments.
+ *      EX_UNAVAILABLE or EX_TEMPFAIL on failure to get the stats.
+ *
+ * Side effects:
+ *      Prints to stderr on error.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+StatSample(char **argv,      // IN: Command line arguments
+           int argc,         // IN: Length of command line arguments
+           gboolean watch)   // IN: Sample repeatedly
+{
+   int exitStatus;
+   int argIdx = optind + 1;
+   unsigned long interval = 0;
+   StatSampleFormat format;
+   const StatSampleField **fields;
+   int numFields = 0;
+   const int numKnownFields = ARRAYSIZE(statSampleFields);
+   VMGuestLibHandle glHandle;
+   VMGuestLibError glError;
+
+   if (watch) {
+      char *end;
+
+      if (argIdx >= argc) {
+         ToolsCmd_MissingEntityError(argv[0],
+                                     SU_(arg.stat.interval, "interval"));
+         return EX_USAGE;
+      }
+      interval = strtoul(argv[argIdx], &end, 10);
+      if (*end != '\0' || interval == 0) {
+         ToolsCmd_UnknownEntityError(argv[0],
+                                     SU_(arg.stat.interval, "interval"),
+                                     argv[argIdx]);
+         return EX_USAGE;
+      }
+      argIdx++;
+   }
+
+   if (argIdx >= argc) {
+      ToolsCmd_MissingEntityError(argv[0], SU_(arg.stat.format, "format"));
+      return EX_USAGE;
+   }
+   if (toolbox_strcmp(argv[argIdx], "csv") == 0) {
+      format = STAT_FORMAT_CSV;
+   } else if (toolbox_strcmp(argv[argIdx], "json") == 0) {
+      format = STAT_FORMAT_JSON;
+   } else {
+      ToolsCmd_UnknownEntityError(argv[0], SU_(arg.stat.format, "format"),
+                                  argv[argIdx]);
+      return EX_USAGE;
+   }
+   argIdx++;
+
+   fields = g_new(const StatSampleField *, MAX(argc - argIdx, numKnownFields));
+   if (argIdx >= argc) {
+      for (numFields = 0; numFields < numKnownFields; numFields++) {
+         fields[numFields] = &statSampleFields[numFields];
+      }
+   }
+   for (; argIdx < argc; argIdx++) {
+      int i;
+
+      for (i = 0; i < numKnownFields; i++) {
+         if (toolbox_strcmp(argv[argIdx], statSampleFields[i].name) == 0) {
+            break;
+         }
+      }
+      if (i == numKnownFields) {
+         ToolsCmd_UnknownEntityError(argv[0], SU_(arg.stat.name, "stat"),
+                                     argv[argIdx]);
+         g_free(fields);
+         return EX_USAGE;
+      }
+      fields[numFields++] = &statSampleFields[i];
+   }
+
+   exitStatus = OpenHandle(&glHandle, &glError);
+   if (exitStatus) {
+      if (exitStatus == EX_TEMPFAIL) {
+         VMGuestLib_CloseHandle(glHandle);
+      }
+      g_free(fields);
+      return exitStatus;
+   }
+
+   if (format == STAT_FORMAT_CSV) {
+      int i;
+
+      g_print("time");
+      for (i = 0; i < numFields; i++) {
+         g_print(",%s", fields[i]->name);
+      }
+      g_print("\n");
+   }
+
+   StatPrintSample(glHandle, fields, numFields, format);
+
+   while (watch) {
+      g_usleep(interval * G_USEC_PER_SEC);
+
+      /* a failed update only loses this sample */
+      glError = VMGuestLib_UpdateInfo(glHandle);
+      if (glError != VMGUESTLIB_ERROR_SUCCESS) {
+         ToolsCmd_PrintErr(SU_(stat.update.failed,
+                               "UpdateInfo failed: %s\n"),
+                           VMGuestLib_GetErrorText(glError));
+         continue;
+      }
+      StatPrintSample(glHandle, fields, numFields, format);
+   }
+
+   VMGuestLib_CloseHandle(glHandle);
+   g_free(fields);
+   return EXIT_SUCCESS;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -564,6 +808,10 @@ Stat_Command(char **argv,      // IN: Command line arguments
       return StatGetCpuLimit();
    } else if (toolbox_strcmp(argv[optind], "speed") == 0) {
       return StatProcessorSpeed();
+   } else if (toolbox_strcmp(argv[optind], "batch") == 0) {
+      return StatSample(argv, argc, FALSE);
+   } else if (toolbox_strcmp(argv[optind], "watch") == 0) {
+      return StatSample(argv, argc, TRUE);
    } else if (toolbox_strcmp(argv[optind], "raw") == 0) {
       return StatGetRaw((optind + 1 < argc) ? argv[optind + 1] : "", // encoding
                         (optind + 2 < argc) ? argv[optind + 2] : "", // stat
@@ -615,7 +863,15 @@ Stat_Help(const char *progName, // IN: The name of the program obtained from arg
                           "      <stat name> includes session, host, resources, vscsi and\n"
                           "      vnet (Some stats like vscsi are two words, e.g. 'vscsi scsi0:0').\n"
                           "      Prints the available stats if <encoding> and <stat name>\n"
-                          "      arguments are not specified.\n"),
+                          "      arguments are not specified.\n"
+                          "   batch <format> [<stat>...]: print several stats from one update\n"
+                          "      <format> can be one of 'csv', 'json'.\n"
+                          "      <stat> can be one of sessionid, balloon, swap, memlimit,\n"
+                          "      memres, memactive, memused, cpures, cpulimit, cpuused,\n"
+                          "      cpustolen, elapsed. All of them are printed if none are\n"
+                          "      specified.\n"
+                          "   watch <interval> <format> [<stat>...]: like batch, but print\n"
+                          "      a sample every <interval> seconds until interrupted\n"),
            cmd, progName, cmd);
 }
 
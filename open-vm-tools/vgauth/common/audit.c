@@ -25,6 +25,7 @@
 #include "audit.h"
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #ifdef _WIN32
 #include "auditMessages.h"
@@ -44,6 +45,28 @@ static gboolean auditInited = FALSE;
 static HANDLE hAuditSource = INVALID_HANDLE_VALUE;
 #endif
 
+/*
+ * The optional writer thread, which takes the event log or syslog write
+ * off the request path.  Events are queued in order; callers wait for
+ * room when the queue is full, so that no event is ever dropped.
+ */
+
+typedef struct AuditRecord {
+   gboolean isSuccess;
+   gchar *msg;
+} AuditRecord;
+
+static GThread *auditWriter = NULL;
+static GMutex *auditLock = NULL;
+static GCond *auditWakeup = NULL;   // Events to write, or stop
+static GCond *auditDrained = NULL;  // Room in the queue
+static GQueue auditQueue = G_QUEUE_INIT;
+static guint auditQueueSize;
+static guint auditFlushInterval;    // Seconds
+static gboolean auditStop = FALSE;
+
+static void AuditWrite(gboolean isSuccess, const gchar *buf);
+
 /*
  ******************************************************************************
  * Audit_Init --                                                         */ /**
@@ -92,6 +115,155 @@ Audit_Init(const char *appName,
 }
 
 
+/*
+ ******************************************************************************
+ * AuditWriterThread --                                                  */ /**
+ *
+ * The audit writer thread.  Writes out the queued events in batches,
+ * either once the flush interval has passed since the first event of the
+ * batch was queued or as soon as half the queue is used, and writes out
+ * whatever is left when asked to stop.
+ *
+ * @param[in] data   Unused.
+ *
+ * @return NULL.
+ *
+ ******************************************************************************
+ */
+
+static gpointer
+AuditWriterThread(gpointer data)
+{
+   g_mutex_lock(auditLock);
+   for (;;) {
+      GQueue batch;
+      AuditRecord *rec;
+
+      while (g_queue_is_empty(&auditQueue) && !auditStop) {
+         g_cond_wait(auditWakeup, auditLock);
+      }
+
+      if (auditFlushInterval > 0 && !auditStop &&
+          g_queue_get_length(&auditQueue) < auditQueueSize / 2) {
+         GTimeVal timeout;
+
+         g_get_current_time(&timeout);
+         g_time_val_add(&timeout, auditFlushInterval * G_USEC_PER_SEC);
+         while (!auditStop &&
+                g_queue_get_length(&auditQueue) < auditQueueSize / 2 &&
+                g_cond_timed_wait(auditWakeup, auditLock, &timeout)) {
+         }
+      }
+
+      if (g_queue_is_empty(&auditQueue)) {
+         break;
+      }
+
+      batch = auditQueue;
+      g_queue_init(&auditQueue);
+      g_cond_broadcast(auditDrained);
+      g_mutex_unlock(auditLock);
+
+      while ((rec = g_queue_pop_head(&batch)) != NULL) {
+         AuditWrite(rec->isSuccess, rec->msg);
+         g_free(rec->msg);
+         g_free(rec);
+      }
+
+      g_mutex_lock(auditLock);
+   }
+   g_mutex_unlock(auditLock);
+
+   return NULL;
+}
+
+
+/*
+ ******************************************************************************
+ * AuditStopWriter --                                                    */ /**
+ *
+ * Stops the audit writer thread once it has written out all queued events.
+ * Events are written synchronously from then on.  Also called at exit, so
+ * that no queued event is lost when the service exits.
+ *
+ ******************************************************************************
+ */
+
+static void
+AuditStopWriter(void)
+{
+   GThread *writer = auditWriter;
+
+   if (NULL == writer) {
+      return;
+   }
+
+   g_mutex_lock(auditLock);
+   auditStop = TRUE;
+   g_cond_signal(auditWakeup);
+   g_mutex_unlock(auditLock);
+
+   g_thread_join(writer);
+
+   g_mutex_lock(auditLock);
+   auditWriter = NULL;
+   g_cond_broadcast(auditDrained);
+   g_mutex_unlock(auditLock);
+}
+
+
+/*
+ ******************************************************************************
+ * Audit_StartWriter --                                                  */ /**
+ *
+ * Starts a thread that writes the audit events, so that logging one only
+ * costs the caller a queue insertion.  Meant for the service; the library
+ * keeps writing its events synchronously.
+ *
+ * @param[in] queueSize      The number of events that can be queued.
+ * @param[in] flushInterval  The number of seconds events may wait in the
+ *                           queue before being written out; 0 writes them
+ *                           out right away.
+ *
+ ******************************************************************************
+ */
+
+void
+Audit_StartWriter(guint queueSize,
+                  guint flushInterval)
+{
+   static gboolean atExitSet = FALSE;
+   GError *gErr = NULL;
+
+   if (!auditInited || NULL != auditWriter) {
+      return;
+   }
+
+   if (NULL == auditLock) {
+      auditLock = g_mutex_new();
+      auditWakeup = g_cond_new();
+      auditDrained = g_cond_new();
+   }
+
+   auditQueueSize = MAX(queueSize, 1);
+   auditFlushInterval = flushInterval;
+   auditStop = FALSE;
+
+   auditWriter = g_thread_create(AuditWriterThread, NULL, TRUE, &gErr);
+   if (NULL == auditWriter) {
+      g_warning("%s: failed to start the audit writer, auditing "
+                "synchronously: %s\n", __FUNCTION__, gErr->message);
+      g_error_free(gErr);
+      return;
+   }
+
+   if (!atExitSet) {
+      atexit(AuditStopWriter);
+      atExitSet = TRUE;
+   }
+}
+
+
 /*
  ******************************************************************************
  * Audit_Shutdown --                                                     */ /**
@@ -104,6 +276,8 @@ Audit_Init(const char *appName,
 void
 Audit_Shutdown(void)
 {
+   AuditStopWriter();
+
 #ifdef _WIN32
    DeregisterEventSource(hAuditSource);
    hAuditSource = INVALID_HANDLE_VALUE;
@@ -168,10 +342,57 @@ Audit_EventV(gboolean isSuccess,
    }
    buf = g_strdup_vprintf(fmt, args);
 
+   if (NULL != auditWriter) {
+      AuditRecord *rec;
+
+      g_mutex_lock(auditLock);
+      while (NULL != auditWriter && !auditStop &&
+             g_queue_get_length(&auditQueue) >= auditQueueSize) {
+         g_cond_wait(auditDrained, auditLock);
+      }
+      if (NULL != auditWriter && !auditStop) {
+         rec = g_new(AuditRecord, 1);
+         rec->isSuccess = isSuccess;
+         rec->msg = buf;
+         g_queue_push_tail(&auditQueue, rec);
+         if (g_queue_get_length(&auditQueue) == 1 ||
+             g_queue_get_length(&auditQueue) == auditQueueSize / 2) {
+            g_cond_signal(auditWakeup);
+         }
+         buf = NULL;
+      }
+      g_mutex_unlock(auditLock);
+
+      if (NULL == buf) {
+         return;
+      }
+   }
+
+   AuditWrite(isSuccess, buf);
+   g_free(buf);
+}
+
+
+/*
+ ******************************************************************************
+ * AuditWrite --                                                         */ /**
+ *
+ * Writes an auditing event to the event log or syslog.
+ *
+ * @param[in] isSuccess   If true, the message is a successful event.
+ * @param[in] buf         The message.
+ *
+ ******************************************************************************
+ */
+
+static void
+AuditWrite(gboolean isSuccess,
+           const gchar *buf)
+{
 #ifdef VMX86_DEBUG
    if (!auditInited) {
       fprintf(stderr, "Audit Event being dropped!: %s\n", buf);
-      goto done;
+      return;
    }
 #endif
 
@@ -204,10 +425,5 @@ Audit_EventV(gboolean isSuccess,
     */
    syslog(isSuccess ? LOG_INFO : LOG_WARNING, "%s.", buf);
 #endif
-
-#ifdef VMX86_DEBUG
-done:
-#endif
-   g_free(buf);
 }
 
@@ -32,6 +32,8 @@ void Audit_Init(const char *appName, gboolean logSuccess);
 
 void Audit_Shutdown(void);
 
+void Audit_StartWriter(guint queueSize, guint flushInterval);
+
 void Audit_Event(gboolean isSuccess, const char *fmt, ...) PRINTF_DECL(2, 3);
 
 void Audit_EventV(gboolean isSuccess, const char *fmt, va_list args);
@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <openssl/ssl.h>
 #include <openssl/bio.h>
 #include <openssl/evp.h>
@@ -45,6 +46,53 @@ VGAuthError CertVerify_CheckSignature(VGAuthHashAlg hash,
                                       size_t signatureLen,
                                       const unsigned char *signature);
 
+/*
+ * Successful chain verifications are remembered for a while, so that the
+ * same chain presented again, typically in another copy of a token, doesn't
+ * go through X509_verify_cert() again.  Entries are keyed by a digest of
+ * the whole chain, trusted certs included, so a change to the alias store
+ * makes for a different key.
+ */
+#define CERT_CACHE_MAX_ENTRIES      64
+#define CERT_CACHE_LIFETIME_SECS    300
+
+static GHashTable *gVerifiedChains = NULL;   // digest -> time_t expiry
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+/*
+ * Older OpenSSL needs the application to supply locking to be used
+ * from more than one thread, which the service does for SAML tokens.
+ */
+static GStaticMutex *gSSLLocks = NULL;
+
+
+/*
+ ******************************************************************************
+ * CertVerifyLockCallback --                                             */ /**
+ *
+ * OpenSSL locking callback.
+ *
+ * @param[in]  mode     CRYPTO_LOCK or CRYPTO_UNLOCK, and read or write.
+ * @param[in]  n        The lock.
+ * @param[in]  file     Source file of the caller.
+ * @param[in]  line     Source line of the caller.
+ *
+ ******************************************************************************
+ */
+
+static void
+CertVerifyLockCallback(int mode,
+                       int n,
+                       const char *file,
+                       int line)
+{
+   if (mode & CRYPTO_LOCK) {
+      g_static_mutex_lock(&gSSLLocks[n]);
+   } else {
+      g_static_mutex_unlock(&gSSLLocks[n]);
+   }
+}
+#endif
 
 
 /*
@@ -73,6 +121,18 @@ CertVerify_Init(void)
     * can add a lot of bloat.
     */
    OpenSSL_add_all_digests();
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+   if (NULL == gSSLLocks && NULL == CRYPTO_get_locking_callback()) {
+      int i;
+
+      gSSLLocks = g_new0(GStaticMutex, CRYPTO_num_locks());
+      for (i = 0; i < CRYPTO_num_locks(); i++) {
+         g_static_mutex_init(&gSSLLocks[i]);
+      }
+      CRYPTO_set_locking_callback(CertVerifyLockCallback);
+   }
+#endif
 }
 
 
@@ -583,6 +643,149 @@ done:
 }
 
 
+/*
+ ******************************************************************************
+ * CertChainDigest --                                                    */ /**
+ *
+ * Computes a digest identifying a certificate chain, and which certs in it
+ * are trusted.
+ *
+ * @param[in]  pemLeafCert              The leaf cert in PEM format.
+ * @param[in]  numUntrustedCerts        The size of the untrusted chain.
+ * @param[in]  pemUntrustedCertChain    The chain of untrusted certificates.
+ * @param[in]  numTrustedCerts          The size of the trusted chain.
+ * @param[in]  pemTrustedCertChain      The chain of trusted certificates.
+ *
+ * @return The digest as a hex string.  Caller must g_free().
+ *
+ ******************************************************************************
+ */
+
+static gchar *
+CertChainDigest(const char *pemLeafCert,
+                int numUntrustedCerts,
+                const char **pemUntrustedCertChain,
+                int numTrustedCerts,
+                const char **pemTrustedCertChain)
+{
+   GChecksum *sum = g_checksum_new(G_CHECKSUM_SHA256);
+   gchar *digest;
+   int i;
+
+   /*
+    * PEM certs have no NULs, so the terminating ones keep the certs apart,
+    * and the tags keep trusted and untrusted ones apart.
+    */
+   g_checksum_update(sum, (const guchar *) pemLeafCert,
+                     strlen(pemLeafCert) + 1);
+   for (i = 0; i < numUntrustedCerts; i++) {
+      g_checksum_update(sum, (const guchar *) "U", 1);
+      g_checksum_update(sum, (const guchar *) pemUntrustedCertChain[i],
+                        strlen(pemUntrustedCertChain[i]) + 1);
+   }
+   for (i = 0; i < numTrustedCerts; i++) {
+      g_checksum_update(sum, (const guchar *) "T", 1);
+      g_checksum_update(sum, (const guchar *) pemTrustedCertChain[i],
+                        strlen(pemTrustedCertChain[i]) + 1);
+   }
+
+   digest = g_strdup(g_checksum_get_string(sum));
+   g_checksum_free(sum);
+
+   return digest;
+}
+
+
+/*
+ ******************************************************************************
+ * CertChainIsValidUntil --                                              */ /**
+ *
+ * Checks that none of the certs of a chain expires before a given time.
+ *
+ * @param[in]  leafCert        The leaf cert.
+ * @param[in]  untrustedChain  The untrusted certs, or NULL.
+ * @param[in]  trustedChain    The trusted certs, or NULL.
+ * @param[in]  limit           The time.
+ *
+ * @return TRUE if all the certs are still valid at that time.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+CertChainIsValidUntil(X509 *leafCert,
+                      STACK_OF(X509) *untrustedChain,
+                      STACK_OF(X509) *trustedChain,
+                      time_t limit)
+{
+   STACK_OF(X509) *chains[2] = { untrustedChain, trustedChain };
+   int i;
+   int j;
+
+   if (X509_cmp_time(X509_get_notAfter(leafCert), &limit) <= 0) {
+      return FALSE;
+   }
+   for (i = 0; i < 2; i++) {
+      for (j = 0; chains[i] != NULL && j < sk_X509_num(chains[i]); j++) {
+         X509 *cert = sk_X509_value(chains[i], j);
+
+         if (X509_cmp_time(X509_get_notAfter(cert), &limit) <= 0) {
+            return FALSE;
+         }
+      }
+   }
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * CertChainCacheAdd --                                                  */ /**
+ *
+ * Remembers a successfully verified chain.  When the cache is full, expired
+ * entries are dropped, and if that isn't enough, the whole cache.
+ *
+ * @param[in]  digest     The digest of the chain.  Ownership is taken.
+ * @param[in]  expiry     Until when the verification can be reused.
+ *
+ ******************************************************************************
+ */
+
+static void
+CertChainCacheAdd(gchar *digest,
+                  time_t expiry)
+{
+   time_t *value;
+
+   if (NULL == gVerifiedChains) {
+      gVerifiedChains = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                              g_free, g_free);
+   }
+
+   if (g_hash_table_size(gVerifiedChains) >= CERT_CACHE_MAX_ENTRIES) {
+      GHashTableIter iter;
+      gpointer key;
+      gpointer val;
+      time_t now = time(NULL);
+
+      g_hash_table_iter_init(&iter, gVerifiedChains);
+      while (g_hash_table_iter_next(&iter, &key, &val)) {
+         if (*(time_t *) val <= now) {
+            g_hash_table_iter_remove(&iter);
+         }
+      }
+      if (g_hash_table_size(gVerifiedChains) >= CERT_CACHE_MAX_ENTRIES) {
+         g_hash_table_remove_all(gVerifiedChains);
+      }
+   }
+
+   value = g_new(time_t, 1);
+   *value = expiry;
+   g_hash_table_replace(gVerifiedChains, digest, value);
+}
+
+
 /*
  ******************************************************************************
  * CertVerify_CertChain --                                               */ /**
@@ -619,8 +822,26 @@ CertVerify_CertChain(const char *pemLeafCert,
    STACK_OF(X509) *untrustedChain = NULL;
    X509_STORE *store = NULL;
    X509_STORE_CTX *verifyCtx = NULL;
-   X509 *leafCert;
+   X509 *leafCert = NULL;
+   gchar *digest;
+   time_t *expiry;
+   time_t now = time(NULL);
 
+   /*
+    * See if the same chain was verified recently.
+    */
+   digest = CertChainDigest(pemLeafCert,
+                            numUntrustedCerts, pemUntrustedCertChain,
+                            numTrustedCerts, pemTrustedCertChain);
+   expiry = (NULL != gVerifiedChains) ?
+      g_hash_table_lookup(gVerifiedChains, digest) : NULL;
+   if (NULL != expiry) {
+      if (now < *expiry) {
+         g_debug("%s: chain verified before\n", __FUNCTION__);
+         goto done;
+      }
+      g_hash_table_remove(gVerifiedChains, digest);
+   }
 
    /*
     * Turn the leaf cert into an x509 object.
@@ -714,7 +935,17 @@ CertVerify_CertChain(const char *pemLeafCert,
       goto done;
    }
 
+   /*
+    * Remember the chain, unless a cert in it expires before the entry.
+    */
+   if (CertChainIsValidUntil(leafCert, untrustedChain, trustedChain,
+                             now + CERT_CACHE_LIFETIME_SECS)) {
+      CertChainCacheAdd(digest, now + CERT_CACHE_LIFETIME_SECS);
+      digest = NULL;
+   }
+
 done:
+   g_free(digest);
    sk_X509_pop_free(trustedChain, X509_free);
    sk_X509_pop_free(untrustedChain, X509_free);
    X509_free(leafCert);
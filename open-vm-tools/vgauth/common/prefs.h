@@ -149,6 +149,19 @@ msgCatalog = /etc/vmware-tools/vgauth/messages
 /** Whether to generate audit events for successful operations. */
 #define VGAUTH_PREF_AUDIT_SUCCESS          "auditSuccessEvents"
 
+/**
+ * Number of audit events the service queues for its audit writer thread.
+ * Requests wait for room when the queue is full.
+ */
+#define VGAUTH_PREF_AUDIT_QUEUE_SIZE       "auditQueueSize"
+
+/**
+ * Number of seconds the audit writer lets events accumulate before writing
+ * them out, unless half the queue fills up first. 0 writes each event as
+ * soon as the writer thread can.
+ */
+#define VGAUTH_PREF_AUDIT_FLUSH_INTERVAL   "auditFlushInterval"
+
 /** SSPI group name. */
 #define VGAUTH_PREF_GROUP_NAME_SSPI        "sspi"
 
@@ -190,5 +203,9 @@ msgCatalog = /etc/vmware-tools/vgauth/messages
 
 #define VGAUTH_PREF_DEFAULT_CLOCK_SKEW_SECS (300)
 
+#define VGAUTH_PREF_DEFAULT_AUDIT_QUEUE_SIZE 1024
+
+#define VGAUTH_PREF_DEFAULT_AUDIT_FLUSH_INTERVAL 0
+
 #endif // _PREFS_H_
 
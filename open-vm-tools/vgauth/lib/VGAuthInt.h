@@ -126,11 +126,9 @@ struct VGAuthContext {
    gboolean isImpersonating;
 
    /*
-    * XXX optimization -- keep a comm channel alive for superuser?
-    *
-    * An app that just does validation would probably just be connected
-    * as root all the time anyways.  But it could be useful for something
-    * that did both certstore work and validation.
+    * The connection in 'comm' is kept for as long as the context, and
+    * reused by every request that can run as its user; see
+    * VGAuth_IsConnectedToServiceAsUser().
     */
 
 };
@@ -199,6 +197,8 @@ VGAuthError VGAuth_CommReadData(VGAuthContext *ctx,
                                 gsize *len,
                                 gchar **response);
 
+void VGAuth_CommDropConnection(VGAuthContext *ctx);
+
 VGAuthError VGAuth_SendConnectRequest(VGAuthContext *ctx);
 
 VGAuthError VGAuth_SendSessionRequest(VGAuthContext *ctx,
@@ -260,6 +260,10 @@ VGAuthError VGAuth_NetworkConnect(VGAuthContext *ctx);
 
 gboolean VGAuth_NetworkValidatePublicPipeOwner(VGAuthContext *ctx);
 
+#ifndef _WIN32
+gboolean VGAuth_NetworkIsAlive(VGAuthContext *ctx);
+#endif
+
 VGAuthError VGAuth_NetworkWriteBytes(VGAuthContext *ctx,
                                      gsize len,
                                      gchar *buffer);
@@ -30,11 +30,55 @@
 #include "usercheck.h"
 
 
+/*
+ ******************************************************************************
+ * VGAuthCommIsAlive --                                                  */ /**
+ *
+ * Checks that the context's connection to the service can be reused.
+ * A connection is kept for the life of the context, so the service may
+ * have dropped it since the last request (it was restarted, or gave up
+ * on us after an error).  Such a connection is closed, so that the
+ * caller makes a new one.
+ *
+ * @param[in]  ctx        The VGAuthContext.
+ *
+ * @return TRUE if the connection is up and usable.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+VGAuthCommIsAlive(VGAuthContext *ctx)
+{
+   if (!ctx->comm.connected) {
+      return FALSE;
+   }
+
+#ifdef UNITTEST
+   if (ctx->comm.fileTest || ctx->comm.bufTest) {
+      return TRUE;
+   }
+#endif
+
+#ifndef _WIN32
+   if (!VGAuth_NetworkIsAlive(ctx)) {
+      Debug("%s: connection to %s has gone away, dropping it\n",
+            __FUNCTION__, ctx->comm.pipeName);
+      VGAuth_CloseConnection(ctx);
+      return FALSE;
+   }
+#endif
+
+   return TRUE;
+}
+
+
 /*
  ******************************************************************************
  * VGAuth_IsConnectedToServiceAsUser --                                  */ /**
  *
  * Checks if the context has a connection to the service.
+ * A connection that the service has dropped is closed.
  *
  * @param[in]  ctx        The VGAuthContext.
  * @param[in]  userName   The user.
@@ -53,7 +97,8 @@ VGAuth_IsConnectedToServiceAsUser(VGAuthContext *ctx,
     * set.
     */
    return ctx->comm.connected &&
-      Usercheck_CompareByName(userName, ctx->comm.userName);
+      Usercheck_CompareByName(userName, ctx->comm.userName) &&
+      VGAuthCommIsAlive(ctx);
 }
 
 
@@ -62,6 +107,7 @@ VGAuth_IsConnectedToServiceAsUser(VGAuthContext *ctx,
  * VGAuth_IsConnectedToServiceAsAnyUser --                               */ /**
  *
  * Checks if the context has a connection to the service.
+ * A connection that the service has dropped is closed.
  *
  * @param[in]  ctx        The VGAuthContext.
  *
@@ -73,7 +119,7 @@ VGAuth_IsConnectedToServiceAsUser(VGAuthContext *ctx,
 gboolean
 VGAuth_IsConnectedToServiceAsAnyUser(VGAuthContext *ctx)
 {
-   return ctx->comm.connected;
+   return VGAuthCommIsAlive(ctx);
 }
 
 
@@ -145,6 +191,7 @@ VGAuth_CloseConnection(VGAuthContext *ctx)
 #else
    if (ctx->comm.sock >= 0) {
       close(ctx->comm.sock);
+      ctx->comm.sock = -1;
    }
 #endif
 
@@ -273,6 +320,12 @@ VGAuth_ConnectToServiceAsUser(VGAuthContext *ctx,
     */
 
 done:
+   /*
+    * Don't leave a half set up connection around to be reused.
+    */
+   if (err != VGAUTH_E_OK) {
+      VGAuth_CloseConnection(ctx);
+   }
    VGAuth_CloseConnection(pubCtx);
    g_free(pubCtx);
 
@@ -337,7 +390,14 @@ VGAuthError
 VGAuth_CommSendData(VGAuthContext *ctx,
                     gchar *packet)
 {
-   return VGAuth_NetworkWriteBytes(ctx, strlen(packet), packet);
+   VGAuthError err;
+
+   err = VGAuth_NetworkWriteBytes(ctx, strlen(packet), packet);
+   if (VGAUTH_E_OK != err) {
+      VGAuth_CommDropConnection(ctx);
+   }
+
+   return err;
 }
 
 
@@ -403,6 +463,36 @@ abort:
 }
 
 
+/*
+ ******************************************************************************
+ * VGAuth_CommDropConnection --                                          */ /**
+ *
+ * Closes the connection after a request failed in a way that leaves the
+ * stream in an unknown state, so that the next request makes a new
+ * connection rather than reusing this one.
+ *
+ * @param[in]  ctx        The VGAuthContext.
+ *
+ ******************************************************************************
+ */
+
+void
+VGAuth_CommDropConnection(VGAuthContext *ctx)
+{
+#ifdef UNITTEST
+   if (ctx->comm.fileTest || ctx->comm.bufTest) {
+      return;
+   }
+#endif
+
+   if (ctx->comm.connected) {
+      Debug("%s: dropping connection to %s\n", __FUNCTION__,
+            ctx->comm.pipeName);
+      VGAuth_CloseConnection(ctx);
+   }
+}
+
+
 #ifdef UNITTEST
 /*
  ******************************************************************************
@@ -35,6 +35,8 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <signal.h>
+#include <sys/poll.h>
+#include <sys/ioctl.h>
 #include "VGAuthInt.h"
 #include "VGAuthLog.h"
 
@@ -181,11 +183,56 @@ done:
 }
 
 
+/*
+ ******************************************************************************
+ * VGAuth_NetworkIsAlive --                                              */ /**
+ *
+ * Checks, without blocking, whether the connection in ctx can still be
+ * used for a request.  The service sends nothing between replies, so if
+ * the socket is readable, it's at EOF, has an error, or holds data that
+ * isn't ours -- either way the connection is no good anymore.
+ *
+ * @param[in]  ctx        The VGAuthContext.
+ *
+ * @return TRUE if the connection looks usable.
+ *
+ ******************************************************************************
+ */
+
+gboolean
+VGAuth_NetworkIsAlive(VGAuthContext *ctx)
+{
+   struct pollfd pfd;
+   int ret;
+
+   if (ctx->comm.sock < 0) {
+      return FALSE;
+   }
+
+   pfd.fd = ctx->comm.sock;
+   pfd.events = POLLIN;
+   pfd.revents = 0;
+
+   do {
+      ret = poll(&pfd, 1, 0);
+   } while (ret == -1 && errno == EINTR);
+
+   if (ret < 0) {
+      VGAUTH_LOG_ERR_POSIX("poll() failed on %s", ctx->comm.pipeName);
+      return FALSE;
+   }
+
+   return ret == 0;
+}
+
+
 /*
  ******************************************************************************
  * VGAuth_NetworkReadBytes --                                            */ /**
  *
- * Reads the available data on the connection.
+ * Reads the available data on the connection.  Everything that has
+ * arrived is read at once, up to a limit, straight into the returned
+ * buffer, so that a big reply (a list of PEM certs) takes few reads.
  *
  * @param[in]  ctx        The VGAuthContext.
  * @param[out] len        The length of the data.  0 if the connection is lost.
@@ -203,30 +250,43 @@ VGAuth_NetworkReadBytes(VGAuthContext *ctx,
 {
    VGAuthError err = VGAUTH_E_OK;
    int ret;
+   int avail = 0;
+   gchar *buf;
 #if NETWORK_FORCE_TINY_PACKETS
 #define  READ_BUFSIZE   1
+#define  READ_MAXSIZE   1
 #else
 #define  READ_BUFSIZE   10240
+#define  READ_MAXSIZE   (256 * 1024)
 #endif
-   char buf[READ_BUFSIZE];
 
    *len = 0;
    *buffer = NULL;
 
+   if (ioctl(ctx->comm.sock, FIONREAD, &avail) < 0 || avail < READ_BUFSIZE) {
+      avail = READ_BUFSIZE;
+   } else if (avail > READ_MAXSIZE) {
+      avail = READ_MAXSIZE;
+   }
+   buf = g_malloc(avail + 1);
+
    do {
-      ret = recv(ctx->comm.sock, buf, sizeof(buf), 0);
+      ret = recv(ctx->comm.sock, buf, avail, 0);
       if (ret == 0) {
          Warning("%s: EOF on socket\n", __FUNCTION__);
+         g_free(buf);
          return err;
       }
    } while (ret == -1 && errno == EINTR);
 
    if (ret < 0) {
       VGAUTH_LOG_ERR_POSIX("error reading from %s", ctx->comm.pipeName);
+      g_free(buf);
       return VGAUTH_E_COMM;
    }
 
-   *buffer = g_strndup(buf, ret);
+   buf[ret] = '\0';
+   *buffer = buf;
    *len = ret;
 
    return err;
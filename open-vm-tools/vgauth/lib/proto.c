@@ -1218,9 +1218,11 @@ VGAuth_ReadAndParseResponse(VGAuthContext *ctx,
       if (0 == len) {      // EOF -- not expected
          err = VGAUTH_E_COMM;
          Warning("%s: EOF on datastream when trying to parse\n", __FUNCTION__);
+         g_free(rawReply);
          goto abort;
       }
       if (VGAUTH_E_OK != err) {
+         g_free(rawReply);
          goto abort;
       }
 #if VGAUTH_PROTO_TRACE
@@ -1234,6 +1236,8 @@ VGAuth_ReadAndParseResponse(VGAuthContext *ctx,
                                           rawReply,
                                           len,
                                           &gErr);
+      g_free(rawReply);
+      rawReply = NULL;
       if (!bRet) {
          /*
           * XXX Could drain the wire here, but since this should
@@ -1249,7 +1253,6 @@ VGAuth_ReadAndParseResponse(VGAuthContext *ctx,
        * XXX need some way to break out if packet never completed
        * yet socket left valid.  timer?
        */
-      g_free(rawReply);
    }
 
 #if VGAUTH_PROTO_TRACE
@@ -1272,6 +1275,11 @@ VGAuth_ReadAndParseResponse(VGAuthContext *ctx,
    goto done;
 
 abort:
+   /*
+    * Whatever is left of the reply on the wire would confuse the next
+    * request, so don't reuse the connection.
+    */
+   VGAuth_CommDropConnection(ctx);
    Proto_FreeReply(reply);
    reply = NULL;
 done:
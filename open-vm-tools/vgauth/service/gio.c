@@ -309,6 +309,51 @@ ServiceIOHandleIO(GIOChannel *chan,
 }
 
 
+/*
+ ******************************************************************************
+ * ServiceResumeIO --                                                    */ /**
+ *
+ * Starts watching for IO on a data connection: a newly accepted one, or
+ * one whose IO was stopped while a request was processed off the main
+ * loop.
+ *
+ * @param[in]   conn           The connection to watch for activity.
+ *
+ * @return VGAuthError
+ *
+ ******************************************************************************
+ */
+
+VGAuthError
+ServiceResumeIO(ServiceConnection *conn)
+{
+#ifdef _WIN32
+   GSource *gSourceData;
+#else
+   GIOChannel *echan;
+#endif
+
+   if (conn->gioId > 0) {
+      return VGAUTH_E_OK;
+   }
+
+#ifdef _WIN32
+   gSourceData = ServiceIONewHandleGSource(conn->ol.hEvent,
+                                           ServiceIOHandleIOGSource,
+                                           (gpointer) conn);
+   conn->gioId = g_source_attach(gSourceData, NULL);
+   g_source_unref(gSourceData);
+#else
+   echan = g_io_channel_unix_new(conn->sock);
+   conn->gioId = g_io_add_watch(echan, G_IO_IN, ServiceIOHandleIO,
+                                (gpointer) conn);
+   g_io_channel_unref(echan);
+#endif
+
+   return VGAUTH_E_OK;
+}
+
+
 /*
  ******************************************************************************
  * ServiceIOAccept --                                                    */ /**
@@ -336,11 +381,6 @@ ServiceIOAcceptGSource(gpointer userData)
    ServiceConnection *newConn = NULL;
    ServiceConnection *lConn = (ServiceConnection *) userData;
    VGAuthError err = VGAUTH_E_OK;
-#ifdef _WIN32
-   GSource *gSourceData;
-#else
-   GIOChannel *echan;
-#endif
 
    err = ServiceConnectionClone(lConn, &newConn);
    if (VGAUTH_E_OK != err) {
@@ -352,18 +392,7 @@ ServiceIOAcceptGSource(gpointer userData)
    if (VGAUTH_E_OK == err) {
       VGAUTH_LOG_DEBUG("Established a new pipe connection %d on %s", newConn->connId,
                        newConn->pipeName);
-#ifdef _WIN32
-      gSourceData = ServiceIONewHandleGSource(newConn->ol.hEvent,
-                                              ServiceIOHandleIOGSource,
-                                              (gpointer) newConn);
-      newConn->gioId = g_source_attach(gSourceData, NULL);
-      g_source_unref(gSourceData);
-#else
-      echan = g_io_channel_unix_new(newConn->sock);
-      newConn->gioId = g_io_add_watch(echan, G_IO_IN, ServiceIOHandleIO,
-                            (gpointer) newConn);
-      g_io_channel_unref(echan);
-#endif
+      (void) ServiceResumeIO(newConn);
    } else if (VGAUTH_E_TOO_MANY_CONNECTIONS == err) {
       ServiceConnectionShutdown(newConn);
    } else {
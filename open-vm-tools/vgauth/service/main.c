@@ -139,6 +139,14 @@ ServiceStartAndRun(void)
    g_free(msgCatalog);
 
    Audit_Init(VGAUTH_SERVICE_NAME, auditSuccess);
+   Audit_StartWriter(Pref_GetInt(gPrefs,
+                                 VGAUTH_PREF_AUDIT_QUEUE_SIZE,
+                                 VGAUTH_PREF_GROUP_NAME_AUDIT,
+                                 VGAUTH_PREF_DEFAULT_AUDIT_QUEUE_SIZE),
+                     Pref_GetInt(gPrefs,
+                                 VGAUTH_PREF_AUDIT_FLUSH_INTERVAL,
+                                 VGAUTH_PREF_GROUP_NAME_AUDIT,
+                                 VGAUTH_PREF_DEFAULT_AUDIT_FLUSH_INTERVAL));
 
    Log("INIT SERVICE\n");
 
@@ -167,7 +175,8 @@ ServiceStartAndRun(void)
       exit(-1);
    }
 
-   err = ServiceRegisterIOFunctions(ServiceIOStartListen, ServiceStopIO);
+   err = ServiceRegisterIOFunctions(ServiceIOStartListen, ServiceStopIO,
+                                    ServiceResumeIO);
    if (VGAUTH_E_OK != err) {
       Warning("%s: failed to register IO functions; exiting\n", __FUNCTION__);
       exit(-1);
@@ -523,6 +532,13 @@ int
 main(int argc,
      char *argv[])
 {
+   /*
+    * SAML tokens are verified on worker threads.
+    */
+   if (!g_thread_supported()) {
+      g_thread_init(NULL);
+   }
+
    gPrefs = Pref_Init(VGAUTH_PREF_CONFIG_FILENAME);
 
    /*
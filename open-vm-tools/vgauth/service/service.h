@@ -53,6 +53,8 @@ VGAuthError ServiceIOMainLoop(void);
 
 VGAuthError ServiceStopIO(ServiceConnection *conn);
 
+VGAuthError ServiceResumeIO(ServiceConnection *conn);
+
 #ifdef _WIN32
 VGAuthError ServiceIORegisterQuitEvent(HANDLE hQuitEvent);
 
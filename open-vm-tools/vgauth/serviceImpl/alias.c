@@ -67,6 +67,24 @@
 
 static gchar *aliasStoreRootDir = DEFAULT_ALIASSTORE_ROOT_DIR;
 
+#ifndef _WIN32
+/*
+ * Parsed contents of an alias store file, kept so that a query doesn't read
+ * and parse the file again as long as it is unchanged.
+ */
+typedef struct _AliasCacheEntry {
+   struct stat st;      // the file the contents were read from
+   int num;
+   gpointer list;       // ServiceAlias or ServiceMappedAlias array
+} AliasCacheEntry;
+
+/*
+ * The cached alias files, by user name, and the mapping file.
+ */
+static GHashTable *aliasCache = NULL;
+static AliasCacheEntry *mapCache = NULL;
+#endif
+
 #ifdef _WIN32
 /*
  * Still used to create the Alias directory; passed through to
@@ -865,6 +883,187 @@ ServiceLoadFileContents(const gchar *fileName,
 }
 
 
+#ifndef _WIN32
+/*
+ ******************************************************************************
+ * AliasCopyAliasList --                                                 */ /**
+ *
+ * Copies an array of ServiceAlias.
+ *
+ * @param[in]   num     The size of the array.
+ * @param[in]   aList   The list of ServiceAlias.
+ *
+ * @return The copy.  The caller should call ServiceAliasFreeAliasList()
+ *         when done.
+ *
+ ******************************************************************************
+ */
+
+static ServiceAlias *
+AliasCopyAliasList(int num,
+                   const ServiceAlias *aList)
+{
+   ServiceAlias *copy = g_malloc0_n(num, sizeof *copy);
+   int i;
+   int j;
+
+   for (i = 0; i < num; i++) {
+      copy[i].pemCert = g_strdup(aList[i].pemCert);
+      copy[i].num = aList[i].num;
+      copy[i].infos = g_malloc0_n(aList[i].num, sizeof *copy[i].infos);
+      for (j = 0; j < aList[i].num; j++) {
+         ServiceAliasCopyAliasInfoContents(&(aList[i].infos[j]),
+                                           &(copy[i].infos[j]));
+      }
+   }
+
+   return copy;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCopyMappedAliasList --                                           */ /**
+ *
+ * Copies an array of ServiceMappedAlias.
+ *
+ * @param[in]   num     The size of the array.
+ * @param[in]   maList  The list of ServiceMappedAlias.
+ *
+ * @return The copy.  The caller should call
+ *         ServiceAliasFreeMappedAliasList() when done.
+ *
+ ******************************************************************************
+ */
+
+static ServiceMappedAlias *
+AliasCopyMappedAliasList(int num,
+                         const ServiceMappedAlias *maList)
+{
+   ServiceMappedAlias *copy = g_malloc0_n(num, sizeof *copy);
+   int i;
+   int j;
+
+   for (i = 0; i < num; i++) {
+      copy[i].pemCert = g_strdup(maList[i].pemCert);
+      copy[i].userName = g_strdup(maList[i].userName);
+      copy[i].num = maList[i].num;
+      copy[i].subjects = g_malloc0_n(maList[i].num, sizeof *copy[i].subjects);
+      for (j = 0; j < maList[i].num; j++) {
+         copy[i].subjects[j].type = maList[i].subjects[j].type;
+         if (SUBJECT_TYPE_NAMED == maList[i].subjects[j].type) {
+            copy[i].subjects[j].name = g_strdup(maList[i].subjects[j].name);
+         }
+      }
+   }
+
+   return copy;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheIsSameFile --                                               */ /**
+ *
+ * Checks whether two lstat() results are of the same, unchanged, file.
+ * Anything ServiceLoadFileContentsPosix() checks (file type, size, owner
+ * and permissions) is part of the comparison, so cached contents are only
+ * used when the file would pass the same checks.
+ *
+ * @param[in]   st1       The first lstat() results.
+ * @param[in]   st2       The second lstat() results.
+ *
+ * @return TRUE if they are of the same file, unchanged.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+AliasCacheIsSameFile(const struct stat *st1,
+                     const struct stat *st2)
+{
+   return st1->st_dev == st2->st_dev &&
+          st1->st_ino == st2->st_ino &&
+          st1->st_size == st2->st_size &&
+          st1->st_mode == st2->st_mode &&
+          st1->st_uid == st2->st_uid &&
+          st1->st_gid == st2->st_gid &&
+          st1->st_mtim.tv_sec == st2->st_mtim.tv_sec &&
+          st1->st_mtim.tv_nsec == st2->st_mtim.tv_nsec &&
+          st1->st_ctim.tv_sec == st2->st_ctim.tv_sec &&
+          st1->st_ctim.tv_nsec == st2->st_ctim.tv_nsec;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheFreeAliasEntry --                                           */ /**
+ *
+ * Frees a cached alias file.
+ *
+ * @param[in]   data      The AliasCacheEntry.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheFreeAliasEntry(gpointer data)
+{
+   AliasCacheEntry *entry = data;
+
+   ServiceAliasFreeAliasList(entry->num, entry->list);
+   g_free(entry);
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheFreeMapEntry --                                             */ /**
+ *
+ * Frees the cached mapping file.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheFreeMapEntry(void)
+{
+   if (NULL != mapCache) {
+      ServiceAliasFreeMappedAliasList(mapCache->num, mapCache->list);
+      g_free(mapCache);
+      mapCache = NULL;
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheInvalidate --                                               */ /**
+ *
+ * Drops the cached alias file of a user, and optionally the mapping file.
+ * Files are replaced when saved so the cache would notice anyway; this
+ * frees the old contents right away.
+ *
+ * @param[in]   userName      The user whose alias file changes.
+ * @param[in]   mapFile       Whether the mapping file changes too.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheInvalidate(const gchar *userName,
+                     gboolean mapFile)
+{
+   if (NULL != aliasCache) {
+      g_hash_table_remove(aliasCache, userName);
+   }
+   if (mapFile) {
+      AliasCacheFreeMapEntry();
+   }
+}
+#endif   // !_WIN32
+
+
 /*
  ******************************************************************************
  * AliasDumpAliases --                                                   */ /**
@@ -1436,6 +1635,10 @@ AliasLoadAliases(const gchar *userName,
    AliasParseList list;
    VGAuthError err;
    GError *gErr = NULL;
+#ifndef _WIN32
+   AliasCacheEntry *entry;
+   struct stat st;
+#endif
 
    ASSERT(num);
    ASSERT(aList);
@@ -1455,8 +1658,26 @@ AliasLoadAliases(const gchar *userName,
     * If it's not there, then we have nothing to read.
     */
    if (!g_file_test(aliasFilename, G_FILE_TEST_EXISTS)) {
+#ifndef _WIN32
+      AliasCacheInvalidate(userName, FALSE);
+#endif
+      goto done;
+   }
+
+#ifndef _WIN32
+   /*
+    * Use the contents read last time if the file hasn't changed.
+    */
+   entry = (aliasCache != NULL) ?
+      g_hash_table_lookup(aliasCache, userName) : NULL;
+   if (g_lstat(aliasFilename, &st) != 0) {
+      memset(&st, 0, sizeof st);
+   } else if (entry != NULL && AliasCacheIsSameFile(&entry->st, &st)) {
+      list.num = entry->num;
+      list.aList = AliasCopyAliasList(entry->num, entry->list);
       goto done;
    }
+#endif
 
    err = ServiceLoadFileContents(aliasFilename, userName,
                                  &fileContents, &fileSize);
@@ -1477,6 +1698,29 @@ AliasLoadAliases(const gchar *userName,
       goto cleanup;
    }
 
+#ifndef _WIN32
+   /*
+    * Keep the contents, unless the file changed while it was read.
+    */
+   if (st.st_ino != 0) {
+      struct stat stAfter;
+
+      if (g_lstat(aliasFilename, &stAfter) == 0 &&
+          AliasCacheIsSameFile(&st, &stAfter)) {
+         if (NULL == aliasCache) {
+            aliasCache = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                               g_free,
+                                               AliasCacheFreeAliasEntry);
+         }
+         entry = g_new0(AliasCacheEntry, 1);
+         entry->st = st;
+         entry->num = list.num;
+         entry->list = AliasCopyAliasList(list.num, list.aList);
+         g_hash_table_replace(aliasCache, g_strdup(userName), entry);
+      }
+   }
+#endif
+
 done:
    /*
     * We're just transferring the data to the caller to free.
@@ -1772,6 +2016,9 @@ AliasLoadMapped(int *num,
    MappedAliasParseList list;
    VGAuthError err;
    GError *gErr = NULL;
+#ifndef _WIN32
+   struct stat st;
+#endif
 
    ASSERT(num);
    ASSERT(maList);
@@ -1793,9 +2040,25 @@ AliasLoadMapped(int *num,
     * If its not there, then we have nothing to read.
     */
    if (!g_file_test(mapFilename, G_FILE_TEST_EXISTS)) {
+#ifndef _WIN32
+      AliasCacheFreeMapEntry();
+#endif
       goto done;
    }
 
+#ifndef _WIN32
+   /*
+    * Use the contents read last time if the file hasn't changed.
+    */
+   if (g_lstat(mapFilename, &st) != 0) {
+      memset(&st, 0, sizeof st);
+   } else if (mapCache != NULL && AliasCacheIsSameFile(&mapCache->st, &st)) {
+      list.num = mapCache->num;
+      list.maList = AliasCopyMappedAliasList(mapCache->num, mapCache->list);
+      goto done;
+   }
+#endif
+
    err = ServiceLoadFileContents(mapFilename, NULL,
                                  &fileContents, &fileSize);
    if (err != VGAUTH_E_OK) {
@@ -1815,6 +2078,24 @@ AliasLoadMapped(int *num,
       goto cleanup;
    }
 
+#ifndef _WIN32
+   /*
+    * Keep the contents, unless the file changed while it was read.
+    */
+   if (st.st_ino != 0) {
+      struct stat stAfter;
+
+      if (g_lstat(mapFilename, &stAfter) == 0 &&
+          AliasCacheIsSameFile(&st, &stAfter)) {
+         AliasCacheFreeMapEntry();
+         mapCache = g_new0(AliasCacheEntry, 1);
+         mapCache->st = st;
+         mapCache->num = list.num;
+         mapCache->list = AliasCopyMappedAliasList(list.num, list.maList);
+      }
+   }
+#endif
+
 done:
    /*
     * We're just transferring the certs to the caller to free.
@@ -2030,6 +2311,10 @@ AliasSaveAliasesAndMapped(const gchar *userName,
    int rc;
    gboolean emptyAliasFile = (num == 0);
 
+#ifndef _WIN32
+   AliasCacheInvalidate(userName, updateMap);
+#endif
+
    /*
     * Special case for empty lists.
     *
@@ -33,6 +33,7 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <sys/ioctl.h>
 #include "serviceInt.h"
 #include "VGAuthProto.h"
 
@@ -287,7 +288,10 @@ ServiceNetworkRemoveListenPipe(ServiceConnection *conn)
  ******************************************************************************
  * ServiceNetworkReadData --                                             */ /**
  *
- * Reads some data off the wire.
+ * Reads some data off the wire.  Everything that has arrived is read at
+ * once, up to a limit, straight into the returned buffer, so that a
+ * request usually takes a single read and parse however big it is (a SAML
+ * token is tens of KB).
  *
  * @param[in]   conn    The connection.
  * @param[out]  len     How much data was read.
@@ -305,31 +309,44 @@ ServiceNetworkReadData(ServiceConnection *conn,
 {
    VGAuthError err = VGAUTH_E_OK;
    int ret;
+   int avail = 0;
+   gchar *buf;
 #if NETWORK_FORCE_TINY_PACKETS
 #define  READ_BUFSIZE   1
+#define  READ_MAXSIZE   1
 #else
 #define  READ_BUFSIZE   10240
+#define  READ_MAXSIZE   (256 * 1024)
 #endif
-   char buf[READ_BUFSIZE];
 
    *len = 0;
    *data = NULL;
 
+   if (ioctl(conn->sock, FIONREAD, &avail) < 0 || avail < READ_BUFSIZE) {
+      avail = READ_BUFSIZE;
+   } else if (avail > READ_MAXSIZE) {
+      avail = READ_MAXSIZE;
+   }
+   buf = g_malloc(avail + 1);
+
    do {
-      ret = recv(conn->sock, buf, sizeof(buf), 0);
+      ret = recv(conn->sock, buf, avail, 0);
       if (ret == 0) {
          Debug("%s: EOF on socket\n", __FUNCTION__);
          conn->eof = TRUE;
+         g_free(buf);
          return err;
       }
    } while (ret == -1 && errno == EINTR);
 
    if (ret < 0) {
       Warning("%s: error %d reading from socket\n", __FUNCTION__, errno);
+      g_free(buf);
       return VGAUTH_E_COMM;
    }
 
-   *data = g_strndup(buf, ret);
+   buf[ret] = '\0';
+   *data = buf;
    *len = ret;
 
    return err;
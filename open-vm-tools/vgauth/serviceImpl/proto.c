@@ -2077,12 +2077,266 @@ ServiceProtoRevokeTicket(ServiceConnection *conn,
 }
 
 
+/*
+ ******************************************************************************
+ * ServiceProtoSendSamlBearerTokenReply --                               */ /**
+ *
+ * Audits the result of a ValidateSamlBearerToken request, and sends the
+ * reply to it.
+ *
+ * @param[in]   conn          The ServiceConnection.
+ * @param[in]   seqno         Sequence number of the request.
+ * @param[in]   err           Result of the validation.
+ * @param[in]   userName      The user the token authenticated as.
+ * @param[in]   subjectName   The subject in the token.
+ * @param[in]   tokenStr      The user token duped into the client, if any.
+ * @param[in]   ai            The alias info used to verify the token.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+static VGAuthError
+ServiceProtoSendSamlBearerTokenReply(ServiceConnection *conn,
+                                     int seqno,
+                                     VGAuthError err,
+                                     const char *userName,
+                                     const char *subjectName,
+                                     const char *tokenStr,
+                                     const ServiceAliasInfo *ai)
+{
+   gchar *packet;
+   gchar *sPacket;
+
+   if (err != VGAUTH_E_OK) {
+      Audit_Event(FALSE,
+                  SU_(validate.samlBearer.fail,
+                      "Validation of SAML bearer token failed: %d"),
+                  (int) err);    // localization code can't deal with
+                                 // differing types of uint64
+
+
+      /*
+       * Rewrite some errors to hide any data that could be useful to an
+       * attacker.  Do this at this stage so that we still have
+       * useful debug and possibly auditing reasons.
+       */
+      if (err ==  VGAUTH_E_INVALID_CERTIFICATE) {
+         err = VGAUTH_E_AUTHENTICATION_DENIED;
+      }
+      packet = ProtoMakeErrorReplyInt(conn, seqno, err,
+                                      "validateSamlToken failed");
+   } else {
+      Audit_Event(FALSE,
+                  SU_(validate.samlBearer.success,
+                      "Validated SAML bearer token for user '%s'"),
+                  userName);
+      packet = g_markup_printf_escaped(VGAUTH_VALIDATESAMLBEARERTOKEN_REPLY_FORMAT_START,
+                                       seqno,
+                                       userName ? userName : "",
+                                       tokenStr ? tokenStr : "",
+                                       subjectName ? subjectName : "");
+
+      if (SUBJECT_TYPE_NAMED == ai->type) {
+            sPacket = g_markup_printf_escaped(VGAUTH_NAMEDALIASINFO_FORMAT,
+                                               ai->name,
+                                               ai->comment);
+      } else {
+            sPacket = g_markup_printf_escaped(VGAUTH_ANYALIASINFO_FORMAT,
+                                              ai->comment);
+      }
+      packet = Proto_ConcatXMLStrings(packet, sPacket);
+      packet = Proto_ConcatXMLStrings(packet,
+                                      g_strdup(VGAUTH_VALIDATESAMLBEARERTOKEN_REPLY_FORMAT_END));
+   }
+
+   err = ServiceNetworkWriteData(conn, strlen(packet), packet);
+   if (err != VGAUTH_E_OK) {
+      VGAUTH_LOG_WARNING("ServiceNetWorkWriteData() failed, pipe = %s", conn->pipeName);
+   }
+   g_free(packet);
+
+   return err;
+}
+
+
+#ifndef _WIN32
+/*
+ * Verifying a SAML token (parsing, schema validation, signature check) is
+ * by far the most expensive request, so it's done on a pool of worker
+ * threads, and the main loop stays free to serve other connections in the
+ * meantime.  Only the token itself is verified on the workers; checking
+ * its cert chain against the alias store and the reply happen back on the
+ * main loop.  The connection isn't read from until the reply is sent,
+ * which keeps the replies on it in order.
+ */
+#define PROTO_SAML_MAX_WORKERS   4
+
+typedef struct ProtoSamlJob {
+   ServiceConnection *conn;
+   int sequenceNumber;
+   gchar *samlToken;
+   gchar *userName;
+
+   /* results */
+   VGAuthError err;
+   gchar *subjectName;
+   int numCerts;
+   gchar **certChain;
+} ProtoSamlJob;
+
+static GThreadPool *samlWorkers = NULL;
+
+
+/*
+ ******************************************************************************
+ * ServiceProtoSamlJobDone --                                            */ /**
+ *
+ * Main loop callback for a SAML token verified by a worker.  Finishes the
+ * validation against the alias store, replies, and goes back to reading
+ * the connection.
+ *
+ * @param[in]   data          The ProtoSamlJob.
+ *
+ * @return FALSE, to run once.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+ServiceProtoSamlJobDone(gpointer data)
+{
+   ProtoSamlJob *job = data;
+   ServiceConnection *conn = job->conn;
+   VGAuthError err = job->err;
+   char *userName = NULL;
+   ServiceAliasInfo *ai = NULL;
+
+   if (err == VGAUTH_E_OK) {
+      err = SAML_VerifyBearerTokenChain(job->numCerts,
+                                        job->certChain,
+                                        job->userName,
+                                        job->subjectName,
+                                        &userName,
+                                        &ai);
+   }
+
+   err = ServiceProtoSendSamlBearerTokenReply(conn, job->sequenceNumber, err,
+                                              userName, job->subjectName,
+                                              NULL, ai);
+   Log("%s: processed reqType %d(%s REQ), returning "
+       VGAUTHERR_FMT64" on connection %d\n", __FUNCTION__,
+       PROTO_REQUEST_VALIDATE_SAML_BEARER_TOKEN,
+       ProtoRequestTypeText(PROTO_REQUEST_VALIDATE_SAML_BEARER_TOKEN),
+       err, conn->connId);
+
+   if (err == VGAUTH_E_OK) {
+      ServiceConnectionResumeIO(conn);
+   } else {
+      ServiceConnectionShutdown(conn);
+   }
+
+   g_free(userName);
+   ServiceAliasFreeAliasInfo(ai);
+   SAML_FreeCertChain(job->numCerts, job->certChain);
+   g_free(job->subjectName);
+   g_free(job->samlToken);
+   g_free(job->userName);
+   g_free(job);
+
+   return FALSE;
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceProtoSamlWorker --                                             */ /**
+ *
+ * Worker thread function; verifies a SAML token and hands the result back
+ * to the main loop.
+ *
+ * @param[in]   data          The ProtoSamlJob.
+ * @param[in]   userData      Unused.
+ *
+ ******************************************************************************
+ */
+
+static void
+ServiceProtoSamlWorker(gpointer data,
+                       gpointer userData)
+{
+   ProtoSamlJob *job = data;
+
+   job->err = SAML_VerifyBearerTokenSignature(job->samlToken,
+                                              &job->subjectName,
+                                              &job->numCerts,
+                                              &job->certChain);
+   g_idle_add(ServiceProtoSamlJobDone, job);
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceProtoStartSamlJob --                                           */ /**
+ *
+ * Hands a ValidateSamlBearerToken request over to the worker threads,
+ * and stops reading the connection until it's been replied to.
+ *
+ * @param[in]   conn          The ServiceConnection.
+ * @param[in]   req           The ValidateSamlToken request to process.
+ *
+ * @return TRUE if the request was queued, FALSE if it has to be handled
+ *         synchronously.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+ServiceProtoStartSamlJob(ServiceConnection *conn,
+                         ProtoRequest *req)
+{
+   ProtoSamlJob *job;
+   GError *gErr = NULL;
+
+   if (NULL == samlWorkers) {
+      samlWorkers = g_thread_pool_new(ServiceProtoSamlWorker, NULL,
+                                      PROTO_SAML_MAX_WORKERS, FALSE, &gErr);
+      if (NULL == samlWorkers) {
+         Warning("%s: failed to create worker threads: %s\n",
+                 __FUNCTION__, gErr->message);
+         g_error_free(gErr);
+         return FALSE;
+      }
+   }
+
+   /*
+    * The request is freed once it's dispatched, so the job takes over its
+    * strings rather than copying them.
+    */
+   job = g_malloc0(sizeof *job);
+   job->conn = conn;
+   job->sequenceNumber = req->sequenceNumber;
+   job->samlToken = req->reqData.validateSamlBToken.samlToken;
+   req->reqData.validateSamlBToken.samlToken = NULL;
+   job->userName = req->reqData.validateSamlBToken.userName;
+   req->reqData.validateSamlBToken.userName = NULL;
+
+   ServiceConnectionPauseIO(conn);
+   g_thread_pool_push(samlWorkers, job, NULL);
+
+   return TRUE;
+}
+#endif
+
+
 /*
  ******************************************************************************
  * ServiceProtoValidateSamlBearerToken --                                */ /**
  *
  * Protocol layer for ValidateSamlBearerToken.  Calls to validate code
- * to validate the token, sends reply.
+ * to validate the token, sends reply.  On POSIX, this is done
+ * asynchronously, see ServiceProtoStartSamlJob().
  *
  * @param[in]   conn          The ServiceConnection.
  * @param[in]   req           The ValidateSamlToken request to process.
@@ -2097,14 +2351,17 @@ ServiceProtoValidateSamlBearerToken(ServiceConnection *conn,
                                     ProtoRequest *req)
 {
    VGAuthError err = VGAUTH_E_FAIL;
-   gchar *packet;
-   gchar *sPacket;
    char *userName = NULL;
    char *subjectName = NULL;
-   char *comment = NULL;
    char *tokenStr = NULL;
    ServiceAliasInfo *ai = NULL;
 
+#ifndef _WIN32
+   if (ServiceProtoStartSamlJob(conn, req)) {
+      return VGAUTH_E_OK;
+   }
+#endif
+
    /*
     * The validate code will do argument validation.
     */
@@ -2140,59 +2397,13 @@ ServiceProtoValidateSamlBearerToken(ServiceConnection *conn,
       Debug("%s: skipping token creation\n", __FUNCTION__);
    }
 #endif
-   if (err != VGAUTH_E_OK) {
-      Audit_Event(FALSE,
-                  SU_(validate.samlBearer.fail,
-                      "Validation of SAML bearer token failed: %d"),
-                  (int) err);    // localization code can't deal with
-                                 // differing types of uint64
 
+   err = ServiceProtoSendSamlBearerTokenReply(conn, req->sequenceNumber, err,
+                                              userName, subjectName,
+                                              tokenStr, ai);
 
-      /*
-       * Rewrite some errors to hide any data that could be useful to an
-       * attacker.  Do this at this stage so that we still have
-       * useful debug and possibly auditing reasons.
-       */
-      if (err ==  VGAUTH_E_INVALID_CERTIFICATE) {
-         err = VGAUTH_E_AUTHENTICATION_DENIED;
-      }
-      packet = Proto_MakeErrorReply(conn, req, err,
-                                    "validateSamlToken failed");
-   } else {
-      Audit_Event(FALSE,
-                  SU_(validate.samlBearer.success,
-                      "Validated SAML bearer token for user '%s'"),
-                  userName);
-      packet = g_markup_printf_escaped(VGAUTH_VALIDATESAMLBEARERTOKEN_REPLY_FORMAT_START,
-                                       req->sequenceNumber,
-                                       userName ? userName : "",
-                                       tokenStr ? tokenStr : "",
-                                       subjectName ? subjectName : "");
-
-      if (SUBJECT_TYPE_NAMED == ai->type) {
-            sPacket = g_markup_printf_escaped(VGAUTH_NAMEDALIASINFO_FORMAT,
-                                               ai->name,
-                                               ai->comment);
-      } else {
-            sPacket = g_markup_printf_escaped(VGAUTH_ANYALIASINFO_FORMAT,
-                                              ai->comment);
-      }
-      packet = Proto_ConcatXMLStrings(packet, sPacket);
-      packet = Proto_ConcatXMLStrings(packet,
-                                      g_strdup(VGAUTH_VALIDATESAMLBEARERTOKEN_REPLY_FORMAT_END));
-   }
-
-   err = ServiceNetworkWriteData(conn, strlen(packet), packet);
-   if (err != VGAUTH_E_OK) {
-      VGAUTH_LOG_WARNING("ServiceNetWorkWriteData() failed, pipe = %s", conn->pipeName);
-      goto done;
-   }
-
-done:
    g_free(userName);
    g_free(subjectName);
-   g_free(packet);
-   g_free(comment);
    g_free(tokenStr);
    ServiceAliasFreeAliasInfo(ai);
 
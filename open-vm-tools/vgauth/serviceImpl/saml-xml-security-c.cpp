@@ -189,6 +189,22 @@ static const char *schemas[] = {
  */
 static XMLGrammarPool *pool = NULL;
 
+/**
+ * Serializes token verification, which may happen on the service's worker
+ * threads, and keeps SAML_Reload() from replacing the pool under it.
+ */
+static GStaticMutex gSAMLLock = G_STATIC_MUTEX_INIT;
+
+/**
+ * Holds gSAMLLock for its lifetime.
+ */
+
+class SAMLLockGuard {
+public:
+   SAMLLockGuard() { g_static_mutex_lock(&gSAMLLock); }
+   ~SAMLLockGuard() { g_static_mutex_unlock(&gSAMLLock); }
+};
+
 static int clockSkewAdjustment = VGAUTH_PREF_DEFAULT_CLOCK_SKEW_SECS;
 
 static bool SAMLLoadSchema(XercesDOMParser &parser,
@@ -347,6 +363,8 @@ void
 SAML_Shutdown()
 {
    try {
+      SAMLLockGuard guard;
+
       delete pool;
       pool = NULL;
       XSECPlatformUtils::Terminate();
@@ -379,6 +397,7 @@ SAML_Reload()
       return;
    }
 
+   SAMLLockGuard guard;
    delete pool;
    pool = myPool.release();
 }
@@ -463,10 +482,9 @@ SAML_VerifyBearerToken(const char *xmlText,
       VGAuthError err;
       SAMLTokenData token;
 
+      SAMLLockGuard guard;
+
       err = SAMLVerifyAssertion(xmlText, token, certs);
-      if (VGAUTH_E_OK != err) {
-         return err;
-      }
 
       return err;
    } catch (XSECException &e) {
@@ -517,45 +535,77 @@ SAML_VerifyBearerTokenAndChain(const char *xmlText,
                                char **subjNameOut,
                                ServiceAliasInfo **verifyAi)
 {
+   VGAuthError err;
+   int num;
+   char **certChain;
+
    *userNameOut = NULL;
-   *subjNameOut = NULL;
    *verifyAi = NULL;
 
+   err = SAML_VerifyBearerTokenSignature(xmlText, subjNameOut, &num,
+                                         &certChain);
+   if (VGAUTH_E_OK != err) {
+      return err;
+   }
+
+   err = SAML_VerifyBearerTokenChain(num, certChain, userName, *subjNameOut,
+                                     userNameOut, verifyAi);
+   SAML_FreeCertChain(num, certChain);
+
+   return err;
+}
+
+
+/*
+ ******************************************************************************
+ * SAML_VerifyBearerTokenSignature --                                    */ /**
+ *
+ * Verifies a SAML bearer token by itself, without checking its cert chain
+ * against the alias store.  May be called from any thread.
+ *
+ * @param[in]  xmlText     The text of the SAML assertion.
+ * @param[out] subjNameOut The subject in the token.
+ * @param[out] numCerts    Number of certs in the token.
+ * @param[out] certChain   Certs in the token.  Free with
+ *                         SAML_FreeCertChain().
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+VGAuthError
+SAML_VerifyBearerTokenSignature(const char *xmlText,
+                                char **subjNameOut,
+                                int *numCerts,
+                                char ***certChain)
+{
+   *subjNameOut = NULL;
+   *numCerts = 0;
+   *certChain = NULL;
+
    try {
       vector<string> certs;
       VGAuthError err;
       SAMLTokenData token;
-      char **pemCerts;
-      ServiceSubject subj;
       int i;
 
-      err = SAMLVerifyAssertion(xmlText, token, certs);
+      {
+         SAMLLockGuard guard;
+
+         err = SAMLVerifyAssertion(xmlText, token, certs);
+      }
       if (VGAUTH_E_OK != err) {
          return err;
       }
 
-      pemCerts = (char **) g_malloc0(sizeof(char *) * certs.size());
+      *certChain = (char **) g_malloc0(sizeof(char *) * (certs.size() + 1));
       for (i = 0; i < (int) certs.size(); i++) {
-         pemCerts[i] = g_strdup(certs[i].c_str());
-      }
-      subj.type = SUBJECT_TYPE_NAMED;
-      if (subjNameOut) {
-         *subjNameOut = g_strdup(token.subjectName.c_str());
+         (*certChain)[i] = g_strdup(certs[i].c_str());
       }
-      subj.name = g_strdup(token.subjectName.c_str());
-      err = ServiceVerifyAndCheckTrustCertChainForSubject((int) certs.size(),
-                                                          (const char **) pemCerts,
-                                                          userName,
-                                                          &subj,
-                                                          userNameOut,
-                                                          verifyAi);
-      Debug("%s: ServiceVerifyAndCheckTrustCertChainForSubject() returned "VGAUTHERR_FMT64"\n", __FUNCTION__, err);
+      *numCerts = (int) certs.size();
+      *subjNameOut = g_strdup(token.subjectName.c_str());
 
-      for (i = 0; i < (int) certs.size(); i++) {
-         g_free(pemCerts[i]);
-      }
-      g_free(pemCerts);
-      g_free(subj.name);
       return err;
    } catch (XSECException &e) {
       SAMLStringWrapper msg(e.getMsg());
@@ -576,6 +626,81 @@ SAML_VerifyBearerTokenAndChain(const char *xmlText,
 }
 
 
+/*
+ ******************************************************************************
+ * SAML_VerifyBearerTokenChain --                                        */ /**
+ *
+ * Checks the cert chain of a SAML bearer token that passed
+ * SAML_VerifyBearerTokenSignature() against the alias store.
+ * Main thread only.
+ *
+ * @param[in]  numCerts    Number of certs in the token.
+ * @param[in]  certChain   Certs in the token.
+ * @param[in]  userName    Optional username to authenticate as.
+ * @param[in]  subjName    The subject in the token.
+ * @param[out] userNameOut The user that the token has authenticated as.
+ * @param[out] verifyAi    The alias info associated with the entry
+ *                         in the alias store used to verify the
+ *                         SAML cert.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+VGAuthError
+SAML_VerifyBearerTokenChain(int numCerts,
+                            char **certChain,
+                            const char *userName,
+                            const char *subjName,
+                            char **userNameOut,
+                            ServiceAliasInfo **verifyAi)
+{
+   VGAuthError err;
+   ServiceSubject subj;
+
+   *userNameOut = NULL;
+   *verifyAi = NULL;
+
+   subj.type = SUBJECT_TYPE_NAMED;
+   subj.name = (char *) subjName;
+   err = ServiceVerifyAndCheckTrustCertChainForSubject(numCerts,
+                                                       (const char **) certChain,
+                                                       userName,
+                                                       &subj,
+                                                       userNameOut,
+                                                       verifyAi);
+   Debug("%s: ServiceVerifyAndCheckTrustCertChainForSubject() returned "VGAUTHERR_FMT64"\n", __FUNCTION__, err);
+
+   return err;
+}
+
+
+/*
+ ******************************************************************************
+ * SAML_FreeCertChain --                                                 */ /**
+ *
+ * Frees a cert chain returned by SAML_VerifyBearerTokenSignature().
+ *
+ * @param[in]  numCerts    Number of certs in the chain.
+ * @param[in]  certChain   The chain.
+ *
+ ******************************************************************************
+ */
+
+void
+SAML_FreeCertChain(int numCerts,
+                   char **certChain)
+{
+   int i;
+
+   for (i = 0; i < numCerts; i++) {
+      g_free(certChain[i]);
+   }
+   g_free(certChain);
+}
+
+
 /*
  ******************************************************************************
  * SAMLVerifyAssertion --                                                */ /**
@@ -47,7 +47,34 @@
 
 static int gClockSkewAdjustment = VGAUTH_PREF_DEFAULT_CLOCK_SKEW_SECS;
 static xmlSchemaPtr gParsedSchemas = NULL;
-static xmlSchemaValidCtxtPtr gSchemaValidateCtx = NULL;
+
+/*
+ * Tokens are verified on the service's worker threads.  They share the
+ * parsed schemas and prefs, which SAML_Reload() only replaces while
+ * holding this lock for writing.
+ */
+static GStaticRWLock gSAMLLock = G_STATIC_RW_LOCK_INIT;
+
+/*
+ * Tokens that passed VerifySAMLToken(), by digest of their text, so that a
+ * token used again isn't parsed, validated and signature checked again.
+ * Entries expire with the token.  The cert chain is still checked against
+ * the alias store each time.
+ */
+#define SAML_CACHE_MAX_ENTRIES      64
+#define SAML_CACHE_MAX_LIFETIME_SECS 300
+
+typedef struct SAMLCacheEntry {
+   glong expiry;        // when the token stops passing the time checks
+   gchar *subject;
+   int numCerts;
+   gchar **certChain;
+} SAMLCacheEntry;
+
+static GHashTable *gVerifiedTokens = NULL;   // digest -> SAMLCacheEntry
+static GStaticMutex gCacheLock = G_STATIC_MUTEX_INIT; // for gVerifiedTokens
+
+static void FlushCache(void);
 
 #define CATALOG_FILENAME            "catalog.xml"
 #define SAML_SCHEMA_FILENAME        "saml-schema-assertion-2.0.xsd"
@@ -226,20 +253,6 @@ LoadCatalogAndSchema(void)
       goto done;
    }
 
-   /*
-    * Set up the validaton context for later use.
-    */
-   gSchemaValidateCtx = xmlSchemaNewValidCtxt(gParsedSchemas);
-   if (NULL == gSchemaValidateCtx) {
-      g_warning("Failed to create schema validation context\n");
-      retVal = FALSE;
-      goto done;
-   }
-   xmlSchemaSetValidErrors(gSchemaValidateCtx,
-                           XmlErrorHandler,
-                           XmlErrorHandler,
-                           NULL);
-
    retVal = TRUE;
 done:
    if (NULL != ctx) {
@@ -265,10 +278,6 @@ done:
 static void
 FreeSchemas(void)
 {
-   if (NULL != gSchemaValidateCtx) {
-      xmlSchemaFreeValidCtxt(gSchemaValidateCtx);
-      gSchemaValidateCtx = NULL;
-   }
    if (NULL != gParsedSchemas) {
       xmlSchemaFree(gParsedSchemas);
       gParsedSchemas = NULL;
@@ -334,6 +343,14 @@ SAML_Init(void)
    /* set up the xml2 error handler */
    xmlSetGenericErrorFunc(NULL, XmlErrorHandler);
 
+   /*
+    * The above are per-thread in libxml2; make them the defaults for
+    * the worker threads tokens are verified on as well.
+    */
+   xmlThrDefLoadExtDtdDefaultValue(XML_DETECT_IDS | XML_COMPLETE_ATTRS);
+   xmlThrDefSubstituteEntitiesDefaultValue(1);
+   xmlThrDefSetGenericErrorFunc(NULL, XmlErrorHandler);
+
    /*
     * Load schemas
     */
@@ -417,7 +434,10 @@ SAML_Init(void)
 void
 SAML_Shutdown()
 {
+   g_static_rw_lock_writer_lock(&gSAMLLock);
+   FlushCache();
    FreeSchemas();
+   g_static_rw_lock_writer_unlock(&gSAMLLock);
    xmlSecCryptoShutdown();
    xmlSecCryptoAppShutdown();
    xmlSecShutdown();
@@ -446,9 +466,12 @@ SAML_Shutdown()
 void
 SAML_Reload()
 {
+   g_static_rw_lock_writer_lock(&gSAMLLock);
+   FlushCache();
    FreeSchemas();
    LoadPrefs();
    LoadCatalogAndSchema();
+   g_static_rw_lock_writer_unlock(&gSAMLLock);
 }
 
 
@@ -476,6 +499,136 @@ FreeCertArray(int num,
 }
 
 
+/*
+ ******************************************************************************
+ * CopyCertArray --                                                      */ /**
+ *
+ * Copies a simple array of pemCert.
+ *
+ * @param[in]  num      Number of certs in array.
+ * @param[in]  certs    Array of certs to copy.
+ *
+ * @return The copy.  Free with FreeCertArray().
+ *
+ ******************************************************************************
+ */
+
+static gchar **
+CopyCertArray(int num,
+              gchar **certs)
+{
+   gchar **copy = g_malloc0_n(num + 1, sizeof(gchar *));
+   int i;
+
+   for (i = 0; i < num; i++) {
+      copy[i] = g_strdup(certs[i]);
+   }
+   return copy;
+}
+
+
+/*
+ ******************************************************************************
+ * FreeCacheEntry --                                                     */ /**
+ *
+ * Frees a SAMLCacheEntry.
+ *
+ * @param[in]  data     The SAMLCacheEntry.
+ *
+ ******************************************************************************
+ */
+
+static void
+FreeCacheEntry(gpointer data)
+{
+   SAMLCacheEntry *entry = data;
+
+   g_free(entry->subject);
+   FreeCertArray(entry->numCerts, entry->certChain);
+   g_free(entry);
+}
+
+
+/*
+ ******************************************************************************
+ * FlushCache --                                                         */ /**
+ *
+ * Forgets all verified tokens.
+ *
+ ******************************************************************************
+ */
+
+static void
+FlushCache(void)
+{
+   g_static_mutex_lock(&gCacheLock);
+   if (NULL != gVerifiedTokens) {
+      g_hash_table_destroy(gVerifiedTokens);
+      gVerifiedTokens = NULL;
+   }
+   g_static_mutex_unlock(&gCacheLock);
+}
+
+
+/*
+ ******************************************************************************
+ * CacheToken --                                                         */ /**
+ *
+ * Remembers a verified token.  When the cache is full, expired entries are
+ * dropped, and if that isn't enough, the whole cache.
+ *
+ * @param[in]  digest     Digest of the token text.  Ownership is taken.
+ * @param[in]  expiry     When the token expires.
+ * @param[in]  subject    Subject of the token.
+ * @param[in]  numCerts   Number of certs in the token.
+ * @param[in]  certChain  Certs in the token.
+ *
+ ******************************************************************************
+ */
+
+static void
+CacheToken(gchar *digest,
+           glong expiry,
+           const gchar *subject,
+           int numCerts,
+           gchar **certChain)
+{
+   SAMLCacheEntry *entry;
+
+   g_static_mutex_lock(&gCacheLock);
+   if (NULL == gVerifiedTokens) {
+      gVerifiedTokens = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                              g_free, FreeCacheEntry);
+   }
+
+   if (g_hash_table_size(gVerifiedTokens) >= SAML_CACHE_MAX_ENTRIES) {
+      GHashTableIter iter;
+      gpointer key;
+      gpointer val;
+      GTimeVal now;
+
+      g_get_current_time(&now);
+      g_hash_table_iter_init(&iter, gVerifiedTokens);
+      while (g_hash_table_iter_next(&iter, &key, &val)) {
+         if (((SAMLCacheEntry *) val)->expiry <= now.tv_sec) {
+            g_hash_table_iter_remove(&iter);
+         }
+      }
+      if (g_hash_table_size(gVerifiedTokens) >= SAML_CACHE_MAX_ENTRIES) {
+         g_hash_table_remove_all(gVerifiedTokens);
+      }
+   }
+
+   entry = g_new0(SAMLCacheEntry, 1);
+   entry->expiry = expiry;
+   entry->subject = g_strdup(subject);
+   entry->numCerts = numCerts;
+   entry->certChain = CopyCertArray(numCerts, certChain);
+   g_hash_table_replace(gVerifiedTokens, digest, entry);
+   g_static_mutex_unlock(&gCacheLock);
+}
+
+
 /*
  ******************************************************************************
  * FindAttrValue --                                                      */ /**
@@ -674,12 +827,33 @@ FindAllNodesByName(xmlNodePtr root,
 static gboolean
 ValidateDoc(xmlDocPtr doc)
 {
+   xmlSchemaValidCtxtPtr ctx;
    int ret;
 
-   ret = xmlSchemaValidateDoc(gSchemaValidateCtx, doc);
+   if (NULL == gParsedSchemas) {
+      g_warning("No schemas to validate doc against\n");
+      return FALSE;
+   }
+
+   /*
+    * The parsed schemas can be shared between threads, but a validation
+    * context can't, so each doc gets its own.
+    */
+   ctx = xmlSchemaNewValidCtxt(gParsedSchemas);
+   if (NULL == ctx) {
+      g_warning("Failed to create schema validation context\n");
+      return FALSE;
+   }
+   xmlSchemaSetValidErrors(ctx,
+                           XmlErrorHandler,
+                           XmlErrorHandler,
+                           NULL);
+
+   ret = xmlSchemaValidateDoc(ctx, doc);
    if (ret < 0) {
       g_warning("Failed to validate doc against schema\n");
    }
+   xmlSchemaFreeValidCtxt(ctx);
 
    return (ret == 0) ? TRUE : FALSE;
 }
@@ -766,6 +940,38 @@ done:
 }
 
 
+/*
+ ******************************************************************************
+ * UpdateExpiry --                                                       */ /**
+ *
+ * Lowers the time a verified token can be reused until to the time the
+ * NotOnOrAfter attribute of a node stops passing CheckTimeAttr().
+ *
+ * @param[in]     node       The node.
+ * @param[in/out] expiry     The expiry time.
+ *
+ ******************************************************************************
+ */
+
+static void
+UpdateExpiry(const xmlNodePtr node,
+             glong *expiry)
+{
+   xmlChar *timeAttr;
+   GTimeVal attrTime;
+
+   timeAttr = FindAttrValue(node, "NotOnOrAfter");
+   if ((NULL != timeAttr) && (0 != *timeAttr) &&
+       g_time_val_from_iso8601(timeAttr, &attrTime) &&
+       attrTime.tv_sec + gClockSkewAdjustment < *expiry) {
+      *expiry = attrTime.tv_sec + gClockSkewAdjustment;
+   }
+   if (timeAttr) {
+      xmlFree(timeAttr);
+   }
+}
+
+
 /*
  ******************************************************************************
  * CheckAudience --                                                      */ /**
@@ -822,6 +1028,8 @@ CheckAudience(const xmlChar *audience)
  * @param[in]     doc         The parsed SAML token.
  * @param[out]    subjectRet  The Subject NameId.  Should be g_free()d by
  *                            caller.
+ * @param[in/out] expiry      Lowered to when the SubjectConfirmation that
+ *                            was met expires.
  *
  * @return TRUE if the conditions in at least one SubjectConfirmation is met,
  *         FALSE otherwise.
@@ -831,7 +1039,8 @@ CheckAudience(const xmlChar *audience)
 
 static gboolean
 VerifySubject(xmlDocPtr doc,
-              gchar **subjectRet)
+              gchar **subjectRet,
+              glong *expiry)
 {
    xmlNodePtr subjNode;
    xmlNodePtr nameIDNode;
@@ -911,6 +1120,8 @@ VerifySubject(xmlDocPtr doc,
                continue;
             }
             xmlFree(recipient);
+
+            UpdateExpiry(subjConfirmData, expiry);
          }
 
          /*
@@ -948,7 +1159,8 @@ done:
  *       </saml:AudienceRestriction>
  *    </saml:Conditions>
  *
- * @param[in]  doc  The parsed SAML token.
+ * @param[in]     doc     The parsed SAML token.
+ * @param[in/out] expiry  Lowered to when the conditions expire.
  *
  * @return TRUE if the conditions are met; FALSE otherwise.
  *
@@ -956,7 +1168,8 @@ done:
  */
 
 static gboolean
-VerifyConditions(xmlDocPtr doc)
+VerifyConditions(xmlDocPtr doc,
+                 glong *expiry)
 {
    xmlNodePtr condNode;
 
@@ -976,6 +1189,7 @@ VerifyConditions(xmlDocPtr doc)
       g_warning("%s: Time Conditions failed!\n", __FUNCTION__);
       return FALSE;
    }
+   UpdateExpiry(condNode, expiry);
 
    /*
     * <Condition> is a generic element, intended as an extension point.
@@ -1297,12 +1511,43 @@ VerifySAMLToken(const gchar *token,
    xmlDocPtr doc = NULL;
    int retCode = FALSE;
    gboolean bRet;
+   gchar *digest;
+   SAMLCacheEntry *entry;
+   GTimeVal now;
+   glong expiry;
    /*
     * If we want to set extra options, use this path.
     */
 #if PARSE_WITH_OPTIONS
    xmlParserCtxtPtr parseCtx = NULL;
+#endif
 
+   /*
+    * See if the token was verified before, and hasn't expired since.
+    */
+   g_get_current_time(&now);
+   digest = g_compute_checksum_for_string(G_CHECKSUM_SHA256, token, -1);
+   g_static_mutex_lock(&gCacheLock);
+   entry = (NULL != gVerifiedTokens) ?
+      g_hash_table_lookup(gVerifiedTokens, digest) : NULL;
+   if (NULL != entry) {
+      if (now.tv_sec < entry->expiry) {
+         g_debug("%s: token verified before\n", __FUNCTION__);
+         if (NULL != subject) {
+            *subject = g_strdup(entry->subject);
+         }
+         *numCerts = entry->numCerts;
+         *certChain = CopyCertArray(entry->numCerts, entry->certChain);
+         g_static_mutex_unlock(&gCacheLock);
+         g_free(digest);
+         return TRUE;
+      }
+      g_hash_table_remove(gVerifiedTokens, digest);
+   }
+   g_static_mutex_unlock(&gCacheLock);
+   expiry = now.tv_sec + SAML_CACHE_MAX_LIFETIME_SECS;
+
+#if PARSE_WITH_OPTIONS
    parseCtx = xmlCreateDocParserCtxt(token);
 
    /*
@@ -1330,13 +1575,13 @@ VerifySAMLToken(const gchar *token,
       goto done;
    }
 
-   bRet = VerifySubject(doc, subject);
+   bRet = VerifySubject(doc, subject, &expiry);
    if (FALSE == bRet) {
       g_warning("Failed to verify Subject node\n");
       goto done;
    }
 
-   bRet = VerifyConditions(doc);
+   bRet = VerifyConditions(doc, &expiry);
    if (FALSE == bRet) {
       g_warning("Failed to verify Conditions\n");
       goto done;
@@ -1348,8 +1593,14 @@ VerifySAMLToken(const gchar *token,
       goto done;
    }
 
+   if (NULL != subject && now.tv_sec < expiry) {
+      CacheToken(digest, expiry, *subject, *numCerts, *certChain);
+      digest = NULL;
+   }
+
    retCode = TRUE;
 done:
+   g_free(digest);
 #if PARSE_WITH_OPTIONS
    if (NULL != parseCtx) {
       xmlFreeParserCtxt(parseCtx);
@@ -1400,10 +1651,12 @@ SAML_VerifyBearerToken(const char *xmlText,
    gchar **certChain = NULL;
    int num = 0;
 
+   g_static_rw_lock_reader_lock(&gSAMLLock);
    ret = VerifySAMLToken(xmlText,
                          subjNameOut,
                          &num,
                          &certChain);
+   g_static_rw_lock_reader_unlock(&gSAMLLock);
 
    // clean up -- this code doesn't look at the chain
    FreeCertArray(num, certChain);
@@ -1412,6 +1665,120 @@ SAML_VerifyBearerToken(const char *xmlText,
 }
 
 
+/*
+ ******************************************************************************
+ * SAML_VerifyBearerTokenSignature --                                    */ /**
+ *
+ * Verifies a SAML bearer token by itself: parses it, validates it against
+ * the schema, and checks its Subject, Conditions and Signature.  This is
+ * the expensive part of SAML_VerifyBearerTokenAndChain(), and unlike the
+ * rest of it, may be called from any thread.
+ *
+ * @param[in]  xmlText     The text of the SAML assertion.
+ * @param[out] subjNameOut The subject in the token.  Caller must g_free().
+ * @param[out] numCerts    Number of certs in the token.
+ * @param[out] certChain   Certs in the token.  Free with
+ *                         SAML_FreeCertChain().
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+VGAuthError
+SAML_VerifyBearerTokenSignature(const char *xmlText,
+                                char **subjNameOut,
+                                int *numCerts,
+                                char ***certChain)
+{
+   gboolean bRet;
+
+   *subjNameOut = NULL;
+   *numCerts = 0;
+   *certChain = NULL;
+
+   g_static_rw_lock_reader_lock(&gSAMLLock);
+   bRet = VerifySAMLToken(xmlText,
+                          subjNameOut,
+                          numCerts,
+                          certChain);
+   g_static_rw_lock_reader_unlock(&gSAMLLock);
+
+   return bRet ? VGAUTH_E_OK : VGAUTH_E_AUTHENTICATION_DENIED;
+}
+
+
+/*
+ ******************************************************************************
+ * SAML_VerifyBearerTokenChain --                                        */ /**
+ *
+ * Checks the cert chain of a SAML bearer token that passed
+ * SAML_VerifyBearerTokenSignature() against the alias store.
+ * Main thread only.
+ *
+ * @param[in]  numCerts    Number of certs in the token.
+ * @param[in]  certChain   Certs in the token.
+ * @param[in]  userName    Optional username to authenticate as.
+ * @param[in]  subjName    The subject in the token.
+ * @param[out] userNameOut The user that the token has authenticated as.
+ * @param[out] verifyAi    The alias info associated with the entry
+ *                         in the alias store used to verify the
+ *                         SAML cert.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+VGAuthError
+SAML_VerifyBearerTokenChain(int numCerts,
+                            char **certChain,
+                            const char *userName,
+                            const char *subjName,
+                            char **userNameOut,
+                            ServiceAliasInfo **verifyAi)
+{
+   VGAuthError err;
+   ServiceSubject subj;
+
+   *userNameOut = NULL;
+   *verifyAi = NULL;
+
+   subj.type = SUBJECT_TYPE_NAMED;
+   subj.name = (char *) subjName;
+   err = ServiceVerifyAndCheckTrustCertChainForSubject(numCerts,
+                                                       (const char **) certChain,
+                                                       userName,
+                                                       &subj,
+                                                       userNameOut,
+                                                       verifyAi);
+   g_debug("%s: ServiceVerifyAndCheckTrustCertChainForSubject() "
+           "returned "VGAUTHERR_FMT64"\n", __FUNCTION__, err);
+
+   return err;
+}
+
+
+/*
+ ******************************************************************************
+ * SAML_FreeCertChain --                                                 */ /**
+ *
+ * Frees a cert chain returned by SAML_VerifyBearerTokenSignature().
+ *
+ * @param[in]  numCerts    Number of certs in the chain.
+ * @param[in]  certChain   The chain.
+ *
+ ******************************************************************************
+ */
+
+void
+SAML_FreeCertChain(int numCerts,
+                   char **certChain)
+{
+   FreeCertArray(numCerts, certChain);
+}
+
+
 /*
  ******************************************************************************
  * SAML_VerifyBearerTokenAndChain --                                     */ /**
@@ -1442,34 +1809,26 @@ SAML_VerifyBearerTokenAndChain(const char *xmlText,
                                ServiceAliasInfo **verifyAi)
 {
    VGAuthError err;
-   gboolean bRet;
    int num;
    gchar **certChain = NULL;
-   ServiceSubject subj;
 
    *userNameOut = NULL;
-   *subjNameOut = NULL;
    *verifyAi = NULL;
 
-   bRet = VerifySAMLToken(xmlText,
-                          subjNameOut,
-                          &num,
-                          &certChain);
-
-   if (FALSE == bRet) {
-      return VGAUTH_E_AUTHENTICATION_DENIED;
+   err = SAML_VerifyBearerTokenSignature(xmlText,
+                                         subjNameOut,
+                                         &num,
+                                         &certChain);
+   if (VGAUTH_E_OK != err) {
+      return err;
    }
 
-   subj.type = SUBJECT_TYPE_NAMED;
-   subj.name = *subjNameOut;
-   err = ServiceVerifyAndCheckTrustCertChainForSubject(num,
-                                                       (const char **) certChain,
-                                                       userName,
-                                                       &subj,
-                                                       userNameOut,
-                                                       verifyAi);
-   g_debug("%s: ServiceVerifyAndCheckTrustCertChainForSubject() "
-           "returned "VGAUTHERR_FMT64"\n", __FUNCTION__, err);
+   err = SAML_VerifyBearerTokenChain(num,
+                                     certChain,
+                                     userName,
+                                     *subjNameOut,
+                                     userNameOut,
+                                     verifyAi);
    FreeCertArray(num, certChain);
 
    return err;
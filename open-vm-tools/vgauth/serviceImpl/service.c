@@ -32,6 +32,7 @@
 
 static ServiceStartListeningForIOFunc startListeningIOFunc = NULL;
 static ServiceStopListeningForIOFunc stopListeningIOFunc = NULL;
+static ServiceResumeListeningForIOFunc resumeListeningIOFunc = NULL;
 
 static GHashTable *listenConnectionMap = NULL;
 
@@ -112,6 +113,8 @@ ServiceConnectionGetNextConnectionId(void)
  *                              listening for IO on a connection.
  * @param[in]   stopFunc        The function called when we no longer
  *                              care about IO on a connection.
+ * @param[in]   resumeFunc      The function called when we care about
+ *                              IO on a data connection again.
  *
  * @return VGAUTH_E_OK on success, VGAuthError on failure
  *
@@ -120,10 +123,12 @@ ServiceConnectionGetNextConnectionId(void)
 
 VGAuthError
 ServiceRegisterIOFunctions(ServiceStartListeningForIOFunc startFunc,
-                           ServiceStopListeningForIOFunc stopFunc)
+                           ServiceStopListeningForIOFunc stopFunc,
+                           ServiceResumeListeningForIOFunc resumeFunc)
 {
    startListeningIOFunc = startFunc;
    stopListeningIOFunc = stopFunc;
+   resumeListeningIOFunc = resumeFunc;
 
    return VGAUTH_E_OK;
 }
@@ -424,6 +429,48 @@ ServiceConnectionShutdown(ServiceConnection *conn)
 }
 
 
+/*
+ ******************************************************************************
+ * ServiceConnectionPauseIO --                                           */ /**
+ *
+ * Stops watching for input on a data connection, while a request read
+ * from it is being processed off the main loop.
+ *
+ * @param[in]   conn          The ServiceConnection.
+ *
+ ******************************************************************************
+ */
+
+void
+ServiceConnectionPauseIO(ServiceConnection *conn)
+{
+   ASSERT(stopListeningIOFunc);
+
+   (* stopListeningIOFunc) (conn);
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceConnectionResumeIO --                                          */ /**
+ *
+ * Watches for input on a data connection again after
+ * ServiceConnectionPauseIO().
+ *
+ * @param[in]   conn          The ServiceConnection.
+ *
+ ******************************************************************************
+ */
+
+void
+ServiceConnectionResumeIO(ServiceConnection *conn)
+{
+   ASSERT(resumeListeningIOFunc);
+
+   (void) (* resumeListeningIOFunc) (conn);
+}
+
+
 /*
  ******************************************************************************
  * ServiceHashConnectionShutdown --                                      */ /**
@@ -257,9 +257,11 @@ gboolean ServiceNetworkIsConnectionPrivateSuperUser(ServiceConnection *conn);
  */
 typedef VGAuthError (* ServiceStartListeningForIOFunc)(ServiceConnection *conn);
 typedef VGAuthError (* ServiceStopListeningForIOFunc)(ServiceConnection *conn);
+typedef VGAuthError (* ServiceResumeListeningForIOFunc)(ServiceConnection *conn);
 
 VGAuthError ServiceRegisterIOFunctions(ServiceStartListeningForIOFunc startFunc,
-                                       ServiceStopListeningForIOFunc stopFunc);
+                                       ServiceStopListeningForIOFunc stopFunc,
+                                       ServiceResumeListeningForIOFunc resumeFunc);
 
 
 /*
@@ -344,6 +346,8 @@ gboolean ServiceComparePEMCerts(const gchar *pemCert1,
  * Connection functions
  */
 void ServiceConnectionShutdown(ServiceConnection *conn);
+void ServiceConnectionPauseIO(ServiceConnection *conn);
+void ServiceConnectionResumeIO(ServiceConnection *conn);
 
 VGAuthError ServiceConnectionClone(ServiceConnection *parent,
                                    ServiceConnection **clone);       // OUT
@@ -486,6 +490,18 @@ VGAuthError SAML_VerifyBearerTokenAndChain(const char *xmlText,
                                            char **userNameOut,
                                            char **subjectNameOut,
                                            ServiceAliasInfo **verifyAi);
+VGAuthError SAML_VerifyBearerTokenSignature(const char *xmlText,
+                                            char **subjectNameOut,
+                                            int *numCerts,
+                                            char ***certChain);
+VGAuthError SAML_VerifyBearerTokenChain(int numCerts,
+                                        char **certChain,
+                                        const char *userName,
+                                        const char *subjectName,
+                                        char **userNameOut,
+                                        ServiceAliasInfo **verifyAi);
+void SAML_FreeCertChain(int numCerts,
+                        char **certChain);
 void SAML_Shutdown(void);
 void SAML_Reload(void);
 
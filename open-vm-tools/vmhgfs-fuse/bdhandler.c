@@ -248,6 +248,7 @@ HgfsBdChannelInit(void)
    bdChannel.ops.recv = NULL;
    bdChannel.ops.exit = HgfsBdChannelExit;
    bdChannel.priv = NULL;
+   bdChannel.notify = FALSE;
    pthread_mutex_init(&bdChannel.connLock, NULL);
    bdChannel.status = HGFS_CHANNEL_NOTCONNECTED;
    return &bdChannel;
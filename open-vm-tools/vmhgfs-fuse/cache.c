@@ -22,9 +22,8 @@
  * Module-specific components of the vmhgfs driver.
  */
 #include "module.h"
-#if !defined(__FreeBSD__) && !defined(__SOLARIS__)
-#include <glib.h>
-#endif
+#include "notify.h"
+#include "vm_atomic.h"
 
 /*
  * We make the default attribute cache timeout 1 second which is the same
@@ -32,10 +31,28 @@
  * This can be overridden with the mount option attr_timeout=T
  */
 #define CACHE_TIMEOUT HGFS_DEFAULT_TTL
-#define CACHE_PURGE_TIME 10
-#define CACHE_PURGE_SLEEP_TIME 30
-#define HASH_THRESHOLD_SIZE (2046 * 4)
-#define HASH_PURGE_SIZE (HASH_THRESHOLD_SIZE / 2)
+#define CACHE_NEGATIVE_TIMEOUT CACHE_TIMEOUT
+
+/*
+ * Entries whose parent directory is watched by the host (see notify.c)
+ * are dropped as soon as the host reports a change, so they are kept much
+ * longer. The timeout only bounds the damage of a lost notification.
+ */
+#define CACHE_WATCHED_TIMEOUT 60
+
+/*
+ * The cache is split into shards, each with its own lock, hash buckets and
+ * LRU list, so that concurrent lookups of unrelated paths do not contend.
+ * The total number of entries is bounded; once a shard is full its least
+ * recently used entry is dropped for every new one, and a few expired
+ * entries are reaped from the LRU tail on each update. This replaces the
+ * periodic bulk purge.
+ */
+#define CACHE_SHARDS 16
+#define CACHE_SHARD_BUCKETS 512
+#define CACHE_MAX_ENTRIES (2046 * 4)
+#define CACHE_SHARD_MAX_ENTRIES (CACHE_MAX_ENTRIES / CACHE_SHARDS)
+#define CACHE_REAP_BATCH 4
 #include "cache.h"
 
 /*
@@ -43,61 +60,89 @@
  */
 
 typedef struct HgfsAttrCache {
-   HgfsAttrInfo attr; /* Attribute of a file or directory */
-   uint64 changeTime; /* time the attribute was last updated */
-   struct list_head list; /* used in linked list implementation */
-   char path[0];      /* path of the file corresponding the the attr */
+   HgfsAttrInfo attr;             /* Attribute of a file or directory */
+   time_t expireTime;             /* time after which the entry is stale */
+   Bool negative;                 /* path is known not to exist */
+   uint32 hash;                   /* hash of the path */
+   struct HgfsAttrCache *next;    /* next entry in the hash bucket */
+   struct list_head lru;          /* position in the shard LRU list */
+   char path[0];                  /* path of the file corresponding the the attr */
 } HgfsAttrCache;
 
+typedef struct HgfsAttrCacheShard {
+   pthread_mutex_t lock;                          /* protects the shard */
+   HgfsAttrCache *buckets[CACHE_SHARD_BUCKETS];   /* hash chains */
+   struct list_head lruList;                      /* most recently used first */
+   uint32 numEntries;
+} HgfsAttrCacheShard;
 
-/* Head of the list */
-struct HgfsAttrCache attrList;
+static HgfsAttrCacheShard attrCache[CACHE_SHARDS];
+static Atomic_uint64 attrCacheHits;
+static Atomic_uint64 attrCacheMisses;
 
-/*Lock for accessing the attribute cache*/
-static pthread_mutex_t HgfsAttrCacheLock = PTHREAD_MUTEX_INITIALIZER;
 
 /*
- * Lists are used to manage attribute cache in Solaris and FreeBSD,
- * HashTables are used in Linux. HashTables perform better and hence
- * once newer version of glib with hash tables are packaged for Solaris
- * and FreeBSD, this section will go away.
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheHash
+ *
+ *    FNV-1a hash of a path.
+ *
+ * Results:
+ *    The hash value.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
  */
 
-#if defined(__FreeBSD__) || defined(__SOLARIS__)
+static uint32
+HgfsAttrCacheHash(const char *path)  //IN: Path of file or directory
+{
+   uint32 hash = 2166136261U;
+
+   while (*path != '\0') {
+      hash ^= (uint8)*path++;
+      hash *= 16777619U;
+   }
+   return hash;
+}
+
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsInitCache
+ * HgfsAttrCacheGetShard
  *
- *    Initializes the list attrList to cache attributes.
+ *    Returns the shard holding the entries with the given hash.
  *
  * Results:
- *    None
+ *    The shard.
  *
  * Side effects:
  *    None
  *
  *----------------------------------------------------------------------
- *
  */
 
-void
-HgfsInitCache()
+static INLINE HgfsAttrCacheShard *
+HgfsAttrCacheGetShard(uint32 hash)  //IN: path hash
 {
-   INIT_LIST_HEAD(&attrList.list);
+   return &attrCache[hash % CACHE_SHARDS];
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsGetAttrCache
+ * HgfsAttrCacheBucket
  *
- *    Retrieves the attr from the list for a given path.
+ *    Returns the hash chain of a shard for the given hash. The low bits
+ *    already picked the shard so the bucket is taken from the high bits.
  *
  * Results:
- *    0 on success else -1 on error
+ *    Pointer to the head of the chain.
  *
  * Side effects:
  *    None
@@ -105,47 +150,56 @@ HgfsInitCache()
  *----------------------------------------------------------------------
  */
 
-int
-HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
-                 HgfsAttrInfo *attr) //IN: Attribute for a given path
+static INLINE HgfsAttrCache **
+HgfsAttrCacheBucket(HgfsAttrCacheShard *shard,  //IN: shard
+                    uint32 hash)                //IN: path hash
 {
-   HgfsAttrCache *tmp;
-   int res = -1;
-   int diff;
+   return &shard->buckets[(hash / CACHE_SHARDS) % CACHE_SHARD_BUCKETS];
+}
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
 
-   attrList.changeTime = HGFS_GET_TIME(time(NULL));
-   list_for_each_entry(tmp, &attrList.list, list) {
-      LOG(4, ("tmp->path = %d\n", tmp->path));
-      if (strcmp(path, tmp->path) == 0) {
-         LOG(4, ("cache hit. path = %s\n", tmp->path));
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheLookup
+ *
+ *    Finds the entry for a path in a shard. The shard lock must be held.
+ *
+ * Results:
+ *    The entry or NULL.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
 
-         diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
+static HgfsAttrCache *
+HgfsAttrCacheLookup(HgfsAttrCacheShard *shard,  //IN: shard
+                    const char *path,           //IN: Path of file or directory
+                    uint32 hash)                //IN: path hash
+{
+   HgfsAttrCache *tmp;
 
-         LOG(4, ("time since last updated is %d seconds\n", diff));
-         if (diff <= CACHE_TIMEOUT) {
-            *attr = tmp->attr;
-            res = 0;
-         }
+   for (tmp = *HgfsAttrCacheBucket(shard, hash); tmp != NULL; tmp = tmp->next) {
+      if (tmp->hash == hash && strcmp(path, tmp->path) == 0) {
          break;
       }
    }
-
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
-   return res;
+   return tmp;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsSetAttrCache
+ * HgfsAttrCacheRemove
  *
- *    Updates the list with the given (key, attr)pair.
+ *    Unlinks an entry from its shard and frees it. The shard lock must
+ *    be held.
  *
  * Results:
- *    0 on success else negative value on error
+ *    None
  *
  * Side effects:
  *    None
@@ -153,49 +207,33 @@ HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
  *----------------------------------------------------------------------
  */
 
-int
-HgfsSetAttrCache(const char* path,   //IN: Path of file or directory
-                 HgfsAttrInfo *attr) //IN: Attribute for a given path
+static void
+HgfsAttrCacheRemove(HgfsAttrCacheShard *shard,  //IN: shard
+                    HgfsAttrCache *entry)       //IN: entry to remove
 {
-   HgfsAttrCache *tmp;
-   int res = 0;
+   HgfsAttrCache **link = HgfsAttrCacheBucket(shard, entry->hash);
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
-
-   attrList.changeTime = HGFS_GET_TIME(time(NULL));
-   list_for_each_entry (tmp, &attrList.list, list) {
-      if (strcmp(path, tmp->path) == 0) {
-         tmp->attr = *attr;
-         tmp->changeTime = HGFS_GET_TIME(time(NULL));
-         LOG(4, ("cache entry updated. path = %s\n", tmp->path));
-         goto out;
-      }
-   }
-
-   tmp = malloc(sizeof(HgfsAttrCache) + strlen(path) + 1);
-   if (tmp == NULL) {
-      res = -ENOMEM;
-      goto out;
+   while (*link != entry) {
+      ASSERT(*link != NULL);
+      link = &(*link)->next;
    }
-   INIT_LIST_HEAD(&tmp->list);
-   Str_Strcpy(tmp->path, path, strlen(path) + 1);
-   tmp->attr = *attr;
-   tmp->changeTime = HGFS_GET_TIME(time(NULL));
-   list_add(&tmp->list, &attrList.list);
-   LOG(4, ("cache entry added. path = %s\n", tmp->path));
+   *link = entry->next;
 
-out:
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
-   return res;
+   list_del(&entry->lru);
+   shard->numEntries--;
+   free(entry);
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsInvalidateAttrCache
+ * HgfsAttrCacheReap
  *
- *    Invalidate the attribute list entry for a given path.
+ *    Makes room in a shard for a new entry. Expired entries are taken from
+ *    the LRU tail, at most CACHE_REAP_BATCH of them, and if the shard is
+ *    still full the least recently used entry goes. The shard lock must be
+ *    held.
  *
  * Results:
  *    None
@@ -206,85 +244,115 @@ out:
  *----------------------------------------------------------------------
  */
 
-void
-HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
+static void
+HgfsAttrCacheReap(HgfsAttrCacheShard *shard,  //IN: shard
+                  time_t now)                 //IN: current time
 {
-   HgfsAttrCache *tmp;
+   int reaped = 0;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
+   while (!list_empty(&shard->lruList) && reaped < CACHE_REAP_BATCH) {
+      HgfsAttrCache *tail = list_entry(shard->lruList.prev, HgfsAttrCache, lru);
 
-   list_for_each_entry (tmp, &attrList.list, list) {
-      if (strcmp(path, tmp->path) == 0) {
-         list_del(&tmp->list);
-         free(tmp);
+      if (now <= tail->expireTime) {
          break;
       }
+      HgfsAttrCacheRemove(shard, tail);
+      reaped++;
    }
 
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   if (shard->numEntries >= CACHE_SHARD_MAX_ENTRIES) {
+      HgfsAttrCache *tail = list_entry(shard->lruList.prev, HgfsAttrCache, lru);
+
+      LOG(4, ("cache entry evicted. path = %s\n", tail->path));
+      HgfsAttrCacheRemove(shard, tail);
+   }
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsPurgeCache:
+ * HgfsAttrCacheUpdate
  *
- *    This routine is called by an independent thread to purge the cache,
- *    deletion is based on time of last update.
+ *    Adds or refreshes the entry for a path.
  *
  * Results:
- *    None
+ *    0 on success else negative value on error
  *
  * Side effects:
- *    None
+ *    May evict other entries of the same shard.
  *
  *----------------------------------------------------------------------
  */
 
-void*
-HgfsPurgeCache(void* unused) //IN: Thread argument
+static int
+HgfsAttrCacheUpdate(const char *path,         //IN: Path of file or directory
+                    const HgfsAttrInfo *attr, //IN/OPT: attribute, NULL if none
+                    time_t ttl)               //IN: entry lifetime in seconds
 {
+   uint32 hash = HgfsAttrCacheHash(path);
+   HgfsAttrCacheShard *shard = HgfsAttrCacheGetShard(hash);
+   time_t now = time(NULL);
    HgfsAttrCache *tmp;
-   HgfsAttrCache *prev;
-   int diff;
+   HgfsAttrCache **bucket;
+   size_t pathLen;
+   int res = 0;
 
-   while (1)
-   {
-      sleep(CACHE_PURGE_SLEEP_TIME);
+   pthread_mutex_lock(&shard->lock);
 
-      pthread_mutex_lock(&HgfsAttrCacheLock);
+   tmp = HgfsAttrCacheLookup(shard, path, hash);
+   if (tmp != NULL) {
+      LOG(4, ("cache entry updated. path = %s\n", tmp->path));
+      list_del(&tmp->lru);
+      goto update;
+   }
 
-      list_for_each_entry_safe (tmp, prev, &attrList.list, list) {
-         diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
-         if (diff > CACHE_PURGE_TIME) {
-            list_del (&tmp->list);
-            free (tmp);
-         }
-      }
+   HgfsAttrCacheReap(shard, now);
 
-      pthread_mutex_unlock(&HgfsAttrCacheLock);
+   pathLen = strlen(path) + 1;
+   tmp = malloc(sizeof(HgfsAttrCache) + pathLen);
+   if (tmp == NULL) {
+      res = -ENOMEM;
+      goto out;
    }
-   return 0;
-}
+   Str_Strcpy(tmp->path, path, pathLen);
+   tmp->hash = hash;
+   bucket = HgfsAttrCacheBucket(shard, hash);
+   tmp->next = *bucket;
+   *bucket = tmp;
+   shard->numEntries++;
+   LOG(4, ("cache entry added. path = %s\n", tmp->path));
 
-#else
+update:
+   if (attr != NULL) {
+      tmp->attr = *attr;
+      tmp->negative = FALSE;
+   } else {
+      memset(&tmp->attr, 0, sizeof tmp->attr);
+      tmp->negative = TRUE;
+   }
+   tmp->expireTime = now + ttl;
+   list_add(&tmp->lru, &shard->lruList);
 
+out:
+   pthread_mutex_unlock(&shard->lock);
+   return res;
+}
 
-GHashTable *g_hash_table;
 
 /*
  *----------------------------------------------------------------------
  *
  * HgfsInitCache
  *
- *    Creates a hash table with string as a key.
+ *    Initializes the attribute cache shards.
  *
  * Results:
  *    None
  *
  * Side effects:
  *    None
+ *
  *----------------------------------------------------------------------
  *
  */
@@ -292,7 +360,14 @@ GHashTable *g_hash_table;
 void
 HgfsInitCache()
 {
-   g_hash_table = g_hash_table_new(g_str_hash, g_str_equal);
+   int i;
+
+   for (i = 0; i < CACHE_SHARDS; i++) {
+      pthread_mutex_init(&attrCache[i].lock, NULL);
+      memset(attrCache[i].buckets, 0, sizeof attrCache[i].buckets);
+      INIT_LIST_HEAD(&attrCache[i].lruList);
+      attrCache[i].numEntries = 0;
+   }
 }
 
 
@@ -301,40 +376,51 @@ HgfsInitCache()
  *
  * HgfsGetAttrCache
  *
- *    Retrieves the attr from the HashTable for a given path.
+ *    Retrieves the attr from the cache for a given path.
  *
  * Results:
- *    0 on success else -1 on error
+ *    0 on success, -ENOENT if the path is cached as nonexistent,
+ *    else -1 if there is no valid entry.
  *
  * Side effects:
- *    None
+ *    Stale entries are dropped.
  *
  *----------------------------------------------------------------------
  */
 
 int
 HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
-                 HgfsAttrInfo *attr) //IN: Attribute for a given path
+                 HgfsAttrInfo *attr) //OUT: Attribute for a given path
 {
+   uint32 hash = HgfsAttrCacheHash(path);
+   HgfsAttrCacheShard *shard = HgfsAttrCacheGetShard(hash);
    HgfsAttrCache *tmp;
    int res = -1;
-   int diff;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
+   pthread_mutex_lock(&shard->lock);
 
-   tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
+   tmp = HgfsAttrCacheLookup(shard, path, hash);
    if (tmp != NULL) {
       LOG(4, ("cache hit. path = %s\n", tmp->path));
 
-      diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
-      LOG(4, ("time since last updated is %d seconds\n", diff));
-      if ( diff <= CACHE_TIMEOUT ) {
-         *attr = tmp->attr;
-         res = 0;
+      if (time(NULL) > tmp->expireTime) {
+         LOG(4, ("cache entry expired\n"));
+         HgfsAttrCacheRemove(shard, tmp);
+      } else {
+         list_del(&tmp->lru);
+         list_add(&tmp->lru, &shard->lruList);
+         if (tmp->negative) {
+            res = -ENOENT;
+         } else {
+            *attr = tmp->attr;
+            res = 0;
+         }
       }
    }
 
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   pthread_mutex_unlock(&shard->lock);
+
+   Atomic_Inc64(res == -1 ? &attrCacheMisses : &attrCacheHits);
    return res;
 }
 
@@ -342,12 +428,13 @@ HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
 /*
  *----------------------------------------------------------------------
  *
- * HgfsSetAttrCache
+ * HgfsGetAttrCacheStats
  *
- *    Updates the HashTable with the given (key, attr) pair.
+ *    Returns the lookup counters of the cache, negative hits count as
+ *    hits.
  *
  * Results:
- *    0 on success else negative value on error
+ *    None
  *
  * Side effects:
  *    None
@@ -355,37 +442,64 @@ HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
  *----------------------------------------------------------------------
  */
 
-int
-HgfsSetAttrCache(const char* path,         //IN: Path of file or directory
-                 HgfsAttrInfo *attr)       //IN: Attribute for a given path
+void
+HgfsGetAttrCacheStats(uint64 *hits,    //OUT: Lookups answered by the cache
+                      uint64 *misses)  //OUT: Lookups which missed
 {
-   HgfsAttrCache *tmp;
-   int res = 0;
+   *hits = Atomic_Read64(&attrCacheHits);
+   *misses = Atomic_Read64(&attrCacheMisses);
+}
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
 
-   tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
-   if (tmp != NULL) {
-      tmp->attr = *attr;
-      tmp->changeTime = HGFS_GET_TIME(time(NULL));
-      goto out;
-   }
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsSetAttrCache
+ *
+ *    Updates the cache with the given (key, attr) pair.
+ *
+ * Results:
+ *    0 on success else negative value on error
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
 
-   tmp = malloc(sizeof(HgfsAttrCache) + strlen(path) + 1);
-   if (tmp == NULL) {
-      return -ENOMEM;
-      goto out;
-   }
+int
+HgfsSetAttrCache(const char* path,   //IN: Path of file or directory
+                 HgfsAttrInfo *attr) //IN: Attribute for a given path
+{
+   return HgfsAttrCacheUpdate(path, attr,
+                              HgfsNotifyParentIsWatched(path) ?
+                              CACHE_WATCHED_TIMEOUT : CACHE_TIMEOUT);
+}
 
-   Str_Strcpy(tmp->path, path, strlen(path) + 1);
-   tmp->attr = *attr;
-   tmp->changeTime = HGFS_GET_TIME(time(NULL));
 
-   g_hash_table_insert(g_hash_table, (gpointer)tmp->path, (gpointer)tmp);
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsSetNegativeAttrCache
+ *
+ *    Records that a path does not exist, so that repeated lookups of it
+ *    are answered without a server round trip.
+ *
+ * Results:
+ *    0 on success else negative value on error
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
 
-out:
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
-   return res;
+int
+HgfsSetNegativeAttrCache(const char* path)   //IN: Path of file or directory
+{
+   return HgfsAttrCacheUpdate(path, NULL,
+                              HgfsNotifyParentIsWatched(path) ?
+                              CACHE_WATCHED_TIMEOUT : CACHE_NEGATIVE_TIMEOUT);
 }
 
 
@@ -394,7 +508,7 @@ out:
  *
  * HgfsInvalidateAttrCache
  *
- *    Invalidate the HashTable entry for a path.
+ *    Invalidate the cache entry for a given path.
  *
  * Results:
  *    None
@@ -408,24 +522,27 @@ out:
 void
 HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
 {
+   uint32 hash = HgfsAttrCacheHash(path);
+   HgfsAttrCacheShard *shard = HgfsAttrCacheGetShard(hash);
    HgfsAttrCache *tmp;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
-   tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
+   pthread_mutex_lock(&shard->lock);
+   tmp = HgfsAttrCacheLookup(shard, path, hash);
    if (tmp != NULL) {
-      tmp->changeTime = 0;
+      HgfsAttrCacheRemove(shard, tmp);
    }
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   pthread_mutex_unlock(&shard->lock);
 }
 
+
 /*
  *----------------------------------------------------------------------
  *
- * HgfsPurgeCache
+ * HgfsInvalidateAttrCacheChildren
  *
- *    This routine is called by an independent thread to purge the cache,
- *    for performance reasons, the deletion is done in random based
- *    on the order of iteration.
+ *    Invalidate the cache entries of everything below a directory. This
+ *    walks every shard, so it is meant for the rare cases where a whole
+ *    subtree may have changed behind our back.
  *
  * Results:
  *    None
@@ -436,28 +553,25 @@ HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
  *----------------------------------------------------------------------
  */
 
-void*
-HgfsPurgeCache(void* unused)      //IN: Thread argument
+void
+HgfsInvalidateAttrCacheChildren(const char* path)  //IN: Path to directory
 {
-   gpointer key, value;
-   GHashTableIter iter;
-
-   while (1) {
-      sleep(CACHE_PURGE_SLEEP_TIME);
-
-      pthread_mutex_lock(&HgfsAttrCacheLock);
-
-      if (g_hash_table_size(g_hash_table) >= HASH_THRESHOLD_SIZE) {
-         g_hash_table_iter_init(&iter, g_hash_table);
-         while (g_hash_table_iter_next(&iter, &key, &value) &&
-               (g_hash_table_size(g_hash_table) >= HASH_PURGE_SIZE)) {
-            g_hash_table_iter_remove(&iter);
-            free(value);
+   size_t len = strlen(path);
+   Bool trailingSlash = len > 0 && path[len - 1] == '/';
+   int i;
+
+   for (i = 0; i < CACHE_SHARDS; i++) {
+      HgfsAttrCacheShard *shard = &attrCache[i];
+      HgfsAttrCache *tmp;
+      HgfsAttrCache *next;
+
+      pthread_mutex_lock(&shard->lock);
+      list_for_each_entry_safe(tmp, next, &shard->lruList, lru) {
+         if (strncmp(tmp->path, path, len) == 0 &&
+             (trailingSlash ? tmp->path[len] != '\0' : tmp->path[len] == '/')) {
+            HgfsAttrCacheRemove(shard, tmp);
          }
       }
-
-      pthread_mutex_unlock(&HgfsAttrCacheLock);
+      pthread_mutex_unlock(&shard->lock);
    }
-   return 0;
 }
-#endif
@@ -27,8 +27,10 @@
 
 int HgfsGetAttrCache(const char* path, HgfsAttrInfo *attr);
 int HgfsSetAttrCache(const char* path, HgfsAttrInfo *attr);
+int HgfsSetNegativeAttrCache(const char* path);
 void HgfsInitCache();
-void* HgfsPurgeCache(void*);
 void HgfsInvalidateAttrCache(const char* path);
+void HgfsInvalidateAttrCacheChildren(const char* path);
+void HgfsGetAttrCacheStats(uint64 *hits, uint64 *misses);
 
 #endif
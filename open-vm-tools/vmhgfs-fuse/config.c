@@ -65,6 +65,10 @@ enum {
    KEY_VERSION,
    KEY_BIG_WRITES,
    KEY_NO_BIG_WRITES,
+   KEY_WRITEBACK_CACHE,
+   KEY_NO_WRITEBACK_CACHE,
+   KEY_STATS_FILE,
+   KEY_VSOCK,
    KEY_ENABLED_FUSE,
 };
 
@@ -78,6 +82,11 @@ const struct fuse_opt vmhgfsOpts[] = {
      /* We will change the default value, unless it is specified explicitly. */
      FUSE_OPT_KEY("big_writes",     KEY_BIG_WRITES),
      FUSE_OPT_KEY("nobig_writes",   KEY_NO_BIG_WRITES),
+     /* Handled by vmhgfs-fuse itself, libfuse 2 has no writeback cache. */
+     FUSE_OPT_KEY("writeback_cache",   KEY_WRITEBACK_CACHE),
+     FUSE_OPT_KEY("nowriteback_cache", KEY_NO_WRITEBACK_CACHE),
+     FUSE_OPT_KEY("stats_file",        KEY_STATS_FILE),
+     FUSE_OPT_KEY("vsock",             KEY_VSOCK),
 
      FUSE_OPT_KEY("-V",             KEY_VERSION),
      FUSE_OPT_KEY("--version",      KEY_VERSION),
@@ -121,11 +130,18 @@ Usage(char *prog_name)  // IN
            "                           1 - system OS version is not supported for HGFS FUSE\n"
            "                           2 - system needs FUSE packages for HGFS FUSE\n"
            "\n"
-#ifdef VMX86_DEVEL
            "vmhgfs options:\n"
+           "    -o writeback_cache     coalesce small writes before sending them\n"
+           "                           to the host, write errors are reported on\n"
+           "                           close or fsync\n"
+           "    -o stats_file          serve performance counters in the\n"
+           "                           read-only file /.vmhgfs/stats\n"
+           "    -o vsock               send requests over the experimental vsock\n"
+           "                           channel when the host provides it\n"
+#ifdef VMX86_DEVEL
            "    -l   --loglevel NUM    set loglevel=NUM only available in debug build.\n"
-           "\n"
 #endif
+           "\n"
            , prog_name, prog_name, prog_name);
 }
 
@@ -442,6 +458,22 @@ vmhgfsOptProc(void *data,                // IN
       config->addBigWrites = FALSE;
       return 0;
 
+   case KEY_WRITEBACK_CACHE:
+      config->writebackCache = TRUE;
+      return 0;
+
+   case KEY_NO_WRITEBACK_CACHE:
+      config->writebackCache = FALSE;
+      return 0;
+
+   case KEY_STATS_FILE:
+      config->statsFile = TRUE;
+      return 0;
+
+   case KEY_VSOCK:
+      config->vsockChannel = TRUE;
+      return 0;
+
    case KEY_HELP:
       Usage(outargs->argv[0]);
       fuse_opt_add_arg(outargs, "-ho");
@@ -502,6 +534,9 @@ vmhgfsPreprocessArgs(struct fuse_args *outargs)    // IN/OUT
 #else
    config.addBigWrites = TRUE;
 #endif
+   config.writebackCache = FALSE;
+   config.statsFile = FALSE;
+   config.vsockChannel = FALSE;
 
    res = fuse_opt_parse(outargs, &config, vmhgfsOpts, vmhgfsOptProc);
    if (res != 0) {
@@ -511,6 +546,10 @@ vmhgfsPreprocessArgs(struct fuse_args *outargs)    // IN/OUT
 #ifdef VMX86_DEVEL
    LOGLEVEL_THRESHOLD = config.logLevel;
 #endif
+   gState->writebackCache = config.writebackCache;
+   gState->statsFile = config.statsFile;
+   gState->vsockChannel = config.vsockChannel;
+
    /* Default option changes for vmhgfs fuse client. */
    if (config.addBigWrites) {
       res = fuse_opt_add_arg(outargs, "-obig_writes");
@@ -519,6 +558,25 @@ vmhgfsPreprocessArgs(struct fuse_args *outargs)    // IN/OUT
       }
    }
 
+#ifndef __APPLE__
+   /*
+    * Large reads are split into parallel server requests, so let the kernel
+    * send them. Keep the page cache across opens of unchanged files.
+    */
+   res = fuse_opt_add_arg(outargs, "-omax_read=131072");
+   if (res != 0) {
+      goto exit;
+   }
+   res = fuse_opt_add_arg(outargs, "-omax_readahead=131072");
+   if (res != 0) {
+      goto exit;
+   }
+#endif
+   res = fuse_opt_add_arg(outargs, "-oauto_cache");
+   if (res != 0) {
+      goto exit;
+   }
+
 exit:
    return res;
 }
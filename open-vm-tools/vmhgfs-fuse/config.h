@@ -32,6 +32,9 @@ struct vmhgfsConfig {
 #endif
    int addBigWrites;
    int addAllowOther;
+   int writebackCache;
+   int statsFile;
+   int vsockChannel;
 };
 
 int vmhgfsOptProc(void *data, const char *arg,
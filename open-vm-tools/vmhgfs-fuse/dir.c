@@ -22,6 +22,8 @@
  * File operations for the hgfs driver.
  */
 #include "module.h"
+#include "cache.h"
+#include "file.h"
 
 
 #define HGFS_CREATE_DIR_MASK (HGFS_CREATE_DIR_VALID_FILE_NAME | \
@@ -230,6 +232,10 @@ out:
  *    server, while for V3 we may have multiple directory entries. The
  *    number of entries can be read from the reply packet.
  *
+ *    The attributes of each entry are also added to the attribute cache,
+ *    so that the getattr calls which usually follow a readdir do not
+ *    need to go to the server.
+ *
  * Results:
  *    0 on success, anything else on failure.
  *
@@ -241,6 +247,9 @@ out:
 
 static int
 HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
+                     char *entryPath,   // IN/OUT: Dir path, entry name is
+                                        //         appended at entryPathLen
+                     size_t entryPathLen, // IN: Length of the dir path
                      void *vfsDirent,   // OUT: Buffer to copy dentries into
                      fuse_fill_dir_t filldir, // IN:  Filler function
                      HgfsReq *req,      // IN:  The request containing reply
@@ -332,6 +341,7 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
       if (result != 0) {
          goto out;
       }
+      attr.fileName = NULL;
 
       /*
        * Escape all non-printable characters (which for linux is just
@@ -371,6 +381,20 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
       /* Reuse fileNameLength to store the filename length after escape. */
       fileNameLength = result;
 
+      if (strcmp(escName, ".") != 0 && strcmp(escName, "..") != 0) {
+         HgfsAttrInfo cachedAttr;
+
+         memcpy(entryPath + entryPathLen, escName, fileNameLength + 1);
+
+         /*
+          * Keep fresh entries, they may carry the size of data which is
+          * still buffered by write coalescing.
+          */
+         if (HgfsGetAttrCache(entryPath, &cachedAttr) != 0) {
+            HgfsSetAttrCache(entryPath, &attr);
+         }
+      }
+
       /* Assign the correct dentry type. */
       switch (attr.type) {
       case HGFS_FILE_TYPE_SYMLINK:
@@ -553,7 +577,8 @@ HgfsRequestDirEntries(HgfsHandle searchHandle, // IN: Handle to dir
  */
 
 int
-HgfsReaddir(HgfsHandle handle,        // IN:  Directory handle to read from
+HgfsReaddir(const char *path,         // IN:  Absolute path of the directory
+            HgfsHandle handle,        // IN:  Directory handle to read from
             void *dirent,             // OUT: Buffer to copy dentries into
             fuse_fill_dir_t filldir)  // IN:  Filler function
 {
@@ -561,12 +586,28 @@ HgfsReaddir(HgfsHandle handle,        // IN:  Directory handle to read from
    HgfsReq *request;
    int result = 0;
    uint32 f_pos = 0;
+   char *entryPath;
+   size_t entryPathLen;
 
    ASSERT(dirent);
+   ASSERT(path);
+
+   /* Room for "<path>/<name>", used as the attribute cache key. */
+   entryPathLen = strlen(path);
+   entryPath = malloc(entryPathLen + NAME_MAX + 2);
+   if (!entryPath) {
+      LOG(4, ("Out of memory allocating entry path buffer.\n"));
+      return -ENOMEM;
+   }
+   memcpy(entryPath, path, entryPathLen);
+   if (entryPathLen == 0 || entryPath[entryPathLen - 1] != '/') {
+      entryPath[entryPathLen++] = '/';
+   }
 
    request = HgfsGetNewRequest();
    if (!request) {
       LOG(4, ("Out of memory while getting new request\n"));
+      free(entryPath);
       return -ENOMEM;
    }
    while (!done) {
@@ -581,8 +622,8 @@ HgfsReaddir(HgfsHandle handle,        // IN:  Directory handle to read from
          break;
       }
 
-      result = HgfsReadDirFromReply(&f_pos, dirent, filldir, request, opUsed,
-                                    &done);
+      result = HgfsReadDirFromReply(&f_pos, entryPath, entryPathLen, dirent,
+                                    filldir, request, opUsed, &done);
 
       LOG(4, ("f_pos = %d\n", f_pos));
       if (result == -ENAMETOOLONG) {
@@ -600,6 +641,7 @@ HgfsReaddir(HgfsHandle handle,        // IN:  Directory handle to read from
       LOG(6, ("End of dir reached.\n"));
    }
    HgfsFreeRequest(request);
+   free(entryPath);
    return result;
 }
 
@@ -835,6 +877,8 @@ HgfsDelete(const char* path,       // IN: Path to file
    HgfsAttrInfo *clearReadOnlyAttr = &newAttr;
    Bool clearedReadOnly = FALSE;
 
+   HgfsOpenCacheInvalidate(path);
+
    if ((op != HGFS_OP_DELETE_FILE) &&
        (op != HGFS_OP_DELETE_DIR)) {
       LOG(4, ("Invalid opcode. op = %d\n", op));
@@ -32,10 +32,16 @@
 #include "vm_assert.h"
 #include "vm_basic_types.h"
 
+/* Read requests outstanding at once when splitting a large read. */
+#define HGFS_READ_MAX_INFLIGHT 8
 
 
 static int
 HgfsGetOpenFlags(uint32 flags);
+static Bool
+HgfsOpenCacheLookup(const char *path, struct fuse_file_info *fi);
+static void
+HgfsReadaheadRelease(HgfsHandle handle);
 
 
 /*
@@ -482,7 +488,10 @@ int
 HgfsOpen(const char *path,             //IN: Path to a file
             struct fuse_file_info *fi) //OUT: File info structure
 {
-     return HgfsOpenInt(path, fi, 0, HGFS_FILE_OPEN_MASK);
+   if (HgfsOpenCacheLookup(path, fi)) {
+      return 0;
+   }
+   return HgfsOpenInt(path, fi, 0, HGFS_FILE_OPEN_MASK);
 }
 
 
@@ -511,6 +520,429 @@ HgfsCreate(const char *path,          //IN: Path to a file
 }
 
 
+/*
+ * Deferred close of read-only handles.
+ *
+ * Releasing a handle opened read-only without O_CREAT or O_TRUNC parks it
+ * for up to HGFS_DEFAULT_TTL seconds instead of closing it on the host.
+ * A reopen of the same path with the same flags within that window takes
+ * the parked handle and skips the open round trip. At most
+ * HGFS_OPEN_CACHE_MAX handles are parked, the oldest is closed when the
+ * cache is full. Expired handles are closed by a reaper thread. Rename,
+ * delete and setattr close the parked handles of the path and of
+ * everything below it before going to the server.
+ */
+
+#define HGFS_OPEN_CACHE_MAX 32
+
+typedef struct HgfsOpenCacheEntry {
+   struct list_head list;     /* On gHgfsOpenCache, newest first. */
+   char *path;                /* Absolute path of the file. */
+   int flags;                 /* Open flags of the handle. */
+   HgfsHandle handle;         /* Parked server handle. */
+   time_t releaseTime;        /* When the handle was released. */
+} HgfsOpenCacheEntry;
+
+static LIST_HEAD(gHgfsOpenCache);
+static uint32 gHgfsOpenCacheCount;
+static pthread_mutex_t gHgfsOpenCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gHgfsOpenCacheCond = PTHREAD_COND_INITIALIZER;
+static pthread_t gHgfsOpenCacheThread;
+static Bool gHgfsOpenCacheThreadRunning;
+static Bool gHgfsOpenCacheStop;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsOpenCacheCloseList --
+ *
+ *    Closes and frees the entries on a private list.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsOpenCacheCloseList(struct list_head *entries)  // IN: Entries to close
+{
+   struct list_head *cur, *next;
+
+   list_for_each_safe(cur, next, entries) {
+      HgfsOpenCacheEntry *entry = list_entry(cur, HgfsOpenCacheEntry, list);
+
+      list_del(&entry->list);
+      LOG(6, ("Closing parked handle %u of %s\n", entry->handle, entry->path));
+      HgfsRelease(entry->handle);
+      free(entry->path);
+      free(entry);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsOpenCacheReaper --
+ *
+ *    Closes parked handles once they expire.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void *
+HgfsOpenCacheReaper(void *data)  // IN: unused
+{
+   pthread_mutex_lock(&gHgfsOpenCacheLock);
+   while (!gHgfsOpenCacheStop) {
+      struct timespec deadline;
+      struct list_head *cur, *next;
+      LIST_HEAD(expired);
+      time_t now = time(NULL);
+
+      list_for_each_safe(cur, next, &gHgfsOpenCache) {
+         HgfsOpenCacheEntry *entry = list_entry(cur, HgfsOpenCacheEntry, list);
+
+         if (now - entry->releaseTime > HGFS_DEFAULT_TTL) {
+            list_move(&entry->list, &expired);
+            gHgfsOpenCacheCount--;
+         }
+      }
+
+      if (!list_empty(&expired)) {
+         pthread_mutex_unlock(&gHgfsOpenCacheLock);
+         HgfsOpenCacheCloseList(&expired);
+         pthread_mutex_lock(&gHgfsOpenCacheLock);
+      }
+
+      deadline.tv_sec = time(NULL) + HGFS_DEFAULT_TTL;
+      deadline.tv_nsec = 0;
+      pthread_cond_timedwait(&gHgfsOpenCacheCond, &gHgfsOpenCacheLock,
+                             &deadline);
+   }
+   pthread_mutex_unlock(&gHgfsOpenCacheLock);
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsOpenCacheLookup --
+ *
+ *    Takes a parked handle for an open of the path with the given flags.
+ *
+ * Results:
+ *    TRUE and the handle in fi->fh on a hit, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HgfsOpenCacheLookup(const char *path,           // IN: Path to a file
+                    struct fuse_file_info *fi)  // IN/OUT: File info structure
+{
+   struct list_head *cur;
+   time_t now = time(NULL);
+   Bool found = FALSE;
+
+   pthread_mutex_lock(&gHgfsOpenCacheLock);
+   list_for_each(cur, &gHgfsOpenCache) {
+      HgfsOpenCacheEntry *entry = list_entry(cur, HgfsOpenCacheEntry, list);
+
+      if (entry->flags == fi->flags &&
+          now - entry->releaseTime <= HGFS_DEFAULT_TTL &&
+          strcmp(entry->path, path) == 0) {
+         list_del(&entry->list);
+         gHgfsOpenCacheCount--;
+         fi->fh = entry->handle;
+         free(entry->path);
+         free(entry);
+         found = TRUE;
+         break;
+      }
+   }
+   pthread_mutex_unlock(&gHgfsOpenCacheLock);
+
+   if (found) {
+      LOG(4, ("Reusing parked handle %"FMT64"u for %s\n", fi->fh, path));
+   }
+   return found;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsOpenCacheInvalidate --
+ *
+ *    Closes the parked handles of a path and of all paths below it.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsOpenCacheInvalidate(const char *path)  // IN: Path to a file or dir
+{
+   struct list_head *cur, *next;
+   LIST_HEAD(invalid);
+   size_t pathLen = strlen(path);
+
+   pthread_mutex_lock(&gHgfsOpenCacheLock);
+   list_for_each_safe(cur, next, &gHgfsOpenCache) {
+      HgfsOpenCacheEntry *entry = list_entry(cur, HgfsOpenCacheEntry, list);
+
+      if (strncmp(entry->path, path, pathLen) == 0 &&
+          (entry->path[pathLen] == '\0' || entry->path[pathLen] == '/')) {
+         list_move(&entry->list, &invalid);
+         gHgfsOpenCacheCount--;
+      }
+   }
+   pthread_mutex_unlock(&gHgfsOpenCacheLock);
+
+   HgfsOpenCacheCloseList(&invalid);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsOpenCacheExit --
+ *
+ *    Stops the reaper thread and closes all parked handles.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsOpenCacheExit(void)
+{
+   LIST_HEAD(all);
+   Bool joinThread;
+
+   pthread_mutex_lock(&gHgfsOpenCacheLock);
+   gHgfsOpenCacheStop = TRUE;
+   joinThread = gHgfsOpenCacheThreadRunning;
+   gHgfsOpenCacheThreadRunning = FALSE;
+   list_splice_init(&gHgfsOpenCache, &all);
+   gHgfsOpenCacheCount = 0;
+   pthread_cond_signal(&gHgfsOpenCacheCond);
+   pthread_mutex_unlock(&gHgfsOpenCacheLock);
+
+   if (joinThread) {
+      pthread_join(gHgfsOpenCacheThread, NULL);
+   }
+   HgfsOpenCacheCloseList(&all);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReleaseDeferred --
+ *
+ *    Called when the last user of a file closes it. Parks read-only
+ *    handles for reuse, closes all others.
+ *
+ * Results:
+ *    Returns zero on success, or an error on failure.
+ *
+ * Side effects:
+ *    May close the oldest parked handle.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsReleaseDeferred(const char *path,           // IN: Path to a file
+                    struct fuse_file_info *fi)  // IN: File info structure
+{
+   HgfsOpenCacheEntry *entry;
+   LIST_HEAD(evicted);
+
+   if ((fi->flags & O_ACCMODE) != O_RDONLY ||
+       HgfsGetOpenFlags(fi->flags) != HGFS_OPEN) {
+      return HgfsRelease(fi->fh);
+   }
+
+   entry = malloc(sizeof *entry);
+   if (entry == NULL) {
+      return HgfsRelease(fi->fh);
+   }
+   entry->path = strdup(path);
+   if (entry->path == NULL) {
+      free(entry);
+      return HgfsRelease(fi->fh);
+   }
+   entry->flags = fi->flags;
+   entry->handle = fi->fh;
+   entry->releaseTime = time(NULL);
+
+   /* Drop the per handle state, a reopen starts from scratch. */
+   HgfsReadaheadRelease(entry->handle);
+
+   pthread_mutex_lock(&gHgfsOpenCacheLock);
+   if (gHgfsOpenCacheStop) {
+      pthread_mutex_unlock(&gHgfsOpenCacheLock);
+      free(entry->path);
+      free(entry);
+      return HgfsRelease(fi->fh);
+   }
+   if (!gHgfsOpenCacheThreadRunning) {
+      gHgfsOpenCacheThreadRunning =
+         pthread_create(&gHgfsOpenCacheThread, NULL,
+                        HgfsOpenCacheReaper, NULL) == 0;
+   }
+   if (!gHgfsOpenCacheThreadRunning) {
+      /* Without the reaper, parked handles would never expire. */
+      pthread_mutex_unlock(&gHgfsOpenCacheLock);
+      free(entry->path);
+      free(entry);
+      return HgfsRelease(fi->fh);
+   }
+
+   list_add(&entry->list, &gHgfsOpenCache);
+   if (++gHgfsOpenCacheCount > HGFS_OPEN_CACHE_MAX) {
+      list_move(gHgfsOpenCache.prev, &evicted);
+      gHgfsOpenCacheCount--;
+   }
+   pthread_mutex_unlock(&gHgfsOpenCacheLock);
+
+   LOG(6, ("Parked handle %u of %s\n", entry->handle, path));
+   HgfsOpenCacheCloseList(&evicted);
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPackReadRequest --
+ *
+ *    Setup the Read request, depending on the op version.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsPackReadRequest(HgfsHandle handle,  // IN: Handle for this file
+                    size_t count,       // IN: Number of bytes to read
+                    loff_t offset,      // IN: Offset at which to read
+                    HgfsOp opUsed,      // IN: Op to be used
+                    HgfsReq *req)       // IN/OUT: Packet to write into
+{
+   if (opUsed == HGFS_OP_READ_V3) {
+      HgfsRequestReadV3 *requestV3 = HgfsGetRequestPayload(req);
+
+      requestV3->file = handle;
+      requestV3->offset = offset;
+      requestV3->requiredSize = count;
+      requestV3->reserved = 0;
+
+      req->payloadSize = sizeof(*requestV3) + HgfsGetRequestHeaderSize();
+
+   } else {
+      HgfsRequestRead *request;
+
+      request = (HgfsRequestRead *)(HGFS_REQ_PAYLOAD(req));
+      request->file = handle;
+      request->offset = offset;
+      request->requiredSize = count;
+      req->payloadSize = sizeof *request;
+   }
+
+   /* Fill in header here as payloadSize needs to be there. */
+   HgfsPackHeader(req, opUsed);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackReadReply --
+ *
+ *    Copies the data of a successful Read reply into the caller buffer.
+ *
+ * Results:
+ *    Returns the number of bytes read, or -EPROTO for a malformed reply.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsUnpackReadReply(HgfsReq *req,       // IN: Reply packet
+                    HgfsOp opUsed,      // IN: Op used for the request
+                    size_t count,       // IN: Number of bytes requested
+                    char *buf)          // OUT: Buffer to copy data into
+{
+   uint32 actualSize;
+   char *payload;
+
+   if (opUsed == HGFS_OP_READ_V3) {
+      HgfsReplyReadV3 * replyV3 = HgfsGetReplyPayload(req);
+
+      actualSize = replyV3->actualSize;
+      payload = replyV3->payload;
+
+   } else {
+      actualSize = ((HgfsReplyRead *)HGFS_REQ_PAYLOAD(req))->actualSize;
+      payload = ((HgfsReplyRead *)HGFS_REQ_PAYLOAD(req))->payload;
+   }
+
+   /* Sanity check on read size. */
+   if (actualSize > count) {
+      LOG(4, ("Server reply: read too big!\n"));
+      return -EPROTO;
+   }
+
+   if (0 == actualSize) {
+      /* We got no bytes, so don't need to copy to user. */
+      LOG(8, ("Server reply returned zero\n"));
+      return 0;
+   }
+
+   /* Return result. */
+   memcpy(buf, payload, actualSize);
+   LOG(8, ("Copied %u\n", actualSize));
+   return actualSize;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -540,8 +972,6 @@ HgfsDoRead(HgfsHandle handle,  // IN:  Handle for this file
    HgfsReq *req;
    HgfsOp opUsed;
    int result = 0;
-   uint32 actualSize = 0;
-   char *payload = NULL;
    HgfsStatus replyStatus;
 
    ASSERT(NULL != buf);
@@ -557,28 +987,7 @@ HgfsDoRead(HgfsHandle handle,  // IN:  Handle for this file
 
  retry:
    opUsed = hgfsVersionRead;
-   if (opUsed == HGFS_OP_READ_V3) {
-      HgfsRequestReadV3 *requestV3 = HgfsGetRequestPayload(req);
-
-      requestV3->file = handle;
-      requestV3->offset = offset;
-      requestV3->requiredSize = count;
-      requestV3->reserved = 0;
-
-      req->payloadSize = sizeof(*requestV3) + HgfsGetRequestHeaderSize();
-
-   } else {
-      HgfsRequestRead *request;
-
-      request = (HgfsRequestRead *)(HGFS_REQ_PAYLOAD(req));
-      request->file = handle;
-      request->offset = offset;
-      request->requiredSize = count;
-      req->payloadSize = sizeof *request;
-   }
-
-   /* Fill in header here as payloadSize needs to be there. */
-   HgfsPackHeader(req, opUsed);
+   HgfsPackReadRequest(handle, count, offset, opUsed, req);
 
    /* Send the request and process the reply. */
    result = HgfsSendRequest(req);
@@ -587,76 +996,893 @@ HgfsDoRead(HgfsHandle handle,  // IN:  Handle for this file
       replyStatus = HgfsGetReplyStatus(req);
       result = HgfsStatusConvertToLinux(replyStatus);
 
-      switch (result) {
-      case 0:
-         if (opUsed == HGFS_OP_READ_V3) {
-            HgfsReplyReadV3 * replyV3 = HgfsGetReplyPayload(req);
+      switch (result) {
+      case 0:
+         result = HgfsUnpackReadReply(req, opUsed, count, buf);
+         break;
+
+      case -EPROTO:
+         /* Retry with older version(s). Set globally. */
+         if (opUsed == HGFS_OP_READ_V3) {
+            LOG(4, ("Version 3 not supported. Falling back to version 1.\n"));
+            hgfsVersionRead = HGFS_OP_READ;
+            goto retry;
+         }
+         break;
+
+      default:
+         break;
+      }
+   } else if (result == -EIO) {
+      LOG(8, ("Error: send request timed out\n"));
+   } else if (result == -EPROTO) {
+      LOG(4, ("Error: send request server returned error: %d\n", result));
+   } else {
+      LOG(4, ("Error: send request unknown : %d\n", result));
+   }
+
+out:
+   HgfsFreeRequest(req);
+   LOG(4, ("Exit(%d)\n", result));
+   return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDoReadSerial --
+ *
+ *    Reads a range one server request at a time, stopping at the first
+ *    short read.
+ *
+ * Results:
+ *    Returns the number of bytes read, or an error if nothing was read.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ssize_t
+HgfsDoReadSerial(HgfsHandle handle,  // IN:  Handle for this file
+                 char *buf,          // OUT: Buffer to copy data into
+                 size_t count,       // IN:  Number of bytes to read
+                 loff_t offset)      // IN:  Offset at which to read
+{
+   size_t done = 0;
+   int result;
+
+   do {
+      size_t nextCount = MIN(count - done, HGFS_LARGE_IO_MAX);
+
+      LOG(4, ("Issue DoRead(0x%x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
+              handle, nextCount, offset + done));
+      result = HgfsDoRead(handle, buf + done, nextCount, offset + done);
+      if (result < 0) {
+         LOG(8, ("Error: DoRead: -> %d\n", result));
+         break;
+      }
+      done += result;
+   } while (result == HGFS_LARGE_IO_MAX && done < count);
+
+   return done > 0 ? done : result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDoReadMultiple --
+ *
+ *    Reads a range larger than one server request with up to
+ *    HGFS_READ_MAX_INFLIGHT requests outstanding at once. The replies are
+ *    consumed in order, data past a short read or an error is discarded.
+ *    Channels which complete the requests synchronously simply degrade to
+ *    one request at a time.
+ *
+ * Results:
+ *    Returns the number of bytes read, or an error if nothing was read.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ssize_t
+HgfsDoReadMultiple(HgfsHandle handle,  // IN:  Handle for this file
+                   char *buf,          // OUT: Buffer to copy data into
+                   size_t count,       // IN:  Number of bytes to read
+                   loff_t offset)      // IN:  Offset at which to read
+{
+   HgfsReq *reqs[HGFS_READ_MAX_INFLIGHT];
+   size_t chunks[HGFS_READ_MAX_INFLIGHT];
+   size_t done = 0;
+   Bool stop = FALSE;
+   int result = 0;
+
+   if (count <= HGFS_LARGE_IO_MAX || hgfsVersionRead != HGFS_OP_READ_V3) {
+      return HgfsDoReadSerial(handle, buf, count, offset);
+   }
+
+   while (!stop && done < count) {
+      size_t submitted = done;
+      int numReqs = 0;
+      int i;
+
+      while (numReqs < HGFS_READ_MAX_INFLIGHT && submitted < count) {
+         size_t chunk = MIN(count - submitted, HGFS_LARGE_IO_MAX);
+         HgfsReq *req = HgfsGetNewRequest();
+
+         if (req == NULL) {
+            LOG(4, ("Out of memory while getting new request\n"));
+            result = -ENOMEM;
+            break;
+         }
+
+         HgfsPackReadRequest(handle, chunk, offset + submitted,
+                             HGFS_OP_READ_V3, req);
+         result = HgfsSubmitRequest(req);
+         if (result != 0) {
+            HgfsFreeRequest(req);
+            break;
+         }
+         reqs[numReqs] = req;
+         chunks[numReqs] = chunk;
+         numReqs++;
+         submitted += chunk;
+      }
+
+      if (numReqs == 0) {
+         break;
+      }
+      stop = numReqs < HGFS_READ_MAX_INFLIGHT && submitted < count;
+
+      for (i = 0; i < numReqs; i++) {
+         HgfsWaitForReply(reqs[i]);
+         if (!stop) {
+            result = HgfsStatusConvertToLinux(HgfsGetReplyStatus(reqs[i]));
+            if (result == 0) {
+               result = HgfsUnpackReadReply(reqs[i], HGFS_OP_READ_V3,
+                                            chunks[i], buf + done);
+            }
+            if (result < 0) {
+               stop = TRUE;
+            } else {
+               done += result;
+               stop = result < chunks[i];
+            }
+         }
+         HgfsFreeRequest(reqs[i]);
+      }
+   }
+
+   if (done == 0 && result == -EPROTO) {
+      /* The server may not support version 3 reads, let the retry logic decide. */
+      return HgfsDoReadSerial(handle, buf, count, offset);
+   }
+
+   LOG(8, ("Read 0x%"FMTSZ"x of 0x%"FMTSZ"x bytes, result %d\n",
+           done, count, result));
+   return done > 0 ? done : result;
+}
+
+
+/*
+ * Per handle readahead, only kept for handles opened read-only.
+ *
+ * A read which starts where the previous read of the handle ended fetches
+ * HGFS_READAHEAD_SIZE bytes with parallel requests, and the following
+ * sequential reads are served from that buffer. The buffered data is
+ * dropped after HGFS_DEFAULT_TTL seconds, like the attribute cache.
+ */
+
+#define HGFS_READAHEAD_SIZE (HGFS_READ_MAX_INFLIGHT * HGFS_LARGE_IO_MAX)
+#define HGFS_READAHEAD_BUCKETS 64
+
+typedef struct HgfsReadahead {
+   struct list_head list;     /* Hash chain. */
+   HgfsHandle handle;         /* Server file handle. */
+   pthread_mutex_t lock;      /* Protects the fields below. */
+   loff_t nextOffset;         /* Offset expected by a sequential read. */
+   loff_t bufOffset;          /* File offset of the buffered data. */
+   size_t bufLen;             /* Bytes in the buffer. */
+   Bool bufEof;               /* The buffer ends at the end of the file. */
+   time_t fillTime;           /* When the buffer was filled. */
+   char *buf;                 /* HGFS_READAHEAD_SIZE bytes, allocated lazily. */
+} HgfsReadahead;
+
+static struct list_head gHgfsReadaheadTable[HGFS_READAHEAD_BUCKETS];
+static Bool gHgfsReadaheadTableInited;
+static pthread_mutex_t gHgfsReadaheadLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsReadaheadGet --
+ *
+ *    Looks up the readahead state of a handle, creating it if needed.
+ *
+ * Results:
+ *    The readahead state, NULL if out of memory.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsReadahead *
+HgfsReadaheadGet(HgfsHandle handle)  // IN: Handle for this file
+{
+   struct list_head *bucket;
+   struct list_head *cur;
+   HgfsReadahead *ra = NULL;
+   int i;
+
+   pthread_mutex_lock(&gHgfsReadaheadLock);
+   if (!gHgfsReadaheadTableInited) {
+      for (i = 0; i < HGFS_READAHEAD_BUCKETS; i++) {
+         INIT_LIST_HEAD(&gHgfsReadaheadTable[i]);
+      }
+      gHgfsReadaheadTableInited = TRUE;
+   }
+
+   bucket = &gHgfsReadaheadTable[handle % HGFS_READAHEAD_BUCKETS];
+   list_for_each(cur, bucket) {
+      HgfsReadahead *tmp = list_entry(cur, HgfsReadahead, list);
+
+      if (tmp->handle == handle) {
+         ra = tmp;
+         goto out;
+      }
+   }
+
+   ra = malloc(sizeof *ra);
+   if (ra == NULL) {
+      goto out;
+   }
+   memset(ra, 0, sizeof *ra);
+   ra->handle = handle;
+   ra->nextOffset = -1;
+   pthread_mutex_init(&ra->lock, NULL);
+   list_add(&ra->list, bucket);
+
+out:
+   pthread_mutex_unlock(&gHgfsReadaheadLock);
+   return ra;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsReadaheadRelease --
+ *
+ *    Frees the readahead state of a handle being closed.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsReadaheadRelease(HgfsHandle handle)  // IN: Handle for this file
+{
+   struct list_head *cur, *next;
+
+   pthread_mutex_lock(&gHgfsReadaheadLock);
+   if (gHgfsReadaheadTableInited) {
+      list_for_each_safe(cur, next,
+                         &gHgfsReadaheadTable[handle % HGFS_READAHEAD_BUCKETS]) {
+         HgfsReadahead *ra = list_entry(cur, HgfsReadahead, list);
+
+         if (ra->handle == handle) {
+            list_del(&ra->list);
+            pthread_mutex_destroy(&ra->lock);
+            free(ra->buf);
+            free(ra);
+            break;
+         }
+      }
+   }
+   pthread_mutex_unlock(&gHgfsReadaheadLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsReadaheadRead --
+ *
+ *    Serves a read from the readahead buffer of the handle, refilling the
+ *    buffer when the read continues a sequential stream.
+ *
+ * Results:
+ *    TRUE if the read was handled, with the number of bytes read or an
+ *    error in *result. FALSE if the caller should read directly.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsReadaheadRead(HgfsHandle handle,  // IN:  Handle for this file
+                  char *buf,          // OUT: Buffer to copy data into
+                  size_t count,       // IN:  Number of bytes to read
+                  loff_t offset,      // IN:  Offset at which to read
+                  ssize_t *result)    // OUT: Bytes read or error
+{
+   HgfsReadahead *ra;
+   time_t now = time(NULL);
+   Bool handled = FALSE;
+   ssize_t filled;
+   size_t copied;
+
+   ra = HgfsReadaheadGet(handle);
+   if (ra == NULL) {
+      return FALSE;
+   }
+
+   pthread_mutex_lock(&ra->lock);
+
+   if (ra->bufLen > 0 && now - ra->fillTime <= HGFS_DEFAULT_TTL &&
+       offset >= ra->bufOffset && offset <= ra->bufOffset + ra->bufLen) {
+      size_t avail = ra->bufOffset + ra->bufLen - offset;
+
+      if (avail >= count || ra->bufEof) {
+         copied = MIN(avail, count);
+         memcpy(buf, ra->buf + (offset - ra->bufOffset), copied);
+         LOG(8, ("Readahead hit 0x%"FMTSZ"x @ 0x%"FMT64"x\n", copied, offset));
+         ra->nextOffset = offset + copied;
+         *result = copied;
+         handled = TRUE;
+         goto out;
+      }
+   }
+
+   if (offset != ra->nextOffset) {
+      /* Not sequential, remember where a sequential read would start. */
+      ra->nextOffset = offset + count;
+      goto out;
+   }
+
+   if (ra->buf == NULL) {
+      ra->buf = malloc(HGFS_READAHEAD_SIZE);
+      if (ra->buf == NULL) {
+         goto out;
+      }
+   }
+
+   filled = HgfsDoReadMultiple(handle, ra->buf, HGFS_READAHEAD_SIZE, offset);
+   if (filled < 0) {
+      ra->bufLen = 0;
+      *result = filled;
+      handled = TRUE;
+      goto out;
+   }
+
+   ra->bufOffset = offset;
+   ra->bufLen = filled;
+   ra->bufEof = filled < HGFS_READAHEAD_SIZE;
+   ra->fillTime = now;
+
+   copied = MIN((size_t)filled, count);
+   memcpy(buf, ra->buf, copied);
+   LOG(8, ("Readahead fill 0x%"FMTSZ"x @ 0x%"FMT64"x\n", ra->bufLen, offset));
+   ra->nextOffset = offset + copied;
+   *result = copied;
+   handled = TRUE;
+
+out:
+   pthread_mutex_unlock(&ra->lock);
+   return handled;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsRead --
+ *
+ *    Called whenever a process reads from a file in our filesystem.
+ *
+ * Results:
+ *    Returns the number of bytes read on success, or an error on
+ *    failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+ssize_t
+HgfsRead(struct fuse_file_info *fi,  // IN:  File info struct
+         char  *buf,                 // OUT: User buffer to copy data into
+         size_t count,               // IN:  Number of bytes to read
+         loff_t offset)              // IN:  Offset at which to read
+{
+   ssize_t result;
+
+   ASSERT(NULL != fi);
+   ASSERT(NULL != buf);
+
+   LOG(4, ("Entry(0x%"FMT64"x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
+           fi->fh, count, offset));
+
+   if (gState->writebackCache && (fi->flags & O_ACCMODE) != O_RDONLY) {
+      result = HgfsWritebackFlush(fi->fh);
+      if (result < 0) {
+         goto out;
+      }
+   }
+
+   if ((fi->flags & O_ACCMODE) != O_RDONLY ||
+       count >= HGFS_READAHEAD_SIZE ||
+       !HgfsReadaheadRead(fi->fh, buf, count, offset, &result)) {
+      result = HgfsDoReadMultiple(fi->fh, buf, count, offset);
+   }
+
+   if (result >= 0) {
+      memset(buf + result, 0, count - result);
+   }
+
+out:
+   LOG(4, ("Exit(%"FMTSZ"d)\n", result));
+   return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDoWrite --
+ *
+ *    Do one write request. Called by HgfsWrite, possibly multiple
+ *    times if the size of the write is too big to be handled by one server
+ *    request.
+ *
+ *    We send a "Write" request to the server with the given handle.
+ *
+ * Results:
+ *    Returns the number of bytes written on success, or an error on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsDoWrite(HgfsHandle handle,       // IN: Handle for the file
+            const char *buf,         // IN: Buffer containing data
+            size_t count,            // IN: Number of bytes to write
+            loff_t offset)           // IN: Offset to begin writing at
+{
+   HgfsReq *req;
+   int result = 0;
+   HgfsOp opUsed;
+   uint32 requiredSize = 0;
+   uint32 actualSize = 0;
+   char *payload = NULL;
+   uint32 reqSize;
+   HgfsStatus replyStatus;
+
+   ASSERT(buf);
+
+   req = HgfsGetNewRequest();
+   if (!req) {
+      LOG(4, ("Out of memory while getting new request\n"));
+      result = -ENOMEM;
+      goto out;
+   }
+   LOG( 4,("handle = %u \n", handle));
+ retry:
+   opUsed = hgfsVersionWrite;
+   if (opUsed == HGFS_OP_WRITE_V3) {
+      HgfsRequestWriteV3 *requestV3 = HgfsGetRequestPayload(req);
+
+      requestV3->file = handle;
+      requestV3->flags = 0;
+      requestV3->offset = offset;
+      requestV3->requiredSize = count;
+      requestV3->reserved = 0;
+      payload = requestV3->payload;
+      requiredSize = requestV3->requiredSize;
+      reqSize = sizeof(*requestV3) + HgfsGetRequestHeaderSize();
+
+   } else {
+      HgfsRequestWrite *request;
+
+      request = (HgfsRequestWrite *)(HGFS_REQ_PAYLOAD(req));
+      request->file = handle;
+      request->flags = 0;
+      request->offset = offset;
+      request->requiredSize = count;
+      payload = request->payload;
+      requiredSize = request->requiredSize;
+      reqSize = sizeof *request;
+   }
+
+   memcpy(payload, buf, requiredSize);
+   req->payloadSize = reqSize + requiredSize - 1;
+
+   /* Fill in header here as payloadSize needs to be there. */
+   HgfsPackHeader(req, opUsed);
+
+   /* Send the request and process the reply. */
+   result = HgfsSendRequest(req);
+   if (result == 0) {
+      /* Get the reply. */
+      replyStatus = HgfsGetReplyStatus(req);
+      result = HgfsStatusConvertToLinux(replyStatus);
+
+      switch (result) {
+      case 0:
+         if (opUsed == HGFS_OP_WRITE_V3) {
+            HgfsReplyWriteV3 * replyV3 = HgfsGetReplyPayload(req);
+
+            actualSize = replyV3->actualSize;
+
+         } else {
+            actualSize = ((HgfsReplyWrite *)HGFS_REQ_PAYLOAD(req))->actualSize;
+         }
+
+         /* Return result. */
+         LOG(6, ("wrote %u bytes\n", actualSize));
+         result = actualSize;
+         break;
+
+      case -EPROTO:
+         /* Retry with older version(s). Set globally. */
+         if (opUsed == HGFS_OP_WRITE_V3) {
+            LOG(4, ("Version 3 not supported. Falling back to version 1.\n"));
+            hgfsVersionWrite = HGFS_OP_WRITE;
+            goto retry;
+         }
+         break;
+
+      default:
+         LOG(4, ("Server returned error: %d\n", result));
+         break;
+      }
+   } else if (result == -EIO) {
+      LOG(8, ("Timed out. error: %d\n", result));
+   } else if (result == -EPROTO) {
+      LOG(4, ("Server returned error: %d\n", result));
+   } else {
+      LOG(4, ("Unknown error: %d\n", result));
+   }
+
+out:
+   HgfsFreeRequest(req);
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsDoWriteRange --
+ *
+ *    Writes a range, splitting it into server sized requests.
+ *
+ * Results:
+ *    Returns the number of bytes written on success, or an error on
+ *    failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static ssize_t
+HgfsDoWriteRange(HgfsHandle handle,   // IN: Handle for the file
+                 const char *buf,     // IN: Buffer containing data
+                 size_t count,        // IN: Number of bytes to write
+                 loff_t offset)       // IN: Offset to begin writing at
+{
+   int result;
+   const char *buffer = buf;
+   loff_t curOffset = offset;
+   size_t nextCount, remainingCount = count;
+
+   do {
+      nextCount = (remainingCount > HGFS_LARGE_IO_MAX) ?
+                                     HGFS_LARGE_IO_MAX : remainingCount;
+
+      LOG(4, ("Issue DoWrite(0x%x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
+              handle, nextCount, curOffset));
+
+      result = HgfsDoWrite(handle, buffer, nextCount, curOffset);
+      if (result < 0) {
+         LOG(4, ("Error: DoWrite -> %d\n", result));
+         return result;
+      }
+      remainingCount -= result;
+      curOffset += result;
+      buffer += result;
+
+   } while ((result > 0) && (remainingCount > 0));
+
+   return count - remainingCount;
+}
+
+
+/*
+ * Write coalescing, enabled with the writeback_cache mount option.
+ *
+ * Each handle buffers one dirty range of up to HGFS_LARGE_IO_MAX bytes.
+ * Writes which extend or overwrite that range are absorbed, anything else
+ * flushes it first. The range is flushed when full, on flush/fsync and
+ * release of the handle, before operations on the path which need the
+ * server to see the data, and by a background thread once it has been
+ * dirty for HGFS_WRITEBACK_DELAY seconds. Errors of background flushes
+ * are reported by the next write or flush of the handle.
+ *
+ * Lock order is gHgfsWritebackLock, then the lock of an entry. Entries
+ * are only freed by HgfsWritebackRelease, which FUSE never runs
+ * concurrently with another operation on the same handle.
+ */
+
+#define HGFS_WRITEBACK_BUCKETS 64
+#define HGFS_WRITEBACK_DELAY 1
+
+typedef struct HgfsWriteback {
+   struct list_head list;     /* Hash chain. */
+   HgfsHandle handle;         /* Server file handle. */
+   char *path;                /* Absolute path the handle was opened with. */
+   pthread_mutex_t lock;      /* Protects the fields below. */
+   loff_t offset;             /* File offset of the dirty range. */
+   size_t len;                /* Bytes in the dirty range. */
+   time_t dirtyTime;          /* When the range became dirty. */
+   int error;                 /* Pending error of a background flush. */
+   char buf[HGFS_LARGE_IO_MAX];
+} HgfsWriteback;
+
+static struct list_head gHgfsWritebackTable[HGFS_WRITEBACK_BUCKETS];
+static pthread_mutex_t gHgfsWritebackLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gHgfsWritebackCond = PTHREAD_COND_INITIALIZER;
+static pthread_t gHgfsWritebackThread;
+static Bool gHgfsWritebackRunning;
+static Bool gHgfsWritebackStop;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWritebackFlushLocked --
+ *
+ *    Sends the dirty range of an entry to the server. The entry lock
+ *    must be held.
+ *
+ * Results:
+ *    Returns zero on success, or an error on failure.
+ *
+ * Side effects:
+ *    The dirty range is dropped even on failure.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsWritebackFlushLocked(HgfsWriteback *wb)  // IN/OUT: Entry to flush
+{
+   ssize_t written;
+   int result = 0;
+
+   if (wb->len > 0) {
+      LOG(6, ("Flush handle %u 0x%"FMTSZ"x bytes @ 0x%"FMT64"x\n",
+              wb->handle, wb->len, wb->offset));
+      written = HgfsDoWriteRange(wb->handle, wb->buf, wb->len, wb->offset);
+      if (written < 0) {
+         result = written;
+      } else if ((size_t)written < wb->len) {
+         result = -EIO;
+      }
+      wb->len = 0;
+   }
+
+   if (result == 0) {
+      result = wb->error;
+   }
+   wb->error = 0;
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWritebackFind --
+ *
+ *    Looks up the entry of a handle. gHgfsWritebackLock must be held.
+ *
+ * Results:
+ *    The entry, NULL if the handle has none.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsWriteback *
+HgfsWritebackFind(HgfsHandle handle)  // IN: Handle for the file
+{
+   struct list_head *cur;
+
+   if (!gHgfsWritebackRunning) {
+      return NULL;
+   }
+
+   list_for_each(cur, &gHgfsWritebackTable[handle % HGFS_WRITEBACK_BUCKETS]) {
+      HgfsWriteback *wb = list_entry(cur, HgfsWriteback, list);
+
+      if (wb->handle == handle) {
+         return wb;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWritebackThread --
+ *
+ *    Flushes dirty ranges which have been buffered for too long.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void *
+HgfsWritebackThread(void *data)  // IN: unused
+{
+   pthread_mutex_lock(&gHgfsWritebackLock);
+   while (!gHgfsWritebackStop) {
+      struct timespec deadline;
+      time_t now = time(NULL);
+      int i;
+
+      for (i = 0; i < HGFS_WRITEBACK_BUCKETS; i++) {
+         struct list_head *cur;
+
+         list_for_each(cur, &gHgfsWritebackTable[i]) {
+            HgfsWriteback *wb = list_entry(cur, HgfsWriteback, list);
+
+            pthread_mutex_lock(&wb->lock);
+            if (wb->len > 0 && now - wb->dirtyTime >= HGFS_WRITEBACK_DELAY) {
+               int error = HgfsWritebackFlushLocked(wb);
+
+               wb->error = error;
+            }
+            pthread_mutex_unlock(&wb->lock);
+         }
+      }
+
+      deadline.tv_sec = time(NULL) + HGFS_WRITEBACK_DELAY;
+      deadline.tv_nsec = 0;
+      pthread_cond_timedwait(&gHgfsWritebackCond, &gHgfsWritebackLock,
+                             &deadline);
+   }
+   pthread_mutex_unlock(&gHgfsWritebackLock);
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWritebackInit --
+ *
+ *    Enables write coalescing and starts the background flush thread.
+ *
+ * Results:
+ *    Returns zero on success, or an error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsWritebackInit(void)
+{
+   int i;
+   int res;
+
+   for (i = 0; i < HGFS_WRITEBACK_BUCKETS; i++) {
+      INIT_LIST_HEAD(&gHgfsWritebackTable[i]);
+   }
+
+   gHgfsWritebackStop = FALSE;
+   res = pthread_create(&gHgfsWritebackThread, NULL, HgfsWritebackThread, NULL);
+   if (res != 0) {
+      LOG(4, ("Failed to create the writeback thread: %d\n", res));
+      return -res;
+   }
+   gHgfsWritebackRunning = TRUE;
+   return 0;
+}
 
-            actualSize = replyV3->actualSize;
-            payload = replyV3->payload;
 
-         } else {
-            actualSize = ((HgfsReplyRead *)HGFS_REQ_PAYLOAD(req))->actualSize;
-            payload = ((HgfsReplyRead *)HGFS_REQ_PAYLOAD(req))->payload;
-         }
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWritebackExit --
+ *
+ *    Stops the background flush thread and writes out all dirty data.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
 
-         /* Sanity check on read size. */
-         if (actualSize > count) {
-            LOG(4, ("Server reply: read too big!\n"));
-            result = -EPROTO;
-            goto out;
-         }
+void
+HgfsWritebackExit(void)
+{
+   int i;
 
-         if (0 == actualSize) {
-            /* We got no bytes, so don't need to copy to user. */
-            LOG(8, ("Server reply returned zero\n"));
-            result = actualSize;
-            goto out;
-         }
+   if (!gHgfsWritebackRunning) {
+      return;
+   }
 
-         /* Return result. */
-         memcpy(buf, payload, actualSize);
-         LOG(8, ("Copied %u\n", actualSize));
-         result = actualSize;
-         break;
+   pthread_mutex_lock(&gHgfsWritebackLock);
+   gHgfsWritebackStop = TRUE;
+   pthread_cond_signal(&gHgfsWritebackCond);
+   pthread_mutex_unlock(&gHgfsWritebackLock);
+   pthread_join(gHgfsWritebackThread, NULL);
 
-      case -EPROTO:
-         /* Retry with older version(s). Set globally. */
-         if (opUsed == HGFS_OP_READ_V3) {
-            LOG(4, ("Version 3 not supported. Falling back to version 1.\n"));
-            hgfsVersionRead = HGFS_OP_READ;
-            goto retry;
-         }
-         break;
+   pthread_mutex_lock(&gHgfsWritebackLock);
+   for (i = 0; i < HGFS_WRITEBACK_BUCKETS; i++) {
+      struct list_head *cur;
 
-      default:
-         break;
+      list_for_each(cur, &gHgfsWritebackTable[i]) {
+         HgfsWriteback *wb = list_entry(cur, HgfsWriteback, list);
+
+         pthread_mutex_lock(&wb->lock);
+         HgfsWritebackFlushLocked(wb);
+         pthread_mutex_unlock(&wb->lock);
       }
-   } else if (result == -EIO) {
-      LOG(8, ("Error: send request timed out\n"));
-   } else if (result == -EPROTO) {
-      LOG(4, ("Error: send request server returned error: %d\n", result));
-   } else {
-      LOG(4, ("Error: send request unknown : %d\n", result));
    }
-
-out:
-   HgfsFreeRequest(req);
-   LOG(4, ("Exit(%d)\n", result));
-   return result;
+   pthread_mutex_unlock(&gHgfsWritebackLock);
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsRead --
+ * HgfsWritebackFlush --
  *
- *    Called whenever a process reads from a file in our filesystem.
+ *    Writes out the dirty range of a handle.
  *
  * Results:
- *    Returns the number of bytes read on success, or an error on
- *    failure.
+ *    Returns zero on success, or an error on failure, including the
+ *    error of an earlier background flush.
  *
  * Side effects:
  *    None
@@ -664,171 +1890,214 @@ out:
  *----------------------------------------------------------------------
  */
 
-ssize_t
-HgfsRead(struct fuse_file_info *fi,  // IN:  File info struct
-         char  *buf,                 // OUT: User buffer to copy data into
-         size_t count,               // IN:  Number of bytes to read
-         loff_t offset)              // IN:  Offset at which to read
+int
+HgfsWritebackFlush(HgfsHandle handle)  // IN: Handle for the file
 {
+   HgfsWriteback *wb;
    int result = 0;
-   char *buffer = buf;
-   loff_t curOffset = offset;
-   size_t nextCount, remainingCount = count;
 
-   ASSERT(NULL != fi);
-   ASSERT(NULL != buf);
-
-   LOG(4, ("Entry(0x%"FMT64"x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
-           fi->fh, count, offset));
+   pthread_mutex_lock(&gHgfsWritebackLock);
+   wb = HgfsWritebackFind(handle);
+   pthread_mutex_unlock(&gHgfsWritebackLock);
 
-    do {
-      nextCount = (remainingCount > HGFS_LARGE_IO_MAX) ?
-                                     HGFS_LARGE_IO_MAX : remainingCount;
-      LOG(4, ("Issue DoRead(0x%"FMT64"x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
-              fi->fh, nextCount, curOffset));
-      result = HgfsDoRead(fi->fh, buffer, nextCount, curOffset);
-      if (result < 0) {
-         LOG(8, ("Error: DoRead: -> %d\n", result));
-         goto out;
-      }
-      remainingCount -= result;
-      curOffset += result;
-      buffer += result;
+   if (wb != NULL) {
+      pthread_mutex_lock(&wb->lock);
+      result = HgfsWritebackFlushLocked(wb);
+      pthread_mutex_unlock(&wb->lock);
+   }
+   return result;
+}
 
-   } while ((result > 0) && (remainingCount > 0));
 
-  memset(buffer, 0, remainingCount);
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWritebackFlushPath --
+ *
+ *    Writes out the dirty ranges of all handles open on a path, so
+ *    that the server sees the data before an operation on the path.
+ *
+ * Results:
+ *    Returns zero on success, or an error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
 
-  out:
-   LOG(4, ("Exit(%"FMTSZ"d)\n", count - remainingCount));
-   return (count - remainingCount);
+int
+HgfsWritebackFlushPath(const char *path)  // IN: Absolute path of the file
+{
+   int result = 0;
+   int i;
+
+   pthread_mutex_lock(&gHgfsWritebackLock);
+   if (gHgfsWritebackRunning) {
+      for (i = 0; i < HGFS_WRITEBACK_BUCKETS; i++) {
+         struct list_head *cur;
+
+         list_for_each(cur, &gHgfsWritebackTable[i]) {
+            HgfsWriteback *wb = list_entry(cur, HgfsWriteback, list);
+
+            if (strcmp(wb->path, path) == 0) {
+               pthread_mutex_lock(&wb->lock);
+               if (wb->len > 0) {
+                  int error = HgfsWritebackFlushLocked(wb);
+
+                  /* Keep the error for the owner of the handle too. */
+                  wb->error = error;
+                  if (result == 0) {
+                     result = error;
+                  }
+               }
+               pthread_mutex_unlock(&wb->lock);
+            }
+         }
+      }
+   }
+   pthread_mutex_unlock(&gHgfsWritebackLock);
+   return result;
 }
 
 
 /*
- *-----------------------------------------------------------------------------
- *
- * HgfsDoWrite --
+ *----------------------------------------------------------------------
  *
- *    Do one write request. Called by HgfsWrite, possibly multiple
- *    times if the size of the write is too big to be handled by one server
- *    request.
+ * HgfsWritebackRelease --
  *
- *    We send a "Write" request to the server with the given handle.
+ *    Writes out and frees the write coalescing state of a handle
+ *    being closed.
  *
  * Results:
- *    Returns the number of bytes written on success, or an error on failure.
+ *    Returns zero on success, or an error on failure.
  *
  * Side effects:
- *    None.
+ *    None
  *
- *-----------------------------------------------------------------------------
+ *----------------------------------------------------------------------
  */
 
 static int
-HgfsDoWrite(HgfsHandle handle,       // IN: Handle for the file
-            const char *buf,         // IN: Buffer containing data
-            size_t count,            // IN: Number of bytes to write
-            loff_t offset)           // IN: Offset to begin writing at
+HgfsWritebackRelease(HgfsHandle handle)  // IN: Handle for the file
 {
-   HgfsReq *req;
+   HgfsWriteback *wb;
    int result = 0;
-   HgfsOp opUsed;
-   uint32 requiredSize = 0;
-   uint32 actualSize = 0;
-   char *payload = NULL;
-   uint32 reqSize;
-   HgfsStatus replyStatus;
 
-   ASSERT(buf);
-
-   req = HgfsGetNewRequest();
-   if (!req) {
-      LOG(4, ("Out of memory while getting new request\n"));
-      result = -ENOMEM;
-      goto out;
+   pthread_mutex_lock(&gHgfsWritebackLock);
+   wb = HgfsWritebackFind(handle);
+   if (wb != NULL) {
+      list_del(&wb->list);
    }
-   LOG( 4,("handle = %u \n", handle));
- retry:
-   opUsed = hgfsVersionWrite;
-   if (opUsed == HGFS_OP_WRITE_V3) {
-      HgfsRequestWriteV3 *requestV3 = HgfsGetRequestPayload(req);
-
-      requestV3->file = handle;
-      requestV3->flags = 0;
-      requestV3->offset = offset;
-      requestV3->requiredSize = count;
-      requestV3->reserved = 0;
-      payload = requestV3->payload;
-      requiredSize = requestV3->requiredSize;
-      reqSize = sizeof(*requestV3) + HgfsGetRequestHeaderSize();
-
-   } else {
-      HgfsRequestWrite *request;
-
-      request = (HgfsRequestWrite *)(HGFS_REQ_PAYLOAD(req));
-      request->file = handle;
-      request->flags = 0;
-      request->offset = offset;
-      request->requiredSize = count;
-      payload = request->payload;
-      requiredSize = request->requiredSize;
-      reqSize = sizeof *request;
+   pthread_mutex_unlock(&gHgfsWritebackLock);
+
+   if (wb != NULL) {
+      pthread_mutex_lock(&wb->lock);
+      result = HgfsWritebackFlushLocked(wb);
+      pthread_mutex_unlock(&wb->lock);
+      pthread_mutex_destroy(&wb->lock);
+      free(wb->path);
+      free(wb);
    }
+   return result;
+}
 
-   memcpy(payload, buf, requiredSize);
-   req->payloadSize = reqSize + requiredSize - 1;
-
-   /* Fill in header here as payloadSize needs to be there. */
-   HgfsPackHeader(req, opUsed);
 
-   /* Send the request and process the reply. */
-   result = HgfsSendRequest(req);
-   if (result == 0) {
-      /* Get the reply. */
-      replyStatus = HgfsGetReplyStatus(req);
-      result = HgfsStatusConvertToLinux(replyStatus);
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWritebackWrite --
+ *
+ *    Tries to absorb a write into the dirty range of the handle.
+ *
+ * Results:
+ *    TRUE if the write was handled, with the number of bytes written or
+ *    an error in *result. FALSE if the caller should write directly.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
 
-      switch (result) {
-      case 0:
-         if (opUsed == HGFS_OP_WRITE_V3) {
-            HgfsReplyWriteV3 * replyV3 = HgfsGetReplyPayload(req);
+static Bool
+HgfsWritebackWrite(const char *path,    // IN: Absolute path of the file
+                   HgfsHandle handle,   // IN: Handle for the file
+                   const char *buf,     // IN: Buffer containing data
+                   size_t count,        // IN: Number of bytes to write
+                   loff_t offset,       // IN: Offset to begin writing at
+                   ssize_t *result)     // OUT: Bytes written or error
+{
+   HgfsWriteback *wb;
+   int error;
+
+   pthread_mutex_lock(&gHgfsWritebackLock);
+   wb = HgfsWritebackFind(handle);
+   if (wb == NULL && count < HGFS_LARGE_IO_MAX) {
+      wb = malloc(sizeof *wb);
+      if (wb != NULL) {
+         wb->path = strdup(path);
+         if (wb->path == NULL) {
+            free(wb);
+            wb = NULL;
+         }
+      }
+      if (wb != NULL) {
+         wb->handle = handle;
+         wb->len = 0;
+         wb->error = 0;
+         pthread_mutex_init(&wb->lock, NULL);
+         list_add(&wb->list,
+                  &gHgfsWritebackTable[handle % HGFS_WRITEBACK_BUCKETS]);
+      }
+   }
+   pthread_mutex_unlock(&gHgfsWritebackLock);
 
-            actualSize = replyV3->actualSize;
+   if (wb == NULL) {
+      return FALSE;
+   }
 
-         } else {
-            actualSize = ((HgfsReplyWrite *)HGFS_REQ_PAYLOAD(req))->actualSize;
-         }
+   pthread_mutex_lock(&wb->lock);
 
-         /* Return result. */
-         LOG(6, ("wrote %u bytes\n", actualSize));
-         result = actualSize;
-         break;
+   if (wb->error != 0) {
+      *result = wb->error;
+      wb->error = 0;
+      goto out;
+   }
 
-      case -EPROTO:
-         /* Retry with older version(s). Set globally. */
-         if (opUsed == HGFS_OP_WRITE_V3) {
-            LOG(4, ("Version 3 not supported. Falling back to version 1.\n"));
-            hgfsVersionWrite = HGFS_OP_WRITE;
-            goto retry;
-         }
-         break;
+   if (wb->len > 0 && offset >= wb->offset &&
+       offset <= wb->offset + wb->len &&
+       offset + count <= wb->offset + HGFS_LARGE_IO_MAX) {
+      /* Extends or overwrites the dirty range. */
+      memcpy(wb->buf + (offset - wb->offset), buf, count);
+      wb->len = MAX(wb->len, offset + count - wb->offset);
+   } else {
+      error = HgfsWritebackFlushLocked(wb);
+      if (error != 0) {
+         *result = error;
+         goto out;
+      }
+      if (count >= HGFS_LARGE_IO_MAX) {
+         *result = HgfsDoWriteRange(handle, buf, count, offset);
+         goto out;
+      }
+      memcpy(wb->buf, buf, count);
+      wb->offset = offset;
+      wb->len = count;
+      wb->dirtyTime = time(NULL);
+   }
 
-      default:
-         LOG(4, ("Server returned error: %d\n", result));
-         break;
+   *result = count;
+   if (wb->len == HGFS_LARGE_IO_MAX) {
+      error = HgfsWritebackFlushLocked(wb);
+      if (error != 0) {
+         *result = error;
       }
-   } else if (result == -EIO) {
-      LOG(8, ("Timed out. error: %d\n", result));
-   } else if (result == -EPROTO) {
-      LOG(4, ("Server returned error: %d\n", result));
-   } else {
-      LOG(4, ("Unknown error: %d\n", result));
    }
 
 out:
-   HgfsFreeRequest(req);
-   return result;
+   pthread_mutex_unlock(&wb->lock);
+   return TRUE;
 }
 
 
@@ -850,16 +2119,13 @@ out:
  */
 
 ssize_t
-HgfsWrite(struct fuse_file_info *fi,  // IN: File info structure
-         const char  *buf,            // OUT: User buffer to copy data into
-         size_t count,                // IN:  Number of bytes to read
-         loff_t offset)               // IN:  Offset at which to read
+HgfsWrite(const char *path,           // IN: Absolute path of the file
+          struct fuse_file_info *fi,  // IN: File info structure
+          const char  *buf,           // IN: User buffer to copy data from
+          size_t count,               // IN: Number of bytes to write
+          loff_t offset)              // IN: Offset at which to write
 {
-   int result;
-   const char *buffer = buf;
-   loff_t curOffset = offset;
-   size_t nextCount, remainingCount = count;
-   ssize_t bytesWritten = 0;
+   ssize_t bytesWritten;
 
    ASSERT(NULL != buf);
    ASSERT(NULL != fi);
@@ -867,28 +2133,11 @@ HgfsWrite(struct fuse_file_info *fi,  // IN: File info structure
    LOG(6, ("Entry(0x%"FMT64"x off bytes 0x%"FMTSZ"x @ 0x%"FMT64"x)\n",
            fi->fh, count, offset));
 
-   do {
-      nextCount = (remainingCount > HGFS_LARGE_IO_MAX) ?
-                                     HGFS_LARGE_IO_MAX : remainingCount;
-
-      LOG(4, ("Issue DoWrite(0x%"FMT64"x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
-              fi->fh, nextCount, curOffset));
-
-      result = HgfsDoWrite(fi->fh, buffer, nextCount, curOffset);
-      if (result < 0) {
-         bytesWritten = result;
-         LOG(4, ("Error: DoWrite -> %d\n", result));
-         goto out;
-      }
-      remainingCount -= result;
-      curOffset += result;
-      buffer += result;
-
-   } while ((result > 0) && (remainingCount > 0));
-
-   bytesWritten = count - remainingCount;
+   if (!gState->writebackCache ||
+       !HgfsWritebackWrite(path, fi->fh, buf, count, offset, &bytesWritten)) {
+      bytesWritten = HgfsDoWriteRange(fi->fh, buf, count, offset);
+   }
 
-out:
    LOG(6, ("Exit(0x%"FMTSZ"x)\n", bytesWritten));
    return bytesWritten;
 }
@@ -929,6 +2178,10 @@ HgfsRename(const char* from, const char* to)
    ASSERT(from);
    ASSERT(to);
 
+   /* Parked handles would keep the old names alive on the host. */
+   HgfsOpenCacheInvalidate(from);
+   HgfsOpenCacheInvalidate(to);
+
    req = HgfsGetNewRequest();
    if (!req) {
       LOG(4, ("Out of memory while getting new request\n"));
@@ -1333,6 +2586,8 @@ HgfsSetattr(const char* path,       //IN: Path to file
 
    LOG(4, ("Entry(%s)\n", path));
 
+   HgfsOpenCacheInvalidate(path);
+
    req = HgfsGetNewRequest();
    if (!req) {
       result = -ENOMEM;
@@ -1410,6 +2665,11 @@ HgfsRelease(HgfsHandle handle)  //IN:File handle to close
 
    LOG(6, ("Entry(handle = %u)\n", handle));
 
+   HgfsReadaheadRelease(handle);
+   if (gState->writebackCache) {
+      HgfsWritebackRelease(handle);
+   }
+
    req = HgfsGetNewRequest();
    if (!req) {
       LOG(4, ("Out of memory while getting new request\n"));
@@ -41,5 +41,8 @@
 
 /* Public functions (with respect to the entire module). */
 int HgfsRelease(HgfsHandle handle);
+int HgfsReleaseDeferred(const char *path, struct fuse_file_info *fi);
+void HgfsOpenCacheInvalidate(const char *path);
+void HgfsOpenCacheExit(void);
 
 #endif // _HGFS_DRIVER_FILE_H_
@@ -47,6 +47,15 @@ typedef struct HgfsFuseState {
 
    GKeyFile *conf;
 
+   /* Coalesce small writes per handle, see HgfsWritebackWrite. */
+   Bool writebackCache;
+
+   /* Serve the statistics control file, see stats.h. */
+   Bool statsFile;
+
+   /* Try the vsock channel before the backdoor, see vsockhandler.c. */
+   Bool vsockChannel;
+
 } HgfsFuseState;
 
 /* Public functions (with respect to the entire module). */
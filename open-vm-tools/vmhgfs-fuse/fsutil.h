@@ -70,11 +70,24 @@ HgfsRestoreReadOnly(const char* path,
                     HgfsAttrInfo *enableWrite);
 
 ssize_t
-HgfsWrite(struct fuse_file_info *fi,
+HgfsWrite(const char *path,
+          struct fuse_file_info *fi,
           const char  *buf,
           size_t count,
           loff_t offset);
 
+int
+HgfsWritebackInit(void);
+
+void
+HgfsWritebackExit(void);
+
+int
+HgfsWritebackFlush(HgfsHandle handle);
+
+int
+HgfsWritebackFlushPath(const char *path);
+
 int
 HgfsRename(const char* from, const char* to);
 
@@ -120,7 +133,8 @@ int
 HgfsDirOpen(const char* path, HgfsHandle* handle);
 
 int
-HgfsReaddir(HgfsHandle handle,
+HgfsReaddir(const char *path,
+            HgfsHandle handle,
             void *dirent,
             fuse_fill_dir_t filldir);
 
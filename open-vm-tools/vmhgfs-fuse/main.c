@@ -30,6 +30,8 @@
 #include "cache.h"
 #include "filesystem.h"
 #include "file.h"
+#include "stats.h"
+#include "notify.h"
 
 /*
  *----------------------------------------------------------------------
@@ -103,6 +105,54 @@ freeAbsPath(char *abspath)  // IN
 }
 
 
+/*
+ * The statistics control file, see stats.h. It only exists when mounted
+ * with -o stats_file, and hides a host entry with the same name.
+ */
+
+#define STATS_PATH_NONE 0
+#define STATS_PATH_DIR  1
+#define STATS_PATH_FILE 2
+
+typedef struct StatsSnapshot {
+   char *buf;
+   size_t len;
+} StatsSnapshot;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * getStatsPathType
+ *
+ *    Checks whether a mount relative path names the statistics control
+ *    directory or file.
+ *
+ * Results:
+ *    STATS_PATH_DIR, STATS_PATH_FILE or STATS_PATH_NONE.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+getStatsPathType(const char *path)  // IN
+{
+   if (!gState->statsFile) {
+      return STATS_PATH_NONE;
+   }
+   if (strcmp(path, HGFS_STATS_DIR_PATH) == 0) {
+      return STATS_PATH_DIR;
+   }
+   if (strcmp(path, HGFS_STATS_FILE_PATH) == 0) {
+      return STATS_PATH_FILE;
+   }
+   return STATS_PATH_NONE;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -123,6 +173,7 @@ static int
 hgfs_getattr(const char *path,    //IN: path of a file/directory
              struct stat *stbuf)  //IN/OUT: file/directoy attribute
 {
+   uint64 startTime = HgfsStatsOpStart();
    HgfsHandle fileHandle = HGFS_INVALID_HANDLE;
    HgfsAttrInfo newAttr = {0};
    HgfsAttrInfo *attr = &newAttr;
@@ -131,6 +182,25 @@ hgfs_getattr(const char *path,    //IN: path of a file/directory
    int res;
 
    LOG(4, ("Entry(path = %s)\n", path));
+
+   switch (getStatsPathType(path)) {
+   case STATS_PATH_DIR:
+      memset(stbuf, 0, sizeof *stbuf);
+      stbuf->st_mode = S_IFDIR | 0555;
+      stbuf->st_nlink = 2;
+      res = 0;
+      goto exit;
+   case STATS_PATH_FILE:
+      /* Size zero, the file is opened with direct_io. */
+      memset(stbuf, 0, sizeof *stbuf);
+      stbuf->st_mode = S_IFREG | 0444;
+      stbuf->st_nlink = 1;
+      res = 0;
+      goto exit;
+   default:
+      break;
+   }
+
    res = getAbsPath(path, &abspath);
    if (res < 0) {
       goto exit;
@@ -138,12 +208,19 @@ hgfs_getattr(const char *path,    //IN: path of a file/directory
 
    res = HgfsGetAttrCache(abspath, attr);
    LOG(4, ("Retrieve attr from cache. result = %d \n", res));
-   if (res != 0) {
+   if (res != 0 && res != -ENOENT) {
+      /* Let the server see buffered writes before asking it for the size. */
+      if (gState->writebackCache) {
+         HgfsWritebackFlushPath(abspath);
+      }
+
       /* Retrieve new complete attribute settings and update the cache. */
       res = HgfsPrivateGetattr(fileHandle, abspath, attr);
       LOG(4, ("Retrieve attr from server. result = %d \n", res));
       if (res == 0 ) {
          HgfsSetAttrCache(abspath, attr);
+      } else if (res == -ENOENT) {
+         HgfsSetNegativeAttrCache(abspath);
       }
    }
 
@@ -208,6 +285,7 @@ hgfs_getattr(const char *path,    //IN: path of a file/directory
    }
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_GETATTR, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -234,6 +312,7 @@ static int
 hgfs_access(const char *path,  //IN: Path to a file.
             int mask)          //IN: Mask
 {
+   uint64 startTime = HgfsStatsOpStart();
    HgfsHandle fileHandle = HGFS_INVALID_HANDLE;
    HgfsAttrInfo newAttr = {0};
    HgfsAttrInfo *attr = &newAttr;
@@ -242,19 +321,27 @@ hgfs_access(const char *path,  //IN: Path to a file.
    int res;
 
    LOG(4, ("Entry(path = %s, mask = %#o)\n", path, mask));
+
+   if (getStatsPathType(path) != STATS_PATH_NONE) {
+      res = (mask & W_OK) ? -EACCES : 0;
+      goto exit;
+   }
+
    res = getAbsPath(path, &abspath);
    if (res < 0) {
       goto exit;
    }
 
-   res = HgfsGetAttrCache(path, attr);
+   res = HgfsGetAttrCache(abspath, attr);
    LOG(4, ("Retrieve attr from cache. result = %d \n", res));
-   if (res != 0) {
+   if (res != 0 && res != -ENOENT) {
       /* Retrieve new complete attribute settings and update the cache. */
       res = HgfsPrivateGetattr(fileHandle, abspath, attr);
       LOG(4, ("Retrieve attr from server. result = %d \n", res));
       if (res == 0 ) {
          HgfsSetAttrCache(abspath, attr);
+      } else if (res == -ENOENT) {
+         HgfsSetNegativeAttrCache(abspath);
       }
    }
 
@@ -287,6 +374,7 @@ hgfs_access(const char *path,  //IN: Path to a file.
   }
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_ACCESS, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -314,6 +402,7 @@ hgfs_readlink(const char *path, //IN: path to a file
               char *buf,        //OUT: buffer to store the filename
               size_t size)      //IN: size of buf
 {
+   uint64 startTime = HgfsStatsOpStart();
    char *abspath = NULL;
    int res = 0;
    HgfsHandle fileHandle = 0;
@@ -344,6 +433,7 @@ hgfs_readlink(const char *path, //IN: path to a file
 exit:
    free(attr->fileName);
    freeAbsPath(abspath);
+   HgfsStatsOpEnd(HGFS_STATS_OP_READLINK, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    return res;
 }
@@ -372,25 +462,41 @@ hgfs_readdir(const char *path,          //IN: path to a directory
              off_t offset,              //IN: offset to read the dir
              struct fuse_file_info *fi) //IN: file info set by open call
 {
+   uint64 startTime = HgfsStatsOpStart();
    char *abspath = NULL;
    int res = 0;
    HgfsHandle fileHandle = HGFS_INVALID_HANDLE;
 
    LOG(4, ("Entry(path = %s, @ %#"FMT64"x)\n", path, offset));
+
+   if (getStatsPathType(path) == STATS_PATH_DIR) {
+      filler(buf, ".", NULL, 0);
+      filler(buf, "..", NULL, 0);
+      filler(buf, HGFS_STATS_FILE_NAME, NULL, 0);
+      goto exit;
+   }
+
    res = getAbsPath(path, &abspath);
    if (res < 0) {
       goto exit;
    }
 
+   /*
+    * Watch the directory before listing it, so that changes made while
+    * the entries are cached are not missed.
+    */
+   HgfsNotifyWatchDir(abspath);
+
    res = HgfsDirOpen(abspath, &fileHandle);
    if (res < 0) {
       goto exit;
    }
 
    fi->fh = fileHandle;
-   res = HgfsReaddir(fileHandle, buf, filler);
+   res = HgfsReaddir(abspath, fileHandle, buf, filler);
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_READDIR, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -449,6 +555,7 @@ static int
 hgfs_mkdir(const char *path,  //IN: path to a new dir
            mode_t mode)       //IN: Mode of dir to be created
 {
+   uint64 startTime = HgfsStatsOpStart();
    char *abspath = NULL;
    int res;
 
@@ -459,8 +566,12 @@ hgfs_mkdir(const char *path,  //IN: path to a new dir
    }
 
    res = HgfsMkdir(abspath, mode);
+   if (res == 0) {
+      HgfsInvalidateAttrCache(abspath);
+   }
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_MKDIR, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -486,6 +597,7 @@ exit:
 static int
 hgfs_unlink(const char *path) //IN: path to a file
 {
+   uint64 startTime = HgfsStatsOpStart();
    char *abspath = NULL;
    int res;
 
@@ -501,6 +613,7 @@ hgfs_unlink(const char *path) //IN: path to a file
    }
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_UNLINK, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -526,6 +639,7 @@ exit:
 static int
 hgfs_rmdir(const char *path) //IN: path to a dir
 {
+   uint64 startTime = HgfsStatsOpStart();
    char *abspath = NULL;
    int res;
 
@@ -541,6 +655,7 @@ hgfs_rmdir(const char *path) //IN: path to a dir
    }
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_RMDIR, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -567,6 +682,7 @@ static int
 hgfs_symlink(const char *symname,   //IN: symname target
              const char *source)    //IN: source name
 {
+   uint64 startTime = HgfsStatsOpStart();
    char *absSource = NULL;
    int res;
 
@@ -578,8 +694,12 @@ hgfs_symlink(const char *symname,   //IN: symname target
 
    LOG(4, ("symname = %s, abs source = %s)\n", symname, absSource));
    res = HgfsSymlink(absSource, symname);
+   if (res == 0) {
+      HgfsInvalidateAttrCache(absSource);
+   }
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_SYMLINK, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(absSource);
    return res;
@@ -606,6 +726,7 @@ static int
 hgfs_rename(const char *from,  //IN: from path name
             const char *to)    //IN: to path name
 {
+   uint64 startTime = HgfsStatsOpStart();
    char *absfrom = NULL;
    char *absto = NULL;
    int res;
@@ -620,6 +741,10 @@ hgfs_rename(const char *from,  //IN: from path name
       goto exit;
    }
 
+   if (gState->writebackCache) {
+      HgfsWritebackFlushPath(absfrom);
+   }
+
    res = HgfsRename(absfrom, absto);
    if (res == 0) {
       HgfsInvalidateAttrCache(absfrom);
@@ -627,6 +752,7 @@ hgfs_rename(const char *from,  //IN: from path name
    }
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_RENAME, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(absfrom);
    freeAbsPath(absto);
@@ -699,6 +825,7 @@ static int
 hgfs_chmod(const char *path,   //IN: path to a file
            mode_t mode)        //IN: mode to set
 {
+   uint64 startTime = HgfsStatsOpStart();
    char *abspath = NULL;
    int res;
    HgfsHandle fileHandle = HGFS_INVALID_HANDLE;
@@ -738,6 +865,7 @@ hgfs_chmod(const char *path,   //IN: path to a file
    HgfsSetAttrCache(abspath, attr);
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_CHMOD, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -765,6 +893,7 @@ hgfs_chown(const char *path,  //IN: Path to a file
            uid_t uid,         //IN: User id
            gid_t gid)         //IN: Group id
 {
+   uint64 startTime = HgfsStatsOpStart();
    HgfsHandle fileHandle = HGFS_INVALID_HANDLE;
    HgfsAttrInfo newAttr = {0};
    HgfsAttrInfo *attr = &newAttr;
@@ -801,6 +930,7 @@ hgfs_chown(const char *path,  //IN: Path to a file
    HgfsSetAttrCache(abspath, attr);
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_CHOWN, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -827,6 +957,7 @@ static int
 hgfs_truncate(const char *path,  //IN: path to a file
               off_t size)        //IN: new size
 {
+   uint64 startTime = HgfsStatsOpStart();
    HgfsHandle fileHandle = HGFS_INVALID_HANDLE;
    HgfsAttrInfo newAttr = {0};
    HgfsAttrInfo *attr = &newAttr;
@@ -847,6 +978,10 @@ hgfs_truncate(const char *path,  //IN: path to a file
                   HGFS_ATTR_VALID_CHANGE_TIME);
    attr->writeTime = attr->accessTime = attr->attrChangeTime = HGFS_GET_TIME(time(NULL));
 
+   if (gState->writebackCache) {
+      HgfsWritebackFlushPath(abspath);
+   }
+
    res = HgfsSetattr(abspath, attr);
    if (res < 0) {
       LOG(4, ("path = %s , HgfsSetattr failed. res = %d\n", abspath, res));
@@ -862,6 +997,7 @@ hgfs_truncate(const char *path,  //IN: path to a file
    HgfsSetAttrCache(abspath, attr);
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_TRUNCATE, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -894,6 +1030,7 @@ hgfs_utime(const char *path,        //IN: path to a file
            struct utimbuf *times)   //IN: new time
 #endif
 {
+   uint64 startTime = HgfsStatsOpStart();
    HgfsHandle fileHandle = HGFS_INVALID_HANDLE;
    HgfsAttrInfo newAttr = {0};
    HgfsAttrInfo *attr = &newAttr;
@@ -909,12 +1046,14 @@ hgfs_utime(const char *path,        //IN: path to a file
 
    res = HgfsGetAttrCache(abspath, attr);
    LOG(4, ("Retrieve attr from cache. result = %d \n", res));
-   if (res != 0) {
+   if (res != 0 && res != -ENOENT) {
       /* Retrieve new complete attribute settings and update the cache. */
       res = HgfsPrivateGetattr(fileHandle, abspath, attr);
       LOG(4, ("Retrieve attr from server. result = %d \n", res));
       if (res == 0 ) {
          HgfsSetAttrCache(abspath, attr);
+      } else if (res == -ENOENT) {
+         HgfsSetNegativeAttrCache(abspath);
       }
    }
 
@@ -950,6 +1089,11 @@ hgfs_utime(const char *path,        //IN: path to a file
    attr->accessTime = HgfsConvertToNtTime(accessTimeSec, accessTimeNsec);
    attr->writeTime = HgfsConvertToNtTime(writeTimeSec, writeTimeNsec);
 
+   /* Buffered writes sent later would move the write time again. */
+   if (gState->writebackCache) {
+      HgfsWritebackFlushPath(abspath);
+   }
+
    res = HgfsSetattr(abspath, attr);
    if (res < 0) {
       LOG(4, ("abspath = %s , HgfsSetattr failed. res = %d\n", abspath, res));
@@ -965,6 +1109,7 @@ hgfs_utime(const char *path,        //IN: path to a file
    HgfsSetAttrCache(abspath, attr);
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_UTIME, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -991,10 +1136,42 @@ static int
 hgfs_open(const char *path,          //IN: path to a file
           struct fuse_file_info *fi) //IN: file info structure
 {
+   uint64 startTime = HgfsStatsOpStart();
    char *abspath = NULL;
    int res;
 
    LOG(4, ("Entry(path = %s)\n", path));
+
+   switch (getStatsPathType(path)) {
+   case STATS_PATH_DIR:
+      res = -EISDIR;
+      goto exit;
+   case STATS_PATH_FILE: {
+      StatsSnapshot *snap;
+
+      if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+         res = -EACCES;
+         goto exit;
+      }
+      snap = malloc(sizeof *snap);
+      if (snap == NULL) {
+         res = -ENOMEM;
+         goto exit;
+      }
+      res = HgfsStatsFormat(&snap->buf, &snap->len);
+      if (res < 0) {
+         free(snap);
+         goto exit;
+      }
+      /* The snapshot is taken once per open, reads ignore the file size. */
+      fi->fh = (uintptr_t)snap;
+      fi->direct_io = 1;
+      goto exit;
+   }
+   default:
+      break;
+   }
+
    res = getAbsPath(path, &abspath);
    if (res < 0) {
       goto exit;
@@ -1003,6 +1180,7 @@ hgfs_open(const char *path,          //IN: path to a file
    res = HgfsOpen(abspath, fi);
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_OPEN, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -1030,6 +1208,7 @@ hgfs_create(const char *path,          //IN: path to a file
             mode_t mode,               //IN: file mode
             struct fuse_file_info *fi) //IN: file info structure
 {
+   uint64 startTime = HgfsStatsOpStart();
    char *abspath = NULL;
    int res;
 
@@ -1040,8 +1219,12 @@ hgfs_create(const char *path,          //IN: path to a file
    }
 
    res = HgfsCreate(abspath, mode, fi);
+   if (res == 0) {
+      HgfsInvalidateAttrCache(abspath);
+   }
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_CREATE, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -1072,11 +1255,24 @@ hgfs_read(const char *path,          //IN: path to a file
           off_t offset,              //IN: starting point to read
           struct fuse_file_info *fi) //IN: file info structure
 {
+   uint64 startTime = HgfsStatsOpStart();
    char *abspath = NULL;
    int res;
 
    LOG(4, ("Entry(path = %s, fi->fh = %#"FMT64"x, %#"FMTSZ"x bytes @ %#"FMT64"x)\n",
            path, fi->fh, size, offset));
+
+   if (getStatsPathType(path) == STATS_PATH_FILE) {
+      StatsSnapshot *snap = (StatsSnapshot *)(uintptr_t)fi->fh;
+
+      res = 0;
+      if (offset < snap->len) {
+         res = MIN(size, snap->len - offset);
+         memcpy(buf, snap->buf + offset, res);
+      }
+      goto exit;
+   }
+
    res = getAbsPath(path, &abspath);
    if (res < 0) {
       goto exit;
@@ -1089,8 +1285,12 @@ hgfs_read(const char *path,          //IN: path to a file
       }
    }
    res = HgfsRead(fi, buf, size, offset);
+   if (res > 0) {
+      HgfsStatsAddBytesRead(res);
+   }
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_READ, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -1121,6 +1321,7 @@ hgfs_write(const char *path,          //IN: path to a file
            off_t offset,              //IN: starting point to write
            struct fuse_file_info *fi) //IN: file info structure
 {
+   uint64 startTime = HgfsStatsOpStart();
    char *abspath = NULL;
    int res;
 
@@ -1138,17 +1339,34 @@ hgfs_write(const char *path,          //IN: path to a file
       }
    }
 
-   res = HgfsWrite(fi, buf, size, offset);
+   res = HgfsWrite(abspath, fi, buf, size, offset);
+   if (res > 0) {
+      HgfsStatsAddBytesWritten(res);
+   }
    if (res >= 0) {
-      /*
-       * Positive result indicates the number of bytes written.
-       * For zero bytes and no error, we still purge the cache
-       * this could effect the attributes.
-       */
-      HgfsInvalidateAttrCache(abspath);
+      HgfsAttrInfo attr;
+
+      if (gState->writebackCache && HgfsGetAttrCache(abspath, &attr) == 0) {
+         /*
+          * The data may still be buffered, so the server would report a
+          * stale size. Update the cached attributes instead.
+          */
+         attr.size = MAX(attr.size, offset + res);
+         attr.mask |= HGFS_ATTR_VALID_WRITE_TIME;
+         attr.writeTime = HGFS_GET_TIME(time(NULL));
+         HgfsSetAttrCache(abspath, &attr);
+      } else {
+         /*
+          * Positive result indicates the number of bytes written.
+          * For zero bytes and no error, we still purge the cache
+          * this could effect the attributes.
+          */
+         HgfsInvalidateAttrCache(abspath);
+      }
    }
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_WRITE, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -1174,6 +1392,7 @@ static int
 hgfs_statfs(const char *path,      //IN: Path to the filesystem
             struct statvfs *stbuf) //OUT:Struct to fill data
 {
+   uint64 startTime = HgfsStatsOpStart();
    char *abspath = NULL;
    int res;
 
@@ -1186,12 +1405,88 @@ hgfs_statfs(const char *path,      //IN: Path to the filesystem
    res = HgfsStatfs(abspath, stbuf);
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_STATFS, startTime, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_flush
+ *
+ *    Called on each close of a file descriptor. Writes out any data
+ *    buffered by write coalescing, so that close reports write errors.
+ *
+ * Results:
+ *    Returns zero on success, or a negative error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+hgfs_flush(const char *path,                //IN: path to a file
+           struct fuse_file_info *fi)       //IN: file info structure
+{
+   uint64 startTime = HgfsStatsOpStart();
+   int res = 0;
+
+   LOG(4, ("Entry(path = %s, fi->fh = %#"FMT64"x)\n", path, fi->fh));
+
+   if (gState->writebackCache && fi->fh != HGFS_INVALID_HANDLE &&
+       getStatsPathType(path) == STATS_PATH_NONE) {
+      res = HgfsWritebackFlush(fi->fh);
+   }
+
+   HgfsStatsOpEnd(HGFS_STATS_OP_FLUSH, startTime, res);
+   LOG(4, ("Exit(%d)\n", res));
+   return res;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_fsync
+ *
+ *    Writes out any data buffered by write coalescing. The host file
+ *    system is not asked to sync, HGFS has no request for that.
+ *
+ * Results:
+ *    Returns zero on success, or a negative error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+hgfs_fsync(const char *path,                //IN: path to a file
+           int datasync,                    //IN: only sync data
+           struct fuse_file_info *fi)       //IN: file info structure
+{
+   uint64 startTime = HgfsStatsOpStart();
+   int res = 0;
+
+   LOG(4, ("Entry(path = %s, fi->fh = %#"FMT64"x)\n", path, fi->fh));
+
+   if (gState->writebackCache && fi->fh != HGFS_INVALID_HANDLE &&
+       getStatsPathType(path) == STATS_PATH_NONE) {
+      res = HgfsWritebackFlush(fi->fh);
+   }
+
+   HgfsStatsOpEnd(HGFS_STATS_OP_FSYNC, startTime, res);
+   LOG(4, ("Exit(%d)\n", res));
+   return res;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1212,21 +1507,34 @@ static int
 hgfs_release(const char *path,                //IN: path to a file
              struct fuse_file_info *fi)       //IN: file info structure
 {
+   uint64 startTime = HgfsStatsOpStart();
    char *abspath = NULL;
    int res;
 
    LOG(4, ("Entry(path = %s, fi->fh = %#"FMT64"x)\n", path, fi->fh));
+
+   if (getStatsPathType(path) == STATS_PATH_FILE) {
+      StatsSnapshot *snap = (StatsSnapshot *)(uintptr_t)fi->fh;
+
+      free(snap->buf);
+      free(snap);
+      fi->fh = HGFS_INVALID_HANDLE;
+      res = 0;
+      goto exit;
+   }
+
    res = getAbsPath(path, &abspath);
    if (res < 0) {
       goto exit;
    }
 
-   res = HgfsRelease(fi->fh);
+   res = HgfsReleaseDeferred(abspath, fi);
    if (0 == res) {
       fi->fh = HGFS_INVALID_HANDLE;
    }
 
 exit:
+   HgfsStatsOpEnd(HGFS_STATS_OP_RELEASE, startTime, res);
    LOG(4, ("Exit(0)\n"));
    freeAbsPath(abspath);
    return 0;
@@ -1238,7 +1546,7 @@ exit:
  *
  * hgfs_init
  *
- *    Initialization routine. We spawn the cache purge thread here.
+ *    Initialization routine. We create the HGFS session here.
  *
  * Results:
  *    Returns NULL.
@@ -1252,27 +1560,23 @@ exit:
 static void*
 hgfs_init(struct fuse_conn_info *conn) // IN: unused
 {
-   pthread_t purgeCacheThread;
-   int dummy;
    int res;
 
    LOG(4, ("Entry()\n"));
 
-   /*
-    * dummy argument is required for Solaris and FreeBSD while creating
-    * thread otherwise the program crashes.
-    */
-   res = pthread_create(&purgeCacheThread, NULL,
-                        HgfsPurgeCache, &dummy);
-   if (res < 0) {
-      LOG(4, ("Pthread create fail. error = %d\n", res));
-   }
-
    res = HgfsCreateSession();
    if (res < 0) {
       LOG(4, ("Create session failed. error = %d\n", res));
    }
 
+   if (gState->writebackCache) {
+      res = HgfsWritebackInit();
+      if (res < 0) {
+         LOG(4, ("Write coalescing disabled. error = %d\n", res));
+         gState->writebackCache = FALSE;
+      }
+   }
+
    LOG(4, ("Exit(NULL)\n"));
    return NULL;
 }
@@ -1297,16 +1601,29 @@ hgfs_init(struct fuse_conn_info *conn) // IN: unused
 static void
 hgfs_destroy(void *data) // IN: unused
 {
+   HgfsReqPoolStats poolStats;
    int res;
 
    LOG(4, ("Entry()\n"));
 
+   if (gState->writebackCache) {
+      HgfsWritebackExit();
+   }
+   HgfsOpenCacheExit();
+
    res = HgfsDestroySession();
    if (res < 0) {
       LOG(4, ("Destroy session failed. error = %d\n", res));
    }
 
    HgfsTransportExit();
+   HgfsNotifyExit();
+
+   HgfsGetRequestPoolStats(&poolStats);
+   LOG(4, ("Request pool: %"FMT64"u allocs, %"FMT64"u hits, %"FMT64"u misses, "
+           "%"FMT64"u frees, %"FMT64"u cached\n",
+           poolStats.allocs, poolStats.hits, poolStats.misses,
+           poolStats.frees, poolStats.cached));
 
    free(gState->basePath);
 
@@ -1344,7 +1661,9 @@ static struct fuse_operations vmhgfs_operations = {
    .read        = hgfs_read,
    .write       = hgfs_write,
    .statfs      = hgfs_statfs,
+   .flush       = hgfs_flush,
    .release     = hgfs_release,
+   .fsync       = hgfs_fsync,
    .create      = hgfs_create,
    .init        = hgfs_init,
    .destroy     = hgfs_destroy,
@@ -1383,6 +1702,7 @@ main(int argc,       //IN: Argument count
    /* Initialization */
    umask(0);
    HgfsResetOps();
+   HgfsNotifyInit();
    res = HgfsTransportInit();
    if (res != 0) {
       fprintf(stderr, "Error %d cannot open connection!\n", res);
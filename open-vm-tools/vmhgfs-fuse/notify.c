@@ -0,0 +1,942 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * notify.c --
+ *
+ * Directory change notifications for the vmhgfs FUSE client.
+ *
+ * Attribute cache entries are normally trusted for a short TTL only. When
+ * the host can tell us about changes, we place a watch on each directory
+ * that is listed and, as long as that watch is intact, the entries of its
+ * children are kept for much longer (see cache.c). Each event drops the
+ * cache entries of the affected child and of the directory itself, so
+ * that the next lookup fetches fresh attributes from the host.
+ *
+ * Watches require a V4 session on a channel that can deliver server
+ * initiated packets (vsock). Whenever the host cannot provide them, or a
+ * watch overflows or goes away, we fall back to plain TTL behavior.
+ *
+ * The high level FUSE API gives us no way to invalidate the kernel's own
+ * entry and attribute caches, so those remain bounded by the entry_timeout
+ * and attr_timeout mount options.
+ */
+
+#include "module.h"
+#include "cache.h"
+#include "notify.h"
+
+/* Watches are looked up by id for every notification, and by path. */
+#define HGFS_NOTIFY_BUCKETS       64
+
+/* Bound on host resources we are willing to hold on to. */
+#define HGFS_NOTIFY_MAX_WATCHES   1024
+
+/* Anything that can make a cached child entry stale. */
+#define HGFS_NOTIFY_EVENTS       (HGFS_NOTIFY_ATTRIB |                 \
+                                  HGFS_NOTIFY_SIZE |                   \
+                                  HGFS_NOTIFY_MTIME |                  \
+                                  HGFS_NOTIFY_CTIME |                  \
+                                  HGFS_NOTIFY_NAME |                   \
+                                  HGFS_NOTIFY_CREATE_FILE |            \
+                                  HGFS_NOTIFY_CREATE_DIR |             \
+                                  HGFS_NOTIFY_DELETE_FILE |            \
+                                  HGFS_NOTIFY_DELETE_DIR |             \
+                                  HGFS_NOTIFY_DELETE_SELF |            \
+                                  HGFS_NOTIFY_MODIFY |                 \
+                                  HGFS_NOTIFY_MOVE_SELF |              \
+                                  HGFS_NOTIFY_OLD_FILE_NAME |          \
+                                  HGFS_NOTIFY_NEW_FILE_NAME |          \
+                                  HGFS_NOTIFY_OLD_DIR_NAME |           \
+                                  HGFS_NOTIFY_NEW_DIR_NAME |           \
+                                  HGFS_NOTIFY_CHANGE_SECURITY)
+
+/* Events after which the watch no longer describes the directory. */
+#define HGFS_NOTIFY_EVENTS_GONE  (HGFS_NOTIFY_DELETE_SELF |            \
+                                  HGFS_NOTIFY_MOVE_SELF |              \
+                                  HGFS_NOTIFY_WATCH_DELETED |          \
+                                  HGFS_NOTIFY_EVENTS_DROPPED)
+
+/* Events which take a whole subtree away from its cached paths. */
+#define HGFS_NOTIFY_EVENTS_SUBTREE (HGFS_NOTIFY_DELETE_DIR |           \
+                                    HGFS_NOTIFY_OLD_DIR_NAME |         \
+                                    HGFS_NOTIFY_NEW_DIR_NAME)
+
+typedef enum {
+   HGFS_NOTIFY_SESSION_NONE,         /* Not tried on this channel yet. */
+   HGFS_NOTIFY_SESSION_READY,        /* Session created, watches supported. */
+   HGFS_NOTIFY_SESSION_UNSUPPORTED,  /* Host can't notify us here. */
+} HgfsNotifySessionState;
+
+typedef struct HgfsNotifyWatch {
+   struct list_head idLinks;       /* Id bucket, or the removal list. */
+   struct list_head pathLinks;     /* Path bucket, while the watch is live. */
+   HgfsSubscriberHandle watchId;   /* Host watch id. */
+   uint32 pathHash;                /* Hash of the directory path. */
+   size_t pathLen;                 /* Length of the directory path. */
+   char path[0];                   /* Directory path, as the cache keys it. */
+} HgfsNotifyWatch;
+
+/* Serializes session creation and the watch requests sent on it. */
+static pthread_mutex_t hgfsNotifyMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Protects the watch tables, the session state and the generation. The
+ * generation is bumped whenever the channel (and with it the host side
+ * session and all its watches) goes away. Never held across a request.
+ */
+static pthread_mutex_t hgfsNotifyLock = PTHREAD_MUTEX_INITIALIZER;
+static HgfsNotifySessionState hgfsNotifyState;
+static uint64 hgfsNotifySessionId;
+static uint32 hgfsNotifyGeneration;
+static unsigned int hgfsNotifyWatchCount;
+static struct list_head hgfsNotifyById[HGFS_NOTIFY_BUCKETS];
+static struct list_head hgfsNotifyByPath[HGFS_NOTIFY_BUCKETS];
+
+/*
+ * Watches dropped by the receive thread which still have to be removed
+ * from the host. The receive thread cannot send requests itself, so they
+ * are removed by the next thread placing a watch.
+ */
+static struct list_head hgfsNotifyRemoved;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyDirLen --
+ *
+ *    Length of a directory path without its trailing separators, so
+ *    that "/share/" and "/share" name the same watch.
+ *
+ * Results:
+ *    The length.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static size_t
+HgfsNotifyDirLen(const char *path)  // IN: Directory path
+{
+   size_t len = strlen(path);
+
+   while (len > 1 && path[len - 1] == '/') {
+      len--;
+   }
+   return len;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyPathHash --
+ *
+ *    FNV-1a hash of the first len bytes of a path.
+ *
+ * Results:
+ *    The hash value.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNotifyPathHash(const char *path,  // IN: Directory path
+                   size_t len)        // IN: Length to hash
+{
+   uint32 hash = 2166136261U;
+
+   while (len-- > 0) {
+      hash ^= (uint8)*path++;
+      hash *= 16777619U;
+   }
+   return hash;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyFindPath --
+ *
+ *    Find the live watch on a directory. Called with hgfsNotifyLock held.
+ *
+ * Results:
+ *    The watch or NULL.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsNotifyWatch *
+HgfsNotifyFindPath(const char *path,  // IN: Directory path
+                   size_t len,        // IN: Its length
+                   uint32 hash)       // IN: Its hash
+{
+   struct list_head *bucket = &hgfsNotifyByPath[hash % HGFS_NOTIFY_BUCKETS];
+   HgfsNotifyWatch *watch;
+
+   list_for_each_entry(watch, bucket, pathLinks) {
+      if (watch->pathHash == hash && watch->pathLen == len &&
+          memcmp(watch->path, path, len) == 0) {
+         return watch;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyFindId --
+ *
+ *    Find the live watch with a host id. Called with hgfsNotifyLock held.
+ *
+ * Results:
+ *    The watch or NULL.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsNotifyWatch *
+HgfsNotifyFindId(HgfsSubscriberHandle watchId)  // IN: Host watch id
+{
+   struct list_head *bucket = &hgfsNotifyById[watchId % HGFS_NOTIFY_BUCKETS];
+   HgfsNotifyWatch *watch;
+
+   list_for_each_entry(watch, bucket, idLinks) {
+      if (watch->watchId == watchId) {
+         return watch;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifySendV4 --
+ *
+ *    Fill in a V4 header for a request whose body has already been
+ *    packed and send it on the notification session. On success,
+ *    returns the reply body.
+ *
+ * Results:
+ *    Zero on success, negative error otherwise.
+ *
+ * Side effects:
+ *    A stale session resets the notification state.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsNotifySendV4(HgfsReq *req,         // IN/OUT: Request to send
+                 HgfsOp op,            // IN: Operation
+                 uint64 sessionId,     // IN: Session to send on
+                 size_t requestSize,   // IN: Size of the request body
+                 size_t replySize,     // IN: Minimum reply body size
+                 char **reply)         // OUT: Reply body
+{
+   HgfsHeader *header = (HgfsHeader *)HGFS_REQ_PAYLOAD(req);
+   int result;
+
+   memset(header, 0, sizeof *header);
+   header->version = HGFS_HEADER_VERSION;
+   header->dummy = HGFS_OP_NEW_HEADER;
+   header->packetSize = sizeof *header + requestSize;
+   header->headerSize = sizeof *header;
+   header->requestId = req->id;
+   header->op = op;
+   header->flags = HGFS_PACKET_FLAG_REQUEST;
+   header->sessionId = sessionId;
+   req->payloadSize = header->packetSize;
+
+   result = HgfsSendRequest(req);
+   if (result != 0) {
+      LOG(4, ("Op %d not sent: %d\n", op, result));
+      return result;
+   }
+
+   if (req->payloadSize < sizeof *header ||
+       header->headerSize < sizeof *header ||
+       header->headerSize > req->payloadSize) {
+      LOG(4, ("Malformed reply to op %d\n", op));
+      return -EPROTO;
+   }
+
+   if (header->status == HGFS_STATUS_STALE_SESSION) {
+      LOG(4, ("Notification session is stale.\n"));
+      HgfsNotifyReset();
+   }
+
+   result = HgfsStatusConvertToLinux(header->status);
+   if (result == 0 && req->payloadSize - header->headerSize < replySize) {
+      LOG(4, ("Reply to op %d too short\n", op));
+      result = -EPROTO;
+   }
+
+   *reply = (char *)header + header->headerSize;
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyCreateSession --
+ *
+ *    Create the V4 session watches are placed on and find out whether
+ *    the host supports them. Called with hgfsNotifyMutex held.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Moves the session state out of HGFS_NOTIFY_SESSION_NONE.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyCreateSession(void)
+{
+   HgfsRequestCreateSessionV4 *request;
+   HgfsReplyCreateSessionV4 *reply;
+   HgfsNotifySessionState state = HGFS_NOTIFY_SESSION_UNSUPPORTED;
+   uint64 sessionId = HGFS_INVALID_SESSION_ID;
+   uint32 generation;
+   HgfsReq *req;
+   size_t capsSize;
+   uint32 i;
+
+   pthread_mutex_lock(&hgfsNotifyLock);
+   generation = hgfsNotifyGeneration;
+   pthread_mutex_unlock(&hgfsNotifyLock);
+
+   /* Notifications arrive on the receive thread of the channel only. */
+   if (!HgfsTransportCanNotify()) {
+      goto out;
+   }
+
+   req = HgfsGetNewRequest();
+   if (!req) {
+      /* Transient, try again on the next readdir. */
+      return;
+   }
+
+   request = (HgfsRequestCreateSessionV4 *)HGFS_REQ_GET_PAYLOAD_HDRV2(req);
+   memset(request, 0, sizeof *request);
+   request->maxPacketSize = HGFS_LARGE_PACKET_MAX;
+   request->flags = HGFS_SESSION_MAXPACKETSIZE_VALID |
+                    HGFS_SESSION_CHANGENOTIFY_ENABLED;
+
+   if (HgfsNotifySendV4(req, HGFS_OP_CREATE_SESSION_V4,
+                        HGFS_INVALID_SESSION_ID, sizeof *request,
+                        offsetof(HgfsReplyCreateSessionV4, capabilities),
+                        (char **)&reply) == 0) {
+      capsSize = req->payloadSize - sizeof(HgfsHeader) -
+                 offsetof(HgfsReplyCreateSessionV4, capabilities);
+      for (i = 0;
+           i < reply->numCapabilities &&
+           (i + 1) * sizeof reply->capabilities[0] <= capsSize;
+           i++) {
+         if (reply->capabilities[i].op == HGFS_OP_SET_WATCH_V4 &&
+             reply->capabilities[i].flags != HGFS_REQUEST_NOT_SUPPORTED) {
+            state = HGFS_NOTIFY_SESSION_READY;
+            break;
+         }
+      }
+      sessionId = reply->sessionId;
+   }
+   HgfsFreeRequest(req);
+
+out:
+   pthread_mutex_lock(&hgfsNotifyLock);
+   if (generation == hgfsNotifyGeneration) {
+      hgfsNotifySessionId = sessionId;
+      hgfsNotifyState = state;
+   }
+   pthread_mutex_unlock(&hgfsNotifyLock);
+
+   LOG(6, ("Change notification %s\n",
+           state == HGFS_NOTIFY_SESSION_READY ? "enabled" : "unavailable"));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyFlushRemoved --
+ *
+ *    Remove the watches dropped by the receive thread from the host.
+ *    Called with hgfsNotifyMutex held.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Frees the dropped watches.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyFlushRemoved(uint64 sessionId)  // IN: Session of the watches
+{
+   struct list_head removed;
+   HgfsNotifyWatch *watch;
+   HgfsNotifyWatch *next;
+
+   INIT_LIST_HEAD(&removed);
+   pthread_mutex_lock(&hgfsNotifyLock);
+   list_splice_init(&hgfsNotifyRemoved, &removed);
+   pthread_mutex_unlock(&hgfsNotifyLock);
+
+   list_for_each_entry_safe(watch, next, &removed, idLinks) {
+      HgfsRequestRemoveWatchV4 *request;
+      HgfsReq *req;
+      char *reply;
+
+      req = HgfsGetNewRequest();
+      if (req) {
+         request = (HgfsRequestRemoveWatchV4 *)HGFS_REQ_GET_PAYLOAD_HDRV2(req);
+         request->watchId = watch->watchId;
+         HgfsNotifySendV4(req, HGFS_OP_REMOVE_WATCH_V4, sessionId,
+                          sizeof *request, 0, &reply);
+         HgfsFreeRequest(req);
+      }
+      list_del(&watch->idLinks);
+      free(watch);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyDropWatch --
+ *
+ *    Take a watch off the live tables. If the host still has it, it is
+ *    queued for removal, otherwise it is freed. Called with
+ *    hgfsNotifyLock held.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyDropWatch(HgfsNotifyWatch *watch,  // IN: Live watch
+                    Bool hostRemoved)        // IN: Host already removed it
+{
+   list_del(&watch->pathLinks);
+   list_del(&watch->idLinks);
+   hgfsNotifyWatchCount--;
+
+   if (hostRemoved) {
+      free(watch);
+   } else {
+      list_add_tail(&watch->idLinks, &hgfsNotifyRemoved);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyInvalidateChild --
+ *
+ *    Drop the cache entry of the child an event refers to. The event
+ *    carries the full cross-platform name; its last component is the
+ *    child's name as the host sees it and must be escaped like readdir
+ *    does.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyInvalidateChild(char *childPath,           // IN/OUT: Dir path,
+                                                     //   room for the name
+                          size_t dirLen,             // IN: Length of dir path
+                          const HgfsNotifyEventV4 *event, // IN: Event
+                          size_t nameSize)           // IN: Room for the name
+{
+   const char *name = event->fileName.name;
+   const char *last;
+   uint32 len;
+   int result;
+
+   len = event->fileName.length;
+   if (len == 0 || len > nameSize) {
+      return;
+   }
+
+   for (last = name + len; last > name && last[-1] != '\0'; last--) {
+      /* Find the start of the last component. */
+   }
+   len -= last - name;
+   if (len == 0) {
+      return;
+   }
+
+   result = HgfsEscape_Do(last, len, NAME_MAX + 1, childPath + dirLen);
+   if (result <= 0) {
+      return;
+   }
+
+   LOG(6, ("Event %#x on %s\n", event->mask, childPath));
+   HgfsInvalidateAttrCache(childPath);
+   if (event->mask & HGFS_NOTIFY_EVENTS_SUBTREE) {
+      HgfsInvalidateAttrCacheChildren(childPath);
+   }
+}
+
+
+/*
+ * Public functions (with respect to the entire module).
+ */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyReceive --
+ *
+ *    Called by the transport for every notification packet the host
+ *    sends. Runs on the channel receive thread, so it must not send
+ *    requests.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Drops the cache entries the notification refers to.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsNotifyReceive(const char *packet,  // IN: Notification packet
+                  size_t packetSize)   // IN: Its size
+{
+   const HgfsHeader *header = (const HgfsHeader *)packet;
+   const HgfsRequestNotifyV4 *notify;
+   const HgfsNotifyEventV4 *event;
+   HgfsNotifyWatch *watch;
+   char *childPath = NULL;
+   size_t dirLen = 0;
+   size_t size;
+   size_t offset;
+   Bool drop;
+   uint32 i;
+
+   if (packetSize < sizeof *header ||
+       header->dummy != HGFS_OP_NEW_HEADER ||
+       header->op != HGFS_OP_NOTIFY_V4 ||
+       header->headerSize < sizeof *header ||
+       header->packetSize > packetSize ||
+       header->headerSize > header->packetSize) {
+      LOG(4, ("Unexpected packet\n"));
+      return;
+   }
+
+   size = header->packetSize - header->headerSize;
+   if (size < offsetof(HgfsRequestNotifyV4, events)) {
+      return;
+   }
+   notify = (const HgfsRequestNotifyV4 *)(packet + header->headerSize);
+
+   /* Room for "<dir>/<name>". */
+   pthread_mutex_lock(&hgfsNotifyLock);
+   watch = HgfsNotifyFindId(notify->watchId);
+   if (watch) {
+      dirLen = watch->pathLen;
+      childPath = malloc(dirLen + NAME_MAX + 2);
+      if (childPath) {
+         memcpy(childPath, watch->path, dirLen);
+         childPath[dirLen] = '\0';
+      }
+   }
+   pthread_mutex_unlock(&hgfsNotifyLock);
+
+   if (!watch) {
+      LOG(4, ("Unknown watch %"FMT64"u\n", notify->watchId));
+      return;
+   }
+
+   /* Without a copy of the path, all we can do is stop trusting it. */
+   drop = childPath == NULL ||
+          (notify->flags & (HGFS_NOTIFY_FLAG_OVERFLOW |
+                            HGFS_NOTIFY_FLAG_REMOVED)) != 0;
+   offset = offsetof(HgfsRequestNotifyV4, events);
+   for (i = 0; !drop && i < notify->count; i++) {
+      if (offset + offsetof(HgfsNotifyEventV4, fileName.name) > size) {
+         break;
+      }
+
+      event = (const HgfsNotifyEventV4 *)((const char *)notify + offset);
+      if (event->mask & HGFS_NOTIFY_EVENTS_GONE) {
+         drop = TRUE;
+      } else {
+         size_t childLen = dirLen;
+
+         if (childPath[childLen - 1] != '/') {
+            childPath[childLen++] = '/';
+         }
+         HgfsNotifyInvalidateChild(childPath, childLen, event,
+                                   size - offset -
+                                   offsetof(HgfsNotifyEventV4, fileName.name));
+         childPath[dirLen] = '\0';
+      }
+
+      if (event->nextOffset == 0) {
+         break;
+      }
+      offset += event->nextOffset;
+   }
+
+   if (drop) {
+      /*
+       * We may have missed changes, or will not hear about new ones: the
+       * children are back to being trusted for the TTL only.
+       */
+      pthread_mutex_lock(&hgfsNotifyLock);
+      watch = HgfsNotifyFindId(notify->watchId);
+      if (watch) {
+         LOG(6, ("Dropping watch %"FMT64"u\n", notify->watchId));
+         HgfsNotifyDropWatch(watch,
+                             (notify->flags & HGFS_NOTIFY_FLAG_REMOVED) != 0);
+      }
+      pthread_mutex_unlock(&hgfsNotifyLock);
+
+      HgfsInvalidateAttrCacheChildren(childPath ? childPath : "/");
+   }
+
+   if (childPath) {
+      /* Any change to the children changes the directory itself. */
+      HgfsInvalidateAttrCache(childPath);
+      free(childPath);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyWatchDir --
+ *
+ *    Ask the host to tell us about changes to a directory which is being
+ *    listed. Failures are silent since the directory simply keeps TTL
+ *    based caching.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    May create the notification session on first use.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsNotifyWatchDir(const char *path)  // IN: Absolute directory path
+{
+   HgfsRequestSetWatchV4 *request;
+   HgfsReplySetWatchV4 *reply;
+   HgfsNotifySessionState state;
+   HgfsNotifyWatch *watch;
+   uint64 sessionId;
+   uint32 generation;
+   uint32 hash;
+   size_t len;
+   HgfsReq *req;
+   size_t nameSize;
+   Bool skip;
+   int result;
+
+   ASSERT(path);
+
+   len = HgfsNotifyDirLen(path);
+   hash = HgfsNotifyPathHash(path, len);
+
+   pthread_mutex_lock(&hgfsNotifyLock);
+   skip = !gState->sessionEnabled ||
+          hgfsNotifyState == HGFS_NOTIFY_SESSION_UNSUPPORTED ||
+          hgfsNotifyWatchCount >= HGFS_NOTIFY_MAX_WATCHES ||
+          HgfsNotifyFindPath(path, len, hash) != NULL;
+   pthread_mutex_unlock(&hgfsNotifyLock);
+   if (skip) {
+      return;
+   }
+
+   pthread_mutex_lock(&hgfsNotifyMutex);
+
+   pthread_mutex_lock(&hgfsNotifyLock);
+   state = hgfsNotifyState;
+   pthread_mutex_unlock(&hgfsNotifyLock);
+   if (state == HGFS_NOTIFY_SESSION_NONE) {
+      HgfsNotifyCreateSession();
+   }
+
+   pthread_mutex_lock(&hgfsNotifyLock);
+   state = hgfsNotifyState;
+   sessionId = hgfsNotifySessionId;
+   generation = hgfsNotifyGeneration;
+   skip = state != HGFS_NOTIFY_SESSION_READY ||
+          HgfsNotifyFindPath(path, len, hash) != NULL;
+   pthread_mutex_unlock(&hgfsNotifyLock);
+   if (skip) {
+      goto out;
+   }
+
+   HgfsNotifyFlushRemoved(sessionId);
+
+   req = HgfsGetNewRequest();
+   if (!req) {
+      goto out;
+   }
+
+   request = (HgfsRequestSetWatchV4 *)HGFS_REQ_GET_PAYLOAD_HDRV2(req);
+   request->events = HGFS_NOTIFY_EVENTS;
+   request->flags = HGFS_NOTIFY_FLAG_POSIX_HINT;
+   request->reserved = 0;
+   request->fileName.flags = 0;
+   request->fileName.caseType = HGFS_FILE_NAME_CASE_SENSITIVE;
+   request->fileName.fid = HGFS_INVALID_HANDLE;
+
+   nameSize = HGFS_NAME_BUFFER_SIZET(HGFS_LARGE_PACKET_MAX,
+                                     sizeof(HgfsHeader) + sizeof *request);
+   result = CPName_ConvertTo(path, nameSize, request->fileName.name);
+   if (result < 0) {
+      goto out_free;
+   }
+   request->fileName.length = result;
+
+   if (HgfsNotifySendV4(req, HGFS_OP_SET_WATCH_V4, sessionId,
+                        sizeof *request + result, sizeof *reply,
+                        (char **)&reply) != 0) {
+      goto out_free;
+   }
+
+   watch = malloc(sizeof *watch + len + 1);
+   if (!watch) {
+      goto out_free;
+   }
+   watch->watchId = reply->watchId;
+   watch->pathHash = hash;
+   watch->pathLen = len;
+   memcpy(watch->path, path, len);
+   watch->path[len] = '\0';
+
+   pthread_mutex_lock(&hgfsNotifyLock);
+   if (generation != hgfsNotifyGeneration) {
+      /* The session, and the watch with it, is gone. */
+      free(watch);
+   } else if (hgfsNotifyWatchCount >= HGFS_NOTIFY_MAX_WATCHES ||
+              HgfsNotifyFindPath(path, len, hash) != NULL) {
+      list_add_tail(&watch->idLinks, &hgfsNotifyRemoved);
+   } else {
+      list_add(&watch->idLinks,
+               &hgfsNotifyById[watch->watchId % HGFS_NOTIFY_BUCKETS]);
+      list_add(&watch->pathLinks, &hgfsNotifyByPath[hash % HGFS_NOTIFY_BUCKETS]);
+      hgfsNotifyWatchCount++;
+      LOG(6, ("Watch %"FMT64"u on %s\n", watch->watchId, watch->path));
+   }
+   pthread_mutex_unlock(&hgfsNotifyLock);
+
+out_free:
+   HgfsFreeRequest(req);
+out:
+   pthread_mutex_unlock(&hgfsNotifyMutex);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyParentIsWatched --
+ *
+ *    Check whether the host reports changes to the directory holding a
+ *    path, so that the path's cache entry can be trusted for longer.
+ *
+ * Results:
+ *    TRUE if the parent directory has a live watch.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+Bool
+HgfsNotifyParentIsWatched(const char *path)  // IN: Absolute path
+{
+   const char *slash = strrchr(path, '/');
+   size_t len;
+   uint32 hash;
+   Bool watched;
+
+   if (slash == NULL) {
+      return FALSE;
+   }
+
+   /* The parent of "/name" is "/". */
+   len = slash == path ? 1 : slash - path;
+   hash = HgfsNotifyPathHash(path, len);
+
+   pthread_mutex_lock(&hgfsNotifyLock);
+   watched = hgfsNotifyWatchCount > 0 &&
+             HgfsNotifyFindPath(path, len, hash) != NULL;
+   pthread_mutex_unlock(&hgfsNotifyLock);
+
+   return watched;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyReset --
+ *
+ *    Forget the session and all watches. Called when the channel closes
+ *    or the session goes stale, which takes the host side watches down.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Cache entries which were trusted because of a watch are dropped.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsNotifyReset(void)
+{
+   HgfsNotifyWatch *watch;
+   HgfsNotifyWatch *next;
+   Bool hadWatches;
+   int i;
+
+   pthread_mutex_lock(&hgfsNotifyLock);
+   hadWatches = hgfsNotifyWatchCount > 0;
+   for (i = 0; i < HGFS_NOTIFY_BUCKETS; i++) {
+      list_for_each_entry_safe(watch, next, &hgfsNotifyById[i], idLinks) {
+         list_del(&watch->pathLinks);
+         list_del(&watch->idLinks);
+         free(watch);
+      }
+   }
+   list_for_each_entry_safe(watch, next, &hgfsNotifyRemoved, idLinks) {
+      list_del(&watch->idLinks);
+      free(watch);
+   }
+   hgfsNotifyWatchCount = 0;
+   hgfsNotifyGeneration++;
+   hgfsNotifyState = HGFS_NOTIFY_SESSION_NONE;
+   hgfsNotifySessionId = HGFS_INVALID_SESSION_ID;
+   pthread_mutex_unlock(&hgfsNotifyLock);
+
+   if (hadWatches) {
+      /* Changes may have been missed, start over from the host. */
+      HgfsInvalidateAttrCacheChildren("/");
+      HgfsInvalidateAttrCache("/");
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyInit --
+ *
+ *    Initialize the notification state. Must run before the transport
+ *    is brought up since closing a channel resets it.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsNotifyInit(void)
+{
+   int i;
+
+   for (i = 0; i < HGFS_NOTIFY_BUCKETS; i++) {
+      INIT_LIST_HEAD(&hgfsNotifyById[i]);
+      INIT_LIST_HEAD(&hgfsNotifyByPath[i]);
+   }
+   INIT_LIST_HEAD(&hgfsNotifyRemoved);
+   hgfsNotifyWatchCount = 0;
+   hgfsNotifyGeneration = 1;
+   hgfsNotifyState = HGFS_NOTIFY_SESSION_NONE;
+   hgfsNotifySessionId = HGFS_INVALID_SESSION_ID;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNotifyExit --
+ *
+ *    Tear down the notification state. The channel must be closed by now
+ *    so that no more notifications arrive.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsNotifyExit(void)
+{
+   HgfsNotifyReset();
+}
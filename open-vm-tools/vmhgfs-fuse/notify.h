@@ -0,0 +1,38 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * notify.h --
+ *
+ * Directory change notifications for the vmhgfs FUSE client.
+ */
+
+#ifndef _VMHGFS_FUSE_NOTIFY_H_
+#define _VMHGFS_FUSE_NOTIFY_H_
+
+#include "vm_basic_types.h"
+
+void HgfsNotifyInit(void);
+void HgfsNotifyExit(void);
+void HgfsNotifyReset(void);
+void HgfsNotifyWatchDir(const char *path);
+Bool HgfsNotifyParentIsWatched(const char *path);
+void HgfsNotifyReceive(const char *packet,
+                       size_t packetSize);
+
+#endif // _VMHGFS_FUSE_NOTIFY_H_
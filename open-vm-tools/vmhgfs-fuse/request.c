@@ -33,6 +33,197 @@
 static HgfsHandle hgfsIdCounter;
 pthread_mutex_t hgfsIdLock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Freed requests are kept on a per thread free list, so that the common
+ * case of one request per FUSE operation needs neither malloc nor a
+ * shared lock. Requests are only one size: the packers size file names
+ * against HGFS_LARGE_PACKET_MAX, so every request must be able to hold
+ * a large packet.
+ */
+#define HGFS_REQ_POOL_THREAD_MAX 8
+
+typedef struct HgfsReqPool {
+   struct list_head freeList;   /* Cached requests, linked by list. */
+   struct list_head links;      /* On hgfsReqPools. */
+   HgfsReqPoolStats stats;      /* Only updated by the owning thread. */
+} HgfsReqPool;
+
+static pthread_key_t hgfsReqPoolKey;
+static pthread_once_t hgfsReqPoolOnce = PTHREAD_ONCE_INIT;
+static Bool hgfsReqPoolKeyValid;
+static pthread_mutex_t hgfsReqPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static LIST_HEAD(hgfsReqPools);
+static HgfsReqPoolStats hgfsReqPoolRetired;   /* Of exited threads. */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReqPoolAddStats --
+ *
+ *    Adds the counters of one pool to a total.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsReqPoolAddStats(HgfsReqPoolStats *total,          // IN/OUT
+                    const HgfsReqPoolStats *stats)    // IN
+{
+   total->allocs += stats->allocs;
+   total->hits += stats->hits;
+   total->misses += stats->misses;
+   total->frees += stats->frees;
+   total->cached += stats->cached;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReqPoolDestroy --
+ *
+ *    Thread exit destructor, frees the cached requests of the thread.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsReqPoolDestroy(void *data)  // IN: Pool of the exiting thread
+{
+   HgfsReqPool *pool = data;
+   struct list_head *cur, *next;
+
+   list_for_each_safe(cur, next, &pool->freeList) {
+      HgfsReq *req = list_entry(cur, HgfsReq, list);
+
+      list_del(&req->list);
+      pthread_cond_destroy(&req->queue);
+      free(req);
+   }
+   pool->stats.cached = 0;
+
+   pthread_mutex_lock(&hgfsReqPoolLock);
+   list_del(&pool->links);
+   HgfsReqPoolAddStats(&hgfsReqPoolRetired, &pool->stats);
+   pthread_mutex_unlock(&hgfsReqPoolLock);
+   free(pool);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReqPoolKeyInit --
+ *
+ *    Creates the thread specific key of the pools.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsReqPoolKeyInit(void)
+{
+   hgfsReqPoolKeyValid = pthread_key_create(&hgfsReqPoolKey,
+                                            HgfsReqPoolDestroy) == 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReqPoolGet --
+ *
+ *    Returns the pool of the calling thread, creating it if needed.
+ *
+ * Results:
+ *    The pool, NULL if it could not be created.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsReqPool *
+HgfsReqPoolGet(void)
+{
+   HgfsReqPool *pool;
+
+   pthread_once(&hgfsReqPoolOnce, HgfsReqPoolKeyInit);
+   if (!hgfsReqPoolKeyValid) {
+      return NULL;
+   }
+
+   pool = pthread_getspecific(hgfsReqPoolKey);
+   if (pool == NULL) {
+      pool = malloc(sizeof *pool);
+      if (pool == NULL) {
+         return NULL;
+      }
+      memset(pool, 0, sizeof *pool);
+      INIT_LIST_HEAD(&pool->freeList);
+      if (pthread_setspecific(hgfsReqPoolKey, pool) != 0) {
+         free(pool);
+         return NULL;
+      }
+      pthread_mutex_lock(&hgfsReqPoolLock);
+      list_add(&pool->links, &hgfsReqPools);
+      pthread_mutex_unlock(&hgfsReqPoolLock);
+   }
+   return pool;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsGetRequestPoolStats --
+ *
+ *    Sums the request pool counters of all threads.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsGetRequestPoolStats(HgfsReqPoolStats *stats)  // OUT
+{
+   struct list_head *cur;
+
+   pthread_mutex_lock(&hgfsReqPoolLock);
+   *stats = hgfsReqPoolRetired;
+   list_for_each(cur, &hgfsReqPools) {
+      HgfsReqPool *pool = list_entry(cur, HgfsReqPool, links);
+
+      HgfsReqPoolAddStats(stats, &pool->stats);
+   }
+   pthread_mutex_unlock(&hgfsReqPoolLock);
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -46,7 +237,8 @@ pthread_mutex_t hgfsIdLock = PTHREAD_MUTEX_INITIALIZER;
  *    initialized. Returns NULL on failure.
  *
  * Side effects:
- *    None
+ *    A newly allocated request is touched in full, so that its page
+ *    faults are taken once rather than on the first large reply.
  *
  *----------------------------------------------------------------------
  */
@@ -54,12 +246,29 @@ pthread_mutex_t hgfsIdLock = PTHREAD_MUTEX_INITIALIZER;
 HgfsReq *
 HgfsGetNewRequest(void)
 {
+   HgfsReqPool *pool = HgfsReqPoolGet();
    HgfsReq *req = NULL;
 
-   req = (HgfsReq*)malloc(sizeof(HgfsReq));
+   if (pool != NULL) {
+      pool->stats.allocs++;
+      if (!list_empty(&pool->freeList)) {
+         req = list_entry(pool->freeList.next, HgfsReq, list);
+         list_del(&req->list);
+         pool->stats.cached--;
+         pool->stats.hits++;
+      } else {
+         pool->stats.misses++;
+      }
+   }
+
    if (req == NULL) {
-      LOG(4, ("Can't allocate memory.\n"));
-      return NULL;
+      req = (HgfsReq*)malloc(sizeof(HgfsReq));
+      if (req == NULL) {
+         LOG(4, ("Can't allocate memory.\n"));
+         return NULL;
+      }
+      memset(req, 0, sizeof *req);
+      pthread_cond_init(&req->queue, NULL);
    }
    INIT_LIST_HEAD(&req->list);
    req->payloadSize = 0;
@@ -326,6 +535,67 @@ HgfsSendRequest(HgfsReq *req)       // IN/OUT: Outgoing request
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsSubmitRequest --
+ *
+ *    Send out an HGFS request via transport layer without waiting for the
+ *    reply, so that several requests can be in flight at once.
+ *
+ * Results:
+ *    Returns zero on success, negative number on error. On success the
+ *    reply must be collected with HgfsWaitForReply.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsSubmitRequest(HgfsReq *req)       // IN/OUT: Outgoing request
+{
+   int ret;
+
+   ASSERT(req);
+   ASSERT(req->payloadSize <= HGFS_LARGE_PACKET_MAX);
+
+   req->state = HGFS_REQ_STATE_UNSENT;
+
+   LOG(8, ("Submitting request id %d\n", req->id));
+   ret = HgfsTransportSubmitRequest(req);
+   LOG(8, ("Request submitted, return %d\n", ret));
+   return ret;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWaitForReply --
+ *
+ *    Wait for the reply of a request sent with HgfsSubmitRequest.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsWaitForReply(HgfsReq *req)       // IN/OUT: Submitted request
+{
+   ASSERT(req);
+
+   HgfsTransportWaitForReply(req);
+   LOG(8, ("Request id %d finished\n", req->id));
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -345,6 +615,24 @@ HgfsSendRequest(HgfsReq *req)       // IN/OUT: Outgoing request
 void
 HgfsFreeRequest(HgfsReq *req) // IN: Request to free
 {
+   HgfsReqPool *pool;
+
+   if (req == NULL) {
+      return;
+   }
+
+   pool = HgfsReqPoolGet();
+   if (pool != NULL) {
+      pool->stats.frees++;
+      if (pool->stats.cached < HGFS_REQ_POOL_THREAD_MAX) {
+         ASSERT(list_empty(&req->list));
+         list_add(&req->list, &pool->freeList);
+         pool->stats.cached++;
+         return;
+      }
+   }
+
+   pthread_cond_destroy(&req->queue);
    free(req);
 }
 
@@ -445,4 +733,5 @@ HgfsCompleteReq(HgfsReq *req,       // IN: Request
    if (!list_empty(&req->list)) {
       list_del_init(&req->list);
    }
+   pthread_cond_signal(&req->queue);
 }
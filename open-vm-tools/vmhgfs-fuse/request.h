@@ -30,6 +30,7 @@
 //#include "driver-config.h"
 
 #include <linux/list.h>
+#include <pthread.h>
 //#include "compat_sched.h"
 //#include "compat_spinlock.h"
 //#include "compat_wait.h"
@@ -90,9 +91,9 @@ typedef struct HgfsReq {
 
    /*
     * When clients wait for the reply to a request, they'll wait on this
-    * wait queue.
+    * condition, used with the transport pending requests lock.
     */
-   //wait_queue_head_t queue;
+   pthread_cond_t queue;
 
    /* Current state of the request. */
    HgfsState state;
@@ -110,8 +111,18 @@ typedef struct HgfsReq {
    char packet[HGFS_LARGE_PACKET_MAX + HGFS_CLIENT_CMD_LEN];
 } HgfsReq;
 
+/* Request pool counters, summed over all threads. */
+typedef struct HgfsReqPoolStats {
+   uint64 allocs;    /* HgfsGetNewRequest calls. */
+   uint64 hits;      /* Served from a thread free list. */
+   uint64 misses;    /* Needed a malloc. */
+   uint64 frees;     /* HgfsFreeRequest calls. */
+   uint64 cached;    /* Requests currently on free lists. */
+} HgfsReqPoolStats;
+
 /* Public functions (with respect to the entire module). */
 HgfsReq *HgfsGetNewRequest(void);
+void HgfsGetRequestPoolStats(HgfsReqPoolStats *stats);
 HgfsStatus HgfsPackHeader(HgfsReq *req, HgfsOp opUsed);
 HgfsStatus HgfsUnpackHeader(void *serverReply,
 			    size_t replySize,
@@ -129,6 +140,8 @@ void* HgfsGetReplyPayload(HgfsReq *req);
 size_t HgfsGetReplyHeaderSize(void);
 size_t HgfsGetRequestHeaderSize(void);
 int HgfsSendRequest(HgfsReq *req);
+int HgfsSubmitRequest(HgfsReq *req);
+void HgfsWaitForReply(HgfsReq *req);
 void HgfsFreeRequest(HgfsReq *req);
 HgfsStatus HgfsGetReplyStatus(HgfsReq *req);
 void HgfsCompleteReq(HgfsReq *req,
@@ -0,0 +1,275 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * stats.c --
+ *
+ * Performance counters of the vmhgfs FUSE client: per operation counts,
+ * errors and latency histograms, plus totals gathered from the cache and
+ * transport layers on demand.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "module.h"
+#include "cache.h"
+#include "stats.h"
+#include "vm_atomic.h"
+
+/*
+ * Latency bucket i counts operations which took less than 2^(i+1)
+ * microseconds, the last bucket takes everything slower.
+ */
+#define HGFS_STATS_HIST_BUCKETS 24
+
+#define HGFS_STATS_FORMAT_SIZE  8192
+
+typedef struct HgfsStatsOpCounters {
+   Atomic_uint64 count;
+   Atomic_uint64 errors;
+   Atomic_uint64 totalUs;
+   Atomic_uint64 maxUs;
+   Atomic_uint64 hist[HGFS_STATS_HIST_BUCKETS];
+} HgfsStatsOpCounters;
+
+#define DEFINE_HGFS_STATS_OP(a, b) b,
+
+static const char *gHgfsStatsOpNames[] = {
+   HGFS_STATS_OPS
+};
+
+#undef DEFINE_HGFS_STATS_OP
+
+static HgfsStatsOpCounters gHgfsStatsOps[HGFS_STATS_OP_MAX];
+static Atomic_uint64 gHgfsStatsBytesRead;
+static Atomic_uint64 gHgfsStatsBytesWritten;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsOpStart --
+ *
+ *    Marks the start of a FUSE operation.
+ *
+ * Results:
+ *    The start time in microseconds, to pass to HgfsStatsOpEnd.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+uint64
+HgfsStatsOpStart(void)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsOpEnd --
+ *
+ *    Accounts a finished FUSE operation.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsStatsOpEnd(HgfsStatsOp op,       // IN: Operation
+               uint64 startTime,     // IN: From HgfsStatsOpStart
+               int result)           // IN: Negative errno on failure
+{
+   HgfsStatsOpCounters *counters;
+   uint64 elapsed;
+   uint64 maxUs;
+   uint32 bucket = 0;
+
+   ASSERT(op < HGFS_STATS_OP_MAX);
+   counters = &gHgfsStatsOps[op];
+
+   elapsed = HgfsStatsOpStart() - startTime;
+   while (bucket < HGFS_STATS_HIST_BUCKETS - 1 && (elapsed >> (bucket + 1)) != 0) {
+      bucket++;
+   }
+
+   Atomic_Inc64(&counters->count);
+   if (result < 0) {
+      Atomic_Inc64(&counters->errors);
+   }
+   Atomic_Add64(&counters->totalUs, elapsed);
+   Atomic_Inc64(&counters->hist[bucket]);
+
+   maxUs = Atomic_Read64(&counters->maxUs);
+   while (elapsed > maxUs) {
+      uint64 old = Atomic_ReadIfEqualWrite64(&counters->maxUs, maxUs, elapsed);
+
+      if (old == maxUs) {
+         break;
+      }
+      maxUs = old;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsAddBytesRead --
+ * HgfsStatsAddBytesWritten --
+ *
+ *    Accounts file data moved by read and write.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsStatsAddBytesRead(uint64 bytes)     // IN
+{
+   Atomic_Add64(&gHgfsStatsBytesRead, bytes);
+}
+
+void
+HgfsStatsAddBytesWritten(uint64 bytes)  // IN
+{
+   Atomic_Add64(&gHgfsStatsBytesWritten, bytes);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsFormat --
+ *
+ *    Renders a snapshot of all counters as text, one name and value per
+ *    line, for the control file.
+ *
+ * Results:
+ *    Zero and a malloc'ed buffer the caller frees, or -ENOMEM.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsStatsFormat(char **buf,    // OUT: Text
+                size_t *len)   // OUT: Length of the text
+{
+   HgfsReqPoolStats poolStats;
+   uint64 cacheHits;
+   uint64 cacheMisses;
+   uint32 inFlight;
+   uint32 resets;
+   size_t size = HGFS_STATS_FORMAT_SIZE;
+   size_t used = 0;
+   char *out;
+   int op;
+
+#define HGFS_STATS_PRINT(...)                                              \
+   do {                                                                    \
+      int n = snprintf(out + used, size - used, __VA_ARGS__);              \
+      if (n > 0) {                                                         \
+         used = MIN(used + n, size - 1);                                   \
+      }                                                                    \
+   } while (0)
+
+   out = malloc(size);
+   if (out == NULL) {
+      return -ENOMEM;
+   }
+   out[0] = '\0';
+
+   for (op = 0; op < HGFS_STATS_OP_MAX; op++) {
+      HgfsStatsOpCounters *counters = &gHgfsStatsOps[op];
+      uint64 count = Atomic_Read64(&counters->count);
+      int bucket;
+
+      if (count == 0) {
+         continue;
+      }
+      HGFS_STATS_PRINT("op.%s count=%"FMT64"u errors=%"FMT64"u "
+                       "avg_us=%"FMT64"u max_us=%"FMT64"u\n",
+                       gHgfsStatsOpNames[op], count,
+                       Atomic_Read64(&counters->errors),
+                       Atomic_Read64(&counters->totalUs) / count,
+                       Atomic_Read64(&counters->maxUs));
+      HGFS_STATS_PRINT("op.%s latency_us", gHgfsStatsOpNames[op]);
+      for (bucket = 0; bucket < HGFS_STATS_HIST_BUCKETS; bucket++) {
+         uint64 hits = Atomic_Read64(&counters->hist[bucket]);
+
+         if (hits == 0) {
+            continue;
+         }
+         if (bucket == HGFS_STATS_HIST_BUCKETS - 1) {
+            HGFS_STATS_PRINT(" inf:%"FMT64"u", hits);
+         } else {
+            HGFS_STATS_PRINT(" %u:%"FMT64"u", 2U << bucket, hits);
+         }
+      }
+      HGFS_STATS_PRINT("\n");
+   }
+
+   HgfsGetAttrCacheStats(&cacheHits, &cacheMisses);
+   HGFS_STATS_PRINT("attr_cache.hits %"FMT64"u\n", cacheHits);
+   HGFS_STATS_PRINT("attr_cache.misses %"FMT64"u\n", cacheMisses);
+   HGFS_STATS_PRINT("attr_cache.hit_rate_pct %"FMT64"u\n",
+                    cacheHits + cacheMisses == 0 ? 0 :
+                    cacheHits * 100 / (cacheHits + cacheMisses));
+
+   HgfsTransportGetStats(&inFlight, &resets);
+   HGFS_STATS_PRINT("transport.requests_in_flight %u\n", inFlight);
+   HGFS_STATS_PRINT("transport.channel_resets %u\n", resets);
+
+   HgfsGetRequestPoolStats(&poolStats);
+   HGFS_STATS_PRINT("request_pool.allocs %"FMT64"u\n", poolStats.allocs);
+   HGFS_STATS_PRINT("request_pool.misses %"FMT64"u\n", poolStats.misses);
+
+   HGFS_STATS_PRINT("bytes_read %"FMT64"u\n",
+                    Atomic_Read64(&gHgfsStatsBytesRead));
+   HGFS_STATS_PRINT("bytes_written %"FMT64"u\n",
+                    Atomic_Read64(&gHgfsStatsBytesWritten));
+
+#undef HGFS_STATS_PRINT
+
+   *buf = out;
+   *len = used;
+   return 0;
+}
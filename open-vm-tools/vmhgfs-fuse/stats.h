@@ -0,0 +1,75 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * stats.h --
+ *
+ * Performance counters of the vmhgfs FUSE client. They are always
+ * collected and can be read through the control file enabled with the
+ * stats_file mount option.
+ */
+
+#ifndef _VMHGFS_FUSE_STATS_H_
+#define _VMHGFS_FUSE_STATS_H_
+
+#include "vm_basic_types.h"
+
+#define HGFS_STATS_OPS \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_GETATTR,  "getattr")  \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_ACCESS,   "access")   \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_READLINK, "readlink") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_READDIR,  "readdir")  \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_MKDIR,    "mkdir")    \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_UNLINK,   "unlink")   \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_RMDIR,    "rmdir")    \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_SYMLINK,  "symlink")  \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_RENAME,   "rename")   \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_CHMOD,    "chmod")    \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_CHOWN,    "chown")    \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_TRUNCATE, "truncate") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_UTIME,    "utime")    \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_OPEN,     "open")     \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_CREATE,   "create")   \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_READ,     "read")     \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_WRITE,    "write")    \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_STATFS,   "statfs")   \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_FLUSH,    "flush")    \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_RELEASE,  "release")  \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_FSYNC,    "fsync")
+
+#define DEFINE_HGFS_STATS_OP(a, b) a,
+
+typedef enum {
+   HGFS_STATS_OPS
+   HGFS_STATS_OP_MAX
+} HgfsStatsOp;
+
+#undef DEFINE_HGFS_STATS_OP
+
+/* Paths of the control directory and file, relative to the mount root. */
+#define HGFS_STATS_DIR_PATH   "/.vmhgfs"
+#define HGFS_STATS_FILE_NAME  "stats"
+#define HGFS_STATS_FILE_PATH  HGFS_STATS_DIR_PATH "/" HGFS_STATS_FILE_NAME
+
+uint64 HgfsStatsOpStart(void);
+void HgfsStatsOpEnd(HgfsStatsOp op, uint64 startTime, int result);
+void HgfsStatsAddBytesRead(uint64 bytes);
+void HgfsStatsAddBytesWritten(uint64 bytes);
+int HgfsStatsFormat(char **buf, size_t *len);
+
+#endif // _VMHGFS_FUSE_STATS_H_
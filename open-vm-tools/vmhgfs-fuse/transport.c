@@ -27,13 +27,19 @@
  * handles the asynchronous replies. A queue of pending replies is
  * maintained and is protected by a lock. The channel opens and close
  * is protected by a mutex.
+ *
+ * The backdoor processes one request at a time. The vsock channel allows
+ * many requests in flight, but no host implements its service yet, so it is
+ * only tried, before the backdoor, with the vsock mount option.
  */
 
 
 
 #include "bdhandler.h"
+#include "vsockhandler.h"
 #include "hgfsProto.h"
 #include "module.h"
+#include "notify.h"
 #include "request.h"
 #include "transport.h"
 #include "vm_assert.h"
@@ -45,10 +51,17 @@ static Bool gHgfsActiveChannelLockInited;
 static struct list_head gHgfsPendingRequests;        /* Pending requests queue. */
 static pthread_mutex_t gHgfsPendingRequestsLock;     /* Pending requests queue lock. */
 static Bool gHgfsPendingRequestsLockInited;
+static uint32 gHgfsChannelResets;                   /* Reset count, for stats. */
 
 
 #define HgfsRequestId(req) ((HgfsRequest *)req)->id
 
+/* Channels in the order they are tried. */
+static HgfsTransportChannel *(* const gHgfsChannelInit[])(void) = {
+   HgfsVsockChannelInit,
+   HgfsBdChannelInit,
+};
+
 static void HgfsTransportChannelClose(HgfsTransportChannel **channel);
 
 /*
@@ -74,19 +87,25 @@ static void HgfsTransportChannelClose(HgfsTransportChannel **channel);
 static int
 HgfsTransportChannelOpen(HgfsTransportChannel **channel) // IN: active channel
 {
-   int result = 0;
+   int i;
 
-   *channel = HgfsBdChannelInit();
-   if (NULL != *channel) {
-      HgfsChannelStatus status = (*channel)->ops.open(*channel);
-      if (status != HGFS_CHANNEL_CONNECTED) {
+   for (i = 0; i < ARRAYSIZE(gHgfsChannelInit); i++) {
+      if (gHgfsChannelInit[i] == HgfsVsockChannelInit && !gState->vsockChannel) {
+         continue;
+      }
+      *channel = gHgfsChannelInit[i]();
+      if (NULL != *channel) {
+         HgfsChannelStatus status = (*channel)->ops.open(*channel);
+         if (status == HGFS_CHANNEL_CONNECTED) {
+            LOG(8, ("Using the %s channel.\n", (*channel)->name));
+            return 0;
+         }
          HgfsTransportChannelClose(channel);
-         result = -ENOTCONN;
-         *channel = NULL;
       }
    }
 
-   return result;
+   *channel = NULL;
+   return -ENOTCONN;
 }
 
 
@@ -115,6 +134,9 @@ HgfsTransportChannelClose(HgfsTransportChannel **channel) // active channel
       closeChannel->ops.close(closeChannel);
       closeChannel->ops.exit(closeChannel);
       *channel = NULL;
+
+      /* The host side session, and any watches on it, went with it. */
+      HgfsNotifyReset();
    }
 }
 
@@ -143,6 +165,7 @@ HgfsTransportChannelReset(HgfsTransportChannel **channel) // IN: active channel
    Bool ret = FALSE;
    int openResult;
 
+   gHgfsChannelResets++;
    HgfsTransportChannelClose(channel);
    openResult = HgfsTransportChannelOpen(channel);
    if (openResult == 0) {
@@ -211,6 +234,40 @@ HgfsTransportDequeueRequest(HgfsReq *req)   // IN: Request to dequeue
  * Public function implementations.
  */
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportGetStats --
+ *
+ *     Returns the number of requests waiting for a reply and the number
+ *     of channel resets so far.
+ *
+ * Results:
+ *     None
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsTransportGetStats(uint32 *inFlight,   // OUT: Pending requests
+                      uint32 *resets)     // OUT: Channel resets
+{
+   struct list_head *cur;
+
+   *inFlight = 0;
+   if (gHgfsPendingRequestsLockInited) {
+      pthread_mutex_lock(&gHgfsPendingRequestsLock);
+      list_for_each(cur, &gHgfsPendingRequests) {
+         (*inFlight)++;
+      }
+      pthread_mutex_unlock(&gHgfsPendingRequestsLock);
+   }
+   *resets = gHgfsChannelResets;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -239,8 +296,26 @@ HgfsTransportProcessPacket(char *receivedPacket,    //IN: received packet
    /* Got the reply. */
 
    ASSERT(receivedPacket != NULL && receivedSize > 0);
-   id = HgfsRequestId(receivedPacket);
+   if (receivedSize >= sizeof (HgfsHeader) &&
+       ((HgfsHeader *)receivedPacket)->dummy == HGFS_OP_NEW_HEADER) {
+      id = ((HgfsHeader *)receivedPacket)->requestId;
+   } else if (receivedSize >= sizeof (HgfsReply)) {
+      id = HgfsRequestId(receivedPacket);
+   } else {
+      LOG(4, ("Runt reply, dropping.\n"));
+      return;
+   }
    LOG(8, ("Entered.\n"));
+
+   /* Change notifications are requests from the server, not replies. */
+   if (receivedSize >= sizeof (HgfsHeader) &&
+       ((HgfsHeader *)receivedPacket)->dummy == HGFS_OP_NEW_HEADER &&
+       ((HgfsHeader *)receivedPacket)->op == HGFS_OP_NOTIFY_V4 &&
+       (((HgfsHeader *)receivedPacket)->flags & HGFS_PACKET_FLAG_REQUEST) != 0) {
+      HgfsNotifyReceive(receivedPacket, receivedSize);
+      return;
+   }
+
    LOG(6, ("Req id: %d\n", id));
    /*
     * Search through gHgfsPendingRequests queue for the matching id and wake up
@@ -272,7 +347,8 @@ HgfsTransportProcessPacket(char *receivedPacket,    //IN: received packet
  * HgfsTransportBeforeExitingRecvThread --
  *
  *     The cleanup work to do before the recv thread exits, including
- *     completing pending requests with error.
+ *     completing the submitted requests with a transport error. Requests
+ *     that are not submitted yet are left for their sender to fail.
  *
  * Results:
  *     None
@@ -292,25 +368,82 @@ HgfsTransportBeforeExitingRecvThread(void)
    pthread_mutex_lock(&gHgfsPendingRequestsLock);
    list_for_each_safe(cur, next, &gHgfsPendingRequests) {
       HgfsReq *req;
-      HgfsReply reply;
 
       req = list_entry(cur, HgfsReq, list);
+      if (req->state != HGFS_REQ_STATE_SUBMITTED) {
+         continue;
+      }
       LOG(6, ("Injecting error reply to req id: %d\n", req->id));
-      HgfsCompleteReq(req, (char *)&reply, sizeof reply);
+      if (gState->sessionEnabled) {
+         HgfsHeader header;
+
+         memset(&header, 0, sizeof header);
+         header.version = gState->headerVersion;
+         header.dummy = HGFS_OP_NEW_HEADER;
+         header.packetSize = sizeof header;
+         header.headerSize = sizeof header;
+         header.requestId = req->id;
+         header.status = HGFS_STATUS_TRANSPORT_ERROR;
+         header.sessionId = gState->sessionId;
+         HgfsCompleteReq(req, (char *)&header, sizeof header);
+      } else {
+         HgfsReply reply;
+
+         reply.id = req->id;
+         reply.status = HGFS_STATUS_TRANSPORT_ERROR;
+         HgfsCompleteReq(req, (char *)&reply, sizeof reply);
+      }
    }
    pthread_mutex_unlock(&gHgfsPendingRequestsLock);
+
+   /* Notifications may be lost until the channel is reopened. */
+   HgfsNotifyReset();
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsTransportSendRequest --
+ * HgfsTransportCanNotify --
  *
- *     Sends the request via channel communication.
+ *     Tells whether the current channel can deliver change notifications,
+ *     which the server sends unsolicited.
  *
  * Results:
- *     Zero on success, non-zero error on failure.
+ *     TRUE if it can, FALSE otherwise or if there is no channel.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+Bool
+HgfsTransportCanNotify(void)
+{
+   Bool canNotify;
+
+   pthread_mutex_lock(&gHgfsActiveChannelLock);
+   canNotify = gHgfsActiveChannel != NULL && gHgfsActiveChannel->notify;
+   pthread_mutex_unlock(&gHgfsActiveChannelLock);
+
+   return canNotify;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportSubmitRequest --
+ *
+ *     Sends the request via channel communication without waiting for
+ *     the reply. The channel lock is only held while sending, so requests
+ *     on an asynchronous channel are in flight concurrently. Synchronous
+ *     channels complete the request before returning.
+ *
+ * Results:
+ *     Zero on success, non-zero error on failure. On success the caller
+ *     must call HgfsTransportWaitForReply before using or freeing req.
  *
  * Side effects:
  *     None
@@ -319,7 +452,7 @@ HgfsTransportBeforeExitingRecvThread(void)
  */
 
 int
-HgfsTransportSendRequest(HgfsReq *req)   // IN: Request to send
+HgfsTransportSubmitRequest(HgfsReq *req)   // IN: Request to send
 {
    int ret;
    ASSERT(req);
@@ -364,6 +497,65 @@ exit:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportWaitForReply --
+ *
+ *     Waits until a submitted request has been completed, by the channel
+ *     itself or by the receive thread.
+ *
+ * Results:
+ *     None
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsTransportWaitForReply(HgfsReq *req)   // IN: Request sent
+{
+   pthread_mutex_lock(&gHgfsPendingRequestsLock);
+   while (req->state == HGFS_REQ_STATE_SUBMITTED) {
+      pthread_cond_wait(&req->queue, &gHgfsPendingRequestsLock);
+   }
+   pthread_mutex_unlock(&gHgfsPendingRequestsLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportSendRequest --
+ *
+ *     Sends the request via channel communication, and waits for the
+ *     reply.
+ *
+ * Results:
+ *     Zero on success, non-zero error on failure.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsTransportSendRequest(HgfsReq *req)   // IN: Request to send
+{
+   int ret;
+
+   ret = HgfsTransportSubmitRequest(req);
+   if (ret == 0) {
+      HgfsTransportWaitForReply(req);
+   }
+
+   return ret;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
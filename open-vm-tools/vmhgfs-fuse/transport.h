@@ -49,6 +49,7 @@ typedef struct HgfsTransportChannel {
    HgfsTransportChannelOps ops;    /* Channel ops. */
    HgfsChannelStatus status;       /* Connection status. */
    void *priv;                     /* Channel private data. */
+   Bool notify;                    /* Receives server initiated packets. */
    pthread_mutex_t connLock;       /* Protect _this_ struct. */
 } HgfsTransportChannel;
 
@@ -56,8 +57,12 @@ typedef struct HgfsTransportChannel {
 int HgfsTransportInit(void);
 void HgfsTransportExit(void);
 int HgfsTransportSendRequest(HgfsReq *req);
+int HgfsTransportSubmitRequest(HgfsReq *req);
+void HgfsTransportWaitForReply(HgfsReq *req);
 void HgfsTransportProcessPacket(char *receivedPacket,
                                 size_t receivedSize);
 void HgfsTransportBeforeExitingRecvThread(void);
+void HgfsTransportGetStats(uint32 *inFlight, uint32 *resets);
+Bool HgfsTransportCanNotify(void);
 
 #endif // _HGFS_DRIVER_TRANSPORT_H_
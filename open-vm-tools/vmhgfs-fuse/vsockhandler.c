@@ -0,0 +1,444 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * vsockhandler.c --
+ *
+ * VSock stream channel. Unlike the backdoor, sends do not wait for the
+ * reply: any number of requests may be outstanding at once. A receive
+ * thread reads the replies off the socket and matches them with the
+ * pending requests by request id.
+ */
+
+#include "vsockhandler.h"
+#include "hgfsProto.h"
+#include "module.h"
+#include "request.h"
+#include "transport.h"
+#include "vm_assert.h"
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include "vmci_defs.h"
+#include "vmci_sockets.h"
+#endif
+
+typedef struct HgfsVsockChannelData {
+   int fd;                   /* Connected stream socket. */
+   pthread_t recvThread;     /* Reads and dispatches the replies. */
+   Bool recvThreadStarted;
+} HgfsVsockChannelData;
+
+static HgfsTransportChannel vsockChannel;
+static HgfsVsockChannelData vsockChannelData = { -1 };
+
+
+#if defined(__linux__)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVsockSendAll --
+ *
+ *      Write the whole buffer to the socket.
+ *
+ * Results:
+ *      0 on success, negative error on failure.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsVsockSendAll(int fd,            // IN: socket
+                 const char *buf,   // IN: data to send
+                 size_t len)        // IN: data size
+{
+   while (len > 0) {
+      ssize_t sent = send(fd, buf, len, MSG_NOSIGNAL);
+
+      if (sent < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return -errno;
+      }
+      buf += sent;
+      len -= sent;
+   }
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVsockRecvAll --
+ *
+ *      Read exactly len bytes from the socket.
+ *
+ * Results:
+ *      0 on success, negative error on failure or end of stream.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsVsockRecvAll(int fd,      // IN: socket
+                 char *buf,   // OUT: received data
+                 size_t len)  // IN: data size
+{
+   while (len > 0) {
+      ssize_t received = recv(fd, buf, len, 0);
+
+      if (received == 0) {
+         return -ECONNRESET;
+      }
+      if (received < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return -errno;
+      }
+      buf += received;
+      len -= received;
+   }
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVsockChannelRecvThread --
+ *
+ *      Receive loop, hands each reply packet to the transport. When the
+ *      stream fails the channel is marked as not connected, so the next
+ *      send reopens it, and the requests still waiting are failed.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HgfsVsockChannelRecvThread(void *arg)   // IN: channel
+{
+   HgfsTransportChannel *channel = arg;
+   HgfsVsockChannelData *data = channel->priv;
+   char *packet;
+   int ret = 0;
+
+   packet = malloc(HGFS_LARGE_PACKET_MAX);
+   if (packet == NULL) {
+      ret = -ENOMEM;
+   }
+
+   while (ret == 0) {
+      uint32 packetSize;
+
+      ret = HgfsVsockRecvAll(data->fd, (char *)&packetSize, sizeof packetSize);
+      if (ret != 0) {
+         break;
+      }
+      if (packetSize == 0 || packetSize > HGFS_LARGE_PACKET_MAX) {
+         LOG(4, ("Bad packet size %u, dropping the connection.\n", packetSize));
+         ret = -EPROTO;
+         break;
+      }
+      ret = HgfsVsockRecvAll(data->fd, packet, packetSize);
+      if (ret == 0) {
+         HgfsTransportProcessPacket(packet, packetSize);
+      }
+   }
+   free(packet);
+
+   LOG(8, ("VSock receive thread exiting, error %d.\n", ret));
+
+   pthread_mutex_lock(&channel->connLock);
+   if (channel->status == HGFS_CHANNEL_CONNECTED) {
+      channel->status = HGFS_CHANNEL_NOTCONNECTED;
+   }
+   pthread_mutex_unlock(&channel->connLock);
+
+   HgfsTransportBeforeExitingRecvThread();
+   return NULL;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVsockChannelOpen --
+ *
+ *      Connect to the host HGFS vsock service and start the receive thread.
+ *
+ * Results:
+ *      Existing or updated channel status, HGFS_CHANNEL_CONNECTED on success.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsChannelStatus
+HgfsVsockChannelOpen(HgfsTransportChannel *channel) // IN: Channel
+{
+#if defined(__linux__)
+   HgfsVsockChannelData *data = channel->priv;
+   struct sockaddr_vm addr;
+   int vsockDev = -1;
+   int family;
+   int fd;
+
+   pthread_mutex_lock(&channel->connLock);
+   if (channel->status != HGFS_CHANNEL_NOTCONNECTED) {
+      LOG(8, ("VSock status %d.\n", channel->status));
+      goto exit;
+   }
+
+   /* A failed connection is closed by the transport before reopening. */
+   ASSERT(!data->recvThreadStarted && data->fd < 0);
+
+   family = VMCISock_GetAFValueFd(&vsockDev);
+   if (family == -1) {
+      LOG(8, ("VSock address family not available.\n"));
+      goto exit;
+   }
+
+   fd = socket(family, SOCK_STREAM, 0);
+   if (fd < 0) {
+      LOG(8, ("VSock socket failed, error %d.\n", errno));
+      goto release;
+   }
+
+   memset(&addr, 0, sizeof addr);
+   addr.svm_family = family;
+   addr.svm_cid = VMCI_HOST_CONTEXT_ID;
+   addr.svm_port = HGFS_VSOCK_PORT;
+   if (connect(fd, (struct sockaddr *)&addr, sizeof addr) != 0) {
+      LOG(8, ("VSock cannot connect, error %d.\n", errno));
+      close(fd);
+      goto release;
+   }
+
+   data->fd = fd;
+   channel->status = HGFS_CHANNEL_CONNECTED;
+   if (pthread_create(&data->recvThread, NULL,
+                      HgfsVsockChannelRecvThread, channel) != 0) {
+      LOG(4, ("VSock receive thread create failed.\n"));
+      channel->status = HGFS_CHANNEL_NOTCONNECTED;
+      close(fd);
+      data->fd = -1;
+      goto release;
+   }
+   data->recvThreadStarted = TRUE;
+   LOG(8, ("VSock opened and connected.\n"));
+
+release:
+   VMCISock_ReleaseAFValueFd(vsockDev);
+exit:
+   pthread_mutex_unlock(&channel->connLock);
+#endif
+   return channel->status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVsockChannelClose --
+ *
+ *      Close the connection in an idempotent way and wait for the receive
+ *      thread, which fails any requests still pending.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsVsockChannelClose(HgfsTransportChannel *channel) // IN: Channel
+{
+   HgfsVsockChannelData *data = channel->priv;
+
+   pthread_mutex_lock(&channel->connLock);
+   if (channel->status == HGFS_CHANNEL_CONNECTED) {
+      channel->status = HGFS_CHANNEL_NOTCONNECTED;
+   }
+#if defined(__linux__)
+   if (data->fd >= 0) {
+      shutdown(data->fd, SHUT_RDWR);
+   }
+#endif
+   pthread_mutex_unlock(&channel->connLock);
+
+   /* The receive thread takes connLock on its way out. */
+   if (data->recvThreadStarted) {
+      pthread_join(data->recvThread, NULL);
+      data->recvThreadStarted = FALSE;
+   }
+   if (data->fd >= 0) {
+      close(data->fd);
+      data->fd = -1;
+   }
+   LOG(8, ("VSock closed.\n"));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsVsockChannelSend --
+ *
+ *     Send a request via vsock. The reply is delivered by the receive
+ *     thread, the request is left in the submitted state.
+ *
+ * Results:
+ *     0 on success, negative error on failure.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsVsockChannelSend(HgfsTransportChannel *channel, // IN: Channel
+                     HgfsReq *req)                  // IN: request to send
+{
+   int ret = -ENOTCONN;
+#if defined(__linux__)
+   HgfsVsockChannelData *data = channel->priv;
+   uint32 packetSize;
+
+   ASSERT(req);
+   ASSERT(req->state == HGFS_REQ_STATE_UNSENT);
+   ASSERT(req->payloadSize <= HGFS_LARGE_PACKET_MAX);
+
+   /* Serializes the writes of whole packets on the stream. */
+   pthread_mutex_lock(&channel->connLock);
+
+   if (channel->status != HGFS_CHANNEL_CONNECTED) {
+      LOG(6, ("VSock not connected.\n"));
+      goto exit;
+   }
+
+   /* The reply may arrive before the send returns. */
+   req->state = HGFS_REQ_STATE_SUBMITTED;
+
+   packetSize = (uint32)req->payloadSize;
+   ret = HgfsVsockSendAll(data->fd, (char *)&packetSize, sizeof packetSize);
+   if (ret == 0) {
+      ret = HgfsVsockSendAll(data->fd, HGFS_REQ_PAYLOAD(req), req->payloadSize);
+   }
+
+   if (ret != 0) {
+      LOG(4, ("VSock send failed, error %d.\n", ret));
+      /* The stream is out of sync now, so stop using the connection. */
+      channel->status = HGFS_CHANNEL_NOTCONNECTED;
+      shutdown(data->fd, SHUT_RDWR);
+      req->state = HGFS_REQ_STATE_UNSENT;
+      ret = -EIO;
+   }
+
+exit:
+   pthread_mutex_unlock(&channel->connLock);
+#endif
+   return ret;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsVsockChannelExit --
+ *
+ *     Tear down the channel.
+ *
+ * Results:
+ *     None
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsVsockChannelExit(HgfsTransportChannel *channel)  // IN
+{
+   HgfsVsockChannelClose(channel);
+
+   pthread_mutex_lock(&channel->connLock);
+   channel->status = HGFS_CHANNEL_UNINITIALIZED;
+   pthread_mutex_unlock(&channel->connLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsVsockChannelInit --
+ *
+ *     Initialize vsock channel.
+ *
+ * Results:
+ *     Pointer to the vsock channel, NULL where vsock is not supported.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+HgfsTransportChannel*
+HgfsVsockChannelInit(void)
+{
+#if defined(__linux__)
+   vsockChannel.name = "vsock";
+   vsockChannel.ops.open = HgfsVsockChannelOpen;
+   vsockChannel.ops.close = HgfsVsockChannelClose;
+   vsockChannel.ops.send = HgfsVsockChannelSend;
+   vsockChannel.ops.recv = NULL;
+   vsockChannel.ops.exit = HgfsVsockChannelExit;
+   vsockChannelData.fd = -1;
+   vsockChannelData.recvThreadStarted = FALSE;
+   vsockChannel.priv = &vsockChannelData;
+   vsockChannel.notify = TRUE;
+   pthread_mutex_init(&vsockChannel.connLock, NULL);
+   vsockChannel.status = HGFS_CHANNEL_NOTCONNECTED;
+   return &vsockChannel;
+#else
+   return NULL;
+#endif
+}
@@ -0,0 +1,41 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * vsockhandler.h --
+ *
+ * VSock channel implementation.
+ */
+
+#ifndef _HGFS_DRIVER_VSOCKHANDLER_H_
+#define _HGFS_DRIVER_VSOCKHANDLER_H_
+
+#include "transport.h"
+
+/*
+ * Host port of the HGFS vsock stream service. Each packet on the stream is
+ * preceded by its size as a 32-bit value in host byte order.
+ *
+ * This framing is not a published host interface; the channel is only used
+ * with the vsock mount option.
+ */
+#define HGFS_VSOCK_PORT 4847
+
+HgfsTransportChannel *HgfsVsockChannelInit(void);
+
+#endif // _HGFS_DRIVER_VSOCKHANDLER_H_
@@ -35,6 +35,12 @@
  *      Aug 24 18:48:10: vcpu-0| Guest: >Mi4K
  *      Aug 24 18:48:10: vcpu-0| Guest: >Logfile Ends
  *
+ *      The "encz" mode writes version 2 transfers: the file is gzip
+ *      compressed when zlib is available (the start mark then ends in
+ *      "gzip" rather than "raw"), the lines are as long as a log RPC
+ *      allows, and all of them go through a single RPC channel. The
+ *      decoder writes compressed transfers out as .gz files.
+ *
  */
 
 #include <stdio.h>
@@ -52,6 +58,11 @@
 #include "base64.h"
 #include "str.h"
 #include "strutil.h"
+#include "util.h"
+#include "vmware/tools/guestrpc.h"
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include "xferlogs_version.h"
 #include "vm_version.h"
@@ -69,6 +80,14 @@ VM_EMBED_VERSION(XFERLOGS_VERSION_STRING);
 
 #define BUF_BASE64_SIZE        57
 #define BUF_OUT_SIZE           256
+
+/*
+ * Version 2 lines carry as much as fits in a log RPC: the base64 of
+ * BUF_STREAM_SIZE bytes plus the '>' mark is at most RPCVMX_MAX_LOG_LEN.
+ */
+#define BUF_STREAM_SIZE        (((RPCVMX_MAX_LOG_LEN - 1) / 4) * 3)
+#define BUF_STREAM_READ_SIZE   (64 * 1024)
+#define BUF_LINE_SIZE          (RPCVMX_MAX_LOG_LEN + BUF_OUT_SIZE)
 #define LOG_GUEST_MARK         "Guest: >"
 #define LOG_START_MARK         ">Logfile Begins "
 #define LOG_END_MARK           ">Logfile Ends "
@@ -79,6 +98,15 @@ typedef enum {
 } extractMode;
 
 #define LOG_VERSION            1
+#define LOG_VERSION_STREAM     2
+#define LOG_ENCODING_GZIP      "gzip"
+#define LOG_ENCODING_RAW       "raw"
+
+#ifdef HAVE_ZLIB
+#define LOG_STREAM_ENCODING    LOG_ENCODING_GZIP
+#else
+#define LOG_STREAM_ENCODING    LOG_ENCODING_RAW
+#endif
 
 
 /*
@@ -134,6 +162,198 @@ exit:
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * xmitLogLine --
+ *
+ *       Sends one line to the vmx log over the given channel.
+ *
+ * Results:
+ *       TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *       Output is added to the vmx log file.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static Bool
+xmitLogLine(RpcChannel *chan,   // IN
+            const char *line)   // IN: "log ..." request
+{
+   char *reply = NULL;
+   size_t replyLen;
+   Bool ok;
+
+   ok = RpcChannel_Send(chan, line, strlen(line), &reply, &replyLen);
+   if (!ok) {
+      Warning("Failed to send log line: %s\n", reply ? reply : "NULL");
+   }
+   RpcChannel_Free(reply);
+   return ok;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * xmitChunk --
+ *
+ *       Base64 encodes a chunk of the transfer and sends it as one line.
+ *
+ * Results:
+ *       TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *       Output is added to the vmx log file.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static Bool
+xmitChunk(RpcChannel *chan,    // IN
+          const uint8 *data,   // IN
+          size_t len)          // IN
+{
+   char line[sizeof "log >" + RPCVMX_MAX_LOG_LEN] = "log >";
+   size_t prefixLen = sizeof "log >" - 1;
+
+   ASSERT(len <= BUF_STREAM_SIZE);
+   if (!Base64_Encode(data, len, line + prefixLen, sizeof line - prefixLen,
+                      NULL)) {
+      Warning("Error in Base64_Encode\n");
+      return FALSE;
+   }
+   return xmitLogLine(chan, line);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * xmitFileStream --
+ *
+ *       Transfers a file to the vmx logs like xmitFile, but gzip compressed
+ *       if zlib is available, in the longest lines a log RPC takes, and over
+ *       one RPC channel kept open for the whole transfer instead of one per
+ *       line.
+ *
+ * Results:
+ *       None.
+ *
+ * Side effects:
+ *       The program exits if the file or the RPC channel can't be opened.
+ *       Output is added to the vmx log file.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+xmitFileStream(char *filename) //IN : file to be transmitted.
+{
+   FILE *fp;
+   RpcChannel *chan;
+   uint8 *readBuf;
+   uint8 chunk[BUF_STREAM_SIZE];
+   size_t readLen;
+   char *line;
+   Bool ok = TRUE;
+#ifdef HAVE_ZLIB
+   z_stream zs;
+   int flush;
+   int zret;
+#else
+   size_t chunkLen = 0;
+#endif
+
+   if (!(fp = fopen(filename, "rb"))) {
+      Warning("Unable to open file %s with errno %d\n", filename, errno);
+      exit(-1);
+   }
+
+   chan = RpcChannel_New();
+   if (chan == NULL || !RpcChannel_Start(chan)) {
+      Warning("Unable to open the RPC channel\n");
+      exit(-1);
+   }
+
+   readBuf = Util_SafeMalloc(BUF_STREAM_READ_SIZE);
+
+#ifdef HAVE_ZLIB
+   memset(&zs, 0, sizeof zs);
+   /* 16 + MAX_WBITS makes a gzip stream, which the host side can gunzip. */
+   if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS,
+                    8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      Warning("Unable to initialize compression\n");
+      exit(-1);
+   }
+#endif
+
+   //XXX the format below is hardcoded and used by extractFile
+   line = Str_Asprintf(NULL, "log %s: %s: ver - %d %s", LOG_START_MARK,
+                       filename, LOG_VERSION_STREAM, LOG_STREAM_ENCODING);
+   ok = line != NULL && xmitLogLine(chan, line);
+   free(line);
+
+#ifdef HAVE_ZLIB
+   zs.next_out = chunk;
+   zs.avail_out = sizeof chunk;
+   do {
+      readLen = fread(readBuf, 1, BUF_STREAM_READ_SIZE, fp);
+      flush = readLen < BUF_STREAM_READ_SIZE ? Z_FINISH : Z_NO_FLUSH;
+      zs.next_in = readBuf;
+      zs.avail_in = readLen;
+
+      do {
+         zret = deflate(&zs, flush);
+         if (zret == Z_STREAM_ERROR) {
+            Warning("Error in compression\n");
+            ok = FALSE;
+            break;
+         }
+         if (zs.avail_out == 0 || zret == Z_STREAM_END) {
+            ok = ok && xmitChunk(chan, chunk, sizeof chunk - zs.avail_out);
+            zs.next_out = chunk;
+            zs.avail_out = sizeof chunk;
+         }
+      } while (ok && (zs.avail_in != 0 ||
+                      (flush == Z_FINISH && zret != Z_STREAM_END)));
+   } while (ok && flush != Z_FINISH);
+   deflateEnd(&zs);
+#else
+   while (ok && (readLen = fread(readBuf, 1, BUF_STREAM_READ_SIZE, fp)) > 0) {
+      size_t off = 0;
+
+      while (ok && off < readLen) {
+         size_t n = MIN(sizeof chunk - chunkLen, readLen - off);
+
+         memcpy(chunk + chunkLen, readBuf + off, n);
+         chunkLen += n;
+         off += n;
+         if (chunkLen == sizeof chunk) {
+            ok = xmitChunk(chan, chunk, chunkLen);
+            chunkLen = 0;
+         }
+      }
+   }
+   if (ok && chunkLen > 0) {
+      ok = xmitChunk(chan, chunk, chunkLen);
+   }
+#endif
+
+   if (!ok) {
+      Warning("Transfer of %s is incomplete\n", filename);
+   }
+   xmitLogLine(chan, "log " LOG_END_MARK);
+
+   free(readBuf);
+   RpcChannel_Stop(chan);
+   RpcChannel_Destroy(chan);
+   fclose(fp);
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -157,8 +377,8 @@ extractFile(char *filename) //IN: vmx log filename e.g. vmware.log
 {
    FILE *fp;
    FILE *outfp = NULL;
-   char buf[BUF_OUT_SIZE];
-   uint8 base64Out[BUF_OUT_SIZE];
+   char buf[BUF_LINE_SIZE];
+   uint8 base64Out[BUF_LINE_SIZE];
    size_t lenOut;
    char fname[256];
    char *ptrStr, *logInpFilename, *ver;
@@ -231,9 +451,16 @@ extractFile(char *filename) //IN: vmx log filename e.g. vmware.log
             if (!ver) {
                Warning("No version information detected\n");
             } else {
+               char *encoding;
+
                ver = ver + sizeof "ver - " - 1;
-               version = strtol(ver, NULL, 0);
-               if (version != LOG_VERSION) {
+               version = strtol(ver, &encoding, 0);
+               if (version == LOG_VERSION_STREAM &&
+                   strstr(encoding, LOG_ENCODING_GZIP) != NULL) {
+                  /* Leave decompression to the reader of the file. */
+                  Str_Strcat(fname, ".gz", sizeof fname);
+               }
+               if (version != LOG_VERSION && version != LOG_VERSION_STREAM) {
                   Warning("input version %d doesnt match the\
                           version of this binary %d", version, LOG_VERSION);
                } else {
@@ -253,7 +480,7 @@ extractFile(char *filename) //IN: vmx log filename e.g. vmware.log
             if (outfp) {
                ptrStr = strstr(buf, LOG_GUEST_MARK);
                ptrStr += sizeof LOG_GUEST_MARK - 1;
-               if (Base64_Decode(ptrStr, base64Out, BUF_OUT_SIZE, &lenOut)) {
+               if (Base64_Decode(ptrStr, base64Out, sizeof base64Out, &lenOut)) {
                   if (fwrite(base64Out, 1, lenOut, outfp) != lenOut) {
                      Warning("Error writing output\n");
                   }
@@ -272,7 +499,7 @@ static void
 usage(void)
 {
    Warning("xferlogs <options> <filename>\n");
-   Warning("options - enc/dec\n");
+   Warning("options - enc/encz/dec\n");
 }
 
 
@@ -286,7 +513,9 @@ main(int argc,
       return -1;
    }
 
-   if (!strncmp(argv[1], "enc", 3)) {
+   if (!strcmp(argv[1], "encz")) {
+      xmitFileStream(argv[2]);
+   } else if (!strncmp(argv[1], "enc", 3)) {
       xmitFile(argv[2]);
    } else if(!strncmp(argv[1], "dec", 3)) {
       extractFile(argv[2]);